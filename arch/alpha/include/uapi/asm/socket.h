@@ -115,4 +115,11 @@
 #define SO_TXTIME		61
 #define SCM_TXTIME		SO_TXTIME
 
+#define SO_DEVMEM_BIND		62
+#define SO_DEVMEM_LINEAR	63
+#define SCM_DEVMEM_LINEAR	SO_DEVMEM_LINEAR
+#define SO_DEVMEM_DMABUF	64
+#define SCM_DEVMEM_DMABUF	SO_DEVMEM_DMABUF
+#define SO_DEVMEM_DONTNEED	65
+
 #endif /* _UAPI_ASM_SOCKET_H */
@@ -19,8 +19,9 @@
  */
 
 #include <crypto/algapi.h>
-#include <crypto/chacha20.h>
+#include <crypto/internal/chacha20.h>
 #include <crypto/internal/skcipher.h>
+#include <linux/jump_label.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 
@@ -31,6 +32,8 @@
 asmlinkage void chacha20_block_xor_neon(u32 *state, u8 *dst, const u8 *src);
 asmlinkage void chacha20_4block_xor_neon(u32 *state, u8 *dst, const u8 *src);
 
+static __ro_after_init DEFINE_STATIC_KEY_FALSE(have_neon);
+
 static void chacha20_doneon(u32 *state, u8 *dst, const u8 *src,
 			    unsigned int bytes)
 {
@@ -65,6 +68,17 @@ static void chacha20_doneon(u32 *state, u8 *dst, const u8 *src,
 	kernel_neon_end();
 }
 
+void chacha20_crypt_arch(u32 *state, u8 *dst, const u8 *src,
+			 unsigned int bytes)
+{
+	if (!static_branch_likely(&have_neon) ||
+	    bytes <= CHACHA20_BLOCK_SIZE || !may_use_simd())
+		return chacha20_crypt_generic(state, dst, src, bytes);
+
+	chacha20_doneon(state, dst, src, bytes);
+}
+EXPORT_SYMBOL(chacha20_crypt_arch);
+
 static int chacha20_neon(struct skcipher_request *req)
 {
 	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
@@ -114,15 +128,22 @@ static struct skcipher_alg alg = {
 
 static int __init chacha20_simd_mod_init(void)
 {
+	/*
+	 * Stay loaded without NEON, the library interface falls back to
+	 * the generic code then.
+	 */
 	if (!(elf_hwcap & HWCAP_ASIMD))
-		return -ENODEV;
+		return 0;
+
+	static_branch_enable(&have_neon);
 
 	return crypto_register_skcipher(&alg);
 }
 
 static void __exit chacha20_simd_mod_fini(void)
 {
-	crypto_unregister_skcipher(&alg);
+	if (static_branch_likely(&have_neon))
+		crypto_unregister_skcipher(&alg);
 }
 
 module_init(chacha20_simd_mod_init);
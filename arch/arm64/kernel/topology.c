@@ -230,6 +230,20 @@ const struct cpumask *cpu_coregroup_mask(int cpu)
 	return core_mask;
 }
 
+const struct cpumask *cpu_clustergroup_mask(int cpu)
+{
+	/*
+	 * Without a cluster, or with one that does not nest within the MC
+	 * level, let the CLS level degenerate into the SMT one.
+	 */
+	if (cpu_topology[cpu].cluster_id == -1 ||
+	    cpumask_subset(cpu_coregroup_mask(cpu),
+			   &cpu_topology[cpu].cluster_sibling))
+		return topology_sibling_cpumask(cpu);
+
+	return &cpu_topology[cpu].cluster_sibling;
+}
+
 static void update_siblings_masks(unsigned int cpuid)
 {
 	struct cpu_topology *cpu_topo, *cpuid_topo = &cpu_topology[cpuid];
@@ -244,6 +258,12 @@ static void update_siblings_masks(unsigned int cpuid)
 			cpumask_set_cpu(cpuid, &cpu_topo->llc_sibling);
 		}
 
+		if (cpuid_topo->cluster_id != -1 &&
+		    cpuid_topo->cluster_id == cpu_topo->cluster_id) {
+			cpumask_set_cpu(cpu, &cpuid_topo->cluster_sibling);
+			cpumask_set_cpu(cpuid, &cpu_topo->cluster_sibling);
+		}
+
 		if (cpuid_topo->package_id != cpu_topo->package_id)
 			continue;
 
@@ -303,6 +323,9 @@ static void clear_cpu_topology(int cpu)
 	cpumask_clear(&cpu_topo->llc_sibling);
 	cpumask_set_cpu(cpu, &cpu_topo->llc_sibling);
 
+	cpumask_clear(&cpu_topo->cluster_sibling);
+	cpumask_set_cpu(cpu, &cpu_topo->cluster_sibling);
+
 	cpumask_clear(&cpu_topo->core_sibling);
 	cpumask_set_cpu(cpu, &cpu_topo->core_sibling);
 	cpumask_clear(&cpu_topo->thread_sibling);
@@ -319,6 +342,7 @@ static void __init reset_cpu_topology(void)
 		cpu_topo->thread_id = -1;
 		cpu_topo->core_id = 0;
 		cpu_topo->package_id = -1;
+		cpu_topo->cluster_id = -1;
 		cpu_topo->llc_id = -1;
 
 		clear_cpu_topology(cpu);
@@ -335,6 +359,8 @@ void remove_cpu_topology(unsigned int cpu)
 		cpumask_clear_cpu(cpu, topology_sibling_cpumask(sibling));
 	for_each_cpu(sibling, topology_llc_cpumask(cpu))
 		cpumask_clear_cpu(cpu, topology_llc_cpumask(sibling));
+	for_each_cpu(sibling, topology_cluster_cpumask(cpu))
+		cpumask_clear_cpu(cpu, topology_cluster_cpumask(sibling));
 
 	clear_cpu_topology(cpu);
 }
@@ -380,6 +406,16 @@ static int __init parse_acpi_topology(void)
 			if (cache_id > 0)
 				cpu_topology[cpu].llc_id = cache_id;
 		}
+
+		/*
+		 * CPUs sharing an L2 below the LLC make up a cluster, as
+		 * on parts where a few cores share an L2.
+		 */
+		if (i > 2) {
+			cache_id = find_acpi_cpu_cache_topology(cpu, 2);
+			if (cache_id > 0)
+				cpu_topology[cpu].cluster_id = cache_id;
+		}
 	}
 
 	return 0;
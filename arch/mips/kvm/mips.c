@@ -258,10 +258,13 @@ void kvm_arch_commit_memory_region(struct kvm *kvm,
 	 * CREATE:	No dirty mappings will already exist.
 	 * MOVE/DELETE:	The old mappings will already have been cleaned up by
 	 *		kvm_arch_flush_shadow_memslot()
+	 * INITIALLY_SET: Every page is reported dirty, KVM_CLEAR_DIRTY_LOG
+	 *		cleans them as user space clears them.
 	 */
 	if (change == KVM_MR_FLAGS_ONLY &&
 	    (!(old->flags & KVM_MEM_LOG_DIRTY_PAGES) &&
-	     new->flags & KVM_MEM_LOG_DIRTY_PAGES)) {
+	     new->flags & KVM_MEM_LOG_DIRTY_PAGES) &&
+	    !kvm_dirty_log_manual_protect_and_init_set(kvm)) {
 		spin_lock(&kvm->mmu_lock);
 		/* Write protect GPA page table entries */
 		needs_flush = kvm_mips_mkclean_gpa_pt(kvm, new->base_gfn,
@@ -1023,6 +1026,38 @@ int kvm_vm_ioctl_get_dirty_log(struct kvm *kvm, struct kvm_dirty_log *log)
 	return r;
 }
 
+/**
+ * kvm_vm_ioctl_clear_dirty_log - clear and re-protect a range of a slot
+ * @kvm: kvm instance
+ * @log: slot id, range and address of the bitmap of pages to clear
+ *
+ * Used with KVM_CAP_MANUAL_DIRTY_LOG_PROTECT, see
+ * kvm_clear_dirty_log_protect().
+ */
+int kvm_vm_ioctl_clear_dirty_log(struct kvm *kvm,
+				 struct kvm_clear_dirty_log *log)
+{
+	struct kvm_memslots *slots;
+	struct kvm_memory_slot *memslot;
+	bool flush = false;
+	int r;
+
+	mutex_lock(&kvm->slots_lock);
+
+	r = kvm_clear_dirty_log_protect(kvm, log, &flush);
+
+	if (flush) {
+		slots = kvm_memslots(kvm);
+		memslot = id_to_memslot(slots, log->slot);
+
+		/* Let implementation handle TLB/GVA invalidation */
+		kvm_mips_callbacks->flush_shadow_memslot(kvm, memslot);
+	}
+
+	mutex_unlock(&kvm->slots_lock);
+	return r;
+}
+
 long kvm_arch_vm_ioctl(struct file *filp, unsigned int ioctl, unsigned long arg)
 {
 	long r;
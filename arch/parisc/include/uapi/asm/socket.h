@@ -107,4 +107,11 @@
 #define SO_TXTIME		0x4036
 #define SCM_TXTIME		SO_TXTIME
 
+#define SO_DEVMEM_BIND		0x4037
+#define SO_DEVMEM_LINEAR	0x4038
+#define SCM_DEVMEM_LINEAR	SO_DEVMEM_LINEAR
+#define SO_DEVMEM_DMABUF	0x4039
+#define SCM_DEVMEM_DMABUF	SO_DEVMEM_DMABUF
+#define SO_DEVMEM_DONTNEED	0x403A
+
 #endif /* _UAPI_ASM_SOCKET_H */
@@ -0,0 +1,237 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Fast user context implementation of getrandom()
+ *
+ * Random bytes come from ChaCha20 keyed by the crng through the system
+ * call, with the key and buffered output kept in per-thread state supplied
+ * by the caller.  The generation in the vvar page tells when the key has
+ * to be fetched again, so reseeds and VM forks take effect as they do for
+ * the system call, and fork wipes the state.
+ *
+ * The code should have no internal unresolved relocations.
+ * Check with readelf after changing.
+ */
+
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <uapi/linux/mman.h>
+#include <uapi/linux/random.h>
+#include <asm/vgetrandom.h>
+#include <asm/vvar.h>
+#include <asm/unistd.h>
+#include <asm/unaligned.h>
+
+#define rng_info (&VVAR(vdso_rng_data))
+
+extern ssize_t __vdso_getrandom(void *buffer, size_t len, unsigned int flags,
+				void *opaque_state, size_t opaque_len);
+
+notrace static long getrandom_syscall(void *buffer, size_t len,
+				      unsigned int flags)
+{
+	long ret;
+
+	asm volatile ("syscall" : "=a" (ret) :
+		      "0" (__NR_getrandom), "D" (buffer), "S" (len),
+		      "d" (flags) :
+		      "rcx", "r11", "memory");
+	return ret;
+}
+
+#define CHACHA_QUARTERROUND(x, a, b, c, d)				\
+	do {								\
+		x[a] += x[b]; x[d] = rol32(x[d] ^ x[a], 16);		\
+		x[c] += x[d]; x[b] = rol32(x[b] ^ x[c], 12);		\
+		x[a] += x[b]; x[d] = rol32(x[d] ^ x[a], 8);		\
+		x[c] += x[d]; x[b] = rol32(x[b] ^ x[c], 7);		\
+	} while (0)
+
+/*
+ * Generate @nblocks ChaCha20 blocks into @dst, starting at and advancing the
+ * 64-bit block @counter.  The working state is wiped afterwards, so no key
+ * material stays behind on the stack of the caller.
+ */
+notrace static void chacha20_blocks(u8 *dst, const u32 *key, u32 *counter,
+				    size_t nblocks)
+{
+	u32 state[16], x[16];
+	int i;
+
+	state[0] = 0x61707865;
+	state[1] = 0x3320646e;
+	state[2] = 0x79622d32;
+	state[3] = 0x6b206574;
+	for (i = 0; i < 8; i++)
+		state[4 + i] = key[i];
+	state[12] = counter[0];
+	state[13] = counter[1];
+	state[14] = 0;
+	state[15] = 0;
+
+	while (nblocks--) {
+		for (i = 0; i < 16; i++)
+			x[i] = state[i];
+
+		for (i = 0; i < 20; i += 2) {
+			CHACHA_QUARTERROUND(x, 0, 4,  8, 12);
+			CHACHA_QUARTERROUND(x, 1, 5,  9, 13);
+			CHACHA_QUARTERROUND(x, 2, 6, 10, 14);
+			CHACHA_QUARTERROUND(x, 3, 7, 11, 15);
+			CHACHA_QUARTERROUND(x, 0, 5, 10, 15);
+			CHACHA_QUARTERROUND(x, 1, 6, 11, 12);
+			CHACHA_QUARTERROUND(x, 2, 7,  8, 13);
+			CHACHA_QUARTERROUND(x, 3, 4,  9, 14);
+		}
+
+		for (i = 0; i < 16; i++)
+			put_unaligned_le32(x[i] + state[i], dst + i * 4);
+		dst += VGETRANDOM_CHACHA_BLOCK_SIZE;
+
+		if (++state[12] == 0)
+			state[13]++;
+	}
+
+	counter[0] = state[12];
+	counter[1] = state[13];
+
+	for (i = 0; i < 16; i++) {
+		((volatile u32 *)state)[i] = 0;
+		((volatile u32 *)x)[i] = 0;
+	}
+}
+
+/* Copy out buffered output, erasing it so it can never be returned twice. */
+notrace static void memcpy_and_zero_src(u8 *dst, u8 *src, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		dst[i] = src[i];
+		((volatile u8 *)src)[i] = 0;
+	}
+}
+
+notrace static void
+vgetrandom_get_params(struct vgetrandom_opaque_params *params)
+{
+	int i;
+
+	params->size_of_opaque_state = sizeof(struct vgetrandom_state);
+	params->mmap_prot = PROT_READ | PROT_WRITE;
+	params->mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	params->madvise_advice[0] = MADV_WIPEONFORK;
+	params->madvise_advice[1] = MADV_DONTDUMP;
+	for (i = 0; i < ARRAY_SIZE(params->reserved); i++)
+		params->reserved[i] = 0;
+}
+
+/*
+ * @opaque_state must point to a struct vgetrandom_state of @opaque_len
+ * bytes, in memory mapped as returned by a call with a NULL @buffer, a
+ * zero @len and @flags, and an @opaque_len of ~0UL, which fills in the
+ * struct vgetrandom_opaque_params at @opaque_state instead.
+ *
+ * Whatever the state cannot serve, unknown flags, an RNG which is not
+ * ready yet or a nested call from a signal handler, goes to the system
+ * call.
+ */
+notrace ssize_t __vdso_getrandom(void *buffer, size_t len, unsigned int flags,
+				 void *opaque_state, size_t opaque_len)
+{
+	struct vgetrandom_state *state = opaque_state;
+	size_t batch_len, nblocks, orig_len = len;
+	unsigned long current_generation;
+	void *orig_buffer = buffer;
+	u32 counter[2] = { 0 };
+
+	if (opaque_len == ~0UL && !buffer && !len && !flags) {
+		vgetrandom_get_params(opaque_state);
+		return 0;
+	}
+
+	if (unlikely(!state || opaque_len != sizeof(*state) ||
+		     (flags & ~GRND_NONBLOCK)))
+		goto fallback_syscall;
+
+	if (unlikely(!READ_ONCE(rng_info->is_ready)))
+		goto fallback_syscall;
+
+	if (unlikely(!len))
+		return 0;
+
+	if (unlikely(READ_ONCE(state->in_use)))
+		goto fallback_syscall;
+	WRITE_ONCE(state->in_use, true);
+
+retry_generation:
+	/* Paired with the smp_store_release() of the crng */
+	current_generation = READ_ONCE(rng_info->generation);
+	if (unlikely(state->generation != current_generation)) {
+		/*
+		 * The key is stale, or this is the first use of the state
+		 * or its first use after fork: fetch a new one.
+		 */
+		if (getrandom_syscall(state->key, sizeof(state->key), 0) !=
+		    sizeof(state->key)) {
+			WRITE_ONCE(state->in_use, false);
+			goto fallback_syscall;
+		}
+		WRITE_ONCE(state->generation, current_generation);
+		barrier();
+		/* The batch was made with the old key, throw it away. */
+		state->pos = sizeof(state->batch);
+	}
+
+	len = orig_len;
+
+more_batch:
+	batch_len = min_t(size_t, sizeof(state->batch) - state->pos, len);
+	if (batch_len) {
+		memcpy_and_zero_src(buffer, state->batch + state->pos,
+				    batch_len);
+		state->pos += batch_len;
+		buffer += batch_len;
+		len -= batch_len;
+	}
+
+	if (!len) {
+		/*
+		 * A reseed during the call means the output may come from
+		 * a key which had already been invalidated: start over.
+		 */
+		barrier();
+		if (unlikely(READ_ONCE(state->generation) !=
+			     READ_ONCE(rng_info->generation))) {
+			buffer = orig_buffer;
+			goto retry_generation;
+		}
+		barrier();
+		WRITE_ONCE(state->in_use, false);
+		return orig_len;
+	}
+
+	/* Whole blocks go straight to the caller's buffer. */
+	nblocks = len / VGETRANDOM_CHACHA_BLOCK_SIZE;
+	if (nblocks) {
+		chacha20_blocks(buffer, state->key, counter, nblocks);
+		buffer += nblocks * VGETRANDOM_CHACHA_BLOCK_SIZE;
+		len -= nblocks * VGETRANDOM_CHACHA_BLOCK_SIZE;
+	}
+
+	BUILD_BUG_ON(sizeof(state->batch_key) % VGETRANDOM_CHACHA_BLOCK_SIZE);
+
+	/*
+	 * Refill the batch and overwrite the key in the same go, so the
+	 * output already handed out can't be recomputed from the state.
+	 */
+	chacha20_blocks(state->batch_key, state->key, counter,
+			sizeof(state->batch_key) / VGETRANDOM_CHACHA_BLOCK_SIZE);
+	state->pos = 0;
+	goto more_batch;
+
+fallback_syscall:
+	return getrandom_syscall(orig_buffer, orig_len, flags);
+}
+
+ssize_t getrandom(void *, size_t, unsigned int, void *, size_t)
+	__attribute__((weak, alias("__vdso_getrandom")));
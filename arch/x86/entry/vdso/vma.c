@@ -16,6 +16,7 @@
 #include <linux/ptrace.h>
 #include <asm/pvclock.h>
 #include <asm/vgtod.h>
+#include <asm/vgetrandom.h>
 #include <asm/proto.h>
 #include <asm/vdso.h>
 #include <asm/vvar.h>
@@ -28,6 +29,10 @@
 unsigned int __read_mostly vdso64_enabled = 1;
 #endif
 
+#ifdef CONFIG_VDSO_GETRANDOM
+DEFINE_VVAR(struct vdso_rng_data, vdso_rng_data);
+#endif
+
 void __init init_vdso_image(const struct vdso_image *image)
 {
 	BUG_ON(image->size % PAGE_SIZE != 0);
@@ -146,6 +146,37 @@ extern __wsum csum_partial_copy_to_user(const void *src, void __user *dst,
 extern __wsum csum_partial_copy_nocheck(const void *src, void *dst,
 					int len, __wsum sum);
 
+/*
+ * Checksum of 64-byte blocks with AVX2 or AVX-512, for buffers large
+ * enough to pay for saving the FPU state.
+ */
+#define CSUM_SIMD_MIN_LEN	1024
+
+#ifdef CONFIG_AS_AVX2
+extern bool csum_simd_usable(void);
+extern unsigned int csum_simd_blocks(const void *buff, unsigned int blocks);
+extern unsigned int csum_copy_simd_blocks(const void *src, void *dst,
+					  unsigned int blocks);
+#else
+static inline bool csum_simd_usable(void)
+{
+	return false;
+}
+
+static inline unsigned int csum_simd_blocks(const void *buff,
+					    unsigned int blocks)
+{
+	return 0;
+}
+
+static inline unsigned int csum_copy_simd_blocks(const void *src, void *dst,
+						 unsigned int blocks)
+{
+	return 0;
+}
+#endif
+
+
 /* Old names. To be removed. */
 #define csum_and_copy_to_user csum_partial_copy_to_user
 #define csum_and_copy_from_user csum_partial_copy_from_user
@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _ASM_X86_VGETRANDOM_H
+#define _ASM_X86_VGETRANDOM_H
+
+#include <linux/types.h>
+
+#define VGETRANDOM_CHACHA_BLOCK_SIZE	64
+#define VGETRANDOM_CHACHA_KEY_SIZE	32
+
+/*
+ * The part of the crng state the vDSO getrandom() needs, in the vvar page.
+ * The generation changes whenever the keys handed out by the crng must no
+ * longer be used: on every reseed of the primary crng and on VM fork.
+ */
+struct vdso_rng_data {
+	unsigned long	generation;
+	bool		is_ready;
+};
+extern struct vdso_rng_data vdso_rng_data;
+
+/*
+ * The opaque per-thread state of the vDSO getrandom(), in memory that user
+ * space maps as told by struct vgetrandom_opaque_params.  It is wiped on
+ * fork, so a child never reuses the parent's key or buffered output: the
+ * zero generation it finds never matches the one of the kernel.
+ *
+ * @batch:	buffered random output, consumed from @pos and zeroed
+ * @key:	ChaCha20 key, replaced on every refill of @batch
+ * @batch_key:	@batch and @key as one buffer, refilled in one go
+ * @generation:	vdso_rng_data.generation when @key was fetched
+ * @pos:	offset of the first unused byte of @batch
+ * @in_use:	set while a call is using the state, so a signal handler
+ *		calling getrandom() on the same state falls back to the
+ *		system call
+ */
+struct vgetrandom_state {
+	union {
+		struct {
+			u8	batch[VGETRANDOM_CHACHA_BLOCK_SIZE * 3 / 2];
+			u32	key[VGETRANDOM_CHACHA_KEY_SIZE / sizeof(u32)];
+		};
+		u8		batch_key[VGETRANDOM_CHACHA_BLOCK_SIZE * 2];
+	};
+	unsigned long		generation;
+	u8			pos;
+	bool			in_use;
+};
+
+#endif /* _ASM_X86_VGETRANDOM_H */
@@ -647,6 +647,14 @@ void __init alternative_instructions(void)
 				(unsigned long)__smp_locks_end);
 #endif
 
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+	/*
+	 * Pick the spinlock slow path before the paravirt call sites get
+	 * patched; any hypervisor-specific choice has been made by now.
+	 */
+	cna_configure_spin_lock_slowpath();
+#endif
+
 	apply_paravirt(__parainstructions, __parainstructions_end);
 
 	restart_nmi();
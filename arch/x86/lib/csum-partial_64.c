@@ -31,6 +31,9 @@ static inline unsigned short from32to16(unsigned a)
  * Manual Prefetching
  * Unrolling to an 128 bytes inner loop.
  * Using interleaving with more registers to break the carry chains.
+ *
+ * Large buffers go to the AVX2/AVX-512 loop instead, which has no carry
+ * chain at all.
  */
 static unsigned do_csum(const unsigned char *buff, unsigned len)
 {
@@ -68,6 +71,19 @@ static unsigned do_csum(const unsigned char *buff, unsigned len)
 			/* main loop using 64byte blocks */
 			zero = 0;
 			count64 = count >> 3;
+			if (count64 >= CSUM_SIMD_MIN_LEN / 64 &&
+			    csum_simd_usable()) {
+				unsigned long simd;
+
+				simd = csum_simd_blocks(buff, count64);
+				asm("addq %[simd],%[res]\n\t"
+				    "adcq %[zero],%[res]"
+				    : [res] "=r" (result)
+				    : [simd] "r" (simd), [zero] "r" (zero),
+				    "[res]" (result));
+				buff += count64 * 64;
+				count64 = 0;
+			}
 			while (count64) { 
 				asm("addq 0*8(%[src]),%[res]\n\t"
 				    "adcq 1*8(%[src]),%[res]\n\t"
@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Checksum of 64-byte blocks with the vector units.
+ *
+ * The 32-bit words of the data are zero-extended into 64-bit lanes and
+ * added up there, so no carry is ever lost and the lanes only need to be
+ * folded once at the end.  Summing 32-bit words gives the same result
+ * modulo 0xffffffff as the 64-bit adc loop of do_csum(), which is all the
+ * internet checksum needs.
+ *
+ * Saving the FPU state is not free, callers only come here for buffers of
+ * at least CSUM_SIMD_MIN_LEN bytes.
+ */
+
+#include <linux/export.h>
+#include <asm/checksum.h>
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+
+#ifdef CONFIG_AS_AVX2
+
+static unsigned int csum_fold_lanes(const u64 *lanes, int n)
+{
+	u64 sum = 0;
+	int i;
+
+	/* Each lane holds less than 2^59, their sum cannot overflow */
+	for (i = 0; i < n; i++)
+		sum += lanes[i];
+
+	return add32_with_carry(sum >> 32, sum & 0xffffffff);
+}
+
+#ifdef CONFIG_AS_AVX512
+static unsigned int csum_avx512_blocks(const void *buff, unsigned int blocks)
+{
+	u64 lanes[8] __aligned(64);
+
+	asm volatile("vpxorq %zmm0,%zmm0,%zmm0\n\t"
+		     "vpxorq %zmm1,%zmm1,%zmm1");
+
+	while (blocks--) {
+		asm volatile("vpmovzxdq 0*32(%0),%%zmm2\n\t"
+			     "vpmovzxdq 1*32(%0),%%zmm3\n\t"
+			     "vpaddq %%zmm2,%%zmm0,%%zmm0\n\t"
+			     "vpaddq %%zmm3,%%zmm1,%%zmm1"
+			     : : "r" (buff) : "memory");
+		buff += 64;
+	}
+
+	asm volatile("vpaddq %%zmm1,%%zmm0,%%zmm0\n\t"
+		     "vmovdqa64 %%zmm0,%0"
+		     : "=m" (lanes));
+
+	return csum_fold_lanes(lanes, ARRAY_SIZE(lanes));
+}
+
+static unsigned int csum_copy_avx512_blocks(const void *src, void *dst,
+					    unsigned int blocks)
+{
+	u64 lanes[8] __aligned(64);
+
+	asm volatile("vpxorq %zmm0,%zmm0,%zmm0\n\t"
+		     "vpxorq %zmm1,%zmm1,%zmm1\n\t"
+		     "vpxorq %zmm5,%zmm5,%zmm5");
+
+	while (blocks--) {
+		asm volatile("vmovdqu64 (%0),%%zmm2\n\t"
+			     "vmovdqu64 %%zmm2,(%1)\n\t"
+			     "vpunpckldq %%zmm5,%%zmm2,%%zmm3\n\t"
+			     "vpunpckhdq %%zmm5,%%zmm2,%%zmm4\n\t"
+			     "vpaddq %%zmm3,%%zmm0,%%zmm0\n\t"
+			     "vpaddq %%zmm4,%%zmm1,%%zmm1"
+			     : : "r" (src), "r" (dst) : "memory");
+		src += 64;
+		dst += 64;
+	}
+
+	asm volatile("vpaddq %%zmm1,%%zmm0,%%zmm0\n\t"
+		     "vmovdqa64 %%zmm0,%0"
+		     : "=m" (lanes));
+
+	return csum_fold_lanes(lanes, ARRAY_SIZE(lanes));
+}
+#endif
+
+static unsigned int csum_avx2_blocks(const void *buff, unsigned int blocks)
+{
+	u64 lanes[4] __aligned(32);
+
+	asm volatile("vpxor %ymm0,%ymm0,%ymm0\n\t"
+		     "vpxor %ymm1,%ymm1,%ymm1");
+
+	while (blocks--) {
+		asm volatile("vpmovzxdq 0*16(%0),%%ymm2\n\t"
+			     "vpmovzxdq 1*16(%0),%%ymm3\n\t"
+			     "vpmovzxdq 2*16(%0),%%ymm4\n\t"
+			     "vpmovzxdq 3*16(%0),%%ymm5\n\t"
+			     "vpaddq %%ymm2,%%ymm0,%%ymm0\n\t"
+			     "vpaddq %%ymm3,%%ymm1,%%ymm1\n\t"
+			     "vpaddq %%ymm4,%%ymm0,%%ymm0\n\t"
+			     "vpaddq %%ymm5,%%ymm1,%%ymm1"
+			     : : "r" (buff) : "memory");
+		buff += 64;
+	}
+
+	asm volatile("vpaddq %%ymm1,%%ymm0,%%ymm0\n\t"
+		     "vmovdqa %%ymm0,%0"
+		     : "=m" (lanes));
+
+	return csum_fold_lanes(lanes, ARRAY_SIZE(lanes));
+}
+
+static unsigned int csum_copy_avx2_blocks(const void *src, void *dst,
+					  unsigned int blocks)
+{
+	u64 lanes[4] __aligned(32);
+
+	asm volatile("vpxor %ymm0,%ymm0,%ymm0\n\t"
+		     "vpxor %ymm1,%ymm1,%ymm1\n\t"
+		     "vpxor %ymm6,%ymm6,%ymm6");
+
+	while (blocks--) {
+		asm volatile("vmovdqu 0*32(%0),%%ymm2\n\t"
+			     "vmovdqu 1*32(%0),%%ymm3\n\t"
+			     "vmovdqu %%ymm2,0*32(%1)\n\t"
+			     "vmovdqu %%ymm3,1*32(%1)\n\t"
+			     "vpunpckldq %%ymm6,%%ymm2,%%ymm4\n\t"
+			     "vpunpckhdq %%ymm6,%%ymm2,%%ymm5\n\t"
+			     "vpaddq %%ymm4,%%ymm0,%%ymm0\n\t"
+			     "vpaddq %%ymm5,%%ymm1,%%ymm1\n\t"
+			     "vpunpckldq %%ymm6,%%ymm3,%%ymm4\n\t"
+			     "vpunpckhdq %%ymm6,%%ymm3,%%ymm5\n\t"
+			     "vpaddq %%ymm4,%%ymm0,%%ymm0\n\t"
+			     "vpaddq %%ymm5,%%ymm1,%%ymm1"
+			     : : "r" (src), "r" (dst) : "memory");
+		src += 64;
+		dst += 64;
+	}
+
+	asm volatile("vpaddq %%ymm1,%%ymm0,%%ymm0\n\t"
+		     "vmovdqa %%ymm0,%0"
+		     : "=m" (lanes));
+
+	return csum_fold_lanes(lanes, ARRAY_SIZE(lanes));
+}
+
+/**
+ * csum_simd_usable - check whether the vector kernels may run here
+ *
+ * The CPU feature tests are patched in by alternatives at boot; every
+ * CPU with AVX-512 also has AVX2.
+ */
+bool csum_simd_usable(void)
+{
+	return static_cpu_has(X86_FEATURE_AVX2) && irq_fpu_usable();
+}
+
+/**
+ * csum_simd_blocks - checksum 64-byte blocks
+ * @buff: the data, best aligned on 8 bytes
+ * @blocks: number of 64-byte blocks at @buff
+ *
+ * Returns a 32-bit unfolded checksum.  Only to be called when
+ * csum_simd_usable() says so.
+ */
+unsigned int csum_simd_blocks(const void *buff, unsigned int blocks)
+{
+	unsigned int sum;
+
+	kernel_fpu_begin();
+#ifdef CONFIG_AS_AVX512
+	if (static_cpu_has(X86_FEATURE_AVX512F))
+		sum = csum_avx512_blocks(buff, blocks);
+	else
+#endif
+		sum = csum_avx2_blocks(buff, blocks);
+	kernel_fpu_end();
+	return sum;
+}
+
+/**
+ * csum_copy_simd_blocks - copy and checksum 64-byte blocks
+ * @src: source address
+ * @dst: destination address
+ * @blocks: number of 64-byte blocks to copy
+ *
+ * Returns a 32-bit unfolded checksum.  Only to be called when
+ * csum_simd_usable() says so.
+ */
+unsigned int csum_copy_simd_blocks(const void *src, void *dst,
+				   unsigned int blocks)
+{
+	unsigned int sum;
+
+	kernel_fpu_begin();
+#ifdef CONFIG_AS_AVX512
+	if (static_cpu_has(X86_FEATURE_AVX512F))
+		sum = csum_copy_avx512_blocks(src, dst, blocks);
+	else
+#endif
+		sum = csum_copy_avx2_blocks(src, dst, blocks);
+	kernel_fpu_end();
+	return sum;
+}
+
+#endif /* CONFIG_AS_AVX2 */
@@ -126,10 +126,21 @@ EXPORT_SYMBOL(csum_partial_copy_to_user);
  * @sum: initial sum that is added into the result (32bit unfolded)
  *
  * Returns an 32bit unfolded checksum of the buffer.
+ * Large buffers are copied and summed in one pass with AVX2 or AVX-512.
  */
 __wsum
 csum_partial_copy_nocheck(const void *src, void *dst, int len, __wsum sum)
 {
+	if (len >= CSUM_SIMD_MIN_LEN && csum_simd_usable()) {
+		unsigned int blocks = len / 64;
+
+		sum = csum_add(sum, (__force __wsum)
+			       csum_copy_simd_blocks(src, dst, blocks));
+		src += blocks * 64;
+		dst += blocks * 64;
+		len -= blocks * 64;
+	}
+
 	return csum_partial_copy_generic(src, dst, len, sum, NULL, NULL);
 }
 EXPORT_SYMBOL(csum_partial_copy_nocheck);
@@ -1334,6 +1334,46 @@ void do_user_addr_fault(struct pt_regs *regs,
 	}
 #endif
 
+#ifdef CONFIG_PER_VMA_LOCK
+	/*
+	 * Try to handle user faults on anonymous memory under the VMA lock
+	 * alone. The fault cannot be retried since there is no mmap_sem to
+	 * drop, so anything that would need that falls back to mmap_sem.
+	 */
+	if (!(flags & FAULT_FLAG_USER))
+		goto lock_mmap;
+
+	vma = lock_vma_under_rcu(mm, address);
+	if (!vma)
+		goto lock_mmap;
+
+	if (unlikely(access_error(sw_error_code, vma))) {
+		vma_read_unlock(vma);
+		goto lock_mmap;
+	}
+	fault = handle_mm_fault(vma, address, flags &
+				~(FAULT_FLAG_ALLOW_RETRY | FAULT_FLAG_KILLABLE));
+	vma_read_unlock(vma);
+
+	if (!(fault & VM_FAULT_RETRY)) {
+		count_vm_event(VMA_LOCK_SUCCESS);
+		if (unlikely(fault & VM_FAULT_ERROR)) {
+			mm_fault_error(regs, sw_error_code, address, fault);
+			return;
+		}
+		if (fault & VM_FAULT_MAJOR) {
+			tsk->maj_flt++;
+			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1, regs, address);
+		} else {
+			tsk->min_flt++;
+			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1, regs, address);
+		}
+		return;
+	}
+	count_vm_event(VMA_LOCK_ABORT);
+lock_mmap:
+#endif /* CONFIG_PER_VMA_LOCK */
+
 	/*
 	 * Kernel-mode access to the user address space should only occur
 	 * on well-defined single instructions listed in the exception
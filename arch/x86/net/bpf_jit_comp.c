@@ -13,9 +13,13 @@
 #include <linux/filter.h>
 #include <linux/if_vlan.h>
 #include <linux/bpf.h>
+#include <linux/memory.h>
+#include <linux/sort.h>
 
 #include <asm/set_memory.h>
 #include <asm/nospec-branch.h>
+#include <asm/text-patching.h>
+#include <asm/asm-prototypes.h>
 
 static u8 *emit_code(u8 *ptr, u32 bytes, unsigned int len)
 {
@@ -1192,3 +1196,387 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 					   tmp : orig_prog);
 	return prog;
 }
+
+#if defined(CONFIG_BPF_SYSCALL)
+#define X86_PATCH_SIZE 5
+
+/* Room left in the image for invoke_bpf_prog() to emit a program, enough
+ * for the epilogue after it as well
+ */
+#define BPF_TRAMP_PROG_MAX_SIZE 128
+
+/* call or jmp rel32 to func, from an instruction at ip */
+static int emit_patch(u8 **pprog, void *func, void *ip, u8 opcode)
+{
+	u8 *prog = *pprog;
+	int cnt = 0;
+	s64 offset;
+
+	offset = func - (ip + X86_PATCH_SIZE);
+	if (!is_simm32(offset)) {
+		pr_err("Target %p is out of range\n", func);
+		return -EINVAL;
+	}
+	EMIT1_off32(opcode, offset);
+	*pprog = prog;
+	return 0;
+}
+
+static int emit_call(u8 **pprog, void *func, void *ip)
+{
+	return emit_patch(pprog, func, ip, 0xE8);
+}
+
+int bpf_arch_text_poke(void *ip, enum bpf_text_poke_type t,
+		       void *old_addr, void *new_addr)
+{
+	u8 opcode = t == BPF_MOD_CALL ? 0xE8 : 0xE9;
+	u8 old_insn[X86_PATCH_SIZE], new_insn[X86_PATCH_SIZE];
+	u8 *prog;
+	int ret;
+
+	memcpy(old_insn, ideal_nops[NOP_ATOMIC5], X86_PATCH_SIZE);
+	if (old_addr) {
+		prog = old_insn;
+		ret = emit_patch(&prog, old_addr, ip, opcode);
+		if (ret)
+			return ret;
+	}
+
+	memcpy(new_insn, ideal_nops[NOP_ATOMIC5], X86_PATCH_SIZE);
+	if (new_addr) {
+		prog = new_insn;
+		ret = emit_patch(&prog, new_addr, ip, opcode);
+		if (ret)
+			return ret;
+	}
+
+	ret = -EBUSY;
+	mutex_lock(&text_mutex);
+	if (memcmp(ip, old_insn, X86_PATCH_SIZE))
+		goto out;
+	/* CPUs hitting the breakpoint meanwhile skip the instruction */
+	if (memcmp(ip, new_insn, X86_PATCH_SIZE))
+		text_poke_bp(ip, new_insn, X86_PATCH_SIZE,
+			     ip + X86_PATCH_SIZE);
+	ret = 0;
+out:
+	mutex_unlock(&text_mutex);
+	return ret;
+}
+
+/* x86-64 registers the traced function gets its arguments in */
+static const u8 tramp_arg_regs[BPF_TRAMP_MAX_ARGS] = {
+	7,	/* RDI */
+	6,	/* RSI */
+	2,	/* RDX */
+	1,	/* RCX */
+	8,	/* R8 */
+	9,	/* R9 */
+};
+
+/* mov qword [rbp + off], reg (0x89) or mov reg, qword [rbp + off] (0x8B) */
+static void emit_rbp_mov(u8 **pprog, u8 opcode, u8 reg, int off)
+{
+	u8 *prog = *pprog;
+	int cnt = 0;
+
+	EMIT4(reg >= 8 ? 0x4C : 0x48, opcode, 0x45 | (reg & 7) << 3, (u8)off);
+	*pprog = prog;
+}
+
+static void save_regs(u8 **pprog, int stack_size)
+{
+	int i;
+
+	for (i = 0; i < BPF_TRAMP_MAX_ARGS; i++)
+		emit_rbp_mov(pprog, 0x89, tramp_arg_regs[i],
+			     -stack_size + i * 8);
+}
+
+static void restore_regs(u8 **pprog, int stack_size)
+{
+	int i;
+
+	for (i = 0; i < BPF_TRAMP_MAX_ARGS; i++)
+		emit_rbp_mov(pprog, 0x8B, tramp_arg_regs[i],
+			     -stack_size + i * 8);
+}
+
+static int invoke_bpf_prog(u8 **pprog, struct bpf_prog *p, int stack_size,
+			   u8 *image_end)
+{
+	u8 *prog = *pprog, *jmp_insn;
+	int cnt = 0;
+
+	if (image_end - prog < BPF_TRAMP_PROG_MAX_SIZE)
+		return -E2BIG;
+
+	if (emit_call(&prog, __bpf_prog_enter, prog))
+		return -EINVAL;
+	/* test rax, rax; je around the program if it's nested */
+	EMIT3(0x48, 0x85, 0xC0);
+	jmp_insn = prog;
+	EMIT2_off32(0x0F, 0x84, 0);
+
+	/* lea rdi, [rbp - stack_size]: the saved registers are the context */
+	EMIT4(0x48, 0x8D, 0x7D, (u8)-stack_size);
+	if (!p->jited)
+		emit_mov_imm64(&prog, BPF_REG_2, (long) p->insnsi >> 32,
+			       (u32) (long) p->insnsi);
+	if (emit_call(&prog, p->bpf_func, prog))
+		return -EINVAL;
+
+	*(s32 *)(jmp_insn + 2) = prog - (jmp_insn + 6);
+
+	if (emit_call(&prog, __bpf_prog_exit, prog))
+		return -EINVAL;
+
+	*pprog = prog;
+	return 0;
+}
+
+/* Generate the trampoline called from the ftrace NOP at orig_call:
+ *
+ *	push rbp
+ *	mov rbp, rsp
+ *	sub rsp, stack_size		; argument registers, return value
+ *	<save argument registers>
+ *	<fentry programs>
+ *
+ * then, without fexit programs:
+ *
+ *	<restore argument registers>
+ *	leave
+ *	ret				; to the rest of the function
+ *
+ * and with them:
+ *
+ *	__bpf_tramp_enter(im)
+ *	<restore argument registers>
+ *	call orig_call + 5		; the rest of the function
+ *	mov [rbp - 8], rax
+ *	nop5				; jmp epilogue once retired
+ *	<fexit programs>
+ * epilogue:
+ *	__bpf_tramp_exit(im)
+ *	mov rax, [rbp - 8]
+ *	leave
+ *	add rsp, 8			; skip the return to the function
+ *	ret				; to its caller
+ *
+ * Each program runs as __bpf_prog_enter() ? p->bpf_func(ctx, insnsi) : 0,
+ * followed by __bpf_prog_exit().
+ */
+int arch_prepare_bpf_trampoline(struct bpf_tramp_image *im, void *image_end,
+				void *orig_call)
+{
+	struct bpf_tramp_progs *fentry = &im->tprogs[BPF_TRAMP_FENTRY];
+	struct bpf_tramp_progs *fexit = &im->tprogs[BPF_TRAMP_FEXIT];
+	int stack_size = (BPF_TRAMP_MAX_ARGS + 1) * 8;
+	u8 *prog = im->image;
+	int i, err, cnt = 0;
+
+	jit_fill_hole(im->image, (u8 *)image_end - (u8 *)im->image);
+
+	EMIT1(0x55);		 /* push rbp */
+	EMIT3(0x48, 0x89, 0xE5); /* mov rbp, rsp */
+	EMIT4(0x48, 0x83, 0xEC, stack_size); /* sub rsp, stack_size */
+
+	save_regs(&prog, stack_size);
+
+	for (i = 0; i < fentry->nr_progs; i++) {
+		err = invoke_bpf_prog(&prog, fentry->progs[i], stack_size,
+				      image_end);
+		if (err)
+			return err;
+	}
+
+	if (!fexit->nr_progs) {
+		restore_regs(&prog, stack_size);
+		EMIT1(0xC9); /* leave */
+		EMIT1(0xC3); /* ret */
+		return 0;
+	}
+
+	emit_mov_imm64(&prog, BPF_REG_1, (long) im >> 32, (u32) (long) im);
+	if (emit_call(&prog, __bpf_tramp_enter, prog))
+		return -EINVAL;
+	restore_regs(&prog, stack_size);
+	if (emit_call(&prog, orig_call + X86_PATCH_SIZE, prog))
+		return -EINVAL;
+	emit_rbp_mov(&prog, 0x89, 0 /* RAX */, -8);
+
+	im->ip_after_call = prog;
+	memcpy(prog, ideal_nops[NOP_ATOMIC5], X86_PATCH_SIZE);
+	prog += X86_PATCH_SIZE;
+
+	for (i = 0; i < fexit->nr_progs; i++) {
+		err = invoke_bpf_prog(&prog, fexit->progs[i], stack_size,
+				      image_end);
+		if (err)
+			return err;
+	}
+
+	im->ip_epilogue = prog;
+	emit_mov_imm64(&prog, BPF_REG_1, (long) im >> 32, (u32) (long) im);
+	if (emit_call(&prog, __bpf_tramp_exit, prog))
+		return -EINVAL;
+	emit_rbp_mov(&prog, 0x8B, 0 /* RAX */, -8);
+	EMIT1(0xC9);		 /* leave */
+	EMIT4(0x48, 0x83, 0xC4, 8); /* add rsp, 8 */
+	EMIT1(0xC3);		 /* ret */
+	return 0;
+}
+
+static int emit_jump(u8 **pprog, void *func, void *ip)
+{
+	return emit_patch(pprog, func, ip, 0xE9);
+}
+
+static int emit_cond_near_jump(u8 **pprog, void *func, void *ip, u8 jmp_cond)
+{
+	u8 *prog = *pprog;
+	int cnt = 0;
+	s64 offset;
+
+	offset = func - (ip + 2 + 4);
+	if (!is_simm32(offset)) {
+		pr_err("Target %p is out of range\n", func);
+		return -EINVAL;
+	}
+	EMIT2_off32(0x0F, jmp_cond + 0x10, offset);
+	*pprog = prog;
+	return 0;
+}
+
+static void emit_nops(u8 **pprog, unsigned int len)
+{
+	unsigned int i, noplen;
+	u8 *prog = *pprog;
+	int cnt = 0;
+
+	while (len > 0) {
+		noplen = len;
+
+		if (noplen > ASM_NOP_MAX)
+			noplen = ASM_NOP_MAX;
+
+		for (i = 0; i < noplen; i++)
+			EMIT1(ideal_nops[noplen][i]);
+		len -= noplen;
+	}
+
+	*pprog = prog;
+}
+
+/* The program isn't one the dispatcher knows about: call it the way the
+ * dispatcher function would have, through the retpoline thunk if any.
+ */
+static int emit_fallback_jump(u8 **pprog)
+{
+	u8 *prog = *pprog;
+	int err = 0;
+
+#ifdef CONFIG_RETPOLINE
+	/* Both GCC and clang name their external thunks this way */
+	err = emit_jump(&prog, __x86_indirect_thunk_rdx, prog);
+#else
+	int cnt = 0;
+
+	EMIT2(0xFF, 0xE2);	/* jmp rdx */
+#endif
+	*pprog = prog;
+	return err;
+}
+
+/* Binary search of the program address, in rdx, among progs[a..b] */
+static int emit_bpf_dispatcher(u8 **pprog, int a, int b, s64 *progs)
+{
+	u8 *jg_reloc, *jg_target, *prog = *pprog;
+	int pivot, err, jg_bytes = 1, cnt = 0;
+	s64 jg_offset;
+
+	if (a == b) {
+		/* leaf: one address left to compare with */
+		EMIT1(add_1mod(0x48, BPF_REG_3));	/* cmp rdx,func */
+		if (!is_simm32(progs[a]))
+			return -1;
+		EMIT2_off32(0x81, add_1reg(0xF8, BPF_REG_3),
+			    progs[a]);
+		err = emit_cond_near_jump(&prog,	/* je func */
+					  (void *)progs[a], prog,
+					  X86_JE);
+		if (err)
+			return err;
+
+		err = emit_fallback_jump(&prog);	/* jmp thunk/indirect */
+		if (err)
+			return err;
+
+		*pprog = prog;
+		return 0;
+	}
+
+	pivot = (b - a) / 2;
+	EMIT1(add_1mod(0x48, BPF_REG_3));		/* cmp rdx,func */
+	if (!is_simm32(progs[a + pivot]))
+		return -1;
+	EMIT2_off32(0x81, add_1reg(0xF8, BPF_REG_3), progs[a + pivot]);
+
+	if (pivot > 2) {				/* jg upper_part */
+		/* the lower part may be too far for a short jump */
+		jg_bytes = 4;
+		EMIT2_off32(0x0F, X86_JG + 0x10, 0);
+	} else {
+		EMIT2(X86_JG, 0);
+	}
+	jg_reloc = prog;
+
+	err = emit_bpf_dispatcher(&prog, a, a + pivot,	/* emit lower_part */
+				  progs);
+	if (err)
+		return err;
+
+	/* branch targets are best 16-byte aligned, see the Intel
+	 * optimization reference manual, 3.4.1.4 Code Alignment
+	 */
+	jg_target = PTR_ALIGN(prog, 16);
+	if (jg_target != prog)
+		emit_nops(&prog, jg_target - prog);
+	jg_offset = prog - jg_reloc;
+	emit_code(jg_reloc - jg_bytes, jg_offset, jg_bytes);
+
+	err = emit_bpf_dispatcher(&prog, a + pivot + 1,	/* emit upper_part */
+				  b, progs);
+	if (err)
+		return err;
+
+	*pprog = prog;
+	return 0;
+}
+
+static int cmp_ips(const void *a, const void *b)
+{
+	const s64 *ipa = a;
+	const s64 *ipb = b;
+
+	if (*ipa > *ipb)
+		return 1;
+	if (*ipa < *ipb)
+		return -1;
+	return 0;
+}
+
+/* The dispatcher function jumps here from its entry, with the context,
+ * the instructions and the program function in rdi, rsi and rdx: the
+ * program is jumped to, and returns to the caller of the function.
+ */
+int arch_prepare_bpf_dispatcher(void *image, s64 *funcs, int num_funcs)
+{
+	u8 *prog = image;
+
+	sort(funcs, num_funcs, sizeof(funcs[0]), cmp_ips, NULL);
+	return emit_bpf_dispatcher(&prog, 0, num_funcs - 1, funcs);
+}
+#endif /* CONFIG_BPF_SYSCALL */
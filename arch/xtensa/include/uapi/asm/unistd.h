@@ -758,7 +758,7 @@ __SYSCALL(341, sys_execveat, 5)
 #define __NR_userfaultfd			342
 __SYSCALL(342, sys_userfaultfd, 1)
 #define __NR_membarrier				343
-__SYSCALL(343, sys_membarrier, 2)
+__SYSCALL(343, sys_membarrier, 3)
 #define __NR_mlock2				344
 __SYSCALL(344, sys_mlock2, 3)
 #define __NR_copy_file_range			345
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Allocation and lifetime of bio inline encryption contexts.
+ */
+#include <linux/bio.h>
+#include <linux/mempool.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/keyslot-manager.h>
+
+static int num_prealloc_crypt_ctxs = 128;
+
+module_param(num_prealloc_crypt_ctxs, int, 0444);
+MODULE_PARM_DESC(num_prealloc_crypt_ctxs,
+		 "Number of bio crypto contexts to preallocate");
+
+static struct kmem_cache *bio_crypt_ctx_cache;
+static mempool_t *bio_crypt_ctx_pool;
+
+int __init bio_crypt_ctx_init(void)
+{
+	bio_crypt_ctx_cache = KMEM_CACHE(bio_crypt_ctx, 0);
+	if (!bio_crypt_ctx_cache)
+		return -ENOMEM;
+
+	bio_crypt_ctx_pool = mempool_create_slab_pool(num_prealloc_crypt_ctxs,
+						      bio_crypt_ctx_cache);
+	if (!bio_crypt_ctx_pool)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * bio_crypt_set_ctx() - attach an inline encryption context to a bio
+ * @bio: the bio, which must not have a context yet
+ * @key: the key to en/decrypt the bio's data with
+ * @dun: the data unit number of the first data unit of @bio
+ * @gfp_mask: memory allocation flags, must include __GFP_DIRECT_RECLAIM
+ *
+ * @key must stay valid until @bio has completed.
+ */
+void bio_crypt_set_ctx(struct bio *bio, const struct blk_crypto_key *key,
+		       u64 dun, gfp_t gfp_mask)
+{
+	struct bio_crypt_ctx *bc;
+
+	/* the mempool guarantees forward progress only if we may sleep */
+	WARN_ON_ONCE(!(gfp_mask & __GFP_DIRECT_RECLAIM));
+
+	bc = mempool_alloc(bio_crypt_ctx_pool, gfp_mask);
+	bc->bc_key = key;
+	bc->bc_dun = dun;
+	bc->bc_ksm = NULL;
+	bc->bc_keyslot = -1;
+
+	bio->bi_crypt_context = bc;
+}
+EXPORT_SYMBOL_GPL(bio_crypt_set_ctx);
+
+void bio_crypt_free_ctx(struct bio *bio)
+{
+	struct bio_crypt_ctx *bc = bio->bi_crypt_context;
+
+	if (!bc)
+		return;
+
+	if (bc->bc_keyslot >= 0)
+		keyslot_manager_put_slot(bc->bc_ksm, bc->bc_keyslot);
+	mempool_free(bc, bio_crypt_ctx_pool);
+	bio->bi_crypt_context = NULL;
+}
+
+/*
+ * Clones share the keyslot of the source bio, and take a reference on it so
+ * that it remains programmed until the last of them has completed.
+ */
+int bio_crypt_clone(struct bio *dst, struct bio *src, gfp_t gfp_mask)
+{
+	struct bio_crypt_ctx *bc = src->bi_crypt_context;
+
+	if (!bc)
+		return 0;
+
+	dst->bi_crypt_context = mempool_alloc(bio_crypt_ctx_pool, gfp_mask);
+	if (!dst->bi_crypt_context)
+		return -ENOMEM;
+
+	*dst->bi_crypt_context = *bc;
+	if (bc->bc_keyslot >= 0)
+		keyslot_manager_get_slot(bc->bc_ksm, bc->bc_keyslot);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bio_crypt_clone);
+
+int bio_crypt_ctx_acquire_keyslot(struct bio_crypt_ctx *bc,
+				  struct keyslot_manager *ksm)
+{
+	int slot = keyslot_manager_get_slot_for_key(ksm, bc->bc_key);
+
+	if (slot < 0)
+		return slot;
+
+	bc->bc_keyslot = slot;
+	bc->bc_ksm = ksm;
+	return 0;
+}
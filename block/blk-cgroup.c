@@ -29,6 +29,7 @@
 #include <linux/blk-cgroup.h>
 #include <linux/tracehook.h>
 #include "blk.h"
+#include "blk-stat.h"
 
 #define MAX_KEY_LEN 100
 
@@ -81,6 +82,9 @@ static void blkg_free(struct blkcg_gq *blkg)
 
 	blkg_rwstat_exit(&blkg->stat_ios);
 	blkg_rwstat_exit(&blkg->stat_bytes);
+#ifdef CONFIG_BLK_LAT_HIST
+	blk_lat_hist_free(blkg->lat_hist);
+#endif
 	kfree(blkg);
 }
 
@@ -107,6 +111,12 @@ static struct blkcg_gq *blkg_alloc(struct blkcg *blkcg, struct request_queue *q,
 	    blkg_rwstat_init(&blkg->stat_ios, gfp_mask))
 		goto err_free;
 
+#ifdef CONFIG_BLK_LAT_HIST
+	blkg->lat_hist = blk_lat_hist_alloc(gfp_mask);
+	if (!blkg->lat_hist)
+		goto err_free;
+#endif
+
 	blkg->q = q;
 	INIT_LIST_HEAD(&blkg->q_node);
 	blkg->blkcg = blkcg;
@@ -333,6 +343,9 @@ static void blkg_destroy(struct blkcg_gq *blkg)
 	if (parent) {
 		blkg_rwstat_add_aux(&parent->stat_bytes, &blkg->stat_bytes);
 		blkg_rwstat_add_aux(&parent->stat_ios, &blkg->stat_ios);
+#ifdef CONFIG_BLK_LAT_HIST
+		blk_lat_hist_transfer(parent->lat_hist, blkg->lat_hist);
+#endif
 	}
 
 	blkg->online = false;
@@ -1025,12 +1038,67 @@ static int blkcg_print_stat(struct seq_file *sf, void *v)
 	return 0;
 }
 
+#ifdef CONFIG_BLK_LAT_HIST
+/*
+ * io.lat_hist: one "<dev> <op> <bucket counts>" line for each device and
+ * kind of request the cgroup and its descendants completed.  See
+ * blk-stat.h for the bucket boundaries.
+ */
+static int blkcg_print_lat_hist(struct seq_file *sf, void *v)
+{
+	struct blkcg *blkcg = css_to_blkcg(seq_css(sf));
+	struct blk_lat_hist *hist;
+	struct blkcg_gq *blkg;
+
+	hist = kmalloc(sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return -ENOMEM;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(blkg, &blkcg->blkg_list, blkcg_node) {
+		struct cgroup_subsys_state *pos_css;
+		struct blkcg_gq *pos_blkg;
+		const char *dname;
+		char *buf;
+		size_t size = seq_get_buf(sf, &buf);
+		int written;
+
+		dname = blkg_dev_name(blkg);
+		if (!dname)
+			continue;
+
+		memset(hist, 0, sizeof(*hist));
+		spin_lock_irq(blkg->q->queue_lock);
+		blkg_for_each_descendant_pre(pos_blkg, pos_css, blkg) {
+			if (pos_blkg->online)
+				blk_lat_hist_sum(hist, pos_blkg->lat_hist);
+		}
+		spin_unlock_irq(blkg->q->queue_lock);
+
+		written = blk_lat_hist_snprintf(buf, size, dname, hist);
+		if (written)
+			seq_commit(sf, written);
+	}
+	rcu_read_unlock();
+
+	kfree(hist);
+	return 0;
+}
+#endif
+
 static struct cftype blkcg_files[] = {
 	{
 		.name = "stat",
 		.flags = CFTYPE_NOT_ON_ROOT,
 		.seq_show = blkcg_print_stat,
 	},
+#ifdef CONFIG_BLK_LAT_HIST
+	{
+		.name = "lat_hist",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = blkcg_print_lat_hist,
+	},
+#endif
 	{ }	/* terminate */
 };
 
@@ -1245,6 +1313,14 @@ int blkcg_init_queue(struct request_queue *q)
 		return ret;
 	}
 
+	ret = blk_iocost_init(q);
+	if (ret) {
+		spin_lock_irq(q->queue_lock);
+		blkg_destroy_all(q);
+		spin_unlock_irq(q->queue_lock);
+		return ret;
+	}
+
 	ret = blk_throtl_init(q);
 	if (ret) {
 		spin_lock_irq(q->queue_lock);
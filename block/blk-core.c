@@ -35,6 +35,7 @@
 #include <linux/blk-cgroup.h>
 #include <linux/debugfs.h>
 #include <linux/bpf.h>
+#include <linux/blk-crypto.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/block.h>
@@ -273,6 +274,17 @@ static void req_bio_endio(struct request *rq, struct bio *bio,
 
 	bio_advance(bio, nbytes);
 
+	if (req_op(rq) == REQ_OP_ZONE_APPEND && bio->bi_status == BLK_STS_OK) {
+		/*
+		 * Report where the data was written.  A partial completion
+		 * can't be reported, as the pieces need not be contiguous.
+		 */
+		if (bio->bi_iter.bi_size)
+			bio->bi_status = BLK_STS_IOERR;
+		else
+			bio->bi_iter.bi_sector = rq->__sector;
+	}
+
 	/* don't actually finish bio if it's part of flush sequence */
 	if (bio->bi_iter.bi_size == 0 && !(rq->rq_flags & RQF_FLUSH_SEQ))
 		bio_endio(bio);
@@ -1799,6 +1811,7 @@ bool bio_attempt_back_merge(struct request_queue *q, struct request *req,
 		return false;
 
 	trace_block_bio_backmerge(q, req, bio);
+	rq_qos_merge(q, req, bio);
 
 	if ((req->cmd_flags & REQ_FAILFAST_MASK) != ff)
 		blk_rq_set_mixed_merge(req);
@@ -1821,6 +1834,7 @@ bool bio_attempt_front_merge(struct request_queue *q, struct request *req,
 		return false;
 
 	trace_block_bio_frontmerge(q, req, bio);
+	rq_qos_merge(q, req, bio);
 
 	if ((req->cmd_flags & REQ_FAILFAST_MASK) != ff)
 		blk_rq_set_mixed_merge(req);
@@ -1847,6 +1861,8 @@ bool bio_attempt_discard_merge(struct request_queue *q, struct request *req,
 	    blk_rq_get_max_sectors(req, blk_rq_pos(req)))
 		goto no_merge;
 
+	rq_qos_merge(q, req, bio);
+
 	req->biotail->bi_next = bio;
 	req->biotail = bio;
 	req->__data_len += bio->bi_iter.bi_size;
@@ -2236,6 +2252,29 @@ static inline int blk_partition_remap(struct bio *bio)
 	return ret;
 }
 
+static inline blk_status_t blk_check_zone_append(struct request_queue *q,
+						 struct bio *bio)
+{
+	sector_t pos = bio->bi_iter.bi_sector;
+	int nr_sectors = bio_sectors(bio);
+
+	if (!blk_queue_is_zoned(q) || !q->limits.max_zone_append_sectors)
+		return BLK_STS_NOTSUPP;
+
+	/* The bio must target the start of a sequential write zone */
+	if (pos & (blk_queue_zone_sectors(q) - 1) ||
+	    !blk_queue_zone_is_seq(q, pos))
+		return BLK_STS_IOERR;
+
+	/* It can't be split, so it must fit in one command and one zone */
+	if (nr_sectors > q->limits.max_zone_append_sectors)
+		return BLK_STS_IOERR;
+
+	bio->bi_opf |= REQ_NOMERGE;
+
+	return BLK_STS_OK;
+}
+
 static noinline_for_stack bool
 generic_make_request_checks(struct bio *bio)
 {
@@ -2266,6 +2305,12 @@ generic_make_request_checks(struct bio *bio)
 		goto end_io;
 
 	if (bio->bi_partno) {
+		/*
+		 * The completion sector of a zone append is reported relative
+		 * to the whole device, so only allow them there.
+		 */
+		if (bio_op(bio) == REQ_OP_ZONE_APPEND)
+			goto not_supported;
 		if (unlikely(blk_partition_remap(bio)))
 			goto end_io;
 	} else {
@@ -2289,6 +2334,13 @@ generic_make_request_checks(struct bio *bio)
 		}
 	}
 
+	/*
+	 * Polled bios may be steered to hardware queues without completion
+	 * interrupts, so only keep the hint if the queue will be polled.
+	 */
+	if (!test_bit(QUEUE_FLAG_POLL, &q->queue_flags))
+		bio->bi_opf &= ~REQ_HIPRI;
+
 	switch (bio_op(bio)) {
 	case REQ_OP_DISCARD:
 		if (!blk_queue_discard(q))
@@ -2306,6 +2358,11 @@ generic_make_request_checks(struct bio *bio)
 		if (!blk_queue_is_zoned(q))
 			goto not_supported;
 		break;
+	case REQ_OP_ZONE_APPEND:
+		status = blk_check_zone_append(q, bio);
+		if (status != BLK_STS_OK)
+			goto end_io;
+		break;
 	case REQ_OP_WRITE_ZEROES:
 		if (!q->limits.max_write_zeroes_sectors)
 			goto not_supported;
@@ -2449,7 +2506,8 @@ blk_qc_t generic_make_request(struct bio *bio)
 			/* Create a fresh bio_list for all subordinate requests */
 			bio_list_on_stack[1] = bio_list_on_stack[0];
 			bio_list_init(&bio_list_on_stack[0]);
-			ret = q->make_request_fn(q, bio);
+			if (!blk_crypto_submit_bio(&bio))
+				ret = q->make_request_fn(q, bio);
 
 			/* sort new bios into those for a lower level
 			 * and those for the same level
@@ -2511,7 +2569,10 @@ blk_qc_t direct_make_request(struct bio *bio)
 		return BLK_QC_T_NONE;
 	}
 
-	ret = q->make_request_fn(q, bio);
+	if (!blk_crypto_submit_bio(&bio))
+		ret = q->make_request_fn(q, bio);
+	else
+		ret = BLK_QC_T_NONE;
 	blk_queue_exit(q);
 	return ret;
 }
@@ -3563,6 +3624,23 @@ EXPORT_SYMBOL(kblockd_mod_delayed_work_on);
  *   this kind of deadlock.
  */
 void blk_start_plug(struct blk_plug *plug)
+{
+	blk_start_plug_nr_ios(plug, 1);
+}
+EXPORT_SYMBOL(blk_start_plug);
+
+/**
+ * blk_start_plug_nr_ios - start a plug for a known number of I/Os
+ * @plug:	The &struct blk_plug that needs to be initialized
+ * @nr_ios:	Number of I/Os the caller expects to submit under the plug
+ *
+ * Description:
+ *   Like blk_start_plug(), but lets blk-mq allocate requests for up to
+ *   @nr_ios I/Os with the first one and cache the rest in the plug. Any
+ *   cached requests not used are freed when the plug is finished, or when
+ *   the task blocks.
+ */
+void blk_start_plug_nr_ios(struct blk_plug *plug, unsigned int nr_ios)
 {
 	struct task_struct *tsk = current;
 
@@ -3575,13 +3653,15 @@ void blk_start_plug(struct blk_plug *plug)
 	INIT_LIST_HEAD(&plug->list);
 	INIT_LIST_HEAD(&plug->mq_list);
 	INIT_LIST_HEAD(&plug->cb_list);
+	INIT_LIST_HEAD(&plug->cached_rqs);
+	plug->nr_ios = min_t(unsigned int, nr_ios, BLK_MAX_REQUEST_COUNT);
 	/*
 	 * Store ordering should not be needed here, since a potential
 	 * preempt will imply a full memory barrier
 	 */
 	tsk->plug = plug;
 }
-EXPORT_SYMBOL(blk_start_plug);
+EXPORT_SYMBOL(blk_start_plug_nr_ios);
 
 static int plug_rq_cmp(void *priv, struct list_head *a, struct list_head *b)
 {
@@ -3667,6 +3747,13 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	if (!list_empty(&plug->mq_list))
 		blk_mq_flush_plug_list(plug, from_schedule);
 
+	/*
+	 * Cached requests pin their queue, don't hold on to them while
+	 * the task sleeps.
+	 */
+	if (from_schedule && !list_empty(&plug->cached_rqs))
+		blk_mq_free_plug_rqs(plug);
+
 	if (list_empty(&plug->list))
 		return;
 
@@ -3723,6 +3810,8 @@ void blk_finish_plug(struct blk_plug *plug)
 	if (plug != current->plug)
 		return;
 	blk_flush_plug_list(plug, false);
+	if (!list_empty(&plug->cached_rqs))
+		blk_mq_free_plug_rqs(plug);
 
 	current->plug = NULL;
 }
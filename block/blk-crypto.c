@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Inline encryption support for the block layer.
+ *
+ * Upper layers attach a struct bio_crypt_ctx to a bio with
+ * bio_crypt_set_ctx().  When the bio is submitted, blk_crypto_submit_bio()
+ * either programs the key into a keyslot of the device's inline encryption
+ * hardware, or, if the device can't handle the bio's crypto mode, hands it
+ * to the crypto API fallback which en/decrypts the data in software.
+ */
+
+#define pr_fmt(fmt) "blk-crypto: " fmt
+
+#include <linux/blkdev.h>
+#include <linux/blk-crypto.h>
+#include <linux/keyslot-manager.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#include "blk-crypto-internal.h"
+
+const struct blk_crypto_mode blk_crypto_modes[] = {
+	[BLK_ENCRYPTION_MODE_AES_256_XTS] = {
+		.cipher_str = "xts(aes)",
+		.keysize = 64,
+		.ivsize = 16,
+	},
+};
+
+/* Each bvec must cover whole data units for the hardware and the fallback */
+static bool bio_crypt_check_alignment(struct bio *bio)
+{
+	const unsigned int data_unit_size =
+		bio->bi_crypt_context->bc_key->data_unit_size;
+	struct bvec_iter iter;
+	struct bio_vec bv;
+
+	bio_for_each_segment(bv, bio, iter) {
+		if (!IS_ALIGNED(bv.bv_len | bv.bv_offset, data_unit_size))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * blk_crypto_submit_bio - prepare a bio for inline encryption
+ * @bio_ptr: pointer to the bio being submitted
+ *
+ * If the bio has an encryption context, get a keyslot for its key from the
+ * device's keyslot manager, or fall back to software en/decryption if the
+ * device doesn't support the bio's crypto mode.  The fallback may replace
+ * *@bio_ptr with a bounce bio for writes.
+ *
+ * Return: 0 if *@bio_ptr should be submitted to the device.  Otherwise
+ * the bio has been completed with an error and must not be touched.
+ */
+int blk_crypto_submit_bio(struct bio **bio_ptr)
+{
+	struct bio *bio = *bio_ptr;
+	struct bio_crypt_ctx *bc = bio->bi_crypt_context;
+	struct request_queue *q;
+	int err;
+
+	if (!bc || !bio_has_data(bio))
+		return 0;
+
+	/* already handled by a higher level of a stacked device */
+	if (bc->bc_keyslot >= 0)
+		return 0;
+
+	if (!bio_crypt_check_alignment(bio)) {
+		bio->bi_status = BLK_STS_IOERR;
+		goto out_endio;
+	}
+
+	q = bio->bi_disk->queue;
+	if (keyslot_manager_crypto_mode_supported(q->ksm,
+			bc->bc_key->crypto_mode, bc->bc_key->data_unit_size)) {
+		err = bio_crypt_ctx_acquire_keyslot(bc, q->ksm);
+		if (!err)
+			return 0;
+
+		pr_warn_once("failed to acquire keyslot for %s (err=%d), falling back to crypto API\n",
+			     bio->bi_disk->disk_name, err);
+	}
+
+	err = blk_crypto_fallback_submit_bio(bio_ptr);
+	if (!err)
+		return 0;
+
+	bio = *bio_ptr;
+out_endio:
+	bio_endio(bio);
+	return -EIO;
+}
+
+/**
+ * blk_crypto_init_key() - prepare a key for use with blk-crypto
+ * @blk_key: pointer to the blk_crypto_key to initialize
+ * @raw_key: pointer to the raw key, which must be the correct size for
+ *	     @crypto_mode
+ * @crypto_mode: identifier for the encryption algorithm to use
+ * @data_unit_size: the data unit size to use for en/decryption
+ *
+ * Return: 0 on success, -errno on failure.  The caller is responsible for
+ *	   zeroizing both blk_key and raw_key when done with them.
+ */
+int blk_crypto_init_key(struct blk_crypto_key *blk_key, const u8 *raw_key,
+			enum blk_crypto_mode_num crypto_mode,
+			unsigned int data_unit_size)
+{
+	const struct blk_crypto_mode *mode;
+
+	memset(blk_key, 0, sizeof(*blk_key));
+
+	if (crypto_mode <= BLK_ENCRYPTION_MODE_INVALID ||
+	    crypto_mode >= ARRAY_SIZE(blk_crypto_modes))
+		return -EINVAL;
+
+	mode = &blk_crypto_modes[crypto_mode];
+	if (mode->keysize == 0)
+		return -EINVAL;
+
+	if (!is_power_of_2(data_unit_size))
+		return -EINVAL;
+
+	blk_key->crypto_mode = crypto_mode;
+	blk_key->data_unit_size = data_unit_size;
+	blk_key->data_unit_size_bits = ilog2(data_unit_size);
+	blk_key->size = mode->keysize;
+	memcpy(blk_key->raw, raw_key, mode->keysize);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(blk_crypto_init_key);
+
+/**
+ * blk_crypto_start_using_mode() - start using a crypto mode on a device
+ * @crypto_mode: the crypto mode that will be used
+ * @data_unit_size: the data unit size that will be used
+ * @q: the request queue for the device
+ *
+ * Upper layers must call this function before submitting bios with keys
+ * of this mode to @q.  If the device doesn't support the mode natively,
+ * this sets up the crypto API fallback for it.
+ *
+ * Return: 0 on success, -ENOPKG if the fallback is needed but disabled, or
+ * another -errno if setting up the fallback failed.
+ */
+int blk_crypto_start_using_mode(enum blk_crypto_mode_num crypto_mode,
+				unsigned int data_unit_size,
+				struct request_queue *q)
+{
+	if (keyslot_manager_crypto_mode_supported(q->ksm, crypto_mode,
+						  data_unit_size))
+		return 0;
+	return blk_crypto_fallback_start_using_mode(crypto_mode);
+}
+EXPORT_SYMBOL_GPL(blk_crypto_start_using_mode);
+
+/**
+ * blk_crypto_evict_key() - evict a key from any inline encryption hardware
+ *			    it may have been programmed into
+ * @q: the request queue the key was used with
+ * @key: the key to evict
+ *
+ * Upper layers must call this before freeing a key, once no bios using it
+ * are in flight anymore.
+ *
+ * Return: 0 on success or if the key wasn't programmed anywhere, else a
+ * negative errno.
+ */
+int blk_crypto_evict_key(struct request_queue *q,
+			 const struct blk_crypto_key *key)
+{
+	if (keyslot_manager_crypto_mode_supported(q->ksm, key->crypto_mode,
+						  key->data_unit_size))
+		return keyslot_manager_evict_key(q->ksm, key);
+
+	return blk_crypto_fallback_evict_key(key);
+}
+EXPORT_SYMBOL_GPL(blk_crypto_evict_key);
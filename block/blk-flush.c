@@ -232,7 +232,7 @@ static void flush_end_io(struct request *flush_rq, blk_status_t error)
 
 		/* release the tag's ownership to the req cloned from */
 		spin_lock_irqsave(&fq->mq_flush_lock, flags);
-		hctx = blk_mq_map_queue(q, flush_rq->mq_ctx->cpu);
+		hctx = flush_rq->mq_hctx;
 		if (!q->elevator) {
 			blk_mq_tag_set_rq(hctx, flush_rq->tag, fq->orig_rq);
 			flush_rq->tag = -1;
@@ -338,11 +338,12 @@ static bool blk_kick_flush(struct request_queue *q, struct blk_flush_queue *fq,
 		struct blk_mq_hw_ctx *hctx;
 
 		flush_rq->mq_ctx = first_rq->mq_ctx;
+		flush_rq->mq_hctx = first_rq->mq_hctx;
 
 		if (!q->elevator) {
 			fq->orig_rq = first_rq;
 			flush_rq->tag = first_rq->tag;
-			hctx = blk_mq_map_queue(q, first_rq->mq_ctx->cpu);
+			hctx = flush_rq->mq_hctx;
 			blk_mq_tag_set_rq(hctx, first_rq->tag, flush_rq);
 		} else {
 			flush_rq->internal_tag = first_rq->internal_tag;
@@ -409,7 +410,7 @@ static void mq_flush_data_end_io(struct request *rq, blk_status_t error)
 	unsigned long flags;
 	struct blk_flush_queue *fq = blk_get_flush_queue(q, ctx);
 
-	hctx = blk_mq_map_queue(q, ctx->cpu);
+	hctx = rq->mq_hctx;
 
 	if (q->elevator) {
 		WARN_ON(rq->tag < 0);
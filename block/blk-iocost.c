@@ -0,0 +1,1433 @@
+/*
+ * Block rq-qos cost model based io controller
+ *
+ * Instead of limiting the number of IOs in flight or their bandwidth, this
+ * controller estimates how much device time each IO is going to occupy and
+ * distributes that time among cgroups in proportion to their weights.
+ *
+ * 1. IO cost model
+ *
+ * The cost of an IO is estimated with a simple linear model which is
+ * configured per device through io.cost.model
+ *
+ *	MAJ:MIN rbps=N rseqiops=N rrandiops=N wbps=N wseqiops=N wrandiops=N
+ *
+ * The bps values are the sequential throughputs of large IOs and the iops
+ * values are the number of 4k IOs per second for sequential and random
+ * patterns.  These are turned into a per-page cost plus a per-IO base cost
+ * which depends on whether the IO is sequential or random, i.e. it is more
+ * than LCOEF_RANDIO_PAGES away from where the previous IO of the cgroup
+ * ended.  The numbers for a device can be measured with
+ * tools/cgroup/iocost_coef_gen.py.  The default parameters are reasonable
+ * for a generic hard disk or SSD depending on the rotational flag.
+ *
+ * 2. Virtual time
+ *
+ * Device time is distributed through a global virtual time (vtime) which
+ * advances at vrate.  Each cgroup has its own vtime cursor and an IO is
+ * issued only if the cgroup's vtime plus the cost of the IO doesn't run ahead
+ * of the global vtime.  The cost is scaled by the inverse of the cgroup's
+ * hierarchical weight (hweight), which is the share of the device it's
+ * entitled to among the cgroups which are currently issuing IOs.  A cgroup
+ * with 25% hweight thus pays four times the absolute cost for each IO and
+ * can only use a quarter of the device when everybody is busy.  A cgroup
+ * which hasn't issued IOs for a whole period is deactivated and doesn't
+ * reduce the share of others.  Its vtime budget is capped at the margin, so
+ * an idle cgroup can't save up budget and burst later.
+ *
+ * 3. vrate adjustment
+ *
+ * If the model were accurate, vrate would simply be the wallclock rate.  As
+ * it never is, the controller periodically looks at how the device is doing
+ * and adjusts vrate.  If requests waited for the device for more than
+ * RQ_WAIT_BUSY_PCT of a period or too many completions missed the latency
+ * targets configured in io.cost.qos
+ *
+ *	MAJ:MIN enable=0|1 rpct=PCT rlat=USEC wpct=PCT wlat=USEC min=PCT max=PCT
+ *
+ * the device is saturated and vrate is lowered.  If cgroups are waiting for
+ * budget while the device is meeting the targets, vrate is raised.  vrate is
+ * kept between min and max percent of the model rate.
+ *
+ * 4. Debt
+ *
+ * IOs which have to be issued as root to avoid priority inversions, IOs from
+ * tasks which are being killed and bios which are merged into existing
+ * requests can't wait.  Their cost is charged anyway, which may push the
+ * cgroup's vtime ahead of the global vtime.  The cgroup then has to wait
+ * until the debt is paid off and, like blk-iolatency, the debt is also
+ * reflected back on the offending tasks through the blkcg delay mechanism.
+ *
+ * The controller is disabled by default and io.cost.weight, the per-cgroup
+ * weight, has no effect until it's enabled on a device.
+ */
+#include <linux/kernel.h>
+#include <linux/blk_types.h>
+#include <linux/backing-dev.h>
+#include <linux/module.h>
+#include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/seqlock.h>
+#include <linux/sched/signal.h>
+#include <linux/blk-cgroup.h>
+#include "blk-rq-qos.h"
+#include "blk-stat.h"
+
+/* vtime ticks per second and derived units */
+#define VTIME_PER_SEC_SHIFT	37
+#define VTIME_PER_SEC		(1LLU << VTIME_PER_SEC_SHIFT)
+#define VTIME_PER_USEC		(VTIME_PER_SEC / USEC_PER_SEC)
+
+/* hierarchical weights are fixed point fractions of HWEIGHT_WHOLE */
+#define HWEIGHT_WHOLE		(1 << 16)
+
+#define MILLION			1000000
+
+/* bounds on vrate in percents of the model rate */
+#define VRATE_MIN_PCT		1
+#define VRATE_MAX_PCT		10000
+#define VRATE_MIN		(VTIME_PER_USEC * VRATE_MIN_PCT / 100)
+
+/* bounds on the period duration */
+#define MIN_PERIOD		USEC_PER_MSEC
+#define MAX_PERIOD		USEC_PER_SEC
+
+/* the budget an idle cgroup can keep, in percents of the period */
+#define MARGIN_PCT		50
+
+/* the device is saturated if requests wait longer than this */
+#define RQ_WAIT_BUSY_PCT	5
+
+/* and not saturated anymore below this fraction of the busy thresholds */
+#define UNBUSY_THR_PCT		75
+
+/* out-of-range vrate is brought back by this much per period */
+#define VRATE_CLAMP_ADJ_PCT	4
+
+/* IOs further away than this from the previous one are random */
+#define LCOEF_RANDIO_PAGES	4096
+
+#define IOC_PAGE_SHIFT		12
+#define IOC_PAGE_SIZE		(1 << IOC_PAGE_SHIFT)
+#define IOC_SECT_TO_PAGE_SHIFT	(IOC_PAGE_SHIFT - SECTOR_SHIFT)
+
+enum {
+	QOS_ENABLE,
+	QOS_RPCT,
+	QOS_RLAT,
+	QOS_WPCT,
+	QOS_WLAT,
+	QOS_MIN,
+	QOS_MAX,
+	NR_QOS_PARAMS,
+};
+
+enum {
+	I_LCOEF_RBPS,
+	I_LCOEF_RSEQIOPS,
+	I_LCOEF_RRANDIOPS,
+	I_LCOEF_WBPS,
+	I_LCOEF_WSEQIOPS,
+	I_LCOEF_WRANDIOPS,
+	NR_I_LCOEFS,
+};
+
+enum {
+	LCOEF_RPAGE,
+	LCOEF_RSEQIO,
+	LCOEF_RRANDIO,
+	LCOEF_WPAGE,
+	LCOEF_WSEQIO,
+	LCOEF_WRANDIO,
+	NR_LCOEFS,
+};
+
+static const char * const qos_param_names[NR_QOS_PARAMS] = {
+	[QOS_ENABLE]	= "enable",
+	[QOS_RPCT]	= "rpct",
+	[QOS_RLAT]	= "rlat",
+	[QOS_WPCT]	= "wpct",
+	[QOS_WLAT]	= "wlat",
+	[QOS_MIN]	= "min",
+	[QOS_MAX]	= "max",
+};
+
+static const char * const i_lcoef_names[NR_I_LCOEFS] = {
+	[I_LCOEF_RBPS]		= "rbps",
+	[I_LCOEF_RSEQIOPS]	= "rseqiops",
+	[I_LCOEF_RRANDIOPS]	= "rrandiops",
+	[I_LCOEF_WBPS]		= "wbps",
+	[I_LCOEF_WSEQIOPS]	= "wseqiops",
+	[I_LCOEF_WRANDIOPS]	= "wrandiops",
+};
+
+struct ioc_params {
+	u32 qos[NR_QOS_PARAMS];
+	u64 i_lcoefs[NR_I_LCOEFS];
+};
+
+/* defaults, the latency targets are in usecs */
+static const struct ioc_params ioc_params_hdd = {
+	.qos = {
+		[QOS_RLAT]	= 250000,
+		[QOS_WLAT]	= 250000,
+		[QOS_MIN]	= VRATE_MIN_PCT,
+		[QOS_MAX]	= VRATE_MAX_PCT,
+	},
+	.i_lcoefs = {
+		[I_LCOEF_RBPS]		= 174019176,
+		[I_LCOEF_RSEQIOPS]	= 41708,
+		[I_LCOEF_RRANDIOPS]	= 370,
+		[I_LCOEF_WBPS]		= 178075866,
+		[I_LCOEF_WSEQIOPS]	= 42705,
+		[I_LCOEF_WRANDIOPS]	= 378,
+	},
+};
+
+static const struct ioc_params ioc_params_ssd = {
+	.qos = {
+		[QOS_RLAT]	= 25000,
+		[QOS_WLAT]	= 25000,
+		[QOS_MIN]	= VRATE_MIN_PCT,
+		[QOS_MAX]	= VRATE_MAX_PCT,
+	},
+	.i_lcoefs = {
+		[I_LCOEF_RBPS]		= 488636629,
+		[I_LCOEF_RSEQIOPS]	= 8932,
+		[I_LCOEF_RRANDIOPS]	= 8518,
+		[I_LCOEF_WBPS]		= 427891549,
+		[I_LCOEF_WSEQIOPS]	= 28755,
+		[I_LCOEF_WRANDIOPS]	= 21940,
+	},
+};
+
+/*
+ * vrate adjustment in percents indexed by the number of consecutive periods
+ * the device has been busy or has had room to spare.
+ */
+static const u8 vrate_adj_pct[] = {
+	0, 0, 0, 0,
+	1, 1, 1, 1, 1, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2,
+	4, 4, 4, 4, 4, 4, 4, 4,
+	8, 8, 8, 8, 8, 8, 8, 8,
+	16,
+};
+
+struct ioc_missed {
+	u64 nr_met;
+	u64 nr_missed;
+	u64 last_met;
+	u64 last_missed;
+};
+
+/*
+ * The counters only ever go up and are updated locklessly on completion, the
+ * period timer keeps the last_* snapshots to calculate per-period deltas.
+ */
+struct ioc_pcpu_stat {
+	struct ioc_missed missed[2];
+	u64 rq_wait_ns;
+	u64 last_rq_wait_ns;
+};
+
+static struct blkcg_policy blkcg_policy_iocost;
+
+struct ioc {
+	struct rq_qos rqos;
+
+	bool enabled;
+	struct ioc_params params;
+	u64 lcoefs[NR_LCOEFS];
+
+	/* everything below is protected by lock */
+	spinlock_t lock;
+	struct timer_list timer;
+	bool running;
+	struct list_head active_iocgs;
+	u64 cur_period;
+	u32 period_us;
+	u64 margin_us;
+	u64 vrate_min;
+	u64 vrate_max;
+	u32 rlat_ns;
+	u32 wlat_ns;
+	int busy_level;
+
+	/* period_at, period_at_vtime and vtime_rate are under period_seqcount */
+	seqcount_t period_seqcount;
+	u64 period_at;
+	u64 period_at_vtime;
+	atomic64_t vtime_rate;
+
+	atomic_t hweight_gen;
+
+	struct ioc_pcpu_stat __percpu *pcpu_stat;
+};
+
+struct ioc_gq {
+	struct blkg_policy_data pd;
+	struct ioc *ioc;
+
+	/* configured weight, 0 means the cgroup default is used */
+	u32 cfg_weight;
+	u32 weight;
+
+	/*
+	 * active_weight is the weight this group contributes to its parent's
+	 * child_active_sum, non-zero while it or any of its descendants is
+	 * issuing IOs.  Both are protected by ioc->lock.
+	 */
+	u32 active_weight;
+	u32 child_active_sum;
+	struct list_head active_list;
+	u64 active_period;
+
+	/* cached hierarchical weight, valid while hweight_gen matches */
+	int hweight_gen;
+	u32 hweight;
+
+	atomic64_t vtime;
+	sector_t cursor;
+	atomic_t indelay;
+
+	wait_queue_head_t waitq;
+	struct hrtimer waitq_timer;
+
+	/* statistics */
+	atomic64_t abs_usage;
+	atomic64_t wait_ns;
+};
+
+struct iocg_cgrp {
+	struct blkcg_policy_data cpd;
+	u32 dfl_weight;
+};
+
+struct ioc_now {
+	u64 now_ns;
+	u64 now;
+	u64 vnow;
+	u64 vrate;
+};
+
+static inline struct ioc *rqos_to_ioc(struct rq_qos *rqos)
+{
+	return container_of(rqos, struct ioc, rqos);
+}
+
+static inline struct ioc *q_to_ioc(struct request_queue *q)
+{
+	struct rq_qos *rqos = rq_qos_id(q, RQ_QOS_COST);
+
+	return rqos ? rqos_to_ioc(rqos) : NULL;
+}
+
+static inline struct ioc_gq *pd_to_iocg(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct ioc_gq, pd) : NULL;
+}
+
+static inline struct ioc_gq *blkg_to_iocg(struct blkcg_gq *blkg)
+{
+	return pd_to_iocg(blkg_to_pd(blkg, &blkcg_policy_iocost));
+}
+
+static inline struct blkcg_gq *iocg_to_blkg(struct ioc_gq *iocg)
+{
+	return pd_to_blkg(&iocg->pd);
+}
+
+static inline struct ioc_gq *iocg_parent(struct ioc_gq *iocg)
+{
+	struct blkcg_gq *parent = iocg_to_blkg(iocg)->parent;
+
+	return parent ? blkg_to_iocg(parent) : NULL;
+}
+
+static inline struct iocg_cgrp *blkcg_to_iocc(struct blkcg *blkcg)
+{
+	return container_of(blkcg_to_cpd(blkcg, &blkcg_policy_iocost),
+			    struct iocg_cgrp, cpd);
+}
+
+static void calc_lcoefs(u64 bps, u64 seqiops, u64 randiops,
+			u64 *page, u64 *seqio, u64 *randio)
+{
+	u64 v;
+
+	*page = *seqio = *randio = 0;
+
+	if (bps)
+		*page = DIV64_U64_ROUND_UP(VTIME_PER_SEC,
+					   DIV_ROUND_UP_ULL(bps, IOC_PAGE_SIZE));
+
+	/* the iops are for 4k IOs, the page cost is already included */
+	if (seqiops) {
+		v = DIV64_U64_ROUND_UP(VTIME_PER_SEC, seqiops);
+		if (v > *page)
+			*seqio = v - *page;
+	}
+
+	if (randiops) {
+		v = DIV64_U64_ROUND_UP(VTIME_PER_SEC, randiops);
+		if (v > *page)
+			*randio = v - *page;
+	}
+}
+
+/* called with ioc->lock held or before the ioc is visible */
+static void ioc_refresh_params(struct ioc *ioc)
+{
+	struct ioc_params *p = &ioc->params;
+	u32 ppm, lat, multi;
+
+	calc_lcoefs(p->i_lcoefs[I_LCOEF_RBPS], p->i_lcoefs[I_LCOEF_RSEQIOPS],
+		    p->i_lcoefs[I_LCOEF_RRANDIOPS], &ioc->lcoefs[LCOEF_RPAGE],
+		    &ioc->lcoefs[LCOEF_RSEQIO], &ioc->lcoefs[LCOEF_RRANDIO]);
+	calc_lcoefs(p->i_lcoefs[I_LCOEF_WBPS], p->i_lcoefs[I_LCOEF_WSEQIOPS],
+		    p->i_lcoefs[I_LCOEF_WRANDIOPS], &ioc->lcoefs[LCOEF_WPAGE],
+		    &ioc->lcoefs[LCOEF_WSEQIO], &ioc->lcoefs[LCOEF_WRANDIO]);
+
+	ioc->rlat_ns = p->qos[QOS_RLAT] * NSEC_PER_USEC;
+	ioc->wlat_ns = p->qos[QOS_WLAT] * NSEC_PER_USEC;
+	ioc->vrate_min = div_u64(VTIME_PER_USEC * p->qos[QOS_MIN], 100);
+	ioc->vrate_max = div_u64(VTIME_PER_USEC * p->qos[QOS_MAX], 100);
+
+	/*
+	 * The period should be long enough to collect a meaningful number of
+	 * completions for the strictest percentile target.
+	 */
+	if (p->qos[QOS_RPCT] && p->qos[QOS_RPCT] >= p->qos[QOS_WPCT]) {
+		ppm = p->qos[QOS_RPCT] * 10000;
+		lat = p->qos[QOS_RLAT];
+	} else if (p->qos[QOS_WPCT]) {
+		ppm = p->qos[QOS_WPCT] * 10000;
+		lat = p->qos[QOS_WLAT];
+	} else {
+		ppm = 0;
+		lat = max(p->qos[QOS_RLAT], p->qos[QOS_WLAT]);
+	}
+
+	multi = ppm ? max_t(u32, (MILLION - ppm) / 50000, 2) : 2;
+	ioc->period_us = clamp_t(u32, multi * lat, MIN_PERIOD, MAX_PERIOD);
+	ioc->margin_us = ioc->period_us * MARGIN_PCT / 100;
+}
+
+static void ioc_now(struct ioc *ioc, struct ioc_now *now)
+{
+	unsigned int seq;
+
+	now->now_ns = ktime_get_ns();
+	now->now = div_u64(now->now_ns, NSEC_PER_USEC);
+
+	do {
+		seq = read_seqcount_begin(&ioc->period_seqcount);
+		now->vrate = atomic64_read(&ioc->vtime_rate);
+		now->vnow = ioc->period_at_vtime;
+		if (now->now > ioc->period_at)
+			now->vnow += (now->now - ioc->period_at) * now->vrate;
+	} while (read_seqcount_retry(&ioc->period_seqcount, seq));
+}
+
+static void ioc_start_period(struct ioc *ioc, struct ioc_now *now, u64 vrate)
+{
+	lockdep_assert_held(&ioc->lock);
+
+	write_seqcount_begin(&ioc->period_seqcount);
+	ioc->period_at = now->now;
+	ioc->period_at_vtime = now->vnow;
+	atomic64_set(&ioc->vtime_rate, vrate);
+	write_seqcount_end(&ioc->period_seqcount);
+
+	ioc->running = true;
+	mod_timer(&ioc->timer, jiffies + usecs_to_jiffies(ioc->period_us));
+}
+
+/* the lowest vtime a group can have, i.e. its maximum budget is the margin */
+static inline u64 ioc_vmin(struct ioc *ioc, struct ioc_now *now)
+{
+	u64 vmargin = ioc->margin_us * now->vrate;
+
+	return now->vnow > vmargin ? now->vnow - vmargin : 0;
+}
+
+/*
+ * Update the active weight contributions from @iocg up to the root after
+ * @iocg got activated or deactivated or its weight changed.
+ */
+static void propagate_active_weight(struct ioc_gq *iocg)
+{
+	struct ioc *ioc = iocg->ioc;
+	struct ioc_gq *parent;
+
+	lockdep_assert_held(&ioc->lock);
+
+	for (; (parent = iocg_parent(iocg)); iocg = parent) {
+		bool active = !list_empty(&iocg->active_list) ||
+			      iocg->child_active_sum;
+		u32 new = active ? iocg->weight : 0;
+
+		if (new == iocg->active_weight)
+			break;
+
+		parent->child_active_sum -= iocg->active_weight;
+		parent->child_active_sum += new;
+		iocg->active_weight = new;
+	}
+
+	atomic_inc(&ioc->hweight_gen);
+}
+
+static u32 current_hweight(struct ioc_gq *iocg)
+{
+	int gen = atomic_read(&iocg->ioc->hweight_gen);
+	struct ioc_gq *child, *parent;
+	u64 hw = HWEIGHT_WHOLE;
+
+	if (gen == READ_ONCE(iocg->hweight_gen))
+		return READ_ONCE(iocg->hweight);
+
+	/*
+	 * Walked without ioc->lock, a racing activation may make the result
+	 * slightly off which is fine as it's recalculated on the next
+	 * generation change.
+	 */
+	for (child = iocg; (parent = iocg_parent(child)); child = parent) {
+		u32 weight = READ_ONCE(child->active_weight) ?: child->weight;
+		u32 sum = max(READ_ONCE(parent->child_active_sum), weight);
+
+		hw = div_u64(hw * weight, sum);
+	}
+
+	WRITE_ONCE(iocg->hweight, max_t(u32, hw, 1));
+	WRITE_ONCE(iocg->hweight_gen, gen);
+	return iocg->hweight;
+}
+
+static void iocg_activate(struct ioc_gq *iocg, struct ioc_now *now)
+{
+	struct ioc *ioc = iocg->ioc;
+	unsigned long flags;
+
+	WRITE_ONCE(iocg->active_period, READ_ONCE(ioc->cur_period));
+	if (!list_empty(&iocg->active_list))
+		return;
+
+	spin_lock_irqsave(&ioc->lock, flags);
+	if (list_empty(&iocg->active_list)) {
+		list_add(&iocg->active_list, &ioc->active_iocgs);
+		propagate_active_weight(iocg);
+		iocg->active_period = ioc->cur_period;
+
+		if (!ioc->running) {
+			ioc_now(ioc, now);
+			ioc_start_period(ioc, now, now->vrate);
+		}
+	}
+	spin_unlock_irqrestore(&ioc->lock, flags);
+}
+
+static void iocg_deactivate(struct ioc_gq *iocg)
+{
+	lockdep_assert_held(&iocg->ioc->lock);
+
+	list_del_init(&iocg->active_list);
+	propagate_active_weight(iocg);
+
+	if (atomic_xchg(&iocg->indelay, 0))
+		blkcg_clear_delay(iocg_to_blkg(iocg));
+}
+
+static u64 abs_cost_to_cost(u64 abs_cost, u32 hw)
+{
+	return DIV64_U64_ROUND_UP(abs_cost * HWEIGHT_WHOLE, hw);
+}
+
+static u64 calc_vtime_cost(struct ioc *ioc, struct ioc_gq *iocg,
+			   struct bio *bio, bool is_merge)
+{
+	u64 pages = max_t(u64, bio_sectors(bio) >> IOC_SECT_TO_PAGE_SHIFT, 1);
+	u64 coef_seqio, coef_randio, coef_page;
+	sector_t sector = bio->bi_iter.bi_sector;
+	sector_t cursor = READ_ONCE(iocg->cursor);
+	u64 seek_pages, cost = 0;
+
+	switch (bio_op(bio)) {
+	case REQ_OP_READ:
+		coef_seqio = ioc->lcoefs[LCOEF_RSEQIO];
+		coef_randio = ioc->lcoefs[LCOEF_RRANDIO];
+		coef_page = ioc->lcoefs[LCOEF_RPAGE];
+		break;
+	case REQ_OP_WRITE:
+		coef_seqio = ioc->lcoefs[LCOEF_WSEQIO];
+		coef_randio = ioc->lcoefs[LCOEF_WRANDIO];
+		coef_page = ioc->lcoefs[LCOEF_WPAGE];
+		break;
+	default:
+		return 0;
+	}
+
+	/* merged bios ride on an IO which already paid the base cost */
+	if (!is_merge) {
+		seek_pages = sector > cursor ? sector - cursor : cursor - sector;
+		seek_pages >>= IOC_SECT_TO_PAGE_SHIFT;
+
+		if (cursor && seek_pages <= LCOEF_RANDIO_PAGES)
+			cost += coef_seqio;
+		else
+			cost += coef_randio;
+	}
+
+	return cost + pages * coef_page;
+}
+
+/*
+ * Charge @cost to @iocg if it fits in the budget.  vtime which lags behind by
+ * more than the margin is forwarded first so that idle groups can't hoard
+ * budget.
+ */
+static bool iocg_try_charge(struct ioc_gq *iocg, u64 cost,
+			    struct ioc_now *now)
+{
+	u64 vmin = ioc_vmin(iocg->ioc, now);
+	s64 vtime = atomic64_read(&iocg->vtime);
+
+	do {
+		u64 base = max_t(u64, vtime, vmin);
+
+		if (base + cost > now->vnow)
+			return false;
+		if (atomic64_try_cmpxchg(&iocg->vtime, &vtime, base + cost))
+			break;
+	} while (1);
+
+	return true;
+}
+
+/* charge @cost unconditionally, the group may go into debt */
+static void iocg_charge_debt(struct ioc_gq *iocg, u64 cost,
+			     struct ioc_now *now)
+{
+	u64 vmin = ioc_vmin(iocg->ioc, now);
+	s64 vtime = atomic64_read(&iocg->vtime);
+
+	while (vtime < vmin &&
+	       !atomic64_try_cmpxchg(&iocg->vtime, &vtime, vmin))
+		;
+	atomic64_add(cost, &iocg->vtime);
+}
+
+static void iocg_kick_waitq_timer(struct ioc_gq *iocg, u64 target,
+				  struct ioc_now *now)
+{
+	u64 delta_us = 1;
+	ktime_t expires;
+	unsigned long flags;
+
+	if (target > now->vnow)
+		delta_us = DIV64_U64_ROUND_UP(target - now->vnow, now->vrate);
+	expires = ns_to_ktime(now->now_ns + delta_us * NSEC_PER_USEC);
+
+	spin_lock_irqsave(&iocg->waitq.lock, flags);
+	if (!hrtimer_is_queued(&iocg->waitq_timer) ||
+	    ktime_before(expires, hrtimer_get_expires(&iocg->waitq_timer)))
+		hrtimer_start(&iocg->waitq_timer, expires, HRTIMER_MODE_ABS);
+	spin_unlock_irqrestore(&iocg->waitq.lock, flags);
+}
+
+static enum hrtimer_restart iocg_waitq_timer_fn(struct hrtimer *timer)
+{
+	struct ioc_gq *iocg = container_of(timer, struct ioc_gq, waitq_timer);
+
+	wake_up_all(&iocg->waitq);
+	return HRTIMER_NORESTART;
+}
+
+static struct blkcg_gq *ioc_bio_blkg(struct request_queue *q, struct bio *bio,
+				     spinlock_t *lock)
+{
+	struct blkcg *blkcg;
+	struct blkcg_gq *blkg;
+
+	rcu_read_lock();
+	blkcg = bio_blkcg(bio);
+	bio_associate_blkcg(bio, &blkcg->css);
+	blkg = blkg_lookup(blkcg, q);
+	if (unlikely(!blkg)) {
+		if (!lock)
+			spin_lock_irq(q->queue_lock);
+		blkg = blkg_lookup_create(blkcg, q);
+		if (IS_ERR(blkg))
+			blkg = NULL;
+		if (!lock)
+			spin_unlock_irq(q->queue_lock);
+	}
+	if (blkg)
+		bio_associate_blkg(bio, blkg);
+	rcu_read_unlock();
+
+	return blkg;
+}
+
+static void ioc_rqos_throttle(struct rq_qos *rqos, struct bio *bio,
+			      spinlock_t *lock)
+{
+	struct ioc *ioc = rqos_to_ioc(rqos);
+	struct blkcg_gq *blkg;
+	struct ioc_gq *iocg;
+	struct ioc_now now;
+	u64 abs_cost, cost;
+	DEFINE_WAIT(wait);
+
+	if (!READ_ONCE(ioc->enabled))
+		return;
+
+	blkg = ioc_bio_blkg(rqos->q, bio, lock);
+	if (!blkg || !blkg->parent)
+		return;
+	iocg = blkg_to_iocg(blkg);
+	if (!iocg)
+		return;
+
+	abs_cost = calc_vtime_cost(ioc, iocg, bio, false);
+	if (!abs_cost)
+		return;
+
+	WRITE_ONCE(iocg->cursor, bio_end_sector(bio));
+	ioc_now(ioc, &now);
+	iocg_activate(iocg, &now);
+	atomic64_add(abs_cost, &iocg->abs_usage);
+
+	/*
+	 * Nobody else is waiting and the budget is there, the fast path.
+	 * Waiters are served in order, don't cut in front of them.
+	 */
+	cost = abs_cost_to_cost(abs_cost, current_hweight(iocg));
+	if (!waitqueue_active(&iocg->waitq) &&
+	    iocg_try_charge(iocg, cost, &now))
+		return;
+
+	/*
+	 * Throttling IOs which are issued on behalf of the root cgroup or by
+	 * a dying task would lead to priority inversions, charge them and
+	 * make the task pay back on its way out to userland instead.
+	 */
+	if (bio_issue_as_root_blkg(bio) || fatal_signal_pending(current)) {
+		iocg_charge_debt(iocg, cost, &now);
+		if (!atomic_xchg(&iocg->indelay, 1))
+			blkcg_use_delay(blkg);
+		blkcg_add_delay(blkg, now.now_ns,
+				div64_u64(cost * NSEC_PER_USEC, now.vrate));
+		blkcg_schedule_throttle(rqos->q,
+					(bio->bi_opf & REQ_SWAP) == REQ_SWAP);
+		return;
+	}
+
+	do {
+		prepare_to_wait_exclusive(&iocg->waitq, &wait,
+					  TASK_UNINTERRUPTIBLE);
+
+		ioc_now(ioc, &now);
+		cost = abs_cost_to_cost(abs_cost, current_hweight(iocg));
+		if (!READ_ONCE(ioc->enabled) ||
+		    iocg_try_charge(iocg, cost, &now))
+			break;
+
+		iocg_kick_waitq_timer(iocg, atomic64_read(&iocg->vtime) + cost,
+				      &now);
+
+		if (lock)
+			spin_unlock_irq(lock);
+		io_schedule();
+		if (lock)
+			spin_lock_irq(lock);
+	} while (1);
+
+	finish_wait(&iocg->waitq, &wait);
+	atomic64_add(ktime_get_ns() - now.now_ns, &iocg->wait_ns);
+
+	/* let the next waiter have a go at the remaining budget */
+	wake_up(&iocg->waitq);
+}
+
+static void ioc_rqos_merge(struct rq_qos *rqos, struct request *rq,
+			   struct bio *bio)
+{
+	struct ioc *ioc = rqos_to_ioc(rqos);
+	struct blkcg_gq *blkg;
+	struct ioc_gq *iocg;
+	struct ioc_now now;
+	u64 abs_cost;
+
+	if (!READ_ONCE(ioc->enabled))
+		return;
+
+	/* we can't sleep here, charge the bio and let it accrue debt */
+	rcu_read_lock();
+	blkg = bio->bi_blkg ?: blkg_lookup(bio_blkcg(bio), rqos->q);
+	iocg = blkg && blkg->parent ? blkg_to_iocg(blkg) : NULL;
+	if (iocg) {
+		abs_cost = calc_vtime_cost(ioc, iocg, bio, true);
+		if (abs_cost) {
+			ioc_now(ioc, &now);
+			iocg_activate(iocg, &now);
+			atomic64_add(abs_cost, &iocg->abs_usage);
+			iocg_charge_debt(iocg, abs_cost_to_cost(abs_cost,
+						current_hweight(iocg)), &now);
+		}
+	}
+	rcu_read_unlock();
+}
+
+static void ioc_rqos_done(struct rq_qos *rqos, struct request *rq)
+{
+	struct ioc *ioc = rqos_to_ioc(rqos);
+	u64 now, on_q_ns, lat_ns;
+	int rw;
+
+	if (!READ_ONCE(ioc->enabled) || !rq->io_start_time_ns)
+		return;
+
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+		rw = READ;
+		lat_ns = ioc->rlat_ns;
+		break;
+	case REQ_OP_WRITE:
+		rw = WRITE;
+		lat_ns = ioc->wlat_ns;
+		break;
+	default:
+		return;
+	}
+
+	now = ktime_get_ns();
+	if (now < rq->io_start_time_ns)
+		return;
+	on_q_ns = now - rq->io_start_time_ns;
+
+	if (on_q_ns <= lat_ns)
+		this_cpu_inc(ioc->pcpu_stat->missed[rw].nr_met);
+	else
+		this_cpu_inc(ioc->pcpu_stat->missed[rw].nr_missed);
+
+	/* how long the request waited for the device to take it */
+	if (rq->io_start_time_ns > rq->start_time_ns)
+		this_cpu_add(ioc->pcpu_stat->rq_wait_ns,
+			     rq->io_start_time_ns - rq->start_time_ns);
+}
+
+static void ioc_rqos_exit(struct rq_qos *rqos)
+{
+	struct ioc *ioc = rqos_to_ioc(rqos);
+
+	spin_lock_irq(&ioc->lock);
+	ioc->running = false;
+	spin_unlock_irq(&ioc->lock);
+	del_timer_sync(&ioc->timer);
+
+	blkcg_deactivate_policy(rqos->q, &blkcg_policy_iocost);
+	free_percpu(ioc->pcpu_stat);
+	kfree(ioc);
+}
+
+static struct rq_qos_ops ioc_rqos_ops = {
+	.throttle = ioc_rqos_throttle,
+	.merge = ioc_rqos_merge,
+	.done = ioc_rqos_done,
+	.exit = ioc_rqos_exit,
+};
+
+/* collect the completion stats of the last period */
+static void ioc_lat_stat(struct ioc *ioc, u32 *missed_ppm, u32 *rq_wait_pct)
+{
+	u64 nr_met[2] = { 0, 0 }, nr_missed[2] = { 0, 0 }, rq_wait_ns = 0;
+	int cpu, rw;
+
+	for_each_possible_cpu(cpu) {
+		struct ioc_pcpu_stat *stat = per_cpu_ptr(ioc->pcpu_stat, cpu);
+		u64 this_rq_wait_ns;
+
+		for (rw = READ; rw <= WRITE; rw++) {
+			struct ioc_missed *m = &stat->missed[rw];
+			u64 this_met = READ_ONCE(m->nr_met);
+			u64 this_missed = READ_ONCE(m->nr_missed);
+
+			nr_met[rw] += this_met - m->last_met;
+			nr_missed[rw] += this_missed - m->last_missed;
+			m->last_met = this_met;
+			m->last_missed = this_missed;
+		}
+
+		this_rq_wait_ns = READ_ONCE(stat->rq_wait_ns);
+		rq_wait_ns += this_rq_wait_ns - stat->last_rq_wait_ns;
+		stat->last_rq_wait_ns = this_rq_wait_ns;
+	}
+
+	for (rw = READ; rw <= WRITE; rw++) {
+		if (nr_met[rw] + nr_missed[rw])
+			missed_ppm[rw] = DIV64_U64_ROUND_UP(nr_missed[rw] * MILLION,
+						nr_met[rw] + nr_missed[rw]);
+		else
+			missed_ppm[rw] = 0;
+	}
+
+	*rq_wait_pct = div64_u64(rq_wait_ns * 100,
+				 (u64)ioc->period_us * NSEC_PER_USEC);
+}
+
+static void ioc_timer_fn(struct timer_list *t)
+{
+	struct ioc *ioc = from_timer(ioc, t, timer);
+	struct ioc_gq *iocg, *tiocg;
+	struct ioc_now now;
+	u32 ppm_rthr = (100 - ioc->params.qos[QOS_RPCT]) * 10000;
+	u32 ppm_wthr = (100 - ioc->params.qos[QOS_WPCT]) * 10000;
+	u32 missed_ppm[2], rq_wait_pct;
+	int nr_shortages = 0;
+	u64 vrate;
+
+	ioc_lat_stat(ioc, missed_ppm, &rq_wait_pct);
+
+	spin_lock_irq(&ioc->lock);
+
+	if (!ioc->running)
+		goto out_unlock;
+
+	ioc_now(ioc, &now);
+
+	list_for_each_entry_safe(iocg, tiocg, &ioc->active_iocgs, active_list) {
+		if (waitqueue_active(&iocg->waitq)) {
+			/* weights or vrate may have changed, re-evaluate */
+			nr_shortages++;
+			wake_up_all(&iocg->waitq);
+		} else if (iocg->active_period != ioc->cur_period) {
+			/* idle for a whole period */
+			iocg_deactivate(iocg);
+			continue;
+		}
+
+		if (atomic_read(&iocg->indelay) &&
+		    atomic64_read(&iocg->vtime) <= now.vnow) {
+			atomic_set(&iocg->indelay, 0);
+			blkcg_clear_delay(iocg_to_blkg(iocg));
+		}
+	}
+	ioc->cur_period++;
+
+	if (rq_wait_pct > RQ_WAIT_BUSY_PCT ||
+	    missed_ppm[READ] > ppm_rthr || missed_ppm[WRITE] > ppm_wthr) {
+		ioc->busy_level = max(ioc->busy_level, 0) + 1;
+	} else if (nr_shortages &&
+		   rq_wait_pct <= RQ_WAIT_BUSY_PCT * UNBUSY_THR_PCT / 100 &&
+		   missed_ppm[READ] <= ppm_rthr * UNBUSY_THR_PCT / 100 &&
+		   missed_ppm[WRITE] <= ppm_wthr * UNBUSY_THR_PCT / 100) {
+		ioc->busy_level = min(ioc->busy_level, 0) - 1;
+	} else {
+		ioc->busy_level = 0;
+	}
+	ioc->busy_level = clamp(ioc->busy_level, -1000, 1000);
+
+	vrate = now.vrate;
+	if (ioc->busy_level) {
+		u64 vrate_min = ioc->vrate_min;
+		int idx = min_t(int, abs(ioc->busy_level),
+				ARRAY_SIZE(vrate_adj_pct) - 1);
+		u32 adj_pct = vrate_adj_pct[idx];
+
+		/* requests piling up is a reliable signal, ignore min */
+		if (rq_wait_pct > RQ_WAIT_BUSY_PCT)
+			vrate_min = VRATE_MIN;
+
+		if (ioc->busy_level > 0)
+			adj_pct = 100 - adj_pct;
+		else
+			adj_pct = 100 + adj_pct;
+
+		vrate = clamp(DIV64_U64_ROUND_UP(vrate * adj_pct, 100),
+			      vrate_min, ioc->vrate_max);
+	} else if (vrate < ioc->vrate_min) {
+		vrate = min(div64_u64(vrate * (100 + VRATE_CLAMP_ADJ_PCT), 100),
+			    ioc->vrate_min);
+	} else if (vrate > ioc->vrate_max) {
+		vrate = max(div64_u64(vrate * (100 - VRATE_CLAMP_ADJ_PCT), 100),
+			    ioc->vrate_max);
+	}
+
+	if (!list_empty(&ioc->active_iocgs))
+		ioc_start_period(ioc, &now, max_t(u64, vrate, VRATE_MIN));
+	else
+		ioc->running = false;
+
+out_unlock:
+	spin_unlock_irq(&ioc->lock);
+}
+
+int blk_iocost_init(struct request_queue *q)
+{
+	struct ioc *ioc;
+	struct rq_qos *rqos;
+	int ret;
+
+	ioc = kzalloc(sizeof(*ioc), GFP_KERNEL);
+	if (!ioc)
+		return -ENOMEM;
+
+	ioc->pcpu_stat = alloc_percpu(struct ioc_pcpu_stat);
+	if (!ioc->pcpu_stat) {
+		kfree(ioc);
+		return -ENOMEM;
+	}
+
+	rqos = &ioc->rqos;
+	rqos->id = RQ_QOS_COST;
+	rqos->ops = &ioc_rqos_ops;
+	rqos->q = q;
+
+	spin_lock_init(&ioc->lock);
+	timer_setup(&ioc->timer, ioc_timer_fn, 0);
+	INIT_LIST_HEAD(&ioc->active_iocgs);
+	seqcount_init(&ioc->period_seqcount);
+	atomic64_set(&ioc->vtime_rate, VTIME_PER_USEC);
+	ioc->period_at = div_u64(ktime_get_ns(), NSEC_PER_USEC);
+
+	if (blk_queue_nonrot(q))
+		ioc->params = ioc_params_ssd;
+	else
+		ioc->params = ioc_params_hdd;
+	ioc_refresh_params(ioc);
+
+	rq_qos_add(q, rqos);
+
+	ret = blkcg_activate_policy(q, &blkcg_policy_iocost);
+	if (ret) {
+		rq_qos_del(q, rqos);
+		free_percpu(ioc->pcpu_stat);
+		kfree(ioc);
+		return ret;
+	}
+
+	return 0;
+}
+
+static void ioc_enable(struct ioc *ioc, bool enable)
+{
+	struct ioc_gq *iocg;
+
+	lockdep_assert_held(&ioc->lock);
+
+	if (enable == ioc->enabled)
+		return;
+
+	/* release everybody on disable, the waiters check ->enabled */
+	if (!enable)
+		list_for_each_entry(iocg, &ioc->active_iocgs, active_list)
+			wake_up_all(&iocg->waitq);
+	WRITE_ONCE(ioc->enabled, enable);
+}
+
+static struct blkcg_policy_data *ioc_cpd_alloc(gfp_t gfp)
+{
+	struct iocg_cgrp *iocc;
+
+	iocc = kzalloc(sizeof(*iocc), gfp);
+	if (!iocc)
+		return NULL;
+	return &iocc->cpd;
+}
+
+static void ioc_cpd_init(struct blkcg_policy_data *cpd)
+{
+	container_of(cpd, struct iocg_cgrp, cpd)->dfl_weight =
+		CGROUP_WEIGHT_DFL;
+}
+
+static void ioc_cpd_free(struct blkcg_policy_data *cpd)
+{
+	kfree(container_of(cpd, struct iocg_cgrp, cpd));
+}
+
+static struct blkg_policy_data *ioc_pd_alloc(gfp_t gfp, int node)
+{
+	struct ioc_gq *iocg;
+
+	iocg = kzalloc_node(sizeof(*iocg), gfp, node);
+	if (!iocg)
+		return NULL;
+	return &iocg->pd;
+}
+
+static void ioc_pd_init(struct blkg_policy_data *pd)
+{
+	struct ioc_gq *iocg = pd_to_iocg(pd);
+	struct blkcg_gq *blkg = iocg_to_blkg(iocg);
+	struct ioc *ioc = q_to_ioc(blkg->q);
+
+	iocg->ioc = ioc;
+	iocg->weight = blkcg_to_iocc(blkg->blkcg)->dfl_weight;
+	INIT_LIST_HEAD(&iocg->active_list);
+	iocg->hweight_gen = atomic_read(&ioc->hweight_gen) - 1;
+	atomic64_set(&iocg->vtime, 0);
+	init_waitqueue_head(&iocg->waitq);
+	hrtimer_init(&iocg->waitq_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	iocg->waitq_timer.function = iocg_waitq_timer_fn;
+}
+
+static void ioc_pd_offline(struct blkg_policy_data *pd)
+{
+	struct ioc_gq *iocg = pd_to_iocg(pd);
+	struct ioc *ioc = iocg->ioc;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ioc->lock, flags);
+	if (!list_empty(&iocg->active_list))
+		iocg_deactivate(iocg);
+	spin_unlock_irqrestore(&ioc->lock, flags);
+
+	hrtimer_cancel(&iocg->waitq_timer);
+}
+
+static void ioc_pd_free(struct blkg_policy_data *pd)
+{
+	kfree(pd_to_iocg(pd));
+}
+
+static size_t ioc_pd_stat(struct blkg_policy_data *pd, char *buf, size_t size)
+{
+	struct ioc_gq *iocg = pd_to_iocg(pd);
+	struct ioc *ioc = iocg->ioc;
+	struct ioc_now now;
+	u64 vtime, debt_us = 0;
+
+	if (!ioc->enabled)
+		return 0;
+
+	if (!iocg_to_blkg(iocg)->parent)
+		return scnprintf(buf, size, " cost.vrate=%llu",
+				 div64_u64(atomic64_read(&ioc->vtime_rate) * 100,
+					   VTIME_PER_USEC));
+
+	/* debt is how long the group has to wait before it can issue again */
+	ioc_now(ioc, &now);
+	vtime = atomic64_read(&iocg->vtime);
+	if (vtime > now.vnow)
+		debt_us = div64_u64(vtime - now.vnow, now.vrate);
+
+	return scnprintf(buf, size, " cost.usage=%llu cost.wait=%llu cost.debt=%llu",
+			 div64_u64(atomic64_read(&iocg->abs_usage),
+				   VTIME_PER_USEC),
+			 div64_u64(atomic64_read(&iocg->wait_ns),
+				   NSEC_PER_USEC),
+			 debt_us);
+}
+
+static void ioc_weight_update(struct ioc_gq *iocg, u32 weight)
+{
+	struct ioc *ioc = iocg->ioc;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ioc->lock, flags);
+	iocg->weight = weight;
+	if (iocg->active_weight)
+		propagate_active_weight(iocg);
+	spin_unlock_irqrestore(&ioc->lock, flags);
+}
+
+static u64 ioc_weight_prfill(struct seq_file *sf, struct blkg_policy_data *pd,
+			     int off)
+{
+	const char *dname = blkg_dev_name(pd->blkg);
+	struct ioc_gq *iocg = pd_to_iocg(pd);
+
+	if (dname && iocg->cfg_weight)
+		seq_printf(sf, "%s %u\n", dname, iocg->cfg_weight);
+	return 0;
+}
+
+static int ioc_weight_show(struct seq_file *sf, void *v)
+{
+	struct blkcg *blkcg = css_to_blkcg(seq_css(sf));
+
+	seq_printf(sf, "default %u\n", blkcg_to_iocc(blkcg)->dfl_weight);
+	blkcg_print_blkgs(sf, blkcg, ioc_weight_prfill,
+			  &blkcg_policy_iocost, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static ssize_t ioc_weight_write(struct kernfs_open_file *of, char *buf,
+				size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct iocg_cgrp *iocc = blkcg_to_iocc(blkcg);
+	struct blkg_conf_ctx ctx;
+	struct ioc_gq *iocg;
+	char *endp;
+	u32 v;
+	int ret;
+
+	buf = strim(buf);
+
+	/* "WEIGHT" or "default WEIGHT" sets the default weight */
+	v = simple_strtoul(buf, &endp, 0);
+	if (*endp == '\0' || sscanf(buf, "default %u", &v) == 1) {
+		struct blkcg_gq *blkg;
+
+		if (v < CGROUP_WEIGHT_MIN || v > CGROUP_WEIGHT_MAX)
+			return -EINVAL;
+
+		spin_lock_irq(&blkcg->lock);
+		iocc->dfl_weight = v;
+		hlist_for_each_entry(blkg, &blkcg->blkg_list, blkcg_node) {
+			iocg = blkg_to_iocg(blkg);
+			if (iocg && !iocg->cfg_weight)
+				ioc_weight_update(iocg, v);
+		}
+		spin_unlock_irq(&blkcg->lock);
+
+		return nbytes;
+	}
+
+	/* "MAJ:MIN WEIGHT" or "MAJ:MIN default" */
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iocost, buf, &ctx);
+	if (ret)
+		return ret;
+
+	iocg = blkg_to_iocg(ctx.blkg);
+
+	ret = -EINVAL;
+	if (!strncmp(ctx.body, "default", 7)) {
+		v = 0;
+	} else if (sscanf(ctx.body, "%u", &v) != 1 ||
+		   v < CGROUP_WEIGHT_MIN || v > CGROUP_WEIGHT_MAX) {
+		goto out;
+	}
+
+	iocg->cfg_weight = v;
+	ioc_weight_update(iocg, v ?: iocc->dfl_weight);
+	ret = 0;
+out:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static u64 ioc_qos_prfill(struct seq_file *sf, struct blkg_policy_data *pd,
+			  int off)
+{
+	const char *dname = blkg_dev_name(pd->blkg);
+	struct ioc *ioc = pd_to_iocg(pd)->ioc;
+	u32 *qos = ioc->params.qos;
+
+	if (!dname)
+		return 0;
+
+	seq_printf(sf, "%s enable=%d rpct=%u rlat=%u wpct=%u wlat=%u min=%u max=%u\n",
+		   dname, ioc->enabled, qos[QOS_RPCT], qos[QOS_RLAT],
+		   qos[QOS_WPCT], qos[QOS_WLAT], qos[QOS_MIN], qos[QOS_MAX]);
+	return 0;
+}
+
+static int ioc_qos_show(struct seq_file *sf, void *v)
+{
+	struct blkcg *blkcg = css_to_blkcg(seq_css(sf));
+
+	blkcg_print_blkgs(sf, blkcg, ioc_qos_prfill,
+			  &blkcg_policy_iocost, seq_cft(sf)->private, false);
+	return 0;
+}
+
+/*
+ * Parse "key=val" tokens from @body into @vals.  Returns the bitmask of the
+ * keys which were found or -EINVAL.
+ */
+static int ioc_parse_params(char *body, const char * const *names, int nr,
+			    u64 *vals)
+{
+	char *p, *tok;
+	int found = 0;
+
+	p = body;
+	while ((tok = strsep(&p, " \t\n"))) {
+		char key[16];
+		u64 v;
+		int i;
+
+		if (!*tok)
+			continue;
+		if (sscanf(tok, "%15[^=]=%llu", key, &v) != 2)
+			return -EINVAL;
+
+		for (i = 0; i < nr; i++)
+			if (!strcmp(key, names[i]))
+				break;
+		if (i == nr)
+			return -EINVAL;
+
+		vals[i] = v;
+		found |= 1 << i;
+	}
+
+	return found;
+}
+
+static ssize_t ioc_qos_write(struct kernfs_open_file *of, char *buf,
+			     size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	struct request_queue *stat_q = NULL;
+	struct ioc *ioc;
+	u64 vals[NR_QOS_PARAMS];
+	u32 qos[NR_QOS_PARAMS];
+	int i, found, ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iocost, buf, &ctx);
+	if (ret)
+		return ret;
+
+	ioc = q_to_ioc(ctx.disk->queue);
+
+	ret = -EINVAL;
+	found = ioc_parse_params(ctx.body, qos_param_names, NR_QOS_PARAMS,
+				 vals);
+	if (!ioc || found < 0)
+		goto out;
+
+	spin_lock_irq(&ioc->lock);
+	memcpy(qos, ioc->params.qos, sizeof(qos));
+	for (i = 0; i < NR_QOS_PARAMS; i++)
+		if (found & (1 << i))
+			qos[i] = min_t(u64, vals[i], U32_MAX);
+
+	if (qos[QOS_ENABLE] > 1 || qos[QOS_RPCT] > 100 ||
+	    qos[QOS_WPCT] > 100 || !qos[QOS_RLAT] || !qos[QOS_WLAT] ||
+	    qos[QOS_MIN] < VRATE_MIN_PCT || qos[QOS_MAX] > VRATE_MAX_PCT ||
+	    qos[QOS_MIN] > qos[QOS_MAX]) {
+		spin_unlock_irq(&ioc->lock);
+		goto out;
+	}
+
+	memcpy(ioc->params.qos, qos, sizeof(qos));
+	ioc_refresh_params(ioc);
+	ioc_enable(ioc, qos[QOS_ENABLE]);
+	spin_unlock_irq(&ioc->lock);
+
+	/*
+	 * ->done needs the issue timestamps.  Enabling them takes the queue
+	 * lock, so it has to wait until blkg_conf_finish().
+	 */
+	if (qos[QOS_ENABLE] && blk_get_queue(ctx.disk->queue))
+		stat_q = ctx.disk->queue;
+	ret = 0;
+out:
+	blkg_conf_finish(&ctx);
+	if (stat_q) {
+		blk_stat_enable_accounting(stat_q);
+		blk_put_queue(stat_q);
+	}
+	return ret ?: nbytes;
+}
+
+static u64 ioc_model_prfill(struct seq_file *sf, struct blkg_policy_data *pd,
+			    int off)
+{
+	const char *dname = blkg_dev_name(pd->blkg);
+	u64 *c = pd_to_iocg(pd)->ioc->params.i_lcoefs;
+
+	if (!dname)
+		return 0;
+
+	seq_printf(sf, "%s model=linear rbps=%llu rseqiops=%llu rrandiops=%llu wbps=%llu wseqiops=%llu wrandiops=%llu\n",
+		   dname, c[I_LCOEF_RBPS], c[I_LCOEF_RSEQIOPS],
+		   c[I_LCOEF_RRANDIOPS], c[I_LCOEF_WBPS],
+		   c[I_LCOEF_WSEQIOPS], c[I_LCOEF_WRANDIOPS]);
+	return 0;
+}
+
+static int ioc_model_show(struct seq_file *sf, void *v)
+{
+	struct blkcg *blkcg = css_to_blkcg(seq_css(sf));
+
+	blkcg_print_blkgs(sf, blkcg, ioc_model_prfill,
+			  &blkcg_policy_iocost, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static ssize_t ioc_model_write(struct kernfs_open_file *of, char *buf,
+			       size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	struct ioc *ioc;
+	u64 vals[NR_I_LCOEFS];
+	int i, found, ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iocost, buf, &ctx);
+	if (ret)
+		return ret;
+
+	ioc = q_to_ioc(ctx.disk->queue);
+
+	ret = -EINVAL;
+	found = ioc_parse_params(ctx.body, i_lcoef_names, NR_I_LCOEFS, vals);
+	if (!ioc || found < 0)
+		goto out;
+
+	spin_lock_irq(&ioc->lock);
+	for (i = 0; i < NR_I_LCOEFS; i++)
+		if (found & (1 << i))
+			ioc->params.i_lcoefs[i] = vals[i];
+	ioc_refresh_params(ioc);
+	spin_unlock_irq(&ioc->lock);
+	ret = 0;
+out:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static struct cftype ioc_files[] = {
+	{
+		.name = "cost.weight",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = ioc_weight_show,
+		.write = ioc_weight_write,
+	},
+	{
+		.name = "cost.qos",
+		.flags = CFTYPE_ONLY_ON_ROOT,
+		.seq_show = ioc_qos_show,
+		.write = ioc_qos_write,
+	},
+	{
+		.name = "cost.model",
+		.flags = CFTYPE_ONLY_ON_ROOT,
+		.seq_show = ioc_model_show,
+		.write = ioc_model_write,
+	},
+	{}
+};
+
+static struct blkcg_policy blkcg_policy_iocost = {
+	.dfl_cftypes	= ioc_files,
+	.cpd_alloc_fn	= ioc_cpd_alloc,
+	.cpd_init_fn	= ioc_cpd_init,
+	.cpd_free_fn	= ioc_cpd_free,
+	.pd_alloc_fn	= ioc_pd_alloc,
+	.pd_init_fn	= ioc_pd_init,
+	.pd_offline_fn	= ioc_pd_offline,
+	.pd_free_fn	= ioc_pd_free,
+	.pd_stat_fn	= ioc_pd_stat,
+};
+
+static int __init ioc_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iocost);
+}
+
+static void __exit ioc_exit(void)
+{
+	return blkcg_policy_unregister(&blkcg_policy_iocost);
+}
+
+module_init(ioc_init);
+module_exit(ioc_exit);
@@ -155,6 +155,10 @@ static inline unsigned get_max_io_size(struct request_queue *q,
 	unsigned sectors = blk_max_size_offset(q, bio->bi_iter.bi_sector);
 	unsigned mask = queue_logical_block_size(q) - 1;
 
+	/* zone appends were size checked on submission and can't be split */
+	if (bio_op(bio) == REQ_OP_ZONE_APPEND)
+		sectors = queue_max_zone_append_sectors(q);
+
 	/* aligned to logical block size */
 	sectors &= ~(mask >> 9);
 
@@ -561,6 +565,9 @@ int ll_back_merge_fn(struct request_queue *q, struct request *req,
 	if (blk_integrity_rq(req) &&
 	    integrity_req_gap_back_merge(req, bio))
 		return 0;
+	if (!bio_crypt_ctx_mergeable(req->biotail,
+				     req->biotail->bi_iter.bi_size, bio))
+		return 0;
 	if (blk_rq_sectors(req) + bio_sectors(bio) >
 	    blk_rq_get_max_sectors(req, blk_rq_pos(req))) {
 		req_set_nomerge(q, req);
@@ -583,6 +590,8 @@ int ll_front_merge_fn(struct request_queue *q, struct request *req,
 	if (blk_integrity_rq(req) &&
 	    integrity_req_gap_front_merge(req, bio))
 		return 0;
+	if (!bio_crypt_ctx_mergeable(bio, bio->bi_iter.bi_size, req->bio))
+		return 0;
 	if (blk_rq_sectors(req) + bio_sectors(bio) >
 	    blk_rq_get_max_sectors(req, bio->bi_iter.bi_sector)) {
 		req_set_nomerge(q, req);
@@ -642,6 +651,10 @@ static int ll_merge_requests_fn(struct request_queue *q, struct request *req,
 	if (req_gap_back_merge(req, next->bio))
 		return 0;
 
+	if (!bio_crypt_ctx_mergeable(req->biotail,
+				     req->biotail->bi_iter.bi_size, next->bio))
+		return 0;
+
 	/*
 	 * Will it become too large?
 	 */
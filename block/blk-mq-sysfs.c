@@ -221,7 +221,8 @@ static void blk_mq_unregister_hctx(struct blk_mq_hw_ctx *hctx)
 		return;
 
 	hctx_for_each_ctx(hctx, ctx, i)
-		kobject_del(&ctx->kobj);
+		if (ctx->hctxs[HCTX_TYPE_DEFAULT] == hctx)
+			kobject_del(&ctx->kobj);
 
 	kobject_del(&hctx->kobj);
 }
@@ -239,7 +240,14 @@ static int blk_mq_register_hctx(struct blk_mq_hw_ctx *hctx)
 	if (ret)
 		return ret;
 
+	/*
+	 * A software queue is mapped to one hardware queue per map type but
+	 * it only has the one kobject, so it shows up under its default
+	 * hardware queue.
+	 */
 	hctx_for_each_ctx(hctx, ctx, i) {
+		if (ctx->hctxs[HCTX_TYPE_DEFAULT] != hctx)
+			continue;
 		ret = kobject_add(&ctx->kobj, &hctx->kobj, "cpu%u", ctx->cpu);
 		if (ret)
 			break;
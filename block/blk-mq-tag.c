@@ -168,7 +168,8 @@ unsigned int blk_mq_get_tag(struct blk_mq_alloc_data *data)
 		io_schedule();
 
 		data->ctx = blk_mq_get_ctx(data->q);
-		data->hctx = blk_mq_map_queue(data->q, data->ctx->cpu);
+		data->hctx = blk_mq_map_queue(data->q, data->cmd_flags,
+						data->ctx);
 		tags = blk_mq_tags_from_data(data);
 		if (data->flags & BLK_MQ_REQ_RESERVED)
 			bt = &tags->breserved_tags;
@@ -197,6 +198,37 @@ unsigned int blk_mq_get_tag(struct blk_mq_alloc_data *data)
 	return tag + tag_offset;
 }
 
+/*
+ * Grab up to @nr_tags driver tags in one go, for requests cached in a plug.
+ * Returns a mask of the tags allocated relative to @offset, 0 if none could
+ * be had without falling back to blk_mq_get_tag().
+ */
+unsigned long blk_mq_get_tags(struct blk_mq_alloc_data *data,
+			      unsigned int nr_tags, unsigned int *offset)
+{
+	struct blk_mq_tags *tags = blk_mq_tags_from_data(data);
+	unsigned long mask;
+
+	if (data->shallow_depth ||
+	    (data->flags & (BLK_MQ_REQ_RESERVED | BLK_MQ_REQ_INTERNAL)) ||
+	    (data->hctx->flags & BLK_MQ_F_TAG_SHARED))
+		return 0;
+
+	mask = __sbitmap_queue_get_batch(&tags->bitmap_tags, nr_tags, offset);
+	*offset += tags->nr_reserved_tags;
+	return mask;
+}
+
+/*
+ * Free a batch of non-reserved driver tags, see blk_mq_end_request_batch().
+ */
+void blk_mq_put_tags(struct blk_mq_tags *tags, const int *tag_array,
+		     int nr_tags)
+{
+	sbitmap_queue_clear_batch(&tags->bitmap_tags, tags->nr_reserved_tags,
+				  tag_array, nr_tags);
+}
+
 void blk_mq_put_tag(struct blk_mq_hw_ctx *hctx, struct blk_mq_tags *tags,
 		    struct blk_mq_ctx *ctx, unsigned int tag)
 {
@@ -531,7 +563,7 @@ u32 blk_mq_unique_tag(struct request *rq)
 	int hwq = 0;
 
 	if (q->mq_ops) {
-		hctx = blk_mq_map_queue(q, rq->mq_ctx->cpu);
+		hctx = rq->mq_hctx;
 		hwq = hctx->queue_num;
 	}
 
@@ -6,6 +6,8 @@
 #include <linux/kernel.h>
 #include <linux/rculist.h>
 #include <linux/blk-mq.h>
+#include <linux/blk-cgroup.h>
+#include <linux/log2.h>
 
 #include "blk-stat.h"
 #include "blk-mq.h"
@@ -15,6 +17,9 @@ struct blk_queue_stats {
 	struct list_head callbacks;
 	spinlock_t lock;
 	bool enable_accounting;
+#ifdef CONFIG_BLK_LAT_HIST
+	struct blk_lat_hist __percpu *lat_hist;
+#endif
 };
 
 void blk_rq_stat_init(struct blk_rq_stat *stat)
@@ -47,6 +52,145 @@ void blk_rq_stat_add(struct blk_rq_stat *stat, u64 value)
 	stat->nr_samples++;
 }
 
+#ifdef CONFIG_BLK_LAT_HIST
+static int blk_lat_hist_op(const struct request *rq)
+{
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+		return BLK_LAT_READ;
+	case REQ_OP_WRITE:
+	case REQ_OP_WRITE_SAME:
+	case REQ_OP_WRITE_ZEROES:
+		return BLK_LAT_WRITE;
+	case REQ_OP_DISCARD:
+	case REQ_OP_SECURE_ERASE:
+		return BLK_LAT_DISCARD;
+	case REQ_OP_FLUSH:
+		return BLK_LAT_FLUSH;
+	default:
+		return -1;
+	}
+}
+
+static int blk_lat_hist_bucket(u64 value)
+{
+	value >>= 10;
+	if (!value)
+		return 0;
+	return min_t(int, ilog2(value) + 1, BLK_LAT_HIST_BUCKETS - 1);
+}
+
+static void blk_lat_hist_add(struct request *rq, u64 value)
+{
+	struct blk_lat_hist __percpu *hists[2] = { rq->q->stats->lat_hist };
+	int op = blk_lat_hist_op(rq);
+	int bucket, i;
+
+	if (op < 0)
+		return;
+
+#ifdef CONFIG_BLK_CGROUP
+	/*
+	 * The request holds a reference on its request_list and thus the
+	 * blkg until it is freed, which happens after we're called.
+	 */
+	if (rq->rl && rq->rl->blkg)
+		hists[1] = rq->rl->blkg->lat_hist;
+#endif
+
+	bucket = blk_lat_hist_bucket(value);
+	for (i = 0; i < ARRAY_SIZE(hists); i++) {
+		if (hists[i])
+			this_cpu_inc(hists[i]->nr[op][bucket]);
+	}
+}
+
+void blk_lat_hist_sum(struct blk_lat_hist *dst,
+		      struct blk_lat_hist __percpu *src)
+{
+	int cpu, op, bucket;
+
+	if (!src)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_lat_hist *hist = per_cpu_ptr(src, cpu);
+
+		for (op = 0; op < BLK_LAT_NR_OPS; op++)
+			for (bucket = 0; bucket < BLK_LAT_HIST_BUCKETS; bucket++)
+				dst->nr[op][bucket] += hist->nr[op][bucket];
+	}
+}
+
+/*
+ * Fold all of @src into the local cpu's counters of @dst, e.g. when a
+ * cgroup goes away and its completions should stay visible in its parent.
+ */
+void blk_lat_hist_transfer(struct blk_lat_hist __percpu *dst,
+			   struct blk_lat_hist __percpu *src)
+{
+	unsigned long flags;
+	int cpu, op, bucket;
+
+	if (!dst || !src)
+		return;
+
+	local_irq_save(flags);
+	for_each_possible_cpu(cpu) {
+		struct blk_lat_hist *hist = per_cpu_ptr(src, cpu);
+
+		for (op = 0; op < BLK_LAT_NR_OPS; op++)
+			for (bucket = 0; bucket < BLK_LAT_HIST_BUCKETS; bucket++)
+				__this_cpu_add(dst->nr[op][bucket],
+					       hist->nr[op][bucket]);
+	}
+	local_irq_restore(flags);
+}
+
+/*
+ * Format @hist as one "[<prefix> ]<op> <bucket0> <bucket1> ..." line per
+ * operation which saw any completions.  Returns the number of characters
+ * written.
+ */
+int blk_lat_hist_snprintf(char *buf, size_t size, const char *prefix,
+			  struct blk_lat_hist *hist)
+{
+	static const char *const op_name[BLK_LAT_NR_OPS] = {
+		[BLK_LAT_READ]		= "read",
+		[BLK_LAT_WRITE]		= "write",
+		[BLK_LAT_DISCARD]	= "discard",
+		[BLK_LAT_FLUSH]		= "flush",
+	};
+	int op, bucket, off = 0;
+
+	for (op = 0; op < BLK_LAT_NR_OPS; op++) {
+		u64 total = 0;
+
+		for (bucket = 0; bucket < BLK_LAT_HIST_BUCKETS; bucket++)
+			total += hist->nr[op][bucket];
+		if (!total)
+			continue;
+
+		if (prefix)
+			off += scnprintf(buf + off, size - off, "%s ", prefix);
+		off += scnprintf(buf + off, size - off, "%s", op_name[op]);
+		for (bucket = 0; bucket < BLK_LAT_HIST_BUCKETS; bucket++)
+			off += scnprintf(buf + off, size - off, " %llu",
+					 hist->nr[op][bucket]);
+		off += scnprintf(buf + off, size - off, "\n");
+	}
+
+	return off;
+}
+
+void blk_stat_lat_hist(struct request_queue *q, struct blk_lat_hist *dst)
+{
+	blk_lat_hist_sum(dst, q->stats->lat_hist);
+}
+#else
+static inline void blk_lat_hist_add(struct request *rq, u64 value) { }
+#endif
+
 void blk_stat_add(struct request *rq, u64 now)
 {
 	struct request_queue *q = rq->q;
@@ -58,6 +202,7 @@ void blk_stat_add(struct request *rq, u64 now)
 	value = (now >= rq->io_start_time_ns) ? now - rq->io_start_time_ns : 0;
 
 	blk_throtl_stat_add(rq, value);
+	blk_lat_hist_add(rq, value);
 
 	rcu_read_lock();
 	list_for_each_entry_rcu(cb, &q->stats->callbacks, list) {
@@ -203,6 +348,10 @@ struct blk_queue_stats *blk_alloc_queue_stats(void)
 	INIT_LIST_HEAD(&stats->callbacks);
 	spin_lock_init(&stats->lock);
 	stats->enable_accounting = false;
+#ifdef CONFIG_BLK_LAT_HIST
+	/* the histograms are best effort, carry on without them */
+	stats->lat_hist = blk_lat_hist_alloc(GFP_KERNEL);
+#endif
 
 	return stats;
 }
@@ -214,5 +363,8 @@ void blk_free_queue_stats(struct blk_queue_stats *stats)
 
 	WARN_ON(!list_empty(&stats->callbacks));
 
+#ifdef CONFIG_BLK_LAT_HIST
+	blk_lat_hist_free(stats->lat_hist);
+#endif
 	kfree(stats);
 }
@@ -7,6 +7,7 @@
 #include <linux/ktime.h>
 #include <linux/rcupdate.h>
 #include <linux/timer.h>
+#include <linux/percpu.h>
 
 /**
  * struct blk_stat_callback - Block statistics callback.
@@ -163,4 +164,49 @@ void blk_rq_stat_add(struct blk_rq_stat *, u64);
 void blk_rq_stat_sum(struct blk_rq_stat *, struct blk_rq_stat *);
 void blk_rq_stat_init(struct blk_rq_stat *);
 
+#ifdef CONFIG_BLK_LAT_HIST
+enum blk_lat_hist_op {
+	BLK_LAT_READ,
+	BLK_LAT_WRITE,
+	BLK_LAT_DISCARD,
+	BLK_LAT_FLUSH,
+	BLK_LAT_NR_OPS,
+};
+
+/*
+ * Bucket 0 counts completions faster than 1024ns, bucket i > 0 those in
+ * [1024ns << (i - 1), 1024ns << i).  The last bucket also takes everything
+ * slower than that.
+ */
+#define BLK_LAT_HIST_BUCKETS	24
+
+/**
+ * struct blk_lat_hist - log2 completion latency histogram.
+ *
+ * Always used per-cpu on the completion side and only summed up by readers,
+ * so updates are a plain increment without any atomics or locking.
+ */
+struct blk_lat_hist {
+	u64 nr[BLK_LAT_NR_OPS][BLK_LAT_HIST_BUCKETS];
+};
+
+static inline struct blk_lat_hist __percpu *blk_lat_hist_alloc(gfp_t gfp)
+{
+	return alloc_percpu_gfp(struct blk_lat_hist, gfp);
+}
+
+static inline void blk_lat_hist_free(struct blk_lat_hist __percpu *hist)
+{
+	free_percpu(hist);
+}
+
+void blk_lat_hist_sum(struct blk_lat_hist *dst,
+		      struct blk_lat_hist __percpu *src);
+void blk_lat_hist_transfer(struct blk_lat_hist __percpu *dst,
+			   struct blk_lat_hist __percpu *src);
+int blk_lat_hist_snprintf(char *buf, size_t size, const char *prefix,
+			  struct blk_lat_hist *hist);
+void blk_stat_lat_hist(struct request_queue *q, struct blk_lat_hist *dst);
+#endif
+
 #endif
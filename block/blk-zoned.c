@@ -40,6 +40,8 @@ bool blk_req_needs_zone_write_lock(struct request *rq)
 	case REQ_OP_WRITE_SAME:
 	case REQ_OP_WRITE:
 		return blk_rq_zone_is_seq(rq);
+	/* zone appends are placed by the device, any order is fine */
+	case REQ_OP_ZONE_APPEND:
 	default:
 		return false;
 	}
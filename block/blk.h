@@ -115,7 +115,7 @@ static inline struct blk_flush_queue *blk_get_flush_queue(
 		struct request_queue *q, struct blk_mq_ctx *ctx)
 {
 	if (q->mq_ops)
-		return blk_mq_map_queue(q, ctx->cpu)->fq;
+		return blk_mq_map_queue(q, REQ_OP_FLUSH, ctx)->fq;
 	return q->fq;
 }
 
@@ -498,6 +498,12 @@ extern int blk_iolatency_init(struct request_queue *q);
 static inline int blk_iolatency_init(struct request_queue *q) { return 0; }
 #endif
 
+#ifdef CONFIG_BLK_CGROUP_IOCOST
+extern int blk_iocost_init(struct request_queue *q);
+#else
+static inline int blk_iocost_init(struct request_queue *q) { return 0; }
+#endif
+
 struct bio *blk_next_bio(struct bio *bio, unsigned int nr_pages, gfp_t gfp);
 
 #ifdef CONFIG_BLK_DEV_ZONED
@@ -0,0 +1,368 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Keyslot manager for inline encryption hardware.
+ *
+ * Inline encryption hardware has a small, fixed number of keyslots, and
+ * every encrypted request has to name the slot its key is programmed into.
+ * The keyslot manager hands out slots to keys: each slot is reference
+ * counted by the bios using it, a key that is already programmed is
+ * reused, and otherwise the least recently used idle slot is reprogrammed.
+ * Callers wait if all slots are busy.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/atomic.h>
+#include <linux/hash.h>
+#include <linux/rwsem.h>
+#include <linux/wait.h>
+#include <linux/keyslot-manager.h>
+
+struct keyslot {
+	atomic_t slot_refs;
+	struct list_head idle_slot_node;
+	struct hlist_node hash_node;
+	const struct blk_crypto_key *key;
+};
+
+struct keyslot_manager {
+	unsigned int num_slots;
+	struct keyslot_mgmt_ll_ops ksm_ll_ops;
+	/* bitmask of the data unit sizes supported for each mode */
+	unsigned int crypto_mode_supported[BLK_ENCRYPTION_MODE_MAX];
+	void *ll_priv_data;
+
+	/* protects programming and eviction of keys */
+	struct rw_semaphore lock;
+
+	wait_queue_head_t idle_slots_wait_queue;
+	struct list_head idle_slots;
+	spinlock_t idle_slots_lock;
+
+	struct hlist_head *slot_hashtable;
+	unsigned int log_slot_ht_size;
+
+	struct keyslot slots[];
+};
+
+/**
+ * keyslot_manager_create() - create a keyslot manager
+ * @num_slots: number of keyslots in the hardware
+ * @ksm_ll_ops: operations to program and evict keys
+ * @crypto_mode_supported: for each crypto mode, the bitmask of data unit
+ *			   sizes supported by the hardware
+ * @ll_priv_data: driver private data, see keyslot_manager_private()
+ *
+ * Return: the new keyslot manager or NULL on failure.
+ */
+struct keyslot_manager *keyslot_manager_create(unsigned int num_slots,
+	const struct keyslot_mgmt_ll_ops *ksm_ll_ops,
+	const unsigned int crypto_mode_supported[BLK_ENCRYPTION_MODE_MAX],
+	void *ll_priv_data)
+{
+	struct keyslot_manager *ksm;
+	unsigned int slot;
+	unsigned int i;
+
+	if (num_slots == 0)
+		return NULL;
+
+	/* both operations are required */
+	if (!ksm_ll_ops->keyslot_program || !ksm_ll_ops->keyslot_evict)
+		return NULL;
+
+	ksm = kvzalloc(struct_size(ksm, slots, num_slots), GFP_KERNEL);
+	if (!ksm)
+		return NULL;
+
+	ksm->num_slots = num_slots;
+	ksm->ksm_ll_ops = *ksm_ll_ops;
+	memcpy(ksm->crypto_mode_supported, crypto_mode_supported,
+	       sizeof(ksm->crypto_mode_supported));
+	ksm->ll_priv_data = ll_priv_data;
+
+	init_rwsem(&ksm->lock);
+
+	init_waitqueue_head(&ksm->idle_slots_wait_queue);
+	INIT_LIST_HEAD(&ksm->idle_slots);
+
+	for (slot = 0; slot < num_slots; slot++) {
+		list_add_tail(&ksm->slots[slot].idle_slot_node,
+			      &ksm->idle_slots);
+	}
+
+	spin_lock_init(&ksm->idle_slots_lock);
+
+	ksm->log_slot_ht_size = ilog2(roundup_pow_of_two(num_slots));
+	ksm->slot_hashtable = kvmalloc_array(1U << ksm->log_slot_ht_size,
+					     sizeof(ksm->slot_hashtable[0]),
+					     GFP_KERNEL);
+	if (!ksm->slot_hashtable) {
+		kvfree(ksm);
+		return NULL;
+	}
+	for (i = 0; i < (1U << ksm->log_slot_ht_size); i++)
+		INIT_HLIST_HEAD(&ksm->slot_hashtable[i]);
+
+	return ksm;
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_create);
+
+static inline struct hlist_head *
+hash_bucket_for_key(struct keyslot_manager *ksm,
+		    const struct blk_crypto_key *key)
+{
+	return &ksm->slot_hashtable[hash_ptr(key, ksm->log_slot_ht_size)];
+}
+
+static void remove_slot_from_lru_list(struct keyslot_manager *ksm, int slot)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ksm->idle_slots_lock, flags);
+	list_del(&ksm->slots[slot].idle_slot_node);
+	spin_unlock_irqrestore(&ksm->idle_slots_lock, flags);
+}
+
+static int find_keyslot(struct keyslot_manager *ksm,
+			const struct blk_crypto_key *key)
+{
+	const struct hlist_head *head = hash_bucket_for_key(ksm, key);
+	const struct keyslot *slotp;
+
+	hlist_for_each_entry(slotp, head, hash_node) {
+		if (slotp->key == key)
+			return slotp - ksm->slots;
+	}
+	return -ENOKEY;
+}
+
+static int find_and_grab_keyslot(struct keyslot_manager *ksm,
+				 const struct blk_crypto_key *key)
+{
+	int slot;
+
+	slot = find_keyslot(ksm, key);
+	if (slot < 0)
+		return slot;
+	if (atomic_inc_return(&ksm->slots[slot].slot_refs) == 1) {
+		/* took the first reference, the slot is no longer idle */
+		remove_slot_from_lru_list(ksm, slot);
+	}
+	return slot;
+}
+
+/**
+ * keyslot_manager_get_slot_for_key() - program a key into a keyslot
+ * @ksm: the keyslot manager
+ * @key: the key to program
+ *
+ * Get a keyslot that holds @key, programming the least recently used idle
+ * slot if the key isn't already in one.  Waits for a slot to become idle
+ * if all of them are in use, so this must be called from process context.
+ * The caller owns a reference on the returned slot and must drop it with
+ * keyslot_manager_put_slot().
+ *
+ * Return: the keyslot on success, else a negative errno.
+ */
+int keyslot_manager_get_slot_for_key(struct keyslot_manager *ksm,
+				     const struct blk_crypto_key *key)
+{
+	struct keyslot *idle_slot;
+	int slot;
+	int err;
+
+	down_read(&ksm->lock);
+	slot = find_and_grab_keyslot(ksm, key);
+	up_read(&ksm->lock);
+	if (slot != -ENOKEY)
+		return slot;
+
+	for (;;) {
+		down_write(&ksm->lock);
+		slot = find_and_grab_keyslot(ksm, key);
+		if (slot != -ENOKEY) {
+			up_write(&ksm->lock);
+			return slot;
+		}
+
+		/*
+		 * If we're here, that means there wasn't a slot that was
+		 * already programmed with the key.  So try to program it.
+		 */
+		if (!list_empty(&ksm->idle_slots))
+			break;
+
+		up_write(&ksm->lock);
+		wait_event(ksm->idle_slots_wait_queue,
+			   !list_empty(&ksm->idle_slots));
+	}
+
+	idle_slot = list_first_entry(&ksm->idle_slots, struct keyslot,
+				     idle_slot_node);
+	slot = idle_slot - ksm->slots;
+
+	err = ksm->ksm_ll_ops.keyslot_program(ksm, key, slot);
+	if (err) {
+		wake_up(&ksm->idle_slots_wait_queue);
+		up_write(&ksm->lock);
+		return err;
+	}
+
+	/* move this slot to the hash list for the new key */
+	if (idle_slot->key)
+		hlist_del(&idle_slot->hash_node);
+	idle_slot->key = key;
+	hlist_add_head(&idle_slot->hash_node, hash_bucket_for_key(ksm, key));
+
+	atomic_set(&idle_slot->slot_refs, 1);
+	remove_slot_from_lru_list(ksm, slot);
+
+	up_write(&ksm->lock);
+	return slot;
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_get_slot_for_key);
+
+/**
+ * keyslot_manager_get_slot() - take another reference on a keyslot
+ * @ksm: the keyslot manager
+ * @slot: a keyslot the caller already holds a reference on
+ */
+void keyslot_manager_get_slot(struct keyslot_manager *ksm, unsigned int slot)
+{
+	if (WARN_ON(slot >= ksm->num_slots))
+		return;
+
+	WARN_ON(atomic_inc_return(&ksm->slots[slot].slot_refs) < 2);
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_get_slot);
+
+/**
+ * keyslot_manager_put_slot() - release a reference to a keyslot
+ * @ksm: the keyslot manager
+ * @slot: the keyslot
+ *
+ * May be called from any context.
+ */
+void keyslot_manager_put_slot(struct keyslot_manager *ksm, unsigned int slot)
+{
+	unsigned long flags;
+
+	if (WARN_ON(slot >= ksm->num_slots))
+		return;
+
+	if (atomic_dec_and_lock_irqsave(&ksm->slots[slot].slot_refs,
+					&ksm->idle_slots_lock, flags)) {
+		list_add_tail(&ksm->slots[slot].idle_slot_node,
+			      &ksm->idle_slots);
+		spin_unlock_irqrestore(&ksm->idle_slots_lock, flags);
+		wake_up(&ksm->idle_slots_wait_queue);
+	}
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_put_slot);
+
+/**
+ * keyslot_manager_crypto_mode_supported() - is a crypto mode supported?
+ * @ksm: the keyslot manager, may be NULL
+ * @crypto_mode: the crypto mode to check for
+ * @data_unit_size: the data unit size that will be used
+ *
+ * Return: whether the hardware behind @ksm supports @crypto_mode with
+ * @data_unit_size sized data units.
+ */
+bool keyslot_manager_crypto_mode_supported(struct keyslot_manager *ksm,
+					   enum blk_crypto_mode_num crypto_mode,
+					   unsigned int data_unit_size)
+{
+	if (!ksm)
+		return false;
+	if (WARN_ON(crypto_mode >= BLK_ENCRYPTION_MODE_MAX))
+		return false;
+	if (WARN_ON(!is_power_of_2(data_unit_size)))
+		return false;
+	return ksm->crypto_mode_supported[crypto_mode] & data_unit_size;
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_crypto_mode_supported);
+
+/**
+ * keyslot_manager_evict_key() - evict a key from the hardware
+ * @ksm: the keyslot manager
+ * @key: the key to evict
+ *
+ * The key must no longer be in use by any bio.
+ *
+ * Return: 0 on success or if the key wasn't programmed, -EBUSY if the key
+ * is still in use, or another negative errno from the driver.
+ */
+int keyslot_manager_evict_key(struct keyslot_manager *ksm,
+			      const struct blk_crypto_key *key)
+{
+	struct keyslot *slotp;
+	int slot;
+	int err;
+
+	down_write(&ksm->lock);
+	slot = find_keyslot(ksm, key);
+	if (slot < 0) {
+		err = 0;
+		goto out_unlock;
+	}
+	slotp = &ksm->slots[slot];
+
+	if (WARN_ON_ONCE(atomic_read(&slotp->slot_refs) != 0)) {
+		err = -EBUSY;
+		goto out_unlock;
+	}
+	err = ksm->ksm_ll_ops.keyslot_evict(ksm, key, slot);
+	if (err)
+		goto out_unlock;
+
+	hlist_del(&slotp->hash_node);
+	slotp->key = NULL;
+out_unlock:
+	up_write(&ksm->lock);
+	return err;
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_evict_key);
+
+/**
+ * keyslot_manager_reprogram_all_keys() - re-program all keyslots
+ * @ksm: the keyslot manager
+ *
+ * Re-program all keyslots that are supposed to have a key programmed, e.g.
+ * after the hardware lost its keys on a reset or on resume.
+ */
+void keyslot_manager_reprogram_all_keys(struct keyslot_manager *ksm)
+{
+	unsigned int slot;
+
+	down_write(&ksm->lock);
+	for (slot = 0; slot < ksm->num_slots; slot++) {
+		const struct blk_crypto_key *key = ksm->slots[slot].key;
+		int err;
+
+		if (!key)
+			continue;
+
+		err = ksm->ksm_ll_ops.keyslot_program(ksm, key, slot);
+		WARN_ON(err);
+	}
+	up_write(&ksm->lock);
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_reprogram_all_keys);
+
+void *keyslot_manager_private(struct keyslot_manager *ksm)
+{
+	return ksm->ll_priv_data;
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_private);
+
+void keyslot_manager_destroy(struct keyslot_manager *ksm)
+{
+	if (!ksm)
+		return;
+	kvfree(ksm->slot_hashtable);
+	memzero_explicit(ksm, struct_size(ksm, slots, ksm->num_slots));
+	kvfree(ksm);
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_destroy);
@@ -147,7 +147,7 @@ struct kyber_cpu_latency {
 
 /*
  * There is a same mapping between ctx & hctx and kcq & khd,
- * we use request->mq_ctx->index_hw to index the kcq in khd.
+ * we use request->mq_ctx->index_hw[hctx->type] to index the kcq in khd.
  */
 struct kyber_ctx_queue {
 	/*
@@ -576,7 +576,7 @@ static bool kyber_bio_merge(struct blk_mq_hw_ctx *hctx, struct bio *bio)
 {
 	struct kyber_hctx_data *khd = hctx->sched_data;
 	struct blk_mq_ctx *ctx = blk_mq_get_ctx(hctx->queue);
-	struct kyber_ctx_queue *kcq = &khd->kcqs[ctx->index_hw];
+	struct kyber_ctx_queue *kcq = &khd->kcqs[ctx->index_hw[hctx->type]];
 	unsigned int sched_domain = kyber_sched_domain(bio->bi_opf);
 	struct list_head *rq_list = &kcq->rq_list[sched_domain];
 	bool merged;
@@ -602,7 +602,8 @@ static void kyber_insert_requests(struct blk_mq_hw_ctx *hctx,
 
 	list_for_each_entry_safe(rq, next, rq_list, queuelist) {
 		unsigned int sched_domain = kyber_sched_domain(rq->cmd_flags);
-		struct kyber_ctx_queue *kcq = &khd->kcqs[rq->mq_ctx->index_hw];
+		unsigned int idx = rq->mq_ctx->index_hw[hctx->type];
+		struct kyber_ctx_queue *kcq = &khd->kcqs[idx];
 		struct list_head *head = &kcq->rq_list[sched_domain];
 
 		spin_lock(&kcq->lock);
@@ -610,8 +611,7 @@ static void kyber_insert_requests(struct blk_mq_hw_ctx *hctx,
 			list_move(&rq->queuelist, head);
 		else
 			list_move_tail(&rq->queuelist, head);
-		sbitmap_set_bit(&khd->kcq_map[sched_domain],
-				rq->mq_ctx->index_hw);
+		sbitmap_set_bit(&khd->kcq_map[sched_domain], idx);
 		blk_mq_sched_request_inserted(rq);
 		spin_unlock(&kcq->lock);
 	}
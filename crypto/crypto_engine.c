@@ -34,14 +34,18 @@ static void crypto_finalize_request(struct crypto_engine *engine,
 	int ret;
 	struct crypto_engine_ctx *enginectx;
 
+	/*
+	 * In batch mode the engine does not keep track of which requests
+	 * the driver holds, any request finalized was handed out by it.
+	 */
 	spin_lock_irqsave(&engine->queue_lock, flags);
-	if (engine->cur_req == req)
+	if (engine->batch_size > 1 || engine->cur_req == req)
 		finalize_cur_req = true;
 	spin_unlock_irqrestore(&engine->queue_lock, flags);
 
 	if (finalize_cur_req) {
 		enginectx = crypto_tfm_ctx(req->tfm);
-		if (engine->cur_req_prepared &&
+		if ((engine->batch_size > 1 || engine->cur_req_prepared) &&
 		    enginectx->op.unprepare_request) {
 			ret = enginectx->op.unprepare_request(engine, req);
 			if (ret)
@@ -50,22 +54,48 @@ static void crypto_finalize_request(struct crypto_engine *engine,
 		spin_lock_irqsave(&engine->queue_lock, flags);
 		engine->cur_req = NULL;
 		engine->cur_req_prepared = false;
+		engine->inflight--;
 		spin_unlock_irqrestore(&engine->queue_lock, flags);
 	}
 
 	req->complete(req, err);
 
+	/*
+	 * Requests completing while the pump is already queued are refilled
+	 * by a single run of it.
+	 */
+	kthread_queue_work(engine->kworker, &engine->pump_requests);
+}
+
+/*
+ * Complete a request of a batch that never made it to the driver, so it
+ * must not be unprepared.
+ */
+static void crypto_abort_batch_request(struct crypto_engine *engine,
+				       struct crypto_async_request *req,
+				       int err)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	engine->inflight--;
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	req->complete(req, err);
+
 	kthread_queue_work(engine->kworker, &engine->pump_requests);
 }
 
 /**
- * crypto_pump_requests - dequeue one request from engine queue to process
+ * crypto_pump_requests - dequeue requests from engine queue to process
  * @engine: the hardware engine
  * @in_kthread: true if we are in the context of the request pump thread
  *
  * This function checks if there is any request in the engine queue that
  * needs processing and if so call out to the driver to initialize hardware
- * and handle each request.
+ * and handle each request.  An engine with a batch size hands the driver
+ * requests until it holds that many or the queue runs dry, then tells it
+ * to submit them with do_batch_requests().
  */
 static void crypto_pump_requests(struct crypto_engine *engine,
 				 bool in_kthread)
@@ -73,13 +103,15 @@ static void crypto_pump_requests(struct crypto_engine *engine,
 	struct crypto_async_request *async_req, *backlog;
 	unsigned long flags;
 	bool was_busy = false;
+	unsigned int handed = 0;
 	int ret;
 	struct crypto_engine_ctx *enginectx;
 
+start_request:
 	spin_lock_irqsave(&engine->queue_lock, flags);
 
-	/* Make sure we are not already running a request */
-	if (engine->cur_req)
+	/* Make sure the driver can take another request */
+	if (engine->inflight >= engine->batch_size)
 		goto out;
 
 	/* If another context is idling then defer */
@@ -90,7 +122,7 @@ static void crypto_pump_requests(struct crypto_engine *engine,
 
 	/* Check if the engine queue is idle */
 	if (!crypto_queue_len(&engine->queue) || !engine->running) {
-		if (!engine->busy)
+		if (!engine->busy || engine->inflight)
 			goto out;
 
 		/* Only do teardown in the thread */
@@ -119,7 +151,9 @@ static void crypto_pump_requests(struct crypto_engine *engine,
 	if (!async_req)
 		goto out;
 
-	engine->cur_req = async_req;
+	if (engine->batch_size == 1)
+		engine->cur_req = async_req;
+	engine->inflight++;
 	if (backlog)
 		backlog->complete(backlog, -EINPROGRESS);
 
@@ -135,7 +169,7 @@ static void crypto_pump_requests(struct crypto_engine *engine,
 		ret = engine->prepare_crypt_hardware(engine);
 		if (ret) {
 			dev_err(engine->dev, "failed to prepare crypt hardware\n");
-			goto req_err;
+			goto prepare_err;
 		}
 	}
 
@@ -146,7 +180,7 @@ static void crypto_pump_requests(struct crypto_engine *engine,
 		if (ret) {
 			dev_err(engine->dev, "failed to prepare request: %d\n",
 				ret);
-			goto req_err;
+			goto prepare_err;
 		}
 		engine->cur_req_prepared = true;
 	}
@@ -160,14 +194,31 @@ static void crypto_pump_requests(struct crypto_engine *engine,
 		dev_err(engine->dev, "Failed to do one request from queue: %d\n", ret);
 		goto req_err;
 	}
+
+	if (engine->batch_size > 1) {
+		handed++;
+		goto start_request;
+	}
 	return;
 
+prepare_err:
+	if (engine->batch_size > 1) {
+		crypto_abort_batch_request(engine, async_req, ret);
+		goto submit_batch;
+	}
 req_err:
 	crypto_finalize_request(engine, async_req, ret);
-	return;
+	goto submit_batch;
 
 out:
 	spin_unlock_irqrestore(&engine->queue_lock, flags);
+submit_batch:
+	if (handed && engine->do_batch_requests) {
+		ret = engine->do_batch_requests(engine);
+		if (ret)
+			dev_err(engine->dev, "failed to do batch requests: %d\n",
+				ret);
+	}
 }
 
 static void crypto_pump_work(struct kthread_work *work)
@@ -420,20 +471,32 @@ int crypto_engine_stop(struct crypto_engine *engine)
 EXPORT_SYMBOL_GPL(crypto_engine_stop);
 
 /**
- * crypto_engine_alloc_init - allocate crypto hardware engine structure and
- * initialize it.
+ * crypto_engine_alloc_init_and_set - allocate crypto hardware engine
+ * structure and initialize it for batches of requests.
  * @dev: the device attached with one hardware engine
  * @rt: whether this queue is set to run as a realtime task
+ * @batch_size: the most requests the driver takes before completing any,
+ * 1 to be handed one request at a time
+ * @cbk_do_batch: called once the driver has been handed the requests of a
+ * batch, for it to submit them to the hardware; may be NULL
+ * @qlen: the most requests queued before backlogging
+ *
+ * With a batch size, do_one_request() is called again before the previous
+ * request completes, and the driver may hold the requests back until
+ * @cbk_do_batch is called to feed them to the hardware together.
  *
  * This must be called from context that can sleep.
  * Return: the crypto engine structure on success, else NULL.
  */
-struct crypto_engine *crypto_engine_alloc_init(struct device *dev, bool rt)
+struct crypto_engine *crypto_engine_alloc_init_and_set(struct device *dev,
+			bool rt, unsigned int batch_size,
+			int (*cbk_do_batch)(struct crypto_engine *engine),
+			int qlen)
 {
 	struct sched_param param = { .sched_priority = MAX_RT_PRIO - 1 };
 	struct crypto_engine *engine;
 
-	if (!dev)
+	if (!dev || !batch_size || qlen <= 0)
 		return NULL;
 
 	engine = devm_kzalloc(dev, sizeof(*engine), GFP_KERNEL);
@@ -447,10 +510,12 @@ struct crypto_engine *crypto_engine_alloc_init(struct device *dev, bool rt)
 	engine->idling = false;
 	engine->cur_req_prepared = false;
 	engine->priv_data = dev;
+	engine->batch_size = batch_size;
+	engine->do_batch_requests = cbk_do_batch;
 	snprintf(engine->name, sizeof(engine->name),
 		 "%s-engine", dev_name(dev));
 
-	crypto_init_queue(&engine->queue, CRYPTO_ENGINE_MAX_QLEN);
+	crypto_init_queue(&engine->queue, qlen);
 	spin_lock_init(&engine->queue_lock);
 
 	engine->kworker = kthread_create_worker(0, "%s", engine->name);
@@ -467,6 +532,22 @@ struct crypto_engine *crypto_engine_alloc_init(struct device *dev, bool rt)
 
 	return engine;
 }
+EXPORT_SYMBOL_GPL(crypto_engine_alloc_init_and_set);
+
+/**
+ * crypto_engine_alloc_init - allocate crypto hardware engine structure and
+ * initialize it.
+ * @dev: the device attached with one hardware engine
+ * @rt: whether this queue is set to run as a realtime task
+ *
+ * This must be called from context that can sleep.
+ * Return: the crypto engine structure on success, else NULL.
+ */
+struct crypto_engine *crypto_engine_alloc_init(struct device *dev, bool rt)
+{
+	return crypto_engine_alloc_init_and_set(dev, rt, 1, NULL,
+						CRYPTO_ENGINE_MAX_QLEN);
+}
 EXPORT_SYMBOL_GPL(crypto_engine_alloc_init);
 
 /**
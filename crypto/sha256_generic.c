@@ -240,6 +240,149 @@ static void sha256_generic_block_fn(struct sha256_state *sst, u8 const *src,
 	}
 }
 
+static const u32 sha256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define SHA256_ROUND(L, i)						\
+do {									\
+	u32 t1 = h##L + e1(e##L) + Ch(e##L, f##L, g##L) +		\
+		 sha256_K[i] + W##L[i];					\
+	u32 t2 = e0(a##L) + Maj(a##L, b##L, c##L);			\
+									\
+	h##L = g##L; g##L = f##L; f##L = e##L; e##L = d##L + t1;	\
+	d##L = c##L; c##L = b##L; b##L = a##L; a##L = t1 + t2;		\
+} while (0)
+
+/*
+ * Compress one block of each of two messages.  The rounds of a single
+ * message form one long dependency chain, interleaving two of them gives
+ * the CPU independent work to overlap it with.
+ */
+static void sha256_transform_x2(u32 *statex, u32 *statey,
+				const u8 *inputx, const u8 *inputy)
+{
+	u32 ax, bx, cx, dx, ex, fx, gx, hx;
+	u32 ay, by, cy, dy, ey, fy, gy, hy;
+	u32 Wx[64], Wy[64];
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		LOAD_OP(i, Wx, inputx);
+		LOAD_OP(i, Wy, inputy);
+	}
+	for (i = 16; i < 64; i++) {
+		BLEND_OP(i, Wx);
+		BLEND_OP(i, Wy);
+	}
+
+	ax = statex[0]; bx = statex[1]; cx = statex[2]; dx = statex[3];
+	ex = statex[4]; fx = statex[5]; gx = statex[6]; hx = statex[7];
+	ay = statey[0]; by = statey[1]; cy = statey[2]; dy = statey[3];
+	ey = statey[4]; fy = statey[5]; gy = statey[6]; hy = statey[7];
+
+	for (i = 0; i < 64; i++) {
+		SHA256_ROUND(x, i);
+		SHA256_ROUND(y, i);
+	}
+
+	statex[0] += ax; statex[1] += bx; statex[2] += cx; statex[3] += dx;
+	statex[4] += ex; statex[5] += fx; statex[6] += gx; statex[7] += hx;
+	statey[0] += ay; statey[1] += by; statey[2] += cy; statey[3] += dy;
+	statey[4] += ey; statey[5] += fy; statey[6] += gy; statey[7] += hy;
+
+	memzero_explicit(Wx, sizeof(Wx));
+	memzero_explicit(Wy, sizeof(Wy));
+}
+
+/*
+ * Both messages have the same length, so they need padding at the same
+ * offsets and go through the same number of blocks.
+ */
+static int sha256_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			   unsigned int len, u8 * const outs[],
+			   unsigned int num_msgs)
+{
+	const unsigned int bit_offset = SHA256_BLOCK_SIZE - sizeof(__be64);
+	unsigned int digest_size = crypto_shash_digestsize(desc->tfm);
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+	struct sha256_state sctx2 = *sctx;
+	const u8 *srcx = data[0], *srcy = data[1];
+	unsigned int partial = sctx->count % SHA256_BLOCK_SIZE;
+	int i;
+
+	sctx->count += len;
+	sctx2.count += len;
+
+	if (partial) {
+		unsigned int p = min_t(unsigned int, len,
+				       SHA256_BLOCK_SIZE - partial);
+
+		memcpy(sctx->buf + partial, srcx, p);
+		memcpy(sctx2.buf + partial, srcy, p);
+		srcx += p;
+		srcy += p;
+		len -= p;
+		partial += p;
+		if (partial == SHA256_BLOCK_SIZE) {
+			sha256_transform_x2(sctx->state, sctx2.state,
+					    sctx->buf, sctx2.buf);
+			partial = 0;
+		}
+	}
+
+	for (; len >= SHA256_BLOCK_SIZE; len -= SHA256_BLOCK_SIZE) {
+		sha256_transform_x2(sctx->state, sctx2.state, srcx, srcy);
+		srcx += SHA256_BLOCK_SIZE;
+		srcy += SHA256_BLOCK_SIZE;
+	}
+	if (len) {
+		memcpy(sctx->buf, srcx, len);
+		memcpy(sctx2.buf, srcy, len);
+		partial = len;
+	}
+
+	sctx->buf[partial] = 0x80;
+	sctx2.buf[partial] = 0x80;
+	partial++;
+	if (partial > bit_offset) {
+		memset(sctx->buf + partial, 0, SHA256_BLOCK_SIZE - partial);
+		memset(sctx2.buf + partial, 0, SHA256_BLOCK_SIZE - partial);
+		sha256_transform_x2(sctx->state, sctx2.state,
+				    sctx->buf, sctx2.buf);
+		partial = 0;
+	}
+	memset(sctx->buf + partial, 0, bit_offset - partial);
+	memset(sctx2.buf + partial, 0, bit_offset - partial);
+	*(__be64 *)(sctx->buf + bit_offset) = cpu_to_be64(sctx->count << 3);
+	*(__be64 *)(sctx2.buf + bit_offset) = cpu_to_be64(sctx2.count << 3);
+	sha256_transform_x2(sctx->state, sctx2.state, sctx->buf, sctx2.buf);
+
+	for (i = 0; i < digest_size / sizeof(__be32); i++) {
+		put_unaligned_be32(sctx->state[i], (__be32 *)outs[0] + i);
+		put_unaligned_be32(sctx2.state[i], (__be32 *)outs[1] + i);
+	}
+
+	*sctx = (struct sha256_state){};
+	memzero_explicit(&sctx2, sizeof(sctx2));
+	return 0;
+}
+
 int crypto_sha256_update(struct shash_desc *desc, const u8 *data,
 			  unsigned int len)
 {
@@ -267,6 +410,8 @@ static struct shash_alg sha256_algs[2] = { {
 	.update		=	crypto_sha256_update,
 	.final		=	sha256_final,
 	.finup		=	crypto_sha256_finup,
+	.finup_mb	=	sha256_finup_mb,
+	.mb_max_msgs	=	2,
 	.descsize	=	sizeof(struct sha256_state),
 	.base		=	{
 		.cra_name	=	"sha256",
@@ -281,6 +426,8 @@ static struct shash_alg sha256_algs[2] = { {
 	.update		=	crypto_sha256_update,
 	.final		=	sha256_final,
 	.finup		=	crypto_sha256_finup,
+	.finup_mb	=	sha256_finup_mb,
+	.mb_max_msgs	=	2,
 	.descsize	=	sizeof(struct sha256_state),
 	.base		=	{
 		.cra_name	=	"sha224",
@@ -179,6 +179,47 @@ int crypto_shash_finup(struct shash_desc *desc, const u8 *data,
 }
 EXPORT_SYMBOL_GPL(crypto_shash_finup);
 
+static bool shash_mb_aligned(struct crypto_shash *tfm,
+			     const u8 * const data[], u8 * const outs[],
+			     unsigned int num_msgs)
+{
+	unsigned long alignmask = crypto_shash_alignmask(tfm);
+	unsigned int i;
+
+	for (i = 0; i < num_msgs; i++)
+		if (((unsigned long)data[i] | (unsigned long)outs[i]) &
+		    alignmask)
+			return false;
+	return true;
+}
+
+int crypto_shash_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			  unsigned int len, u8 * const outs[],
+			  unsigned int num_msgs)
+{
+	struct crypto_shash *tfm = desc->tfm;
+	struct shash_alg *shash = crypto_shash_alg(tfm);
+	SHASH_DESC_ON_STACK(copy, tfm);
+	unsigned int i;
+	int err = 0;
+
+	if (num_msgs > 1 && num_msgs <= shash->mb_max_msgs &&
+	    shash_mb_aligned(tfm, data, outs, num_msgs))
+		return shash->finup_mb(desc, data, len, outs, num_msgs);
+
+	for (i = 0; i + 1 < num_msgs && !err; i++) {
+		memcpy(copy, desc, sizeof(*desc) + crypto_shash_descsize(tfm));
+		err = crypto_shash_finup(copy, data[i], len, outs[i]);
+	}
+	shash_desc_zero(copy);
+	if (err)
+		return err;
+
+	/* The last message may use up @desc itself */
+	return crypto_shash_finup(desc, data[i], len, outs[i]);
+}
+EXPORT_SYMBOL_GPL(crypto_shash_finup_mb);
+
 static int shash_digest_unaligned(struct shash_desc *desc, const u8 *data,
 				  unsigned int len, u8 *out)
 {
@@ -483,6 +524,10 @@ static int shash_prepare_alg(struct shash_alg *alg)
 	}
 	if (!alg->setkey)
 		alg->setkey = shash_no_setkey;
+	if (!alg->finup_mb)
+		alg->mb_max_msgs = 1;
+	else if (alg->mb_max_msgs < 2 || alg->mb_max_msgs > HASH_MAX_MB_MSGS)
+		return -EINVAL;
 
 	return 0;
 }
@@ -28,6 +28,7 @@
 #include <linux/list.h>
 #include <linux/fs.h>
 #include <linux/async.h>
+#include <linux/initrd.h>
 #include <linux/pm.h>
 #include <linux/suspend.h>
 #include <linux/syscore_ops.h>
@@ -302,6 +303,9 @@ fw_get_filesystem_firmware(struct device *device, struct fw_priv *fw_priv)
 	enum kernel_read_file_id id = READING_FIRMWARE;
 	size_t msize = INT_MAX;
 
+	/* The firmware may well be shipped in the initramfs */
+	wait_for_initramfs();
+
 	/* Already populated data member means we're loading into a buffer */
 	if (fw_priv->data) {
 		id = READING_FIRMWARE_PREALLOC_BUFFER;
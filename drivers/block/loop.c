@@ -77,6 +77,8 @@
 #include <linux/falloc.h>
 #include <linux/uio.h>
 #include <linux/ioprio.h>
+#include <linux/sched/mm.h>
+#include <linux/memcontrol.h>
 
 #include "loop.h"
 
@@ -450,11 +452,24 @@ static int lo_req_flush(struct loop_device *lo, struct request *rq)
 	return ret;
 }
 
+static void loop_put_cgroups(struct loop_cmd *cmd)
+{
+	if (cmd->blkcg_css)
+		css_put(cmd->blkcg_css);
+	if (cmd->memcg_css)
+		css_put(cmd->memcg_css);
+	cmd->blkcg_css = NULL;
+	cmd->memcg_css = NULL;
+}
+
 static void lo_complete_rq(struct request *rq)
 {
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 	blk_status_t ret = BLK_STS_OK;
 
+	/* a requeued request picks them up again in loop_queue_rq() */
+	loop_put_cgroups(cmd);
+
 	if (!cmd->use_aio || cmd->ret < 0 || cmd->ret == blk_rq_bytes(rq) ||
 	    req_op(rq) != REQ_OP_READ) {
 		if (cmd->ret < 0)
@@ -500,8 +515,6 @@ static void lo_rw_aio_complete(struct kiocb *iocb, long ret, long ret2)
 {
 	struct loop_cmd *cmd = container_of(iocb, struct loop_cmd, iocb);
 
-	if (cmd->css)
-		css_put(cmd->css);
 	cmd->ret = ret;
 	lo_rw_aio_do_completion(cmd);
 }
@@ -562,8 +575,6 @@ static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 	cmd->iocb.ki_complete = lo_rw_aio_complete;
 	cmd->iocb.ki_flags = IOCB_DIRECT;
 	cmd->iocb.ki_ioprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_NONE, 0);
-	if (cmd->css)
-		kthread_associate_blkcg(cmd->css);
 
 	if (rw == WRITE)
 		ret = call_write_iter(file, &cmd->iocb, &iter);
@@ -571,7 +582,6 @@ static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 		ret = call_read_iter(file, &cmd->iocb, &iter);
 
 	lo_rw_aio_do_completion(cmd);
-	kthread_associate_blkcg(NULL);
 
 	if (ret != -EIOCBQUEUED)
 		cmd->iocb.ki_complete(&cmd->iocb, ret, 0);
@@ -879,8 +889,15 @@ static void loop_config_discard(struct loop_device *lo)
 
 static void loop_unprepare_queue(struct loop_device *lo)
 {
-	kthread_flush_worker(&lo->worker);
-	kthread_stop(lo->worker_task);
+	unsigned int i;
+
+	for (i = 0; i < lo->nr_workers; i++) {
+		kthread_flush_worker(&lo->workers[i].worker);
+		kthread_stop(lo->workers[i].task);
+	}
+	kfree(lo->workers);
+	lo->workers = NULL;
+	lo->nr_workers = 0;
 }
 
 static int loop_kthread_worker_fn(void *worker_ptr)
@@ -889,14 +906,45 @@ static int loop_kthread_worker_fn(void *worker_ptr)
 	return kthread_worker_fn(worker_ptr);
 }
 
+/*
+ * Start one worker per hardware queue and keep it on the CPUs which map
+ * to that queue, so unrelated IO submitted on different CPUs doesn't
+ * serialize behind a single thread.
+ */
 static int loop_prepare_queue(struct loop_device *lo)
 {
-	kthread_init_worker(&lo->worker);
-	lo->worker_task = kthread_run(loop_kthread_worker_fn,
-			&lo->worker, "loop%d", lo->lo_number);
-	if (IS_ERR(lo->worker_task))
+	unsigned int nr = lo->tag_set.nr_hw_queues;
+	struct blk_mq_hw_ctx *hctx;
+	struct task_struct *task;
+	unsigned int i;
+
+	lo->workers = kcalloc(nr, sizeof(*lo->workers), GFP_KERNEL);
+	if (!lo->workers)
 		return -ENOMEM;
-	set_user_nice(lo->worker_task, MIN_NICE);
+
+	queue_for_each_hw_ctx(lo->lo_queue, hctx, i) {
+		struct loop_worker *w = &lo->workers[i];
+
+		kthread_init_worker(&w->worker);
+		if (nr == 1)
+			task = kthread_create(loop_kthread_worker_fn,
+					&w->worker, "loop%d", lo->lo_number);
+		else
+			task = kthread_create(loop_kthread_worker_fn,
+					&w->worker, "loop%d.%u",
+					lo->lo_number, i);
+		if (IS_ERR(task)) {
+			loop_unprepare_queue(lo);
+			return -ENOMEM;
+		}
+
+		if (nr > 1 && !cpumask_empty(hctx->cpumask))
+			set_cpus_allowed_ptr(task, hctx->cpumask);
+		set_user_nice(task, MIN_NICE);
+		w->task = task;
+		lo->nr_workers++;
+		wake_up_process(task);
+	}
 	return 0;
 }
 
@@ -1693,6 +1741,9 @@ module_param(max_loop, int, 0444);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, 0444);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+static unsigned int nr_hw_queues = 1;
+module_param(nr_hw_queues, uint, 0444);
+MODULE_PARM_DESC(nr_hw_queues, "Number of hardware queues and worker threads per loop device, up to the number of CPUs (default: 1)");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1757,15 +1808,23 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		break;
 	}
 
-	/* always use the first bio's css */
+	/*
+	 * Always use the first bio's cgroups, the backing file IO is issued
+	 * and its page cache charged on behalf of them.
+	 */
+	cmd->blkcg_css = NULL;
+	cmd->memcg_css = NULL;
 #ifdef CONFIG_BLK_CGROUP
-	if (cmd->use_aio && rq->bio && rq->bio->bi_css) {
-		cmd->css = rq->bio->bi_css;
-		css_get(cmd->css);
-	} else
+	if (rq->bio && rq->bio->bi_css) {
+		cmd->blkcg_css = rq->bio->bi_css;
+		css_get(cmd->blkcg_css);
+#ifdef CONFIG_MEMCG
+		cmd->memcg_css = cgroup_get_e_css(cmd->blkcg_css->cgroup,
+						  &memory_cgrp_subsys);
+#endif
+	}
 #endif
-		cmd->css = NULL;
-	kthread_queue_work(&lo->worker, &cmd->work);
+	kthread_queue_work(&lo->workers[hctx->queue_num].worker, &cmd->work);
 
 	return BLK_STS_OK;
 }
@@ -1782,7 +1841,21 @@ static void loop_handle_cmd(struct loop_cmd *cmd)
 		goto failed;
 	}
 
+	if (cmd->blkcg_css)
+		kthread_associate_blkcg(cmd->blkcg_css);
+#ifdef CONFIG_MEMCG
+	if (cmd->memcg_css)
+		memalloc_use_memcg(mem_cgroup_from_css(cmd->memcg_css));
+#endif
+
 	ret = do_req_filebacked(lo, rq);
+
+#ifdef CONFIG_MEMCG
+	if (cmd->memcg_css)
+		memalloc_unuse_memcg();
+#endif
+	if (cmd->blkcg_css)
+		kthread_associate_blkcg(NULL);
  failed:
 	/* complete non-aio request */
 	if (!cmd->use_aio || ret) {
@@ -1841,7 +1914,7 @@ static int loop_add(struct loop_device **l, int i)
 
 	err = -ENOMEM;
 	lo->tag_set.ops = &loop_mq_ops;
-	lo->tag_set.nr_hw_queues = 1;
+	lo->tag_set.nr_hw_queues = nr_hw_queues;
 	lo->tag_set.queue_depth = 128;
 	lo->tag_set.numa_node = NUMA_NO_NODE;
 	lo->tag_set.cmd_size = sizeof(struct loop_cmd);
@@ -2086,6 +2159,8 @@ static int __init loop_init(void)
 		goto err_out;
 	}
 
+	nr_hw_queues = clamp_t(unsigned int, nr_hw_queues, 1, nr_cpu_ids);
+
 	/*
 	 * If max_loop is specified, create that many devices upfront.
 	 * This also becomes a hard limit. If max_loop is not specified,
@@ -55,8 +55,8 @@ struct loop_device {
 	spinlock_t		lo_lock;
 	int			lo_state;
 	struct mutex		lo_ctl_mutex;
-	struct kthread_worker	worker;
-	struct task_struct	*worker_task;
+	struct loop_worker	*workers;	/* one per hw queue */
+	unsigned int		nr_workers;
 	bool			use_dio;
 	bool			sysfs_inited;
 
@@ -65,6 +65,11 @@ struct loop_device {
 	struct gendisk		*lo_disk;
 };
 
+struct loop_worker {
+	struct kthread_worker	worker;
+	struct task_struct	*task;
+};
+
 struct loop_cmd {
 	struct kthread_work work;
 	bool use_aio; /* use AIO interface to handle I/O */
@@ -72,7 +77,8 @@ struct loop_cmd {
 	long ret;
 	struct kiocb iocb;
 	struct bio_vec *bvec;
-	struct cgroup_subsys_state *css;
+	struct cgroup_subsys_state *blkcg_css;
+	struct cgroup_subsys_state *memcg_css;
 };
 
 /* Support for loadable transfer modules */
@@ -1176,6 +1176,21 @@ static blk_status_t null_handle_cmd(struct nullb_cmd *cmd)
 		}
 	}
 
+	/* place zone appends before the data is transferred */
+	if (dev->zoned) {
+		if (dev->queue_mode == NULL_Q_BIO) {
+			if (bio_op(cmd->bio) == REQ_OP_ZONE_APPEND)
+				null_zone_append(cmd, cmd->bio->bi_iter.bi_sector,
+						 bio_sectors(cmd->bio));
+		} else {
+			if (req_op(cmd->rq) == REQ_OP_ZONE_APPEND)
+				null_zone_append(cmd, blk_rq_pos(cmd->rq),
+						 blk_rq_sectors(cmd->rq));
+		}
+		if (cmd->error)
+			goto out;
+	}
+
 	if (dev->memory_backed) {
 		if (dev->queue_mode == NULL_Q_BIO) {
 			if (bio_op(cmd->bio) == REQ_OP_FLUSH)
@@ -1687,6 +1702,8 @@ static int null_add_dev(struct nullb_device *dev)
 
 		blk_queue_chunk_sectors(nullb->q, dev->zone_size_sects);
 		nullb->q->limits.zoned = BLK_ZONED_HM;
+		blk_queue_max_zone_append_sectors(nullb->q,
+						  dev->zone_size_sects);
 	}
 
 	nullb->q->queuedata = nullb;
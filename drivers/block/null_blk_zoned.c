@@ -105,6 +105,31 @@ void null_zone_write(struct nullb_cmd *cmd, sector_t sector,
 	}
 }
 
+/*
+ * Zone append: the data goes to the write pointer of the zone containing
+ * @sector, and that position is reported back in the command's sector.
+ */
+void null_zone_append(struct nullb_cmd *cmd, sector_t sector,
+		      unsigned int nr_sectors)
+{
+	struct nullb_device *dev = cmd->nq->dev;
+	unsigned int zno = null_zone_no(dev, sector);
+	struct blk_zone *zone = &dev->zones[zno];
+
+	sector = zone->wp;
+	if (dev->queue_mode == NULL_Q_BIO)
+		cmd->bio->bi_iter.bi_sector = sector;
+	else
+		cmd->rq->__sector = sector;
+
+	if (zone->wp + nr_sectors > zone->start + zone->len) {
+		cmd->error = BLK_STS_IOERR;
+		return;
+	}
+
+	null_zone_write(cmd, sector, nr_sectors);
+}
+
 void null_zone_reset(struct nullb_cmd *cmd, sector_t sector)
 {
 	struct nullb_device *dev = cmd->nq->dev;
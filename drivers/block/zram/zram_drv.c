@@ -52,6 +52,8 @@ static unsigned int num_devices = 1;
 static size_t huge_class_size;
 
 static void zram_free_page(struct zram *zram, size_t index);
+static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
+				u32 index, int offset, struct bio *bio);
 
 static void zram_slot_lock(struct zram *zram, u32 index)
 {
@@ -133,6 +135,15 @@ static void zram_set_obj_size(struct zram *zram,
 	zram->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
+/* A slot is no longer idle once it is read or written */
+static void zram_accessed(struct zram *zram, u32 index)
+{
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+#ifdef CONFIG_ZRAM_MEMORY_TRACKING
+	zram->table[index].ac_time = ktime_get_boottime();
+#endif
+}
+
 #if PAGE_SIZE != 4096
 static inline bool is_partial_io(struct bio_vec *bvec)
 {
@@ -455,6 +466,7 @@ static unsigned long get_entry_bdev(struct zram *zram)
 
 	set_bit(entry, zram->bitmap);
 	spin_unlock(&zram->bitmap_lock);
+	atomic64_inc(&zram->stats.bd_count);
 
 	return entry;
 }
@@ -467,6 +479,7 @@ static void put_entry_bdev(struct zram *zram, unsigned long entry)
 	was_set = test_and_clear_bit(entry, zram->bitmap);
 	spin_unlock(&zram->bitmap_lock);
 	WARN_ON_ONCE(!was_set);
+	atomic64_dec(&zram->stats.bd_count);
 }
 
 static void zram_page_end_io(struct bio *bio)
@@ -561,6 +574,7 @@ static int read_from_bdev_sync(struct zram *zram, struct bio_vec *bvec,
 static int read_from_bdev(struct zram *zram, struct bio_vec *bvec,
 			unsigned long entry, struct bio *parent, bool sync)
 {
+	atomic64_inc(&zram->stats.bd_reads);
 	if (sync)
 		return read_from_bdev_sync(zram, bvec, entry, parent);
 	else
@@ -603,6 +617,7 @@ static int write_to_bdev(struct zram *zram, struct bio_vec *bvec,
 
 	submit_bio(bio);
 	*pentry = entry;
+	atomic64_inc(&zram->stats.bd_writes);
 
 	return 0;
 }
@@ -617,6 +632,411 @@ static void zram_wb_clear(struct zram *zram, u32 index)
 	put_entry_bdev(zram, entry);
 }
 
+#define FOUR_K(x) ((x) * (1 << (PAGE_SHIFT - 12)))
+
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+		"%8llu %8llu %8llu\n",
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_count)),
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_reads)),
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t writeback_limit_enable_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (kstrtobool(buf, &val))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	spin_lock(&zram->wb_limit_lock);
+	zram->wb_limit_enable = val;
+	spin_unlock(&zram->wb_limit_lock);
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t writeback_limit_enable_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	down_read(&zram->init_lock);
+	spin_lock(&zram->wb_limit_lock);
+	val = zram->wb_limit_enable;
+	spin_unlock(&zram->wb_limit_lock);
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+}
+
+/* The limit is in 4K units regardless of PAGE_SIZE */
+static ssize_t writeback_limit_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	u64 val;
+
+	if (kstrtoull(buf, 10, &val))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	spin_lock(&zram->wb_limit_lock);
+	zram->bd_wb_limit = val;
+	spin_unlock(&zram->wb_limit_lock);
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t writeback_limit_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	u64 val;
+
+	down_read(&zram->init_lock);
+	spin_lock(&zram->wb_limit_lock);
+	val = zram->bd_wb_limit;
+	spin_unlock(&zram->wb_limit_lock);
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%llu\n", val);
+}
+
+/* Check whether @nr_pages more pages fit into the writeback budget */
+static bool zram_wb_limit_ok(struct zram *zram, unsigned int nr_pages)
+{
+	bool ok;
+
+	spin_lock(&zram->wb_limit_lock);
+	ok = !zram->wb_limit_enable ||
+		zram->bd_wb_limit >= FOUR_K((u64)nr_pages);
+	spin_unlock(&zram->wb_limit_lock);
+
+	return ok;
+}
+
+static void zram_wb_limit_charge(struct zram *zram)
+{
+	spin_lock(&zram->wb_limit_lock);
+	if (zram->wb_limit_enable && zram->bd_wb_limit > 0)
+		zram->bd_wb_limit -= min_t(u64, FOUR_K(1), zram->bd_wb_limit);
+	spin_unlock(&zram->wb_limit_lock);
+}
+
+#define IDLE_WRITEBACK		1
+#define HUGE_WRITEBACK		2
+
+/* Maximum number of pages written back by one round of bios */
+#define ZRAM_WB_BATCH		32
+
+struct zram_wb_batch;
+
+struct zram_wb_req {
+	struct zram_wb_batch *batch;
+	struct page *page;
+	u32 index;
+	unsigned long entry;
+	/* number of reqs carried by the bio this req starts, or 0 */
+	unsigned int nr_bio_reqs;
+	blk_status_t status;
+};
+
+struct zram_wb_batch {
+	struct zram *zram;
+	unsigned int nr;
+	atomic_t pending;
+	wait_queue_head_t wait;
+	struct zram_wb_req reqs[ZRAM_WB_BATCH];
+};
+
+static void zram_wb_batch_free(struct zram_wb_batch *batch)
+{
+	int i;
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		if (batch->reqs[i].page)
+			__free_page(batch->reqs[i].page);
+	}
+	kfree(batch);
+}
+
+static struct zram_wb_batch *zram_wb_batch_alloc(struct zram *zram)
+{
+	struct zram_wb_batch *batch;
+	int i;
+
+	batch = kzalloc(sizeof(*batch), GFP_KERNEL);
+	if (!batch)
+		return NULL;
+
+	batch->zram = zram;
+	init_waitqueue_head(&batch->wait);
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		batch->reqs[i].batch = batch;
+		batch->reqs[i].page = alloc_page(GFP_KERNEL | __GFP_HIGHMEM);
+		if (!batch->reqs[i].page) {
+			zram_wb_batch_free(batch);
+			return NULL;
+		}
+	}
+
+	return batch;
+}
+
+static void zram_wb_end_io(struct bio *bio)
+{
+	struct zram_wb_req *req = bio->bi_private;
+	struct zram_wb_batch *batch = req->batch;
+	unsigned int i;
+
+	for (i = 0; i < req->nr_bio_reqs; i++)
+		req[i].status = bio->bi_status;
+	bio_put(bio);
+
+	if (atomic_dec_and_test(&batch->pending))
+		wake_up(&batch->wait);
+}
+
+static void zram_wb_submit_bio(struct zram_wb_batch *batch, struct bio *bio)
+{
+	atomic_inc(&batch->pending);
+	submit_bio(bio);
+}
+
+/*
+ * Write the batched pages out, merging requests for consecutive blocks
+ * of the backing device into one bio, and wait for all of them.
+ */
+static void zram_wb_submit(struct zram_wb_batch *batch)
+{
+	struct zram *zram = batch->zram;
+	struct zram_wb_req *first = NULL;
+	struct bio *bio = NULL;
+	struct blk_plug plug;
+	unsigned int i;
+
+	atomic_set(&batch->pending, 1);
+	blk_start_plug(&plug);
+	for (i = 0; i < batch->nr; i++) {
+		struct zram_wb_req *req = &batch->reqs[i];
+
+		req->nr_bio_reqs = 0;
+		req->status = BLK_STS_OK;
+		if (bio && req->entry == req[-1].entry + 1 &&
+		    bio_add_page(bio, req->page, PAGE_SIZE, 0)) {
+			first->nr_bio_reqs++;
+			continue;
+		}
+
+		if (bio)
+			zram_wb_submit_bio(batch, bio);
+
+		bio = bio_alloc(GFP_NOIO, batch->nr - i);
+		bio_set_dev(bio, zram->bdev);
+		bio->bi_iter.bi_sector = req->entry * (PAGE_SIZE >> 9);
+		bio->bi_opf = REQ_OP_WRITE | REQ_SYNC;
+		bio->bi_end_io = zram_wb_end_io;
+		bio->bi_private = req;
+		bio_add_page(bio, req->page, PAGE_SIZE, 0);
+		first = req;
+		first->nr_bio_reqs = 1;
+	}
+	if (bio)
+		zram_wb_submit_bio(batch, bio);
+	blk_finish_plug(&plug);
+
+	if (!atomic_dec_and_test(&batch->pending))
+		wait_event(batch->wait, !atomic_read(&batch->pending));
+}
+
+/* Undo the claim writeback_store() put on a slot it won't write back */
+static void zram_wb_cancel(struct zram *zram, u32 index)
+{
+	zram_slot_lock(zram, index);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_slot_unlock(zram, index);
+}
+
+static int zram_wb_flush(struct zram_wb_batch *batch)
+{
+	struct zram *zram = batch->zram;
+	int ret = 0;
+	unsigned int i;
+
+	if (!batch->nr)
+		return 0;
+
+	zram_wb_submit(batch);
+
+	for (i = 0; i < batch->nr; i++) {
+		struct zram_wb_req *req = &batch->reqs[i];
+
+		if (req->status) {
+			zram_wb_cancel(zram, req->index);
+			put_entry_bdev(zram, req->entry);
+			ret = blk_status_to_errno(req->status);
+			continue;
+		}
+
+		atomic64_inc(&zram->stats.bd_writes);
+		zram_wb_limit_charge(zram);
+
+		/*
+		 * The slot lock was dropped during the IO, so the slot may
+		 * have been freed or rewritten meanwhile.  Both clear
+		 * ZRAM_IDLE and idle_store() never marks a slot under
+		 * writeback, so a set ZRAM_IDLE means the data on the
+		 * backing device is still current.
+		 */
+		zram_slot_lock(zram, req->index);
+		if (!zram_allocated(zram, req->index) ||
+		    !zram_test_flag(zram, req->index, ZRAM_IDLE)) {
+			zram_clear_flag(zram, req->index, ZRAM_UNDER_WB);
+			zram_clear_flag(zram, req->index, ZRAM_IDLE);
+			zram_slot_unlock(zram, req->index);
+			put_entry_bdev(zram, req->entry);
+			continue;
+		}
+
+		zram_free_page(zram, req->index);
+		zram_clear_flag(zram, req->index, ZRAM_UNDER_WB);
+		zram_set_flag(zram, req->index, ZRAM_WB);
+		zram_set_element(zram, req->index, req->entry);
+		zram_slot_unlock(zram, req->index);
+		atomic64_inc(&zram->stats.pages_stored);
+	}
+	batch->nr = 0;
+
+	return ret;
+}
+
+static bool zram_can_writeback(struct zram *zram, u32 index, int mode)
+{
+	if (!zram_allocated(zram, index))
+		return false;
+
+	if (zram_test_flag(zram, index, ZRAM_WB) ||
+	    zram_test_flag(zram, index, ZRAM_SAME) ||
+	    zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		return false;
+
+	if (mode == IDLE_WRITEBACK && !zram_test_flag(zram, index, ZRAM_IDLE))
+		return false;
+	if (mode == HUGE_WRITEBACK && !zram_test_flag(zram, index, ZRAM_HUGE))
+		return false;
+
+	return true;
+}
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_wb_batch *batch;
+	unsigned long nr_pages, index;
+	ssize_t ret = len;
+	int mode, err;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = IDLE_WRITEBACK;
+	else if (sysfs_streq(buf, "huge"))
+		mode = HUGE_WRITEBACK;
+	else
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	if (!zram_wb_enabled(zram)) {
+		ret = -ENODEV;
+		goto release_init_lock;
+	}
+
+	batch = zram_wb_batch_alloc(zram);
+	if (!batch) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		struct zram_wb_req *req = &batch->reqs[batch->nr];
+		struct bio_vec bvec;
+
+		if (!zram_wb_limit_ok(zram, batch->nr + 1)) {
+			ret = -EIO;
+			break;
+		}
+
+		zram_slot_lock(zram, index);
+		if (!zram_can_writeback(zram, index, mode)) {
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+		/*
+		 * Clearing ZRAM_UNDER_WB is the duty of writeback, i.e.
+		 * zram_free_page() never clears it.  ZRAM_IDLE is set for
+		 * the huge mode as well to catch racing accesses.
+		 */
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		zram_set_flag(zram, index, ZRAM_IDLE);
+		zram_slot_unlock(zram, index);
+
+		bvec.bv_page = req->page;
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		if (zram_bvec_read(zram, &bvec, index, 0, NULL)) {
+			zram_wb_cancel(zram, index);
+			continue;
+		}
+
+		req->entry = get_entry_bdev(zram);
+		if (!req->entry) {
+			zram_wb_cancel(zram, index);
+			ret = -ENOSPC;
+			break;
+		}
+		req->index = index;
+
+		if (++batch->nr == ZRAM_WB_BATCH) {
+			err = zram_wb_flush(batch);
+			if (err)
+				ret = err;
+		}
+		cond_resched();
+	}
+
+	err = zram_wb_flush(batch);
+	if (err)
+		ret = err;
+	zram_wb_batch_free(batch);
+
+release_init_lock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
 #else
 static bool zram_wb_enabled(struct zram *zram) { return false; }
 static inline void reset_bdev(struct zram *zram) {};
@@ -650,11 +1070,6 @@ static void zram_debugfs_destroy(void)
 	debugfs_remove_recursive(zram_debugfs_root);
 }
 
-static void zram_accessed(struct zram *zram, u32 index)
-{
-	zram->table[index].ac_time = ktime_get_boottime();
-}
-
 static void zram_reset_access(struct zram *zram, u32 index)
 {
 	zram->table[index].ac_time = 0;
@@ -689,12 +1104,14 @@ static ssize_t read_block_state(struct file *file, char __user *buf,
 
 		ts = ktime_to_timespec64(zram->table[index].ac_time);
 		copied = snprintf(kbuf + written, count,
-			"%12zd %12lld.%06lu %c%c%c\n",
+			"%12zd %12lld.%06lu %c%c%c%c%c\n",
 			index, (s64)ts.tv_sec,
 			ts.tv_nsec / NSEC_PER_USEC,
 			zram_test_flag(zram, index, ZRAM_SAME) ? 's' : '.',
 			zram_test_flag(zram, index, ZRAM_WB) ? 'w' : '.',
-			zram_test_flag(zram, index, ZRAM_HUGE) ? 'h' : '.');
+			zram_test_flag(zram, index, ZRAM_HUGE) ? 'h' : '.',
+			zram_test_flag(zram, index, ZRAM_IDLE) ? 'i' : '.',
+			zram_test_flag(zram, index, ZRAM_RECOMP) ? 'r' : '.');
 
 		if (count < copied) {
 			zram_slot_unlock(zram, index);
@@ -739,7 +1156,6 @@ static void zram_debugfs_unregister(struct zram *zram)
 #else
 static void zram_debugfs_create(void) {};
 static void zram_debugfs_destroy(void) {};
-static void zram_accessed(struct zram *zram, u32 index) {};
 static void zram_reset_access(struct zram *zram, u32 index) {};
 static void zram_debugfs_register(struct zram *zram) {};
 static void zram_debugfs_unregister(struct zram *zram) {};
@@ -779,11 +1195,10 @@ static ssize_t comp_algorithm_show(struct device *dev,
 	return sz;
 }
 
-static ssize_t comp_algorithm_store(struct device *dev,
-		struct device_attribute *attr, const char *buf, size_t len)
+static ssize_t __comp_algorithm_store(struct zram *zram, char *algo,
+		const char *buf, size_t len)
 {
-	struct zram *zram = dev_to_zram(dev);
-	char compressor[ARRAY_SIZE(zram->compressor)];
+	char compressor[CRYPTO_MAX_ALG_NAME];
 	size_t sz;
 
 	strlcpy(compressor, buf, sizeof(compressor));
@@ -802,11 +1217,42 @@ static ssize_t comp_algorithm_store(struct device *dev,
 		return -EBUSY;
 	}
 
-	strcpy(zram->compressor, compressor);
+	strcpy(algo, compressor);
 	up_write(&zram->init_lock);
 	return len;
 }
 
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return __comp_algorithm_store(zram, zram->compressor, buf, len);
+}
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->recomp_algorithm, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return __comp_algorithm_store(zram, zram->recomp_algorithm, buf, len);
+}
+#endif
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -824,6 +1270,39 @@ static ssize_t compact_store(struct device *dev,
 	return len;
 }
 
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages, index;
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		/*
+		 * Do not mark ZRAM_UNDER_WB slot as ZRAM_IDLE to close race.
+		 * See the comment in zram_wb_flush().
+		 */
+		zram_slot_lock(zram, index);
+		if (zram_allocated(zram, index) &&
+		    !zram_test_flag(zram, index, ZRAM_UNDER_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		zram_slot_unlock(zram, index);
+		cond_resched();
+	}
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
 static ssize_t io_stat_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -941,6 +1420,9 @@ static void zram_free_page(struct zram *zram, size_t index)
 	unsigned long handle;
 
 	zram_reset_access(zram, index);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_RECOMP);
+	zram_clear_flag(zram, index, ZRAM_INCOMPRESSIBLE);
 
 	if (zram_test_flag(zram, index, ZRAM_HUGE)) {
 		zram_clear_flag(zram, index, ZRAM_HUGE);
@@ -979,32 +1461,28 @@ static void zram_free_page(struct zram *zram, size_t index)
 	zram_set_obj_size(zram, index, 0);
 }
 
-static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
-				struct bio *bio, bool partial_io)
+/* The algorithm the in-memory object of @index was compressed with */
+static struct zcomp *zram_slot_comp(struct zram *zram, u32 index)
+{
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	if (zram_test_flag(zram, index, ZRAM_RECOMP))
+		return zram->recomp;
+#endif
+	return zram->comp;
+}
+
+/*
+ * Decompress the in-memory copy of slot @index into @page.
+ * The caller must hold the slot lock.
+ */
+static int zram_read_from_zspool(struct zram *zram, struct page *page,
+				u32 index)
 {
 	int ret;
 	unsigned long handle;
 	unsigned int size;
 	void *src, *dst;
 
-	if (zram_wb_enabled(zram)) {
-		zram_slot_lock(zram, index);
-		if (zram_test_flag(zram, index, ZRAM_WB)) {
-			struct bio_vec bvec;
-
-			zram_slot_unlock(zram, index);
-
-			bvec.bv_page = page;
-			bvec.bv_len = PAGE_SIZE;
-			bvec.bv_offset = 0;
-			return read_from_bdev(zram, &bvec,
-					zram_get_element(zram, index),
-					bio, partial_io);
-		}
-		zram_slot_unlock(zram, index);
-	}
-
-	zram_slot_lock(zram, index);
 	handle = zram_get_handle(zram, index);
 	if (!handle || zram_test_flag(zram, index, ZRAM_SAME)) {
 		unsigned long value;
@@ -1014,7 +1492,6 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		mem = kmap_atomic(page);
 		zram_fill_page(mem, PAGE_SIZE, value);
 		kunmap_atomic(mem);
-		zram_slot_unlock(zram, index);
 		return 0;
 	}
 
@@ -1027,14 +1504,43 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		kunmap_atomic(dst);
 		ret = 0;
 	} else {
-		struct zcomp_strm *zstrm = zcomp_stream_get(zram->comp);
+		struct zcomp *comp = zram_slot_comp(zram, index);
+		struct zcomp_strm *zstrm = zcomp_stream_get(comp);
 
 		dst = kmap_atomic(page);
 		ret = zcomp_decompress(zstrm, src, size, dst);
 		kunmap_atomic(dst);
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 	}
 	zs_unmap_object(zram->mem_pool, handle);
+
+	return ret;
+}
+
+static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
+				struct bio *bio, bool partial_io)
+{
+	int ret;
+
+	if (zram_wb_enabled(zram)) {
+		zram_slot_lock(zram, index);
+		if (zram_test_flag(zram, index, ZRAM_WB)) {
+			struct bio_vec bvec;
+
+			zram_slot_unlock(zram, index);
+
+			bvec.bv_page = page;
+			bvec.bv_len = PAGE_SIZE;
+			bvec.bv_offset = 0;
+			return read_from_bdev(zram, &bvec,
+					zram_get_element(zram, index),
+					bio, partial_io);
+		}
+		zram_slot_unlock(zram, index);
+	}
+
+	zram_slot_lock(zram, index);
+	ret = zram_read_from_zspool(zram, page, index);
 	zram_slot_unlock(zram, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
@@ -1248,6 +1754,178 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+#define RECOMPRESS_IDLE		(1 << 0)
+#define RECOMPRESS_HUGE		(1 << 1)
+
+static bool zram_can_recompress(struct zram *zram, u32 index, int mode)
+{
+	if (!zram_allocated(zram, index) || !zram_get_handle(zram, index))
+		return false;
+
+	if (zram_test_flag(zram, index, ZRAM_WB) ||
+	    zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+	    zram_test_flag(zram, index, ZRAM_SAME) ||
+	    zram_test_flag(zram, index, ZRAM_RECOMP) ||
+	    zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
+		return false;
+
+	if ((mode & RECOMPRESS_IDLE) && !zram_test_flag(zram, index, ZRAM_IDLE))
+		return false;
+	if ((mode & RECOMPRESS_HUGE) && !zram_test_flag(zram, index, ZRAM_HUGE))
+		return false;
+
+	return true;
+}
+
+/*
+ * Recompress slot @index with the secondary algorithm and keep the new
+ * object only if it is smaller.  Runs entirely under the slot lock, so
+ * the object allocation must not sleep; slots we fail to allocate for
+ * are simply left alone.  @page is a scratch page.
+ */
+static int zram_recompress(struct zram *zram, u32 index, struct page *page)
+{
+	unsigned int comp_len_old, comp_len_new;
+	unsigned long handle_new;
+	struct zcomp_strm *zstrm;
+	bool idle;
+	void *src, *dst;
+	int ret;
+
+	comp_len_old = zram_get_obj_size(zram, index);
+	ret = zram_read_from_zspool(zram, page, index);
+	if (ret)
+		return ret;
+
+	zstrm = zcomp_stream_get(zram->recomp);
+	src = kmap_atomic(page);
+	ret = zcomp_compress(zstrm, src, &comp_len_new);
+	kunmap_atomic(src);
+	if (ret) {
+		zcomp_stream_put(zram->recomp);
+		return ret;
+	}
+
+	if (comp_len_new >= huge_class_size || comp_len_new >= comp_len_old) {
+		zcomp_stream_put(zram->recomp);
+		/* Don't waste cycles on this slot again */
+		zram_set_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+		return 0;
+	}
+
+	handle_new = zs_malloc(zram->mem_pool, comp_len_new,
+			__GFP_KSWAPD_RECLAIM |
+			__GFP_NOWARN |
+			__GFP_HIGHMEM |
+			__GFP_MOVABLE);
+	if (!handle_new) {
+		zcomp_stream_put(zram->recomp);
+		return 0;
+	}
+
+	dst = zs_map_object(zram->mem_pool, handle_new, ZS_MM_WO);
+	memcpy(dst, zstrm->buffer, comp_len_new);
+	zcomp_stream_put(zram->recomp);
+	zs_unmap_object(zram->mem_pool, handle_new);
+
+	/* Recompression is not an access, keep the slot idle */
+	idle = zram_test_flag(zram, index, ZRAM_IDLE);
+	zram_free_page(zram, index);
+	zram_set_handle(zram, index, handle_new);
+	zram_set_obj_size(zram, index, comp_len_new);
+	zram_set_flag(zram, index, ZRAM_RECOMP);
+	if (idle)
+		zram_set_flag(zram, index, ZRAM_IDLE);
+
+	atomic64_add(comp_len_new, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.pages_stored);
+
+	return 0;
+}
+
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages, index;
+	struct page *page;
+	ssize_t ret = len;
+	int mode;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = RECOMPRESS_IDLE;
+	else if (sysfs_streq(buf, "huge"))
+		mode = RECOMPRESS_HUGE;
+	else if (sysfs_streq(buf, "huge_idle"))
+		mode = RECOMPRESS_IDLE | RECOMPRESS_HUGE;
+	else
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->recomp) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	page = alloc_page(GFP_KERNEL | __GFP_HIGHMEM);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		int err = 0;
+
+		zram_slot_lock(zram, index);
+		if (zram_can_recompress(zram, index, mode))
+			err = zram_recompress(zram, index, page);
+		zram_slot_unlock(zram, index);
+
+		if (err) {
+			ret = err;
+			break;
+		}
+		cond_resched();
+	}
+	__free_page(page);
+
+release_init_lock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static int zram_recomp_create(struct zram *zram)
+{
+	struct zcomp *recomp;
+
+	if (!zram->recomp_algorithm[0])
+		return 0;
+
+	recomp = zcomp_create(zram->recomp_algorithm);
+	if (IS_ERR(recomp)) {
+		pr_err("Cannot initialise %s recompressing backend\n",
+				zram->recomp_algorithm);
+		return PTR_ERR(recomp);
+	}
+
+	zram->recomp = recomp;
+	return 0;
+}
+
+static void zram_recomp_destroy(struct zram *zram)
+{
+	if (zram->recomp)
+		zcomp_destroy(zram->recomp);
+	zram->recomp = NULL;
+}
+#else
+static int zram_recomp_create(struct zram *zram) { return 0; }
+static void zram_recomp_destroy(struct zram *zram) {}
+#endif
+
 /*
  * zram_bio_discard - handler on discard request
  * @index: physical block index in PAGE_SIZE units
@@ -1483,6 +2161,7 @@ static void zram_reset_device(struct zram *zram)
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zcomp_destroy(comp);
+	zram_recomp_destroy(zram);
 	reset_bdev(zram);
 }
 
@@ -1519,6 +2198,12 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_free_meta;
 	}
 
+	err = zram_recomp_create(zram);
+	if (err) {
+		zcomp_destroy(comp);
+		goto out_free_meta;
+	}
+
 	zram->comp = comp;
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
@@ -1603,6 +2288,7 @@ static const struct block_device_operations zram_devops = {
 };
 
 static DEVICE_ATTR_WO(compact);
+static DEVICE_ATTR_WO(idle);
 static DEVICE_ATTR_RW(disksize);
 static DEVICE_ATTR_RO(initstate);
 static DEVICE_ATTR_WO(reset);
@@ -1612,6 +2298,14 @@ static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
+static DEVICE_ATTR_WO(writeback);
+static DEVICE_ATTR_RW(writeback_limit);
+static DEVICE_ATTR_RW(writeback_limit_enable);
+static DEVICE_ATTR_RO(bd_stat);
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(recompress);
 #endif
 
 static struct attribute *zram_disk_attrs[] = {
@@ -1619,12 +2313,21 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_initstate.attr,
 	&dev_attr_reset.attr,
 	&dev_attr_compact.attr,
+	&dev_attr_idle.attr,
 	&dev_attr_mem_limit.attr,
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_writeback_limit.attr,
+	&dev_attr_writeback_limit_enable.attr,
+	&dev_attr_bd_stat.attr,
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
 #endif
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
@@ -1661,6 +2364,9 @@ static int zram_add(void)
 	device_id = ret;
 
 	init_rwsem(&zram->init_lock);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->wb_limit_lock);
+#endif
 
 	queue = blk_alloc_queue(GFP_KERNEL);
 	if (!queue) {
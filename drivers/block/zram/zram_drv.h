@@ -47,7 +47,11 @@ enum zram_pageflags {
 	ZRAM_LOCK = ZRAM_FLAG_SHIFT,
 	ZRAM_SAME,	/* Page consists the same element */
 	ZRAM_WB,	/* page is stored on backing_device */
+	ZRAM_UNDER_WB,	/* page is under writeback */
 	ZRAM_HUGE,	/* Incompressible page */
+	ZRAM_IDLE,	/* not accessed page since last idle marking */
+	ZRAM_RECOMP,	/* page is compressed with the secondary algorithm */
+	ZRAM_INCOMPRESSIBLE, /* recompression did not save memory */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -79,6 +83,11 @@ struct zram_stats {
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	atomic64_t bd_count;		/* no. of pages in backing device */
+	atomic64_t bd_reads;		/* no. of reads from backing device */
+	atomic64_t bd_writes;		/* no. of writes to backing device */
+#endif
 };
 
 struct zram {
@@ -100,6 +109,11 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 	char compressor[CRYPTO_MAX_ALG_NAME];
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	/* optional slower, higher ratio algorithm for idle/huge pages */
+	struct zcomp *recomp;
+	char recomp_algorithm[CRYPTO_MAX_ALG_NAME];
+#endif
 	/*
 	 * zram is claimed so open request will be failed
 	 */
@@ -111,6 +125,9 @@ struct zram {
 	unsigned long *bitmap;
 	unsigned long nr_pages;
 	spinlock_t bitmap_lock;
+	spinlock_t wb_limit_lock;
+	bool wb_limit_enable;
+	u64 bd_wb_limit;	/* in 4K units */
 #endif
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
 	struct dentry *debugfs_dir;
@@ -266,6 +266,9 @@
 #include <linux/completion.h>
 #include <linux/uuid.h>
 #include <crypto/chacha20.h>
+#ifdef CONFIG_VDSO_GETRANDOM
+#include <asm/vgetrandom.h>
+#endif
 
 #include <asm/processor.h>
 #include <linux/uaccess.h>
@@ -439,6 +442,31 @@ static void _crng_backtrack_protect(struct crng_state *crng,
 static void process_random_ready_list(void);
 static void _get_random_bytes(void *buf, int nbytes);
 
+#ifdef CONFIG_VDSO_GETRANDOM
+static atomic_long_t vdso_rng_generation = ATOMIC_LONG_INIT(0);
+
+/*
+ * Make every vDSO getrandom() state fetch a new key from the crng on its
+ * next use.  Concurrent callers may publish their generations out of
+ * order, which is fine: each of them differs from all earlier ones.
+ */
+static void crng_vdso_invalidate(void)
+{
+	/* Paired with the READ_ONCE()s of the generation in the vDSO */
+	smp_store_release(&vdso_rng_data.generation,
+			  atomic_long_inc_return(&vdso_rng_generation));
+}
+
+static void crng_vdso_set_ready(void)
+{
+	crng_vdso_invalidate();
+	smp_store_release(&vdso_rng_data.is_ready, true);
+}
+#else
+static inline void crng_vdso_invalidate(void) {}
+static inline void crng_vdso_set_ready(void) {}
+#endif
+
 static struct ratelimit_state unseeded_warning =
 	RATELIMIT_STATE_INIT("warn_unseeded_randomness", HZ, 3);
 static struct ratelimit_state urandom_warning =
@@ -808,6 +836,7 @@ static void crng_initialize(struct crng_state *crng)
 	}
 	if (trust_cpu && arch_init) {
 		crng_init = 2;
+		crng_vdso_set_ready();
 		pr_notice("random: crng done (trusting CPU's manufacturer)\n");
 	}
 	crng->init_time = jiffies - CRNG_RESEED_INTERVAL - 1;
@@ -950,10 +979,13 @@ static void crng_reseed(struct crng_state *crng, struct entropy_store *r)
 	memzero_explicit(&buf, sizeof(buf));
 	crng->init_time = jiffies;
 	spin_unlock_irqrestore(&crng->lock, flags);
+	if (crng == &primary_crng && crng_init == 2)
+		crng_vdso_invalidate();
 	if (crng == &primary_crng && crng_init < 2) {
 		invalidate_batched_entropy();
 		numa_crng_init();
 		crng_init = 2;
+		crng_vdso_set_ready();
 		process_random_ready_list();
 		wake_up_interruptible(&crng_init_wait);
 		pr_notice("random: crng init done\n");
@@ -1114,6 +1146,28 @@ void add_device_randomness(const void *buf, unsigned int size)
 }
 EXPORT_SYMBOL(add_device_randomness);
 
+/**
+ * add_vmfork_randomness - reseed after the VM was forked or restored
+ * @unique_vm_id: the new VM generation ID
+ * @size: size of @unique_vm_id
+ *
+ * Called by the VM generation ID driver when the hypervisor reports that
+ * the VM is a clone or a restored snapshot, so that the copies stop
+ * producing the same random numbers.  The vDSO getrandom() states are
+ * invalidated even if the input pool cannot reseed the crng yet.
+ */
+void add_vmfork_randomness(const void *unique_vm_id, unsigned int size)
+{
+	add_device_randomness(unique_vm_id, size);
+	if (crng_ready()) {
+		crng_reseed(&primary_crng, &input_pool);
+		crng_global_init_time = jiffies - 1;
+		crng_vdso_invalidate();
+		pr_notice("random: crng reseeded due to virtual machine fork\n");
+	}
+}
+EXPORT_SYMBOL_GPL(add_vmfork_randomness);
+
 static struct timer_rand_state input_timer_state = INIT_TIMER_RAND_STATE;
 
 /*
@@ -461,6 +461,92 @@ static inline void verity_bv_skip_block(struct dm_verity *v,
 	bio_advance_iter(bio, iter, 1 << v->data_dev_block_bits);
 }
 
+/*
+ * Whether the data block at iter can be hashed together with others: the
+ * algorithm can do it, and the block lies within a single page.
+ */
+static bool verity_can_batch_block(struct dm_verity *v,
+				   struct dm_verity_io *io,
+				   struct bvec_iter *iter)
+{
+	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_io_data_size);
+	unsigned int block_size = 1 << v->data_dev_block_bits;
+	struct bio_vec bv;
+
+	if (!v->shash_tfm)
+		return false;
+
+	bv = bio_iter_iovec(bio, *iter);
+	return bv.bv_len >= block_size &&
+	       bv.bv_offset + block_size <= PAGE_SIZE;
+}
+
+/*
+ * Hash the pending data blocks in one call and check them, the same way
+ * verity_verify_io() checks a single block.
+ */
+static int verity_verify_pending(struct dm_verity *v, struct dm_verity_io *io)
+{
+	const u8 *data[DM_VERITY_MAX_PENDING_DATA_BLOCKS];
+	u8 *outs[DM_VERITY_MAX_PENDING_DATA_BLOCKS];
+	SHASH_DESC_ON_STACK(desc, v->shash_tfm);
+	unsigned int i;
+	int r;
+
+	if (!io->num_pending)
+		return 0;
+
+	desc->tfm = v->shash_tfm;
+	desc->flags = 0;
+	r = crypto_shash_init(desc);
+	if (likely(!r) && v->salt_size)
+		r = crypto_shash_update(desc, v->salt, v->salt_size);
+	if (likely(!r)) {
+		for (i = 0; i < io->num_pending; i++) {
+			data[i] = (u8 *)kmap_atomic(io->pending[i].page) +
+				  io->pending[i].offset;
+			outs[i] = io->pending[i].real_digest;
+		}
+		r = crypto_shash_finup_mb(desc, data,
+					  1 << v->data_dev_block_bits,
+					  outs, io->num_pending);
+		while (i--)
+			kunmap_atomic((void *)data[i]);
+	}
+	shash_desc_zero(desc);
+	if (unlikely(r < 0)) {
+		DMERR("verity_verify_pending crypto op failed: %d", r);
+		goto out;
+	}
+
+	for (i = 0; i < io->num_pending; i++) {
+		struct dm_verity_pending_block *pb = &io->pending[i];
+
+		if (likely(memcmp(pb->real_digest, pb->want_digest,
+				  v->digest_size) == 0)) {
+			if (v->validated_blocks)
+				set_bit(pb->block, v->validated_blocks);
+			continue;
+		}
+
+		/* FEC checks its result against the io's want digest */
+		memcpy(verity_io_want_digest(v, io), pb->want_digest,
+		       v->digest_size);
+		if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
+				      pb->block, NULL, &pb->start) == 0)
+			continue;
+		if (verity_handle_err(v, DM_VERITY_BLOCK_TYPE_DATA,
+				      pb->block)) {
+			r = -EIO;
+			goto out;
+		}
+	}
+	r = 0;
+out:
+	io->num_pending = 0;
+	return r;
+}
+
 /*
  * Verify one "dm_verity_io" structure.
  */
@@ -472,6 +558,8 @@ static int verity_verify_io(struct dm_verity_io *io)
 	unsigned b;
 	struct crypto_wait wait;
 
+	io->num_pending = 0;
+
 	for (b = 0; b < io->n_blocks; b++) {
 		int r;
 		sector_t cur_block = io->block + b;
@@ -502,6 +590,29 @@ static int verity_verify_io(struct dm_verity_io *io)
 			continue;
 		}
 
+		if (verity_can_batch_block(v, io, &io->iter)) {
+			struct bio *bio = dm_bio_from_per_bio_data(io,
+						v->ti->per_io_data_size);
+			struct bio_vec bv = bio_iter_iovec(bio, io->iter);
+			struct dm_verity_pending_block *pb =
+				&io->pending[io->num_pending++];
+
+			pb->block = cur_block;
+			pb->start = io->iter;
+			pb->page = bv.bv_page;
+			pb->offset = bv.bv_offset;
+			memcpy(pb->want_digest, verity_io_want_digest(v, io),
+			       v->digest_size);
+			verity_bv_skip_block(v, io, &io->iter);
+
+			if (io->num_pending == v->mb_max_msgs) {
+				r = verity_verify_pending(v, io);
+				if (unlikely(r < 0))
+					return r;
+			}
+			continue;
+		}
+
 		r = verity_hash_init(v, req, &wait);
 		if (unlikely(r < 0))
 			return r;
@@ -530,7 +641,7 @@ static int verity_verify_io(struct dm_verity_io *io)
 			return -EIO;
 	}
 
-	return 0;
+	return verity_verify_pending(v, io);
 }
 
 /*
@@ -790,6 +901,9 @@ static void verity_dtr(struct dm_target *ti)
 	if (v->tfm)
 		crypto_free_ahash(v->tfm);
 
+	if (v->shash_tfm)
+		crypto_free_shash(v->shash_tfm);
+
 	kfree(v->alg_name);
 
 	if (v->hash_dev)
@@ -855,6 +969,39 @@ static int verity_alloc_zero_digest(struct dm_verity *v)
 	return r;
 }
 
+/*
+ * Data blocks are hashed several at once when the algorithm has a
+ * synchronous implementation that interleaves them.  Only when the salt
+ * comes first (or there is none), as the blocks then share the salted
+ * state.
+ */
+static int verity_alloc_shash(struct dm_verity *v)
+{
+	struct crypto_shash *tfm;
+
+	if (v->salt_size && !v->version)
+		return 0;
+
+	tfm = crypto_alloc_shash(v->alg_name, 0, 0);
+	if (IS_ERR(tfm)) {
+		/* The algorithm may only be available as an ahash */
+		if (PTR_ERR(tfm) == -ENOENT)
+			return 0;
+		return PTR_ERR(tfm);
+	}
+
+	if (crypto_shash_mb_max_msgs(tfm) < 2 ||
+	    crypto_shash_digestsize(tfm) != v->digest_size) {
+		crypto_free_shash(tfm);
+		return 0;
+	}
+
+	v->shash_tfm = tfm;
+	v->mb_max_msgs = min_t(unsigned int, crypto_shash_mb_max_msgs(tfm),
+			       DM_VERITY_MAX_PENDING_DATA_BLOCKS);
+	return 0;
+}
+
 static int verity_parse_opt_args(struct dm_arg_set *as, struct dm_verity *v)
 {
 	int r;
@@ -1078,6 +1225,12 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 		}
 	}
 
+	r = verity_alloc_shash(v);
+	if (r) {
+		ti->error = "Cannot initialize hash function";
+		goto bad;
+	}
+
 	argv += 10;
 	argc -= 10;
 
@@ -18,6 +18,9 @@
 
 #define DM_VERITY_MAX_LEVELS		63
 
+/* Data blocks hashed together, when the hash algorithm supports it */
+#define DM_VERITY_MAX_PENDING_DATA_BLOCKS	HASH_MAX_MB_MSGS
+
 enum verity_mode {
 	DM_VERITY_MODE_EIO,
 	DM_VERITY_MODE_LOGGING,
@@ -38,6 +41,7 @@ struct dm_verity {
 	struct dm_bufio_client *bufio;
 	char *alg_name;
 	struct crypto_ahash *tfm;
+	struct crypto_shash *shash_tfm;	/* for hashing data blocks together */
 	u8 *root_digest;	/* digest of the root block */
 	u8 *salt;		/* salt: its size is salt_size */
 	u8 *zero_digest;	/* digest for a zero block */
@@ -53,6 +57,7 @@ struct dm_verity {
 	unsigned char version;
 	unsigned digest_size;	/* digest size for the current hash algorithm */
 	unsigned int ahash_reqsize;/* the size of temporary space for crypto */
+	unsigned int mb_max_msgs;	/* data blocks to hash together */
 	int hash_failed;	/* set to 1 if hash of any block failed */
 	enum verity_mode mode;	/* mode for handling verification errors */
 	unsigned corrupted_errs;/* Number of errors for corrupted blocks */
@@ -79,6 +84,17 @@ struct dm_verity_io {
 
 	struct work_struct work;
 
+	/* Data blocks waiting to be hashed together by verity_verify_io() */
+	unsigned int num_pending;
+	struct dm_verity_pending_block {
+		sector_t block;
+		struct bvec_iter start;
+		struct page *page;
+		unsigned int offset;
+		u8 want_digest[HASH_MAX_DIGESTSIZE];
+		u8 real_digest[HASH_MAX_DIGESTSIZE];
+	} pending[DM_VERITY_MAX_PENDING_DATA_BLOCKS];
+
 	/*
 	 * Three variably-size fields follow this struct:
 	 *
@@ -598,6 +598,7 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 		sector_t first_bad;
 		int bad_sectors;
 		unsigned int pending;
+		int opt_iosize;
 		bool nonrot;
 
 		rdev = rcu_dereference(conf->mirrors[disk].rdev);
@@ -668,14 +669,21 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 		has_nonrot_disk |= nonrot;
 		pending = atomic_read(&rdev->nr_pending);
 		dist = abs(this_sector - conf->mirrors[disk].head_position);
+		opt_iosize = bdev_io_opt(rdev->bdev) >> 9;
 		if (choose_first) {
 			best_disk = disk;
 			break;
 		}
-		/* Don't change to another disk for sequential reads */
-		if (conf->mirrors[disk].next_seq_sect == this_sector
-		    || dist == 0) {
-			int opt_iosize = bdev_io_opt(rdev->bdev) >> 9;
+		/*
+		 * Don't change to another disk for sequential reads.  Head
+		 * position means nothing to a non-rotational device, so
+		 * only keep a stream on it when it advertises an optimal
+		 * IO size to batch up to, and balance on queue depth
+		 * otherwise.
+		 */
+		if ((!nonrot || opt_iosize > 0) &&
+		    (conf->mirrors[disk].next_seq_sect == this_sector
+		     || dist == 0)) {
 			struct raid1_info *mirror = &conf->mirrors[disk];
 
 			best_disk = disk;
@@ -703,6 +711,12 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 			break;
 		}
 
+		/* An idle non-rotational device can't be beaten */
+		if (nonrot && pending == 0) {
+			best_disk = disk;
+			break;
+		}
+
 		if (choose_next_idle)
 			continue;
 
@@ -748,7 +748,10 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 	sector_t new_distance, best_dist;
 	struct md_rdev *best_rdev, *rdev = NULL;
 	int do_balance;
-	int best_slot;
+	int best_slot, best_pending_slot;
+	struct md_rdev *best_pending_rdev;
+	unsigned int min_pending;
+	bool has_nonrot_disk;
 	struct geom *geo = &conf->geo;
 
 	raid10_find_phys(conf, r10_bio);
@@ -756,6 +759,10 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 	best_slot = -1;
 	best_rdev = NULL;
 	best_dist = MaxSector;
+	best_pending_slot = -1;
+	best_pending_rdev = NULL;
+	min_pending = UINT_MAX;
+	has_nonrot_disk = false;
 	best_good_sectors = 0;
 	do_balance = 1;
 	clear_bit(R10BIO_FailFast, &r10_bio->state);
@@ -776,6 +783,8 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 		sector_t first_bad;
 		int bad_sectors;
 		sector_t dev_sector;
+		unsigned int pending;
+		bool nonrot;
 
 		if (r10_bio->devs[slot].bio == IO_BLOCKED)
 			continue;
@@ -829,6 +838,20 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 		if (best_slot >= 0)
 			/* At least 2 disks to choose from so failfast is OK */
 			set_bit(R10BIO_FailFast, &r10_bio->state);
+
+		/*
+		 * Head position means nothing to a non-rotational device,
+		 * prefer the one with the fewest requests in flight.
+		 */
+		nonrot = blk_queue_nonrot(bdev_get_queue(rdev->bdev));
+		has_nonrot_disk |= nonrot;
+		pending = atomic_read(&rdev->nr_pending);
+		if (nonrot && min_pending > pending) {
+			min_pending = pending;
+			best_pending_slot = slot;
+			best_pending_rdev = rdev;
+		}
+
 		/* This optimisation is debatable, and completely destroys
 		 * sequential read speed for 'far copies' arrays.  So only
 		 * keep it for 'near' arrays, and review those later.
@@ -849,8 +872,13 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 		}
 	}
 	if (slot >= conf->copies) {
-		slot = best_slot;
-		rdev = best_rdev;
+		if (has_nonrot_disk && best_pending_slot >= 0) {
+			slot = best_pending_slot;
+			rdev = best_pending_rdev;
+		} else {
+			slot = best_slot;
+			rdev = best_rdev;
+		}
 	}
 
 	if (slot >= 0) {
@@ -531,7 +531,7 @@ static inline bool nicvf_xdp_rx(struct nicvf *nic, struct bpf_prog *prog,
 	xdp.data = (void *)cpu_addr;
 	xdp_set_data_meta_invalid(&xdp);
 	xdp.data_end = xdp.data + len;
-	xdp.rxq = &rq->xdp_rxq;
+	xdp_init_buff(&xdp, &rq->xdp_rxq);
 	orig_data = xdp.data;
 
 	rcu_read_lock();
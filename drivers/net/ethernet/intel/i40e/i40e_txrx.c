@@ -1464,6 +1464,9 @@ int i40e_setup_rx_descriptors(struct i40e_ring *rx_ring)
 				       rx_ring->queue_index);
 		if (err < 0)
 			goto err;
+		if (rx_ring->q_vector)
+			rx_ring->xdp_rxq.napi_id =
+				rx_ring->q_vector->napi.napi_id;
 	}
 
 	rx_ring->xdp_prog = rx_ring->vsi->xdp_prog;
@@ -2344,7 +2347,7 @@ static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
 	bool failure = false;
 	struct xdp_buff xdp;
 
-	xdp.rxq = &rx_ring->xdp_rxq;
+	xdp_init_buff(&xdp, &rx_ring->xdp_rxq);
 
 	while (likely(total_rx_packets < (unsigned int)budget)) {
 		struct i40e_rx_buffer *rx_buffer;
@@ -66,7 +66,7 @@ bool mlx5e_xdp_handle(struct mlx5e_rq *rq, struct mlx5e_dma_info *di,
 	xdp_set_data_meta_invalid(&xdp);
 	xdp.data_end = xdp.data + *len;
 	xdp.data_hard_start = va;
-	xdp.rxq = &rq->xdp_rxq;
+	xdp_init_buff(&xdp, &rq->xdp_rxq);
 
 	act = bpf_prog_run_xdp(prog, &xdp);
 	switch (act) {
@@ -1074,7 +1074,7 @@ static bool qede_rx_xdp(struct qede_dev *edev,
 	xdp.data = xdp.data_hard_start + *data_offset;
 	xdp_set_data_meta_invalid(&xdp);
 	xdp.data_end = xdp.data + *len;
-	xdp.rxq = &rxq->xdp_rxq;
+	xdp_init_buff(&xdp, &rxq->xdp_rxq);
 
 	/* Queues always have a full reset currently, so for the time
 	 * being until there's atomic program replace just mark read
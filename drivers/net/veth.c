@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/ethtool.h>
 #include <linux/etherdevice.h>
+#include <linux/if_vlan.h>
 #include <linux/u64_stats_sync.h>
 
 #include <net/rtnetlink.h>
@@ -55,6 +56,12 @@ struct veth_rq {
 	struct xdp_rxq_info	xdp_rxq;
 };
 
+/* Lets veth_xdp_metadata_ops find the skb behind the xdp_buff */
+struct veth_xdp_buff {
+	struct xdp_buff xdp;
+	struct sk_buff *skb;
+};
+
 struct veth_priv {
 	struct net_device __rcu	*peer;
 	atomic64_t		dropped;
@@ -484,6 +491,53 @@ static int veth_xdp_tx(struct net_device *dev, struct xdp_buff *xdp)
 	return veth_xdp_xmit(dev, 1, &frame, 0);
 }
 
+/* Frames redirected from another device's XDP program carry no metadata,
+ * only packets that arrived as an skb do.
+ */
+static int veth_xdp_rx_timestamp(const struct xdp_buff *ctx, u64 *timestamp)
+{
+	struct veth_xdp_buff *_ctx = (void *)ctx;
+
+	if (!_ctx->skb)
+		return -ENODATA;
+
+	*timestamp = ktime_to_ns(skb_hwtstamps(_ctx->skb)->hwtstamp);
+	return *timestamp ? 0 : -ENODATA;
+}
+
+static int veth_xdp_rx_hash(const struct xdp_buff *ctx, u32 *hash,
+			    u32 *rss_type)
+{
+	struct veth_xdp_buff *_ctx = (void *)ctx;
+
+	if (!_ctx->skb)
+		return -ENODATA;
+
+	*hash = skb_get_hash(_ctx->skb);
+	*rss_type = _ctx->skb->l4_hash ? XDP_RSS_TYPE_L4_ANY :
+					 XDP_RSS_TYPE_NONE;
+	return 0;
+}
+
+static int veth_xdp_rx_vlan_tag(const struct xdp_buff *ctx,
+				__be16 *vlan_proto, u16 *vlan_tci)
+{
+	struct veth_xdp_buff *_ctx = (void *)ctx;
+
+	if (!_ctx->skb || !skb_vlan_tag_present(_ctx->skb))
+		return -ENODATA;
+
+	*vlan_proto = _ctx->skb->vlan_proto;
+	*vlan_tci = skb_vlan_tag_get(_ctx->skb);
+	return 0;
+}
+
+static const struct xdp_metadata_ops veth_xdp_metadata_ops = {
+	.xmo_rx_timestamp	= veth_xdp_rx_timestamp,
+	.xmo_rx_hash		= veth_xdp_rx_hash,
+	.xmo_rx_vlan_tag	= veth_xdp_rx_vlan_tag,
+};
+
 static struct sk_buff *veth_xdp_rcv_one(struct veth_rq *rq,
 					struct xdp_frame *frame,
 					unsigned int *xdp_xmit)
@@ -499,27 +553,30 @@ static struct sk_buff *veth_xdp_rcv_one(struct veth_rq *rq,
 	rcu_read_lock();
 	xdp_prog = rcu_dereference(rq->xdp_prog);
 	if (likely(xdp_prog)) {
-		struct xdp_buff xdp;
+		struct veth_xdp_buff vxbuf;
+		struct xdp_buff *xdp = &vxbuf.xdp;
 		u32 act;
 
-		xdp.data_hard_start = hard_start;
-		xdp.data = frame->data;
-		xdp.data_end = frame->data + frame->len;
-		xdp.data_meta = frame->data - frame->metasize;
-		xdp.rxq = &rq->xdp_rxq;
+		xdp->data_hard_start = hard_start;
+		xdp->data = frame->data;
+		xdp->data_end = frame->data + frame->len;
+		xdp->data_meta = frame->data - frame->metasize;
+		xdp_init_buff(xdp, &rq->xdp_rxq);
+		xdp_buff_set_rx_meta(xdp);
+		vxbuf.skb = NULL;
 
-		act = bpf_prog_run_xdp(xdp_prog, &xdp);
+		act = bpf_prog_run_xdp(xdp_prog, xdp);
 
 		switch (act) {
 		case XDP_PASS:
-			delta = frame->data - xdp.data;
-			len = xdp.data_end - xdp.data;
+			delta = frame->data - xdp->data;
+			len = xdp->data_end - xdp->data;
 			break;
 		case XDP_TX:
 			orig_frame = *frame;
-			xdp.data_hard_start = head;
-			xdp.rxq->mem = frame->mem;
-			if (unlikely(veth_xdp_tx(rq->dev, &xdp) < 0)) {
+			xdp->data_hard_start = head;
+			xdp->rxq->mem = frame->mem;
+			if (unlikely(veth_xdp_tx(rq->dev, xdp) < 0)) {
 				trace_xdp_exception(rq->dev, xdp_prog, act);
 				frame = &orig_frame;
 				goto err_xdp;
@@ -529,9 +586,9 @@ static struct sk_buff *veth_xdp_rcv_one(struct veth_rq *rq,
 			goto xdp_xmit;
 		case XDP_REDIRECT:
 			orig_frame = *frame;
-			xdp.data_hard_start = head;
-			xdp.rxq->mem = frame->mem;
-			if (xdp_do_redirect(rq->dev, &xdp, xdp_prog)) {
+			xdp->data_hard_start = head;
+			xdp->rxq->mem = frame->mem;
+			if (xdp_do_redirect(rq->dev, xdp, xdp_prog)) {
 				frame = &orig_frame;
 				goto err_xdp;
 			}
@@ -573,7 +630,8 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq, struct sk_buff *skb,
 	void *orig_data, *orig_data_end;
 	struct bpf_prog *xdp_prog;
 	int mac_len, delta, off;
-	struct xdp_buff xdp;
+	struct veth_xdp_buff vxbuf;
+	struct xdp_buff *xdp = &vxbuf.xdp;
 
 	skb_orphan(skb);
 
@@ -626,24 +684,26 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq, struct sk_buff *skb,
 		skb = nskb;
 	}
 
-	xdp.data_hard_start = skb->head;
-	xdp.data = skb_mac_header(skb);
-	xdp.data_end = xdp.data + pktlen;
-	xdp.data_meta = xdp.data;
-	xdp.rxq = &rq->xdp_rxq;
-	orig_data = xdp.data;
-	orig_data_end = xdp.data_end;
+	xdp->data_hard_start = skb->head;
+	xdp->data = skb_mac_header(skb);
+	xdp->data_end = xdp->data + pktlen;
+	xdp->data_meta = xdp->data;
+	xdp_init_buff(xdp, &rq->xdp_rxq);
+	xdp_buff_set_rx_meta(xdp);
+	vxbuf.skb = skb;
+	orig_data = xdp->data;
+	orig_data_end = xdp->data_end;
 
-	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+	act = bpf_prog_run_xdp(xdp_prog, xdp);
 
 	switch (act) {
 	case XDP_PASS:
 		break;
 	case XDP_TX:
-		get_page(virt_to_page(xdp.data));
+		get_page(virt_to_page(xdp->data));
 		consume_skb(skb);
-		xdp.rxq->mem = rq->xdp_mem;
-		if (unlikely(veth_xdp_tx(rq->dev, &xdp) < 0)) {
+		xdp->rxq->mem = rq->xdp_mem;
+		if (unlikely(veth_xdp_tx(rq->dev, xdp) < 0)) {
 			trace_xdp_exception(rq->dev, xdp_prog, act);
 			goto err_xdp;
 		}
@@ -651,10 +711,10 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq, struct sk_buff *skb,
 		rcu_read_unlock();
 		goto xdp_xmit;
 	case XDP_REDIRECT:
-		get_page(virt_to_page(xdp.data));
+		get_page(virt_to_page(xdp->data));
 		consume_skb(skb);
-		xdp.rxq->mem = rq->xdp_mem;
-		if (xdp_do_redirect(rq->dev, &xdp, xdp_prog))
+		xdp->rxq->mem = rq->xdp_mem;
+		if (xdp_do_redirect(rq->dev, xdp, xdp_prog))
 			goto err_xdp;
 		*xdp_xmit |= VETH_XDP_REDIR;
 		rcu_read_unlock();
@@ -668,19 +728,19 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq, struct sk_buff *skb,
 	}
 	rcu_read_unlock();
 
-	delta = orig_data - xdp.data;
+	delta = orig_data - xdp->data;
 	off = mac_len + delta;
 	if (off > 0)
 		__skb_push(skb, off);
 	else if (off < 0)
 		__skb_pull(skb, -off);
 	skb->mac_header -= delta;
-	off = xdp.data_end - orig_data_end;
+	off = xdp->data_end - orig_data_end;
 	if (off != 0)
 		__skb_put(skb, off);
 	skb->protocol = eth_type_trans(skb, rq->dev);
 
-	metalen = xdp.data - xdp.data_meta;
+	metalen = xdp->data - xdp->data_meta;
 	if (metalen)
 		skb_metadata_set(skb, metalen);
 out:
@@ -691,7 +751,7 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq, struct sk_buff *skb,
 	return NULL;
 err_xdp:
 	rcu_read_unlock();
-	page_frag_free(xdp.data);
+	page_frag_free(xdp->data);
 xdp_xmit:
 	return NULL;
 }
@@ -1163,6 +1223,7 @@ static void veth_setup(struct net_device *dev)
 	dev->priv_flags |= IFF_PHONY_HEADROOM;
 
 	dev->netdev_ops = &veth_netdev_ops;
+	dev->xdp_metadata_ops = &veth_xdp_metadata_ops;
 	dev->ethtool_ops = &veth_ethtool_ops;
 	dev->features |= NETIF_F_LLTX;
 	dev->features |= VETH_FEATURES;
@@ -1178,6 +1239,7 @@ static void veth_setup(struct net_device *dev)
 	dev->hw_features = VETH_FEATURES;
 	dev->hw_enc_features = VETH_FEATURES;
 	dev->mpls_features = NETIF_F_HW_CSUM | NETIF_F_GSO_SOFTWARE;
+	netif_set_tso_max_size(dev, GSO_MAX_SIZE);
 }
 
 /*
@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * The allowed IPs of the peers of a device, which both route outgoing
+ * packets to a peer and filter the inner source address of packets
+ * received from it.
+ *
+ * All prefixes of a device are on one RCU list sorted by decreasing
+ * prefix length, so the first match is the longest one.  Writers hold
+ * the device_update_lock.
+ */
+
+#include "allowedips.h"
+#include "peer.h"
+
+#include <linux/inetdevice.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <net/ipv6.h>
+
+static bool prefix_matches(const struct wg_allowedip *aip, u16 family,
+			   const void *addr)
+{
+	if (aip->family != family)
+		return false;
+
+	if (family == AF_INET)
+		return !((((const struct in_addr *)addr)->s_addr ^
+			  aip->addr.ip4.s_addr) & inet_make_mask(aip->cidr));
+
+	return ipv6_prefix_equal(addr, &aip->addr.ip6, aip->cidr);
+}
+
+static void copy_and_mask(struct wg_allowedip *aip, u16 family,
+			  const void *addr, u8 cidr)
+{
+	aip->family = family;
+	aip->cidr = cidr;
+	if (family == AF_INET)
+		aip->addr.ip4.s_addr = ((const struct in_addr *)addr)->s_addr &
+				       inet_make_mask(cidr);
+	else
+		ipv6_addr_prefix(&aip->addr.ip6, addr, cidr);
+}
+
+int wg_allowedips_insert(struct wg_device *wg, u16 family, const void *addr,
+			 u8 cidr, struct wg_peer *peer)
+{
+	struct wg_allowedip *aip, *new;
+	struct list_head *pos;
+
+	lockdep_assert_held(&wg->device_update_lock);
+
+	if ((family == AF_INET && cidr > 32) ||
+	    (family == AF_INET6 && cidr > 128) ||
+	    (family != AF_INET && family != AF_INET6))
+		return -EINVAL;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (unlikely(!new))
+		return -ENOMEM;
+	copy_and_mask(new, family, addr, cidr);
+	new->peer = peer;
+
+	/* Insert in front of the first shorter prefix, or replace a match */
+	pos = &wg->allowedips;
+	list_for_each_entry(aip, &wg->allowedips, list) {
+		if (aip->cidr < cidr) {
+			pos = &aip->list;
+			break;
+		}
+		if (aip->cidr == cidr && aip->family == family &&
+		    !memcmp(&aip->addr, &new->addr, sizeof(new->addr))) {
+			/* The prefix moves over to @peer */
+			list_add_tail(&new->peer_list, &peer->allowedips_list);
+			list_replace_rcu(&aip->list, &new->list);
+			list_del(&aip->peer_list);
+			kfree_rcu(aip, rcu);
+			return 0;
+		}
+	}
+
+	list_add_tail(&new->peer_list, &peer->allowedips_list);
+	list_add_tail_rcu(&new->list, pos);
+	return 0;
+}
+
+void wg_allowedips_remove_by_peer(struct wg_device *wg, struct wg_peer *peer)
+{
+	struct wg_allowedip *aip, *tmp;
+
+	lockdep_assert_held(&wg->device_update_lock);
+
+	list_for_each_entry_safe(aip, tmp, &peer->allowedips_list, peer_list) {
+		list_del(&aip->peer_list);
+		list_del_rcu(&aip->list);
+		kfree_rcu(aip, rcu);
+	}
+}
+
+static struct wg_peer *lookup(struct wg_device *wg, u16 family,
+			      const void *addr)
+{
+	struct wg_peer *peer = NULL;
+	struct wg_allowedip *aip;
+
+	rcu_read_lock_bh();
+	list_for_each_entry_rcu(aip, &wg->allowedips, list) {
+		if (prefix_matches(aip, family, addr)) {
+			peer = wg_peer_get_maybe_zero(aip->peer);
+			break;
+		}
+	}
+	rcu_read_unlock_bh();
+
+	return peer;
+}
+
+/* Returns a strong reference to a peer */
+struct wg_peer *wg_allowedips_lookup_dst(struct wg_device *wg,
+					 struct sk_buff *skb)
+{
+	if (skb->protocol == htons(ETH_P_IP))
+		return lookup(wg, AF_INET, &ip_hdr(skb)->daddr);
+	else if (skb->protocol == htons(ETH_P_IPV6))
+		return lookup(wg, AF_INET6, &ipv6_hdr(skb)->daddr);
+	return NULL;
+}
+
+/* Returns a strong reference to a peer */
+struct wg_peer *wg_allowedips_lookup_src(struct wg_device *wg,
+					 struct sk_buff *skb)
+{
+	if (skb->protocol == htons(ETH_P_IP))
+		return lookup(wg, AF_INET, &ip_hdr(skb)->saddr);
+	else if (skb->protocol == htons(ETH_P_IPV6))
+		return lookup(wg, AF_INET6, &ipv6_hdr(skb)->saddr);
+	return NULL;
+}
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#ifndef _WG_ALLOWEDIPS_H
+#define _WG_ALLOWEDIPS_H
+
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/list.h>
+
+struct wg_device;
+struct wg_peer;
+struct sk_buff;
+
+/* A prefix routed to a peer, and accepted as source address from it */
+struct wg_allowedip {
+	struct list_head list;
+	struct list_head peer_list;
+	struct wg_peer *peer;
+	struct rcu_head rcu;
+	union {
+		struct in_addr ip4;
+		struct in6_addr ip6;
+	} addr;
+	u16 family;
+	u8 cidr;
+};
+
+int wg_allowedips_insert(struct wg_device *wg, u16 family, const void *addr,
+			 u8 cidr, struct wg_peer *peer);
+void wg_allowedips_remove_by_peer(struct wg_device *wg, struct wg_peer *peer);
+
+/* These return a strong reference to a peer: */
+struct wg_peer *wg_allowedips_lookup_dst(struct wg_device *wg,
+					 struct sk_buff *skb);
+struct wg_peer *wg_allowedips_lookup_src(struct wg_device *wg,
+					 struct sk_buff *skb);
+
+#endif /* _WG_ALLOWEDIPS_H */
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#ifndef _WG_DEVICE_H
+#define _WG_DEVICE_H
+
+#include <linux/types.h>
+#include <linux/netdevice.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/net.h>
+#include <linux/ptr_ring.h>
+#include <linux/hashtable.h>
+#include <net/gro_cells.h>
+
+struct wg_device;
+
+struct multicore_worker {
+	void *ptr;
+	struct work_struct work;
+};
+
+struct crypt_queue {
+	struct ptr_ring ring;
+	union {
+		struct {
+			struct multicore_worker __percpu *worker;
+			int last_cpu;
+		};
+		struct work_struct work;
+	};
+};
+
+struct wg_device {
+	struct net_device *dev;
+	struct crypt_queue encrypt_queue, decrypt_queue;
+	struct sock __rcu *sock4, *sock6;
+	struct gro_cells gro_cells;
+	struct workqueue_struct *packet_crypt_wq;
+	/* Sorted by decreasing prefix length, so the first match wins */
+	struct list_head allowedips;
+	/* Sessions by the index their packets are received with */
+	DECLARE_HASHTABLE(index_hash, 13);
+	spinlock_t index_hash_lock;
+	struct list_head peer_list;
+	struct mutex device_update_lock, socket_update_lock;
+	unsigned int num_peers;
+	u32 fwmark;
+	u16 incoming_port;
+};
+
+int wg_device_init(void);
+void wg_device_uninit(void);
+
+#endif /* _WG_DEVICE_H */
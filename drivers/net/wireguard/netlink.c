@@ -0,0 +1,456 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include "netlink.h"
+#include "device.h"
+#include "peer.h"
+#include "socket.h"
+#include "queueing.h"
+#include "messages.h"
+#include "allowedips.h"
+
+#include <uapi/linux/wireguard.h>
+#include <linux/if.h>
+#include <net/genetlink.h>
+#include <net/sock.h>
+
+static struct genl_family genl_family;
+
+static const struct nla_policy device_policy[WGDEVICE_A_MAX + 1] = {
+	[WGDEVICE_A_IFINDEX]		= { .type = NLA_U32 },
+	[WGDEVICE_A_IFNAME]		= { .type = NLA_NUL_STRING, .len = IFNAMSIZ - 1 },
+	[WGDEVICE_A_FLAGS]		= { .type = NLA_U32 },
+	[WGDEVICE_A_LISTEN_PORT]	= { .type = NLA_U16 },
+	[WGDEVICE_A_FWMARK]		= { .type = NLA_U32 },
+	[WGDEVICE_A_PEERS]		= { .type = NLA_NESTED }
+};
+
+static const struct nla_policy peer_policy[WGPEER_A_MAX + 1] = {
+	[WGPEER_A_PUBLIC_KEY]		= NLA_POLICY_EXACT_LEN(WG_KEY_LEN),
+	[WGPEER_A_FLAGS]		= { .type = NLA_U32 },
+	[WGPEER_A_ENDPOINT]		= { .type = NLA_UNSPEC, .len = sizeof(struct sockaddr) },
+	[WGPEER_A_RX_BYTES]		= { .type = NLA_U64 },
+	[WGPEER_A_TX_BYTES]		= { .type = NLA_U64 },
+	[WGPEER_A_ALLOWEDIPS]		= { .type = NLA_NESTED },
+	[WGPEER_A_SEND_KEY]		= NLA_POLICY_EXACT_LEN(CHACHA20POLY1305_KEY_SIZE),
+	[WGPEER_A_RECEIVE_KEY]		= NLA_POLICY_EXACT_LEN(CHACHA20POLY1305_KEY_SIZE),
+	[WGPEER_A_SEND_INDEX]		= { .type = NLA_U32 },
+	[WGPEER_A_RECEIVE_INDEX]	= { .type = NLA_U32 }
+};
+
+static const struct nla_policy allowedip_policy[WGALLOWEDIP_A_MAX + 1] = {
+	[WGALLOWEDIP_A_FAMILY]		= { .type = NLA_U16 },
+	[WGALLOWEDIP_A_IPADDR]		= { .type = NLA_UNSPEC, .len = sizeof(struct in_addr) },
+	[WGALLOWEDIP_A_CIDR_MASK]	= { .type = NLA_U8 }
+};
+
+static struct wg_device *lookup_interface(struct nlattr **attrs,
+					  struct sk_buff *skb)
+{
+	struct net_device *dev = NULL;
+
+	if (!attrs[WGDEVICE_A_IFINDEX] == !attrs[WGDEVICE_A_IFNAME])
+		return ERR_PTR(-EBADR);
+	if (attrs[WGDEVICE_A_IFINDEX])
+		dev = dev_get_by_index(sock_net(skb->sk),
+				       nla_get_u32(attrs[WGDEVICE_A_IFINDEX]));
+	else if (attrs[WGDEVICE_A_IFNAME])
+		dev = dev_get_by_name(sock_net(skb->sk),
+				      nla_data(attrs[WGDEVICE_A_IFNAME]));
+	if (!dev)
+		return ERR_PTR(-ENODEV);
+	if (!dev->rtnl_link_ops || !dev->rtnl_link_ops->kind ||
+	    strcmp(dev->rtnl_link_ops->kind, KBUILD_MODNAME)) {
+		dev_put(dev);
+		return ERR_PTR(-EOPNOTSUPP);
+	}
+	return netdev_priv(dev);
+}
+
+static int get_allowedip(struct sk_buff *skb, const struct wg_allowedip *aip)
+{
+	struct nlattr *allowedip_nest;
+
+	allowedip_nest = nla_nest_start(skb, 0);
+	if (!allowedip_nest)
+		return -EMSGSIZE;
+
+	if (nla_put_u8(skb, WGALLOWEDIP_A_CIDR_MASK, aip->cidr) ||
+	    nla_put_u16(skb, WGALLOWEDIP_A_FAMILY, aip->family) ||
+	    nla_put(skb, WGALLOWEDIP_A_IPADDR, aip->family == AF_INET6 ?
+		    sizeof(struct in6_addr) : sizeof(struct in_addr),
+		    &aip->addr)) {
+		nla_nest_cancel(skb, allowedip_nest);
+		return -EMSGSIZE;
+	}
+
+	nla_nest_end(skb, allowedip_nest);
+	return 0;
+}
+
+static int get_peer(struct wg_peer *peer, struct sk_buff *skb)
+{
+	struct nlattr *allowedips_nest, *peer_nest;
+	struct wg_allowedip *aip;
+	struct wg_keypair *keypair;
+
+	peer_nest = nla_nest_start(skb, 0);
+	if (!peer_nest)
+		return -EMSGSIZE;
+
+	if (nla_put(skb, WGPEER_A_PUBLIC_KEY, WG_KEY_LEN, peer->public_key) ||
+	    nla_put_u64_64bit(skb, WGPEER_A_TX_BYTES, peer->tx_bytes,
+			      WGPEER_A_UNSPEC) ||
+	    nla_put_u64_64bit(skb, WGPEER_A_RX_BYTES, peer->rx_bytes,
+			      WGPEER_A_UNSPEC))
+		goto err;
+
+	read_lock_bh(&peer->endpoint_lock);
+	if (peer->endpoint.addr.sa_family == AF_INET &&
+	    nla_put(skb, WGPEER_A_ENDPOINT, sizeof(peer->endpoint.addr4),
+		    &peer->endpoint.addr4)) {
+		read_unlock_bh(&peer->endpoint_lock);
+		goto err;
+	}
+	if (peer->endpoint.addr.sa_family == AF_INET6 &&
+	    nla_put(skb, WGPEER_A_ENDPOINT, sizeof(peer->endpoint.addr6),
+		    &peer->endpoint.addr6)) {
+		read_unlock_bh(&peer->endpoint_lock);
+		goto err;
+	}
+	read_unlock_bh(&peer->endpoint_lock);
+
+	keypair = rcu_dereference_protected(peer->keypair,
+			lockdep_is_held(&peer->device->device_update_lock));
+	if (keypair &&
+	    (nla_put_u32(skb, WGPEER_A_SEND_INDEX,
+			 le32_to_cpu(keypair->send_index)) ||
+	     nla_put_u32(skb, WGPEER_A_RECEIVE_INDEX,
+			 le32_to_cpu(keypair->receive_index))))
+		goto err;
+
+	allowedips_nest = nla_nest_start(skb, WGPEER_A_ALLOWEDIPS);
+	if (!allowedips_nest)
+		goto err;
+	list_for_each_entry(aip, &peer->allowedips_list, peer_list) {
+		if (get_allowedip(skb, aip)) {
+			nla_nest_cancel(skb, allowedips_nest);
+			goto err;
+		}
+	}
+	nla_nest_end(skb, allowedips_nest);
+
+	nla_nest_end(skb, peer_nest);
+	return 0;
+
+err:
+	nla_nest_cancel(skb, peer_nest);
+	return -EMSGSIZE;
+}
+
+static size_t peer_msg_size(struct wg_peer *peer)
+{
+	size_t size = nla_total_size(0) +		/* peer nest */
+		nla_total_size(WG_KEY_LEN) +		/* public key */
+		2 * nla_total_size_64bit(sizeof(u64)) +	/* rx/tx bytes */
+		nla_total_size(sizeof(struct sockaddr_in6)) +
+		2 * nla_total_size(sizeof(u32)) +	/* session indices */
+		nla_total_size(0);			/* allowedips nest */
+	struct wg_allowedip *aip;
+
+	list_for_each_entry(aip, &peer->allowedips_list, peer_list)
+		size += nla_total_size(0) + nla_total_size(sizeof(u8)) +
+			nla_total_size(sizeof(u16)) +
+			nla_total_size(sizeof(struct in6_addr));
+	return size;
+}
+
+/*
+ * The configuration of a device is replied in a single message, sized
+ * for all of its peers while holding the lock that keeps them in place.
+ */
+static int wg_get_device(struct sk_buff *skb, struct genl_info *info)
+{
+	struct nlattr *peers_nest;
+	struct wg_device *wg;
+	struct wg_peer *peer;
+	struct sk_buff *msg;
+	void *hdr;
+	size_t size;
+	int ret;
+
+	wg = lookup_interface(info->attrs, skb);
+	if (IS_ERR(wg))
+		return PTR_ERR(wg);
+
+	rtnl_lock();
+	mutex_lock(&wg->device_update_lock);
+
+	size = nla_total_size(sizeof(u32)) +		/* ifindex */
+	       nla_total_size(IFNAMSIZ) +		/* ifname */
+	       nla_total_size(sizeof(u16)) +		/* listen port */
+	       nla_total_size(sizeof(u32)) +		/* fwmark */
+	       nla_total_size(0);			/* peers nest */
+	list_for_each_entry(peer, &wg->peer_list, peer_list)
+		size += peer_msg_size(peer);
+
+	ret = -ENOMEM;
+	msg = genlmsg_new(size, GFP_KERNEL);
+	if (!msg)
+		goto out;
+
+	ret = -EMSGSIZE;
+	hdr = genlmsg_put(msg, info->snd_portid, info->snd_seq, &genl_family,
+			  0, WG_CMD_GET_DEVICE);
+	if (!hdr)
+		goto err_free;
+
+	if (nla_put_u16(msg, WGDEVICE_A_LISTEN_PORT, wg->incoming_port) ||
+	    nla_put_u32(msg, WGDEVICE_A_FWMARK, wg->fwmark) ||
+	    nla_put_u32(msg, WGDEVICE_A_IFINDEX, wg->dev->ifindex) ||
+	    nla_put_string(msg, WGDEVICE_A_IFNAME, wg->dev->name))
+		goto err_free;
+
+	peers_nest = nla_nest_start(msg, WGDEVICE_A_PEERS);
+	if (!peers_nest)
+		goto err_free;
+	list_for_each_entry(peer, &wg->peer_list, peer_list) {
+		if (get_peer(peer, msg))
+			goto err_free;
+	}
+	nla_nest_end(msg, peers_nest);
+
+	genlmsg_end(msg, hdr);
+	mutex_unlock(&wg->device_update_lock);
+	rtnl_unlock();
+	dev_put(wg->dev);
+	return genlmsg_reply(msg, info);
+
+err_free:
+	nlmsg_free(msg);
+out:
+	mutex_unlock(&wg->device_update_lock);
+	rtnl_unlock();
+	dev_put(wg->dev);
+	return ret;
+}
+
+static int set_port(struct wg_device *wg, u16 port)
+{
+	if (wg->incoming_port == port)
+		return 0;
+	if (!netif_running(wg->dev)) {
+		wg->incoming_port = port;
+		return 0;
+	}
+	return wg_socket_init(wg, port);
+}
+
+static int set_allowedip(struct wg_peer *peer, struct nlattr **attrs)
+{
+	struct nlattr *addr = attrs[WGALLOWEDIP_A_IPADDR];
+	u16 family;
+	u8 cidr;
+
+	if (!attrs[WGALLOWEDIP_A_FAMILY] || !addr ||
+	    !attrs[WGALLOWEDIP_A_CIDR_MASK])
+		return -EINVAL;
+	family = nla_get_u16(attrs[WGALLOWEDIP_A_FAMILY]);
+	cidr = nla_get_u8(attrs[WGALLOWEDIP_A_CIDR_MASK]);
+
+	if (!(family == AF_INET && nla_len(addr) == sizeof(struct in_addr)) &&
+	    !(family == AF_INET6 && nla_len(addr) == sizeof(struct in6_addr)))
+		return -EINVAL;
+
+	return wg_allowedips_insert(peer->device, family, nla_data(addr), cidr,
+				    peer);
+}
+
+static int set_endpoint(struct wg_peer *peer, struct nlattr *attr)
+{
+	const struct sockaddr *addr = nla_data(attr);
+	size_t len = nla_len(attr);
+	struct wg_endpoint endpoint;
+
+	memset(&endpoint, 0, sizeof(endpoint));
+	if (len == sizeof(struct sockaddr_in) && addr->sa_family == AF_INET)
+		endpoint.addr4 = *(const struct sockaddr_in *)addr;
+	else if (len == sizeof(struct sockaddr_in6) &&
+		 addr->sa_family == AF_INET6)
+		endpoint.addr6 = *(const struct sockaddr_in6 *)addr;
+	else
+		return -EINVAL;
+
+	wg_socket_set_peer_endpoint(peer, &endpoint);
+	return 0;
+}
+
+static int set_keypair(struct wg_peer *peer, struct nlattr **attrs)
+{
+	if (!attrs[WGPEER_A_SEND_KEY] && !attrs[WGPEER_A_RECEIVE_KEY] &&
+	    !attrs[WGPEER_A_SEND_INDEX] && !attrs[WGPEER_A_RECEIVE_INDEX])
+		return 0;
+	if (!attrs[WGPEER_A_SEND_KEY] || !attrs[WGPEER_A_RECEIVE_KEY] ||
+	    !attrs[WGPEER_A_SEND_INDEX] || !attrs[WGPEER_A_RECEIVE_INDEX])
+		return -EINVAL;
+
+	return wg_peer_set_keypair(peer, nla_data(attrs[WGPEER_A_SEND_KEY]),
+		nla_data(attrs[WGPEER_A_RECEIVE_KEY]),
+		cpu_to_le32(nla_get_u32(attrs[WGPEER_A_SEND_INDEX])),
+		cpu_to_le32(nla_get_u32(attrs[WGPEER_A_RECEIVE_INDEX])));
+}
+
+static int set_peer(struct wg_device *wg, struct nlattr **attrs)
+{
+	struct wg_peer *peer;
+	u32 flags = 0;
+	int ret;
+
+	if (!attrs[WGPEER_A_PUBLIC_KEY])
+		return -EINVAL;
+
+	if (attrs[WGPEER_A_FLAGS])
+		flags = nla_get_u32(attrs[WGPEER_A_FLAGS]);
+	if (flags & ~__WGPEER_F_ALL)
+		return -EOPNOTSUPP;
+
+	peer = wg_peer_lookup(wg, nla_data(attrs[WGPEER_A_PUBLIC_KEY]));
+	if (flags & WGPEER_F_REMOVE_ME) {
+		wg_peer_remove(peer);
+		return 0;
+	}
+	if (!peer) {
+		peer = wg_peer_create(wg, nla_data(attrs[WGPEER_A_PUBLIC_KEY]));
+		if (IS_ERR(peer))
+			return PTR_ERR(peer);
+	}
+
+	if (attrs[WGPEER_A_ENDPOINT]) {
+		ret = set_endpoint(peer, attrs[WGPEER_A_ENDPOINT]);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (flags & WGPEER_F_REPLACE_ALLOWEDIPS)
+		wg_allowedips_remove_by_peer(wg, peer);
+
+	if (attrs[WGPEER_A_ALLOWEDIPS]) {
+		struct nlattr *attr, *allowedip[WGALLOWEDIP_A_MAX + 1];
+		int rem;
+
+		nla_for_each_nested(attr, attrs[WGPEER_A_ALLOWEDIPS], rem) {
+			ret = nla_parse_nested(allowedip, WGALLOWEDIP_A_MAX,
+					       attr, allowedip_policy, NULL);
+			if (ret < 0)
+				return ret;
+			ret = set_allowedip(peer, allowedip);
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	ret = set_keypair(peer, attrs);
+	if (ret < 0)
+		return ret;
+
+	/* Packets staged while waiting for a session may go out now. */
+	if (netif_running(wg->dev))
+		wg_packet_send_staged_packets(peer);
+
+	return 0;
+}
+
+static int wg_set_device(struct sk_buff *skb, struct genl_info *info)
+{
+	struct wg_device *wg = lookup_interface(info->attrs, skb);
+	u32 flags = 0;
+	int ret;
+
+	if (IS_ERR(wg)) {
+		ret = PTR_ERR(wg);
+		goto out_nodev;
+	}
+
+	rtnl_lock();
+	mutex_lock(&wg->device_update_lock);
+
+	if (info->attrs[WGDEVICE_A_FLAGS])
+		flags = nla_get_u32(info->attrs[WGDEVICE_A_FLAGS]);
+	ret = -EOPNOTSUPP;
+	if (flags & ~__WGDEVICE_F_ALL)
+		goto out;
+
+	if (info->attrs[WGDEVICE_A_FWMARK]) {
+		struct wg_peer *peer;
+
+		wg->fwmark = nla_get_u32(info->attrs[WGDEVICE_A_FWMARK]);
+		list_for_each_entry(peer, &wg->peer_list, peer_list)
+			dst_cache_reset(&peer->endpoint_cache);
+	}
+
+	if (info->attrs[WGDEVICE_A_LISTEN_PORT]) {
+		ret = set_port(wg,
+			nla_get_u16(info->attrs[WGDEVICE_A_LISTEN_PORT]));
+		if (ret)
+			goto out;
+	}
+
+	if (flags & WGDEVICE_F_REPLACE_PEERS)
+		wg_peer_remove_all(wg);
+
+	if (info->attrs[WGDEVICE_A_PEERS]) {
+		struct nlattr *attr, *peer[WGPEER_A_MAX + 1];
+		int rem;
+
+		nla_for_each_nested(attr, info->attrs[WGDEVICE_A_PEERS], rem) {
+			ret = nla_parse_nested(peer, WGPEER_A_MAX, attr,
+					       peer_policy, NULL);
+			if (ret < 0)
+				goto out;
+			ret = set_peer(wg, peer);
+			if (ret < 0)
+				goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	mutex_unlock(&wg->device_update_lock);
+	rtnl_unlock();
+	dev_put(wg->dev);
+out_nodev:
+	return ret;
+}
+
+static const struct genl_ops genl_ops[] = {
+	{
+		.cmd = WG_CMD_GET_DEVICE,
+		.doit = wg_get_device,
+		.policy = device_policy,
+		.flags = GENL_ADMIN_PERM
+	}, {
+		.cmd = WG_CMD_SET_DEVICE,
+		.doit = wg_set_device,
+		.policy = device_policy,
+		.flags = GENL_ADMIN_PERM
+	}
+};
+
+static struct genl_family genl_family __ro_after_init = {
+	.ops = genl_ops,
+	.n_ops = ARRAY_SIZE(genl_ops),
+	.name = WG_GENL_NAME,
+	.version = WG_GENL_VERSION,
+	.maxattr = WGDEVICE_A_MAX,
+	.module = THIS_MODULE,
+	.netnsok = true
+};
+
+int __init wg_genetlink_init(void)
+{
+	return genl_register_family(&genl_family);
+}
+
+void __exit wg_genetlink_uninit(void)
+{
+	genl_unregister_family(&genl_family);
+}
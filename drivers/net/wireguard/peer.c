@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Peers of a wireguard device and their transport sessions.
+ *
+ * A peer holds at most one session at a time.  Every packet in flight
+ * holds a reference to the session it is sealed or opened with, and to
+ * its peer, so that replacing a session or removing a peer never waits
+ * for the crypto workers.
+ */
+
+#include "peer.h"
+#include "device.h"
+#include "queueing.h"
+#include "allowedips.h"
+
+#include <linux/kref.h>
+#include <linux/lockdep.h>
+#include <linux/rcupdate.h>
+#include <linux/list.h>
+
+static atomic64_t peer_counter = ATOMIC64_INIT(0);
+
+struct wg_peer *wg_peer_create(struct wg_device *wg,
+			       const u8 public_key[WG_KEY_LEN])
+{
+	struct wg_peer *peer;
+	int ret = -ENOMEM;
+
+	lockdep_assert_held(&wg->device_update_lock);
+
+	if (wg->num_peers >= MAX_PEERS_PER_DEVICE)
+		return ERR_PTR(ret);
+
+	peer = kzalloc(sizeof(*peer), GFP_KERNEL);
+	if (unlikely(!peer))
+		return ERR_PTR(ret);
+	peer->device = wg;
+
+	if (dst_cache_init(&peer->endpoint_cache, GFP_KERNEL))
+		goto err_free;
+	if (wg_packet_queue_init(&peer->tx_queue, wg_packet_tx_worker, false,
+				 MAX_QUEUED_PACKETS))
+		goto err_dst_cache;
+	if (wg_packet_queue_init(&peer->rx_queue, wg_packet_rx_worker, false,
+				 MAX_QUEUED_PACKETS))
+		goto err_tx_queue;
+
+	memcpy(peer->public_key, public_key, WG_KEY_LEN);
+	peer->internal_id = atomic64_inc_return(&peer_counter);
+	peer->serial_work_cpu = nr_cpumask_bits;
+	rwlock_init(&peer->endpoint_lock);
+	kref_init(&peer->refcount);
+	skb_queue_head_init(&peer->staged_packet_queue);
+	INIT_LIST_HEAD(&peer->allowedips_list);
+	list_add_tail(&peer->peer_list, &wg->peer_list);
+	++wg->num_peers;
+	return peer;
+
+err_tx_queue:
+	wg_packet_queue_free(&peer->tx_queue, false);
+err_dst_cache:
+	dst_cache_destroy(&peer->endpoint_cache);
+err_free:
+	kfree(peer);
+	return ERR_PTR(ret);
+}
+
+struct wg_peer *wg_peer_lookup(struct wg_device *wg,
+			       const u8 public_key[WG_KEY_LEN])
+{
+	struct wg_peer *peer;
+
+	lockdep_assert_held(&wg->device_update_lock);
+
+	list_for_each_entry(peer, &wg->peer_list, peer_list)
+		if (!memcmp(peer->public_key, public_key, WG_KEY_LEN))
+			return peer;
+	return NULL;
+}
+
+struct wg_peer *wg_peer_get_maybe_zero(struct wg_peer *peer)
+{
+	RCU_LOCKDEP_WARN(!rcu_read_lock_bh_held(),
+			 "Taking peer reference without holding the RCU read lock");
+	if (unlikely(!peer || !kref_get_unless_zero(&peer->refcount)))
+		return NULL;
+	return peer;
+}
+
+static void keypair_free_rcu(struct rcu_head *rcu)
+{
+	kzfree(container_of(rcu, struct wg_keypair, rcu));
+}
+
+static void keypair_free_kref(struct kref *kref)
+{
+	struct wg_keypair *keypair =
+		container_of(kref, struct wg_keypair, refcount);
+
+	call_rcu(&keypair->rcu, keypair_free_rcu);
+}
+
+struct wg_keypair *wg_keypair_get(struct wg_keypair *keypair)
+{
+	RCU_LOCKDEP_WARN(!rcu_read_lock_bh_held(),
+			 "Taking keypair reference without holding the RCU BH read lock");
+	if (unlikely(!keypair || !kref_get_unless_zero(&keypair->refcount)))
+		return NULL;
+	return keypair;
+}
+
+void wg_keypair_put(struct wg_keypair *keypair)
+{
+	if (keypair)
+		kref_put(&keypair->refcount, keypair_free_kref);
+}
+
+struct wg_keypair *wg_index_hashtable_lookup(struct wg_device *wg,
+					     __le32 index)
+{
+	struct wg_keypair *iter, *keypair = NULL;
+
+	rcu_read_lock_bh();
+	hash_for_each_possible_rcu(wg->index_hash, iter, index_hash,
+				   (__force u32)index) {
+		if (iter->receive_index == index) {
+			keypair = wg_keypair_get(iter);
+			break;
+		}
+	}
+	rcu_read_unlock_bh();
+
+	return keypair;
+}
+
+static struct wg_keypair *index_hashtable_find(struct wg_device *wg,
+					       __le32 index)
+{
+	struct wg_keypair *iter;
+
+	hash_for_each_possible(wg->index_hash, iter, index_hash,
+			       (__force u32)index)
+		if (iter->receive_index == index)
+			return iter;
+	return NULL;
+}
+
+/* Drops the session of @peer, the caller holds the device_update_lock */
+static void peer_clear_keypair(struct wg_peer *peer)
+{
+	struct wg_device *wg = peer->device;
+	struct wg_keypair *old;
+
+	old = rcu_dereference_protected(peer->keypair,
+				lockdep_is_held(&wg->device_update_lock));
+	if (!old)
+		return;
+
+	RCU_INIT_POINTER(peer->keypair, NULL);
+	spin_lock_bh(&wg->index_hash_lock);
+	hash_del_rcu(&old->index_hash);
+	spin_unlock_bh(&wg->index_hash_lock);
+	wg_keypair_put(old);
+}
+
+int wg_peer_set_keypair(struct wg_peer *peer,
+			const u8 send_key[CHACHA20POLY1305_KEY_SIZE],
+			const u8 receive_key[CHACHA20POLY1305_KEY_SIZE],
+			__le32 send_index, __le32 receive_index)
+{
+	struct wg_device *wg = peer->device;
+	struct wg_keypair *keypair, *found;
+
+	lockdep_assert_held(&wg->device_update_lock);
+
+	keypair = kzalloc(sizeof(*keypair), GFP_KERNEL);
+	if (unlikely(!keypair))
+		return -ENOMEM;
+
+	keypair->peer = peer;
+	memcpy(keypair->send_key, send_key, sizeof(keypair->send_key));
+	memcpy(keypair->receive_key, receive_key,
+	       sizeof(keypair->receive_key));
+	atomic64_set(&keypair->send_counter, 0);
+	spin_lock_init(&keypair->receive_counter.lock);
+	keypair->send_index = send_index;
+	keypair->receive_index = receive_index;
+	kref_init(&keypair->refcount);
+
+	/* A rekey of the same peer may reuse its receive index */
+	found = index_hashtable_find(wg, receive_index);
+	if (found && found->peer != peer) {
+		kzfree(keypair);
+		return -EADDRINUSE;
+	}
+
+	peer_clear_keypair(peer);
+
+	spin_lock_bh(&wg->index_hash_lock);
+	hash_add_rcu(wg->index_hash, &keypair->index_hash,
+		     (__force u32)receive_index);
+	spin_unlock_bh(&wg->index_hash_lock);
+	rcu_assign_pointer(peer->keypair, keypair);
+
+	return 0;
+}
+
+bool wg_replay_counter_validate(struct wg_replay_counter *counter,
+				u64 their_counter)
+{
+	unsigned long index, index_current, top, i;
+	bool ret = false;
+
+	spin_lock_bh(&counter->lock);
+
+	if (unlikely(counter->counter >= REJECT_AFTER_MESSAGES + 1 ||
+		     their_counter >= REJECT_AFTER_MESSAGES))
+		goto out;
+
+	++their_counter;
+
+	if (unlikely((COUNTER_WINDOW_SIZE + their_counter) <
+		     counter->counter))
+		goto out;
+
+	index = their_counter >> ilog2(BITS_PER_LONG);
+
+	if (likely(their_counter > counter->counter)) {
+		index_current = counter->counter >> ilog2(BITS_PER_LONG);
+		top = min_t(unsigned long, index - index_current,
+			    COUNTER_BITS_TOTAL / BITS_PER_LONG);
+		for (i = 1; i <= top; ++i)
+			counter->backtrack[(i + index_current) &
+				((COUNTER_BITS_TOTAL / BITS_PER_LONG) - 1)] = 0;
+		counter->counter = their_counter;
+	}
+
+	index &= (COUNTER_BITS_TOTAL / BITS_PER_LONG) - 1;
+	ret = !test_and_set_bit(their_counter & (BITS_PER_LONG - 1),
+				&counter->backtrack[index]);
+
+out:
+	spin_unlock_bh(&counter->lock);
+	return ret;
+}
+
+static void rcu_release(struct rcu_head *rcu)
+{
+	struct wg_peer *peer = container_of(rcu, struct wg_peer, rcu);
+
+	dst_cache_destroy(&peer->endpoint_cache);
+	wg_packet_queue_free(&peer->rx_queue, false);
+	wg_packet_queue_free(&peer->tx_queue, false);
+	kzfree(peer);
+}
+
+static void kref_release(struct kref *refcount)
+{
+	struct wg_peer *peer = container_of(refcount, struct wg_peer, refcount);
+
+	/* Remove any lingering packets that didn't have a chance to be
+	 * transmitted.
+	 */
+	wg_packet_purge_staged_packets(peer);
+
+	/* Free the memory used. */
+	call_rcu(&peer->rcu, rcu_release);
+}
+
+void wg_peer_put(struct wg_peer *peer)
+{
+	if (unlikely(!peer))
+		return;
+	kref_put(&peer->refcount, kref_release);
+}
+
+static void peer_make_dead(struct wg_peer *peer)
+{
+	/* Remove from configuration-time lookup structures. */
+	list_del_init(&peer->peer_list);
+	wg_allowedips_remove_by_peer(peer->device, peer);
+	peer_clear_keypair(peer);
+
+	/* Mark as dead, so that we don't allow jumping contexts after. */
+	WRITE_ONCE(peer->is_dead, true);
+
+	/* The caller must now synchronize_net() for this to take effect. */
+}
+
+static void peer_remove_after_dead(struct wg_peer *peer)
+{
+	WARN_ON(!peer->is_dead);
+
+	/*
+	 * The transition between packet encryption/decryption queues isn't
+	 * guarded by is_dead, but each reference's life is strictly bounded
+	 * by two generations: once for parallel crypto and once for serial
+	 * ingestion, so we can simply flush twice, and be sure that we no
+	 * longer have references inside these queues.
+	 */
+	flush_workqueue(peer->device->packet_crypt_wq);
+	flush_workqueue(peer->device->packet_crypt_wq);
+
+	--peer->device->num_peers;
+	wg_peer_put(peer);
+}
+
+/*
+ * We have a separate "remove" function make sure that all active places
+ * where a peer is currently operating will eventually come to an end and
+ * not pass their reference onto another context.
+ */
+void wg_peer_remove(struct wg_peer *peer)
+{
+	if (unlikely(!peer))
+		return;
+	lockdep_assert_held(&peer->device->device_update_lock);
+
+	peer_make_dead(peer);
+	synchronize_net();
+	peer_remove_after_dead(peer);
+}
+
+void wg_peer_remove_all(struct wg_device *wg)
+{
+	struct wg_peer *peer, *temp;
+	LIST_HEAD(dead_peers);
+
+	lockdep_assert_held(&wg->device_update_lock);
+
+	list_for_each_entry_safe(peer, temp, &wg->peer_list, peer_list) {
+		peer_make_dead(peer);
+		list_add_tail(&peer->peer_list, &dead_peers);
+	}
+	synchronize_net();
+	list_for_each_entry_safe(peer, temp, &dead_peers, peer_list)
+		peer_remove_after_dead(peer);
+}
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#ifndef _WG_PEER_H
+#define _WG_PEER_H
+
+#include "device.h"
+#include "messages.h"
+
+#include <uapi/linux/wireguard.h>
+#include <linux/types.h>
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/spinlock.h>
+#include <linux/kref.h>
+#include <net/dst_cache.h>
+
+struct wg_device;
+
+struct wg_endpoint {
+	union {
+		struct sockaddr addr;
+		struct sockaddr_in addr4;
+		struct sockaddr_in6 addr6;
+	};
+};
+
+struct wg_replay_counter {
+	u64 counter;
+	spinlock_t lock;
+	unsigned long backtrack[COUNTER_BITS_TOTAL / BITS_PER_LONG];
+};
+
+/*
+ * One transport session with a peer, as agreed on by the handshake: the
+ * keys and indices for both directions, the nonce counter of the sending
+ * side and the replay window of the receiving side.
+ */
+struct wg_keypair {
+	struct wg_peer *peer;
+	struct hlist_node index_hash;
+	u8 send_key[CHACHA20POLY1305_KEY_SIZE];
+	u8 receive_key[CHACHA20POLY1305_KEY_SIZE];
+	atomic64_t send_counter;
+	struct wg_replay_counter receive_counter;
+	__le32 send_index;
+	__le32 receive_index;
+	struct kref refcount;
+	struct rcu_head rcu;
+};
+
+struct wg_peer {
+	struct wg_device *device;
+	struct crypt_queue tx_queue, rx_queue;
+	struct sk_buff_head staged_packet_queue;
+	int serial_work_cpu;
+	struct wg_endpoint endpoint;
+	struct dst_cache endpoint_cache;
+	rwlock_t endpoint_lock;
+	struct wg_keypair __rcu *keypair;
+	u8 public_key[WG_KEY_LEN];
+	u64 rx_bytes, tx_bytes;
+	struct list_head peer_list;
+	struct list_head allowedips_list;
+	u64 internal_id;
+	struct kref refcount;
+	struct rcu_head rcu;
+	bool is_dead;
+};
+
+struct wg_peer *wg_peer_create(struct wg_device *wg,
+			       const u8 public_key[WG_KEY_LEN]);
+struct wg_peer *wg_peer_lookup(struct wg_device *wg,
+			       const u8 public_key[WG_KEY_LEN]);
+
+struct wg_peer *__must_check wg_peer_get_maybe_zero(struct wg_peer *peer);
+static inline struct wg_peer *wg_peer_get(struct wg_peer *peer)
+{
+	kref_get(&peer->refcount);
+	return peer;
+}
+void wg_peer_put(struct wg_peer *peer);
+void wg_peer_remove(struct wg_peer *peer);
+void wg_peer_remove_all(struct wg_device *wg);
+
+int wg_peer_set_keypair(struct wg_peer *peer,
+			const u8 send_key[CHACHA20POLY1305_KEY_SIZE],
+			const u8 receive_key[CHACHA20POLY1305_KEY_SIZE],
+			__le32 send_index, __le32 receive_index);
+
+struct wg_keypair *wg_keypair_get(struct wg_keypair *keypair);
+void wg_keypair_put(struct wg_keypair *keypair);
+struct wg_keypair *wg_index_hashtable_lookup(struct wg_device *wg,
+					     __le32 index);
+bool wg_replay_counter_validate(struct wg_replay_counter *counter,
+				u64 their_counter);
+
+#endif /* _WG_PEER_H */
@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include "queueing.h"
+#include "socket.h"
+#include "peer.h"
+#include "messages.h"
+
+#include <linux/skbuff.h>
+#include <net/ip_tunnels.h>
+
+/*
+ * Pad the plaintext to a multiple of MESSAGE_PADDING_MULTIPLE, without
+ * going over the MTU of the device, so that the length on the wire
+ * reveals less about the packet inside.
+ */
+static unsigned int calculate_skb_padding(struct sk_buff *skb)
+{
+	unsigned int padded_size, last_unit = skb->len;
+
+	if (unlikely(!PACKET_CB(skb)->mtu))
+		return ALIGN(last_unit, MESSAGE_PADDING_MULTIPLE) - last_unit;
+
+	/* We do this modulo business with the MTU, just in case the networking
+	 * layer gives us a packet that's bigger than the MTU. In that case, we
+	 * wouldn't want the final subtraction to overflow in the case of the
+	 * padded_size being clamped.
+	 */
+	if (unlikely(last_unit > PACKET_CB(skb)->mtu))
+		last_unit %= PACKET_CB(skb)->mtu;
+
+	padded_size = min(PACKET_CB(skb)->mtu,
+			  ALIGN(last_unit, MESSAGE_PADDING_MULTIPLE));
+	return padded_size - last_unit;
+}
+
+static bool encrypt_packet(struct sk_buff *skb, struct wg_keypair *keypair)
+{
+	unsigned int padding_len, plaintext_len, trailer_len;
+	int nhead, ntail;
+	struct message_data *header;
+
+	if (skb->ip_summed == CHECKSUM_PARTIAL && skb_checksum_help(skb))
+		return false;
+
+	padding_len = calculate_skb_padding(skb);
+	trailer_len = padding_len + CHACHA20POLY1305_AUTHTAG_SIZE;
+
+	/* The message is sealed in place, so it must be linear and ours. */
+	if (unlikely(skb_linearize_cow(skb)))
+		return false;
+	nhead = max_t(int, DATA_PACKET_HEAD_ROOM - skb_headroom(skb), 0);
+	ntail = max_t(int, trailer_len - skb_tailroom(skb), 0);
+	if (unlikely((nhead || ntail) &&
+		     pskb_expand_head(skb, nhead, ntail, GFP_ATOMIC)))
+		return false;
+
+	skb_put_zero(skb, padding_len);
+	plaintext_len = skb->len;
+	skb_put(skb, CHACHA20POLY1305_AUTHTAG_SIZE);
+
+	header = skb_push(skb, sizeof(*header));
+	header->header.type = cpu_to_le32(MESSAGE_DATA);
+	header->key_idx = keypair->send_index;
+	header->counter = cpu_to_le64(PACKET_CB(skb)->nonce);
+
+	chacha20poly1305_encrypt(header->encrypted_data, header->encrypted_data,
+				 plaintext_len, NULL, 0, PACKET_CB(skb)->nonce,
+				 keypair->send_key);
+	return true;
+}
+
+void wg_packet_tx_worker(struct work_struct *work)
+{
+	struct crypt_queue *queue = container_of(work, struct crypt_queue,
+						 work);
+	enum packet_state state;
+	struct sk_buff *skb;
+
+	while ((skb = __ptr_ring_peek(&queue->ring)) != NULL &&
+	       (state = atomic_read_acquire(&PACKET_CB(skb)->state)) !=
+		       PACKET_STATE_UNCRYPTED) {
+		struct wg_keypair *keypair = PACKET_CB(skb)->keypair;
+		struct wg_peer *peer = keypair->peer;
+
+		__ptr_ring_discard_one(&queue->ring);
+
+		if (likely(state == PACKET_STATE_CRYPTED))
+			wg_socket_send_skb_to_peer(peer, skb,
+						   PACKET_CB(skb)->ds);
+		else
+			kfree_skb(skb);
+
+		wg_keypair_put(keypair);
+		wg_peer_put(peer);
+		if (need_resched())
+			cond_resched();
+	}
+}
+
+void wg_packet_encrypt_worker(struct work_struct *work)
+{
+	struct crypt_queue *queue = container_of(work, struct multicore_worker,
+						 work)->ptr;
+	struct sk_buff *skb;
+
+	while ((skb = ptr_ring_consume_bh(&queue->ring)) != NULL) {
+		enum packet_state state = PACKET_STATE_CRYPTED;
+
+		if (likely(encrypt_packet(skb, PACKET_CB(skb)->keypair)))
+			wg_reset_packet(skb, true);
+		else
+			state = PACKET_STATE_DEAD;
+		wg_queue_enqueue_per_peer(&PACKET_PEER(skb)->tx_queue, skb,
+					  state);
+		if (need_resched())
+			cond_resched();
+	}
+}
+
+static void wg_packet_create_data(struct sk_buff *skb)
+{
+	struct wg_peer *peer = PACKET_PEER(skb);
+	struct wg_device *wg = peer->device;
+	int ret;
+
+	ret = wg_queue_enqueue_per_device_and_peer(&wg->encrypt_queue,
+						   &peer->tx_queue, skb,
+						   wg->packet_crypt_wq,
+						   &wg->encrypt_queue.last_cpu);
+	if (unlikely(ret == -EPIPE))
+		wg_queue_enqueue_per_peer(&peer->tx_queue, skb,
+					  PACKET_STATE_DEAD);
+	if (likely(!ret || ret == -EPIPE))
+		return;
+
+	wg_keypair_put(PACKET_CB(skb)->keypair);
+	wg_peer_put(peer);
+	kfree_skb(skb);
+}
+
+void wg_packet_purge_staged_packets(struct wg_peer *peer)
+{
+	spin_lock_bh(&peer->staged_packet_queue.lock);
+	peer->device->dev->stats.tx_dropped +=
+		skb_queue_len(&peer->staged_packet_queue);
+	__skb_queue_purge(&peer->staged_packet_queue);
+	spin_unlock_bh(&peer->staged_packet_queue.lock);
+}
+
+/*
+ * Hand the staged packets of @peer to the crypto workers.  Without a
+ * usable session they stay staged, and go out once user space installs
+ * one.
+ */
+void wg_packet_send_staged_packets(struct wg_peer *peer)
+{
+	struct wg_keypair *keypair;
+	struct sk_buff_head packets;
+	struct sk_buff *skb;
+
+	/* Steal the current queue into our local one. */
+	__skb_queue_head_init(&packets);
+	spin_lock_bh(&peer->staged_packet_queue.lock);
+	skb_queue_splice_init(&peer->staged_packet_queue, &packets);
+	spin_unlock_bh(&peer->staged_packet_queue.lock);
+	if (unlikely(skb_queue_empty(&packets)))
+		return;
+
+	rcu_read_lock_bh();
+	keypair = wg_keypair_get(rcu_dereference_bh(peer->keypair));
+	rcu_read_unlock_bh();
+	if (unlikely(!keypair))
+		goto out_nokey;
+
+	/*
+	 * Claim the nonces up front, so that a session running out of them
+	 * leaves all of the packets staged instead of sending some.
+	 */
+	skb_queue_walk(&packets, skb) {
+		PACKET_CB(skb)->ds = ip_tunnel_ecn_encap(0, ip_hdr(skb), skb);
+		PACKET_CB(skb)->nonce =
+			atomic64_inc_return(&keypair->send_counter) - 1;
+		if (unlikely(PACKET_CB(skb)->nonce >= REJECT_AFTER_MESSAGES))
+			goto out_invalid;
+	}
+
+	while ((skb = __skb_dequeue(&packets)) != NULL) {
+		kref_get(&keypair->refcount);
+		PACKET_CB(skb)->keypair = keypair;
+		wg_peer_get(peer);
+		wg_packet_create_data(skb);
+	}
+	wg_keypair_put(keypair);
+	return;
+
+out_invalid:
+	atomic64_set(&keypair->send_counter, REJECT_AFTER_MESSAGES);
+	wg_keypair_put(keypair);
+	net_dbg_ratelimited("%s: Session with peer %llu is out of nonces\n",
+			    peer->device->dev->name, peer->internal_id);
+out_nokey:
+	/*
+	 * We orphan the packets if we're waiting on a session, so that they
+	 * don't block a socket's pool.
+	 */
+	skb_queue_walk(&packets, skb)
+		skb_orphan(skb);
+	/*
+	 * Then we put them back on the top of the queue. We're not too
+	 * concerned about accidentally getting things a little out of order
+	 * if packets are being added really fast, because this queue is for
+	 * before packets can even be sent and it's small anyway.
+	 */
+	spin_lock_bh(&peer->staged_packet_queue.lock);
+	skb_queue_splice(&packets, &peer->staged_packet_queue);
+	spin_unlock_bh(&peer->staged_packet_queue.lock);
+}
@@ -250,6 +250,7 @@ void nvme_complete_rq(struct request *req)
 	blk_status_t status = nvme_error_status(req);
 
 	trace_nvme_complete_rq(req);
+	nvme_mpath_end_request(req);
 
 	if (unlikely(status != BLK_STS_OK && nvme_req_needs_retry(req))) {
 		if ((req->cmd_flags & REQ_NVME_MPATH) &&
@@ -268,6 +269,22 @@ void nvme_complete_rq(struct request *req)
 }
 EXPORT_SYMBOL_GPL(nvme_complete_rq);
 
+/*
+ * End the commands collected by nvme_end_request_batch(). They all succeeded,
+ * so there is nothing to retry or fail over.
+ */
+void nvme_complete_batch(struct blk_mq_comp_batch *cb)
+{
+	unsigned int i;
+
+	for (i = 0; i < cb->nr; i++) {
+		trace_nvme_complete_rq(cb->rqs[i]);
+		nvme_mpath_end_request(cb->rqs[i]);
+	}
+	blk_mq_end_request_batch(cb);
+}
+EXPORT_SYMBOL_GPL(nvme_complete_batch);
+
 void nvme_cancel_request(struct request *req, void *data, bool reserved)
 {
 	dev_dbg_ratelimited(((struct nvme_ctrl *) data)->device,
@@ -642,6 +659,9 @@ static inline blk_status_t nvme_setup_rw(struct nvme_ns *ns,
 
 void nvme_cleanup_cmd(struct request *req)
 {
+	/* the transports clean up commands which failed after being started */
+	nvme_mpath_end_request(req);
+
 	if (blk_integrity_rq(req) && req_op(req) == REQ_OP_READ &&
 	    nvme_req(req)->status == 0) {
 		struct nvme_ns *ns = req->rq_disk->private_data;
@@ -2186,6 +2206,9 @@ static struct attribute *nvme_subsys_attrs[] = {
 	&subsys_attr_serial.attr,
 	&subsys_attr_firmware_rev.attr,
 	&subsys_attr_subsysnqn.attr,
+#ifdef CONFIG_NVME_MULTIPATH
+	&subsys_attr_iopolicy.attr,
+#endif
 	NULL,
 };
 
@@ -2238,6 +2261,7 @@ static int nvme_init_subsystem(struct nvme_ctrl *ctrl, struct nvme_id_ctrl *id)
 	memcpy(subsys->firmware_rev, id->fr, sizeof(subsys->firmware_rev));
 	subsys->vendor_id = le16_to_cpu(id->vid);
 	subsys->cmic = id->cmic;
+	nvme_mpath_default_iopolicy(subsys);
 
 	subsys->dev.class = nvme_subsys_class;
 	subsys->dev.release = nvme_release_subsystem;
@@ -2855,6 +2879,9 @@ static struct attribute *nvme_dev_attrs[] = {
 	&dev_attr_subsysnqn.attr,
 	&dev_attr_address.attr,
 	&dev_attr_state.attr,
+#ifdef CONFIG_NVME_MULTIPATH
+	&dev_attr_nr_active.attr,
+#endif
 	NULL
 };
 
@@ -3562,9 +3589,13 @@ int nvme_init_ctrl(struct nvme_ctrl *ctrl, struct device *dev,
 	memset(&ctrl->ka_cmd, 0, sizeof(ctrl->ka_cmd));
 	ctrl->ka_cmd.common.opcode = nvme_admin_keep_alive;
 
+	ret = nvme_mpath_init_ctrl(ctrl);
+	if (ret)
+		goto out;
+
 	ret = ida_simple_get(&nvme_instance_ida, 0, 0, GFP_KERNEL);
 	if (ret < 0)
-		goto out;
+		goto out_mpath_uninit;
 	ctrl->instance = ret;
 
 	device_initialize(&ctrl->ctrl_device);
@@ -3598,6 +3629,8 @@ int nvme_init_ctrl(struct nvme_ctrl *ctrl, struct device *dev,
 	kfree_const(ctrl->device->kobj.name);
 out_release_instance:
 	ida_simple_remove(&nvme_instance_ida, ctrl->instance);
+out_mpath_uninit:
+	nvme_mpath_uninit(ctrl);
 out:
 	return ret;
 }
@@ -23,6 +23,7 @@
 #include <linux/sed-opal.h>
 #include <linux/fault-inject.h>
 #include <linux/rcupdate.h>
+#include <linux/percpu_counter.h>
 
 extern unsigned int nvme_io_timeout;
 #define NVME_IO_TIMEOUT	(nvme_io_timeout * HZ)
@@ -113,6 +114,7 @@ struct nvme_request {
 enum {
 	NVME_REQ_CANCELLED		= (1 << 0),
 	NVME_REQ_USERCMD		= (1 << 1),
+	NVME_MPATH_CNT_ACTIVE		= (1 << 2),
 };
 
 static inline struct nvme_request *nvme_req(struct request *req)
@@ -217,6 +219,8 @@ struct nvme_ctrl {
 	size_t ana_log_size;
 	struct timer_list anatt_timer;
 	struct work_struct ana_work;
+	/* commands in flight, only counted for the queue-depth iopolicy */
+	struct percpu_counter nr_active;
 #endif
 
 	/* Power saving configuration */
@@ -239,6 +243,16 @@ struct nvme_ctrl {
 	struct nvmf_ctrl_options *opts;
 };
 
+#define SUBSYS_ATTR_RW(_name, _mode, _show, _store)		\
+	struct device_attribute subsys_attr_##_name =		\
+		__ATTR(_name, _mode, _show, _store)
+
+enum nvme_iopolicy {
+	NVME_IOPOLICY_NUMA,
+	NVME_IOPOLICY_RR,
+	NVME_IOPOLICY_QD,
+};
+
 struct nvme_subsystem {
 	int			instance;
 	struct device		dev;
@@ -258,6 +272,9 @@ struct nvme_subsystem {
 	u8			cmic;
 	u16			vendor_id;
 	struct ida		ns_ida;
+#ifdef CONFIG_NVME_MULTIPATH
+	enum nvme_iopolicy	iopolicy;
+#endif
 };
 
 /*
@@ -397,6 +414,25 @@ static inline void nvme_end_request(struct request *req, __le16 status,
 	blk_mq_complete_request(req);
 }
 
+/*
+ * Like nvme_end_request(), but successful commands are collected in @cb so
+ * that the transport can end them together with nvme_complete_batch().
+ */
+static inline void nvme_end_request_batch(struct request *req, __le16 status,
+		union nvme_result result, struct blk_mq_comp_batch *cb)
+{
+	struct nvme_request *rq = nvme_req(req);
+
+	rq->status = le16_to_cpu(status) >> 1;
+	rq->result = result;
+	/* inject error when permitted by fault injection framework */
+	nvme_should_fail(req);
+	if (likely(rq->status == NVME_SC_SUCCESS))
+		blk_mq_complete_request_batch(req, cb);
+	else
+		blk_mq_complete_request(req);
+}
+
 static inline void nvme_get_ctrl(struct nvme_ctrl *ctrl)
 {
 	get_device(ctrl->device);
@@ -408,6 +444,7 @@ static inline void nvme_put_ctrl(struct nvme_ctrl *ctrl)
 }
 
 void nvme_complete_rq(struct request *req);
+void nvme_complete_batch(struct blk_mq_comp_batch *cb);
 void nvme_cancel_request(struct request *req, void *data, bool reserved);
 bool nvme_change_ctrl_state(struct nvme_ctrl *ctrl,
 		enum nvme_ctrl_state new_state);
@@ -477,6 +514,39 @@ void nvme_mpath_uninit(struct nvme_ctrl *ctrl);
 void nvme_mpath_stop(struct nvme_ctrl *ctrl);
 void nvme_mpath_clear_current_path(struct nvme_ns *ns);
 struct nvme_ns *nvme_find_path(struct nvme_ns_head *head);
+int nvme_mpath_init_ctrl(struct nvme_ctrl *ctrl);
+void nvme_mpath_default_iopolicy(struct nvme_subsystem *subsys);
+
+/*
+ * The per-cpu deltas are folded into the shared count every few commands,
+ * which keeps the hot path cheap while bounding the error path selection
+ * sees from percpu_counter_read().
+ */
+#define NVME_NR_ACTIVE_BATCH	8
+
+static inline void nvme_mpath_start_request(struct request *rq)
+{
+	struct nvme_ns *ns = rq->q->queuedata;
+
+	if (!(rq->cmd_flags & REQ_NVME_MPATH) ||
+	    READ_ONCE(ns->head->subsys->iopolicy) != NVME_IOPOLICY_QD ||
+	    (nvme_req(rq)->flags & NVME_MPATH_CNT_ACTIVE))
+		return;
+
+	percpu_counter_add_batch(&ns->ctrl->nr_active, 1,
+				 NVME_NR_ACTIVE_BATCH);
+	nvme_req(rq)->flags |= NVME_MPATH_CNT_ACTIVE;
+}
+
+static inline void nvme_mpath_end_request(struct request *rq)
+{
+	if (!(nvme_req(rq)->flags & NVME_MPATH_CNT_ACTIVE))
+		return;
+
+	percpu_counter_add_batch(&nvme_req(rq)->ctrl->nr_active, -1,
+				 NVME_NR_ACTIVE_BATCH);
+	nvme_req(rq)->flags &= ~NVME_MPATH_CNT_ACTIVE;
+}
 
 static inline void nvme_mpath_check_last_path(struct nvme_ns *ns)
 {
@@ -488,6 +558,8 @@ static inline void nvme_mpath_check_last_path(struct nvme_ns *ns)
 
 extern struct device_attribute dev_attr_ana_grpid;
 extern struct device_attribute dev_attr_ana_state;
+extern struct device_attribute dev_attr_nr_active;
+extern struct device_attribute subsys_attr_iopolicy;
 
 #else
 static inline bool nvme_ctrl_use_ana(struct nvme_ctrl *ctrl)
@@ -542,8 +614,31 @@ static inline void nvme_mpath_uninit(struct nvme_ctrl *ctrl)
 static inline void nvme_mpath_stop(struct nvme_ctrl *ctrl)
 {
 }
+static inline int nvme_mpath_init_ctrl(struct nvme_ctrl *ctrl)
+{
+	return 0;
+}
+static inline void nvme_mpath_default_iopolicy(struct nvme_subsystem *subsys)
+{
+}
+static inline void nvme_mpath_start_request(struct request *rq)
+{
+}
+static inline void nvme_mpath_end_request(struct request *rq)
+{
+}
 #endif /* CONFIG_NVME_MULTIPATH */
 
+/*
+ * Called by the transports right before a command is handed to the hardware,
+ * once it is certain to complete through nvme_complete_rq().
+ */
+static inline void nvme_start_request(struct request *rq)
+{
+	nvme_mpath_start_request(rq);
+	blk_mq_start_request(rq);
+}
+
 #ifdef CONFIG_NVM
 void nvme_nvm_update_nvm_info(struct nvme_ns *ns);
 int nvme_nvm_register(struct nvme_ns *ns, char *disk_name, int node);
@@ -74,6 +74,12 @@ static int io_queue_depth = 1024;
 module_param_cb(io_queue_depth, &io_queue_depth_ops, &io_queue_depth, 0644);
 MODULE_PARM_DESC(io_queue_depth, "set io queue depth, should >= 2");
 
+static unsigned int poll_queues;
+module_param(poll_queues, uint, 0444);
+MODULE_PARM_DESC(poll_queues,
+	"Number of I/O queues without interrupts, used for polled I/O. "
+	"These are taken out of the interrupt driven queues.");
+
 struct nvme_dev;
 struct nvme_queue;
 
@@ -92,6 +98,7 @@ struct nvme_dev {
 	struct dma_pool *prp_small_pool;
 	unsigned online_queues;
 	unsigned max_qid;
+	unsigned io_queues[HCTX_MAX_TYPES];
 	unsigned int num_vecs;
 	int q_depth;
 	u32 db_stride;
@@ -172,6 +179,7 @@ struct nvme_queue {
 	u16 last_cq_head;
 	u16 qid;
 	u8 cq_phase;
+	bool polled;		/* no interrupt, completions are polled for */
 	u32 *dbbuf_sq_db;
 	u32 *dbbuf_cq_db;
 	u32 *dbbuf_sq_ei;
@@ -434,9 +442,34 @@ static int nvme_init_request(struct blk_mq_tag_set *set, struct request *req,
 static int nvme_pci_map_queues(struct blk_mq_tag_set *set)
 {
 	struct nvme_dev *dev = set->driver_data;
+	int i, qoff, offset;
+
+	offset = dev->num_vecs > 1 ? 1 /* admin queue */ : 0;
+	qoff = 0;
+	for (i = 0; i < set->nr_maps; i++) {
+		struct blk_mq_queue_map *map = &set->map[i];
+
+		map->nr_queues = dev->io_queues[i];
+		if (!map->nr_queues) {
+			BUG_ON(i == HCTX_TYPE_DEFAULT);
+			continue;
+		}
 
-	return blk_mq_pci_map_queues(set, to_pci_dev(dev->dev),
-			dev->num_vecs > 1 ? 1 /* admin queue */ : 0);
+		/*
+		 * The poll queues don't have an interrupt (and hence no
+		 * interrupt affinity), so use the regular blk-mq cpu mapping
+		 * for them.
+		 */
+		map->queue_offset = qoff;
+		if (i != HCTX_TYPE_POLL)
+			blk_mq_pci_map_queues(map, to_pci_dev(dev->dev), offset);
+		else
+			blk_mq_map_queues(map);
+		qoff += map->nr_queues;
+		offset += map->nr_queues;
+	}
+
+	return 0;
 }
 
 /**
@@ -839,7 +872,7 @@ static blk_status_t nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 			goto out_cleanup_iod;
 	}
 
-	blk_mq_start_request(req);
+	nvme_start_request(req);
 	nvme_submit_cmd(nvmeq, &cmnd);
 	return BLK_STS_OK;
 out_cleanup_iod:
@@ -857,6 +890,19 @@ static void nvme_pci_complete_rq(struct request *req)
 	nvme_complete_rq(req);
 }
 
+static void nvme_pci_complete_batch(struct blk_mq_comp_batch *cb)
+{
+	unsigned int i;
+
+	for (i = 0; i < cb->nr; i++) {
+		struct request *req = cb->rqs[i];
+		struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
+
+		nvme_unmap_data(iod->nvmeq->dev, req);
+	}
+	nvme_complete_batch(cb);
+}
+
 /* We read the CQE phase first to check if the rest of the entry is valid */
 static inline bool nvme_cqe_pending(struct nvme_queue *nvmeq)
 {
@@ -873,7 +919,8 @@ static inline void nvme_ring_cq_doorbell(struct nvme_queue *nvmeq)
 		writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
 }
 
-static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
+static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx,
+		struct blk_mq_comp_batch *cb)
 {
 	volatile struct nvme_completion *cqe = &nvmeq->cqes[idx];
 	struct request *req;
@@ -899,16 +946,23 @@ static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
 	}
 
 	req = blk_mq_tag_to_rq(*nvmeq->tags, cqe->command_id);
-	nvme_end_request(req, cqe->status, cqe->result);
+	nvme_end_request_batch(req, cqe->status, cqe->result, cb);
 }
 
 static void nvme_complete_cqes(struct nvme_queue *nvmeq, u16 start, u16 end)
 {
+	struct blk_mq_comp_batch cb = { .nr = 0 };
+
 	while (start != end) {
-		nvme_handle_cqe(nvmeq, start);
+		nvme_handle_cqe(nvmeq, start, &cb);
+		if (cb.nr == BLK_MQ_COMP_BATCH)
+			nvme_pci_complete_batch(&cb);
 		if (++start == nvmeq->q_depth)
 			start = 0;
 	}
+
+	if (cb.nr)
+		nvme_pci_complete_batch(&cb);
 }
 
 static inline void nvme_update_cq_head(struct nvme_queue *nvmeq)
@@ -1016,7 +1070,10 @@ static int adapter_alloc_cq(struct nvme_dev *dev, u16 qid,
 		struct nvme_queue *nvmeq, s16 vector)
 {
 	struct nvme_command c;
-	int flags = NVME_QUEUE_PHYS_CONTIG | NVME_CQ_IRQ_ENABLED;
+	int flags = NVME_QUEUE_PHYS_CONTIG;
+
+	if (!nvmeq->polled)
+		flags |= NVME_CQ_IRQ_ENABLED;
 
 	/*
 	 * Note: we (ab)use the fact that the prp fields survive if no data
@@ -1288,7 +1345,8 @@ static int nvme_suspend_queue(struct nvme_queue *nvmeq)
 	if (!nvmeq->qid && nvmeq->dev->ctrl.admin_q)
 		blk_mq_quiesce_queue(nvmeq->dev->ctrl.admin_q);
 
-	pci_free_irq(to_pci_dev(nvmeq->dev->dev), vector, nvmeq);
+	if (!nvmeq->polled)
+		pci_free_irq(to_pci_dev(nvmeq->dev->dev), vector, nvmeq);
 
 	return 0;
 }
@@ -1422,7 +1480,7 @@ static void nvme_init_queue(struct nvme_queue *nvmeq, u16 qid)
 	spin_unlock_irq(&nvmeq->cq_lock);
 }
 
-static int nvme_create_queue(struct nvme_queue *nvmeq, int qid)
+static int nvme_create_queue(struct nvme_queue *nvmeq, int qid, bool polled)
 {
 	struct nvme_dev *dev = nvmeq->dev;
 	int result;
@@ -1430,9 +1488,14 @@ static int nvme_create_queue(struct nvme_queue *nvmeq, int qid)
 
 	/*
 	 * A queue's vector matches the queue identifier unless the controller
-	 * has only one vector available.
+	 * has only one vector available.  Polled queues have no vector, but
+	 * still need a valid ->cq_vector to be considered live.
 	 */
-	vector = dev->num_vecs == 1 ? 0 : qid;
+	if (polled)
+		vector = 0;
+	else
+		vector = dev->num_vecs == 1 ? 0 : qid;
+	nvmeq->polled = polled;
 	result = adapter_alloc_cq(dev, qid, nvmeq, vector);
 	if (result)
 		return result;
@@ -1450,6 +1513,9 @@ static int nvme_create_queue(struct nvme_queue *nvmeq, int qid)
 	 */
 	nvmeq->cq_vector = vector;
 	nvme_init_queue(nvmeq, qid);
+	if (polled)
+		return 0;
+
 	result = queue_request_irq(nvmeq);
 	if (result < 0)
 		goto release_sq;
@@ -1595,6 +1661,7 @@ static int nvme_pci_configure_admin_queue(struct nvme_dev *dev)
 		return result;
 
 	nvmeq->cq_vector = 0;
+	nvmeq->polled = false;
 	nvme_init_queue(nvmeq, 0);
 	result = queue_request_irq(nvmeq);
 	if (result) {
@@ -1607,7 +1674,7 @@ static int nvme_pci_configure_admin_queue(struct nvme_dev *dev)
 
 static int nvme_create_io_queues(struct nvme_dev *dev)
 {
-	unsigned i, max;
+	unsigned i, max, irq_queues, live;
 	int ret = 0;
 
 	for (i = dev->ctrl.queue_count; i <= dev->max_qid; i++) {
@@ -1618,12 +1685,21 @@ static int nvme_create_io_queues(struct nvme_dev *dev)
 	}
 
 	max = min(dev->max_qid, dev->ctrl.queue_count - 1);
+	irq_queues = dev->io_queues[HCTX_TYPE_DEFAULT];
 	for (i = dev->online_queues; i <= max; i++) {
-		ret = nvme_create_queue(&dev->queues[i], i);
+		ret = nvme_create_queue(&dev->queues[i], i, i > irq_queues);
 		if (ret)
 			break;
 	}
 
+	/*
+	 * Queues are created in order, interrupt driven ones first, so if
+	 * we came up short it's the poll queues that go missing first.
+	 */
+	live = dev->online_queues - 1;
+	dev->io_queues[HCTX_TYPE_DEFAULT] = min(irq_queues, live);
+	dev->io_queues[HCTX_TYPE_POLL] = live - dev->io_queues[HCTX_TYPE_DEFAULT];
+
 	/*
 	 * Ignore failing Create SQ/CQ commands, we can continue with less
 	 * than the desired amount of queues, and even a controller without
@@ -1895,7 +1971,7 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 {
 	struct nvme_queue *adminq = &dev->queues[0];
 	struct pci_dev *pdev = to_pci_dev(dev->dev);
-	int result, nr_io_queues;
+	int result, nr_io_queues, nr_poll_queues;
 	unsigned long size;
 
 	struct irq_affinity affd = {
@@ -1932,17 +2008,27 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	/* Deregister the admin queue's interrupt */
 	pci_free_irq(pdev, 0, adminq);
 
+	/*
+	 * Poll queues don't need an interrupt vector, but always leave at
+	 * least one interrupt driven queue for everything else.
+	 */
+	nr_poll_queues = min_t(int, READ_ONCE(poll_queues), nr_io_queues - 1);
+
 	/*
 	 * If we enable msix early due to not intx, disable it again before
 	 * setting up the full range we need.
 	 */
 	pci_free_irq_vectors(pdev);
-	result = pci_alloc_irq_vectors_affinity(pdev, 1, nr_io_queues + 1,
+	result = pci_alloc_irq_vectors_affinity(pdev, 1,
+			nr_io_queues - nr_poll_queues + 1,
 			PCI_IRQ_ALL_TYPES | PCI_IRQ_AFFINITY, &affd);
 	if (result <= 0)
 		return -EIO;
 	dev->num_vecs = result;
-	dev->max_qid = max(result - 1, 1);
+	dev->io_queues[HCTX_TYPE_DEFAULT] = max(result - 1, 1);
+	dev->io_queues[HCTX_TYPE_READ] = 0;
+	dev->io_queues[HCTX_TYPE_POLL] = nr_poll_queues;
+	dev->max_qid = dev->io_queues[HCTX_TYPE_DEFAULT] + nr_poll_queues;
 
 	/*
 	 * Should investigate if there's a performance win from allocating
@@ -2045,6 +2131,7 @@ static int nvme_dev_add(struct nvme_dev *dev)
 	if (!dev->ctrl.tagset) {
 		dev->tagset.ops = &nvme_mq_ops;
 		dev->tagset.nr_hw_queues = dev->online_queues - 1;
+		dev->tagset.nr_maps = HCTX_MAX_TYPES;
 		dev->tagset.timeout = NVME_IO_TIMEOUT;
 		dev->tagset.numa_node = dev_to_node(dev->dev);
 		dev->tagset.queue_depth =
@@ -24,6 +24,7 @@
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/kthread.h>
+#include <linux/capability.h>
 #include <linux/cgroup.h>
 #include <linux/module.h>
 #include <linux/sort.h>
@@ -265,15 +266,21 @@ void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
 		 * test_and_set_bit() implies a memory barrier.
 		 */
 		llist_add(&work->node, &dev->work_list);
+		if (dev->shared)
+			WRITE_ONCE(dev->shared->pending, true);
 		wake_up_process(dev->worker);
 	}
 }
 EXPORT_SYMBOL_GPL(vhost_work_queue);
 
-/* A lockless hint for busy polling code to exit the loop */
+/* A lockless hint for busy polling code to exit the loop, on a shared
+ * worker work queued on other devices counts too, so that one device
+ * busy polling doesn't hold up the others.
+ */
 bool vhost_has_work(struct vhost_dev *dev)
 {
-	return !llist_empty(&dev->work_list);
+	return !llist_empty(&dev->work_list) ||
+	       (dev->shared && READ_ONCE(dev->shared->pending));
 }
 EXPORT_SYMBOL_GPL(vhost_has_work);
 
@@ -372,6 +379,205 @@ static int vhost_worker(void *data)
 	return 0;
 }
 
+static DEFINE_MUTEX(vhost_shared_workers_mutex);
+static LIST_HEAD(vhost_shared_workers);
+
+/* Continuous polling: look for new buffers without waiting for the guest
+ * to kick us. The handlers bail out on rings which aren't set up.
+ */
+static void vhost_dev_poll_vqs(struct vhost_dev *dev)
+{
+	struct vhost_virtqueue *vq;
+	int i;
+
+	for (i = 0; i < dev->nvqs; ++i) {
+		vq = dev->vqs[i];
+		if (vq->handle_kick && READ_ONCE(vq->kick))
+			vq->handle_kick(&vq->poll.work);
+	}
+}
+
+/* One round over the devices of a shared worker, running the work queued on
+ * each of them in turn. Caller holds the worker mutex, the mm of a device is
+ * only used while running its work, as the device can be released as soon as
+ * the mutex is dropped. Returns whether any work was found.
+ */
+static bool vhost_shared_worker_run(struct vhost_shared_worker *w)
+{
+	struct vhost_work *work, *work_next;
+	struct mm_struct *mm = NULL;
+	struct llist_node *node;
+	struct vhost_dev *dev;
+	bool found = false;
+
+	/* Clear the hint before looking at the work lists, work queued after
+	 * that sets it again.
+	 */
+	WRITE_ONCE(w->pending, false);
+	smp_mb();
+
+	list_for_each_entry(dev, &w->dev_list, shared_node) {
+		node = llist_del_all(&dev->work_list);
+		if (!node && !(dev->worker_flags & VHOST_WORKER_F_POLL))
+			continue;
+
+		if (dev->mm != mm) {
+			if (mm)
+				unuse_mm(mm);
+			mm = dev->mm;
+			use_mm(mm);
+		}
+
+		if (!node) {
+			vhost_dev_poll_vqs(dev);
+			continue;
+		}
+
+		found = true;
+		node = llist_reverse_order(node);
+		/* make sure flag is seen after deletion */
+		smp_wmb();
+		llist_for_each_entry_safe(work, work_next, node, node) {
+			clear_bit(VHOST_WORK_QUEUED, &work->flags);
+			work->fn(work);
+			cond_resched();
+		}
+	}
+	if (mm)
+		unuse_mm(mm);
+
+	/* Don't always favour the same device */
+	if (!list_empty(&w->dev_list))
+		list_rotate_left(&w->dev_list);
+
+	return found;
+}
+
+static int vhost_shared_worker(void *data)
+{
+	struct vhost_shared_worker *w = data;
+	mm_segment_t oldfs = get_fs();
+	bool found, poll;
+
+	set_fs(USER_DS);
+
+	while (!kthread_should_stop()) {
+		mutex_lock(&w->mutex);
+		found = vhost_shared_worker_run(w);
+		poll = w->nr_polling;
+		mutex_unlock(&w->mutex);
+
+		if (found || poll) {
+			cond_resched();
+			continue;
+		}
+
+		/* mb paired w/ kthread_stop and vhost_work_queue() */
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!READ_ONCE(w->pending) && !kthread_should_stop())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+	}
+	set_fs(oldfs);
+	return 0;
+}
+
+static struct vhost_shared_worker *vhost_shared_worker_get(int cpu)
+{
+	struct vhost_shared_worker *w;
+	struct task_struct *task;
+
+	list_for_each_entry(w, &vhost_shared_workers, node) {
+		if (w->cpu == cpu) {
+			w->refcnt++;
+			return w;
+		}
+	}
+
+	w = kzalloc(sizeof(*w), GFP_KERNEL);
+	if (!w)
+		return ERR_PTR(-ENOMEM);
+
+	mutex_init(&w->mutex);
+	INIT_LIST_HEAD(&w->dev_list);
+	w->refcnt = 1;
+	w->cpu = cpu;
+
+	task = kthread_create_on_node(vhost_shared_worker, w, cpu_to_node(cpu),
+				      "vhost-shared-%d", cpu);
+	if (IS_ERR(task)) {
+		kfree(w);
+		return ERR_CAST(task);
+	}
+	kthread_bind(task, cpu);
+	w->task = task;
+	list_add(&w->node, &vhost_shared_workers);
+	wake_up_process(task);	/* avoid contributing to loadavg */
+
+	return w;
+}
+
+static void vhost_shared_worker_put(struct vhost_shared_worker *w)
+{
+	if (--w->refcnt)
+		return;
+
+	list_del(&w->node);
+	kthread_stop(w->task);
+	kfree(w);
+}
+
+static int vhost_shared_worker_attach(struct vhost_dev *dev)
+{
+	struct vhost_shared_worker *w;
+
+	mutex_lock(&vhost_shared_workers_mutex);
+	w = vhost_shared_worker_get(dev->worker_cpu);
+	mutex_unlock(&vhost_shared_workers_mutex);
+	if (IS_ERR(w))
+		return PTR_ERR(w);
+
+	mutex_lock(&w->mutex);
+	list_add_tail(&dev->shared_node, &w->dev_list);
+	if (dev->worker_flags & VHOST_WORKER_F_POLL)
+		w->nr_polling++;
+	dev->shared = w;
+	dev->worker = w->task;
+	mutex_unlock(&w->mutex);
+
+	wake_up_process(w->task);
+
+	return 0;
+}
+
+/* Once the worker mutex is released, the worker is done with the device */
+static void vhost_shared_worker_detach(struct vhost_dev *dev)
+{
+	struct vhost_shared_worker *w = dev->shared;
+
+	mutex_lock(&w->mutex);
+	list_del(&dev->shared_node);
+	if (dev->worker_flags & VHOST_WORKER_F_POLL)
+		w->nr_polling--;
+	dev->shared = NULL;
+	dev->worker = NULL;
+	mutex_unlock(&w->mutex);
+
+	mutex_lock(&vhost_shared_workers_mutex);
+	vhost_shared_worker_put(w);
+	mutex_unlock(&vhost_shared_workers_mutex);
+}
+
+static void vhost_dev_stop_worker(struct vhost_dev *dev)
+{
+	if (dev->shared) {
+		vhost_shared_worker_detach(dev);
+	} else if (dev->worker) {
+		kthread_stop(dev->worker);
+		dev->worker = NULL;
+	}
+}
+
 static void vhost_vq_free_iovecs(struct vhost_virtqueue *vq)
 {
 	kfree(vq->indirect);
@@ -430,6 +636,9 @@ void vhost_dev_init(struct vhost_dev *dev,
 	dev->iotlb = NULL;
 	dev->mm = NULL;
 	dev->worker = NULL;
+	dev->shared = NULL;
+	dev->worker_cpu = -1;
+	dev->worker_flags = 0;
 	init_llist_head(&dev->work_list);
 	init_waitqueue_head(&dev->wait);
 	INIT_LIST_HEAD(&dev->read_list);
@@ -506,18 +715,27 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
-	if (IS_ERR(worker)) {
-		err = PTR_ERR(worker);
-		goto err_worker;
-	}
+	if (dev->worker_cpu >= 0) {
+		/* Shared workers stay in the root cgroup */
+		err = vhost_shared_worker_attach(dev);
+		if (err)
+			goto err_worker;
+	} else {
+		worker = kthread_create(vhost_worker, dev, "vhost-%d",
+					current->pid);
+		if (IS_ERR(worker)) {
+			err = PTR_ERR(worker);
+			goto err_worker;
+		}
 
-	dev->worker = worker;
-	wake_up_process(worker);	/* avoid contributing to loadavg */
+		dev->worker = worker;
+		/* avoid contributing to loadavg */
+		wake_up_process(worker);
 
-	err = vhost_attach_cgroups(dev);
-	if (err)
-		goto err_cgroup;
+		err = vhost_attach_cgroups(dev);
+		if (err)
+			goto err_cgroup;
+	}
 
 	err = vhost_dev_alloc_iovecs(dev);
 	if (err)
@@ -525,8 +743,7 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	return 0;
 err_cgroup:
-	kthread_stop(worker);
-	dev->worker = NULL;
+	vhost_dev_stop_worker(dev);
 err_worker:
 	if (dev->mm)
 		mmput(dev->mm);
@@ -618,6 +835,11 @@ void vhost_dev_cleanup(struct vhost_dev *dev)
 {
 	int i;
 
+	/* A polling shared worker calls the kick handlers without any work
+	 * queued, stop it before tearing the rings down.
+	 */
+	vhost_dev_stop_worker(dev);
+
 	for (i = 0; i < dev->nvqs; ++i) {
 		if (dev->vqs[i]->error_ctx)
 			eventfd_ctx_put(dev->vqs[i]->error_ctx);
@@ -639,10 +861,6 @@ void vhost_dev_cleanup(struct vhost_dev *dev)
 	vhost_clear_msg(dev);
 	wake_up_interruptible_poll(&dev->wait, EPOLLIN | EPOLLRDNORM);
 	WARN_ON(!llist_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
-	}
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -1598,6 +1816,33 @@ int vhost_init_device_iotlb(struct vhost_dev *d, bool enabled)
 }
 EXPORT_SYMBOL_GPL(vhost_init_device_iotlb);
 
+/* Caller must have device mutex */
+static long vhost_dev_set_worker(struct vhost_dev *d, void __user *argp)
+{
+	struct vhost_worker_state s;
+
+	if (copy_from_user(&s, argp, sizeof(s)))
+		return -EFAULT;
+	if (s.flags & ~VHOST_WORKER_F_POLL)
+		return -EINVAL;
+	if (s.cpu == -1) {
+		if (s.flags)
+			return -EINVAL;
+	} else if (s.cpu < 0 || s.cpu >= nr_cpu_ids || !cpu_online(s.cpu)) {
+		return -EINVAL;
+	}
+	if ((s.flags & VHOST_WORKER_F_POLL) && !capable(CAP_SYS_NICE))
+		return -EPERM;
+
+	/* The worker is set up when becoming the owner */
+	if (vhost_dev_has_owner(d))
+		return -EBUSY;
+
+	d->worker_cpu = s.cpu;
+	d->worker_flags = s.flags;
+	return 0;
+}
+
 /* Caller must have device mutex */
 long vhost_dev_ioctl(struct vhost_dev *d, unsigned int ioctl, void __user *argp)
 {
@@ -1612,6 +1857,12 @@ long vhost_dev_ioctl(struct vhost_dev *d, unsigned int ioctl, void __user *argp)
 		goto done;
 	}
 
+	/* Nor is picking the worker, until you are */
+	if (ioctl == VHOST_SET_WORKER) {
+		r = vhost_dev_set_worker(d, argp);
+		goto done;
+	}
+
 	/* You must be the owner to do anything else */
 	r = vhost_dev_check_owner(d);
 	if (r)
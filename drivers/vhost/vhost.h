@@ -156,6 +156,20 @@ struct vhost_msg_node {
   struct list_head node;
 };
 
+/* Worker thread bound to a CPU, serving the devices which asked for it
+ * with VHOST_SET_WORKER in round-robin, instead of a thread per device.
+ */
+struct vhost_shared_worker {
+	struct task_struct *task;
+	struct mutex mutex;		/* protects dev_list and nr_polling */
+	struct list_head dev_list;
+	struct list_head node;		/* on the list of shared workers */
+	bool pending;			/* hint: work queued on some device */
+	int nr_polling;			/* devices asking to be polled */
+	int refcnt;
+	int cpu;
+};
+
 struct vhost_dev {
 	struct mm_struct *mm;
 	struct mutex mutex;
@@ -164,6 +178,10 @@ struct vhost_dev {
 	struct eventfd_ctx *log_ctx;
 	struct llist_head work_list;
 	struct task_struct *worker;
+	struct vhost_shared_worker *shared;
+	struct list_head shared_node;
+	int worker_cpu;
+	u32 worker_flags;
 	struct vhost_umem *umem;
 	struct vhost_umem *iotlb;
 	spinlock_t iotlb_lock;
@@ -1447,9 +1447,13 @@ static int aio_prep_rw(struct kiocb *req, struct iocb *iocb)
 		req->ki_ioprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_NONE, 0);
 
 	ret = kiocb_set_rw_flags(req, iocb->aio_rw_flags);
-	if (unlikely(ret))
+	if (unlikely(ret)) {
 		fput(req->ki_filp);
-	return ret;
+		return ret;
+	}
+
+	req->ki_flags &= ~IOCB_HIPRI; /* no one is going to poll for this I/O */
+	return 0;
 }
 
 static int aio_setup_rw(int rw, struct iocb *iocb, struct iovec **iovec,
@@ -1907,7 +1911,7 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 	if (nr > ctx->nr_events)
 		nr = ctx->nr_events;
 
-	blk_start_plug(&plug);
+	blk_start_plug_nr_ios(&plug, nr);
 	for (i = 0; i < nr; i++) {
 		struct iocb __user *user_iocb;
 
@@ -1947,7 +1951,7 @@ COMPAT_SYSCALL_DEFINE3(io_submit, compat_aio_context_t, ctx_id,
 	if (nr > ctx->nr_events)
 		nr = ctx->nr_events;
 
-	blk_start_plug(&plug);
+	blk_start_plug_nr_ios(&plug, nr);
 	for (i = 0; i < nr; i++) {
 		compat_uptr_t user_iocb;
 
@@ -31,6 +31,7 @@
 #include "extent_io.h"
 #include "extent_map.h"
 #include "async-thread.h"
+#include "locking.h"
 
 struct btrfs_trans_handle;
 struct btrfs_transaction;
@@ -670,6 +671,35 @@ struct btrfs_block_group_cache {
 
 	/* Record locked full stripes for RAID5/6 block group */
 	struct btrfs_full_stripe_locks_tree full_stripe_locks_root;
+
+	/*
+	 * Asynchronous discard state, see discard.c.  The list linkage and
+	 * the fields below it are protected by fs_info->discard_ctl.lock.
+	 */
+	struct extent_io_tree discard_pending;
+	struct list_head discard_list;
+	int discard_index;
+	bool discard_trimmed;
+	u64 discard_cursor;
+};
+
+/* Lists of block groups with pending asynchronous discards, in service order */
+enum {
+	BTRFS_DISCARD_INDEX_UNUSED,
+	BTRFS_DISCARD_INDEX_LARGE,
+	BTRFS_DISCARD_INDEX_SMALL,
+	BTRFS_NR_DISCARD_LISTS,
+};
+
+struct btrfs_discard_ctl {
+	struct delayed_work work;
+	spinlock_t lock;
+	struct list_head discard_list[BTRFS_NR_DISCARD_LISTS];
+	u64 discarded_bytes;
+	/* Tunables, see /sys/fs/btrfs/<UUID>/discard/ */
+	u32 iops_limit;
+	u32 kbps_limit;
+	u64 max_discard_size;
 };
 
 /* delayed seq elem */
@@ -958,6 +988,7 @@ struct btrfs_fs_info {
 	u32 thread_pool_size;
 
 	struct kobject *space_info_kobj;
+	struct kobject *discard_kobj;
 	struct list_head pending_raid_kobjs;
 	spinlock_t pending_raid_kobjs_lock; /* uncontended */
 
@@ -1100,6 +1131,9 @@ struct btrfs_fs_info {
 	struct mutex unused_bg_unpin_mutex;
 	struct mutex delete_unused_bgs_mutex;
 
+	/* Asynchronous discard of freed extents */
+	struct btrfs_discard_ctl discard_ctl;
+
 	/* For btrfs to record security options */
 	struct security_mnt_opts security_opts;
 
@@ -1334,7 +1368,7 @@ static inline u32 BTRFS_MAX_XATTR_SIZE(const struct btrfs_fs_info *info)
 #define BTRFS_MOUNT_FLUSHONCOMMIT       (1 << 7)
 #define BTRFS_MOUNT_SSD_SPREAD		(1 << 8)
 #define BTRFS_MOUNT_NOSSD		(1 << 9)
-#define BTRFS_MOUNT_DISCARD		(1 << 10)
+#define BTRFS_MOUNT_DISCARD_SYNC	(1 << 10)
 #define BTRFS_MOUNT_FORCE_COMPRESS      (1 << 11)
 #define BTRFS_MOUNT_SPACE_CACHE		(1 << 12)
 #define BTRFS_MOUNT_CLEAR_CACHE		(1 << 13)
@@ -1353,6 +1387,7 @@ static inline u32 BTRFS_MAX_XATTR_SIZE(const struct btrfs_fs_info *info)
 #define BTRFS_MOUNT_FREE_SPACE_TREE	(1 << 26)
 #define BTRFS_MOUNT_NOLOGREPLAY		(1 << 27)
 #define BTRFS_MOUNT_REF_VERIFY		(1 << 28)
+#define BTRFS_MOUNT_DISCARD_ASYNC	(1 << 29)
 
 #define BTRFS_DEFAULT_COMMIT_INTERVAL	(30)
 #define BTRFS_DEFAULT_MAX_INLINE	(2048)
@@ -2633,7 +2668,8 @@ struct extent_buffer *btrfs_alloc_tree_block(struct btrfs_trans_handle *trans,
 					     u64 parent, u64 root_objectid,
 					     const struct btrfs_disk_key *key,
 					     int level, u64 hint,
-					     u64 empty_size);
+					     u64 empty_size,
+					     enum btrfs_lock_nesting nest);
 void btrfs_free_tree_block(struct btrfs_trans_handle *trans,
 			   struct btrfs_root *root,
 			   struct extent_buffer *buf,
@@ -2777,6 +2813,7 @@ int btrfs_discard_extent(struct btrfs_fs_info *fs_info, u64 bytenr,
 			 u64 num_bytes, u64 *actual_bytes);
 int btrfs_force_chunk_alloc(struct btrfs_trans_handle *trans, u64 type);
 int btrfs_trim_fs(struct btrfs_fs_info *fs_info, struct fstrim_range *range);
+int btrfs_cache_block_group(struct btrfs_block_group_cache *cache);
 
 int btrfs_init_space_info(struct btrfs_fs_info *fs_info);
 int btrfs_delayed_refs_qgroup_accounting(struct btrfs_trans_handle *trans,
@@ -2827,7 +2864,8 @@ int btrfs_compare_trees(struct btrfs_root *left_root,
 int btrfs_cow_block(struct btrfs_trans_handle *trans,
 		    struct btrfs_root *root, struct extent_buffer *buf,
 		    struct extent_buffer *parent, int parent_slot,
-		    struct extent_buffer **cow_ret);
+		    struct extent_buffer **cow_ret,
+		    enum btrfs_lock_nesting nest);
 int btrfs_copy_root(struct btrfs_trans_handle *trans,
 		      struct btrfs_root *root,
 		      struct extent_buffer *buf,
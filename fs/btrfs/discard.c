@@ -0,0 +1,481 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
+#include <linux/workqueue.h>
+#include "ctree.h"
+#include "discard.h"
+#include "free-space-cache.h"
+
+/*
+ * Asynchronous discard
+ *
+ * With -o discard=async, the extents freed by a transaction are not discarded
+ * from btrfs_finish_extent_commit(), which used to stall the commit for as
+ * long as the device took to process the discards.  Instead, the freed ranges
+ * are recorded in the discard_pending tree of their block group, and a
+ * delayed work item trims them in the background one request at a time.
+ * Requests are at most max_discard_size bytes long and paced by iops_limit
+ * and kbps_limit, see /sys/fs/btrfs/<UUID>/discard/.
+ *
+ * Pending ranges are only ever discarded through the free space cache (see
+ * btrfs_trim_block_group()), which takes the space out of the allocator's
+ * reach while the discard is in flight and skips whatever has been allocated
+ * again in the meantime.
+ *
+ * Block groups with pending work sit on one of the discard_ctl lists, which
+ * are served in order:
+ *
+ * BTRFS_DISCARD_INDEX_UNUSED: empty block groups btrfs_delete_unused_bgs()
+ *	wants to remove.  They are trimmed as a whole and then handed back to
+ *	it, instead of being discarded during the commit removing them.
+ * BTRFS_DISCARD_INDEX_LARGE: block groups that may have a pending range of
+ *	at least BTRFS_ASYNC_DISCARD_LARGE_FILTER bytes.  Only such ranges are
+ *	issued from here, so large contiguous frees are discarded first.
+ * BTRFS_DISCARD_INDEX_SMALL: everything else.  Ranges below
+ *	BTRFS_ASYNC_DISCARD_MIN_FILTER are dropped, they are not worth a
+ *	request of their own and are left to fstrim.
+ */
+
+static struct btrfs_fs_info *
+discard_ctl_to_fs_info(struct btrfs_discard_ctl *discard_ctl)
+{
+	return container_of(discard_ctl, struct btrfs_fs_info, discard_ctl);
+}
+
+static bool btrfs_run_discard_work(struct btrfs_discard_ctl *discard_ctl)
+{
+	struct btrfs_fs_info *fs_info = discard_ctl_to_fs_info(discard_ctl);
+
+	return btrfs_test_opt(fs_info, DISCARD_ASYNC) &&
+	       !sb_rdonly(fs_info->sb) &&
+	       !test_bit(BTRFS_FS_CLOSING_START, &fs_info->flags);
+}
+
+/* Called with discard_ctl->lock held. */
+static void add_to_discard_list(struct btrfs_discard_ctl *discard_ctl,
+				struct btrfs_block_group_cache *block_group,
+				int index)
+{
+	lockdep_assert_held(&discard_ctl->lock);
+
+	if (list_empty(&block_group->discard_list))
+		btrfs_get_block_group(block_group);
+	block_group->discard_index = index;
+	list_move_tail(&block_group->discard_list,
+		       &discard_ctl->discard_list[index]);
+}
+
+/* Called with discard_ctl->lock held. */
+static void remove_from_discard_list(struct btrfs_discard_ctl *discard_ctl,
+				     struct btrfs_block_group_cache *block_group)
+{
+	lockdep_assert_held(&discard_ctl->lock);
+
+	if (list_empty(&block_group->discard_list))
+		return;
+	list_del_init(&block_group->discard_list);
+	btrfs_put_block_group(block_group);
+}
+
+/*
+ * Pick the block group to work on next and take a reference on it.  Returns
+ * NULL if there is nothing to discard.
+ */
+static struct btrfs_block_group_cache *
+peek_discard_list(struct btrfs_discard_ctl *discard_ctl, int *index)
+{
+	struct btrfs_block_group_cache *block_group = NULL;
+	int i;
+
+	spin_lock(&discard_ctl->lock);
+	for (i = 0; i < BTRFS_NR_DISCARD_LISTS; i++) {
+		if (list_empty(&discard_ctl->discard_list[i]))
+			continue;
+		block_group = list_first_entry(&discard_ctl->discard_list[i],
+					       struct btrfs_block_group_cache,
+					       discard_list);
+		btrfs_get_block_group(block_group);
+		*index = i;
+		break;
+	}
+	spin_unlock(&discard_ctl->lock);
+
+	return block_group;
+}
+
+static u64 discard_delay_ms(struct btrfs_discard_ctl *discard_ctl, u64 bytes)
+{
+	u32 iops_limit = READ_ONCE(discard_ctl->iops_limit);
+	u32 kbps_limit = READ_ONCE(discard_ctl->kbps_limit);
+	u64 delay = 0;
+
+	if (iops_limit)
+		delay = MSEC_PER_SEC / iops_limit;
+	if (kbps_limit && bytes)
+		delay = max(delay, div64_u64(bytes * MSEC_PER_SEC,
+					     (u64)kbps_limit * SZ_1K));
+	return delay;
+}
+
+static void queue_discard_work(struct btrfs_discard_ctl *discard_ctl,
+			       u64 delay_ms)
+{
+	queue_delayed_work(system_unbound_wq, &discard_ctl->work,
+			   msecs_to_jiffies(delay_ms));
+}
+
+/**
+ * btrfs_discard_schedule_work - make sure the discard work will run
+ * @discard_ctl: discard control
+ * @now: run it right away instead of after the iops_limit delay
+ */
+void btrfs_discard_schedule_work(struct btrfs_discard_ctl *discard_ctl,
+				 bool now)
+{
+	if (!btrfs_run_discard_work(discard_ctl))
+		return;
+
+	queue_discard_work(discard_ctl,
+			   now ? 0 : discard_delay_ms(discard_ctl, 0));
+}
+
+/**
+ * btrfs_discard_queue_range - queue a freed range for asynchronous discard
+ * @block_group: block group the range belongs to
+ * @start: logical start of the range
+ * @len: length of the range
+ *
+ * The range must have been returned to the free space cache already.
+ */
+void btrfs_discard_queue_range(struct btrfs_block_group_cache *block_group,
+			       u64 start, u64 len)
+{
+	struct btrfs_fs_info *fs_info = block_group->fs_info;
+	struct btrfs_discard_ctl *discard_ctl = &fs_info->discard_ctl;
+	struct extent_io_tree *pending = &block_group->discard_pending;
+	u64 found_start;
+	u64 found_end;
+	int index = BTRFS_DISCARD_INDEX_SMALL;
+
+	if (!btrfs_run_discard_work(discard_ctl) || block_group->removed)
+		return;
+
+	if (set_extent_dirty(pending, start, start + len - 1, GFP_NOFS))
+		return;
+
+	/* Classify by the contiguous range this one got merged into. */
+	if (!find_first_extent_bit(pending, start, &found_start, &found_end,
+				   EXTENT_DIRTY, NULL) &&
+	    found_end + 1 - found_start >= BTRFS_ASYNC_DISCARD_LARGE_FILTER)
+		index = BTRFS_DISCARD_INDEX_LARGE;
+
+	spin_lock(&discard_ctl->lock);
+	block_group->discard_trimmed = false;
+	if (list_empty(&block_group->discard_list) ||
+	    (block_group->discard_index == BTRFS_DISCARD_INDEX_SMALL &&
+	     index == BTRFS_DISCARD_INDEX_LARGE))
+		add_to_discard_list(discard_ctl, block_group, index);
+	spin_unlock(&discard_ctl->lock);
+
+	btrfs_discard_schedule_work(discard_ctl, false);
+}
+
+/**
+ * btrfs_discard_queue_unused - trim an unused block group before removal
+ * @block_group: block group btrfs_delete_unused_bgs() wants to remove
+ *
+ * Returns true if the block group has been queued, in which case the caller
+ * must leave it alone.  It is put back on the unused list once it has been
+ * trimmed.  Returns false if it can be removed right away.
+ */
+bool btrfs_discard_queue_unused(struct btrfs_block_group_cache *block_group)
+{
+	struct btrfs_discard_ctl *discard_ctl = &block_group->fs_info->discard_ctl;
+
+	if (!btrfs_run_discard_work(discard_ctl))
+		return false;
+
+	spin_lock(&discard_ctl->lock);
+	if (block_group->discard_trimmed) {
+		spin_unlock(&discard_ctl->lock);
+		return false;
+	}
+	if (list_empty(&block_group->discard_list) ||
+	    block_group->discard_index != BTRFS_DISCARD_INDEX_UNUSED) {
+		block_group->discard_cursor = block_group->key.objectid;
+		add_to_discard_list(discard_ctl, block_group,
+				    BTRFS_DISCARD_INDEX_UNUSED);
+	}
+	spin_unlock(&discard_ctl->lock);
+
+	btrfs_discard_schedule_work(discard_ctl, true);
+	return true;
+}
+
+/**
+ * btrfs_discard_cancel_work - forget about a block group
+ * @discard_ctl: discard control
+ * @block_group: block group being removed
+ *
+ * A discard already running on it finishes, but it is not requeued.
+ */
+void btrfs_discard_cancel_work(struct btrfs_discard_ctl *discard_ctl,
+			       struct btrfs_block_group_cache *block_group)
+{
+	spin_lock(&discard_ctl->lock);
+	remove_from_discard_list(discard_ctl, block_group);
+	spin_unlock(&discard_ctl->lock);
+}
+
+/*
+ * Find the next range to discard on list @index, see the comment at the top.
+ * @end is inclusive.
+ */
+static bool find_discard_range(struct btrfs_block_group_cache *block_group,
+			       int index, u64 *start, u64 *end)
+{
+	struct extent_io_tree *pending = &block_group->discard_pending;
+	u64 cur = block_group->key.objectid;
+	u64 len;
+
+	while (!find_first_extent_bit(pending, cur, start, end, EXTENT_DIRTY,
+				      NULL)) {
+		len = *end + 1 - *start;
+		if (index == BTRFS_DISCARD_INDEX_LARGE) {
+			if (len >= BTRFS_ASYNC_DISCARD_LARGE_FILTER)
+				return true;
+		} else {
+			if (len >= BTRFS_ASYNC_DISCARD_MIN_FILTER)
+				return true;
+			clear_extent_bits(pending, *start, *end, EXTENT_DIRTY);
+		}
+		cur = *end + 1;
+		cond_resched();
+	}
+
+	return false;
+}
+
+/*
+ * Requeue a block group after working on it: rotate it to the tail of its
+ * list, move it to the small list once it has no large range left, or drop
+ * it if it has nothing pending anymore.
+ */
+static void requeue_block_group(struct btrfs_discard_ctl *discard_ctl,
+				struct btrfs_block_group_cache *block_group,
+				int index, bool found)
+{
+	spin_lock(&discard_ctl->lock);
+	if (list_empty(&block_group->discard_list) ||
+	    block_group->discard_index != index)
+		goto out;
+
+	if (!READ_ONCE(block_group->discard_pending.dirty_bytes))
+		remove_from_discard_list(discard_ctl, block_group);
+	else if (!found && index == BTRFS_DISCARD_INDEX_LARGE)
+		add_to_discard_list(discard_ctl, block_group,
+				    BTRFS_DISCARD_INDEX_SMALL);
+	else
+		add_to_discard_list(discard_ctl, block_group, index);
+out:
+	spin_unlock(&discard_ctl->lock);
+}
+
+/* An unused block group has been trimmed, give it back to the cleaner. */
+static void finish_unused(struct btrfs_discard_ctl *discard_ctl,
+			  struct btrfs_block_group_cache *block_group)
+{
+	bool trimmed = false;
+
+	spin_lock(&discard_ctl->lock);
+	if (list_empty(&block_group->discard_list) ||
+	    block_group->discard_index != BTRFS_DISCARD_INDEX_UNUSED) {
+		spin_unlock(&discard_ctl->lock);
+		return;
+	}
+
+	/* Something was freed behind the cursor, it was in use after all. */
+	if (READ_ONCE(block_group->discard_pending.dirty_bytes)) {
+		add_to_discard_list(discard_ctl, block_group,
+				    BTRFS_DISCARD_INDEX_SMALL);
+	} else {
+		block_group->discard_trimmed = true;
+		remove_from_discard_list(discard_ctl, block_group);
+		trimmed = true;
+	}
+	spin_unlock(&discard_ctl->lock);
+
+	if (trimmed)
+		btrfs_mark_bg_unused(block_group);
+}
+
+static void btrfs_discard_workfn(struct work_struct *work)
+{
+	struct btrfs_discard_ctl *discard_ctl;
+	struct btrfs_block_group_cache *block_group;
+	struct extent_io_tree *pending;
+	u64 start;
+	u64 end;
+	u64 bg_end;
+	u64 max_size;
+	u64 trimmed = 0;
+	bool issued = false;
+	bool found;
+	bool more;
+	int index;
+	int i;
+
+	discard_ctl = container_of(work, struct btrfs_discard_ctl, work.work);
+
+	if (!btrfs_run_discard_work(discard_ctl))
+		return;
+
+	block_group = peek_discard_list(discard_ctl, &index);
+	if (!block_group)
+		return;
+
+	pending = &block_group->discard_pending;
+	bg_end = block_group->key.objectid + block_group->key.offset;
+	max_size = READ_ONCE(discard_ctl->max_discard_size);
+
+	/* Trimming goes through the free space cache, it has to be loaded. */
+	if (btrfs_cache_block_group(block_group)) {
+		if (index == BTRFS_DISCARD_INDEX_UNUSED)
+			block_group->discard_cursor = bg_end;
+		else
+			clear_extent_bits(pending, block_group->key.objectid,
+					  bg_end - 1, EXTENT_DIRTY);
+		found = false;
+		goto requeue;
+	}
+
+	if (index == BTRFS_DISCARD_INDEX_UNUSED) {
+		start = block_group->discard_cursor;
+		end = min(bg_end, start + max_size);
+		clear_extent_bits(pending, start, end - 1, EXTENT_DIRTY);
+		btrfs_trim_block_group(block_group, &trimmed, start, end, 0);
+		block_group->discard_cursor = end;
+		issued = true;
+		found = true;
+		goto requeue;
+	}
+
+	found = find_discard_range(block_group, index, &start, &end);
+	if (found) {
+		end = min(end + 1, start + max_size);
+		clear_extent_bits(pending, start, end - 1, EXTENT_DIRTY);
+		btrfs_trim_block_group(block_group, &trimmed, start, end, 0);
+		issued = true;
+	}
+
+requeue:
+	if (index == BTRFS_DISCARD_INDEX_UNUSED) {
+		if (block_group->discard_cursor >= bg_end)
+			finish_unused(discard_ctl, block_group);
+	} else {
+		requeue_block_group(discard_ctl, block_group, index, found);
+	}
+	btrfs_put_block_group(block_group);
+
+	spin_lock(&discard_ctl->lock);
+	discard_ctl->discarded_bytes += trimmed;
+	more = false;
+	for (i = 0; i < BTRFS_NR_DISCARD_LISTS; i++)
+		more |= !list_empty(&discard_ctl->discard_list[i]);
+	spin_unlock(&discard_ctl->lock);
+
+	if (more && btrfs_run_discard_work(discard_ctl))
+		queue_discard_work(discard_ctl, issued ?
+				   discard_delay_ms(discard_ctl, trimmed) : 0);
+}
+
+/**
+ * btrfs_discard_pending_bytes - number of bytes waiting to be discarded
+ * @discard_ctl: discard control
+ */
+u64 btrfs_discard_pending_bytes(struct btrfs_discard_ctl *discard_ctl)
+{
+	struct btrfs_block_group_cache *block_group;
+	u64 bytes = 0;
+	int i;
+
+	spin_lock(&discard_ctl->lock);
+	for (i = 0; i < BTRFS_NR_DISCARD_LISTS; i++) {
+		list_for_each_entry(block_group, &discard_ctl->discard_list[i],
+				    discard_list) {
+			if (i == BTRFS_DISCARD_INDEX_UNUSED)
+				bytes += block_group->key.objectid +
+					 block_group->key.offset -
+					 block_group->discard_cursor;
+			else
+				bytes += READ_ONCE(block_group->discard_pending.dirty_bytes);
+		}
+	}
+	spin_unlock(&discard_ctl->lock);
+
+	return bytes;
+}
+
+/* Kick the discard work after a remount that (re)enabled it. */
+void btrfs_discard_resume(struct btrfs_fs_info *fs_info)
+{
+	btrfs_discard_schedule_work(&fs_info->discard_ctl, true);
+}
+
+void btrfs_discard_init(struct btrfs_fs_info *fs_info)
+{
+	struct btrfs_discard_ctl *discard_ctl = &fs_info->discard_ctl;
+	int i;
+
+	spin_lock_init(&discard_ctl->lock);
+	INIT_DELAYED_WORK(&discard_ctl->work, btrfs_discard_workfn);
+	for (i = 0; i < BTRFS_NR_DISCARD_LISTS; i++)
+		INIT_LIST_HEAD(&discard_ctl->discard_list[i]);
+	discard_ctl->discarded_bytes = 0;
+	discard_ctl->iops_limit = BTRFS_DISCARD_DEFAULT_IOPS;
+	discard_ctl->kbps_limit = 0;
+	discard_ctl->max_discard_size = BTRFS_DISCARD_DEFAULT_MAX_SIZE;
+}
+
+/**
+ * btrfs_discard_cleanup - stop the discard work and drop what is pending
+ * @fs_info: filesystem
+ *
+ * Called on unmount and when a remount turns asynchronous discard off.
+ * Unused block groups waiting to be trimmed go back to the cleaner.
+ */
+void btrfs_discard_cleanup(struct btrfs_fs_info *fs_info)
+{
+	struct btrfs_discard_ctl *discard_ctl = &fs_info->discard_ctl;
+	struct btrfs_block_group_cache *block_group;
+	LIST_HEAD(unused);
+	int i;
+
+	cancel_delayed_work_sync(&discard_ctl->work);
+
+	spin_lock(&discard_ctl->lock);
+	list_splice_init(&discard_ctl->discard_list[BTRFS_DISCARD_INDEX_UNUSED],
+			 &unused);
+	for (i = 0; i < BTRFS_NR_DISCARD_LISTS; i++) {
+		while (!list_empty(&discard_ctl->discard_list[i])) {
+			block_group = list_first_entry(
+					&discard_ctl->discard_list[i],
+					struct btrfs_block_group_cache,
+					discard_list);
+			remove_from_discard_list(discard_ctl, block_group);
+		}
+	}
+	spin_unlock(&discard_ctl->lock);
+
+	while (!list_empty(&unused)) {
+		block_group = list_first_entry(&unused,
+					       struct btrfs_block_group_cache,
+					       discard_list);
+		list_del_init(&block_group->discard_list);
+		btrfs_mark_bg_unused(block_group);
+		btrfs_put_block_group(block_group);
+	}
+}
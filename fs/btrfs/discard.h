@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#ifndef BTRFS_DISCARD_H
+#define BTRFS_DISCARD_H
+
+/* Default tunables of asynchronous discard */
+#define BTRFS_DISCARD_DEFAULT_IOPS		10
+#define BTRFS_DISCARD_DEFAULT_MAX_SIZE		SZ_64M
+
+/*
+ * Pending ranges of at least this size are discarded before any smaller
+ * ones, and ranges below the minimum are not discarded in the background.
+ */
+#define BTRFS_ASYNC_DISCARD_LARGE_FILTER	SZ_1M
+#define BTRFS_ASYNC_DISCARD_MIN_FILTER		SZ_32K
+
+struct btrfs_fs_info;
+struct btrfs_discard_ctl;
+struct btrfs_block_group_cache;
+
+void btrfs_discard_queue_range(struct btrfs_block_group_cache *block_group,
+			       u64 start, u64 len);
+bool btrfs_discard_queue_unused(struct btrfs_block_group_cache *block_group);
+void btrfs_discard_cancel_work(struct btrfs_discard_ctl *discard_ctl,
+			       struct btrfs_block_group_cache *block_group);
+void btrfs_discard_schedule_work(struct btrfs_discard_ctl *discard_ctl,
+				 bool now);
+u64 btrfs_discard_pending_bytes(struct btrfs_discard_ctl *discard_ctl);
+void btrfs_discard_resume(struct btrfs_fs_info *fs_info);
+void btrfs_discard_init(struct btrfs_fs_info *fs_info);
+void btrfs_discard_cleanup(struct btrfs_fs_info *fs_info);
+
+#endif
@@ -28,6 +28,7 @@
 #include "sysfs.h"
 #include "qgroup.h"
 #include "ref-verify.h"
+#include "discard.h"
 
 #undef SCRAMBLE_DELAYED_REFS
 
@@ -115,6 +116,9 @@ void btrfs_put_block_group(struct btrfs_block_group_cache *cache)
 		 * No better way to resolve, but only to warn.
 		 */
 		WARN_ON(!RB_EMPTY_ROOT(&cache->full_stripe_locks_root.root));
+		/* We may be called under a spinlock, e.g. unused_bgs_lock */
+		__clear_extent_bit(&cache->discard_pending, 0, (u64)-1,
+				   EXTENT_DIRTY, 0, 0, NULL, GFP_ATOMIC, NULL);
 		kfree(cache->free_space_ctl);
 		kfree(cache);
 	}
@@ -6563,8 +6567,12 @@ static int unpin_extent_range(struct btrfs_fs_info *fs_info,
 
 		if (start < cache->last_byte_to_unpin) {
 			len = min(len, cache->last_byte_to_unpin - start);
-			if (return_free_space)
+			if (return_free_space) {
 				btrfs_add_free_space(cache, start, len);
+				if (btrfs_test_opt(fs_info, DISCARD_ASYNC))
+					btrfs_discard_queue_range(cache, start,
+								  len);
+			}
 		}
 
 		start += len;
@@ -6655,7 +6663,7 @@ int btrfs_finish_extent_commit(struct btrfs_trans_handle *trans)
 			break;
 		}
 
-		if (btrfs_test_opt(fs_info, DISCARD))
+		if (btrfs_test_opt(fs_info, DISCARD_SYNC))
 			ret = btrfs_discard_extent(fs_info, start,
 						   end + 1 - start, NULL);
 
@@ -7167,6 +7175,23 @@ wait_block_group_cache_done(struct btrfs_block_group_cache *cache)
 	return ret;
 }
 
+/*
+ * Load the free space of @cache and wait until it is done, for users that
+ * need all of it in the free space cache, like the discard work.
+ */
+int btrfs_cache_block_group(struct btrfs_block_group_cache *cache)
+{
+	int ret;
+
+	if (block_group_cache_done(cache))
+		return (cache->cached == BTRFS_CACHE_ERROR) ? -EIO : 0;
+
+	ret = cache_block_group(cache, 0);
+	if (ret)
+		return ret;
+	return wait_block_group_cache_done(cache);
+}
+
 enum btrfs_loop_type {
 	LOOP_CACHING_NOWAIT = 0,
 	LOOP_CACHING_WAIT = 1,
@@ -7877,9 +7902,11 @@ static int __btrfs_free_reserved_extent(struct btrfs_fs_info *fs_info,
 	if (pin)
 		pin_down_extent(fs_info, cache, start, len, 1);
 	else {
-		if (btrfs_test_opt(fs_info, DISCARD))
+		if (btrfs_test_opt(fs_info, DISCARD_SYNC))
 			ret = btrfs_discard_extent(fs_info, start, len, NULL);
 		btrfs_add_free_space(cache, start, len);
+		if (btrfs_test_opt(fs_info, DISCARD_ASYNC))
+			btrfs_discard_queue_range(cache, start, len);
 		btrfs_free_reserved_bytes(cache, len, delalloc);
 		trace_btrfs_reserved_extent_free(fs_info, start, len);
 	}
@@ -8133,7 +8160,8 @@ int btrfs_alloc_logged_file_extent(struct btrfs_trans_handle *trans,
 
 static struct extent_buffer *
 btrfs_init_new_buffer(struct btrfs_trans_handle *trans, struct btrfs_root *root,
-		      u64 bytenr, int level, u64 owner)
+		      u64 bytenr, int level, u64 owner,
+		      enum btrfs_lock_nesting nest)
 {
 	struct btrfs_fs_info *fs_info = root->fs_info;
 	struct extent_buffer *buf;
@@ -8156,7 +8184,7 @@ btrfs_init_new_buffer(struct btrfs_trans_handle *trans, struct btrfs_root *root,
 	}
 
 	btrfs_set_buffer_lockdep_class(root->root_key.objectid, buf, level);
-	btrfs_tree_lock(buf);
+	__btrfs_tree_lock(buf, nest);
 	clean_tree_block(fs_info, buf);
 	clear_bit(EXTENT_BUFFER_STALE, &buf->bflags);
 
@@ -8264,7 +8292,8 @@ struct extent_buffer *btrfs_alloc_tree_block(struct btrfs_trans_handle *trans,
 					     u64 parent, u64 root_objectid,
 					     const struct btrfs_disk_key *key,
 					     int level, u64 hint,
-					     u64 empty_size)
+					     u64 empty_size,
+					     enum btrfs_lock_nesting nest)
 {
 	struct btrfs_fs_info *fs_info = root->fs_info;
 	struct btrfs_key ins;
@@ -8279,7 +8308,7 @@ struct extent_buffer *btrfs_alloc_tree_block(struct btrfs_trans_handle *trans,
 #ifdef CONFIG_BTRFS_FS_RUN_SANITY_TESTS
 	if (btrfs_is_testing(fs_info)) {
 		buf = btrfs_init_new_buffer(trans, root, root->alloc_bytenr,
-					    level, root_objectid);
+					    level, root_objectid, nest);
 		if (!IS_ERR(buf))
 			root->alloc_bytenr += blocksize;
 		return buf;
@@ -8296,7 +8325,7 @@ struct extent_buffer *btrfs_alloc_tree_block(struct btrfs_trans_handle *trans,
 		goto out_unuse;
 
 	buf = btrfs_init_new_buffer(trans, root, ins.objectid, level,
-				    root_objectid);
+				    root_objectid, nest);
 	if (IS_ERR(buf)) {
 		ret = PTR_ERR(buf);
 		goto out_free_reserved;
@@ -9888,6 +9917,8 @@ btrfs_create_block_group_cache(struct btrfs_fs_info *fs_info,
 	atomic_set(&cache->trimming, 0);
 	mutex_init(&cache->free_space_lock);
 	btrfs_init_full_stripe_locks_tree(&cache->full_stripe_locks_root);
+	extent_io_tree_init(&cache->discard_pending, NULL);
+	INIT_LIST_HEAD(&cache->discard_list);
 
 	return cache;
 }
@@ -10274,6 +10305,7 @@ int btrfs_remove_block_group(struct btrfs_trans_handle *trans,
 	BUG_ON(!block_group->ro);
 
 	trace_btrfs_remove_block_group(block_group);
+	btrfs_discard_cancel_work(&fs_info->discard_ctl, block_group);
 	/*
 	 * Free the reserved super bytes from this block group before
 	 * remove it.
@@ -10640,6 +10672,15 @@ void btrfs_delete_unused_bgs(struct btrfs_fs_info *fs_info)
 		}
 		spin_unlock(&block_group->lock);
 
+		/*
+		 * With async discard, trim the block group in the background
+		 * first, it will be put back on the unused list when done.
+		 */
+		if (btrfs_discard_queue_unused(block_group)) {
+			up_write(&space_info->groups_sem);
+			goto next;
+		}
+
 		/* We don't want to force the issue, only flip if it's ok. */
 		ret = inc_block_group_ro(block_group, 0);
 		up_write(&space_info->groups_sem);
@@ -10709,7 +10750,7 @@ void btrfs_delete_unused_bgs(struct btrfs_fs_info *fs_info)
 		spin_unlock(&space_info->lock);
 
 		/* DISCARD can flip during remount */
-		trimming = btrfs_test_opt(fs_info, DISCARD);
+		trimming = btrfs_test_opt(fs_info, DISCARD_SYNC);
 
 		/* Implicit trim during transaction commit. */
 		if (trimming)
@@ -11,27 +11,79 @@
 #define BTRFS_WRITE_LOCK_BLOCKING 3
 #define BTRFS_READ_LOCK_BLOCKING 4
 
+/*
+ * Lockdep subclasses for tree blocks of the same level that are locked at the
+ * same time.  Locking a child while holding its parent needs no annotation,
+ * the lockdep class of a tree block already depends on its level, see
+ * btrfs_set_buffer_lockdep_class().
+ */
+enum btrfs_lock_nesting {
+	BTRFS_NESTING_NORMAL,
+
+	/* The new copy of a block being COWed, while holding the original */
+	BTRFS_NESTING_COW,
+
+	/* The left and right siblings of a block, while holding it */
+	BTRFS_NESTING_LEFT,
+	BTRFS_NESTING_RIGHT,
+
+	/* The new copy of a left or right sibling being COWed */
+	BTRFS_NESTING_LEFT_COW,
+	BTRFS_NESTING_RIGHT_COW,
+
+	/* The new block allocated when splitting a node or a leaf */
+	BTRFS_NESTING_SPLIT,
+
+	/* The new root allocated when the tree grows a level */
+	BTRFS_NESTING_NEW_ROOT,
+
+	/* Lockdep only supports MAX_LOCKDEP_SUBCLASSES (8) subclasses */
+	BTRFS_NESTING_MAX,
+};
+
+struct extent_buffer;
+
+void __btrfs_tree_lock(struct extent_buffer *eb, enum btrfs_lock_nesting nest);
 void btrfs_tree_lock(struct extent_buffer *eb);
 void btrfs_tree_unlock(struct extent_buffer *eb);
 
+void __btrfs_tree_read_lock(struct extent_buffer *eb,
+			    enum btrfs_lock_nesting nest);
 void btrfs_tree_read_lock(struct extent_buffer *eb);
 void btrfs_tree_read_unlock(struct extent_buffer *eb);
-void btrfs_tree_read_unlock_blocking(struct extent_buffer *eb);
-void btrfs_set_lock_blocking_rw(struct extent_buffer *eb, int rw);
-void btrfs_clear_lock_blocking_rw(struct extent_buffer *eb, int rw);
 void btrfs_assert_tree_locked(struct extent_buffer *eb);
 int btrfs_try_tree_read_lock(struct extent_buffer *eb);
 int btrfs_try_tree_write_lock(struct extent_buffer *eb);
-int btrfs_tree_read_lock_atomic(struct extent_buffer *eb);
 
+/*
+ * Tree locks used to be spinning locks that had to be switched to blocking
+ * mode before sleeping.  They are rw_semaphores now, so the blocking variants
+ * are the same as the plain ones and switching is a no-op.
+ */
+static inline void btrfs_tree_read_unlock_blocking(struct extent_buffer *eb)
+{
+	btrfs_tree_read_unlock(eb);
+}
+
+static inline int btrfs_tree_read_lock_atomic(struct extent_buffer *eb)
+{
+	return btrfs_try_tree_read_lock(eb);
+}
+
+static inline void btrfs_set_lock_blocking_rw(struct extent_buffer *eb, int rw)
+{
+}
+
+static inline void btrfs_clear_lock_blocking_rw(struct extent_buffer *eb,
+						int rw)
+{
+}
 
 static inline void btrfs_tree_unlock_rw(struct extent_buffer *eb, int rw)
 {
 	if (rw == BTRFS_WRITE_LOCK || rw == BTRFS_WRITE_LOCK_BLOCKING)
 		btrfs_tree_unlock(eb);
-	else if (rw == BTRFS_READ_LOCK_BLOCKING)
-		btrfs_tree_read_unlock_blocking(eb);
-	else if (rw == BTRFS_READ_LOCK)
+	else if (rw == BTRFS_READ_LOCK_BLOCKING || rw == BTRFS_READ_LOCK)
 		btrfs_tree_read_unlock(eb);
 	else
 		BUG();
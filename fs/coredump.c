@@ -40,6 +40,8 @@
 #include <linux/fs.h>
 #include <linux/path.h>
 #include <linux/timekeeping.h>
+#include <linux/vmalloc.h>
+#include <linux/crypto.h>
 
 #include <linux/uaccess.h>
 #include <asm/mmu_context.h>
@@ -53,6 +55,7 @@
 
 int core_uses_pid;
 unsigned int core_pipe_limit;
+int core_compress;
 char core_pattern[CORENAME_MAX_SIZE] = "core";
 static int core_name_size = CORENAME_MAX_SIZE;
 
@@ -536,6 +539,90 @@ static int umh_pipe_setup(struct subprocess_info *info, struct cred *new)
 	return err;
 }
 
+/*
+ * The dump is written in CORE_DUMP_BUF_SIZE chunks rather than page by page,
+ * and with kernel.core_compress set each chunk is compressed into a zstd
+ * frame of its own.  Concatenated zstd frames form a valid zstd stream, so
+ * the resulting file (or pipe output) can be fed to "zstd -d" as is.
+ */
+#define CORE_DUMP_BUF_SIZE	(1024 * 1024)
+/* worst case zstd output size for one chunk */
+#define CORE_DUMP_COMP_SIZE	(CORE_DUMP_BUF_SIZE + CORE_DUMP_BUF_SIZE / 128 + \
+				 PAGE_SIZE)
+
+static void dump_buf_init(struct coredump_params *cprm)
+{
+	cprm->buf = vmalloc(CORE_DUMP_BUF_SIZE);
+	if (!cprm->buf || !core_compress)
+		return;
+
+	cprm->comp = crypto_alloc_comp("zstd", 0, 0);
+	if (IS_ERR(cprm->comp)) {
+		cprm->comp = NULL;
+		goto fail;
+	}
+	cprm->comp_buf = vmalloc(CORE_DUMP_COMP_SIZE);
+	if (!cprm->comp_buf) {
+		crypto_free_comp(cprm->comp);
+		cprm->comp = NULL;
+		goto fail;
+	}
+	return;
+fail:
+	pr_warn_ratelimited("Pid %d(%s): cannot compress core dump, writing it uncompressed\n",
+			    task_tgid_vnr(current), current->comm);
+}
+
+static void dump_buf_free(struct coredump_params *cprm)
+{
+	if (cprm->comp)
+		crypto_free_comp(cprm->comp);
+	vfree(cprm->comp_buf);
+	vfree(cprm->buf);
+}
+
+static int __dump_write(struct coredump_params *cprm, const void *addr,
+			size_t nr)
+{
+	struct file *file = cprm->file;
+	loff_t pos = file->f_pos;
+	ssize_t n;
+
+	while (nr) {
+		if (dump_interrupted())
+			return 0;
+		n = __kernel_write(file, addr, nr, &pos);
+		if (n <= 0)
+			return 0;
+		file->f_pos = pos;
+		addr += n;
+		nr -= n;
+	}
+	return 1;
+}
+
+/* Write out (and compress) whatever has been batched up in cprm->buf. */
+static int dump_flush(struct coredump_params *cprm)
+{
+	const void *data = cprm->buf;
+	unsigned int len = cprm->buf_len;
+
+	if (!len)
+		return 1;
+	cprm->buf_len = 0;
+
+	if (cprm->comp) {
+		unsigned int dlen = CORE_DUMP_COMP_SIZE;
+
+		if (crypto_comp_compress(cprm->comp, data, len,
+					 cprm->comp_buf, &dlen))
+			return 0;
+		data = cprm->comp_buf;
+		len = dlen;
+	}
+	return __dump_write(cprm, data, len);
+}
+
 void do_coredump(const kernel_siginfo_t *siginfo)
 {
 	struct core_state core_state;
@@ -753,13 +840,17 @@ void do_coredump(const kernel_siginfo_t *siginfo)
 	if (displaced)
 		put_files_struct(displaced);
 	if (!dump_interrupted()) {
+		dump_buf_init(&cprm);
 		file_start_write(cprm.file);
 		core_dumped = binfmt->core_dump(&cprm);
+		if (core_dumped && !dump_flush(&cprm))
+			core_dumped = 0;
 		file_end_write(cprm.file);
 	}
 	if (ispipe && core_pipe_limit)
 		wait_for_dump_helpers(cprm.file);
 close_fail:
+	dump_buf_free(&cprm);
 	if (cprm.file)
 		filp_close(cprm.file, NULL);
 fail_dropcount:
@@ -782,22 +873,32 @@ void do_coredump(const kernel_siginfo_t *siginfo)
  */
 int dump_emit(struct coredump_params *cprm, const void *addr, int nr)
 {
-	struct file *file = cprm->file;
-	loff_t pos = file->f_pos;
-	ssize_t n;
 	if (cprm->written + nr > cprm->limit)
 		return 0;
-	while (nr) {
-		if (dump_interrupted())
+
+	if (!cprm->buf) {
+		if (!__dump_write(cprm, addr, nr))
 			return 0;
-		n = __kernel_write(file, addr, nr, &pos);
-		if (n <= 0)
+	} else {
+		size_t left = nr;
+
+		if (dump_interrupted())
 			return 0;
-		file->f_pos = pos;
-		cprm->written += n;
-		cprm->pos += n;
-		nr -= n;
+		while (left) {
+			size_t n = min_t(size_t, left,
+					 CORE_DUMP_BUF_SIZE - cprm->buf_len);
+
+			memcpy(cprm->buf + cprm->buf_len, addr, n);
+			cprm->buf_len += n;
+			addr += n;
+			left -= n;
+			if (cprm->buf_len == CORE_DUMP_BUF_SIZE &&
+			    !dump_flush(cprm))
+				return 0;
+		}
 	}
+	cprm->written += nr;
+	cprm->pos += nr;
 	return 1;
 }
 EXPORT_SYMBOL(dump_emit);
@@ -806,8 +907,10 @@ int dump_skip(struct coredump_params *cprm, size_t nr)
 {
 	static char zeroes[PAGE_SIZE];
 	struct file *file = cprm->file;
-	if (file->f_op->llseek && file->f_op->llseek != no_llseek) {
-		if (dump_interrupted() ||
+	/* a compressed stream has no holes, the zeroes go to the compressor */
+	if (!cprm->comp &&
+	    file->f_op->llseek && file->f_op->llseek != no_llseek) {
+		if (dump_interrupted() || !dump_flush(cprm) ||
 		    file->f_op->llseek(file, nr, SEEK_CUR) < 0)
 			return 0;
 		cprm->pos += nr;
@@ -842,6 +945,9 @@ void dump_truncate(struct coredump_params *cprm)
 	struct file *file = cprm->file;
 	loff_t offset;
 
+	if (cprm->comp || !dump_flush(cprm))
+		return;
+
 	if (file->f_op->llseek && file->f_op->llseek != no_llseek) {
 		offset = file->f_op->llseek(file, 0, SEEK_CUR);
 		if (i_size_read(file->f_mapping->host) < offset)
@@ -62,6 +62,12 @@ struct fscrypt_info {
 	struct crypto_skcipher *ci_ctfm;
 	struct crypto_cipher *ci_essiv_tfm;
 	u8 ci_master_key[FS_KEY_DESCRIPTOR_SIZE];
+#ifdef CONFIG_FS_ENCRYPTION_INLINE_CRYPT
+	/* contents are en/decrypted by the block layer with ci_blk_key */
+	bool ci_inlinecrypt;
+	struct blk_crypto_key *ci_blk_key;
+	struct request_queue *ci_blk_queue;
+#endif
 };
 
 typedef enum {
@@ -117,4 +123,30 @@ extern bool fscrypt_fname_encrypted_size(const struct inode *inode,
 /* keyinfo.c */
 extern void __exit fscrypt_essiv_cleanup(void);
 
+/* inline_crypt.c */
+#ifdef CONFIG_FS_ENCRYPTION_INLINE_CRYPT
+extern void fscrypt_select_encryption_impl(struct fscrypt_info *ci,
+					   const struct inode *inode);
+extern int fscrypt_prepare_inline_crypt_key(struct fscrypt_info *ci,
+					    const struct inode *inode,
+					    const u8 *raw_key);
+extern void fscrypt_free_inline_crypt_key(struct fscrypt_info *ci);
+#else
+static inline void fscrypt_select_encryption_impl(struct fscrypt_info *ci,
+						  const struct inode *inode)
+{
+}
+
+static inline int fscrypt_prepare_inline_crypt_key(struct fscrypt_info *ci,
+						   const struct inode *inode,
+						   const u8 *raw_key)
+{
+	return 0;
+}
+
+static inline void fscrypt_free_inline_crypt_key(struct fscrypt_info *ci)
+{
+}
+#endif
+
 #endif /* _FSCRYPT_PRIVATE_H */
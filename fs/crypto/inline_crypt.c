@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Inline encryption support for fscrypt
+ *
+ * With inline encryption, the filesystem attaches the inode's key and the
+ * logical block number of the first block to each bio of an encrypted
+ * regular file, and the block layer (blk-crypto) en/decrypts the data,
+ * either with inline encryption hardware or with the crypto API fallback.
+ * The IV of a block is its logical block number in both cases, so the
+ * on-disk format is the same as with fscrypt_encrypt_page().
+ */
+
+#include <linux/blk-crypto.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+
+#include "fscrypt_private.h"
+
+static enum blk_crypto_mode_num fscrypt_blk_crypto_mode(u8 data_mode)
+{
+	switch (data_mode) {
+	case FS_ENCRYPTION_MODE_AES_256_XTS:
+		return BLK_ENCRYPTION_MODE_AES_256_XTS;
+	default:
+		/* AES-128-CBC needs ESSIV, which blk-crypto doesn't do */
+		return BLK_ENCRYPTION_MODE_INVALID;
+	}
+}
+
+/* Enable inline encryption for this file if the filesystem asked for it */
+void fscrypt_select_encryption_impl(struct fscrypt_info *ci,
+				    const struct inode *inode)
+{
+	const struct super_block *sb = inode->i_sb;
+
+	ci->ci_inlinecrypt = false;
+
+	if (!S_ISREG(inode->i_mode))
+		return;
+
+	if (!sb->s_cop->inline_crypt_enabled ||
+	    !sb->s_cop->inline_crypt_enabled(inode->i_sb))
+		return;
+
+	if (fscrypt_blk_crypto_mode(ci->ci_data_mode) ==
+	    BLK_ENCRYPTION_MODE_INVALID)
+		return;
+
+	/* the data unit number is the logical block number */
+	if (!sb->s_bdev)
+		return;
+
+	ci->ci_inlinecrypt = true;
+}
+
+int fscrypt_prepare_inline_crypt_key(struct fscrypt_info *ci,
+				     const struct inode *inode,
+				     const u8 *raw_key)
+{
+	enum blk_crypto_mode_num crypto_mode =
+		fscrypt_blk_crypto_mode(ci->ci_data_mode);
+	unsigned int data_unit_size = inode->i_sb->s_blocksize;
+	struct request_queue *q = bdev_get_queue(inode->i_sb->s_bdev);
+	struct blk_crypto_key *blk_key;
+	int err;
+
+	if (!ci->ci_inlinecrypt)
+		return 0;
+
+	err = blk_crypto_start_using_mode(crypto_mode, data_unit_size, q);
+	if (err) {
+		/* no hardware support and no fallback, do it ourselves */
+		fscrypt_warn(inode->i_sb,
+			     "error %d starting to use blk-crypto, using fs-layer encryption for inode %lu",
+			     err, inode->i_ino);
+		ci->ci_inlinecrypt = false;
+		return 0;
+	}
+
+	blk_key = kzalloc(sizeof(*blk_key), GFP_NOFS);
+	if (!blk_key)
+		return -ENOMEM;
+
+	err = blk_crypto_init_key(blk_key, raw_key, crypto_mode,
+				  data_unit_size);
+	if (err) {
+		fscrypt_err(inode->i_sb,
+			    "error %d initializing blk-crypto key for inode %lu",
+			    err, inode->i_ino);
+		kzfree(blk_key);
+		return err;
+	}
+
+	ci->ci_blk_key = blk_key;
+	ci->ci_blk_queue = q;
+	return 0;
+}
+
+void fscrypt_free_inline_crypt_key(struct fscrypt_info *ci)
+{
+	if (!ci->ci_blk_key)
+		return;
+
+	blk_crypto_evict_key(ci->ci_blk_queue, ci->ci_blk_key);
+	kzfree(ci->ci_blk_key);
+	ci->ci_blk_key = NULL;
+}
+
+/**
+ * fscrypt_inode_uses_inline_crypto - test whether an inode uses inline
+ *				      encryption
+ * @inode: an inode
+ *
+ * Return: true if the inode's file contents are en/decrypted by the block
+ * layer, in which case the filesystem must attach a crypt context to its
+ * bios with fscrypt_set_bio_crypt_ctx() and must not en/decrypt the data.
+ */
+bool fscrypt_inode_uses_inline_crypto(const struct inode *inode)
+{
+	return IS_ENCRYPTED(inode) && S_ISREG(inode->i_mode) &&
+		inode->i_crypt_info && inode->i_crypt_info->ci_blk_key;
+}
+EXPORT_SYMBOL_GPL(fscrypt_inode_uses_inline_crypto);
+
+/**
+ * fscrypt_set_bio_crypt_ctx - prepare a file contents bio for inline
+ *			       encryption
+ * @bio: a bio which will eventually be submitted to the file
+ * @inode: the file's inode
+ * @first_lblk: the first file logical block number in the I/O
+ * @gfp_mask: memory allocation flags, must allow sleeping
+ *
+ * If the contents of the file should be encrypted (or decrypted) with inline
+ * encryption, then assign the appropriate encryption context to the bio.
+ * Otherwise do nothing.
+ */
+void fscrypt_set_bio_crypt_ctx(struct bio *bio, const struct inode *inode,
+			       u64 first_lblk, gfp_t gfp_mask)
+{
+	if (!fscrypt_inode_uses_inline_crypto(inode))
+		return;
+
+	bio_crypt_set_ctx(bio, inode->i_crypt_info->ci_blk_key, first_lblk,
+			  gfp_mask);
+}
+EXPORT_SYMBOL_GPL(fscrypt_set_bio_crypt_ctx);
+
+/**
+ * fscrypt_mergeable_bio - test whether data can be added to a bio
+ * @bio: the bio being built up
+ * @inode: the inode for the next part of the I/O
+ * @next_lblk: the next file logical block number in the I/O
+ *
+ * When building a bio which may contain data which should undergo inline
+ * encryption (or decryption) via fscrypt, filesystems should call this
+ * function to ensure that the resulting bio contains only logically
+ * contiguous data of a single file.  This is needed because the block
+ * layer derives the IV of each data unit from the bio's first one.
+ *
+ * Return: true iff the I/O is mergeable
+ */
+bool fscrypt_mergeable_bio(struct bio *bio, const struct inode *inode,
+			   u64 next_lblk)
+{
+	const struct bio_crypt_ctx *bc = bio->bi_crypt_context;
+
+	if (!!bc != fscrypt_inode_uses_inline_crypto(inode))
+		return false;
+	if (!bc)
+		return true;
+
+	if (bc->bc_key != inode->i_crypt_info->ci_blk_key)
+		return false;
+
+	return bc->bc_dun +
+		(bio->bi_iter.bi_size >> bc->bc_key->data_unit_size_bits) ==
+		next_lblk;
+}
+EXPORT_SYMBOL_GPL(fscrypt_mergeable_bio);
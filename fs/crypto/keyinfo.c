@@ -203,6 +203,7 @@ static void put_crypt_info(struct fscrypt_info *ci)
 	if (!ci)
 		return;
 
+	fscrypt_free_inline_crypt_key(ci);
 	crypto_free_skcipher(ci->ci_ctfm);
 	crypto_free_cipher(ci->ci_essiv_tfm);
 	kmem_cache_free(fscrypt_info_cachep, ci);
@@ -321,6 +322,11 @@ int fscrypt_get_encryption_info(struct inode *inode)
 	crypt_info->ci_filename_mode = ctx.filenames_encryption_mode;
 	crypt_info->ci_ctfm = NULL;
 	crypt_info->ci_essiv_tfm = NULL;
+#ifdef CONFIG_FS_ENCRYPTION_INLINE_CRYPT
+	crypt_info->ci_inlinecrypt = false;
+	crypt_info->ci_blk_key = NULL;
+	crypt_info->ci_blk_queue = NULL;
+#endif
 	memcpy(crypt_info->ci_master_key, ctx.master_key_descriptor,
 				sizeof(crypt_info->ci_master_key));
 
@@ -370,6 +376,17 @@ int fscrypt_get_encryption_info(struct inode *inode)
 	if (res)
 		goto out;
 
+	/*
+	 * The software transform is kept even for inline encryption: data
+	 * read or written without going through the filesystem's bios, e.g.
+	 * by fscrypt_zeroout_range(), is still en/decrypted with it, and the
+	 * resulting ciphertext is identical.
+	 */
+	fscrypt_select_encryption_impl(crypt_info, inode);
+	res = fscrypt_prepare_inline_crypt_key(crypt_info, inode, raw_key);
+	if (res)
+		goto out;
+
 	if (S_ISREG(inode->i_mode) &&
 	    crypt_info->ci_data_mode == FS_ENCRYPTION_MODE_AES_128_CBC) {
 		res = init_essiv_generator(crypt_info, raw_key, mode->keysize);
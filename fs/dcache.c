@@ -30,6 +30,8 @@
 #include <linux/bit_spinlock.h>
 #include <linux/rculist_bl.h>
 #include <linux/list_lru.h>
+#include <linux/workqueue.h>
+#include <linux/wait_bit.h>
 #include "internal.h"
 #include "mount.h"
 
@@ -119,8 +121,7 @@ struct dentry_stat_t dentry_stat = {
 
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
-
-#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
+static DEFINE_PER_CPU(long, nr_dentry_negative);
 
 /*
  * Here we resort to our own counters instead of using generic per-cpu counters
@@ -152,15 +153,69 @@ static long get_nr_dentry_unused(void)
 	return sum < 0 ? 0 : sum;
 }
 
+static long get_nr_dentry_negative(void)
+{
+	int i;
+	long sum = 0;
+
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_negative, i);
+	return sum < 0 ? 0 : sum;
+}
+
+#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 int proc_nr_dentry(struct ctl_table *table, int write, void __user *buffer,
 		   size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
 	dentry_stat.nr_unused = get_nr_dentry_unused();
+	dentry_stat.nr_negative = get_nr_dentry_negative();
 	return proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
 }
 #endif
 
+/*
+ * Negative dentry limit
+ *
+ * Lookups of names that don't exist leave negative dentries behind, which
+ * only go away under memory pressure.  sysctl fs.negative-dentry-limit caps
+ * the number of unused negative dentries to a percentage of all dentries,
+ * 0 (the default) meaning no limit.  Going over it kicks a work item that
+ * frees the oldest unused negative dentries on the superblock LRUs.
+ *
+ * The per-cpu counters are not summed on every dput(): each CPU checks its
+ * own counter against its share of the limit, computed by the last run of
+ * the work, and the work itself checks the real totals.
+ */
+int sysctl_negative_dentry_limit __read_mostly;
+static long neg_dentry_percpu_limit __read_mostly;
+
+static void negative_dentry_trim(struct work_struct *work);
+static DECLARE_DELAYED_WORK(negative_dentry_trim_work, negative_dentry_trim);
+
+static inline void negative_dentry_limit_check(void)
+{
+	if (unlikely(READ_ONCE(sysctl_negative_dentry_limit)) &&
+	    this_cpu_read(nr_dentry_negative) >
+	    READ_ONCE(neg_dentry_percpu_limit))
+		schedule_delayed_work(&negative_dentry_trim_work, HZ);
+}
+
+#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
+int proc_negative_dentry_limit(struct ctl_table *table, int write,
+			       void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (!ret && write && sysctl_negative_dentry_limit) {
+		WRITE_ONCE(neg_dentry_percpu_limit, 0);
+		mod_delayed_work(system_wq, &negative_dentry_trim_work, 0);
+	}
+	return ret;
+}
+#endif
+
 /*
  * Compare 2 name strings, return 0 if they match, otherwise non-zero.
  * The strings are both count bytes long, and count is non-zero.
@@ -308,6 +363,8 @@ static inline void __d_set_inode_and_type(struct dentry *dentry,
 	flags &= ~(DCACHE_ENTRY_TYPE | DCACHE_FALLTHRU);
 	flags |= type_flags;
 	WRITE_ONCE(dentry->d_flags, flags);
+	if (flags & DCACHE_LRU_LIST)
+		this_cpu_dec(nr_dentry_negative);
 }
 
 static inline void __d_clear_type_and_inode(struct dentry *dentry)
@@ -317,6 +374,8 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	flags &= ~(DCACHE_ENTRY_TYPE | DCACHE_FALLTHRU);
 	WRITE_ONCE(dentry->d_flags, flags);
 	dentry->d_inode = NULL;
+	if (flags & DCACHE_LRU_LIST)
+		this_cpu_inc(nr_dentry_negative);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -369,7 +428,8 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * on the shrink list (ie not on the superblock LRU list).
  *
  * The per-cpu "nr_dentry_unused" counters are updated with
- * the DCACHE_LRU_LIST bit.
+ * the DCACHE_LRU_LIST bit, and so are the "nr_dentry_negative"
+ * counters for negative dentries.
  *
  * These helper functions make sure we always follow the
  * rules. d_lock must be held by the caller.
@@ -380,6 +440,10 @@ static void d_lru_add(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, 0);
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	if (d_is_negative(dentry)) {
+		this_cpu_inc(nr_dentry_negative);
+		negative_dentry_limit_check();
+	}
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -388,6 +452,8 @@ static void d_lru_del(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		this_cpu_dec(nr_dentry_negative);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -397,6 +463,8 @@ static void d_shrink_del(struct dentry *dentry)
 	list_del_init(&dentry->d_lru);
 	dentry->d_flags &= ~(DCACHE_SHRINK_LIST | DCACHE_LRU_LIST);
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		this_cpu_dec(nr_dentry_negative);
 }
 
 static void d_shrink_add(struct dentry *dentry, struct list_head *list)
@@ -405,6 +473,8 @@ static void d_shrink_add(struct dentry *dentry, struct list_head *list)
 	list_add(&dentry->d_lru, list);
 	dentry->d_flags |= DCACHE_SHRINK_LIST | DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		this_cpu_inc(nr_dentry_negative);
 }
 
 /*
@@ -418,6 +488,8 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		this_cpu_dec(nr_dentry_negative);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
 
@@ -1188,20 +1260,98 @@ static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
  */
 void shrink_dcache_sb(struct super_block *sb)
 {
-	long freed;
-
 	do {
 		LIST_HEAD(dispose);
 
-		freed = list_lru_walk(&sb->s_dentry_lru,
+		list_lru_walk(&sb->s_dentry_lru,
 			dentry_lru_isolate_shrink, &dispose, 1024);
-
-		this_cpu_sub(nr_dentry_unused, freed);
 		shrink_dentry_list(&dispose);
 	} while (list_lru_count(&sb->s_dentry_lru) > 0);
 }
 EXPORT_SYMBOL(shrink_dcache_sb);
 
+struct negative_dentry_batch {
+	struct list_head dispose;
+	long nr_to_free;
+};
+
+static enum lru_status dentry_negative_lru_isolate(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
+{
+	struct negative_dentry_batch *trim = arg;
+	struct dentry	*dentry = container_of(item, struct dentry, d_lru);
+
+	if (trim->nr_to_free <= 0)
+		return LRU_SKIP;
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	if (dentry->d_lockref.count) {
+		d_lru_isolate(lru, dentry);
+		spin_unlock(&dentry->d_lock);
+		return LRU_REMOVED;
+	}
+
+	/*
+	 * Move positive dentries out of the way so that the next batch
+	 * doesn't walk them again, and give recently used negative dentries
+	 * another pass like the regular shrinker does.
+	 */
+	if (d_is_positive(dentry) || dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	d_lru_shrink_move(lru, dentry, &trim->dispose);
+	trim->nr_to_free--;
+	spin_unlock(&dentry->d_lock);
+
+	return LRU_REMOVED;
+}
+
+static void prune_negative_dentries_sb(struct super_block *sb, void *arg)
+{
+	long *nr_to_free = arg;
+	unsigned long nr_to_walk = list_lru_count(&sb->s_dentry_lru);
+	struct negative_dentry_batch trim;
+	unsigned long batch;
+
+	while (nr_to_walk && *nr_to_free > 0) {
+		INIT_LIST_HEAD(&trim.dispose);
+		trim.nr_to_free = *nr_to_free;
+		batch = min(nr_to_walk, 1024UL);
+		nr_to_walk -= batch;
+
+		list_lru_walk(&sb->s_dentry_lru, dentry_negative_lru_isolate,
+			      &trim, batch);
+		*nr_to_free = trim.nr_to_free;
+		shrink_dentry_list(&trim.dispose);
+		cond_resched();
+	}
+}
+
+static void negative_dentry_trim(struct work_struct *work)
+{
+	int pct = READ_ONCE(sysctl_negative_dentry_limit);
+	long limit, nr_negative, nr_to_free;
+
+	if (!pct)
+		return;
+
+	limit = mult_frac(get_nr_dentry(), pct, 100);
+	WRITE_ONCE(neg_dentry_percpu_limit, limit / num_possible_cpus());
+
+	nr_negative = get_nr_dentry_negative();
+	if (nr_negative <= limit)
+		return;
+
+	/* Go some way below the limit so that we are not back right away */
+	nr_to_free = nr_negative - limit + limit / 8;
+	iterate_supers(prune_negative_dentries_sb, &nr_to_free);
+}
+
 /**
  * enum d_walk_ret - action to talke during tree walk
  * @D_WALK_CONTINUE:	contrinue walk
@@ -2536,6 +2686,48 @@ void __d_lookup_done(struct dentry *dentry)
 }
 EXPORT_SYMBOL(__d_lookup_done);
 
+/**
+ * d_lock_update - serialize a create or unlink on a name
+ * @dentry: the dentry of the name, hashed
+ *
+ * With FS_PAR_DIR_UPDATE the parent is only locked shared for creating and
+ * unlinking non-directories, so the name itself is locked by setting
+ * DCACHE_PAR_UPDATE on its dentry.  Waits for the current holder, if any.
+ * Returns false if the dentry got unhashed meanwhile, as it does when a
+ * busy dentry is unlinked: the caller must drop it and look the name up
+ * again.
+ */
+bool d_lock_update(struct dentry *dentry)
+{
+	spin_lock(&dentry->d_lock);
+	while (dentry->d_flags & DCACHE_PAR_UPDATE) {
+		spin_unlock(&dentry->d_lock);
+		wait_var_event(&dentry->d_flags,
+			       !(READ_ONCE(dentry->d_flags) &
+				 DCACHE_PAR_UPDATE));
+		spin_lock(&dentry->d_lock);
+	}
+	if (d_unhashed(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		return false;
+	}
+	dentry->d_flags |= DCACHE_PAR_UPDATE;
+	spin_unlock(&dentry->d_lock);
+	return true;
+}
+EXPORT_SYMBOL(d_lock_update);
+
+void d_unlock_update(struct dentry *dentry)
+{
+	spin_lock(&dentry->d_lock);
+	dentry->d_flags &= ~DCACHE_PAR_UPDATE;
+	spin_unlock(&dentry->d_lock);
+	/* Order the clearing against the waitqueue_active() check */
+	smp_mb();
+	wake_up_var(&dentry->d_flags);
+}
+EXPORT_SYMBOL(d_unlock_update);
+
 /* inode->i_lock held if inode is non-NULL */
 
 static inline void __d_add(struct dentry *dentry, struct inode *inode)
@@ -26,6 +26,7 @@
 #include <linux/file.h>
 #include <linux/fdtable.h>
 #include <linux/mm.h>
+#include <linux/ksm.h>
 #include <linux/vmacache.h>
 #include <linux/stat.h>
 #include <linux/fcntl.h>
@@ -295,9 +296,13 @@ static int __bprm_mm_init(struct linux_binprm *bprm)
 		return -ENOMEM;
 	vma_set_anonymous(vma);
 
+	err = ksm_execve(mm);
+	if (err)
+		goto err_free;
+
 	if (down_write_killable(&mm->mmap_sem)) {
 		err = -EINTR;
-		goto err_free;
+		goto err_ksm;
 	}
 
 	/*
@@ -323,6 +328,8 @@ static int __bprm_mm_init(struct linux_binprm *bprm)
 	return 0;
 err:
 	up_write(&mm->mmap_sem);
+err_ksm:
+	ksm_exit(mm);
 err_free:
 	bprm->vma = NULL;
 	vm_area_free(vma);
@@ -1034,6 +1041,7 @@ static int exec_mmap(struct mm_struct *mm)
 	activate_mm(active_mm, mm);
 	tsk->mm->vmacache_seqnum = 0;
 	vmacache_flush(tsk);
+	lru_gen_add_mm(mm);
 	task_unlock(tsk);
 	if (old_mm) {
 		up_read(&old_mm->mmap_sem);
@@ -1750,6 +1758,7 @@ static int __do_execve_file(int fd, struct filename *filename,
 
 	check_unsafe_exec(bprm);
 	current->in_execve = 1;
+	sched_mm_cid_before_execve(current);
 
 	if (!file)
 		file = do_open_execat(fd, filename, flags);
@@ -1823,6 +1832,7 @@ static int __do_execve_file(int fd, struct filename *filename,
 	/* execve succeeded */
 	current->fs->in_exec = 0;
 	current->in_execve = 0;
+	sched_mm_cid_after_execve(current);
 	membarrier_execve(current);
 	rseq_execve(current);
 	acct_update_integrals(current);
@@ -1844,6 +1854,7 @@ static int __do_execve_file(int fd, struct filename *filename,
 out_unmark:
 	current->fs->in_exec = 0;
 	current->in_execve = 0;
+	sched_mm_cid_after_execve(current);
 
 out_free:
 	free_bprm(bprm);
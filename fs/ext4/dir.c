@@ -108,6 +108,7 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 	struct inode *inode = file_inode(file);
 	struct super_block *sb = inode->i_sb;
 	struct buffer_head *bh = NULL;
+	char *buf = NULL;
 	int dir_has_error = 0;
 	struct fscrypt_str fstr = FSTR_INIT(NULL, 0);
 
@@ -144,6 +145,18 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 			return err;
 	}
 
+	/*
+	 * Entries may be added and deleted while we run (FS_PAR_DIR_UPDATE),
+	 * so each block is copied under i_dir_sem and the copy is parsed.
+	 * i_dir_sem can't be held across dir_emit(): faulting in the user
+	 * buffer may start a handle, and i_dir_sem is taken inside handles.
+	 */
+	buf = kmalloc(sb->s_blocksize, GFP_KERNEL);
+	if (!buf) {
+		err = -ENOMEM;
+		goto errout;
+	}
+
 	offset = ctx->pos & (sb->s_blocksize - 1);
 
 	while (ctx->pos < inode->i_size) {
@@ -190,9 +203,11 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 		}
 
 		/* Check the checksum */
+		down_read(&EXT4_I(inode)->i_dir_sem);
 		if (!buffer_verified(bh) &&
 		    !ext4_dirent_csum_verify(inode,
 				(struct ext4_dir_entry *)bh->b_data)) {
+			up_read(&EXT4_I(inode)->i_dir_sem);
 			EXT4_ERROR_FILE(file, 0, "directory fails checksum "
 					"at offset %llu",
 					(unsigned long long)ctx->pos);
@@ -202,6 +217,8 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 			continue;
 		}
 		set_buffer_verified(bh);
+		memcpy(buf, bh->b_data, sb->s_blocksize);
+		up_read(&EXT4_I(inode)->i_dir_sem);
 
 		/* If the dir block has changed since the last call to
 		 * readdir(2), then we might be pointing to an invalid
@@ -209,8 +226,7 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 		 * to make sure. */
 		if (!inode_eq_iversion(inode, file->f_version)) {
 			for (i = 0; i < sb->s_blocksize && i < offset; ) {
-				de = (struct ext4_dir_entry_2 *)
-					(bh->b_data + i);
+				de = (struct ext4_dir_entry_2 *)(buf + i);
 				/* It's too expensive to do a full
 				 * dirent test each time round this
 				 * loop, but we do have to test at
@@ -231,10 +247,9 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 
 		while (ctx->pos < inode->i_size
 		       && offset < sb->s_blocksize) {
-			de = (struct ext4_dir_entry_2 *) (bh->b_data + offset);
+			de = (struct ext4_dir_entry_2 *) (buf + offset);
 			if (ext4_check_dir_entry(inode, file, de, bh,
-						 bh->b_data, bh->b_size,
-						 offset)) {
+						 buf, bh->b_size, offset)) {
 				/*
 				 * On error, skip to the next block
 				 */
@@ -286,6 +301,7 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 #ifdef CONFIG_EXT4_FS_ENCRYPTION
 	fscrypt_fname_free_buffer(&fstr);
 #endif
+	kfree(buf);
 	brelse(bh);
 	return err;
 }
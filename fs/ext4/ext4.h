@@ -142,6 +142,8 @@ enum SHIFT_DIRECTION {
 #define EXT4_MB_USE_ROOT_BLOCKS		0x1000
 /* Use blocks from reserved pool */
 #define EXT4_MB_USE_RESERVED		0x2000
+/* Criteria 1 optimized scan resumes after ac_last_optimal_group */
+#define EXT4_MB_CR1_OPTIMIZED		0x4000
 
 struct ext4_allocation_request {
 	/* target inode for block we're allocating */
@@ -894,6 +896,7 @@ do {									       \
 #endif /* defined(__KERNEL__) || defined(__linux__) */
 
 #include "extents_status.h"
+#include "fast_commit.h"
 
 /*
  * Lock subclasses for i_data_sem in the ext4_inode_info structure.
@@ -949,6 +952,15 @@ struct ext4_inode_info {
 	 */
 	struct rw_semaphore xattr_sem;
 
+	/*
+	 * Creates and unlinks of non-directories run with the parent's
+	 * i_rwsem held shared (FS_PAR_DIR_UPDATE).  i_dir_sem guards the
+	 * shape of a directory against them: the htree index, i_size and
+	 * the conversion between inline, linear and indexed.  See
+	 * ext4_dir_block_lock().
+	 */
+	struct rw_semaphore i_dir_sem;
+
 	struct list_head i_orphan;	/* unlinked but open inodes */
 
 	/*
@@ -1056,6 +1068,16 @@ struct ext4_inode_info {
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
 
+	/*
+	 * Fast commit tracking: entry in sbi->s_fc_q, the tid of the last
+	 * tracked update and the range of logical blocks whose mapping
+	 * changed since the inode was last committed [sbi->s_fc_lock].
+	 */
+	struct list_head i_fc_list;
+	tid_t i_fc_tid;
+	ext4_lblk_t i_fc_lblk_start;
+	ext4_lblk_t i_fc_lblk_len;
+
 #ifdef CONFIG_QUOTA
 	struct dquot *i_dquot[MAXQUOTAS];
 #endif
@@ -1072,6 +1094,7 @@ struct ext4_inode_info {
 #define	EXT4_VALID_FS			0x0001	/* Unmounted cleanly */
 #define	EXT4_ERROR_FS			0x0002	/* Errors detected */
 #define	EXT4_ORPHAN_FS			0x0004	/* Orphans being recovered */
+#define	EXT4_FC_REPLAY			0x0020	/* Fast commit replay ongoing */
 
 /*
  * Misc. filesystem flags
@@ -1120,6 +1143,11 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_JOURNAL_CHECKSUM	0x800000 /* Journal checksums */
 #define EXT4_MOUNT_JOURNAL_ASYNC_COMMIT	0x1000000 /* Journal Async Commit */
 #define EXT4_MOUNT_WARN_ON_ERROR	0x2000000 /* Trigger WARN_ON on error */
+#ifdef CONFIG_FS_ENCRYPTION_INLINE_CRYPT
+#define EXT4_MOUNT_INLINECRYPT		0x4000000 /* Inline encryption support */
+#else
+#define EXT4_MOUNT_INLINECRYPT		0
+#endif
 #define EXT4_MOUNT_DELALLOC		0x8000000 /* Delalloc support */
 #define EXT4_MOUNT_DATA_ERR_ABORT	0x10000000 /* Abort on file data write */
 #define EXT4_MOUNT_BLOCK_VALIDITY	0x20000000 /* Block validity checking */
@@ -1142,6 +1170,12 @@ struct ext4_inode_info {
 #define EXT4_MOUNT2_EXPLICIT_JOURNAL_CHECKSUM	0x00000008 /* User explicitly
 						specified journal checksum */
 
+#define EXT4_MOUNT2_JOURNAL_FAST_COMMIT	0x00000010 /* Journal fast commit */
+#define EXT4_MOUNT2_MB_OPTIMIZE_SCAN	0x00000020 /* Pick block groups for
+						      criteria 0 and 1 from
+						      per order lists and
+						      fragment size tree */
+
 #define clear_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt &= \
 						~EXT4_MOUNT_##opt
 #define set_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt |= \
@@ -1423,6 +1457,10 @@ struct ext4_sb_info {
 	unsigned int s_mb_free_pending;
 	struct list_head s_freed_data_list;	/* List of blocks to be freed
 						   after commit completed */
+	struct rb_root s_mb_avg_fragment_size_root;
+	rwlock_t s_mb_rb_lock;
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
 
 	/* tunables */
 	unsigned long s_stripe;
@@ -1445,6 +1483,11 @@ struct ext4_sb_info {
 	atomic_t s_bal_goals;	/* goal hits */
 	atomic_t s_bal_breaks;	/* too long searches */
 	atomic_t s_bal_2orders;	/* 2^order hits */
+	atomic_t s_bal_groups_scanned;	/* groups scanned */
+	atomic_t s_bal_cX_hits[4];	/* allocations per criteria */
+	atomic64_t s_bal_cX_groups_considered[4];
+	atomic_t s_bal_cX_failed[4];	/* criteria loops without success */
+	atomic_t s_bal_bad_suggestions;	/* optimized scan picks that missed */
 	spinlock_t s_bal_lock;
 	unsigned long s_mb_buddies_generated;
 	unsigned long long s_mb_generation_time;
@@ -1507,6 +1550,19 @@ struct ext4_sb_info {
 	/* Barrier between changing inodes' journal flags and writepages ops. */
 	struct percpu_rw_semaphore s_journal_flag_rwsem;
 	struct dax_device *s_daxdev;
+
+	/* Fast commit */
+	struct list_head s_fc_q;	/* Inodes to fast commit */
+	struct list_head s_fc_dentry_q;	/* Directory entry updates */
+	spinlock_t s_fc_lock;		/* Protects the lists and below */
+	bool s_fc_ineligible;		/* Next commit must be a full one */
+	tid_t s_fc_ineligible_tid;
+	struct buffer_head *s_fc_bh;	/* Fast commit block being filled */
+	unsigned int s_fc_bytes;	/* Bytes used in s_fc_bh */
+	u32 s_fc_crc;
+	int s_fc_nblks;			/* Blocks used by this fast commit */
+	struct ext4_fc_stats s_fc_stats;
+	struct ext4_fc_replay_state s_fc_replay_state;
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
@@ -1535,7 +1591,6 @@ enum {
 	EXT4_STATE_NO_EXPAND,		/* No space for expansion */
 	EXT4_STATE_DA_ALLOC_CLOSE,	/* Alloc DA blks on close */
 	EXT4_STATE_EXT_MIGRATE,		/* Inode is migrating */
-	EXT4_STATE_DIO_UNWRITTEN,	/* need convert on dio done*/
 	EXT4_STATE_NEWENTRY,		/* File just added to dir */
 	EXT4_STATE_MAY_INLINE_DATA,	/* may have in-inode data */
 	EXT4_STATE_EXT_PRECACHED,	/* extents have been precached */
@@ -1626,6 +1681,7 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 #define EXT4_FEATURE_COMPAT_RESIZE_INODE	0x0010
 #define EXT4_FEATURE_COMPAT_DIR_INDEX		0x0020
 #define EXT4_FEATURE_COMPAT_SPARSE_SUPER2	0x0200
+#define EXT4_FEATURE_COMPAT_FAST_COMMIT		0x0400
 
 #define EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER	0x0001
 #define EXT4_FEATURE_RO_COMPAT_LARGE_FILE	0x0002
@@ -1720,6 +1776,7 @@ EXT4_FEATURE_COMPAT_FUNCS(xattr,		EXT_ATTR)
 EXT4_FEATURE_COMPAT_FUNCS(resize_inode,		RESIZE_INODE)
 EXT4_FEATURE_COMPAT_FUNCS(dir_index,		DIR_INDEX)
 EXT4_FEATURE_COMPAT_FUNCS(sparse_super2,	SPARSE_SUPER2)
+EXT4_FEATURE_COMPAT_FUNCS(fast_commit,		FAST_COMMIT)
 
 EXT4_FEATURE_RO_COMPAT_FUNCS(sparse_super,	SPARSE_SUPER)
 EXT4_FEATURE_RO_COMPAT_FUNCS(large_file,	LARGE_FILE)
@@ -2253,6 +2310,10 @@ extern ext4_grpblk_t ext4_block_group_offset(struct super_block *sb,
 extern int ext4_bg_has_super(struct super_block *sb, ext4_group_t group);
 extern unsigned long ext4_bg_num_gdb(struct super_block *sb,
 			ext4_group_t group);
+extern int ext4_init_block_bitmap(struct super_block *sb,
+				  struct buffer_head *bh,
+				  ext4_group_t block_group,
+				  struct ext4_group_desc *gdp);
 extern ext4_fsblk_t ext4_new_meta_blocks(handle_t *handle, struct inode *inode,
 					 ext4_fsblk_t goal,
 					 unsigned int flags,
@@ -2374,6 +2435,30 @@ extern int ext4_check_all_de(struct inode *dir, struct buffer_head *bh,
 /* fsync.c */
 extern int ext4_sync_file(struct file *, loff_t, loff_t, int);
 
+/* fast_commit.c */
+extern void ext4_fc_init(struct super_block *sb, journal_t *journal);
+extern void ext4_fc_init_inode(struct inode *inode);
+extern void ext4_fc_mark_ineligible(struct super_block *sb, int reason,
+				    handle_t *handle);
+extern void ext4_fc_track_inode(handle_t *handle, struct inode *inode);
+extern void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+				ext4_lblk_t start, ext4_lblk_t end);
+extern void ext4_fc_track_create(handle_t *handle, struct dentry *dentry);
+extern void ext4_fc_track_link(handle_t *handle, struct dentry *dentry);
+extern void ext4_fc_track_unlink(handle_t *handle, struct dentry *dentry);
+extern void ext4_fc_del(struct inode *inode);
+extern void ext4_fc_release(struct super_block *sb);
+extern int ext4_fc_commit(journal_t *journal, tid_t commit_tid);
+extern int ext4_fc_info_show(struct seq_file *seq, void *v);
+extern ext4_fsblk_t ext4_fc_replay_alloc_block(struct inode *inode,
+					       ext4_fsblk_t goal, int *errp);
+extern void ext4_fc_replay_free_blocks(struct inode *inode,
+				       ext4_fsblk_t block,
+				       unsigned long count);
+extern int ext4_fc_replay(journal_t *journal, struct buffer_head *bh,
+			  int pass, int off, tid_t expected_tid);
+extern void ext4_fc_replay_cleanup(struct super_block *sb);
+
 /* hash.c */
 extern int ext4fs_dirhash(const char *name, int len, struct
 			  dx_hash_info *hinfo);
@@ -2406,6 +2491,7 @@ extern void ext4_end_bitmap_read(struct buffer_head *bh, int uptodate);
 
 /* mballoc.c */
 extern const struct seq_operations ext4_mb_seq_groups_ops;
+extern int ext4_seq_mb_stats_show(struct seq_file *seq, void *offset);
 extern long ext4_mb_stats;
 extern long ext4_mb_max_to_scan;
 extern int ext4_mb_init(struct super_block *);
@@ -2438,8 +2524,6 @@ int ext4_get_block_unwritten(struct inode *inode, sector_t iblock,
 			     struct buffer_head *bh_result, int create);
 int ext4_get_block(struct inode *inode, sector_t iblock,
 		   struct buffer_head *bh_result, int create);
-int ext4_dio_get_block(struct inode *inode, sector_t iblock,
-		       struct buffer_head *bh_result, int create);
 int ext4_da_get_block_prep(struct inode *inode, sector_t iblock,
 			   struct buffer_head *bh, int create);
 int ext4_walk_page_buffers(handle_t *handle,
@@ -2528,6 +2612,13 @@ extern int ext4_generic_delete_entry(handle_t *handle,
 				     int buf_size,
 				     int csum_size);
 extern bool ext4_empty_dir(struct inode *inode);
+extern void __init ext4_init_dir_locks(void);
+extern int ext4_fc_replay_add_entry(struct inode *dir,
+				    const struct qstr *name,
+				    struct inode *inode);
+extern int ext4_fc_replay_del_entry(struct inode *dir,
+				    const struct qstr *name,
+				    unsigned long ino);
 
 /* resize.c */
 extern int ext4_group_add(struct super_block *sb,
@@ -2862,7 +2953,11 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_grpblk_t	bb_avg_fragment_size;	/* key in fragment size tree */
+	ext4_group_t	bb_group;	/* group number */
 	struct          list_head bb_prealloc_list;
+	struct list_head bb_largest_free_order_node;
+	struct rb_node	bb_avg_fragment_size_rb;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
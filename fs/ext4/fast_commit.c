@@ -0,0 +1,1629 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fs/ext4/fast_commit.c
+ *
+ * Ext4 fast commits
+ *
+ * A full jbd2 commit writes every metadata block touched by the running
+ * transaction.  For fsync that is mostly wasted work: what has to be made
+ * durable is the inode being synced and the directory entries leading to
+ * it.  A fast commit instead logs compact, logical records of the inodes
+ * and directory entries changed since the last commit into a dedicated area
+ * at the end of the journal, and recovery replays them on top of the
+ * replayed full commits.
+ *
+ * Tracking: while a transaction runs, inodes whose metadata changed are put
+ * on sbi->s_fc_q together with the range of logical blocks whose mapping
+ * changed, and directory entry changes are put on sbi->s_fc_dentry_q.
+ * Operations that can't be described that way (renames, directory
+ * creation, external xattrs, resizing, ...) mark the transaction
+ * ineligible, and fsync then falls back to a full commit.
+ *
+ * Commit: with updates to the journal locked out, every tracked directory
+ * entry and inode is logged.  CREAT records are preceded by the new inode,
+ * mapping changes are logged as ADD_RANGE/DEL_RANGE records and inodes as
+ * raw on-disk inodes.  A TAIL tag with the tid and a checksum of the fast
+ * commit ends it.  All of it covers the state at the time of the commit,
+ * so a fast commit supersedes the earlier ones of the same transaction
+ * only for the objects it contains: fast commits are replayed in order.
+ *
+ * Replay: fast commits are only replayed if their tid is the one that
+ * follows the last full commit found in the journal and their checksum
+ * matches.  Replay runs inside jbd2 recovery, before mballoc is set up,
+ * so bitmaps and group descriptors are updated directly and the blocks
+ * needed by extent tree changes come from a simple allocator that stays
+ * clear of the blocks claimed by the fast commits being replayed.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/quotaops.h>
+#include <linux/seq_file.h>
+
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+
+static bool ext4_fc_disabled(struct super_block *sb)
+{
+	return !test_opt2(sb, JOURNAL_FAST_COMMIT) ||
+		(EXT4_SB(sb)->s_mount_state & EXT4_FC_REPLAY);
+}
+
+void ext4_fc_init_inode(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	INIT_LIST_HEAD(&ei->i_fc_list);
+	ei->i_fc_lblk_start = 0;
+	ei->i_fc_lblk_len = 0;
+}
+
+static void __ext4_fc_mark_ineligible(struct ext4_sb_info *sbi, int reason,
+				      tid_t tid)
+{
+	spin_lock(&sbi->s_fc_lock);
+	if (!sbi->s_fc_ineligible || tid_gt(tid, sbi->s_fc_ineligible_tid))
+		sbi->s_fc_ineligible_tid = tid;
+	sbi->s_fc_ineligible = true;
+	sbi->s_fc_stats.fc_ineligible_reason_count[reason]++;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/**
+ * ext4_fc_mark_ineligible() - force the next commit to be a full one
+ * @sb: the filesystem
+ * @reason: EXT4_FC_REASON_*
+ * @handle: the handle of the operation, or NULL
+ *
+ * Fsyncs of the transaction @handle belongs to fall back to a full commit.
+ * Without a handle, every transaction up to the next one to start does.
+ */
+void ext4_fc_mark_ineligible(struct super_block *sb, int reason,
+			     handle_t *handle)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	tid_t tid;
+
+	if (ext4_fc_disabled(sb) || !journal)
+		return;
+
+	if (ext4_handle_valid(handle)) {
+		tid = handle->h_transaction->t_tid;
+	} else {
+		read_lock(&journal->j_state_lock);
+		tid = journal->j_transaction_sequence;
+		read_unlock(&journal->j_state_lock);
+	}
+	__ext4_fc_mark_ineligible(sbi, reason, tid);
+}
+
+static void ext4_fc_queue_inode(handle_t *handle, struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	ei->i_fc_tid = handle->h_transaction->t_tid;
+	if (list_empty(&ei->i_fc_list))
+		list_add_tail(&ei->i_fc_list, &sbi->s_fc_q);
+}
+
+/*
+ * Called whenever the on-disk inode is updated within a transaction.
+ * Directories aren't logged: their blocks are rebuilt by replaying the
+ * directory entry records.
+ */
+void ext4_fc_track_inode(handle_t *handle, struct inode *inode)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	if (ext4_fc_disabled(inode->i_sb) || !ext4_handle_valid(handle))
+		return;
+
+	if (S_ISDIR(inode->i_mode))
+		return;
+
+	if (inode->i_ino < EXT4_FIRST_INO(inode->i_sb) ||
+	    ext4_should_journal_data(inode) || ext4_has_inline_data(inode)) {
+		ext4_fc_mark_ineligible(inode->i_sb,
+					EXT4_FC_REASON_INODE_UNSUPP, handle);
+		return;
+	}
+
+	spin_lock(&sbi->s_fc_lock);
+	ext4_fc_queue_inode(handle, inode);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Called when the mapping of logical blocks @start to @end (inclusive)
+ * of @inode changed within a transaction.
+ */
+void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+			 ext4_lblk_t start, ext4_lblk_t end)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	ext4_lblk_t old_end;
+
+	if (ext4_fc_disabled(inode->i_sb) || !ext4_handle_valid(handle) ||
+	    S_ISDIR(inode->i_mode) || start > end)
+		return;
+
+	if (!ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
+		ext4_fc_mark_ineligible(inode->i_sb,
+					EXT4_FC_REASON_INODE_UNSUPP, handle);
+		return;
+	}
+
+	spin_lock(&sbi->s_fc_lock);
+	if (ei->i_fc_lblk_len) {
+		old_end = ei->i_fc_lblk_start + ei->i_fc_lblk_len - 1;
+		ei->i_fc_lblk_start = min(ei->i_fc_lblk_start, start);
+		end = max(old_end, end);
+	} else {
+		ei->i_fc_lblk_start = start;
+	}
+	ei->i_fc_lblk_len = end - ei->i_fc_lblk_start + 1;
+	ext4_fc_queue_inode(handle, inode);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+static void ext4_fc_track_dentry(handle_t *handle, struct dentry *dentry,
+				 int op)
+{
+	struct inode *dir = d_inode(dentry->d_parent);
+	struct inode *inode = d_inode(dentry);
+	struct ext4_sb_info *sbi = EXT4_SB(dir->i_sb);
+	struct ext4_fc_dentry_update *node;
+
+	if (ext4_fc_disabled(dir->i_sb) || !ext4_handle_valid(handle))
+		return;
+
+	if (IS_ENCRYPTED(dir)) {
+		ext4_fc_mark_ineligible(dir->i_sb,
+					EXT4_FC_REASON_ENCRYPTED_DIR, handle);
+		return;
+	}
+
+	node = kmalloc(sizeof(*node) + dentry->d_name.len, GFP_NOFS);
+	if (!node) {
+		ext4_fc_mark_ineligible(dir->i_sb, EXT4_FC_REASON_NOMEM,
+					handle);
+		return;
+	}
+	node->fcd_op = op;
+	node->fcd_tid = handle->h_transaction->t_tid;
+	node->fcd_parent = dir->i_ino;
+	node->fcd_ino = inode->i_ino;
+	node->fcd_name_len = dentry->d_name.len;
+	memcpy(node->fcd_name, dentry->d_name.name, dentry->d_name.len);
+
+	spin_lock(&sbi->s_fc_lock);
+	list_add_tail(&node->fcd_list, &sbi->s_fc_dentry_q);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+void ext4_fc_track_create(handle_t *handle, struct dentry *dentry)
+{
+	ext4_fc_track_dentry(handle, dentry, EXT4_FC_TAG_CREAT);
+}
+
+void ext4_fc_track_link(handle_t *handle, struct dentry *dentry)
+{
+	ext4_fc_track_dentry(handle, dentry, EXT4_FC_TAG_LINK);
+}
+
+void ext4_fc_track_unlink(handle_t *handle, struct dentry *dentry)
+{
+	ext4_fc_track_dentry(handle, dentry, EXT4_FC_TAG_UNLINK);
+}
+
+/*
+ * An inode is going away.  If it has changes that weren't fast committed,
+ * they are lost to later fast commits of the transaction, and so are the
+ * blocks its eviction may free, so fall back to a full commit.
+ */
+void ext4_fc_del(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	bool tracked = false;
+
+	if (!test_opt2(inode->i_sb, JOURNAL_FAST_COMMIT))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	if (!list_empty(&ei->i_fc_list)) {
+		list_del_init(&ei->i_fc_list);
+		tracked = true;
+	}
+	spin_unlock(&sbi->s_fc_lock);
+
+	if (tracked)
+		ext4_fc_mark_ineligible(inode->i_sb, EXT4_FC_REASON_EVICT,
+					NULL);
+}
+
+/*
+ * Called by jbd2 after a fast commit or a full commit.  After a full
+ * commit of @tid, everything tracked up to @tid is on disk.
+ */
+static void ext4_fc_cleanup(journal_t *journal, int full, tid_t tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei, *ei_n;
+	struct ext4_fc_dentry_update *fcd, *fcd_n;
+	LIST_HEAD(free_q);
+
+	if (!full)
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(ei, ei_n, &sbi->s_fc_q, i_fc_list) {
+		if (tid_geq(tid, ei->i_fc_tid)) {
+			list_del_init(&ei->i_fc_list);
+			ei->i_fc_lblk_start = 0;
+			ei->i_fc_lblk_len = 0;
+		}
+	}
+	list_for_each_entry_safe(fcd, fcd_n, &sbi->s_fc_dentry_q, fcd_list) {
+		if (tid_geq(tid, fcd->fcd_tid))
+			list_move_tail(&fcd->fcd_list, &free_q);
+	}
+	if (sbi->s_fc_ineligible && tid_geq(tid, sbi->s_fc_ineligible_tid))
+		sbi->s_fc_ineligible = false;
+	spin_unlock(&sbi->s_fc_lock);
+
+	list_for_each_entry_safe(fcd, fcd_n, &free_q, fcd_list)
+		kfree(fcd);
+}
+
+/* Free the directory entry updates left behind by an aborted journal */
+void ext4_fc_release(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_dentry_update *fcd, *fcd_n;
+
+	list_for_each_entry_safe(fcd, fcd_n, &sbi->s_fc_dentry_q, fcd_list) {
+		list_del(&fcd->fcd_list);
+		kfree(fcd);
+	}
+}
+
+/*
+ * Return a pointer to @len bytes of the fast commit area.  If they don't
+ * fit in the current block, pad it out and start a new one.
+ */
+static u8 *ext4_fc_reserve_space(struct super_block *sb, int len)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_tl *tl;
+	struct buffer_head *bh;
+	unsigned int rem;
+	u8 *dst;
+	int ret;
+
+	if (len > sb->s_blocksize)
+		return ERR_PTR(-E2BIG);
+
+	if (sbi->s_fc_bh && sbi->s_fc_bytes + len > sb->s_blocksize) {
+		rem = sb->s_blocksize - sbi->s_fc_bytes;
+		if (rem >= sizeof(*tl)) {
+			tl = (struct ext4_fc_tl *)(sbi->s_fc_bh->b_data +
+						   sbi->s_fc_bytes);
+			tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_PAD);
+			tl->fc_len = cpu_to_le16(rem - sizeof(*tl));
+			sbi->s_fc_crc = ext4_chksum(sbi, sbi->s_fc_crc, tl, rem);
+		}
+		sbi->s_fc_bh = NULL;
+	}
+
+	if (!sbi->s_fc_bh) {
+		ret = jbd2_fc_get_buf(sbi->s_journal, &bh);
+		if (ret)
+			return ERR_PTR(ret);
+		memset(bh->b_data, 0, sb->s_blocksize);
+		sbi->s_fc_bh = bh;
+		sbi->s_fc_bytes = 0;
+		sbi->s_fc_nblks++;
+	}
+
+	dst = sbi->s_fc_bh->b_data + sbi->s_fc_bytes;
+	sbi->s_fc_bytes += len;
+	return dst;
+}
+
+/* Write a tag whose value is @val followed by @val2 */
+static int ext4_fc_write_tag(struct super_block *sb, u16 tag,
+			     const void *val, int len,
+			     const void *val2, int len2)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_tl tl;
+	u8 *dst;
+
+	dst = ext4_fc_reserve_space(sb, sizeof(tl) + len + len2);
+	if (IS_ERR(dst))
+		return PTR_ERR(dst);
+
+	tl.fc_tag = cpu_to_le16(tag);
+	tl.fc_len = cpu_to_le16(len + len2);
+	memcpy(dst, &tl, sizeof(tl));
+	memcpy(dst + sizeof(tl), val, len);
+	if (len2)
+		memcpy(dst + sizeof(tl) + len, val2, len2);
+	sbi->s_fc_crc = ext4_chksum(sbi, sbi->s_fc_crc, dst,
+				    sizeof(tl) + len + len2);
+	return 0;
+}
+
+static int ext4_fc_write_head(struct super_block *sb, tid_t tid)
+{
+	struct ext4_fc_head head;
+
+	head.fc_features = cpu_to_le32(EXT4_FC_SUPPORTED_FEATURES);
+	head.fc_tid = cpu_to_le32(tid);
+	return ext4_fc_write_tag(sb, EXT4_FC_TAG_HEAD, &head, sizeof(head),
+				 NULL, 0);
+}
+
+/* The tail covers the rest of its block; the next fast commit starts anew */
+static int ext4_fc_write_tail(struct super_block *sb, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_tail tail;
+	struct ext4_fc_tl tl;
+	u8 *dst;
+
+	dst = ext4_fc_reserve_space(sb, sizeof(tl) + sizeof(tail));
+	if (IS_ERR(dst))
+		return PTR_ERR(dst);
+
+	tl.fc_tag = cpu_to_le16(EXT4_FC_TAG_TAIL);
+	tl.fc_len = cpu_to_le16(sb->s_blocksize - sizeof(tl) -
+				(dst - (u8 *)sbi->s_fc_bh->b_data));
+	memcpy(dst, &tl, sizeof(tl));
+	tail.fc_tid = cpu_to_le32(tid);
+	memcpy(dst + sizeof(tl), &tail.fc_tid, sizeof(tail.fc_tid));
+	sbi->s_fc_crc = ext4_chksum(sbi, sbi->s_fc_crc, dst,
+				    sizeof(tl) + sizeof(tail.fc_tid));
+	tail.fc_crc = cpu_to_le32(sbi->s_fc_crc);
+	memcpy(dst + sizeof(tl) + offsetof(struct ext4_fc_tail, fc_crc),
+	       &tail.fc_crc, sizeof(tail.fc_crc));
+
+	sbi->s_fc_bh = NULL;
+	return 0;
+}
+
+static int ext4_fc_write_inode(struct inode *inode)
+{
+	struct ext4_fc_inode fc_inode;
+	struct ext4_iloc iloc;
+	int ret;
+
+	if (ext4_has_inline_data(inode))
+		return -EOPNOTSUPP;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	fc_inode.fc_ino = cpu_to_le32(inode->i_ino);
+	ret = ext4_fc_write_tag(inode->i_sb, EXT4_FC_TAG_INODE,
+				&fc_inode, sizeof(fc_inode),
+				ext4_raw_inode(&iloc),
+				EXT4_INODE_SIZE(inode->i_sb));
+	brelse(iloc.bh);
+	return ret;
+}
+
+/* Log the current mapping of logical blocks @start to @end of @inode */
+static int ext4_fc_write_inode_data(struct inode *inode, ext4_lblk_t start,
+				    ext4_lblk_t end)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_fc_del_range lrange;
+	struct ext4_fc_add_range fc_ext;
+	struct ext4_extent *ex = (struct ext4_extent *)fc_ext.fc_ex;
+	struct ext4_map_blocks map;
+	ext4_lblk_t cur = start;
+	unsigned int max;
+	int ret;
+
+	while (cur <= end) {
+		map.m_lblk = cur;
+		map.m_len = end - cur + 1;
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			return ret;
+		if (!map.m_len)
+			return -EFSCORRUPTED;
+
+		if (ret == 0) {
+			lrange.fc_ino = cpu_to_le32(inode->i_ino);
+			lrange.fc_lblk = cpu_to_le32(map.m_lblk);
+			lrange.fc_len = cpu_to_le32(map.m_len);
+			ret = ext4_fc_write_tag(sb, EXT4_FC_TAG_DEL_RANGE,
+						&lrange, sizeof(lrange),
+						NULL, 0);
+		} else {
+			max = map.m_flags & EXT4_MAP_UNWRITTEN ?
+				EXT_UNWRITTEN_MAX_LEN : EXT_INIT_MAX_LEN;
+			map.m_len = min(max, map.m_len);
+
+			fc_ext.fc_ino = cpu_to_le32(inode->i_ino);
+			ex->ee_block = cpu_to_le32(map.m_lblk);
+			ex->ee_len = cpu_to_le16(map.m_len);
+			ext4_ext_store_pblock(ex, map.m_pblk);
+			if (map.m_flags & EXT4_MAP_UNWRITTEN)
+				ext4_ext_mark_unwritten(ex);
+			ret = ext4_fc_write_tag(sb, EXT4_FC_TAG_ADD_RANGE,
+						&fc_ext, sizeof(fc_ext),
+						NULL, 0);
+		}
+		if (ret)
+			return ret;
+		if (end - cur < map.m_len)
+			break;
+		cur += map.m_len;
+	}
+	return 0;
+}
+
+/* A CREAT record is preceded by the new inode, so that replay can link it */
+static int ext4_fc_write_dentry(struct super_block *sb,
+				struct ext4_fc_dentry_update *fcd,
+				struct inode **inodes, int nr)
+{
+	struct ext4_fc_dentry_info fcdi;
+	int i, ret;
+
+	if (fcd->fcd_op == EXT4_FC_TAG_CREAT) {
+		for (i = 0; i < nr; i++)
+			if (inodes[i]->i_ino == fcd->fcd_ino)
+				break;
+		if (i == nr)
+			return -ENOENT;
+		ret = ext4_fc_write_inode(inodes[i]);
+		if (ret)
+			return ret;
+	}
+
+	fcdi.fc_parent_ino = cpu_to_le32(fcd->fcd_parent);
+	fcdi.fc_ino = cpu_to_le32(fcd->fcd_ino);
+	return ext4_fc_write_tag(sb, fcd->fcd_op, &fcdi, sizeof(fcdi),
+				 fcd->fcd_name, fcd->fcd_name_len);
+}
+
+static void ext4_fc_submit_bh(struct buffer_head *bh, int op_flags)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(REQ_OP_WRITE, REQ_SYNC | op_flags, bh);
+}
+
+/*
+ * Write out the blocks of the fast commit.  The tail block is only
+ * written once the others are done and, with barriers, flushes the data
+ * and the rest of the fast commit before it hits the disk.
+ */
+static int ext4_fc_submit(journal_t *journal, int nblks)
+{
+	bool barrier = journal->j_flags & JBD2_BARRIER;
+	int first = journal->j_fc_off - nblks;
+	int i;
+
+	if (barrier && journal->j_fs_dev != journal->j_dev)
+		blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+
+	for (i = first; i < journal->j_fc_off - 1; i++)
+		ext4_fc_submit_bh(journal->j_fc_wbuf[i], 0);
+	if (barrier)
+		for (i = first; i < journal->j_fc_off - 1; i++)
+			wait_on_buffer(journal->j_fc_wbuf[i]);
+	ext4_fc_submit_bh(journal->j_fc_wbuf[journal->j_fc_off - 1],
+			  barrier ? REQ_PREFLUSH | REQ_FUA : 0);
+
+	return jbd2_fc_wait_bufs(journal, nblks);
+}
+
+struct ext4_fc_inode_snap {
+	struct inode *inode;
+	ext4_lblk_t start;
+	ext4_lblk_t len;
+};
+
+/*
+ * Log everything tracked since the last commit.  Returns -ECANCELED if the
+ * transaction is ineligible for fast commits.  On any other error, tracked
+ * updates may have been dropped.
+ */
+static int ext4_fc_perform_commit(journal_t *journal, tid_t tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_dentry_update *fcd, *fcd_n;
+	struct ext4_fc_inode_snap *snap = NULL;
+	struct ext4_inode_info *ei;
+	struct inode **inodes = NULL;
+	LIST_HEAD(dentry_q);
+	int i, nr = 0, count = 0;
+	int ret = 0;
+
+	/*
+	 * With updates locked out nothing gets tracked, so the queues stay
+	 * put except for inodes being evicted.
+	 */
+	jbd2_journal_lock_updates(journal);
+
+	spin_lock(&sbi->s_fc_lock);
+	if (sbi->s_fc_ineligible)
+		ret = -ECANCELED;
+	list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list)
+		count++;
+	spin_unlock(&sbi->s_fc_lock);
+	if (ret)
+		goto out_unlock;
+
+	if (count) {
+		inodes = kmalloc_array(count, sizeof(*inodes), GFP_NOFS);
+		snap = kmalloc_array(count, sizeof(*snap), GFP_NOFS);
+		if (!inodes || !snap) {
+			ret = -ENOMEM;
+			goto out_unlock;
+		}
+	}
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list) {
+		if (nr == count || !igrab(&ei->vfs_inode)) {
+			ret = -EBUSY;
+			break;
+		}
+		inodes[nr] = &ei->vfs_inode;
+		snap[nr].inode = &ei->vfs_inode;
+		snap[nr].start = ei->i_fc_lblk_start;
+		snap[nr].len = ei->i_fc_lblk_len;
+		nr++;
+	}
+	list_splice_init(&sbi->s_fc_dentry_q, &dentry_q);
+	spin_unlock(&sbi->s_fc_lock);
+	if (ret)
+		goto out_unlock;
+
+	/*
+	 * Blocks allocated to a file are only reachable after replay, so an
+	 * inode truncated half way can't be logged.
+	 */
+	for (i = 0; i < nr; i++) {
+		if (inodes[i]->i_nlink &&
+		    !list_empty(&EXT4_I(inodes[i])->i_orphan)) {
+			ret = -EBUSY;
+			goto out_unlock;
+		}
+	}
+
+	sbi->s_fc_bh = NULL;
+	sbi->s_fc_bytes = 0;
+	sbi->s_fc_crc = 0;
+	sbi->s_fc_nblks = 0;
+
+	if (journal->j_fc_off == 0)
+		ret = ext4_fc_write_head(sb, tid);
+	if (!ret) {
+		list_for_each_entry(fcd, &dentry_q, fcd_list) {
+			ret = ext4_fc_write_dentry(sb, fcd, inodes, nr);
+			if (ret)
+				break;
+		}
+	}
+	for (i = 0; i < nr && !ret; i++) {
+		if (snap[i].len)
+			ret = ext4_fc_write_inode_data(inodes[i],
+					snap[i].start,
+					snap[i].start + snap[i].len - 1);
+		if (!ret)
+			ret = ext4_fc_write_inode(inodes[i]);
+	}
+	if (!ret)
+		ret = ext4_fc_write_tail(sb, tid);
+
+	if (!ret) {
+		spin_lock(&sbi->s_fc_lock);
+		for (i = 0; i < nr; i++) {
+			ei = EXT4_I(inodes[i]);
+			list_del_init(&ei->i_fc_list);
+			ei->i_fc_lblk_start = 0;
+			ei->i_fc_lblk_len = 0;
+		}
+		spin_unlock(&sbi->s_fc_lock);
+	}
+
+out_unlock:
+	jbd2_journal_unlock_updates(journal);
+
+	if (!ret) {
+		/* newly mapped blocks must hold their data before the tail */
+		for (i = 0; i < nr; i++) {
+			struct address_space *mapping = inodes[i]->i_mapping;
+
+			if (snap[i].len && ext4_should_order_data(inodes[i]))
+				filemap_fdatawrite_range(mapping,
+					(loff_t)snap[i].start << sb->s_blocksize_bits,
+					(((loff_t)snap[i].start + snap[i].len) <<
+						sb->s_blocksize_bits) - 1);
+			filemap_fdatawait_keep_errors(mapping);
+		}
+		ret = ext4_fc_submit(journal, sbi->s_fc_nblks);
+		sbi->s_fc_stats.fc_numblks += sbi->s_fc_nblks;
+	} else if (sbi->s_fc_nblks) {
+		jbd2_fc_wait_bufs(journal, sbi->s_fc_nblks);
+	}
+	sbi->s_fc_nblks = 0;
+	sbi->s_fc_bh = NULL;
+
+	list_for_each_entry_safe(fcd, fcd_n, &dentry_q, fcd_list)
+		kfree(fcd);
+	for (i = 0; i < nr; i++)
+		iput(inodes[i]);
+	kfree(inodes);
+	kfree(snap);
+	return ret;
+}
+
+/**
+ * ext4_fc_commit() - make the changes of a transaction durable
+ * @journal: the journal
+ * @commit_tid: the transaction to commit
+ *
+ * Fast commit the running transaction @commit_tid if possible, else wait
+ * for a full commit of it.
+ *
+ * Return: 0 on success, or a negative errno.
+ */
+int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int ret;
+
+	if (!test_opt2(sb, JOURNAL_FAST_COMMIT))
+		return jbd2_complete_transaction(journal, commit_tid);
+
+	do {
+		ret = jbd2_fc_begin_commit(journal, commit_tid);
+	} while (ret == -EAGAIN);
+	if (ret)
+		return jbd2_complete_transaction(journal, commit_tid);
+
+	/* quota file updates aren't tracked */
+	if (sb_any_quota_loaded(sb))
+		ret = -ECANCELED;
+	else
+		ret = ext4_fc_perform_commit(journal, commit_tid);
+	if (ret) {
+		/*
+		 * A failed fast commit may have dropped tracked updates or
+		 * used up fast commit blocks, so later fast commits of this
+		 * transaction would be incomplete or never replayed.
+		 */
+		if (ret != -ECANCELED)
+			__ext4_fc_mark_ineligible(sbi, EXT4_FC_REASON_FAILED,
+						  commit_tid);
+		sbi->s_fc_stats.fc_ineligible_commits++;
+		return jbd2_fc_end_commit_fallback(journal, commit_tid);
+	}
+
+	sbi->s_fc_stats.fc_num_commits++;
+	return jbd2_fc_end_commit(journal);
+}
+
+/* Enable fast commits on a journal which has the feature set */
+void ext4_fc_init(struct super_block *sb, journal_t *journal)
+{
+	journal->j_fc_cleanup_callback = ext4_fc_cleanup;
+}
+
+static const char * const fc_ineligible_reasons[] = {
+	[EXT4_FC_REASON_XATTR]			= "Extended attributes changed",
+	[EXT4_FC_REASON_RENAME]			= "Rename",
+	[EXT4_FC_REASON_DIR_OP]			= "Directory or symlink created or removed",
+	[EXT4_FC_REASON_JOURNAL_FLAG_CHANGE]	= "Journal flag changed",
+	[EXT4_FC_REASON_INODE_UNSUPP]		= "Unsupported inode",
+	[EXT4_FC_REASON_ENCRYPTED_DIR]		= "Encrypted directory",
+	[EXT4_FC_REASON_FALLOC_RANGE]		= "Falloc range op",
+	[EXT4_FC_REASON_RESIZE]			= "Resize",
+	[EXT4_FC_REASON_SWAP_BOOT]		= "Swap boot",
+	[EXT4_FC_REASON_MOVE_EXT]		= "Extents moved",
+	[EXT4_FC_REASON_MIGRATE]		= "Inode migrated",
+	[EXT4_FC_REASON_EVICT]			= "Tracked inode evicted",
+	[EXT4_FC_REASON_NOMEM]			= "Out of memory",
+	[EXT4_FC_REASON_FAILED]			= "Fast commit failed",
+};
+
+int ext4_fc_info_show(struct seq_file *seq, void *v)
+{
+	struct ext4_sb_info *sbi = EXT4_SB((struct super_block *)seq->private);
+	struct ext4_fc_stats *stats = &sbi->s_fc_stats;
+	int i;
+
+	seq_printf(seq, "fc stats:\n%lu commits\n%lu ineligible\n%lu numblks\n",
+		   stats->fc_num_commits, stats->fc_ineligible_commits,
+		   stats->fc_numblks);
+	seq_puts(seq, "Ineligible reasons:\n");
+	for (i = 0; i < EXT4_FC_REASON_MAX; i++)
+		seq_printf(seq, "\"%s\":\t%u\n", fc_ineligible_reasons[i],
+			   stats->fc_ineligible_reason_count[i]);
+	return 0;
+}
+
+/* Replay */
+
+/*
+ * Read the inode or block bitmap of a group.  mballoc isn't set up during
+ * replay, so uninitialized bitmaps are built here.
+ */
+static struct buffer_head *ext4_fc_read_bitmap(struct super_block *sb,
+					       ext4_group_t group,
+					       struct ext4_group_desc *gdp,
+					       bool inode_bitmap)
+{
+	u16 uninit = inode_bitmap ? EXT4_BG_INODE_UNINIT : EXT4_BG_BLOCK_UNINIT;
+	struct buffer_head *bh;
+	int ret = 0;
+
+	bh = sb_getblk(sb, inode_bitmap ? ext4_inode_bitmap(sb, gdp) :
+					  ext4_block_bitmap(sb, gdp));
+	if (unlikely(!bh))
+		return ERR_PTR(-ENOMEM);
+
+	if (ext4_has_group_desc_csum(sb) &&
+	    (gdp->bg_flags & cpu_to_le16(uninit))) {
+		if (!ext4_group_desc_csum_verify(sb, group, gdp)) {
+			brelse(bh);
+			return ERR_PTR(-EFSBADCRC);
+		}
+		lock_buffer(bh);
+		if (inode_bitmap) {
+			memset(bh->b_data, 0, sb->s_blocksize);
+			ext4_mark_bitmap_end(EXT4_INODES_PER_GROUP(sb),
+					     sb->s_blocksize * 8, bh->b_data);
+		} else {
+			ret = ext4_init_block_bitmap(sb, bh, group, gdp);
+		}
+		if (!ret)
+			set_buffer_uptodate(bh);
+		unlock_buffer(bh);
+		if (ret) {
+			brelse(bh);
+			return ERR_PTR(ret);
+		}
+		/* the caller updates the descriptor checksum */
+		gdp->bg_flags &= cpu_to_le16(~uninit);
+		return bh;
+	}
+
+	if (bh_submit_read(bh) < 0) {
+		brelse(bh);
+		return ERR_PTR(-EIO);
+	}
+	return bh;
+}
+
+static int ext4_fc_inode_in_use(struct super_block *sb, unsigned long ino)
+{
+	ext4_group_t group = (ino - 1) / EXT4_INODES_PER_GROUP(sb);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	int ret;
+
+	gdp = ext4_get_group_desc(sb, group, NULL);
+	if (!gdp)
+		return -EFSCORRUPTED;
+	if (gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_UNINIT))
+		return 0;
+
+	bh = ext4_fc_read_bitmap(sb, group, gdp, true);
+	if (IS_ERR(bh))
+		return PTR_ERR(bh);
+	ret = ext4_test_bit((ino - 1) % EXT4_INODES_PER_GROUP(sb), bh->b_data);
+	brelse(bh);
+	return !!ret;
+}
+
+static int ext4_fc_mark_inode_used(struct super_block *sb, unsigned long ino,
+				   bool is_dir)
+{
+	ext4_group_t group = (ino - 1) / EXT4_INODES_PER_GROUP(sb);
+	int bit = (ino - 1) % EXT4_INODES_PER_GROUP(sb);
+	struct buffer_head *bh, *gd_bh;
+	struct ext4_group_desc *gdp;
+	int unused;
+
+	gdp = ext4_get_group_desc(sb, group, &gd_bh);
+	if (!gdp)
+		return -EFSCORRUPTED;
+	bh = ext4_fc_read_bitmap(sb, group, gdp, true);
+	if (IS_ERR(bh))
+		return PTR_ERR(bh);
+
+	if (!ext4_test_and_set_bit(bit, bh->b_data)) {
+		ext4_free_inodes_set(sb, gdp,
+				     ext4_free_inodes_count(sb, gdp) - 1);
+		if (is_dir)
+			ext4_used_dirs_set(sb, gdp,
+					   ext4_used_dirs_count(sb, gdp) + 1);
+		if (ext4_has_group_desc_csum(sb)) {
+			unused = ext4_itable_unused_count(sb, gdp);
+			if (bit >= EXT4_INODES_PER_GROUP(sb) - unused)
+				ext4_itable_unused_set(sb, gdp,
+					EXT4_INODES_PER_GROUP(sb) - bit - 1);
+		}
+	}
+	ext4_inode_bitmap_csum_set(sb, group, gdp, bh,
+				   EXT4_INODES_PER_GROUP(sb) / 8);
+	ext4_group_desc_csum_set(sb, group, gdp);
+	mark_buffer_dirty(bh);
+	mark_buffer_dirty(gd_bh);
+	brelse(bh);
+	return 0;
+}
+
+static int ext4_fc_mark_blocks(struct super_block *sb, ext4_fsblk_t pblk,
+			       unsigned long len, bool used)
+{
+	struct buffer_head *bh, *gd_bh;
+	struct ext4_group_desc *gdp;
+	ext4_group_t group;
+	ext4_grpblk_t off;
+	unsigned long n, i, changed;
+	u32 free;
+
+	while (len) {
+		ext4_get_group_no_and_offset(sb, pblk, &group, &off);
+		n = min_t(unsigned long, len, EXT4_BLOCKS_PER_GROUP(sb) - off);
+
+		gdp = ext4_get_group_desc(sb, group, &gd_bh);
+		if (!gdp)
+			return -EFSCORRUPTED;
+		bh = ext4_fc_read_bitmap(sb, group, gdp, false);
+		if (IS_ERR(bh))
+			return PTR_ERR(bh);
+
+		changed = 0;
+		for (i = 0; i < n; i++) {
+			if (used)
+				changed += !ext4_test_and_set_bit(off + i,
+								  bh->b_data);
+			else
+				changed += !!ext4_test_and_clear_bit(off + i,
+								     bh->b_data);
+		}
+		free = ext4_free_group_clusters(sb, gdp);
+		free = used ? free - changed : free + changed;
+		ext4_free_group_clusters_set(sb, gdp, free);
+		ext4_block_bitmap_csum_set(sb, group, gdp, bh);
+		ext4_group_desc_csum_set(sb, group, gdp);
+		mark_buffer_dirty(bh);
+		mark_buffer_dirty(gd_bh);
+		brelse(bh);
+
+		pblk += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static bool ext4_fc_region_claimed(struct super_block *sb, ext4_fsblk_t blk)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	struct ext4_fc_alloc_region *region;
+	int i;
+
+	for (i = 0; i < state->fc_regions_used; i++) {
+		region = &state->fc_regions[i];
+		if (blk >= region->pblk && blk < region->pblk + region->len)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * ext4_fc_replay_alloc_block() - allocate a block during replay
+ * @inode: the inode the block is for
+ * @goal: where to start looking
+ * @errp: the error code
+ *
+ * Stands in for mballoc while fast commits are replayed.  Blocks claimed by
+ * the fast commits being replayed are never handed out.
+ *
+ * Return: the block, or 0 with *@errp set on failure.
+ */
+ext4_fsblk_t ext4_fc_replay_alloc_block(struct inode *inode,
+					ext4_fsblk_t goal, int *errp)
+{
+	struct super_block *sb = inode->i_sb;
+	ext4_group_t ngroups = ext4_get_groups_count(sb);
+	ext4_group_t group, i;
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	ext4_grpblk_t bit, max = EXT4_CLUSTERS_PER_GROUP(sb);
+	ext4_fsblk_t blk;
+
+	if (goal < le32_to_cpu(EXT4_SB(sb)->s_es->s_first_data_block) ||
+	    goal >= ext4_blocks_count(EXT4_SB(sb)->s_es))
+		goal = le32_to_cpu(EXT4_SB(sb)->s_es->s_first_data_block);
+	group = ext4_get_group_number(sb, goal);
+
+	for (i = 0; i < ngroups; i++, group = (group + 1) % ngroups) {
+		gdp = ext4_get_group_desc(sb, group, NULL);
+		if (!gdp || !ext4_free_group_clusters(sb, gdp))
+			continue;
+		bh = ext4_fc_read_bitmap(sb, group, gdp, false);
+		if (IS_ERR(bh))
+			continue;
+		for (bit = 0;
+		     (bit = ext4_find_next_zero_bit(bh->b_data, max, bit)) < max;
+		     bit++) {
+			blk = ext4_group_first_block_no(sb, group) + bit;
+			if (ext4_fc_region_claimed(sb, blk))
+				continue;
+			brelse(bh);
+			*errp = ext4_fc_mark_blocks(sb, blk, 1, true);
+			if (*errp)
+				return 0;
+			dquot_alloc_block_nofail(inode, 1);
+			return blk;
+		}
+		brelse(bh);
+	}
+
+	*errp = -ENOSPC;
+	return 0;
+}
+
+/* Stands in for ext4_free_blocks() while fast commits are replayed */
+void ext4_fc_replay_free_blocks(struct inode *inode, ext4_fsblk_t block,
+				unsigned long count)
+{
+	if (!ext4_fc_mark_blocks(inode->i_sb, block, count, false))
+		dquot_free_block(inode, count);
+}
+
+static int ext4_fc_record_region(struct super_block *sb, ext4_fsblk_t pblk,
+				 int len)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	struct ext4_fc_alloc_region *region;
+
+	if (state->fc_regions_used == state->fc_regions_size) {
+		region = krealloc(state->fc_regions,
+				  (state->fc_regions_size + 32) *
+				  sizeof(*region), GFP_KERNEL);
+		if (!region)
+			return -ENOMEM;
+		state->fc_regions = region;
+		state->fc_regions_size += 32;
+	}
+	region = &state->fc_regions[state->fc_regions_used++];
+	region->pblk = pblk;
+	region->len = len;
+	return 0;
+}
+
+/* Inodes whose i_blocks and block bitmap bits are fixed up at the end */
+static int ext4_fc_record_modified_inode(struct super_block *sb,
+					 unsigned long ino)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	unsigned long *inos;
+	int i;
+
+	for (i = 0; i < state->fc_modified_inodes_used; i++)
+		if (state->fc_modified_inodes[i] == ino)
+			return 0;
+
+	if (state->fc_modified_inodes_used == state->fc_modified_inodes_size) {
+		inos = krealloc(state->fc_modified_inodes,
+				(state->fc_modified_inodes_size + 32) *
+				sizeof(*inos), GFP_KERNEL);
+		if (!inos)
+			return -ENOMEM;
+		state->fc_modified_inodes = inos;
+		state->fc_modified_inodes_size += 32;
+	}
+	state->fc_modified_inodes[state->fc_modified_inodes_used++] = ino;
+	return 0;
+}
+
+static struct buffer_head *ext4_fc_get_raw_inode(struct super_block *sb,
+						 unsigned long ino,
+						 struct ext4_inode **raw)
+{
+	unsigned long index = (ino - 1) % EXT4_INODES_PER_GROUP(sb);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+
+	gdp = ext4_get_group_desc(sb, (ino - 1) / EXT4_INODES_PER_GROUP(sb),
+				  NULL);
+	if (!gdp)
+		return ERR_PTR(-EFSCORRUPTED);
+
+	bh = sb_getblk(sb, ext4_inode_table(sb, gdp) +
+			   index / EXT4_INODES_PER_BLOCK(sb));
+	if (unlikely(!bh))
+		return ERR_PTR(-ENOMEM);
+	if (bh_submit_read(bh) < 0) {
+		brelse(bh);
+		return ERR_PTR(-EIO);
+	}
+	*raw = (struct ext4_inode *)(bh->b_data +
+		(index % EXT4_INODES_PER_BLOCK(sb)) * EXT4_INODE_SIZE(sb));
+	return bh;
+}
+
+static bool ext4_fc_inode_valid(struct super_block *sb, unsigned long ino)
+{
+	return ino >= EXT4_FIRST_INO(sb) &&
+		ino <= le32_to_cpu(EXT4_SB(sb)->s_es->s_inodes_count);
+}
+
+/*
+ * Orphan-list handling is left to orphan cleanup, which runs after
+ * replay, so unlinked inodes just need to be on the list.
+ */
+static bool ext4_fc_orphan_listed(struct super_block *sb, unsigned long ino)
+{
+	struct ext4_super_block *es = EXT4_SB(sb)->s_es;
+	unsigned long next = le32_to_cpu(es->s_last_orphan);
+	unsigned int n = le32_to_cpu(es->s_inodes_count);
+	struct ext4_inode *raw;
+	struct buffer_head *bh;
+
+	while (next && n--) {
+		if (next == ino)
+			return true;
+		if (!ext4_fc_inode_valid(sb, next))
+			break;
+		bh = ext4_fc_get_raw_inode(sb, next, &raw);
+		if (IS_ERR(bh))
+			break;
+		next = le32_to_cpu(raw->i_dtime);
+		brelse(bh);
+	}
+	return false;
+}
+
+static int ext4_fc_replay_inode(struct super_block *sb, u8 *val, int len)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode *raw_fc_inode, *raw_inode;
+	struct ext4_extent_header *eh;
+	struct ext4_fc_inode fc_inode;
+	__le32 old_i_block[EXT4_N_BLOCKS];
+	__le32 old_flags = 0, old_dtime = 0;
+	struct buffer_head *bh;
+	struct inode *inode;
+	unsigned long ino;
+	int in_use, ret;
+
+	memcpy(&fc_inode, val, sizeof(fc_inode));
+	ino = le32_to_cpu(fc_inode.fc_ino);
+	raw_fc_inode = (struct ext4_inode *)(val + sizeof(fc_inode));
+	if (!ext4_fc_inode_valid(sb, ino))
+		return -EFSCORRUPTED;
+
+	in_use = ext4_fc_inode_in_use(sb, ino);
+	if (in_use < 0)
+		return in_use;
+
+	bh = ext4_fc_get_raw_inode(sb, ino, &raw_inode);
+	if (IS_ERR(bh))
+		return PTR_ERR(bh);
+	if (in_use) {
+		memcpy(old_i_block, raw_inode->i_block, sizeof(old_i_block));
+		old_flags = raw_inode->i_flags;
+		old_dtime = raw_inode->i_dtime;
+	}
+
+	memcpy(raw_inode, raw_fc_inode, EXT4_INODE_SIZE(sb));
+
+	/* the extent tree is rebuilt from the range records */
+	if (raw_inode->i_flags & cpu_to_le32(EXT4_EXTENTS_FL)) {
+		if (old_flags & cpu_to_le32(EXT4_EXTENTS_FL)) {
+			memcpy(raw_inode->i_block, old_i_block,
+			       sizeof(old_i_block));
+		} else {
+			memset(raw_inode->i_block, 0,
+			       sizeof(raw_inode->i_block));
+			eh = (struct ext4_extent_header *)raw_inode->i_block;
+			eh->eh_magic = EXT4_EXT_MAGIC;
+			eh->eh_max = cpu_to_le16((sizeof(raw_inode->i_block) -
+						  sizeof(*eh)) /
+						 sizeof(struct ext4_extent));
+		}
+	}
+
+	/* i_dtime links the orphan list on disk */
+	raw_inode->i_dtime = old_dtime;
+	if (!raw_inode->i_links_count && !ext4_fc_orphan_listed(sb, ino)) {
+		raw_inode->i_dtime = sbi->s_es->s_last_orphan;
+		sbi->s_es->s_last_orphan = cpu_to_le32(ino);
+		ext4_superblock_csum_set(sb);
+		mark_buffer_dirty(sbi->s_sbh);
+	}
+	mark_buffer_dirty(bh);
+	brelse(bh);
+
+	ret = ext4_fc_mark_inode_used(sb, ino,
+			S_ISDIR(le16_to_cpu(raw_fc_inode->i_mode)));
+	if (ret)
+		return ret;
+
+	inode = ext4_iget(sb, ino);
+	if (IS_ERR(inode))
+		return PTR_ERR(inode);
+	if (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS))
+		ret = ext4_fc_record_modified_inode(sb, ino);
+	/* rewrite the inode with a valid checksum */
+	if (!ret)
+		ret = ext4_mark_inode_dirty(NULL, inode);
+	iput(inode);
+	return ret;
+}
+
+/* Get an inode that range records apply to, or NULL to skip them */
+static struct inode *ext4_fc_replay_iget(struct super_block *sb,
+					 unsigned long ino)
+{
+	struct inode *inode;
+	int ret;
+
+	if (!ext4_fc_inode_valid(sb, ino))
+		return ERR_PTR(-EFSCORRUPTED);
+
+	/* an O_TMPFILE that never got linked, gone after orphan cleanup */
+	ret = ext4_fc_inode_in_use(sb, ino);
+	if (ret <= 0)
+		return ERR_PTR(ret);
+
+	inode = ext4_iget(sb, ino);
+	if (IS_ERR(inode))
+		return inode;
+	if (!ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
+		iput(inode);
+		return ERR_PTR(-EFSCORRUPTED);
+	}
+	ret = ext4_fc_record_modified_inode(sb, ino);
+	if (ret) {
+		iput(inode);
+		return ERR_PTR(ret);
+	}
+	return inode;
+}
+
+static int ext4_fc_replay_add_range(struct super_block *sb, u8 *val, int len)
+{
+	struct ext4_fc_add_range fc_add_ex;
+	struct ext4_extent newex, *ex;
+	struct ext4_ext_path *path;
+	struct ext4_map_blocks map;
+	struct inode *inode;
+	ext4_lblk_t lblk, cur;
+	ext4_fsblk_t pblk;
+	unsigned int ex_len;
+	bool unwritten;
+	int ret = 0;
+
+	memcpy(&fc_add_ex, val, sizeof(fc_add_ex));
+	ex = (struct ext4_extent *)fc_add_ex.fc_ex;
+	lblk = le32_to_cpu(ex->ee_block);
+	ex_len = ext4_ext_get_actual_len(ex);
+	pblk = ext4_ext_pblock(ex);
+	unwritten = ext4_ext_is_unwritten(ex);
+
+	if (!ext4_data_block_valid(EXT4_SB(sb), pblk, ex_len))
+		return -EFSCORRUPTED;
+
+	inode = ext4_fc_replay_iget(sb, le32_to_cpu(fc_add_ex.fc_ino));
+	if (IS_ERR_OR_NULL(inode))
+		return PTR_ERR(inode);
+
+	/* nothing to do if the blocks are already mapped this way */
+	for (cur = lblk; cur < lblk + ex_len; cur += map.m_len) {
+		map.m_lblk = cur;
+		map.m_len = lblk + ex_len - cur;
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			goto out;
+		if (ret == 0 || map.m_pblk != pblk + cur - lblk ||
+		    !!(map.m_flags & EXT4_MAP_UNWRITTEN) != unwritten)
+			break;
+	}
+	ret = 0;
+	if (cur >= lblk + ex_len)
+		goto out;
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ret = ext4_es_remove_extent(inode, lblk, ex_len);
+	if (!ret)
+		ret = ext4_ext_remove_space(inode, lblk, lblk + ex_len - 1);
+	if (!ret) {
+		newex = *ex;
+		path = ext4_find_extent(inode, lblk, NULL, 0);
+		if (IS_ERR(path)) {
+			ret = PTR_ERR(path);
+		} else {
+			ret = ext4_ext_insert_extent(NULL, inode, &path,
+						     &newex, 0);
+			ext4_ext_drop_refs(path);
+			kfree(path);
+		}
+	}
+	up_write(&EXT4_I(inode)->i_data_sem);
+	if (!ret)
+		ret = ext4_fc_mark_blocks(sb, pblk, ex_len, true);
+out:
+	iput(inode);
+	return ret;
+}
+
+static int ext4_fc_replay_del_range(struct super_block *sb, u8 *val, int len)
+{
+	struct ext4_fc_del_range lrange;
+	struct inode *inode;
+	ext4_lblk_t lblk;
+	u32 nr;
+	int ret;
+
+	memcpy(&lrange, val, sizeof(lrange));
+	lblk = le32_to_cpu(lrange.fc_lblk);
+	nr = le32_to_cpu(lrange.fc_len);
+
+	inode = ext4_fc_replay_iget(sb, le32_to_cpu(lrange.fc_ino));
+	if (IS_ERR_OR_NULL(inode))
+		return PTR_ERR(inode);
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ret = ext4_es_remove_extent(inode, lblk, nr);
+	if (!ret)
+		ret = ext4_ext_remove_space(inode, lblk, lblk + nr - 1);
+	up_write(&EXT4_I(inode)->i_data_sem);
+
+	iput(inode);
+	return ret;
+}
+
+static int ext4_fc_replay_dentry(struct super_block *sb, int tag, u8 *val,
+				 int len)
+{
+	struct ext4_fc_dentry_info fcdi;
+	struct inode *dir, *inode;
+	struct qstr name;
+	unsigned long ino;
+	int ret;
+
+	memcpy(&fcdi, val, sizeof(fcdi));
+	ino = le32_to_cpu(fcdi.fc_ino);
+	name.name = val + sizeof(fcdi);
+	name.len = len - sizeof(fcdi);
+
+	dir = ext4_iget(sb, le32_to_cpu(fcdi.fc_parent_ino));
+	if (IS_ERR(dir))
+		return PTR_ERR(dir);
+	if (!S_ISDIR(dir->i_mode)) {
+		iput(dir);
+		return -EFSCORRUPTED;
+	}
+
+	if (tag == EXT4_FC_TAG_UNLINK) {
+		ret = ext4_fc_replay_del_entry(dir, &name, ino);
+	} else {
+		inode = ext4_iget(sb, ino);
+		if (IS_ERR(inode)) {
+			iput(dir);
+			return PTR_ERR(inode);
+		}
+		ret = ext4_fc_replay_add_entry(dir, &name, inode);
+		iput(inode);
+	}
+	iput(dir);
+	return ret;
+}
+
+/*
+ * Set i_blocks and mark the blocks of an inode in use: the extent tree
+ * blocks allocated at run time aren't the ones replay allocated, and
+ * blocks may have been freed again by a later record of another file.
+ */
+static int ext4_fc_replay_fix_inode(struct inode *inode)
+{
+	ext4_fsblk_t prev[EXT4_MAX_EXTENT_DEPTH + 1] = { 0 };
+	struct super_block *sb = inode->i_sb;
+	struct ext4_ext_path *path;
+	struct ext4_map_blocks map;
+	ext4_lblk_t cur = 0;
+	blkcnt_t nblocks = 0;
+	int i, depth, ret = 0;
+
+	while (cur < EXT_MAX_BLOCKS) {
+		down_read(&EXT4_I(inode)->i_data_sem);
+		path = ext4_find_extent(inode, cur, NULL, 0);
+		if (IS_ERR(path)) {
+			up_read(&EXT4_I(inode)->i_data_sem);
+			return PTR_ERR(path);
+		}
+		depth = min(ext_depth(inode), EXT4_MAX_EXTENT_DEPTH);
+		for (i = 1; i <= depth && !ret; i++) {
+			if (!path[i].p_bh ||
+			    path[i].p_bh->b_blocknr == prev[i])
+				continue;
+			prev[i] = path[i].p_bh->b_blocknr;
+			nblocks++;
+			ret = ext4_fc_mark_blocks(sb, prev[i], 1, true);
+		}
+		ext4_ext_drop_refs(path);
+		kfree(path);
+		up_read(&EXT4_I(inode)->i_data_sem);
+		if (ret)
+			return ret;
+
+		map.m_lblk = cur;
+		map.m_len = EXT_MAX_BLOCKS - cur;
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			return ret;
+		if (ret > 0) {
+			nblocks += map.m_len;
+			ret = ext4_fc_mark_blocks(sb, map.m_pblk, map.m_len,
+						  true);
+			if (ret)
+				return ret;
+		}
+		if (!map.m_len)
+			break;
+		cur += map.m_len;
+	}
+
+	if (EXT4_I(inode)->i_file_acl)
+		nblocks++;
+	inode->i_blocks = nblocks << (sb->s_blocksize_bits - 9);
+	return ext4_mark_inode_dirty(NULL, inode);
+}
+
+static int ext4_fc_replay_finish(struct super_block *sb)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	struct inode *inode;
+	int i, ret;
+
+	for (i = 0; i < state->fc_modified_inodes_used; i++) {
+		inode = ext4_iget(sb, state->fc_modified_inodes[i]);
+		if (IS_ERR(inode))
+			continue;
+		ret = ext4_fc_replay_fix_inode(inode);
+		iput(inode);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* Check that a tag fits the block and has a sane length */
+static bool ext4_fc_tag_valid(struct super_block *sb, u16 tag, u8 *val,
+			      int len)
+{
+	struct ext4_fc_add_range fc_add_ex;
+	struct ext4_fc_del_range lrange;
+	struct ext4_extent *ex;
+
+	switch (tag) {
+	case EXT4_FC_TAG_ADD_RANGE:
+		if (len != sizeof(fc_add_ex))
+			return false;
+		memcpy(&fc_add_ex, val, len);
+		ex = (struct ext4_extent *)fc_add_ex.fc_ex;
+		return ext4_ext_get_actual_len(ex) &&
+			(u64)le32_to_cpu(ex->ee_block) +
+			ext4_ext_get_actual_len(ex) <= EXT_MAX_BLOCKS;
+	case EXT4_FC_TAG_DEL_RANGE:
+		if (len != sizeof(lrange))
+			return false;
+		memcpy(&lrange, val, len);
+		return lrange.fc_len &&
+			(u64)le32_to_cpu(lrange.fc_lblk) +
+			le32_to_cpu(lrange.fc_len) <= EXT_MAX_BLOCKS;
+	case EXT4_FC_TAG_CREAT:
+	case EXT4_FC_TAG_LINK:
+	case EXT4_FC_TAG_UNLINK:
+		return len > sizeof(struct ext4_fc_dentry_info) &&
+			len - sizeof(struct ext4_fc_dentry_info) <=
+			EXT4_NAME_LEN;
+	case EXT4_FC_TAG_INODE:
+		return len == sizeof(struct ext4_fc_inode) +
+			EXT4_INODE_SIZE(sb);
+	case EXT4_FC_TAG_HEAD:
+		return len == sizeof(struct ext4_fc_head);
+	case EXT4_FC_TAG_TAIL:
+		return len >= sizeof(struct ext4_fc_tail);
+	case EXT4_FC_TAG_PAD:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Scan pass: verify the fast commits and count the tags of the valid
+ * ones, collecting the blocks they claim on the way.
+ */
+static int ext4_fc_replay_scan(struct super_block *sb, struct buffer_head *bh,
+			       int off, tid_t expected_tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_replay_state *state = &sbi->s_fc_replay_state;
+	u8 *start = bh->b_data, *end = start + sb->s_blocksize, *cur, *val;
+	struct ext4_fc_add_range fc_add_ex;
+	struct ext4_fc_head head;
+	struct ext4_fc_tail tail;
+	struct ext4_extent *ex;
+	struct ext4_fc_tl tl;
+	int len, ret;
+	u16 tag;
+
+	if (off != state->fc_replay_expected_off)
+		return JBD2_FC_REPLAY_STOP;
+	state->fc_replay_expected_off++;
+
+	for (cur = start; end - cur >= sizeof(tl); cur = val + len) {
+		memcpy(&tl, cur, sizeof(tl));
+		tag = le16_to_cpu(tl.fc_tag);
+		len = le16_to_cpu(tl.fc_len);
+		val = cur + sizeof(tl);
+		if (end - val < len || !ext4_fc_tag_valid(sb, tag, val, len))
+			return JBD2_FC_REPLAY_STOP;
+		/* the area starts with a head, and only there */
+		if ((off == 0 && cur == start) != (tag == EXT4_FC_TAG_HEAD))
+			return JBD2_FC_REPLAY_STOP;
+
+		state->fc_cur_tags++;
+		switch (tag) {
+		case EXT4_FC_TAG_HEAD:
+			memcpy(&head, val, sizeof(head));
+			if (le32_to_cpu(head.fc_tid) != expected_tid)
+				return JBD2_FC_REPLAY_STOP;
+			if (le32_to_cpu(head.fc_features) &
+			    ~EXT4_FC_SUPPORTED_FEATURES)
+				return -EOPNOTSUPP;
+			break;
+		case EXT4_FC_TAG_ADD_RANGE:
+			memcpy(&fc_add_ex, val, sizeof(fc_add_ex));
+			ex = (struct ext4_extent *)fc_add_ex.fc_ex;
+			ret = ext4_fc_record_region(sb, ext4_ext_pblock(ex),
+						ext4_ext_get_actual_len(ex));
+			if (ret)
+				return ret;
+			break;
+		case EXT4_FC_TAG_TAIL:
+			memcpy(&tail, val, sizeof(tail));
+			state->fc_crc = ext4_chksum(sbi, state->fc_crc, cur,
+					sizeof(tl) + sizeof(tail.fc_tid));
+			if (le32_to_cpu(tail.fc_tid) != expected_tid ||
+			    le32_to_cpu(tail.fc_crc) != state->fc_crc)
+				return JBD2_FC_REPLAY_STOP;
+			state->fc_replay_num_tags += state->fc_cur_tags;
+			state->fc_cur_tags = 0;
+			state->fc_crc = 0;
+			continue;
+		}
+		state->fc_crc = ext4_chksum(sbi, state->fc_crc, cur,
+					    sizeof(tl) + len);
+	}
+	return JBD2_FC_REPLAY_CONTINUE;
+}
+
+/* Replay pass: apply the tags counted by the scan pass */
+static int ext4_fc_replay_tags(struct super_block *sb, struct buffer_head *bh)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	u8 *start = bh->b_data, *end = start + sb->s_blocksize, *cur, *val;
+	struct ext4_fc_tl tl;
+	int len, ret = 0;
+	u16 tag;
+
+	for (cur = start; end - cur >= sizeof(tl); cur = val + len) {
+		memcpy(&tl, cur, sizeof(tl));
+		tag = le16_to_cpu(tl.fc_tag);
+		len = le16_to_cpu(tl.fc_len);
+		val = cur + sizeof(tl);
+
+		switch (tag) {
+		case EXT4_FC_TAG_ADD_RANGE:
+			ret = ext4_fc_replay_add_range(sb, val, len);
+			break;
+		case EXT4_FC_TAG_DEL_RANGE:
+			ret = ext4_fc_replay_del_range(sb, val, len);
+			break;
+		case EXT4_FC_TAG_CREAT:
+		case EXT4_FC_TAG_LINK:
+		case EXT4_FC_TAG_UNLINK:
+			ret = ext4_fc_replay_dentry(sb, tag, val, len);
+			break;
+		case EXT4_FC_TAG_INODE:
+			ret = ext4_fc_replay_inode(sb, val, len);
+			break;
+		}
+		if (ret < 0) {
+			ext4_msg(sb, KERN_ERR,
+				 "fast commit replay of tag %u failed: %d",
+				 tag, ret);
+			return ret;
+		}
+
+		if (--state->fc_replay_num_tags == 0) {
+			ret = ext4_fc_replay_finish(sb);
+			return ret < 0 ? ret : JBD2_FC_REPLAY_STOP;
+		}
+	}
+	return JBD2_FC_REPLAY_CONTINUE;
+}
+
+/**
+ * ext4_fc_replay() - jbd2 fast commit replay callback
+ * @journal: the journal being recovered
+ * @bh: a block of the fast commit area
+ * @pass: PASS_SCAN or PASS_REPLAY
+ * @off: offset of @bh in the fast commit area
+ * @expected_tid: the tid following the last full commit
+ *
+ * Return: JBD2_FC_REPLAY_CONTINUE for the next block, JBD2_FC_REPLAY_STOP
+ * when done, or a negative errno.
+ */
+int ext4_fc_replay(journal_t *journal, struct buffer_head *bh, int pass,
+		   int off, tid_t expected_tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_replay_state *state = &sbi->s_fc_replay_state;
+	bool rdonly = sb_rdonly(sb);
+	int ret;
+
+	if (pass == PASS_SCAN) {
+		if (off == 0) {
+			state->fc_replay_num_tags = 0;
+			state->fc_cur_tags = 0;
+			state->fc_replay_expected_off = 0;
+			state->fc_crc = 0;
+			state->fc_regions_used = 0;
+			state->fc_modified_inodes_used = 0;
+		}
+		return ext4_fc_replay_scan(sb, bh, off, expected_tid);
+	}
+
+	if (pass != PASS_REPLAY || !state->fc_replay_num_tags)
+		return JBD2_FC_REPLAY_STOP;
+
+	/* ext4 only writes with the filesystem writable */
+	sbi->s_mount_state |= EXT4_FC_REPLAY;
+	sb->s_flags &= ~SB_RDONLY;
+	ret = ext4_fc_replay_tags(sb, bh);
+	if (rdonly)
+		sb->s_flags |= SB_RDONLY;
+	sbi->s_mount_state &= ~EXT4_FC_REPLAY;
+	return ret;
+}
+
+/* Free the replay state once the journal is loaded */
+void ext4_fc_replay_cleanup(struct super_block *sb)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+
+	kfree(state->fc_regions);
+	kfree(state->fc_modified_inodes);
+	memset(state, 0, sizeof(*state));
+}
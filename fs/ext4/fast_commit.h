@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  fs/ext4/fast_commit.h
+ *
+ * On-disk format and in-memory state of ext4 fast commits.
+ */
+
+#ifndef __FAST_COMMIT_H__
+#define __FAST_COMMIT_H__
+
+/*
+ * A fast commit is a sequence of tag-length-value records written to the
+ * fast commit area at the end of the journal.  Tags never cross a block
+ * boundary; the unused end of a block is covered by a PAD tag, or left
+ * zeroed if it can't even hold a tag header.  A fast commit ends with a
+ * TAIL tag covering the rest of its block, so the next one starts on a new
+ * block.  The HEAD tag only appears at the start of the area.
+ */
+#define EXT4_FC_TAG_ADD_RANGE		0x0001
+#define EXT4_FC_TAG_DEL_RANGE		0x0002
+#define EXT4_FC_TAG_CREAT		0x0003
+#define EXT4_FC_TAG_LINK		0x0004
+#define EXT4_FC_TAG_UNLINK		0x0005
+#define EXT4_FC_TAG_INODE		0x0006
+#define EXT4_FC_TAG_PAD			0x0007
+#define EXT4_FC_TAG_TAIL		0x0008
+#define EXT4_FC_TAG_HEAD		0x0009
+
+#define EXT4_FC_SUPPORTED_FEATURES	0x0
+
+/* On-disk fast commit tlv value structures */
+
+/* Fast commit on-disk tag length structure */
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;
+};
+
+/* Value structure for tag EXT4_FC_TAG_HEAD. */
+struct ext4_fc_head {
+	__le32 fc_features;
+	__le32 fc_tid;
+};
+
+/* Value structure for EXT4_FC_TAG_ADD_RANGE. */
+struct ext4_fc_add_range {
+	__le32 fc_ino;
+	__u8 fc_ex[12];		/* struct ext4_extent */
+};
+
+/* Value structure for tag EXT4_FC_TAG_DEL_RANGE. */
+struct ext4_fc_del_range {
+	__le32 fc_ino;
+	__le32 fc_lblk;
+	__le32 fc_len;
+};
+
+/*
+ * This is the value structure for tags EXT4_FC_TAG_CREAT, EXT4_FC_TAG_LINK
+ * and EXT4_FC_TAG_UNLINK.
+ */
+struct ext4_fc_dentry_info {
+	__le32 fc_parent_ino;
+	__le32 fc_ino;
+	__u8 fc_dname[0];
+};
+
+/* Value structure for EXT4_FC_TAG_INODE. */
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__u8 fc_raw_inode[0];
+};
+
+/*
+ * Value structure for tag EXT4_FC_TAG_TAIL.  fc_crc covers all tags since
+ * the previous tail, and the tag header and fc_tid of this one.
+ */
+struct ext4_fc_tail {
+	__le32 fc_tid;
+	__le32 fc_crc;
+};
+
+/* Reasons for falling back to a full commit */
+enum {
+	EXT4_FC_REASON_XATTR = 0,
+	EXT4_FC_REASON_RENAME,
+	EXT4_FC_REASON_DIR_OP,
+	EXT4_FC_REASON_JOURNAL_FLAG_CHANGE,
+	EXT4_FC_REASON_INODE_UNSUPP,
+	EXT4_FC_REASON_ENCRYPTED_DIR,
+	EXT4_FC_REASON_FALLOC_RANGE,
+	EXT4_FC_REASON_RESIZE,
+	EXT4_FC_REASON_SWAP_BOOT,
+	EXT4_FC_REASON_MOVE_EXT,
+	EXT4_FC_REASON_MIGRATE,
+	EXT4_FC_REASON_EVICT,
+	EXT4_FC_REASON_NOMEM,
+	EXT4_FC_REASON_FAILED,
+	EXT4_FC_REASON_MAX
+};
+
+struct ext4_fc_stats {
+	unsigned int fc_ineligible_reason_count[EXT4_FC_REASON_MAX];
+	unsigned long fc_num_commits;
+	unsigned long fc_ineligible_commits;
+	unsigned long fc_numblks;
+};
+
+/* A directory entry update waiting for the next fast commit */
+struct ext4_fc_dentry_update {
+	struct list_head fcd_list;
+	int fcd_op;			/* EXT4_FC_TAG_{CREAT,LINK,UNLINK} */
+	tid_t fcd_tid;
+	unsigned long fcd_parent;
+	unsigned long fcd_ino;
+	unsigned int fcd_name_len;
+	unsigned char fcd_name[0];
+};
+
+/* A physical extent allocated by the fast commits being replayed */
+struct ext4_fc_alloc_region {
+	ext4_fsblk_t pblk;
+	int len;
+};
+
+/* Fast commit replay state, see ext4_fc_replay() */
+struct ext4_fc_replay_state {
+	int fc_replay_num_tags;		/* Tags left to replay */
+	int fc_cur_tags;		/* Tags since the last valid tail */
+	int fc_replay_expected_off;	/* Next block expected */
+	u32 fc_crc;
+	struct ext4_fc_alloc_region *fc_regions;
+	int fc_regions_size, fc_regions_used;
+	unsigned long *fc_modified_inodes;
+	int fc_modified_inodes_size, fc_modified_inodes_used;
+};
+
+#endif /* __FAST_COMMIT_H__ */
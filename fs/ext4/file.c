@@ -33,6 +33,7 @@
 #include "ext4_jbd2.h"
 #include "xattr.h"
 #include "acl.h"
+#include "truncate.h"
 
 #ifdef CONFIG_FS_DAX
 static ssize_t ext4_dax_read_iter(struct kiocb *iocb, struct iov_iter *to)
@@ -62,6 +63,52 @@ static ssize_t ext4_dax_read_iter(struct kiocb *iocb, struct iov_iter *to)
 }
 #endif
 
+/*
+ * Direct I/O goes straight to the blocks, so it can't be used when the data
+ * has to pass through the journal, be encrypted or live in the inode.
+ */
+static bool ext4_dio_supported(struct inode *inode)
+{
+	if (ext4_encrypted_inode(inode))
+		return false;
+	if (ext4_should_journal_data(inode))
+		return false;
+	if (ext4_has_inline_data(inode))
+		return false;
+	return true;
+}
+
+static ssize_t ext4_dio_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct inode *inode = file_inode(iocb->ki_filp);
+	ssize_t ret;
+
+	/*
+	 * Shared inode_lock is enough for us - it protects against concurrent
+	 * writes & truncates and iomap_dio_rw() writes back the page cache,
+	 * so we are protected against page writeback as well.
+	 */
+	if (!inode_trylock_shared(inode)) {
+		if (iocb->ki_flags & IOCB_NOWAIT)
+			return -EAGAIN;
+		inode_lock_shared(inode);
+	}
+
+	if (!ext4_dio_supported(inode)) {
+		inode_unlock_shared(inode);
+		/* Fallback to buffered IO, without its direct IO path */
+		iocb->ki_flags &= ~IOCB_DIRECT;
+		return generic_file_read_iter(iocb, to);
+	}
+
+	ret = iomap_dio_rw(iocb, to, &ext4_iomap_ops, NULL,
+			   is_sync_kiocb(iocb));
+	inode_unlock_shared(inode);
+
+	file_accessed(iocb->ki_filp);
+	return ret;
+}
+
 static ssize_t ext4_file_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
 	if (unlikely(ext4_forced_shutdown(EXT4_SB(file_inode(iocb->ki_filp)->i_sb))))
@@ -74,6 +121,8 @@ static ssize_t ext4_file_read_iter(struct kiocb *iocb, struct iov_iter *to)
 	if (IS_DAX(file_inode(iocb->ki_filp)))
 		return ext4_dax_read_iter(iocb, to);
 #endif
+	if (iocb->ki_flags & IOCB_DIRECT)
+		return ext4_dio_read_iter(iocb, to);
 	return generic_file_read_iter(iocb, to);
 }
 
@@ -103,21 +152,14 @@ static int ext4_release_file(struct inode *inode, struct file *filp)
 	return 0;
 }
 
-static void ext4_unwritten_wait(struct inode *inode)
-{
-	wait_queue_head_t *wq = ext4_ioend_wq(inode);
-
-	wait_event(*wq, (atomic_read(&EXT4_I(inode)->i_unwritten) == 0));
-}
-
 /*
  * This tests whether the IO in question is block-aligned or not.
  * Ext4 utilizes unwritten extents when hole-filling during direct IO, and they
  * are converted to written only after the IO is complete.  Until they are
- * mapped, these blocks appear as holes, so dio_zero_block() will assume that
- * it needs to zero out portions of the start and/or end block.  If 2 AIO
- * threads are at work on the same unwritten block, they must be synchronized
- * or one thread will zero the other's data, causing corruption.
+ * converted, the direct IO code zeroes the unwritten parts of the start and
+ * end block.  If 2 AIO threads are at work on the same unwritten block, they
+ * must be synchronized or one thread will zero the other's data, causing
+ * corruption.
  */
 static int
 ext4_unaligned_aio(struct inode *inode, struct iov_iter *from, loff_t pos)
@@ -176,58 +218,133 @@ static ssize_t ext4_write_checks(struct kiocb *iocb, struct iov_iter *from)
 			return -EFBIG;
 		iov_iter_truncate(from, sbi->s_bitmap_maxbytes - iocb->ki_pos);
 	}
+
+	ret = file_remove_privs(iocb->ki_filp);
+	if (ret)
+		return ret;
+	ret = file_update_time(iocb->ki_filp);
+	if (ret)
+		return ret;
 	return iov_iter_count(from);
 }
 
-#ifdef CONFIG_FS_DAX
-static ssize_t
-ext4_dax_write_iter(struct kiocb *iocb, struct iov_iter *from)
+static ssize_t ext4_buffered_write_iter(struct kiocb *iocb,
+					struct iov_iter *from)
 {
 	struct inode *inode = file_inode(iocb->ki_filp);
 	ssize_t ret;
 
-	if (!inode_trylock(inode)) {
-		if (iocb->ki_flags & IOCB_NOWAIT)
-			return -EAGAIN;
-		inode_lock(inode);
-	}
+	if (iocb->ki_flags & IOCB_NOWAIT)
+		return -EOPNOTSUPP;
+
+	inode_lock(inode);
 	ret = ext4_write_checks(iocb, from);
 	if (ret <= 0)
 		goto out;
-	ret = file_remove_privs(iocb->ki_filp);
-	if (ret)
-		goto out;
-	ret = file_update_time(iocb->ki_filp);
-	if (ret)
-		goto out;
 
-	ret = dax_iomap_rw(iocb, from, &ext4_iomap_ops);
+	current->backing_dev_info = inode_to_bdi(inode);
+	ret = generic_perform_write(iocb->ki_filp, from, iocb->ki_pos);
+	current->backing_dev_info = NULL;
 out:
 	inode_unlock(inode);
-	if (ret > 0)
+	if (likely(ret > 0)) {
+		iocb->ki_pos += ret;
 		ret = generic_write_sync(iocb, ret);
+	}
 	return ret;
 }
-#endif
 
-static ssize_t
-ext4_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
+/*
+ * Finish a direct IO write that went beyond i_disksize: truncate blocks that
+ * were allocated past what was actually written and take the inode off the
+ * orphan list ext4_dio_write_iter() put it on.
+ */
+static ssize_t ext4_handle_inode_extension(struct inode *inode, loff_t offset,
+					   ssize_t written, size_t count)
+{
+	u8 blkbits = inode->i_blkbits;
+	handle_t *handle;
+
+	/*
+	 * We may need to truncate allocated but not written blocks beyond EOF.
+	 */
+	if (written < 0 || (ALIGN(offset + written, 1 << blkbits) <
+			    ALIGN(offset + count, 1 << blkbits) &&
+			    ext4_can_truncate(inode))) {
+		ext4_truncate_failed_write(inode);
+		goto orphan_del;
+	}
+
+	/*
+	 * Remove inode from orphan list if we were extending a inode and
+	 * everything went fine.
+	 */
+	if (!inode->i_nlink)
+		return written;
+	handle = ext4_journal_start(inode, EXT4_HT_INODE, 2);
+	if (IS_ERR(handle)) {
+		if (!written)
+			written = PTR_ERR(handle);
+		goto orphan_del;
+	}
+	ext4_orphan_del(handle, inode);
+	ext4_journal_stop(handle);
+	return written;
+
+orphan_del:
+	/*
+	 * If truncate failed early the inode might still be on the orphan
+	 * list; we need to make sure the inode is removed from the orphan
+	 * list in that case.
+	 */
+	if (inode->i_nlink)
+		ext4_orphan_del(NULL, inode);
+	return written;
+}
+
+/*
+ * Called by iomap once a direct IO write is on disk, from process context
+ * also for AIO.  Convert the unwritten extents it went to and update the
+ * size of an extending write.  The latter has to happen here, before iomap
+ * invalidates the page cache and syncs O_[D]SYNC writes; it is safe because
+ * extending writes are waited for under an exclusive i_rwsem.
+ */
+static int ext4_dio_write_end_io(struct kiocb *iocb, ssize_t size,
+				 unsigned int flags)
 {
 	struct inode *inode = file_inode(iocb->ki_filp);
-	int o_direct = iocb->ki_flags & IOCB_DIRECT;
-	int unaligned_aio = 0;
-	int overwrite = 0;
-	ssize_t ret;
+	loff_t pos = iocb->ki_pos;
+	handle_t *handle;
+	int ret;
 
-	if (unlikely(ext4_forced_shutdown(EXT4_SB(inode->i_sb))))
-		return -EIO;
+	if (size <= 0)
+		return size;
 
-#ifdef CONFIG_FS_DAX
-	if (IS_DAX(inode))
-		return ext4_dax_write_iter(iocb, from);
-#endif
-	if (!o_direct && (iocb->ki_flags & IOCB_NOWAIT))
-		return -EOPNOTSUPP;
+	if (flags & IOMAP_DIO_UNWRITTEN) {
+		ret = ext4_convert_unwritten_extents(NULL, inode, pos, size);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (pos + size <= EXT4_I(inode)->i_disksize)
+		return 0;
+
+	handle = ext4_journal_start(inode, EXT4_HT_INODE, 1);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+	if (ext4_update_inode_size(inode, pos + size))
+		ext4_mark_inode_dirty(handle, inode);
+	return ext4_journal_stop(handle);
+}
+
+static ssize_t ext4_dio_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct inode *inode = file_inode(iocb->ki_filp);
+	bool extend, overwrite = false, unaligned_aio = false;
+	handle_t *handle;
+	loff_t offset;
+	size_t count;
+	ssize_t ret;
 
 	if (!inode_trylock(inode)) {
 		if (iocb->ki_flags & IOCB_NOWAIT)
@@ -235,46 +352,151 @@ ext4_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
 		inode_lock(inode);
 	}
 
+	if (!ext4_dio_supported(inode)) {
+		inode_unlock(inode);
+		/* Fallback to buffered IO in case we cannot support direct IO */
+		return ext4_buffered_write_iter(iocb, from);
+	}
+
 	ret = ext4_write_checks(iocb, from);
-	if (ret <= 0)
-		goto out;
+	if (ret <= 0) {
+		inode_unlock(inode);
+		return ret;
+	}
+	offset = iocb->ki_pos;
+	count = iov_iter_count(from);
 
 	/*
 	 * Unaligned direct AIO must be serialized among each other as zeroing
 	 * of partial blocks of two competing unaligned AIOs can result in data
-	 * corruption.
+	 * corruption.  Wait for the running ones here and have ours complete
+	 * before we drop i_rwsem.
 	 */
-	if (o_direct && ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) &&
-	    !is_sync_kiocb(iocb) &&
-	    ext4_unaligned_aio(inode, from, iocb->ki_pos)) {
-		unaligned_aio = 1;
-		ext4_unwritten_wait(inode);
+	if (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) &&
+	    !is_sync_kiocb(iocb) && ext4_unaligned_aio(inode, from, offset)) {
+		if (iocb->ki_flags & IOCB_NOWAIT) {
+			ret = -EAGAIN;
+			goto out;
+		}
+		unaligned_aio = true;
+		inode_dio_wait(inode);
 	}
 
-	iocb->private = &overwrite;
-	/* Check whether we do a DIO overwrite or not */
-	if (o_direct && !unaligned_aio) {
-		if (ext4_overwrite_io(inode, iocb->ki_pos, iov_iter_count(from))) {
-			if (ext4_should_dioread_nolock(inode))
-				overwrite = 1;
-		} else if (iocb->ki_flags & IOCB_NOWAIT) {
-			ret = -EAGAIN;
+	/*
+	 * Overwrites of allocated and initialized blocks neither allocate nor
+	 * convert extents, so they only need to be protected against truncate
+	 * and can run in parallel under a shared i_rwsem.  That doesn't hold
+	 * for writes past i_disksize, which update the size.
+	 */
+	extend = offset + count > EXT4_I(inode)->i_disksize;
+	if (!unaligned_aio && !extend &&
+	    ext4_overwrite_io(inode, offset, count)) {
+		if (ext4_should_dioread_nolock(inode)) {
+			overwrite = true;
+			downgrade_write(&inode->i_rwsem);
+		}
+	} else if (iocb->ki_flags & IOCB_NOWAIT) {
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	/*
+	 * If the write extends the file, add the inode to the orphan list so
+	 * that recovery truncates it back to the original size if we crash
+	 * during the write.  The size is only updated once the IO completed,
+	 * so extending AIO is waited for as well.
+	 */
+	if (extend) {
+		/* Credits for sb + inode write */
+		handle = ext4_journal_start(inode, EXT4_HT_INODE, 2);
+		if (IS_ERR(handle)) {
+			ret = PTR_ERR(handle);
 			goto out;
 		}
+		ret = ext4_orphan_add(handle, inode);
+		ext4_journal_stop(handle);
+		if (ret)
+			goto out;
 	}
 
-	ret = __generic_file_write_iter(iocb, from);
-	inode_unlock(inode);
+	ret = iomap_dio_rw(iocb, from, &ext4_iomap_ops, ext4_dio_write_end_io,
+			   is_sync_kiocb(iocb) || unaligned_aio || extend);
 
-	if (ret > 0)
-		ret = generic_write_sync(iocb, ret);
+	if (extend)
+		ret = ext4_handle_inode_extension(inode, offset, ret, count);
+out:
+	if (overwrite)
+		inode_unlock_shared(inode);
+	else
+		inode_unlock(inode);
 
+	/*
+	 * Whatever iomap could not write directly, e.g. holes in indirect
+	 * mapped files, is written through the page cache, which is then
+	 * written back and invalidated to keep direct IO semantics.
+	 */
+	if (ret >= 0 && iov_iter_count(from)) {
+		ssize_t err;
+		loff_t endbyte;
+
+		offset = iocb->ki_pos;
+		err = ext4_buffered_write_iter(iocb, from);
+		if (err < 0)
+			return err;
+
+		ret += err;
+		endbyte = offset + err - 1;
+		err = filemap_write_and_wait_range(iocb->ki_filp->f_mapping,
+						   offset, endbyte);
+		if (!err)
+			invalidate_mapping_pages(iocb->ki_filp->f_mapping,
+						 offset >> PAGE_SHIFT,
+						 endbyte >> PAGE_SHIFT);
+	}
 	return ret;
+}
+
+#ifdef CONFIG_FS_DAX
+static ssize_t
+ext4_dax_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct inode *inode = file_inode(iocb->ki_filp);
+	ssize_t ret;
+
+	if (!inode_trylock(inode)) {
+		if (iocb->ki_flags & IOCB_NOWAIT)
+			return -EAGAIN;
+		inode_lock(inode);
+	}
+	ret = ext4_write_checks(iocb, from);
+	if (ret <= 0)
+		goto out;
 
+	ret = dax_iomap_rw(iocb, from, &ext4_iomap_ops);
 out:
 	inode_unlock(inode);
+	if (ret > 0)
+		ret = generic_write_sync(iocb, ret);
 	return ret;
 }
+#endif
+
+static ssize_t
+ext4_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct inode *inode = file_inode(iocb->ki_filp);
+
+	if (unlikely(ext4_forced_shutdown(EXT4_SB(inode->i_sb))))
+		return -EIO;
+
+#ifdef CONFIG_FS_DAX
+	if (IS_DAX(inode))
+		return ext4_dax_write_iter(iocb, from);
+#endif
+	if (iocb->ki_flags & IOCB_DIRECT)
+		return ext4_dio_write_iter(iocb, from);
+	return ext4_buffered_write_iter(iocb, from);
+}
 
 #ifdef CONFIG_FS_DAX
 static vm_fault_t ext4_dax_huge_fault(struct vm_fault *vmf,
@@ -688,25 +688,98 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group.  With mb_optimize_scan the group is also kept on the list of groups
+ * of that order, which criteria 0 picks groups from.
+ * Must be called under group lock!
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	int i;
-	int bits;
 
-	grp->bb_largest_free_order = -1; /* uninit */
-
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
-		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--)
+		if (grp->bb_counters[i] > 0)
 			break;
-		}
+
+	if (!test_opt2(sb, MB_OPTIMIZE_SCAN) ||
+	    i == grp->bb_largest_free_order) {
+		grp->bb_largest_free_order = i;
+		return;
+	}
+
+	if (grp->bb_largest_free_order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+	}
+	grp->bb_largest_free_order = i;
+	if (i >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[i]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
 	}
 }
 
+static void
+ext4_mb_avg_fragment_size_insert(struct rb_root *root,
+				 struct ext4_group_info *grp)
+{
+	struct rb_node **n = &root->rb_node, *parent = NULL;
+	struct ext4_group_info *entry;
+
+	while (*n) {
+		parent = *n;
+		entry = rb_entry(parent, struct ext4_group_info,
+				 bb_avg_fragment_size_rb);
+		if (grp->bb_avg_fragment_size < entry->bb_avg_fragment_size ||
+		    (grp->bb_avg_fragment_size == entry->bb_avg_fragment_size &&
+		     grp->bb_group < entry->bb_group))
+			n = &(*n)->rb_left;
+		else
+			n = &(*n)->rb_right;
+	}
+	rb_link_node(&grp->bb_avg_fragment_size_rb, parent, n);
+	rb_insert_color(&grp->bb_avg_fragment_size_rb, root);
+}
+
+/*
+ * With mb_optimize_scan, keep the group in the tree of groups sorted by
+ * average free fragment size (and group number), which criteria 1 picks
+ * groups from.  Groups without free space are kept out of the tree.
+ * Must be called under group lock!
+ */
+static void
+mb_update_avg_fragment_size(struct super_block *sb, struct ext4_group_info *grp)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	bool queued = !RB_EMPTY_NODE(&grp->bb_avg_fragment_size_rb);
+	ext4_grpblk_t avg = 0;
+
+	if (!test_opt2(sb, MB_OPTIMIZE_SCAN))
+		return;
+
+	if (grp->bb_fragments)
+		avg = grp->bb_free / grp->bb_fragments;
+	if (queued ? avg == grp->bb_avg_fragment_size : avg == 0)
+		return;
+
+	write_lock(&sbi->s_mb_rb_lock);
+	if (queued) {
+		rb_erase(&grp->bb_avg_fragment_size_rb,
+			 &sbi->s_mb_avg_fragment_size_root);
+		RB_CLEAR_NODE(&grp->bb_avg_fragment_size_rb);
+	}
+	grp->bb_avg_fragment_size = avg;
+	if (avg)
+		ext4_mb_avg_fragment_size_insert(
+				&sbi->s_mb_avg_fragment_size_root, grp);
+	write_unlock(&sbi->s_mb_rb_lock);
+}
+
 static noinline_for_stack
 void ext4_mb_generate_buddy(struct super_block *sb,
 				void *buddy, void *bitmap, ext4_group_t group)
@@ -754,6 +827,7 @@ void ext4_mb_generate_buddy(struct super_block *sb,
 					EXT4_GROUP_INFO_BBITMAP_CORRUPT);
 	}
 	mb_set_largest_free_order(sb, grp);
+	mb_update_avg_fragment_size(sb, grp);
 
 	clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state));
 
@@ -1487,6 +1561,7 @@ static void mb_free_blocks(struct inode *inode, struct ext4_buddy *e4b,
 
 done:
 	mb_set_largest_free_order(sb, e4b->bd_info);
+	mb_update_avg_fragment_size(sb, e4b->bd_info);
 	mb_check_buddy(e4b);
 }
 
@@ -1621,6 +1696,7 @@ static int mb_mark_used(struct ext4_buddy *e4b, struct ext4_free_extent *ex)
 		e4b->bd_info->bb_counters[ord]++;
 	}
 	mb_set_largest_free_order(e4b->bd_sb, e4b->bd_info);
+	mb_update_avg_fragment_size(e4b->bd_sb, e4b->bd_info);
 
 	ext4_set_bits(e4b->bd_bitmap, ex->fe_start, len0);
 	mb_check_buddy(e4b);
@@ -2095,12 +2171,129 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * With mb_optimize_scan, criteria 0 and 1 don't walk the groups one by one:
+ * criteria 0 takes a group from the lists of orders at least as large as the
+ * request, criteria 1 looks up the groups whose average free fragment is at
+ * least as long as the goal.  Groups are picked without their lock, the
+ * caller checks them again under it.
+ */
+static bool ext4_mb_use_optimized_scan(struct ext4_allocation_context *ac,
+				       int cr)
+{
+	if (!test_opt2(ac->ac_sb, MB_OPTIMIZE_SCAN) || cr >= 2)
+		return false;
+	/* non-extent files are limited to low blocks/groups */
+	return ext4_test_inode_flag(ac->ac_inode, EXT4_INODE_EXTENTS);
+}
+
+/* Check a group before locking it, counting it for mb_stats */
+static int ext4_mb_good_group_nolock(struct ext4_allocation_context *ac,
+				     ext4_group_t group, int cr)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+
+	if (sbi->s_mb_stats)
+		atomic64_inc(&sbi->s_bal_cX_groups_considered[cr]);
+	return ext4_mb_good_group(ac, group, cr);
+}
+
+/*
+ * A group on the lists or in the tree may still be finishing its buddy
+ * initialization, which can't be waited for under their locks.
+ */
+static bool ext4_mb_optimized_good_group(struct ext4_allocation_context *ac,
+					 struct ext4_group_info *grp, int cr)
+{
+	if (EXT4_MB_GRP_NEED_INIT(grp))
+		return false;
+	return ext4_mb_good_group_nolock(ac, grp->bb_group, cr) > 0;
+}
+
+static bool ext4_mb_choose_group_cr0(struct ext4_allocation_context *ac,
+				     ext4_group_t *group)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_group_info *iter, *grp = NULL;
+	int i;
+
+	for (i = ac->ac_2order; i < MB_NUM_ORDERS(ac->ac_sb) && !grp; i++) {
+		if (list_empty(&sbi->s_mb_largest_free_orders[i]))
+			continue;
+		read_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_for_each_entry(iter, &sbi->s_mb_largest_free_orders[i],
+				    bb_largest_free_order_node) {
+			if (ext4_mb_optimized_good_group(ac, iter, 0)) {
+				grp = iter;
+				break;
+			}
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+	if (!grp)
+		return false;
+	*group = grp->bb_group;
+	return true;
+}
+
+static bool ext4_mb_choose_group_cr1(struct ext4_allocation_context *ac,
+				     ext4_group_t *group)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_group_info *iter, *grp = NULL;
+	struct rb_node *n, *first = NULL;
+	ext4_grpblk_t min_avg = ac->ac_g_ex.fe_len;
+	ext4_group_t min_group = 0;
+
+	/*
+	 * Continue after the previous pick, so a group that turned out not
+	 * to fit isn't handed out again.
+	 */
+	if (ac->ac_flags & EXT4_MB_CR1_OPTIMIZED) {
+		min_avg = ac->ac_last_optimal_avg;
+		min_group = ac->ac_last_optimal_group + 1;
+	}
+
+	read_lock(&sbi->s_mb_rb_lock);
+	n = sbi->s_mb_avg_fragment_size_root.rb_node;
+	while (n) {
+		iter = rb_entry(n, struct ext4_group_info,
+				bb_avg_fragment_size_rb);
+		if (iter->bb_avg_fragment_size > min_avg ||
+		    (iter->bb_avg_fragment_size == min_avg &&
+		     iter->bb_group >= min_group)) {
+			first = n;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
+	for (n = first; n; n = rb_next(n)) {
+		iter = rb_entry(n, struct ext4_group_info,
+				bb_avg_fragment_size_rb);
+		if (ext4_mb_optimized_good_group(ac, iter, 1)) {
+			grp = iter;
+			ac->ac_last_optimal_avg = grp->bb_avg_fragment_size;
+			ac->ac_last_optimal_group = grp->bb_group;
+			break;
+		}
+	}
+	read_unlock(&sbi->s_mb_rb_lock);
+
+	if (!grp)
+		return false;
+	ac->ac_flags |= EXT4_MB_CR1_OPTIMIZED;
+	*group = grp->bb_group;
+	return true;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
 	ext4_group_t ngroups, group, i;
 	int cr;
 	int err = 0, first_err = 0;
+	bool optimized;
 	struct ext4_sb_info *sbi;
 	struct super_block *sb;
 	struct ext4_buddy e4b;
@@ -2168,23 +2361,34 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 		 * from the goal value specified
 		 */
 		group = ac->ac_g_ex.fe_group;
+		optimized = ext4_mb_use_optimized_scan(ac, cr);
+		ac->ac_flags &= ~EXT4_MB_CR1_OPTIMIZED;
 
 		for (i = 0; i < ngroups; group++, i++) {
 			int ret = 0;
 			cond_resched();
-			/*
-			 * Artificially restricted ngroups for non-extent
-			 * files makes group > ngroups possible on first loop.
-			 */
-			if (group >= ngroups)
+			if (optimized) {
+				if (cr == 0 ?
+				    !ext4_mb_choose_group_cr0(ac, &group) :
+				    !ext4_mb_choose_group_cr1(ac, &group))
+					break;
+			} else if (group >= ngroups) {
+				/*
+				 * Artificially restricted ngroups for non-extent
+				 * files makes group > ngroups possible on first
+				 * loop.
+				 */
 				group = 0;
+			}
 
 			/* This now checks without needing the buddy page */
-			ret = ext4_mb_good_group(ac, group, cr);
-			if (ret <= 0) {
-				if (!first_err)
-					first_err = ret;
-				continue;
+			if (!optimized) {
+				ret = ext4_mb_good_group_nolock(ac, group, cr);
+				if (ret <= 0) {
+					if (!first_err)
+						first_err = ret;
+					continue;
+				}
 			}
 
 			err = ext4_mb_load_buddy(sb, group, &e4b);
@@ -2201,6 +2405,8 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 			if (ret <= 0) {
 				ext4_unlock_group(sb, group);
 				ext4_mb_unload_buddy(&e4b);
+				if (optimized && sbi->s_mb_stats)
+					atomic_inc(&sbi->s_bal_bad_suggestions);
 				if (!first_err)
 					first_err = ret;
 				continue;
@@ -2220,7 +2426,11 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
+			if (optimized && sbi->s_mb_stats)
+				atomic_inc(&sbi->s_bal_bad_suggestions);
 		}
+		if (ac->ac_status == AC_STATUS_CONTINUE && sbi->s_mb_stats)
+			atomic_inc(&sbi->s_bal_cX_failed[cr]);
 	}
 
 	if (ac->ac_b_ex.fe_len > 0 && ac->ac_status != AC_STATUS_FOUND &&
@@ -2248,6 +2458,9 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 			goto repeat;
 		}
 	}
+
+	if (ac->ac_status == AC_STATUS_FOUND && sbi->s_mb_stats)
+		atomic_inc(&sbi->s_bal_cX_hits[ac->ac_criteria]);
 out:
 	if (!err && ac->ac_status != AC_STATUS_FOUND && first_err)
 		err = first_err;
@@ -2339,6 +2552,53 @@ const struct seq_operations ext4_mb_seq_groups_ops = {
 	.show   = ext4_mb_seq_groups_show,
 };
 
+int ext4_seq_mb_stats_show(struct seq_file *seq, void *offset)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int i;
+
+	seq_puts(seq, "mballoc:\n");
+	seq_printf(seq, "\toptimize_scan: %d\n",
+		   test_opt2(sb, MB_OPTIMIZE_SCAN) ? 1 : 0);
+	if (!sbi->s_mb_stats) {
+		seq_puts(seq, "\tmb stats collection turned off.\n");
+		seq_puts(seq, "\tTo enable, please write \"1\" to sysfs file mb_stats.\n");
+		return 0;
+	}
+	seq_printf(seq, "\treqs: %u\n", atomic_read(&sbi->s_bal_reqs));
+	seq_printf(seq, "\tsuccess: %u\n", atomic_read(&sbi->s_bal_success));
+	seq_printf(seq, "\tgroups_scanned: %u\n",
+		   atomic_read(&sbi->s_bal_groups_scanned));
+	for (i = 0; i < 4; i++) {
+		seq_printf(seq, "\tcr%d_stats:\n", i);
+		seq_printf(seq, "\t\thits: %u\n",
+			   atomic_read(&sbi->s_bal_cX_hits[i]));
+		seq_printf(seq, "\t\tgroups_considered: %lld\n",
+			   (long long)atomic64_read(
+				&sbi->s_bal_cX_groups_considered[i]));
+		seq_printf(seq, "\t\tuseless_loops: %u\n",
+			   atomic_read(&sbi->s_bal_cX_failed[i]));
+	}
+	seq_printf(seq, "\tbad_suggestions: %u\n",
+		   atomic_read(&sbi->s_bal_bad_suggestions));
+	seq_printf(seq, "\textents_scanned: %u\n",
+		   atomic_read(&sbi->s_bal_ex_scanned));
+	seq_printf(seq, "\tgoal_hits: %u\n", atomic_read(&sbi->s_bal_goals));
+	seq_printf(seq, "\t2^n_hits: %u\n", atomic_read(&sbi->s_bal_2orders));
+	seq_printf(seq, "\tbreaks: %u\n", atomic_read(&sbi->s_bal_breaks));
+	seq_printf(seq, "\tlost: %u\n", atomic_read(&sbi->s_mb_lost_chunks));
+	seq_printf(seq, "\tbuddies_generated: %lu\n",
+		   sbi->s_mb_buddies_generated);
+	seq_printf(seq, "\tbuddies_time_used: %llu\n",
+		   sbi->s_mb_generation_time);
+	seq_printf(seq, "\tpreallocated: %u\n",
+		   atomic_read(&sbi->s_mb_preallocated));
+	seq_printf(seq, "\tdiscarded: %u\n",
+		   atomic_read(&sbi->s_mb_discarded));
+	return 0;
+}
+
 static struct kmem_cache *get_groupinfo_cache(int blocksize_bits)
 {
 	int cache_index = blocksize_bits - EXT4_MIN_BLOCK_LOG_SIZE;
@@ -2438,6 +2698,9 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
+	RB_CLEAR_NODE(&meta_group_info[i]->bb_avg_fragment_size_rb);
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2607,6 +2870,23 @@ int ext4_mb_init(struct super_block *sb)
 		i++;
 	} while (i <= sb->s_blocksize_bits + 1);
 
+	sbi->s_mb_largest_free_orders =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(struct list_head),
+			      GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(rwlock_t), GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders ||
+	    !sbi->s_mb_largest_free_orders_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+	sbi->s_mb_avg_fragment_size_root = RB_ROOT;
+	rwlock_init(&sbi->s_mb_rb_lock);
+
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
 	sbi->s_mb_free_pending = 0;
@@ -2669,6 +2949,10 @@ int ext4_mb_init(struct super_block *sb)
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2721,6 +3005,8 @@ int ext4_mb_release(struct super_block *sb)
 			kfree(sbi->s_group_info[i]);
 		kvfree(sbi->s_group_info);
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
@@ -3260,6 +3546,7 @@ static void ext4_mb_collect_stats(struct ext4_allocation_context *ac)
 		if (ac->ac_b_ex.fe_len >= ac->ac_o_ex.fe_len)
 			atomic_inc(&sbi->s_bal_success);
 		atomic_add(ac->ac_found, &sbi->s_bal_ex_scanned);
+		atomic_add(ac->ac_groups_scanned, &sbi->s_bal_groups_scanned);
 		if (ac->ac_g_ex.fe_start == ac->ac_b_ex.fe_start &&
 				ac->ac_g_ex.fe_group == ac->ac_b_ex.fe_group)
 			atomic_inc(&sbi->s_bal_goals);
@@ -4474,6 +4761,11 @@ ext4_fsblk_t ext4_mb_new_blocks(handle_t *handle,
 	sb = ar->inode->i_sb;
 	sbi = EXT4_SB(sb);
 
+	if (sbi->s_mount_state & EXT4_FC_REPLAY) {
+		ar->len = 1;
+		return ext4_fc_replay_alloc_block(ar->inode, ar->goal, errp);
+	}
+
 	trace_ext4_request_blocks(ar);
 
 	/* Allow to use superuser reservation for quota file */
@@ -4786,6 +5078,12 @@ void ext4_free_blocks(handle_t *handle, struct inode *inode,
 		}
 	}
 
+	/* Fast commit replay keeps its own bitmap state, see fast_commit.c */
+	if (sbi->s_mount_state & EXT4_FC_REPLAY) {
+		ext4_fc_replay_free_blocks(inode, block, count);
+		return;
+	}
+
 do_more:
 	overflow = 0;
 	ext4_get_group_no_and_offset(sb, block, &block_group, &bit);
@@ -77,6 +77,12 @@ do {									\
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * Number of buddy orders: bb_counters[] and the largest free order lists
+ * are indexed by order, 0 to blocksize_bits + 1.
+ */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* this links the free block information from sb_info */
@@ -171,6 +177,9 @@ struct ext4_allocation_context {
 	__u8 ac_2order;		/* if request is to allocate 2^N blocks and
 				 * N > 0, the field stores N, otherwise 0 */
 	__u8 ac_op;		/* operation, for history only */
+	/* last group picked by the optimized scan, and its tree key */
+	ext4_group_t ac_last_optimal_group;
+	ext4_grpblk_t ac_last_optimal_avg;
 	struct page *ac_bitmap_page;
 	struct page *ac_buddy_page;
 	struct ext4_prealloc_space *ac_pa;
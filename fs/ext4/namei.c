@@ -35,6 +35,7 @@
 #include <linux/buffer_head.h>
 #include <linux/bio.h>
 #include <linux/iversion.h>
+#include <linux/hash.h>
 #include "ext4.h"
 #include "ext4_jbd2.h"
 
@@ -49,6 +50,33 @@
 #define NAMEI_RA_BLOCKS  4
 #define NAMEI_RA_SIZE	     (NAMEI_RA_CHUNKS * NAMEI_RA_BLOCKS)
 
+/*
+ * With i_dir_sem held shared, entries are only added to and deleted from
+ * the leaf blocks of an indexed directory, under the write side of the
+ * block's lock; the readers of a leaf take the read side.  Anything else
+ * that changes a directory needs i_dir_sem exclusive.  The locks are
+ * hashed by directory and logical block, so they can be taken before the
+ * block is read and its checksum verified.
+ */
+#define EXT4_DIR_LOCK_BITS	10
+
+static struct rw_semaphore ext4_dir_locks[1 << EXT4_DIR_LOCK_BITS];
+
+static struct rw_semaphore *ext4_dir_block_lock(struct inode *dir,
+						ext4_lblk_t block)
+{
+	return &ext4_dir_locks[hash_long((unsigned long)dir + block,
+					 EXT4_DIR_LOCK_BITS)];
+}
+
+void __init ext4_init_dir_locks(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ext4_dir_locks); i++)
+		init_rwsem(&ext4_dir_locks[i]);
+}
+
 static struct buffer_head *ext4_append(handle_t *handle,
 					struct inode *inode,
 					ext4_lblk_t *block)
@@ -274,9 +302,12 @@ static int ext4_htree_next_block(struct inode *dir, __u32 hash,
 				 __u32 *start_hash);
 static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 		struct ext4_filename *fname,
-		struct ext4_dir_entry_2 **res_dir);
+		struct ext4_dir_entry_2 **res_dir, ext4_lblk_t *lblk);
 static int ext4_dx_add_entry(handle_t *handle, struct ext4_filename *fname,
 			     struct inode *dir, struct inode *inode);
+static int ext4_dx_add_entry_leaf(handle_t *handle,
+				  struct ext4_filename *fname,
+				  struct inode *dir, struct inode *inode);
 
 /* checksumming functions */
 void initialize_dirent_tail(struct ext4_dir_entry_tail *t,
@@ -1062,9 +1093,10 @@ static int htree_dirblock_to_tree(struct file *dir_file,
  * This function returns the number of entries inserted into the tree,
  * or a negative error code.
  */
-int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
-			 __u32 start_minor_hash, __u32 *next_hash)
+static int __ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
+				  __u32 start_minor_hash, __u32 *next_hash)
 {
+	struct rw_semaphore *lock;
 	struct dx_hash_info hinfo;
 	struct ext4_dir_entry_2 *de;
 	struct dx_frame frames[EXT4_HTREE_LEVEL], *frame;
@@ -1136,8 +1168,11 @@ int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 		}
 		cond_resched();
 		block = dx_get_block(frame->at);
+		lock = ext4_dir_block_lock(dir, block);
+		down_read(lock);
 		ret = htree_dirblock_to_tree(dir_file, dir, block, &hinfo,
 					     start_hash, start_minor_hash);
+		up_read(lock);
 		if (ret < 0) {
 			err = ret;
 			goto errout;
@@ -1169,6 +1204,19 @@ int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 	return (err);
 }
 
+int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
+			 __u32 start_minor_hash, __u32 *next_hash)
+{
+	struct inode *dir = file_inode(dir_file);
+	int ret;
+
+	down_read(&EXT4_I(dir)->i_dir_sem);
+	ret = __ext4_htree_fill_tree(dir_file, start_hash, start_minor_hash,
+				     next_hash);
+	up_read(&EXT4_I(dir)->i_dir_sem);
+	return ret;
+}
+
 static inline int search_dirblock(struct buffer_head *bh,
 				  struct inode *dir,
 				  struct ext4_filename *fname,
@@ -1335,12 +1383,13 @@ static int is_dx_internal_node(struct inode *dir, ext4_lblk_t block,
  * entry - you'll have to do that yourself if you want to.
  *
  * The returned buffer_head has ->b_count elevated.  The caller is expected
- * to brelse() it when appropriate.
+ * to brelse() it when appropriate.  If @lblk is not NULL, it is set to the
+ * logical block of a directory block the entry was found in.
  */
-static struct buffer_head * ext4_find_entry (struct inode *dir,
-					const struct qstr *d_name,
-					struct ext4_dir_entry_2 **res_dir,
-					int *inlined)
+static struct buffer_head *__ext4_find_entry(struct inode *dir,
+					     const struct qstr *d_name,
+					     struct ext4_dir_entry_2 **res_dir,
+					     int *inlined, ext4_lblk_t *lblk)
 {
 	struct super_block *sb;
 	struct buffer_head *bh_use[NAMEI_RA_SIZE];
@@ -1389,7 +1438,7 @@ static struct buffer_head * ext4_find_entry (struct inode *dir,
 		goto restart;
 	}
 	if (is_dx(dir)) {
-		ret = ext4_dx_find_entry(dir, &fname, res_dir);
+		ret = ext4_dx_find_entry(dir, &fname, res_dir, lblk);
 		/*
 		 * On success, or if the error was file not found,
 		 * return.  Otherwise, fall back to doing a search the
@@ -1457,6 +1506,8 @@ static struct buffer_head * ext4_find_entry (struct inode *dir,
 			    block << EXT4_BLOCK_SIZE_BITS(sb), res_dir);
 		if (i == 1) {
 			EXT4_I(dir)->i_dir_start_lookup = block;
+			if (lblk)
+				*lblk = block;
 			ret = bh;
 			goto cleanup_and_exit;
 		} else {
@@ -1488,12 +1539,21 @@ static struct buffer_head * ext4_find_entry (struct inode *dir,
 	return ret;
 }
 
+static struct buffer_head *ext4_find_entry(struct inode *dir,
+					   const struct qstr *d_name,
+					   struct ext4_dir_entry_2 **res_dir,
+					   int *inlined)
+{
+	return __ext4_find_entry(dir, d_name, res_dir, inlined, NULL);
+}
+
 static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 			struct ext4_filename *fname,
-			struct ext4_dir_entry_2 **res_dir)
+			struct ext4_dir_entry_2 **res_dir, ext4_lblk_t *lblk)
 {
 	struct super_block * sb = dir->i_sb;
 	struct dx_frame frames[EXT4_HTREE_LEVEL], *frame;
+	struct rw_semaphore *lock;
 	struct buffer_head *bh;
 	ext4_lblk_t block;
 	int retval;
@@ -1506,15 +1566,23 @@ static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 		return (struct buffer_head *) frame;
 	do {
 		block = dx_get_block(frame->at);
+		lock = ext4_dir_block_lock(dir, block);
+		down_read(lock);
 		bh = ext4_read_dirblock(dir, block, DIRENT);
-		if (IS_ERR(bh))
+		if (IS_ERR(bh)) {
+			up_read(lock);
 			goto errout;
+		}
 
 		retval = search_dirblock(bh, dir, fname,
 					 block << EXT4_BLOCK_SIZE_BITS(sb),
 					 res_dir);
-		if (retval == 1)
+		up_read(lock);
+		if (retval == 1) {
+			if (lblk)
+				*lblk = block;
 			goto success;
+		}
 		brelse(bh);
 		if (retval == -1) {
 			bh = ERR_PTR(ERR_BAD_DX_DIR);
@@ -1555,13 +1623,17 @@ static struct dentry *ext4_lookup(struct inode *dir, struct dentry *dentry, unsi
 	if (dentry->d_name.len > EXT4_NAME_LEN)
 		return ERR_PTR(-ENAMETOOLONG);
 
+	down_read(&EXT4_I(dir)->i_dir_sem);
 	bh = ext4_find_entry(dir, &dentry->d_name, &de, NULL);
-	if (IS_ERR(bh))
+	if (IS_ERR(bh)) {
+		up_read(&EXT4_I(dir)->i_dir_sem);
 		return ERR_CAST(bh);
+	}
 	inode = NULL;
 	if (bh) {
 		__u32 ino = le32_to_cpu(de->inode);
 		brelse(bh);
+		up_read(&EXT4_I(dir)->i_dir_sem);
 		if (!ext4_valid_inum(dir->i_sb, ino)) {
 			EXT4_ERROR_INODE(dir, "bad inode number: %u", ino);
 			return ERR_PTR(-EFSCORRUPTED);
@@ -1587,6 +1659,8 @@ static struct dentry *ext4_lookup(struct inode *dir, struct dentry *dentry, unsi
 			iput(inode);
 			return ERR_PTR(-EPERM);
 		}
+	} else {
+		up_read(&EXT4_I(dir)->i_dir_sem);
 	}
 	return d_splice_alias(inode, dentry);
 }
@@ -2032,6 +2106,7 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 			  struct inode *inode)
 {
 	struct inode *dir = d_inode(dentry->d_parent);
+	struct ext4_inode_info *ei = EXT4_I(dir);
 	struct buffer_head *bh = NULL;
 	struct ext4_dir_entry_2 *de;
 	struct ext4_dir_entry_tail *t;
@@ -2055,6 +2130,22 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	if (retval)
 		return retval;
 
+	/*
+	 * Most entries of an indexed directory fit into the leaf the index
+	 * points at; only splitting it, or any other change to the shape
+	 * of the directory, needs i_dir_sem exclusive.
+	 */
+	down_read(&ei->i_dir_sem);
+	if (is_dx(dir) && !ext4_has_inline_data(dir)) {
+		retval = ext4_dx_add_entry_leaf(handle, &fname, dir, inode);
+		if (retval != -EAGAIN && retval != ERR_BAD_DX_DIR) {
+			up_read(&ei->i_dir_sem);
+			goto out_fname;
+		}
+	}
+	up_read(&ei->i_dir_sem);
+	down_write(&ei->i_dir_sem);
+
 	if (ext4_has_inline_data(dir)) {
 		retval = ext4_try_add_inline_entry(handle, &fname, dir, inode);
 		if (retval < 0)
@@ -2112,13 +2203,47 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 
 	retval = add_dirent_to_buf(handle, &fname, dir, inode, de, bh);
 out:
-	ext4_fname_free_filename(&fname);
+	up_write(&ei->i_dir_sem);
 	brelse(bh);
+out_fname:
+	ext4_fname_free_filename(&fname);
 	if (retval == 0)
 		ext4_set_inode_state(inode, EXT4_STATE_NEWENTRY);
 	return retval;
 }
 
+/*
+ * Add an entry to the leaf the index points at, with i_dir_sem held
+ * shared.  Returns -EAGAIN if the leaf is full and has to be split.
+ */
+static int ext4_dx_add_entry_leaf(handle_t *handle,
+				  struct ext4_filename *fname,
+				  struct inode *dir, struct inode *inode)
+{
+	struct dx_frame frames[EXT4_HTREE_LEVEL], *frame;
+	struct rw_semaphore *lock;
+	struct buffer_head *bh;
+	ext4_lblk_t block;
+	int err;
+
+	frame = dx_probe(fname, dir, NULL, frames);
+	if (IS_ERR(frame))
+		return PTR_ERR(frame);
+	block = dx_get_block(frame->at);
+	lock = ext4_dir_block_lock(dir, block);
+	down_write(lock);
+	bh = ext4_read_dirblock(dir, block, DIRENT);
+	if (IS_ERR(bh)) {
+		err = PTR_ERR(bh);
+	} else {
+		err = add_dirent_to_buf(handle, fname, dir, inode, NULL, bh);
+		brelse(bh);
+	}
+	up_write(lock);
+	dx_release(frames);
+	return err == -ENOSPC ? -EAGAIN : err;
+}
+
 /*
  * Returns 0 for success, or a negative error value
  */
@@ -2377,6 +2502,66 @@ static int ext4_delete_entry(handle_t *handle,
 	return err;
 }
 
+/*
+ * Directory updates replayed from fast commits.  These run from journal
+ * recovery, before the filesystem is fully mounted and without a journal
+ * handle.  Entries that are already on disk are left alone, so a fast commit
+ * may be replayed more than once.
+ */
+int ext4_fc_replay_add_entry(struct inode *dir, const struct qstr *name,
+			     struct inode *inode)
+{
+	struct ext4_dir_entry_2 *de;
+	struct buffer_head *bh;
+	struct dentry *dentry_dir, *dentry;
+	int err;
+
+	bh = ext4_find_entry(dir, name, &de, NULL);
+	if (IS_ERR(bh))
+		return PTR_ERR(bh);
+	if (bh) {
+		err = le32_to_cpu(de->inode) == inode->i_ino ? 0 : -EEXIST;
+		brelse(bh);
+		return err;
+	}
+
+	ihold(dir);
+	dentry_dir = d_obtain_alias(dir);
+	if (IS_ERR(dentry_dir))
+		return PTR_ERR(dentry_dir);
+	dentry = d_alloc(dentry_dir, name);
+	if (!dentry) {
+		dput(dentry_dir);
+		return -ENOMEM;
+	}
+	err = ext4_add_entry(NULL, dentry, inode);
+	dput(dentry);
+	dput(dentry_dir);
+	return err;
+}
+
+int ext4_fc_replay_del_entry(struct inode *dir, const struct qstr *name,
+			     unsigned long ino)
+{
+	struct ext4_dir_entry_2 *de;
+	struct buffer_head *bh;
+	int err;
+
+	bh = ext4_find_entry(dir, name, &de, NULL);
+	if (IS_ERR(bh))
+		return PTR_ERR(bh);
+	if (!bh)
+		return 0;
+	err = 0;
+	if (le32_to_cpu(de->inode) == ino) {
+		err = ext4_delete_entry(NULL, dir, de, bh);
+		if (!err)
+			err = ext4_mark_inode_dirty(NULL, dir);
+	}
+	brelse(bh);
+	return err;
+}
+
 /*
  * Set directory link count to 1 if nlinks > EXT4_LINK_MAX, or if nlinks == 2
  * since this indicates that nlinks count was previously 1 to avoid overflowing
@@ -2414,6 +2599,7 @@ static int ext4_add_nondir(handle_t *handle,
 	if (!err) {
 		ext4_mark_inode_dirty(handle, inode);
 		d_instantiate_new(dentry, inode);
+		ext4_fc_track_create(handle, dentry);
 		return 0;
 	}
 	drop_nlink(inode);
@@ -2631,6 +2817,7 @@ static int ext4_mkdir(struct inode *dir, struct dentry *dentry, umode_t mode)
 	if (IS_ERR(inode))
 		goto out_stop;
 
+	ext4_fc_mark_ineligible(dir->i_sb, EXT4_FC_REASON_DIR_OP, handle);
 	inode->i_op = &ext4_dir_inode_operations;
 	inode->i_fop = &ext4_dir_operations;
 	err = ext4_init_new_dir(handle, dir, inode);
@@ -2954,6 +3141,7 @@ static int ext4_rmdir(struct inode *dir, struct dentry *dentry)
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
 
+	ext4_fc_mark_ineligible(dir->i_sb, EXT4_FC_REASON_DIR_OP, handle);
 	retval = ext4_delete_entry(handle, dir, de, bh);
 	if (retval)
 		goto end_rmdir;
@@ -2982,13 +3170,35 @@ static int ext4_rmdir(struct inode *dir, struct dentry *dentry)
 	return retval;
 }
 
+/*
+ * Take i_dir_sem for deleting an entry: shared for an indexed directory,
+ * whose leaves have locks of their own, exclusive otherwise.  Returns
+ * whether it was taken shared.
+ */
+static bool ext4_dir_lock_delete(struct inode *dir)
+{
+	struct ext4_inode_info *ei = EXT4_I(dir);
+
+	if (is_dx(dir)) {
+		down_read(&ei->i_dir_sem);
+		if (is_dx(dir) && !ext4_has_inline_data(dir))
+			return true;
+		up_read(&ei->i_dir_sem);
+	}
+	down_write(&ei->i_dir_sem);
+	return false;
+}
+
 static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 {
 	int retval;
 	struct inode *inode;
 	struct buffer_head *bh;
 	struct ext4_dir_entry_2 *de;
-	handle_t *handle = NULL;
+	struct rw_semaphore *lock = NULL;
+	ext4_lblk_t block;
+	handle_t *handle;
+	bool shared;
 
 	if (unlikely(ext4_forced_shutdown(EXT4_SB(dir->i_sb))))
 		return -EIO;
@@ -3003,10 +3213,23 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	if (retval)
 		return retval;
 
+	/*
+	 * The handle is started before taking i_dir_sem, which adding an
+	 * entry takes with a handle running.
+	 */
+	handle = ext4_journal_start(dir, EXT4_HT_DIR,
+				    EXT4_DATA_TRANS_BLOCKS(dir->i_sb));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	shared = ext4_dir_lock_delete(dir);
 	retval = -ENOENT;
-	bh = ext4_find_entry(dir, &dentry->d_name, &de, NULL);
-	if (IS_ERR(bh))
-		return PTR_ERR(bh);
+	bh = __ext4_find_entry(dir, &dentry->d_name, &de, NULL, &block);
+	if (IS_ERR(bh)) {
+		retval = PTR_ERR(bh);
+		bh = NULL;
+		goto end_unlink;
+	}
 	if (!bh)
 		goto end_unlink;
 
@@ -3016,14 +3239,6 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	if (le32_to_cpu(de->inode) != inode->i_ino)
 		goto end_unlink;
 
-	handle = ext4_journal_start(dir, EXT4_HT_DIR,
-				    EXT4_DATA_TRANS_BLOCKS(dir->i_sb));
-	if (IS_ERR(handle)) {
-		retval = PTR_ERR(handle);
-		handle = NULL;
-		goto end_unlink;
-	}
-
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
 
@@ -3032,7 +3247,13 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 				   dentry->d_name.len, dentry->d_name.name);
 		set_nlink(inode, 1);
 	}
+	if (shared) {
+		lock = ext4_dir_block_lock(dir, block);
+		down_write(lock);
+	}
 	retval = ext4_delete_entry(handle, dir, de, bh);
+	if (lock)
+		up_write(lock);
 	if (retval)
 		goto end_unlink;
 	dir->i_ctime = dir->i_mtime = current_time(dir);
@@ -3043,11 +3264,15 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 		ext4_orphan_add(handle, inode);
 	inode->i_ctime = current_time(inode);
 	ext4_mark_inode_dirty(handle, inode);
+	ext4_fc_track_unlink(handle, dentry);
 
 end_unlink:
+	if (shared)
+		up_read(&EXT4_I(dir)->i_dir_sem);
+	else
+		up_write(&EXT4_I(dir)->i_dir_sem);
 	brelse(bh);
-	if (handle)
-		ext4_journal_stop(handle);
+	ext4_journal_stop(handle);
 	trace_ext4_unlink_exit(dentry, retval);
 	return retval;
 }
@@ -3103,6 +3328,8 @@ static int ext4_symlink(struct inode *dir,
 		return PTR_ERR(inode);
 	}
 
+	ext4_fc_mark_ineligible(dir->i_sb, EXT4_FC_REASON_DIR_OP, handle);
+
 	if (IS_ENCRYPTED(inode)) {
 		err = fscrypt_encrypt_symlink(inode, symname, len, &disk_link);
 		if (err)
@@ -3146,6 +3373,8 @@ static int ext4_symlink(struct inode *dir,
 			handle = NULL;
 			goto err_drop_inode;
 		}
+		ext4_fc_mark_ineligible(dir->i_sb, EXT4_FC_REASON_DIR_OP,
+					handle);
 		set_nlink(inode, 1);
 		err = ext4_orphan_del(handle, inode);
 		if (err)
@@ -3228,6 +3457,11 @@ static int ext4_link(struct dentry *old_dentry,
 		if (inode->i_nlink == 1)
 			ext4_orphan_del(handle, inode);
 		d_instantiate(dentry, inode);
+		/* a linked tmpfile is new to fast commit replay */
+		if (inode->i_nlink == 1)
+			ext4_fc_track_create(handle, dentry);
+		else
+			ext4_fc_track_link(handle, dentry);
 	} else {
 		drop_nlink(inode);
 		iput(inode);
@@ -3557,6 +3791,8 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 	if (IS_DIRSYNC(old.dir) || IS_DIRSYNC(new.dir))
 		ext4_handle_sync(handle);
 
+	ext4_fc_mark_ineligible(old.dir->i_sb, EXT4_FC_REASON_RENAME, handle);
+
 	if (S_ISDIR(old.inode->i_mode)) {
 		if (new.inode) {
 			retval = -ENOTEMPTY;
@@ -3738,6 +3974,8 @@ static int ext4_cross_rename(struct inode *old_dir, struct dentry *old_dentry,
 	if (IS_DIRSYNC(old.dir) || IS_DIRSYNC(new.dir))
 		ext4_handle_sync(handle);
 
+	ext4_fc_mark_ineligible(old.dir->i_sb, EXT4_FC_REASON_RENAME, handle);
+
 	if (S_ISDIR(old.inode->i_mode)) {
 		old.is_dir = true;
 		retval = ext4_rename_dir_prepare(handle, &old);
@@ -366,7 +366,17 @@ void ext4_io_submit_init(struct ext4_io_submit *io,
 	io->io_end = NULL;
 }
 
+/* The file logical block number of a buffer of a page cache page */
+static u64 ext4_bh_lblk(struct inode *inode, struct page *page,
+			struct buffer_head *bh)
+{
+	return ((u64)page->index << (PAGE_SHIFT - inode->i_blkbits)) +
+		(bh_offset(bh) >> inode->i_blkbits);
+}
+
 static int io_submit_init_bio(struct ext4_io_submit *io,
+			      struct inode *inode,
+			      struct page *page,
 			      struct buffer_head *bh)
 {
 	struct bio *bio;
@@ -374,6 +384,8 @@ static int io_submit_init_bio(struct ext4_io_submit *io,
 	bio = bio_alloc(GFP_NOIO, BIO_MAX_PAGES);
 	if (!bio)
 		return -ENOMEM;
+	fscrypt_set_bio_crypt_ctx(bio, inode, ext4_bh_lblk(inode, page, bh),
+				  GFP_NOIO);
 	wbc_init_bio(io->io_wbc, bio);
 	bio->bi_iter.bi_sector = bh->b_blocknr * (bh->b_size >> 9);
 	bio_set_dev(bio, bh->b_bdev);
@@ -391,12 +403,14 @@ static int io_submit_add_bh(struct ext4_io_submit *io,
 {
 	int ret;
 
-	if (io->io_bio && bh->b_blocknr != io->io_next_block) {
+	if (io->io_bio && (bh->b_blocknr != io->io_next_block ||
+			   !fscrypt_mergeable_bio(io->io_bio, inode,
+					ext4_bh_lblk(inode, page, bh)))) {
 submit_and_retry:
 		ext4_io_submit(io);
 	}
 	if (io->io_bio == NULL) {
-		ret = io_submit_init_bio(io, bh);
+		ret = io_submit_init_bio(io, inode, page, bh);
 		if (ret)
 			return ret;
 		io->io_bio->bi_write_hint = inode->i_write_hint;
@@ -477,8 +491,7 @@ int ext4_bio_write_page(struct ext4_io_submit *io,
 
 	bh = head = page_buffers(page);
 
-	if (ext4_encrypted_inode(inode) && S_ISREG(inode->i_mode) &&
-	    nr_to_submit) {
+	if (fscrypt_inode_uses_fs_layer_crypto(inode) && nr_to_submit) {
 		gfp_t gfp_flags = GFP_NOFS;
 
 	retry_encrypt:
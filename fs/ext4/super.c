@@ -119,7 +119,7 @@ static struct file_system_type ext2_fs_type = {
 	.name		= "ext2",
 	.mount		= ext4_mount,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_PAR_DIR_UPDATE,
 };
 MODULE_ALIAS_FS("ext2");
 MODULE_ALIAS("ext2");
@@ -134,7 +134,7 @@ static struct file_system_type ext3_fs_type = {
 	.name		= "ext3",
 	.mount		= ext4_mount,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_PAR_DIR_UPDATE,
 };
 MODULE_ALIAS_FS("ext3");
 MODULE_ALIAS("ext3");
@@ -951,6 +951,7 @@ static void ext4_put_super(struct super_block *sb)
 		if ((err < 0) && !aborted)
 			ext4_abort(sb, "Couldn't clean up the journal");
 	}
+	ext4_fc_release(sb);
 
 	ext4_unregister_sysfs(sb);
 	ext4_es_unregister_shrinker(sbi);
@@ -1064,6 +1065,7 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	ei->i_datasync_tid = 0;
 	atomic_set(&ei->i_unwritten, 0);
 	INIT_WORK(&ei->i_rsv_conversion_work, ext4_end_io_rsv_work);
+	ext4_fc_init_inode(&ei->vfs_inode);
 	return &ei->vfs_inode;
 }
 
@@ -1071,6 +1073,13 @@ static int ext4_drop_inode(struct inode *inode)
 {
 	int drop = generic_drop_inode(inode);
 
+	/*
+	 * Fast commit replay rewrites raw inodes behind the inode cache, so
+	 * don't keep any around.
+	 */
+	if (EXT4_SB(inode->i_sb)->s_mount_state & EXT4_FC_REPLAY)
+		drop = 1;
+
 	trace_ext4_drop_inode(inode, drop);
 	return drop;
 }
@@ -1101,6 +1110,7 @@ static void init_once(void *foo)
 
 	INIT_LIST_HEAD(&ei->i_orphan);
 	init_rwsem(&ei->xattr_sem);
+	init_rwsem(&ei->i_dir_sem);
 	init_rwsem(&ei->i_data_sem);
 	init_rwsem(&ei->i_mmap_sem);
 	inode_init_once(&ei->vfs_inode);
@@ -1132,6 +1142,7 @@ static void destroy_inodecache(void)
 
 void ext4_clear_inode(struct inode *inode)
 {
+	ext4_fc_del(inode);
 	invalidate_inode_buffers(inode);
 	clear_inode(inode);
 	dquot_drop(inode);
@@ -1305,6 +1316,11 @@ static bool ext4_dummy_context(struct inode *inode)
 	return DUMMY_ENCRYPTION_ENABLED(EXT4_SB(inode->i_sb));
 }
 
+static bool ext4_inline_crypt_enabled(struct super_block *sb)
+{
+	return test_opt(sb, INLINECRYPT);
+}
+
 static const struct fscrypt_operations ext4_cryptops = {
 	.key_prefix		= "ext4:",
 	.get_context		= ext4_get_context,
@@ -1312,6 +1328,7 @@ static const struct fscrypt_operations ext4_cryptops = {
 	.dummy_context		= ext4_dummy_context,
 	.empty_dir		= ext4_empty_dir,
 	.max_namelen		= EXT4_NAME_LEN,
+	.inline_crypt_enabled	= ext4_inline_crypt_enabled,
 };
 #endif
 
@@ -1417,6 +1434,7 @@ enum {
 	Opt_dioread_nolock, Opt_dioread_lock,
 	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
 	Opt_max_dir_size_kb, Opt_nojournal_checksum, Opt_nombcache,
+	Opt_inlinecrypt, Opt_mb_optimize_scan,
 };
 
 static const match_table_t tokens = {
@@ -1501,8 +1519,10 @@ static const match_table_t tokens = {
 	{Opt_noinit_itable, "noinit_itable"},
 	{Opt_max_dir_size_kb, "max_dir_size_kb=%u"},
 	{Opt_test_dummy_encryption, "test_dummy_encryption"},
+	{Opt_inlinecrypt, "inlinecrypt"},
 	{Opt_nombcache, "nombcache"},
 	{Opt_nombcache, "no_mbcache"},	/* for backward compatibility */
+	{Opt_mb_optimize_scan, "mb_optimize_scan=%d"},
 	{Opt_removed, "check=none"},	/* mount option from ext2/3 */
 	{Opt_removed, "nocheck"},	/* mount option from ext2/3 */
 	{Opt_removed, "reservation"},	/* mount option from ext2/3 */
@@ -1712,7 +1732,9 @@ static const struct mount_opts {
 	{Opt_jqfmt_vfsv1, QFMT_VFS_V1, MOPT_QFMT},
 	{Opt_max_dir_size_kb, 0, MOPT_GTE0},
 	{Opt_test_dummy_encryption, 0, MOPT_GTE0},
+	{Opt_inlinecrypt, EXT4_MOUNT_INLINECRYPT, MOPT_SET},
 	{Opt_nombcache, EXT4_MOUNT_NO_MBCACHE, MOPT_SET},
+	{Opt_mb_optimize_scan, EXT4_MOUNT2_MB_OPTIMIZE_SCAN, MOPT_GTE0},
 	{Opt_err, 0, 0}
 };
 
@@ -1934,6 +1956,13 @@ static int handle_mount_opt(struct super_block *sb, char *opt, int token,
 			return 1;
 		}
 		sbi->s_jquota_fmt = m->mount_opt;
+#endif
+	} else if (token == Opt_inlinecrypt) {
+#ifdef CONFIG_FS_ENCRYPTION_INLINE_CRYPT
+		sbi->s_mount_opt |= m->mount_opt;
+#else
+		ext4_msg(sb, KERN_INFO, "inlinecrypt option not supported");
+		return -1;
 #endif
 	} else if (token == Opt_dax) {
 #ifdef CONFIG_FS_DAX
@@ -1944,6 +1973,23 @@ static int handle_mount_opt(struct super_block *sb, char *opt, int token,
 		ext4_msg(sb, KERN_INFO, "dax option not supported");
 		return -1;
 #endif
+	} else if (token == Opt_mb_optimize_scan) {
+		if (arg > 1) {
+			ext4_msg(sb, KERN_ERR,
+				 "mb_optimize_scan should be set to 0 or 1.");
+			return -1;
+		}
+		/* the lists and tree are only kept up to date when enabled */
+		if (is_remount &&
+		    !!arg != !!test_opt2(sb, MB_OPTIMIZE_SCAN)) {
+			ext4_msg(sb, KERN_ERR,
+				 "can't change mb_optimize_scan on remount");
+			return -1;
+		}
+		if (arg)
+			sbi->s_mount_opt2 |= m->mount_opt;
+		else
+			sbi->s_mount_opt2 &= ~m->mount_opt;
 	} else if (token == Opt_data_err_abort) {
 		sbi->s_mount_opt |= m->mount_opt;
 	} else if (token == Opt_data_err_ignore) {
@@ -2164,6 +2210,9 @@ static int _ext4_show_options(struct seq_file *seq, struct super_block *sb,
 		SEQ_OPTS_PRINT("max_dir_size_kb=%u", sbi->s_max_dir_size_kb);
 	if (test_opt(sb, DATA_ERR_ABORT))
 		SEQ_OPTS_PUTS("data_err=abort");
+	if (nodefs || !test_opt2(sb, MB_OPTIMIZE_SCAN))
+		SEQ_OPTS_PRINT("mb_optimize_scan=%d",
+			       test_opt2(sb, MB_OPTIMIZE_SCAN) ? 1 : 0);
 	if (DUMMY_ENCRYPTION_ENABLED(sbi))
 		SEQ_OPTS_PUTS("test_dummy_encryption");
 
@@ -3681,6 +3730,9 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	    ((def_mount_opts & EXT4_DEFM_NODELALLOC) == 0))
 		set_opt(sb, DELALLOC);
 
+	/* pick block groups from lists instead of scanning them all */
+	set_opt2(sb, MB_OPTIMIZE_SCAN);
+
 	/*
 	 * set default s_li_wait_mult for lazyinit, for the case there is
 	 * no mount option specified.
@@ -4159,6 +4211,10 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	INIT_LIST_HEAD(&sbi->s_orphan); /* unlinked but open files */
 	mutex_init(&sbi->s_orphan_lock);
 
+	INIT_LIST_HEAD(&sbi->s_fc_q);
+	INIT_LIST_HEAD(&sbi->s_fc_dentry_q);
+	spin_lock_init(&sbi->s_fc_lock);
+
 	sb->s_root = NULL;
 
 	needs_recovery = (es->s_last_orphan != 0 ||
@@ -4267,6 +4323,23 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 
 	sbi->s_journal->j_commit_callback = ext4_journal_commit_callback;
 
+	/*
+	 * Fast commits log logical changes, which data=journal can't do, and
+	 * track blocks rather than clusters.
+	 */
+	if (ext4_has_feature_fast_commit(sb) && !sb_rdonly(sb) &&
+	    !ext4_has_feature_bigalloc(sb) &&
+	    test_opt(sb, DATA_FLAGS) != EXT4_MOUNT_JOURNAL_DATA) {
+		if (jbd2_journal_set_features(sbi->s_journal, 0, 0,
+				JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+			ext4_fc_init(sb, sbi->s_journal);
+			set_opt2(sb, JOURNAL_FAST_COMMIT);
+		} else {
+			ext4_msg(sb, KERN_WARNING,
+				 "Failed to enable fast commits");
+		}
+	}
+
 no_journal:
 	if (!test_opt(sb, NO_MBCACHE)) {
 		sbi->s_ea_block_cache = ext4_xattr_create_cache();
@@ -4804,7 +4877,10 @@ static int ext4_load_journal(struct super_block *sb,
 		if (save)
 			memcpy(save, ((char *) es) +
 			       EXT4_S_ERR_START, EXT4_S_ERR_LEN);
+		if (ext4_has_feature_fast_commit(sb))
+			journal->j_fc_replay_callback = ext4_fc_replay;
 		err = jbd2_journal_load(journal);
+		ext4_fc_replay_cleanup(sb);
 		if (save)
 			memcpy(((char *) es) + EXT4_S_ERR_START,
 			       save, EXT4_S_ERR_LEN);
@@ -5954,7 +6030,7 @@ static struct file_system_type ext4_fs_type = {
 	.name		= "ext4",
 	.mount		= ext4_mount,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_PAR_DIR_UPDATE,
 };
 MODULE_ALIAS_FS("ext4");
 
@@ -5974,6 +6050,7 @@ static int __init ext4_init_fs(void)
 
 	for (i = 0; i < EXT4_WQ_HASH_SZ; i++)
 		init_waitqueue_head(&ext4__ioend_wq[i]);
+	ext4_init_dir_locks();
 
 	err = ext4_init_es();
 	if (err)
@@ -2427,6 +2427,11 @@ ext4_xattr_set_handle(handle_t *handle, struct inode *inode, int name_index,
 	}
 	if (!error) {
 		ext4_xattr_update_super_block(handle, inode->i_sb);
+		/* fast commits only log xattrs stored in the inode body */
+		if (EXT4_I(inode)->i_file_acl || !bs.s.not_found ||
+		    ext4_has_feature_ea_inode(inode->i_sb))
+			ext4_fc_mark_ineligible(inode->i_sb,
+						EXT4_FC_REASON_XATTR, handle);
 		inode->i_ctime = current_time(inode);
 		if (!value)
 			no_expand = 0;
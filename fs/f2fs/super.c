@@ -136,6 +136,7 @@ enum {
 	Opt_alloc,
 	Opt_fsync,
 	Opt_test_dummy_encryption,
+	Opt_inlinecrypt,
 	Opt_checkpoint,
 	Opt_err,
 };
@@ -195,6 +196,7 @@ static match_table_t f2fs_tokens = {
 	{Opt_alloc, "alloc_mode=%s"},
 	{Opt_fsync, "fsync_mode=%s"},
 	{Opt_test_dummy_encryption, "test_dummy_encryption"},
+	{Opt_inlinecrypt, "inlinecrypt"},
 	{Opt_checkpoint, "checkpoint=%s"},
 	{Opt_err, NULL},
 };
@@ -769,6 +771,14 @@ static int parse_options(struct super_block *sb, char *options)
 #else
 			f2fs_msg(sb, KERN_INFO,
 					"Test dummy encryption mount option ignored");
+#endif
+			break;
+		case Opt_inlinecrypt:
+#ifdef CONFIG_FS_ENCRYPTION_INLINE_CRYPT
+			set_opt(sbi, INLINECRYPT);
+#else
+			f2fs_msg(sb, KERN_INFO,
+					"inline encryption not supported");
 #endif
 			break;
 		case Opt_checkpoint:
@@ -1391,6 +1401,8 @@ static int f2fs_show_options(struct seq_file *seq, struct dentry *root)
 	if (F2FS_OPTION(sbi).test_dummy_encryption)
 		seq_puts(seq, ",test_dummy_encryption");
 #endif
+	if (test_opt(sbi, INLINECRYPT))
+		seq_puts(seq, ",inlinecrypt");
 
 	if (F2FS_OPTION(sbi).alloc_mode == ALLOC_MODE_DEFAULT)
 		seq_printf(seq, ",alloc_mode=%s", "default");
@@ -2187,6 +2199,14 @@ static bool f2fs_dummy_context(struct inode *inode)
 	return DUMMY_ENCRYPTION_ENABLED(F2FS_I_SB(inode));
 }
 
+static bool f2fs_inline_crypt_enabled(struct super_block *sb)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(sb);
+
+	/* the key is only programmed for the first device */
+	return test_opt(sbi, INLINECRYPT) && !sbi->s_ndevs;
+}
+
 static const struct fscrypt_operations f2fs_cryptops = {
 	.key_prefix	= "f2fs:",
 	.get_context	= f2fs_get_context,
@@ -2194,6 +2214,7 @@ static const struct fscrypt_operations f2fs_cryptops = {
 	.dummy_context	= f2fs_dummy_context,
 	.empty_dir	= f2fs_empty_dir,
 	.max_namelen	= F2FS_NAME_LEN,
+	.inline_crypt_enabled = f2fs_inline_crypt_enabled,
 };
 #endif
 
@@ -18,6 +18,7 @@
 #include <linux/bitops.h>
 #include <linux/spinlock.h>
 #include <linux/rcupdate.h>
+#include <linux/close_range.h>
 
 unsigned int sysctl_nr_open __read_mostly = 1024*1024;
 unsigned int sysctl_nr_open_min = BITS_PER_LONG;
@@ -640,6 +641,73 @@ int __close_fd(struct files_struct *files, unsigned fd)
 }
 EXPORT_SYMBOL(__close_fd); /* for ksys_close() */
 
+/**
+ * __close_range() - Close all file descriptors in a given range.
+ *
+ * @fd:     starting file descriptor to close
+ * @max_fd: last file descriptor to close
+ * @flags:  CLOSE_RANGE_UNSHARE and/or CLOSE_RANGE_CLOEXEC
+ *
+ * This closes a range of file descriptors. All file descriptors
+ * from @fd up to and including @max_fd are closed.  Only the descriptors
+ * that are actually open are visited, by walking the open_fds bitmap, so
+ * the cost does not depend on RLIMIT_NOFILE.
+ */
+int __close_range(unsigned int fd, unsigned int max_fd, unsigned int flags)
+{
+	struct files_struct *displaced = NULL;
+	struct files_struct *files;
+	struct fdtable *fdt;
+	int ret;
+
+	if (flags & ~(CLOSE_RANGE_UNSHARE | CLOSE_RANGE_CLOEXEC))
+		return -EINVAL;
+
+	if (fd > max_fd)
+		return -EINVAL;
+
+	if (flags & CLOSE_RANGE_UNSHARE) {
+		ret = unshare_files(&displaced);
+		if (ret)
+			return ret;
+	}
+
+	files = current->files;
+	spin_lock(&files->file_lock);
+	for (;;) {
+		struct file *file;
+		unsigned int last;
+
+		fdt = files_fdtable(files);
+		last = min(max_fd, fdt->max_fds - 1);
+		fd = find_next_bit(fdt->open_fds, last + 1, fd);
+		if (fd > last)
+			break;
+
+		if (flags & CLOSE_RANGE_CLOEXEC) {
+			__set_close_on_exec(fd++, fdt);
+			continue;
+		}
+
+		file = fdt->fd[fd];
+		if (file) {
+			rcu_assign_pointer(fdt->fd[fd], NULL);
+			__put_unused_fd(files, fd);
+			spin_unlock(&files->file_lock);
+			filp_close(file, files);
+			cond_resched();
+			spin_lock(&files->file_lock);
+		}
+		fd++;
+	}
+	spin_unlock(&files->file_lock);
+
+	if (displaced)
+		put_files_struct(displaced);
+
+	return 0;
+}
+
 void do_close_on_exec(struct files_struct *files)
 {
 	unsigned i;
@@ -25,10 +25,6 @@
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
 
-/* Ordinary requests have even IDs, while interrupts IDs are odd */
-#define FUSE_INT_REQ_BIT (1ULL << 0)
-#define FUSE_REQ_ID_STEP (1ULL << 1)
-
 static struct kmem_cache *fuse_req_cachep;
 
 static struct fuse_dev *fuse_get_dev(struct file *file)
@@ -361,7 +357,7 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 
 static u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
-	fiq->reqctr += FUSE_REQ_ID_STEP;
+	fiq->reqctr += fiq->reqstep;
 	return fiq->reqctr;
 }
 
@@ -370,10 +366,56 @@ static unsigned int fuse_req_hash(u64 unique)
 	return hash_long(unique & ~FUSE_INT_REQ_BIT, FUSE_PQ_HASH_BITS);
 }
 
+/*
+ * Lock the input queue that requests submitted on this CPU go to: the
+ * CPU's own queue if some device is reading from it, otherwise the shared
+ * queue.
+ */
+static struct fuse_iqueue *fuse_lock_submit_iq(struct fuse_conn *fc)
+{
+	struct fuse_iqueue __percpu *cpu_iq = READ_ONCE(fc->cpu_iq);
+	struct fuse_iqueue *fiq;
+
+	if (cpu_iq) {
+		fiq = raw_cpu_ptr(cpu_iq);
+		if (READ_ONCE(fiq->nr_readers)) {
+			spin_lock(&fiq->waitq.lock);
+			/* The last reader may have gone away meanwhile */
+			if (fiq->nr_readers)
+				return fiq;
+			spin_unlock(&fiq->waitq.lock);
+		}
+	}
+	fiq = &fc->iq;
+	spin_lock(&fiq->waitq.lock);
+	return fiq;
+}
+
+/*
+ * Lock the input queue the request was queued on, or return NULL if it
+ * has not been queued yet.  Requests are moved to the shared queue when
+ * the last reader of a per-CPU queue goes away, hence the recheck.
+ */
+static struct fuse_iqueue *fuse_lock_req_iq(struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->fiq);
+		if (!fiq)
+			return NULL;
+		spin_lock(&fiq->waitq.lock);
+		if (likely(fiq == req->fiq))
+			return fiq;
+		spin_unlock(&fiq->waitq.lock);
+	}
+}
+
 static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->fiq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	wake_up_locked(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
@@ -382,12 +424,12 @@ static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	forget->forget_one.nodeid = nodeid;
 	forget->forget_one.nlookup = nlookup;
 
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_submit_iq(fc);
 	if (fiq->connected) {
 		fiq->forget_list_tail->next = forget;
 		fiq->forget_list_tail = forget;
@@ -401,7 +443,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 
 static void flush_bg_queue(struct fuse_conn *fc)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
@@ -410,7 +452,7 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_first_entry(&fc->bg_queue, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_submit_iq(fc);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request(fiq, req);
 		spin_unlock(&fiq->waitq.lock);
@@ -427,14 +469,16 @@ static void flush_bg_queue(struct fuse_conn *fc)
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	if (test_and_set_bit(FR_FINISHED, &req->flags))
 		goto put_request;
 
-	spin_lock(&fiq->waitq.lock);
-	list_del_init(&req->intr_entry);
-	spin_unlock(&fiq->waitq.lock);
+	fiq = fuse_lock_req_iq(req);
+	if (fiq) {
+		list_del_init(&req->intr_entry);
+		spin_unlock(&fiq->waitq.lock);
+	}
 	WARN_ON(test_bit(FR_PENDING, &req->flags));
 	WARN_ON(test_bit(FR_SENT, &req->flags));
 	if (test_bit(FR_BACKGROUND, &req->flags)) {
@@ -470,9 +514,10 @@ static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 	fuse_put_request(fc, req);
 }
 
-static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
+static void queue_interrupt(struct fuse_req *req)
 {
-	spin_lock(&fiq->waitq.lock);
+	struct fuse_iqueue *fiq = fuse_lock_req_iq(req);
+
 	if (test_bit(FR_FINISHED, &req->flags)) {
 		spin_unlock(&fiq->waitq.lock);
 		return;
@@ -487,7 +532,7 @@ static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 	int err;
 
 	if (!fc->no_interrupt) {
@@ -501,7 +546,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		/* matches barrier in fuse_dev_do_read() */
 		smp_mb__after_atomic();
 		if (test_bit(FR_SENT, &req->flags))
-			queue_interrupt(fiq, req);
+			queue_interrupt(req);
 	}
 
 	if (!test_bit(FR_FORCE, &req->flags)) {
@@ -511,7 +556,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_req_iq(req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -532,10 +577,10 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_submit_iq(fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->waitq.lock);
 		req->out.h.error = -ENOTCONN;
@@ -672,11 +717,11 @@ static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
 	int err = -ENODEV;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	__clear_bit(FR_ISREPLY, &req->flags);
 	req->in.h.unique = unique;
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_submit_iq(fc);
 	if (fiq->connected) {
 		queue_request(fiq, req);
 		err = 0;
@@ -1286,7 +1331,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = READ_ONCE(fud->iq);
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_in *in;
@@ -1372,7 +1417,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(req);
 	fuse_put_request(fc, req);
 
 	return reqsize;
@@ -1947,7 +1992,7 @@ static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(&fc->iq, req);
+			queue_interrupt(req);
 		fuse_put_request(fc, req);
 
 		fuse_copy_finish(cs);
@@ -2094,7 +2139,7 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return EPOLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = READ_ONCE(fud->iq);
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->waitq.lock);
@@ -2139,6 +2184,23 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/* Disconnect an input queue and move its pending requests to to_end */
+static void fuse_abort_iq(struct fuse_iqueue *fiq, struct list_head *to_end)
+{
+	struct fuse_req *req;
+
+	spin_lock(&fiq->waitq.lock);
+	fiq->connected = 0;
+	list_for_each_entry(req, &fiq->pending, list)
+		clear_bit(FR_PENDING, &req->flags);
+	list_splice_tail_init(&fiq->pending, to_end);
+	while (forget_pending(fiq))
+		kfree(dequeue_forget(fiq, 1, NULL));
+	wake_up_all_locked(&fiq->waitq);
+	spin_unlock(&fiq->waitq.lock);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
 /*
  * Abort all requests.
  *
@@ -2159,14 +2221,13 @@ static void end_polls(struct fuse_conn *fc)
  */
 void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
-
 	spin_lock(&fc->lock);
 	if (fc->connected) {
 		struct fuse_dev *fud;
 		struct fuse_req *req, *next;
 		LIST_HEAD(to_end);
 		unsigned int i;
+		int cpu;
 
 		/* Background queuing checks fc->connected under bg_lock */
 		spin_lock(&fc->bg_lock);
@@ -2202,16 +2263,12 @@ void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 		flush_bg_queue(fc);
 		spin_unlock(&fc->bg_lock);
 
-		spin_lock(&fiq->waitq.lock);
-		fiq->connected = 0;
-		list_for_each_entry(req, &fiq->pending, list)
-			clear_bit(FR_PENDING, &req->flags);
-		list_splice_tail_init(&fiq->pending, &to_end);
-		while (forget_pending(fiq))
-			kfree(dequeue_forget(fiq, 1, NULL));
-		wake_up_all_locked(&fiq->waitq);
-		spin_unlock(&fiq->waitq.lock);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		fuse_abort_iq(&fc->iq, &to_end);
+		if (fc->cpu_iq) {
+			for_each_possible_cpu(cpu)
+				fuse_abort_iq(per_cpu_ptr(fc->cpu_iq, cpu),
+					      &to_end);
+		}
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2230,6 +2287,43 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+/*
+ * Drop a reader of a per-CPU input queue.  Once the last one is gone, new
+ * requests from that CPU go to the shared queue, and anything still queued
+ * is moved there so that it is not stranded.
+ */
+static void fuse_iqueue_drop_reader(struct fuse_conn *fc,
+				    struct fuse_iqueue *fiq)
+{
+	struct fuse_iqueue *shared = &fc->iq;
+	struct fuse_req *req;
+
+	spin_lock(&fiq->waitq.lock);
+	if (--fiq->nr_readers) {
+		spin_unlock(&fiq->waitq.lock);
+		return;
+	}
+
+	spin_lock_nested(&shared->waitq.lock, SINGLE_DEPTH_NESTING);
+	list_for_each_entry(req, &fiq->pending, list)
+		WRITE_ONCE(req->fiq, shared);
+	list_for_each_entry(req, &fiq->interrupts, intr_entry)
+		WRITE_ONCE(req->fiq, shared);
+	list_splice_tail_init(&fiq->pending, &shared->pending);
+	list_splice_tail_init(&fiq->interrupts, &shared->interrupts);
+	if (forget_pending(fiq)) {
+		shared->forget_list_tail->next = fiq->forget_list_head.next;
+		shared->forget_list_tail = fiq->forget_list_tail;
+		fiq->forget_list_head.next = NULL;
+		fiq->forget_list_tail = &fiq->forget_list_head;
+	}
+	if (request_pending(shared))
+		wake_up_locked(&shared->waitq);
+	spin_unlock(&shared->waitq.lock);
+	spin_unlock(&fiq->waitq.lock);
+	kill_fasync(&shared->fasync, SIGIO, POLL_IN);
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2248,6 +2342,9 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 
 		end_requests(fc, &to_end);
 
+		if (fud->iq != &fc->iq)
+			fuse_iqueue_drop_reader(fc, fud->iq);
+
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
 			WARN_ON(fc->iq.fasync != NULL);
@@ -2267,7 +2364,7 @@ static int fuse_dev_fasync(int fd, struct file *file, int on)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fud->fc->iq.fasync);
+	return fasync_helper(fd, file, on, &READ_ONCE(fud->iq)->fasync);
 }
 
 static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
@@ -2287,6 +2384,51 @@ static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
 	return 0;
 }
 
+/* Make the device read from the input queue of the given CPU */
+static int fuse_dev_set_queue(struct fuse_dev *fud, u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue __percpu *cpu_iq = NULL;
+	struct fuse_iqueue *fiq;
+	unsigned int i;
+	int err;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	if (!READ_ONCE(fc->cpu_iq)) {
+		cpu_iq = alloc_percpu(struct fuse_iqueue);
+		if (!cpu_iq)
+			return -ENOMEM;
+		for_each_possible_cpu(i)
+			fuse_iqueue_init(per_cpu_ptr(cpu_iq, i), i + 1);
+	}
+
+	spin_lock(&fc->lock);
+	err = -ENOTCONN;
+	if (!fc->connected)
+		goto out_unlock;
+	err = -EBUSY;
+	if (fud->iq != &fc->iq)
+		goto out_unlock;
+	if (!fc->cpu_iq) {
+		/* Pairs with READ_ONCE() in fuse_lock_submit_iq() */
+		smp_store_release(&fc->cpu_iq, cpu_iq);
+		cpu_iq = NULL;
+	}
+	fiq = per_cpu_ptr(fc->cpu_iq, cpu);
+	spin_lock(&fiq->waitq.lock);
+	fiq->nr_readers++;
+	spin_unlock(&fiq->waitq.lock);
+	WRITE_ONCE(fud->iq, fiq);
+	err = 0;
+out_unlock:
+	spin_unlock(&fc->lock);
+	free_percpu(cpu_iq);
+
+	return err;
+}
+
 static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			   unsigned long arg)
 {
@@ -2319,6 +2461,37 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				fput(old);
 			}
 		}
+	} else if (cmd == FUSE_DEV_IOC_BACKING_OPEN) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		struct fuse_backing_map map;
+
+		err = -EPERM;
+		if (fud) {
+			err = -EFAULT;
+			if (!copy_from_user(&map, (void __user *) arg,
+					    sizeof(map)))
+				err = fuse_backing_open(fud->fc, &map);
+		}
+	} else if (cmd == FUSE_DEV_IOC_BACKING_CLOSE) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		int backing_id;
+
+		err = -EPERM;
+		if (fud) {
+			err = -EFAULT;
+			if (!get_user(backing_id, (__u32 __user *) arg))
+				err = fuse_backing_close(fud->fc, backing_id);
+		}
+	} else if (cmd == FUSE_DEV_IOC_SET_QUEUE) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		u32 cpu;
+
+		err = -EPERM;
+		if (fud) {
+			err = -EFAULT;
+			if (!get_user(cpu, (__u32 __user *) arg))
+				err = fuse_dev_set_queue(fud, cpu);
+		}
 	}
 	return err;
 }
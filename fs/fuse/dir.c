@@ -460,6 +460,13 @@ static int fuse_create_open(struct inode *dir, struct dentry *entry,
 	d_instantiate(entry, inode);
 	fuse_change_entry_timeout(entry, &outentry);
 	fuse_dir_changed(dir);
+	if (ff->open_flags & FOPEN_PASSTHROUGH) {
+		err = fuse_passthrough_open(ff, file, outopen.backing_id);
+		if (err) {
+			fuse_sync_release(ff, flags);
+			return err;
+		}
+	}
 	err = finish_open(file, entry, generic_file_open);
 	if (err) {
 		fuse_sync_release(ff, flags);
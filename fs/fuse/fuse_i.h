@@ -27,6 +27,7 @@
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
 #include <linux/user_namespace.h>
+#include <linux/idr.h>
 
 /** Default max number of pages that can be used in a single read request */
 #define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
@@ -43,6 +44,10 @@
 /** Number of dentries for each connection in the control filesystem */
 #define FUSE_CTL_NUM_DENTRIES 5
 
+/* Ordinary requests have even IDs, while interrupts IDs are odd */
+#define FUSE_INT_REQ_BIT (1ULL << 0)
+#define FUSE_REQ_ID_STEP (1ULL << 1)
+
 /** Number of page pointers embedded in fuse_req */
 #define FUSE_REQ_INLINE_PAGES 1
 
@@ -211,6 +216,18 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Backing file opened for passthrough I/O, if any */
+	struct file *passthrough;
+};
+
+/** Backing file registered with FUSE_DEV_IOC_BACKING_OPEN */
+struct fuse_backing {
+	/** The file supplied by the server */
+	struct file *file;
+
+	/** Credentials used to open passthrough files on the backing inode */
+	const struct cred *cred;
 };
 
 /** One input argument of a request */
@@ -363,6 +380,9 @@ struct fuse_req {
 	/** Entry on the interrupts list  */
 	struct list_head intr_entry;
 
+	/** Input queue the request was queued on */
+	struct fuse_iqueue *fiq;
+
 	/** refcount */
 	refcount_t count;
 
@@ -446,6 +466,12 @@ struct fuse_iqueue {
 	/** The next unique request id */
 	u64 reqctr;
 
+	/** Increment of reqctr, keeps ids unique across all queues */
+	u64 reqstep;
+
+	/** Number of devices reading from this queue (per-CPU queues only) */
+	unsigned int nr_readers;
+
 	/** The list of pending requests */
 	struct list_head pending;
 
@@ -490,6 +516,9 @@ struct fuse_dev {
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
+	/** Input queue read by this device */
+	struct fuse_iqueue *iq;
+
 	/** list entry on fc->devices */
 	struct list_head entry;
 };
@@ -537,12 +566,18 @@ struct fuse_conn {
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/** Per-CPU input queues, allocated by FUSE_DEV_IOC_SET_QUEUE */
+	struct fuse_iqueue __percpu *cpu_iq;
+
 	/** The next unique kernel file handle */
 	u64 khctr;
 
 	/** rbtree of fuse_files waiting for poll events indexed by ph */
 	struct rb_root polled_files;
 
+	/** Backing files for passthrough, indexed by backing_id */
+	struct idr backing_files_map;
+
 	/** Maximum number of outstanding background requests */
 	unsigned max_background;
 
@@ -616,6 +651,9 @@ struct fuse_conn {
 	/** cache READLINK responses in page cache */
 	unsigned cache_symlinks:1;
 
+	/** Passthrough of read/write/mmap to a backing file is enabled */
+	unsigned passthrough:1;
+
 	/*
 	 * The following bitfields are only for optimization purposes
 	 * and hence races in setting them will not cause malfunction
@@ -956,6 +994,11 @@ void fuse_change_entry_timeout(struct dentry *entry, struct fuse_entry_out *o);
  */
 struct fuse_conn *fuse_conn_get(struct fuse_conn *fc);
 
+/**
+ * Initialize an input queue, id selects its share of the request ids
+ */
+void fuse_iqueue_init(struct fuse_iqueue *fiq, unsigned int id);
+
 /**
  * Initialize fuse_conn
  */
@@ -1074,4 +1117,14 @@ int fuse_set_acl(struct inode *inode, struct posix_acl *acl, int type);
 /* readdir.c */
 int fuse_readdir(struct file *file, struct dir_context *ctx);
 
+/* passthrough.c */
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map);
+int fuse_backing_close(struct fuse_conn *fc, int backing_id);
+void fuse_backing_files_free(struct fuse_conn *fc);
+int fuse_passthrough_open(struct fuse_file *ff, struct file *file,
+			  int backing_id);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *iter);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *iter);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
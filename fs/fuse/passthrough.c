@@ -0,0 +1,238 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * FUSE passthrough: forward read/write/mmap of an open file to a backing
+ * file registered by the server, bypassing the userspace round trip.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/capability.h>
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/uio.h>
+
+static void fuse_backing_free(struct fuse_backing *fb)
+{
+	fput(fb->file);
+	put_cred(fb->cred);
+	kfree(fb);
+}
+
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map)
+{
+	struct fuse_backing *fb;
+	struct file *file;
+	int res;
+
+	if (!fc->passthrough || !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (map->flags || map->padding)
+		return -EINVAL;
+
+	file = fget(map->fd);
+	if (!file)
+		return -EBADF;
+
+	res = -EINVAL;
+	if (!S_ISREG(file_inode(file)->i_mode))
+		goto out_fput;
+
+	/*
+	 * The fuse superblock was given a stack depth of one when passthrough
+	 * was negotiated, so this refuses both fuse-on-fuse passthrough and
+	 * backing files on stacked filesystems such as overlayfs.
+	 */
+	res = -ELOOP;
+	if (file_inode(file)->i_sb->s_stack_depth >= fc->sb->s_stack_depth)
+		goto out_fput;
+
+	res = -ENOMEM;
+	fb = kmalloc(sizeof(*fb), GFP_KERNEL);
+	if (!fb)
+		goto out_fput;
+
+	fb->file = file;
+	fb->cred = get_cred(file->f_cred);
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	res = idr_alloc_cyclic(&fc->backing_files_map, fb, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+
+	if (res < 0)
+		fuse_backing_free(fb);
+
+	return res;
+
+out_fput:
+	fput(file);
+	return res;
+}
+
+int fuse_backing_close(struct fuse_conn *fc, int backing_id)
+{
+	struct fuse_backing *fb;
+
+	if (!fc->passthrough || !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (backing_id <= 0)
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	fb = idr_remove(&fc->backing_files_map, backing_id);
+	spin_unlock(&fc->lock);
+
+	if (!fb)
+		return -ENOENT;
+
+	/* Files already opened in passthrough mode hold their own reference */
+	fuse_backing_free(fb);
+
+	return 0;
+}
+
+void fuse_backing_files_free(struct fuse_conn *fc)
+{
+	struct fuse_backing *fb;
+	int id;
+
+	idr_for_each_entry(&fc->backing_files_map, fb, id)
+		fuse_backing_free(fb);
+	idr_destroy(&fc->backing_files_map);
+}
+
+int fuse_passthrough_open(struct fuse_file *ff, struct file *file,
+			  int backing_id)
+{
+	struct fuse_conn *fc = ff->fc;
+	struct fuse_backing *fb;
+	struct file *backing_file = NULL;
+	const struct cred *cred = NULL;
+	struct file *passthrough;
+	int flags = file->f_flags & ~(O_CREAT | O_EXCL | O_NOCTTY | O_TRUNC);
+	int err;
+
+	if (!fc->passthrough)
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	fb = idr_find(&fc->backing_files_map, backing_id);
+	if (fb) {
+		backing_file = get_file(fb->file);
+		cred = get_cred(fb->cred);
+	}
+	spin_unlock(&fc->lock);
+
+	if (!fb)
+		return -ENOENT;
+
+	/*
+	 * dentry_open() does not check inode permissions, so only allow the
+	 * access modes that the server itself had on the backing file.
+	 */
+	err = -EACCES;
+	if (file->f_mode & ~backing_file->f_mode & (FMODE_READ | FMODE_WRITE))
+		goto out;
+
+	passthrough = dentry_open(&backing_file->f_path, flags, cred);
+	if (IS_ERR(passthrough)) {
+		err = PTR_ERR(passthrough);
+		goto out;
+	}
+
+	ff->passthrough = passthrough;
+	err = 0;
+out:
+	put_cred(cred);
+	fput(backing_file);
+	return err;
+}
+
+static rwf_t fuse_iocb_to_rwf(struct kiocb *iocb)
+{
+	int ifl = iocb->ki_flags;
+	rwf_t flags = 0;
+
+	if (ifl & IOCB_NOWAIT)
+		flags |= RWF_NOWAIT;
+	if (ifl & IOCB_HIPRI)
+		flags |= RWF_HIPRI;
+	if (ifl & IOCB_DSYNC)
+		flags |= RWF_DSYNC;
+	if (ifl & IOCB_SYNC)
+		flags |= RWF_SYNC;
+
+	return flags;
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	ssize_t ret;
+
+	if (!iov_iter_count(iter))
+		return 0;
+
+	ret = vfs_iter_read(ff->passthrough, iter, &iocb->ki_pos,
+			    fuse_iocb_to_rwf(iocb));
+	fuse_invalidate_atime(file_inode(file));
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	ssize_t ret;
+
+	if (!iov_iter_count(iter))
+		return 0;
+
+	inode_lock(inode);
+	file_start_write(ff->passthrough);
+	ret = vfs_iter_write(ff->passthrough, iter, &iocb->ki_pos,
+			     fuse_iocb_to_rwf(iocb));
+	file_end_write(ff->passthrough);
+	if (ret > 0)
+		fuse_write_update_size(inode, iocb->ki_pos);
+	fuse_invalidate_attr(inode);
+	inode_unlock(inode);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing_file = ff->passthrough;
+	int ret;
+
+	if (!backing_file->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	vma->vm_file = get_file(backing_file);
+
+	ret = call_mmap(vma->vm_file, vma);
+
+	if (ret) {
+		/* Drop reference count from new vm_file value */
+		fput(backing_file);
+	} else {
+		/* Drop reference count from previous vm_file value */
+		fput(file);
+	}
+
+	fuse_invalidate_atime(file_inode(file));
+
+	return ret;
+}
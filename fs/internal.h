@@ -17,6 +17,8 @@ struct linux_binprm;
 struct path;
 struct mount;
 struct shrink_control;
+struct kstat;
+struct statx;
 
 /*
  * block_dev.c
@@ -156,6 +158,11 @@ extern struct dentry *d_alloc_cursor(struct dentry *);
  */
 extern int rw_verify_area(int, struct file *, const loff_t *, size_t);
 
+/*
+ * stat.c
+ */
+extern int cp_statx(const struct kstat *stat, struct statx __user *buffer);
+
 /*
  * pipe.c
  */
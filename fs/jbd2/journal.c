@@ -782,6 +782,184 @@ int jbd2_complete_transaction(journal_t *journal, tid_t tid)
 }
 EXPORT_SYMBOL(jbd2_complete_transaction);
 
+/*
+ * Fast commit support.
+ *
+ * A fast commit writes a filesystem specific log of the changes made since
+ * the last full commit into the fast commit area at the end of the journal,
+ * without going through the running transaction.  Fast commits and full
+ * commits exclude each other: a full commit waits for an ongoing fast
+ * commit to finish and resets the fast commit area once it is done, which
+ * makes the fast commits written for earlier transactions stale.
+ */
+
+/**
+ * jbd2_fc_begin_commit() - start a fast commit
+ * @journal: Journal to act on.
+ * @tid: tid of the running transaction the fast commit is made for.
+ *
+ * Return: 0 if the caller may write a fast commit, -EALREADY if @tid is
+ * already committed or committing (the caller should wait for that commit
+ * instead), -EAGAIN if another commit was in progress and has now finished
+ * (the caller should try again), or -EINVAL if fast commits are disabled.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	if (!jbd2_has_feature_fast_commit(journal) || !journal->j_fc_wbuf)
+		return -EINVAL;
+
+	write_lock(&journal->j_state_lock);
+	if (!journal->j_running_transaction ||
+	    journal->j_running_transaction->t_tid != tid) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+
+	if (journal->j_flags &
+	    (JBD2_FULL_COMMIT_ONGOING | JBD2_FAST_COMMIT_ONGOING)) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		return -EAGAIN;
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+
+	/*
+	 * Recovery skips a journal marked empty, so undo the effects of a
+	 * prior jbd2_journal_flush() before the fast commit hits the disk.
+	 */
+	if (journal->j_flags & JBD2_FLUSHED) {
+		int err = 0;
+
+		mutex_lock_io(&journal->j_checkpoint_mutex);
+		if (journal->j_flags & JBD2_FLUSHED)
+			err = jbd2_journal_update_sb_log_tail(journal,
+						journal->j_tail_sequence,
+						journal->j_tail, REQ_SYNC);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+		if (err) {
+			write_lock(&journal->j_state_lock);
+			journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+			write_unlock(&journal->j_state_lock);
+			wake_up(&journal->j_fc_wait);
+			return err;
+		}
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+static int __jbd2_fc_end_commit(journal_t *journal, tid_t tid, bool fallback)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	if (!fallback && journal->j_fc_cleanup_callback)
+		journal->j_fc_cleanup_callback(journal, 0, tid);
+	wake_up(&journal->j_fc_wait);
+
+	if (fallback)
+		return jbd2_complete_transaction(journal, tid);
+	return 0;
+}
+
+/**
+ * jbd2_fc_end_commit() - finish a successful fast commit
+ * @journal: Journal to act on.
+ */
+int jbd2_fc_end_commit(journal_t *journal)
+{
+	return __jbd2_fc_end_commit(journal, 0, false);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
+/**
+ * jbd2_fc_end_commit_fallback() - give up on a fast commit
+ * @journal: Journal to act on.
+ * @tid: tid of the transaction the fast commit was started for.
+ *
+ * Finish the fast commit and fall back to committing @tid in full.
+ *
+ * Return: the result of waiting for the full commit.
+ */
+int jbd2_fc_end_commit_fallback(journal_t *journal, tid_t tid)
+{
+	return __jbd2_fc_end_commit(journal, tid, true);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit_fallback);
+
+/**
+ * jbd2_fc_get_buf() - get the next block of the fast commit area
+ * @journal: Journal to act on.
+ * @bh_out: the buffer head of the block, not uptodate.
+ *
+ * The buffer is referenced until jbd2_fc_wait_bufs() is called for it.
+ *
+ * Return: 0 on success, -ENOSPC if the fast commit area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	unsigned long blocknr;
+	struct buffer_head *bh;
+	int err;
+
+	*bh_out = NULL;
+
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return -ENOSPC;
+	blocknr = journal->j_fc_first + journal->j_fc_off;
+
+	err = jbd2_journal_bmap(journal, blocknr, &pblock);
+	if (err)
+		return err;
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	journal->j_fc_wbuf[journal->j_fc_off++] = bh;
+	*bh_out = bh;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+
+/**
+ * jbd2_fc_wait_bufs() - wait for fast commit blocks to be written
+ * @journal: Journal to act on.
+ * @num_blks: number of blocks, counted back from the last one handed out
+ *	      by jbd2_fc_get_buf().
+ *
+ * Drops the references to the buffers taken by jbd2_fc_get_buf().
+ *
+ * Return: 0 on success, -EIO if any of the blocks could not be written.
+ */
+int jbd2_fc_wait_bufs(journal_t *journal, int num_blks)
+{
+	struct buffer_head *bh;
+	int i, err = 0;
+
+	for (i = journal->j_fc_off - 1;
+	     i >= 0 && i >= (int)journal->j_fc_off - num_blks; i--) {
+		bh = journal->j_fc_wbuf[i];
+		if (!bh)
+			continue;
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			err = -EIO;
+		put_bh(bh);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_wait_bufs);
+
 /*
  * Log buffer allocation routines:
  */
@@ -1145,6 +1323,7 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1306,6 +1485,14 @@ static int journal_reset(journal_t *journal)
 
 	first = be32_to_cpu(sb->s_first);
 	last = be32_to_cpu(sb->s_maxlen);
+	/* The fast commit area sits at the end of the journal */
+	if (jbd2_has_feature_fast_commit(journal) &&
+	    journal->j_fc_wbufsize > 0) {
+		journal->j_fc_last = last;
+		last -= journal->j_fc_wbufsize;
+		journal->j_fc_first = last;
+		journal->j_fc_off = 0;
+	}
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1616,6 +1803,43 @@ static int journal_get_superblock(journal_t *journal)
 	return err;
 }
 
+static unsigned long jbd2_journal_get_num_fc_blks(journal_superblock_t *sb)
+{
+	unsigned long num_fc_blks = be32_to_cpu(sb->s_num_fc_blks);
+
+	return num_fc_blks ? num_fc_blks : JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+}
+
+/*
+ * Carve the fast commit area out of the end of the journal.  Must be called
+ * on an empty journal, either from load_superblock() or when the feature is
+ * turned on right after the journal has been loaded.
+ */
+static int jbd2_journal_init_fast_commit(journal_t *journal)
+{
+	unsigned long num_fc_blks;
+
+	num_fc_blks = jbd2_journal_get_num_fc_blks(journal->j_superblock);
+	if (journal->j_last < journal->j_first + num_fc_blks +
+			      JBD2_MIN_JOURNAL_BLOCKS)
+		return -ENOSPC;
+
+	if (!journal->j_fc_wbuf) {
+		journal->j_fc_wbuf = kmalloc_array(num_fc_blks,
+					sizeof(struct buffer_head *),
+					GFP_KERNEL);
+		if (!journal->j_fc_wbuf)
+			return -ENOMEM;
+	}
+
+	journal->j_fc_wbufsize = num_fc_blks;
+	journal->j_fc_last = journal->j_last;
+	journal->j_last = journal->j_fc_last - num_fc_blks;
+	journal->j_fc_first = journal->j_last;
+	journal->j_fc_off = 0;
+	return 0;
+}
+
 /*
  * Load the on-disk journal superblock and read the key fields into the
  * journal_t.
@@ -1638,6 +1862,13 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (jbd2_has_feature_fast_commit(journal) &&
+	    jbd2_journal_init_fast_commit(journal)) {
+		printk(KERN_ERR "JBD2: Cannot set up the fast commit area.\n");
+		journal_fail_superblock(journal);
+		return -EINVAL;
+	}
+
 	return 0;
 }
 
@@ -1778,6 +2009,7 @@ int jbd2_journal_destroy(journal_t *journal)
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
 	kfree(journal->j_wbuf);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal);
 
 	return err;
@@ -1918,6 +2150,25 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 		}
 	}
 
+	/*
+	 * The fast commit area is taken from the end of the log, which is
+	 * only possible while the log is still empty.
+	 */
+	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		unsigned long old_last = journal->j_last;
+
+		if (journal->j_running_transaction ||
+		    journal->j_committing_transaction ||
+		    journal->j_head != journal->j_first ||
+		    journal->j_tail != journal->j_first)
+			return 0;
+		if (jbd2_journal_init_fast_commit(journal))
+			return 0;
+		write_lock(&journal->j_state_lock);
+		journal->j_free -= old_last - journal->j_last;
+		write_unlock(&journal->j_state_lock);
+	}
+
 	/* If enabling v1 checksums, downgrade superblock */
 	if (COMPAT_FEATURE_ON(JBD2_FEATURE_COMPAT_CHECKSUM))
 		sb->s_feature_incompat &=
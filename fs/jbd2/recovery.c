@@ -35,7 +35,6 @@ struct recovery_info
 	int		nr_revoke_hits;
 };
 
-enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
 static int do_one_pass(journal_t *journal,
 				struct recovery_info *info, enum passtype pass);
 static int scan_revoke_records(journal_t *, struct buffer_head *,
@@ -229,6 +228,46 @@ do {									\
 		var -= ((journal)->j_last - (journal)->j_first);	\
 } while (0)
 
+/*
+ * Hand the blocks of the fast commit area to the filesystem, which replays
+ * the fast commits made on top of the last transaction found in the log.
+ */
+static int fc_do_one_pass(journal_t *journal,
+			  struct recovery_info *info, enum passtype pass)
+{
+	unsigned int expected_commit_id = info->end_transaction;
+	unsigned long next_fc_block;
+	struct buffer_head *bh;
+	int err = 0;
+
+	if (!journal->j_fc_replay_callback)
+		return 0;
+
+	for (next_fc_block = journal->j_fc_first;
+	     next_fc_block < journal->j_fc_last; next_fc_block++) {
+		jbd_debug(3, "Fast commit replay: next block %lu\n",
+			  next_fc_block);
+		err = jread(&bh, journal, next_fc_block);
+		if (err) {
+			jbd_debug(3, "Fast commit replay: read error\n");
+			break;
+		}
+
+		err = journal->j_fc_replay_callback(journal, bh, pass,
+					next_fc_block - journal->j_fc_first,
+					expected_commit_id);
+		brelse(bh);
+		if (err <= 0)
+			break;
+		err = 0;
+	}
+
+	if (err)
+		jbd_debug(3, "Fast commit replay failed, err = %d\n", err);
+
+	return err;
+}
+
 /**
  * jbd2_journal_recover - recovers a on-disk journal
  * @journal: the journal to recover
@@ -239,7 +278,8 @@ do {									\
  * Recovery is done in three passes.  In the first pass, we look for the
  * end of the log.  In the second, we assemble the list of revoke
  * blocks.  In the third and final pass, we replay any un-revoked blocks
- * in the log.
+ * in the log.  If the journal has a fast commit area, the filesystem then
+ * replays the fast commits made on top of the last transaction.
  */
 int jbd2_journal_recover(journal_t *journal)
 {
@@ -269,6 +309,11 @@ int jbd2_journal_recover(journal_t *journal)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err && jbd2_has_feature_fast_commit(journal)) {
+		err = fc_do_one_pass(journal, &info, PASS_SCAN);
+		if (!err)
+			err = fc_do_one_pass(journal, &info, PASS_REPLAY);
+	}
 
 	jbd_debug(1, "JBD2: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
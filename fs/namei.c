@@ -493,7 +493,7 @@ struct nameidata {
 	struct path	root;
 	struct inode	*inode; /* path.dentry.d_inode */
 	unsigned int	flags;
-	unsigned	seq, m_seq;
+	unsigned	seq, m_seq, r_seq;
 	int		last_type;
 	unsigned	depth;
 	int		total_link_count;
@@ -672,6 +672,11 @@ static int unlazy_walk(struct nameidata *nd)
 	BUG_ON(!(nd->flags & LOOKUP_RCU));
 
 	nd->flags &= ~LOOKUP_RCU;
+	if (unlikely(nd->flags & LOOKUP_CACHED)) {
+		drop_links(nd);
+		nd->depth = 0;
+		goto out2;
+	}
 	if (unlikely(!legitimize_links(nd)))
 		goto out2;
 	if (unlikely(!legitimize_path(nd, &nd->path, nd->seq)))
@@ -713,6 +718,11 @@ static int unlazy_child(struct nameidata *nd, struct dentry *dentry, unsigned se
 	BUG_ON(!(nd->flags & LOOKUP_RCU));
 
 	nd->flags &= ~LOOKUP_RCU;
+	if (unlikely(nd->flags & LOOKUP_CACHED)) {
+		drop_links(nd);
+		nd->depth = 0;
+		goto out2;
+	}
 	if (unlikely(!legitimize_links(nd)))
 		goto out2;
 	if (unlikely(!legitimize_mnt(nd->path.mnt, nd->m_seq)))
@@ -787,6 +797,8 @@ static int complete_walk(struct nameidata *nd)
 	if (nd->flags & LOOKUP_RCU) {
 		if (!(nd->flags & LOOKUP_ROOT))
 			nd->root.mnt = NULL;
+		/* The walk itself stayed in the dcache; legitimizing is fine. */
+		nd->flags &= ~LOOKUP_CACHED;
 		if (unlikely(unlazy_walk(nd)))
 			return -ECHILD;
 	}
@@ -845,6 +857,13 @@ static inline void path_to_nameidata(const struct path *path,
 
 static int nd_jump_root(struct nameidata *nd)
 {
+	if (unlikely(nd->flags & LOOKUP_BENEATH))
+		return -EXDEV;
+	if (unlikely(nd->flags & LOOKUP_NO_XDEV)) {
+		/* Absolute pathname arguments to path_init() are allowed. */
+		if (nd->path.mnt != NULL && nd->path.mnt != nd->root.mnt)
+			return -EXDEV;
+	}
 	if (nd->flags & LOOKUP_RCU) {
 		struct dentry *d;
 		nd->path = nd->root;
@@ -865,16 +884,35 @@ static int nd_jump_root(struct nameidata *nd)
 
 /*
  * Helper to directly jump to a known parsed path from ->get_link,
- * caller must have taken a reference to path beforehand.
+ * caller must have taken a reference to path beforehand.  The
+ * reference is dropped if the jump is refused by the lookup flags.
  */
-void nd_jump_link(struct path *path)
+int nd_jump_link(struct path *path)
 {
+	int error = -ELOOP;
 	struct nameidata *nd = current->nameidata;
-	path_put(&nd->path);
 
+	if (unlikely(nd->flags & LOOKUP_NO_MAGICLINKS))
+		goto err;
+
+	error = -EXDEV;
+	if (unlikely(nd->flags & LOOKUP_NO_XDEV)) {
+		if (nd->path.mnt != path->mnt)
+			goto err;
+	}
+	/* Not currently safe for scoped-lookups. */
+	if (unlikely(nd->flags & LOOKUP_IS_SCOPED))
+		goto err;
+
+	path_put(&nd->path);
 	nd->path = *path;
 	nd->inode = nd->path.dentry->d_inode;
 	nd->flags |= LOOKUP_JUMPED;
+	return 0;
+
+err:
+	path_put(path);
+	return error;
 }
 
 static inline void put_link(struct nameidata *nd)
@@ -1089,8 +1127,9 @@ const char *get_link(struct nameidata *nd)
 	if (*res == '/') {
 		if (!nd->root.mnt)
 			set_root(nd);
-		if (unlikely(nd_jump_root(nd)))
-			return ERR_PTR(-ECHILD);
+		error = nd_jump_root(nd);
+		if (unlikely(error))
+			return ERR_PTR(error);
 		while (unlikely(*++res == '/'))
 			;
 	}
@@ -1275,8 +1314,11 @@ static int follow_managed(struct path *path, struct nameidata *nd)
 		mntput(path->mnt);
 	if (ret == -EISDIR || !ret)
 		ret = 1;
-	if (need_mntput)
+	if (need_mntput) {
+		if (unlikely(nd->flags & LOOKUP_NO_XDEV) && ret >= 0)
+			ret = -EXDEV;
 		nd->flags |= LOOKUP_JUMPED;
+	}
 	if (unlikely(ret < 0))
 		path_put_conditional(path, nd);
 	return ret;
@@ -1333,6 +1375,9 @@ static bool __follow_mount_rcu(struct nameidata *nd, struct path *path,
 		mounted = __lookup_mnt(path->mnt, path->dentry);
 		if (!mounted)
 			break;
+		/* Let follow_managed() fail the lookup in ref-walk mode. */
+		if (unlikely(nd->flags & LOOKUP_NO_XDEV))
+			return false;
 		path->mnt = &mounted->mnt;
 		path->dentry = mounted->mnt.mnt_root;
 		nd->flags |= LOOKUP_JUMPED;
@@ -1353,8 +1398,11 @@ static int follow_dotdot_rcu(struct nameidata *nd)
 	struct inode *inode = nd->inode;
 
 	while (1) {
-		if (path_equal(&nd->path, &nd->root))
+		if (path_equal(&nd->path, &nd->root)) {
+			if (unlikely(nd->flags & LOOKUP_BENEATH))
+				return -EXDEV;
 			break;
+		}
 		if (nd->path.dentry != nd->path.mnt->mnt_root) {
 			struct dentry *old = nd->path.dentry;
 			struct dentry *parent = old->d_parent;
@@ -1379,6 +1427,8 @@ static int follow_dotdot_rcu(struct nameidata *nd)
 				return -ECHILD;
 			if (&mparent->mnt == nd->path.mnt)
 				break;
+			if (unlikely(nd->flags & LOOKUP_NO_XDEV))
+				return -EXDEV;
 			/* we know that mountpoint was pinned */
 			nd->path.dentry = mountpoint;
 			nd->path.mnt = &mparent->mnt;
@@ -1393,6 +1443,8 @@ static int follow_dotdot_rcu(struct nameidata *nd)
 			return -ECHILD;
 		if (!mounted)
 			break;
+		if (unlikely(nd->flags & LOOKUP_NO_XDEV))
+			return -EXDEV;
 		nd->path.mnt = &mounted->mnt;
 		nd->path.dentry = mounted->mnt.mnt_root;
 		inode = nd->path.dentry->d_inode;
@@ -1452,10 +1504,13 @@ int follow_down(struct path *path)
 EXPORT_SYMBOL(follow_down);
 
 /*
- * Skip to top of mountpoint pile in refwalk mode for follow_dotdot()
+ * Skip to top of mountpoint pile in refwalk mode for follow_dotdot().
+ * Returns true if a mount was crossed.
  */
-static void follow_mount(struct path *path)
+static bool follow_mount(struct path *path)
 {
+	bool jumped = false;
+
 	while (d_mountpoint(path->dentry)) {
 		struct vfsmount *mounted = lookup_mnt(path);
 		if (!mounted)
@@ -1464,7 +1519,9 @@ static void follow_mount(struct path *path)
 		mntput(path->mnt);
 		path->mnt = mounted;
 		path->dentry = dget(mounted->mnt_root);
+		jumped = true;
 	}
+	return jumped;
 }
 
 static int path_parent_directory(struct path *path)
@@ -1481,8 +1538,11 @@ static int path_parent_directory(struct path *path)
 static int follow_dotdot(struct nameidata *nd)
 {
 	while(1) {
-		if (path_equal(&nd->path, &nd->root))
+		if (path_equal(&nd->path, &nd->root)) {
+			if (unlikely(nd->flags & LOOKUP_BENEATH))
+				return -EXDEV;
 			break;
+		}
 		if (nd->path.dentry != nd->path.mnt->mnt_root) {
 			int ret = path_parent_directory(&nd->path);
 			if (ret)
@@ -1491,8 +1551,11 @@ static int follow_dotdot(struct nameidata *nd)
 		}
 		if (!follow_up(&nd->path))
 			break;
+		if (unlikely(nd->flags & LOOKUP_NO_XDEV))
+			return -EXDEV;
 	}
-	follow_mount(&nd->path);
+	if (follow_mount(&nd->path) && unlikely(nd->flags & LOOKUP_NO_XDEV))
+		return -EXDEV;
 	nd->inode = nd->path.dentry->d_inode;
 	return 0;
 }
@@ -1690,6 +1753,36 @@ static struct dentry *lookup_slow(const struct qstr *name,
 	return res;
 }
 
+/*
+ * Filesystems with FS_PAR_DIR_UPDATE have non-directories created and
+ * unlinked with the parent locked shared.  Updates of the same name are
+ * serialized by d_lock_update() instead, and the filesystem takes care of
+ * its own directory structure.
+ */
+static inline bool dir_par_update(struct inode *dir)
+{
+	return (dir->i_sb->s_type->fs_flags & FS_PAR_DIR_UPDATE) &&
+	       !dir->i_op->atomic_open;
+}
+
+/*
+ * __lookup_hash() for a parent locked shared: look the name up the way
+ * lookup_slow() does, and lock it for the update.
+ */
+static struct dentry *lookup_hash_update(const struct qstr *name,
+					 struct dentry *base,
+					 unsigned int flags)
+{
+	struct dentry *dentry;
+
+	for (;;) {
+		dentry = __lookup_slow(name, base, flags);
+		if (IS_ERR(dentry) || d_lock_update(dentry))
+			return dentry;
+		dput(dentry);
+	}
+}
+
 static inline int may_lookup(struct nameidata *nd)
 {
 	if (nd->flags & LOOKUP_RCU) {
@@ -1705,12 +1798,32 @@ static inline int may_lookup(struct nameidata *nd)
 static inline int handle_dots(struct nameidata *nd, int type)
 {
 	if (type == LAST_DOTDOT) {
+		int error;
+
 		if (!nd->root.mnt)
 			set_root(nd);
-		if (nd->flags & LOOKUP_RCU) {
-			return follow_dotdot_rcu(nd);
-		} else
-			return follow_dotdot(nd);
+		if (nd->flags & LOOKUP_RCU)
+			error = follow_dotdot_rcu(nd);
+		else
+			error = follow_dotdot(nd);
+		if (error)
+			return error;
+
+		if (unlikely(nd->flags & LOOKUP_IS_SCOPED)) {
+			/*
+			 * If there was a racing rename or mount along our
+			 * path, then we can't be sure that ".." hasn't jumped
+			 * above nd->root (and so userspace should retry or use
+			 * some fallback).
+			 */
+			smp_rmb();
+			if (unlikely(__read_seqcount_retry(&mount_lock.seqcount,
+							   nd->m_seq)))
+				return -EAGAIN;
+			if (unlikely(__read_seqcount_retry(&rename_lock.seqcount,
+							   nd->r_seq)))
+				return -EAGAIN;
+		}
 	}
 	return 0;
 }
@@ -1720,7 +1833,8 @@ static int pick_link(struct nameidata *nd, struct path *link,
 {
 	int error;
 	struct saved *last;
-	if (unlikely(nd->total_link_count++ >= MAXSYMLINKS)) {
+	if (unlikely(nd->flags & LOOKUP_NO_SYMLINKS) ||
+	    unlikely(nd->total_link_count++ >= MAXSYMLINKS)) {
 		path_to_nameidata(link, nd);
 		return -ELOOP;
 	}
@@ -2181,6 +2295,11 @@ static const char *path_init(struct nameidata *nd, unsigned flags)
 	nd->last_type = LAST_ROOT; /* if there are only slashes... */
 	nd->flags = flags | LOOKUP_JUMPED | LOOKUP_PARENT;
 	nd->depth = 0;
+
+	nd->m_seq = __read_seqcount_begin(&mount_lock.seqcount);
+	nd->r_seq = __read_seqcount_begin(&rename_lock.seqcount);
+	smp_rmb();
+
 	if (flags & LOOKUP_ROOT) {
 		struct dentry *root = nd->root.dentry;
 		struct inode *inode = root->d_inode;
@@ -2191,7 +2310,6 @@ static const char *path_init(struct nameidata *nd, unsigned flags)
 		if (flags & LOOKUP_RCU) {
 			nd->seq = __read_seqcount_begin(&nd->path.dentry->d_seq);
 			nd->root_seq = nd->seq;
-			nd->m_seq = read_seqbegin(&mount_lock);
 		} else {
 			path_get(&nd->path);
 		}
@@ -2202,13 +2320,23 @@ static const char *path_init(struct nameidata *nd, unsigned flags)
 	nd->path.mnt = NULL;
 	nd->path.dentry = NULL;
 
-	nd->m_seq = read_seqbegin(&mount_lock);
-	if (*s == '/') {
+	/* LOOKUP_CACHED requires RCU, ask caller to retry */
+	if (unlikely((flags & (LOOKUP_RCU | LOOKUP_CACHED)) == LOOKUP_CACHED))
+		return ERR_PTR(-EAGAIN);
+
+	/* Absolute pathname -- fetch the root (LOOKUP_IN_ROOT uses nd->dfd). */
+	if (*s == '/' && !(flags & LOOKUP_IN_ROOT)) {
+		int error;
+
 		set_root(nd);
-		if (likely(!nd_jump_root(nd)))
-			return s;
-		return ERR_PTR(-ECHILD);
-	} else if (nd->dfd == AT_FDCWD) {
+		error = nd_jump_root(nd);
+		if (unlikely(error))
+			return ERR_PTR(error);
+		return s;
+	}
+
+	/* Relative pathname -- get the starting-point it is relative to. */
+	if (nd->dfd == AT_FDCWD) {
 		if (flags & LOOKUP_RCU) {
 			struct fs_struct *fs = current->fs;
 			unsigned seq;
@@ -2223,7 +2351,6 @@ static const char *path_init(struct nameidata *nd, unsigned flags)
 			get_fs_pwd(current->fs, &nd->path);
 			nd->inode = nd->path.dentry->d_inode;
 		}
-		return s;
 	} else {
 		/* Caller must check execute permissions on the starting path component */
 		struct fd f = fdget_raw(nd->dfd);
@@ -2248,8 +2375,17 @@ static const char *path_init(struct nameidata *nd, unsigned flags)
 			nd->inode = nd->path.dentry->d_inode;
 		}
 		fdput(f);
-		return s;
 	}
+
+	/* For scoped-lookups we need to set the root to the dirfd as well. */
+	if (flags & LOOKUP_IS_SCOPED) {
+		nd->root = nd->path;
+		if (flags & LOOKUP_RCU)
+			nd->root_seq = nd->seq;
+		else
+			path_get(&nd->root);
+	}
+	return s;
 }
 
 static const char *trailing_symlink(struct nameidata *nd)
@@ -3135,11 +3271,13 @@ static int lookup_open(struct nameidata *nd, struct path *path,
 	struct dentry *dentry;
 	int error, create_error = 0;
 	umode_t mode = op->mode;
+	bool shared = (open_flag & O_CREAT) && dir_par_update(dir_inode);
 	DECLARE_WAIT_QUEUE_HEAD_ONSTACK(wq);
 
 	if (unlikely(IS_DEADDIR(dir_inode)))
 		return -ENOENT;
 
+again:
 	file->f_mode &= ~FMODE_CREATED;
 	dentry = d_lookup(dir, &nd->last);
 	for (;;) {
@@ -3225,14 +3363,27 @@ static int lookup_open(struct nameidata *nd, struct path *path,
 
 	/* Negative dentry, just create the file */
 	if (!dentry->d_inode && (open_flag & O_CREAT)) {
+		/* With the parent locked shared, someone may beat us to it */
+		if (shared) {
+			if (!d_lock_update(dentry)) {
+				dput(dentry);
+				goto again;
+			}
+			if (dentry->d_inode) {
+				d_unlock_update(dentry);
+				goto out_no_open;
+			}
+		}
 		file->f_mode |= FMODE_CREATED;
 		audit_inode_child(dir_inode, dentry, AUDIT_TYPE_CHILD_CREATE);
-		if (!dir_inode->i_op->create) {
+		if (!dir_inode->i_op->create)
 			error = -EACCES;
-			goto out_dput;
-		}
-		error = dir_inode->i_op->create(dir_inode, dentry, mode,
-						open_flag & O_EXCL);
+		else
+			error = dir_inode->i_op->create(dir_inode, dentry,
+							mode,
+							open_flag & O_EXCL);
+		if (shared)
+			d_unlock_update(dentry);
 		if (error)
 			goto out_dput;
 		fsnotify_create(dir_inode, dentry);
@@ -3261,6 +3412,7 @@ static int do_last(struct nameidata *nd,
 	int open_flag = op->open_flag;
 	bool will_truncate = (open_flag & O_TRUNC) != 0;
 	bool got_write = false;
+	bool shared;
 	int acc_mode = op->acc_mode;
 	unsigned seq;
 	struct inode *inode;
@@ -3317,15 +3469,16 @@ static int do_last(struct nameidata *nd,
 		 * dropping this one anyway.
 		 */
 	}
-	if (open_flag & O_CREAT)
-		inode_lock(dir->d_inode);
-	else
+	shared = !(open_flag & O_CREAT) || dir_par_update(dir->d_inode);
+	if (shared)
 		inode_lock_shared(dir->d_inode);
-	error = lookup_open(nd, &path, file, op, got_write);
-	if (open_flag & O_CREAT)
-		inode_unlock(dir->d_inode);
 	else
+		inode_lock(dir->d_inode);
+	error = lookup_open(nd, &path, file, op, got_write);
+	if (shared)
 		inode_unlock_shared(dir->d_inode);
+	else
+		inode_unlock(dir->d_inode);
 
 	if (error)
 		goto out;
@@ -3608,6 +3761,7 @@ static struct dentry *filename_create(int dfd, struct filename *name,
 	int err2;
 	int error;
 	bool is_dir = (lookup_flags & LOOKUP_DIRECTORY);
+	bool shared;
 
 	/*
 	 * Note that only LOOKUP_REVAL and LOOKUP_DIRECTORY matter here. Any
@@ -3632,8 +3786,14 @@ static struct dentry *filename_create(int dfd, struct filename *name,
 	 * Do the final lookup.
 	 */
 	lookup_flags |= LOOKUP_CREATE | LOOKUP_EXCL;
-	inode_lock_nested(path->dentry->d_inode, I_MUTEX_PARENT);
-	dentry = __lookup_hash(&last, path->dentry, lookup_flags);
+	shared = !is_dir && dir_par_update(path->dentry->d_inode);
+	if (shared) {
+		inode_lock_shared_nested(path->dentry->d_inode, I_MUTEX_PARENT);
+		dentry = lookup_hash_update(&last, path->dentry, lookup_flags);
+	} else {
+		inode_lock_nested(path->dentry->d_inode, I_MUTEX_PARENT);
+		dentry = __lookup_hash(&last, path->dentry, lookup_flags);
+	}
 	if (IS_ERR(dentry))
 		goto unlock;
 
@@ -3658,10 +3818,15 @@ static struct dentry *filename_create(int dfd, struct filename *name,
 	putname(name);
 	return dentry;
 fail:
+	if (shared)
+		d_unlock_update(dentry);
 	dput(dentry);
 	dentry = ERR_PTR(error);
 unlock:
-	inode_unlock(path->dentry->d_inode);
+	if (shared)
+		inode_unlock_shared(path->dentry->d_inode);
+	else
+		inode_unlock(path->dentry->d_inode);
 	if (!err2)
 		mnt_drop_write(path->mnt);
 out:
@@ -3680,8 +3845,15 @@ EXPORT_SYMBOL(kern_path_create);
 
 void done_path_create(struct path *path, struct dentry *dentry)
 {
-	dput(dentry);
-	inode_unlock(path->dentry->d_inode);
+	/* Only filename_create() can have locked the name */
+	if (dentry->d_flags & DCACHE_PAR_UPDATE) {
+		d_unlock_update(dentry);
+		dput(dentry);
+		inode_unlock_shared(path->dentry->d_inode);
+	} else {
+		dput(dentry);
+		inode_unlock(path->dentry->d_inode);
+	}
 	mnt_drop_write(path->mnt);
 	path_put(path);
 }
@@ -3965,7 +4137,8 @@ SYSCALL_DEFINE1(rmdir, const char __user *, pathname)
  * @dentry:	victim
  * @delegated_inode: returns victim inode, if the inode is delegated.
  *
- * The caller must hold dir->i_mutex.
+ * The caller must hold dir->i_mutex, or hold it shared and have the name
+ * locked with d_lock_update() on FS_PAR_DIR_UPDATE filesystems.
  *
  * If vfs_unlink discovers a delegation, it will return -EWOULDBLOCK and
  * return a reference to the inode in delegated_inode.  The caller
@@ -4033,6 +4206,7 @@ long do_unlinkat(int dfd, struct filename *name)
 	struct inode *inode = NULL;
 	struct inode *delegated_inode = NULL;
 	unsigned int lookup_flags = 0;
+	bool shared;
 retry:
 	name = filename_parentat(dfd, name, lookup_flags, &path, &last, &type);
 	if (IS_ERR(name))
@@ -4045,9 +4219,15 @@ long do_unlinkat(int dfd, struct filename *name)
 	error = mnt_want_write(path.mnt);
 	if (error)
 		goto exit1;
+	shared = dir_par_update(path.dentry->d_inode);
 retry_deleg:
-	inode_lock_nested(path.dentry->d_inode, I_MUTEX_PARENT);
-	dentry = __lookup_hash(&last, path.dentry, lookup_flags);
+	if (shared) {
+		inode_lock_shared_nested(path.dentry->d_inode, I_MUTEX_PARENT);
+		dentry = lookup_hash_update(&last, path.dentry, lookup_flags);
+	} else {
+		inode_lock_nested(path.dentry->d_inode, I_MUTEX_PARENT);
+		dentry = __lookup_hash(&last, path.dentry, lookup_flags);
+	}
 	error = PTR_ERR(dentry);
 	if (!IS_ERR(dentry)) {
 		/* Why not before? Because we want correct error value */
@@ -4062,9 +4242,14 @@ long do_unlinkat(int dfd, struct filename *name)
 			goto exit2;
 		error = vfs_unlink(path.dentry->d_inode, dentry, &delegated_inode);
 exit2:
+		if (shared)
+			d_unlock_update(dentry);
 		dput(dentry);
 	}
-	inode_unlock(path.dentry->d_inode);
+	if (shared)
+		inode_unlock_shared(path.dentry->d_inode);
+	else
+		inode_unlock(path.dentry->d_inode);
 	if (inode)
 		iput(inode);	/* truncate the inode here */
 	inode = NULL;
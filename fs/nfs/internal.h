@@ -57,6 +57,9 @@ struct nfs_clone_mount {
  */
 #define NFS_MAX_SECFLAVORS	(12)
 
+/* Maximum number of transports per server, see the nconnect option */
+#define NFS_MAX_CONNECTIONS	(16)
+
 /*
  * Value used if the user did not specify a port value.
  */
@@ -81,6 +84,7 @@ struct nfs_client_initdata {
 	struct nfs_subversion *nfs_mod;
 	int proto;
 	u32 minorversion;
+	unsigned int nconnect;
 	struct net *net;
 	const struct rpc_timeout *timeparms;
 };
@@ -121,6 +125,7 @@ struct nfs_parsed_mount_data {
 		char			*export_path;
 		int			port;
 		unsigned short		protocol;
+		unsigned short		nconnect;
 	} nfs_server;
 
 	struct security_mnt_opts lsm_opts;
@@ -0,0 +1,558 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Open file cache.
+ *
+ * NFSv2/v3 have no OPEN, so without a cache every READ, WRITE and COMMIT
+ * opens and closes the file it operates on.  Instead, keep the struct file
+ * around, keyed by inode, access mode, credentials and net namespace, and
+ * close it once it has been idle for a couple of laundrette passes or when
+ * memory is short.
+ */
+
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/file.h>
+#include <linux/sched.h>
+#include <linux/cred.h>
+#include <linux/list_lru.h>
+#include <linux/notifier.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
+
+#include "vfs.h"
+#include "nfsd.h"
+#include "nfsfh.h"
+#include "filecache.h"
+
+#define NFSDDBG_FACILITY	NFSDDBG_FH
+
+#define NFSD_FILE_HASH_BITS		12
+#define NFSD_FILE_HASH_SIZE		(1 << NFSD_FILE_HASH_BITS)
+#define NFSD_LAUNDRETTE_DELAY		(2 * HZ)
+
+/* Only these bits of the may_flags select a distinct open file */
+#define NFSD_FILE_MAY_MASK	(NFSD_MAY_READ|NFSD_MAY_WRITE)
+
+struct nfsd_fcache_bucket {
+	struct hlist_head	nfb_head;
+	spinlock_t		nfb_lock;
+	unsigned int		nfb_count;
+	unsigned int		nfb_maxcount;
+};
+
+static DEFINE_PER_CPU(unsigned long, nfsd_file_cache_hits);
+
+static struct kmem_cache		*nfsd_file_slab;
+static struct nfsd_fcache_bucket	*nfsd_file_hashtbl;
+static struct list_lru			nfsd_file_lru;
+static atomic_long_t			nfsd_filecache_count;
+static struct delayed_work		nfsd_filecache_laundrette;
+
+static void
+nfsd_file_schedule_laundrette(void)
+{
+	if (atomic_long_read(&nfsd_filecache_count))
+		queue_delayed_work(system_wq, &nfsd_filecache_laundrette,
+				   NFSD_LAUNDRETTE_DELAY);
+}
+
+static struct nfsd_file *
+nfsd_file_alloc(struct inode *inode, unsigned int may, unsigned int hashval,
+		struct net *net)
+{
+	struct nfsd_file *nf;
+
+	nf = kmem_cache_alloc(nfsd_file_slab, GFP_KERNEL);
+	if (!nf)
+		return NULL;
+
+	INIT_HLIST_NODE(&nf->nf_node);
+	INIT_LIST_HEAD(&nf->nf_lru);
+	nf->nf_file = NULL;
+	nf->nf_cred = get_current_cred();
+	nf->nf_net = net;
+	nf->nf_flags = 0;
+	nf->nf_inode = inode;
+	nf->nf_hashval = hashval;
+	atomic_set(&nf->nf_ref, 1);
+	nf->nf_may = may;
+	atomic_long_inc(&nfsd_filecache_count);
+	return nf;
+}
+
+/* Returns true if the struct file was closed and needs a delayed fput flush */
+static bool
+nfsd_file_free(struct nfsd_file *nf)
+{
+	bool flush = false;
+
+	put_cred(nf->nf_cred);
+	if (nf->nf_file) {
+		fput(nf->nf_file);
+		flush = true;
+	}
+	kmem_cache_free(nfsd_file_slab, nf);
+	atomic_long_dec(&nfsd_filecache_count);
+	return flush;
+}
+
+void
+nfsd_file_put(struct nfsd_file *nf)
+{
+	set_bit(NFSD_FILE_REFERENCED, &nf->nf_flags);
+	if (atomic_dec_and_test(&nf->nf_ref))
+		nfsd_file_free(nf);
+}
+
+/*
+ * Take an entry out of the hash table and the LRU, and put it on the
+ * dispose list.  Whoever clears NFSD_FILE_HASHED owns this step and the
+ * hash table's reference.  Called with the bucket lock held.
+ */
+static bool
+nfsd_file_unhash_locked(struct nfsd_file *nf, struct list_head *dispose)
+{
+	if (!test_and_clear_bit(NFSD_FILE_HASHED, &nf->nf_flags))
+		return false;
+	hlist_del_init(&nf->nf_node);
+	nfsd_file_hashtbl[nf->nf_hashval].nfb_count--;
+	list_lru_del(&nfsd_file_lru, &nf->nf_lru);
+	list_add(&nf->nf_lru, dispose);
+	return true;
+}
+
+static void
+nfsd_file_dispose_list(struct list_head *dispose)
+{
+	struct nfsd_file *nf;
+	bool flush = false;
+
+	while (!list_empty(dispose)) {
+		nf = list_first_entry(dispose, struct nfsd_file, nf_lru);
+		list_del(&nf->nf_lru);
+		if (atomic_dec_and_test(&nf->nf_ref))
+			flush |= nfsd_file_free(nf);
+	}
+	if (flush)
+		flush_delayed_fput();
+}
+
+/*
+ * Entries isolated by the LRU walk are already off the LRU with
+ * NFSD_FILE_HASHED cleared; finish taking them out of the hash table.
+ */
+static void
+nfsd_file_dispose_isolated(struct list_head *isolated)
+{
+	struct nfsd_file *nf;
+	bool flush = false;
+
+	while (!list_empty(isolated)) {
+		struct nfsd_fcache_bucket *b;
+
+		nf = list_first_entry(isolated, struct nfsd_file, nf_lru);
+		list_del(&nf->nf_lru);
+		b = &nfsd_file_hashtbl[nf->nf_hashval];
+		spin_lock(&b->nfb_lock);
+		hlist_del_init(&nf->nf_node);
+		b->nfb_count--;
+		spin_unlock(&b->nfb_lock);
+		if (atomic_dec_and_test(&nf->nf_ref))
+			flush |= nfsd_file_free(nf);
+	}
+	if (flush)
+		flush_delayed_fput();
+}
+
+/*
+ * Called with the LRU lock held, so the bucket lock must not be taken
+ * here; see nfsd_file_dispose_isolated().
+ */
+static enum lru_status
+nfsd_file_lru_cb(struct list_head *item, struct list_lru_one *lru,
+		 spinlock_t *lock, void *arg)
+{
+	struct list_head *head = arg;
+	struct nfsd_file *nf = list_entry(item, struct nfsd_file, nf_lru);
+
+	/* In use right now, look again on the next pass */
+	if (atomic_read(&nf->nf_ref) > 1)
+		return LRU_SKIP;
+
+	/* Used since the last pass, give it another round */
+	if (test_and_clear_bit(NFSD_FILE_REFERENCED, &nf->nf_flags))
+		return LRU_ROTATE;
+
+	/* Being unhashed by someone else */
+	if (!test_and_clear_bit(NFSD_FILE_HASHED, &nf->nf_flags))
+		return LRU_SKIP;
+
+	list_lru_isolate_move(lru, &nf->nf_lru, head);
+	return LRU_REMOVED;
+}
+
+static void
+nfsd_file_gc(void)
+{
+	LIST_HEAD(head);
+
+	list_lru_walk(&nfsd_file_lru, nfsd_file_lru_cb, &head, LONG_MAX);
+	nfsd_file_dispose_isolated(&head);
+}
+
+static void
+nfsd_file_gc_worker(struct work_struct *work)
+{
+	nfsd_file_gc();
+	nfsd_file_schedule_laundrette();
+}
+
+static unsigned long
+nfsd_file_lru_count(struct shrinker *s, struct shrink_control *sc)
+{
+	return list_lru_count(&nfsd_file_lru);
+}
+
+static unsigned long
+nfsd_file_lru_scan(struct shrinker *s, struct shrink_control *sc)
+{
+	LIST_HEAD(head);
+	unsigned long ret;
+
+	ret = list_lru_shrink_walk(&nfsd_file_lru, sc, nfsd_file_lru_cb, &head);
+	nfsd_file_dispose_isolated(&head);
+	return ret;
+}
+
+static struct shrinker	nfsd_file_shrinker = {
+	.scan_objects = nfsd_file_lru_scan,
+	.count_objects = nfsd_file_lru_count,
+	.seeks = 1,
+};
+
+static unsigned int
+nfsd_file_hashval(struct inode *inode)
+{
+	return hash_ptr(inode, NFSD_FILE_HASH_BITS);
+}
+
+/**
+ * nfsd_file_close_inode_sync - close all cached files of an inode
+ * @inode: inode of the file
+ *
+ * Unhash and put every cached file for @inode, then flush the delayed
+ * fput queue so that files whose last reference we dropped are closed
+ * by the time this returns.
+ */
+void
+nfsd_file_close_inode_sync(struct inode *inode)
+{
+	struct nfsd_fcache_bucket *b;
+	struct nfsd_file *nf;
+	struct hlist_node *tmp;
+	LIST_HEAD(dispose);
+
+	if (!nfsd_file_hashtbl)
+		return;
+
+	b = &nfsd_file_hashtbl[nfsd_file_hashval(inode)];
+	spin_lock(&b->nfb_lock);
+	hlist_for_each_entry_safe(nf, tmp, &b->nfb_head, nf_node) {
+		if (nf->nf_inode == inode)
+			nfsd_file_unhash_locked(nf, &dispose);
+	}
+	spin_unlock(&b->nfb_lock);
+	nfsd_file_dispose_list(&dispose);
+}
+
+/*
+ * A lease can't be set while nfsd keeps other opens of the file, so drop
+ * cached files as soon as someone tries to take one.
+ */
+static int
+nfsd_file_lease_notifier_call(struct notifier_block *nb, unsigned long arg,
+			      void *data)
+{
+	struct file_lock *fl = data;
+
+	/* Only close files for F_SETLEASE leases */
+	if (fl->fl_flags & FL_LEASE)
+		nfsd_file_close_inode_sync(file_inode(fl->fl_file));
+	return 0;
+}
+
+static struct notifier_block nfsd_file_lease_notifier = {
+	.notifier_call = nfsd_file_lease_notifier_call,
+};
+
+int
+nfsd_file_cache_init(void)
+{
+	int		ret = -ENOMEM;
+	unsigned int	i;
+
+	if (nfsd_file_hashtbl)
+		return 0;
+
+	nfsd_file_hashtbl = kcalloc(NFSD_FILE_HASH_SIZE,
+				sizeof(*nfsd_file_hashtbl), GFP_KERNEL);
+	if (!nfsd_file_hashtbl) {
+		pr_err("nfsd: unable to allocate nfsd_file_hashtbl\n");
+		goto out_err;
+	}
+
+	nfsd_file_slab = kmem_cache_create("nfsd_file",
+				sizeof(struct nfsd_file), 0, 0, NULL);
+	if (!nfsd_file_slab) {
+		pr_err("nfsd: unable to create nfsd_file_slab\n");
+		goto out_err;
+	}
+
+	ret = list_lru_init(&nfsd_file_lru);
+	if (ret) {
+		pr_err("nfsd: failed to init nfsd_file_lru: %d\n", ret);
+		goto out_err;
+	}
+
+	ret = register_shrinker(&nfsd_file_shrinker);
+	if (ret) {
+		pr_err("nfsd: failed to register nfsd_file_shrinker: %d\n", ret);
+		goto out_lru;
+	}
+
+	ret = lease_register_notifier(&nfsd_file_lease_notifier);
+	if (ret) {
+		pr_err("nfsd: unable to register lease notifier: %d\n", ret);
+		goto out_shrinker;
+	}
+
+	for (i = 0; i < NFSD_FILE_HASH_SIZE; i++) {
+		INIT_HLIST_HEAD(&nfsd_file_hashtbl[i].nfb_head);
+		spin_lock_init(&nfsd_file_hashtbl[i].nfb_lock);
+	}
+
+	INIT_DELAYED_WORK(&nfsd_filecache_laundrette, nfsd_file_gc_worker);
+	return 0;
+
+out_shrinker:
+	unregister_shrinker(&nfsd_file_shrinker);
+out_lru:
+	list_lru_destroy(&nfsd_file_lru);
+out_err:
+	kmem_cache_destroy(nfsd_file_slab);
+	nfsd_file_slab = NULL;
+	kfree(nfsd_file_hashtbl);
+	nfsd_file_hashtbl = NULL;
+	return ret;
+}
+
+/**
+ * nfsd_file_cache_purge - close cached files
+ * @net: only close files opened in this namespace, or all of them if NULL
+ */
+void
+nfsd_file_cache_purge(struct net *net)
+{
+	unsigned int		i;
+	struct nfsd_file	*nf;
+	struct hlist_node	*tmp;
+	LIST_HEAD(dispose);
+
+	if (!nfsd_file_hashtbl)
+		return;
+
+	for (i = 0; i < NFSD_FILE_HASH_SIZE; i++) {
+		struct nfsd_fcache_bucket *b = &nfsd_file_hashtbl[i];
+
+		spin_lock(&b->nfb_lock);
+		hlist_for_each_entry_safe(nf, tmp, &b->nfb_head, nf_node) {
+			if (net && nf->nf_net != net)
+				continue;
+			nfsd_file_unhash_locked(nf, &dispose);
+		}
+		spin_unlock(&b->nfb_lock);
+		nfsd_file_dispose_list(&dispose);
+	}
+}
+
+void
+nfsd_file_cache_shutdown(void)
+{
+	if (!nfsd_file_hashtbl)
+		return;
+
+	lease_unregister_notifier(&nfsd_file_lease_notifier);
+	unregister_shrinker(&nfsd_file_shrinker);
+	cancel_delayed_work_sync(&nfsd_filecache_laundrette);
+	nfsd_file_cache_purge(NULL);
+	list_lru_destroy(&nfsd_file_lru);
+	kmem_cache_destroy(nfsd_file_slab);
+	nfsd_file_slab = NULL;
+	kfree(nfsd_file_hashtbl);
+	nfsd_file_hashtbl = NULL;
+}
+
+static bool
+nfsd_match_cred(const struct cred *c1, const struct cred *c2)
+{
+	int i;
+
+	if (!uid_eq(c1->fsuid, c2->fsuid))
+		return false;
+	if (!gid_eq(c1->fsgid, c2->fsgid))
+		return false;
+	if (!cap_issubset(c1->cap_effective, c2->cap_effective) ||
+	    !cap_issubset(c2->cap_effective, c1->cap_effective))
+		return false;
+	if (c1->group_info == NULL || c2->group_info == NULL)
+		return c1->group_info == c2->group_info;
+	if (c1->group_info->ngroups != c2->group_info->ngroups)
+		return false;
+	for (i = 0; i < c1->group_info->ngroups; i++) {
+		if (!gid_eq(c1->group_info->gid[i], c2->group_info->gid[i]))
+			return false;
+	}
+	return true;
+}
+
+/* Find a hashed entry and take a reference.  Called with the bucket lock. */
+static struct nfsd_file *
+nfsd_file_find_locked(struct inode *inode, unsigned int may,
+		      unsigned int hashval, struct net *net)
+{
+	struct nfsd_file *nf;
+
+	hlist_for_each_entry(nf, &nfsd_file_hashtbl[hashval].nfb_head,
+			     nf_node) {
+		if (nf->nf_inode != inode || nf->nf_may != may ||
+		    nf->nf_net != net)
+			continue;
+		if (!test_bit(NFSD_FILE_HASHED, &nf->nf_flags))
+			continue;
+		if (!nfsd_match_cred(nf->nf_cred, current_cred()))
+			continue;
+		atomic_inc(&nf->nf_ref);
+		return nf;
+	}
+	return NULL;
+}
+
+/**
+ * nfsd_file_acquire - get an open file for a READ, WRITE or COMMIT
+ * @rqstp: the RPC transaction being executed
+ * @fhp: the NFS filehandle of the file to be opened
+ * @may_flags: NFSD_MAY_ settings for the file
+ * @pnf: OUT: the cached file, release with nfsd_file_put()
+ *
+ * The filehandle and permissions are verified on every call, just as
+ * nfsd_open() does; only the open itself is cached.
+ */
+__be32
+nfsd_file_acquire(struct svc_rqst *rqstp, struct svc_fh *fhp,
+		  unsigned int may_flags, struct nfsd_file **pnf)
+{
+	struct net *net = SVC_NET(rqstp);
+	unsigned int may = may_flags & NFSD_FILE_MAY_MASK;
+	struct nfsd_fcache_bucket *b;
+	struct nfsd_file *nf, *new;
+	struct inode *inode;
+	unsigned int hashval;
+	struct file *file;
+	__be32 status;
+
+	status = fh_verify(rqstp, fhp, S_IFREG,
+			   may_flags|NFSD_MAY_OWNER_OVERRIDE);
+	if (status != nfs_ok)
+		return status;
+
+	inode = d_inode(fhp->fh_dentry);
+	hashval = nfsd_file_hashval(inode);
+	b = &nfsd_file_hashtbl[hashval];
+
+	spin_lock(&b->nfb_lock);
+	nf = nfsd_file_find_locked(inode, may, hashval, net);
+	spin_unlock(&b->nfb_lock);
+	if (nf)
+		goto found;
+
+	status = nfsd_open_verified(rqstp, fhp, S_IFREG, may_flags, &file);
+	if (status != nfs_ok)
+		return status;
+
+	new = nfsd_file_alloc(inode, may, hashval, net);
+	if (!new) {
+		fput(file);
+		return nfserr_jukebox;
+	}
+	new->nf_file = file;
+
+	spin_lock(&b->nfb_lock);
+	nf = nfsd_file_find_locked(inode, may, hashval, net);
+	if (unlikely(nf)) {
+		/* Someone else opened it meanwhile, use theirs */
+		spin_unlock(&b->nfb_lock);
+		nfsd_file_put(new);
+		*pnf = nf;
+		return nfs_ok;
+	}
+	/* One reference for the hash table, one for the caller */
+	atomic_inc(&new->nf_ref);
+	__set_bit(NFSD_FILE_HASHED, &new->nf_flags);
+	hlist_add_head(&new->nf_node, &b->nfb_head);
+	list_lru_add(&nfsd_file_lru, &new->nf_lru);
+	if (++b->nfb_count > b->nfb_maxcount)
+		b->nfb_maxcount = b->nfb_count;
+	spin_unlock(&b->nfb_lock);
+
+	nfsd_file_schedule_laundrette();
+	*pnf = new;
+	return nfs_ok;
+
+found:
+	this_cpu_inc(nfsd_file_cache_hits);
+	status = nfserrno(nfsd_open_break_lease(inode, may_flags));
+	if (status != nfs_ok) {
+		nfsd_file_put(nf);
+		return status;
+	}
+	*pnf = nf;
+	return nfs_ok;
+}
+
+/*
+ * Note that fields may be added, removed or reordered in the future. Programs
+ * scraping this file for info should test the labels to ensure they're
+ * getting the correct field.
+ */
+static int nfsd_file_cache_stats_show(struct seq_file *m, void *v)
+{
+	unsigned int i, count = 0, longest = 0;
+	unsigned long hits = 0;
+
+	/*
+	 * No need for spinlocks here since we're not terribly interested in
+	 * accuracy. We do take the nfsd_mutex simply to ensure that we
+	 * don't end up racing with server shutdown
+	 */
+	mutex_lock(&nfsd_mutex);
+	if (nfsd_file_hashtbl) {
+		for (i = 0; i < NFSD_FILE_HASH_SIZE; i++) {
+			count += nfsd_file_hashtbl[i].nfb_count;
+			longest = max(longest, nfsd_file_hashtbl[i].nfb_count);
+		}
+	}
+	mutex_unlock(&nfsd_mutex);
+
+	for_each_possible_cpu(i)
+		hits += per_cpu(nfsd_file_cache_hits, i);
+
+	seq_printf(m, "total entries: %u\n", count);
+	seq_printf(m, "longest chain: %u\n", longest);
+	seq_printf(m, "cache hits:    %lu\n", hits);
+	return 0;
+}
+
+int nfsd_file_cache_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nfsd_file_cache_stats_show, NULL);
+}
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _FS_NFSD_FILECACHE_H
+#define _FS_NFSD_FILECACHE_H
+
+#include <linux/list_lru.h>
+
+struct svc_rqst;
+struct svc_fh;
+
+/*
+ * A file that knfsd has opened on behalf of its clients.  These are hashed
+ * by inode and kept open for a while after their last use so that a stream
+ * of READ/WRITE/COMMIT calls does not open and close the file each time.
+ *
+ * The nfsd_file does not hold a reference to the inode itself (nf_file
+ * does), so nf_inode is only ever used for comparisons.
+ */
+struct nfsd_file {
+	struct hlist_node	nf_node;
+	struct list_head	nf_lru;
+	struct file		*nf_file;
+	const struct cred	*nf_cred;
+	struct net		*nf_net;
+#define NFSD_FILE_HASHED	(0)
+#define NFSD_FILE_REFERENCED	(1)
+	unsigned long		nf_flags;
+	struct inode		*nf_inode;
+	unsigned int		nf_hashval;
+	atomic_t		nf_ref;
+	unsigned char		nf_may;
+};
+
+int		nfsd_file_cache_init(void);
+void		nfsd_file_cache_purge(struct net *net);
+void		nfsd_file_cache_shutdown(void);
+void		nfsd_file_put(struct nfsd_file *nf);
+void		nfsd_file_close_inode_sync(struct inode *inode);
+__be32		nfsd_file_acquire(struct svc_rqst *rqstp, struct svc_fh *fhp,
+				  unsigned int may_flags, struct nfsd_file **nfp);
+int		nfsd_file_cache_stats_open(struct inode *, struct file *);
+
+#endif /* _FS_NFSD_FILECACHE_H */
@@ -33,11 +33,13 @@ static bool should_merge(struct fsnotify_event *old_fsn,
 }
 
 /* and the list better be locked by something too! */
-static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
+static int fanotify_merge(struct fsnotify_group *group,
+			  struct fsnotify_event *event)
 {
-	struct fsnotify_event *test_event;
+	struct hlist_head *hlist;
+	struct fanotify_event_info *test_event;
 
-	pr_debug("%s: list=%p event=%p\n", __func__, list, event);
+	pr_debug("%s: group=%p event=%p\n", __func__, group, event);
 
 	/*
 	 * Don't merge a permission event with any other event so that we know
@@ -47,9 +49,15 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 	if (fanotify_is_perm_event(event->mask))
 		return 0;
 
-	list_for_each_entry_reverse(test_event, list, list) {
-		if (should_merge(test_event, event)) {
-			test_event->mask |= event->mask;
+	/*
+	 * The hash chain holds all queued events for objects that hash the
+	 * same, newest first, so the first match is the same event that a
+	 * backwards scan of the notification list would find.
+	 */
+	hlist = fanotify_event_hash_bucket(group, event);
+	hlist_for_each_entry(test_event, hlist, merge_list) {
+		if (should_merge(&test_event->fse, event)) {
+			test_event->fse.mask |= event->mask;
 			return 1;
 		}
 	}
@@ -57,6 +65,21 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 	return 0;
 }
 
+static void fanotify_insert_event(struct fsnotify_group *group,
+				  struct fsnotify_event *event)
+{
+	struct hlist_head *hlist;
+
+	assert_spin_locked(&group->notification_lock);
+
+	/* Permission events are never merged, don't bother hashing them */
+	if (fanotify_is_perm_event(event->mask))
+		return;
+
+	hlist = fanotify_event_hash_bucket(group, event);
+	hlist_add_head(&FANOTIFY_E(event)->merge_list, hlist);
+}
+
 static int fanotify_get_response(struct fsnotify_group *group,
 				 struct fanotify_perm_event_info *event,
 				 struct fsnotify_iter_info *iter_info)
@@ -171,6 +194,7 @@ struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
 		goto out;
 init: __maybe_unused
 	fsnotify_init_event(&event->fse, inode, mask);
+	INIT_HLIST_NODE(&event->merge_list);
 	if (FAN_GROUP_FLAG(group, FAN_REPORT_TID))
 		event->pid = get_pid(task_pid(current));
 	else
@@ -238,7 +262,8 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 	}
 
 	fsn_event = &event->fse;
-	ret = fsnotify_add_event(group, fsn_event, fanotify_merge);
+	ret = fsnotify_add_event(group, fsn_event, fanotify_merge,
+				 fanotify_insert_event);
 	if (ret) {
 		/* Permission events shouldn't be merged */
 		BUG_ON(ret == 1 && mask & FANOTIFY_PERM_EVENTS);
@@ -265,6 +290,7 @@ static void fanotify_free_group_priv(struct fsnotify_group *group)
 	user = group->fanotify_data.user;
 	atomic_dec(&user->fanotify_listeners);
 	free_uid(user);
+	kfree(group->fanotify_data.merge_hash);
 }
 
 static void fanotify_free_event(struct fsnotify_event *fsn_event)
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 #include <linux/fsnotify_backend.h>
+#include <linux/hash.h>
 #include <linux/path.h>
 #include <linux/slab.h>
 
@@ -7,6 +8,13 @@ extern struct kmem_cache *fanotify_mark_cache;
 extern struct kmem_cache *fanotify_event_cachep;
 extern struct kmem_cache *fanotify_perm_event_cachep;
 
+/*
+ * Queued events are hashed by the object they happened to, so that merging
+ * a new event does not need to scan the whole notification queue.
+ */
+#define FANOTIFY_HTABLE_BITS	(7)
+#define FANOTIFY_HTABLE_SIZE	(1 << FANOTIFY_HTABLE_BITS)
+
 /*
  * Structure for normal fanotify events. It gets allocated in
  * fanotify_handle_event() and freed when the information is retrieved by
@@ -20,6 +28,8 @@ struct fanotify_event_info {
 	 */
 	struct path path;
 	struct pid *pid;
+	/* entry in group->fanotify_data.merge_hash, under notification_lock */
+	struct hlist_node merge_list;
 };
 
 /*
@@ -52,6 +62,25 @@ static inline struct fanotify_event_info *FANOTIFY_E(struct fsnotify_event *fse)
 	return container_of(fse, struct fanotify_event_info, fse);
 }
 
+static inline struct hlist_head *
+fanotify_event_hash_bucket(struct fsnotify_group *group,
+			   struct fsnotify_event *fse)
+{
+	return &group->fanotify_data.merge_hash[hash_ptr(fse->inode,
+							 FANOTIFY_HTABLE_BITS)];
+}
+
+/*
+ * Remove an event that has been taken off the notification queue from the
+ * merge hash.  Called with the notification_lock held.
+ */
+static inline void fanotify_unhash_event(struct fsnotify_group *group,
+					 struct fsnotify_event *fse)
+{
+	assert_spin_locked(&group->notification_lock);
+	hlist_del_init(&FANOTIFY_E(fse)->merge_list);
+}
+
 struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
 						 struct inode *inode, u32 mask,
 						 const struct path *path);
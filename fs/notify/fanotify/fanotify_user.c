@@ -57,6 +57,8 @@ struct kmem_cache *fanotify_perm_event_cachep __read_mostly;
 static struct fsnotify_event *get_one_event(struct fsnotify_group *group,
 					    size_t count)
 {
+	struct fsnotify_event *fsn_event;
+
 	assert_spin_locked(&group->notification_lock);
 
 	pr_debug("%s: group=%p count=%zd\n", __func__, group, count);
@@ -69,7 +71,9 @@ static struct fsnotify_event *get_one_event(struct fsnotify_group *group,
 
 	/* held the notification_lock the whole time, so this is the
 	 * same event we peeked above */
-	return fsnotify_remove_first_event(group);
+	fsn_event = fsnotify_remove_first_event(group);
+	fanotify_unhash_event(group, fsn_event);
+	return fsn_event;
 }
 
 static int create_fd(struct fsnotify_group *group,
@@ -395,6 +399,7 @@ static int fanotify_release(struct inode *ignored, struct file *file)
 	 */
 	while (!fsnotify_notify_queue_is_empty(group)) {
 		fsn_event = fsnotify_remove_first_event(group);
+		fanotify_unhash_event(group, fsn_event);
 		if (!(fsn_event->mask & FANOTIFY_PERM_EVENTS)) {
 			spin_unlock(&group->notification_lock);
 			fsnotify_destroy_event(group, fsn_event);
@@ -680,7 +685,7 @@ static int fanotify_add_inode_mark(struct fsnotify_group *group,
 SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 {
 	struct fsnotify_group *group;
-	int f_flags, fd;
+	int f_flags, fd, i;
 	struct user_struct *user;
 	struct fanotify_event_info *oevent;
 
@@ -733,6 +738,15 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 	atomic_inc(&user->fanotify_listeners);
 	group->memcg = get_mem_cgroup_from_mm(current->mm);
 
+	group->fanotify_data.merge_hash = kmalloc_array(FANOTIFY_HTABLE_SIZE,
+					sizeof(struct hlist_head), GFP_KERNEL);
+	if (!group->fanotify_data.merge_hash) {
+		fd = -ENOMEM;
+		goto out_destroy_group;
+	}
+	for (i = 0; i < FANOTIFY_HTABLE_SIZE; i++)
+		INIT_HLIST_HEAD(&group->fanotify_data.merge_hash[i]);
+
 	oevent = fanotify_alloc_event(group, NULL, FS_Q_OVERFLOW, NULL);
 	if (unlikely(!oevent)) {
 		fd = -ENOMEM;
@@ -126,6 +126,7 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 	loff_t old_pos = 0;
 	loff_t new_pos = 0;
 	loff_t cloned;
+	bool try_copy_range;
 	int error = 0;
 
 	if (len == 0)
@@ -147,6 +148,16 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 		goto out;
 	/* Couldn't clone, so now we try to copy the data */
 
+	/*
+	 * If lower and upper are on the same fs, let the fs copy the data
+	 * itself (e.g. server side copy), before falling back to splice.
+	 * Write access to upper is already held, so call the method directly
+	 * rather than vfs_copy_file_range(), which would take it again.
+	 */
+	try_copy_range = file_inode(old_file)->i_sb ==
+			 file_inode(new_file)->i_sb &&
+			 new_file->f_op->copy_file_range;
+
 	/* FIXME: copy up sparse files efficiently */
 	while (len) {
 		size_t this_len = OVL_COPY_UP_CHUNK_SIZE;
@@ -160,6 +171,20 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 			break;
 		}
 
+		if (try_copy_range) {
+			bytes = new_file->f_op->copy_file_range(old_file,
+						old_pos, new_file, new_pos,
+						this_len, 0);
+			if (bytes > 0) {
+				old_pos += bytes;
+				new_pos += bytes;
+				len -= bytes;
+				continue;
+			}
+			/* Not supported or no progress, copy the rest by hand */
+			try_copy_range = false;
+		}
+
 		bytes = do_splice_direct(old_file, &old_pos,
 					 new_file, &new_pos,
 					 this_len, SPLICE_F_MOVE);
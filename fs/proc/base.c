@@ -92,6 +92,7 @@
 #include <linux/sched/coredump.h>
 #include <linux/sched/debug.h>
 #include <linux/sched/stat.h>
+#include <linux/delayacct.h>
 #include <linux/flex_array.h>
 #include <linux/posix-timers.h>
 #include <trace/events/oom.h>
@@ -1611,7 +1612,10 @@ static const char *proc_pid_get_link(struct dentry *dentry,
 	if (error)
 		goto out;
 
-	nd_jump_link(&path);
+	error = nd_jump_link(&path);
+	if (error)
+		goto out;
+
 	return NULL;
 out:
 	return ERR_PTR(error);
@@ -2753,6 +2757,82 @@ static int proc_tgid_io_accounting(struct seq_file *m, struct pid_namespace *ns,
 }
 #endif /* CONFIG_TASK_IO_ACCOUNTING */
 
+#ifdef CONFIG_TASK_DELAY_ACCT
+static int do_delays(struct task_struct *task, struct seq_file *m, int whole)
+{
+	struct taskstats *d;
+	unsigned long flags;
+	int result;
+
+	d = kzalloc(sizeof(*d), GFP_KERNEL);
+	if (!d)
+		return -ENOMEM;
+
+	result = mutex_lock_killable(&task->signal->cred_guard_mutex);
+	if (result)
+		goto out_free;
+
+	if (!ptrace_may_access(task, PTRACE_MODE_READ_FSCREDS)) {
+		result = -EACCES;
+		goto out_unlock;
+	}
+
+	if (whole && lock_task_sighand(task, &flags)) {
+		struct task_struct *t = task;
+
+		do {
+			delayacct_add_tsk(d, t);
+		} while_each_thread(task, t);
+
+		unlock_task_sighand(task, &flags);
+	} else {
+		delayacct_add_tsk(d, task);
+	}
+
+	seq_printf(m,
+		   "cpu_count: %llu\n"
+		   "cpu_delay_total: %llu\n",
+		   (unsigned long long)d->cpu_count,
+		   (unsigned long long)d->cpu_delay_total);
+
+#define DELAYS_SHOW(name)						\
+	seq_printf(m,							\
+		   #name "_count: %llu\n"				\
+		   #name "_delay_total: %llu\n"				\
+		   #name "_delay_max: %llu\n",				\
+		   (unsigned long long)d->name##_count,			\
+		   (unsigned long long)d->name##_delay_total,		\
+		   (unsigned long long)d->name##_delay_max)
+
+	DELAYS_SHOW(blkio);
+	DELAYS_SHOW(swapin);
+	DELAYS_SHOW(freepages);
+	DELAYS_SHOW(thrashing);
+	DELAYS_SHOW(compact);
+	DELAYS_SHOW(pagewait);
+#undef DELAYS_SHOW
+	result = 0;
+
+out_unlock:
+	mutex_unlock(&task->signal->cred_guard_mutex);
+out_free:
+	kfree(d);
+	return result;
+}
+
+static int proc_tid_delays(struct seq_file *m, struct pid_namespace *ns,
+			   struct pid *pid, struct task_struct *task)
+{
+	return do_delays(task, m, 0);
+}
+
+static int proc_tgid_delays(struct seq_file *m, struct pid_namespace *ns,
+			    struct pid *pid, struct task_struct *task)
+{
+	return do_delays(task, m, 1);
+}
+#endif /* CONFIG_TASK_DELAY_ACCT */
+
 #ifdef CONFIG_USER_NS
 static int proc_id_map_open(struct inode *inode, struct file *file,
 	const struct seq_operations *seq_ops)
@@ -3008,6 +3088,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_TASK_IO_ACCOUNTING
 	ONE("io",	S_IRUSR, proc_tgid_io_accounting),
 #endif
+#ifdef CONFIG_TASK_DELAY_ACCT
+	ONE("delays",	S_IRUSR, proc_tgid_delays),
+#endif
 #ifdef CONFIG_USER_NS
 	REG("uid_map",    S_IRUGO|S_IWUSR, proc_uid_map_operations),
 	REG("gid_map",    S_IRUGO|S_IWUSR, proc_gid_map_operations),
@@ -3038,6 +3121,18 @@ static const struct file_operations proc_tgid_base_operations = {
 	.llseek		= generic_file_llseek,
 };
 
+/*
+ * Return the pid of the process whose /proc/<pid> directory @file is open
+ * on, so such a file can be used as a stable handle of the process.
+ */
+struct pid *tgid_pidfd_to_pid(const struct file *file)
+{
+	if (file->f_op != &proc_tgid_base_operations)
+		return ERR_PTR(-EBADF);
+
+	return proc_pid(file_inode(file));
+}
+
 static struct dentry *proc_tgid_base_lookup(struct inode *dir, struct dentry *dentry, unsigned int flags)
 {
 	return proc_pident_lookup(dir, dentry,
@@ -3393,6 +3488,9 @@ static const struct pid_entry tid_base_stuff[] = {
 #ifdef CONFIG_TASK_IO_ACCOUNTING
 	ONE("io",	S_IRUSR, proc_tid_io_accounting),
 #endif
+#ifdef CONFIG_TASK_DELAY_ACCT
+	ONE("delays",	S_IRUSR, proc_tid_delays),
+#endif
 #ifdef CONFIG_USER_NS
 	REG("uid_map",    S_IRUGO|S_IWUSR, proc_uid_map_operations),
 	REG("gid_map",    S_IRUGO|S_IWUSR, proc_gid_map_operations),
@@ -652,6 +652,9 @@ static void show_smap_vma_flags(struct seq_file *m, struct vm_area_struct *vma)
 		[ilog2(VM_PKEY_BIT4)]	= "",
 #endif
 #endif /* CONFIG_ARCH_HAS_PKEYS */
+#ifdef CONFIG_HAVE_ARCH_USERFAULTFD_MINOR
+		[ilog2(VM_UFFD_MINOR)]	= "ui",
+#endif
 	};
 	size_t i;
 
@@ -1018,6 +1021,14 @@ static int clear_refs_pte_range(pmd_t *pmd, unsigned long addr,
 
 	if (pmd_trans_unstable(pmd))
 		return 0;
+	/*
+	 * Clearing soft-dirty write-protects the entries for this process
+	 * alone, which needs its own copy of a PTE table shared on fork.
+	 * The young bits are only a hint, and are cleared for all sharers.
+	 */
+	if (cp->type == CLEAR_REFS_SOFT_DIRTY && pmd_pte_shared(*pmd) &&
+	    unshare_pte_table(vma, addr, pmd))
+		return -ENOMEM;
 
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; pte++, addr += PAGE_SIZE) {
@@ -1141,11 +1152,13 @@ static ssize_t clear_refs_write(struct file *file, const char __user *buf,
 			}
 			mmu_notifier_invalidate_range_start(mm, 0, -1);
 		}
-		walk_page_range(0, mm->highest_vm_end, &clear_refs_walk);
+		rv = walk_page_range(0, mm->highest_vm_end, &clear_refs_walk);
 		if (type == CLEAR_REFS_SOFT_DIRTY)
 			mmu_notifier_invalidate_range_end(mm, 0, -1);
 		tlb_finish_mmu(&tlb, 0, -1);
 		up_read(&mm->mmap_sem);
+		if (rv < 0)
+			count = rv;
 out_mm:
 		mmput(mm);
 	}
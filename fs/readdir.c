@@ -20,9 +20,16 @@
 #include <linux/syscalls.h>
 #include <linux/unistd.h>
 #include <linux/compat.h>
+#include <linux/fs_struct.h>
+#include <linux/mount.h>
+#include <linux/namei.h>
+#include <linux/path.h>
+#include <linux/dirent_statx.h>
 
 #include <linux/uaccess.h>
 
+#include "internal.h"
+
 int iterate_dir(struct file *file, struct dir_context *ctx)
 {
 	struct inode *inode = file_inode(file);
@@ -333,6 +340,211 @@ SYSCALL_DEFINE3(getdents64, unsigned int, fd,
 	return ksys_getdents64(fd, dirent, count);
 }
 
+/*
+ * getdents_statx() reads a batch of names with iterate_dir() into a kernel
+ * buffer first, then looks each one up and fills in its attributes once the
+ * directory lock has been dropped.  Doing the lookups from inside the
+ * ->iterate() actor is not an option, as the filesystem may hold its own
+ * locks there and lookup takes the directory lock.
+ */
+#define DIRENT_STATX_MAX_BUF	(1U << 20)
+
+struct dirent_statx_entry {
+	u64		ino;
+	loff_t		off;
+	unsigned int	namlen;
+	unsigned int	type;
+	char		name[];
+};
+
+struct getdents_statx_callback {
+	struct dir_context ctx;
+	void *buf;
+	struct dirent_statx_entry *previous;
+	unsigned int used;	/* bytes of buf in use */
+	unsigned int count;	/* bytes of user buffer left */
+	int error;
+};
+
+static unsigned int dirent_statx_reclen(int namlen)
+{
+	return ALIGN(offsetof(struct linux_dirent_statx, d_name) + namlen + 1,
+		     sizeof(u64));
+}
+
+static int filldir_statx(struct dir_context *ctx, const char *name, int namlen,
+			 loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct getdents_statx_callback *buf =
+		container_of(ctx, struct getdents_statx_callback, ctx);
+	struct dirent_statx_entry *de;
+	unsigned int reclen = dirent_statx_reclen(namlen);
+
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (reclen > buf->count)
+		return -EINVAL;
+	if (buf->previous) {
+		if (signal_pending(current))
+			return -EINTR;
+		buf->previous->off = offset;
+	}
+
+	/* The kernel record is always smaller than the user one */
+	de = buf->buf + buf->used;
+	de->ino = ino;
+	de->off = 0;
+	de->namlen = namlen;
+	de->type = d_type;
+	memcpy(de->name, name, namlen);
+	buf->previous = de;
+	buf->used += ALIGN(offsetof(struct dirent_statx_entry, name) + namlen,
+			   sizeof(u64));
+	buf->count -= reclen;
+	return 0;
+}
+
+/*
+ * Look up @de in the directory @dir and fill in @stat.  Mount points are
+ * crossed and symlinks are not followed, as for statx(AT_SYMLINK_NOFOLLOW).
+ */
+static int dirent_statx_getattr(const struct path *dir,
+				struct dirent_statx_entry *de,
+				struct kstat *stat, unsigned int mask,
+				unsigned int flags)
+{
+	struct path path;
+	int error;
+
+	if (de->namlen == 1 && de->name[0] == '.') {
+		path_get(dir);
+		path = *dir;
+	} else if (de->namlen == 2 && de->name[0] == '.' && de->name[1] == '.') {
+		struct path root;
+
+		get_fs_root(current->fs, &root);
+		path_get(dir);
+		path = *dir;
+		while (path.dentry == path.mnt->mnt_root &&
+		       !path_equal(&path, &root)) {
+			if (!follow_up(&path))
+				break;
+		}
+		if (!path_equal(&path, &root)) {
+			struct dentry *parent = dget_parent(path.dentry);
+
+			dput(path.dentry);
+			path.dentry = parent;
+		}
+		path_put(&root);
+	} else {
+		struct dentry *dentry;
+
+		dentry = lookup_one_len_unlocked(de->name, dir->dentry,
+						 de->namlen);
+		if (IS_ERR(dentry))
+			return PTR_ERR(dentry);
+		if (d_is_negative(dentry)) {
+			dput(dentry);
+			return -ENOENT;
+		}
+		path.mnt = mntget(dir->mnt);
+		path.dentry = dentry;
+		while (d_mountpoint(path.dentry) && follow_down_one(&path))
+			;
+	}
+
+	error = vfs_getattr(&path, stat, mask, flags);
+	path_put(&path);
+	return error;
+}
+
+static int dirent_statx_copy(const struct path *dir,
+			     struct getdents_statx_callback *buf,
+			     struct linux_dirent_statx __user *dirent,
+			     unsigned int mask, unsigned int flags)
+{
+	void *p = buf->buf;
+	void *end = buf->buf + buf->used;
+
+	while (p < end) {
+		struct dirent_statx_entry *de = p;
+		unsigned int reclen = dirent_statx_reclen(de->namlen);
+		struct kstat stat;
+		int err;
+
+		err = dirent_statx_getattr(dir, de, &stat, mask, flags);
+
+		if (__put_user(de->ino, &dirent->d_ino) ||
+		    __put_user(de->off, &dirent->d_off) ||
+		    __put_user(reclen, &dirent->d_reclen) ||
+		    __put_user(de->type, &dirent->d_type) ||
+		    __put_user(0, &dirent->__pad) ||
+		    __put_user(err, &dirent->d_stat_err))
+			return -EFAULT;
+		if (err) {
+			if (clear_user(&dirent->d_stat, sizeof(dirent->d_stat)))
+				return -EFAULT;
+		} else if (cp_statx(&stat, &dirent->d_stat)) {
+			return -EFAULT;
+		}
+		if (copy_to_user(dirent->d_name, de->name, de->namlen) ||
+		    __put_user(0, dirent->d_name + de->namlen))
+			return -EFAULT;
+
+		dirent = (void __user *)dirent + reclen;
+		p += ALIGN(offsetof(struct dirent_statx_entry, name) +
+			   de->namlen, sizeof(u64));
+	}
+	return 0;
+}
+
+SYSCALL_DEFINE5(getdents_statx, unsigned int, fd,
+		struct linux_dirent_statx __user *, dirent,
+		unsigned int, count, unsigned int, mask, unsigned int, flags)
+{
+	struct getdents_statx_callback buf = {
+		.ctx.actor = filldir_statx,
+	};
+	struct fd f;
+	int error;
+
+	if (mask & STATX__RESERVED)
+		return -EINVAL;
+	if (flags & ~AT_STATX_SYNC_TYPE)
+		return -EINVAL;
+	if ((flags & AT_STATX_SYNC_TYPE) == AT_STATX_SYNC_TYPE)
+		return -EINVAL;
+
+	count = min(count, DIRENT_STATX_MAX_BUF);
+	if (!access_ok(VERIFY_WRITE, dirent, count))
+		return -EFAULT;
+
+	f = fdget_pos(fd);
+	if (!f.file)
+		return -EBADF;
+
+	error = -ENOMEM;
+	buf.count = count;
+	buf.buf = kvmalloc(count, GFP_KERNEL);
+	if (!buf.buf)
+		goto out;
+
+	error = iterate_dir(f.file, &buf.ctx);
+	if (error >= 0)
+		error = buf.error;
+	if (buf.previous) {
+		buf.previous->off = buf.ctx.pos;
+		error = dirent_statx_copy(&f.file->f_path, &buf, dirent,
+					  mask, flags);
+		if (!error)
+			error = count - buf.count;
+	}
+	kvfree(buf.buf);
+out:
+	fdput_pos(f);
+	return error;
+}
+
 #ifdef CONFIG_COMPAT
 struct compat_old_linux_dirent {
 	compat_ulong_t	d_ino;
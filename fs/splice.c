@@ -32,6 +32,7 @@
 #include <linux/security.h>
 #include <linux/gfp.h>
 #include <linux/socket.h>
+#include <linux/net.h>
 #include <linux/compat.h>
 #include <linux/sched/signal.h>
 
@@ -453,6 +454,44 @@ static int pipe_to_sendpage(struct pipe_inode_info *pipe,
 				    sd->len, &pos, more);
 }
 
+/*
+ * Send a pipe buffer with MSG_ZEROCOPY.  The socket keeps its own reference
+ * to the page, like with ->sendpage(), but the send also takes part in the
+ * socket's zerocopy notification scheme: once the stack has released the
+ * page, a completion is queued on the socket error queue exactly as for a
+ * sendmsg(MSG_ZEROCOPY) call.  Together with vmsplice(SPLICE_F_GIFT) this
+ * tells user space when a buffer it spliced may be reused.
+ */
+static int pipe_to_sendmsg_zerocopy(struct pipe_inode_info *pipe,
+				    struct pipe_buffer *buf,
+				    struct splice_desc *sd)
+{
+	struct file *file = sd->u.file;
+	struct bio_vec bvec = {
+		.bv_page	= buf->page,
+		.bv_offset	= buf->offset,
+		.bv_len		= sd->len,
+	};
+	struct msghdr msg = {
+		.msg_flags	= MSG_ZEROCOPY,
+	};
+	struct socket *sock;
+	int err;
+
+	sock = sock_from_file(file, &err);
+	if (!sock)
+		return err;
+
+	if (file->f_flags & O_NONBLOCK)
+		msg.msg_flags |= MSG_DONTWAIT;
+	if ((sd->flags & SPLICE_F_MORE) ||
+	    (sd->len < sd->total_len && pipe->nrbufs > 1))
+		msg.msg_flags |= MSG_MORE;
+
+	iov_iter_bvec(&msg.msg_iter, WRITE, &bvec, 1, sd->len);
+	return sock_sendmsg(sock, &msg);
+}
+
 static void wakeup_pipe_writers(struct pipe_inode_info *pipe)
 {
 	smp_mb();
@@ -823,12 +862,17 @@ static ssize_t default_file_splice_write(struct pipe_inode_info *pipe,
  *
  * Description:
  *    Will send @len bytes from the pipe to a network socket. No data copying
- *    is involved.
+ *    is involved.  With SPLICE_F_ZEROCOPY the data is sent as MSG_ZEROCOPY,
+ *    so that a socket with SO_ZEROCOPY enabled reports on its error queue
+ *    when the pages are no longer in use.
  *
  */
 ssize_t generic_splice_sendpage(struct pipe_inode_info *pipe, struct file *out,
 				loff_t *ppos, size_t len, unsigned int flags)
 {
+	if (flags & SPLICE_F_ZEROCOPY)
+		return splice_from_pipe(pipe, out, ppos, len, flags,
+					pipe_to_sendmsg_zerocopy);
 	return splice_from_pipe(pipe, out, ppos, len, flags, pipe_to_sendpage);
 }
 
@@ -18,6 +18,7 @@
 #include "xfs_quota.h"
 #include "xfs_trace.h"
 #include "xfs_icache.h"
+#include "xfs_bmap.h"
 #include "xfs_bmap_util.h"
 #include "xfs_dquot_item.h"
 #include "xfs_dquot.h"
@@ -219,7 +220,7 @@ xfs_perag_clear_reclaim_tag(
  * Once we get tag lookups on the radix tree, this inode flag
  * can go away.
  */
-void
+static void
 xfs_inode_set_reclaim_tag(
 	struct xfs_inode	*ip)
 {
@@ -233,6 +234,7 @@ xfs_inode_set_reclaim_tag(
 	radix_tree_tag_set(&pag->pag_ici_root, XFS_INO_TO_AGINO(mp, ip->i_ino),
 			   XFS_ICI_RECLAIM_TAG);
 	xfs_perag_set_reclaim_tag(pag);
+	ip->i_flags &= ~(XFS_NEED_INACTIVE | XFS_INACTIVATING);
 	__xfs_iflags_set(ip, XFS_IRECLAIMABLE);
 
 	spin_unlock(&ip->i_flags_lock);
@@ -240,6 +242,220 @@ xfs_inode_set_reclaim_tag(
 	xfs_perag_put(pag);
 }
 
+#ifdef DEBUG
+static void
+xfs_check_delalloc(
+	struct xfs_inode	*ip,
+	int			whichfork)
+{
+	struct xfs_ifork	*ifp = XFS_IFORK_PTR(ip, whichfork);
+	struct xfs_bmbt_irec	got;
+	struct xfs_iext_cursor	icur;
+
+	if (!ifp || !xfs_iext_lookup_extent(ip, ifp, 0, &icur, &got))
+		return;
+	do {
+		if (isnullstartblock(got.br_startblock)) {
+			xfs_warn(ip->i_mount,
+	"ino %llx %s fork has delalloc extent at [0x%llx:0x%llx]",
+				ip->i_ino,
+				whichfork == XFS_DATA_FORK ? "data" : "cow",
+				got.br_startoff, got.br_blockcount);
+		}
+	} while (xfs_iext_next_extent(ifp, &icur, &got));
+}
+#else
+#define xfs_check_delalloc(ip, whichfork)	do { } while (0)
+#endif
+
+/*
+ * Hand an inactive inode over to background reclaim.
+ */
+static void
+xfs_inode_set_reclaimable(
+	struct xfs_inode	*ip)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+
+	if (!XFS_FORCED_SHUTDOWN(mp) && ip->i_delayed_blks) {
+		xfs_check_delalloc(ip, XFS_DATA_FORK);
+		xfs_check_delalloc(ip, XFS_COW_FORK);
+		ASSERT(0);
+	}
+
+	XFS_STATS_INC(mp, vn_reclaim);
+
+	/*
+	 * We always use background reclaim here because even if the
+	 * inode is clean, it still may be under IO and hence we have
+	 * to take the flush lock. The background reclaim path handles
+	 * this more efficiently than we can here, so simply let background
+	 * reclaim tear down all inodes.
+	 */
+	xfs_inode_set_reclaim_tag(ip);
+}
+
+/*
+ * Background inode inactivation.
+ *
+ * Freeing an unlinked inode (truncating it, removing its xattrs and freeing
+ * the inode chunk slot) takes several transactions, and used to be done
+ * synchronously by whoever dropped the last reference, typically unlink(2).
+ * Instead, evicted inodes that still need such work are put on a lockless
+ * per-cpu list and inactivated in batches by a per-cpu worker, so the
+ * metadata they touch stays hot in that CPU's cache and the unlinking task
+ * returns as soon as the directory entry is gone.
+ *
+ * The queues are bounded: a task that finds more than
+ * XFS_INODEGC_MAX_BACKLOG inodes queued on its CPU waits for the worker, so
+ * a mass unlink can't run arbitrarily far ahead of the inactivation work.
+ * Callers that report space and inode usage (statfs, quota) flush the queues
+ * first so freed resources show up immediately.
+ */
+#define XFS_INODEGC_MAX_BACKLOG		(4 * XFS_INODES_PER_CHUNK)
+
+static inline bool
+xfs_inodegc_enabled(
+	struct xfs_mount	*mp)
+{
+	return test_bit(XFS_OPSTATE_INODEGC_ENABLED, &mp->m_opstate);
+}
+
+void
+xfs_inodegc_worker(
+	struct work_struct	*work)
+{
+	struct xfs_inodegc	*gc = container_of(work, struct xfs_inodegc,
+						   work);
+	struct llist_node	*node = llist_del_all(&gc->list);
+	struct xfs_inode	*ip, *n;
+
+	WRITE_ONCE(gc->items, 0);
+	if (!node)
+		return;
+
+	/* Inactivate in the order the inodes were queued. */
+	node = llist_reverse_order(node);
+	llist_for_each_entry_safe(ip, n, node, i_gclist) {
+		trace_xfs_inode_inactivating(ip);
+		xfs_iflags_set(ip, XFS_INACTIVATING);
+		xfs_inactive(ip);
+		xfs_inode_set_reclaimable(ip);
+	}
+}
+
+/* Kick the workers of all CPUs that have inodes queued. */
+static void
+xfs_inodegc_queue_all(
+	struct xfs_mount	*mp)
+{
+	struct xfs_inodegc	*gc;
+	int			cpu;
+
+	for_each_possible_cpu(cpu) {
+		gc = per_cpu_ptr(mp->m_inodegc, cpu);
+		if (llist_empty(&gc->list))
+			continue;
+		if (cpu_online(cpu))
+			queue_work_on(cpu, mp->m_inodegc_wq, &gc->work);
+		else
+			queue_work(mp->m_inodegc_wq, &gc->work);
+	}
+}
+
+static void
+xfs_inodegc_queue(
+	struct xfs_inode	*ip)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_inodegc	*gc;
+	unsigned int		items;
+
+	trace_xfs_inode_set_need_inactive(ip);
+	xfs_iflags_set(ip, XFS_NEED_INACTIVE);
+
+	gc = get_cpu_ptr(mp->m_inodegc);
+	llist_add(&ip->i_gclist, &gc->list);
+	items = READ_ONCE(gc->items) + 1;
+	WRITE_ONCE(gc->items, items);
+	if (!xfs_inodegc_enabled(mp)) {
+		put_cpu_ptr(gc);
+		return;
+	}
+	queue_work_on(smp_processor_id(), mp->m_inodegc_wq, &gc->work);
+	put_cpu_ptr(gc);
+
+	/*
+	 * Throttle the producer if the worker is falling behind, unless we are
+	 * running in transaction context and the worker could end up waiting
+	 * on log space we hold.
+	 */
+	if (items > XFS_INODEGC_MAX_BACKLOG && !current->journal_info)
+		flush_work(&gc->work);
+}
+
+/*
+ * The VFS is done with this inode.  Queue it for background inactivation if
+ * it still has work to do, otherwise hand it straight to reclaim.
+ */
+void
+xfs_inode_mark_reclaimable(
+	struct xfs_inode	*ip)
+{
+	/*
+	 * We should never get here with one of the reclaim flags already set.
+	 */
+	ASSERT_ALWAYS(!xfs_iflags_test(ip, XFS_IRECLAIMABLE));
+	ASSERT_ALWAYS(!xfs_iflags_test(ip, XFS_IRECLAIM));
+
+	if (xfs_inode_needs_inactive(ip))
+		xfs_inodegc_queue(ip);
+	else
+		xfs_inode_set_reclaimable(ip);
+}
+
+/*
+ * Inactivate all queued inodes and wait for it, so that the space and inodes
+ * they free are accounted for.  Does nothing while the workers are stopped.
+ */
+void
+xfs_inodegc_flush(
+	struct xfs_mount	*mp)
+{
+	if (!xfs_inodegc_enabled(mp))
+		return;
+
+	xfs_inodegc_queue_all(mp);
+	flush_workqueue(mp->m_inodegc_wq);
+}
+
+/*
+ * Inactivate all queued inodes and stop the workers, e.g. before the
+ * filesystem is frozen or remounted read-only.  Inodes evicted afterwards
+ * stay queued until xfs_inodegc_start().
+ */
+void
+xfs_inodegc_stop(
+	struct xfs_mount	*mp)
+{
+	if (!test_and_clear_bit(XFS_OPSTATE_INODEGC_ENABLED, &mp->m_opstate))
+		return;
+
+	xfs_inodegc_queue_all(mp);
+	flush_workqueue(mp->m_inodegc_wq);
+}
+
+/* (Re)start the workers and run whatever was queued while they were off. */
+void
+xfs_inodegc_start(
+	struct xfs_mount	*mp)
+{
+	if (test_and_set_bit(XFS_OPSTATE_INODEGC_ENABLED, &mp->m_opstate))
+		return;
+
+	xfs_inodegc_queue_all(mp);
+}
+
 STATIC void
 xfs_inode_clear_reclaim_tag(
 	struct xfs_perag	*pag,
@@ -378,13 +594,33 @@ xfs_iget_cache_hit(
 	 *	     wait_on_inode to wait for these flags to be cleared
 	 *	     instead of polling for it.
 	 */
-	if (ip->i_flags & (XFS_INEW|XFS_IRECLAIM)) {
+	if (ip->i_flags & (XFS_INEW|XFS_IRECLAIM|XFS_INACTIVATING)) {
 		trace_xfs_iget_skip(ip);
 		XFS_STATS_INC(mp, xs_ig_frecycle);
 		error = -EAGAIN;
 		goto out_error;
 	}
 
+	/*
+	 * The VFS inode is gone and the inode is waiting for background
+	 * inactivation.  An unlinked inode can't come back; otherwise retry
+	 * once the inactivation workers have moved it to reclaimable state.
+	 */
+	if (ip->i_flags & XFS_NEED_INACTIVE) {
+		trace_xfs_iget_skip(ip);
+		XFS_STATS_INC(mp, xs_ig_frecycle);
+		if (VFS_I(ip)->i_nlink == 0) {
+			error = -ENOENT;
+			goto out_error;
+		}
+		spin_unlock(&ip->i_flags_lock);
+		rcu_read_unlock();
+		/* The caller may hold an AGI buffer lock, so don't wait here. */
+		if (xfs_inodegc_enabled(mp))
+			xfs_inodegc_queue_all(mp);
+		return -EAGAIN;
+	}
+
 	/*
 	 * Check the inode free state is valid. This also detects lookup
 	 * racing with unlinks.
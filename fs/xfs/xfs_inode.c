@@ -1810,6 +1810,64 @@ xfs_inactive_ifree(
 	return 0;
 }
 
+/*
+ * Decide whether an inode the VFS is done with has any inactivation work left:
+ * freeing an unlinked inode or trimming CoW and post-EOF blocks.  Such inodes
+ * are handed to the background inactivation workers, all others can go
+ * straight to reclaim.
+ */
+bool
+xfs_inode_needs_inactive(
+	struct xfs_inode	*ip)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_bmbt_irec	imap;
+	struct xfs_iext_cursor	icur;
+	xfs_fileoff_t		end_fsb;
+	bool			found;
+
+	/*
+	 * If the inode is already free, then there can be nothing
+	 * to clean up here.
+	 */
+	if (VFS_I(ip)->i_mode == 0)
+		return false;
+
+	/* If this is a read-only mount, don't do this (would generate I/O) */
+	if (mp->m_flags & XFS_MOUNT_RDONLY)
+		return false;
+
+	/* Nothing can be logged anymore, push the inode straight to reclaim. */
+	if (XFS_FORCED_SHUTDOWN(mp))
+		return false;
+
+	/* Metadata inodes are torn down explicitly at unmount. */
+	if (ip == mp->m_rbmip || ip == mp->m_rsumip ||
+	    xfs_is_quota_inode(&mp->m_sb, ip->i_ino))
+		return false;
+
+	if (xfs_inode_has_cow_data(ip))
+		return true;
+
+	/* Unlinked files must be freed. */
+	if (VFS_I(ip)->i_nlink == 0)
+		return true;
+
+	if (!xfs_can_free_eofblocks(ip, true))
+		return false;
+
+	/*
+	 * Only queue the inode if there really is something mapped beyond EOF,
+	 * otherwise nearly every regular file would go through the workers.
+	 */
+	end_fsb = XFS_B_TO_FSB(mp, (xfs_ufsize_t)XFS_ISIZE(ip));
+	xfs_ilock(ip, XFS_ILOCK_SHARED);
+	found = xfs_iext_lookup_extent(ip, &ip->i_df, end_fsb, &icur, &imap);
+	xfs_iunlock(ip, XFS_ILOCK_SHARED);
+
+	return found;
+}
+
 /*
  * xfs_inactive
  *
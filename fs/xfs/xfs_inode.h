@@ -55,6 +55,9 @@ typedef struct xfs_inode {
 	xfs_extnum_t		i_cnextents;	/* # of extents in cow fork */
 	unsigned int		i_cformat;	/* format of cow fork */
 
+	/* Background inactivation queue linkage */
+	struct llist_node	i_gclist;
+
 	/* VFS inode */
 	struct inode		i_vnode;	/* embedded VFS inode */
 } xfs_inode_t;
@@ -230,6 +233,15 @@ static inline bool xfs_inode_has_cow_data(struct xfs_inode *ip)
 #define XFS_IRECOVERY		(1 << 11)
 #define XFS_ICOWBLOCKS		(1 << 12)/* has the cowblocks tag set */
 
+/*
+ * The VFS has evicted this inode, but it still has to be freed or have its
+ * post-EOF and CoW blocks trimmed before it can be reclaimed.  That work is
+ * queued for the background inactivation workers, which set XFS_INACTIVATING
+ * while they run it.  Lookups must not pick up the inode in either state.
+ */
+#define XFS_NEED_INACTIVE	(1 << 13)
+#define XFS_INACTIVATING	(1 << 14)
+
 /*
  * Per-lifetime flags need to be reset when re-using a reclaimable inode during
  * inode lookup. This prevents unintended behaviour on the new inode from
@@ -398,6 +410,7 @@ enum layout_break_reason {
 	 (VFS_I(pip)->i_mode & S_ISGID))
 
 int		xfs_release(struct xfs_inode *ip);
+bool		xfs_inode_needs_inactive(struct xfs_inode *ip);
 void		xfs_inactive(struct xfs_inode *ip);
 int		xfs_lookup(struct xfs_inode *dp, struct xfs_name *name,
 			   struct xfs_inode **ipp, struct xfs_name *ci_name);
@@ -44,6 +44,7 @@ typedef __u32			xfs_nlink_t;
 #include <linux/seq_file.h>
 #include <linux/init.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/proc_fs.h>
 #include <linux/sort.h>
 #include <linux/cpu.h>
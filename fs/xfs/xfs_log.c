@@ -18,6 +18,7 @@
 #include "xfs_log_priv.h"
 #include "xfs_log_recover.h"
 #include "xfs_inode.h"
+#include "xfs_icache.h"
 #include "xfs_trace.h"
 #include "xfs_fsops.h"
 #include "xfs_cksum.h"
@@ -781,6 +782,12 @@ xfs_log_mount_finish(
 	mp->m_super->s_flags &= ~SB_ACTIVE;
 	evict_inodes(mp->m_super);
 
+	/*
+	 * Inactivate the unlinked inodes released above before we possibly go
+	 * back to read-only mode, which would leave them on the unlinked lists.
+	 */
+	xfs_inodegc_flush(mp);
+
 	/*
 	 * Drain the buffer LRU after log recovery. This is required for v4
 	 * filesystems to avoid leaving around buffers with NULL verifier ops,
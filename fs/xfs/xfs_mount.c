@@ -872,6 +872,13 @@ xfs_mountfs(
 		goto out_free_perag;
 	}
 
+	/*
+	 * Start the background inactivation workers, log recovery may already
+	 * release unlinked inodes.  On a read-only mount nothing but recovery
+	 * ever queues an inode.
+	 */
+	xfs_inodegc_start(mp);
+
 	/*
 	 * Log's mount-time initialization. The first part of recovery can place
 	 * some items on the AIL, to be handled when recovery is finished or
@@ -1046,6 +1053,8 @@ xfs_mountfs(
 	xfs_irele(rip);
 	/* Clean out dquots that might be in memory after quotacheck. */
 	xfs_qm_unmount(mp);
+	/* Inactivate anything evicted so far so that reclaim can free it. */
+	xfs_inodegc_flush(mp);
 	/*
 	 * Cancel all delayed reclaim work and reclaim the inodes directly.
 	 * We have to do this /after/ rtunmount and qm_unmount because those
@@ -1095,6 +1104,12 @@ xfs_unmountfs(
 	uint64_t		resblks;
 	int			error;
 
+	/*
+	 * Finish inactivating the inodes the VFS evicted on the way to unmount
+	 * while we still have the metadata space reservations for it.
+	 */
+	xfs_inodegc_flush(mp);
+
 	xfs_icache_disable_reclaim(mp);
 	xfs_fs_unreserve_ag_blocks(mp);
 	xfs_qm_unmount_quotas(mp);
@@ -51,6 +51,16 @@ enum {
  * signed 32-bit long is sufficient for a HZ value up to 24855.  Making it
  * signed lets us store the special "-1" value, meaning retry forever.
  */
+/*
+ * Per-cpu queue of evicted inodes waiting for background inactivation.
+ */
+struct xfs_inodegc {
+	struct xfs_mount	*mp;
+	struct llist_head	list;
+	struct work_struct	work;
+	unsigned int		items;		/* approximate queue length */
+};
+
 struct xfs_error_cfg {
 	struct xfs_kobj	kobj;
 	int		max_retries;
@@ -171,6 +181,9 @@ typedef struct xfs_mount {
 	struct workqueue_struct	*m_log_workqueue;
 	struct workqueue_struct *m_eofblocks_workqueue;
 	struct workqueue_struct	*m_sync_workqueue;
+	struct workqueue_struct	*m_inodegc_wq;
+	struct xfs_inodegc __percpu *m_inodegc;	/* inactivation queues */
+	unsigned long		m_opstate;	/* XFS_OPSTATE_* bits */
 
 	/*
 	 * Generation of the filesysyem layout.  This is incremented by each
@@ -195,6 +208,11 @@ typedef struct xfs_mount {
 #endif
 } xfs_mount_t;
 
+/*
+ * Bits for m_opstate, changed atomically at runtime.
+ */
+#define XFS_OPSTATE_INODEGC_ENABLED	0	/* inactivation workers run */
+
 /*
  * Flags for m_flags.
  */
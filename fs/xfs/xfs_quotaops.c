@@ -226,6 +226,9 @@ xfs_fs_get_dqblk(
 	if (!XFS_IS_QUOTA_ON(mp))
 		return -ESRCH;
 
+	/* Account for the resources of inodes still waiting to be freed. */
+	xfs_inodegc_flush(mp);
+
 	id = from_kqid(&init_user_ns, qid);
 	return xfs_qm_scall_getquota(mp, id, xfs_quota_type(qid.type), qdq);
 }
@@ -246,6 +249,8 @@ xfs_fs_get_nextdqblk(
 	if (!XFS_IS_QUOTA_ON(mp))
 		return -ESRCH;
 
+	xfs_inodegc_flush(mp);
+
 	id = from_kqid(&init_user_ns, *qid);
 	ret = xfs_qm_scall_getquota_next(mp, &id, xfs_quota_type(qid->type),
 			qdq);
@@ -1,27 +1,78 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 /*
- * Common values for the ChaCha20 algorithm
+ * Common values and helper functions for the ChaCha20 algorithm
+ *
+ * These are the library interfaces, callable without going through the
+ * crypto API.  The skcipher bits live in <crypto/internal/chacha20.h>.
  */
 
 #ifndef _CRYPTO_CHACHA20_H
 #define _CRYPTO_CHACHA20_H
 
-#include <crypto/skcipher.h>
+#include <asm/unaligned.h>
 #include <linux/types.h>
-#include <linux/crypto.h>
 
 #define CHACHA20_IV_SIZE	16
 #define CHACHA20_KEY_SIZE	32
 #define CHACHA20_BLOCK_SIZE	64
 
-struct chacha20_ctx {
-	u32 key[8];
-};
+#define CHACHA20_STATE_WORDS	(CHACHA20_BLOCK_SIZE / sizeof(u32))
 
 void chacha20_block(u32 *state, u8 *stream);
-void crypto_chacha20_init(u32 *state, struct chacha20_ctx *ctx, u8 *iv);
-int crypto_chacha20_setkey(struct crypto_skcipher *tfm, const u8 *key,
-			   unsigned int keysize);
-int crypto_chacha20_crypt(struct skcipher_request *req);
+
+static inline void chacha20_init_consts(u32 *state)
+{
+	state[0]  = 0x61707865; /* "expa" */
+	state[1]  = 0x3320646e; /* "nd 3" */
+	state[2]  = 0x79622d32; /* "2-by" */
+	state[3]  = 0x6b206574; /* "te k" */
+}
+
+/**
+ * chacha20_init - set up a ChaCha20 state
+ * @state: the state, CHACHA20_STATE_WORDS words
+ * @key: the key, as eight little endian words
+ * @iv: 32-bit block counter followed by the 96-bit nonce, as in RFC7539
+ */
+static inline void chacha20_init(u32 *state, const u32 *key, const u8 *iv)
+{
+	chacha20_init_consts(state);
+	state[4]  = key[0];
+	state[5]  = key[1];
+	state[6]  = key[2];
+	state[7]  = key[3];
+	state[8]  = key[4];
+	state[9]  = key[5];
+	state[10] = key[6];
+	state[11] = key[7];
+	state[12] = get_unaligned_le32(iv +  0);
+	state[13] = get_unaligned_le32(iv +  4);
+	state[14] = get_unaligned_le32(iv +  8);
+	state[15] = get_unaligned_le32(iv + 12);
+}
+
+void chacha20_crypt_arch(u32 *state, u8 *dst, const u8 *src,
+			 unsigned int bytes);
+void chacha20_crypt_generic(u32 *state, u8 *dst, const u8 *src,
+			    unsigned int bytes);
+
+/**
+ * chacha20_crypt - en/decrypt with ChaCha20
+ * @state: a state set up with chacha20_init(), advanced past the blocks used
+ * @dst: destination buffer, may be the same as @src
+ * @src: source buffer
+ * @bytes: length of @src
+ *
+ * Uses the fastest implementation the CPU supports, and may be called in
+ * any context.  A partial last block consumes a whole block of key stream.
+ */
+static inline void chacha20_crypt(u32 *state, u8 *dst, const u8 *src,
+				  unsigned int bytes)
+{
+	if (IS_ENABLED(CONFIG_CRYPTO_ARCH_HAVE_LIB_CHACHA20))
+		chacha20_crypt_arch(state, dst, src, bytes);
+	else
+		chacha20_crypt_generic(state, dst, src, bytes);
+}
 
 #endif
@@ -40,10 +40,14 @@
  * @unprepare_crypt_hardware: there are currently no more requests on the
  * queue so the subsystem notifies the driver that it may relax the
  * hardware by issuing this call
+ * @do_batch_requests: the driver has been handed a batch of requests, which
+ * it may now submit to the hardware together
  * @kworker: kthread worker struct for request pump
  * @pump_requests: work struct for scheduling work to the request pump
  * @priv_data: the engine private data
- * @cur_req: the current request which is on processing
+ * @cur_req: the current request which is on processing, without batching
+ * @batch_size: the most requests handed to the driver at a time
+ * @inflight: the requests handed to the driver and not finalized yet
  */
 struct crypto_engine {
 	char			name[ENGINE_NAME_LEN];
@@ -61,12 +65,15 @@ struct crypto_engine {
 
 	int (*prepare_crypt_hardware)(struct crypto_engine *engine);
 	int (*unprepare_crypt_hardware)(struct crypto_engine *engine);
+	int (*do_batch_requests)(struct crypto_engine *engine);
 
 	struct kthread_worker           *kworker;
 	struct kthread_work             pump_requests;
 
 	void				*priv_data;
 	struct crypto_async_request	*cur_req;
+	unsigned int			batch_size;
+	unsigned int			inflight;
 };
 
 /*
@@ -111,6 +118,10 @@ void crypto_finalize_skcipher_request(struct crypto_engine *engine,
 int crypto_engine_start(struct crypto_engine *engine);
 int crypto_engine_stop(struct crypto_engine *engine);
 struct crypto_engine *crypto_engine_alloc_init(struct device *dev, bool rt);
+struct crypto_engine *crypto_engine_alloc_init_and_set(struct device *dev,
+			bool rt, unsigned int batch_size,
+			int (*cbk_do_batch)(struct crypto_engine *engine),
+			int qlen);
 int crypto_engine_exit(struct crypto_engine *engine);
 
 #endif /* _CRYPTO_ENGINE_H */
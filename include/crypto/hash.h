@@ -155,6 +155,9 @@ struct shash_desc {
 #define HASH_MAX_DESCSIZE	360
 #define HASH_MAX_STATESIZE	512
 
+/* The most messages crypto_shash_finup_mb() hashes in one go */
+#define HASH_MAX_MB_MSGS	2
+
 #define SHASH_DESC_ON_STACK(shash, ctx)				  \
 	char __##shash##_desc[sizeof(struct shash_desc) +	  \
 		HASH_MAX_DESCSIZE] CRYPTO_MINALIGN_ATTR; \
@@ -170,6 +173,12 @@ struct shash_desc {
  * @export: see struct ahash_alg
  * @import: see struct ahash_alg
  * @setkey: see struct ahash_alg
+ * @finup_mb: **[optional]** Finish hashing several messages of the same
+ *	      length which all start with the data already hashed into the
+ *	      operational state, between 2 and @mb_max_msgs of them.  For
+ *	      implementations which can interleave the messages to hash
+ *	      them faster than one after the other.
+ * @mb_max_msgs: the most messages @finup_mb takes, at most HASH_MAX_MB_MSGS
  * @digestsize: see struct ahash_alg
  * @statesize: see struct ahash_alg
  * @descsize: Size of the operational state for the message digest. This state
@@ -190,6 +199,10 @@ struct shash_alg {
 	int (*import)(struct shash_desc *desc, const void *in);
 	int (*setkey)(struct crypto_shash *tfm, const u8 *key,
 		      unsigned int keylen);
+	int (*finup_mb)(struct shash_desc *desc, const u8 * const data[],
+			unsigned int len, u8 * const outs[],
+			unsigned int num_msgs);
+	unsigned int mb_max_msgs;
 
 	unsigned int descsize;
 
@@ -826,6 +839,18 @@ static inline unsigned int crypto_shash_descsize(struct crypto_shash *tfm)
 	return tfm->descsize;
 }
 
+/**
+ * crypto_shash_mb_max_msgs() - obtain how many messages are hashed together
+ * @tfm: cipher handle
+ *
+ * Return: the number of messages crypto_shash_finup_mb() hashes faster than
+ *	   one after the other, 1 if the algorithm hashes them one by one
+ */
+static inline unsigned int crypto_shash_mb_max_msgs(struct crypto_shash *tfm)
+{
+	return crypto_shash_alg(tfm)->mb_max_msgs;
+}
+
 static inline void *shash_desc_ctx(struct shash_desc *desc)
 {
 	return desc->__ctx;
@@ -967,6 +992,27 @@ int crypto_shash_final(struct shash_desc *desc, u8 *out);
 int crypto_shash_finup(struct shash_desc *desc, const u8 *data,
 		       unsigned int len, u8 *out);
 
+/**
+ * crypto_shash_finup_mb() - calculate message digests of several buffers
+ * @desc: operational state holding the data common to all the messages
+ * @data: the remaining data of each message
+ * @len: length of each buffer in @data, they are all the same
+ * @outs: output buffer of each message digest
+ * @num_msgs: the number of messages
+ *
+ * The equivalent of calling crypto_shash_finup() on a copy of @desc for
+ * each message, but faster with algorithms that can interleave several
+ * messages, see crypto_shash_mb_max_msgs().  This suits callers hashing
+ * many blocks of the same size, such as the data blocks of dm-verity.
+ * Like crypto_shash_finup(), this leaves @desc unusable.
+ *
+ * Return: 0 if the message digest creation was successful; < 0 if an error
+ *	   occurred
+ */
+int crypto_shash_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			  unsigned int len, u8 * const outs[],
+			  unsigned int num_msgs);
+
 static inline void shash_desc_zero(struct shash_desc *desc)
 {
 	memzero_explicit(desc,
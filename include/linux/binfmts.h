@@ -76,6 +76,8 @@ struct linux_binprm {
 #define BINPRM_FLAGS_PATH_INACCESSIBLE_BIT 2
 #define BINPRM_FLAGS_PATH_INACCESSIBLE (1 << BINPRM_FLAGS_PATH_INACCESSIBLE_BIT)
 
+struct crypto_comp;
+
 /* Function parameter for binfmt->coredump */
 struct coredump_params {
 	const kernel_siginfo_t *siginfo;
@@ -85,6 +87,11 @@ struct coredump_params {
 	unsigned long mm_flags;
 	loff_t written;
 	loff_t pos;
+	/* output is batched (and optionally compressed) in buf */
+	void *buf;
+	size_t buf_len;
+	struct crypto_comp *comp;
+	void *comp_buf;
 };
 
 /*
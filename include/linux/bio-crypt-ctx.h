@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Inline encryption context attached to a bio.
+ */
+#ifndef __LINUX_BIO_CRYPT_CTX_H
+#define __LINUX_BIO_CRYPT_CTX_H
+
+#include <linux/types.h>
+
+enum blk_crypto_mode_num {
+	BLK_ENCRYPTION_MODE_INVALID,
+	BLK_ENCRYPTION_MODE_AES_256_XTS,
+	BLK_ENCRYPTION_MODE_MAX,
+};
+
+#define BLK_CRYPTO_MAX_KEY_SIZE		64
+#define BLK_CRYPTO_MAX_IV_SIZE		16
+
+/**
+ * struct blk_crypto_key - an inline encryption key
+ * @crypto_mode: encryption algorithm this key is for
+ * @data_unit_size: the data unit size for all en/decryptions with this key.
+ *	This is the size in bytes of each individual plaintext and ciphertext,
+ *	e.g. the filesystem block size.  Always a power of 2.
+ * @data_unit_size_bits: log2 of @data_unit_size
+ * @size: size of this key in bytes, determined by @crypto_mode
+ * @raw: the raw bytes of this key, only the first @size bytes are used
+ *
+ * A blk_crypto_key is immutable once initialized and may be referenced by
+ * many bios at the same time.  It must be evicted with blk_crypto_evict_key()
+ * and must not be freed before all bios using it have completed.
+ */
+struct blk_crypto_key {
+	enum blk_crypto_mode_num crypto_mode;
+	unsigned int data_unit_size;
+	unsigned int data_unit_size_bits;
+	unsigned int size;
+	u8 raw[BLK_CRYPTO_MAX_KEY_SIZE];
+};
+
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+
+#include <linux/blk_types.h>
+
+struct keyslot_manager;
+
+/**
+ * struct bio_crypt_ctx - an inline encryption context
+ * @bc_key: the key, algorithm and data unit size to use
+ * @bc_dun: the data unit number of the first data unit of the bio, which
+ *	    is used as the starting IV
+ * @bc_ksm: the keyslot manager @bc_key has been programmed into, or NULL
+ * @bc_keyslot: the keyslot of @bc_key in @bc_ksm, or -1.  The bio holds a
+ *		reference on the keyslot until it is freed.
+ */
+struct bio_crypt_ctx {
+	const struct blk_crypto_key	*bc_key;
+	u64				bc_dun;
+	struct keyslot_manager		*bc_ksm;
+	int				bc_keyslot;
+};
+
+int bio_crypt_ctx_init(void);
+
+void bio_crypt_set_ctx(struct bio *bio, const struct blk_crypto_key *key,
+		       u64 dun, gfp_t gfp_mask);
+void bio_crypt_free_ctx(struct bio *bio);
+int bio_crypt_clone(struct bio *dst, struct bio *src, gfp_t gfp_mask);
+int bio_crypt_ctx_acquire_keyslot(struct bio_crypt_ctx *bc,
+				  struct keyslot_manager *ksm);
+
+static inline bool bio_has_crypt_ctx(struct bio *bio)
+{
+	return bio->bi_crypt_context;
+}
+
+static inline bool bio_crypt_has_keyslot(struct bio *bio)
+{
+	return bio->bi_crypt_context && bio->bi_crypt_context->bc_keyslot >= 0;
+}
+
+static inline void bio_crypt_advance(struct bio *bio, unsigned int bytes)
+{
+	struct bio_crypt_ctx *bc = bio->bi_crypt_context;
+
+	if (bc)
+		bc->bc_dun += bytes >> bc->bc_key->data_unit_size_bits;
+}
+
+/*
+ * Can @b_2 be appended to @b_1, which is @b1_bytes long, in one request?
+ * Only if both use the same key and keyslot and the data unit numbers are
+ * contiguous, or if neither is encrypted.
+ */
+static inline bool bio_crypt_ctx_mergeable(struct bio *b_1,
+					   unsigned int b1_bytes,
+					   struct bio *b_2)
+{
+	struct bio_crypt_ctx *bc1 = b_1->bi_crypt_context;
+	struct bio_crypt_ctx *bc2 = b_2->bi_crypt_context;
+
+	if (!bc1 || !bc2)
+		return !bc1 && !bc2;
+
+	if (bc1->bc_key != bc2->bc_key || bc1->bc_ksm != bc2->bc_ksm ||
+	    bc1->bc_keyslot != bc2->bc_keyslot)
+		return false;
+
+	return bc1->bc_dun + (b1_bytes >> bc1->bc_key->data_unit_size_bits) ==
+		bc2->bc_dun;
+}
+
+#else /* CONFIG_BLK_INLINE_ENCRYPTION */
+
+struct bio;
+
+static inline int bio_crypt_ctx_init(void)
+{
+	return 0;
+}
+
+static inline void bio_crypt_free_ctx(struct bio *bio) { }
+
+static inline int bio_crypt_clone(struct bio *dst, struct bio *src,
+				  gfp_t gfp_mask)
+{
+	return 0;
+}
+
+static inline bool bio_has_crypt_ctx(struct bio *bio)
+{
+	return false;
+}
+
+static inline bool bio_crypt_has_keyslot(struct bio *bio)
+{
+	return false;
+}
+
+static inline void bio_crypt_advance(struct bio *bio, unsigned int bytes) { }
+
+static inline bool bio_crypt_ctx_mergeable(struct bio *b_1,
+					   unsigned int b1_bytes,
+					   struct bio *b_2)
+{
+	return true;
+}
+
+#endif /* CONFIG_BLK_INLINE_ENCRYPTION */
+
+#endif /* __LINUX_BIO_CRYPT_CTX_H */
@@ -42,6 +42,7 @@ enum blkg_rwstat_type {
 };
 
 struct blkcg_gq;
+struct blk_lat_hist;
 
 struct blkcg {
 	struct cgroup_subsys_state	css;
@@ -133,6 +134,9 @@ struct blkcg_gq {
 
 	struct blkg_rwstat		stat_bytes;
 	struct blkg_rwstat		stat_ios;
+#ifdef CONFIG_BLK_LAT_HIST
+	struct blk_lat_hist __percpu	*lat_hist;
+#endif
 
 	struct blkg_policy_data		*pd[BLKCG_MAX_POLS];
 
@@ -13,6 +13,7 @@
 struct bio_set;
 struct bio;
 struct bio_integrity_payload;
+struct bio_crypt_ctx;
 struct page;
 struct block_device;
 struct io_context;
@@ -187,6 +188,9 @@ struct bio {
 		struct bio_integrity_payload *bi_integrity; /* data integrity */
 #endif
 	};
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+	struct bio_crypt_ctx	*bi_crypt_context;	/* inline encryption */
+#endif
 
 	unsigned short		bi_vcnt;	/* how many bio_vec's */
 
@@ -292,6 +296,8 @@ enum req_opf {
 	REQ_OP_WRITE_SAME	= 7,
 	/* write the zero filled sector many times */
 	REQ_OP_WRITE_ZEROES	= 9,
+	/* write data at the current zone write pointer */
+	REQ_OP_ZONE_APPEND	= 13,
 
 	/* SCSI passthrough using struct scsi_request */
 	REQ_OP_SCSI_IN		= 32,
@@ -319,6 +325,7 @@ enum req_flag_bits {
 	__REQ_RAHEAD,		/* read ahead, can fail anytime */
 	__REQ_BACKGROUND,	/* background IO */
 	__REQ_NOWAIT,           /* Don't wait if request will block */
+	__REQ_HIPRI,		/* completion will be polled for */
 
 	/* command specific flags for REQ_OP_WRITE_ZEROES: */
 	__REQ_NOUNMAP,		/* do not free blocks when zeroing */
@@ -343,6 +350,7 @@ enum req_flag_bits {
 #define REQ_RAHEAD		(1ULL << __REQ_RAHEAD)
 #define REQ_BACKGROUND		(1ULL << __REQ_BACKGROUND)
 #define REQ_NOWAIT		(1ULL << __REQ_NOWAIT)
+#define REQ_HIPRI		(1ULL << __REQ_HIPRI)
 
 #define REQ_NOUNMAP		(1ULL << __REQ_NOUNMAP)
 
@@ -16,14 +16,23 @@
 #include <linux/rbtree_latch.h>
 #include <linux/numa.h>
 #include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/refcount.h>
 
 struct bpf_verifier_env;
 struct perf_event;
 struct bpf_prog;
 struct bpf_map;
 struct sock;
+struct task_struct;
 struct seq_file;
 struct btf_type;
+struct vm_area_struct;
+struct poll_table_struct;
+struct module;
+struct seq_operations;
+struct bpf_local_storage;
+struct bpf_local_storage_map;
 
 /* map is generic key/value storage optionally accesible by eBPF programs */
 struct bpf_map_ops {
@@ -34,6 +43,16 @@ struct bpf_map_ops {
 	void (*map_free)(struct bpf_map *map);
 	int (*map_get_next_key)(struct bpf_map *map, void *key, void *next_key);
 	void (*map_release_uref)(struct bpf_map *map);
+	int (*map_lookup_batch)(struct bpf_map *map, const union bpf_attr *attr,
+				union bpf_attr __user *uattr);
+	int (*map_lookup_and_delete_batch)(struct bpf_map *map,
+					   const union bpf_attr *attr,
+					   union bpf_attr __user *uattr);
+	int (*map_update_batch)(struct bpf_map *map, struct file *map_file,
+				const union bpf_attr *attr,
+				union bpf_attr __user *uattr);
+	int (*map_delete_batch)(struct bpf_map *map, const union bpf_attr *attr,
+				union bpf_attr __user *uattr);
 
 	/* funcs callable from userspace and from eBPF programs */
 	void *(*map_lookup_elem)(struct bpf_map *map, void *key);
@@ -54,6 +73,26 @@ struct bpf_map_ops {
 	int (*map_check_btf)(const struct bpf_map *map,
 			     const struct btf_type *key_type,
 			     const struct btf_type *value_type);
+
+	/* funcs called by the verifier and the dump of programs, for the
+	 * BPF_PSEUDO_MAP_VALUE ld_imm64 of global data
+	 */
+	int (*map_direct_value_addr)(const struct bpf_map *map, u64 *imm,
+				     u32 off);
+	int (*map_direct_value_meta)(const struct bpf_map *map, u64 imm,
+				     u32 *off);
+
+	/* funcs called through the map file descriptor */
+	int (*map_mmap)(struct bpf_map *map, struct vm_area_struct *vma);
+	__poll_t (*map_poll)(struct bpf_map *map, struct file *filp,
+			     struct poll_table_struct *pts);
+
+	/* funcs called by local storage maps, see bpf_local_storage.h */
+	int (*map_local_storage_charge)(struct bpf_local_storage_map *smap,
+					void *owner, u32 size);
+	void (*map_local_storage_uncharge)(struct bpf_local_storage_map *smap,
+					   void *owner, u32 size);
+	struct bpf_local_storage __rcu **(*map_owner_storage_ptr)(void *owner);
 };
 
 struct bpf_map {
@@ -77,7 +116,8 @@ struct bpf_map {
 	u32 btf_value_type_id;
 	struct btf *btf;
 	bool unpriv_array;
-	/* 55 bytes hole */
+	bool frozen; /* write-once, under freeze_mutex */
+	/* 54 bytes hole */
 
 	/* The 3rd and 4th cacheline with misc members to avoid false sharing
 	 * particularly with refcounting.
@@ -87,6 +127,8 @@ struct bpf_map {
 	atomic_t usercnt;
 	struct work_struct work;
 	char name[BPF_OBJ_NAME_LEN];
+	struct mutex freeze_mutex;
+	u64 writecnt; /* writable mappings, under freeze_mutex */
 };
 
 struct bpf_offload_dev;
@@ -142,6 +184,7 @@ enum bpf_arg_type {
 	ARG_PTR_TO_MAP_KEY,	/* pointer to stack used as map key */
 	ARG_PTR_TO_MAP_VALUE,	/* pointer to stack used as map value */
 	ARG_PTR_TO_UNINIT_MAP_VALUE,	/* pointer to valid memory used to store a map value */
+	ARG_PTR_TO_MAP_VALUE_OR_NULL,	/* pointer to stack used as map value or NULL */
 
 	/* the following constraints used to prototype bpf_memcmp() and other
 	 * functions that access data on eBPF program stack
@@ -159,6 +202,8 @@ enum bpf_arg_type {
 	ARG_PTR_TO_CTX,		/* pointer to context */
 	ARG_ANYTHING,		/* any (initialized) argument is ok */
 	ARG_PTR_TO_SOCKET,	/* pointer to bpf_sock */
+	ARG_PTR_TO_ALLOC_MEM,	/* pointer to memory returned by an allocating helper */
+	ARG_CONST_ALLOC_SIZE_OR_ZERO,	/* number of bytes to allocate, or 0 */
 };
 
 /* type of values returned from helper functions */
@@ -168,6 +213,7 @@ enum bpf_return_type {
 	RET_PTR_TO_MAP_VALUE,		/* returns a pointer to map elem value */
 	RET_PTR_TO_MAP_VALUE_OR_NULL,	/* returns a pointer to map elem value or NULL */
 	RET_PTR_TO_SOCKET_OR_NULL,	/* returns a pointer to a socket or NULL */
+	RET_PTR_TO_ALLOC_MEM_OR_NULL,	/* returns a pointer to allocated memory or NULL */
 };
 
 /* eBPF function prototype used by verifier to allow BPF_CALLs from eBPF programs
@@ -221,6 +267,8 @@ enum bpf_reg_type {
 	PTR_TO_FLOW_KEYS,	 /* reg points to bpf_flow_keys */
 	PTR_TO_SOCKET,		 /* reg points to struct bpf_sock */
 	PTR_TO_SOCKET_OR_NULL,	 /* reg points to struct bpf_sock or NULL */
+	PTR_TO_MEM,		 /* reg points to valid memory region */
+	PTR_TO_MEM_OR_NULL,	 /* reg points to valid memory region or NULL */
 };
 
 /* The information passed from prog-specific *_is_valid_access
@@ -297,6 +345,7 @@ struct bpf_prog_aux {
 	u32 id;
 	u32 func_cnt;
 	bool offload_requested;
+	bool xdp_has_frags; /* XDP prog can handle multi-buffer packets */
 	struct bpf_prog **func;
 	void *jit_data; /* JIT specific data. arch dependent */
 	struct latch_tree_node ksym_tnode;
@@ -312,12 +361,155 @@ struct bpf_prog_aux {
 	void *security;
 #endif
 	struct bpf_prog_offload *offload;
+	struct bpf_trampoline *trampoline; /* fentry/fexit attachment */
+	struct hlist_node tramp_hlist;
 	union {
 		struct work_struct work;
 		struct rcu_head	rcu;
 	};
 };
 
+/* fentry/fexit programs see the argument registers of the traced function as
+ * an array of u64, followed, for fexit, by its return value
+ */
+#define BPF_TRAMP_MAX_ARGS 6
+
+#if defined(CONFIG_BPF_JIT) && defined(CONFIG_BPF_SYSCALL)
+#define BPF_MAX_TRAMP_PROGS 40
+
+enum bpf_tramp_prog_type {
+	BPF_TRAMP_FENTRY,
+	BPF_TRAMP_FEXIT,
+	BPF_TRAMP_MAX
+};
+
+struct bpf_tramp_progs {
+	struct bpf_prog *progs[BPF_MAX_TRAMP_PROGS];
+	int nr_progs;
+};
+
+/* Executable image of a trampoline, built for a given set of programs, each
+ * of which it holds a reference on, and replaced as a whole when that set
+ * changes. The replaced image is freed once the tasks that were running the
+ * original function from it have all returned.
+ */
+struct bpf_tramp_image {
+	void *image;
+	void *ip_after_call;	/* original function returns here */
+	void *ip_epilogue;	/* fexit programs are skipped to here */
+	u64 __percpu *active;	/* tasks in the original function */
+	struct bpf_tramp_progs tprogs[BPF_TRAMP_MAX];
+	union {
+		struct rcu_head rcu;
+		struct delayed_work dwork;
+	};
+};
+
+struct bpf_trampoline {
+	struct hlist_node hlist;
+	/* serializes program linking and image updates */
+	struct mutex mutex;
+	refcount_t refcnt;
+	unsigned long ip;	/* ftrace location of the traced function */
+	struct module *mod;	/* module of the traced function, if any */
+	struct hlist_head progs_hlist[BPF_TRAMP_MAX];
+	int progs_cnt[BPF_TRAMP_MAX];
+	struct bpf_tramp_image *cur_image;
+};
+
+enum bpf_text_poke_type {
+	BPF_MOD_CALL,
+	BPF_MOD_JUMP,
+};
+
+int arch_prepare_bpf_trampoline(struct bpf_tramp_image *im, void *image_end,
+				void *orig_call);
+int bpf_arch_text_poke(void *ip, enum bpf_text_poke_type t,
+		       void *old_addr, void *new_addr);
+
+int bpf_trampoline_link_prog(struct bpf_prog *prog, const char *func_name);
+int bpf_trampoline_unlink_prog(struct bpf_prog *prog);
+
+/* called from trampoline images */
+u64 notrace __bpf_prog_enter(void);
+void notrace __bpf_prog_exit(void);
+void notrace __bpf_tramp_enter(struct bpf_tramp_image *im);
+void notrace __bpf_tramp_exit(struct bpf_tramp_image *im);
+#else
+static inline int bpf_trampoline_link_prog(struct bpf_prog *prog,
+					   const char *func_name)
+{
+	return -ENOTSUPP;
+}
+
+static inline int bpf_trampoline_unlink_prog(struct bpf_prog *prog)
+{
+	return -ENOTSUPP;
+}
+#endif
+
+/* A dispatcher is a function calling the program it's passed, which gets
+ * patched into a direct jump to generated code comparing the program to
+ * those it knows about, so that a direct call replaces the indirect one,
+ * and its retpoline, for them.
+ */
+#define BPF_DISPATCHER_MAX 48 /* fits in half a page */
+
+struct bpf_dispatcher_prog {
+	struct bpf_prog *prog;
+	refcount_t users;
+};
+
+struct bpf_dispatcher {
+	struct mutex mutex;	/* serializes changes of the programs */
+	void *func;
+	struct bpf_dispatcher_prog progs[BPF_DISPATCHER_MAX];
+	int num_progs;
+	/* two halves, one of which is current while the other is rebuilt */
+	void *image;
+	u32 image_off;
+};
+
+#define BPF_DISPATCHER_INIT(name) {				\
+	.mutex = __MUTEX_INITIALIZER(name.mutex),		\
+	.func = &name##func,					\
+}
+
+#define DEFINE_BPF_DISPATCHER(name)				\
+	noinline unsigned int name##func(			\
+		const void *ctx,				\
+		const struct bpf_insn *insnsi,			\
+		unsigned int (*bpf_func)(const void *,		\
+					 const struct bpf_insn *)) \
+	{							\
+		return bpf_func(ctx, insnsi);			\
+	}							\
+	EXPORT_SYMBOL(name##func);				\
+	struct bpf_dispatcher name = BPF_DISPATCHER_INIT(name);
+
+#define DECLARE_BPF_DISPATCHER(name)				\
+	unsigned int name##func(				\
+		const void *ctx,				\
+		const struct bpf_insn *insnsi,			\
+		unsigned int (*bpf_func)(const void *,		\
+					 const struct bpf_insn *)); \
+	extern struct bpf_dispatcher name;
+
+#define BPF_DISPATCHER_FUNC(name) name##func
+#define BPF_DISPATCHER_PTR(name) (&name)
+
+#if defined(CONFIG_BPF_JIT) && defined(CONFIG_BPF_SYSCALL)
+int arch_prepare_bpf_dispatcher(void *image, s64 *funcs, int num_funcs);
+void bpf_dispatcher_change_prog(struct bpf_dispatcher *d, struct bpf_prog *from,
+				struct bpf_prog *to);
+#else
+static inline void bpf_dispatcher_change_prog(struct bpf_dispatcher *d,
+					      struct bpf_prog *from,
+					      struct bpf_prog *to)
+{
+}
+#endif
+
 struct bpf_array {
 	struct bpf_map map;
 	u32 elem_size;
@@ -329,6 +521,7 @@ struct bpf_array {
 	 */
 	enum bpf_prog_type owner_prog_type;
 	bool owner_jited;
+	bool owner_xdp_devmap;
 	union {
 		char value[0] __aligned(8);
 		void *ptrs[0] __aligned(8);
@@ -338,6 +531,11 @@ struct bpf_array {
 
 #define MAX_TAIL_CALL_CNT 32
 
+/* max size of the programs of privileged loaders, in insns, and max number
+ * of insns the verifier processes for them
+ */
+#define BPF_COMPLEXITY_LIMIT_INSNS 1000000
+
 struct bpf_event_entry {
 	struct perf_event *event;
 	struct file *perf_file;
@@ -459,6 +657,7 @@ struct bpf_prog * __must_check bpf_prog_add(struct bpf_prog *prog, int i);
 void bpf_prog_sub(struct bpf_prog *prog, int i);
 struct bpf_prog * __must_check bpf_prog_inc(struct bpf_prog *prog);
 struct bpf_prog * __must_check bpf_prog_inc_not_zero(struct bpf_prog *prog);
+struct bpf_prog *bpf_prog_by_id(u32 id);
 void bpf_prog_put(struct bpf_prog *prog);
 int __bpf_prog_charge(struct user_struct *user, u32 pages);
 void __bpf_prog_uncharge(struct user_struct *user, u32 pages);
@@ -475,6 +674,7 @@ int bpf_map_precharge_memlock(u32 pages);
 int bpf_map_charge_memlock(struct bpf_map *map, u32 pages);
 void bpf_map_uncharge_memlock(struct bpf_map *map, u32 pages);
 void *bpf_map_area_alloc(size_t size, int numa_node);
+void *bpf_map_area_mmapable_alloc(size_t size, int numa_node);
 void bpf_map_area_free(void *base);
 void bpf_map_init_from_attr(struct bpf_map *map, union bpf_attr *attr);
 
@@ -502,6 +702,16 @@ int bpf_fd_htab_map_update_elem(struct bpf_map *map, struct file *map_file,
 				void *key, void *value, u64 map_flags);
 int bpf_fd_htab_map_lookup_elem(struct bpf_map *map, void *key, u32 *value);
 
+int generic_map_lookup_batch(struct bpf_map *map,
+			     const union bpf_attr *attr,
+			     union bpf_attr __user *uattr);
+int generic_map_update_batch(struct bpf_map *map, struct file *map_file,
+			     const union bpf_attr *attr,
+			     union bpf_attr __user *uattr);
+int generic_map_delete_batch(struct bpf_map *map,
+			     const union bpf_attr *attr,
+			     union bpf_attr __user *uattr);
+
 int bpf_get_file_flag(int flags);
 int bpf_check_uarg_tail_zero(void __user *uaddr, size_t expected_size,
 			     size_t actual_size);
@@ -537,6 +747,11 @@ int dev_map_enqueue(struct bpf_dtab_netdev *dst, struct xdp_buff *xdp,
 		    struct net_device *dev_rx);
 int dev_map_generic_redirect(struct bpf_dtab_netdev *dst, struct sk_buff *skb,
 			     struct bpf_prog *xdp_prog);
+int dev_map_enqueue_multi(struct xdp_buff *xdp, struct net_device *dev_rx,
+			  struct bpf_map *map, bool exclude_ingress);
+int dev_map_redirect_multi(struct net_device *dev, struct sk_buff *skb,
+			   struct bpf_prog *xdp_prog, struct bpf_map *map,
+			   bool exclude_ingress);
 
 struct bpf_cpu_map_entry *__cpu_map_lookup_elem(struct bpf_map *map, u32 key);
 void __cpu_map_insert_ctx(struct bpf_map *map, u32 index);
@@ -554,6 +769,58 @@ static inline int bpf_map_attr_numa_node(const union bpf_attr *attr)
 struct bpf_prog *bpf_prog_get_type_path(const char *name, enum bpf_prog_type type);
 int array_map_alloc_check(union bpf_attr *attr);
 
+struct bpf_map *bpf_map_get_curr_or_next(u32 *id);
+
+/* BPF iterators: a target walks one kind of kernel object with seq_file
+ * operations, whose ->show() runs the BPF_TRACE_ITER program attached to
+ * it on each object, see bpf_iter_run_prog().
+ */
+#define BPF_ITER_CTX_ARGS 3
+
+struct bpf_iter_meta {
+	struct seq_file *seq;
+	u64 session_id;		/* of the iterator file */
+	u64 seq_num;		/* of the object in the session */
+};
+
+/* Context of BPF_TRACE_ITER programs, which read it as u64 values. args
+ * are target specific, and all zero on the last run, after the last object.
+ */
+struct bpf_iter_ctx {
+	struct bpf_iter_meta *meta;
+	u64 args[BPF_ITER_CTX_ARGS];
+};
+
+typedef int (*bpf_iter_init_seq_priv_t)(void *private_data);
+typedef void (*bpf_iter_fini_seq_priv_t)(void *private_data);
+
+struct bpf_iter_reg {
+	const char *target;
+	const struct seq_operations *seq_ops;
+	bpf_iter_init_seq_priv_t init_seq_private;
+	bpf_iter_fini_seq_priv_t fini_seq_private;
+	u32 seq_priv_size;
+};
+
+struct bpf_iter_link;
+
+int bpf_iter_reg_target(const struct bpf_iter_reg *reg_info);
+struct bpf_prog *bpf_iter_get_info(struct bpf_iter_meta *meta, bool in_stop);
+int bpf_iter_run_prog(struct bpf_prog *prog, struct bpf_iter_ctx *ctx);
+int bpf_iter_link_attach(struct bpf_prog *prog, const char *target);
+struct bpf_iter_link *bpf_iter_link_get_from_fd(u32 ufd);
+void bpf_iter_link_inc(struct bpf_iter_link *link);
+void bpf_iter_link_put(struct bpf_iter_link *link);
+int bpf_iter_link_new_fd(struct bpf_iter_link *link);
+int bpf_iter_new_fd(struct bpf_iter_link *link);
+int bpf_iter_init_seq_net(void *priv_data);
+void bpf_iter_fini_seq_net(void *priv_data);
+
+extern const struct file_operations bpf_iter_fops;
+extern const struct bpf_func_proto bpf_seq_write_proto;
+
+void bpf_task_storage_free(struct task_struct *task);
+
 #else /* !CONFIG_BPF_SYSCALL */
 static inline struct bpf_prog *bpf_prog_get(u32 ufd)
 {
@@ -592,6 +859,11 @@ bpf_prog_inc_not_zero(struct bpf_prog *prog)
 	return ERR_PTR(-EOPNOTSUPP);
 }
 
+static inline struct bpf_prog *bpf_prog_by_id(u32 id)
+{
+	return ERR_PTR(-ENOTSUPP);
+}
+
 static inline int __bpf_prog_charge(struct user_struct *user, u32 pages)
 {
 	return 0;
@@ -639,6 +911,22 @@ static inline int dev_map_generic_redirect(struct bpf_dtab_netdev *dst,
 	return 0;
 }
 
+static inline
+int dev_map_enqueue_multi(struct xdp_buff *xdp, struct net_device *dev_rx,
+			  struct bpf_map *map, bool exclude_ingress)
+{
+	return 0;
+}
+
+static inline int dev_map_redirect_multi(struct net_device *dev,
+					 struct sk_buff *skb,
+					 struct bpf_prog *xdp_prog,
+					 struct bpf_map *map,
+					 bool exclude_ingress)
+{
+	return 0;
+}
+
 static inline
 struct bpf_cpu_map_entry *__cpu_map_lookup_elem(struct bpf_map *map, u32 key)
 {
@@ -665,6 +953,10 @@ static inline struct bpf_prog *bpf_prog_get_type_path(const char *name,
 {
 	return ERR_PTR(-EOPNOTSUPP);
 }
+
+static inline void bpf_task_storage_free(struct task_struct *task)
+{
+}
 #endif /* CONFIG_BPF_SYSCALL */
 
 static inline struct bpf_prog *bpf_prog_get_type(u32 ufd,
@@ -817,6 +1109,11 @@ extern const struct bpf_func_proto bpf_map_delete_elem_proto;
 extern const struct bpf_func_proto bpf_map_push_elem_proto;
 extern const struct bpf_func_proto bpf_map_pop_elem_proto;
 extern const struct bpf_func_proto bpf_map_peek_elem_proto;
+extern const struct bpf_func_proto bpf_ringbuf_output_proto;
+extern const struct bpf_func_proto bpf_ringbuf_reserve_proto;
+extern const struct bpf_func_proto bpf_ringbuf_submit_proto;
+extern const struct bpf_func_proto bpf_ringbuf_discard_proto;
+extern const struct bpf_func_proto bpf_ringbuf_query_proto;
 
 extern const struct bpf_func_proto bpf_get_prandom_u32_proto;
 extern const struct bpf_func_proto bpf_get_smp_processor_id_proto;
@@ -837,6 +1134,8 @@ extern const struct bpf_func_proto bpf_sk_redirect_hash_proto;
 extern const struct bpf_func_proto bpf_sk_redirect_map_proto;
 
 extern const struct bpf_func_proto bpf_get_local_storage_proto;
+extern const struct bpf_func_proto bpf_task_storage_get_proto;
+extern const struct bpf_func_proto bpf_task_storage_delete_proto;
 
 /* Shared helpers among cBPF and eBPF. */
 void bpf_user_rnd_init_once(void);
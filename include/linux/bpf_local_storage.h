@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Storage of BPF programs local to kernel objects, such as sockets and
+ * tasks: a value per map and per object, which hangs off the object and
+ * goes away with it.
+ */
+#ifndef _BPF_LOCAL_STORAGE_H
+#define _BPF_LOCAL_STORAGE_H
+
+#include <linux/bpf.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+#define BPF_LOCAL_STORAGE_CACHE_SIZE	16
+
+struct bpf_local_storage_map_bucket {
+	struct hlist_head list;
+	raw_spinlock_t lock;
+};
+
+/* The map isn't the owner of its elements, the objects they hang off
+ * are: an element is linked both in the storage of its object, through
+ * which programs find it, and in a bucket of its map, so that the map
+ * can get rid of its elements when it's freed.
+ */
+struct bpf_local_storage_map {
+	struct bpf_map map;
+	struct bpf_local_storage_map_bucket *buckets;
+	u32 bucket_log;
+	u16 elem_size;
+	/* slot of the map in the cache of the storages */
+	u16 cache_idx;
+};
+
+struct bpf_local_storage_data {
+	/* the map is the key of the value in the storage of an object */
+	struct bpf_local_storage_map __rcu *smap;
+	u8 data[0] __aligned(8);
+};
+
+struct bpf_local_storage_elem {
+	struct hlist_node map_node;	/* in a bucket of the map */
+	struct hlist_node snode;	/* in the storage of the object */
+	struct bpf_local_storage __rcu *local_storage;
+	struct rcu_head rcu;
+	struct bpf_local_storage_data sdata ____cacheline_aligned;
+};
+
+struct bpf_local_storage {
+	struct bpf_local_storage_data __rcu *cache[BPF_LOCAL_STORAGE_CACHE_SIZE];
+	struct hlist_head list;		/* of bpf_local_storage_elem */
+	void *owner;
+	struct rcu_head rcu;
+	raw_spinlock_t lock;		/* protects list and cache */
+};
+
+/* Largest value of an element, which is allocated as a whole with
+ * kmalloc() and whose size has to fit in elem_size.
+ */
+#define BPF_LOCAL_STORAGE_MAX_VALUE_SIZE				       \
+	min_t(u32,							       \
+	      (KMALLOC_MAX_SIZE - MAX_BPF_STACK -			       \
+	       sizeof(struct bpf_local_storage_elem)),			       \
+	      (U16_MAX - sizeof(struct bpf_local_storage_elem)))
+
+#define SELEM(_SDATA)							       \
+	container_of((_SDATA), struct bpf_local_storage_elem, sdata)
+#define SDATA(_SELEM) (&(_SELEM)->sdata)
+
+/* Maps of an object type share the slots of the cache of its storages */
+struct bpf_local_storage_cache {
+	spinlock_t idx_lock;
+	u64 idx_usage_counts[BPF_LOCAL_STORAGE_CACHE_SIZE];
+};
+
+#define DEFINE_BPF_STORAGE_CACHE(name)					       \
+static struct bpf_local_storage_cache name = {				       \
+	.idx_lock = __SPIN_LOCK_UNLOCKED(name.idx_lock),		       \
+}
+
+u16 bpf_local_storage_cache_idx_get(struct bpf_local_storage_cache *cache);
+void bpf_local_storage_cache_idx_free(struct bpf_local_storage_cache *cache,
+				      u16 idx);
+
+int bpf_local_storage_map_alloc_check(union bpf_attr *attr);
+struct bpf_local_storage_map *
+bpf_local_storage_map_alloc(union bpf_attr *attr);
+void bpf_local_storage_map_free(struct bpf_local_storage_map *smap,
+				int __percpu *busy_counter);
+
+struct bpf_local_storage_data *
+bpf_local_storage_lookup(struct bpf_local_storage *local_storage,
+			 struct bpf_local_storage_map *smap,
+			 bool cacheit_lockit);
+struct bpf_local_storage_data *
+bpf_local_storage_update(void *owner, struct bpf_local_storage_map *smap,
+			 void *value, u64 map_flags);
+void bpf_selem_unlink(struct bpf_local_storage_elem *selem);
+void bpf_local_storage_destroy(struct bpf_local_storage *local_storage,
+			       bool uncharge_mem);
+
+int bpf_local_storage_map_get_next_key(struct bpf_map *map, void *key,
+				       void *next_key);
+
+#endif /* _BPF_LOCAL_STORAGE_H */
@@ -52,6 +52,9 @@ struct bpf_reg_state {
 		 */
 		struct bpf_map *map_ptr;
 
+		/* valid when type == PTR_TO_MEM | PTR_TO_MEM_OR_NULL */
+		u32 mem_size;
+
 		/* Max size from any of the above. */
 		unsigned long raw;
 	};
@@ -147,6 +150,17 @@ struct bpf_verifier_state {
 	/* call stack tracking */
 	struct bpf_func_state *frame[MAX_CALL_FRAMES];
 	u32 curframe;
+	/* explored state this one was derived from. Read marks of registers
+	 * go through their own parentage chain instead.
+	 */
+	struct bpf_verifier_state *parent;
+	/* number of paths from this state still being explored, including
+	 * the current one. A state with a non-zero count is in progress: it
+	 * is an ancestor of the current state in a loop, and the verifier
+	 * mustn't prune against it.
+	 */
+	u32 branches;
+	u32 insn_idx;
 };
 
 #define bpf_get_spilled_reg(slot, frame)				\
@@ -171,6 +185,10 @@ struct bpf_insn_aux_data {
 		enum bpf_reg_type ptr_type;	/* pointer type for load/store insns */
 		unsigned long map_state;	/* pointer/poison value for maps */
 		s32 call_imm;			/* saved imm field of call insn */
+		struct {
+			u32 map_index;		/* index into used_maps[] */
+			u32 map_off;		/* offset in the value */
+		};
 	};
 	int ctx_field_size; /* the ctx field size for load insn, maybe 0 */
 	int sanitize_stack_off; /* stack slot to be cleared */
@@ -181,6 +199,12 @@ struct bpf_insn_aux_data {
 
 #define BPF_VERIFIER_TMP_LOG_SIZE	1024
 
+#define BPF_LOG_LEVEL1	1
+#define BPF_LOG_LEVEL2	2
+#define BPF_LOG_STATS	4
+#define BPF_LOG_LEVEL	(BPF_LOG_LEVEL1 | BPF_LOG_LEVEL2)
+#define BPF_LOG_MASK	(BPF_LOG_LEVEL | BPF_LOG_STATS)
+
 struct bpf_verifier_log {
 	u32 level;
 	char kbuf[BPF_VERIFIER_TMP_LOG_SIZE];
@@ -226,6 +250,16 @@ struct bpf_verifier_env {
 	struct bpf_verifier_log log;
 	struct bpf_subprog_info subprog_info[BPF_MAX_SUBPROGS + 1];
 	u32 subprog_cnt;
+	/* the following fields are verification statistics, the first four
+	 * also drive the pruning heuristics in is_state_visited()
+	 */
+	u32 insn_processed;
+	u32 prev_insn_processed;
+	u32 jmps_processed;
+	u32 prev_jmps_processed;
+	u32 max_states_per_insn;
+	u32 total_states;
+	u64 verification_time;
 };
 
 __printf(2, 0) void bpf_verifier_vlog(struct bpf_verifier_log *log,
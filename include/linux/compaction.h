@@ -91,7 +91,10 @@ extern int sysctl_extfrag_threshold;
 extern int sysctl_extfrag_handler(struct ctl_table *table, int write,
 			void __user *buffer, size_t *length, loff_t *ppos);
 extern int sysctl_compact_unevictable_allowed;
+extern int sysctl_compaction_proactiveness;
 
+extern unsigned int extfrag_for_order(struct zone *zone, unsigned int order);
+extern unsigned int fragmentation_score_total(void);
 extern int fragmentation_index(struct zone *zone, unsigned int order);
 extern enum compact_result try_to_compact_pages(gfp_t gfp_mask,
 		unsigned int order, unsigned int alloc_flags,
@@ -854,6 +854,10 @@ asmlinkage long compat_sys_mbind(compat_ulong_t start, compat_ulong_t len,
 				 compat_ulong_t mode,
 				 compat_ulong_t __user *nmask,
 				 compat_ulong_t maxnode, compat_ulong_t flags);
+asmlinkage long compat_sys_process_madvise(compat_int_t pidfd,
+					  const struct compat_iovec __user *vec,
+					  compat_size_t vlen, compat_int_t behavior,
+					  compat_uint_t flags);
 asmlinkage long compat_sys_get_mempolicy(int __user *policy,
 					 compat_ulong_t __user *nmask,
 					 compat_ulong_t maxnode,
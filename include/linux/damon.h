@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * DAMON: data access monitoring.
+ *
+ * The monitored address space of each target is split into regions whose
+ * pages are assumed to be accessed alike. Every sampling interval one page
+ * of each region is checked for an access, and the counts are aggregated
+ * over an aggregation interval. Adjacent regions with similar counts are
+ * then merged and every region is split in two at random, so that the
+ * regions follow the access pattern while their number, and so the
+ * monitoring overhead, stays between min_nr_regions and max_nr_regions
+ * whatever the size of the target.
+ */
+#ifndef _LINUX_DAMON_H
+#define _LINUX_DAMON_H
+
+#include <linux/mutex.h>
+#include <linux/time64.h>
+#include <linux/types.h>
+
+struct pid;
+struct task_struct;
+
+/* Minimal region size. Every damon_region is aligned by this. */
+#define DAMON_MIN_REGION	PAGE_SIZE
+
+/**
+ * struct damon_addr_range - Represents an address region of [@start, @end).
+ * @start:	Start address of the region (inclusive).
+ * @end:	End address of the region (exclusive).
+ */
+struct damon_addr_range {
+	unsigned long start;
+	unsigned long end;
+};
+
+/**
+ * struct damon_region - Represents a monitoring target region.
+ * @ar:			The address range of the region.
+ * @sampling_addr:	Address of the sample for the next access check.
+ * @nr_accesses:	Access frequency of this region.
+ * @list:		List head for siblings.
+ *
+ * @nr_accesses is the number of sampling intervals of the last
+ * aggregation interval in which an access to the region was seen.
+ */
+struct damon_region {
+	struct damon_addr_range ar;
+	unsigned long sampling_addr;
+	unsigned int nr_accesses;
+	struct list_head list;
+};
+
+/**
+ * struct damon_target - Represents a monitoring target.
+ * @pid:		The pid of the process to monitor, NULL for
+ *			physical memory.
+ * @nr_regions:		Number of monitoring target regions of this target.
+ * @regions_list:	Head of the monitoring target regions of this target.
+ * @list:		List head for siblings.
+ */
+struct damon_target {
+	struct pid *pid;
+	unsigned int nr_regions;
+	struct list_head regions_list;
+	struct list_head list;
+};
+
+enum damon_target_type {
+	DAMON_TARGET_VADDR,	/* virtual address spaces of processes */
+	DAMON_TARGET_PADDR,	/* the physical address space */
+};
+
+struct damon_ctx;
+
+/**
+ * struct damon_callback - Monitoring events notification callbacks.
+ * @after_aggregation:	Called at the end of each aggregation interval,
+ *			with the access counts of the interval still set.
+ *
+ * The callback runs in the monitoring thread, which holds no lock that
+ * the context API takes. A non-zero return stops the monitoring.
+ */
+struct damon_callback {
+	void *private;
+	int (*after_aggregation)(struct damon_ctx *ctx);
+};
+
+/**
+ * struct damon_ctx - Represents a context for each monitoring.
+ * @sample_interval:	The time between access samplings, in us.
+ * @aggr_interval:	The time between monitor results aggregations, in us.
+ * @update_interval:	The time between updates of the monitoring target
+ *			regions from the target memory mappings, in us.
+ * @min_nr_regions:	The minimum number of monitoring regions.
+ * @max_nr_regions:	The maximum number of monitoring regions.
+ * @type:		What address space the targets are in.
+ * @callback:		Notification callbacks of the monitoring.
+ * @kdamond:		Kernel thread doing the monitoring, if running.
+ * @kdamond_lock:	Mutex protecting @kdamond and @targets_list.
+ * @targets_list:	Head of the monitoring targets of this context.
+ *
+ * The attributes and the targets may only be changed while the monitoring
+ * is not running.
+ */
+struct damon_ctx {
+	unsigned long sample_interval;
+	unsigned long aggr_interval;
+	unsigned long update_interval;
+	unsigned long min_nr_regions;
+	unsigned long max_nr_regions;
+	enum damon_target_type type;
+	struct damon_callback callback;
+
+	struct timespec64 last_aggregation;
+	struct timespec64 last_update;
+
+	struct task_struct *kdamond;
+	bool kdamond_stop;
+	struct mutex kdamond_lock;
+	struct list_head targets_list;
+};
+
+#define damon_for_each_target(t, ctx) \
+	list_for_each_entry(t, &(ctx)->targets_list, list)
+
+#define damon_for_each_region(r, t) \
+	list_for_each_entry(r, &(t)->regions_list, list)
+
+#ifdef CONFIG_DAMON
+
+struct damon_ctx *damon_new_ctx(enum damon_target_type type);
+void damon_destroy_ctx(struct damon_ctx *ctx);
+int damon_set_attrs(struct damon_ctx *ctx, unsigned long sample_int,
+		    unsigned long aggr_int, unsigned long update_int,
+		    unsigned long min_nr_reg, unsigned long max_nr_reg);
+int damon_set_targets(struct damon_ctx *ctx, int *pids, unsigned int nr_pids);
+int damon_start(struct damon_ctx *ctx);
+int damon_stop(struct damon_ctx *ctx);
+
+#endif	/* CONFIG_DAMON */
+
+#endif	/* _LINUX_DAMON_H */
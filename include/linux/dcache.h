@@ -64,9 +64,11 @@ struct dentry_stat_t {
 	long nr_unused;
 	long age_limit;          /* age in seconds */
 	long want_pages;         /* pages requested by system */
-	long dummy[2];
+	long nr_negative;        /* # of unused negative dentries */
+	long dummy;
 };
 extern struct dentry_stat_t dentry_stat;
+extern int sysctl_negative_dentry_limit;
 
 /*
  * Try to keep struct dentry aligned on 64 byte cachelines (this will
@@ -213,6 +215,7 @@ struct dentry_operations {
 #define DCACHE_FALLTHRU			0x01000000 /* Fall through to lower layer */
 #define DCACHE_ENCRYPTED_WITH_KEY	0x02000000 /* dir is encrypted with a valid key */
 #define DCACHE_OP_REAL			0x04000000
+#define DCACHE_PAR_UPDATE		0x08000000 /* being created or unlinked (with parent locked shared) */
 
 #define DCACHE_PAR_LOOKUP		0x10000000 /* being looked up (with parent locked shared) */
 #define DCACHE_DENTRY_CURSOR		0x20000000
@@ -370,6 +373,9 @@ static inline void d_lookup_done(struct dentry *dentry)
 	}
 }
 
+extern bool d_lock_update(struct dentry *);
+extern void d_unlock_update(struct dentry *);
+
 extern void dput(struct dentry *);
 
 static inline bool d_managed(const struct dentry *dentry)
@@ -63,6 +63,23 @@ struct task_delay_info {
 
 	u32 freepages_count;	/* total count of memory reclaim */
 	u32 thrashing_count;	/* total count of thrash waits */
+
+	u64 compact_start;
+	u64 compact_delay;	/* wait for direct compaction */
+
+	u64 pagewait_start;
+	u64 pagewait_delay;	/* wait for page cache page lock/writeback */
+
+	u32 compact_count;	/* total count of direct compactions */
+	u32 pagewait_count;	/* total count of page cache waits */
+
+	/* The longest single delay of each stat, in nanoseconds */
+	u64 blkio_delay_max;
+	u64 swapin_delay_max;
+	u64 freepages_delay_max;
+	u64 thrashing_delay_max;
+	u64 compact_delay_max;
+	u64 pagewait_delay_max;
 };
 #endif
 
@@ -83,6 +100,10 @@ extern void __delayacct_freepages_start(void);
 extern void __delayacct_freepages_end(void);
 extern void __delayacct_thrashing_start(void);
 extern void __delayacct_thrashing_end(void);
+extern void __delayacct_compact_start(void);
+extern void __delayacct_compact_end(void);
+extern void __delayacct_pagewait_start(void);
+extern void __delayacct_pagewait_end(void);
 
 static inline int delayacct_is_task_waiting_on_io(struct task_struct *p)
 {
@@ -175,6 +196,30 @@ static inline void delayacct_thrashing_end(void)
 		__delayacct_thrashing_end();
 }
 
+static inline void delayacct_compact_start(void)
+{
+	if (current->delays)
+		__delayacct_compact_start();
+}
+
+static inline void delayacct_compact_end(void)
+{
+	if (current->delays)
+		__delayacct_compact_end();
+}
+
+static inline void delayacct_pagewait_start(void)
+{
+	if (current->delays)
+		__delayacct_pagewait_start();
+}
+
+static inline void delayacct_pagewait_end(void)
+{
+	if (current->delays)
+		__delayacct_pagewait_end();
+}
+
 #else
 static inline void delayacct_set_flag(int flag)
 {}
@@ -205,6 +250,14 @@ static inline void delayacct_thrashing_start(void)
 {}
 static inline void delayacct_thrashing_end(void)
 {}
+static inline void delayacct_compact_start(void)
+{}
+static inline void delayacct_compact_end(void)
+{}
+static inline void delayacct_pagewait_start(void)
+{}
+static inline void delayacct_pagewait_end(void)
+{}
 
 #endif /* CONFIG_TASK_DELAY_ACCT */
 
@@ -438,6 +438,8 @@ int ftrace_test_record(struct dyn_ftrace *rec, int enable);
 void ftrace_run_stop_machine(int command);
 unsigned long ftrace_location(unsigned long ip);
 unsigned long ftrace_location_range(unsigned long start, unsigned long end);
+int ftrace_reserve_location(unsigned long ip);
+void ftrace_release_location(unsigned long ip);
 unsigned long ftrace_get_addr_new(struct dyn_ftrace *rec);
 unsigned long ftrace_get_addr_curr(struct dyn_ftrace *rec);
 
@@ -607,6 +609,11 @@ static inline unsigned long ftrace_location(unsigned long ip)
 {
 	return 0;
 }
+static inline int ftrace_reserve_location(unsigned long ip)
+{
+	return -EINVAL;
+}
+static inline void ftrace_release_location(unsigned long ip) { }
 
 /*
  * Again users of functions that have ftrace_ops may not
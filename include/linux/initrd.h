@@ -22,3 +22,9 @@ extern unsigned long initrd_start, initrd_end;
 extern void free_initrd_mem(unsigned long, unsigned long);
 
 extern unsigned int real_root_dev;
+
+#ifdef CONFIG_BLK_DEV_INITRD
+extern void wait_for_initramfs(void);
+#else
+static inline void wait_for_initramfs(void) {}
+#endif
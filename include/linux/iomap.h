@@ -103,13 +103,14 @@ struct iomap_ops {
 };
 
 /*
- * Structure allocate for each page when block size < PAGE_SIZE to track
- * sub-page uptodate status and I/O completions.
+ * Structure allocate for each page when block size < page size to track
+ * sub-page uptodate status and I/O completions.  The bitmap is sized for
+ * the number of blocks in the page, which may be a huge page.
  */
 struct iomap_page {
 	atomic_t		read_count;
 	atomic_t		write_count;
-	DECLARE_BITMAP(uptodate, PAGE_SIZE / 512);
+	unsigned long		uptodate[];
 };
 
 static inline struct iomap_page *to_iomap_page(struct page *page)
@@ -161,7 +162,9 @@ sector_t iomap_bmap(struct address_space *mapping, sector_t bno,
 typedef int (iomap_dio_end_io_t)(struct kiocb *iocb, ssize_t ret,
 		unsigned flags);
 ssize_t iomap_dio_rw(struct kiocb *iocb, struct iov_iter *iter,
-		const struct iomap_ops *ops, iomap_dio_end_io_t end_io);
+		const struct iomap_ops *ops, iomap_dio_end_io_t end_io,
+		bool wait_for_completion);
+int iomap_dio_iopoll(struct kiocb *kiocb);
 
 #ifdef CONFIG_SWAP
 struct file;
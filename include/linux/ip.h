@@ -34,4 +34,30 @@ static inline struct iphdr *ipip_hdr(const struct sk_buff *skb)
 {
 	return (struct iphdr *)skb_transport_header(skb);
 }
+
+/*
+ * A TCP GSO packet above 64k has tot_len set to 0, its length is then
+ * that of the skb.
+ */
+static inline unsigned int iph_totlen(const struct sk_buff *skb,
+				      const struct iphdr *iph)
+{
+	u32 len = ntohs(iph->tot_len);
+
+	return (len || !skb_is_gso(skb) || !skb_is_gso_tcp(skb)) ?
+	       len : skb->len - skb_network_offset(skb);
+}
+
+static inline unsigned int skb_ip_totlen(const struct sk_buff *skb)
+{
+	return iph_totlen(skb, ip_hdr(skb));
+}
+
+/* IPv4 datagram length is stored into 16bit field (tot_len) */
+#define IP_MAX_TOTLEN	0xFFFF
+
+static inline void iph_set_totlen(struct iphdr *iph, unsigned int len)
+{
+	iph->tot_len = len <= IP_MAX_TOTLEN ? htons(len) : 0;
+}
 #endif	/* _LINUX_IP_H */
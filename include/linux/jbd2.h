@@ -70,6 +70,11 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS 256
+
+/* Return values of journal_t.j_fc_replay_callback */
+#define JBD2_FC_REPLAY_STOP	0
+#define JBD2_FC_REPLAY_CONTINUE	1
 
 #ifdef __KERNEL__
 
@@ -107,6 +112,9 @@ typedef struct jbd2_journal_handle handle_t;	/* Atomic operation type */
 typedef struct journal_s	journal_t;	/* Journal control structure */
 #endif
 
+/* Recovery passes, also seen by fast commit replay callbacks */
+enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
+
 /*
  * Internal structures used by the logging mechanism:
  */
@@ -265,7 +273,9 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__be32	s_num_fc_blks;		/* Number of fast commit blocks */
+	__u32	s_padding[41];
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -291,6 +301,7 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000020
 
 /* See "journal feature predicate functions" below */
 
@@ -301,7 +312,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -902,6 +914,30 @@ struct journal_s
 	 */
 	unsigned long		j_last;
 
+	/**
+	 * @j_fc_first:
+	 *
+	 * The block number of the first fast commit block in the journal
+	 * [j_state_lock].
+	 */
+	unsigned long		j_fc_first;
+
+	/**
+	 * @j_fc_off:
+	 *
+	 * Number of fast commit blocks currently allocated.  Accessed only
+	 * during fast commit; the fast commit path has exclusive access.
+	 */
+	unsigned long		j_fc_off;
+
+	/**
+	 * @j_fc_last:
+	 *
+	 * The block number one beyond the last fast commit block in the
+	 * journal [j_state_lock].
+	 */
+	unsigned long		j_fc_last;
+
 	/**
 	 * @j_dev: Device where we store the journal.
 	 */
@@ -1052,6 +1088,28 @@ struct journal_s
 	 */
 	int			j_wbufsize;
 
+	/**
+	 * @j_fc_wbuf:
+	 *
+	 * Array of fast commit bhs for jbd2_fc_get_buf().
+	 */
+	struct buffer_head	**j_fc_wbuf;
+
+	/**
+	 * @j_fc_wbufsize:
+	 *
+	 * Size of @j_fc_wbuf array.
+	 */
+	int			j_fc_wbufsize;
+
+	/**
+	 * @j_fc_wait:
+	 *
+	 * Wait queue for processes waiting for a fast commit or a full commit
+	 * to finish [j_state_lock].
+	 */
+	wait_queue_head_t	j_fc_wait;
+
 	/**
 	 * @j_last_sync_writer:
 	 *
@@ -1092,6 +1150,29 @@ struct journal_s
 	void			(*j_commit_callback)(journal_t *,
 						     transaction_t *);
 
+	/**
+	 * @j_fc_cleanup_callback:
+	 *
+	 * Clean-up after a fast commit or a full commit.  @full is true
+	 * for a full commit, in which case @tid is the committed tid.
+	 */
+	void			(*j_fc_cleanup_callback)(journal_t *journal,
+							 int full, tid_t tid);
+
+	/**
+	 * @j_fc_replay_callback:
+	 *
+	 * Fast commit replay function, called during recovery for each fast
+	 * commit block after the full commits have been replayed.  @pass is
+	 * PASS_SCAN for the first walk over the fast commit area and
+	 * PASS_REPLAY for the second one.  Returns JBD2_FC_REPLAY_CONTINUE,
+	 * JBD2_FC_REPLAY_STOP or a negative errno.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *journal,
+							struct buffer_head *bh,
+							int pass, int off,
+							tid_t expected_commit_id);
+
 	/*
 	 * Journal statistics
 	 */
@@ -1221,6 +1302,7 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(fast_commit,	FAST_COMMIT)
 
 /*
  * Journal flag definitions
@@ -1235,6 +1317,8 @@ JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_FAST_COMMIT_ONGOING	0x100	/* Fast commit is ongoing */
+#define JBD2_FULL_COMMIT_ONGOING	0x200	/* Full commit is ongoing */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1395,6 +1479,11 @@ extern int	   jbd2_journal_errno      (journal_t *);
 extern void	   jbd2_journal_ack_err    (journal_t *);
 extern int	   jbd2_journal_clear_err  (journal_t *);
 extern int	   jbd2_journal_bmap(journal_t *, unsigned long, unsigned long long *);
+extern int	   jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+extern int	   jbd2_fc_end_commit(journal_t *journal);
+extern int	   jbd2_fc_end_commit_fallback(journal_t *journal, tid_t tid);
+extern int	   jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out);
+extern int	   jbd2_fc_wait_bufs(journal_t *journal, int num_blks);
 extern int	   jbd2_journal_force_commit(journal_t *);
 extern int	   jbd2_journal_force_commit_nested(journal_t *);
 extern int	   jbd2_journal_inode_add_write(handle_t *handle, struct jbd2_inode *inode);
@@ -7,6 +7,7 @@
 
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 extern struct attribute_group khugepaged_attr_group;
+extern unsigned int khugepaged_max_ptes_none __read_mostly;
 
 extern int khugepaged_init(void);
 extern void khugepaged_destroy(void);
@@ -97,6 +97,9 @@ enum mem_cgroup_events_target {
 struct mem_cgroup_stat_cpu {
 	long count[MEMCG_NR_STAT];
 	unsigned long events[NR_VM_EVENT_ITEMS];
+	/* What the last rstat flush has already folded in */
+	long count_prev[MEMCG_NR_STAT];
+	unsigned long events_prev[NR_VM_EVENT_ITEMS];
 	unsigned long nr_page_events;
 	unsigned long targets[MEM_CGROUP_NTARGETS];
 };
@@ -179,6 +182,26 @@ enum memcg_kmem_state {
 	KMEM_ONLINE,
 };
 
+/*
+ * Bytes of slab objects are charged to an obj_cgroup rather than to the
+ * memcg directly.  The obj_cgroup is an indirection: when the memcg goes
+ * offline its obj_cgroups are reparented, so the objects still alive don't
+ * pin the dead memcg and its slab caches.  Charges are rounded to whole
+ * pages at the memcg level, the sub-page remainder of each obj_cgroup is
+ * kept in nr_charged_bytes.
+ */
+struct obj_cgroup {
+	struct percpu_ref refcnt;
+	struct mem_cgroup *memcg;
+	atomic_t nr_charged_bytes;
+	/* Sub-page remainders of NR_SLAB_{UN,}RECLAIMABLE, in bytes */
+	atomic_t nr_slab_bytes[2];
+	union {
+		struct list_head list;
+		struct rcu_head rcu;
+	};
+};
+
 #if defined(CONFIG_SMP)
 struct memcg_padding {
 	char x[0];
@@ -278,8 +301,18 @@ struct mem_cgroup {
 
 	MEMCG_PADDING(_pad2_);
 
-	atomic_long_t		stat[MEMCG_NR_STAT];
-	atomic_long_t		events[NR_VM_EVENT_ITEMS];
+	/*
+	 * Folded in from stat_cpu by rstat flushes, see
+	 * mem_cgroup_css_rstat_flush(): this cgroup's own counts, the
+	 * counts of its whole subtree, and child counts that still have
+	 * to be added to the subtree counts.
+	 */
+	long			stat[MEMCG_NR_STAT];
+	long			stat_tree[MEMCG_NR_STAT];
+	long			stat_pending[MEMCG_NR_STAT];
+	unsigned long		events[NR_VM_EVENT_ITEMS];
+	unsigned long		events_tree[NR_VM_EVENT_ITEMS];
+	unsigned long		events_pending[NR_VM_EVENT_ITEMS];
 	atomic_long_t memory_events[MEMCG_NR_MEMORY_EVENTS];
 
 	unsigned long		socket_pressure;
@@ -293,6 +326,9 @@ struct mem_cgroup {
 	int kmemcg_id;
 	enum memcg_kmem_state kmem_state;
 	struct list_head kmem_caches;
+	struct obj_cgroup __rcu *objcg;
+	/* Reparented obj_cgroups, still pointing at this memcg */
+	struct list_head objcg_list;
 #endif
 
 	int last_scanned_node;
@@ -307,6 +343,11 @@ struct mem_cgroup {
 	struct wb_domain cgwb_domain;
 #endif
 
+#ifdef CONFIG_LRU_GEN
+	/* The mm_structs owned by tasks in this memcg, see lru_gen_add_mm() */
+	struct lru_gen_mm_list mm_list;
+#endif
+
 	/* List of events which userspace want to receive */
 	struct list_head event_list;
 	spinlock_t event_list_lock;
@@ -392,6 +433,10 @@ static inline struct lruvec *mem_cgroup_lruvec(struct pglist_data *pgdat,
 
 struct lruvec *mem_cgroup_page_lruvec(struct page *, struct pglist_data *);
 
+struct lruvec *lock_page_lruvec_irq(struct page *page);
+struct lruvec *lock_page_lruvec_irqsave(struct page *page,
+					unsigned long *flags);
+
 bool task_in_mem_cgroup(struct task_struct *task, struct mem_cgroup *memcg);
 struct mem_cgroup *mem_cgroup_from_task(struct task_struct *p);
 
@@ -559,11 +604,38 @@ struct mem_cgroup *lock_page_memcg(struct page *page);
 void __unlock_page_memcg(struct mem_cgroup *memcg);
 void unlock_page_memcg(struct page *page);
 
+void memcg_rstat_updated(struct mem_cgroup *memcg, int val);
+void mem_cgroup_flush_stats(void);
+
+/*
+ * The page state and event readers below return the counts as of the
+ * last rstat flush. Callers that need them current must flush first,
+ * with mem_cgroup_flush_stats() or cgroup_rstat_flush().
+ */
+
 /* idx can be of type enum memcg_stat_item or node_stat_item */
 static inline unsigned long memcg_page_state(struct mem_cgroup *memcg,
 					     int idx)
 {
-	long x = atomic_long_read(&memcg->stat[idx]);
+	long x = READ_ONCE(memcg->stat[idx]);
+#ifdef CONFIG_SMP
+	if (x < 0)
+		x = 0;
+#endif
+	return x;
+}
+
+/* Same as memcg_page_state(), but summed over the subtree of @memcg */
+static inline unsigned long memcg_tree_page_state(struct mem_cgroup *memcg,
+						  int idx)
+{
+	long x;
+
+	/* A cgroup1 non-hierarchical memcg only accounts for itself */
+	if (!memcg->use_hierarchy && !mem_cgroup_is_root(memcg))
+		return memcg_page_state(memcg, idx);
+
+	x = READ_ONCE(memcg->stat_tree[idx]);
 #ifdef CONFIG_SMP
 	if (x < 0)
 		x = 0;
@@ -575,17 +647,11 @@ static inline unsigned long memcg_page_state(struct mem_cgroup *memcg,
 static inline void __mod_memcg_state(struct mem_cgroup *memcg,
 				     int idx, int val)
 {
-	long x;
-
 	if (mem_cgroup_disabled())
 		return;
 
-	x = val + __this_cpu_read(memcg->stat_cpu->count[idx]);
-	if (unlikely(abs(x) > MEMCG_CHARGE_BATCH)) {
-		atomic_long_add(x, &memcg->stat[idx]);
-		x = 0;
-	}
-	__this_cpu_write(memcg->stat_cpu->count[idx], x);
+	__this_cpu_add(memcg->stat_cpu->count[idx], val);
+	memcg_rstat_updated(memcg, val);
 }
 
 /* idx can be of type enum memcg_stat_item or node_stat_item */
@@ -718,17 +784,11 @@ static inline void __count_memcg_events(struct mem_cgroup *memcg,
 					enum vm_event_item idx,
 					unsigned long count)
 {
-	unsigned long x;
-
 	if (mem_cgroup_disabled())
 		return;
 
-	x = count + __this_cpu_read(memcg->stat_cpu->events[idx]);
-	if (unlikely(x > MEMCG_CHARGE_BATCH)) {
-		atomic_long_add(x, &memcg->events[idx]);
-		x = 0;
-	}
-	__this_cpu_write(memcg->stat_cpu->events[idx], x);
+	__this_cpu_add(memcg->stat_cpu->events[idx], count);
+	memcg_rstat_updated(memcg, count);
 }
 
 static inline void count_memcg_events(struct mem_cgroup *memcg,
@@ -878,6 +938,23 @@ static inline struct lruvec *mem_cgroup_page_lruvec(struct page *page,
 	return &pgdat->lruvec;
 }
 
+static inline struct lruvec *lock_page_lruvec_irq(struct page *page)
+{
+	struct pglist_data *pgdat = page_pgdat(page);
+
+	spin_lock_irq(&pgdat->lruvec.lru_lock);
+	return &pgdat->lruvec;
+}
+
+static inline struct lruvec *lock_page_lruvec_irqsave(struct page *page,
+						      unsigned long *flags)
+{
+	struct pglist_data *pgdat = page_pgdat(page);
+
+	spin_lock_irqsave(&pgdat->lruvec.lru_lock, *flags);
+	return &pgdat->lruvec;
+}
+
 static inline bool mm_match_cgroup(struct mm_struct *mm,
 		struct mem_cgroup *memcg)
 {
@@ -1019,12 +1096,22 @@ static inline void mem_cgroup_print_oom_group(struct mem_cgroup *memcg)
 {
 }
 
+static inline void mem_cgroup_flush_stats(void)
+{
+}
+
 static inline unsigned long memcg_page_state(struct mem_cgroup *memcg,
 					     int idx)
 {
 	return 0;
 }
 
+static inline unsigned long memcg_tree_page_state(struct mem_cgroup *memcg,
+						  int idx)
+{
+	return 0;
+}
+
 static inline void __mod_memcg_state(struct mem_cgroup *memcg,
 				     int idx,
 				     int nr)
@@ -1108,6 +1195,51 @@ void count_memcg_event_mm(struct mm_struct *mm, enum vm_event_item idx)
 }
 #endif /* CONFIG_MEMCG */
 
+static inline void unlock_page_lruvec_irq(struct lruvec *lruvec)
+{
+	spin_unlock_irq(&lruvec->lru_lock);
+}
+
+static inline void unlock_page_lruvec_irqrestore(struct lruvec *lruvec,
+						 unsigned long flags)
+{
+	spin_unlock_irqrestore(&lruvec->lru_lock, flags);
+}
+
+/* Is @page on, or headed for, the lists of @lruvec */
+static inline bool lruvec_holds_page_lru_lock(struct page *page,
+					      struct lruvec *lruvec)
+{
+	return lruvec == mem_cgroup_page_lruvec(page, page_pgdat(page));
+}
+
+/*
+ * Batches of pages are usually of the same memcg and node: only drop the
+ * lock held for the previous page when this one lives on another lruvec.
+ */
+static inline struct lruvec *relock_page_lruvec_irq(struct page *page,
+						    struct lruvec *locked)
+{
+	if (locked) {
+		if (lruvec_holds_page_lru_lock(page, locked))
+			return locked;
+		unlock_page_lruvec_irq(locked);
+	}
+	return lock_page_lruvec_irq(page);
+}
+
+static inline struct lruvec *relock_page_lruvec_irqsave(struct page *page,
+							struct lruvec *locked,
+							unsigned long *flags)
+{
+	if (locked) {
+		if (lruvec_holds_page_lru_lock(page, locked))
+			return locked;
+		unlock_page_lruvec_irqrestore(locked, *flags);
+	}
+	return lock_page_lruvec_irqsave(page, flags);
+}
+
 /* idx can be of type enum memcg_stat_item or node_stat_item */
 static inline void __inc_memcg_state(struct mem_cgroup *memcg,
 				     int idx)
@@ -1264,8 +1396,6 @@ static inline bool mem_cgroup_under_socket_pressure(struct mem_cgroup *memcg)
 }
 #endif
 
-struct kmem_cache *memcg_kmem_get_cache(struct kmem_cache *cachep);
-void memcg_kmem_put_cache(struct kmem_cache *cachep);
 int memcg_kmem_charge_memcg(struct page *page, gfp_t gfp, int order,
 			    struct mem_cgroup *memcg);
 
@@ -1273,6 +1403,37 @@ int memcg_kmem_charge_memcg(struct page *page, gfp_t gfp, int order,
 int memcg_kmem_charge(struct page *page, gfp_t gfp, int order);
 void memcg_kmem_uncharge(struct page *page, int order);
 
+struct obj_cgroup *get_obj_cgroup_from_current(void);
+int obj_cgroup_charge(struct obj_cgroup *objcg, gfp_t gfp, size_t size);
+void obj_cgroup_uncharge(struct obj_cgroup *objcg, size_t size);
+void mod_objcg_slab_state(struct obj_cgroup *objcg, bool reclaimable,
+			  int nr_bytes);
+struct mem_cgroup *mem_cgroup_from_obj(void *p);
+
+static inline bool obj_cgroup_tryget(struct obj_cgroup *objcg)
+{
+	return percpu_ref_tryget(&objcg->refcnt);
+}
+
+static inline void obj_cgroup_get(struct obj_cgroup *objcg)
+{
+	percpu_ref_get(&objcg->refcnt);
+}
+
+static inline void obj_cgroup_put(struct obj_cgroup *objcg)
+{
+	percpu_ref_put(&objcg->refcnt);
+}
+
+/*
+ * After the initial checks, objcg->memcg can change under reparenting:
+ * must be called under rcu_read_lock(), or with a reference on the memcg.
+ */
+static inline struct mem_cgroup *obj_cgroup_memcg(struct obj_cgroup *objcg)
+{
+	return READ_ONCE(objcg->memcg);
+}
+
 extern struct static_key_false memcg_kmem_enabled_key;
 extern struct workqueue_struct *memcg_kmem_cache_wq;
 
@@ -25,6 +25,7 @@ enum migrate_reason {
 	MR_MEMPOLICY_MBIND,
 	MR_NUMA_MISPLACED,
 	MR_CONTIG_RANGE,
+	MR_DEMOTION,
 	MR_TYPES
 };
 
@@ -108,6 +109,27 @@ static inline int migrate_huge_page_move_mapping(struct address_space *mapping,
 
 #endif /* CONFIG_MIGRATION */
 
+/*
+ * Memory tiering: nodes with CPUs are the fast, top tier; memory-only
+ * nodes (PMEM, CXL) are the slow tier that reclaim demotes cold pages to
+ * and NUMA balancing promotes hot pages from.
+ */
+static inline bool node_is_toptier(int node)
+{
+	return node_state(node, N_CPU);
+}
+
+#if defined(CONFIG_MIGRATION) && defined(CONFIG_NUMA)
+extern bool numa_demotion_enabled;
+extern int next_demotion_node(int node);
+#else
+#define numa_demotion_enabled	false
+static inline int next_demotion_node(int node)
+{
+	return NUMA_NO_NODE;
+}
+#endif
+
 #ifdef CONFIG_COMPACTION
 extern int PageMovable(struct page *page);
 extern void __SetPageMovable(struct page *page, struct address_space *mapping);
@@ -231,6 +231,13 @@ extern unsigned int kobjsize(const void *objp);
 #define VM_HIGH_ARCH_4	BIT(VM_HIGH_ARCH_BIT_4)
 #endif /* CONFIG_ARCH_USES_HIGH_VMA_FLAGS */
 
+#ifdef CONFIG_HAVE_ARCH_USERFAULTFD_MINOR
+# define VM_UFFD_MINOR_BIT	37
+# define VM_UFFD_MINOR		BIT(VM_UFFD_MINOR_BIT)	/* UFFD minor faults */
+#else
+# define VM_UFFD_MINOR		VM_NONE
+#endif
+
 #ifdef CONFIG_ARCH_HAS_PKEYS
 # define VM_PKEY_SHIFT	VM_HIGH_ARCH_BIT_0
 # define VM_PKEY_BIT0	VM_HIGH_ARCH_0	/* A protection key is a 4-bit value */
@@ -452,6 +459,92 @@ struct vm_operations_struct {
 					  unsigned long addr);
 };
 
+#ifdef CONFIG_PER_VMA_LOCK
+/*
+ * Per-VMA locks let page faults run without mmap_sem.
+ *
+ * With mmap_sem held for write, a VMA is write-locked by vma_write_lock()
+ * before it is modified or removed: this waits for the faults running
+ * under the VMA and then sets vm_lock_seq to the mm's mm_lock_seq. All the
+ * VMAs locked that way are released at once by vma_write_unlock_mm(),
+ * which bumps mm_lock_seq before mmap_sem is dropped. Faults that find
+ * the VMA write-locked fall back to mmap_sem.
+ */
+static inline void vma_lock_init(struct vm_area_struct *vma)
+{
+	init_rwsem(&vma->vm_lock);
+	vma->vm_lock_seq = -1;
+	vma->vm_detached = false;
+}
+
+static inline bool vma_read_trylock(struct mm_struct *mm,
+				    struct vm_area_struct *vma)
+{
+	/* Check before locking, a write-locked VMA is the common failure */
+	if (READ_ONCE(vma->vm_lock_seq) == smp_load_acquire(&mm->mm_lock_seq))
+		return false;
+
+	if (unlikely(!down_read_trylock(&vma->vm_lock)))
+		return false;
+
+	/*
+	 * vm_lock_seq only changes under the write side of vm_lock, while
+	 * mm_lock_seq may have been bumped meanwhile, which just means the
+	 * VMA got unlocked. Pairs with smp_store_release() in
+	 * vma_write_unlock_mm().
+	 */
+	if (unlikely(vma->vm_lock_seq == smp_load_acquire(&mm->mm_lock_seq))) {
+		up_read(&vma->vm_lock);
+		return false;
+	}
+	return true;
+}
+
+static inline void vma_read_unlock(struct vm_area_struct *vma)
+{
+	up_read(&vma->vm_lock);
+}
+
+static inline void vma_write_lock(struct vm_area_struct *vma)
+{
+	int mm_lock_seq;
+
+	lockdep_assert_held_exclusive(&vma->vm_mm->mmap_sem);
+
+	/* mm_lock_seq cannot change while we hold mmap_sem for write */
+	mm_lock_seq = vma->vm_mm->mm_lock_seq;
+	if (vma->vm_lock_seq == mm_lock_seq)
+		return;
+
+	down_write(&vma->vm_lock);
+	WRITE_ONCE(vma->vm_lock_seq, mm_lock_seq);
+	up_write(&vma->vm_lock);
+}
+
+static inline void vma_write_unlock_mm(struct mm_struct *mm)
+{
+	lockdep_assert_held_exclusive(&mm->mmap_sem);
+	smp_store_release(&mm->mm_lock_seq, mm->mm_lock_seq + 1);
+}
+
+static inline void vma_mark_detached(struct vm_area_struct *vma, bool detached)
+{
+	/* Faults must not find a VMA that is being removed */
+	if (detached)
+		vma_write_lock(vma);
+	vma->vm_detached = detached;
+}
+
+struct vm_area_struct *lock_vma_under_rcu(struct mm_struct *mm,
+					  unsigned long address);
+#else
+static inline void vma_lock_init(struct vm_area_struct *vma) {}
+static inline void vma_write_lock(struct vm_area_struct *vma) {}
+static inline void vma_write_unlock_mm(struct mm_struct *mm) {}
+static inline void vma_mark_detached(struct vm_area_struct *vma,
+				     bool detached) {}
+#endif /* CONFIG_PER_VMA_LOCK */
+
 static inline void vma_init(struct vm_area_struct *vma, struct mm_struct *mm)
 {
 	static const struct vm_operations_struct dummy_vm_ops = {};
@@ -460,6 +553,7 @@ static inline void vma_init(struct vm_area_struct *vma, struct mm_struct *mm)
 	vma->vm_mm = mm;
 	vma->vm_ops = &dummy_vm_ops;
 	INIT_LIST_HEAD(&vma->anon_vma_chain);
+	vma_lock_init(vma);
 }
 
 static inline void vma_set_anonymous(struct vm_area_struct *vma)
@@ -799,11 +893,12 @@ vm_fault_t finish_mkwrite_fault(struct vm_fault *vmf);
  * sets it, so none of the operations on it need to be atomic.
  */
 
-/* Page flags: | [SECTION] | [NODE] | ZONE | [LAST_CPUPID] | ... | FLAGS | */
+/* Page flags: | [SECTION] | [NODE] | ZONE | [LRU_GEN] | [LAST_CPUPID] | ... | FLAGS | */
 #define SECTIONS_PGOFF		((sizeof(unsigned long)*8) - SECTIONS_WIDTH)
 #define NODES_PGOFF		(SECTIONS_PGOFF - NODES_WIDTH)
 #define ZONES_PGOFF		(NODES_PGOFF - ZONES_WIDTH)
-#define LAST_CPUPID_PGOFF	(ZONES_PGOFF - LAST_CPUPID_WIDTH)
+#define LRU_GEN_PGOFF		(ZONES_PGOFF - LRU_GEN_WIDTH)
+#define LAST_CPUPID_PGOFF	(LRU_GEN_PGOFF - LAST_CPUPID_WIDTH)
 
 /*
  * Define the bit shifts to access each section.  For non-existent
@@ -828,8 +923,8 @@ vm_fault_t finish_mkwrite_fault(struct vm_fault *vmf);
 
 #define ZONEID_PGSHIFT		(ZONEID_PGOFF * (ZONEID_SHIFT != 0))
 
-#if SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
-#error SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
+#if SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH+LRU_GEN_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
+#error SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH+LRU_GEN_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
 #endif
 
 #define ZONES_MASK		((1UL << ZONES_WIDTH) - 1)
@@ -837,6 +932,8 @@ vm_fault_t finish_mkwrite_fault(struct vm_fault *vmf);
 #define SECTIONS_MASK		((1UL << SECTIONS_WIDTH) - 1)
 #define LAST_CPUPID_MASK	((1UL << LAST_CPUPID_SHIFT) - 1)
 #define ZONEID_MASK		((1UL << ZONEID_SHIFT) - 1)
+/* Generation + 1 of a page on a multi-gen LRU list, 0 otherwise */
+#define LRU_GEN_MASK		(((1UL << LRU_GEN_WIDTH) - 1) << LRU_GEN_PGOFF)
 
 static inline enum zone_type page_zonenum(const struct page *page)
 {
@@ -1055,6 +1152,30 @@ static inline void page_cpupid_reset_last(struct page *page)
 	page->flags |= LAST_CPUPID_MASK << LAST_CPUPID_PGSHIFT;
 }
 #endif /* LAST_CPUPID_NOT_IN_PAGE_FLAGS */
+
+/*
+ * In memory tiering mode, the last_cpupid field of a slow memory page has
+ * no task to track and holds the time, in ms, its PTE was last made
+ * PROT_NONE by the NUMA scanner. With few bits, the lowest ones of the
+ * time are dropped to keep a usable range.
+ */
+#define PAGE_ACCESS_TIME_MIN_BITS	12
+#if LAST_CPUPID_SHIFT < PAGE_ACCESS_TIME_MIN_BITS
+#define PAGE_ACCESS_TIME_BUCKETS	(PAGE_ACCESS_TIME_MIN_BITS - LAST_CPUPID_SHIFT)
+#else
+#define PAGE_ACCESS_TIME_BUCKETS	0
+#endif
+
+#define PAGE_ACCESS_TIME_MASK	(LAST_CPUPID_MASK << PAGE_ACCESS_TIME_BUCKETS)
+
+static inline int xchg_page_access_time(struct page *page, int time)
+{
+	int last_time;
+
+	last_time = page_cpupid_xchg_last(page,
+					  time >> PAGE_ACCESS_TIME_BUCKETS);
+	return last_time << PAGE_ACCESS_TIME_BUCKETS;
+}
 #else /* !CONFIG_NUMA_BALANCING */
 static inline int page_cpupid_xchg_last(struct page *page, int cpupid)
 {
@@ -1066,6 +1187,11 @@ static inline int page_cpupid_last(struct page *page)
 	return page_to_nid(page); /* XXX */
 }
 
+static inline int xchg_page_access_time(struct page *page, int time)
+{
+	return 0;
+}
+
 static inline int cpupid_to_nid(int cpupid)
 {
 	return -1;
@@ -1338,6 +1464,9 @@ struct zap_details {
 	struct address_space *check_mapping;	/* Check page->mapping if set */
 	pgoff_t	first_index;			/* Lowest page->index to unmap */
 	pgoff_t last_index;			/* Highest page->index to unmap */
+	bool reclaim_pt;			/* Note the PTE tables zapped */
+	unsigned long pt_start;			/* First PTE table zapped */
+	unsigned long pt_end;			/* End of the last one */
 };
 
 struct page *_vm_normal_page(struct vm_area_struct *vma, unsigned long addr,
@@ -1349,6 +1478,8 @@ struct page *vm_normal_page_pmd(struct vm_area_struct *vma, unsigned long addr,
 
 void zap_vma_ptes(struct vm_area_struct *vma, unsigned long address,
 		  unsigned long size);
+void zap_page_range_single(struct vm_area_struct *vma, unsigned long address,
+			   unsigned long size, struct zap_details *details);
 void zap_page_range(struct vm_area_struct *vma, unsigned long address,
 		    unsigned long size);
 void unmap_vmas(struct mmu_gather *tlb, struct vm_area_struct *start_vma,
@@ -1588,9 +1719,26 @@ extern unsigned long move_page_tables(struct vm_area_struct *vma,
 		unsigned long old_addr, struct vm_area_struct *new_vma,
 		unsigned long new_addr, unsigned long len,
 		bool need_rmap_locks);
+
+/*
+ * Flags used by change_protection().  For now we make it a bitmap so
+ * that we can pass in multiple flags just like parameters.  However
+ * for now all the callers are only use one of the flags at the same
+ * time.
+ */
+/* Whether we should allow dirty bit accounting */
+#define  MM_CP_DIRTY_ACCT                  (1UL << 0)
+/* Whether this protection change is for NUMA hints */
+#define  MM_CP_PROT_NUMA                   (1UL << 1)
+/* Whether this change is for write protecting */
+#define  MM_CP_UFFD_WP                     (1UL << 2) /* do wp */
+#define  MM_CP_UFFD_WP_RESOLVE             (1UL << 3) /* Resolve wp */
+#define  MM_CP_UFFD_WP_ALL                 (MM_CP_UFFD_WP | \
+					    MM_CP_UFFD_WP_RESOLVE)
+
 extern unsigned long change_protection(struct vm_area_struct *vma, unsigned long start,
 			      unsigned long end, pgprot_t newprot,
-			      int dirty_accountable, int prot_numa);
+			      unsigned long cp_flags);
 extern int mprotect_fixup(struct vm_area_struct *vma,
 			  struct vm_area_struct **pprev, unsigned long start,
 			  unsigned long end, unsigned long newflags);
@@ -1931,6 +2079,9 @@ static inline bool pgtable_page_ctor(struct page *page)
 	if (!ptlock_init(page))
 		return false;
 	__SetPageTable(page);
+#ifdef CONFIG_FORK_SHARE_PTE
+	atomic_set(&page->pt_share_count, 0);
+#endif
 	inc_zone_page_state(page, NR_PAGETABLE);
 	return true;
 }
@@ -1966,6 +2117,46 @@ static inline void pgtable_page_dtor(struct page *page)
 	(pte_alloc(mm, pmd, address) ?			\
 		 NULL : pte_offset_map_lock(mm, pmd, address, ptlp))
 
+#ifdef CONFIG_FORK_SHARE_PTE
+/*
+ * A PTE table shared between processes since fork() is mapped read-only
+ * at the PMD level, and must be unshared before any of its entries is
+ * changed.
+ */
+static inline bool pmd_pte_shared(pmd_t pmd)
+{
+	return pmd_present(pmd) && !pmd_trans_huge(pmd) && !pmd_devmap(pmd) &&
+	       !pmd_write(pmd);
+}
+int unshare_pte_table(struct vm_area_struct *vma, unsigned long addr,
+		      pmd_t *pmd);
+int unshare_pte_tables(struct vm_area_struct *vma, unsigned long start,
+		       unsigned long end);
+int unshare_partial_pte_tables(struct vm_area_struct *vma,
+			       unsigned long start, unsigned long end);
+#else
+static inline bool pmd_pte_shared(pmd_t pmd)
+{
+	return false;
+}
+static inline int unshare_pte_table(struct vm_area_struct *vma,
+				    unsigned long addr, pmd_t *pmd)
+{
+	return 0;
+}
+static inline int unshare_pte_tables(struct vm_area_struct *vma,
+				     unsigned long start, unsigned long end)
+{
+	return 0;
+}
+static inline int unshare_partial_pte_tables(struct vm_area_struct *vma,
+					     unsigned long start,
+					     unsigned long end)
+{
+	return 0;
+}
+#endif
+
 #define pte_alloc_kernel(pmd, address)			\
 	((unlikely(pmd_none(*(pmd))) && __pte_alloc_kernel(pmd, address))? \
 		NULL: pte_offset_kernel(pmd, address))
@@ -2264,6 +2455,7 @@ extern int split_vma(struct mm_struct *, struct vm_area_struct *,
 extern int insert_vm_struct(struct mm_struct *, struct vm_area_struct *);
 extern void __vma_link_rb(struct mm_struct *, struct vm_area_struct *,
 	struct rb_node **, struct rb_node *);
+extern void vma_tree_reserve(struct mm_struct *);
 extern void unlink_file_vma(struct vm_area_struct *);
 extern struct vm_area_struct *copy_vma(struct vm_area_struct **,
 	unsigned long addr, unsigned long len, pgoff_t pgoff,
@@ -2318,6 +2510,8 @@ extern int __do_munmap(struct mm_struct *, unsigned long, size_t,
 		       struct list_head *uf, bool downgrade);
 extern int do_munmap(struct mm_struct *, unsigned long, size_t,
 		     struct list_head *uf);
+extern int do_madvise(struct mm_struct *mm, unsigned long start, size_t len_in,
+		      int behavior);
 
 static inline unsigned long
 do_mmap_pgoff(struct file *file, unsigned long addr,
@@ -2398,6 +2592,7 @@ void task_dirty_inc(struct task_struct *tsk);
 /* readahead.c */
 #define VM_MAX_READAHEAD	128	/* kbytes */
 #define VM_MIN_READAHEAD	16	/* kbytes (includes current page) */
+#define VM_MAX_ADAPT_READAHEAD	4096	/* kbytes */
 
 int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 			pgoff_t offset, unsigned long nr_to_read);
@@ -2683,6 +2878,12 @@ void vmemmap_free(unsigned long start, unsigned long end,
 #endif
 void register_page_bootmem_memmap(unsigned long section_nr, struct page *map,
 				  unsigned long nr_pages);
+#ifdef CONFIG_HUGETLB_PAGE_FREE_VMEMMAP
+int vmemmap_remap_free(unsigned long start, unsigned long end,
+		       unsigned long reuse);
+int vmemmap_remap_alloc(unsigned long start, unsigned long end,
+			unsigned long reuse, gfp_t gfp_mask);
+#endif
 
 enum mf_flags {
 	MF_COUNT_INCREASED = 1 << 0,
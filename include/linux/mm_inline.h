@@ -4,6 +4,7 @@
 
 #include <linux/huge_mm.h>
 #include <linux/swap.h>
+#include <linux/jump_label.h>
 
 /**
  * page_is_file_cache - should the page be on a file LRU or anon LRU?
@@ -29,7 +30,7 @@ static __always_inline void __update_lru_size(struct lruvec *lruvec,
 {
 	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
 
-	__mod_node_page_state(pgdat, NR_LRU_BASE + lru, nr_pages);
+	__mod_lruvec_state(lruvec, NR_LRU_BASE + lru, nr_pages);
 	__mod_zone_page_state(&pgdat->node_zones[zid],
 				NR_ZONE_LRU_BASE + lru, nr_pages);
 }
@@ -44,9 +45,189 @@ static __always_inline void update_lru_size(struct lruvec *lruvec,
 #endif
 }
 
+#ifdef CONFIG_LRU_GEN
+
+#ifdef CONFIG_LRU_GEN_ENABLED
+DECLARE_STATIC_KEY_TRUE(lru_gen_key);
+#else
+DECLARE_STATIC_KEY_FALSE(lru_gen_key);
+#endif
+
+static inline bool lru_gen_enabled(void)
+{
+	return static_branch_unlikely(&lru_gen_key);
+}
+
+/* Whether the evictable pages of @lruvec are on the generation lists */
+static inline bool lru_gen_lruvec(struct lruvec *lruvec)
+{
+	return READ_ONCE(lruvec->lrugen.enabled);
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/* Returns the generation @page is on, or -1 if it is not on a gen list */
+static inline int page_lru_gen(struct page *page)
+{
+	unsigned long flags = READ_ONCE(page->flags);
+
+	return ((flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+/* The two youngest generations are accounted as the active lists */
+static inline bool lru_gen_is_active(struct lruvec *lruvec, int gen)
+{
+	unsigned long max_seq = lruvec->lrugen.max_seq;
+
+	return gen == lru_gen_from_seq(max_seq) ||
+	       gen == lru_gen_from_seq(max_seq - 1);
+}
+
+static inline void lru_gen_update_size(struct lruvec *lruvec, struct page *page,
+				       int old_gen, int new_gen)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	int zid = page_zonenum(page);
+	int delta = hpage_nr_pages(page);
+	enum lru_list lru = type * LRU_FILE;
+
+	if (old_gen >= 0)
+		lrugen->nr_pages[old_gen][type][zid] -= delta;
+	if (new_gen >= 0)
+		lrugen->nr_pages[new_gen][type][zid] += delta;
+
+	if (old_gen < 0) {
+		if (lru_gen_is_active(lruvec, new_gen))
+			lru += LRU_ACTIVE;
+		update_lru_size(lruvec, lru, zid, delta);
+	} else if (new_gen < 0) {
+		if (lru_gen_is_active(lruvec, old_gen))
+			lru += LRU_ACTIVE;
+		update_lru_size(lruvec, lru, zid, -delta);
+	} else if (!lru_gen_is_active(lruvec, old_gen) &&
+		   lru_gen_is_active(lruvec, new_gen)) {
+		update_lru_size(lruvec, lru, zid, -delta);
+		update_lru_size(lruvec, lru + LRU_ACTIVE, zid, delta);
+	} else {
+		/* Pages only move to younger generations while on the lists */
+		VM_WARN_ON_ONCE(lru_gen_is_active(lruvec, old_gen) &&
+				!lru_gen_is_active(lruvec, new_gen));
+	}
+}
+
+/*
+ * Put @page on a generation list of @lruvec instead of lruvec->lists[].
+ * PG_active only says which generation a page goes to; while it is on
+ * the list, the generation stands in for it:
+ *
+ * 1. Active pages, e.g. freshly faulted in, activated or refaulting in
+ *    the workingset, go to the youngest generation.
+ * 2. Pages that cannot be evicted right away, i.e. anon pages without
+ *    swap space allocated and dirty pages pending writeback, go to the
+ *    second youngest one.
+ * 3. Pages to be evicted first, e.g. clean pages from
+ *    rotate_reclaimable_page(), go to the oldest one.
+ * 4. Everything else, e.g. from deactivate_file_page() or put back by
+ *    reclaim, goes to the second oldest one.
+ */
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page,
+				    bool tail)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	unsigned long seq;
+	int gen;
+
+	if (PageUnevictable(page) || !lrugen->enabled)
+		return false;
+
+	VM_BUG_ON_PAGE(page_lru_gen(page) >= 0, page);
+
+	if (PageActive(page))
+		seq = lrugen->max_seq;
+	else if ((!type && !PageSwapCache(page)) ||
+		 (PageReclaim(page) &&
+		  (PageDirty(page) || PageWriteback(page))))
+		seq = lrugen->max_seq - 1;
+	else if (tail || lrugen->min_seq[type] + MIN_NR_GENS >= lrugen->max_seq)
+		seq = lrugen->min_seq[type];
+	else
+		seq = lrugen->min_seq[type] + 1;
+
+	gen = lru_gen_from_seq(seq);
+	set_mask_bits(&page->flags, LRU_GEN_MASK | BIT(PG_active),
+		      (gen + 1UL) << LRU_GEN_PGOFF);
+	lru_gen_update_size(lruvec, page, -1, gen);
+	if (tail)
+		list_add_tail(&page->lru, &lrugen->lists[gen][type]);
+	else
+		list_add(&page->lru, &lrugen->lists[gen][type]);
+
+	return true;
+}
+
+/*
+ * Take @page off its generation list. Unless it is isolated for reclaim,
+ * PG_active is set again for a page of an active generation, so that
+ * page_lru() stays right for the callers that put it back.
+ */
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page,
+				    bool reclaiming)
+{
+	unsigned long flags;
+	int gen = page_lru_gen(page);
+
+	if (gen < 0)
+		return false;
+
+	VM_BUG_ON_PAGE(PageActive(page), page);
+	VM_BUG_ON_PAGE(PageUnevictable(page), page);
+
+	flags = !reclaiming && lru_gen_is_active(lruvec, gen) ?
+		BIT(PG_active) : 0;
+	set_mask_bits(&page->flags, LRU_GEN_MASK, flags);
+	lru_gen_update_size(lruvec, page, gen, -1);
+	list_del(&page->lru);
+
+	return true;
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline bool lru_gen_lruvec(struct lruvec *lruvec)
+{
+	return false;
+}
+
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page,
+				    bool tail)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page,
+				    bool reclaiming)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static __always_inline void add_page_to_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_add_page(lruvec, page, false))
+		return;
+
 	update_lru_size(lruvec, lru, page_zonenum(page), hpage_nr_pages(page));
 	list_add(&page->lru, &lruvec->lists[lru]);
 }
@@ -54,6 +235,9 @@ static __always_inline void add_page_to_lru_list(struct page *page,
 static __always_inline void add_page_to_lru_list_tail(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_add_page(lruvec, page, true))
+		return;
+
 	update_lru_size(lruvec, lru, page_zonenum(page), hpage_nr_pages(page));
 	list_add_tail(&page->lru, &lruvec->lists[lru]);
 }
@@ -61,6 +245,9 @@ static __always_inline void add_page_to_lru_list_tail(struct page *page,
 static __always_inline void del_page_from_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_del_page(lruvec, page, false))
+		return;
+
 	list_del(&page->lru);
 	update_lru_size(lruvec, lru, page_zonenum(page), -hpage_nr_pages(page));
 }
@@ -8,6 +8,7 @@
 #include <linux/list.h>
 #include <linux/spinlock.h>
 #include <linux/rbtree.h>
+#include <linux/range_tree.h>
 #include <linux/rwsem.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
@@ -26,6 +27,7 @@ typedef int vm_fault_t;
 
 struct address_space;
 struct mem_cgroup;
+struct obj_cgroup;
 struct hmm;
 
 /*
@@ -80,7 +82,7 @@ struct page {
 		struct {	/* Page cache and anonymous pages */
 			/**
 			 * @lru: Pageout list, eg. active_list protected by
-			 * zone_lru_lock.  Sometimes used as a generic list
+			 * lruvec->lru_lock.  Sometimes used as a generic list
 			 * by the page owner.
 			 */
 			struct list_head lru;
@@ -122,6 +124,16 @@ struct page {
 				};
 			};
 		};
+		struct {	/* page_pool used by netstack */
+			/**
+			 * @pp_magic: magic value to avoid recycling non
+			 * page_pool allocated pages.
+			 */
+			unsigned long pp_magic;
+			struct page_pool *pp;
+			unsigned long _pp_mapping_pad;
+			/* DMA address stays in @private */
+		};
 		struct {	/* Tail pages of compound page */
 			unsigned long compound_head;	/* Bit zero is set */
 
@@ -142,6 +154,7 @@ struct page {
 			union {
 				struct mm_struct *pt_mm; /* x86 pgds only */
 				atomic_t pt_frag_refcount; /* powerpc */
+				atomic_t pt_share_count; /* x86 pte tables */
 			};
 #if ALLOC_SPLIT_PTLOCKS
 			spinlock_t *ptl;
@@ -183,7 +196,14 @@ struct page {
 	atomic_t _refcount;
 
 #ifdef CONFIG_MEMCG
-	struct mem_cgroup *mem_cgroup;
+	union {
+		struct mem_cgroup *mem_cgroup;
+		/*
+		 * Slab pages: one obj_cgroup per object, tagged with
+		 * bit 0 so it can't be mistaken for a mem_cgroup.
+		 */
+		struct obj_cgroup **obj_cgroups;
+	};
 #endif
 
 	/*
@@ -328,6 +348,16 @@ struct vm_area_struct {
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
 	struct vm_userfaultfd_ctx vm_userfaultfd_ctx;
+#ifdef CONFIG_PER_VMA_LOCK
+	/* Taken by page faults that do not hold mmap_sem, see mm.h */
+	struct rw_semaphore vm_lock;
+	/* Write-locked while equal to vm_mm->mm_lock_seq */
+	int vm_lock_seq;
+	/* Set once the VMA is removed from the mm's tree */
+	bool vm_detached;
+	/* VMAs are freed after a grace period for lockless lookups */
+	struct rcu_head vm_rcu;
+#endif
 } __randomize_layout;
 
 struct core_thread {
@@ -346,6 +376,7 @@ struct mm_struct {
 	struct {
 		struct vm_area_struct *mmap;		/* list of VMAs */
 		struct rb_root mm_rb;
+		struct range_tree vma_tree;	/* VMAs by vm_end, RCU safe */
 		u64 vmacache_seqnum;                   /* per-thread vmacache */
 #ifdef CONFIG_MMU
 		unsigned long (*get_unmapped_area) (struct file *filp,
@@ -392,6 +423,13 @@ struct mm_struct {
 					     * counters
 					     */
 		struct rw_semaphore mmap_sem;
+#ifdef CONFIG_PER_VMA_LOCK
+		/*
+		 * Bumped under mmap_sem to release all VMAs write-locked
+		 * with vma_write_lock() at once.
+		 */
+		int mm_lock_seq;
+#endif
 
 		struct list_head mmlist; /* List of maybe swapped mm's.	These
 					  * are globally strung together off
@@ -495,18 +533,61 @@ struct mm_struct {
 #if IS_ENABLED(CONFIG_HMM)
 		/* HMM needs to track a few things per mm */
 		struct hmm *hmm;
+#endif
+#ifdef CONFIG_SCHED_MM_CID
+		/* Protects the concurrency ID mask, see mm_cidmask() */
+		raw_spinlock_t cid_lock;
+#endif
+#ifdef CONFIG_LRU_GEN
+		struct {
+			/* On the mm list walked by the multi-gen LRU aging */
+			struct list_head list;
+#ifdef CONFIG_MEMCG
+			/* The memcg of "owner" whose list this is on */
+			struct mem_cgroup *memcg;
+#endif
+		} lru_gen;
 #endif
 	} __randomize_layout;
 
 	/*
 	 * The mm_cpumask needs to be at the end of mm_struct, because it
-	 * is dynamically sized based on nr_cpu_ids.
+	 * is dynamically sized based on nr_cpu_ids. With
+	 * CONFIG_SCHED_MM_CID it is followed by the mm_cidmask, of the
+	 * same size.
 	 */
 	unsigned long cpu_bitmap[];
 };
 
 extern struct mm_struct init_mm;
 
+#ifdef CONFIG_LRU_GEN
+void lru_gen_init_mm(struct mm_struct *mm);
+void lru_gen_add_mm(struct mm_struct *mm);
+void lru_gen_del_mm(struct mm_struct *mm);
+#ifdef CONFIG_MEMCG
+void lru_gen_migrate_mm(struct mm_struct *mm);
+#endif
+#else
+static inline void lru_gen_init_mm(struct mm_struct *mm)
+{
+}
+
+static inline void lru_gen_add_mm(struct mm_struct *mm)
+{
+}
+
+static inline void lru_gen_del_mm(struct mm_struct *mm)
+{
+}
+#endif
+
+#if !defined(CONFIG_LRU_GEN) || !defined(CONFIG_MEMCG)
+static inline void lru_gen_migrate_mm(struct mm_struct *mm)
+{
+}
+#endif
+
 /* Pointer magic because the dynamic array size confuses some compilers. */
 static inline void mm_init_cpumask(struct mm_struct *mm)
 {
@@ -522,6 +603,39 @@ static inline cpumask_t *mm_cpumask(struct mm_struct *mm)
 	return (struct cpumask *)&mm->cpu_bitmap;
 }
 
+#ifdef CONFIG_SCHED_MM_CID
+/*
+ * The concurrency IDs in use by the threads of the mm that are running
+ * right now, allocated at context switch.
+ */
+static inline cpumask_t *mm_cidmask(struct mm_struct *mm)
+{
+	unsigned long cid_bitmap = (unsigned long)mm;
+
+	cid_bitmap += offsetof(struct mm_struct, cpu_bitmap);
+	/* Skip cpu_bitmap */
+	cid_bitmap += cpumask_size();
+	return (struct cpumask *)cid_bitmap;
+}
+
+static inline void mm_init_cid(struct mm_struct *mm)
+{
+	raw_spin_lock_init(&mm->cid_lock);
+	cpumask_clear(mm_cidmask(mm));
+}
+
+static inline unsigned int mm_cid_size(void)
+{
+	return cpumask_size();
+}
+#else
+static inline void mm_init_cid(struct mm_struct *mm) { }
+static inline unsigned int mm_cid_size(void)
+{
+	return 0;
+}
+#endif
+
 struct mmu_gather;
 extern void tlb_gather_mmu(struct mmu_gather *tlb, struct mm_struct *mm,
 				unsigned long start, unsigned long end);
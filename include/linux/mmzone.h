@@ -3,9 +3,18 @@
 #define _LINUX_MMZONE_H
 
 #ifndef __ASSEMBLY__
+
+/*
+ * Generations of the multi-gen LRU, see lru_gen_add_page(). The two
+ * youngest ones stand in for the active lists and are never evicted from.
+ */
+#define MIN_NR_GENS		2U
+#define MAX_NR_GENS		4U
+
 #ifndef __GENERATING_BOUNDS_H
 
 #include <linux/spinlock.h>
+#include <linux/mutex.h>
 #include <linux/list.h>
 #include <linux/wait.h>
 #include <linux/bitops.h>
@@ -101,10 +110,10 @@ struct free_area {
 struct pglist_data;
 
 /*
- * zone->lock and the zone lru_lock are two of the hottest locks in the kernel.
- * So add a wild amount of padding here to ensure that they fall into separate
- * cachelines.  There are very few zone structures in the machine, so space
- * consumption is not a concern here.
+ * zone->lock and the lru_lock of the node lruvec are two of the hottest locks
+ * in the kernel.  So add a wild amount of padding here to ensure that they
+ * fall into separate cachelines.  There are very few zone structures in the
+ * machine, so space consumption is not a concern here.
  */
 #if defined(CONFIG_SMP)
 struct zone_padding {
@@ -176,6 +185,7 @@ enum node_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_SHMEM_THPS,
 	NR_SHMEM_PMDMAPPED,
+	NR_FILE_THPS,
 	NR_ANON_THPS,
 	NR_UNSTABLE_NFS,	/* NFS unstable pages */
 	NR_VMSCAN_WRITE,
@@ -235,13 +245,54 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#define ANON_AND_FILE 2
+
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-gen LRU keeps the evictable pages of a lruvec on per-generation
+ * lists instead of lruvec->lists[]. Generations are numbered by sequence,
+ * min_seq[] is the oldest one of each type that still has pages and max_seq
+ * the youngest; a page's generation, seq % MAX_NR_GENS, is stored in its
+ * flags. Eviction takes the oldest generation, the aging opens a new one
+ * after moving the pages found young in the page tables to the youngest.
+ *
+ * The lists and counters are protected by the lru_lock of the lruvec.
+ */
+struct lru_gen_struct {
+	unsigned long max_seq;
+	unsigned long min_seq[ANON_AND_FILE];
+	struct list_head lists[MAX_NR_GENS][ANON_AND_FILE];
+	/* Pages in each generation, by zone for the active/inactive sizes */
+	long nr_pages[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* Whether pages are added to the lists above */
+	bool enabled;
+	/* Serializes the aging of this lruvec */
+	struct mutex aging_mutex;
+	/* Time of the last page table walk, in jiffies */
+	unsigned long walk_timestamp;
+	/* Next mm to walk on the mm list, protected by the list lock */
+	struct list_head *mm_iter;
+};
+
+/* The mm_structs of a memcg, or of all tasks without CONFIG_MEMCG */
+struct lru_gen_mm_list {
+	struct list_head fifo;
+	spinlock_t lock;
+};
+#endif
+
 struct lruvec {
 	struct list_head		lists[NR_LRU_LISTS];
+	/* Protects the lists, and the LRU state of the pages on them */
+	spinlock_t			lru_lock;
 	struct zone_reclaim_stat	reclaim_stat;
 	/* Evictions & activations on the inactive file list */
 	atomic_long_t			inactive_age;
 	/* Refaults at the time of last reclaim cycle */
 	unsigned long			refaults;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct		lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct pglist_data *pgdat;
 #endif
@@ -273,13 +324,19 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * The pcp lists cache pages up to PAGE_ALLOC_COSTLY_ORDER, one list per
+ * migrate type and order.
+ */
+#define NR_PCP_LISTS	(MIGRATE_PCPTYPES * (PAGE_ALLOC_COSTLY_ORDER + 1))
+
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/* Lists of pages, one per migrate type and order on the pcp-lists */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
 struct per_cpu_pageset {
@@ -681,9 +738,14 @@ typedef struct pglist_data {
 	unsigned long		min_slab_pages;
 #endif /* CONFIG_NUMA */
 
+#ifdef CONFIG_NUMA_BALANCING
+	/* Rate limiting of the promotions to this node, per second */
+	unsigned int		nbp_rl_start;
+	atomic_long_t		nbp_rl_nr_cand;
+#endif
+
 	/* Write-intensive fields used by page reclaim */
 	ZONE_PADDING(_pad1_)
-	spinlock_t		lru_lock;
 
 #ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
 	/*
@@ -724,11 +786,6 @@ typedef struct pglist_data {
 
 #define node_start_pfn(nid)	(NODE_DATA(nid)->node_start_pfn)
 #define node_end_pfn(nid) pgdat_end_pfn(NODE_DATA(nid))
-static inline spinlock_t *zone_lru_lock(struct zone *zone)
-{
-	return &zone->zone_pgdat->lru_lock;
-}
-
 static inline struct lruvec *node_lruvec(struct pglist_data *pgdat)
 {
 	return &pgdat->lruvec;
@@ -765,6 +822,13 @@ extern void init_currently_empty_zone(struct zone *zone, unsigned long start_pfn
 				     unsigned long size);
 
 extern void lruvec_init(struct lruvec *lruvec);
+#ifdef CONFIG_LRU_GEN
+extern void lru_gen_init_lruvec(struct lruvec *lruvec);
+#else
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+#endif
 
 static inline struct pglist_data *lruvec_pgdat(struct lruvec *lruvec)
 {
@@ -897,6 +961,8 @@ int lowmem_reserve_ratio_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
 int percpu_pagelist_fraction_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
+int percpu_pagelist_high_order_sysctl_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
 int sysctl_min_unmapped_ratio_sysctl_handler(struct ctl_table *, int,
 			void __user *, size_t *, loff_t *);
 int sysctl_min_slab_ratio_sysctl_handler(struct ctl_table *, int,
@@ -29,6 +29,7 @@ enum mapping_flags {
 	AS_EXITING	= 4, 	/* final truncate in progress */
 	/* writeback related tags are not used */
 	AS_NO_WRITEBACK_TAGS = 5,
+	AS_LARGE_PAGES	= 6,	/* readahead may add huge pages */
 };
 
 /**
@@ -97,6 +98,55 @@ static inline int mapping_use_writeback_tags(struct address_space *mapping)
 	return !test_bit(AS_NO_WRITEBACK_TAGS, &mapping->flags);
 }
 
+/*
+ * Filesystems whose ->readpage(s) can fill a huge page set this on regular
+ * files. Readahead only adds huge pages while the file is not open for
+ * writing; a write splits the huge page it lands in, see
+ * filemap_split_large_page().
+ */
+static inline void mapping_set_large_pages(struct address_space *mapping)
+{
+	if (IS_ENABLED(CONFIG_FILE_LARGE_PAGES))
+		set_bit(AS_LARGE_PAGES, &mapping->flags);
+}
+
+static inline bool mapping_large_pages(struct address_space *mapping)
+{
+	return IS_ENABLED(CONFIG_FILE_LARGE_PAGES) &&
+		test_bit(AS_LARGE_PAGES, &mapping->flags);
+}
+
+static inline unsigned long filemap_nr_thps(struct address_space *mapping)
+{
+#ifdef CONFIG_FILE_LARGE_PAGES
+	return READ_ONCE(mapping->nrthps);
+#else
+	return 0;
+#endif
+}
+
+static inline void filemap_nr_thps_add(struct address_space *mapping, int nr)
+{
+#ifdef CONFIG_FILE_LARGE_PAGES
+	mapping->nrthps += nr;
+#endif
+}
+
+#ifdef CONFIG_FILE_LARGE_PAGES
+int filemap_split_large_page(struct page *page);
+void filemap_drop_large_pages(struct address_space *mapping,
+			      pgoff_t start, pgoff_t end);
+#else
+static inline int filemap_split_large_page(struct page *page)
+{
+	return 0;
+}
+static inline void filemap_drop_large_pages(struct address_space *mapping,
+					    pgoff_t start, pgoff_t end)
+{
+}
+#endif
+
 static inline gfp_t mapping_gfp_mask(struct address_space * mapping)
 {
 	return mapping->gfp_mask;
@@ -221,14 +271,20 @@ static inline int page_cache_add_speculative(struct page *page, int count)
 }
 
 #ifdef CONFIG_NUMA
-extern struct page *__page_cache_alloc(gfp_t gfp);
+extern struct page *__page_cache_alloc_order(gfp_t gfp, unsigned int order);
 #else
-static inline struct page *__page_cache_alloc(gfp_t gfp)
+static inline struct page *__page_cache_alloc_order(gfp_t gfp,
+						    unsigned int order)
 {
-	return alloc_pages(gfp, 0);
+	return alloc_pages(gfp, order);
 }
 #endif
 
+static inline struct page *__page_cache_alloc(gfp_t gfp)
+{
+	return __page_cache_alloc_order(gfp, 0);
+}
+
 static inline struct page *page_cache_alloc(struct address_space *x)
 {
 	return __page_cache_alloc(mapping_gfp_mask(x));
@@ -89,4 +89,8 @@
 /********** security/ **********/
 #define KEY_DESTROY		0xbd
 
+/********** net/core/page_pool.c **********/
+/* Bit 0 must stay clear, the word overlays page->compound_head */
+#define PP_SIGNATURE		(0x40 + POISON_POINTER_DELTA)
+
 #endif
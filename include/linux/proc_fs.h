@@ -18,6 +18,7 @@ typedef int (*proc_write_t)(struct file *, char *, size_t);
 
 extern void proc_root_init(void);
 extern void proc_flush_task(struct task_struct *);
+extern struct pid *tgid_pidfd_to_pid(const struct file *file);
 
 extern struct proc_dir_entry *proc_symlink(const char *,
 		struct proc_dir_entry *, const char *);
@@ -84,6 +85,11 @@ static inline void proc_flush_task(struct task_struct *task)
 {
 }
 
+static inline struct pid *tgid_pidfd_to_pid(const struct file *file)
+{
+	return ERR_PTR(-EBADF);
+}
+
 static inline struct proc_dir_entry *proc_symlink(const char *name,
 		struct proc_dir_entry *parent,const char *dest) { return NULL;}
 static inline struct proc_dir_entry *proc_mkdir(const char *name,
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Range tree: a B+tree of non-overlapping ranges, indexed by range end.
+ *
+ * range_tree_find() returns the first range ending above an address, which
+ * is what find_vma() needs. Lookups are lockless and may run under
+ * rcu_read_lock() concurrently with a writer; they can then miss a range
+ * that is being moved around, but never walk freed memory. Writers must be
+ * serialized by the caller.
+ *
+ * The caller can also record the size of the free gap before each range,
+ * and look for the lowest or highest range with a large enough gap, the
+ * way get_unmapped_area() does; that takes the writer lock.
+ */
+#ifndef _LINUX_RANGE_TREE_H
+#define _LINUX_RANGE_TREE_H
+
+#include <linux/types.h>
+
+struct range_tree_node;
+
+struct range_tree {
+	struct range_tree_node __rcu *root;
+	struct range_tree_node *reserve;	/* preallocated nodes */
+	unsigned int nr_reserve;
+	unsigned int height;
+};
+
+#define RANGE_TREE_INIT { .root = NULL }
+
+static inline void range_tree_init(struct range_tree *rt)
+{
+	*rt = (struct range_tree)RANGE_TREE_INIT;
+}
+
+void *range_tree_find(struct range_tree *rt, unsigned long addr);
+int range_tree_reserve(struct range_tree *rt, gfp_t gfp);
+int range_tree_insert(struct range_tree *rt, unsigned long end, void *entry,
+		      gfp_t gfp);
+void *range_tree_erase(struct range_tree *rt, unsigned long end);
+void range_tree_update(struct range_tree *rt, unsigned long old_end,
+		       unsigned long new_end);
+void range_tree_set_gap(struct range_tree *rt, unsigned long end,
+			unsigned long gap);
+void *range_tree_gap_first(struct range_tree *rt, unsigned long gap,
+			   unsigned long min_end);
+void *range_tree_gap_last(struct range_tree *rt, unsigned long gap,
+			  unsigned long max_end);
+void range_tree_destroy(struct range_tree *rt);
+void range_tree_init_cache(void);
+
+#endif /* _LINUX_RANGE_TREE_H */
@@ -97,6 +97,25 @@ __ring_buffer_alloc(unsigned long size, unsigned flags, struct lock_class_key *k
 	__ring_buffer_alloc((size), (flags), &__key);	\
 })
 
+struct ring_buffer *
+__ring_buffer_alloc_range(unsigned long size, unsigned flags,
+			  unsigned long start, unsigned long range_size,
+			  struct lock_class_key *key);
+
+/*
+ * Allocate a ring buffer on a memory range, which may hold the events of
+ * the previous boot.
+ */
+#define ring_buffer_alloc_range(size, flags, start, range_size)	\
+({									\
+	static struct lock_class_key __key;				\
+	__ring_buffer_alloc_range((size), (flags), (start),		\
+				  (range_size), &__key);		\
+})
+
+bool ring_buffer_last_boot_delta(struct ring_buffer *buffer, long *text);
+void ring_buffer_last_boot_clear(struct ring_buffer *buffer);
+
 int ring_buffer_wait(struct ring_buffer *buffer, int cpu, bool full);
 __poll_t ring_buffer_poll_wait(struct ring_buffer *buffer, int cpu,
 			  struct file *filp, poll_table *poll_table);
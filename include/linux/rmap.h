@@ -241,7 +241,12 @@ int page_mkclean(struct page *);
  */
 void try_to_munlock(struct page *);
 
-void remove_migration_ptes(struct page *old, struct page *new, bool locked);
+enum rmp_flags {
+	RMP_LOCKED		= 1 << 0,
+	RMP_USE_SHARED_ZEROPAGE	= 1 << 1,
+};
+
+void remove_migration_ptes(struct page *old, struct page *new, int flags);
 
 /*
  * Called by memory-failure.c to kill processes.
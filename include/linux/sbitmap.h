@@ -406,6 +406,23 @@ int __sbitmap_queue_get(struct sbitmap_queue *sbq);
 int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 				unsigned int shallow_depth);
 
+/**
+ * __sbitmap_queue_get_batch() - Try to allocate a batch of free bits from a
+ * &struct sbitmap_queue with preemption already disabled.
+ * @sbq: Bitmap queue to allocate from.
+ * @nr_bits: Number of bits to try to allocate, at most BITS_PER_LONG.
+ * @offset: Output parameter; bit number of the first bit in the returned mask.
+ *
+ * All the bits are taken from a single word with one atomic operation, so
+ * fewer than @nr_bits may be returned. The caller owns bit @offset + i for
+ * each bit i set in the returned mask.
+ *
+ * Return: Mask of allocated bits relative to @offset, 0 if none were found.
+ */
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq,
+					unsigned int nr_bits,
+					unsigned int *offset);
+
 /**
  * sbitmap_queue_get() - Try to allocate a free bit from a &struct
  * sbitmap_queue.
@@ -479,6 +496,20 @@ void sbitmap_queue_min_shallow_depth(struct sbitmap_queue *sbq,
 void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 			 unsigned int cpu);
 
+/**
+ * sbitmap_queue_clear_batch() - Free a batch of allocated bits and wake up
+ * waiters on a &struct sbitmap_queue.
+ * @sbq: Bitmap to free from.
+ * @offset: Value to subtract from each entry of @bits to get the bit number.
+ * @bits: Bit numbers to free, plus @offset.
+ * @nr_bits: Number of entries in @bits.
+ *
+ * Bits that share a word are cleared with a single atomic operation, so
+ * callers should keep @bits sorted where they can.
+ */
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
+			       const int *bits, int nr_bits);
+
 static inline int sbq_index_inc(int index)
 {
 	return (index + 1) & (SBQ_WAIT_QUEUES - 1);
@@ -71,9 +71,13 @@ static inline int get_dumpable(struct mm_struct *mm)
 #define MMF_HUGE_ZERO_PAGE	23      /* mm has ever used the global huge zero page */
 #define MMF_DISABLE_THP		24	/* disable THP for all VMAs */
 #define MMF_OOM_VICTIM		25	/* mm is the oom victim */
+#define MMF_NO_VMA_TREE		26	/* vma_tree failed, find_vma() uses mm_rb */
+#define MMF_VM_MERGE_ANY	27	/* KSM may merge all anonymous memory */
+#define MMF_FORK_SHARE_PTE	28	/* fork() shares anon PTE tables */
 #define MMF_DISABLE_THP_MASK	(1 << MMF_DISABLE_THP)
+#define MMF_VM_MERGE_ANY_MASK	(1 << MMF_VM_MERGE_ANY)
 
 #define MMF_INIT_MASK		(MMF_DUMPABLE_MASK | MMF_DUMP_FILTER_MASK |\
-				 MMF_DISABLE_THP_MASK)
+				 MMF_DISABLE_THP_MASK | MMF_VM_MERGE_ANY_MASK)
 
 #endif /* _LINUX_SCHED_COREDUMP_H */
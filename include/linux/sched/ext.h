@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_SCHED_EXT_H
+#define _LINUX_SCHED_EXT_H
+
+/*
+ * sched_ext: a scheduling class, between the fair and the idle ones, whose
+ * policy is supplied by a loadable scheduler through struct sched_ext_ops.
+ *
+ * Tasks are queued on dispatch queues (DSQs). Every CPU runs the tasks of
+ * its local DSQ in order; the scheduler moves tasks there either from its
+ * ops.enqueue() callback or by consuming the global DSQ or a DSQ of its own
+ * from ops.dispatch(). Should the scheduler misbehave or let a runnable
+ * task wait for longer than its timeout, it is unloaded and all its tasks
+ * go back to the fair class.
+ */
+
+#include <linux/list.h>
+#include <linux/spinlock_types.h>
+#include <linux/types.h>
+
+#ifdef CONFIG_SCHED_EXT
+
+struct task_struct;
+
+#define SCX_OPS_NAME_LEN	128
+
+/* Default time slice, in ns */
+#define SCX_SLICE_DFL		(20 * NSEC_PER_MSEC)
+
+/* Timeout of the stall watchdog, in ms */
+#define SCX_WATCHDOG_MAX_TIMEOUT	(30 * MSEC_PER_SEC)
+
+/*
+ * Built-in DSQ ids have the top bit set, scheduler created DSQs must not.
+ */
+#define SCX_DSQ_FLAG_BUILTIN	(1ULL << 63)
+#define SCX_DSQ_GLOBAL		(SCX_DSQ_FLAG_BUILTIN | 1)
+#define SCX_DSQ_LOCAL		(SCX_DSQ_FLAG_BUILTIN | 2)
+
+/* scx_create_dsq() flags */
+#define SCX_DSQ_VTIME		0x1	/* ordered by vtime instead of FIFO */
+
+/* ops.enqueue() and scx_dispatch() flags */
+#define SCX_ENQ_WAKEUP		0x1	/* the task just woke up */
+#define SCX_ENQ_HEAD		0x2	/* queue at the head of the DSQ */
+#define SCX_ENQ_PREEMPT		0x4	/* preempt the current task */
+#define SCX_ENQ_REQUEUE		0x8	/* the task was preempted or ran out of slice */
+
+/* ops.dequeue() flags */
+#define SCX_DEQ_SLEEP		0x1	/* the task is going to sleep */
+
+/* sched_ext_ops.flags */
+#define SCX_OPS_SWITCH_ALL	0x1	/* also take SCHED_NORMAL/BATCH/IDLE tasks */
+
+struct scx_dispatch_q {
+	raw_spinlock_t		lock;
+	struct list_head	list;
+	u32			nr;
+	u32			flags;
+	u64			id;
+	struct hlist_node	hash_node;
+	struct rcu_head		rcu;
+};
+
+/* p->scx.flags */
+#define SCX_TASK_QUEUED		0x1	/* between enqueue and dequeue */
+#define SCX_TASK_RUNNING	0x2	/* picked and not yet put */
+#define SCX_TASK_MOVING		0x4	/* being moved to a consuming CPU */
+
+/*
+ * The sched_ext part of the task_struct. Fields are protected by the rq
+ * lock of the task, and the list node also by the lock of @dsq.
+ */
+struct sched_ext_entity {
+	struct scx_dispatch_q	*dsq;
+	struct list_head	dsq_node;
+	struct list_head	runnable_node;	/* rq->scx.runnable_list */
+	unsigned long		runnable_at;	/* jiffies, for the watchdog */
+	u64			slice;		/* time slice left, in ns */
+	u64			dsq_vtime;	/* order in a SCX_DSQ_VTIME DSQ */
+	u32			flags;
+	int			holding_cpu;	/* CPU moving it off a DSQ */
+};
+
+/**
+ * struct sched_ext_ops - Operations of a sched_ext scheduler
+ * @select_cpu:	Pick the CPU a waking task is queued on. Optional, the
+ *		default picks an idle CPU sharing the LLC with @prev_cpu.
+ * @enqueue:	A task became runnable on its CPU. Must put it on a DSQ with
+ *		scx_dispatch() or scx_dispatch_vtime(); without it, the task
+ *		goes on the global DSQ.
+ * @dequeue:	A task queued with @enqueue is no longer runnable, or moves.
+ * @dispatch:	@cpu has nothing left in its local DSQ, nor does the global
+ *		DSQ have anything it may run; call scx_consume() to feed it.
+ * @running:	A task starts running on its CPU.
+ * @stopping:	A task stops running; @runnable says whether it is still.
+ * @init:	Called when the scheduler is loaded, may sleep.
+ * @exit:	Called when the scheduler is unloaded, may sleep.
+ * @flags:	SCX_OPS_* flags.
+ * @timeout_ms:	How long a runnable task may wait before the scheduler is
+ *		considered stalled and unloaded, up to and by default
+ *		SCX_WATCHDOG_MAX_TIMEOUT.
+ * @name:	Name of the scheduler, for reporting.
+ *
+ * @select_cpu runs with the pi_lock of @p held, @init and @exit may sleep,
+ * and the other callbacks run with the rq lock of @p, or of @cpu, held.
+ * The module providing the callbacks must unregister them before going.
+ */
+struct sched_ext_ops {
+	s32 (*select_cpu)(struct task_struct *p, s32 prev_cpu, u64 wake_flags);
+	void (*enqueue)(struct task_struct *p, u64 enq_flags);
+	void (*dequeue)(struct task_struct *p, u64 deq_flags);
+	void (*dispatch)(s32 cpu, struct task_struct *prev);
+	void (*running)(struct task_struct *p);
+	void (*stopping)(struct task_struct *p, bool runnable);
+	int (*init)(void);
+	void (*exit)(void);
+	u64 flags;
+	u32 timeout_ms;
+	char name[SCX_OPS_NAME_LEN];
+};
+
+int scx_register_ops(struct sched_ext_ops *ops);
+void scx_unregister_ops(struct sched_ext_ops *ops);
+
+int scx_create_dsq(u64 dsq_id, u32 flags, int node);
+int scx_destroy_dsq(u64 dsq_id);
+void scx_dispatch(struct task_struct *p, u64 dsq_id, u64 slice, u64 enq_flags);
+void scx_dispatch_vtime(struct task_struct *p, u64 dsq_id, u64 slice,
+			u64 vtime, u64 enq_flags);
+bool scx_consume(u64 dsq_id);
+void scx_kick_cpu(s32 cpu);
+__printf(1, 2) void scx_ops_error(const char *fmt, ...);
+
+#endif	/* CONFIG_SCHED_EXT */
+
+#endif	/* _LINUX_SCHED_EXT_H */
@@ -6,6 +6,16 @@
 #define MIN_NICE	-20
 #define NICE_WIDTH	(MAX_NICE - MIN_NICE + 1)
 
+/*
+ * Latency nice tells CFS how much wakeup latency a task can put up with:
+ * negative values preempt the running task sooner and look harder for an
+ * idle CPU, positive values are for batch work that rather not preempt.
+ */
+#define MAX_LATENCY_NICE	19
+#define MIN_LATENCY_NICE	-20
+#define LATENCY_NICE_WIDTH	(MAX_LATENCY_NICE - MIN_LATENCY_NICE + 1)
+#define DEFAULT_LATENCY_NICE	0
+
 /*
  * Priority of a process goes from 0..MAX_PRIO-1, valid RT
  * priority is 0..MAX_RT_PRIO-1, and SCHED_NORMAL/SCHED_BATCH
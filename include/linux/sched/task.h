@@ -71,6 +71,20 @@ extern void do_group_exit(int);
 extern void exit_files(struct task_struct *);
 extern void exit_itimers(struct signal_struct *);
 
+struct kernel_clone_args {
+	u64 flags;
+	int __user *child_tid;
+	int __user *parent_tid;
+	unsigned long stack;
+	unsigned long stack_size;
+	unsigned long tls;
+	/* For CLONE_INTO_CGROUP: the fd, the cgroup and the child's css_set */
+	int cgroup;
+	struct cgroup *cgrp;
+	struct css_set *cset;
+};
+
+extern pid_t kernel_clone(struct kernel_clone_args *kargs);
 extern long _do_fork(unsigned long, unsigned long, unsigned long, int __user *, int __user *, unsigned long);
 extern long do_fork(unsigned long, unsigned long, unsigned long, int __user *, int __user *);
 struct task_struct *fork_idle(int);
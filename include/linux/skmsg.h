@@ -57,6 +57,7 @@ struct sk_psock_progs {
 
 enum sk_psock_state_bits {
 	SK_PSOCK_TX_ENABLED,
+	SK_PSOCK_BYPASS,
 };
 
 struct sk_psock_link {
@@ -80,6 +81,7 @@ struct sk_psock_work_state {
 struct sk_psock {
 	struct sock			*sk;
 	struct sock			*sk_redir;
+	struct sock __rcu		*sk_peer;
 	u32				apply_bytes;
 	u32				cork_bytes;
 	u32				eval;
@@ -409,6 +411,8 @@ static inline struct sk_psock *sk_psock_get(struct sock *sk)
 void sk_psock_stop(struct sock *sk, struct sk_psock *psock);
 void sk_psock_destroy(struct rcu_head *rcu);
 void sk_psock_drop(struct sock *sk, struct sk_psock *psock);
+void sk_psock_pair(struct sk_psock *psock, struct sk_psock *peer);
+void sk_psock_unpair(struct sk_psock *psock);
 
 static inline void sk_psock_put(struct sock *sk, struct sk_psock *psock)
 {
@@ -36,6 +36,10 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	ALLOC_SHEAF,		/* Allocation from the cpu sheaf */
+	FREE_SHEAF,		/* Free to the cpu sheaf */
+	SHEAF_REFILL,		/* Refill cpu sheaf from cpu slab */
+	SHEAF_DRAIN,		/* Drain part of the cpu sheaf to slabs */
 	NR_SLUB_STAT_ITEMS };
 
 struct kmem_cache_cpu {
@@ -67,6 +71,20 @@ struct kmem_cache_cpu {
 #define slub_percpu_partial_read_once(c)	NULL
 #endif // CONFIG_SLUB_CPU_PARTIAL
 
+#ifdef CONFIG_SLUB_SHEAVES
+#define SLUB_SHEAF_MAX	32
+
+/*
+ * Per cpu array of free objects of a cache, filled from the cpu slab and
+ * drained back to their slabs in bulk. Frees of objects from any slab of
+ * the local node land here, so that they do not touch remote slab pages.
+ */
+struct slub_sheaf {
+	unsigned int count;
+	void *objects[SLUB_SHEAF_MAX];
+};
+#endif
+
 /*
  * Word size structure that can be atomically updated or read and that
  * contains both the order and the number of objects that a slab of the
@@ -90,6 +108,11 @@ struct kmem_cache {
 #ifdef CONFIG_SLUB_CPU_PARTIAL
 	/* Number of per cpu partial objects to keep around */
 	unsigned int cpu_partial;
+#endif
+#ifdef CONFIG_SLUB_SHEAVES
+	/* Objects kept in the per cpu sheaves, 0 if they are disabled */
+	unsigned int sheaf_capacity;
+	struct slub_sheaf __percpu *sheaf;
 #endif
 	struct kmem_cache_order_objects oo;
 
@@ -182,4 +205,17 @@ static inline void *nearest_obj(struct kmem_cache *cache, struct page *page,
 	return result;
 }
 
+/* The red zone on the left of an object is smaller than cache->size */
+static inline unsigned int obj_to_index(const struct kmem_cache *cache,
+					const struct page *page, void *obj)
+{
+	return (obj - page_address(page)) / cache->size;
+}
+
+static inline int objs_per_slab_page(const struct kmem_cache *cache,
+				     const struct page *page)
+{
+	return page->objects;
+}
+
 #endif /* _LINUX_SLUB_DEF_H */
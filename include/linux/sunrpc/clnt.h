@@ -124,6 +124,7 @@ struct rpc_create_args {
 	unsigned long		flags;
 	char			*client_name;
 	struct svc_xprt		*bc_xprt;	/* NFSv4.1 backchannel */
+	unsigned int		nconnect;	/* number of transports */
 };
 
 struct rpc_add_xprt_test {
@@ -330,6 +330,7 @@ extern void lru_add_drain_cpu(int cpu);
 extern void lru_add_drain_all(void);
 extern void rotate_reclaimable_page(struct page *page);
 extern void deactivate_file_page(struct page *page);
+extern void deactivate_page(struct page *page);
 extern void mark_page_lazyfree(struct page *page);
 extern void swap_setup(void);
 
@@ -345,6 +346,12 @@ extern unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 						  unsigned long nr_pages,
 						  gfp_t gfp_mask,
 						  bool may_swap);
+extern unsigned long try_to_free_mem_cgroup_pages_proactive(struct mem_cgroup *memcg,
+						unsigned long nr_pages,
+						int swappiness,
+						bool may_file,
+						bool may_anon);
+extern unsigned long reclaim_pages(struct list_head *page_list);
 extern unsigned long mem_cgroup_shrink_node(struct mem_cgroup *mem,
 						gfp_t gfp_mask, bool noswap,
 						pg_data_t *pgdat,
@@ -457,6 +464,7 @@ extern sector_t map_swap_page(struct page *, struct block_device **);
 extern sector_t swapdev_block(int, pgoff_t);
 extern int page_swapcount(struct page *);
 extern int __swap_count(struct swap_info_struct *si, swp_entry_t entry);
+extern bool swap_range_exclusive(swp_entry_t entry, int nr);
 extern int __swp_swapcount(swp_entry_t entry);
 extern int swp_swapcount(swp_entry_t entry);
 extern struct swap_info_struct *page_swap_info(struct page *);
@@ -577,6 +585,11 @@ static inline int __swap_count(struct swap_info_struct *si, swp_entry_t entry)
 	return 0;
 }
 
+static inline bool swap_range_exclusive(swp_entry_t entry, int nr)
+{
+	return false;
+}
+
 static inline int __swp_swapcount(swp_entry_t entry)
 {
 	return 0;
@@ -12,6 +12,7 @@
 #define _LINUX_SYSCALLS_H
 
 struct __aio_sigset;
+struct clone_args;
 struct epoll_event;
 struct iattr;
 struct inode;
@@ -23,6 +24,7 @@ struct itimerval;
 struct kexec_segment;
 struct linux_dirent;
 struct linux_dirent64;
+struct linux_dirent_statx;
 struct list_head;
 struct mmap_arg_struct;
 struct msgbuf;
@@ -68,6 +70,9 @@ struct perf_event_attr;
 struct file_handle;
 struct sigaltstack;
 struct rseq;
+struct futex_waitv;
+struct io_uring_params;
+struct open_how;
 union bpf_attr;
 
 #include <linux/types.h>
@@ -779,6 +784,8 @@ asmlinkage long sys_clone(unsigned long, unsigned long, int __user *,
 	       int __user *, unsigned long);
 #endif
 #endif
+
+asmlinkage long sys_clone3(struct clone_args __user *uargs, size_t size);
 asmlinkage long sys_execve(const char __user *filename,
 		const char __user *const __user *argv,
 		const char __user *const __user *envp);
@@ -888,7 +895,7 @@ asmlinkage long sys_execveat(int dfd, const char __user *filename,
 			const char __user *const __user *argv,
 			const char __user *const __user *envp, int flags);
 asmlinkage long sys_userfaultfd(int flags);
-asmlinkage long sys_membarrier(int cmd, int flags);
+asmlinkage long sys_membarrier(int cmd, unsigned int flags, int cpu_id);
 asmlinkage long sys_mlock2(unsigned long start, size_t len, int flags);
 asmlinkage long sys_copy_file_range(int fd_in, loff_t __user *off_in,
 				    int fd_out, loff_t __user *off_out,
@@ -907,6 +914,28 @@ asmlinkage long sys_statx(int dfd, const char __user *path, unsigned flags,
 			  unsigned mask, struct statx __user *buffer);
 asmlinkage long sys_rseq(struct rseq __user *rseq, uint32_t rseq_len,
 			 int flags, uint32_t sig);
+asmlinkage long sys_process_madvise(int pidfd, const struct iovec __user *vec,
+				    size_t vlen, int behavior,
+				    unsigned int flags);
+asmlinkage long sys_futex_waitv(struct futex_waitv __user *waiters,
+				unsigned int nr_futexes, unsigned int flags,
+				struct __kernel_timespec __user *timeout,
+				clockid_t clockid);
+asmlinkage long sys_io_uring_setup(u32 entries,
+				struct io_uring_params __user *p);
+asmlinkage long sys_io_uring_enter(unsigned int fd, u32 to_submit,
+				u32 min_complete, u32 flags,
+				const sigset_t __user *sig, size_t sigsz);
+asmlinkage long sys_io_uring_register(unsigned int fd, unsigned int op,
+				void __user *arg, unsigned int nr_args);
+asmlinkage long sys_openat2(int dfd, const char __user *filename,
+			    struct open_how __user *how, size_t size);
+asmlinkage long sys_close_range(unsigned int fd, unsigned int max_fd,
+				unsigned int flags);
+asmlinkage long sys_getdents_statx(unsigned int fd,
+				   struct linux_dirent_statx __user *dirent,
+				   unsigned int count, unsigned int mask,
+				   unsigned int flags);
 
 /*
  * Architecture-specific system calls
@@ -8,10 +8,16 @@
 #include <linux/refcount.h>
 #include <net/sock.h>
 
-void unix_inflight(struct user_struct *user, struct file *fp);
-void unix_notinflight(struct user_struct *user, struct file *fp);
+struct scm_fp_list;
+struct unix_sock;
+
+void unix_add_edges(struct scm_fp_list *fpl, struct unix_sock *receiver);
+void unix_update_edges(struct unix_sock *receiver);
+int unix_prepare_fpl(struct scm_fp_list *fpl);
+void unix_destroy_fpl(struct scm_fp_list *fpl);
 void unix_gc(void);
-void wait_for_unix_gc(void);
+void unix_gc_flush(void);
+void wait_for_unix_gc(struct scm_fp_list *fpl);
 struct sock *unix_get_socket(struct file *filp);
 struct sock *unix_peer_get(struct sock *sk);
 
@@ -22,6 +28,25 @@ extern unsigned int unix_tot_inflight;
 extern spinlock_t unix_table_lock;
 extern struct hlist_head unix_socket_table[2 * UNIX_HASH_SIZE];
 
+/* In-flight graph: a vertex per in-flight AF_UNIX socket, an edge per
+ * in-flight descriptor of it, see net/unix/garbage.c
+ */
+struct unix_vertex {
+	struct list_head	edges;
+	struct list_head	entry;
+	struct list_head	scc_entry;
+	unsigned long		out_degree;
+	unsigned long		index;
+	unsigned long		scc_index;
+};
+
+struct unix_edge {
+	struct unix_sock	*predecessor;	/* socket in flight */
+	struct unix_sock	*successor;	/* receiver */
+	struct list_head	vertex_entry;
+	struct list_head	stack_entry;
+};
+
 struct unix_address {
 	refcount_t	refcnt;
 	int		len;
@@ -56,12 +81,10 @@ struct unix_sock {
 	struct path		path;
 	struct mutex		iolock, bindlock;
 	struct sock		*peer;
-	struct list_head	link;
-	atomic_long_t		inflight;
+	struct sock		*listener;	/* of embryo, until accept() */
+	struct unix_vertex	*vertex;	/* if in flight */
+	unsigned long		nr_unix_fds;	/* queued AF_UNIX fds */
 	spinlock_t		lock;
-	unsigned long		gc_flags;
-#define UNIX_GC_CANDIDATE	0
-#define UNIX_GC_MAYBE_CYCLE	1
 	struct socket_wq	peer_wq;
 	wait_queue_entry_t	peer_wake;
 };
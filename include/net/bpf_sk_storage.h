@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _BPF_SK_STORAGE_H
+#define _BPF_SK_STORAGE_H
+
+struct sock;
+
+#ifdef CONFIG_BPF_SYSCALL
+void bpf_sk_storage_free(struct sock *sk);
+#else
+static inline void bpf_sk_storage_free(struct sock *sk)
+{
+}
+#endif
+
+extern const struct bpf_func_proto bpf_sk_storage_get_proto;
+extern const struct bpf_func_proto bpf_sk_storage_delete_proto;
+extern const struct bpf_func_proto bpf_sk_storage_get_skb_proto;
+extern const struct bpf_func_proto bpf_sk_storage_delete_skb_proto;
+extern const struct bpf_func_proto bpf_sk_storage_get_sock_ops_proto;
+extern const struct bpf_func_proto bpf_sk_storage_delete_sock_ops_proto;
+
+#endif /* _BPF_SK_STORAGE_H */
@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Device memory TCP
+ *
+ * A dma-buf, typically accelerator memory, is bound to a receive queue
+ * whose driver splits headers from payload.  The payload is DMAed
+ * straight into the dma-buf and shows up in skbs as net_iov frags, which
+ * the CPU never touches: recvmsg() hands out their location in the
+ * dma-buf instead of copying them.
+ */
+#ifndef _NET_DEVMEM_H
+#define _NET_DEVMEM_H
+
+#include <linux/atomic.h>
+#include <linux/errno.h>
+#include <linux/list.h>
+#include <linux/refcount.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+#include <asm/page.h>
+
+struct dma_buf;
+struct dma_buf_attachment;
+struct net_device;
+struct page_pool;
+struct sg_table;
+struct sock;
+
+struct net_devmem_dmabuf_binding {
+	struct dma_buf *dmabuf;
+	struct dma_buf_attachment *attachment;
+	struct sg_table *sgt;
+	struct net_device *dev;
+	unsigned int rxq_idx;
+	/* Reported to user space along with each frag */
+	u32 id;
+	/* Held by the binding socket and by the page_pools using it */
+	refcount_t ref;
+	/* On the list of the socket which made the binding */
+	struct list_head sk_list;
+	struct work_struct free_work;
+
+	/* One net_iov per page of the dma-buf, and a stack of free ones */
+	struct net_iov *niovs;
+	unsigned long num_niovs;
+	spinlock_t free_lock;
+	struct net_iov **free_niovs;
+	unsigned long num_free;
+};
+
+/* A page sized piece of a dma-buf, standing in for a page in skb frags */
+struct net_iov {
+	struct net_devmem_dmabuf_binding *binding;
+	struct page_pool *pp;
+	dma_addr_t dma_addr;
+	/* skb frags and user space tokens referencing it */
+	atomic_t ref;
+};
+
+static inline unsigned long net_iov_dmabuf_offset(const struct net_iov *niov)
+{
+	return (niov - niov->binding->niovs) << PAGE_SHIFT;
+}
+
+static inline dma_addr_t net_iov_dma_addr(const struct net_iov *niov)
+{
+	return niov->dma_addr;
+}
+
+static inline void net_iov_get(struct net_iov *niov)
+{
+	atomic_inc(&niov->ref);
+}
+
+#ifdef CONFIG_NET_DEVMEM
+void net_iov_put(struct net_iov *niov);
+
+struct net_iov *
+net_devmem_alloc_niov(struct net_devmem_dmabuf_binding *binding);
+void net_devmem_free_niov(struct net_iov *niov);
+
+void net_devmem_binding_put(struct net_devmem_dmabuf_binding *binding);
+struct net_devmem_dmabuf_binding *
+net_devmem_rxq_binding(struct net_device *dev, unsigned int rxq_idx);
+
+int net_devmem_bind_sk(struct sock *sk, unsigned int ifindex,
+		       unsigned int rxq_idx, int dmabuf_fd, u32 *id);
+void net_devmem_unbind_sk(struct sock *sk);
+#else
+static inline void net_iov_put(struct net_iov *niov)
+{
+}
+
+static inline struct net_devmem_dmabuf_binding *
+net_devmem_rxq_binding(struct net_device *dev, unsigned int rxq_idx)
+{
+	return NULL;
+}
+
+static inline int net_devmem_bind_sk(struct sock *sk, unsigned int ifindex,
+				     unsigned int rxq_idx, int dmabuf_fd,
+				     u32 *id)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void net_devmem_unbind_sk(struct sock *sk)
+{
+}
+#endif
+
+#endif /* _NET_DEVMEM_H */
@@ -49,9 +49,11 @@ struct fib_config {
 	struct nl_info		fc_nlinfo;
 	struct nlattr		*fc_encap;
 	u16			fc_encap_type;
+	u32			fc_nh_id;
 };
 
 struct fib_info;
+struct nexthop;
 struct rtable;
 
 struct fib_nh_exception {
@@ -122,6 +124,8 @@ struct fib_info {
 #define fib_window fib_metrics->metrics[RTAX_WINDOW-1]
 #define fib_rtt fib_metrics->metrics[RTAX_RTT-1]
 #define fib_advmss fib_metrics->metrics[RTAX_ADVMSS-1]
+	struct nexthop		*nh;		/* fib_nh built from this */
+	struct list_head	nh_list;	/* on nh->fi_list */
 	int			fib_nhs;
 	struct rcu_head		rcu;
 	struct fib_nh		fib_nh[0];
@@ -242,6 +246,8 @@ int fib_table_delete(struct net *, struct fib_table *, struct fib_config *,
 int fib_table_dump(struct fib_table *table, struct sk_buff *skb,
 		   struct netlink_callback *cb, struct fib_dump_filter *filter);
 int fib_table_flush(struct net *net, struct fib_table *table);
+int fib_table_replace_info(struct net *net, struct fib_table *tb,
+			   struct fib_info *ofi, struct fib_info *nfi);
 struct fib_table *fib_trie_unmerge(struct fib_table *main_tb);
 void fib_table_flush_external(struct fib_table *table);
 void fib_free_table(struct fib_table *tb);
@@ -400,6 +406,7 @@ static inline int fib_num_tclassid_users(struct net *net)
 }
 #endif
 int fib_unmerge(struct net *net);
+void fib_flush(struct net *net);
 
 /* Exported by fib_semantics.c */
 int ip_fib_check_default(__be32 gw, struct net_device *dev);
@@ -407,6 +414,11 @@ int fib_sync_down_dev(struct net_device *dev, unsigned long event, bool force);
 int fib_sync_down_addr(struct net_device *dev, __be32 local);
 int fib_sync_up(struct net_device *dev, unsigned int nh_flags);
 void fib_sync_mtu(struct net_device *dev, u32 orig_mtu);
+struct nh_info;
+int fib_check_nexthop(struct net *net, const struct nh_info *nhi,
+		      struct netlink_ext_ack *extack);
+void fib_nexthop_update(struct nexthop *nh);
+void fib_nexthop_remove(struct nexthop *nh);
 
 #ifdef CONFIG_IP_ROUTE_MULTIPATH
 int fib_multipath_hash(const struct net *net, const struct flowi4 *fl4,
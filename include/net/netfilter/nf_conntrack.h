@@ -290,6 +290,8 @@ extern struct hlist_nulls_head *nf_conntrack_hash;
 extern unsigned int nf_conntrack_htable_size;
 extern seqcount_t nf_conntrack_generation;
 extern unsigned int nf_conntrack_max;
+extern unsigned int nf_conntrack_resizes;
+extern int nf_conntrack_htable_autoresize;
 
 /* must be called with rcu read lock held */
 static inline void
@@ -20,19 +20,31 @@ struct nf_flowtable_type {
 	struct module			*owner;
 };
 
+enum nf_flowtable_flags {
+	NF_FLOWTABLE_HW_OFFLOAD		= 0x1,	/* NFT_FLOWTABLE_HW_OFFLOAD */
+};
+
 struct nf_flowtable {
 	struct list_head		list;
 	struct rhashtable		rhashtable;
 	const struct nf_flowtable_type	*type;
+	u32				flags;
 	struct delayed_work		gc_work;
 };
 
+static inline bool nf_flowtable_hw_offload(const struct nf_flowtable *flowtable)
+{
+	return flowtable->flags & NF_FLOWTABLE_HW_OFFLOAD;
+}
+
 enum flow_offload_tuple_dir {
 	FLOW_OFFLOAD_DIR_ORIGINAL = IP_CT_DIR_ORIGINAL,
 	FLOW_OFFLOAD_DIR_REPLY = IP_CT_DIR_REPLY,
 	FLOW_OFFLOAD_DIR_MAX = IP_CT_DIR_MAX
 };
 
+#define NF_FLOW_TABLE_ENCAP_MAX		2
+
 struct flow_offload_tuple {
 	union {
 		struct in_addr		src_v4;
@@ -51,7 +63,16 @@ struct flow_offload_tuple {
 
 	u8				l3proto;
 	u8				l4proto;
+
+	/* VLAN tags the packet carries on iifidx, outermost first */
+	struct {
+		u16			id;
+		__be16			proto;
+	} encap[NF_FLOW_TABLE_ENCAP_MAX];
+
+	/* All members above are keys for lookups, see flow_offload_hash(). */
 	u8				dir;
+	u8				encap_num;
 
 	int				oifidx;
 
@@ -70,9 +91,16 @@ struct flow_offload_tuple_rhash {
 #define FLOW_OFFLOAD_DYING	0x4
 #define FLOW_OFFLOAD_TEARDOWN	0x8
 
+/* Bits in hw_flags, updated from the offload work */
+enum flow_offload_hw_bits {
+	NF_FLOW_HW,		/* flow is installed in hardware */
+	NF_FLOW_HW_PENDING,	/* a hardware request is queued */
+};
+
 struct flow_offload {
 	struct flow_offload_tuple_rhash		tuplehash[FLOW_OFFLOAD_DIR_MAX];
 	u32					flags;
+	unsigned long				hw_flags;
 	union {
 		/* Your private driver data here. */
 		u32		timeout;
@@ -85,9 +113,53 @@ struct nf_flow_route {
 	struct {
 		struct dst_entry	*dst;
 		int			ifindex;
+		/* device and tags packets are looked up with, if not ifindex */
+		int			iifidx;
+		struct {
+			u16		id;
+			__be16		proto;
+		} encap[NF_FLOW_TABLE_ENCAP_MAX];
+		u8			encap_num;
 	} tuple[FLOW_OFFLOAD_DIR_MAX];
 };
 
+enum flow_offload_hw_command {
+	FLOW_OFFLOAD_HW_REPLACE,
+	FLOW_OFFLOAD_HW_DESTROY,
+	FLOW_OFFLOAD_HW_STATS,
+};
+
+struct flow_offload_hw_stats {
+	u64			pkts;
+	u64			bytes;
+	unsigned long		lastused;
+};
+
+/**
+ * struct flow_offload_hw - flowtable request to a device driver
+ * @command: install, remove or query one direction of a flow
+ * @cookie: identifies this direction of the flow in all requests
+ * @tuple: packets received on tuple->iifidx matching this are forwarded
+ * @other: tuple of the opposite direction, with the addresses and ports
+ *	   that are to be written to the packet if @flags asks for NAT
+ * @flags: FLOW_OFFLOAD_SNAT and FLOW_OFFLOAD_DNAT
+ * @stats: on FLOW_OFFLOAD_HW_STATS, filled in by the driver with counters
+ *	   since the previous request and the last time a packet was seen
+ *
+ * Passed to ndo_setup_tc() of the device receiving the packets, with type
+ * TC_SETUP_FT, from process context. The device is expected to decrease
+ * the TTL, to forward packets out of tuple->oifidx via tuple->dst_cache and
+ * to pass TCP packets with FIN or RST set to the software path.
+ */
+struct flow_offload_hw {
+	enum flow_offload_hw_command	command;
+	unsigned long			cookie;
+	const struct flow_offload_tuple	*tuple;
+	const struct flow_offload_tuple	*other;
+	u32				flags;
+	struct flow_offload_hw_stats	stats;
+};
+
 struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
 					struct nf_flow_route *route);
 void flow_offload_free(struct flow_offload *flow);
@@ -101,6 +173,8 @@ int nf_flow_table_iterate(struct nf_flowtable *flow_table,
 
 void nf_flow_table_cleanup(struct net_device *dev);
 
+void nf_flow_table_offload_flush(struct nf_flowtable *flowtable);
+
 int nf_flow_table_init(struct nf_flowtable *flow_table);
 void nf_flow_table_free(struct nf_flowtable *flow_table);
 
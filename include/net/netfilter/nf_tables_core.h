@@ -74,6 +74,10 @@ extern struct nft_set_type nft_set_hash_type;
 extern struct nft_set_type nft_set_hash_fast_type;
 extern struct nft_set_type nft_set_rbtree_type;
 extern struct nft_set_type nft_set_bitmap_type;
+extern struct nft_set_type nft_set_pipapo_type;
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX2)
+extern struct nft_set_type nft_set_pipapo_avx2_type;
+#endif
 
 struct nft_expr;
 struct nft_regs;
@@ -3,7 +3,10 @@
 #define __NET_NEXTHOP_H
 
 #include <linux/rtnetlink.h>
+#include <linux/rbtree.h>
+#include <linux/refcount.h>
 #include <net/netlink.h>
+#include <uapi/linux/nexthop.h>
 
 static inline int rtnh_ok(const struct rtnexthop *rtnh, int remaining)
 {
@@ -31,4 +34,111 @@ static inline int rtnh_attrlen(const struct rtnexthop *rtnh)
 	return rtnh->rtnh_len - NLA_ALIGN(sizeof(*rtnh));
 }
 
+/*
+ * Nexthop objects
+ *
+ * Nexthops and nexthop groups are objects of their own, created, replaced
+ * and removed through RTM_{NEW,DEL,GET}NEXTHOP, that IPv4 routes refer to by
+ * id (RTA_NH_ID). A fib_info built from a nexthop keeps a copy of its paths
+ * in fib_nh, so the forwarding path is not affected, and it is rebuilt for
+ * all routes using it when the nexthop changes. All of this is under RTNL.
+ */
+#define NEXTHOP_MAX_PATHS	256
+
+struct nexthop;
+
+struct nh_config {
+	u32		nh_id;
+
+	u8		nh_family;
+	u8		nh_protocol;
+	u8		nh_blackhole;
+	u32		nh_flags;
+
+	int		nh_ifindex;
+	__be32		nh_gw;
+
+	struct nlattr	*nh_grp;
+	u16		nh_grp_type;
+
+	struct nl_info	nlinfo;
+};
+
+struct nh_info {
+	u8		family;
+	int		oif;
+	__be32		gw;
+	u32		flags;		/* RTNH_F_ONLINK */
+};
+
+struct nh_grp_entry {
+	struct nexthop	*nh;
+	u16		weight;
+
+	struct list_head nh_list;	/* on nh->grp_list */
+	struct nexthop	*nh_parent;	/* nexthop of group with this entry */
+};
+
+struct nh_group {
+	u16		num_nh;
+	struct nh_grp_entry nh_entries[0];
+};
+
+struct nexthop {
+	struct rb_node		rb_node;    /* entry on netns rbtree */
+	struct list_head	fi_list;    /* v4 routes using this nexthop */
+	struct list_head	grp_list;   /* nh group entries using this nh */
+	struct net		*net;
+
+	u32			id;
+
+	u8			protocol;   /* app managing this nh */
+	u8			nh_flags;
+	bool			is_group;
+
+	refcount_t		refcnt;
+
+	union {
+		struct nh_info	*nh_info;
+		struct nh_group	*nh_grp;
+	};
+};
+
+/* caller holds RTNL */
+struct nexthop *nexthop_find_by_id(struct net *net, u32 id);
+
+void nexthop_free(struct nexthop *nh);
+
+static inline void nexthop_get(struct nexthop *nh)
+{
+	refcount_inc(&nh->refcnt);
+}
+
+static inline void nexthop_put(struct nexthop *nh)
+{
+	if (refcount_dec_and_test(&nh->refcnt))
+		nexthop_free(nh);
+}
+
+/* number of paths a route using this nexthop gets */
+static inline int nexthop_num_path(const struct nexthop *nh)
+{
+	return nh->is_group ? nh->nh_grp->num_nh : 1;
+}
+
+/* info of i-th path, and its weight (1 to NEXTHOP_MAX_PATHS) */
+static inline const struct nh_info *nexthop_path(const struct nexthop *nh,
+						 int i, int *weight)
+{
+	if (nh->is_group) {
+		const struct nh_grp_entry *nhge = &nh->nh_grp->nh_entries[i];
+
+		*weight = nhge->weight;
+		return nhge->nh->nh_info;
+	}
+
+	*weight = 1;
+	return nh->nh_info;
+}
+
 #endif
@@ -24,6 +24,21 @@
  * If no DMA mapping is done, then it can act as shim-layer that
  * fall-through to alloc_page.  As no state is kept on the page, the
  * regular put_page() call is sufficient.
+ *
+ * Every page handed out carries a pointer back to its pool, and the
+ * pool is only freed once all of them came back.  A driver that frees
+ * a page with put_page() instead of page_pool_put_page() must first
+ * disconnect it with page_pool_release_page().
+ *
+ * An skb built from page_pool pages can be marked with
+ * skb_mark_for_recycle(), then freeing the skb returns its head and
+ * frag pages straight to their pool, DMA mapping included, instead
+ * of to the page allocator.
+ *
+ * A pool created with a device memory binding hands out net_iovs from
+ * the bound dma-buf with page_pool_alloc_net_iov() instead of pages.
+ * They are already DMA mapped, and come back to the pool when their last
+ * reference is dropped with net_iov_put().
  */
 #ifndef _NET_PAGE_POOL_H
 #define _NET_PAGE_POOL_H
@@ -31,10 +46,14 @@
 #include <linux/mm.h> /* Needed by ptr_ring */
 #include <linux/ptr_ring.h>
 #include <linux/dma-direction.h>
+#include <linux/workqueue.h>
 
 #define PP_FLAG_DMA_MAP 1 /* Should page_pool do the DMA map/unmap */
 #define PP_FLAG_ALL	PP_FLAG_DMA_MAP
 
+struct net_iov;
+struct net_devmem_dmabuf_binding;
+
 /*
  * Fast allocation side cache array/stack
  *
@@ -63,6 +82,8 @@ struct page_pool_params {
 	int		nid;  /* Numa node id to allocate from pages from */
 	struct device	*dev; /* device, for DMA pre-mapping purposes */
 	enum dma_data_direction dma_dir; /* DMA mapping direction */
+	/* device memory to allocate from, see net_devmem_rxq_binding() */
+	struct net_devmem_dmabuf_binding *binding;
 };
 
 struct page_pool {
@@ -96,6 +117,17 @@ struct page_pool {
 	 * TODO: Implement bulk return pages into this structure.
 	 */
 	struct ptr_ring ring;
+
+	/* Pages leaving the page allocator for the pool, and pages going
+	 * back.  The difference is what is still in flight, e.g. sitting
+	 * in an skb, and keeps the pool alive past page_pool_destroy().
+	 * hold_cnt is only touched from the (protected) allocation side.
+	 */
+	u32 pages_state_hold_cnt;
+	atomic_t pages_state_release_cnt ____cacheline_aligned_in_smp;
+
+	struct delayed_work release_dw;
+	unsigned long defer_warn;
 };
 
 struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp);
@@ -111,6 +143,15 @@ struct page_pool *page_pool_create(const struct page_pool_params *params);
 
 void page_pool_destroy(struct page_pool *pool);
 
+/* Disconnect a page from its pool, before the driver put_page()s it */
+void page_pool_release_page(struct page_pool *pool, struct page *page);
+
+/* Called from the skb free path for skbs marked with pp_recycle */
+bool page_pool_return_skb_page(struct page *page);
+
+struct net_iov *page_pool_alloc_net_iov(struct page_pool *pool);
+void page_pool_put_net_iov(struct page_pool *pool, struct net_iov *niov);
+
 /* Never call this directly, use helpers below */
 void __page_pool_put_page(struct page_pool *pool,
 			  struct page *page, bool allow_direct);
@@ -154,11 +154,21 @@ struct fastopen_queue {
 	struct tcp_fastopen_context __rcu *ctx; /* cipher context for cookie */
 };
 
+/* Per-CPU FIFO of established children, see TCP_ACCEPT_PERCPU */
+struct request_sock_subqueue {
+	spinlock_t		lock;
+	struct request_sock	*head;
+	struct request_sock	*tail;
+};
+
 /** struct request_sock_queue - queue of request_socks
  *
  * @rskq_accept_head - FIFO head of established children
  * @rskq_accept_tail - FIFO tail of established children
  * @rskq_defer_accept - User waits for some data after accept()
+ * @rskq_subq - if set, children are queued here instead, on the CPU that
+ *		completed their handshake
+ * @rskq_subq_len - number of children queued on @rskq_subq
  *
  */
 struct request_sock_queue {
@@ -174,15 +184,26 @@ struct request_sock_queue {
 	struct fastopen_queue	fastopenq;  /* Check max_qlen != 0 to determine
 					     * if TFO is enabled.
 					     */
+
+	atomic_t		rskq_subq_len;
+	struct request_sock_subqueue __percpu *rskq_subq;
 };
 
 void reqsk_queue_alloc(struct request_sock_queue *queue);
+int reqsk_subqueue_alloc(struct request_sock_queue *queue);
+void reqsk_subqueue_free(struct request_sock_queue *queue);
+void reqsk_subqueue_add(struct request_sock_queue *queue,
+			struct request_sock *req, struct sock *parent);
+struct request_sock *reqsk_subqueue_remove(struct request_sock_queue *queue,
+					   struct sock *parent);
 
 void reqsk_fastopen_remove(struct sock *sk, struct request_sock *req,
 			   bool reset);
 
 static inline bool reqsk_queue_empty(const struct request_sock_queue *queue)
 {
+	if (queue->rskq_subq)
+		return atomic_read(&queue->rskq_subq_len) == 0;
 	return queue->rskq_accept_head == NULL;
 }
 
@@ -191,6 +212,9 @@ static inline struct request_sock *reqsk_queue_remove(struct request_sock_queue
 {
 	struct request_sock *req;
 
+	if (queue->rskq_subq)
+		return reqsk_subqueue_remove(queue, parent);
+
 	spin_lock_bh(&queue->rskq_lock);
 	req = queue->rskq_accept_head;
 	if (req) {
@@ -183,6 +183,23 @@ int ip_route_input_rcu(struct sk_buff *skb, __be32 dst, __be32 src,
 		       u8 tos, struct net_device *devin,
 		       struct fib_result *res);
 
+/* Last input route looked up for a list of received packets, see
+ * ip_route_input_hint().
+ */
+struct ip_rt_input_hint {
+	struct rtable		*rt;
+	const struct net_device	*dev;
+	__be32			daddr;
+	__be32			saddr;
+	u32			mark;
+	u8			tos;
+	u16			ipcb_flags;
+};
+
+int ip_route_input_hint(struct sk_buff *skb, __be32 dst, __be32 src,
+			u8 tos, struct net_device *devin,
+			struct ip_rt_input_hint *hint);
+
 static inline int ip_route_input(struct sk_buff *skb, __be32 dst, __be32 src,
 				 u8 tos, struct net_device *devin)
 {
@@ -21,9 +21,18 @@ struct scm_creds {
 	kgid_t	gid;
 };
 
+struct unix_edge;
+
 struct scm_fp_list {
 	short			count;
 	short			max;
+#if IS_ENABLED(CONFIG_UNIX)
+	short			count_unix;
+	bool			inflight;
+	bool			dead;
+	struct list_head	vertices;	/* preallocated for GC */
+	struct unix_edge	*edges;
+#endif
 	struct user_struct	*user;
 	struct file		*fp[SCM_MAX_FD];
 };
@@ -1855,6 +1855,8 @@ struct tcp_iter_state {
 	struct sock		*syn_wait_sk;
 	int			bucket, offset, sbucket, num;
 	loff_t			last_pos;
+	/* set for BPF iterators, which have no proc entry */
+	struct tcp_seq_afinfo	*bpf_seq_afinfo;
 };
 
 extern struct request_sock_ops tcp_request_sock_ops;
@@ -2101,6 +2103,7 @@ struct sk_psock;
 
 int tcp_bpf_init(struct sock *sk);
 void tcp_bpf_reinit(struct sock *sk);
+void tcp_bpf_pair(struct sock *sk, struct sk_psock *psock);
 int tcp_bpf_sendmsg_redir(struct sock *sk, struct sk_msg *msg, u32 bytes,
 			  int flags);
 int tcp_bpf_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
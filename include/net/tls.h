@@ -58,6 +58,13 @@
 #define TLS_RECORD_TYPE_DATA		0x17
 
 #define TLS_AAD_SPACE_SIZE		13
+#define TLS_1_3_AAD_SPACE_SIZE		TLS_HEADER_SIZE
+
+/* TLS 1.3 hides the record type in the last byte of the plaintext, and
+ * allows the ciphertext to be up to 256 bytes bigger than the payload
+ */
+#define TLS_1_3_TAIL_SIZE		1
+#define TLS_1_3_MAX_EXPANSION		256
 #define TLS_DEVICE_NAME_MAX		32
 
 /*
@@ -113,7 +120,16 @@ struct tls_rec {
 	/* AAD | msg_encrypted.sg.data (data contains overhead for hdr & iv & tag) */
 	struct scatterlist sg_aead_out[2];
 
+	/* TLS 1.3 record type, chained after msg_plaintext */
+	struct scatterlist sg_content_type;
+	u8 content_type;
+
 	char aad_space[TLS_AAD_SPACE_SIZE];
+	/* nonce for this record, the context IV may move on before async
+	 * encryption completes
+	 */
+	char iv_data[TLS_CIPHER_AES_GCM_128_SALT_SIZE +
+		     TLS_CIPHER_AES_GCM_128_IV_SIZE];
 	struct aead_request aead_req;
 	u8 aead_req_ctx[];
 };
@@ -189,6 +205,8 @@ struct cipher_context {
 	u16 prepend_size;
 	u16 tag_size;
 	u16 overhead_size;
+	u16 aad_size;
+	u16 tail_size;
 	u16 iv_size;
 	char *iv;
 	u16 rec_seq_size;
@@ -213,6 +231,7 @@ struct tls_context {
 
 	u8 tx_conf:3;
 	u8 rx_conf:3;
+	u8 zerocopy_sendfile:1;
 
 	struct cipher_context tx;
 	struct cipher_context rx;
@@ -384,12 +403,28 @@ static inline bool tls_bigint_increment(unsigned char *seq, int len)
 }
 
 static inline void tls_advance_record_sn(struct sock *sk,
-					 struct cipher_context *ctx)
+					 struct cipher_context *ctx,
+					 int version)
 {
 	if (tls_bigint_increment(ctx->rec_seq, ctx->rec_seq_size))
 		tls_err_abort(sk, EBADMSG);
-	tls_bigint_increment(ctx->iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
-			     ctx->iv_size);
+
+	/* TLS 1.3 nonces are derived from the sequence number instead */
+	if (version != TLS_1_3_VERSION)
+		tls_bigint_increment(ctx->iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
+				     ctx->iv_size);
+}
+
+/* TLS 1.3 nonce: the static IV XORed with the padded sequence number */
+static inline void tls_xor_iv_with_seq(int version, char *iv, char *seq)
+{
+	int i;
+
+	if (version != TLS_1_3_VERSION)
+		return;
+
+	for (i = 0; i < TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE; i++)
+		iv[i + TLS_CIPHER_AES_GCM_128_SALT_SIZE] ^= seq[i];
 }
 
 static inline void tls_fill_prepend(struct tls_context *ctx,
@@ -399,6 +434,20 @@ static inline void tls_fill_prepend(struct tls_context *ctx,
 {
 	size_t pkt_len, iv_size = ctx->tx.iv_size;
 
+	if (ctx->crypto_send.info.version == TLS_1_3_VERSION) {
+		/* no explicit nonce, version and type are fixed, see
+		 * RFC 8446 5.2; plaintext_len includes the real type
+		 */
+		pkt_len = plaintext_len + ctx->tx.tag_size;
+
+		buf[0] = TLS_RECORD_TYPE_DATA;
+		buf[1] = TLS_1_2_VERSION_MINOR;
+		buf[2] = TLS_1_2_VERSION_MAJOR;
+		buf[3] = pkt_len >> 8;
+		buf[4] = pkt_len & 0xFF;
+		return;
+	}
+
 	pkt_len = plaintext_len + iv_size + ctx->tx.tag_size;
 
 	/* we cover nonce explicit here as well, so buf should be of
@@ -414,19 +463,30 @@ static inline void tls_fill_prepend(struct tls_context *ctx,
 	       ctx->tx.iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE, iv_size);
 }
 
+/* For TLS 1.3, the AAD is the record header, and @size the length of the
+ * encrypted record, tag included.
+ */
 static inline void tls_make_aad(char *buf,
 				size_t size,
 				char *record_sequence,
 				int record_sequence_size,
-				unsigned char record_type)
+				unsigned char record_type,
+				int version)
 {
-	memcpy(buf, record_sequence, record_sequence_size);
+	int pos = 0;
+
+	if (version != TLS_1_3_VERSION) {
+		memcpy(buf, record_sequence, record_sequence_size);
+		pos = record_sequence_size;
+	} else {
+		record_type = TLS_RECORD_TYPE_DATA;
+	}
 
-	buf[8] = record_type;
-	buf[9] = TLS_1_2_VERSION_MAJOR;
-	buf[10] = TLS_1_2_VERSION_MINOR;
-	buf[11] = size >> 8;
-	buf[12] = size & 0xFF;
+	buf[pos] = record_type;
+	buf[pos + 1] = TLS_1_2_VERSION_MAJOR;
+	buf[pos + 2] = TLS_1_2_VERSION_MINOR;
+	buf[pos + 3] = size >> 8;
+	buf[pos + 4] = size & 0xFF;
 }
 
 static inline struct tls_context *tls_get_ctx(const struct sock *sk)
@@ -173,9 +173,15 @@ typedef struct sock *(*udp_lookup_t)(struct sk_buff *skb, __be16 sport,
 struct sk_buff *udp_gro_receive(struct list_head *head, struct sk_buff *skb,
 				struct udphdr *uh, udp_lookup_t lookup);
 int udp_gro_complete(struct sk_buff *skb, int nhoff, udp_lookup_t lookup);
+int udp_gro_complete_list(struct sk_buff *skb, int nhoff);
 
 struct sk_buff *__udp_gso_segment(struct sk_buff *gso_skb,
 				  netdev_features_t features);
+struct sk_buff *__udp_gso_segment_list(struct sk_buff *skb,
+				       netdev_features_t features);
+
+/* Max number of packets chained by fraglist GRO */
+#define UDP_GRO_CNT_MAX 64
 
 static inline struct udphdr *udp_gro_udphdr(struct sk_buff *skb)
 {
@@ -426,6 +432,8 @@ struct udp_seq_afinfo {
 struct udp_iter_state {
 	struct seq_net_private  p;
 	int			bucket;
+	/* set for BPF iterators, which have no proc entry */
+	struct udp_seq_afinfo	*bpf_seq_afinfo;
 };
 
 void *udp_seq_start(struct seq_file *seq, loff_t *pos);
@@ -6,6 +6,8 @@
 #ifndef __LINUX_NET_XDP_H__
 #define __LINUX_NET_XDP_H__
 
+#include <linux/skbuff.h> /* skb_shared_info */
+
 /**
  * DOC: XDP RX-queue information
  *
@@ -61,8 +63,18 @@ struct xdp_rxq_info {
 	u32 queue_index;
 	u32 reg_state;
 	struct xdp_mem_info mem;
+	unsigned int napi_id; /* for busy polling, set by the driver */
 } ____cacheline_aligned; /* perf critical, avoid false-sharing */
 
+struct xdp_txq_info {
+	struct net_device *dev;
+};
+
+enum xdp_buff_flags {
+	XDP_FLAGS_HAS_FRAGS	= BIT(0), /* non-linear xdp buff */
+	XDP_FLAGS_RX_META	= BIT(1), /* driver xdp_metadata_ops usable */
+};
+
 struct xdp_buff {
 	void *data;
 	void *data_end;
@@ -70,8 +82,121 @@ struct xdp_buff {
 	void *data_hard_start;
 	unsigned long handle;
 	struct xdp_rxq_info *rxq;
+	struct xdp_txq_info *txq; /* only set for devmap egress programs */
+	u32 frame_sz; /* frame size, only valid with XDP_FLAGS_HAS_FRAGS */
+	u32 flags; /* supported values defined in xdp_buff_flags */
 };
 
+/* Must be called by every driver before running the XDP program on a
+ * freshly received buffer, so that state left behind by a previous
+ * multi-buffer packet is not carried over.
+ */
+static __always_inline void
+xdp_init_buff(struct xdp_buff *xdp, struct xdp_rxq_info *rxq)
+{
+	xdp->rxq = rxq;
+	xdp->frame_sz = 0;
+	xdp->flags = 0;
+}
+
+static __always_inline bool xdp_buff_has_frags(const struct xdp_buff *xdp)
+{
+	return !!(xdp->flags & XDP_FLAGS_HAS_FRAGS);
+}
+
+/* Drivers implementing xdp_metadata_ops embed the xdp_buff in their own
+ * receive context and mark it with this once that context is filled in.
+ * Buffers built elsewhere (cpumap, devmap, generic XDP) never carry the
+ * flag, so the driver callbacks only ever see their own buffers.
+ */
+static __always_inline void xdp_buff_set_rx_meta(struct xdp_buff *xdp)
+{
+	xdp->flags |= XDP_FLAGS_RX_META;
+}
+
+static __always_inline bool xdp_buff_has_rx_meta(const struct xdp_buff *xdp)
+{
+	return !!(xdp->flags & XDP_FLAGS_RX_META);
+}
+
+/* Driver callbacks behind the bpf_xdp_metadata_rx_*() helpers. Each
+ * returns 0 on success, -ENODATA when the packet carries no such
+ * information.
+ */
+struct xdp_metadata_ops {
+	int (*xmo_rx_timestamp)(const struct xdp_buff *xdp, u64 *timestamp);
+	int (*xmo_rx_hash)(const struct xdp_buff *xdp, u32 *hash,
+			   u32 *rss_type);
+	int (*xmo_rx_vlan_tag)(const struct xdp_buff *xdp, __be16 *vlan_proto,
+			       u16 *vlan_tci);
+};
+
+/* A multi-buffer xdp_buff keeps its fragments in a skb_shared_info at
+ * the end of the head buffer, laid out exactly as build_skb() expects,
+ * so that the frame can later be turned into an skb without copying.
+ */
+static __always_inline struct skb_shared_info *
+xdp_get_shared_info_from_buff(const struct xdp_buff *xdp)
+{
+	return xdp->data_hard_start + xdp->frame_sz -
+	       SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+}
+
+/* Start describing a multi-buffer packet.  @frame_sz is the size of the
+ * head buffer starting at data_hard_start, including the tailroom that
+ * holds the skb_shared_info.  Drivers must only do so when the attached
+ * program was loaded with BPF_F_XDP_HAS_FRAGS (aux->xdp_has_frags).
+ */
+static inline void xdp_buff_init_frags(struct xdp_buff *xdp, u32 frame_sz)
+{
+	xdp->frame_sz = frame_sz;
+	xdp->flags |= XDP_FLAGS_HAS_FRAGS;
+	xdp_get_shared_info_from_buff(xdp)->nr_frags = 0;
+}
+
+/* Append a fragment to a packet set up with xdp_buff_init_frags().  The
+ * reference on @page is handed over to the xdp_buff and is released
+ * through the memory model of the RX queue.
+ */
+static inline bool xdp_buff_add_frag(struct xdp_buff *xdp, struct page *page,
+				     u32 off, u32 size)
+{
+	struct skb_shared_info *sinfo = xdp_get_shared_info_from_buff(xdp);
+	skb_frag_t *frag;
+
+	if (unlikely(sinfo->nr_frags >= MAX_SKB_FRAGS))
+		return false;
+
+	frag = &sinfo->frags[sinfo->nr_frags++];
+	frag->page.p = page;
+	frag->page_offset = off;
+	skb_frag_size_set(frag, size);
+	return true;
+}
+
+static inline unsigned int
+xdp_get_frags_len(const struct skb_shared_info *sinfo)
+{
+	unsigned int len = 0;
+	int i;
+
+	for (i = 0; i < sinfo->nr_frags; i++)
+		len += skb_frag_size(&sinfo->frags[i]);
+
+	return len;
+}
+
+/* Length of the packet, head and fragments included */
+static inline unsigned int xdp_get_buff_len(const struct xdp_buff *xdp)
+{
+	unsigned int len = xdp->data_end - xdp->data;
+
+	if (unlikely(xdp_buff_has_frags(xdp)))
+		len += xdp_get_frags_len(xdp_get_shared_info_from_buff(xdp));
+
+	return len;
+}
+
 struct xdp_frame {
 	void *data;
 	u16 len;
@@ -82,8 +207,25 @@ struct xdp_frame {
 	 */
 	struct xdp_mem_info mem;
 	struct net_device *dev_rx; /* used by cpumap */
+	u32 frame_sz;
+	u32 flags; /* supported values defined in xdp_buff_flags */
 };
 
+static __always_inline bool xdp_frame_has_frags(const struct xdp_frame *frame)
+{
+	return !!(frame->flags & XDP_FLAGS_HAS_FRAGS);
+}
+
+/* The xdp_frame sits at data_hard_start, so the head buffer starts there */
+static __always_inline struct skb_shared_info *
+xdp_get_shared_info_from_frame(const struct xdp_frame *frame)
+{
+	void *data_hard_start = (void *)frame;
+
+	return data_hard_start + frame->frame_sz -
+	       SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+}
+
 /* Clear kernel pointers in xdp_frame */
 static inline void xdp_scrub_frame(struct xdp_frame *frame)
 {
@@ -92,33 +234,58 @@ static inline void xdp_scrub_frame(struct xdp_frame *frame)
 }
 
 struct xdp_frame *xdp_convert_zc_to_xdp_frame(struct xdp_buff *xdp);
+struct xdp_frame *xdpf_clone(struct xdp_frame *xdpf);
 
-/* Convert xdp_buff to xdp_frame */
-static inline
-struct xdp_frame *convert_to_xdp_frame(struct xdp_buff *xdp)
+/* Rebuild an xdp_buff from a frame, e.g. to run a program on it again */
+static inline void xdp_convert_frame_to_buff(struct xdp_frame *frame,
+					     struct xdp_buff *xdp)
+{
+	xdp->data_hard_start = frame;
+	xdp->data = frame->data;
+	xdp->data_end = frame->data + frame->len;
+	xdp->data_meta = frame->data - frame->metasize;
+	xdp->frame_sz = frame->frame_sz;
+	xdp->flags = frame->flags;
+}
+
+static inline int xdp_update_frame_from_buff(struct xdp_buff *xdp,
+					     struct xdp_frame *xdp_frame)
 {
-	struct xdp_frame *xdp_frame;
 	int metasize;
 	int headroom;
 
-	if (xdp->rxq->mem.type == MEM_TYPE_ZERO_COPY)
-		return xdp_convert_zc_to_xdp_frame(xdp);
-
 	/* Assure headroom is available for storing info */
 	headroom = xdp->data - xdp->data_hard_start;
 	metasize = xdp->data - xdp->data_meta;
 	metasize = metasize > 0 ? metasize : 0;
 	if (unlikely((headroom - metasize) < sizeof(*xdp_frame)))
-		return NULL;
-
-	/* Store info in top of packet */
-	xdp_frame = xdp->data_hard_start;
+		return -ENOSPC;
 
 	xdp_frame->data = xdp->data;
 	xdp_frame->len  = xdp->data_end - xdp->data;
 	xdp_frame->headroom = headroom - sizeof(*xdp_frame);
 	xdp_frame->metasize = metasize;
 
+	xdp_frame->frame_sz = xdp->frame_sz;
+	xdp_frame->flags = xdp->flags & ~XDP_FLAGS_RX_META;
+
+	return 0;
+}
+
+/* Convert xdp_buff to xdp_frame */
+static inline
+struct xdp_frame *convert_to_xdp_frame(struct xdp_buff *xdp)
+{
+	struct xdp_frame *xdp_frame;
+
+	if (xdp->rxq->mem.type == MEM_TYPE_ZERO_COPY)
+		return xdp_convert_zc_to_xdp_frame(xdp);
+
+	/* Store info in top of packet */
+	xdp_frame = xdp->data_hard_start;
+	if (unlikely(xdp_update_frame_from_buff(xdp, xdp_frame) < 0))
+		return NULL;
+
 	/* rxq only valid until napi_schedule ends, convert to xdp_mem_info */
 	xdp_frame->mem = xdp->rxq->mem;
 
@@ -128,6 +295,7 @@ struct xdp_frame *convert_to_xdp_frame(struct xdp_buff *xdp)
 void xdp_return_frame(struct xdp_frame *xdpf);
 void xdp_return_frame_rx_napi(struct xdp_frame *xdpf);
 void xdp_return_buff(struct xdp_buff *xdp);
+void xdp_return_buff_frag(struct xdp_buff *xdp, skb_frag_t *frag);
 
 int xdp_rxq_info_reg(struct xdp_rxq_info *xdp_rxq,
 		     struct net_device *dev, u32 queue_index);
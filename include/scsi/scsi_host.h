@@ -556,7 +556,8 @@ struct Scsi_Host {
 		struct blk_mq_tag_set	tag_set;
 	};
 
-	atomic_t host_busy;		   /* commands actually active on low-level */
+	/* commands actually active on low-level, not used with blk-mq */
+	atomic_t host_busy;
 	atomic_t host_blocked;
 
 	unsigned int host_failed;	   /* commands that failed.
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+#if !defined(_TRACE_READAHEAD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_READAHEAD_H
+
+#include <linux/fs.h>
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(readahead_ondemand,
+
+	TP_PROTO(struct address_space *mapping, struct file_ra_state *ra,
+		pgoff_t offset, unsigned long req_size, bool marker),
+
+	TP_ARGS(mapping, ra, offset, req_size, marker),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, ino)
+		__field(pgoff_t, offset)
+		__field(unsigned long, req_size)
+		__field(pgoff_t, start)
+		__field(unsigned int, size)
+		__field(unsigned int, async_size)
+		__field(unsigned int, ra_pages)
+		__field(bool, marker)
+	),
+
+	TP_fast_assign(
+		__entry->dev = mapping->host->i_sb->s_dev;
+		__entry->ino = mapping->host->i_ino;
+		__entry->offset = offset;
+		__entry->req_size = req_size;
+		__entry->start = ra->start;
+		__entry->size = ra->size;
+		__entry->async_size = ra->async_size;
+		__entry->ra_pages = ra->ra_pages;
+		__entry->marker = marker;
+	),
+
+	TP_printk("dev=%d:%d ino=%lx offset=%lu req_size=%lu%s start=%lu size=%u async_size=%u ra_pages=%u",
+		MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+		__entry->offset, __entry->req_size,
+		__entry->marker ? " marker" : "",
+		__entry->start, __entry->size, __entry->async_size,
+		__entry->ra_pages)
+);
+
+TRACE_EVENT(readahead_adjust,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		unsigned int old_pages, unsigned int new_pages, bool thrash),
+
+	TP_ARGS(mapping, offset, old_pages, new_pages, thrash),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, ino)
+		__field(pgoff_t, offset)
+		__field(unsigned int, old_pages)
+		__field(unsigned int, new_pages)
+		__field(bool, thrash)
+	),
+
+	TP_fast_assign(
+		__entry->dev = mapping->host->i_sb->s_dev;
+		__entry->ino = mapping->host->i_ino;
+		__entry->offset = offset;
+		__entry->old_pages = old_pages;
+		__entry->new_pages = new_pages;
+		__entry->thrash = thrash;
+	),
+
+	TP_printk("dev=%d:%d ino=%lx offset=%lu %s ra_pages=%u->%u",
+		MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+		__entry->offset, __entry->thrash ? "thrash" : "stall",
+		__entry->old_pages, __entry->new_pages)
+);
+
+#endif /* _TRACE_READAHEAD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -738,9 +738,29 @@ __SYSCALL(__NR_statx,     sys_statx)
 __SC_COMP(__NR_io_pgetevents, sys_io_pgetevents, compat_sys_io_pgetevents)
 #define __NR_rseq 293
 __SYSCALL(__NR_rseq, sys_rseq)
+#define __NR_process_madvise 294
+__SC_COMP(__NR_process_madvise, sys_process_madvise, compat_sys_process_madvise)
+#define __NR_futex_waitv 295
+__SYSCALL(__NR_futex_waitv, sys_futex_waitv)
+#define __NR_io_uring_setup 296
+__SYSCALL(__NR_io_uring_setup, sys_io_uring_setup)
+#define __NR_io_uring_enter 297
+__SYSCALL(__NR_io_uring_enter, sys_io_uring_enter)
+#define __NR_io_uring_register 298
+__SYSCALL(__NR_io_uring_register, sys_io_uring_register)
+#define __NR_openat2 299
+__SYSCALL(__NR_openat2, sys_openat2)
+#define __NR_close_range 300
+__SYSCALL(__NR_close_range, sys_close_range)
+#define __NR_getdents_statx 301
+__SYSCALL(__NR_getdents_statx, sys_getdents_statx)
+#define __NR_clone3 302
+#ifdef __ARCH_WANT_SYS_CLONE3
+__SYSCALL(__NR_clone3, sys_clone3)
+#endif
 
 #undef __NR_syscalls
-#define __NR_syscalls 294
+#define __NR_syscalls 303
 
 /*
  * 32 bit systems traditionally used different
@@ -104,6 +104,12 @@ enum bpf_cmd {
 	BPF_BTF_GET_FD_BY_ID,
 	BPF_TASK_FD_QUERY,
 	BPF_MAP_LOOKUP_AND_DELETE_ELEM,
+	BPF_MAP_LOOKUP_BATCH,
+	BPF_MAP_LOOKUP_AND_DELETE_BATCH,
+	BPF_MAP_UPDATE_BATCH,
+	BPF_MAP_DELETE_BATCH,
+	BPF_ITER_CREATE,
+	BPF_MAP_FREEZE,
 };
 
 enum bpf_map_type {
@@ -131,6 +137,10 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_PERCPU_CGROUP_STORAGE,
 	BPF_MAP_TYPE_QUEUE,
 	BPF_MAP_TYPE_STACK,
+	BPF_MAP_TYPE_RINGBUF,
+	BPF_MAP_TYPE_SK_STORAGE,
+	BPF_MAP_TYPE_TASK_STORAGE,
+	BPF_MAP_TYPE_RHASH,
 };
 
 enum bpf_prog_type {
@@ -157,6 +167,7 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_LIRC_MODE2,
 	BPF_PROG_TYPE_SK_REUSEPORT,
 	BPF_PROG_TYPE_FLOW_DISSECTOR,
+	BPF_PROG_TYPE_TRACING,
 };
 
 enum bpf_attach_type {
@@ -178,6 +189,10 @@ enum bpf_attach_type {
 	BPF_CGROUP_UDP6_SENDMSG,
 	BPF_LIRC_MODE2,
 	BPF_FLOW_DISSECTOR,
+	BPF_XDP_DEVMAP,
+	BPF_TRACE_FENTRY,
+	BPF_TRACE_FEXIT,
+	BPF_TRACE_ITER,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -232,8 +247,20 @@ enum bpf_attach_type {
  */
 #define BPF_F_STRICT_ALIGNMENT	(1U << 0)
 
+/* If BPF_F_XDP_HAS_FRAGS is used in BPF_PROG_LOAD command, the XDP
+ * program declares that it can handle multi-buffer packets, i.e. it
+ * does not assume that data_end marks the end of the packet and uses
+ * the frags aware helpers to reach the rest of it.
+ */
+#define BPF_F_XDP_HAS_FRAGS	(1U << 1)
+
 /* when bpf_ldimm64->src_reg == BPF_PSEUDO_MAP_FD, bpf_ldimm64->imm == fd */
 #define BPF_PSEUDO_MAP_FD	1
+/* when bpf_ldimm64->src_reg == BPF_PSEUDO_MAP_VALUE, bpf_ldimm64->imm == fd
+ * and the imm of the second half is an offset in the value: the insn loads
+ * the address of the value at that offset, of a map with one element
+ */
+#define BPF_PSEUDO_MAP_VALUE	2
 
 /* when bpf_call->src_reg == BPF_PSEUDO_CALL, bpf_call->imm == pc-relative
  * offset to another bpf function
@@ -269,6 +296,16 @@ enum bpf_attach_type {
 /* Flag for stack_map, store build_id+offset instead of pointer */
 #define BPF_F_STACK_BUILD_ID	(1U << 5)
 
+/* Flag for array map, allocate values in pages that user space can mmap()
+ * through the map fd
+ */
+#define BPF_F_MMAPABLE		(1U << 6)
+
+/* Flag for sockmap and sockhash, data sent between the two ends of a TCP
+ * connection on this host, both in such maps, skips the TCP/IP stack
+ */
+#define BPF_F_SOCK_BYPASS	(1U << 7)
+
 enum bpf_stack_build_id_status {
 	/* user space need an empty entry to identify end of a trace */
 	BPF_STACK_BUILD_ID_EMPTY = 0,
@@ -318,6 +355,28 @@ union bpf_attr {
 		__u64		flags;
 	};
 
+	struct { /* struct used by BPF_MAP_*_BATCH commands */
+		__aligned_u64	in_batch;	/* start batch,
+						 * NULL to start from beginning
+						 */
+		__aligned_u64	out_batch;	/* output: next start batch */
+		__aligned_u64	keys;
+		__aligned_u64	values;
+		__u32		count;		/* input/output:
+						 * input: # of key/value
+						 * elements
+						 * output: # of filled elements
+						 */
+		__u32		map_fd;
+		__u64		elem_flags;
+		__u64		flags;
+	} batch;
+
+	struct { /* struct used by BPF_ITER_CREATE command */
+		__u32		link_fd;
+		__u32		flags;
+	} iter_create;
+
 	struct { /* anonymous struct used by BPF_PROG_LOAD command */
 		__u32		prog_type;	/* one of enum bpf_prog_type */
 		__u32		insn_cnt;
@@ -388,7 +447,7 @@ union bpf_attr {
 	} query;
 
 	struct {
-		__u64 name;
+		__u64 name;	/* tracepoint, or traced function */
 		__u32 prog_fd;
 	} raw_tracepoint;
 
@@ -1488,8 +1547,12 @@ union bpf_attr {
  * 		but this is only implemented for native XDP (with driver
  * 		support) as of this writing).
  *
- * 		All values for *flags* are reserved for future usage, and must
- * 		be left at zero.
+ * 		With a **BPF_MAP_TYPE_DEVMAP**, **BPF_F_BROADCAST** may be
+ * 		passed in *flags* to send a copy of the packet to every
+ * 		device in *map*, ignoring *key*. **BPF_F_EXCLUDE_INGRESS**
+ * 		can be added to leave out the device the packet came in on.
+ * 		All other values for *flags* are reserved for future usage,
+ * 		and must be left at zero.
  *
  * 		When used to redirect packets to net devices, this helper
  * 		provides a high performance increase over **bpf_redirect**\ ().
@@ -2265,6 +2328,179 @@ union bpf_attr {
  *
  *	Return
  *		0 on success, or a negative error in case of failure.
+ *
+ * u64 bpf_xdp_get_buff_len(struct xdp_buff *xdp_md)
+ *	Description
+ *		Get the total size of the packet described by *xdp_md*,
+ *		including the fragments of a multi-buffer packet.
+ *	Return
+ *		The length of the packet.
+ *
+ * int bpf_xdp_load_bytes(struct xdp_buff *xdp_md, u32 offset, void *buf, u32 len)
+ *	Description
+ *		This helper is provided as an easy way to load data from a
+ *		xdp buffer. It can be used to load *len* bytes from *offset*
+ *		from the frame associated to *xdp_md*, into the buffer
+ *		pointed by *buf*. Unlike direct packet access, it can reach
+ *		the data held in the fragments of a multi-buffer packet.
+ *	Return
+ *		0 on success, or a negative error in case of failure.
+ *
+ * int bpf_xdp_store_bytes(struct xdp_buff *xdp_md, u32 offset, void *buf, u32 len)
+ *	Description
+ *		Store *len* bytes from buffer *buf* into the frame
+ *		associated to *xdp_md*, at *offset*. Unlike direct packet
+ *		access, it can reach the data held in the fragments of a
+ *		multi-buffer packet.
+ *	Return
+ *		0 on success, or a negative error in case of failure.
+ *
+ * int bpf_xdp_metadata_rx_timestamp(struct xdp_buff *xdp_md, u64 *timestamp, u32 size)
+ *	Description
+ *		Read the hardware receive timestamp of the packet described
+ *		by *xdp_md*, as reported by the driver, into *timestamp*.
+ *		*size* must be **sizeof**\ (*u64*).
+ *	Return
+ *		0 on success, or a negative error in case of failure. In
+ *		particular **-EOPNOTSUPP** if the driver does not implement
+ *		it and **-ENODATA** if no timestamp is available for this
+ *		packet. On failure *timestamp* is zeroed.
+ *
+ * int bpf_xdp_metadata_rx_hash(struct xdp_buff *xdp_md, struct bpf_xdp_rx_hash *hash, u32 size)
+ *	Description
+ *		Read the receive hash the device computed for the packet
+ *		described by *xdp_md*, along with the headers it covered
+ *		(one of the **XDP_RSS_TYPE_\*** values), into *hash*.
+ *		*size* must be **sizeof**\ (**struct bpf_xdp_rx_hash**).
+ *
+ *		This saves the program from recomputing a flow hash the
+ *		hardware already provides.
+ *	Return
+ *		0 on success, or a negative error in case of failure, see
+ *		**bpf_xdp_metadata_rx_timestamp**\ ().
+ *
+ * int bpf_xdp_metadata_rx_vlan_tag(struct xdp_buff *xdp_md, struct bpf_xdp_rx_vlan *vlan, u32 size)
+ *	Description
+ *		Read the VLAN tag the device stripped from the packet
+ *		described by *xdp_md* into *vlan*. *size* must be
+ *		**sizeof**\ (**struct bpf_xdp_rx_vlan**).
+ *	Return
+ *		0 on success, or a negative error in case of failure, see
+ *		**bpf_xdp_metadata_rx_timestamp**\ ().
+ *
+ * int bpf_ringbuf_output(void *ringbuf, void *data, u64 size, u64 flags)
+ *	Description
+ *		Copy *size* bytes from *data* into a new record of the ring
+ *		buffer *ringbuf*. Unless **BPF_RB_NO_WAKEUP** is set in
+ *		*flags*, the consumer is notified of the new data only if it
+ *		has already caught up with the previous records, which keeps
+ *		the wakeup cost off the hot path; **BPF_RB_FORCE_WAKEUP**
+ *		notifies it unconditionally.
+ *	Return
+ *		0 on success, or a negative error in case of failure, in
+ *		particular **-EAGAIN** if the ring buffer is full.
+ *
+ * void *bpf_ringbuf_reserve(void *ringbuf, u64 size, u64 flags)
+ *	Description
+ *		Reserve *size* bytes of payload in the ring buffer *ringbuf*,
+ *		so that the program can build the record in place, without
+ *		an intermediate copy. *size* must be a known constant, and
+ *		*flags* must be 0.
+ *
+ *		The record is invisible to the consumer, and holds back the
+ *		ones reserved after it, until it is passed to either
+ *		**bpf_ringbuf_submit**\ () or **bpf_ringbuf_discard**\ ().
+ *		The verifier makes sure that every reservation is released
+ *		on all paths.
+ *	Return
+ *		A pointer to the reserved memory, or **NULL** if the ring
+ *		buffer is full.
+ *
+ * void bpf_ringbuf_submit(void *data, u64 flags)
+ *	Description
+ *		Commit the record *data*, previously reserved with
+ *		**bpf_ringbuf_reserve**\ (). *flags* are the wakeup flags of
+ *		**bpf_ringbuf_output**\ ().
+ *	Return
+ *		Nothing. Always succeeds.
+ *
+ * void bpf_ringbuf_discard(void *data, u64 flags)
+ *	Description
+ *		Release the record *data*, previously reserved with
+ *		**bpf_ringbuf_reserve**\ (), without handing it to the
+ *		consumer, which just skips it. *flags* are the wakeup flags
+ *		of **bpf_ringbuf_output**\ ().
+ *	Return
+ *		Nothing. Always succeeds.
+ *
+ * u64 bpf_ringbuf_query(void *ringbuf, u64 flags)
+ *	Description
+ *		Query the state of the ring buffer *ringbuf*, *flags* selects
+ *		one of:
+ *
+ *		* **BPF_RB_AVAIL_DATA**: amount of data not yet consumed.
+ *		* **BPF_RB_RING_SIZE**: size of the data area.
+ *		* **BPF_RB_CONS_POS**: consumer position.
+ *		* **BPF_RB_PROD_POS**: producer position.
+ *
+ *		The positions can wrap around, and the values are only a
+ *		snapshot, which can change right away: they are meant for
+ *		heuristics, such as sizing the next records.
+ *	Return
+ *		The requested value, or 0 if *flags* is invalid.
+ *
+ * int bpf_seq_write(void *ctx, const void *data, u32 len)
+ *	Description
+ *		Append *len* bytes from *data* to the output of the BPF
+ *		iterator program which got *ctx* as context. The output is
+ *		what readers of the iterator file get.
+ *	Return
+ *		0 on success, or **-EOVERFLOW** if the output buffer is full;
+ *		the program is then run again for the same object with a
+ *		larger buffer.
+ *
+ * void *bpf_sk_storage_get(struct bpf_map *map, void *sk, void *value, u64 flags)
+ *	Description
+ *		Get the value of the socket *sk* in *map*, of type
+ *		**BPF_MAP_TYPE_SK_STORAGE**. *sk* is a socket returned by
+ *		**bpf_sk_lookup_tcp**\ () or **bpf_sk_lookup_udp**\ (), or
+ *		for cgroup skb and sock_ops programs, their context, which
+ *		stands for the socket of the packet or of the operation.
+ *
+ *		With **BPF_LOCAL_STORAGE_GET_F_CREATE** in *flags*, a value
+ *		is created if there's none yet, initialized from *value*, or
+ *		zeroed if *value* is NULL.
+ *
+ *		The value is freed along with the socket.
+ *	Return
+ *		A pointer to the value, or NULL if there's none, it couldn't
+ *		be created or *sk* isn't a full socket.
+ *
+ * int bpf_sk_storage_delete(struct bpf_map *map, void *sk)
+ *	Description
+ *		Delete the value of the socket *sk* in *map*, where *sk* is
+ *		as for **bpf_sk_storage_get**\ ().
+ *	Return
+ *		0 on success, or **-ENOENT** if there's no value.
+ *
+ * void *bpf_task_storage_get(struct bpf_map *map, void *value, u64 flags)
+ *	Description
+ *		Get the value of the current task in *map*, of type
+ *		**BPF_MAP_TYPE_TASK_STORAGE**. *value* and *flags* are as
+ *		for **bpf_sk_storage_get**\ ().
+ *
+ *		The value is freed along with the task.
+ *	Return
+ *		A pointer to the value, or NULL if there's none or it
+ *		couldn't be created.
+ *
+ * int bpf_task_storage_delete(struct bpf_map *map)
+ *	Description
+ *		Delete the value of the current task in *map*.
+ *	Return
+ *		0 on success, **-ENOENT** if there's no value, or **-EBUSY**
+ *		if the storage of the task is being updated on this CPU,
+ *		by the program this one interrupted.
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -2357,7 +2593,23 @@ union bpf_attr {
 	FN(map_push_elem),		\
 	FN(map_pop_elem),		\
 	FN(map_peek_elem),		\
-	FN(msg_push_data),
+	FN(msg_push_data),		\
+	FN(xdp_get_buff_len),		\
+	FN(xdp_load_bytes),		\
+	FN(xdp_store_bytes),		\
+	FN(xdp_metadata_rx_timestamp),	\
+	FN(xdp_metadata_rx_hash),	\
+	FN(xdp_metadata_rx_vlan_tag),	\
+	FN(ringbuf_output),		\
+	FN(ringbuf_reserve),		\
+	FN(ringbuf_submit),		\
+	FN(ringbuf_discard),		\
+	FN(ringbuf_query),		\
+	FN(seq_write),			\
+	FN(sk_storage_get),		\
+	FN(sk_storage_delete),		\
+	FN(task_storage_get),		\
+	FN(task_storage_delete),
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
  * function eBPF program intends to call
@@ -2388,6 +2640,10 @@ enum bpf_func_id {
 /* BPF_FUNC_clone_redirect and BPF_FUNC_redirect flags. */
 #define BPF_F_INGRESS			(1ULL << 0)
 
+/* BPF_FUNC_redirect_map flags. */
+#define BPF_F_BROADCAST			(1ULL << 0)
+#define BPF_F_EXCLUDE_INGRESS		(1ULL << 1)
+
 /* BPF_FUNC_skb_set_tunnel_key and BPF_FUNC_skb_get_tunnel_key flags. */
 #define BPF_F_TUNINFO_IPV6		(1ULL << 0)
 
@@ -2416,6 +2672,32 @@ enum bpf_func_id {
 /* Current network namespace */
 #define BPF_F_CURRENT_NETNS		(-1L)
 
+/* BPF_FUNC_ringbuf_output, BPF_FUNC_ringbuf_submit and
+ * BPF_FUNC_ringbuf_discard flags.
+ */
+#define BPF_RB_NO_WAKEUP		(1ULL << 0)
+#define BPF_RB_FORCE_WAKEUP		(1ULL << 1)
+
+/* BPF_FUNC_ringbuf_query flags. */
+enum {
+	BPF_RB_AVAIL_DATA = 0,
+	BPF_RB_RING_SIZE = 1,
+	BPF_RB_CONS_POS = 2,
+	BPF_RB_PROD_POS = 3,
+};
+
+/* Each BPF_MAP_TYPE_RINGBUF record starts with an 8 byte header: the
+ * length of the payload, which follows it, with the BUSY bit set while
+ * the record is reserved but not yet committed, and the DISCARD bit set
+ * if the consumer should skip it. Records are 8 byte aligned.
+ */
+#define BPF_RINGBUF_BUSY_BIT		(1U << 31)
+#define BPF_RINGBUF_DISCARD_BIT		(1U << 30)
+#define BPF_RINGBUF_HDR_SZ		8
+
+/* BPF_FUNC_sk_storage_get and BPF_FUNC_task_storage_get flags. */
+#define BPF_LOCAL_STORAGE_GET_F_CREATE	(1ULL << 0)
+
 /* Mode for BPF_FUNC_skb_adjust_room helper. */
 enum bpf_adj_room_mode {
 	BPF_ADJ_ROOM_NET,
@@ -2578,6 +2860,76 @@ struct xdp_md {
 	/* Below access go through struct xdp_rxq_info */
 	__u32 ingress_ifindex; /* rxq->dev->ifindex */
 	__u32 rx_queue_index;  /* rxq->queue_index  */
+
+	__u32 egress_ifindex;  /* txq->dev->ifindex */
+};
+
+/* DEVMAP map-value layout
+ *
+ * The struct data-layout of map-value is a configuration interface.
+ * New members can only be added to the end of this structure.
+ */
+struct bpf_devmap_val {
+	__u32 ifindex;   /* device index */
+	union {
+		int   fd;  /* prog fd on map write */
+		__u32 id;  /* prog id on map read */
+	} bpf_prog;
+};
+
+/* Headers covered by the hash returned from bpf_xdp_metadata_rx_hash() */
+enum xdp_rss_hash_type {
+	/* First part: individual bits for L3/L4 types */
+	XDP_RSS_L3_IPV4		= 1U << 0,
+	XDP_RSS_L3_IPV6		= 1U << 1,
+	/* The fixed (L3) IPv4 and IPv6 headers can both be followed by
+	 * variable/dynamic headers, IPv4 called Options and IPv6 called
+	 * Extension Headers. HW RSS type can contain this info.
+	 */
+	XDP_RSS_L3_DYNHDR	= 1U << 2,
+	/* When RSS hash covers L4 then drivers MUST set XDP_RSS_L4 bit in
+	 * addition to the protocol specific bit.
+	 */
+	XDP_RSS_L4		= 1U << 3,
+	XDP_RSS_L4_TCP		= 1U << 4,
+	XDP_RSS_L4_UDP		= 1U << 5,
+	XDP_RSS_L4_SCTP		= 1U << 6,
+	XDP_RSS_L4_IPSEC	= 1U << 7,
+
+	/* Second part: RSS hash type combinations used for driver HW
+	 * mapping
+	 */
+	XDP_RSS_TYPE_NONE	= 0,
+	XDP_RSS_TYPE_L2		= XDP_RSS_TYPE_NONE,
+
+	XDP_RSS_TYPE_L3_IPV4	= XDP_RSS_L3_IPV4,
+	XDP_RSS_TYPE_L3_IPV6	= XDP_RSS_L3_IPV6,
+	XDP_RSS_TYPE_L3_IPV4_OPT = XDP_RSS_L3_IPV4 | XDP_RSS_L3_DYNHDR,
+	XDP_RSS_TYPE_L3_IPV6_EX	= XDP_RSS_L3_IPV6 | XDP_RSS_L3_DYNHDR,
+
+	XDP_RSS_TYPE_L4_ANY	= XDP_RSS_L4,
+	XDP_RSS_TYPE_L4_IPV4_TCP = XDP_RSS_L3_IPV4 | XDP_RSS_L4 |
+				   XDP_RSS_L4_TCP,
+	XDP_RSS_TYPE_L4_IPV4_UDP = XDP_RSS_L3_IPV4 | XDP_RSS_L4 |
+				   XDP_RSS_L4_UDP,
+	XDP_RSS_TYPE_L4_IPV4_SCTP = XDP_RSS_L3_IPV4 | XDP_RSS_L4 |
+				    XDP_RSS_L4_SCTP,
+	XDP_RSS_TYPE_L4_IPV6_TCP = XDP_RSS_L3_IPV6 | XDP_RSS_L4 |
+				   XDP_RSS_L4_TCP,
+	XDP_RSS_TYPE_L4_IPV6_UDP = XDP_RSS_L3_IPV6 | XDP_RSS_L4 |
+				   XDP_RSS_L4_UDP,
+	XDP_RSS_TYPE_L4_IPV6_SCTP = XDP_RSS_L3_IPV6 | XDP_RSS_L4 |
+				    XDP_RSS_L4_SCTP,
+};
+
+struct bpf_xdp_rx_hash {
+	__u32 hash;
+	__u32 rss_type;	/* enum xdp_rss_hash_type */
+};
+
+struct bpf_xdp_rx_vlan {
+	__be16 vlan_proto;
+	__u16 vlan_tci;	/* PCP, DEI and VID */
 };
 
 enum sk_action {
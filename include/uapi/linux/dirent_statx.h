@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_DIRENT_STATX_H
+#define _UAPI_LINUX_DIRENT_STATX_H
+
+#include <linux/types.h>
+#include <linux/stat.h>
+
+/*
+ * Record returned by getdents_statx().  Each record is padded to a multiple
+ * of 8 bytes and d_reclen gives the distance to the next one.
+ *
+ * d_stat is only valid if d_stat_err is zero; otherwise d_stat_err holds the
+ * negative errno that statx() would have returned for the entry (for
+ * instance -ENOENT if it was unlinked after being read).
+ */
+struct linux_dirent_statx {
+	__u64		d_ino;
+	__s64		d_off;
+	__u16		d_reclen;
+	__u8		d_type;
+	__u8		__pad;
+	__s32		d_stat_err;
+	struct statx	d_stat;
+	char		d_name[];
+};
+
+#endif /* _UAPI_LINUX_DIRENT_STATX_H */
@@ -18,6 +18,7 @@
 /* For O_CLOEXEC */
 #include <linux/fcntl.h>
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /* Flags for epoll_create1.  */
 #define EPOLL_CLOEXEC O_CLOEXEC
@@ -79,6 +80,30 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/*
+ * Per-instance busy poll parameters, set and read with the EPIOCSPARAMS
+ * and EPIOCGPARAMS ioctls on an epoll file descriptor.
+ *
+ * @busy_poll_usecs: how long epoll_wait() busy polls the NAPI context of
+ *                   the ready sockets; 0 falls back to net.core.busy_poll.
+ * @busy_poll_budget: packets processed per NAPI poll; 0 is the default.
+ * @prefer_busy_poll: 1 to keep device interrupts deferred (per the device's
+ *                    napi_defer_hard_irqs and gro_flush_timeout) while this
+ *                    instance busy polls.
+ */
+struct epoll_params {
+	__u32 busy_poll_usecs;
+	__u16 busy_poll_budget;
+	__u8 prefer_busy_poll;
+
+	/* pad the struct to a multiple of 64bits */
+	__u8 __pad;
+};
+
+#define EPOLL_IOC_TYPE 0x8A
+#define EPIOCSPARAMS _IOW(EPOLL_IOC_TYPE, 0x01, struct epoll_params)
+#define EPIOCGPARAMS _IOR(EPOLL_IOC_TYPE, 0x02, struct epoll_params)
+
 #ifdef CONFIG_PM_SLEEP
 static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
 {
@@ -386,8 +386,14 @@ typedef int __bitwise __kernel_rwf_t;
 /* per-IO O_APPEND */
 #define RWF_APPEND	((__force __kernel_rwf_t)0x00000010)
 
+/* per-IO, drop the page cache used by this I/O once it has completed */
+#define RWF_UNCACHED	((__force __kernel_rwf_t)0x00000020)
+
+/* per-IO, copy read data to user space without filling the CPU caches */
+#define RWF_NOCACHE_COPY	((__force __kernel_rwf_t)0x00000040)
+
 /* mask of flags supported by the kernel */
 #define RWF_SUPPORTED	(RWF_HIPRI | RWF_DSYNC | RWF_SYNC | RWF_NOWAIT |\
-			 RWF_APPEND)
+			 RWF_APPEND | RWF_UNCACHED | RWF_NOCACHE_COPY)
 
 #endif /* _UAPI_LINUX_FS_H */
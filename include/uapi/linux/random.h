@@ -53,4 +53,29 @@ struct rand_pool_info {
 #define GRND_NONBLOCK	0x0001
 #define GRND_RANDOM	0x0002
 
+/**
+ * struct vgetrandom_opaque_params - arguments for allocating memory for
+ * the vDSO getrandom() state
+ *
+ * @size_of_opaque_state:	Size of each state that is to be passed to
+ *				the vDSO getrandom().
+ * @mmap_prot:			Value of the prot argument to mmap(2).
+ * @mmap_flags:			Value of the flags argument to mmap(2).
+ * @madvise_advice:		Advice to apply with madvise(2) to the
+ *				mapping before use, zero entries are unused.
+ * @reserved:			Reserved for future use.
+ *
+ * Filled in by the vDSO getrandom() when called with a NULL buffer, a zero
+ * length and flags, and an opaque_len of ~0UL.  User space maps an array
+ * of states with these parameters, typically one per thread, and passes
+ * one of them to each call.
+ */
+struct vgetrandom_opaque_params {
+	__u32 size_of_opaque_state;
+	__u32 mmap_prot;
+	__u32 mmap_flags;
+	__u32 madvise_advice[2];
+	__u32 reserved[11];
+};
+
 #endif /* _UAPI_LINUX_RANDOM_H */
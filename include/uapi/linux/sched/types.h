@@ -9,6 +9,8 @@ struct sched_param {
 };
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+#define SCHED_ATTR_SIZE_VER1	56	/* add: util_{min,max} */
+#define SCHED_ATTR_SIZE_VER2	60	/* add: sched_latency_nice */
 
 /*
  * Extended scheduling parameters data structure.
@@ -46,6 +48,30 @@ struct sched_param {
  *  @sched_runtime	representative of the task's runtime
  *  @sched_period	representative of the task's period
  *
+ * Task Utilization Attributes
+ * ===========================
+ *
+ * A subset of sched_attr attributes allows to specify the utilization
+ * expected for a task. These attributes allow to inform the scheduler about
+ * the utilization boundaries within which it should schedule the task. These
+ * boundaries are valuable hints to support scheduler decisions on both task
+ * placement and frequency selection.
+ *
+ *  @sched_util_min	represents the minimum utilization
+ *  @sched_util_max	represents the maximum utilization
+ *
+ * Utilization is a value in the range [0..SCHED_CAPACITY_SCALE]. It
+ * represents the percentage of CPU time used by a task when running at the
+ * maximum frequency on the highest capacity CPU of the system. For example, a
+ * 20% utilization task is a task running for 2ms every 10ms at maximum
+ * frequency.
+ *
+ * They are used when SCHED_FLAG_UTIL_CLAMP_MIN, or _MAX, is set, and
+ * looked at for all the scheduling policies but SCHED_DEADLINE.
+ *
+ *  @sched_latency_nice	task's latency nice value (SCHED_NORMAL/BATCH),
+ *			used when SCHED_FLAG_LATENCY_NICE is set
+ *
  * Given this task model, there are a multiplicity of scheduling algorithms
  * and policies, that can be used to ensure all the tasks will make their
  * timing constraints.
@@ -70,6 +96,13 @@ struct sched_attr {
 	__u64 sched_runtime;
 	__u64 sched_deadline;
 	__u64 sched_period;
+
+	/* Utilization hints */
+	__u32 sched_util_min;
+	__u32 sched_util_max;
+
+	/* SCHED_NORMAL, SCHED_BATCH */
+	__s32 sched_latency_nice;
 };
 
 #endif /* _UAPI_LINUX_SCHED_TYPES_H */
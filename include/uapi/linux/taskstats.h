@@ -34,7 +34,7 @@
  */
 
 
-#define TASKSTATS_VERSION	9
+#define TASKSTATS_VERSION	10
 #define TS_COMM_LEN		32	/* should be >= TASK_COMM_LEN
 					 * in linux/sched.h */
 
@@ -168,6 +168,27 @@ struct taskstats {
 	/* Delay waiting for thrashing page */
 	__u64	thrashing_count;
 	__u64	thrashing_delay_total;
+	/* version 9 ends here */
+
+	/* Delay waiting for direct memory compaction */
+	__u64	compact_count;
+	__u64	compact_delay_total;
+
+	/* Delay waiting for the lock or writeback of a page cache page,
+	 * other than for a thrashing page
+	 */
+	__u64	pagewait_count;
+	__u64	pagewait_delay_total;
+
+	/* The longest single delay of each of the stats above, in
+	 * nanoseconds; of all the threads for a thread group
+	 */
+	__u64	blkio_delay_max;
+	__u64	swapin_delay_max;
+	__u64	freepages_delay_max;
+	__u64	thrashing_delay_max;
+	__u64	compact_delay_max;
+	__u64	pagewait_delay_max;
 };
 
 
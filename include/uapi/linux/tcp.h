@@ -124,6 +124,7 @@ enum {
 #define TCP_FASTOPEN_NO_COOKIE	34	/* Enable TFO without a TFO cookie */
 #define TCP_ZEROCOPY_RECEIVE	35
 #define TCP_INQ			36	/* Notify bytes available to read as a cmsg on read */
+#define TCP_ACCEPT_PERCPU	37	/* Per-CPU accept queues on a listener */
 
 #define TCP_CM_INQ		TCP_INQ
 
@@ -298,5 +299,10 @@ struct tcp_zerocopy_receive {
 	__u64 address;		/* in: address of mapping */
 	__u32 length;		/* in/out: number of bytes to map/mapped */
 	__u32 recv_skip_hint;	/* out: amount of bytes to skip */
+	__u32 inq;		/* out: amount of bytes in read queue */
+	__s32 err;		/* out: socket error */
+	__u64 copybuf_address;	/* in: buffer for data that cannot be mapped */
+	__s32 copybuf_len;	/* in/out: copybuf size/bytes copied or error */
+	__u32 flags;		/* in: must be zero */
 };
 #endif /* _UAPI_LINUX_TCP_H */
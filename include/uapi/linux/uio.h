@@ -24,6 +24,29 @@ struct iovec
  *	UIO_MAXIOV shall be at least 16 1003.1g (5.4.1.1)
  */
  
+struct dmabuf_cmsg {
+	__u64 frag_offset;	/* offset of the frag in the dma-buf */
+	__u32 frag_size;	/* size of the frag */
+	__u32 frag_token;	/* token to give the frag back with
+				 * SO_DEVMEM_DONTNEED
+				 */
+	__u32 dmabuf_id;	/* dma-buf binding the frag belongs to */
+	__u32 flags;		/* currently unused */
+};
+
+struct dmabuf_token {
+	__u32 token_start;
+	__u32 token_count;
+};
+
+/* SO_DEVMEM_BIND: attach a dma-buf to a receive queue of a device */
+struct dmabuf_bind {
+	__u32 ifindex;
+	__u32 rxq_idx;
+	__s32 dmabuf_fd;
+	__u32 dmabuf_id;	/* returned by the kernel */
+};
+
 #define UIO_FASTIOV	8
 #define UIO_MAXIOV	1024
 
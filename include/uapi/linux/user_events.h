@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * User events: trace events registered and written by user space through
+ * the user_events_data and user_events_status files of tracefs.
+ */
+#ifndef _UAPI_LINUX_USER_EVENTS_H
+#define _UAPI_LINUX_USER_EVENTS_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define USER_EVENTS_SYSTEM "user_events"
+
+/* Bits of the status byte of an event, in the mmap()ed user_events_status
+ * page: the event is only worth writing while its byte is non-zero.
+ */
+#define EVENT_BIT_FTRACE 0
+#define EVENT_BIT_PERF 1
+
+#define EVENT_STATUS_FTRACE (1 << EVENT_BIT_FTRACE)
+#define EVENT_STATUS_PERF (1 << EVENT_BIT_PERF)
+
+/*
+ * Argument of DIAG_IOCSREG. name_args points to the description of the
+ * event, its name then its fields separated by ';', for example:
+ *	"my_event u32 count; char[16] comm; __data_loc char[] msg"
+ * The payload is laid out as a C struct of the fields. The value written
+ * for a __data_loc field is a u32 of the length of its data, NUL included,
+ * shifted by 16, or'ed with the offset of the data from the payload start.
+ *
+ * On return, status_index is the offset of the status byte of the event in
+ * the status page, and write_index the u32 to prefix the payloads written
+ * for the event to the data file with.
+ */
+struct user_reg {
+	/* size of this structure, for extensibility */
+	__u32 size;
+
+	/* pointer to the description of the event, a C string */
+	__u64 name_args;
+
+	/* output */
+	__u32 status_index;
+	__u32 write_index;
+};
+
+#define DIAG_IOC_MAGIC '*'
+
+/* register an event, or get the one of the same name */
+#define DIAG_IOCSREG _IOWR(DIAG_IOC_MAGIC, 0, struct user_reg *)
+
+/* delete an event by name, when no open data file refers to it anymore */
+#define DIAG_IOCSDEL _IOW(DIAG_IOC_MAGIC, 1, char *)
+
+#endif /* _UAPI_LINUX_USER_EVENTS_H */
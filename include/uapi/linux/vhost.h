@@ -28,6 +28,17 @@ struct vhost_vring_file {
 
 };
 
+struct vhost_worker_state {
+	/* CPU of the shared worker to use, -1 for a worker of the device's
+	 * own (the default).
+	 */
+	int cpu;
+	unsigned int flags;
+	/* Flag values: */
+	/* Poll the rings continuously instead of waiting for kicks */
+#define VHOST_WORKER_F_POLL 0x1
+};
+
 struct vhost_vring_addr {
 	unsigned int index;
 	/* Option flags. */
@@ -178,6 +189,12 @@ struct vhost_memory {
 #define VHOST_SET_BACKEND_FEATURES _IOW(VHOST_VIRTIO, 0x25, __u64)
 #define VHOST_GET_BACKEND_FEATURES _IOR(VHOST_VIRTIO, 0x26, __u64)
 
+/* Process the device on the worker thread shared by all the devices bound
+ * to the same CPU, in round-robin. Must be set before VHOST_SET_OWNER.
+ * Continuous polling needs CAP_SYS_NICE.
+ */
+#define VHOST_SET_WORKER _IOW(VHOST_VIRTIO, 0x27, struct vhost_worker_state)
+
 /* VHOST_NET specific defines */
 
 /* Attach virtio net ring to a raw socket, or tap device.
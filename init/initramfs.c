@@ -10,6 +10,7 @@
 #include <linux/syscalls.h>
 #include <linux/utime.h>
 #include <linux/file.h>
+#include <linux/async.h>
 
 static ssize_t __init xwrite(int fd, const char *p, size_t count)
 {
@@ -599,7 +600,15 @@ static void __init clean_rootfs(void)
 }
 #endif
 
-static int __init populate_rootfs(void)
+static bool __initdata initramfs_async = true;
+static int __init initramfs_async_setup(char *str)
+{
+	strtobool(str, &initramfs_async);
+	return 1;
+}
+__setup("initramfs_async=", initramfs_async_setup);
+
+static void __init do_populate_rootfs(void *unused, async_cookie_t cookie)
 {
 	/* Load the built in initramfs */
 	char *err = unpack_to_rootfs(__initramfs_start, __initramfs_size);
@@ -646,12 +655,50 @@ static int __init populate_rootfs(void)
 #endif
 	}
 	flush_delayed_fput();
-	/*
-	 * Try loading default modules from initramfs.  This gives
-	 * us a chance to load before device_initcalls.
-	 */
-	load_default_modules();
+}
+
+static ASYNC_DOMAIN_EXCLUSIVE(initramfs_domain);
+static async_cookie_t initramfs_cookie;
 
+/*
+ * Wait for the initramfs to be unpacked, for anything about to look at the
+ * rootfs: usermode helpers, firmware loading and the exec of init.
+ */
+void wait_for_initramfs(void)
+{
+	if (!initramfs_cookie) {
+		/*
+		 * Something before rootfs_initcall wants to access
+		 * the filesystem/initramfs. Probably a bug. Make a
+		 * note, avoid deadlocking the machine, and let the
+		 * caller's access fail as it used to.
+		 */
+		pr_warn_once("wait_for_initramfs() called before rootfs_initcalls\n");
+		return;
+	}
+	async_synchronize_cookie_domain(initramfs_cookie + 1,
+					&initramfs_domain);
+}
+EXPORT_SYMBOL_GPL(wait_for_initramfs);
+
+/*
+ * Unpacking a large initramfs takes a while; do it off the boot critical
+ * path, concurrently with the device initcalls, unless initramfs_async=0.
+ */
+static int __init populate_rootfs(void)
+{
+	initramfs_cookie = async_schedule_domain(do_populate_rootfs, NULL,
+						 &initramfs_domain);
+	if (!initramfs_async) {
+		wait_for_initramfs();
+		/*
+		 * Try loading default modules from initramfs.  This gives
+		 * us a chance to load before device_initcalls.  When
+		 * unpacking asynchronously, they are loaded once the
+		 * initramfs is there, at the end of kernel_init_freeable().
+		 */
+		load_default_modules();
+	}
 	return 0;
 }
 rootfs_initcall(populate_rootfs);
@@ -615,6 +615,7 @@ asmlinkage __visible void __init start_kernel(void)
 		 "Interrupts were enabled *very* early, fixing it\n"))
 		local_irq_disable();
 	radix_tree_init();
+	range_tree_init_cache();
 
 	/*
 	 * Set up housekeeping before setting up workqueues to allow the unbound
@@ -1146,10 +1147,15 @@ static noinline void __init kernel_init_freeable(void)
 	smp_init();
 	sched_init_smp();
 
+	workqueue_init_topology();
+
 	page_alloc_init_late();
 
 	do_basic_setup();
 
+	/* The rootfs is about to be used, the initramfs must be there */
+	wait_for_initramfs();
+
 	/* Open the /dev/console on the rootfs, this should never fail */
 	if (ksys_open((const char __user *) "/dev/console", O_RDWR, 0) < 0)
 		pr_err("Warning: unable to open an initial console.\n");
@@ -0,0 +1,351 @@
+// SPDX-License-Identifier: GPL-2.0
+/* BPF iterators
+ *
+ * A BPF_TRACE_ITER program is attached to a target, such as "task" or
+ * "tcp", with BPF_RAW_TRACEPOINT_OPEN, which returns an iterator link.
+ * Each BPF_ITER_CREATE on the link, or open() of the link pinned in bpffs,
+ * returns a new seq_file, whose read() walks the objects of the target,
+ * running the program on each of them; what it writes with bpf_seq_write()
+ * is what read() returns.
+ */
+#include <linux/anon_inodes.h>
+#include <linux/bpf.h>
+#include <linux/file.h>
+#include <linux/filter.h>
+#include <linux/fs.h>
+#include <linux/nsproxy.h>
+#include <linux/seq_file.h>
+#include <linux/seq_file_net.h>
+#include <linux/slab.h>
+
+struct bpf_iter_target_info {
+	struct list_head list;
+	const struct bpf_iter_reg *reg_info;
+};
+
+struct bpf_iter_link {
+	refcount_t refcnt;	/* link fds and bpffs inodes */
+	struct bpf_prog *prog;
+	struct bpf_iter_target_info *tinfo;
+};
+
+struct bpf_iter_priv_data {
+	struct bpf_iter_target_info *tinfo;
+	struct bpf_prog *prog;
+	u64 session_id;
+	u64 seq_num;
+	bool done_stop;
+	u8 target_private[] __aligned(8);
+};
+
+static struct list_head targets = LIST_HEAD_INIT(targets);
+static DEFINE_MUTEX(targets_mutex);
+
+static atomic64_t session_id;
+
+static const struct file_operations bpf_iter_link_fops;
+
+static struct bpf_iter_priv_data *seq_to_priv_data(struct seq_file *seq)
+{
+	return container_of(seq->private, struct bpf_iter_priv_data,
+			    target_private);
+}
+
+static int prepare_seq_file(struct file *file, struct bpf_iter_link *link)
+{
+	const struct bpf_iter_reg *reg_info = link->tinfo->reg_info;
+	struct bpf_iter_priv_data *priv_data;
+	struct bpf_prog *prog;
+	struct seq_file *seq;
+	int err;
+
+	/* the file runs the program, even once the link is gone */
+	prog = bpf_prog_inc(link->prog);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	priv_data = __seq_open_private(file, reg_info->seq_ops,
+				       offsetof(struct bpf_iter_priv_data,
+						target_private) +
+				       reg_info->seq_priv_size);
+	if (!priv_data) {
+		err = -ENOMEM;
+		goto release_prog;
+	}
+
+	if (reg_info->init_seq_private) {
+		err = reg_info->init_seq_private(priv_data->target_private);
+		if (err)
+			goto release_seq_file;
+	}
+
+	priv_data->tinfo = link->tinfo;
+	priv_data->prog = prog;
+	priv_data->session_id = atomic64_inc_return(&session_id);
+
+	/* targets get their own private data, as with seq_open_private() */
+	seq = file->private_data;
+	seq->private = priv_data->target_private;
+
+	return 0;
+
+release_seq_file:
+	seq_release_private(file->f_inode, file);
+	file->private_data = NULL;
+release_prog:
+	bpf_prog_put(prog);
+	return err;
+}
+
+static int iter_open(struct inode *inode, struct file *file)
+{
+	struct bpf_iter_link *link = inode->i_private;
+
+	return prepare_seq_file(file, link);
+}
+
+static int iter_release(struct inode *inode, struct file *file)
+{
+	const struct bpf_iter_reg *reg_info;
+	struct bpf_iter_priv_data *priv_data;
+	struct seq_file *seq;
+
+	seq = file->private_data;
+	if (!seq)
+		return 0;
+
+	priv_data = seq_to_priv_data(seq);
+	reg_info = priv_data->tinfo->reg_info;
+	if (reg_info->fini_seq_private)
+		reg_info->fini_seq_private(seq->private);
+
+	bpf_prog_put(priv_data->prog);
+	seq->private = priv_data;
+
+	return seq_release_private(inode, file);
+}
+
+/* Used for both BPF_ITER_CREATE files and link inodes pinned in bpffs,
+ * ->open() is only called for the latter.
+ */
+const struct file_operations bpf_iter_fops = {
+	.open		= iter_open,
+	.llseek		= no_llseek,
+	.read		= seq_read,
+	.release	= iter_release,
+};
+
+int bpf_iter_reg_target(const struct bpf_iter_reg *reg_info)
+{
+	struct bpf_iter_target_info *tinfo;
+
+	tinfo = kmalloc(sizeof(*tinfo), GFP_KERNEL);
+	if (!tinfo)
+		return -ENOMEM;
+
+	tinfo->reg_info = reg_info;
+	INIT_LIST_HEAD(&tinfo->list);
+
+	mutex_lock(&targets_mutex);
+	list_add(&tinfo->list, &targets);
+	mutex_unlock(&targets_mutex);
+
+	return 0;
+}
+
+/* Called by the seq_file operations of targets, before running the program
+ * on an object, or on the last run, from ->stop() once no object is left,
+ * in which case NULL is returned if that run already happened.
+ */
+struct bpf_prog *bpf_iter_get_info(struct bpf_iter_meta *meta, bool in_stop)
+{
+	struct bpf_iter_priv_data *priv_data;
+	struct seq_file *seq = meta->seq;
+
+	if (seq->file->f_op != &bpf_iter_fops)
+		return NULL;
+
+	priv_data = seq_to_priv_data(seq);
+	if (in_stop) {
+		if (priv_data->done_stop)
+			return NULL;
+		priv_data->done_stop = true;
+	}
+
+	meta->session_id = priv_data->session_id;
+	meta->seq_num = priv_data->seq_num;
+
+	return priv_data->prog;
+}
+
+/* The program returns 0, anything else ends the read with -EAGAIN */
+int bpf_iter_run_prog(struct bpf_prog *prog, struct bpf_iter_ctx *ctx)
+{
+	struct seq_file *seq = ctx->meta->seq;
+	int ret;
+
+	rcu_read_lock();
+	preempt_disable();
+	ret = BPF_PROG_RUN(prog, ctx);
+	preempt_enable();
+	rcu_read_unlock();
+
+	if (ret)
+		return -EAGAIN;
+
+	/* an overflowing object is shown again, with a larger buffer */
+	if (!seq_has_overflowed(seq))
+		seq_to_priv_data(seq)->seq_num++;
+
+	return 0;
+}
+
+BPF_CALL_3(bpf_seq_write, struct bpf_iter_ctx *, ctx, const void *, data,
+	   u32, len)
+{
+	return seq_write(ctx->meta->seq, data, len) ? -EOVERFLOW : 0;
+}
+
+const struct bpf_func_proto bpf_seq_write_proto = {
+	.func		= bpf_seq_write,
+	.gpl_only	= true,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_PTR_TO_MEM,
+	.arg3_type	= ARG_CONST_SIZE_OR_ZERO,
+};
+
+void bpf_iter_link_inc(struct bpf_iter_link *link)
+{
+	refcount_inc(&link->refcnt);
+}
+
+void bpf_iter_link_put(struct bpf_iter_link *link)
+{
+	if (!refcount_dec_and_test(&link->refcnt))
+		return;
+
+	bpf_prog_put(link->prog);
+	kfree(link);
+}
+
+static int bpf_iter_link_release(struct inode *inode, struct file *filp)
+{
+	bpf_iter_link_put(filp->private_data);
+	return 0;
+}
+
+static const struct file_operations bpf_iter_link_fops = {
+	.release	= bpf_iter_link_release,
+};
+
+int bpf_iter_link_new_fd(struct bpf_iter_link *link)
+{
+	return anon_inode_getfd("bpf-iter-link", &bpf_iter_link_fops, link,
+				O_CLOEXEC);
+}
+
+struct bpf_iter_link *bpf_iter_link_get_from_fd(u32 ufd)
+{
+	struct bpf_iter_link *link;
+	struct fd f = fdget(ufd);
+
+	if (!f.file)
+		return ERR_PTR(-EBADF);
+	if (f.file->f_op != &bpf_iter_link_fops) {
+		fdput(f);
+		return ERR_PTR(-EINVAL);
+	}
+
+	link = f.file->private_data;
+	bpf_iter_link_inc(link);
+	fdput(f);
+
+	return link;
+}
+
+/* On success, the link takes over the reference on @prog of the caller */
+int bpf_iter_link_attach(struct bpf_prog *prog, const char *target)
+{
+	struct bpf_iter_target_info *tinfo;
+	struct bpf_iter_link *link;
+	bool existed = false;
+	int fd;
+
+	mutex_lock(&targets_mutex);
+	list_for_each_entry(tinfo, &targets, list) {
+		if (!strcmp(target, tinfo->reg_info->target)) {
+			existed = true;
+			break;
+		}
+	}
+	mutex_unlock(&targets_mutex);
+	if (!existed)
+		return -ENOENT;
+
+	link = kzalloc(sizeof(*link), GFP_USER | __GFP_NOWARN);
+	if (!link)
+		return -ENOMEM;
+
+	refcount_set(&link->refcnt, 1);
+	link->prog = prog;
+	link->tinfo = tinfo;
+
+	fd = bpf_iter_link_new_fd(link);
+	if (fd < 0)
+		kfree(link);
+
+	return fd;
+}
+
+int bpf_iter_new_fd(struct bpf_iter_link *link)
+{
+	struct file *file;
+	int err, fd;
+
+	fd = get_unused_fd_flags(O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return fd;
+
+	file = anon_inode_getfile("bpf-iter", &bpf_iter_fops, NULL,
+				  O_RDONLY | O_CLOEXEC);
+	if (IS_ERR(file)) {
+		err = PTR_ERR(file);
+		goto free_fd;
+	}
+
+	err = prepare_seq_file(file, link);
+	if (err)
+		goto free_file;
+
+	fd_install(fd, file);
+	return fd;
+
+free_file:
+	fput(file);
+free_fd:
+	put_unused_fd(fd);
+	return err;
+}
+
+/* init_seq_private/fini_seq_private of targets whose private data starts
+ * with struct seq_net_private, for seq_file_net()
+ */
+int bpf_iter_init_seq_net(void *priv_data)
+{
+#ifdef CONFIG_NET_NS
+	struct seq_net_private *p = priv_data;
+
+	p->net = get_net(current->nsproxy->net_ns);
+#endif
+	return 0;
+}
+
+void bpf_iter_fini_seq_net(void *priv_data)
+{
+#ifdef CONFIG_NET_NS
+	struct seq_net_private *p = priv_data;
+
+	put_net(p->net);
+#endif
+}
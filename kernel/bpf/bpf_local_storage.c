@@ -0,0 +1,542 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Storage of BPF programs local to kernel objects
+ *
+ * An object has a single pointer to a bpf_local_storage, allocated along
+ * with its first element, which lists the elements of all maps for that
+ * object. The lookup of an element by a program is a cache hit most of
+ * the time: a storage caches the last element looked up for each slot,
+ * and maps of the same object type get different slots as long as there
+ * are fewer of them than BPF_LOCAL_STORAGE_CACHE_SIZE.
+ *
+ * Elements are freed after an RCU grace period, programs and syscalls
+ * look them up under rcu_read_lock(). They're unlinked from their object
+ * by the object type, when the object is destroyed, or from their map by
+ * bpf_local_storage_map_free(), whichever comes first.
+ */
+#include <linux/bpf.h>
+#include <linux/bpf_local_storage.h>
+#include <linux/hash.h>
+#include <linux/mm.h>
+#include <linux/rculist.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#define BPF_LOCAL_STORAGE_CREATE_FLAG_MASK (BPF_F_NO_PREALLOC)
+
+static struct bpf_local_storage_map_bucket *
+select_bucket(struct bpf_local_storage_map *smap,
+	      struct bpf_local_storage_elem *selem)
+{
+	return &smap->buckets[hash_ptr(selem, smap->bucket_log)];
+}
+
+static int mem_charge(struct bpf_local_storage_map *smap, void *owner,
+		      u32 size)
+{
+	const struct bpf_map_ops *ops = smap->map.ops;
+
+	if (!ops->map_local_storage_charge)
+		return 0;
+
+	return ops->map_local_storage_charge(smap, owner, size);
+}
+
+static void mem_uncharge(struct bpf_local_storage_map *smap, void *owner,
+			 u32 size)
+{
+	const struct bpf_map_ops *ops = smap->map.ops;
+
+	if (ops->map_local_storage_uncharge)
+		ops->map_local_storage_uncharge(smap, owner, size);
+}
+
+static struct bpf_local_storage __rcu **
+owner_storage(struct bpf_local_storage_map *smap, void *owner)
+{
+	return smap->map.ops->map_owner_storage_ptr(owner);
+}
+
+static bool selem_linked_to_storage(const struct bpf_local_storage_elem *selem)
+{
+	return !hlist_unhashed(&selem->snode);
+}
+
+static bool selem_linked_to_map(const struct bpf_local_storage_elem *selem)
+{
+	return !hlist_unhashed(&selem->map_node);
+}
+
+static struct bpf_local_storage_elem *
+bpf_selem_alloc(struct bpf_local_storage_map *smap, void *owner,
+		void *value, bool charge_mem)
+{
+	struct bpf_local_storage_elem *selem;
+
+	if (charge_mem && mem_charge(smap, owner, smap->elem_size))
+		return NULL;
+
+	selem = kzalloc(smap->elem_size, GFP_ATOMIC | __GFP_NOWARN);
+	if (!selem) {
+		if (charge_mem)
+			mem_uncharge(smap, owner, smap->elem_size);
+		return NULL;
+	}
+
+	if (value)
+		memcpy(SDATA(selem)->data, value, smap->map.value_size);
+
+	return selem;
+}
+
+/* local_storage->lock must be held. Returns true if the storage is empty
+ * now, in which case it's unlinked from its owner and must be freed by
+ * the caller, once the lock is released.
+ */
+static bool
+bpf_selem_unlink_storage_nolock(struct bpf_local_storage *local_storage,
+				struct bpf_local_storage_elem *selem,
+				bool uncharge_mem)
+{
+	struct bpf_local_storage_map *smap;
+	bool free_local_storage;
+	void *owner;
+
+	smap = rcu_dereference(SDATA(selem)->smap);
+	owner = local_storage->owner;
+
+	/* the owner may be freed once its last element is unlinked, all
+	 * uncharging has to be done before
+	 */
+	if (uncharge_mem)
+		mem_uncharge(smap, owner, smap->elem_size);
+
+	free_local_storage = hlist_is_singular_node(&selem->snode,
+						    &local_storage->list);
+	if (free_local_storage) {
+		mem_uncharge(smap, owner, sizeof(struct bpf_local_storage));
+		local_storage->owner = NULL;
+		RCU_INIT_POINTER(*owner_storage(smap, owner), NULL);
+	}
+
+	hlist_del_init_rcu(&selem->snode);
+	if (rcu_access_pointer(local_storage->cache[smap->cache_idx]) ==
+	    SDATA(selem))
+		RCU_INIT_POINTER(local_storage->cache[smap->cache_idx], NULL);
+
+	kfree_rcu(selem, rcu);
+
+	return free_local_storage;
+}
+
+static void __bpf_selem_unlink_storage(struct bpf_local_storage_elem *selem)
+{
+	struct bpf_local_storage *local_storage;
+	bool free_local_storage = false;
+	unsigned long flags;
+
+	if (unlikely(!selem_linked_to_storage(selem)))
+		return;
+
+	local_storage = rcu_dereference(selem->local_storage);
+	raw_spin_lock_irqsave(&local_storage->lock, flags);
+	if (likely(selem_linked_to_storage(selem)))
+		free_local_storage =
+			bpf_selem_unlink_storage_nolock(local_storage, selem,
+							true);
+	raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+
+	if (free_local_storage)
+		kfree_rcu(local_storage, rcu);
+}
+
+static void
+bpf_selem_link_storage_nolock(struct bpf_local_storage *local_storage,
+			      struct bpf_local_storage_elem *selem)
+{
+	RCU_INIT_POINTER(selem->local_storage, local_storage);
+	hlist_add_head_rcu(&selem->snode, &local_storage->list);
+}
+
+static void bpf_selem_unlink_map(struct bpf_local_storage_elem *selem)
+{
+	struct bpf_local_storage_map_bucket *b;
+	struct bpf_local_storage_map *smap;
+	unsigned long flags;
+
+	if (unlikely(!selem_linked_to_map(selem)))
+		return;
+
+	smap = rcu_dereference(SDATA(selem)->smap);
+	b = select_bucket(smap, selem);
+	raw_spin_lock_irqsave(&b->lock, flags);
+	if (likely(selem_linked_to_map(selem)))
+		hlist_del_init_rcu(&selem->map_node);
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+}
+
+static void bpf_selem_link_map(struct bpf_local_storage_map *smap,
+			       struct bpf_local_storage_elem *selem)
+{
+	struct bpf_local_storage_map_bucket *b = select_bucket(smap, selem);
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&b->lock, flags);
+	RCU_INIT_POINTER(SDATA(selem)->smap, smap);
+	hlist_add_head_rcu(&selem->map_node, &b->list);
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+}
+
+void bpf_selem_unlink(struct bpf_local_storage_elem *selem)
+{
+	/* the element is freed once unlinked from the storage, unlink it
+	 * from the map first
+	 */
+	bpf_selem_unlink_map(selem);
+	__bpf_selem_unlink_storage(selem);
+}
+
+struct bpf_local_storage_data *
+bpf_local_storage_lookup(struct bpf_local_storage *local_storage,
+			 struct bpf_local_storage_map *smap,
+			 bool cacheit_lockit)
+{
+	struct bpf_local_storage_data *sdata;
+	struct bpf_local_storage_elem *selem;
+	unsigned long flags;
+
+	sdata = rcu_dereference(local_storage->cache[smap->cache_idx]);
+	if (sdata && rcu_access_pointer(sdata->smap) == smap)
+		return sdata;
+
+	hlist_for_each_entry_rcu(selem, &local_storage->list, snode)
+		if (rcu_access_pointer(SDATA(selem)->smap) == smap)
+			break;
+
+	if (!selem)
+		return NULL;
+
+	sdata = SDATA(selem);
+	if (cacheit_lockit) {
+		/* an element deleted meanwhile mustn't be cached, it would
+		 * be found there after it's freed
+		 */
+		raw_spin_lock_irqsave(&local_storage->lock, flags);
+		if (selem_linked_to_storage(selem))
+			rcu_assign_pointer(local_storage->cache[smap->cache_idx],
+					   sdata);
+		raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+	}
+
+	return sdata;
+}
+
+static int check_flags(const struct bpf_local_storage_data *old_sdata,
+		       u64 map_flags)
+{
+	if (old_sdata && map_flags == BPF_NOEXIST)
+		return -EEXIST;
+
+	if (!old_sdata && map_flags == BPF_EXIST)
+		return -ENOENT;
+
+	return 0;
+}
+
+static int bpf_local_storage_alloc(void *owner,
+				   struct bpf_local_storage_map *smap,
+				   struct bpf_local_storage_elem *first_selem)
+{
+	struct bpf_local_storage *prev_storage, *storage;
+	struct bpf_local_storage **owner_storage_ptr;
+	int err;
+
+	err = mem_charge(smap, owner, sizeof(*storage));
+	if (err)
+		return err;
+
+	storage = kzalloc(sizeof(*storage), GFP_ATOMIC | __GFP_NOWARN);
+	if (!storage) {
+		err = -ENOMEM;
+		goto uncharge;
+	}
+
+	INIT_HLIST_HEAD(&storage->list);
+	raw_spin_lock_init(&storage->lock);
+	storage->owner = owner;
+
+	bpf_selem_link_storage_nolock(storage, first_selem);
+	bpf_selem_link_map(smap, first_selem);
+
+	/* Publish the storage with a cmpxchg() rather than under a lock of
+	 * the owner, which works whatever the context of the caller. From
+	 * then on, the pointer of the owner is only cleared with the lock
+	 * of the storage held.
+	 */
+	owner_storage_ptr =
+		(struct bpf_local_storage **)owner_storage(smap, owner);
+	prev_storage = cmpxchg(owner_storage_ptr, NULL, storage);
+	if (unlikely(prev_storage)) {
+		/* the element can be freed right away by the caller, since
+		 * bpf_local_storage_map_free() waits for an RCU grace period
+		 * before walking the buckets
+		 */
+		bpf_selem_unlink_map(first_selem);
+		err = -EAGAIN;
+		goto uncharge;
+	}
+
+	return 0;
+
+uncharge:
+	kfree(storage);
+	mem_uncharge(smap, owner, sizeof(*storage));
+	return err;
+}
+
+/* Add or replace the value of @owner in @smap. The caller holds a
+ * reference on @owner, or otherwise ensures that it isn't being destroyed.
+ */
+struct bpf_local_storage_data *
+bpf_local_storage_update(void *owner, struct bpf_local_storage_map *smap,
+			 void *value, u64 map_flags)
+{
+	struct bpf_local_storage_data *old_sdata = NULL;
+	struct bpf_local_storage *local_storage;
+	struct bpf_local_storage_elem *selem;
+	unsigned long flags;
+	int err;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		return ERR_PTR(-EINVAL);
+
+	local_storage = rcu_dereference(*owner_storage(smap, owner));
+	if (!local_storage || hlist_empty(&local_storage->list)) {
+		/* the first element of the owner */
+		err = check_flags(NULL, map_flags);
+		if (err)
+			return ERR_PTR(err);
+
+		selem = bpf_selem_alloc(smap, owner, value, true);
+		if (!selem)
+			return ERR_PTR(-ENOMEM);
+
+		err = bpf_local_storage_alloc(owner, smap, selem);
+		if (err) {
+			kfree(selem);
+			mem_uncharge(smap, owner, smap->elem_size);
+			return ERR_PTR(err);
+		}
+
+		return SDATA(selem);
+	}
+
+	raw_spin_lock_irqsave(&local_storage->lock, flags);
+
+	/* the last element was deleted since, and the storage is going away */
+	if (unlikely(hlist_empty(&local_storage->list))) {
+		err = -EAGAIN;
+		goto unlock_err;
+	}
+
+	old_sdata = bpf_local_storage_lookup(local_storage, smap, false);
+	err = check_flags(old_sdata, map_flags);
+	if (err)
+		goto unlock_err;
+
+	/* An element replacing another one isn't charged, the old one won't
+	 * be uncharged either: the update can't fail on the charge limit.
+	 */
+	selem = bpf_selem_alloc(smap, owner, value, !old_sdata);
+	if (!selem) {
+		err = -ENOMEM;
+		goto unlock_err;
+	}
+
+	bpf_selem_link_map(smap, selem);
+	bpf_selem_link_storage_nolock(local_storage, selem);
+
+	if (old_sdata) {
+		bpf_selem_unlink_map(SELEM(old_sdata));
+		bpf_selem_unlink_storage_nolock(local_storage, SELEM(old_sdata),
+						false);
+	}
+
+	raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+	return SDATA(selem);
+
+unlock_err:
+	raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+	return ERR_PTR(err);
+}
+
+/* Unlink and free all the elements of an owner being destroyed. Neither
+ * programs nor syscalls can add elements anymore, only
+ * bpf_local_storage_map_free() may race with this, unlinking elements
+ * of its map.
+ */
+void bpf_local_storage_destroy(struct bpf_local_storage *local_storage,
+			       bool uncharge_mem)
+{
+	struct bpf_local_storage_elem *selem;
+	bool free_local_storage = false;
+	struct hlist_node *n;
+	unsigned long flags;
+
+	rcu_read_lock();
+	raw_spin_lock_irqsave(&local_storage->lock, flags);
+	hlist_for_each_entry_safe(selem, n, &local_storage->list, snode) {
+		bpf_selem_unlink_map(selem);
+		free_local_storage =
+			bpf_selem_unlink_storage_nolock(local_storage, selem,
+							uncharge_mem);
+	}
+	raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+	rcu_read_unlock();
+
+	if (free_local_storage)
+		kfree_rcu(local_storage, rcu);
+}
+
+u16 bpf_local_storage_cache_idx_get(struct bpf_local_storage_cache *cache)
+{
+	u64 min_usage = U64_MAX;
+	u16 i, res = 0;
+
+	spin_lock(&cache->idx_lock);
+
+	for (i = 0; i < BPF_LOCAL_STORAGE_CACHE_SIZE; i++) {
+		if (cache->idx_usage_counts[i] < min_usage) {
+			min_usage = cache->idx_usage_counts[i];
+			res = i;
+
+			if (!min_usage)
+				break;
+		}
+	}
+	cache->idx_usage_counts[res]++;
+
+	spin_unlock(&cache->idx_lock);
+
+	return res;
+}
+
+void bpf_local_storage_cache_idx_free(struct bpf_local_storage_cache *cache,
+				      u16 idx)
+{
+	spin_lock(&cache->idx_lock);
+	cache->idx_usage_counts[idx]--;
+	spin_unlock(&cache->idx_lock);
+}
+
+int bpf_local_storage_map_alloc_check(union bpf_attr *attr)
+{
+	if (attr->map_flags & ~BPF_LOCAL_STORAGE_CREATE_FLAG_MASK ||
+	    !(attr->map_flags & BPF_F_NO_PREALLOC) ||
+	    attr->max_entries ||
+	    attr->key_size != sizeof(int) || !attr->value_size)
+		return -EINVAL;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (attr->value_size > BPF_LOCAL_STORAGE_MAX_VALUE_SIZE)
+		return -E2BIG;
+
+	return 0;
+}
+
+struct bpf_local_storage_map *
+bpf_local_storage_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_local_storage_map *smap;
+	unsigned int i;
+	u32 nbuckets;
+	u64 cost;
+	int ret;
+
+	/* hash_ptr() needs at least one bit */
+	nbuckets = roundup_pow_of_two(num_possible_cpus());
+	nbuckets = max_t(u32, 2, nbuckets);
+
+	cost = sizeof(*smap->buckets) * nbuckets + sizeof(*smap);
+	cost = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+	ret = bpf_map_precharge_memlock(cost);
+	if (ret < 0)
+		return ERR_PTR(ret);
+
+	smap = kzalloc(sizeof(*smap), GFP_USER | __GFP_NOWARN);
+	if (!smap)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&smap->map, attr);
+	smap->map.pages = cost;
+	smap->bucket_log = ilog2(nbuckets);
+
+	smap->buckets = kvcalloc(nbuckets, sizeof(*smap->buckets),
+				 GFP_USER | __GFP_NOWARN);
+	if (!smap->buckets) {
+		kfree(smap);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	for (i = 0; i < nbuckets; i++) {
+		INIT_HLIST_HEAD(&smap->buckets[i].list);
+		raw_spin_lock_init(&smap->buckets[i].lock);
+	}
+
+	smap->elem_size = sizeof(struct bpf_local_storage_elem) +
+			  attr->value_size;
+
+	return smap;
+}
+
+/* @busy_counter, if any, is the per-CPU counter of the object type which
+ * keeps its programs off the storage locks held by this CPU.
+ */
+void bpf_local_storage_map_free(struct bpf_local_storage_map *smap,
+				int __percpu *busy_counter)
+{
+	struct bpf_local_storage_map_bucket *b;
+	struct bpf_local_storage_elem *selem;
+	unsigned int i;
+
+	/* Programs and syscalls can't reach the map anymore once this grace
+	 * period is over, no element is added to it from then on.
+	 */
+	synchronize_rcu();
+
+	for (i = 0; i < (1U << smap->bucket_log); i++) {
+		b = &smap->buckets[i];
+
+		rcu_read_lock();
+		while ((selem = hlist_entry_safe(
+				rcu_dereference_raw(hlist_first_rcu(&b->list)),
+				struct bpf_local_storage_elem, map_node))) {
+			if (busy_counter) {
+				preempt_disable();
+				__this_cpu_inc(*busy_counter);
+			}
+			bpf_selem_unlink(selem);
+			if (busy_counter) {
+				__this_cpu_dec(*busy_counter);
+				preempt_enable();
+			}
+			cond_resched_rcu();
+		}
+		rcu_read_unlock();
+	}
+
+	/* An owner being destroyed may have unlinked an element from the
+	 * map above, and still be uncharging it, using smap->elem_size.
+	 */
+	synchronize_rcu();
+
+	kvfree(smap->buckets);
+	kfree(smap);
+}
+
+int bpf_local_storage_map_get_next_key(struct bpf_map *map, void *key,
+				       void *next_key)
+{
+	return -ENOTSUPP;
+}
@@ -175,7 +175,8 @@ int bpf_prog_calc_tag(struct bpf_prog *fp)
 		dst[i] = fp->insnsi[i];
 		if (!was_ld_map &&
 		    dst[i].code == (BPF_LD | BPF_IMM | BPF_DW) &&
-		    dst[i].src_reg == BPF_PSEUDO_MAP_FD) {
+		    (dst[i].src_reg == BPF_PSEUDO_MAP_FD ||
+		     dst[i].src_reg == BPF_PSEUDO_MAP_VALUE)) {
 			was_ld_map = true;
 			dst[i].imm = 0;
 		} else if (was_ld_map &&
@@ -1495,10 +1496,20 @@ bool bpf_prog_array_compatible(struct bpf_array *array,
 		 */
 		array->owner_prog_type = fp->type;
 		array->owner_jited = fp->jited;
+		array->owner_xdp_devmap =
+			fp->expected_attach_type == BPF_XDP_DEVMAP;
 
 		return true;
 	}
 
+	/* Devmap programs may read the egress device, which ingress
+	 * programs tail calling into them would not provide.
+	 */
+	if (fp->type == BPF_PROG_TYPE_XDP &&
+	    array->owner_xdp_devmap !=
+	    (fp->expected_attach_type == BPF_XDP_DEVMAP))
+		return false;
+
 	return array->owner_prog_type == fp->type &&
 	       array->owner_jited == fp->jited;
 }
@@ -1861,6 +1872,11 @@ const struct bpf_func_proto bpf_map_delete_elem_proto __weak;
 const struct bpf_func_proto bpf_map_push_elem_proto __weak;
 const struct bpf_func_proto bpf_map_pop_elem_proto __weak;
 const struct bpf_func_proto bpf_map_peek_elem_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_output_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_reserve_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_submit_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_discard_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_query_proto __weak;
 
 const struct bpf_func_proto bpf_get_prandom_u32_proto __weak;
 const struct bpf_func_proto bpf_get_smp_processor_id_proto __weak;
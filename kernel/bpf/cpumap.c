@@ -162,9 +162,11 @@ static void cpu_map_kthread_stop(struct work_struct *work)
 static struct sk_buff *cpu_map_build_skb(struct bpf_cpu_map_entry *rcpu,
 					 struct xdp_frame *xdpf)
 {
+	struct skb_shared_info *sinfo;
 	unsigned int frame_size;
 	void *pkt_data_start;
 	struct sk_buff *skb;
+	u8 nr_frags = 0;
 
 	/* build_skb need to place skb_shared_info after SKB end, and
 	 * also want to know the memory "truesize".  Thus, need to
@@ -186,6 +188,17 @@ static struct sk_buff *cpu_map_build_skb(struct bpf_cpu_map_entry *rcpu,
 	frame_size = SKB_DATA_ALIGN(xdpf->len) + xdpf->headroom +
 		SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
 
+	/* A multi-buffer frame already carries its fragments in a
+	 * skb_shared_info at the end of the head buffer, so the real
+	 * frame size has to be used.  build_skb() clears nr_frags, but
+	 * leaves frags[] alone, hence only nr_frags needs saving.
+	 */
+	if (unlikely(xdp_frame_has_frags(xdpf))) {
+		sinfo = xdp_get_shared_info_from_frame(xdpf);
+		nr_frags = sinfo->nr_frags;
+		frame_size = xdpf->frame_sz - sizeof(*xdpf);
+	}
+
 	pkt_data_start = xdpf->data - xdpf->headroom;
 	skb = build_skb(pkt_data_start, frame_size);
 	if (!skb)
@@ -196,6 +209,13 @@ static struct sk_buff *cpu_map_build_skb(struct bpf_cpu_map_entry *rcpu,
 	if (xdpf->metasize)
 		skb_metadata_set(skb, xdpf->metasize);
 
+	if (unlikely(nr_frags)) {
+		skb_shinfo(skb)->nr_frags = nr_frags;
+		skb->data_len = xdp_get_frags_len(skb_shinfo(skb));
+		skb->len += skb->data_len;
+		skb->truesize += nr_frags * xdpf->frame_sz;
+	}
+
 	/* Essential SKB info: protocol and skb->dev */
 	skb->protocol = eth_type_trans(skb, xdpf->dev_rx);
 
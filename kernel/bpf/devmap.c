@@ -67,6 +67,8 @@ struct bpf_dtab_netdev {
 	struct bpf_dtab *dtab;
 	unsigned int bit;
 	struct xdp_bulk_queue __percpu *bulkq;
+	struct bpf_prog *xdp_prog; /* optional egress program */
+	struct bpf_devmap_val val;
 	struct rcu_head rcu;
 };
 
@@ -94,9 +96,13 @@ static struct bpf_map *dev_map_alloc(union bpf_attr *attr)
 	if (!capable(CAP_NET_ADMIN))
 		return ERR_PTR(-EPERM);
 
-	/* check sanity of attributes */
+	/* check sanity of attributes. 4 bytes values only hold an ifindex,
+	 * the full struct bpf_devmap_val also takes an egress program.
+	 */
 	if (attr->max_entries == 0 || attr->key_size != 4 ||
-	    attr->value_size != 4 || attr->map_flags & ~DEV_CREATE_FLAG_MASK)
+	    (attr->value_size != offsetofend(struct bpf_devmap_val, ifindex) &&
+	     attr->value_size != sizeof(struct bpf_devmap_val)) ||
+	    attr->map_flags & ~DEV_CREATE_FLAG_MASK)
 		return ERR_PTR(-EINVAL);
 
 	dtab = kzalloc(sizeof(*dtab), GFP_USER);
@@ -183,6 +189,8 @@ static void dev_map_free(struct bpf_map *map)
 		if (!dev)
 			continue;
 
+		if (dev->xdp_prog)
+			bpf_prog_put(dev->xdp_prog);
 		dev_put(dev->dev);
 		kfree(dev);
 	}
@@ -217,30 +225,94 @@ void __dev_map_insert_ctx(struct bpf_map *map, u32 bit)
 	__set_bit(bit, bitmap);
 }
 
+/* Run the egress program of the entry over the frames of a bulk queue.
+ * Frames the program did not pass are released, the remaining ones are
+ * compacted at the start of @frames and their count is returned.
+ */
+static int dev_map_bpf_prog_run(struct bpf_prog *xdp_prog,
+				struct xdp_frame **frames, int n,
+				struct net_device *dev,
+				struct net_device *dev_rx, bool in_napi_ctx)
+{
+	struct xdp_txq_info txq = { .dev = dev };
+	struct xdp_rxq_info rxq = { .dev = dev_rx };
+	struct xdp_buff xdp;
+	int i, nframes = 0;
+
+	for (i = 0; i < n; i++) {
+		struct xdp_frame *xdpf = frames[i];
+		u32 act;
+
+		if (unlikely(xdp_frame_has_frags(xdpf) &&
+			     !xdp_prog->aux->xdp_has_frags)) {
+			act = XDP_DROP;
+			goto drop;
+		}
+
+		xdp_convert_frame_to_buff(xdpf, &xdp);
+		xdp.rxq = &rxq;
+		xdp.txq = &txq;
+
+		act = bpf_prog_run_xdp(xdp_prog, &xdp);
+		switch (act) {
+		case XDP_PASS:
+			if (unlikely(xdp_update_frame_from_buff(&xdp, xdpf)))
+				goto drop;
+			frames[nframes++] = xdpf;
+			continue;
+		default:
+			bpf_warn_invalid_xdp_action(act);
+			/* fall through */
+		case XDP_ABORTED:
+			trace_xdp_exception(dev, xdp_prog, act);
+			/* fall through */
+		case XDP_DROP:
+			break;
+		}
+drop:
+		if (likely(in_napi_ctx))
+			xdp_return_frame_rx_napi(xdpf);
+		else
+			xdp_return_frame(xdpf);
+	}
+
+	return nframes;
+}
+
 static int bq_xmit_all(struct bpf_dtab_netdev *obj,
 		       struct xdp_bulk_queue *bq, u32 flags,
 		       bool in_napi_ctx)
 {
 	struct net_device *dev = obj->dev;
 	int sent = 0, drops = 0, err = 0;
+	unsigned int cnt = bq->count;
 	int i;
 
-	if (unlikely(!bq->count))
+	if (unlikely(!cnt))
 		return 0;
 
-	for (i = 0; i < bq->count; i++) {
+	for (i = 0; i < cnt; i++) {
 		struct xdp_frame *xdpf = bq->q[i];
 
 		prefetch(xdpf);
 	}
 
-	sent = dev->netdev_ops->ndo_xdp_xmit(dev, bq->count, bq->q, flags);
+	if (obj->xdp_prog) {
+		cnt = dev_map_bpf_prog_run(obj->xdp_prog, bq->q, cnt, dev,
+					   bq->dev_rx, in_napi_ctx);
+		drops = bq->count - cnt;
+		bq->count = cnt;
+		if (!cnt)
+			goto out;
+	}
+
+	sent = dev->netdev_ops->ndo_xdp_xmit(dev, cnt, bq->q, flags);
 	if (sent < 0) {
 		err = sent;
 		sent = 0;
 		goto error;
 	}
-	drops = bq->count - sent;
+	drops += cnt - sent;
 out:
 	bq->count = 0;
 
@@ -344,7 +416,11 @@ int dev_map_enqueue(struct bpf_dtab_netdev *dst, struct xdp_buff *xdp,
 	if (!dev->netdev_ops->ndo_xdp_xmit)
 		return -EOPNOTSUPP;
 
-	err = xdp_ok_fwd_dev(dev, xdp->data_end - xdp->data);
+	if (unlikely(xdp_buff_has_frags(xdp) &&
+		     !(dev->priv_flags & IFF_XDP_XMIT_FRAGS)))
+		return -EOPNOTSUPP;
+
+	err = xdp_ok_fwd_dev(dev, xdp_get_buff_len(xdp));
 	if (unlikely(err))
 		return err;
 
@@ -355,6 +431,48 @@ int dev_map_enqueue(struct bpf_dtab_netdev *dst, struct xdp_buff *xdp,
 	return bq_enqueue(dst, xdpf, dev_rx);
 }
 
+/* Generic XDP flavour of dev_map_bpf_prog_run(). The skb is consumed
+ * unless XDP_PASS is returned.
+ */
+static u32 dev_map_bpf_prog_run_skb(struct sk_buff *skb,
+				    struct bpf_dtab_netdev *dst)
+{
+	struct xdp_txq_info txq = { .dev = dst->dev };
+	struct xdp_buff xdp;
+	u32 act;
+
+	if (!dst->xdp_prog)
+		return XDP_PASS;
+
+	/* Broadcast copies share their data, give the program its own */
+	if (skb_unclone(skb, GFP_ATOMIC)) {
+		kfree_skb(skb);
+		return XDP_DROP;
+	}
+
+	/* netif_receive_generic_xdp() expects the ingress skb layout */
+	__skb_pull(skb, skb_mac_header_len(skb));
+	xdp.txq = &txq;
+
+	act = netif_receive_generic_xdp(skb, &xdp, dst->xdp_prog);
+	switch (act) {
+	case XDP_PASS:
+		__skb_push(skb, skb_mac_header_len(skb));
+		break;
+	case XDP_TX:
+	case XDP_REDIRECT:
+		/* not supported from the egress hook */
+		trace_xdp_exception(dst->dev, dst->xdp_prog, act);
+		kfree_skb(skb);
+		break;
+	default:
+		/* already freed by netif_receive_generic_xdp() */
+		break;
+	}
+
+	return act;
+}
+
 int dev_map_generic_redirect(struct bpf_dtab_netdev *dst, struct sk_buff *skb,
 			     struct bpf_prog *xdp_prog)
 {
@@ -363,18 +481,142 @@ int dev_map_generic_redirect(struct bpf_dtab_netdev *dst, struct sk_buff *skb,
 	err = xdp_ok_fwd_dev(dst->dev, skb->len);
 	if (unlikely(err))
 		return err;
+
+	if (dev_map_bpf_prog_run_skb(skb, dst) != XDP_PASS)
+		return 0;
+
 	skb->dev = dst->dev;
 	generic_xdp_tx(skb, xdp_prog);
 
 	return 0;
 }
 
+static bool dev_map_is_valid_dst(struct bpf_dtab_netdev *obj,
+				 struct xdp_buff *xdp, int exclude_ifindex)
+{
+	struct net_device *dev;
+
+	if (!obj)
+		return false;
+
+	dev = obj->dev;
+	if (dev->ifindex == exclude_ifindex || !dev->netdev_ops->ndo_xdp_xmit)
+		return false;
+
+	if (xdp_buff_has_frags(xdp) && !(dev->priv_flags & IFF_XDP_XMIT_FRAGS))
+		return false;
+
+	return !xdp_ok_fwd_dev(dev, xdp_get_buff_len(xdp));
+}
+
+static int dev_map_enqueue_clone(struct bpf_dtab_netdev *obj,
+				 struct net_device *dev_rx,
+				 struct xdp_frame *xdpf)
+{
+	struct xdp_frame *nxdpf;
+
+	nxdpf = xdpf_clone(xdpf);
+	if (unlikely(!nxdpf))
+		return -ENOMEM;
+
+	bq_enqueue(obj, nxdpf, dev_rx);
+	__dev_map_insert_ctx(&obj->dtab->map, obj->bit);
+	return 0;
+}
+
+/* Broadcast the frame to every device in the map, except the ingress
+ * device when @exclude_ingress is set. All destinations but the last get
+ * a copy, the last one takes over the original frame. Copies still go
+ * through the per-device bulk queues, so a flood of broadcast frames is
+ * sent in bulk to each target just like unicast redirects.
+ */
+int dev_map_enqueue_multi(struct xdp_buff *xdp, struct net_device *dev_rx,
+			  struct bpf_map *map, bool exclude_ingress)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	int exclude_ifindex = exclude_ingress ? dev_rx->ifindex : 0;
+	struct bpf_dtab_netdev *dst, *last_dst = NULL;
+	struct xdp_frame *xdpf;
+	int err;
+	u32 i;
+
+	/* Copies are plain single page frames */
+	if (unlikely(xdp_buff_has_frags(xdp)))
+		return -EOPNOTSUPP;
+
+	xdpf = convert_to_xdp_frame(xdp);
+	if (unlikely(!xdpf))
+		return -EOVERFLOW;
+
+	for (i = 0; i < map->max_entries; i++) {
+		dst = READ_ONCE(dtab->netdev_map[i]);
+		if (!dev_map_is_valid_dst(dst, xdp, exclude_ifindex))
+			continue;
+
+		if (last_dst) {
+			err = dev_map_enqueue_clone(last_dst, dev_rx, xdpf);
+			if (unlikely(err))
+				return err;
+		}
+		last_dst = dst;
+	}
+
+	if (!last_dst) {
+		xdp_return_frame_rx_napi(xdpf);
+		return 0;
+	}
+
+	bq_enqueue(last_dst, xdpf, dev_rx);
+	__dev_map_insert_ctx(map, last_dst->bit);
+	return 0;
+}
+
+/* Generic XDP counterpart of dev_map_enqueue_multi(), working on skbs */
+int dev_map_redirect_multi(struct net_device *dev, struct sk_buff *skb,
+			   struct bpf_prog *xdp_prog, struct bpf_map *map,
+			   bool exclude_ingress)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	int exclude_ifindex = exclude_ingress ? dev->ifindex : 0;
+	struct bpf_dtab_netdev *dst, *last_dst = NULL;
+	struct sk_buff *nskb;
+	int err;
+	u32 i;
+
+	for (i = 0; i < map->max_entries; i++) {
+		dst = READ_ONCE(dtab->netdev_map[i]);
+		if (!dst || dst->dev->ifindex == exclude_ifindex ||
+		    xdp_ok_fwd_dev(dst->dev, skb->len))
+			continue;
+
+		if (last_dst) {
+			nskb = skb_clone(skb, GFP_ATOMIC);
+			if (unlikely(!nskb))
+				return -ENOMEM;
+
+			err = dev_map_generic_redirect(last_dst, nskb,
+						       xdp_prog);
+			if (unlikely(err)) {
+				kfree_skb(nskb);
+				return err;
+			}
+		}
+		last_dst = dst;
+	}
+
+	if (!last_dst) {
+		consume_skb(skb);
+		return 0;
+	}
+
+	return dev_map_generic_redirect(last_dst, skb, xdp_prog);
+}
+
 static void *dev_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_dtab_netdev *obj = __dev_map_lookup_elem(map, *(u32 *)key);
-	struct net_device *dev = obj ? obj->dev : NULL;
 
-	return dev ? &dev->ifindex : NULL;
+	return obj ? &obj->val : NULL;
 }
 
 static void dev_map_flush_old(struct bpf_dtab_netdev *dev)
@@ -401,6 +643,8 @@ static void __dev_map_entry_free(struct rcu_head *rcu)
 
 	dev = container_of(rcu, struct bpf_dtab_netdev, rcu);
 	dev_map_flush_old(dev);
+	if (dev->xdp_prog)
+		bpf_prog_put(dev->xdp_prog);
 	free_percpu(dev->bulkq);
 	dev_put(dev->dev);
 	kfree(dev);
@@ -435,9 +679,10 @@ static int dev_map_update_elem(struct bpf_map *map, void *key, void *value,
 	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
 	struct net *net = current->nsproxy->net_ns;
 	gfp_t gfp = GFP_ATOMIC | __GFP_NOWARN;
+	struct bpf_devmap_val val = { .bpf_prog.fd = -1 };
 	struct bpf_dtab_netdev *dev, *old_dev;
+	struct bpf_prog *prog = NULL;
 	u32 i = *(u32 *)key;
-	u32 ifindex = *(u32 *)value;
 
 	if (unlikely(map_flags > BPF_EXIST))
 		return -EINVAL;
@@ -446,8 +691,14 @@ static int dev_map_update_elem(struct bpf_map *map, void *key, void *value,
 	if (unlikely(map_flags == BPF_NOEXIST))
 		return -EEXIST;
 
-	if (!ifindex) {
+	/* already verified value_size <= sizeof val */
+	memcpy(&val, value, map->value_size);
+
+	if (!val.ifindex) {
 		dev = NULL;
+		/* can not specify fd if ifindex is 0 */
+		if (val.bpf_prog.fd != -1)
+			return -EINVAL;
 	} else {
 		dev = kmalloc_node(sizeof(*dev), gfp, map->numa_node);
 		if (!dev)
@@ -460,15 +711,27 @@ static int dev_map_update_elem(struct bpf_map *map, void *key, void *value,
 			return -ENOMEM;
 		}
 
-		dev->dev = dev_get_by_index(net, ifindex);
+		dev->dev = dev_get_by_index(net, val.ifindex);
 		if (!dev->dev) {
 			free_percpu(dev->bulkq);
 			kfree(dev);
 			return -EINVAL;
 		}
 
+		if (val.bpf_prog.fd > 0) {
+			prog = bpf_prog_get_type_dev(val.bpf_prog.fd,
+						     BPF_PROG_TYPE_XDP, false);
+			if (IS_ERR(prog))
+				goto err_put_dev;
+			if (prog->expected_attach_type != BPF_XDP_DEVMAP)
+				goto err_put_prog;
+		}
+
 		dev->bit = i;
 		dev->dtab = dtab;
+		dev->xdp_prog = prog;
+		dev->val.ifindex = val.ifindex;
+		dev->val.bpf_prog.id = prog ? prog->aux->id : 0;
 	}
 
 	/* Use call_rcu() here to ensure rcu critical sections have completed
@@ -480,6 +743,14 @@ static int dev_map_update_elem(struct bpf_map *map, void *key, void *value,
 		call_rcu(&old_dev->rcu, __dev_map_entry_free);
 
 	return 0;
+
+err_put_prog:
+	bpf_prog_put(prog);
+err_put_dev:
+	dev_put(dev->dev);
+	free_percpu(dev->bulkq);
+	kfree(dev);
+	return -EINVAL;
 }
 
 const struct bpf_map_ops dev_map_ops = {
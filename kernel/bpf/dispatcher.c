@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-2.0
+/* BPF dispatchers
+ *
+ * A dispatcher is a function, defined with DEFINE_BPF_DISPATCHER(), which
+ * calls the program it's passed through an indirect call, a retpoline on
+ * affected CPUs. Once programs are registered with it, the ftrace NOP at
+ * its entry is patched into a jump to an image generated for them: a
+ * binary search of the address of the program, ending in a direct jump to
+ * it, and in the indirect call for programs it doesn't know about.
+ *
+ * The image is made of two halves, the new one generated while the old
+ * one may still be running, and switched to with a single text poke.
+ */
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/ftrace.h>
+#include <linux/moduleloader.h>
+#include <linux/rcupdate.h>
+
+static struct bpf_dispatcher_prog *
+bpf_dispatcher_find_prog(struct bpf_dispatcher *d, struct bpf_prog *prog)
+{
+	int i;
+
+	for (i = 0; i < BPF_DISPATCHER_MAX; i++) {
+		if (prog == d->progs[i].prog)
+			return &d->progs[i];
+	}
+	return NULL;
+}
+
+static struct bpf_dispatcher_prog *
+bpf_dispatcher_find_free(struct bpf_dispatcher *d)
+{
+	return bpf_dispatcher_find_prog(d, NULL);
+}
+
+/* Return whether the image needs to be rebuilt */
+static bool bpf_dispatcher_add_prog(struct bpf_dispatcher *d,
+				    struct bpf_prog *prog)
+{
+	struct bpf_dispatcher_prog *entry;
+
+	if (!prog)
+		return false;
+
+	entry = bpf_dispatcher_find_prog(d, prog);
+	if (entry) {
+		refcount_inc(&entry->users);
+		return false;
+	}
+
+	/* the program goes through the indirect call then */
+	entry = bpf_dispatcher_find_free(d);
+	if (!entry)
+		return false;
+
+	if (IS_ERR(bpf_prog_inc(prog)))
+		return false;
+	entry->prog = prog;
+	refcount_set(&entry->users, 1);
+	d->num_progs++;
+	return true;
+}
+
+/* Return whether the image needs to be rebuilt. A program which isn't in
+ * the image anymore may still be running from the old one, its reference
+ * is dropped nonetheless: programs are freed after an RCU grace period.
+ */
+static bool bpf_dispatcher_remove_prog(struct bpf_dispatcher *d,
+				       struct bpf_prog *prog)
+{
+	struct bpf_dispatcher_prog *entry;
+
+	if (!prog)
+		return false;
+
+	entry = bpf_dispatcher_find_prog(d, prog);
+	if (!entry)
+		return false;
+
+	if (refcount_dec_and_test(&entry->users)) {
+		entry->prog = NULL;
+		bpf_prog_put(prog);
+		d->num_progs--;
+		return true;
+	}
+	return false;
+}
+
+int __weak arch_prepare_bpf_dispatcher(void *image, s64 *funcs, int num_funcs)
+{
+	return -ENOTSUPP;
+}
+
+static int bpf_dispatcher_prepare(struct bpf_dispatcher *d, void *image)
+{
+	s64 ips[BPF_DISPATCHER_MAX] = {}, *ipsp = &ips[0];
+	int i;
+
+	for (i = 0; i < BPF_DISPATCHER_MAX; i++) {
+		if (d->progs[i].prog)
+			*ipsp++ = (s64)(uintptr_t)d->progs[i].prog->bpf_func;
+	}
+	return arch_prepare_bpf_dispatcher(image, &ips[0], d->num_progs);
+}
+
+static void bpf_dispatcher_update(struct bpf_dispatcher *d, int prev_num_progs)
+{
+	unsigned long ip = (unsigned long)d->func;
+	void *old, *new;
+	u32 noff;
+	int err;
+
+	if (!prev_num_progs) {
+		old = NULL;
+		noff = 0;
+	} else {
+		old = d->image + d->image_off;
+		noff = d->image_off ^ (PAGE_SIZE / 2);
+	}
+
+	new = d->num_progs ? d->image + noff : NULL;
+	if (new && bpf_dispatcher_prepare(d, new))
+		return;
+
+	/* the NOP at the function entry is ftrace's while no image is
+	 * installed there
+	 */
+	if (!old && ftrace_reserve_location(ip))
+		return;
+
+	err = bpf_arch_text_poke(d->func, BPF_MOD_JUMP, old, new);
+	if (err) {
+		if (!old)
+			ftrace_release_location(ip);
+		return;
+	}
+
+	/* the half we just left is the next to be rebuilt: wait for the
+	 * programs running from it, which do so under rcu_read_lock()
+	 */
+	synchronize_rcu();
+
+	if (new)
+		d->image_off = noff;
+	else
+		ftrace_release_location(ip);
+}
+
+void bpf_dispatcher_change_prog(struct bpf_dispatcher *d, struct bpf_prog *from,
+				struct bpf_prog *to)
+{
+	bool changed = false;
+	int prev_num_progs;
+
+	if (from == to)
+		return;
+
+	/* the function can only be patched at its ftrace NOP */
+	if (ftrace_location((unsigned long)d->func) != (unsigned long)d->func)
+		return;
+
+	mutex_lock(&d->mutex);
+	if (!d->image) {
+		/* executable, and within rel32 reach of the kernel text */
+		d->image = module_alloc(PAGE_SIZE);
+		if (!d->image)
+			goto out;
+	}
+
+	prev_num_progs = d->num_progs;
+	changed |= bpf_dispatcher_remove_prog(d, from);
+	changed |= bpf_dispatcher_add_prog(d, to);
+
+	if (!changed)
+		goto out;
+
+	bpf_dispatcher_update(d, prev_num_progs);
+out:
+	mutex_unlock(&d->mutex);
+}
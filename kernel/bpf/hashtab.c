@@ -54,6 +54,7 @@ struct htab_elem {
 			union {
 				struct bpf_htab *htab;
 				struct pcpu_freelist_node fnode;
+				struct htab_elem *batch_flink;
 			};
 		};
 	};
@@ -1188,6 +1189,246 @@ static void htab_map_seq_show_elem(struct bpf_map *map, void *key,
 	rcu_read_unlock();
 }
 
+static int
+__htab_map_lookup_and_delete_batch(struct bpf_map *map,
+				   const union bpf_attr *attr,
+				   union bpf_attr __user *uattr,
+				   bool do_delete, bool is_lru_map,
+				   bool is_percpu)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	void __user *uvalues = u64_to_user_ptr(attr->batch.values);
+	void __user *ukeys = u64_to_user_ptr(attr->batch.keys);
+	void __user *ubatch = u64_to_user_ptr(attr->batch.in_batch);
+	u32 batch, max_count, total, bucket_cnt, bucket_size;
+	u32 key_size, value_size, size;
+	struct htab_elem *node_to_free = NULL;
+	void *keys = NULL, *values = NULL;
+	void *dst_key, *dst_val;
+	struct hlist_nulls_node *n;
+	struct htab_elem *l;
+	unsigned long flags;
+	struct bucket *b;
+	int ret = 0;
+
+	if (attr->batch.elem_flags || attr->batch.flags)
+		return -EINVAL;
+
+	max_count = attr->batch.count;
+	if (!max_count)
+		return 0;
+
+	if (put_user(0, &uattr->batch.count))
+		return -EFAULT;
+
+	/* the batch is the index of the next bucket to walk */
+	batch = 0;
+	if (ubatch && copy_from_user(&batch, ubatch, sizeof(batch)))
+		return -EFAULT;
+
+	if (batch >= htab->n_buckets)
+		return -ENOENT;
+
+	key_size = map->key_size;
+	size = round_up(map->value_size, 8);
+	if (is_percpu)
+		value_size = size * num_possible_cpus();
+	else
+		value_size = map->value_size;
+	total = 0;
+	/* buckets seldom hold more than a few elements, this grows on demand */
+	bucket_size = 5;
+
+alloc:
+	/* a bucket is copied here under its lock, and to user space after */
+	keys = kvmalloc_array(key_size, bucket_size, GFP_USER | __GFP_NOWARN);
+	values = kvmalloc_array(value_size, bucket_size,
+				GFP_USER | __GFP_NOWARN);
+	if (!keys || !values) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (; batch < htab->n_buckets; batch++) {
+		b = &htab->buckets[batch];
+
+		/* don't take the lock of empty buckets */
+		if (hlist_nulls_empty(&b->head))
+			continue;
+
+		preempt_disable();
+		__this_cpu_inc(bpf_prog_active);
+		raw_spin_lock_irqsave(&b->lock, flags);
+
+		bucket_cnt = 0;
+		hlist_nulls_for_each_entry(l, n, &b->head, hash_node)
+			bucket_cnt++;
+
+		if (bucket_cnt > max_count - total ||
+		    bucket_cnt > bucket_size) {
+			raw_spin_unlock_irqrestore(&b->lock, flags);
+			__this_cpu_dec(bpf_prog_active);
+			preempt_enable();
+
+			/* buckets aren't split across batches */
+			if (bucket_cnt > max_count - total) {
+				if (!total)
+					ret = -ENOSPC;
+				goto out_batch;
+			}
+
+			kvfree(keys);
+			kvfree(values);
+			bucket_size = bucket_cnt;
+			goto alloc;
+		}
+
+		dst_key = keys;
+		dst_val = values;
+		hlist_nulls_for_each_entry_safe(l, n, &b->head, hash_node) {
+			memcpy(dst_key, l->key, key_size);
+
+			if (is_percpu) {
+				void __percpu *pptr;
+				int off = 0, cpu;
+
+				pptr = htab_elem_get_ptr(l, key_size);
+				for_each_possible_cpu(cpu) {
+					bpf_long_memcpy(dst_val + off,
+							per_cpu_ptr(pptr, cpu),
+							size);
+					off += size;
+				}
+			} else {
+				memcpy(dst_val, l->key + round_up(key_size, 8),
+				       value_size);
+			}
+
+			if (do_delete) {
+				hlist_nulls_del_rcu(&l->hash_node);
+
+				/* bpf_lru_push_free() takes the LRU lock,
+				 * not to be nested in the bucket lock, see
+				 * prealloc_lru_pop()
+				 */
+				if (is_lru_map) {
+					l->batch_flink = node_to_free;
+					node_to_free = l;
+				} else {
+					free_htab_elem(htab, l);
+				}
+			}
+
+			dst_key += key_size;
+			dst_val += value_size;
+		}
+
+		raw_spin_unlock_irqrestore(&b->lock, flags);
+
+		while (node_to_free) {
+			l = node_to_free;
+			node_to_free = node_to_free->batch_flink;
+			bpf_lru_push_free(&htab->lru, &l->lru_node);
+		}
+
+		__this_cpu_dec(bpf_prog_active);
+		preempt_enable();
+
+		if (copy_to_user(ukeys + total * key_size, keys,
+				 key_size * bucket_cnt) ||
+		    copy_to_user(uvalues + total * value_size, values,
+				 value_size * bucket_cnt)) {
+			ret = -EFAULT;
+			goto out;
+		}
+
+		total += bucket_cnt;
+	}
+
+	/* all buckets walked */
+	ret = -ENOENT;
+
+out_batch:
+	ubatch = u64_to_user_ptr(attr->batch.out_batch);
+	if (copy_to_user(ubatch, &batch, sizeof(batch)) ||
+	    put_user(total, &uattr->batch.count))
+		ret = -EFAULT;
+
+out:
+	kvfree(keys);
+	kvfree(values);
+	return ret;
+}
+
+static int
+htab_percpu_map_lookup_batch(struct bpf_map *map, const union bpf_attr *attr,
+			     union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  false, true);
+}
+
+static int
+htab_percpu_map_lookup_and_delete_batch(struct bpf_map *map,
+					const union bpf_attr *attr,
+					union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  false, true);
+}
+
+static int
+htab_map_lookup_batch(struct bpf_map *map, const union bpf_attr *attr,
+		      union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  false, false);
+}
+
+static int
+htab_map_lookup_and_delete_batch(struct bpf_map *map,
+				 const union bpf_attr *attr,
+				 union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  false, false);
+}
+
+static int
+htab_lru_percpu_map_lookup_batch(struct bpf_map *map,
+				 const union bpf_attr *attr,
+				 union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  true, true);
+}
+
+static int
+htab_lru_percpu_map_lookup_and_delete_batch(struct bpf_map *map,
+					    const union bpf_attr *attr,
+					    union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  true, true);
+}
+
+static int
+htab_lru_map_lookup_batch(struct bpf_map *map, const union bpf_attr *attr,
+			  union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  true, false);
+}
+
+static int
+htab_lru_map_lookup_and_delete_batch(struct bpf_map *map,
+				     const union bpf_attr *attr,
+				     union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  true, false);
+}
+
 const struct bpf_map_ops htab_map_ops = {
 	.map_alloc_check = htab_map_alloc_check,
 	.map_alloc = htab_map_alloc,
@@ -1198,6 +1439,10 @@ const struct bpf_map_ops htab_map_ops = {
 	.map_delete_elem = htab_map_delete_elem,
 	.map_gen_lookup = htab_map_gen_lookup,
 	.map_seq_show_elem = htab_map_seq_show_elem,
+	.map_lookup_batch = htab_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 const struct bpf_map_ops htab_lru_map_ops = {
@@ -1210,6 +1455,10 @@ const struct bpf_map_ops htab_lru_map_ops = {
 	.map_delete_elem = htab_lru_map_delete_elem,
 	.map_gen_lookup = htab_lru_map_gen_lookup,
 	.map_seq_show_elem = htab_map_seq_show_elem,
+	.map_lookup_batch = htab_lru_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_lru_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 /* Called from eBPF program */
@@ -1323,6 +1572,10 @@ const struct bpf_map_ops htab_percpu_map_ops = {
 	.map_update_elem = htab_percpu_map_update_elem,
 	.map_delete_elem = htab_map_delete_elem,
 	.map_seq_show_elem = htab_percpu_map_seq_show_elem,
+	.map_lookup_batch = htab_percpu_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_percpu_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 const struct bpf_map_ops htab_lru_percpu_map_ops = {
@@ -1334,6 +1587,10 @@ const struct bpf_map_ops htab_lru_percpu_map_ops = {
 	.map_update_elem = htab_lru_percpu_map_update_elem,
 	.map_delete_elem = htab_lru_map_delete_elem,
 	.map_seq_show_elem = htab_percpu_map_seq_show_elem,
+	.map_lookup_batch = htab_lru_percpu_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_lru_percpu_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 static int fd_htab_map_alloc_check(union bpf_attr *attr)
@@ -0,0 +1,463 @@
+// SPDX-License-Identifier: GPL-2.0
+/* BPF_MAP_TYPE_RHASH: resizable hash map
+ *
+ * A hash map on top of rhashtable: the bucket array starts small, and a
+ * worker grows or shrinks it incrementally with the number of elements,
+ * while lookups keep going on under RCU. max_entries only bounds the
+ * number of elements. Unless BPF_F_NO_PREALLOC is given, the elements are
+ * preallocated, as those of BPF_MAP_TYPE_HASH, and reused right away once
+ * deleted.
+ *
+ * rhashtable locks its buckets with bottom halves disabled: tracing
+ * programs, which may run with interrupts disabled or in NMI context, can
+ * only look elements up, see check_map_func_compatibility().
+ */
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/filter.h>
+#include <linux/rhashtable.h>
+#include <linux/slab.h>
+#include "percpu_freelist.h"
+
+#define RHTAB_CREATE_FLAG_MASK						\
+	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE | BPF_F_RDONLY | BPF_F_WRONLY)
+
+struct bpf_rhtab {
+	struct bpf_map map;
+	struct rhashtable ht;
+	void *elems;
+	struct pcpu_freelist freelist;
+	atomic_t count;	/* number of elements in this hashtable */
+	u32 elem_size;	/* size of each element in bytes */
+};
+
+/* each rhtab element is struct rhtab_elem + key + value */
+struct rhtab_elem {
+	/* lookups may still walk through a preallocated element that is
+	 * deleted and reused: its node doesn't share room with the freelist
+	 */
+	struct rhash_head node;
+	union {
+		struct pcpu_freelist_node fnode;
+		struct rcu_head rcu;
+	};
+	char key[0] __aligned(8);
+};
+
+/* key_len is left to the one of the map, in rhtab->ht.p */
+static const struct rhashtable_params rhtab_params = {
+	.head_offset		= offsetof(struct rhtab_elem, node),
+	.key_offset		= offsetof(struct rhtab_elem, key),
+	.automatic_shrinking	= true,
+};
+
+static bool rhtab_is_prealloc(const struct bpf_rhtab *rhtab)
+{
+	return !(rhtab->map.map_flags & BPF_F_NO_PREALLOC);
+}
+
+static void *rhtab_elem_value(const struct bpf_rhtab *rhtab,
+			      struct rhtab_elem *l)
+{
+	return l->key + round_up(rhtab->map.key_size, 8);
+}
+
+static int prealloc_init(struct bpf_rhtab *rhtab)
+{
+	/* an update replacing an element needs a new one before the old
+	 * one is back in the freelist, there's one in flight per cpu
+	 */
+	u32 num_entries = rhtab->map.max_entries + num_possible_cpus();
+	int err;
+
+	rhtab->elems = bpf_map_area_alloc(rhtab->elem_size * num_entries,
+					  rhtab->map.numa_node);
+	if (!rhtab->elems)
+		return -ENOMEM;
+
+	err = pcpu_freelist_init(&rhtab->freelist);
+	if (err) {
+		bpf_map_area_free(rhtab->elems);
+		return err;
+	}
+
+	pcpu_freelist_populate(&rhtab->freelist,
+			       rhtab->elems + offsetof(struct rhtab_elem, fnode),
+			       rhtab->elem_size, num_entries);
+	return 0;
+}
+
+static void prealloc_destroy(struct bpf_rhtab *rhtab)
+{
+	bpf_map_area_free(rhtab->elems);
+	pcpu_freelist_destroy(&rhtab->freelist);
+}
+
+/* Called from syscall */
+static int rhtab_map_alloc_check(union bpf_attr *attr)
+{
+	if (attr->map_flags & ~RHTAB_CREATE_FLAG_MASK)
+		/* reserved bits should not be used */
+		return -EINVAL;
+
+	if (attr->max_entries == 0 || attr->key_size == 0 ||
+	    attr->value_size == 0)
+		return -EINVAL;
+
+	if (attr->key_size > MAX_BPF_STACK)
+		/* eBPF programs initialize keys on stack, so they cannot be
+		 * larger than max stack size
+		 */
+		return -E2BIG;
+
+	if (attr->value_size >= KMALLOC_MAX_SIZE -
+	    MAX_BPF_STACK - sizeof(struct rhtab_elem))
+		/* same as for BPF_MAP_TYPE_HASH */
+		return -E2BIG;
+
+	return 0;
+}
+
+static struct bpf_map *rhtab_map_alloc(union bpf_attr *attr)
+{
+	struct rhashtable_params params = rhtab_params;
+	struct bpf_rhtab *rhtab;
+	u64 cost;
+	int err;
+
+	rhtab = kzalloc(sizeof(*rhtab), GFP_USER);
+	if (!rhtab)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&rhtab->map, attr);
+
+	rhtab->elem_size = sizeof(struct rhtab_elem) +
+			   round_up(rhtab->map.key_size, 8) +
+			   round_up(rhtab->map.value_size, 8);
+
+	/* charge for the largest bucket array the map can grow to */
+	cost = (u64) roundup_pow_of_two(rhtab->map.max_entries) *
+	       sizeof(struct rhash_head *) +
+	       (u64) rhtab->elem_size *
+	       (rhtab->map.max_entries + num_possible_cpus());
+
+	err = -E2BIG;
+	if (cost >= U32_MAX - PAGE_SIZE)
+		/* make sure page count doesn't overflow */
+		goto free_rhtab;
+
+	rhtab->map.pages = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+
+	/* if map size is larger than memlock limit, reject it early */
+	err = bpf_map_precharge_memlock(rhtab->map.pages);
+	if (err)
+		goto free_rhtab;
+
+	params.key_len = rhtab->map.key_size;
+	params.max_size = roundup_pow_of_two(rhtab->map.max_entries);
+	err = rhashtable_init(&rhtab->ht, &params);
+	if (err)
+		goto free_rhtab;
+
+	if (rhtab_is_prealloc(rhtab)) {
+		err = prealloc_init(rhtab);
+		if (err)
+			goto free_ht;
+	}
+
+	return &rhtab->map;
+
+free_ht:
+	rhashtable_destroy(&rhtab->ht);
+free_rhtab:
+	kfree(rhtab);
+	return ERR_PTR(err);
+}
+
+static struct rhtab_elem *__rhtab_map_lookup_elem(struct bpf_map *map,
+						  void *key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+
+	/* Must be called with rcu_read_lock. */
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	return rhashtable_lookup(&rhtab->ht, key, rhtab_params);
+}
+
+/* Called from syscall or from eBPF program */
+static void *rhtab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l = __rhtab_map_lookup_elem(map, key);
+
+	if (l)
+		return rhtab_elem_value(rhtab, l);
+
+	return NULL;
+}
+
+/* A dump racing with a resize may miss elements moved to the new bucket
+ * array, as one racing with deletions restarts from the first element.
+ */
+static int rhtab_map_get_next_key(struct bpf_map *map, void *key,
+				  void *next_key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhashtable *ht = &rhtab->ht;
+	struct rhtab_elem *l, *next_l;
+	struct bucket_table *tbl;
+	struct rhash_head *pos;
+	u32 key_size, hash;
+	unsigned int i = 0;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+
+	if (!key)
+		goto find_first_elem;
+
+	hash = rht_key_hashfn(ht, tbl, key, rhtab_params);
+	rht_for_each_entry_rcu(l, pos, tbl, hash, node) {
+		if (memcmp(l->key, key, key_size))
+			continue;
+
+		/* key was found, get next key in the same bucket */
+		pos = rht_dereference_bucket_rcu(pos->next, tbl, hash);
+		if (!rht_is_a_nulls(pos)) {
+			next_l = rht_obj(ht, pos);
+			memcpy(next_key, next_l->key, key_size);
+			return 0;
+		}
+
+		/* no more elements in this bucket, go to the next one */
+		i = hash + 1;
+		break;
+	}
+
+find_first_elem:
+	/* iterate over buckets */
+	for (; i < tbl->size; i++) {
+		rht_for_each_entry_rcu(next_l, pos, tbl, i, node) {
+			/* pick first element in the bucket */
+			memcpy(next_key, next_l->key, key_size);
+			return 0;
+		}
+	}
+
+	/* iterated over all buckets and all elements */
+	return -ENOENT;
+}
+
+static void rhtab_elem_free_rcu(struct rcu_head *head)
+{
+	struct rhtab_elem *l = container_of(head, struct rhtab_elem, rcu);
+
+	/* must increment bpf_prog_active to avoid kprobe+bpf triggering while
+	 * we're calling kfree, otherwise deadlock is possible if kprobes
+	 * are placed somewhere inside of slub
+	 */
+	preempt_disable();
+	__this_cpu_inc(bpf_prog_active);
+	kfree(l);
+	__this_cpu_dec(bpf_prog_active);
+	preempt_enable();
+}
+
+/* @l isn't in the table anymore, @counted if it's one of its elements */
+static void free_rhtab_elem(struct bpf_rhtab *rhtab, struct rhtab_elem *l,
+			    bool counted)
+{
+	if (counted)
+		atomic_dec(&rhtab->count);
+
+	if (rhtab_is_prealloc(rhtab)) {
+		pcpu_freelist_push(&rhtab->freelist, &l->fnode);
+	} else {
+		call_rcu(&l->rcu, rhtab_elem_free_rcu);
+	}
+}
+
+static struct rhtab_elem *alloc_rhtab_elem(struct bpf_rhtab *rhtab,
+					   void *key, void *value)
+{
+	struct pcpu_freelist_node *node;
+	struct rhtab_elem *l;
+
+	if (rhtab_is_prealloc(rhtab)) {
+		node = pcpu_freelist_pop(&rhtab->freelist);
+		if (!node)
+			return ERR_PTR(-E2BIG);
+		l = container_of(node, struct rhtab_elem, fnode);
+	} else {
+		l = kmalloc_node(rhtab->elem_size, GFP_ATOMIC | __GFP_NOWARN,
+				 rhtab->map.numa_node);
+		if (!l)
+			return ERR_PTR(-ENOMEM);
+	}
+
+	memcpy(l->key, key, rhtab->map.key_size);
+	memcpy(rhtab_elem_value(rhtab, l), value, rhtab->map.value_size);
+	return l;
+}
+
+static int check_flags(struct rhtab_elem *l_old, u64 map_flags)
+{
+	if (l_old && map_flags == BPF_NOEXIST)
+		/* elem already exists */
+		return -EEXIST;
+
+	if (!l_old && map_flags == BPF_EXIST)
+		/* elem doesn't exist, cannot update it */
+		return -ENOENT;
+
+	return 0;
+}
+
+/* Called from syscall or from eBPF program */
+static int rhtab_map_update_elem(struct bpf_map *map, void *key, void *value,
+				 u64 map_flags)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l_new, *l_old;
+	int ret;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	l_new = alloc_rhtab_elem(rhtab, key, value);
+	if (IS_ERR(l_new))
+		/* all pre-allocated elements are in use or memory exhausted */
+		return PTR_ERR(l_new);
+
+again:
+	l_old = __rhtab_map_lookup_elem(map, key);
+	ret = check_flags(l_old, map_flags);
+	if (ret)
+		goto err;
+
+	if (l_old) {
+		ret = rhashtable_replace_fast(&rhtab->ht, &l_old->node,
+					      &l_new->node, rhtab_params);
+		if (ret == -ENOENT)
+			/* deleted since the lookup */
+			goto again;
+		if (ret)
+			goto err;
+		free_rhtab_elem(rhtab, l_old, false);
+		return 0;
+	}
+
+	if (atomic_inc_return(&rhtab->count) > map->max_entries) {
+		atomic_dec(&rhtab->count);
+		ret = -E2BIG;
+		goto err;
+	}
+
+	ret = rhashtable_lookup_insert_fast(&rhtab->ht, &l_new->node,
+					    rhtab_params);
+	if (ret) {
+		atomic_dec(&rhtab->count);
+		if (ret == -EEXIST)
+			/* inserted since the lookup */
+			goto again;
+		goto err;
+	}
+	return 0;
+
+err:
+	free_rhtab_elem(rhtab, l_new, false);
+	return ret;
+}
+
+/* Called from syscall or from eBPF program */
+static int rhtab_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l;
+	int ret;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	l = __rhtab_map_lookup_elem(map, key);
+	if (!l)
+		return -ENOENT;
+
+	ret = rhashtable_remove_fast(&rhtab->ht, &l->node, rhtab_params);
+	if (ret)
+		/* deleted or replaced since the lookup */
+		return ret;
+
+	free_rhtab_elem(rhtab, l, true);
+	return 0;
+}
+
+static void rhtab_free_elem(void *ptr, void *arg)
+{
+	kfree(ptr);
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void rhtab_map_free(struct bpf_map *map)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+
+	/* at this point bpf_prog->aux->refcnt == 0 and this map->refcnt == 0,
+	 * so the programs (can be more than one that used this map) were
+	 * disconnected from events. Wait for outstanding critical sections in
+	 * these programs to complete
+	 */
+	synchronize_rcu();
+
+	/* some of free_rhtab_elem() callbacks for elements of this map may
+	 * not have executed. Wait for them.
+	 */
+	rcu_barrier();
+	if (rhtab_is_prealloc(rhtab)) {
+		rhashtable_destroy(&rhtab->ht);
+		prealloc_destroy(rhtab);
+	} else {
+		rhashtable_free_and_destroy(&rhtab->ht, rhtab_free_elem, NULL);
+	}
+	kfree(rhtab);
+}
+
+static void rhtab_map_seq_show_elem(struct bpf_map *map, void *key,
+				    struct seq_file *m)
+{
+	void *value;
+
+	rcu_read_lock();
+
+	value = rhtab_map_lookup_elem(map, key);
+	if (!value) {
+		rcu_read_unlock();
+		return;
+	}
+
+	btf_type_seq_show(map->btf, map->btf_key_type_id, key, m);
+	seq_puts(m, ": ");
+	btf_type_seq_show(map->btf, map->btf_value_type_id, value, m);
+	seq_puts(m, "\n");
+
+	rcu_read_unlock();
+}
+
+const struct bpf_map_ops rhtab_map_ops = {
+	.map_alloc_check = rhtab_map_alloc_check,
+	.map_alloc = rhtab_map_alloc,
+	.map_free = rhtab_map_free,
+	.map_get_next_key = rhtab_map_get_next_key,
+	.map_lookup_elem = rhtab_map_lookup_elem,
+	.map_update_elem = rhtab_map_update_elem,
+	.map_delete_elem = rhtab_map_delete_elem,
+	.map_seq_show_elem = rhtab_map_seq_show_elem,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
+};
@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: GPL-2.0
+/* BPF iterator targets for tasks and their open files
+ *
+ * "task": args[0] is the task_struct.
+ * "task_file": args[0] is the task_struct, args[1] the fd, args[2] the file.
+ *
+ * Tasks are those of the pid namespace of the opener of the iterator file.
+ */
+#include <linux/bpf.h>
+#include <linux/fdtable.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/pid_namespace.h>
+#include <linux/sched/task.h>
+#include <linux/seq_file.h>
+
+struct bpf_iter_seq_task_common {
+	struct pid_namespace *ns;
+};
+
+struct bpf_iter_seq_task_info {
+	/* must come first, for init_seq_pidns() and fini_seq_pidns() */
+	struct bpf_iter_seq_task_common common;
+	int tid;
+};
+
+/* Return the task with the lowest tid from *tid on, with a reference */
+static struct task_struct *task_seq_get_next(struct pid_namespace *ns,
+					     int *tid)
+{
+	struct task_struct *task = NULL;
+	struct pid *pid;
+
+	rcu_read_lock();
+retry:
+	pid = idr_get_next(&ns->idr, tid);
+	if (pid) {
+		task = get_pid_task(pid, PIDTYPE_PID);
+		if (!task) {
+			++*tid;
+			goto retry;
+		}
+	}
+	rcu_read_unlock();
+
+	return task;
+}
+
+/* The position is the tid of the next task, not *pos, so that a task not
+ * shown by a read() is the first one of the next.
+ */
+static void *task_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_iter_seq_task_info *info = seq->private;
+
+	return task_seq_get_next(info->common.ns, &info->tid);
+}
+
+static void *task_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_iter_seq_task_info *info = seq->private;
+
+	++*pos;
+	++info->tid;
+	put_task_struct((struct task_struct *)v);
+
+	return task_seq_get_next(info->common.ns, &info->tid);
+}
+
+static int __task_seq_show(struct seq_file *seq, struct task_struct *task,
+			   bool in_stop)
+{
+	struct bpf_iter_ctx ctx = {};
+	struct bpf_iter_meta meta;
+	struct bpf_prog *prog;
+
+	meta.seq = seq;
+	prog = bpf_iter_get_info(&meta, in_stop);
+	if (!prog)
+		return 0;
+
+	ctx.meta = &meta;
+	ctx.args[0] = (unsigned long)task;
+	return bpf_iter_run_prog(prog, &ctx);
+}
+
+static int task_seq_show(struct seq_file *seq, void *v)
+{
+	return __task_seq_show(seq, v, false);
+}
+
+static void task_seq_stop(struct seq_file *seq, void *v)
+{
+	if (!v)
+		(void)__task_seq_show(seq, v, true);
+	else
+		put_task_struct((struct task_struct *)v);
+}
+
+static const struct seq_operations task_seq_ops = {
+	.start	= task_seq_start,
+	.next	= task_seq_next,
+	.stop	= task_seq_stop,
+	.show	= task_seq_show,
+};
+
+struct bpf_iter_seq_task_file_info {
+	/* must come first, for init_seq_pidns() and fini_seq_pidns() */
+	struct bpf_iter_seq_task_common common;
+	struct task_struct *task;
+	struct files_struct *files;
+	int tid;
+	int fd;
+};
+
+/* Return the open file with the lowest fd from info->fd on, of the task
+ * with the lowest tid from info->tid on, holding a reference on the file,
+ * the task and its file table, which are kept in info. Threads share the
+ * file table of their group leader, they're skipped.
+ */
+static struct file *
+task_file_seq_get_next(struct bpf_iter_seq_task_file_info *info)
+{
+	struct pid_namespace *ns = info->common.ns;
+	struct files_struct *files;
+	struct task_struct *task;
+	struct file *f;
+	int fd;
+
+again:
+	if (info->task) {
+		task = info->task;
+		files = info->files;
+	} else {
+		task = task_seq_get_next(ns, &info->tid);
+		if (!task)
+			return NULL;
+
+		files = thread_group_leader(task) ?
+			get_files_struct(task) : NULL;
+		if (!files) {
+			put_task_struct(task);
+			++info->tid;
+			info->fd = 0;
+			goto again;
+		}
+
+		info->task = task;
+		info->files = files;
+	}
+
+	rcu_read_lock();
+	for (fd = info->fd; fd < files_fdtable(files)->max_fds; fd++) {
+		f = fcheck_files(files, fd);
+		if (!f || !get_file_rcu(f))
+			continue;
+
+		info->fd = fd;
+		rcu_read_unlock();
+		return f;
+	}
+	rcu_read_unlock();
+
+	/* no file left in this task, go on with the next one */
+	put_files_struct(files);
+	put_task_struct(task);
+	info->task = NULL;
+	info->files = NULL;
+	info->fd = 0;
+	++info->tid;
+	goto again;
+}
+
+static void *task_file_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_iter_seq_task_file_info *info = seq->private;
+
+	return task_file_seq_get_next(info);
+}
+
+static void *task_file_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_iter_seq_task_file_info *info = seq->private;
+
+	++*pos;
+	++info->fd;
+	fput((struct file *)v);
+
+	return task_file_seq_get_next(info);
+}
+
+static int __task_file_seq_show(struct seq_file *seq, struct file *file,
+				bool in_stop)
+{
+	struct bpf_iter_seq_task_file_info *info = seq->private;
+	struct bpf_iter_ctx ctx = {};
+	struct bpf_iter_meta meta;
+	struct bpf_prog *prog;
+
+	meta.seq = seq;
+	prog = bpf_iter_get_info(&meta, in_stop);
+	if (!prog)
+		return 0;
+
+	ctx.meta = &meta;
+	if (file) {
+		ctx.args[0] = (unsigned long)info->task;
+		ctx.args[1] = info->fd;
+		ctx.args[2] = (unsigned long)file;
+	}
+	return bpf_iter_run_prog(prog, &ctx);
+}
+
+static int task_file_seq_show(struct seq_file *seq, void *v)
+{
+	return __task_file_seq_show(seq, v, false);
+}
+
+/* A file not shown by a read() is the first one of the next, from the task
+ * and fd kept in info, only the references are dropped meanwhile.
+ */
+static void task_file_seq_stop(struct seq_file *seq, void *v)
+{
+	struct bpf_iter_seq_task_file_info *info = seq->private;
+
+	if (!v) {
+		(void)__task_file_seq_show(seq, v, true);
+	} else {
+		fput((struct file *)v);
+		put_files_struct(info->files);
+		put_task_struct(info->task);
+		info->files = NULL;
+		info->task = NULL;
+	}
+}
+
+static const struct seq_operations task_file_seq_ops = {
+	.start	= task_file_seq_start,
+	.next	= task_file_seq_next,
+	.stop	= task_file_seq_stop,
+	.show	= task_file_seq_show,
+};
+
+static int init_seq_pidns(void *priv_data)
+{
+	struct bpf_iter_seq_task_common *common = priv_data;
+
+	common->ns = get_pid_ns(task_active_pid_ns(current));
+	return 0;
+}
+
+static void fini_seq_pidns(void *priv_data)
+{
+	struct bpf_iter_seq_task_common *common = priv_data;
+
+	put_pid_ns(common->ns);
+}
+
+static const struct bpf_iter_reg task_reg_info = {
+	.target			= "task",
+	.seq_ops		= &task_seq_ops,
+	.init_seq_private	= init_seq_pidns,
+	.fini_seq_private	= fini_seq_pidns,
+	.seq_priv_size		= sizeof(struct bpf_iter_seq_task_info),
+};
+
+static const struct bpf_iter_reg task_file_reg_info = {
+	.target			= "task_file",
+	.seq_ops		= &task_file_seq_ops,
+	.init_seq_private	= init_seq_pidns,
+	.fini_seq_private	= fini_seq_pidns,
+	.seq_priv_size		= sizeof(struct bpf_iter_seq_task_file_info),
+};
+
+static int __init task_iter_init(void)
+{
+	int ret;
+
+	ret = bpf_iter_reg_target(&task_reg_info);
+	if (ret)
+		return ret;
+
+	return bpf_iter_reg_target(&task_file_reg_info);
+}
+late_initcall(task_iter_init);
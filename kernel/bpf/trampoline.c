@@ -0,0 +1,393 @@
+// SPDX-License-Identifier: GPL-2.0
+/* BPF trampolines
+ *
+ * A trampoline is generated code, called from the ftrace NOP at the entry
+ * of a kernel function, which runs the fentry programs attached to that
+ * function with its argument registers as context. When fexit programs are
+ * attached too, the trampoline calls the body of the function itself, and
+ * runs them with the return value once it returns. There's no breakpoint,
+ * no ftrace ops dispatch and no pt_regs to build on the way.
+ *
+ * The image is rebuilt each time a program is linked or unlinked, and the
+ * call at the function entry switched to the new one. The old image is
+ * freed once no task can be running it anymore, see bpf_tramp_image_put().
+ */
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/ftrace.h>
+#include <linux/hash.h>
+#include <linux/kallsyms.h>
+#include <linux/module.h>
+#include <linux/moduleloader.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#define TRAMPOLINE_HASH_BITS 10
+#define TRAMPOLINE_TABLE_SIZE (1 << TRAMPOLINE_HASH_BITS)
+
+/* how often to check whether tasks are still in a retired image */
+#define BPF_TRAMP_DRAIN_DELAY (HZ / 10)
+
+static struct hlist_head trampoline_table[TRAMPOLINE_TABLE_SIZE];
+
+/* serializes access to trampoline_table */
+static DEFINE_MUTEX(trampoline_mutex);
+
+static struct bpf_trampoline *bpf_trampoline_get(unsigned long ip)
+{
+	struct bpf_trampoline *tr;
+	struct hlist_head *head;
+	struct module *mod;
+	int i;
+
+	mutex_lock(&trampoline_mutex);
+	head = &trampoline_table[hash_long(ip, TRAMPOLINE_HASH_BITS)];
+	hlist_for_each_entry(tr, head, hlist) {
+		if (tr->ip == ip) {
+			refcount_inc(&tr->refcnt);
+			goto out;
+		}
+	}
+
+	/* the image calls into the function: keep its module around */
+	preempt_disable();
+	mod = __module_text_address(ip);
+	if (mod && !try_module_get(mod)) {
+		preempt_enable();
+		tr = NULL;
+		goto out;
+	}
+	preempt_enable();
+
+	tr = kzalloc(sizeof(*tr), GFP_KERNEL);
+	if (!tr) {
+		module_put(mod);
+		goto out;
+	}
+
+	tr->ip = ip;
+	tr->mod = mod;
+	refcount_set(&tr->refcnt, 1);
+	mutex_init(&tr->mutex);
+	for (i = 0; i < BPF_TRAMP_MAX; i++)
+		INIT_HLIST_HEAD(&tr->progs_hlist[i]);
+	hlist_add_head(&tr->hlist, head);
+out:
+	mutex_unlock(&trampoline_mutex);
+	return tr;
+}
+
+static void bpf_trampoline_put(struct bpf_trampoline *tr)
+{
+	mutex_lock(&trampoline_mutex);
+	if (!refcount_dec_and_test(&tr->refcnt))
+		goto out;
+	WARN_ON_ONCE(tr->cur_image);
+	hlist_del(&tr->hlist);
+	module_put(tr->mod);
+	kfree(tr);
+out:
+	mutex_unlock(&trampoline_mutex);
+}
+
+static struct bpf_tramp_image *bpf_tramp_image_alloc(void)
+{
+	struct bpf_tramp_image *im;
+
+	im = kzalloc(sizeof(*im), GFP_KERNEL);
+	if (!im)
+		return NULL;
+
+	im->active = alloc_percpu(u64);
+	if (!im->active)
+		goto out_free_im;
+
+	/* executable, and within rel32 reach of the kernel text */
+	im->image = module_alloc(PAGE_SIZE);
+	if (!im->image)
+		goto out_free_active;
+
+	return im;
+
+out_free_active:
+	free_percpu(im->active);
+out_free_im:
+	kfree(im);
+	return NULL;
+}
+
+static void bpf_tramp_image_free(struct bpf_tramp_image *im)
+{
+	int kind, i;
+
+	for (kind = 0; kind < BPF_TRAMP_MAX; kind++)
+		for (i = 0; i < im->tprogs[kind].nr_progs; i++)
+			bpf_prog_put(im->tprogs[kind].progs[i]);
+	module_memfree(im->image);
+	free_percpu(im->active);
+	kfree(im);
+}
+
+/* The image holds a reference on each program it calls, so that programs
+ * unlinked while a task still runs the image stay around until it's freed.
+ */
+static int bpf_tramp_image_get_progs(struct bpf_tramp_image *im,
+				     const struct bpf_trampoline *tr)
+{
+	struct bpf_prog_aux *aux;
+	struct bpf_prog *prog;
+	int kind;
+
+	for (kind = 0; kind < BPF_TRAMP_MAX; kind++) {
+		struct bpf_tramp_progs *tp = &im->tprogs[kind];
+
+		hlist_for_each_entry(aux, &tr->progs_hlist[kind], tramp_hlist) {
+			prog = bpf_prog_inc(aux->prog);
+			if (IS_ERR(prog))
+				return PTR_ERR(prog);
+			tp->progs[tp->nr_progs++] = prog;
+		}
+	}
+
+	return 0;
+}
+
+static u64 bpf_tramp_image_active(struct bpf_tramp_image *im)
+{
+	u64 active = 0;
+	int cpu;
+
+	/* a task can enter the original function on one CPU and return on
+	 * another, only the sum over all CPUs is meaningful
+	 */
+	for_each_possible_cpu(cpu)
+		active += *per_cpu_ptr(im->active, cpu);
+
+	return active;
+}
+
+static void bpf_tramp_image_drain(struct work_struct *work)
+{
+	struct bpf_tramp_image *im;
+
+	im = container_of(to_delayed_work(work), struct bpf_tramp_image, dwork);
+
+	/* tasks still in the original function return to the image, and
+	 * go straight to its epilogue, which is where they leave the count
+	 */
+	if (bpf_tramp_image_active(im)) {
+		schedule_delayed_work(&im->dwork, BPF_TRAMP_DRAIN_DELAY);
+		return;
+	}
+
+	bpf_tramp_image_free(im);
+}
+
+static void bpf_tramp_image_rcu_tasks(struct rcu_head *rcu)
+{
+	struct bpf_tramp_image *im;
+
+	im = container_of(rcu, struct bpf_tramp_image, rcu);
+	INIT_DELAYED_WORK(&im->dwork, bpf_tramp_image_drain);
+	schedule_delayed_work(&im->dwork, 0);
+}
+
+/* Retire an image which isn't called from the function entry anymore.
+ *
+ * Tasks running it outside of the original function are preemptible but
+ * never sleep there, an RCU tasks grace period waits for all of them to
+ * be gone. Tasks in the original function may sleep there for as long as
+ * it takes, they're counted in im->active instead; the fexit programs are
+ * skipped on their way back, since the new image, if any, runs them now.
+ */
+static void bpf_tramp_image_put(struct bpf_tramp_image *im)
+{
+	if (im->ip_after_call)
+		WARN_ON_ONCE(bpf_arch_text_poke(im->ip_after_call,
+						BPF_MOD_JUMP, NULL,
+						im->ip_epilogue));
+
+	call_rcu_tasks(&im->rcu, bpf_tramp_image_rcu_tasks);
+}
+
+static int bpf_trampoline_update(struct bpf_trampoline *tr)
+{
+	struct bpf_tramp_image *old_im = tr->cur_image;
+	struct bpf_tramp_image *im;
+	void *ip = (void *)tr->ip;
+	int err;
+
+	if (!tr->progs_cnt[BPF_TRAMP_FENTRY] &&
+	    !tr->progs_cnt[BPF_TRAMP_FEXIT]) {
+		err = bpf_arch_text_poke(ip, BPF_MOD_CALL, old_im->image,
+					 NULL);
+		if (WARN_ON_ONCE(err))
+			return err;
+		tr->cur_image = NULL;
+		bpf_tramp_image_put(old_im);
+		ftrace_release_location(tr->ip);
+		return 0;
+	}
+
+	im = bpf_tramp_image_alloc();
+	if (!im)
+		return -ENOMEM;
+
+	err = bpf_tramp_image_get_progs(im, tr);
+	if (err)
+		goto out_free;
+
+	err = arch_prepare_bpf_trampoline(im, im->image + PAGE_SIZE, ip);
+	if (err)
+		goto out_free;
+
+	/* the NOP at the function entry is ftrace's until the first image
+	 * is installed there, and ours until the last one is removed
+	 */
+	if (!old_im) {
+		err = ftrace_reserve_location(tr->ip);
+		if (err)
+			goto out_free;
+	}
+
+	err = bpf_arch_text_poke(ip, BPF_MOD_CALL,
+				 old_im ? old_im->image : NULL, im->image);
+	if (err) {
+		if (!old_im)
+			ftrace_release_location(tr->ip);
+		goto out_free;
+	}
+
+	tr->cur_image = im;
+	if (old_im)
+		bpf_tramp_image_put(old_im);
+	return 0;
+
+out_free:
+	bpf_tramp_image_free(im);
+	return err;
+}
+
+static enum bpf_tramp_prog_type bpf_attach_type_to_tramp(enum bpf_attach_type t)
+{
+	return t == BPF_TRACE_FEXIT ? BPF_TRAMP_FEXIT : BPF_TRAMP_FENTRY;
+}
+
+int bpf_trampoline_link_prog(struct bpf_prog *prog, const char *func_name)
+{
+	enum bpf_tramp_prog_type kind;
+	struct bpf_trampoline *tr;
+	unsigned long ip;
+	int err;
+
+	if (prog->aux->trampoline)
+		return -EBUSY;
+
+	ip = kallsyms_lookup_name(func_name);
+	if (!ip)
+		return -ENOENT;
+
+	/* the call to the trampoline replaces the ftrace NOP, which must be
+	 * the first instruction, for the arguments to be in their registers
+	 */
+	if (ftrace_location(ip) != ip)
+		return -EINVAL;
+
+	tr = bpf_trampoline_get(ip);
+	if (!tr)
+		return -ENOMEM;
+
+	kind = bpf_attach_type_to_tramp(prog->expected_attach_type);
+
+	mutex_lock(&tr->mutex);
+	if (tr->progs_cnt[BPF_TRAMP_FENTRY] +
+	    tr->progs_cnt[BPF_TRAMP_FEXIT] >= BPF_MAX_TRAMP_PROGS) {
+		err = -E2BIG;
+		goto out_unlock;
+	}
+
+	hlist_add_head(&prog->aux->tramp_hlist, &tr->progs_hlist[kind]);
+	tr->progs_cnt[kind]++;
+	err = bpf_trampoline_update(tr);
+	if (err) {
+		hlist_del(&prog->aux->tramp_hlist);
+		tr->progs_cnt[kind]--;
+		goto out_unlock;
+	}
+	prog->aux->trampoline = tr;
+out_unlock:
+	mutex_unlock(&tr->mutex);
+	if (err)
+		bpf_trampoline_put(tr);
+	return err;
+}
+
+/* If building the image without the program fails, the current one keeps
+ * running it, holding a reference on it, until the next update.
+ */
+int bpf_trampoline_unlink_prog(struct bpf_prog *prog)
+{
+	struct bpf_trampoline *tr = prog->aux->trampoline;
+	enum bpf_tramp_prog_type kind;
+	int err;
+
+	if (!tr)
+		return -EINVAL;
+
+	kind = bpf_attach_type_to_tramp(prog->expected_attach_type);
+
+	mutex_lock(&tr->mutex);
+	hlist_del(&prog->aux->tramp_hlist);
+	tr->progs_cnt[kind]--;
+	err = bpf_trampoline_update(tr);
+	mutex_unlock(&tr->mutex);
+
+	prog->aux->trampoline = NULL;
+	bpf_trampoline_put(tr);
+	return err;
+}
+
+/* Called by the image around each program. Programs don't nest on a CPU,
+ * as with kprobes: a program traced from another one is skipped, 0 is
+ * returned then.
+ */
+u64 notrace __bpf_prog_enter(void)
+{
+	rcu_read_lock();
+	preempt_disable();
+	if (unlikely(__this_cpu_inc_return(bpf_prog_active) != 1))
+		return 0;
+	return 1;
+}
+
+void notrace __bpf_prog_exit(void)
+{
+	__this_cpu_dec(bpf_prog_active);
+	preempt_enable();
+	rcu_read_unlock();
+}
+
+/* Called by the image around the call to the original function */
+void notrace __bpf_tramp_enter(struct bpf_tramp_image *im)
+{
+	this_cpu_inc(*im->active);
+}
+
+void notrace __bpf_tramp_exit(struct bpf_tramp_image *im)
+{
+	this_cpu_dec(*im->active);
+}
+
+int __weak arch_prepare_bpf_trampoline(struct bpf_tramp_image *im,
+				       void *image_end, void *orig_call)
+{
+	return -ENOTSUPP;
+}
+
+int __weak bpf_arch_text_poke(void *ip, enum bpf_text_poke_type t,
+			      void *old_addr, void *new_addr)
+{
+	return -ENOTSUPP;
+}
@@ -889,6 +889,8 @@ static int cgroup1_show_options(struct seq_file *seq, struct kernfs_root *kf_roo
 		seq_puts(seq, ",xattr");
 	if (root->flags & CGRP_ROOT_CPUSET_V2_MODE)
 		seq_puts(seq, ",cpuset_v2_mode");
+	if (root->flags & CGRP_ROOT_FAVOR_DYNMODS)
+		seq_puts(seq, ",favordynmods");
 
 	spin_lock(&release_agent_path_lock);
 	if (strlen(root->release_agent_path))
@@ -917,6 +919,8 @@ static int parse_cgroupfs_options(char *data, struct cgroup_sb_opts *opts)
 #endif
 
 	memset(opts, 0, sizeof(*opts));
+	if (IS_ENABLED(CONFIG_CGROUP_FAVOR_DYNMODS))
+		opts->flags |= CGRP_ROOT_FAVOR_DYNMODS;
 
 	while ((token = strsep(&o, ",")) != NULL) {
 		nr_opts++;
@@ -951,6 +955,10 @@ static int parse_cgroupfs_options(char *data, struct cgroup_sb_opts *opts)
 			opts->flags |= CGRP_ROOT_XATTR;
 			continue;
 		}
+		if (!strcmp(token, "favordynmods")) {
+			opts->flags |= CGRP_ROOT_FAVOR_DYNMODS;
+			continue;
+		}
 		if (!strncmp(token, "release_agent=", 14)) {
 			/* Specifying two release agents is forbidden */
 			if (opts->release_agent)
@@ -555,6 +555,7 @@ struct cgroup_subsys_state *cgroup_get_e_css(struct cgroup *cgrp,
 	rcu_read_unlock();
 	return css;
 }
+EXPORT_SYMBOL_GPL(cgroup_get_e_css);
 
 static void cgroup_get_live(struct cgroup *cgrp)
 {
@@ -1235,9 +1236,33 @@ static void cgroup_exit_root_id(struct cgroup_root *root)
 	idr_remove(&cgroup_hierarchy_idr, root->hierarchy_id);
 }
 
+/**
+ * cgroup_favor_dynmods - enable or disable favordynmods
+ * @root: cgroup root of interest
+ * @favor: whether to favor dynamic modifications
+ *
+ * With favordynmods, readers of cgroup_threadgroup_rwsem are kept on the
+ * slow path, so migrations don't wait for an RCU grace period each.  The
+ * rcu_sync counts, so the mode stays on while any hierarchy wants it.
+ */
+void cgroup_favor_dynmods(struct cgroup_root *root, bool favor)
+{
+	bool favoring = root->flags & CGRP_ROOT_FAVOR_DYNMODS;
+
+	/* see the comment above CGRP_ROOT_FAVOR_DYNMODS definition */
+	if (favor && !favoring) {
+		rcu_sync_enter(&cgroup_threadgroup_rwsem.rss);
+		root->flags |= CGRP_ROOT_FAVOR_DYNMODS;
+	} else if (!favor && favoring) {
+		rcu_sync_exit(&cgroup_threadgroup_rwsem.rss);
+		root->flags &= ~CGRP_ROOT_FAVOR_DYNMODS;
+	}
+}
+
 void cgroup_free_root(struct cgroup_root *root)
 {
 	if (root) {
+		cgroup_favor_dynmods(root, false);
 		idr_destroy(&root->cgroup_idr);
 		kfree(root);
 	}
@@ -1281,6 +1306,7 @@ static void cgroup_destroy_root(struct cgroup_root *root)
 
 	mutex_unlock(&cgroup_mutex);
 
+	cgroup_rstat_exit(cgrp);
 	kernfs_destroy_root(root->kf_root);
 	cgroup_free_root(root);
 }
@@ -1683,6 +1709,12 @@ int rebind_subsystems(struct cgroup_root *dst_root, u16 ss_mask)
 		ss->root = dst_root;
 		css->cgroup = dcgrp;
 
+		if (ss->css_rstat_flush) {
+			list_del_rcu(&css->rstat_css_node);
+			list_add_rcu(&css->rstat_css_node,
+				     &dcgrp->rstat_css_list);
+		}
+
 		spin_lock_irq(&css_set_lock);
 		hash_for_each(css_set_table, i, cset, hlist)
 			list_move_tail(&cset->e_cset_node[ss->id],
@@ -1743,6 +1775,8 @@ static int parse_cgroup_root_flags(char *data, unsigned int *root_flags)
 	char *token;
 
 	*root_flags = 0;
+	if (IS_ENABLED(CONFIG_CGROUP_FAVOR_DYNMODS))
+		*root_flags |= CGRP_ROOT_FAVOR_DYNMODS;
 
 	if (!data)
 		return 0;
@@ -1752,6 +1786,10 @@ static int parse_cgroup_root_flags(char *data, unsigned int *root_flags)
 			*root_flags |= CGRP_ROOT_NS_DELEGATE;
 			continue;
 		}
+		if (!strcmp(token, "favordynmods")) {
+			*root_flags |= CGRP_ROOT_FAVOR_DYNMODS;
+			continue;
+		}
 
 		pr_err("cgroup2: unknown option \"%s\"\n", token);
 		return -EINVAL;
@@ -1767,6 +1805,9 @@ static void apply_cgroup_root_flags(unsigned int root_flags)
 			cgrp_dfl_root.flags |= CGRP_ROOT_NS_DELEGATE;
 		else
 			cgrp_dfl_root.flags &= ~CGRP_ROOT_NS_DELEGATE;
+
+		cgroup_favor_dynmods(&cgrp_dfl_root,
+				     root_flags & CGRP_ROOT_FAVOR_DYNMODS);
 	}
 }
 
@@ -1774,6 +1815,8 @@ static int cgroup_show_options(struct seq_file *seq, struct kernfs_root *kf_root
 {
 	if (cgrp_dfl_root.flags & CGRP_ROOT_NS_DELEGATE)
 		seq_puts(seq, ",nsdelegate");
+	if (cgrp_dfl_root.flags & CGRP_ROOT_FAVOR_DYNMODS)
+		seq_puts(seq, ",favordynmods");
 	return 0;
 }
 
@@ -1884,7 +1927,8 @@ void init_cgroup_root(struct cgroup_root *root, struct cgroup_sb_opts *opts)
 	init_cgroup_housekeeping(cgrp);
 	idr_init(&root->cgroup_idr);
 
-	root->flags = opts->flags;
+	root->flags = opts->flags & ~CGRP_ROOT_FAVOR_DYNMODS;
+	cgroup_favor_dynmods(root, opts->flags & CGRP_ROOT_FAVOR_DYNMODS);
 	if (opts->release_agent)
 		strscpy(root->release_agent_path, opts->release_agent, PATH_MAX);
 	if (opts->name)
@@ -1914,6 +1958,10 @@ int cgroup_setup_root(struct cgroup_root *root, u16 ss_mask, int ref_flags)
 	if (ret)
 		goto out;
 
+	ret = cgroup_rstat_init(root_cgrp);
+	if (ret)
+		goto cancel_ref;
+
 	/*
 	 * We're accessing css_set_count without locking css_set_lock here,
 	 * but that's OK - it can only be increased by someone holding
@@ -1923,11 +1971,11 @@ int cgroup_setup_root(struct cgroup_root *root, u16 ss_mask, int ref_flags)
 	 */
 	ret = allocate_cgrp_cset_links(2 * css_set_count, &tmp_links);
 	if (ret)
-		goto cancel_ref;
+		goto exit_stats;
 
 	ret = cgroup_init_root_id(root);
 	if (ret)
-		goto cancel_ref;
+		goto exit_stats;
 
 	kf_sops = root == &cgrp_dfl_root ?
 		&cgroup_kf_syscall_ops : &cgroup1_kf_syscall_ops;
@@ -1987,6 +2035,8 @@ int cgroup_setup_root(struct cgroup_root *root, u16 ss_mask, int ref_flags)
 	root->kf_root = NULL;
 exit_root_id:
 	cgroup_exit_root_id(root);
+exit_stats:
+	cgroup_rstat_exit(root_cgrp);
 cancel_ref:
 	percpu_ref_exit(&root_cgrp->self.refcnt);
 out:
@@ -3430,7 +3480,70 @@ static int cgroup_cpu_pressure_show(struct seq_file *seq, void *v)
 {
 	return psi_show(seq, &seq_css(seq)->cgroup->psi, PSI_CPU);
 }
-#endif
+
+static ssize_t cgroup_pressure_write(struct kernfs_open_file *of, char *buf,
+					  size_t nbytes, enum psi_res res)
+{
+	struct psi_trigger *new;
+	struct cgroup *cgrp;
+
+	cgrp = cgroup_kn_lock_live(of->kn, false);
+	if (!cgrp)
+		return -ENODEV;
+
+	cgroup_get(cgrp);
+	cgroup_kn_unlock(of->kn);
+
+	/* Allow only one trigger per file descriptor */
+	if (of->priv) {
+		cgroup_put(cgrp);
+		return -EBUSY;
+	}
+
+	new = psi_trigger_create(&cgrp->psi, buf, nbytes, res);
+	if (IS_ERR(new)) {
+		cgroup_put(cgrp);
+		return PTR_ERR(new);
+	}
+
+	smp_store_release(&of->priv, new);
+	cgroup_put(cgrp);
+
+	return nbytes;
+}
+
+static ssize_t cgroup_io_pressure_write(struct kernfs_open_file *of,
+					  char *buf, size_t nbytes,
+					  loff_t off)
+{
+	return cgroup_pressure_write(of, buf, nbytes, PSI_IO);
+}
+
+static ssize_t cgroup_memory_pressure_write(struct kernfs_open_file *of,
+					  char *buf, size_t nbytes,
+					  loff_t off)
+{
+	return cgroup_pressure_write(of, buf, nbytes, PSI_MEM);
+}
+
+static ssize_t cgroup_cpu_pressure_write(struct kernfs_open_file *of,
+					  char *buf, size_t nbytes,
+					  loff_t off)
+{
+	return cgroup_pressure_write(of, buf, nbytes, PSI_CPU);
+}
+
+static __poll_t cgroup_pressure_poll(struct kernfs_open_file *of,
+					  poll_table *pt)
+{
+	return psi_trigger_poll(&of->priv, of->file, pt);
+}
+
+static void cgroup_pressure_release(struct kernfs_open_file *of)
+{
+	psi_trigger_destroy(of->priv);
+}
+#endif /* CONFIG_PSI */
 
 static int cgroup_file_open(struct kernfs_open_file *of)
 {
@@ -3449,6 +3562,16 @@ static void cgroup_file_release(struct kernfs_open_file *of)
 		cft->release(of);
 }
 
+static __poll_t cgroup_file_poll(struct kernfs_open_file *of, poll_table *pt)
+{
+	struct cftype *cft = of->kn->priv;
+
+	if (cft->poll)
+		return cft->poll(of, pt);
+
+	return kernfs_generic_poll(of, pt);
+}
+
 static ssize_t cgroup_file_write(struct kernfs_open_file *of, char *buf,
 				 size_t nbytes, loff_t off)
 {
@@ -3537,6 +3660,7 @@ static struct kernfs_ops cgroup_kf_single_ops = {
 	.open			= cgroup_file_open,
 	.release		= cgroup_file_release,
 	.write			= cgroup_file_write,
+	.poll			= cgroup_file_poll,
 	.seq_show		= cgroup_seqfile_show,
 };
 
@@ -3545,6 +3669,7 @@ static struct kernfs_ops cgroup_kf_ops = {
 	.open			= cgroup_file_open,
 	.release		= cgroup_file_release,
 	.write			= cgroup_file_write,
+	.poll			= cgroup_file_poll,
 	.seq_start		= cgroup_seqfile_start,
 	.seq_next		= cgroup_seqfile_next,
 	.seq_stop		= cgroup_seqfile_stop,
@@ -4567,16 +4692,25 @@ static struct cftype cgroup_base_files[] = {
 		.name = "io.pressure",
 		.flags = CFTYPE_NOT_ON_ROOT,
 		.seq_show = cgroup_io_pressure_show,
+		.write = cgroup_io_pressure_write,
+		.poll = cgroup_pressure_poll,
+		.release = cgroup_pressure_release,
 	},
 	{
 		.name = "memory.pressure",
 		.flags = CFTYPE_NOT_ON_ROOT,
 		.seq_show = cgroup_memory_pressure_show,
+		.write = cgroup_memory_pressure_write,
+		.poll = cgroup_pressure_poll,
+		.release = cgroup_pressure_release,
 	},
 	{
 		.name = "cpu.pressure",
 		.flags = CFTYPE_NOT_ON_ROOT,
 		.seq_show = cgroup_cpu_pressure_show,
+		.write = cgroup_cpu_pressure_write,
+		.poll = cgroup_pressure_poll,
+		.release = cgroup_pressure_release,
 	},
 #endif
 	{ }	/* terminate */
@@ -4640,8 +4774,7 @@ static void css_free_rwork_fn(struct work_struct *work)
 			cgroup_put(cgroup_parent(cgrp));
 			kernfs_put(cgrp->kn);
 			psi_cgroup_free(cgrp);
-			if (cgroup_on_dfl(cgrp))
-				cgroup_rstat_exit(cgrp);
+			cgroup_rstat_exit(cgrp);
 			kfree(cgrp);
 		} else {
 			/*
@@ -4743,7 +4876,7 @@ static void init_and_link_css(struct cgroup_subsys_state *css,
 		css_get(css->parent);
 	}
 
-	if (cgroup_on_dfl(cgrp) && ss->css_rstat_flush)
+	if (ss->css_rstat_flush)
 		list_add_rcu(&css->rstat_css_node, &cgrp->rstat_css_list);
 
 	BUG_ON(cgroup_css(cgrp, ss));
@@ -4875,11 +5008,9 @@ static struct cgroup *cgroup_create(struct cgroup *parent)
 	if (ret)
 		goto out_free_cgrp;
 
-	if (cgroup_on_dfl(parent)) {
-		ret = cgroup_rstat_init(cgrp);
-		if (ret)
-			goto out_cancel_ref;
-	}
+	ret = cgroup_rstat_init(cgrp);
+	if (ret)
+		goto out_cancel_ref;
 
 	/*
 	 * Temporarily set the pointer to NULL, so idr_find() won't return
@@ -4947,8 +5078,7 @@ static struct cgroup *cgroup_create(struct cgroup *parent)
 out_idr_free:
 	cgroup_idr_remove(&root->cgroup_idr, cgrp->id);
 out_stat_exit:
-	if (cgroup_on_dfl(parent))
-		cgroup_rstat_exit(cgrp);
+	cgroup_rstat_exit(cgrp);
 out_cancel_ref:
 	percpu_ref_exit(&cgrp->self.refcnt);
 out_free_cgrp:
@@ -5345,8 +5475,15 @@ int __init cgroup_init(void)
 	/*
 	 * The latency of the synchronize_sched() is too high for cgroups,
 	 * avoid it at the cost of forcing all readers into the slow path.
+	 * This is the default; without CONFIG_CGROUP_FAVOR_DYNMODS readers
+	 * stay on the fast path until a hierarchy is mounted with
+	 * favordynmods.  Nobody can be waiting for a grace period yet, so
+	 * the default hierarchy takes its reference without one.
 	 */
-	rcu_sync_enter_start(&cgroup_threadgroup_rwsem.rss);
+	if (IS_ENABLED(CONFIG_CGROUP_FAVOR_DYNMODS)) {
+		rcu_sync_enter_start(&cgroup_threadgroup_rwsem.rss);
+		cgrp_dfl_root.flags |= CGRP_ROOT_FAVOR_DYNMODS;
+	}
 
 	get_user_ns(init_cgroup_ns.user_ns);
 
@@ -5555,21 +5692,151 @@ void cgroup_fork(struct task_struct *child)
 	INIT_LIST_HEAD(&child->cg_list);
 }
 
+/**
+ * cgroup_css_set_fork - find or create a css_set for a child process
+ * @kargs: the arguments passed to create the child process
+ *
+ * This functions finds or creates a new css_set which the child
+ * process will be attached to in cgroup_post_fork().  Without
+ * CLONE_INTO_CGROUP the child simply joins the css_set of %current
+ * there, and nothing but cgroup_threadgroup_rwsem is taken here.
+ *
+ * With CLONE_INTO_CGROUP, cgroup_mutex is held until the child is
+ * attached, the target cgroup is checked with the rules of a write to
+ * its cgroup.procs (or cgroup.threads for CLONE_THREAD), and a
+ * reference to the target css_set is left in @kargs.
+ */
+static int cgroup_css_set_fork(struct kernel_clone_args *kargs)
+	__acquires(&cgroup_mutex) __acquires(&cgroup_threadgroup_rwsem)
+{
+	struct cgroup_subsys_state *css;
+	struct cgroup *src_cgrp, *dst_cgrp;
+	struct css_set *cset;
+	struct super_block *sb;
+	struct file *f;
+	int ret;
+
+	kargs->cgrp = NULL;
+	kargs->cset = NULL;
+
+	if (!(kargs->flags & CLONE_INTO_CGROUP)) {
+		cgroup_threadgroup_change_begin(current);
+		return 0;
+	}
+
+	f = fget_raw(kargs->cgroup);
+	if (!f)
+		return -EBADF;
+	sb = f->f_path.dentry->d_sb;
+
+	css = css_tryget_online_from_dir(f->f_path.dentry, NULL);
+	if (IS_ERR(css)) {
+		fput(f);
+		return PTR_ERR(css);
+	}
+	dst_cgrp = css->cgroup;
+
+	/* The css_set task lists must be in use for the child to join one */
+	if (!use_task_css_set_links)
+		cgroup_enable_task_cg_lists();
+
+	mutex_lock(&cgroup_mutex);
+	cgroup_threadgroup_change_begin(current);
+
+	ret = -EBADF;
+	if (!cgroup_on_dfl(dst_cgrp))
+		goto err;
+
+	ret = -ENODEV;
+	if (cgroup_is_dead(dst_cgrp))
+		goto err;
+
+	spin_lock_irq(&css_set_lock);
+	cset = task_css_set(current);
+	get_css_set(cset);
+	spin_unlock_irq(&css_set_lock);
+	src_cgrp = cset->dfl_cgrp;
+
+	/*
+	 * We don't go through the vfs to write cgroup.procs, so check
+	 * what a write would have checked.
+	 */
+	ret = cgroup_procs_write_permission(src_cgrp, dst_cgrp, sb);
+	if (!ret && (kargs->flags & CLONE_THREAD) &&
+	    src_cgrp->dom_cgrp != dst_cgrp->dom_cgrp)
+		ret = -EOPNOTSUPP;
+	if (!ret)
+		ret = cgroup_migrate_vet_dst(dst_cgrp);
+	if (ret) {
+		put_css_set(cset);
+		goto err;
+	}
+
+	kargs->cset = find_css_set(cset, dst_cgrp);
+	put_css_set(cset);
+	if (!kargs->cset) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	fput(f);
+	kargs->cgrp = dst_cgrp;
+	return 0;
+
+err:
+	cgroup_threadgroup_change_end(current);
+	mutex_unlock(&cgroup_mutex);
+	cgroup_put(dst_cgrp);
+	fput(f);
+	return ret;
+}
+
+/**
+ * cgroup_css_set_put_fork - drop what cgroup_css_set_fork() took
+ * @kargs: the arguments passed to create the child process
+ */
+static void cgroup_css_set_put_fork(struct kernel_clone_args *kargs)
+	__releases(&cgroup_threadgroup_rwsem) __releases(&cgroup_mutex)
+{
+	cgroup_threadgroup_change_end(current);
+
+	if (kargs->flags & CLONE_INTO_CGROUP) {
+		struct cgroup *cgrp = kargs->cgrp;
+		struct css_set *cset = kargs->cset;
+
+		mutex_unlock(&cgroup_mutex);
+
+		put_css_set(cset);
+		kargs->cset = NULL;
+
+		cgroup_put(cgrp);
+		kargs->cgrp = NULL;
+	}
+}
+
 /**
  * cgroup_can_fork - called on a new task before the process is exposed
  * @child: the task in question.
- *
- * This calls the subsystem can_fork() callbacks. If the can_fork() callback
- * returns an error, the fork aborts with that error code. This allows for
- * a cgroup subsystem to conditionally allow or deny new forks.
+ * @kargs: the arguments passed to create the child process
+ *
+ * This prepares a new css_set for the child process which the child will
+ * be attached to in cgroup_post_fork(), and takes cgroup_threadgroup_rwsem
+ * until then.  It then calls the subsystem can_fork() callbacks.  If the
+ * can_fork() callback returns an error, the fork aborts with that error
+ * code.  This allows for a cgroup subsystem to conditionally allow or deny
+ * new forks.
  */
-int cgroup_can_fork(struct task_struct *child)
+int cgroup_can_fork(struct task_struct *child, struct kernel_clone_args *kargs)
 {
 	struct cgroup_subsys *ss;
 	int i, j, ret;
 
+	ret = cgroup_css_set_fork(kargs);
+	if (ret)
+		return ret;
+
 	do_each_subsys_mask(ss, i, have_canfork_callback) {
-		ret = ss->can_fork(child);
+		ret = ss->can_fork(child, kargs->cset);
 		if (ret)
 			goto out_revert;
 	} while_each_subsys_mask();
@@ -5581,32 +5848,40 @@ int cgroup_can_fork(struct task_struct *child)
 		if (j >= i)
 			break;
 		if (ss->cancel_fork)
-			ss->cancel_fork(child);
+			ss->cancel_fork(child, kargs->cset);
 	}
 
+	cgroup_css_set_put_fork(kargs);
+
 	return ret;
 }
 
 /**
  * cgroup_cancel_fork - called if a fork failed after cgroup_can_fork()
  * @child: the task in question
+ * @kargs: the arguments passed to create the child process
  *
  * This calls the cancel_fork() callbacks if a fork failed *after*
- * cgroup_can_fork() succeded.
+ * cgroup_can_fork() succeded and cleans up references we took to
+ * prepare a new css_set for the child process in cgroup_can_fork().
  */
-void cgroup_cancel_fork(struct task_struct *child)
+void cgroup_cancel_fork(struct task_struct *child,
+			struct kernel_clone_args *kargs)
 {
 	struct cgroup_subsys *ss;
 	int i;
 
 	for_each_subsys(ss, i)
 		if (ss->cancel_fork)
-			ss->cancel_fork(child);
+			ss->cancel_fork(child, kargs->cset);
+
+	cgroup_css_set_put_fork(kargs);
 }
 
 /**
  * cgroup_post_fork - called on a new task after adding it to the task list
  * @child: the task in question
+ * @kargs: the arguments passed to create the child process
  *
  * Adds the task to the list running through its css_set if necessary and
  * call the subsystem fork() callbacks.  Has to be after the task is
@@ -5614,7 +5889,8 @@ void cgroup_cancel_fork(struct task_struct *child)
  * cgroup_task_iter_start() - to guarantee that the new task ends up on its
  * list.
  */
-void cgroup_post_fork(struct task_struct *child)
+void cgroup_post_fork(struct task_struct *child,
+		      struct kernel_clone_args *kargs)
 {
 	struct cgroup_subsys *ss;
 	int i;
@@ -5644,7 +5920,8 @@ void cgroup_post_fork(struct task_struct *child)
 		struct css_set *cset;
 
 		spin_lock_irq(&css_set_lock);
-		cset = task_css_set(current);
+		/* CLONE_INTO_CGROUP picked the css_set in cgroup_can_fork() */
+		cset = kargs->cset ?: task_css_set(current);
 		if (list_empty(&child->cg_list)) {
 			get_css_set(cset);
 			cset->nr_tasks++;
@@ -5661,6 +5938,8 @@ void cgroup_post_fork(struct task_struct *child)
 	do_each_subsys_mask(ss, i, have_fork_callback) {
 		ss->fork(child);
 	} while_each_subsys_mask();
+
+	cgroup_css_set_put_fork(kargs);
 }
 
 /**
@@ -6009,7 +6288,7 @@ static struct kobj_attribute cgroup_delegate_attr = __ATTR_RO(delegate);
 static ssize_t features_show(struct kobject *kobj, struct kobj_attribute *attr,
 			     char *buf)
 {
-	return snprintf(buf, PAGE_SIZE, "nsdelegate\n");
+	return snprintf(buf, PAGE_SIZE, "nsdelegate\nfavordynmods\n");
 }
 static struct kobj_attribute cgroup_features_attr = __ATTR_RO(features);
 
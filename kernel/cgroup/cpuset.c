@@ -109,6 +109,12 @@ struct cpuset {
 	cpumask_var_t effective_cpus;
 	nodemask_t effective_mems;
 
+	/*
+	 * CPUs of a partition root that were handed out to its child
+	 * partition roots. They are not part of its effective_cpus.
+	 */
+	cpumask_var_t subparts_cpus;
+
 	/*
 	 * This is old Memory Nodes tasks took on.
 	 *
@@ -134,6 +140,47 @@ struct cpuset {
 
 	/* for custom sched domain */
 	int relax_domain_level;
+
+	/* partition root state, and why it is invalid if it is */
+	int partition_root_state;
+	int prs_err;
+};
+
+/*
+ * Partition root states, on the default hierarchy only:
+ *
+ *   0 - member: a regular cpuset, using the CPUs of its parent
+ *   1 - root: owns its CPUs, which form a sched domain on their own
+ *   2 - isolated: owns its CPUs, which are not load balanced at all
+ *  -1 - invalid root
+ *  -2 - invalid isolated
+ *
+ * A partition root takes the CPUs in its cpuset.cpus away from its parent,
+ * which must be a valid partition root itself, and keeps them exclusive.
+ * When the CPUs can no longer all be granted, because of hotplug or of
+ * changes to cpuset.cpus, the partition becomes invalid and behaves like
+ * a member until they can be again.
+ */
+#define PRS_MEMBER		0
+#define PRS_ROOT		1
+#define PRS_ISOLATED		2
+#define PRS_INVALID_ROOT	-1
+#define PRS_INVALID_ISOLATED	-2
+
+/* Reasons for a partition root to be invalid */
+enum prs_errcode {
+	PERR_NONE = 0,
+	PERR_INVCPUS,
+	PERR_PARENT,
+	PERR_NOCPUS,
+	PERR_HOTPLUG,
+};
+
+static const char * const perr_strings[] = {
+	[PERR_INVCPUS]	= "Invalid cpu list in cpuset.cpus",
+	[PERR_PARENT]	= "Parent is an invalid partition root",
+	[PERR_NOCPUS]	= "Parent unable to distribute cpu downstream",
+	[PERR_HOTPLUG]	= "No cpu available due to hotplug",
 };
 
 static inline struct cpuset *css_cs(struct cgroup_subsys_state *css)
@@ -218,9 +265,15 @@ static inline int is_spread_slab(const struct cpuset *cs)
 	return test_bit(CS_SPREAD_SLAB, &cs->flags);
 }
 
+static inline bool is_partition_valid(const struct cpuset *cs)
+{
+	return cs->partition_root_state > 0;
+}
+
 static struct cpuset top_cpuset = {
 	.flags = ((1 << CS_ONLINE) | (1 << CS_CPU_EXCLUSIVE) |
 		  (1 << CS_MEM_EXCLUSIVE)),
+	.partition_root_state = PRS_ROOT,
 };
 
 /**
@@ -666,7 +719,8 @@ static int generate_sched_domains(cpumask_var_t **domains,
 	csa = NULL;
 
 	/* Special case for the 99% of systems with one, full, sched domain */
-	if (is_sched_load_balance(&top_cpuset)) {
+	if (is_sched_load_balance(&top_cpuset) &&
+	    cpumask_empty(top_cpuset.subparts_cpus)) {
 		ndoms = 1;
 		doms = alloc_sched_domains(ndoms);
 		if (!doms)
@@ -688,6 +742,45 @@ static int generate_sched_domains(cpumask_var_t **domains,
 		goto done;
 	csn = 0;
 
+	/*
+	 * On the default hierarchy, each valid partition root that isn't
+	 * isolated makes a sched domain of its effective CPUs, which don't
+	 * overlap those of any other partition.  The CPUs of isolated
+	 * partitions are not in any domain.
+	 */
+	if (cgroup_subsys_on_dfl(cpuset_cgrp_subsys)) {
+		rcu_read_lock();
+		cpuset_for_each_descendant_pre(cp, pos_css, &top_cpuset) {
+			/* only partition roots have partition root children */
+			if (!is_partition_valid(cp)) {
+				pos_css = css_rightmost_descendant(pos_css);
+				continue;
+			}
+			if (cp->partition_root_state == PRS_ROOT &&
+			    cpumask_intersects(cp->effective_cpus,
+					housekeeping_cpumask(HK_FLAG_DOMAIN)))
+				csa[csn++] = cp;
+		}
+		rcu_read_unlock();
+
+		ndoms = csn;
+		doms = alloc_sched_domains(ndoms);
+		if (!doms)
+			goto done;
+
+		dattr = kmalloc_array(ndoms, sizeof(struct sched_domain_attr),
+				      GFP_KERNEL);
+		for (i = 0; i < ndoms; i++) {
+			cpumask_and(doms[i], csa[i]->effective_cpus,
+				    housekeeping_cpumask(HK_FLAG_DOMAIN));
+			if (dattr) {
+				dattr[i] = SD_ATTR_INIT;
+				update_domain_attr_tree(dattr + i, csa[i]);
+			}
+		}
+		goto done;
+	}
+
 	rcu_read_lock();
 	cpuset_for_each_descendant_pre(cp, pos_css, &top_cpuset) {
 		if (cp == &top_cpuset)
@@ -826,8 +919,10 @@ static int generate_sched_domains(cpumask_var_t **domains,
  */
 static void rebuild_sched_domains_locked(void)
 {
+	struct cgroup_subsys_state *pos_css;
 	struct sched_domain_attr *attr;
 	cpumask_var_t *doms;
+	struct cpuset *cs;
 	int ndoms;
 
 	lockdep_assert_held(&cpuset_mutex);
@@ -837,9 +932,28 @@ static void rebuild_sched_domains_locked(void)
 	 * We have raced with CPU hotplug. Don't do anything to avoid
 	 * passing doms with offlined cpu to partition_sched_domains().
 	 * Anyways, hotplug work item will rebuild sched domains.
+	 *
+	 * With partitions, the CPUs of the top cpuset are spread over the
+	 * effective_cpus of the valid partition roots.
 	 */
-	if (!cpumask_equal(top_cpuset.effective_cpus, cpu_active_mask))
-		goto out;
+	if (cpumask_empty(top_cpuset.subparts_cpus)) {
+		if (!cpumask_equal(top_cpuset.effective_cpus, cpu_active_mask))
+			goto out;
+	} else {
+		rcu_read_lock();
+		cpuset_for_each_descendant_pre(cs, pos_css, &top_cpuset) {
+			if (!is_partition_valid(cs)) {
+				pos_css = css_rightmost_descendant(pos_css);
+				continue;
+			}
+			if (!cpumask_subset(cs->effective_cpus,
+					    cpu_active_mask)) {
+				rcu_read_unlock();
+				goto out;
+			}
+		}
+		rcu_read_unlock();
+	}
 
 	/* Generate domain masks and attrs */
 	ndoms = generate_sched_domains(&doms, &attr);
@@ -876,24 +990,147 @@ static void update_tasks_cpumask(struct cpuset *cs)
 	struct task_struct *task;
 
 	css_task_iter_start(&cs->css, 0, &it);
-	while ((task = css_task_iter_next(&it)))
+	while ((task = css_task_iter_next(&it))) {
+		/* per-cpu kthreads of the top cpuset stay where they are */
+		if (task->flags & PF_NO_SETAFFINITY)
+			continue;
 		set_cpus_allowed_ptr(task, cs->effective_cpus);
+	}
 	css_task_iter_end(&it);
 }
 
+/*
+ * The CPUs a partition root owns: the active ones of its cpuset.cpus, or
+ * all of them for the top cpuset.
+ */
+static void partition_active_cpus(struct cpuset *cs, struct cpumask *pmask)
+{
+	if (cs == &top_cpuset)
+		cpumask_copy(pmask, cpu_active_mask);
+	else
+		cpumask_and(pmask, cs->cpus_allowed, cpu_active_mask);
+}
+
+/*
+ * compute_effective_cpumask - compute the effective cpumask of a cpuset
+ * @new_cpus: the temp variable for the new effective_cpus mask
+ * @cs: the cpuset that needs its effective_cpus computed
+ * @parent: the parent cpuset
+ *
+ * A valid partition root runs on its own active CPUs, less those given to
+ * its child partitions.  Any other cpuset gets the effective CPUs of its
+ * parent that it asks for, or on the default hierarchy all of them if that
+ * is none.
+ */
+static void compute_effective_cpumask(struct cpumask *new_cpus,
+				      struct cpuset *cs, struct cpuset *parent)
+{
+	if (is_partition_valid(cs)) {
+		partition_active_cpus(cs, new_cpus);
+		cpumask_andnot(new_cpus, new_cpus, cs->subparts_cpus);
+		return;
+	}
+
+	cpumask_and(new_cpus, cs->cpus_allowed, parent->effective_cpus);
+	if (is_in_v2_mode() && cpumask_empty(new_cpus))
+		cpumask_copy(new_cpus, parent->effective_cpus);
+}
+
+/*
+ * update_subparts - hand out the CPUs of a cpuset to its child partitions
+ * @cs: the cpuset whose children are considered
+ * @pool: temp variable for the CPUs @cs has left to give
+ * @part_cpus: temp variable
+ *
+ * Going through the children in order, each child partition root of a valid
+ * partition root gets the active CPUs of its cpuset.cpus, if they are all
+ * still available and the parent keeps some.  The partitions that can't be
+ * satisfied, and all the child partitions of a cpuset that isn't a valid
+ * partition root, are made invalid until a later update allows them again.
+ *
+ * Returns true if @cs->subparts_cpus or the state of a child changed.
+ *
+ * Called with cpuset_mutex and the RCU read lock held.
+ */
+static bool update_subparts(struct cpuset *cs, struct cpumask *pool,
+			    struct cpumask *part_cpus)
+{
+	struct cgroup_subsys_state *pos_css;
+	struct cpuset *child;
+	bool changed = false;
+
+	if (is_partition_valid(cs))
+		partition_active_cpus(cs, pool);
+	else
+		cpumask_clear(pool);
+
+	cpuset_for_each_child(child, pos_css, cs) {
+		int prs = child->partition_root_state;
+		int err = PERR_NONE;
+
+		if (prs == PRS_MEMBER)
+			continue;
+
+		cpumask_and(part_cpus, child->cpus_allowed, cpu_active_mask);
+		if (!is_partition_valid(cs))
+			err = PERR_PARENT;
+		else if (cpumask_empty(child->cpus_allowed))
+			err = PERR_INVCPUS;
+		else if (cpumask_empty(part_cpus))
+			err = PERR_HOTPLUG;
+		else if (!cpumask_subset(part_cpus, pool))
+			err = PERR_INVCPUS;
+		else if (cpumask_equal(part_cpus, pool))
+			err = PERR_NOCPUS;
+
+		if (err == PERR_NONE)
+			cpumask_andnot(pool, pool, part_cpus);
+
+		prs = err ? -abs(prs) : abs(prs);
+		if (prs != child->partition_root_state ||
+		    err != child->prs_err) {
+			spin_lock_irq(&callback_lock);
+			child->partition_root_state = prs;
+			child->prs_err = err;
+			spin_unlock_irq(&callback_lock);
+			changed = true;
+		}
+	}
+
+	/* what was given is what is no longer in the pool */
+	cpumask_clear(part_cpus);
+	if (is_partition_valid(cs)) {
+		partition_active_cpus(cs, part_cpus);
+		cpumask_andnot(part_cpus, part_cpus, pool);
+	}
+
+	if (!cpumask_equal(part_cpus, cs->subparts_cpus)) {
+		spin_lock_irq(&callback_lock);
+		cpumask_copy(cs->subparts_cpus, part_cpus);
+		spin_unlock_irq(&callback_lock);
+		changed = true;
+	}
+
+	return changed;
+}
+
 /*
  * update_cpumasks_hier - Update effective cpumasks and tasks in the subtree
  * @cs: the cpuset to consider
  * @new_cpus: temp variable for calculating new effective_cpus
+ * @part_cpus: temp variable for calculating partitions
  *
  * When congifured cpumask is changed, the effective cpumasks of this cpuset
- * and all its descendants need to be updated.
+ * and all its descendants need to be updated.  As whether a partition root
+ * can be one depends on its parent and siblings, @cs should be the parent of
+ * any partition root whose cpumask or state changed.
  *
  * On legacy hierachy, effective_cpus will be the same with cpu_allowed.
  *
  * Called with cpuset_mutex held
  */
-static void update_cpumasks_hier(struct cpuset *cs, struct cpumask *new_cpus)
+static void update_cpumasks_hier(struct cpuset *cs, struct cpumask *new_cpus,
+				 struct cpumask *part_cpus)
 {
 	struct cpuset *cp;
 	struct cgroup_subsys_state *pos_css;
@@ -902,18 +1139,25 @@ static void update_cpumasks_hier(struct cpuset *cs, struct cpumask *new_cpus)
 	rcu_read_lock();
 	cpuset_for_each_descendant_pre(cp, pos_css, cs) {
 		struct cpuset *parent = parent_cs(cp);
-
-		cpumask_and(new_cpus, cp->cpus_allowed, parent->effective_cpus);
+		bool had_subparts = !cpumask_empty(cp->subparts_cpus);
+		bool subparts_changed;
 
 		/*
-		 * If it becomes empty, inherit the effective mask of the
-		 * parent, which is guaranteed to have some CPUs.
+		 * Settle what the child partitions of @cp get before
+		 * computing what is left for @cp itself.
 		 */
-		if (is_in_v2_mode() && cpumask_empty(new_cpus))
-			cpumask_copy(new_cpus, parent->effective_cpus);
+		subparts_changed = update_subparts(cp, new_cpus, part_cpus);
+		if (subparts_changed)
+			need_rebuild_sched_domains = true;
 
-		/* Skip the whole subtree if the cpumask remains the same. */
-		if (cpumask_equal(new_cpus, cp->effective_cpus)) {
+		compute_effective_cpumask(new_cpus, cp, parent);
+
+		/*
+		 * Skip the whole subtree if the cpumask remains the same,
+		 * and so do the partitions below.
+		 */
+		if (cp != cs && !subparts_changed &&
+		    cpumask_equal(new_cpus, cp->effective_cpus)) {
 			pos_css = css_rightmost_descendant(pos_css);
 			continue;
 		}
@@ -929,14 +1173,23 @@ static void update_cpumasks_hier(struct cpuset *cs, struct cpumask *new_cpus)
 		WARN_ON(!is_in_v2_mode() &&
 			!cpumask_equal(cp->cpus_allowed, cp->effective_cpus));
 
-		update_tasks_cpumask(cp);
+		/*
+		 * We don't mess with cpumasks of tasks in top_cpuset, unless
+		 * it gives, or gave, some of its CPUs to partitions.
+		 */
+		if (cp != &top_cpuset || had_subparts ||
+		    !cpumask_empty(cp->subparts_cpus))
+			update_tasks_cpumask(cp);
 
 		/*
 		 * If the effective cpumask of any non-empty cpuset is changed,
-		 * we need to rebuild sched domains.
+		 * we need to rebuild sched domains.  On default hierarchy, the
+		 * cpuset needs to be a partition root as well.
 		 */
 		if (!cpumask_empty(cp->cpus_allowed) &&
-		    is_sched_load_balance(cp))
+		    is_sched_load_balance(cp) &&
+		    (!cgroup_subsys_on_dfl(cpuset_cgrp_subsys) ||
+		     is_partition_valid(cp)))
 			need_rebuild_sched_domains = true;
 
 		rcu_read_lock();
@@ -993,8 +1246,13 @@ static int update_cpumask(struct cpuset *cs, struct cpuset *trialcs,
 	cpumask_copy(cs->cpus_allowed, trialcs->cpus_allowed);
 	spin_unlock_irq(&callback_lock);
 
-	/* use trialcs->cpus_allowed as a temp variable */
-	update_cpumasks_hier(cs, trialcs->cpus_allowed);
+	/*
+	 * A partition root may become valid or invalid, which is settled
+	 * from its parent.  Use trialcs->cpus_allowed and ->effective_cpus
+	 * as temp variables.
+	 */
+	update_cpumasks_hier(cs->partition_root_state ? parent_cs(cs) : cs,
+			     trialcs->cpus_allowed, trialcs->effective_cpus);
 	return 0;
 }
 
@@ -1352,6 +1610,73 @@ static int update_flag(cpuset_flagbits_t bit, struct cpuset *cs,
 	return err;
 }
 
+/*
+ * update_prstate - update the partition root state of a cpuset
+ * @cs: the cpuset to update
+ * @new_prs: PRS_MEMBER, PRS_ROOT or PRS_ISOLATED
+ *
+ * A member only becomes a partition root if it can be a valid one right
+ * away: its parent must be a valid partition root with all the active CPUs
+ * of its cpuset.cpus to give, and some left.  A partition root with child
+ * partitions can't go back to being a member.
+ *
+ * Call with cpuset_mutex held.
+ */
+static int update_prstate(struct cpuset *cs, int new_prs)
+{
+	int old_prs = cs->partition_root_state;
+	struct cpuset *parent = parent_cs(cs);
+	struct cpuset *trialcs;
+	int err = 0;
+
+	if (abs(old_prs) == new_prs)
+		return 0;
+
+	/* for the temp variables */
+	trialcs = alloc_trial_cpuset(cs);
+	if (!trialcs)
+		return -ENOMEM;
+
+	if (old_prs == PRS_MEMBER) {
+		cpumask_and(trialcs->cpus_allowed, cs->cpus_allowed,
+			    cpu_active_mask);
+		err = -EINVAL;
+		if (!is_partition_valid(parent) ||
+		    cpumask_empty(trialcs->cpus_allowed) ||
+		    !cpumask_subset(trialcs->cpus_allowed,
+				    parent->effective_cpus) ||
+		    cpumask_equal(trialcs->cpus_allowed,
+				  parent->effective_cpus))
+			goto out;
+
+		err = update_flag(CS_CPU_EXCLUSIVE, cs, 1);
+		if (err)
+			goto out;
+	} else if (new_prs == PRS_MEMBER) {
+		/* fails with -EBUSY if there are exclusive children */
+		err = update_flag(CS_CPU_EXCLUSIVE, cs, 0);
+		if (err)
+			goto out;
+	}
+
+	spin_lock_irq(&callback_lock);
+	/* changing the type of an invalid partition keeps it invalid */
+	cs->partition_root_state = old_prs < 0 ? -new_prs : new_prs;
+	if (new_prs == PRS_MEMBER)
+		cs->prs_err = PERR_NONE;
+	spin_unlock_irq(&callback_lock);
+
+	/* only the load balancing changes between root and isolated */
+	if (old_prs && new_prs)
+		rebuild_sched_domains_locked();
+	else
+		update_cpumasks_hier(parent, trialcs->cpus_allowed,
+				     trialcs->effective_cpus);
+out:
+	free_trial_cpuset(trialcs);
+	return err;
+}
+
 /*
  * Frequency meter - How fast is some event occurring?
  *
@@ -1602,6 +1927,7 @@ typedef enum {
 	FILE_MEMORY_PRESSURE,
 	FILE_SPREAD_PAGE,
 	FILE_SPREAD_SLAB,
+	FILE_PARTITION_ROOT,
 } cpuset_filetype_t;
 
 static int cpuset_write_u64(struct cgroup_subsys_state *css, struct cftype *cft,
@@ -1824,12 +2150,69 @@ static s64 cpuset_read_s64(struct cgroup_subsys_state *css, struct cftype *cft)
 	return 0;
 }
 
+static int sched_partition_show(struct seq_file *seq, void *v)
+{
+	struct cpuset *cs = css_cs(seq_css(seq));
+	const char *type;
+
+	spin_lock_irq(&callback_lock);
+	switch (abs(cs->partition_root_state)) {
+	case PRS_ROOT:
+		type = "root";
+		break;
+	case PRS_ISOLATED:
+		type = "isolated";
+		break;
+	default:
+		type = "member";
+		break;
+	}
+
+	if (cs->partition_root_state < 0)
+		seq_printf(seq, "%s invalid (%s)\n", type,
+			   perr_strings[cs->prs_err]);
+	else
+		seq_printf(seq, "%s\n", type);
+	spin_unlock_irq(&callback_lock);
+
+	return 0;
+}
+
+static ssize_t sched_partition_write(struct kernfs_open_file *of, char *buf,
+				     size_t nbytes, loff_t off)
+{
+	struct cpuset *cs = css_cs(of_css(of));
+	int retval = -ENODEV;
+	int val;
+
+	buf = strstrip(buf);
+
+	if (!strcmp(buf, "member"))
+		val = PRS_MEMBER;
+	else if (!strcmp(buf, "root"))
+		val = PRS_ROOT;
+	else if (!strcmp(buf, "isolated"))
+		val = PRS_ISOLATED;
+	else
+		return -EINVAL;
+
+	css_get(&cs->css);
+	mutex_lock(&cpuset_mutex);
+	if (!is_cpuset_online(cs))
+		goto out_unlock;
+
+	retval = update_prstate(cs, val);
+out_unlock:
+	mutex_unlock(&cpuset_mutex);
+	css_put(&cs->css);
+	return retval ?: nbytes;
+}
 
 /*
  * for the common functions, 'private' gives the type of file
  */
 
-static struct cftype files[] = {
+static struct cftype legacy_files[] = {
 	{
 		.name = "cpus",
 		.seq_show = cpuset_common_seq_show,
@@ -1931,6 +2314,52 @@ static struct cftype files[] = {
 	{ }	/* terminate */
 };
 
+/*
+ * The default hierarchy only has the basic masks, and the partition
+ * roots in place of sched_load_balance and cpu_exclusive.
+ */
+static struct cftype dfl_files[] = {
+	{
+		.name = "cpus",
+		.seq_show = cpuset_common_seq_show,
+		.write = cpuset_write_resmask,
+		.max_write_len = (100U + 6 * NR_CPUS),
+		.private = FILE_CPULIST,
+		.flags = CFTYPE_NOT_ON_ROOT,
+	},
+
+	{
+		.name = "mems",
+		.seq_show = cpuset_common_seq_show,
+		.write = cpuset_write_resmask,
+		.max_write_len = (100U + 6 * MAX_NUMNODES),
+		.private = FILE_MEMLIST,
+		.flags = CFTYPE_NOT_ON_ROOT,
+	},
+
+	{
+		.name = "cpus.effective",
+		.seq_show = cpuset_common_seq_show,
+		.private = FILE_EFFECTIVE_CPULIST,
+	},
+
+	{
+		.name = "mems.effective",
+		.seq_show = cpuset_common_seq_show,
+		.private = FILE_EFFECTIVE_MEMLIST,
+	},
+
+	{
+		.name = "cpus.partition",
+		.seq_show = sched_partition_show,
+		.write = sched_partition_write,
+		.private = FILE_PARTITION_ROOT,
+		.flags = CFTYPE_NOT_ON_ROOT,
+	},
+
+	{ }	/* terminate */
+};
+
 /*
  *	cpuset_css_alloc - allocate a cpuset css
  *	cgrp:	control group that the new cpuset will be part of
@@ -1951,6 +2380,8 @@ cpuset_css_alloc(struct cgroup_subsys_state *parent_css)
 		goto free_cs;
 	if (!alloc_cpumask_var(&cs->effective_cpus, GFP_KERNEL))
 		goto free_cpus;
+	if (!zalloc_cpumask_var(&cs->subparts_cpus, GFP_KERNEL))
+		goto free_effective_cpus;
 
 	set_bit(CS_SCHED_LOAD_BALANCE, &cs->flags);
 	cpumask_clear(cs->cpus_allowed);
@@ -1962,6 +2393,8 @@ cpuset_css_alloc(struct cgroup_subsys_state *parent_css)
 
 	return &cs->css;
 
+free_effective_cpus:
+	free_cpumask_var(cs->effective_cpus);
 free_cpus:
 	free_cpumask_var(cs->cpus_allowed);
 free_cs:
@@ -2033,9 +2466,10 @@ static int cpuset_css_online(struct cgroup_subsys_state *css)
 }
 
 /*
- * If the cpuset being removed has its flag 'sched_load_balance'
- * enabled, then simulate turning sched_load_balance off, which
- * will call rebuild_sched_domains_locked().
+ * If the cpuset being removed is a partition root, give its CPUs back
+ * to the parent.  If it has its flag 'sched_load_balance' enabled, then
+ * simulate turning sched_load_balance off, which will call
+ * rebuild_sched_domains_locked().
  */
 
 static void cpuset_css_offline(struct cgroup_subsys_state *css)
@@ -2044,6 +2478,9 @@ static void cpuset_css_offline(struct cgroup_subsys_state *css)
 
 	mutex_lock(&cpuset_mutex);
 
+	if (cs->partition_root_state)
+		update_prstate(cs, PRS_MEMBER);
+
 	if (is_sched_load_balance(cs))
 		update_flag(CS_SCHED_LOAD_BALANCE, cs, 0);
 
@@ -2057,6 +2494,7 @@ static void cpuset_css_free(struct cgroup_subsys_state *css)
 {
 	struct cpuset *cs = css_cs(css);
 
+	free_cpumask_var(cs->subparts_cpus);
 	free_cpumask_var(cs->effective_cpus);
 	free_cpumask_var(cs->cpus_allowed);
 	kfree(cs);
@@ -2087,11 +2525,29 @@ static void cpuset_bind(struct cgroup_subsys_state *root_css)
  */
 static void cpuset_fork(struct task_struct *task)
 {
-	if (task_css_is_root(task, cpuset_cgrp_id))
+	struct cpuset *cs;
+	bool same_cs;
+
+	rcu_read_lock();
+	cs = task_cs(task);
+	same_cs = cs == task_cs(current);
+	rcu_read_unlock();
+
+	if (same_cs) {
+		if (cs == &top_cpuset)
+			return;
+
+		set_cpus_allowed_ptr(task, &current->cpus_allowed);
+		task->mems_allowed = current->mems_allowed;
 		return;
+	}
 
-	set_cpus_allowed_ptr(task, &current->cpus_allowed);
-	task->mems_allowed = current->mems_allowed;
+	/* CLONE_INTO_CGROUP placed @task in a cpuset other than current's */
+	mutex_lock(&cpuset_mutex);
+	guarantee_online_cpus(cs, cpus_attach);
+	set_cpus_allowed_ptr(task, cpus_attach);
+	guarantee_online_mems(cs, &task->mems_allowed);
+	mutex_unlock(&cpuset_mutex);
 }
 
 struct cgroup_subsys cpuset_cgrp_subsys = {
@@ -2105,8 +2561,10 @@ struct cgroup_subsys cpuset_cgrp_subsys = {
 	.post_attach	= cpuset_post_attach,
 	.bind		= cpuset_bind,
 	.fork		= cpuset_fork,
-	.legacy_cftypes	= files,
+	.legacy_cftypes	= legacy_files,
+	.dfl_cftypes	= dfl_files,
 	.early_init	= true,
+	.threaded	= true,
 };
 
 /**
@@ -2121,6 +2579,7 @@ int __init cpuset_init(void)
 
 	BUG_ON(!alloc_cpumask_var(&top_cpuset.cpus_allowed, GFP_KERNEL));
 	BUG_ON(!alloc_cpumask_var(&top_cpuset.effective_cpus, GFP_KERNEL));
+	BUG_ON(!zalloc_cpumask_var(&top_cpuset.subparts_cpus, GFP_KERNEL));
 
 	cpumask_setall(top_cpuset.cpus_allowed);
 	nodes_setall(top_cpuset.mems_allowed);
@@ -2255,7 +2714,11 @@ static void cpuset_hotplug_update_tasks(struct cpuset *cs)
 		goto retry;
 	}
 
-	cpumask_and(&new_cpus, cs->cpus_allowed, parent_cs(cs)->effective_cpus);
+	if (is_in_v2_mode())
+		compute_effective_cpumask(&new_cpus, cs, parent_cs(cs));
+	else
+		cpumask_and(&new_cpus, cs->cpus_allowed,
+			    parent_cs(cs)->effective_cpus);
 	nodes_and(new_mems, cs->mems_allowed, parent_cs(cs)->effective_mems);
 
 	cpus_updated = !cpumask_equal(&new_cpus, cs->effective_cpus);
@@ -2296,10 +2759,11 @@ void cpuset_force_rebuild(void)
  */
 static void cpuset_hotplug_workfn(struct work_struct *work)
 {
-	static cpumask_t new_cpus;
+	static cpumask_t new_cpus, part_cpus;
 	static nodemask_t new_mems;
 	bool cpus_updated, mems_updated;
 	bool on_dfl = is_in_v2_mode();
+	bool partitions = cgroup_subsys_on_dfl(cpuset_cgrp_subsys);
 
 	mutex_lock(&cpuset_mutex);
 
@@ -2310,14 +2774,24 @@ static void cpuset_hotplug_workfn(struct work_struct *work)
 	cpus_updated = !cpumask_equal(top_cpuset.effective_cpus, &new_cpus);
 	mems_updated = !nodes_equal(top_cpuset.effective_mems, new_mems);
 
-	/* synchronize cpus_allowed to cpu_active_mask */
+	/*
+	 * synchronize cpus_allowed to cpu_active_mask
+	 *
+	 * With partitions, the top cpuset doesn't have all of them, which
+	 * makes cpus_updated a false positive at times.  Let the partitions
+	 * be settled again, which computes the effective_cpus of the top
+	 * cpuset too.
+	 */
 	if (cpus_updated) {
 		spin_lock_irq(&callback_lock);
 		if (!on_dfl)
 			cpumask_copy(top_cpuset.cpus_allowed, &new_cpus);
-		cpumask_copy(top_cpuset.effective_cpus, &new_cpus);
+		if (!partitions)
+			cpumask_copy(top_cpuset.effective_cpus, &new_cpus);
 		spin_unlock_irq(&callback_lock);
 		/* we don't mess with cpumasks of tasks in top_cpuset */
+		if (partitions)
+			update_cpumasks_hier(&top_cpuset, &new_cpus, &part_cpus);
 	}
 
 	/* synchronize mems_allowed to N_MEMORY */
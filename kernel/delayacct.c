@@ -49,10 +49,10 @@ void __delayacct_tsk_init(struct task_struct *tsk)
 
 /*
  * Finish delay accounting for a statistic using its timestamps (@start),
- * accumalator (@total) and @count
+ * accumalator (@total), @count and longest delay (@max)
  */
 static void delayacct_end(raw_spinlock_t *lock, u64 *start, u64 *total,
-			  u32 *count)
+			  u32 *count, u64 *max)
 {
 	s64 ns = ktime_get_ns() - *start;
 	unsigned long flags;
@@ -61,6 +61,8 @@ static void delayacct_end(raw_spinlock_t *lock, u64 *start, u64 *total,
 		raw_spin_lock_irqsave(lock, flags);
 		*total += ns;
 		(*count)++;
+		if (ns > *max)
+			*max = ns;
 		raw_spin_unlock_irqrestore(lock, flags);
 	}
 }
@@ -77,18 +79,20 @@ void __delayacct_blkio_start(void)
 void __delayacct_blkio_end(struct task_struct *p)
 {
 	struct task_delay_info *delays = p->delays;
-	u64 *total;
+	u64 *total, *max;
 	u32 *count;
 
 	if (p->delays->flags & DELAYACCT_PF_SWAPIN) {
 		total = &delays->swapin_delay;
 		count = &delays->swapin_count;
+		max = &delays->swapin_delay_max;
 	} else {
 		total = &delays->blkio_delay;
 		count = &delays->blkio_count;
+		max = &delays->blkio_delay_max;
 	}
 
-	delayacct_end(&delays->lock, &delays->blkio_start, total, count);
+	delayacct_end(&delays->lock, &delays->blkio_start, total, count, max);
 }
 
 int __delayacct_add_tsk(struct taskstats *d, struct task_struct *tsk)
@@ -141,6 +145,26 @@ int __delayacct_add_tsk(struct taskstats *d, struct task_struct *tsk)
 	d->swapin_count += tsk->delays->swapin_count;
 	d->freepages_count += tsk->delays->freepages_count;
 	d->thrashing_count += tsk->delays->thrashing_count;
+	tmp = d->compact_delay_total + tsk->delays->compact_delay;
+	d->compact_delay_total = (tmp < d->compact_delay_total) ? 0 : tmp;
+	tmp = d->pagewait_delay_total + tsk->delays->pagewait_delay;
+	d->pagewait_delay_total = (tmp < d->pagewait_delay_total) ? 0 : tmp;
+	d->compact_count += tsk->delays->compact_count;
+	d->pagewait_count += tsk->delays->pagewait_count;
+
+	/* the max of the stats of a thread group is of all its threads */
+	d->blkio_delay_max = max(d->blkio_delay_max,
+				 tsk->delays->blkio_delay_max);
+	d->swapin_delay_max = max(d->swapin_delay_max,
+				  tsk->delays->swapin_delay_max);
+	d->freepages_delay_max = max(d->freepages_delay_max,
+				     tsk->delays->freepages_delay_max);
+	d->thrashing_delay_max = max(d->thrashing_delay_max,
+				     tsk->delays->thrashing_delay_max);
+	d->compact_delay_max = max(d->compact_delay_max,
+				   tsk->delays->compact_delay_max);
+	d->pagewait_delay_max = max(d->pagewait_delay_max,
+				    tsk->delays->pagewait_delay_max);
 	raw_spin_unlock_irqrestore(&tsk->delays->lock, flags);
 
 	return 0;
@@ -169,7 +193,8 @@ void __delayacct_freepages_end(void)
 		&current->delays->lock,
 		&current->delays->freepages_start,
 		&current->delays->freepages_delay,
-		&current->delays->freepages_count);
+		&current->delays->freepages_count,
+		&current->delays->freepages_delay_max);
 }
 
 void __delayacct_thrashing_start(void)
@@ -182,5 +207,34 @@ void __delayacct_thrashing_end(void)
 	delayacct_end(&current->delays->lock,
 		      &current->delays->thrashing_start,
 		      &current->delays->thrashing_delay,
-		      &current->delays->thrashing_count);
+		      &current->delays->thrashing_count,
+		      &current->delays->thrashing_delay_max);
+}
+
+void __delayacct_compact_start(void)
+{
+	current->delays->compact_start = ktime_get_ns();
+}
+
+void __delayacct_compact_end(void)
+{
+	delayacct_end(&current->delays->lock,
+		      &current->delays->compact_start,
+		      &current->delays->compact_delay,
+		      &current->delays->compact_count,
+		      &current->delays->compact_delay_max);
+}
+
+void __delayacct_pagewait_start(void)
+{
+	current->delays->pagewait_start = ktime_get_ns();
+}
+
+void __delayacct_pagewait_end(void)
+{
+	delayacct_end(&current->delays->lock,
+		      &current->delays->pagewait_start,
+		      &current->delays->pagewait_delay,
+		      &current->delays->pagewait_count,
+		      &current->delays->pagewait_delay_max);
 }
@@ -890,6 +890,49 @@ static inline void perf_cgroup_sched_in(struct task_struct *prev,
 	rcu_read_unlock();
 }
 
+/*
+ * visit_groups_merge() keeps an iterator on each cgroup from the current
+ * one up to the root, plus one for the events without a cgroup, in the
+ * storage of the CPU context: make it large enough for the cgroup of
+ * @event on every CPU.
+ */
+static int perf_cgroup_ensure_storage(struct perf_event *event,
+				      struct cgroup_subsys_state *css)
+{
+	struct perf_cpu_context *cpuctx;
+	struct perf_event **storage;
+	int cpu, heap_size, ret = 0;
+
+	for (heap_size = 1; css; css = css->parent)
+		heap_size++;
+
+	for_each_possible_cpu(cpu) {
+		cpuctx = per_cpu_ptr(event->pmu->pmu_cpu_context, cpu);
+		if (heap_size <= cpuctx->heap_size)
+			continue;
+
+		storage = kmalloc_node(heap_size * sizeof(struct perf_event *),
+				       GFP_KERNEL, cpu_to_node(cpu));
+		if (!storage) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		raw_spin_lock_irq(&cpuctx->ctx.lock);
+		if (cpuctx->heap_size < heap_size) {
+			swap(cpuctx->heap, storage);
+			if (storage == cpuctx->heap_default)
+				storage = NULL;
+			cpuctx->heap_size = heap_size;
+		}
+		raw_spin_unlock_irq(&cpuctx->ctx.lock);
+
+		kfree(storage);
+	}
+
+	return ret;
+}
+
 static inline int perf_cgroup_connect(int fd, struct perf_event *event,
 				      struct perf_event_attr *attr,
 				      struct perf_event *group_leader)
@@ -909,6 +952,12 @@ static inline int perf_cgroup_connect(int fd, struct perf_event *event,
 		goto out;
 	}
 
+	ret = perf_cgroup_ensure_storage(event, css);
+	if (ret) {
+		css_put(css);
+		goto out;
+	}
+
 	cgrp = container_of(css, struct perf_cgroup, css);
 	event->cgrp = cgrp;
 
@@ -1514,19 +1563,60 @@ static void perf_event_groups_init(struct perf_event_groups *groups)
 	groups->index = 0;
 }
 
+static inline struct cgroup *event_cgroup(const struct perf_event *event)
+{
+	struct cgroup *cgroup = NULL;
+
+#ifdef CONFIG_CGROUP_PERF
+	if (event->cgrp)
+		cgroup = event->cgrp->css.cgroup;
+#endif
+
+	return cgroup;
+}
+
+/*
+ * Compare {@cpu, @cgrp} with the CPU and cgroup part of the key of @event.
+ * Events without a cgroup sort before the cgroup events of the same CPU.
+ */
+static int
+perf_event_groups_cmp(int cpu, struct cgroup *cgrp,
+		      const struct perf_event *event)
+{
+	struct cgroup *event_cgrp;
+
+	if (cpu < event->cpu)
+		return -1;
+	if (cpu > event->cpu)
+		return 1;
+
+	event_cgrp = event_cgroup(event);
+	if (cgrp != event_cgrp) {
+		if (!cgrp)
+			return -1;
+		if (!event_cgrp)
+			return 1;
+		return cgrp->id < event_cgrp->id ? -1 : 1;
+	}
+
+	return 0;
+}
+
 /*
  * Compare function for event groups;
  *
- * Implements complex key that first sorts by CPU and then by virtual index
- * which provides ordering when rotating groups for the same CPU.
+ * Implements complex key that first sorts by CPU, then by cgroup and then by
+ * virtual index which provides ordering when rotating groups for the same
+ * CPU and cgroup.
  */
 static bool
 perf_event_groups_less(struct perf_event *left, struct perf_event *right)
 {
-	if (left->cpu < right->cpu)
-		return true;
-	if (left->cpu > right->cpu)
-		return false;
+	int cmp;
+
+	cmp = perf_event_groups_cmp(left->cpu, event_cgroup(left), right);
+	if (cmp)
+		return cmp < 0;
 
 	if (left->group_index < right->group_index)
 		return true;
@@ -1537,9 +1627,9 @@ perf_event_groups_less(struct perf_event *left, struct perf_event *right)
 }
 
 /*
- * Insert @event into @groups' tree; using {@event->cpu, ++@groups->index} for
- * key (see perf_event_groups_less). This places it last inside the CPU
- * subtree.
+ * Insert @event into @groups' tree; using {@event->cpu, @event's cgroup,
+ * ++@groups->index} for key (see perf_event_groups_less). This places it last
+ * inside the CPU and cgroup subtree.
  */
 static void
 perf_event_groups_insert(struct perf_event_groups *groups,
@@ -1607,20 +1697,24 @@ del_event_from_groups(struct perf_event *event, struct perf_event_context *ctx)
 }
 
 /*
- * Get the leftmost event in the @cpu subtree.
+ * Get the leftmost event in the {@cpu, @cgrp} subtree; a NULL @cgrp is the
+ * subtree of the events without a cgroup.
  */
 static struct perf_event *
-perf_event_groups_first(struct perf_event_groups *groups, int cpu)
+perf_event_groups_first(struct perf_event_groups *groups, int cpu,
+			struct cgroup *cgrp)
 {
 	struct perf_event *node_event = NULL, *match = NULL;
 	struct rb_node *node = groups->tree.rb_node;
+	int cmp;
 
 	while (node) {
 		node_event = container_of(node, struct perf_event, group_node);
 
-		if (cpu < node_event->cpu) {
+		cmp = perf_event_groups_cmp(cpu, cgrp, node_event);
+		if (cmp < 0) {
 			node = node->rb_left;
-		} else if (cpu > node_event->cpu) {
+		} else if (cmp > 0) {
 			node = node->rb_right;
 		} else {
 			match = node_event;
@@ -1632,7 +1726,7 @@ perf_event_groups_first(struct perf_event_groups *groups, int cpu)
 }
 
 /*
- * Like rb_entry_next_safe() for the @cpu subtree.
+ * Like rb_entry_next_safe() for the {@event->cpu, @event's cgroup} subtree.
  */
 static struct perf_event *
 perf_event_groups_next(struct perf_event *event)
@@ -1640,7 +1734,8 @@ perf_event_groups_next(struct perf_event *event)
 	struct perf_event *next;
 
 	next = rb_entry_safe(rb_next(&event->group_node), typeof(*event), group_node);
-	if (next && next->cpu == event->cpu)
+	if (next && next->cpu == event->cpu &&
+	    event_cgroup(next) == event_cgroup(event))
 		return next;
 
 	return NULL;
@@ -3233,25 +3328,63 @@ static void cpu_ctx_sched_out(struct perf_cpu_context *cpuctx,
 	ctx_sched_out(&cpuctx->ctx, cpuctx, event_type);
 }
 
-static int visit_groups_merge(struct perf_event_groups *groups, int cpu,
+/*
+ * Visit the groups of @groups that may run on @cpu, in group_index order.
+ *
+ * A task context holds the events of any CPU and those of @cpu; a CPU
+ * context (@cpuctx) holds events of @cpu only, those without a cgroup and
+ * the cgroup events. Of the latter only the subtrees of the cgroup of the
+ * current task and its ancestors are visited, so the cost of switching
+ * cgroups does not grow with the number of monitored cgroups.
+ */
+static int visit_groups_merge(struct perf_cpu_context *cpuctx,
+			      struct perf_event_groups *groups, int cpu,
 			      int (*func)(struct perf_event *, void *), void *data)
 {
-	struct perf_event **evt, *evt1, *evt2;
-	int ret;
+	struct perf_event *_itrs[2];
+	struct perf_event **itrs = _itrs;
+	struct perf_event **evt, *first;
+	int nr = 0, size = ARRAY_SIZE(_itrs);
+	int i, ret;
 
-	evt1 = perf_event_groups_first(groups, -1);
-	evt2 = perf_event_groups_first(groups, cpu);
-
-	while (evt1 || evt2) {
-		if (evt1 && evt2) {
-			if (evt1->group_index < evt2->group_index)
-				evt = &evt1;
-			else
-				evt = &evt2;
-		} else if (evt1) {
-			evt = &evt1;
-		} else {
-			evt = &evt2;
+	if (cpuctx) {
+		itrs = cpuctx->heap;
+		size = cpuctx->heap_size;
+
+		first = perf_event_groups_first(groups, cpu, NULL);
+		if (first)
+			itrs[nr++] = first;
+
+#ifdef CONFIG_CGROUP_PERF
+		if (cpuctx->cgrp) {
+			struct cgroup_subsys_state *css;
+
+			for (css = &cpuctx->cgrp->css; css; css = css->parent) {
+				first = perf_event_groups_first(groups, cpu,
+								css->cgroup);
+				if (!first)
+					continue;
+				/* see perf_cgroup_ensure_storage() */
+				if (WARN_ON_ONCE(nr >= size))
+					break;
+				itrs[nr++] = first;
+			}
+		}
+#endif
+	} else {
+		first = perf_event_groups_first(groups, -1, NULL);
+		if (first)
+			itrs[nr++] = first;
+		first = perf_event_groups_first(groups, cpu, NULL);
+		if (first)
+			itrs[nr++] = first;
+	}
+
+	while (nr) {
+		evt = &itrs[0];
+		for (i = 1; i < nr; i++) {
+			if (itrs[i]->group_index < (*evt)->group_index)
+				evt = &itrs[i];
 		}
 
 		ret = func(*evt, data);
@@ -3259,6 +3392,8 @@ static int visit_groups_merge(struct perf_event_groups *groups, int cpu,
 			return ret;
 
 		*evt = perf_event_groups_next(*evt);
+		if (!*evt)
+			*evt = itrs[--nr];
 	}
 
 	return 0;
@@ -3325,7 +3460,11 @@ ctx_pinned_sched_in(struct perf_event_context *ctx,
 		.can_add_hw = 1,
 	};
 
-	visit_groups_merge(&ctx->pinned_groups,
+	/* cgroup events only live in the CPU context */
+	if (ctx != &cpuctx->ctx)
+		cpuctx = NULL;
+
+	visit_groups_merge(cpuctx, &ctx->pinned_groups,
 			   smp_processor_id(),
 			   pinned_sched_in, &sid);
 }
@@ -3340,7 +3479,10 @@ ctx_flexible_sched_in(struct perf_event_context *ctx,
 		.can_add_hw = 1,
 	};
 
-	visit_groups_merge(&ctx->flexible_groups,
+	if (ctx != &cpuctx->ctx)
+		cpuctx = NULL;
+
+	visit_groups_merge(cpuctx, &ctx->flexible_groups,
 			   smp_processor_id(),
 			   flexible_sched_in, &sid);
 }
@@ -9454,6 +9596,9 @@ static struct perf_cpu_context __percpu *find_pmu_context(int ctxn)
 
 static void free_pmu_context(struct pmu *pmu)
 {
+	struct perf_cpu_context *cpuctx;
+	int cpu;
+
 	/*
 	 * Static contexts such as perf_sw_context have a global lifetime
 	 * and may be shared between different PMUs. Avoid freeing them
@@ -9462,6 +9607,12 @@ static void free_pmu_context(struct pmu *pmu)
 	if (pmu->task_ctx_nr > perf_invalid_context)
 		return;
 
+	for_each_possible_cpu(cpu) {
+		cpuctx = per_cpu_ptr(pmu->pmu_cpu_context, cpu);
+		if (cpuctx->heap != cpuctx->heap_default)
+			kfree(cpuctx->heap);
+	}
+
 	free_percpu(pmu->pmu_cpu_context);
 }
 
@@ -9664,6 +9815,8 @@ int perf_pmu_register(struct pmu *pmu, const char *name, int type)
 		lockdep_set_class(&cpuctx->ctx.lock, &cpuctx_lock);
 		cpuctx->ctx.pmu = pmu;
 		cpuctx->online = cpumask_test_cpu(cpu, perf_online_mask);
+		cpuctx->heap = cpuctx->heap_default;
+		cpuctx->heap_size = ARRAY_SIZE(cpuctx->heap_default);
 
 		__perf_mux_hrtimer_init(cpuctx, cpu);
 	}
@@ -10065,18 +10218,22 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 	if (!has_branch_stack(event))
 		event->attr.branch_sample_type = 0;
 
-	if (cgroup_fd != -1) {
-		err = perf_cgroup_connect(cgroup_fd, event, attr, group_leader);
-		if (err)
-			goto err_ns;
-	}
-
 	pmu = perf_init_event(event);
 	if (IS_ERR(pmu)) {
 		err = PTR_ERR(pmu);
 		goto err_ns;
 	}
 
+	/*
+	 * Connect the cgroup once the PMU is known, to size the storage of
+	 * its CPU contexts for the cgroup, see perf_cgroup_ensure_storage().
+	 */
+	if (cgroup_fd != -1) {
+		err = perf_cgroup_connect(cgroup_fd, event, attr, group_leader);
+		if (err)
+			goto err_pmu;
+	}
+
 	err = exclusive_event_init(event);
 	if (err)
 		goto err_pmu;
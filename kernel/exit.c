@@ -483,6 +483,7 @@ void mm_update_next_owner(struct mm_struct *mm)
 		goto retry;
 	}
 	mm->owner = c;
+	lru_gen_migrate_mm(mm);
 	task_unlock(c);
 	put_task_struct(c);
 }
@@ -65,7 +65,6 @@
 #include <linux/sched/mm.h>
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
-#include <linux/memblock.h>
 #include <linux/fault-inject.h>
 
 #include <asm/futex.h>
@@ -192,6 +191,13 @@ int __read_mostly futex_cmpxchg_enabled;
 #endif
 #define FLAGS_CLOCKRT		0x02
 #define FLAGS_HAS_TIMEOUT	0x04
+#define FLAGS_NUMA		0x08
+
+/*
+ * The home node of a FLAGS_NUMA futex is kept in the key above the page
+ * offset, biased by one so that zero means the futex has none.
+ */
+#define FUT_OFF_NODE_SHIFT	PAGE_SHIFT
 
 /*
  * Priority Inheritance state:
@@ -266,16 +272,19 @@ struct futex_hash_bucket {
 } ____cacheline_aligned_in_smp;
 
 /*
- * The base of the bucket array and its size are always used together
- * (after initialization only in hash_futex()), so ensure that they
- * reside in the same cacheline.
+ * Every node has a bucket array of its own, allocated on that node, so that
+ * the waiters and wakers of a futex homed there do not touch remote memory.
+ * The arrays and their size are always used together (after initialization
+ * only in hash_futex()), so ensure that they reside in the same cacheline.
  */
 static struct {
-	struct futex_hash_bucket *queues;
+	struct futex_hash_bucket **queues;
 	unsigned long            hashsize;
-} __futex_data __read_mostly __aligned(2*sizeof(long));
-#define futex_queues   (__futex_data.queues)
-#define futex_hashsize (__futex_data.hashsize)
+	unsigned int             hashshift;
+} __futex_data __read_mostly __aligned(4*sizeof(long));
+#define futex_queues    (__futex_data.queues)
+#define futex_hashsize  (__futex_data.hashsize)
+#define futex_hashshift (__futex_data.hashshift)
 
 
 /*
@@ -384,18 +393,26 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 }
 
 /**
- * hash_futex - Return the hash bucket in the global hash
+ * hash_futex - Return the hash bucket in the per-node hashes
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the hash of the futex's home node. Futexes
+ * without a home node are spread over the nodes by the hash bits that are
+ * not used to pick the bucket.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & (futex_hashsize - 1)];
+	int node = (key->both.offset >> FUT_OFF_NODE_SHIFT) - 1;
+
+	if (node < 0)
+		node = nr_node_ids > 1 ?
+		       (hash >> futex_hashshift) % nr_node_ids : 0;
+
+	return &futex_queues[node][hash & (futex_hashsize - 1)];
 }
 
 
@@ -478,10 +495,42 @@ static void drop_futex_key_refs(union futex_key *key)
 	}
 }
 
+/**
+ * get_futex_node() - Read the home node of a FLAGS_NUMA futex
+ * @uaddr:	virtual address of the futex
+ * @node:	address where the node is stored
+ *
+ * The node is the u32 following the futex. FUTEX_NO_NODE leaves the futex
+ * without a home node. User space sets it before the futex is first used;
+ * waiters and wakers must agree on it, as they would on the address.
+ *
+ * Return: a negative error code or 0
+ */
+static int get_futex_node(u32 __user *uaddr, int *node)
+{
+	u32 __user *naddr = uaddr + 1;
+	u32 val;
+
+	if (unlikely(!access_ok(VERIFY_READ, naddr, sizeof(u32))))
+		return -EFAULT;
+	if (get_user(val, naddr))
+		return -EFAULT;
+
+	if (val == (u32)FUTEX_NO_NODE) {
+		*node = NUMA_NO_NODE;
+		return 0;
+	}
+	if (val >= nr_node_ids)
+		return -EINVAL;
+
+	*node = val;
+	return 0;
+}
+
 /**
  * get_futex_key() - Get parameters which are the keys for a futex
  * @uaddr:	virtual address of the futex
- * @fshared:	0 for a PROCESS_PRIVATE futex, 1 for PROCESS_SHARED
+ * @flags:	futex flags (FLAGS_SHARED for PROCESS_SHARED, FLAGS_NUMA, etc.)
  * @key:	address where result is stored.
  * @rw:		mapping needs to be read/write (values: VERIFY_READ,
  *              VERIFY_WRITE)
@@ -497,12 +546,15 @@ static void drop_futex_key_refs(union futex_key *key)
  * lock_page() might sleep, the caller should not hold a spinlock.
  */
 static int
-get_futex_key(u32 __user *uaddr, int fshared, union futex_key *key, int rw)
+get_futex_key(u32 __user *uaddr, unsigned int flags, union futex_key *key,
+	      int rw)
 {
 	unsigned long address = (unsigned long)uaddr;
+	int fshared = flags & FLAGS_SHARED;
 	struct mm_struct *mm = current->mm;
 	struct page *page, *tail;
 	struct address_space *mapping;
+	int node = NUMA_NO_NODE;
 	int err, ro = 0;
 
 	/*
@@ -519,6 +571,13 @@ get_futex_key(u32 __user *uaddr, int fshared, union futex_key *key, int rw)
 	if (unlikely(should_fail_futex(fshared)))
 		return -EFAULT;
 
+	if (flags & FLAGS_NUMA) {
+		err = get_futex_node(uaddr, &node);
+		if (err)
+			return err;
+	}
+	key->both.offset |= (node + 1) << FUT_OFF_NODE_SHIFT;
+
 	/*
 	 * PROCESS_PRIVATE futexes are fast.
 	 * As the mm cannot disappear under us and the 'key' only needs
@@ -1523,7 +1582,7 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	if (!bitset)
 		return -EINVAL;
 
-	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &key, VERIFY_READ);
+	ret = get_futex_key(uaddr, flags, &key, VERIFY_READ);
 	if (unlikely(ret != 0))
 		goto out;
 
@@ -1622,10 +1681,10 @@ futex_wake_op(u32 __user *uaddr1, unsigned int flags, u32 __user *uaddr2,
 	DEFINE_WAKE_Q(wake_q);
 
 retry:
-	ret = get_futex_key(uaddr1, flags & FLAGS_SHARED, &key1, VERIFY_READ);
+	ret = get_futex_key(uaddr1, flags, &key1, VERIFY_READ);
 	if (unlikely(ret != 0))
 		goto out;
-	ret = get_futex_key(uaddr2, flags & FLAGS_SHARED, &key2, VERIFY_WRITE);
+	ret = get_futex_key(uaddr2, flags, &key2, VERIFY_WRITE);
 	if (unlikely(ret != 0))
 		goto out_put_key1;
 
@@ -1901,10 +1960,10 @@ static int futex_requeue(u32 __user *uaddr1, unsigned int flags,
 	}
 
 retry:
-	ret = get_futex_key(uaddr1, flags & FLAGS_SHARED, &key1, VERIFY_READ);
+	ret = get_futex_key(uaddr1, flags, &key1, VERIFY_READ);
 	if (unlikely(ret != 0))
 		goto out;
-	ret = get_futex_key(uaddr2, flags & FLAGS_SHARED, &key2,
+	ret = get_futex_key(uaddr2, flags, &key2,
 			    requeue_pi ? VERIFY_WRITE : VERIFY_READ);
 	if (unlikely(ret != 0))
 		goto out_put_key1;
@@ -2574,7 +2633,7 @@ static int futex_wait_setup(u32 __user *uaddr, u32 val, unsigned int flags,
 	 * while the syscall executes.
 	 */
 retry:
-	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &q->key, VERIFY_READ);
+	ret = get_futex_key(uaddr, flags, &q->key, VERIFY_READ);
 	if (unlikely(ret != 0))
 		return ret;
 
@@ -2699,6 +2758,308 @@ static long futex_wait_restart(struct restart_block *restart)
 }
 
 
+/*
+ * Wait on multiple futexes at once, for futex_waitv().
+ */
+
+#define FUTEX2_VALID_MASK	(FUTEX2_SIZE_U32 | FUTEX2_NUMA | FUTEX2_PRIVATE)
+
+/**
+ * struct futex_vector - Auxiliary struct for futex_waitv()
+ * @w:		userspace provided data
+ * @q:		kernel side data
+ */
+struct futex_vector {
+	struct futex_waitv w;
+	struct futex_q q;
+};
+
+static inline unsigned int futex2_to_flags(unsigned int flags2)
+{
+	unsigned int flags = 0;
+
+	if (!(flags2 & FUTEX2_PRIVATE))
+		flags |= FLAGS_SHARED;
+	if (flags2 & FUTEX2_NUMA)
+		flags |= FLAGS_NUMA;
+
+	return flags;
+}
+
+static void put_futex_keys(struct futex_vector *vs, int from, int to)
+{
+	int i;
+
+	for (i = from; i < to; i++)
+		put_futex_key(&vs[i].q.key);
+}
+
+/**
+ * unqueue_multiple() - Remove various futexes from their hash buckets
+ * @vs:		the futexes to unqueue
+ * @count:	the number of futexes in @vs
+ *
+ * Helper to unqueue a list of futexes, which also drops their key
+ * references. This can't fail.
+ *
+ * Return:
+ *  - >=0 - index of the last futex that was woken;
+ *  -  -1 - no futex was woken
+ */
+static int unqueue_multiple(struct futex_vector *vs, int count)
+{
+	int ret = -1, i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&vs[i].q))
+			ret = i;
+	}
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup() - Prepare to wait and enqueue multiple futexes
+ * @vs:		the futexes to wait on
+ * @count:	the number of futexes in @vs
+ * @woken:	index of the last woken futex, if any
+ *
+ * Queuing multiple futexes is tricky: each futex must be queued before the
+ * next hash bucket is locked, and the task state must be set before the first
+ * one is queued so that no wakeup is lost. get_futex_key() may sleep, so the
+ * keys of all the futexes are taken first, and only then is each value
+ * checked and its futex queued.
+ *
+ * Return:
+ *  -  1 - one of the futexes was woken by another thread;
+ *  -  0 - all the futexes were queued, ready to sleep;
+ *  - <0 - -EFAULT, -EINVAL or -EWOULDBLOCK (a value did not match) with no
+ *	   futex queued
+ */
+static int futex_wait_multiple_setup(struct futex_vector *vs, int count,
+				     int *woken)
+{
+	struct futex_hash_bucket *hb;
+	int ret, i;
+	u32 uval;
+
+retry:
+	for (i = 0; i < count; i++) {
+		ret = get_futex_key(u64_to_user_ptr(vs[i].w.uaddr),
+				    futex2_to_flags(vs[i].w.flags),
+				    &vs[i].q.key, VERIFY_READ);
+		if (unlikely(ret)) {
+			put_futex_keys(vs, 0, i);
+			return ret;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		u32 __user *uaddr = u64_to_user_ptr(vs[i].w.uaddr);
+		struct futex_q *q = &vs[i].q;
+		u32 val = (u32)vs[i].w.val;
+
+		hb = queue_lock(q);
+		ret = get_futex_value_locked(&uval, uaddr);
+
+		if (!ret && uval == val) {
+			/*
+			 * The hash bucket lock can't be held while dealing
+			 * with the next futex, so queue this one right away.
+			 */
+			queue_me(q, hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		/*
+		 * A futex queued so far may have been woken already; that
+		 * wins over whatever went wrong with this one.
+		 */
+		*woken = unqueue_multiple(vs, i);
+		put_futex_keys(vs, i, count);
+		if (*woken >= 0)
+			return 1;
+
+		if (ret) {
+			/*
+			 * The fault must be handled with no lock held and no
+			 * futex queued, or a wakeup could be lost. Then start
+			 * over.
+			 */
+			if (get_user(uval, uaddr))
+				return -EFAULT;
+			goto retry;
+		}
+
+		return -EWOULDBLOCK;
+	}
+
+	return 0;
+}
+
+/**
+ * futex_sleep_multiple() - Sleep unless a futex was woken or the timer fired
+ * @vs:		the queued futexes
+ * @count:	the number of futexes in @vs
+ * @to:		the armed timeout, or NULL
+ */
+static void futex_sleep_multiple(struct futex_vector *vs, int count,
+				 struct hrtimer_sleeper *to)
+{
+	int i;
+
+	if (to && !to->task)
+		return;
+
+	for (i = 0; i < count; i++) {
+		if (!READ_ONCE(vs[i].q.lock_ptr))
+			return;
+	}
+
+	freezable_schedule();
+}
+
+/**
+ * futex_wait_multiple() - Wait on multiple futexes at once
+ * @vs:		the futexes to wait on
+ * @count:	the number of futexes in @vs
+ * @to:		the prepared hrtimer_sleeper, or NULL for no timeout
+ *
+ * Return:
+ *  - >=0 - index of a woken futex;
+ *  -  <0 - -EWOULDBLOCK, -ETIMEDOUT, -ERESTARTSYS or a key lookup error
+ */
+static int futex_wait_multiple(struct futex_vector *vs, int count,
+			       struct hrtimer_sleeper *to)
+{
+	int ret, woken = -1;
+
+	if (to)
+		hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+
+	for (;;) {
+		ret = futex_wait_multiple_setup(vs, count, &woken);
+		if (ret)
+			return ret > 0 ? woken : ret;
+
+		futex_sleep_multiple(vs, count, to);
+
+		__set_current_state(TASK_RUNNING);
+
+		ret = unqueue_multiple(vs, count);
+		if (ret >= 0)
+			return ret;
+
+		if (to && !to->task)
+			return -ETIMEDOUT;
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+
+		/* A spurious wakeup, go around again. */
+	}
+}
+
+static int futex_parse_waitv(struct futex_vector *vs,
+			     struct futex_waitv __user *uwaitv,
+			     unsigned int nr_futexes)
+{
+	struct futex_waitv aux;
+	unsigned int i;
+
+	for (i = 0; i < nr_futexes; i++) {
+		if (copy_from_user(&aux, &uwaitv[i], sizeof(aux)))
+			return -EFAULT;
+
+		if ((aux.flags & ~FUTEX2_VALID_MASK) || aux.__reserved)
+			return -EINVAL;
+
+		/* Only 32 bit futexes exist so far. */
+		if (!(aux.flags & FUTEX2_SIZE_U32) || aux.val > U32_MAX)
+			return -EINVAL;
+
+		vs[i].w = aux;
+		vs[i].q = futex_q_init;
+	}
+
+	return 0;
+}
+
+/**
+ * sys_futex_waitv - Wait on a list of futexes
+ * @waiters:	list of futexes to wait on
+ * @nr_futexes:	length of @waiters, at most FUTEX_WAITV_MAX
+ * @flags:	must be 0
+ * @timeout:	optional absolute timeout
+ * @clockid:	clock to be used for the timeout, realtime or monotonic
+ *
+ * Given an array of `struct futex_waitv`, wait on each uaddr. The thread
+ * wakes if a futex_wake() is performed at any uaddr. The syscall returns
+ * immediately if any waiter has *uaddr != val. *timeout is an optional
+ * timeout value for the operation. Each waiter has individual flags; with
+ * FUTEX2_NUMA the futex is followed by its home node, as for
+ * FUTEX_NUMA_FLAG.
+ *
+ * Return: the array index of one of the woken futexes. No further
+ * information is provided: any number of other futexes may also have been
+ * woken by the same event, and if more than one futex was woken, the
+ * returned index may refer to any one of them.
+ */
+SYSCALL_DEFINE5(futex_waitv, struct futex_waitv __user *, waiters,
+		unsigned int, nr_futexes, unsigned int, flags,
+		struct __kernel_timespec __user *, timeout, clockid_t, clockid)
+{
+	struct hrtimer_sleeper to;
+	struct futex_vector *futexv;
+	struct timespec64 ts;
+	int ret;
+
+	/* This syscall supports no flags for now */
+	if (flags)
+		return -EINVAL;
+
+	if (!nr_futexes || nr_futexes > FUTEX_WAITV_MAX || !waiters)
+		return -EINVAL;
+
+	if (timeout) {
+		if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC)
+			return -EINVAL;
+		if (get_timespec64(&ts, timeout))
+			return -EFAULT;
+		if (!timespec64_valid(&ts))
+			return -EINVAL;
+
+		hrtimer_init_on_stack(&to.timer, clockid, HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(&to, current);
+		hrtimer_set_expires_range_ns(&to.timer, timespec64_to_ktime(ts),
+					     current->timer_slack_ns);
+	}
+
+	futexv = kcalloc(nr_futexes, sizeof(*futexv), GFP_KERNEL);
+	if (!futexv) {
+		ret = -ENOMEM;
+		goto destroy_timer;
+	}
+
+	ret = futex_parse_waitv(futexv, waiters, nr_futexes);
+	if (!ret)
+		ret = futex_wait_multiple(futexv, nr_futexes,
+					  timeout ? &to : NULL);
+
+	kfree(futexv);
+
+destroy_timer:
+	if (timeout) {
+		hrtimer_cancel(&to.timer);
+		destroy_hrtimer_on_stack(&to.timer);
+	}
+	return ret;
+}
+
+
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
  * and failed. The kernel side here does the whole locking operation:
@@ -2733,7 +3094,7 @@ static int futex_lock_pi(u32 __user *uaddr, unsigned int flags,
 	}
 
 retry:
-	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &q.key, VERIFY_WRITE);
+	ret = get_futex_key(uaddr, flags, &q.key, VERIFY_WRITE);
 	if (unlikely(ret != 0))
 		goto out;
 
@@ -2912,7 +3273,7 @@ static int futex_unlock_pi(u32 __user *uaddr, unsigned int flags)
 	if ((uval & FUTEX_TID_MASK) != vpid)
 		return -EPERM;
 
-	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &key, VERIFY_WRITE);
+	ret = get_futex_key(uaddr, flags, &key, VERIFY_WRITE);
 	if (ret)
 		return ret;
 
@@ -3139,7 +3500,7 @@ static int futex_wait_requeue_pi(u32 __user *uaddr, unsigned int flags,
 	 */
 	rt_mutex_init_waiter(&rt_waiter);
 
-	ret = get_futex_key(uaddr2, flags & FLAGS_SHARED, &key2, VERIFY_WRITE);
+	ret = get_futex_key(uaddr2, flags, &key2, VERIFY_WRITE);
 	if (unlikely(ret != 0))
 		goto out;
 
@@ -3510,6 +3871,18 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 			return -ENOSYS;
 	}
 
+	if (op & FUTEX_NUMA_FLAG) {
+		flags |= FLAGS_NUMA;
+		switch (cmd) {
+		case FUTEX_LOCK_PI:
+		case FUTEX_UNLOCK_PI:
+		case FUTEX_TRYLOCK_PI:
+		case FUTEX_WAIT_REQUEUE_PI:
+		case FUTEX_CMP_REQUEUE_PI:
+			return -ENOSYS;
+		}
+	}
+
 	switch (cmd) {
 	case FUTEX_LOCK_PI:
 	case FUTEX_UNLOCK_PI:
@@ -3611,30 +3984,45 @@ static void __init futex_detect_cmpxchg(void)
 
 static int __init futex_init(void)
 {
-	unsigned int futex_shift;
 	unsigned long i;
+	int node;
 
 #if CONFIG_BASE_SMALL
 	futex_hashsize = 16;
 #else
-	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+	futex_hashsize = roundup_pow_of_two(256 *
+			DIV_ROUND_UP(num_possible_cpus(), nr_node_ids));
 #endif
+	futex_hashshift = ilog2(futex_hashsize);
+
+	futex_queues = kcalloc(nr_node_ids, sizeof(*futex_queues), GFP_KERNEL);
+	if (!futex_queues)
+		panic("futex: cannot allocate the hash tables");
+
+	for (node = 0; node < nr_node_ids; node++) {
+		struct futex_hash_bucket *queues;
+
+		queues = kvmalloc_node(futex_hashsize * sizeof(*queues),
+				       GFP_KERNEL,
+				       node_state(node, N_MEMORY) ?
+				       node : NUMA_NO_NODE);
+		if (!queues)
+			panic("futex: cannot allocate the hash table of node %d",
+			      node);
+
+		for (i = 0; i < futex_hashsize; i++) {
+			atomic_set(&queues[i].waiters, 0);
+			plist_head_init(&queues[i].chain);
+			spin_lock_init(&queues[i].lock);
+		}
+		futex_queues[node] = queues;
+	}
 
-	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
-					       futex_hashsize, 0,
-					       futex_hashsize < 256 ? HASH_SMALL : 0,
-					       &futex_shift, NULL,
-					       futex_hashsize, futex_hashsize);
-	futex_hashsize = 1UL << futex_shift;
+	pr_info("futex hash table entries: %lu (%d nodes)\n",
+		futex_hashsize, nr_node_ids);
 
 	futex_detect_cmpxchg();
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
-
 	return 0;
 }
 core_initcall(futex_init);
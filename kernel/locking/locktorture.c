@@ -42,6 +42,7 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/percpu-rwsem.h>
+#include <linux/topology.h>
 #include <linux/torture.h>
 
 MODULE_LICENSE("GPL");
@@ -95,6 +96,7 @@ struct lock_torture_ops {
 	int (*readlock)(void);
 	void (*read_delay)(struct torture_random_state *trsp);
 	void (*readunlock)(void);
+	void (*print_stats)(char *page);
 
 	unsigned long flags; /* for irq spinlocks */
 	const char *name;
@@ -196,6 +198,67 @@ static struct lock_torture_ops spin_lock_ops = {
 	.name		= "spin_lock"
 };
 
+/*
+ * NUMA handoff scenario: a short critical section that dirties a couple of
+ * shared cachelines, recording whether each acquisition found the lock last
+ * held on the same node.  Compare the write throughput and the share of
+ * local handoffs with numa_spinlock=off and numa_spinlock=on.
+ */
+static struct {
+	int last_node;
+	long n_local;
+	long n_remote;
+	unsigned long data[2 * L1_CACHE_BYTES / sizeof(unsigned long)];
+} torture_spin_lock_numa ____cacheline_aligned_in_smp = {
+	.last_node = NUMA_NO_NODE,
+};
+
+static int torture_spin_lock_numa_write_lock(void) __acquires(torture_spinlock)
+{
+	int node = numa_node_id();
+
+	spin_lock(&torture_spinlock);
+	if (torture_spin_lock_numa.last_node == node)
+		torture_spin_lock_numa.n_local++;
+	else if (torture_spin_lock_numa.last_node != NUMA_NO_NODE)
+		torture_spin_lock_numa.n_remote++;
+	torture_spin_lock_numa.last_node = node;
+	return 0;
+}
+
+static void torture_spin_lock_numa_write_delay(struct torture_random_state *trsp)
+{
+	int i;
+
+	/* Touch the protected data so that handoffs move it between nodes. */
+	for (i = 0; i < ARRAY_SIZE(torture_spin_lock_numa.data); i++)
+		torture_spin_lock_numa.data[i]++;
+	if (!(torture_random(trsp) % (cxt.nrealwriters_stress * 20000)))
+		torture_preempt_schedule();  /* Allow test to be preempted. */
+}
+
+static void torture_spin_lock_numa_print_stats(char *page)
+{
+	long local = READ_ONCE(torture_spin_lock_numa.n_local);
+	long remote = READ_ONCE(torture_spin_lock_numa.n_remote);
+
+	sprintf(page, "Handoffs:  Local: %ld  Remote: %ld  Locality: %ld%%\n",
+		local, remote,
+		local + remote ? local * 100 / (local + remote) : 0);
+}
+
+static struct lock_torture_ops spin_lock_numa_ops = {
+	.writelock	= torture_spin_lock_numa_write_lock,
+	.write_delay	= torture_spin_lock_numa_write_delay,
+	.task_boost     = torture_boost_dummy,
+	.writeunlock	= torture_spin_lock_write_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.print_stats	= torture_spin_lock_numa_print_stats,
+	.name		= "spin_lock_numa"
+};
+
 static int torture_spin_lock_write_lock_irq(void)
 __acquires(torture_spinlock)
 {
@@ -748,6 +811,8 @@ static void lock_torture_stats_print(void)
 	}
 
 	__torture_print_stats(buf, cxt.lwsa, true);
+	if (cxt.cur_ops->print_stats)
+		cxt.cur_ops->print_stats(buf + strlen(buf));
 	pr_alert("%s", buf);
 	kfree(buf);
 
@@ -854,7 +919,7 @@ static int __init lock_torture_init(void)
 	int firsterr = 0;
 	static struct lock_torture_ops *torture_ops[] = {
 		&lock_busted_ops,
-		&spin_lock_ops, &spin_lock_irq_ops,
+		&spin_lock_ops, &spin_lock_irq_ops, &spin_lock_numa_ops,
 		&rw_lock_ops, &rw_lock_irq_ops,
 		&mutex_lock_ops,
 		&ww_mutex_lock_ops,
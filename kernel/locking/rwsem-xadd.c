@@ -19,7 +19,10 @@
 #include <linux/sched/debug.h>
 #include <linux/osq_lock.h>
 
+#include <trace/events/lock.h>
+
 #include "rwsem.h"
+#include "rwsem_stat.h"
 
 /*
  * Guide to the rw_semaphore's count field for common values.
@@ -68,6 +71,12 @@
  *	 are only waiters but none active (5th case above), and attempt to
  *	 steal the lock.
  *
+ *	 A writer which has been waiting at the head of the queue for longer
+ *	 than RWSEM_WAIT_TIMEOUT adds a second WAITING_BIAS to the count (lock
+ *	 handoff).  The count of an unlocked rwsem then stays below
+ *	 WAITING_BIAS, which neither optimistic spinners nor newly arriving
+ *	 writers will try to steal, so the lock ends up with that waiter.
+ *
  */
 
 /*
@@ -103,8 +112,17 @@ struct rwsem_waiter {
 	struct list_head list;
 	struct task_struct *task;
 	enum rwsem_waiter_type type;
+	unsigned long timeout;
+	bool handoff_set;
 };
 
+/*
+ * The typical HZ value is either 250 or 1000. So set the minimum waiting
+ * time to at least 4ms or 1 jiffy (if it is higher than 4ms) in the wait
+ * queue before a waiting writer asks for the lock to be handed off to it.
+ */
+#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
+
 enum rwsem_wake_type {
 	RWSEM_WAKE_ANY,		/* Wake whatever's at head of wait list */
 	RWSEM_WAKE_READERS,	/* Wake readers only */
@@ -147,6 +165,7 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 			 * will notice the queued writer.
 			 */
 			wake_q_add(wake_q, waiter->task);
+			rwstat_inc(rwstat_wake_writer);
 		}
 
 		return;
@@ -199,6 +218,7 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 		tsk = waiter->task;
 
 		wake_q_add(wake_q, tsk);
+		rwstat_inc(rwstat_wake_reader);
 		list_del(&waiter->list);
 		/*
 		 * Ensure that the last operation is setting the reader
@@ -219,6 +239,9 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 		atomic_long_add(adjustment, &sem->count);
 }
 
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem);
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock);
+
 /*
  * Wait for the read lock to be granted
  */
@@ -229,6 +252,24 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 	struct rwsem_waiter waiter;
 	DEFINE_WAKE_Q(wake_q);
 
+	trace_contention_begin(sem, LCB_F_READ);
+
+	/*
+	 * A writer holds the lock and nobody is queued: rather than going
+	 * to sleep straight away, back out our bias and spin on the owner
+	 * like a writer would, as the write hold is likely to be short.
+	 * If that fails, put the bias back and carry on as if we had just
+	 * come from down_read().
+	 */
+	if (list_empty(&sem->wait_list) && rwsem_can_spin_on_owner(sem)) {
+		atomic_long_add(-RWSEM_ACTIVE_READ_BIAS, &sem->count);
+		if (rwsem_optimistic_spin(sem, false)) {
+			trace_contention_end(sem, 0);
+			return sem;
+		}
+		atomic_long_add(RWSEM_ACTIVE_READ_BIAS, &sem->count);
+	}
+
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_READ;
 
@@ -242,6 +283,8 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 		 */
 		if (atomic_long_read(&sem->count) >= 0) {
 			raw_spin_unlock_irq(&sem->wait_lock);
+			rwstat_inc(rwstat_rlock_fast);
+			trace_contention_end(sem, 0);
 			return sem;
 		}
 		adjustment += RWSEM_WAITING_BIAS;
@@ -253,11 +296,13 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 
 	/*
 	 * If there are no active locks, wake the front queued process(es).
+	 * The count may carry a pending writer handoff, so only look at its
+	 * active part for that.
 	 *
 	 * If there are no writers and we are first in the queue,
 	 * wake our own waiter to join the existing active readers !
 	 */
-	if (count == RWSEM_WAITING_BIAS ||
+	if (!(count & RWSEM_ACTIVE_MASK) ||
 	    (count > RWSEM_WAITING_BIAS &&
 	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
 		__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
@@ -278,9 +323,12 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 			break;
 		}
 		schedule();
+		rwstat_inc(rwstat_sleep_reader);
 	}
 
 	__set_current_state(TASK_RUNNING);
+	rwstat_inc(rwstat_rlock);
+	trace_contention_end(sem, 0);
 	return sem;
 out_nolock:
 	list_del(&waiter.list);
@@ -288,6 +336,8 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 		atomic_long_add(-RWSEM_WAITING_BIAS, &sem->count);
 	raw_spin_unlock_irq(&sem->wait_lock);
 	__set_current_state(TASK_RUNNING);
+	rwstat_inc(rwstat_rlock_fail);
+	trace_contention_end(sem, -EINTR);
 	return ERR_PTR(-EINTR);
 }
 
@@ -305,17 +355,33 @@ rwsem_down_read_failed_killable(struct rw_semaphore *sem)
 }
 EXPORT_SYMBOL(rwsem_down_read_failed_killable);
 
+/*
+ * Return true if the count shows an unlocked rwsem that is being handed
+ * off to the writer at the head of the wait queue.
+ */
+static inline bool rwsem_handoff_pending(long count)
+{
+	return !(count & RWSEM_ACTIVE_MASK) && count < RWSEM_WAITING_BIAS;
+}
+
 /*
  * This function must be called with the sem->wait_lock held to prevent
  * race conditions between checking the rwsem wait list and setting the
  * sem->count accordingly.
  */
-static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
+static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem,
+					struct rwsem_waiter *waiter)
 {
+	long expected = RWSEM_WAITING_BIAS;
+
+	/* The handoff bias is dropped along with taking the lock. */
+	if (waiter->handoff_set)
+		expected += RWSEM_WAITING_BIAS;
+
 	/*
 	 * Avoid trying to acquire write lock if count isn't RWSEM_WAITING_BIAS.
 	 */
-	if (count != RWSEM_WAITING_BIAS)
+	if (count != expected)
 		return false;
 
 	/*
@@ -326,8 +392,8 @@ static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
 			RWSEM_ACTIVE_WRITE_BIAS :
 			RWSEM_ACTIVE_WRITE_BIAS + RWSEM_WAITING_BIAS;
 
-	if (atomic_long_cmpxchg_acquire(&sem->count, RWSEM_WAITING_BIAS, count)
-							== RWSEM_WAITING_BIAS) {
+	if (atomic_long_cmpxchg_acquire(&sem->count, expected, count)
+							== expected) {
 		rwsem_set_owner(sem);
 		return true;
 	}
@@ -358,6 +424,28 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	}
 }
 
+/*
+ * Try to acquire read lock before the reader has been put on wait queue.
+ * Only succeeds while there is neither a writer nor a waiter.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = atomic_long_read(&sem->count);
+
+	while (count >= 0) {
+		old = atomic_long_cmpxchg_acquire(&sem->count, count,
+				      count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count) {
+			rwsem_set_reader_owned(sem);
+			return true;
+		}
+
+		count = old;
+	}
+
+	return false;
+}
+
 static inline bool owner_on_cpu(struct task_struct *owner)
 {
 	/*
@@ -427,7 +515,7 @@ static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem)
 	return is_rwsem_owner_spinnable(READ_ONCE(sem->owner));
 }
 
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	bool taken = false;
 
@@ -445,17 +533,29 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	 * lock whenever the owner changes. Spinning will be stopped when:
 	 *  1) the owning writer isn't running; or
 	 *  2) readers own the lock as we can't determine if they are
-	 *     actively running or not.
+	 *     actively running or not; or
+	 *  3) the lock is being handed off to a waiter.
 	 */
 	while (rwsem_spin_on_owner(sem)) {
 		/*
 		 * Try to acquire the lock
 		 */
-		if (rwsem_try_write_lock_unqueued(sem)) {
+		if (wlock ? rwsem_try_write_lock_unqueued(sem) :
+			    rwsem_try_read_lock_unqueued(sem)) {
 			taken = true;
 			break;
 		}
 
+		if (rwsem_handoff_pending(atomic_long_read(&sem->count)))
+			break;
+
+		/*
+		 * A reader can't get ahead of queued waiters, there is no
+		 * point in spinning any longer.
+		 */
+		if (!wlock && !list_empty(&sem->wait_list))
+			break;
+
 		/*
 		 * When there's no owner, we might have preempted between the
 		 * owner acquiring the lock and setting the owner field. If
@@ -473,7 +573,19 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 		 */
 		cpu_relax();
 	}
+
+	/*
+	 * Spinning stops as soon as readers own the lock, which a reader
+	 * can still join.
+	 */
+	if (!taken && !wlock)
+		taken = rwsem_try_read_lock_unqueued(sem);
+
 	osq_unlock(&sem->osq);
+	if (taken)
+		rwstat_inc(wlock ? rwstat_opt_wlock : rwstat_opt_rlock);
+	else
+		rwstat_inc(rwstat_opt_fail);
 done:
 	preempt_enable();
 	return taken;
@@ -488,7 +600,12 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 }
 
 #else
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	return false;
 }
@@ -511,12 +628,16 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	struct rw_semaphore *ret = sem;
 	DEFINE_WAKE_Q(wake_q);
 
+	trace_contention_begin(sem, LCB_F_WRITE);
+
 	/* undo write bias from down_write operation, stop active locking */
 	count = atomic_long_sub_return(RWSEM_ACTIVE_WRITE_BIAS, &sem->count);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem, true)) {
+		trace_contention_end(sem, 0);
 		return sem;
+	}
 
 	/*
 	 * Optimistic spinning failed, proceed to the slowpath
@@ -524,6 +645,8 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	 */
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
+	waiter.handoff_set = false;
 
 	raw_spin_lock_irq(&sem->wait_lock);
 
@@ -565,8 +688,25 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	/* wait until we successfully acquire the lock */
 	set_current_state(state);
 	while (true) {
-		if (rwsem_try_write_lock(count, sem))
+		if (rwsem_try_write_lock(count, sem, &waiter))
 			break;
+
+		/*
+		 * We have been at the head of the queue for too long while
+		 * spinners and new writers kept stealing the lock: have it
+		 * handed off to us instead.
+		 */
+		if (!waiter.handoff_set &&
+		    time_after(jiffies, waiter.timeout) &&
+		    list_first_entry(&sem->wait_list, struct rwsem_waiter,
+				     list) == &waiter) {
+			count = atomic_long_add_return(RWSEM_WAITING_BIAS,
+						       &sem->count);
+			waiter.handoff_set = true;
+			rwstat_inc(rwstat_wlock_handoff);
+			if (rwsem_try_write_lock(count, sem, &waiter))
+				break;
+		}
 		raw_spin_unlock_irq(&sem->wait_lock);
 
 		/* Block until there are no active lockers. */
@@ -575,6 +715,7 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 				goto out_nolock;
 
 			schedule();
+			rwstat_inc(rwstat_sleep_writer);
 			set_current_state(state);
 		} while ((count = atomic_long_read(&sem->count)) & RWSEM_ACTIVE_MASK);
 
@@ -583,6 +724,8 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	__set_current_state(TASK_RUNNING);
 	list_del(&waiter.list);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	rwstat_inc(rwstat_wlock);
+	trace_contention_end(sem, 0);
 
 	return ret;
 
@@ -590,12 +733,16 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	__set_current_state(TASK_RUNNING);
 	raw_spin_lock_irq(&sem->wait_lock);
 	list_del(&waiter.list);
+	if (waiter.handoff_set)
+		atomic_long_add(-RWSEM_WAITING_BIAS, &sem->count);
 	if (list_empty(&sem->wait_list))
 		atomic_long_add(-RWSEM_WAITING_BIAS, &sem->count);
 	else
 		__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
 	raw_spin_unlock_irq(&sem->wait_lock);
 	wake_up_q(&wake_q);
+	rwstat_inc(rwstat_wlock_fail);
+	trace_contention_end(sem, -EINTR);
 
 	return ERR_PTR(-EINTR);
 }
@@ -670,8 +817,12 @@ struct rw_semaphore *rwsem_wake(struct rw_semaphore *sem)
 	 * a trylock in rwsem_down_write_failed() before sleeping. IOW, if
 	 * rwsem_has_spinner() is true, it will guarantee at least one
 	 * trylock attempt on the rwsem later on.
+	 *
+	 * That doesn't hold while the lock is being handed off to the first
+	 * waiter, which spinners won't take, so that one must be woken.
 	 */
-	if (rwsem_has_spinner(sem)) {
+	if (rwsem_has_spinner(sem) &&
+	    !rwsem_handoff_pending(atomic_long_read(&sem->count))) {
 		/*
 		 * The smp_rmb() here is to make sure that the spinner
 		 * state is consulted before reading the wait_lock.
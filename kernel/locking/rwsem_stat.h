@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * When rwsem statistical counters are enabled, the following debugfs files
+ * will be created for reporting the counter values:
+ *
+ * <debugfs>/rwsemstat/
+ *   rwsem_sleep_reader	- # of reader sleeps
+ *   rwsem_sleep_writer	- # of writer sleeps
+ *   rwsem_wake_reader	- # of reader wakeups
+ *   rwsem_wake_writer	- # of writer wakeups
+ *   rwsem_opt_rlock	- # of read locks opt-spin acquired
+ *   rwsem_opt_wlock	- # of write locks opt-spin acquired
+ *   rwsem_opt_fail	- # of failed opt-spinnings
+ *   rwsem_rlock	- # of read locks acquired after sleeping
+ *   rwsem_rlock_fast	- # of read locks acquired in the slowpath without
+ *			  queueing
+ *   rwsem_rlock_fail	- # of failed read lock acquisitions
+ *   rwsem_wlock	- # of write locks acquired after sleeping
+ *   rwsem_wlock_fail	- # of failed write lock acquisitions
+ *   rwsem_wlock_handoff - # of write lock handoffs
+ *
+ * Writing to the "reset_counters" file will reset all the above counter
+ * values.
+ *
+ * Like the qspinlock ones, these counters are implemented as per-cpu
+ * variables which are summed whenever the corresponding debugfs files
+ * are read.
+ */
+enum rwsem_stats {
+	rwstat_sleep_reader,
+	rwstat_sleep_writer,
+	rwstat_wake_reader,
+	rwstat_wake_writer,
+	rwstat_opt_rlock,
+	rwstat_opt_wlock,
+	rwstat_opt_fail,
+	rwstat_rlock,
+	rwstat_rlock_fast,
+	rwstat_rlock_fail,
+	rwstat_wlock,
+	rwstat_wlock_fail,
+	rwstat_wlock_handoff,
+	rwstat_num,	/* Total number of statistical counters */
+	rwstat_reset_cnts = rwstat_num,
+};
+
+#ifdef CONFIG_RWSEM_LOCK_STAT
+/*
+ * Collect rwsem statistics
+ */
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+
+static const char * const rwstat_names[rwstat_num + 1] = {
+	[rwstat_sleep_reader]	= "rwsem_sleep_reader",
+	[rwstat_sleep_writer]	= "rwsem_sleep_writer",
+	[rwstat_wake_reader]	= "rwsem_wake_reader",
+	[rwstat_wake_writer]	= "rwsem_wake_writer",
+	[rwstat_opt_rlock]	= "rwsem_opt_rlock",
+	[rwstat_opt_wlock]	= "rwsem_opt_wlock",
+	[rwstat_opt_fail]	= "rwsem_opt_fail",
+	[rwstat_rlock]		= "rwsem_rlock",
+	[rwstat_rlock_fast]	= "rwsem_rlock_fast",
+	[rwstat_rlock_fail]	= "rwsem_rlock_fail",
+	[rwstat_wlock]		= "rwsem_wlock",
+	[rwstat_wlock_fail]	= "rwsem_wlock_fail",
+	[rwstat_wlock_handoff]	= "rwsem_wlock_handoff",
+	[rwstat_reset_cnts]	= "reset_counters",
+};
+
+/*
+ * Per-cpu counters
+ */
+static DEFINE_PER_CPU(unsigned long, rwstats[rwstat_num]);
+
+static ssize_t rwstat_read(struct file *file, char __user *user_buf,
+			   size_t count, loff_t *ppos)
+{
+	char buf[64];
+	int cpu, counter, len;
+	u64 stat = 0;
+
+	/*
+	 * Get the counter ID stored in file->f_inode->i_private
+	 */
+	counter = (long)file_inode(file)->i_private;
+
+	if (counter >= rwstat_num)
+		return -EBADF;
+
+	for_each_possible_cpu(cpu)
+		stat += per_cpu(rwstats[counter], cpu);
+
+	len = snprintf(buf, sizeof(buf) - 1, "%llu\n", stat);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+/*
+ * When counter = reset_cnts, reset all the counter values.
+ */
+static ssize_t rwstat_write(struct file *file, const char __user *user_buf,
+			    size_t count, loff_t *ppos)
+{
+	int cpu;
+
+	if ((long)file_inode(file)->i_private != rwstat_reset_cnts)
+		return count;
+
+	for_each_possible_cpu(cpu) {
+		int i;
+		unsigned long *ptr = per_cpu_ptr(rwstats, cpu);
+
+		for (i = 0 ; i < rwstat_num; i++)
+			WRITE_ONCE(ptr[i], 0);
+	}
+	return count;
+}
+
+static const struct file_operations fops_rwstat = {
+	.read = rwstat_read,
+	.write = rwstat_write,
+	.llseek = default_llseek,
+};
+
+static int __init init_rwsem_stat(void)
+{
+	struct dentry *d_rwstat = debugfs_create_dir("rwsemstat", NULL);
+	int i;
+
+	if (!d_rwstat)
+		goto out;
+
+	for (i = 0; i < rwstat_num; i++)
+		if (!debugfs_create_file(rwstat_names[i], 0400, d_rwstat,
+					 (void *)(long)i, &fops_rwstat))
+			goto fail_undo;
+
+	if (!debugfs_create_file(rwstat_names[rwstat_reset_cnts], 0200,
+				 d_rwstat, (void *)(long)rwstat_reset_cnts,
+				 &fops_rwstat))
+		goto fail_undo;
+
+	return 0;
+fail_undo:
+	debugfs_remove_recursive(d_rwstat);
+out:
+	pr_warn("Could not create 'rwsemstat' debugfs entries\n");
+	return -ENOMEM;
+}
+fs_initcall(init_rwsem_stat);
+
+static inline void rwstat_inc(enum rwsem_stats stat)
+{
+	this_cpu_inc(rwstats[stat]);
+}
+
+#else /* CONFIG_RWSEM_LOCK_STAT */
+
+static inline void rwstat_inc(enum rwsem_stats stat)	{ }
+
+#endif /* CONFIG_RWSEM_LOCK_STAT */
@@ -2896,9 +2896,12 @@ static int copy_module_from_user(const void __user *umod, unsigned long len,
 	return 0;
 }
 
-static void free_copy(struct load_info *info)
+static void free_copy(struct load_info *info, int flags)
 {
-	vfree(info->hdr);
+	if (flags & MODULE_INIT_COMPRESSED_FILE)
+		module_decompress_cleanup(info);
+	else
+		vfree(info->hdr);
 }
 
 static int rewrite_section_headers(struct load_info *info, int flags)
@@ -3791,7 +3794,7 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	}
 
 	/* Get rid of temporary copy. */
-	free_copy(info);
+	free_copy(info, flags);
 
 	/* Done! */
 	trace_module_load(mod);
@@ -3842,7 +3845,7 @@ static int load_module(struct load_info *info, const char __user *uargs,
 
 	module_deallocate(mod, info);
  free_copy:
-	free_copy(info);
+	free_copy(info, flags);
 	return err;
 }
 
@@ -3880,15 +3883,28 @@ SYSCALL_DEFINE3(finit_module, int, fd, const char __user *, uargs, int, flags)
 	pr_debug("finit_module: fd=%d, uargs=%p, flags=%i\n", fd, uargs, flags);
 
 	if (flags & ~(MODULE_INIT_IGNORE_MODVERSIONS
-		      |MODULE_INIT_IGNORE_VERMAGIC))
+		      |MODULE_INIT_IGNORE_VERMAGIC
+		      |MODULE_INIT_COMPRESSED_FILE))
 		return -EINVAL;
 
 	err = kernel_read_file_from_fd(fd, &hdr, &size, INT_MAX,
 				       READING_MODULE);
 	if (err)
 		return err;
-	info.hdr = hdr;
-	info.len = size;
+
+	/*
+	 * Decompress before load_module(): no lock is held yet, so modules
+	 * loaded in parallel inflate concurrently.
+	 */
+	if (flags & MODULE_INIT_COMPRESSED_FILE) {
+		err = module_decompress(&info, hdr, size);
+		vfree(hdr);
+		if (err)
+			return err;
+	} else {
+		info.hdr = hdr;
+		info.len = size;
+	}
 
 	return load_module(&info, uargs, flags);
 }
@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * In-kernel decompression of compressed modules
+ *
+ * finit_module() with MODULE_INIT_COMPRESSED_FILE hands us the module file
+ * as installed, so the integrity checks on the file still apply and user
+ * space no longer has to inflate it into a buffer of its own first.  The
+ * image is decompressed page by page and mapped contiguously for
+ * load_module().
+ */
+
+#define pr_fmt(fmt) "module: " fmt
+
+#include <linux/kernel.h>
+#include <linux/highmem.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/xz.h>
+#include <linux/zstd.h>
+
+#include "module-internal.h"
+
+static int module_extend_max_pages(struct load_info *info, unsigned int extent)
+{
+	struct page **new_pages;
+
+	new_pages = kvmalloc_array(info->max_pages + extent,
+				   sizeof(*info->pages), GFP_KERNEL);
+	if (!new_pages)
+		return -ENOMEM;
+
+	memcpy(new_pages, info->pages, info->max_pages * sizeof(*info->pages));
+	kvfree(info->pages);
+	info->pages = new_pages;
+	info->max_pages += extent;
+
+	return 0;
+}
+
+static struct page *module_get_next_page(struct load_info *info)
+{
+	struct page *page;
+	int error;
+
+	if (info->max_pages == info->used_pages) {
+		error = module_extend_max_pages(info, info->used_pages);
+		if (error)
+			return ERR_PTR(error);
+	}
+
+	page = alloc_page(GFP_KERNEL | __GFP_HIGHMEM);
+	if (!page)
+		return ERR_PTR(-ENOMEM);
+
+	info->pages[info->used_pages++] = page;
+	return page;
+}
+
+static const u8 module_xz_signature[] = { 0xfd, '7', 'z', 'X', 'Z', 0 };
+
+static ssize_t module_xz_decompress(struct load_info *info,
+				    const void *buf, size_t size)
+{
+	struct xz_dec *xz_dec;
+	struct xz_buf xz_buf;
+	enum xz_ret xz_ret;
+	size_t new_size = 0;
+	ssize_t retval;
+
+	xz_dec = xz_dec_init(XZ_DYNALLOC, (u32)-1);
+	if (!xz_dec)
+		return -ENOMEM;
+
+	xz_buf.in_size = size;
+	xz_buf.in = buf;
+	xz_buf.in_pos = 0;
+
+	do {
+		struct page *page = module_get_next_page(info);
+
+		if (IS_ERR(page)) {
+			retval = PTR_ERR(page);
+			goto out;
+		}
+
+		xz_buf.out = kmap(page);
+		xz_buf.out_pos = 0;
+		xz_buf.out_size = PAGE_SIZE;
+		xz_ret = xz_dec_run(xz_dec, &xz_buf);
+		kunmap(page);
+
+		new_size += xz_buf.out_pos;
+	} while (xz_buf.out_pos == PAGE_SIZE && xz_ret == XZ_OK);
+
+	if (xz_ret != XZ_STREAM_END) {
+		pr_err("xz decompression failed with status %d\n", xz_ret);
+		retval = -EINVAL;
+		goto out;
+	}
+
+	retval = new_size;
+out:
+	xz_dec_end(xz_dec);
+	return retval;
+}
+
+static const u8 module_zstd_signature[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+static ssize_t module_zstd_decompress(struct load_info *info,
+				      const void *buf, size_t size)
+{
+	ZSTD_inBuffer zstd_buf = { .src = buf, .size = size, .pos = 0 };
+	ZSTD_outBuffer zstd_dec;
+	ZSTD_frameParams params;
+	ZSTD_DStream *dstream;
+	size_t wksp_size, ret;
+	size_t new_size = 0;
+	ssize_t retval;
+	void *wksp;
+
+	ret = ZSTD_getFrameParams(&params, buf, size);
+	if (ret != 0 || !params.windowSize) {
+		pr_err("failed to read zstd frame header\n");
+		return -EINVAL;
+	}
+
+	wksp_size = ZSTD_DStreamWorkspaceBound(params.windowSize);
+	wksp = kvmalloc(wksp_size, GFP_KERNEL);
+	if (!wksp)
+		return -ENOMEM;
+
+	dstream = ZSTD_initDStream(params.windowSize, wksp, wksp_size);
+	if (!dstream) {
+		pr_err("can't initialize zstd stream\n");
+		retval = -EINVAL;
+		goto out;
+	}
+
+	do {
+		struct page *page = module_get_next_page(info);
+
+		if (IS_ERR(page)) {
+			retval = PTR_ERR(page);
+			goto out;
+		}
+
+		zstd_dec.dst = kmap(page);
+		zstd_dec.pos = 0;
+		zstd_dec.size = PAGE_SIZE;
+		ret = ZSTD_decompressStream(dstream, &zstd_dec, &zstd_buf);
+		kunmap(page);
+
+		if (ZSTD_isError(ret)) {
+			pr_err("zstd decompression failed with status %d\n",
+			       ZSTD_getErrorCode(ret));
+			retval = -EINVAL;
+			goto out;
+		}
+
+		new_size += zstd_dec.pos;
+	} while (zstd_dec.pos == PAGE_SIZE && ret != 0);
+
+	/* Anything but the end of the frame means the input was cut short */
+	if (ret != 0) {
+		pr_err("zstd compressed module is truncated\n");
+		retval = -EINVAL;
+		goto out;
+	}
+
+	retval = new_size;
+out:
+	kvfree(wksp);
+	return retval;
+}
+
+static bool module_has_signature(const void *buf, size_t size,
+				 const u8 *signature, size_t len)
+{
+	return size >= len && !memcmp(buf, signature, len);
+}
+
+/**
+ * module_decompress - decompress a module file into a temporary image
+ * @info: load_info to fill in, the image replaces info->hdr
+ * @buf: the compressed module as read from the file
+ * @size: size of @buf
+ *
+ * The format is told from the magic of the data, so one kernel can load
+ * modules compressed with any of the decompressors it has built in.
+ * The image must be released with module_decompress_cleanup().
+ */
+int module_decompress(struct load_info *info, const void *buf, size_t size)
+{
+	unsigned int n_pages;
+	ssize_t data_size;
+	int error;
+
+	/*
+	 * Start with a guess of twice the compressed size, the page array
+	 * doubles whenever the decompressed data does not fit.
+	 */
+	n_pages = DIV_ROUND_UP(size, PAGE_SIZE) * 2;
+	error = module_extend_max_pages(info, n_pages);
+	if (error)
+		goto err;
+
+	if (IS_BUILTIN(CONFIG_XZ_DEC) &&
+	    module_has_signature(buf, size, module_xz_signature,
+				 sizeof(module_xz_signature))) {
+		data_size = module_xz_decompress(info, buf, size);
+	} else if (IS_BUILTIN(CONFIG_ZSTD_DECOMPRESS) &&
+		   module_has_signature(buf, size, module_zstd_signature,
+					sizeof(module_zstd_signature))) {
+		data_size = module_zstd_decompress(info, buf, size);
+	} else {
+		pr_err("module compression format not supported\n");
+		data_size = -ENOEXEC;
+	}
+
+	if (data_size < 0) {
+		error = data_size;
+		goto err;
+	}
+
+	info->hdr = vmap(info->pages, info->used_pages, VM_MAP, PAGE_KERNEL);
+	if (!info->hdr) {
+		error = -ENOMEM;
+		goto err;
+	}
+
+	info->len = data_size;
+	return 0;
+
+err:
+	module_decompress_cleanup(info);
+	return error;
+}
+
+void module_decompress_cleanup(struct load_info *info)
+{
+	int i;
+
+	if (info->hdr)
+		vunmap(info->hdr);
+	info->hdr = NULL;
+
+	for (i = 0; i < info->used_pages; i++)
+		__free_page(info->pages[i]);
+
+	kvfree(info->pages);
+
+	info->pages = NULL;
+	info->max_pages = info->used_pages = 0;
+}
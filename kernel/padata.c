@@ -21,6 +21,7 @@
  * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <linux/completion.h>
 #include <linux/export.h>
 #include <linux/cpumask.h>
 #include <linux/err.h>
@@ -32,6 +33,7 @@
 #include <linux/sysfs.h>
 #include <linux/rcupdate.h>
 #include <linux/module.h>
+#include <linux/topology.h>
 
 #define MAX_OBJ_NUM 1000
 
@@ -1088,6 +1090,130 @@ void padata_free(struct padata_instance *pinst)
 }
 EXPORT_SYMBOL(padata_free);
 
+/* Shared state of the threads working on one padata_mt_job */
+struct padata_mt_job_state {
+	spinlock_t		lock;
+	struct completion	completion;
+	struct padata_mt_job	*job;
+	int			nworks;
+	int			nworks_fini;
+	unsigned long		chunk_size;
+};
+
+struct padata_mt_work {
+	struct work_struct		work;
+	struct padata_mt_job_state	*ps;
+};
+
+static void padata_mt_helper(struct work_struct *w)
+{
+	struct padata_mt_work *pw = container_of(w, struct padata_mt_work, work);
+	struct padata_mt_job_state *ps = pw->ps;
+	struct padata_mt_job *job = ps->job;
+	bool done;
+
+	spin_lock(&ps->lock);
+
+	while (job->size > 0) {
+		unsigned long start, size, end;
+
+		start = job->start;
+		/* So end is chunk size aligned if enough work remains. */
+		size = roundup(start + 1, ps->chunk_size) - start;
+		size = min(size, job->size);
+		end = start + size;
+
+		job->start = end;
+		job->size -= size;
+
+		spin_unlock(&ps->lock);
+		job->thread_fn(start, end, job->fn_arg);
+		spin_lock(&ps->lock);
+	}
+
+	++ps->nworks_fini;
+	done = (ps->nworks_fini == ps->nworks);
+	spin_unlock(&ps->lock);
+
+	if (done)
+		complete(&ps->completion);
+}
+
+/**
+ * padata_do_multithreaded - run a multithreaded job
+ * @job: Description of the job.
+ *
+ * The work is split into chunks that helper threads from the unbound
+ * workqueue and the calling thread take in turn until none are left.
+ * Returns once the whole job is done.  Must be called from a context
+ * that may sleep.
+ */
+void padata_do_multithreaded(struct padata_mt_job *job)
+{
+	/* In case threads finish at different times. */
+	static const unsigned long load_balance_factor = 4;
+	struct padata_mt_work my_work, *works;
+	struct padata_mt_job_state ps;
+	int nworks, cpu, i;
+
+	if (job->size == 0)
+		return;
+
+	/* Ensure at least one thread when size < min_chunk. */
+	nworks = max(job->size / job->min_chunk, 1ul);
+	nworks = min(nworks, job->max_threads);
+
+	works = NULL;
+	if (nworks > 1)
+		works = kcalloc(nworks - 1, sizeof(*works), GFP_KERNEL);
+	if (!works) {
+		/* Single thread, no coordination needed, cut to the chase. */
+		job->thread_fn(job->start, job->start + job->size, job->fn_arg);
+		return;
+	}
+
+	spin_lock_init(&ps.lock);
+	init_completion(&ps.completion);
+	ps.job = job;
+	ps.nworks = nworks;
+	ps.nworks_fini = 0;
+
+	/*
+	 * Chunk size is the amount of work a helper does per call to the
+	 * thread function.  Load balance large jobs between threads by
+	 * increasing the number of chunks, guarantee at least the minimum
+	 * chunk size from the caller, and honor the caller's alignment.
+	 */
+	ps.chunk_size = job->size / (nworks * load_balance_factor);
+	ps.chunk_size = max(ps.chunk_size, job->min_chunk);
+	ps.chunk_size = roundup(ps.chunk_size, job->align);
+
+	cpu = WORK_CPU_UNBOUND;
+	if (job->nid != NUMA_NO_NODE) {
+		cpu = cpumask_any_and(cpumask_of_node(job->nid),
+				      cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = WORK_CPU_UNBOUND;
+	}
+
+	for (i = 0; i < nworks - 1; i++) {
+		INIT_WORK(&works[i].work, padata_mt_helper);
+		works[i].ps = &ps;
+		queue_work_on(cpu, system_unbound_wq, &works[i].work);
+	}
+
+	/* Use the current thread, which saves starting a workqueue worker. */
+	INIT_WORK_ONSTACK(&my_work.work, padata_mt_helper);
+	my_work.ps = &ps;
+	padata_mt_helper(&my_work.work);
+
+	/* Wait for all the helpers to finish. */
+	wait_for_completion(&ps.completion);
+
+	destroy_work_on_stack(&my_work.work);
+	kfree(works);
+}
+
 #ifdef CONFIG_HOTPLUG_CPU
 
 static __init int padata_driver_init(void)
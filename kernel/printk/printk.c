@@ -47,6 +47,7 @@
 #include <linux/sched/clock.h>
 #include <linux/sched/debug.h>
 #include <linux/sched/task_stack.h>
+#include <linux/kthread.h>
 
 #include <linux/uaccess.h>
 #include <asm/sections.h>
@@ -1828,21 +1829,12 @@ static size_t log_output(int facility, int level, enum log_flags lflags, const c
 }
 
 /* Must be called under logbuf_lock. */
-int vprintk_store(int facility, int level,
-		  const char *dict, size_t dictlen,
-		  const char *fmt, va_list args)
+static int vprintk_store_text(int facility, int level,
+			      const char *dict, size_t dictlen,
+			      char *text, size_t text_len)
 {
-	static char textbuf[LOG_LINE_MAX];
-	char *text = textbuf;
-	size_t text_len;
 	enum log_flags lflags = 0;
 
-	/*
-	 * The printf needs to come first; we need the syslog
-	 * prefix which might be passed-in as a parameter.
-	 */
-	text_len = vscnprintf(text, sizeof(textbuf), fmt, args);
-
 	/* mark and strip a trailing newline */
 	if (text_len && text[text_len-1] == '\n') {
 		text_len--;
@@ -1881,14 +1873,149 @@ int vprintk_store(int facility, int level,
 			  dict, dictlen, text, text_len);
 }
 
+/* Must be called under logbuf_lock. */
+int vprintk_store(int facility, int level,
+		  const char *dict, size_t dictlen,
+		  const char *fmt, va_list args)
+{
+	static char textbuf[LOG_LINE_MAX];
+	size_t text_len;
+
+	/*
+	 * The printf needs to come first; we need the syslog
+	 * prefix which might be passed-in as a parameter.
+	 */
+	text_len = vscnprintf(textbuf, sizeof(textbuf), fmt, args);
+
+	return vprintk_store_text(facility, level, dict, dictlen,
+				  textbuf, text_len);
+}
+
+/*
+ * vprintk_emit() formats the messages in a buffer of the CPU and of the
+ * context it runs in, before taking logbuf_lock: the lock is then only
+ * held to copy the text into the log buffer, rather than for the whole
+ * of the vsnprintf(). A printk() nested in the same context, from the
+ * vsnprintf() itself, finds the buffer busy and falls back to formatting
+ * under the lock.
+ */
+enum printk_sprint_ctx {
+	PRINTK_SPRINT_TASK,
+	PRINTK_SPRINT_SOFTIRQ,
+	PRINTK_SPRINT_HARDIRQ,
+	PRINTK_SPRINT_NMI,
+	PRINTK_SPRINT_NR,
+};
+
+static DEFINE_PER_CPU(char [PRINTK_SPRINT_NR][LOG_LINE_MAX], printk_sprint_buf);
+static DEFINE_PER_CPU(bool [PRINTK_SPRINT_NR], printk_sprint_busy);
+
+static enum printk_sprint_ctx printk_sprint_ctx(void)
+{
+	if (in_nmi())
+		return PRINTK_SPRINT_NMI;
+	if (in_irq())
+		return PRINTK_SPRINT_HARDIRQ;
+	if (in_serving_softirq())
+		return PRINTK_SPRINT_SOFTIRQ;
+	return PRINTK_SPRINT_TASK;
+}
+
+/* Must be called with preemption disabled. */
+static char *printk_sprint_get(enum printk_sprint_ctx ctx)
+{
+	bool *busy = this_cpu_ptr(&printk_sprint_busy[ctx]);
+
+	if (*busy)
+		return NULL;
+	*busy = true;
+	barrier();
+
+	return *this_cpu_ptr(&printk_sprint_buf[ctx]);
+}
+
+static void printk_sprint_put(enum printk_sprint_ctx ctx)
+{
+	barrier();
+	*this_cpu_ptr(&printk_sprint_busy[ctx]) = false;
+}
+
+/*
+ * The consoles are written by the printk kthread once it runs, so that no
+ * task calling printk() or console_unlock() ends up flushing them for
+ * everybody else. They are written directly when the kthread cannot be
+ * relied on: before it is started, when the system goes down and in an
+ * emergency (oops_in_progress, which includes panic).
+ */
+static struct task_struct *printk_kthread;
+
+static bool printk_offload(void)
+{
+	return printk_kthread && current != printk_kthread &&
+	       !oops_in_progress && system_state == SYSTEM_RUNNING;
+}
+
+static void printk_kthread_wake(void)
+{
+	wake_up_process(printk_kthread);
+}
+
+static bool printk_console_pending(void)
+{
+	unsigned long flags;
+	bool pending;
+
+	logbuf_lock_irqsave(flags);
+	/* resume_console() wakes the kthread up again */
+	pending = console_seq != log_next_seq && !console_suspended;
+	logbuf_unlock_irqrestore(flags);
+
+	return pending;
+}
+
+static int printk_kthread_func(void *data)
+{
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!printk_console_pending())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+	}
+
+	return 0;
+}
+
+static int __init printk_kthread_init(void)
+{
+	struct task_struct *kthread;
+
+	kthread = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(kthread)) {
+		pr_err("printk: unable to create the printing thread\n");
+		return PTR_ERR(kthread);
+	}
+
+	printk_kthread = kthread;
+	/* flush what was logged since the last direct printing */
+	printk_kthread_wake();
+	return 0;
+}
+late_initcall(printk_kthread_init);
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
 {
 	int printed_len;
 	bool in_sched = false, pending_output;
+	enum printk_sprint_ctx ctx;
+	size_t text_len = 0;
 	unsigned long flags;
 	u64 curr_log_seq;
+	char *text;
 
 	if (level == LOGLEVEL_SCHED) {
 		level = LOGLEVEL_DEFAULT;
@@ -1898,15 +2025,33 @@ asmlinkage int vprintk_emit(int facility, int level,
 	boot_delay_msec(level);
 	printk_delay();
 
+	preempt_disable();
+	ctx = printk_sprint_ctx();
+	text = printk_sprint_get(ctx);
+	if (text)
+		text_len = vscnprintf(text, LOG_LINE_MAX, fmt, args);
+
 	/* This stops the holder of console_sem just where we want him */
 	logbuf_lock_irqsave(flags);
 	curr_log_seq = log_next_seq;
-	printed_len = vprintk_store(facility, level, dict, dictlen, fmt, args);
+	if (text)
+		printed_len = vprintk_store_text(facility, level, dict, dictlen,
+						 text, text_len);
+	else
+		printed_len = vprintk_store(facility, level, dict, dictlen,
+					    fmt, args);
 	pending_output = (curr_log_seq != log_next_seq);
 	logbuf_unlock_irqrestore(flags);
 
+	if (text)
+		printk_sprint_put(ctx);
+	preempt_enable();
+
 	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched && pending_output) {
+	if (!in_sched && pending_output && printk_offload()) {
+		/* Leave the printing to the printk kthread */
+		printk_kthread_wake();
+	} else if (!in_sched && pending_output) {
 		/*
 		 * Disable preemption to avoid being preempted while holding
 		 * console_sem which would prevent anyone from printing to
@@ -2031,6 +2176,8 @@ static void call_console_drivers(const char *ext_text, size_t ext_len,
 static size_t msg_print_text(const struct printk_log *msg,
 			     bool syslog, char *buf, size_t size) { return 0; }
 static bool suppress_message_printing(int level) { return false; }
+static bool printk_offload(void) { return false; }
+static void printk_kthread_wake(void) { }
 
 #endif /* CONFIG_PRINTK */
 
@@ -2316,6 +2463,14 @@ void console_unlock(void)
 		return;
 	}
 
+	/* Leave the printing to the printk kthread, see printk_offload() */
+	if (printk_offload()) {
+		console_locked = 0;
+		up_console_sem();
+		printk_kthread_wake();
+		return;
+	}
+
 	/*
 	 * Console drivers are called with interrupts disabled, so
 	 * @console_may_schedule should be cleared before; however, we may
@@ -2881,8 +3036,10 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 	int pending = __this_cpu_xchg(printk_pending, 0);
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
+		if (printk_offload())
+			printk_kthread_wake();
 		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		else if (console_trylock())
 			console_unlock();
 	}
 
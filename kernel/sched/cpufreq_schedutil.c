@@ -205,7 +205,11 @@ static unsigned long sugov_get_util(struct sugov_cpu *sg_cpu)
 	sg_cpu->max = max = arch_scale_cpu_capacity(NULL, sg_cpu->cpu);
 	sg_cpu->bw_dl = cpu_bw_dl(rq);
 
-	if (rt_rq_is_runnable(&rq->rt))
+	/*
+	 * With utilization clamping, whether RT tasks get f_max is up to their
+	 * (by default maximum) util_min.
+	 */
+	if (!IS_BUILTIN(CONFIG_UCLAMP_TASK) && rt_rq_is_runnable(&rq->rt))
 		return max;
 
 	/*
@@ -226,6 +230,12 @@ static unsigned long sugov_get_util(struct sugov_cpu *sg_cpu)
 	util = cpu_util_cfs(rq);
 	util += cpu_util_rt(rq);
 
+	/*
+	 * Boost or cap the CFS+RT utilization as asked by the clamps of the
+	 * RUNNABLE tasks; DEADLINE keeps its bandwidth regardless.
+	 */
+	util = uclamp_util(rq, util);
+
 	/*
 	 * We do not make cpu_util_dl() a permanent part of this sum because we
 	 * want to use cpu_bw_dl() later on, but we need to check if the
@@ -0,0 +1,990 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Extensible scheduling class: the policy comes from a struct
+ * sched_ext_ops registered by a module, see include/linux/sched/ext.h.
+ *
+ * Each CPU runs the tasks of its local DSQ, which is protected by the rq
+ * lock. The global DSQ and the DSQs the scheduler creates have their own
+ * lock, nesting inside the rq lock. A CPU with an empty local DSQ first
+ * consumes the global DSQ and then asks ops.dispatch() for more; a task
+ * consumed from the DSQ while queued on another rq is moved over with
+ * both rq locks held, after being taken off the DSQ and marked with
+ * holding_cpu so that a dequeue in the window can tell the consumer to
+ * back off.
+ *
+ * Once the scheduler is being disabled, its callbacks are no longer used:
+ * tasks go to the global DSQ in FIFO order until all of them are back in
+ * the fair class.
+ */
+#include "sched.h"
+
+#include <linux/hashtable.h>
+
+enum scx_ops_state {
+	SCX_OPS_DISABLED,
+	SCX_OPS_ENABLED,
+	SCX_OPS_DISABLING,
+};
+
+/* Internal scx_dispatch_q.flags */
+#define SCX_DSQ_DEAD		0x80000000
+
+DEFINE_STATIC_KEY_FALSE(__scx_ops_enabled);
+
+static DEFINE_MUTEX(scx_ops_mutex);
+static struct sched_ext_ops *scx_ops;
+static int scx_ops_state = SCX_OPS_DISABLED;
+static bool scx_switch_all;
+static unsigned long scx_watchdog_timeout;
+
+/* Why the scheduler was disabled, set by the first scx_ops_error() */
+static atomic_t scx_exit_pending = ATOMIC_INIT(0);
+static char scx_exit_msg[128];
+
+static struct scx_dispatch_q scx_dsq_global = {
+	.lock	= __RAW_SPIN_LOCK_UNLOCKED(scx_dsq_global.lock),
+	.list	= LIST_HEAD_INIT(scx_dsq_global.list),
+	.id	= SCX_DSQ_GLOBAL,
+};
+
+/* DSQs created by the scheduler, looked up under RCU */
+static DEFINE_HASHTABLE(scx_dsq_hash, 6);
+static DEFINE_RAW_SPINLOCK(scx_dsq_hash_lock);
+
+/* The task ops.enqueue() and the rq ops.dispatch() are called for */
+static DEFINE_PER_CPU(struct task_struct *, scx_enq_task);
+static DEFINE_PER_CPU(struct rq *, scx_dispatch_rq);
+static DEFINE_PER_CPU(struct rq_flags *, scx_dispatch_rf);
+
+static void scx_ops_disable_workfn(struct work_struct *work);
+static DECLARE_WORK(scx_ops_disable_work, scx_ops_disable_workfn);
+
+static void scx_watchdog_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(scx_watchdog_work, scx_watchdog_workfn);
+
+static void scx_ops_error_irq_workfn(struct irq_work *work)
+{
+	schedule_work(&scx_ops_disable_work);
+}
+
+static struct irq_work scx_ops_error_irq_work = {
+	.func	= scx_ops_error_irq_workfn,
+};
+
+static inline bool scx_ops_bypassing(void)
+{
+	return READ_ONCE(scx_ops_state) != SCX_OPS_ENABLED;
+}
+
+bool task_should_scx(struct task_struct *p)
+{
+	if (READ_ONCE(scx_ops_state) != SCX_OPS_ENABLED)
+		return false;
+	if (p->policy == SCHED_EXT)
+		return true;
+	return READ_ONCE(scx_switch_all) &&
+	       (fair_policy(p->policy) || idle_policy(p->policy));
+}
+
+/**
+ * scx_ops_error - Report a scheduler error and unload it
+ * @fmt: format of the reason, printed when the scheduler is unloaded
+ *
+ * May be called from any context, including with rq locks held: the
+ * scheduler is disabled from a work item.
+ */
+void scx_ops_error(const char *fmt, ...)
+{
+	va_list args;
+
+	if (READ_ONCE(scx_ops_state) != SCX_OPS_ENABLED ||
+	    atomic_xchg(&scx_exit_pending, 1))
+		return;
+
+	va_start(args, fmt);
+	vscnprintf(scx_exit_msg, sizeof(scx_exit_msg), fmt, args);
+	va_end(args);
+
+	irq_work_queue(&scx_ops_error_irq_work);
+}
+EXPORT_SYMBOL_GPL(scx_ops_error);
+
+static void scx_kick_workfn(struct irq_work *work)
+{
+	struct rq *rq = container_of(work, struct rq, scx.kick_work);
+
+	resched_cpu(cpu_of(rq));
+}
+
+/**
+ * scx_kick_cpu - Make a CPU go through the scheduler
+ * @cpu: the CPU to kick
+ *
+ * Used to have an idle CPU run ops.dispatch(), usually after queueing a
+ * task on a DSQ it consumes.
+ */
+void scx_kick_cpu(s32 cpu)
+{
+	struct irq_work *work;
+
+	if (cpu < 0 || cpu >= nr_cpu_ids || !cpu_online(cpu))
+		return;
+
+	work = &cpu_rq(cpu)->scx.kick_work;
+	if (cpu == raw_smp_processor_id())
+		irq_work_queue(work);
+	else
+		irq_work_queue_on(work, cpu);
+}
+EXPORT_SYMBOL_GPL(scx_kick_cpu);
+
+/* Wake up an idle CPU that may run @p, now on a shared DSQ */
+static void scx_kick_idle_cpu(struct task_struct *p)
+{
+	int cpu;
+
+	for_each_cpu_wrap(cpu, &p->cpus_allowed, task_cpu(p)) {
+		if (cpu_online(cpu) && available_idle_cpu(cpu)) {
+			scx_kick_cpu(cpu);
+			return;
+		}
+	}
+}
+
+static struct scx_dispatch_q *find_user_dsq(u64 dsq_id)
+{
+	struct scx_dispatch_q *dsq;
+
+	hash_for_each_possible_rcu(scx_dsq_hash, dsq, hash_node, dsq_id)
+		if (dsq->id == dsq_id)
+			return dsq;
+	return NULL;
+}
+
+static void dispatch_enqueue(struct rq *rq, struct scx_dispatch_q *dsq,
+			     struct task_struct *p, u64 enq_flags)
+{
+	bool is_local = dsq == &rq->scx.local_dsq;
+
+	if (!is_local) {
+		raw_spin_lock(&dsq->lock);
+		if (unlikely(dsq->flags & SCX_DSQ_DEAD)) {
+			raw_spin_unlock(&dsq->lock);
+			scx_ops_error("dispatching to destroyed DSQ 0x%llx",
+				      dsq->id);
+			dsq = &scx_dsq_global;
+			raw_spin_lock(&dsq->lock);
+		}
+	}
+
+	if (dsq->flags & SCX_DSQ_VTIME) {
+		struct task_struct *pos;
+
+		/* New tasks tend to have the largest vtime, look from the tail */
+		list_for_each_entry_reverse(pos, &dsq->list, scx.dsq_node)
+			if ((s64)(p->scx.dsq_vtime - pos->scx.dsq_vtime) >= 0)
+				break;
+		list_add(&p->scx.dsq_node, &pos->scx.dsq_node);
+	} else if (enq_flags & SCX_ENQ_HEAD) {
+		list_add(&p->scx.dsq_node, &dsq->list);
+	} else {
+		list_add_tail(&p->scx.dsq_node, &dsq->list);
+	}
+	dsq->nr++;
+	p->scx.dsq = dsq;
+
+	if (!is_local)
+		raw_spin_unlock(&dsq->lock);
+}
+
+static void dispatch_dequeue(struct rq *rq, struct task_struct *p)
+{
+	/* Pairs with the release in consume_dispatch_q() */
+	struct scx_dispatch_q *dsq = smp_load_acquire(&p->scx.dsq);
+	bool is_local = dsq == &rq->scx.local_dsq;
+
+	if (!dsq) {
+		/* A consumer may be moving @p over, tell it to back off */
+		p->scx.holding_cpu = -1;
+		return;
+	}
+
+	if (!is_local)
+		raw_spin_lock(&dsq->lock);
+
+	if (likely(p->scx.dsq == dsq)) {
+		list_del_init(&p->scx.dsq_node);
+		dsq->nr--;
+		p->scx.dsq = NULL;
+	} else {
+		/* Consumed meanwhile */
+		p->scx.holding_cpu = -1;
+	}
+
+	if (!is_local)
+		raw_spin_unlock(&dsq->lock);
+}
+
+static void do_dispatch(struct rq *rq, struct scx_dispatch_q *dsq,
+			struct task_struct *p, u64 enq_flags)
+{
+	dispatch_enqueue(rq, dsq, p, enq_flags);
+
+	if (dsq != &rq->scx.local_dsq) {
+		scx_kick_idle_cpu(p);
+	} else if ((enq_flags & SCX_ENQ_PREEMPT) && rq->curr != p &&
+		   rq->curr->sched_class == &ext_sched_class) {
+		rq->curr->scx.slice = 0;
+		resched_curr(rq);
+	}
+}
+
+static struct scx_dispatch_q *find_dsq_for_dispatch(struct rq *rq, u64 dsq_id,
+						    struct task_struct *p)
+{
+	struct scx_dispatch_q *dsq;
+
+	if (dsq_id == SCX_DSQ_LOCAL)
+		return &rq->scx.local_dsq;
+	if (dsq_id == SCX_DSQ_GLOBAL)
+		return &scx_dsq_global;
+
+	dsq = find_user_dsq(dsq_id);
+	if (unlikely(!dsq)) {
+		scx_ops_error("non-existent DSQ 0x%llx for %s[%d]",
+			      dsq_id, p->comm, p->pid);
+		return &scx_dsq_global;
+	}
+	return dsq;
+}
+
+static bool scx_dispatch_check(struct task_struct *p, const char *func)
+{
+	if (unlikely(__this_cpu_read(scx_enq_task) != p)) {
+		scx_ops_error("%s() of %s[%d] outside of its ops.enqueue()",
+			      func, p->comm, p->pid);
+		return false;
+	}
+	if (unlikely(p->scx.dsq)) {
+		scx_ops_error("%s[%d] dispatched twice", p->comm, p->pid);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * scx_dispatch - Queue a task on a FIFO DSQ
+ * @p: the task, from ops.enqueue()
+ * @dsq_id: SCX_DSQ_LOCAL, SCX_DSQ_GLOBAL or a DSQ made by scx_create_dsq()
+ * @slice: time slice of @p in ns, 0 for SCX_SLICE_DFL
+ * @enq_flags: SCX_ENQ_HEAD to queue at the head, SCX_ENQ_PREEMPT to also
+ *	       preempt the current task when @dsq_id is SCX_DSQ_LOCAL
+ *
+ * Only valid from ops.enqueue(), once per call.
+ */
+void scx_dispatch(struct task_struct *p, u64 dsq_id, u64 slice, u64 enq_flags)
+{
+	struct rq *rq = task_rq(p);
+	struct scx_dispatch_q *dsq;
+
+	if (!scx_dispatch_check(p, "scx_dispatch"))
+		return;
+
+	dsq = find_dsq_for_dispatch(rq, dsq_id, p);
+	if (unlikely(dsq->flags & SCX_DSQ_VTIME)) {
+		scx_ops_error("scx_dispatch() to vtime DSQ 0x%llx", dsq_id);
+		dsq = &scx_dsq_global;
+	}
+
+	p->scx.slice = slice ?: SCX_SLICE_DFL;
+	do_dispatch(rq, dsq, p, enq_flags);
+}
+EXPORT_SYMBOL_GPL(scx_dispatch);
+
+/**
+ * scx_dispatch_vtime - Queue a task on a vtime ordered DSQ
+ * @p: the task, from ops.enqueue()
+ * @dsq_id: a DSQ made by scx_create_dsq() with SCX_DSQ_VTIME
+ * @slice: time slice of @p in ns, 0 for SCX_SLICE_DFL
+ * @vtime: position of @p in the DSQ, tasks with the lowest run first
+ * @enq_flags: SCX_ENQ_* flags
+ *
+ * Only valid from ops.enqueue(), once per call. Comparisons of @vtime are
+ * wrap-safe.
+ */
+void scx_dispatch_vtime(struct task_struct *p, u64 dsq_id, u64 slice,
+			u64 vtime, u64 enq_flags)
+{
+	struct rq *rq = task_rq(p);
+	struct scx_dispatch_q *dsq;
+
+	if (!scx_dispatch_check(p, "scx_dispatch_vtime"))
+		return;
+
+	dsq = find_dsq_for_dispatch(rq, dsq_id, p);
+	if (unlikely(!(dsq->flags & SCX_DSQ_VTIME))) {
+		scx_ops_error("scx_dispatch_vtime() to FIFO DSQ 0x%llx",
+			      dsq_id);
+		dsq = &scx_dsq_global;
+	}
+
+	p->scx.slice = slice ?: SCX_SLICE_DFL;
+	p->scx.dsq_vtime = vtime;
+	do_dispatch(rq, dsq, p, enq_flags);
+}
+EXPORT_SYMBOL_GPL(scx_dispatch_vtime);
+
+static void do_enqueue_task(struct rq *rq, struct task_struct *p, u64 enq_flags)
+{
+	if (unlikely(scx_ops_bypassing()) || !scx_ops->enqueue)
+		goto global;
+
+	__this_cpu_write(scx_enq_task, p);
+	scx_ops->enqueue(p, enq_flags);
+	__this_cpu_write(scx_enq_task, NULL);
+
+	if (p->scx.dsq)
+		return;
+global:
+	p->scx.slice = SCX_SLICE_DFL;
+	do_dispatch(rq, &scx_dsq_global, p, enq_flags);
+}
+
+/*
+ * Move @p, just taken off a DSQ, from @src_rq to @rq. Both rq locks are
+ * needed, so the one of @rq may be dropped: @p is marked with holding_cpu
+ * and only moved if nothing dequeued it meanwhile.
+ */
+static bool move_task_to_local(struct rq *rq, struct rq_flags *rf,
+			       struct task_struct *p, struct rq *src_rq)
+{
+	bool moved = false;
+
+	rq_unpin_lock(rq, rf);
+	double_lock_balance(rq, src_rq);
+
+	if (likely(task_rq(p) == src_rq && task_on_rq_queued(p) &&
+		   p->scx.holding_cpu == cpu_of(rq) &&
+		   !task_running(src_rq, p))) {
+		update_rq_clock(src_rq);
+		p->scx.flags |= SCX_TASK_MOVING;
+		p->on_rq = TASK_ON_RQ_MIGRATING;
+		deactivate_task(src_rq, p, DEQUEUE_NOCLOCK);
+		set_task_cpu(p, cpu_of(rq));
+		moved = true;
+	}
+
+	double_unlock_balance(rq, src_rq);
+
+	if (moved) {
+		activate_task(rq, p, ENQUEUE_NOCLOCK);
+		p->on_rq = TASK_ON_RQ_QUEUED;
+	}
+
+	rq_repin_lock(rq, rf);
+	return moved;
+}
+
+/* Move the first task of @dsq that may run on @rq to its local DSQ */
+static bool consume_dispatch_q(struct rq *rq, struct rq_flags *rf,
+			       struct scx_dispatch_q *dsq)
+{
+	struct task_struct *p;
+	struct rq *src_rq;
+
+	if (list_empty(&dsq->list))
+		return false;
+
+	raw_spin_lock(&dsq->lock);
+
+	list_for_each_entry(p, &dsq->list, scx.dsq_node) {
+		/* Queued on a DSQ, @p cannot change rq before we drop its lock */
+		src_rq = task_rq(p);
+		if (!cpumask_test_cpu(cpu_of(rq), &p->cpus_allowed) ||
+		    task_running(src_rq, p))
+			continue;
+
+		list_del_init(&p->scx.dsq_node);
+		dsq->nr--;
+
+		if (src_rq == rq) {
+			p->scx.dsq = NULL;
+			raw_spin_unlock(&dsq->lock);
+			dispatch_enqueue(rq, &rq->scx.local_dsq, p, 0);
+			return true;
+		}
+
+		p->scx.holding_cpu = cpu_of(rq);
+		smp_store_release(&p->scx.dsq, NULL);
+		raw_spin_unlock(&dsq->lock);
+		return move_task_to_local(rq, rf, p, src_rq);
+	}
+
+	raw_spin_unlock(&dsq->lock);
+	return false;
+}
+
+/**
+ * scx_consume - Move a task of a DSQ to the local DSQ of the current CPU
+ * @dsq_id: SCX_DSQ_GLOBAL or a DSQ made by scx_create_dsq()
+ *
+ * Only valid from ops.dispatch(). Takes the first task of the DSQ allowed
+ * on the CPU and returns whether there was one; the rq lock may have been
+ * dropped meanwhile.
+ */
+bool scx_consume(u64 dsq_id)
+{
+	struct rq *rq = __this_cpu_read(scx_dispatch_rq);
+	struct scx_dispatch_q *dsq;
+
+	if (unlikely(!rq)) {
+		scx_ops_error("scx_consume() outside of ops.dispatch()");
+		return false;
+	}
+
+	if (dsq_id == SCX_DSQ_GLOBAL)
+		dsq = &scx_dsq_global;
+	else if (!(dsq_id & SCX_DSQ_FLAG_BUILTIN))
+		dsq = find_user_dsq(dsq_id);
+	else
+		dsq = NULL;
+
+	if (unlikely(!dsq)) {
+		scx_ops_error("scx_consume() of invalid DSQ 0x%llx", dsq_id);
+		return false;
+	}
+
+	return consume_dispatch_q(rq, __this_cpu_read(scx_dispatch_rf), dsq);
+}
+EXPORT_SYMBOL_GPL(scx_consume);
+
+/**
+ * scx_create_dsq - Create a DSQ
+ * @dsq_id: id of the new DSQ, without SCX_DSQ_FLAG_BUILTIN
+ * @flags: SCX_DSQ_VTIME for a vtime ordered DSQ, 0 for FIFO
+ * @node: NUMA node to allocate it on
+ *
+ * May sleep. Return: 0, -EINVAL, -ENOMEM or -EEXIST.
+ */
+int scx_create_dsq(u64 dsq_id, u32 flags, int node)
+{
+	struct scx_dispatch_q *dsq;
+	unsigned long irqflags;
+	int ret = 0;
+
+	if ((dsq_id & SCX_DSQ_FLAG_BUILTIN) || (flags & ~SCX_DSQ_VTIME))
+		return -EINVAL;
+
+	dsq = kzalloc_node(sizeof(*dsq), GFP_KERNEL, node);
+	if (!dsq)
+		return -ENOMEM;
+
+	raw_spin_lock_init(&dsq->lock);
+	INIT_LIST_HEAD(&dsq->list);
+	dsq->id = dsq_id;
+	dsq->flags = flags;
+
+	raw_spin_lock_irqsave(&scx_dsq_hash_lock, irqflags);
+	if (find_user_dsq(dsq_id))
+		ret = -EEXIST;
+	else
+		hash_add_rcu(scx_dsq_hash, &dsq->hash_node, dsq_id);
+	raw_spin_unlock_irqrestore(&scx_dsq_hash_lock, irqflags);
+
+	if (ret)
+		kfree(dsq);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(scx_create_dsq);
+
+static int __scx_destroy_dsq(u64 dsq_id, bool force)
+{
+	struct scx_dispatch_q *dsq;
+	unsigned long irqflags;
+	int ret = 0;
+
+	raw_spin_lock_irqsave(&scx_dsq_hash_lock, irqflags);
+
+	dsq = find_user_dsq(dsq_id);
+	if (!dsq) {
+		ret = -ENOENT;
+		goto unlock;
+	}
+
+	raw_spin_lock(&dsq->lock);
+	if (dsq->nr && !force) {
+		ret = -EBUSY;
+	} else {
+		dsq->flags |= SCX_DSQ_DEAD;
+		hash_del_rcu(&dsq->hash_node);
+	}
+	raw_spin_unlock(&dsq->lock);
+
+	if (!ret)
+		kfree_rcu(dsq, rcu);
+unlock:
+	raw_spin_unlock_irqrestore(&scx_dsq_hash_lock, irqflags);
+	return ret;
+}
+
+/**
+ * scx_destroy_dsq - Destroy a DSQ made by scx_create_dsq()
+ * @dsq_id: id of the DSQ
+ *
+ * Return: 0, -ENOENT, or -EBUSY if tasks are still queued on it.
+ */
+int scx_destroy_dsq(u64 dsq_id)
+{
+	return __scx_destroy_dsq(dsq_id, false);
+}
+EXPORT_SYMBOL_GPL(scx_destroy_dsq);
+
+static void update_curr_scx(struct rq *rq)
+{
+	struct task_struct *curr = rq->curr;
+	u64 delta_exec;
+	u64 now;
+
+	if (curr->sched_class != &ext_sched_class)
+		return;
+
+	now = rq_clock_task(rq);
+	delta_exec = now - curr->se.exec_start;
+	if (unlikely((s64)delta_exec <= 0))
+		return;
+
+	schedstat_set(curr->se.statistics.exec_max,
+		      max(curr->se.statistics.exec_max, delta_exec));
+
+	curr->se.sum_exec_runtime += delta_exec;
+	account_group_exec_runtime(curr, delta_exec);
+
+	curr->se.exec_start = now;
+	cgroup_account_cputime(curr, delta_exec);
+
+	curr->scx.slice -= min(curr->scx.slice, delta_exec);
+}
+
+static void enqueue_task_scx(struct rq *rq, struct task_struct *p, int flags)
+{
+	p->scx.flags |= SCX_TASK_QUEUED;
+	rq->scx.nr_running++;
+	add_nr_running(rq, 1);
+	list_add_tail(&p->scx.runnable_node, &rq->scx.runnable_list);
+
+	/* Consumed by this CPU, it already waited its turn */
+	if (p->scx.flags & SCX_TASK_MOVING) {
+		p->scx.flags &= ~SCX_TASK_MOVING;
+		p->scx.holding_cpu = -1;
+		dispatch_enqueue(rq, &rq->scx.local_dsq, p, 0);
+		return;
+	}
+
+	p->scx.runnable_at = jiffies;
+	do_enqueue_task(rq, p, flags & ENQUEUE_WAKEUP ? SCX_ENQ_WAKEUP : 0);
+}
+
+static void dequeue_task_scx(struct rq *rq, struct task_struct *p, int flags)
+{
+	if (!(p->scx.flags & SCX_TASK_QUEUED))
+		return;
+
+	if (!(p->scx.flags & SCX_TASK_MOVING)) {
+		dispatch_dequeue(rq, p);
+		if (!scx_ops_bypassing() && scx_ops->dequeue)
+			scx_ops->dequeue(p, flags & DEQUEUE_SLEEP ?
+					 SCX_DEQ_SLEEP : 0);
+	}
+
+	p->scx.flags &= ~SCX_TASK_QUEUED;
+	list_del_init(&p->scx.runnable_node);
+	rq->scx.nr_running--;
+	sub_nr_running(rq, 1);
+}
+
+static void yield_task_scx(struct rq *rq)
+{
+	rq->curr->scx.slice = 0;
+}
+
+static void check_preempt_curr_scx(struct rq *rq, struct task_struct *p,
+				   int wake_flags)
+{
+	/* Preemption within the class is up to the scheduler: SCX_ENQ_PREEMPT */
+}
+
+static void set_next_task_scx(struct rq *rq, struct task_struct *p)
+{
+	dispatch_dequeue(rq, p);
+
+	p->se.exec_start = rq_clock_task(rq);
+	p->scx.flags |= SCX_TASK_RUNNING;
+
+	if (!scx_ops_bypassing() && scx_ops->running)
+		scx_ops->running(p);
+}
+
+static void put_prev_task_scx(struct rq *rq, struct task_struct *p)
+{
+	bool runnable;
+
+	if (!(p->scx.flags & SCX_TASK_RUNNING))
+		return;
+
+	update_curr_scx(rq);
+	p->scx.flags &= ~SCX_TASK_RUNNING;
+
+	runnable = p->scx.flags & SCX_TASK_QUEUED;
+	if (!scx_ops_bypassing() && scx_ops->stopping)
+		scx_ops->stopping(p, runnable);
+
+	if (!runnable)
+		return;
+
+	p->scx.runnable_at = jiffies;
+	list_move_tail(&p->scx.runnable_node, &rq->scx.runnable_list);
+
+	/*
+	 * Preempted by a higher class with slice left: run it again first
+	 * once the CPU comes back, else it is for the scheduler to decide.
+	 */
+	if (p->scx.slice && !scx_ops_bypassing())
+		dispatch_enqueue(rq, &rq->scx.local_dsq, p, SCX_ENQ_HEAD);
+	else
+		do_enqueue_task(rq, p, SCX_ENQ_REQUEUE);
+}
+
+static struct task_struct *first_local_task(struct rq *rq)
+{
+	return list_first_entry_or_null(&rq->scx.local_dsq.list,
+					struct task_struct, scx.dsq_node);
+}
+
+/* The queued task that has waited the longest to run */
+static struct task_struct *first_waiting_task(struct rq *rq)
+{
+	struct task_struct *p;
+
+	list_for_each_entry(p, &rq->scx.runnable_list, scx.runnable_node)
+		if (!(p->scx.flags & SCX_TASK_RUNNING))
+			return p;
+	return NULL;
+}
+
+static struct task_struct *
+pick_next_task_scx(struct rq *rq, struct task_struct *prev, struct rq_flags *rf)
+{
+	struct task_struct *p;
+
+	/* @prev competes with the rest, requeue it before looking */
+	if (prev->sched_class == &ext_sched_class)
+		put_prev_task_scx(rq, prev);
+
+	if (!rq->scx.nr_running)
+		return NULL;
+
+	p = first_local_task(rq);
+	if (!p && unlikely(!rq->online)) {
+		/* Tasks left on an offline rq are picked to be migrated */
+		p = first_waiting_task(rq);
+	} else if (!p) {
+		if (!consume_dispatch_q(rq, rf, &scx_dsq_global) &&
+		    !scx_ops_bypassing() && scx_ops->dispatch &&
+		    cpu_active(cpu_of(rq))) {
+			__this_cpu_write(scx_dispatch_rq, rq);
+			__this_cpu_write(scx_dispatch_rf, rf);
+			scx_ops->dispatch(cpu_of(rq),
+					  prev->sched_class == &ext_sched_class ?
+					  prev : NULL);
+			__this_cpu_write(scx_dispatch_rq, NULL);
+			__this_cpu_write(scx_dispatch_rf, NULL);
+		}
+
+		/* The lock may have been dropped, let higher classes go first */
+		if (unlikely(rq->nr_running != rq->scx.nr_running))
+			return RETRY_TASK;
+
+		p = first_local_task(rq);
+	}
+
+	if (!p)
+		return NULL;
+
+	put_prev_task(rq, prev);
+	set_next_task_scx(rq, p);
+	return p;
+}
+
+static int scx_select_cpu_dfl(struct task_struct *p, int prev_cpu)
+{
+	struct sched_domain *sd;
+	int cpu;
+
+	if (available_idle_cpu(prev_cpu))
+		return prev_cpu;
+
+	rcu_read_lock();
+	sd = rcu_dereference(per_cpu(sd_llc, prev_cpu));
+	if (sd) {
+		for_each_cpu_wrap(cpu, sched_domain_span(sd), prev_cpu) {
+			if (cpumask_test_cpu(cpu, &p->cpus_allowed) &&
+			    available_idle_cpu(cpu)) {
+				prev_cpu = cpu;
+				break;
+			}
+		}
+	}
+	rcu_read_unlock();
+
+	return prev_cpu;
+}
+
+static int
+select_task_rq_scx(struct task_struct *p, int prev_cpu, int sd_flag,
+		   int wake_flags)
+{
+	if (!scx_ops_bypassing() && scx_ops->select_cpu)
+		return scx_ops->select_cpu(p, prev_cpu, wake_flags);
+
+	return scx_select_cpu_dfl(p, prev_cpu);
+}
+
+static void set_curr_task_scx(struct rq *rq)
+{
+	set_next_task_scx(rq, rq->curr);
+}
+
+static void task_tick_scx(struct rq *rq, struct task_struct *curr, int queued)
+{
+	update_curr_scx(rq);
+
+	if (!curr->scx.slice)
+		resched_curr(rq);
+}
+
+static void switched_to_scx(struct rq *rq, struct task_struct *p)
+{
+	if (task_on_rq_queued(p) && rq->curr->sched_class == &idle_sched_class)
+		resched_curr(rq);
+}
+
+static void prio_changed_scx(struct rq *rq, struct task_struct *p, int oldprio)
+{
+}
+
+static unsigned int get_rr_interval_scx(struct rq *rq, struct task_struct *p)
+{
+	return nsecs_to_jiffies(p->scx.slice ?: SCX_SLICE_DFL);
+}
+
+const struct sched_class ext_sched_class = {
+	.next			= &idle_sched_class,
+	.enqueue_task		= enqueue_task_scx,
+	.dequeue_task		= dequeue_task_scx,
+	.yield_task		= yield_task_scx,
+
+	.check_preempt_curr	= check_preempt_curr_scx,
+
+	.pick_next_task		= pick_next_task_scx,
+	.put_prev_task		= put_prev_task_scx,
+
+	.select_task_rq		= select_task_rq_scx,
+	.set_cpus_allowed	= set_cpus_allowed_common,
+
+	.set_curr_task		= set_curr_task_scx,
+	.task_tick		= task_tick_scx,
+
+	.get_rr_interval	= get_rr_interval_scx,
+
+	.prio_changed		= prio_changed_scx,
+	.switched_to		= switched_to_scx,
+
+	.update_curr		= update_curr_scx,
+
+#ifdef CONFIG_UCLAMP_TASK
+	.uclamp_enabled		= 1,
+#endif
+};
+
+/*
+ * Report a queued task that has not run for scx_watchdog_timeout. Tasks
+ * are added at the tail of the runnable list, so each check only needs to
+ * look at the first one that is not running.
+ */
+static void scx_watchdog_workfn(struct work_struct *work)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+		struct task_struct *p;
+		unsigned long flags;
+
+		raw_spin_lock_irqsave(&rq->lock, flags);
+		p = first_waiting_task(rq);
+		if (p && time_after(jiffies, p->scx.runnable_at +
+					     scx_watchdog_timeout))
+			scx_ops_error("%s[%d] stalled for %u ms on CPU %d",
+				      p->comm, p->pid,
+				      jiffies_to_msecs(jiffies - p->scx.runnable_at),
+				      cpu);
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+
+		cond_resched();
+	}
+
+	queue_delayed_work(system_unbound_wq, &scx_watchdog_work,
+			   scx_watchdog_timeout / 2);
+}
+
+static void scx_reclass_all(void)
+{
+	struct task_struct *g, *p;
+
+	read_lock(&tasklist_lock);
+	for_each_process_thread(g, p)
+		sched_ext_reclass_task(p);
+	read_unlock(&tasklist_lock);
+}
+
+static void scx_destroy_all_dsqs(void)
+{
+	struct scx_dispatch_q *dsq;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe(scx_dsq_hash, bkt, tmp, dsq, hash_node)
+		__scx_destroy_dsq(dsq->id, true);
+}
+
+static void scx_ops_disable(const char *reason)
+{
+	lockdep_assert_held(&scx_ops_mutex);
+
+	if (scx_ops_state != SCX_OPS_ENABLED)
+		return;
+
+	/* No more callbacks: enqueues go to the global DSQ from now on */
+	atomic_set(&scx_exit_pending, 1);
+	WRITE_ONCE(scx_ops_state, SCX_OPS_DISABLING);
+
+	cancel_delayed_work_sync(&scx_watchdog_work);
+	scx_reclass_all();
+
+	static_branch_disable(&__scx_ops_enabled);
+	/* Callbacks are only called with an rq or pi_lock held */
+	synchronize_rcu();
+
+	if (scx_ops->exit)
+		scx_ops->exit();
+	scx_destroy_all_dsqs();
+
+	pr_info("sched_ext: \"%s\" disabled: %s\n", scx_ops->name,
+		reason ?: scx_exit_msg);
+
+	scx_ops = NULL;
+	WRITE_ONCE(scx_ops_state, SCX_OPS_DISABLED);
+}
+
+static void scx_ops_disable_workfn(struct work_struct *work)
+{
+	mutex_lock(&scx_ops_mutex);
+	scx_ops_disable(NULL);
+	mutex_unlock(&scx_ops_mutex);
+}
+
+/**
+ * scx_register_ops - Load a sched_ext scheduler
+ * @ops: its callbacks
+ *
+ * Calls @ops->init() and moves the SCHED_EXT tasks, and with
+ * SCX_OPS_SWITCH_ALL also the fair ones, to the class. Only one scheduler
+ * may be loaded at a time.
+ *
+ * Return: 0, -EBUSY if another scheduler is loaded, or the error of
+ * @ops->init().
+ */
+int scx_register_ops(struct sched_ext_ops *ops)
+{
+	unsigned int timeout_ms;
+	int ret = 0;
+
+	mutex_lock(&scx_ops_mutex);
+
+	if (scx_ops) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	if (ops->init) {
+		ret = ops->init();
+		if (ret)
+			goto unlock;
+	}
+
+	timeout_ms = ops->timeout_ms ?: SCX_WATCHDOG_MAX_TIMEOUT;
+	timeout_ms = min_t(unsigned int, timeout_ms, SCX_WATCHDOG_MAX_TIMEOUT);
+	scx_watchdog_timeout = msecs_to_jiffies(timeout_ms);
+
+	scx_ops = ops;
+	WRITE_ONCE(scx_switch_all, ops->flags & SCX_OPS_SWITCH_ALL);
+	scx_exit_msg[0] = '\0';
+	atomic_set(&scx_exit_pending, 0);
+
+	static_branch_enable(&__scx_ops_enabled);
+	WRITE_ONCE(scx_ops_state, SCX_OPS_ENABLED);
+
+	queue_delayed_work(system_unbound_wq, &scx_watchdog_work,
+			   scx_watchdog_timeout / 2);
+	scx_reclass_all();
+
+	pr_info("sched_ext: \"%s\" enabled\n", ops->name);
+unlock:
+	mutex_unlock(&scx_ops_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(scx_register_ops);
+
+/**
+ * scx_unregister_ops - Unload a sched_ext scheduler
+ * @ops: the callbacks passed to scx_register_ops()
+ *
+ * Moves all the tasks back to the fair class. Nothing is done if @ops was
+ * already disabled because of an error.
+ */
+void scx_unregister_ops(struct sched_ext_ops *ops)
+{
+	mutex_lock(&scx_ops_mutex);
+	if (scx_ops == ops)
+		scx_ops_disable("unregistered");
+	mutex_unlock(&scx_ops_mutex);
+
+	/* An error may have queued the disabling, do not let it run late */
+	irq_work_sync(&scx_ops_error_irq_work);
+	flush_work(&scx_ops_disable_work);
+}
+EXPORT_SYMBOL_GPL(scx_unregister_ops);
+
+void init_scx_task(struct task_struct *p)
+{
+	p->scx.dsq = NULL;
+	INIT_LIST_HEAD(&p->scx.dsq_node);
+	INIT_LIST_HEAD(&p->scx.runnable_node);
+	p->scx.runnable_at = jiffies;
+	p->scx.slice = SCX_SLICE_DFL;
+	p->scx.dsq_vtime = 0;
+	p->scx.flags = 0;
+	p->scx.holding_cpu = -1;
+}
+
+void __init init_scx_rq(struct rq *rq)
+{
+	struct scx_dispatch_q *dsq = &rq->scx.local_dsq;
+
+	raw_spin_lock_init(&dsq->lock);
+	INIT_LIST_HEAD(&dsq->list);
+	dsq->id = SCX_DSQ_LOCAL;
+
+	INIT_LIST_HEAD(&rq->scx.runnable_list);
+	init_irq_work(&rq->scx.kick_work, scx_kick_workfn);
+}
@@ -1035,6 +1035,14 @@ unsigned int sysctl_numa_balancing_scan_size = 256;
 /* Scan @scan_size MB every @scan_period after an initial @scan_delay in ms */
 unsigned int sysctl_numa_balancing_scan_delay = 1000;
 
+/*
+ * Memory tiering: a slow memory page is hot, and promoted, if it is
+ * accessed within @hot_threshold ms of being scanned. At most
+ * @promote_rate_limit MB/s are promoted to each node.
+ */
+unsigned int sysctl_numa_balancing_hot_threshold = MSEC_PER_SEC;
+unsigned int sysctl_numa_balancing_promote_rate_limit = 65536;
+
 struct numa_group {
 	atomic_t refcount;
 
@@ -1385,6 +1393,32 @@ static inline unsigned long group_weight(struct task_struct *p, int nid,
 	return 1000 * faults / total_faults;
 }
 
+/* The time between the NUMA scan of @page and this hint fault, in ms */
+static int numa_hint_fault_latency(struct page *page)
+{
+	int last_time, time;
+
+	time = jiffies_to_msecs(jiffies);
+	last_time = xchg_page_access_time(page, time);
+
+	return (time - last_time) & PAGE_ACCESS_TIME_MASK;
+}
+
+/* Has @pgdat taken its share of promotions for this second? */
+static bool numa_promotion_rate_limit(struct pglist_data *pgdat,
+				      unsigned long rate_limit, int nr)
+{
+	unsigned int now, start;
+
+	now = jiffies_to_msecs(jiffies);
+	start = READ_ONCE(pgdat->nbp_rl_start);
+	if (now - start > MSEC_PER_SEC &&
+	    cmpxchg(&pgdat->nbp_rl_start, start, now) == start)
+		atomic_long_set(&pgdat->nbp_rl_nr_cand, 0);
+
+	return atomic_long_add_return(nr, &pgdat->nbp_rl_nr_cand) > rate_limit;
+}
+
 bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 				int src_nid, int dst_cpu)
 {
@@ -1392,6 +1426,25 @@ bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 	int dst_nid = cpu_to_node(dst_cpu);
 	int last_cpupid, this_cpupid;
 
+	/*
+	 * In memory tiering mode, promote the slow memory pages that are
+	 * hot: faulted on soon after being scanned.
+	 */
+	if ((sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING) &&
+	    !node_is_toptier(src_nid)) {
+		struct pglist_data *pgdat = NODE_DATA(dst_nid);
+		unsigned long rate_limit;
+
+		if (numa_hint_fault_latency(page) >=
+		    READ_ONCE(sysctl_numa_balancing_hot_threshold))
+			return false;
+
+		rate_limit = READ_ONCE(sysctl_numa_balancing_promote_rate_limit)
+			     << (20 - PAGE_SHIFT);
+		return !numa_promotion_rate_limit(pgdat, rate_limit,
+						  hpage_nr_pages(page));
+	}
+
 	this_cpupid = cpu_pid_to_cpupid(dst_cpu, current->pid);
 	last_cpupid = page_cpupid_xchg_last(page, this_cpupid);
 
@@ -2362,6 +2415,14 @@ void task_numa_fault(int last_cpupid, int mem_node, int pages, int flags)
 	if (!p->mm)
 		return;
 
+	/*
+	 * In memory tiering mode, the faults on slow memory only drive its
+	 * promotion: they do not tell where the task should run.
+	 */
+	if ((sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING) &&
+	    !node_is_toptier(mem_node))
+		return;
+
 	/* Allocate buffer to track faults on a per-node basis */
 	if (unlikely(!p->numa_faults)) {
 		int size = sizeof(*p->numa_faults) *
@@ -4251,20 +4312,33 @@ static inline u64 sched_cfs_bandwidth_slice(void)
 
 /*
  * Replenish runtime according to assigned quota and update expiration time.
- * We use sched_clock_cpu directly instead of rq->clock to avoid adding
- * additional synchronization around rq->lock.
+ * Runtime left unused in the last period is carried over, up to the burst
+ * limit on top of the quota, so that a group below its average can absorb
+ * a short spike without being throttled. We use sched_clock_cpu directly
+ * instead of rq->clock to avoid adding additional synchronization around
+ * rq->lock.
  *
  * requires cfs_b->lock
  */
 void __refill_cfs_bandwidth_runtime(struct cfs_bandwidth *cfs_b)
 {
+	s64 runtime;
 	u64 now;
 
 	if (cfs_b->quota == RUNTIME_INF)
 		return;
 
 	now = sched_clock_cpu(smp_processor_id());
-	cfs_b->runtime = cfs_b->quota;
+	cfs_b->runtime += cfs_b->quota;
+	/* anything consumed beyond the quota came out of the burst */
+	runtime = cfs_b->runtime_snap - cfs_b->runtime;
+	if (runtime > 0) {
+		cfs_b->burst_time += runtime;
+		cfs_b->nr_burst++;
+	}
+
+	cfs_b->runtime = min(cfs_b->runtime, cfs_b->quota + cfs_b->burst);
+	cfs_b->runtime_snap = cfs_b->runtime;
 	cfs_b->runtime_expires = now + ktime_to_ns(cfs_b->period);
 	cfs_b->expires_seq++;
 }
@@ -4878,6 +4952,7 @@ void init_cfs_bandwidth(struct cfs_bandwidth *cfs_b)
 	cfs_b->runtime = 0;
 	cfs_b->quota = RUNTIME_INF;
 	cfs_b->period = ns_to_ktime(default_cfs_period());
+	cfs_b->burst = 0;
 
 	INIT_LIST_HEAD(&cfs_b->throttled_cfs_rq);
 	hrtimer_init(&cfs_b->period_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_PINNED);
@@ -5963,28 +6038,89 @@ static inline bool test_idle_cores(int cpu, bool def)
  * Since SMT siblings share all cache levels, inspecting this limited remote
  * state should be fairly cheap.
  */
-void __update_idle_core(struct rq *rq)
+static bool is_core_idle(int core)
 {
-	int core = cpu_of(rq);
 	int cpu;
 
-	rcu_read_lock();
-	if (test_idle_cores(core, true))
-		goto unlock;
-
 	for_each_cpu(cpu, cpu_smt_mask(core)) {
 		if (cpu == core)
 			continue;
 
 		if (!available_idle_cpu(cpu))
-			goto unlock;
+			return false;
 	}
 
-	set_idle_cores(core, 1);
+	return true;
+}
+
+/*
+ * Also remember the core in sd_llc_shared->idle_core, so that
+ * select_idle_core() can try it before scanning the LLC. The hint is
+ * dropped again by __clear_idle_core() when a sibling stops idling.
+ */
+void __update_idle_core(struct rq *rq)
+{
+	struct sched_domain_shared *sds;
+	int core = cpu_of(rq);
+
+	rcu_read_lock();
+	sds = rcu_dereference(per_cpu(sd_llc_shared, core));
+	if (!sds)
+		goto unlock;
+	if (READ_ONCE(sds->has_idle_cores) && READ_ONCE(sds->idle_core) >= 0)
+		goto unlock;
+
+	if (!is_core_idle(core))
+		goto unlock;
+
+	WRITE_ONCE(sds->idle_core, core);
+	WRITE_ONCE(sds->has_idle_cores, 1);
 unlock:
 	rcu_read_unlock();
 }
 
+/* Called on idle exit: the core of @rq is no longer idle */
+void __clear_idle_core(struct rq *rq)
+{
+	struct sched_domain_shared *sds;
+	int cpu = cpu_of(rq), core;
+
+	rcu_read_lock();
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (sds) {
+		core = READ_ONCE(sds->idle_core);
+		if (core >= 0 && cpumask_test_cpu(core, cpu_smt_mask(cpu)))
+			WRITE_ONCE(sds->idle_core, -1);
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * The core that last went idle in the LLC of @target, if it still is and
+ * @p may run on it.
+ */
+static int select_idle_core_hint(struct task_struct *p,
+				 struct sched_domain *sd, int target)
+{
+	struct sched_domain_shared *sds;
+	int core;
+
+	sds = rcu_dereference(per_cpu(sd_llc_shared, target));
+	if (!sds)
+		return -1;
+
+	core = READ_ONCE(sds->idle_core);
+	if (core < 0 || !cpumask_test_cpu(core, sched_domain_span(sd)) ||
+	    !cpumask_test_cpu(core, &p->cpus_allowed))
+		return -1;
+
+	if (!available_idle_cpu(core) || !is_core_idle(core))
+		return -1;
+
+	schedstat_inc(this_rq()->sis_core_hint);
+	return core;
+}
+
 /*
  * Scan the entire LLC domain for idle cores; this dynamically switches off if
  * there are no idle cores left in the system; tracked through
@@ -6001,6 +6137,10 @@ static int select_idle_core(struct task_struct *p, struct sched_domain *sd, int
 	if (!test_idle_cores(target, false))
 		return -1;
 
+	core = select_idle_core_hint(p, sd, target);
+	if (core >= 0)
+		return core;
+
 	cpumask_and(cpus, sched_domain_span(sd), &p->cpus_allowed);
 
 	for_each_cpu_wrap(core, cpus, target) {
@@ -6058,6 +6198,30 @@ static inline int select_idle_smt(struct task_struct *p, struct sched_domain *sd
 
 #endif /* CONFIG_SCHED_SMT */
 
+static inline void sis_scan_stat(int nr)
+{
+	schedstat_inc(this_rq()->sis_scan[nr ? min(fls(nr), SIS_SCAN_BUCKETS - 1) : 0]);
+}
+
+/*
+ * Scale the SIS_UTIL scan budget by latency nice: the most latency sensitive
+ * tasks may scan the whole LLC, the most tolerant ones hardly scan at all.
+ * @nr is the budget plus one, the way select_idle_cpu() counts it.
+ */
+static int sis_latency_nr(struct task_struct *p, struct sched_domain *sd, int nr)
+{
+	int latency_nice = p->latency_nice;
+	int scan = nr - 1;
+
+	if (latency_nice < 0 && scan < sd->span_weight)
+		scan += (int)(sd->span_weight - scan) * latency_nice /
+			MIN_LATENCY_NICE;
+	else if (latency_nice > 0)
+		scan -= scan * latency_nice / (MAX_LATENCY_NICE + 1);
+
+	return scan + 1;
+}
+
 /*
  * Scan the LLC domain for idle CPUs; this is dynamically regulated by
  * comparing the average scan cost (tracked in sd->avg_scan_cost) against the
@@ -6065,16 +6229,32 @@ static inline int select_idle_smt(struct task_struct *p, struct sched_domain *sd
  */
 static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int target)
 {
+	struct sched_domain_shared *sd_share;
 	struct sched_domain *this_sd;
 	u64 avg_cost, avg_idle;
 	u64 time, cost;
 	s64 delta;
-	int cpu, nr = INT_MAX;
+	int cpu, nr = INT_MAX, scanned = 0;
 
 	this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
 	if (!this_sd)
 		return -1;
 
+	if (sched_feat(SIS_UTIL)) {
+		sd_share = rcu_dereference(per_cpu(sd_llc_shared, target));
+		if (sd_share) {
+			/* because !--nr is the condition to stop scan */
+			nr = READ_ONCE(sd_share->nr_idle_scan) + 1;
+			if (p->latency_nice)
+				nr = sis_latency_nr(p, sd, nr);
+			/* overloaded LLC is unlikely to have idle cpu/core */
+			if (nr == 1) {
+				sis_scan_stat(0);
+				return -1;
+			}
+		}
+	}
+
 	/*
 	 * Due to large variance we need a large fuzz factor; hackbench in
 	 * particularly is sensitive here.
@@ -6082,27 +6262,33 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	avg_idle = this_rq()->avg_idle / 512;
 	avg_cost = this_sd->avg_scan_cost + 1;
 
-	if (sched_feat(SIS_AVG_CPU) && avg_idle < avg_cost)
+	if (sched_feat(SIS_AVG_CPU) && avg_idle < avg_cost) {
+		sis_scan_stat(0);
 		return -1;
+	}
 
 	if (sched_feat(SIS_PROP)) {
 		u64 span_avg = sd->span_weight * avg_idle;
 		if (span_avg > 4*avg_cost)
-			nr = div_u64(span_avg, avg_cost);
+			nr = min_t(u64, nr, div_u64(span_avg, avg_cost));
 		else
-			nr = 4;
+			nr = min(nr, 4);
 	}
 
 	time = local_clock();
 
 	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
-		if (!--nr)
+		if (!--nr) {
+			sis_scan_stat(scanned);
 			return -1;
+		}
+		scanned++;
 		if (!cpumask_test_cpu(cpu, &p->cpus_allowed))
 			continue;
 		if (available_idle_cpu(cpu))
 			break;
 	}
+	sis_scan_stat(scanned);
 
 	time = local_clock() - time;
 	cost = this_sd->avg_scan_cost;
@@ -6112,6 +6298,43 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	return cpu;
 }
 
+#ifdef CONFIG_SCHED_CLUSTER
+/*
+ * Scan the cluster of @target for an idle CPU before going to the LLC. A
+ * cluster is only a handful of CPUs, so it is scanned in full; while the
+ * LLC still has idle cores, only a CPU of a fully idle core is taken.
+ */
+static int select_idle_cluster(struct task_struct *p, struct sched_domain *sd, int target)
+{
+	bool idle_cores = false;
+	int cpu;
+
+#ifdef CONFIG_SCHED_SMT
+	if (static_branch_likely(&sched_smt_present))
+		idle_cores = test_idle_cores(target, false);
+#endif
+
+	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
+		if (!cpumask_test_cpu(cpu, &p->cpus_allowed))
+			continue;
+		if (!available_idle_cpu(cpu))
+			continue;
+#ifdef CONFIG_SCHED_SMT
+		if (idle_cores && !is_core_idle(cpu))
+			continue;
+#endif
+		return cpu;
+	}
+
+	return -1;
+}
+#else
+static inline int select_idle_cluster(struct task_struct *p, struct sched_domain *sd, int target)
+{
+	return -1;
+}
+#endif /* CONFIG_SCHED_CLUSTER */
+
 /*
  * Try and locate an idle core/thread in the LLC cache domain.
  */
@@ -6144,6 +6367,17 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 		return recent_used_cpu;
 	}
 
+	/*
+	 * Keep communicating tasks within the L2 cluster of @target when
+	 * one of its CPUs is idle.
+	 */
+	sd = rcu_dereference(per_cpu(sd_cluster, target));
+	if (sd) {
+		i = select_idle_cluster(p, sd, target);
+		if ((unsigned)i < nr_cpumask_bits)
+			return i;
+	}
+
 	sd = rcu_dereference(per_cpu(sd_llc, target));
 	if (!sd)
 		return target;
@@ -6489,6 +6723,23 @@ static unsigned long wakeup_gran(struct sched_entity *se)
 	return calc_delta_fair(gran, se);
 }
 
+/*
+ * How much earlier than its vruntime alone says 'se' should preempt 'curr'.
+ *
+ * A negative latency offset on either side is a latency requirement that
+ * is weighed against the other entity; a positive one only says how much
+ * scheduling delay 'se' tolerates.
+ */
+static long wakeup_latency_gran(struct sched_entity *curr, struct sched_entity *se)
+{
+	long latency_offset = se->latency_offset;
+
+	if (latency_offset < 0 || curr->latency_offset < 0)
+		latency_offset -= curr->latency_offset;
+
+	return min_t(long, latency_offset, sysctl_sched_latency);
+}
+
 /*
  * Should 'se' preempt 'curr'.
  *
@@ -6508,6 +6759,8 @@ wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se)
 {
 	s64 gran, vdiff = curr->vruntime - se->vruntime;
 
+	/* Take the latency nice of both entities into account */
+	vdiff -= wakeup_latency_gran(curr, se);
 	if (vdiff <= 0)
 		return -1;
 
@@ -8084,12 +8337,58 @@ static inline enum fbq_type fbq_classify_rq(struct rq *rq)
  * @env: The load balancing environment.
  * @sds: variable to hold the statistics for this sched_domain.
  */
+/*
+ * Update the number of CPUs select_idle_cpu() may scan in the LLC domain
+ * from its utilization. The write to sd_llc_shared is costly, as it is a
+ * shared cache line, so it is only done from periodic load balancing
+ * rather than on CPU_NEWLY_IDLE, which fires a lot more often.
+ */
+static void update_idle_cpu_scan(struct lb_env *env,
+				 unsigned long sum_util)
+{
+	struct sched_domain_shared *sd_share;
+	int llc_weight, pct;
+	u64 x, y, tmp;
+
+	if (!sched_feat(SIS_UTIL) || env->idle == CPU_NEWLY_IDLE)
+		return;
+
+	llc_weight = per_cpu(sd_llc_size, env->dst_cpu);
+	if (env->sd->span_weight != llc_weight)
+		return;
+
+	sd_share = rcu_dereference(per_cpu(sd_llc_shared, env->dst_cpu));
+	if (!sd_share)
+		return;
+
+	/*
+	 * The number of CPUs to scan drops quadratically as the average
+	 * utilization x of the LLC grows, down to none once x reaches
+	 * 100 / imbalance_pct, when the LLC is considered overloaded:
+	 *
+	 *   nr_scan = llc_weight * (1 - x^2 * pct^2 / 10000)
+	 *
+	 * With x scaled by SCHED_CAPACITY_SCALE, x = sum_util / llc_weight.
+	 */
+	x = sum_util / llc_weight;
+	pct = env->sd->imbalance_pct;
+	tmp = x * x * pct * pct;
+	do_div(tmp, 10000 * SCHED_CAPACITY_SCALE);
+	tmp = min_t(unsigned long, tmp, SCHED_CAPACITY_SCALE);
+	y = SCHED_CAPACITY_SCALE - tmp;
+	y *= llc_weight;
+	do_div(y, SCHED_CAPACITY_SCALE);
+	if ((int)y != sd_share->nr_idle_scan)
+		WRITE_ONCE(sd_share->nr_idle_scan, (int)y);
+}
+
 static inline void update_sd_lb_stats(struct lb_env *env, struct sd_lb_stats *sds)
 {
 	struct sched_domain *child = env->sd->child;
 	struct sched_group *sg = env->sd->groups;
 	struct sg_lb_stats *local = &sds->local_stat;
 	struct sg_lb_stats tmp_sgs;
+	unsigned long sum_util = 0;
 	int load_idx;
 	bool overload = false;
 	bool prefer_sibling = child && child->flags & SD_PREFER_SIBLING;
@@ -8148,6 +8447,7 @@ static inline void update_sd_lb_stats(struct lb_env *env, struct sd_lb_stats *sd
 		sds->total_running += sgs->sum_nr_running;
 		sds->total_load += sgs->group_load;
 		sds->total_capacity += sgs->group_capacity;
+		sum_util += sgs->group_util;
 
 		sg = sg->next;
 	} while (sg != env->sd->groups);
@@ -8169,6 +8469,7 @@ static inline void update_sd_lb_stats(struct lb_env *env, struct sd_lb_stats *sd
 		if (READ_ONCE(env->dst_rq->rd->overload) != overload)
 			WRITE_ONCE(env->dst_rq->rd->overload, overload);
 	}
+	update_idle_cpu_scan(env, sum_util);
 }
 
 /**
@@ -10208,6 +10509,34 @@ int sched_group_set_shares(struct task_group *tg, unsigned long shares)
 		rq_unlock_irqrestore(rq, &rf);
 	}
 
+done:
+	mutex_unlock(&shares_mutex);
+	return 0;
+}
+
+int sched_group_set_latency(struct task_group *tg, int latency_nice)
+{
+	long latency_offset;
+	int i;
+
+	/*
+	 * We can't change the latency nice of the root cgroup.
+	 */
+	if (!tg->se[0])
+		return -EINVAL;
+
+	if (latency_nice < MIN_LATENCY_NICE || latency_nice > MAX_LATENCY_NICE)
+		return -ERANGE;
+
+	mutex_lock(&shares_mutex);
+	if (tg->latency_nice == latency_nice)
+		goto done;
+
+	tg->latency_nice = latency_nice;
+	latency_offset = latency_nice_to_offset(latency_nice);
+	for_each_possible_cpu(i)
+		WRITE_ONCE(tg->se[i]->latency_offset, latency_offset);
+
 done:
 	mutex_unlock(&shares_mutex);
 	return 0;
@@ -10247,7 +10576,11 @@ static unsigned int get_rr_interval_fair(struct rq *rq, struct task_struct *task
  * All the scheduling class methods:
  */
 const struct sched_class fair_sched_class = {
+#ifdef CONFIG_SCHED_EXT
+	.next			= &ext_sched_class,
+#else
 	.next			= &idle_sched_class,
+#endif
 	.enqueue_task		= enqueue_task_fair,
 	.dequeue_task		= dequeue_task_fair,
 	.yield_task		= yield_task_fair,
@@ -10284,6 +10617,10 @@ const struct sched_class fair_sched_class = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	.task_change_group	= task_change_group_fair,
 #endif
+
+#ifdef CONFIG_UCLAMP_TASK
+	.uclamp_enabled		= 1,
+#endif
 };
 
 #ifdef CONFIG_SCHED_DEBUG
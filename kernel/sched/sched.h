@@ -157,9 +157,15 @@ static inline int idle_policy(int policy)
 {
 	return policy == SCHED_IDLE;
 }
+static inline int ext_policy(int policy)
+{
+	return IS_ENABLED(CONFIG_SCHED_EXT) && policy == SCHED_EXT;
+}
+
 static inline int fair_policy(int policy)
 {
-	return policy == SCHED_NORMAL || policy == SCHED_BATCH;
+	return policy == SCHED_NORMAL || policy == SCHED_BATCH ||
+	       ext_policy(policy);
 }
 
 static inline int rt_policy(int policy)
@@ -334,6 +340,8 @@ struct cfs_bandwidth {
 	ktime_t			period;
 	u64			quota;
 	u64			runtime;
+	u64			burst;
+	u64			runtime_snap;
 	s64			hierarchical_quota;
 	u64			runtime_expires;
 	int			expires_seq;
@@ -348,6 +356,8 @@ struct cfs_bandwidth {
 	int			nr_periods;
 	int			nr_throttled;
 	u64			throttled_time;
+	int			nr_burst;
+	u64			burst_time;
 
 	bool                    distribute_running;
 #endif
@@ -363,6 +373,7 @@ struct task_group {
 	/* runqueue "owned" by this group on each CPU */
 	struct cfs_rq		**cfs_rq;
 	unsigned long		shares;
+	int			latency_nice;
 
 #ifdef	CONFIG_SMP
 	/*
@@ -393,6 +404,20 @@ struct task_group {
 #endif
 
 	struct cfs_bandwidth	cfs_bandwidth;
+
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+	/* The two decimal precision [%] value requested from user-space */
+	unsigned int		uclamp_pct[UCLAMP_CNT];
+	/* Clamp values requested for a task group */
+	struct uclamp_se	uclamp_req[UCLAMP_CNT];
+	/* Effective clamp values used for a task group */
+	struct uclamp_se	uclamp[UCLAMP_CNT];
+#endif
+
+#ifdef CONFIG_SCHED_INFO
+	/* Run queue latencies of the tasks of the group, see stats.c */
+	struct sched_lat_hist __percpu *lat_hist;
+#endif
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -460,8 +485,23 @@ extern void sched_offline_group(struct task_group *tg);
 
 extern void sched_move_task(struct task_struct *tsk);
 
+#ifdef CONFIG_SCHED_INFO
+extern int sched_lat_alloc(struct task_group *tg);
+extern void sched_lat_free(struct task_group *tg);
+extern int sched_lat_stat_show(struct seq_file *sf, struct task_group *tg);
+#else
+static inline int sched_lat_alloc(struct task_group *tg) { return 0; }
+static inline void sched_lat_free(struct task_group *tg) { }
+static inline int sched_lat_stat_show(struct seq_file *sf,
+				      struct task_group *tg)
+{
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 extern int sched_group_set_shares(struct task_group *tg, unsigned long shares);
+extern int sched_group_set_latency(struct task_group *tg, int latency_nice);
 
 #ifdef CONFIG_SMP
 extern void set_task_rq_fair(struct sched_entity *se,
@@ -678,6 +718,17 @@ struct dl_rq {
 	u64			bw_ratio;
 };
 
+#ifdef CONFIG_SCHED_EXT
+/* sched_ext related fields in a runqueue */
+struct scx_rq {
+	struct scx_dispatch_q	local_dsq;
+	/* Queued tasks, the one that waited longest to run first: */
+	struct list_head	runnable_list;
+	unsigned int		nr_running;
+	struct irq_work		kick_work;
+};
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 /* An entity is a task if it doesn't "own" a runqueue */
 #define entity_is_task(se)	(!se->my_q)
@@ -772,6 +823,69 @@ extern void rto_push_irq_work_func(struct irq_work *work);
 #endif
 #endif /* CONFIG_SMP */
 
+/*
+ * select_idle_cpu() scan lengths are counted in log2 buckets: none, 1,
+ * 2-3, 4-7, ..., and 64 or more CPUs.
+ */
+#define SIS_SCAN_BUCKETS	8
+
+#ifdef CONFIG_SCHED_INFO
+/*
+ * Run queue latencies, from a task being queued to it running, are counted
+ * in log2 buckets of usecs: less than 1, 1, 2-3, 4-7, ..., and 2^22 (about
+ * 4 seconds) or more.
+ */
+#define SCHED_LAT_BUCKETS	24
+
+struct sched_lat_hist {
+	u64			count[SCHED_LAT_BUCKETS];
+	/* sum of the latencies, in nsecs */
+	u64			total;
+};
+#endif
+
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * struct uclamp_bucket - Utilization clamp bucket
+ * @value: utilization clamp value for tasks on this clamp bucket
+ * @tasks: number of RUNNABLE tasks on this clamp bucket
+ *
+ * Keep track of how many tasks are RUNNABLE for a given utilization
+ * clamp value.
+ */
+struct uclamp_bucket {
+	unsigned long value : 11;
+	unsigned long tasks : BITS_PER_LONG - 11;
+};
+
+/*
+ * struct uclamp_rq - rq's utilization clamp
+ * @value: currently active clamp values for a rq
+ * @bucket: utilization clamp buckets affecting a rq
+ *
+ * Keep track of RUNNABLE tasks on a rq to aggregate their clamp values.
+ * A clamp value is affecting a rq when there is at least one task RUNNABLE
+ * (or actually running) with that value.
+ *
+ * There are up to UCLAMP_CNT possible different clamp values, currently there
+ * are only two: minimum utilization and maximum utilization.
+ *
+ * All utilization clamping values are MAX aggregated, since:
+ * - for util_min: we want to run the CPU at least at the max of the minimum
+ *   utilization required by its currently RUNNABLE tasks.
+ * - for util_max: we want to allow the CPU to run up to the max of the
+ *   maximum utilization allowed by its currently RUNNABLE tasks.
+ *
+ * Since on each system we expect only a limited number of different
+ * utilization clamp values (UCLAMP_BUCKETS), use a simple array to track
+ * the metrics required to compute all the per-rq utilization clamp values.
+ */
+struct uclamp_rq {
+	unsigned int value;
+	struct uclamp_bucket bucket[UCLAMP_BUCKETS];
+};
+#endif /* CONFIG_UCLAMP_TASK */
+
 /*
  * This is the main, per-CPU runqueue data structure.
  *
@@ -810,9 +924,19 @@ struct rq {
 	unsigned long		nr_load_updates;
 	u64			nr_switches;
 
+#ifdef CONFIG_UCLAMP_TASK
+	/* Utilization clamp values based on CPU's RUNNABLE tasks */
+	struct uclamp_rq	uclamp[UCLAMP_CNT] ____cacheline_aligned;
+	unsigned int		uclamp_flags;
+#define UCLAMP_FLAG_IDLE 0x01
+#endif
+
 	struct cfs_rq		cfs;
 	struct rt_rq		rt;
 	struct dl_rq		dl;
+#ifdef CONFIG_SCHED_EXT
+	struct scx_rq		scx;
+#endif
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this CPU: */
@@ -914,6 +1038,10 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int		ttwu_count;
 	unsigned int		ttwu_local;
+
+	/* select_idle_sibling() stats */
+	unsigned int		sis_core_hint;
+	unsigned int		sis_scan[SIS_SCAN_BUCKETS];
 #endif
 
 #ifdef CONFIG_SMP
@@ -938,6 +1066,7 @@ static inline int cpu_of(struct rq *rq)
 
 #ifdef CONFIG_SCHED_SMT
 extern void __update_idle_core(struct rq *rq);
+extern void __clear_idle_core(struct rq *rq);
 
 static inline void update_idle_core(struct rq *rq)
 {
@@ -945,8 +1074,15 @@ static inline void update_idle_core(struct rq *rq)
 		__update_idle_core(rq);
 }
 
+static inline void clear_idle_core(struct rq *rq)
+{
+	if (static_branch_unlikely(&sched_smt_present))
+		__clear_idle_core(rq);
+}
+
 #else
 static inline void update_idle_core(struct rq *rq) { }
+static inline void clear_idle_core(struct rq *rq) { }
 #endif
 
 DECLARE_PER_CPU_SHARED_ALIGNED(struct rq, runqueues);
@@ -1284,6 +1420,7 @@ DECLARE_PER_CPU(struct sched_domain *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
 DECLARE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
+DECLARE_PER_CPU(struct sched_domain *, sd_cluster);
 DECLARE_PER_CPU(struct sched_domain *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain *, sd_asym);
 extern struct static_key_false sched_asym_cpucapacity;
@@ -1562,6 +1699,15 @@ static inline int task_on_rq_migrating(struct task_struct *p)
 extern const int		sched_prio_to_weight[40];
 extern const u32		sched_prio_to_wmult[40];
 
+/*
+ * Latency nice maps linearly onto a wakeup preemption bias of at most half
+ * of sysctl_sched_latency either way; negative means preempt sooner.
+ */
+static inline long latency_nice_to_offset(int latency_nice)
+{
+	return (long)sysctl_sched_latency * latency_nice / LATENCY_NICE_WIDTH;
+}
+
 /*
  * {de,en}queue flags:
  *
@@ -1604,6 +1750,10 @@ extern const u32		sched_prio_to_wmult[40];
 struct sched_class {
 	const struct sched_class *next;
 
+#ifdef CONFIG_UCLAMP_TASK
+	int uclamp_enabled;
+#endif
+
 	void (*enqueue_task) (struct rq *rq, struct task_struct *p, int flags);
 	void (*dequeue_task) (struct rq *rq, struct task_struct *p, int flags);
 	void (*yield_task)   (struct rq *rq);
@@ -1687,8 +1837,35 @@ extern const struct sched_class stop_sched_class;
 extern const struct sched_class dl_sched_class;
 extern const struct sched_class rt_sched_class;
 extern const struct sched_class fair_sched_class;
+extern const struct sched_class ext_sched_class;
 extern const struct sched_class idle_sched_class;
 
+#ifdef CONFIG_SCHED_EXT
+DECLARE_STATIC_KEY_FALSE(__scx_ops_enabled);
+#define scx_enabled()		static_branch_unlikely(&__scx_ops_enabled)
+
+extern bool task_should_scx(struct task_struct *p);
+extern void init_scx_rq(struct rq *rq);
+extern void init_scx_task(struct task_struct *p);
+extern void sched_ext_reclass_task(struct task_struct *p);
+#else
+#define scx_enabled()		false
+
+static inline bool task_should_scx(struct task_struct *p) { return false; }
+static inline void init_scx_rq(struct rq *rq) { }
+static inline void init_scx_task(struct task_struct *p) { }
+#endif
+
+/*
+ * The class a task of a fair policy runs in: ext_sched_class when a
+ * sched_ext scheduler takes it, fair_sched_class otherwise.
+ */
+static inline const struct sched_class *normal_sched_class(struct task_struct *p)
+{
+	if (task_should_scx(p))
+		return &ext_sched_class;
+	return &fair_sched_class;
+}
 
 #ifdef CONFIG_SMP
 
@@ -2235,6 +2412,30 @@ static inline unsigned long cpu_util_rt(struct rq *rq)
 }
 #endif
 
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * Clamp @util within the max aggregated clamps of the RUNNABLE tasks of
+ * @rq. Those may be inverted, when tasks with different clamps share the
+ * CPU: the boost wins then.
+ */
+static __always_inline
+unsigned long uclamp_util(struct rq *rq, unsigned long util)
+{
+	unsigned long min_util = READ_ONCE(rq->uclamp[UCLAMP_MIN].value);
+	unsigned long max_util = READ_ONCE(rq->uclamp[UCLAMP_MAX].value);
+
+	if (unlikely(min_util >= max_util))
+		return min_util;
+
+	return clamp(util, min_util, max_util);
+}
+#else /* CONFIG_UCLAMP_TASK */
+static inline unsigned long uclamp_util(struct rq *rq, unsigned long util)
+{
+	return util;
+}
+#endif /* CONFIG_UCLAMP_TASK */
+
 #ifdef CONFIG_HAVE_SCHED_AVG_IRQ
 static inline unsigned long cpu_util_irq(struct rq *rq)
 {
@@ -2262,3 +2463,61 @@ unsigned long scale_irq_capacity(unsigned long util, unsigned long irq, unsigned
 	return util;
 }
 #endif
+
+#ifdef CONFIG_SCHED_MM_CID
+static inline int __mm_cid_get(struct mm_struct *mm)
+{
+	struct cpumask *cpumask;
+	int cid;
+
+	cpumask = mm_cidmask(mm);
+	cid = cpumask_next_zero(-1, cpumask);
+	if (cid >= nr_cpu_ids)
+		return -1;
+	__cpumask_set_cpu(cid, cpumask);
+	return cid;
+}
+
+static inline void mm_cid_put(struct mm_struct *mm, int cid)
+{
+	lockdep_assert_irqs_disabled();
+	if (cid < 0)
+		return;
+	raw_spin_lock(&mm->cid_lock);
+	__cpumask_clear_cpu(cid, mm_cidmask(mm));
+	raw_spin_unlock(&mm->cid_lock);
+}
+
+static inline int mm_cid_get(struct mm_struct *mm)
+{
+	int ret;
+
+	lockdep_assert_irqs_disabled();
+	raw_spin_lock(&mm->cid_lock);
+	ret = __mm_cid_get(mm);
+	raw_spin_unlock(&mm->cid_lock);
+	return ret;
+}
+
+static inline void switch_mm_cid(struct task_struct *prev, struct task_struct *next)
+{
+	if (prev->mm_cid_active) {
+		if (next->mm_cid_active && next->mm == prev->mm) {
+			/*
+			 * Context switch between threads in same mm, hand over
+			 * the mm_cid from prev to next.
+			 */
+			next->mm_cid = prev->mm_cid;
+			prev->mm_cid = -1;
+			return;
+		}
+		mm_cid_put(prev->mm, prev->mm_cid);
+		prev->mm_cid = -1;
+	}
+	if (next->mm_cid_active)
+		next->mm_cid = mm_cid_get(next->mm);
+}
+
+#else
+static inline void switch_mm_cid(struct task_struct *prev, struct task_struct *next) { }
+#endif
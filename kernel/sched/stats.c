@@ -4,17 +4,89 @@
  */
 #include "sched.h"
 
+#if defined(CONFIG_SCHED_INFO) && defined(CONFIG_CGROUP_SCHED)
+/*
+ * Run queue latency histograms of the task groups, from the time a task is
+ * queued, by a wakeup or after being preempted, to the time it runs. They
+ * are per-CPU and only of the tasks of each group itself, so the cost on
+ * every context switch is a bucket increment; the hierarchical sums are
+ * computed when cpu.latency.stat is read.
+ */
+void sched_lat_account(struct task_struct *t, u64 delta)
+{
+	struct task_group *tg = task_group(t);
+	struct sched_lat_hist *hist;
+	u64 usecs = div_u64(delta, NSEC_PER_USEC);
+
+	/* autogroups are not in the hierarchy, account them to the root */
+	if (task_group_is_autogroup(tg))
+		tg = &root_task_group;
+
+	hist = this_cpu_ptr(tg->lat_hist);
+	hist->count[usecs ? min(fls64(usecs), SCHED_LAT_BUCKETS - 1) : 0]++;
+	hist->total += delta;
+}
+
+int sched_lat_alloc(struct task_group *tg)
+{
+	tg->lat_hist = alloc_percpu(struct sched_lat_hist);
+	if (!tg->lat_hist)
+		return -ENOMEM;
+
+	return 0;
+}
+
+void sched_lat_free(struct task_group *tg)
+{
+	free_percpu(tg->lat_hist);
+}
+
+int sched_lat_stat_show(struct seq_file *sf, struct task_group *tg)
+{
+	struct cgroup_subsys_state *pos;
+	struct sched_lat_hist *hist;
+	u64 count[SCHED_LAT_BUCKETS] = { };
+	u64 total = 0, nr = 0;
+	int cpu, i;
+
+	rcu_read_lock();
+	css_for_each_descendant_pre(pos, &tg->css) {
+		struct task_group *child;
+
+		child = container_of(pos, struct task_group, css);
+		for_each_possible_cpu(cpu) {
+			hist = per_cpu_ptr(child->lat_hist, cpu);
+			for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+				count[i] += READ_ONCE(hist->count[i]);
+			total += READ_ONCE(hist->total);
+		}
+	}
+	rcu_read_unlock();
+
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+		nr += count[i];
+
+	seq_printf(sf, "nr_latencies %llu\n", nr);
+	seq_printf(sf, "total_usec %llu\n", div_u64(total, NSEC_PER_USEC));
+	for (i = 0; i < SCHED_LAT_BUCKETS - 1; i++)
+		seq_printf(sf, "lt_%lluus %llu\n", 1ULL << i, count[i]);
+	seq_printf(sf, "ge_%lluus %llu\n", 1ULL << (i - 1), count[i]);
+
+	return 0;
+}
+#endif
+
 /*
  * Current schedstat API version.
  *
  * Bump this up when changing the output format or the meaning of an existing
  * format, so that tools can adapt (or abort)
  */
-#define SCHEDSTAT_VERSION 15
+#define SCHEDSTAT_VERSION 16
 
 static int show_schedstat(struct seq_file *seq, void *v)
 {
-	int cpu;
+	int cpu, i;
 
 	if (v == (void *)1) {
 		seq_printf(seq, "version %d\n", SCHEDSTAT_VERSION);
@@ -37,6 +109,11 @@ static int show_schedstat(struct seq_file *seq, void *v)
 		    rq->rq_cpu_time,
 		    rq->rq_sched_info.run_delay, rq->rq_sched_info.pcount);
 
+		/* select_idle_sibling() stats */
+		seq_printf(seq, " %u", rq->sis_core_hint);
+		for (i = 0; i < SIS_SCAN_BUCKETS; i++)
+			seq_printf(seq, " %u", rq->sis_scan[i]);
+
 		seq_printf(seq, "\n");
 
 #ifdef CONFIG_SMP
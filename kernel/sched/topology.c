@@ -396,6 +396,7 @@ DEFINE_PER_CPU(struct sched_domain *, sd_llc);
 DEFINE_PER_CPU(int, sd_llc_size);
 DEFINE_PER_CPU(int, sd_llc_id);
 DEFINE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
+DEFINE_PER_CPU(struct sched_domain *, sd_cluster);
 DEFINE_PER_CPU(struct sched_domain *, sd_numa);
 DEFINE_PER_CPU(struct sched_domain *, sd_asym);
 DEFINE_STATIC_KEY_FALSE(sched_asym_cpucapacity);
@@ -419,6 +420,16 @@ static void update_top_cache_domain(int cpu)
 	per_cpu(sd_llc_id, cpu) = id;
 	rcu_assign_pointer(per_cpu(sd_llc_shared, cpu), sds);
 
+	/*
+	 * A cluster is a cache sharing level below the LLC that is not the
+	 * SMT one; it only survives degeneration if it is narrower than both.
+	 */
+	if (sd)
+		sd = sd->child;
+	if (sd && (sd->flags & SD_SHARE_CPUCAPACITY))
+		sd = NULL;
+	rcu_assign_pointer(per_cpu(sd_cluster, cpu), sd);
+
 	sd = lowest_flag_domain(cpu, SD_NUMA);
 	rcu_assign_pointer(per_cpu(sd_numa, cpu), sd);
 
@@ -763,6 +774,7 @@ build_overlap_sched_groups(struct sched_domain *sd, int cpu)
  * topology features. By default (default_topology[]) these include:
  *
  *  - Simultaneous multithreading (SMT)
+ *  - Cluster of cores sharing an L2 (CLS)
  *  - Multi-Core Cache (MC)
  *  - Package (DIE)
  *
@@ -1200,6 +1212,8 @@ sd_init(struct sched_domain_topology_level *tl,
 		sd->shared = *per_cpu_ptr(sdd->sds, sd_id);
 		atomic_inc(&sd->shared->ref);
 		atomic_set(&sd->shared->nr_busy_cpus, sd_weight);
+		sd->shared->idle_core = -1;
+		sd->shared->nr_idle_scan = sd_weight;
 	}
 
 	sd->private = sdd;
@@ -1214,6 +1228,9 @@ static struct sched_domain_topology_level default_topology[] = {
 #ifdef CONFIG_SCHED_SMT
 	{ cpu_smt_mask, cpu_smt_flags, SD_INIT_NAME(SMT) },
 #endif
+#ifdef CONFIG_SCHED_CLUSTER
+	{ cpu_clustergroup_mask, cpu_cluster_flags, SD_INIT_NAME(CLS) },
+#endif
 #ifdef CONFIG_SCHED_MC
 	{ cpu_coregroup_mask, cpu_core_flags, SD_INIT_NAME(MC) },
 #endif
@@ -48,6 +48,7 @@
 #include <linux/kprobes.h>
 #include <linux/user_namespace.h>
 #include <linux/binfmts.h>
+#include <linux/ksm.h>
 
 #include <linux/sched.h>
 #include <linux/sched/autogroup.h>
@@ -2444,6 +2445,45 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			clear_bit(MMF_DISABLE_THP, &me->mm->flags);
 		up_write(&me->mm->mmap_sem);
 		break;
+#ifdef CONFIG_KSM
+	case PR_SET_MEMORY_MERGE:
+		if (arg3 || arg4 || arg5)
+			return -EINVAL;
+		if (!capable(CAP_SYS_RESOURCE))
+			return -EPERM;
+		if (down_write_killable(&me->mm->mmap_sem))
+			return -EINTR;
+		if (arg2)
+			error = ksm_enable_merge_any(me->mm);
+		else
+			error = ksm_disable_merge_any(me->mm);
+		vma_write_unlock_mm(me->mm);
+		up_write(&me->mm->mmap_sem);
+		break;
+	case PR_GET_MEMORY_MERGE:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = !!test_bit(MMF_VM_MERGE_ANY, &me->mm->flags);
+		break;
+#endif
+#ifdef CONFIG_FORK_SHARE_PTE
+	case PR_SET_FORK_SHARE_PTE:
+		if (arg3 || arg4 || arg5)
+			return -EINVAL;
+		/* Processes sharing a table serialize on its own lock */
+		if (!USE_SPLIT_PTE_PTLOCKS)
+			return -EINVAL;
+		if (arg2)
+			set_bit(MMF_FORK_SHARE_PTE, &me->mm->flags);
+		else
+			clear_bit(MMF_FORK_SHARE_PTE, &me->mm->flags);
+		break;
+	case PR_GET_FORK_SHARE_PTE:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = !!test_bit(MMF_FORK_SHARE_PTE, &me->mm->flags);
+		break;
+#endif
 	case PR_MPX_ENABLE_MANAGEMENT:
 		if (arg2 || arg3 || arg4 || arg5)
 			return -EINVAL;
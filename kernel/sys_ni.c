@@ -47,6 +47,11 @@ COND_SYSCALL(io_pgetevents);
 COND_SYSCALL_COMPAT(io_getevents);
 COND_SYSCALL_COMPAT(io_pgetevents);
 
+/* fs/io_uring.c */
+COND_SYSCALL(io_uring_setup);
+COND_SYSCALL(io_uring_enter);
+COND_SYSCALL(io_uring_register);
+
 /* fs/xattr.c */
 
 /* fs/dcache.c */
@@ -136,6 +141,7 @@ COND_SYSCALL(capset);
 /* kernel/futex.c */
 COND_SYSCALL(futex);
 COND_SYSCALL_COMPAT(futex);
+COND_SYSCALL(futex_waitv);
 COND_SYSCALL(set_robust_list);
 COND_SYSCALL_COMPAT(set_robust_list);
 COND_SYSCALL(get_robust_list);
@@ -269,6 +275,8 @@ COND_SYSCALL(mlockall);
 COND_SYSCALL(munlockall);
 COND_SYSCALL(mincore);
 COND_SYSCALL(madvise);
+COND_SYSCALL(process_madvise);
+COND_SYSCALL_COMPAT(process_madvise);
 COND_SYSCALL(remap_file_pages);
 COND_SYSCALL(mbind);
 COND_SYSCALL_COMPAT(mbind);
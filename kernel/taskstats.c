@@ -561,6 +561,58 @@ static int taskstats_user_cmd(struct sk_buff *skb, struct genl_info *info)
 		return -EINVAL;
 }
 
+/*
+ * Dump the stats of every task in the caller's pid namespace, one
+ * TASKSTATS_TYPE_AGGR_PID record per task, so that a monitor can sample
+ * all tasks with a single request instead of one request (or several
+ * /proc files) per task.  cb->args[0] holds the next pid to look at.
+ */
+static int taskstats_user_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct pid_namespace *ns = task_active_pid_ns(current);
+	struct task_struct *tsk;
+	struct taskstats *stats;
+	struct pid *pid;
+	void *reply;
+	int nr = cb->args[0];
+
+	for (;; nr++) {
+		rcu_read_lock();
+		pid = find_ge_pid(nr, ns);
+		if (!pid) {
+			rcu_read_unlock();
+			break;
+		}
+		nr = pid_nr_ns(pid, ns);
+		tsk = pid_task(pid, PIDTYPE_PID);
+		if (tsk)
+			get_task_struct(tsk);
+		rcu_read_unlock();
+		if (!tsk)
+			continue;
+
+		reply = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+				    cb->nlh->nlmsg_seq, &family, NLM_F_MULTI,
+				    TASKSTATS_CMD_NEW);
+		if (!reply) {
+			put_task_struct(tsk);
+			break;
+		}
+		stats = mk_reply(skb, TASKSTATS_TYPE_PID, nr);
+		if (!stats) {
+			genlmsg_cancel(skb, reply);
+			put_task_struct(tsk);
+			break;
+		}
+		fill_stats(current_user_ns(), ns, tsk, stats);
+		put_task_struct(tsk);
+		genlmsg_end(skb, reply);
+	}
+
+	cb->args[0] = nr;
+	return skb->len;
+}
+
 static struct taskstats *taskstats_tgid_alloc(struct task_struct *tsk)
 {
 	struct signal_struct *sig = tsk->signal;
@@ -650,6 +702,7 @@ static const struct genl_ops taskstats_ops[] = {
 	{
 		.cmd		= TASKSTATS_CMD_GET,
 		.doit		= taskstats_user_cmd,
+		.dumpit		= taskstats_user_dump,
 		.policy		= taskstats_cmd_get_policy,
 		.flags		= GENL_ADMIN_PERM,
 	},
@@ -1569,7 +1569,7 @@ static int ftrace_cmp_recs(const void *a, const void *b)
  * that is either a NOP or call to the function tracer. It checks the ftrace
  * internal tables to determine if the address belongs or not.
  */
-unsigned long ftrace_location_range(unsigned long start, unsigned long end)
+static struct dyn_ftrace *lookup_rec(unsigned long start, unsigned long end)
 {
 	struct ftrace_page *pg;
 	struct dyn_ftrace *rec;
@@ -1586,9 +1586,20 @@ unsigned long ftrace_location_range(unsigned long start, unsigned long end)
 			      sizeof(struct dyn_ftrace),
 			      ftrace_cmp_recs);
 		if (rec)
-			return rec->ip;
+			return rec;
 	}
 
+	return NULL;
+}
+
+unsigned long ftrace_location_range(unsigned long start, unsigned long end)
+{
+	struct dyn_ftrace *rec;
+
+	rec = lookup_rec(start, end);
+	if (rec)
+		return rec->ip;
+
 	return 0;
 }
 
@@ -5615,12 +5626,6 @@ struct ftrace_mod_map {
 	unsigned int		num_funcs;
 };
 
-#ifdef CONFIG_MODULES
-
-#define next_to_ftrace_page(p) container_of(p, struct ftrace_page, next)
-
-static LIST_HEAD(ftrace_mod_maps);
-
 static int referenced_filters(struct dyn_ftrace *rec)
 {
 	struct ftrace_ops *ops;
@@ -5634,6 +5639,79 @@ static int referenced_filters(struct dyn_ftrace *rec)
 	return cnt;
 }
 
+/**
+ * ftrace_reserve_location - take a traced location over from ftrace
+ * @ip: the ftrace location, as returned by ftrace_location()
+ *
+ * Lets the caller patch the NOP at @ip itself, for instance into a call to
+ * a BPF trampoline: ftrace leaves the location alone, and ignores it when
+ * enabling tracers, until ftrace_release_location() is called, with the NOP
+ * put back in place.
+ *
+ * Returns 0 on success, -EINVAL if @ip isn't an ftrace location, and -EBUSY
+ * if it is in use, by a tracer or by another reservation.
+ */
+int ftrace_reserve_location(unsigned long ip)
+{
+	struct dyn_ftrace *rec;
+	int ret = -EINVAL;
+
+	mutex_lock(&ftrace_lock);
+	rec = lookup_rec(ip, ip);
+	if (rec && rec->ip == ip) {
+		ret = -EBUSY;
+		if (!ftrace_rec_count(rec) &&
+		    !(rec->flags & (FTRACE_FL_ENABLED | FTRACE_FL_DISABLED))) {
+			rec->flags |= FTRACE_FL_DISABLED;
+			ret = 0;
+		}
+	}
+	mutex_unlock(&ftrace_lock);
+
+	return ret;
+}
+
+/**
+ * ftrace_release_location - give a location back to ftrace
+ * @ip: the location reserved with ftrace_reserve_location()
+ *
+ * The NOP must be back in place: the tracers that were enabled on the
+ * location in the meantime are enabled on it now.
+ */
+void ftrace_release_location(unsigned long ip)
+{
+	struct dyn_ftrace *rec;
+	int cnt = 0;
+
+	mutex_lock(&ftrace_lock);
+	rec = lookup_rec(ip, ip);
+	if (WARN_ON_ONCE(!rec || !(rec->flags & FTRACE_FL_DISABLED)))
+		goto out_unlock;
+
+	if (ftrace_start_up)
+		cnt = referenced_filters(rec);
+
+	/* This clears FTRACE_FL_DISABLED */
+	rec->flags = cnt;
+
+	if (ftrace_start_up && cnt) {
+		int failed = __ftrace_replace_code(rec, 1);
+
+		if (failed)
+			ftrace_bug(failed, rec);
+		ftrace_arch_code_modify_post_process();
+	}
+
+ out_unlock:
+	mutex_unlock(&ftrace_lock);
+}
+
+#ifdef CONFIG_MODULES
+
+#define next_to_ftrace_page(p) container_of(p, struct ftrace_page, next)
+
+static LIST_HEAD(ftrace_mod_maps);
+
 static void
 clear_mod_from_hash(struct ftrace_page *pg, struct ftrace_hash *hash)
 {
@@ -25,6 +25,7 @@
 #include <linux/cpu.h>
 #include <linux/oom.h>
 
+#include <asm/sections.h>
 #include <asm/local.h>
 
 static void update_pages_handler(struct work_struct *work);
@@ -331,6 +332,8 @@ struct buffer_page {
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
 	struct buffer_data_page *page;	/* Actual data page */
+	u32		 id;		/* slot in the meta data of a range */
+	bool		 range;		/* page is in a memory range */
 };
 
 /*
@@ -373,7 +376,8 @@ size_t ring_buffer_page_len(void *page)
  */
 static void free_buffer_page(struct buffer_page *bpage)
 {
-	free_page((unsigned long)bpage->page);
+	if (!bpage->range)
+		free_page((unsigned long)bpage->page);
 	kfree(bpage);
 }
 
@@ -459,6 +463,35 @@ enum {
 	RB_CTX_MAX
 };
 
+/*
+ * A ring buffer can be laid out on a memory range which outlives a warm
+ * reboot, one reserved with memmap= for instance, so that the next boot
+ * can read the events of the previous one.
+ *
+ * The range starts with a page holding the ring_buffer_meta, followed by
+ * an area per possible CPU: a ring_buffer_cpu_meta, then the sub-buffers,
+ * the pages of events. The buffers[] of the CPU meta hold the sub-buffer
+ * of each slot: slot 0 is the reader page, the others are the ring in
+ * order. Along with the indexes of the head and commit sub-buffers, this
+ * is enough to rebuild the buffer as it was left.
+ */
+#define RB_META_MAGIC		0x52424d54	/* "RBMT" */
+
+struct ring_buffer_meta {
+	u32		magic;
+	u32		struct_size;
+	u32		nr_cpus;
+	u32		nr_subbufs;	/* per CPU, reader page included */
+	unsigned long	text_addr;	/* _text of the boot which wrote it */
+};
+
+struct ring_buffer_cpu_meta {
+	u32		head_idx;	/* sub-buffer of the head page */
+	u32		commit_idx;	/* sub-buffer of the commit page */
+	u32		nr_subbufs;
+	u32		buffers[];	/* sub-buffer of each slot */
+};
+
 /*
  * head_page == tail_page && head == tail then buffer is empty.
  */
@@ -498,6 +531,10 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* for a buffer laid out on a memory range */
+	struct ring_buffer_cpu_meta	*ring_meta;
+	void				*subbufs;
 };
 
 struct ring_buffer {
@@ -518,6 +555,14 @@ struct ring_buffer {
 
 	struct rb_irq_work		irq_work;
 	bool				time_stamp_abs;
+
+	/* for a buffer laid out on a memory range, see rb_range_setup() */
+	struct ring_buffer_meta		*meta;
+	unsigned long			range_addr_start;
+	unsigned long			range_cpu_size;
+	u32				range_nr_subbufs;
+	bool				last_boot;
+	long				last_text_delta;
 };
 
 struct ring_buffer_iter {
@@ -1161,6 +1206,289 @@ static int rb_check_pages(struct ring_buffer_per_cpu *cpu_buffer)
 	return 0;
 }
 
+static struct ring_buffer_cpu_meta *
+rb_range_cpu_meta(struct ring_buffer *buffer, int cpu)
+{
+	return (void *)buffer->range_addr_start + PAGE_SIZE +
+		cpu * buffer->range_cpu_size;
+}
+
+static void *rb_range_subbuf(struct ring_buffer_per_cpu *cpu_buffer, u32 idx)
+{
+	return cpu_buffer->subbufs + ((unsigned long)idx << PAGE_SHIFT);
+}
+
+static u32 rb_range_subbuf_idx(struct ring_buffer_per_cpu *cpu_buffer,
+			       struct buffer_page *bpage)
+{
+	return ((void *)bpage->page - cpu_buffer->subbufs) >> PAGE_SHIFT;
+}
+
+/*
+ * Lay out the buffer on the memory range at @start. Returns false if the
+ * range is too small. The buffer may hold the events of the previous boot
+ * if the meta data of the range describes the same layout, each CPU meta
+ * is checked when its buffer gets allocated.
+ */
+static bool rb_range_setup(struct ring_buffer *buffer, unsigned long start,
+			   unsigned long size)
+{
+	struct ring_buffer_meta *meta = (void *)start;
+	unsigned long meta_pages;
+	unsigned long cpu_size;
+	unsigned long nr;
+	u32 nr_subbufs;
+
+	if (!PAGE_ALIGNED(start) || !PAGE_ALIGNED(size) || size <= PAGE_SIZE)
+		return false;
+
+	cpu_size = rounddown((size - PAGE_SIZE) / nr_cpu_ids, PAGE_SIZE);
+	nr = cpu_size >> PAGE_SHIFT;
+	meta_pages = DIV_ROUND_UP(sizeof(struct ring_buffer_cpu_meta) +
+				  nr * sizeof(u32), PAGE_SIZE);
+	/* the reader page and at least two pages in the ring */
+	if (nr < meta_pages + 3 || nr - meta_pages > U32_MAX)
+		return false;
+	nr_subbufs = nr - meta_pages;
+
+	buffer->meta = meta;
+	buffer->range_addr_start = start;
+	buffer->range_cpu_size = cpu_size;
+	buffer->range_nr_subbufs = nr_subbufs;
+
+	if (meta->magic == RB_META_MAGIC &&
+	    meta->struct_size == sizeof(*meta) &&
+	    meta->nr_cpus == nr_cpu_ids &&
+	    meta->nr_subbufs == nr_subbufs) {
+		buffer->last_boot = true;
+		return true;
+	}
+
+	meta->magic = RB_META_MAGIC;
+	meta->struct_size = sizeof(*meta);
+	meta->nr_cpus = nr_cpu_ids;
+	meta->nr_subbufs = nr_subbufs;
+	meta->text_addr = (unsigned long)_text;
+	return true;
+}
+
+/* The slots must hold each sub-buffer once */
+static bool rb_cpu_meta_valid(struct ring_buffer_cpu_meta *meta, u32 nr)
+{
+	unsigned long *subbuf_mask;
+	bool ret = false;
+	u32 i;
+
+	if (meta->nr_subbufs != nr || meta->head_idx >= nr ||
+	    meta->commit_idx >= nr)
+		return false;
+
+	subbuf_mask = bitmap_zalloc(nr, GFP_KERNEL);
+	if (!subbuf_mask)
+		return false;
+
+	for (i = 0; i < nr; i++) {
+		if (meta->buffers[i] >= nr ||
+		    __test_and_set_bit(meta->buffers[i], subbuf_mask))
+			goto out;
+	}
+	ret = true;
+ out:
+	bitmap_free(subbuf_mask);
+	return ret;
+}
+
+/*
+ * Keep the meta data of the CPU buffer if it may hold the events of the
+ * previous boot, start it afresh otherwise.
+ */
+static void rb_range_meta_init(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct ring_buffer *buffer = cpu_buffer->buffer;
+	struct ring_buffer_cpu_meta *meta;
+	u32 nr = buffer->range_nr_subbufs;
+	u32 i;
+
+	meta = rb_range_cpu_meta(buffer, cpu_buffer->cpu);
+	cpu_buffer->ring_meta = meta;
+	cpu_buffer->subbufs = (void *)meta + buffer->range_cpu_size -
+		((unsigned long)nr << PAGE_SHIFT);
+
+	if (buffer->last_boot && rb_cpu_meta_valid(meta, nr))
+		return;
+
+	meta->nr_subbufs = nr;
+	for (i = 0; i < nr; i++) {
+		meta->buffers[i] = i;
+		rb_init_page(rb_range_subbuf(cpu_buffer, i));
+	}
+	meta->head_idx = 1;
+	meta->commit_idx = 1;
+}
+
+/* The ring pages of a range, in the order of their slots */
+static int rb_range_allocate_pages(struct ring_buffer_per_cpu *cpu_buffer,
+				   long nr_pages, struct list_head *pages)
+{
+	struct ring_buffer_cpu_meta *meta = cpu_buffer->ring_meta;
+	struct buffer_page *bpage, *tmp;
+	long i;
+
+	for (i = 0; i < nr_pages; i++) {
+		bpage = kzalloc_node(ALIGN(sizeof(*bpage), cache_line_size()),
+				     GFP_KERNEL, cpu_to_node(cpu_buffer->cpu));
+		if (!bpage)
+			goto free_pages;
+
+		list_add_tail(&bpage->list, pages);
+		bpage->id = i + 1;
+		bpage->range = true;
+		bpage->page = rb_range_subbuf(cpu_buffer, meta->buffers[i + 1]);
+	}
+	return 0;
+
+free_pages:
+	list_for_each_entry_safe(bpage, tmp, pages, list) {
+		list_del_init(&bpage->list);
+		free_buffer_page(bpage);
+	}
+	return -ENOMEM;
+}
+
+/*
+ * Returns the number of events of a page left by the previous boot,
+ * or -1 if they can't be walked.
+ */
+static int rb_validate_page(struct buffer_data_page *dpage)
+{
+	struct ring_buffer_event *event;
+	unsigned long commit;
+	unsigned long tail;
+	unsigned length;
+	int entries = 0;
+
+	commit = local_read(&dpage->commit);
+	if (commit > BUF_PAGE_SIZE)
+		return -1;
+
+	for (tail = 0; tail < commit; tail += length) {
+		if (commit - tail < RB_EVNT_MIN_SIZE)
+			return -1;
+
+		event = (struct ring_buffer_event *)&dpage->data[tail];
+		if (rb_null_event(event))
+			return -1;
+
+		length = rb_event_length(event);
+		if (!length || length & (RB_ALIGNMENT - 1) ||
+		    length > commit - tail)
+			return -1;
+
+		if (event->type_len <= RINGBUF_TYPE_DATA_TYPE_LEN_MAX)
+			entries++;
+	}
+	return entries;
+}
+
+static void rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer);
+
+/*
+ * Rebuild the CPU buffer from the meta data of its range, so that the
+ * events left by the previous boot can be read: from the reader page,
+ * then from the head page up to the commit page. Any inconsistency in
+ * them resets the buffer.
+ */
+static void rb_range_restore(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct ring_buffer_cpu_meta *meta = cpu_buffer->ring_meta;
+	struct buffer_page *reader = cpu_buffer->reader_page;
+	struct buffer_page *head = NULL, *commit = NULL;
+	struct buffer_data_page *dpage;
+	unsigned long entries_bytes = 0;
+	unsigned long entries = 0;
+	struct buffer_page *bpage;
+	u32 tmp;
+	int ret;
+
+	bpage = list_entry(cpu_buffer->pages, struct buffer_page, list);
+	do {
+		if (rb_range_subbuf_idx(cpu_buffer, bpage) == meta->head_idx)
+			head = bpage;
+		if (rb_range_subbuf_idx(cpu_buffer, bpage) == meta->commit_idx)
+			commit = bpage;
+		rb_inc_page(cpu_buffer, &bpage);
+	} while (&bpage->list != cpu_buffer->pages);
+
+	if (!head)
+		goto invalid;
+
+	/*
+	 * The writer was on the reader page, every page of the ring was
+	 * read: the reader page moves in place of the head page, which
+	 * is the next one the writer would have gone to.
+	 */
+	if (!commit && meta->commit_idx == meta->buffers[0]) {
+		dpage = reader->page;
+		reader->page = head->page;
+		head->page = dpage;
+		tmp = meta->buffers[0];
+		meta->buffers[0] = meta->buffers[head->id];
+		meta->buffers[head->id] = tmp;
+		rb_init_page(reader->page);
+		meta->head_idx = meta->commit_idx;
+		commit = head;
+	}
+
+	if (!commit)
+		goto invalid;
+
+	ret = rb_validate_page(reader->page);
+	if (ret < 0)
+		goto invalid;
+	local_set(&reader->write, local_read(&reader->page->commit));
+	local_set(&reader->entries, ret);
+	entries_bytes += local_read(&reader->page->commit);
+	entries += ret;
+
+	for (bpage = head; ; rb_inc_page(cpu_buffer, &bpage)) {
+		ret = rb_validate_page(bpage->page);
+		if (ret < 0)
+			goto invalid;
+		local_set(&bpage->write, local_read(&bpage->page->commit));
+		local_set(&bpage->entries, ret);
+		entries_bytes += local_read(&bpage->page->commit);
+		entries += ret;
+		if (bpage == commit)
+			break;
+	}
+
+	/* the pages past the commit one were overwritten or read */
+	for (rb_inc_page(cpu_buffer, &bpage); bpage != head;
+	     rb_inc_page(cpu_buffer, &bpage)) {
+		local_set(&bpage->write, 0);
+		local_set(&bpage->entries, 0);
+		rb_init_page(bpage->page);
+	}
+
+	cpu_buffer->head_page = head;
+	cpu_buffer->tail_page = commit;
+	cpu_buffer->commit_page = commit;
+	local_set(&cpu_buffer->entries, entries);
+	local_set(&cpu_buffer->entries_bytes, entries_bytes);
+	return;
+
+ invalid:
+	pr_info("Ring buffer of CPU %d from the previous boot is invalid\n",
+		cpu_buffer->cpu);
+	rb_init_page(reader->page);
+	bpage = list_entry(cpu_buffer->pages, struct buffer_page, list);
+	do {
+		rb_init_page(bpage->page);
+		rb_inc_page(cpu_buffer, &bpage);
+	} while (&bpage->list != cpu_buffer->pages);
+	rb_reset_cpu(cpu_buffer);
+}
+
 static int __rb_allocate_pages(long nr_pages, struct list_head *pages, int cpu)
 {
 	struct buffer_page *bpage, *tmp;
@@ -1236,10 +1564,15 @@ static int rb_allocate_pages(struct ring_buffer_per_cpu *cpu_buffer,
 			     unsigned long nr_pages)
 {
 	LIST_HEAD(pages);
+	int ret;
 
 	WARN_ON(!nr_pages);
 
-	if (__rb_allocate_pages(nr_pages, &pages, cpu_buffer->cpu))
+	if (cpu_buffer->ring_meta)
+		ret = rb_range_allocate_pages(cpu_buffer, nr_pages, &pages);
+	else
+		ret = __rb_allocate_pages(nr_pages, &pages, cpu_buffer->cpu);
+	if (ret)
 		return -ENOMEM;
 
 	/*
@@ -1261,6 +1594,7 @@ static struct ring_buffer_per_cpu *
 rb_allocate_cpu_buffer(struct ring_buffer *buffer, long nr_pages, int cpu)
 {
 	struct ring_buffer_per_cpu *cpu_buffer;
+	struct ring_buffer_cpu_meta *meta;
 	struct buffer_page *bpage;
 	struct page *page;
 	int ret;
@@ -1289,11 +1623,19 @@ rb_allocate_cpu_buffer(struct ring_buffer *buffer, long nr_pages, int cpu)
 	rb_check_bpage(cpu_buffer, bpage);
 
 	cpu_buffer->reader_page = bpage;
-	page = alloc_pages_node(cpu_to_node(cpu), GFP_KERNEL, 0);
-	if (!page)
-		goto fail_free_reader;
-	bpage->page = page_address(page);
-	rb_init_page(bpage->page);
+
+	if (buffer->range_addr_start) {
+		rb_range_meta_init(cpu_buffer);
+		meta = cpu_buffer->ring_meta;
+		bpage->range = true;
+		bpage->page = rb_range_subbuf(cpu_buffer, meta->buffers[0]);
+	} else {
+		page = alloc_pages_node(cpu_to_node(cpu), GFP_KERNEL, 0);
+		if (!page)
+			goto fail_free_reader;
+		bpage->page = page_address(page);
+		rb_init_page(bpage->page);
+	}
 
 	INIT_LIST_HEAD(&cpu_buffer->reader_page->list);
 	INIT_LIST_HEAD(&cpu_buffer->new_pages);
@@ -1306,6 +1648,9 @@ rb_allocate_cpu_buffer(struct ring_buffer *buffer, long nr_pages, int cpu)
 		= list_entry(cpu_buffer->pages, struct buffer_page, list);
 	cpu_buffer->tail_page = cpu_buffer->commit_page = cpu_buffer->head_page;
 
+	if (cpu_buffer->ring_meta)
+		rb_range_restore(cpu_buffer);
+
 	rb_head_page_activate(cpu_buffer);
 
 	return cpu_buffer;
@@ -1339,17 +1684,9 @@ static void rb_free_cpu_buffer(struct ring_buffer_per_cpu *cpu_buffer)
 	kfree(cpu_buffer);
 }
 
-/**
- * __ring_buffer_alloc - allocate a new ring_buffer
- * @size: the size in bytes per cpu that is needed.
- * @flags: attributes to set for the ring buffer.
- *
- * Currently the only flag that is available is the RB_FL_OVERWRITE
- * flag. This flag means that the buffer will overwrite old data
- * when the buffer wraps. If this flag is not set, the buffer will
- * drop data when the tail hits the head.
- */
-struct ring_buffer *__ring_buffer_alloc(unsigned long size, unsigned flags,
+static struct ring_buffer *alloc_buffer(unsigned long size, unsigned flags,
+					unsigned long start,
+					unsigned long range_size,
 					struct lock_class_key *key)
 {
 	struct ring_buffer *buffer;
@@ -1379,6 +1716,13 @@ struct ring_buffer *__ring_buffer_alloc(unsigned long size, unsigned flags,
 	if (nr_pages < 2)
 		nr_pages = 2;
 
+	/* the size of a range buffer is the one of the range */
+	if (start) {
+		if (!rb_range_setup(buffer, start, range_size))
+			goto fail_free_cpumask;
+		nr_pages = buffer->range_nr_subbufs - 1;
+	}
+
 	buffer->cpus = nr_cpu_ids;
 
 	bsize = sizeof(void *) * nr_cpu_ids;
@@ -1399,6 +1743,15 @@ struct ring_buffer *__ring_buffer_alloc(unsigned long size, unsigned flags,
 
 	mutex_init(&buffer->mutex);
 
+	if (buffer->meta) {
+		buffer->last_boot = !ring_buffer_empty(buffer);
+		if (buffer->last_boot)
+			buffer->last_text_delta = (unsigned long)_text -
+				buffer->meta->text_addr;
+		else
+			buffer->meta->text_addr = (unsigned long)_text;
+	}
+
 	return buffer;
 
  fail_free_buffers:
@@ -1415,8 +1768,85 @@ struct ring_buffer *__ring_buffer_alloc(unsigned long size, unsigned flags,
 	kfree(buffer);
 	return NULL;
 }
+
+/**
+ * __ring_buffer_alloc - allocate a new ring_buffer
+ * @size: the size in bytes per cpu that is needed.
+ * @flags: attributes to set for the ring buffer.
+ *
+ * Currently the only flag that is available is the RB_FL_OVERWRITE
+ * flag. This flag means that the buffer will overwrite old data
+ * when the buffer wraps. If this flag is not set, the buffer will
+ * drop data when the tail hits the head.
+ */
+struct ring_buffer *__ring_buffer_alloc(unsigned long size, unsigned flags,
+					struct lock_class_key *key)
+{
+	return alloc_buffer(size, flags, 0, 0, key);
+}
 EXPORT_SYMBOL_GPL(__ring_buffer_alloc);
 
+/**
+ * __ring_buffer_alloc_range - allocate a ring_buffer on a memory range
+ * @size: unused, the size of the buffer is set by the range
+ * @flags: attributes to set for the ring buffer.
+ * @start: the page aligned virtual address of the range
+ * @range_size: the size of the range
+ *
+ * The pages of the buffer are the ones of the range, which is split
+ * between the possible CPUs. If the range was laid out the same way by
+ * the previous boot, the buffer holds its events, see
+ * ring_buffer_last_boot_delta(). The buffer can't be resized.
+ */
+struct ring_buffer *__ring_buffer_alloc_range(unsigned long size,
+					      unsigned flags,
+					      unsigned long start,
+					      unsigned long range_size,
+					      struct lock_class_key *key)
+{
+	return alloc_buffer(size, flags, start, range_size, key);
+}
+EXPORT_SYMBOL_GPL(__ring_buffer_alloc_range);
+
+/**
+ * ring_buffer_last_boot_delta - tell if a buffer holds a previous boot
+ * @buffer: The ring buffer
+ * @text: Set to the offset of the kernel text of this boot from the
+ *	one of the boot which wrote the events
+ *
+ * Returns true if @buffer is laid out on a memory range and holds the
+ * events of the previous boot, which weren't cleared since with
+ * ring_buffer_last_boot_clear().
+ */
+bool ring_buffer_last_boot_delta(struct ring_buffer *buffer, long *text)
+{
+	if (!buffer->last_boot)
+		return false;
+
+	*text = buffer->last_text_delta;
+	return true;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_last_boot_delta);
+
+/**
+ * ring_buffer_last_boot_clear - drop the events of the previous boot
+ * @buffer: The ring buffer
+ *
+ * Resets all the CPU buffers of @buffer, the events written from then on
+ * are the ones of this boot.
+ */
+void ring_buffer_last_boot_clear(struct ring_buffer *buffer)
+{
+	if (!buffer->last_boot)
+		return;
+
+	ring_buffer_reset(buffer);
+	buffer->meta->text_addr = (unsigned long)_text;
+	buffer->last_text_delta = 0;
+	buffer->last_boot = false;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_last_boot_clear);
+
 /**
  * ring_buffer_free - free a ring buffer.
  * @buffer: the buffer to free.
@@ -1705,6 +2135,10 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size,
 	    !cpumask_test_cpu(cpu_id, buffer->cpumask))
 		return size;
 
+	/* the pages of a range buffer are the ones of the range */
+	if (buffer->range_addr_start)
+		return -EINVAL;
+
 	nr_pages = DIV_ROUND_UP(size, BUF_PAGE_SIZE);
 
 	/* we need a minimum of two pages */
@@ -1939,6 +2373,21 @@ static void rb_inc_iter(struct ring_buffer_iter *iter)
 	iter->head = 0;
 }
 
+/*
+ * The head of a range buffer moved past @old_head. Only move it once: an
+ * interrupt which came in may already have moved it further.
+ */
+static void rb_range_update_head(struct ring_buffer_per_cpu *cpu_buffer,
+				 struct buffer_page *old_head)
+{
+	struct buffer_page *new_head = old_head;
+
+	rb_inc_page(cpu_buffer, &new_head);
+	(void)cmpxchg(&cpu_buffer->ring_meta->head_idx,
+		      rb_range_subbuf_idx(cpu_buffer, old_head),
+		      rb_range_subbuf_idx(cpu_buffer, new_head));
+}
+
 /*
  * rb_handle_head_page - writer hit the head page
  *
@@ -1992,6 +2441,9 @@ rb_handle_head_page(struct ring_buffer_per_cpu *cpu_buffer,
 		 * tail page.
 		 */
 
+		if (cpu_buffer->ring_meta)
+			rb_range_update_head(cpu_buffer, next_page);
+
 		/* still more to do */
 		break;
 
@@ -2457,6 +2909,10 @@ rb_set_commit_to_write(struct ring_buffer_per_cpu *cpu_buffer)
 		local_set(&cpu_buffer->commit_page->page->commit,
 			  rb_page_write(cpu_buffer->commit_page));
 		rb_inc_page(cpu_buffer, &cpu_buffer->commit_page);
+		if (cpu_buffer->ring_meta)
+			cpu_buffer->ring_meta->commit_idx =
+				rb_range_subbuf_idx(cpu_buffer,
+						    cpu_buffer->commit_page);
 		/* Only update the write stamp if the page has an event */
 		if (rb_page_write(cpu_buffer->commit_page))
 			cpu_buffer->write_stamp =
@@ -3628,6 +4084,25 @@ rb_update_iter_read_stamp(struct ring_buffer_iter *iter,
 	return;
 }
 
+/* The reader page of a range buffer took the slot of @reader */
+static void rb_range_update_reader(struct ring_buffer_per_cpu *cpu_buffer,
+				   struct buffer_page *reader)
+{
+	struct ring_buffer_cpu_meta *meta = cpu_buffer->ring_meta;
+	u32 id = reader->id;
+	u32 tmp;
+
+	tmp = meta->buffers[0];
+	meta->buffers[0] = meta->buffers[id];
+	meta->buffers[id] = tmp;
+
+	cpu_buffer->reader_page->id = id;
+	reader->id = 0;
+
+	meta->head_idx = rb_range_subbuf_idx(cpu_buffer,
+					     cpu_buffer->head_page);
+}
+
 static struct buffer_page *
 rb_get_reader_page(struct ring_buffer_per_cpu *cpu_buffer)
 {
@@ -3739,6 +4214,9 @@ rb_get_reader_page(struct ring_buffer_per_cpu *cpu_buffer)
 	rb_list_head(reader->list.next)->prev = &cpu_buffer->reader_page->list;
 	rb_inc_page(cpu_buffer, &cpu_buffer->head_page);
 
+	if (cpu_buffer->ring_meta)
+		rb_range_update_reader(cpu_buffer, reader);
+
 	/* Finally update the reader page to the new head */
 	cpu_buffer->reader_page = reader;
 	cpu_buffer->reader_page->read = 0;
@@ -4343,6 +4821,13 @@ rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 	cpu_buffer->lost_events = 0;
 	cpu_buffer->last_overrun = 0;
 
+	if (cpu_buffer->ring_meta) {
+		cpu_buffer->ring_meta->head_idx =
+			rb_range_subbuf_idx(cpu_buffer, cpu_buffer->head_page);
+		cpu_buffer->ring_meta->commit_idx =
+			cpu_buffer->ring_meta->head_idx;
+	}
+
 	rb_head_page_activate(cpu_buffer);
 }
 
@@ -4474,6 +4959,10 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	    !cpumask_test_cpu(cpu, buffer_b->cpumask))
 		goto out;
 
+	/* the pages of a range buffer can't leave it */
+	if (buffer_a->range_addr_start || buffer_b->range_addr_start)
+		goto out;
+
 	cpu_buffer_a = buffer_a->buffers[cpu];
 	cpu_buffer_b = buffer_b->buffers[cpu];
 
@@ -4762,14 +5251,20 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 		cpu_buffer->read += rb_page_entries(reader);
 		cpu_buffer->read_bytes += BUF_PAGE_SIZE;
 
-		/* swap the pages */
-		rb_init_page(bpage);
-		bpage = reader->page;
-		reader->page = *data_page;
+		if (reader->range) {
+			/* the pages of a range can't leave it, copy */
+			memcpy(bpage, reader->page, PAGE_SIZE);
+			rb_init_page(reader->page);
+		} else {
+			/* swap the pages */
+			rb_init_page(bpage);
+			bpage = reader->page;
+			reader->page = *data_page;
+			*data_page = bpage;
+		}
 		local_set(&reader->write, 0);
 		local_set(&reader->entries, 0);
 		reader->read = 0;
-		*data_page = bpage;
 
 		/*
 		 * Use the real_end for the data size,
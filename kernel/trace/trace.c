@@ -29,6 +29,7 @@
 #include <linux/vmalloc.h>
 #include <linux/ftrace.h>
 #include <linux/module.h>
+#include <linux/io.h>
 #include <linux/percpu.h>
 #include <linux/splice.h>
 #include <linux/kdebug.h>
@@ -238,6 +239,40 @@ static int __init set_tracepoint_printk(char *str)
 }
 __setup("tp_printk", set_tracepoint_printk);
 
+static char boot_instance_name[MAX_TRACER_SIZE] __initdata;
+static phys_addr_t boot_instance_start __initdata;
+static unsigned long boot_instance_size __initdata;
+
+/*
+ * trace_instance=<name>,<size>@<start> creates the instance <name> with
+ * its buffer laid out on the memory range at <start>, which must be kept
+ * by the kernel across reboots (see memmap=). The buffer of the instance
+ * then holds the events of the previous boot, until it gets cleared.
+ */
+static int __init set_trace_boot_instance(char *str)
+{
+	char *comma = strchr(str, ',');
+	unsigned long size;
+	phys_addr_t start;
+	char *p;
+
+	if (!comma || comma == str || comma - str >= MAX_TRACER_SIZE)
+		return 0;
+
+	size = memparse(comma + 1, &p);
+	if (*p != '@')
+		return 0;
+	start = memparse(p + 1, &p);
+	if (!size || !PAGE_ALIGNED(size) || !PAGE_ALIGNED(start))
+		return 0;
+
+	strlcpy(boot_instance_name, str, comma - str + 1);
+	boot_instance_start = start;
+	boot_instance_size = size;
+	return 1;
+}
+__setup("trace_instance=", set_trace_boot_instance);
+
 unsigned long long ns2usecs(u64 nsec)
 {
 	nsec += 500;
@@ -759,6 +794,10 @@ __trace_buffer_lock_reserve(struct ring_buffer *buffer,
 
 void tracer_tracing_on(struct trace_array *tr)
 {
+	/* the events of the previous boot are kept until cleared */
+	if (tr->flags & TRACE_ARRAY_FL_LAST_BOOT)
+		return;
+
 	if (tr->trace_buffer.buffer)
 		ring_buffer_record_on(tr->trace_buffer.buffer);
 	/*
@@ -954,6 +993,10 @@ int tracing_alloc_snapshot_instance(struct trace_array *tr)
 {
 	int ret;
 
+	/* the buffer of a range can't be swapped with another */
+	if (tr->range_addr_start)
+		return -EBUSY;
+
 	if (!tr->allocated_snapshot) {
 
 		/* allocate spare buffer */
@@ -1708,6 +1751,22 @@ void tracing_reset_online_cpus(struct trace_buffer *buf)
 	ring_buffer_record_enable(buffer);
 }
 
+/* Drop the events of the previous boot, the instance records again */
+static void tracing_last_boot_clear(struct trace_array *tr)
+{
+	struct trace_buffer *buf = &tr->trace_buffer;
+
+	mutex_lock(&trace_types_lock);
+	if (tr->flags & TRACE_ARRAY_FL_LAST_BOOT) {
+		ring_buffer_last_boot_clear(buf->buffer);
+		buf->time_start = buffer_ftrace_now(buf, buf->cpu);
+		tr->flags &= ~TRACE_ARRAY_FL_LAST_BOOT;
+		tr->text_delta = 0;
+		tracer_tracing_on(tr);
+	}
+	mutex_unlock(&trace_types_lock);
+}
+
 /* Must have trace_types_lock held */
 void tracing_reset_all_online_cpus(void)
 {
@@ -4041,7 +4100,10 @@ static int tracing_open(struct inode *inode, struct file *file)
 			trace_buf = &tr->max_buffer;
 #endif
 
-		if (cpu == RING_BUFFER_ALL_CPUS)
+		if (cpu == RING_BUFFER_ALL_CPUS &&
+		    (tr->flags & TRACE_ARRAY_FL_LAST_BOOT))
+			tracing_last_boot_clear(tr);
+		else if (cpu == RING_BUFFER_ALL_CPUS)
 			tracing_reset_online_cpus(trace_buf);
 		else
 			tracing_reset(trace_buf, cpu);
@@ -5535,7 +5597,8 @@ tracing_thresh_write(struct file *filp, const char __user *ubuf,
 	return ret;
 }
 
-#if defined(CONFIG_TRACER_MAX_TRACE) || defined(CONFIG_HWLAT_TRACER)
+#if defined(CONFIG_TRACER_MAX_TRACE) || defined(CONFIG_HWLAT_TRACER) || \
+	defined(CONFIG_OSNOISE_TRACER)
 
 static ssize_t
 tracing_max_lat_read(struct file *filp, char __user *ubuf,
@@ -6560,7 +6623,8 @@ static const struct file_operations tracing_thresh_fops = {
 	.llseek		= generic_file_llseek,
 };
 
-#if defined(CONFIG_TRACER_MAX_TRACE) || defined(CONFIG_HWLAT_TRACER)
+#if defined(CONFIG_TRACER_MAX_TRACE) || defined(CONFIG_HWLAT_TRACER) || \
+	defined(CONFIG_OSNOISE_TRACER)
 static const struct file_operations tracing_max_lat_fops = {
 	.open		= tracing_open_generic,
 	.read		= tracing_max_lat_read,
@@ -7676,7 +7740,12 @@ allocate_trace_buffer(struct trace_array *tr, struct trace_buffer *buf, int size
 
 	buf->tr = tr;
 
-	buf->buffer = ring_buffer_alloc(size, rb_flags);
+	if (tr->range_addr_start && buf == &tr->trace_buffer)
+		buf->buffer = ring_buffer_alloc_range(size, rb_flags,
+						      tr->range_addr_start,
+						      tr->range_addr_size);
+	else
+		buf->buffer = ring_buffer_alloc(size, rb_flags);
 	if (!buf->buffer)
 		return -ENOMEM;
 
@@ -7769,7 +7838,8 @@ static void update_tracer_options(struct trace_array *tr)
 	mutex_unlock(&trace_types_lock);
 }
 
-static int instance_mkdir(const char *name)
+static int trace_array_create(const char *name, unsigned long range_start,
+			      unsigned long range_size)
 {
 	struct trace_array *tr;
 	int ret;
@@ -7809,9 +7879,19 @@ static int instance_mkdir(const char *name)
 	INIT_LIST_HEAD(&tr->events);
 	INIT_LIST_HEAD(&tr->hist_vars);
 
+	tr->range_addr_start = range_start;
+	tr->range_addr_size = range_size;
+
 	if (allocate_trace_buffers(tr, trace_buf_size) < 0)
 		goto out_free_tr;
 
+	if (range_start &&
+	    ring_buffer_last_boot_delta(tr->trace_buffer.buffer,
+					&tr->text_delta)) {
+		tracer_tracing_off(tr);
+		tr->flags |= TRACE_ARRAY_FL_LAST_BOOT;
+	}
+
 	tr->dir = tracefs_create_dir(name, trace_instance_dir);
 	if (!tr->dir)
 		goto out_free_tr;
@@ -7849,6 +7929,11 @@ static int instance_mkdir(const char *name)
 
 }
 
+static int instance_mkdir(const char *name)
+{
+	return trace_array_create(name, 0, 0);
+}
+
 static int instance_rmdir(const char *name)
 {
 	struct trace_array *tr;
@@ -7869,8 +7954,10 @@ static int instance_rmdir(const char *name)
 	if (!found)
 		goto out_unlock;
 
+	/* the memory range of the buffer stays mapped */
 	ret = -EBUSY;
-	if (tr->ref || (tr->current_trace && tr->current_trace->ref))
+	if (tr->ref || (tr->current_trace && tr->current_trace->ref) ||
+	    tr->range_addr_start)
 		goto out_unlock;
 
 	list_del(&tr->list);
@@ -7916,6 +8003,29 @@ static __init void create_trace_instances(struct dentry *d_tracer)
 		return;
 }
 
+static __init void create_boot_instance(void)
+{
+	void *start;
+
+	if (!boot_instance_size)
+		return;
+
+	start = memremap(boot_instance_start, boot_instance_size,
+			 MEMREMAP_WB);
+	if (!start) {
+		pr_warn("Tracing: failed to map the range of instance %s\n",
+			boot_instance_name);
+		return;
+	}
+
+	if (trace_array_create(boot_instance_name, (unsigned long)start,
+			       boot_instance_size)) {
+		pr_warn("Tracing: failed to create instance %s\n",
+			boot_instance_name);
+		memunmap(start);
+	}
+}
+
 static void
 init_tracer_tracefs(struct trace_array *tr, struct dentry *d_tracer)
 {
@@ -7972,7 +8082,8 @@ init_tracer_tracefs(struct trace_array *tr, struct dentry *d_tracer)
 
 	create_trace_options_dir(tr);
 
-#if defined(CONFIG_TRACER_MAX_TRACE) || defined(CONFIG_HWLAT_TRACER)
+#if defined(CONFIG_TRACER_MAX_TRACE) || defined(CONFIG_HWLAT_TRACER) || \
+	defined(CONFIG_OSNOISE_TRACER)
 	trace_create_file("tracing_max_latency", 0644, d_tracer,
 			&tr->max_latency, &tracing_max_lat_fops);
 #endif
@@ -8176,6 +8287,8 @@ static __init int tracer_init_tracefs(void)
 
 	create_trace_instances(d_tracer);
 
+	create_boot_instance();
+
 	update_tracer_options(&global_trace);
 
 	return 0;
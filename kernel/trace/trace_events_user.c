@@ -0,0 +1,972 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * User events: trace events defined and written by user space
+ *
+ * A process registers an event with an ioctl() on the user_events_data
+ * file, which gives it a byte of the user_events_status page and an index
+ * private to the open file. Once the page is mmap()ed, checking whether
+ * the event is enabled is a load, and writing it is a single write() or
+ * writev() of the index followed by the payload, copied straight into the
+ * ring buffer or the perf buffer. The events are regular trace events of
+ * the "user_events" system otherwise: with a format, filters, triggers,
+ * hist triggers and perf.
+ */
+#include <linux/bitmap.h>
+#include <linux/ctype.h>
+#include <linux/fs.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/tracefs.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <uapi/linux/user_events.h>
+
+#include "trace.h"
+
+/* a byte of the status page per event */
+#define MAX_EVENTS		PAGE_SIZE
+#define MAX_EVENT_DESC		512
+#define MAX_FIELD_ARRAY_SIZE	1024
+
+#define EVENT_NAME(user)	((user)->tp.name)
+
+static char *register_page_data;
+
+/* Protects the events, the status page bitmap and the refs of the files */
+static DEFINE_MUTEX(reg_mutex);
+static DEFINE_HASHTABLE(register_table, 4);
+static DECLARE_BITMAP(page_bitmap, MAX_EVENTS);
+
+struct user_event_field {
+	struct list_head	link;
+	char			*type;
+	char			*name;
+	int			offset;
+	int			size;
+	bool			is_signed;
+	bool			is_array;
+	bool			is_dyn;
+};
+
+struct user_event {
+	struct tracepoint		tp;
+	struct trace_event_class	class;
+	struct trace_event_call		call;
+	struct hlist_node		node;
+	struct list_head		fields;
+	/* number of files which may write the event */
+	atomic_t			refcnt;
+	int				index;
+	/* size of the payload up to the end of the last field */
+	int				min_size;
+	/* protected by event_mutex, as the reg callback is */
+	int				ftrace_users;
+	int				perf_users;
+};
+
+/* The events an open data file registered, its indexes being the ones
+ * the writes are prefixed with.
+ */
+struct user_event_refs {
+	struct rcu_head		rcu;
+	int			count;
+	struct user_event	*events[];
+};
+
+typedef void (*user_event_func_t)(struct user_event *user,
+				  struct iov_iter *i, void *tpdata);
+
+static u32 user_event_key(const char *name)
+{
+	return jhash(name, strlen(name), 0);
+}
+
+static struct user_event *find_user_event(const char *name, u32 key)
+{
+	struct user_event *user;
+
+	hash_for_each_possible(register_table, user, node, key) {
+		if (!strcmp(EVENT_NAME(user), name))
+			return user;
+	}
+
+	return NULL;
+}
+
+static bool user_event_name_valid(const char *name)
+{
+	if (!*name)
+		return false;
+
+	for (; *name; name++) {
+		if (!isalnum(*name) && *name != '_')
+			return false;
+	}
+
+	return true;
+}
+
+/* Return the size of a field of @type, 0 if the type isn't supported */
+static int user_field_size(const char *type, bool *is_array, bool *is_dyn)
+{
+	const char *array;
+	unsigned int len;
+
+	*is_array = false;
+	*is_dyn = false;
+
+	if (!strncmp(type, "__data_loc ", 11)) {
+		type += 11;
+		if (strcmp(type, "char[]"))
+			return 0;
+		*is_dyn = true;
+		return sizeof(u32);
+	}
+
+	if (!strcmp(type, "s64") || !strcmp(type, "u64"))
+		return sizeof(u64);
+	if (!strcmp(type, "s32") || !strcmp(type, "u32") ||
+	    !strcmp(type, "int") || !strcmp(type, "unsigned int") ||
+	    !strcmp(type, "pid_t"))
+		return sizeof(u32);
+	if (!strcmp(type, "s16") || !strcmp(type, "u16"))
+		return sizeof(u16);
+	if (!strcmp(type, "s8") || !strcmp(type, "u8") ||
+	    !strcmp(type, "char") || !strcmp(type, "unsigned char"))
+		return sizeof(u8);
+	if (!strcmp(type, "long") || !strcmp(type, "unsigned long"))
+		return sizeof(long);
+
+	array = strchr(type, '[');
+	if (!array || strncmp(type, "char[", 5) ||
+	    sscanf(array, "[%u]", &len) != 1 || type[strlen(type) - 1] != ']')
+		return 0;
+	if (!len || len > MAX_FIELD_ARRAY_SIZE)
+		return 0;
+	*is_array = true;
+	return len;
+}
+
+static const char *user_field_format(struct user_event_field *field)
+{
+	if (field->is_array || field->is_dyn)
+		return "%s";
+
+	switch (field->size) {
+	case 8:
+		return field->is_signed ? "%lld" : "%llu";
+	case 4:
+	case 2:
+	case 1:
+		return field->is_signed ? "%d" : "%u";
+	}
+
+	return "%llu";
+}
+
+static void user_event_destroy_fields(struct user_event *user)
+{
+	struct user_event_field *field, *next;
+
+	list_for_each_entry_safe(field, next, &user->fields, link) {
+		list_del(&field->link);
+		kfree(field->type);
+		kfree(field->name);
+		kfree(field);
+	}
+}
+
+/* Parse "type name" into a field of @user, at *@offset of the record, which
+ * is moved past it. Fields are laid out as in a C struct.
+ */
+static int user_event_parse_field(char *desc, struct user_event *user,
+				  int *offset)
+{
+	struct user_event_field *field;
+	bool is_array, is_dyn;
+	char *type, *name;
+	int size;
+
+	desc = strim(desc);
+	name = strrchr(desc, ' ');
+	if (!name)
+		return -EINVAL;
+	*name++ = '\0';
+	type = strim(desc);
+
+	if (!user_event_name_valid(name))
+		return -EINVAL;
+
+	size = user_field_size(type, &is_array, &is_dyn);
+	if (!size)
+		return -EINVAL;
+
+	field = kzalloc(sizeof(*field), GFP_KERNEL);
+	if (!field)
+		return -ENOMEM;
+
+	field->type = kstrdup(type, GFP_KERNEL);
+	field->name = kstrdup(name, GFP_KERNEL);
+	if (!field->type || !field->name) {
+		kfree(field->type);
+		kfree(field->name);
+		kfree(field);
+		return -ENOMEM;
+	}
+
+	if (!is_array)
+		*offset = ALIGN(*offset, min_t(int, size, sizeof(u64)));
+	field->offset = *offset;
+	field->size = size;
+	field->is_array = is_array;
+	field->is_dyn = is_dyn;
+	field->is_signed = !is_array && !is_dyn && type[0] != 'u';
+	list_add_tail(&field->link, &user->fields);
+
+	*offset += size;
+	return 0;
+}
+
+static int user_event_parse_fields(struct user_event *user, char *args)
+{
+	int offset = sizeof(struct trace_entry);
+	char *desc;
+	int ret;
+
+	while (args && (desc = strsep(&args, ";")) != NULL) {
+		/* a trailing ';' is fine */
+		if (!*strim(desc))
+			continue;
+
+		ret = user_event_parse_field(desc, user, &offset);
+		if (ret)
+			return ret;
+	}
+
+	user->min_size = offset - sizeof(struct trace_entry);
+	return 0;
+}
+
+static int user_event_define_fields(struct trace_event_call *call)
+{
+	struct user_event *user = call->data;
+	struct user_event_field *field;
+	int ret;
+
+	list_for_each_entry(field, &user->fields, link) {
+		ret = trace_define_field(call, field->type, field->name,
+					 field->offset, field->size,
+					 field->is_signed, FILTER_OTHER);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int __user_event_set_print_fmt(struct user_event *user, char *buf,
+				      int len)
+{
+	struct user_event_field *field;
+	int pos = 0;
+
+	/* When len=0, we just calculate the needed length */
+#define LEN_OR_ZERO (len ? len - pos : 0)
+
+	pos += snprintf(buf + pos, LEN_OR_ZERO, "\"");
+	list_for_each_entry(field, &user->fields, link) {
+		pos += snprintf(buf + pos, LEN_OR_ZERO, "%s%s=%s",
+				pos > 1 ? " " : "", field->name,
+				user_field_format(field));
+	}
+	pos += snprintf(buf + pos, LEN_OR_ZERO, "\"");
+
+	list_for_each_entry(field, &user->fields, link) {
+		if (field->is_dyn)
+			pos += snprintf(buf + pos, LEN_OR_ZERO,
+					", __get_str(%s)", field->name);
+		else
+			pos += snprintf(buf + pos, LEN_OR_ZERO,
+					", REC->%s", field->name);
+	}
+
+#undef LEN_OR_ZERO
+
+	/* return the length of print_fmt */
+	return pos;
+}
+
+static int user_event_set_print_fmt(struct user_event *user)
+{
+	char *print_fmt;
+	int len;
+
+	/* First: called with 0 length to calculate the needed length */
+	len = __user_event_set_print_fmt(user, NULL, 0);
+
+	print_fmt = kmalloc(len + 1, GFP_KERNEL);
+	if (!print_fmt)
+		return -ENOMEM;
+
+	/* Second: actually write the @print_fmt */
+	__user_event_set_print_fmt(user, print_fmt, len + 1);
+	user->call.print_fmt = print_fmt;
+
+	return 0;
+}
+
+static enum print_line_t print_user_event(struct trace_iterator *iter,
+					  int flags, struct trace_event *event)
+{
+	struct trace_seq *s = &iter->seq;
+	struct user_event_field *field;
+	struct user_event *user;
+	void *entry = iter->ent;
+	void *data;
+	u32 loc;
+
+	user = container_of(event, struct user_event, call.event);
+
+	trace_seq_printf(s, "%s:", EVENT_NAME(user));
+
+	list_for_each_entry(field, &user->fields, link) {
+		if (trace_seq_has_overflowed(s))
+			break;
+
+		data = entry + field->offset;
+		trace_seq_printf(s, " %s=", field->name);
+
+		if (field->is_dyn) {
+			loc = *(u32 *)data;
+			trace_seq_printf(s, "%.*s", loc >> 16,
+					 (char *)entry + (loc & 0xffff));
+			continue;
+		}
+		if (field->is_array) {
+			trace_seq_printf(s, "%.*s", field->size, (char *)data);
+			continue;
+		}
+
+		switch (field->size) {
+		case 8:
+			trace_seq_printf(s, user_field_format(field),
+					 *(u64 *)data);
+			break;
+		case 4:
+			trace_seq_printf(s, user_field_format(field),
+					 *(u32 *)data);
+			break;
+		case 2:
+			trace_seq_printf(s, "%d", field->is_signed ?
+					 *(s16 *)data : *(u16 *)data);
+			break;
+		case 1:
+			trace_seq_printf(s, "%d", field->is_signed ?
+					 *(s8 *)data : *(u8 *)data);
+			break;
+		}
+	}
+
+	trace_seq_putc(s, '\n');
+
+	return trace_handle_return(s);
+}
+
+static struct trace_event_functions user_event_funcs = {
+	.trace		= print_user_event
+};
+
+/*
+ * Check the __data_loc fields of the @size bytes @record, and rebase their
+ * offsets from the payload, as user space writes them, to the record, as
+ * the filters and the output read them.
+ */
+static bool user_event_validate(struct user_event *user, void *record,
+				u32 size)
+{
+	u32 payload = size - sizeof(struct trace_entry);
+	struct user_event_field *field;
+	u32 *loc, off, len;
+
+	list_for_each_entry(field, &user->fields, link) {
+		if (!field->is_dyn)
+			continue;
+
+		loc = record + field->offset;
+		off = *loc & 0xffff;
+		len = *loc >> 16;
+
+		if (off < user->min_size || off + len > payload)
+			return false;
+		/* strings, the filters and hist triggers expect */
+		if (len && ((char *)record)[sizeof(struct trace_entry) +
+					     off + len - 1])
+			return false;
+
+		*loc = (len << 16) | (off + sizeof(struct trace_entry));
+	}
+
+	return true;
+}
+
+/* Copy from the user pages of @i with preemption disabled: writes fault
+ * them in beforehand, a fault now drops the event.
+ */
+static __always_inline __must_check
+size_t copy_nofault(void *addr, size_t bytes, struct iov_iter *i)
+{
+	size_t ret;
+
+	pagefault_disable();
+	ret = copy_from_iter_nocache(addr, bytes, i);
+	pagefault_enable();
+
+	return ret;
+}
+
+static void user_event_ftrace(struct user_event *user, struct iov_iter *i,
+			      void *tpdata)
+{
+	struct trace_event_file *file = tpdata;
+	struct trace_event_buffer event_buffer;
+	size_t len = i->count;
+	void *entry;
+
+	if (unlikely(!file || !(file->flags & EVENT_FILE_FL_ENABLED) ||
+		     trace_trigger_soft_disabled(file)))
+		return;
+
+	entry = trace_event_buffer_reserve(&event_buffer, file,
+					   sizeof(struct trace_entry) + len);
+	if (unlikely(!entry))
+		return;
+
+	if (unlikely(copy_nofault(entry + sizeof(struct trace_entry), len,
+				  i) != len ||
+		     !user_event_validate(user, entry,
+					  sizeof(struct trace_entry) + len))) {
+		__trace_event_discard_commit(event_buffer.buffer,
+					     event_buffer.event);
+		return;
+	}
+
+	trace_event_buffer_commit(&event_buffer);
+}
+
+#ifdef CONFIG_PERF_EVENTS
+static void user_event_perf(struct user_event *user, struct iov_iter *i,
+			    void *tpdata)
+{
+	struct trace_event_call *call = &user->call;
+	size_t count = i->count, len = sizeof(struct trace_entry) + count;
+	struct trace_entry *perf_entry;
+	struct hlist_head *perf_head;
+	struct pt_regs *regs;
+	int context, size;
+
+	perf_head = this_cpu_ptr(call->perf_events);
+	if (!bpf_prog_array_valid(call) && hlist_empty(perf_head))
+		return;
+
+	size = ALIGN(len + sizeof(u32), sizeof(u64)) - sizeof(u32);
+	if (size > PERF_MAX_TRACE_SIZE)
+		return;
+
+	perf_entry = perf_trace_buf_alloc(size, &regs, &context);
+	if (unlikely(!perf_entry))
+		return;
+
+	perf_fetch_caller_regs(regs);
+
+	if (unlikely(copy_nofault(perf_entry + 1, count, i) != count ||
+		     !user_event_validate(user, perf_entry, len))) {
+		perf_swevent_put_recursion_context(context);
+		return;
+	}
+
+	memset((void *)perf_entry + len, 0, size - len);
+	perf_trace_run_bpf_submit(perf_entry, size, context, call, 1, regs,
+				  perf_head, NULL);
+}
+#endif
+
+static void user_event_update_status(struct user_event *user)
+{
+	char status = 0;
+
+	if (user->ftrace_users)
+		status |= EVENT_STATUS_FTRACE;
+	if (user->perf_users)
+		status |= EVENT_STATUS_PERF;
+
+	WRITE_ONCE(register_page_data[user->index], status);
+}
+
+static int user_event_reg(struct trace_event_call *call,
+			  enum trace_reg type, void *data)
+{
+	struct user_event *user = call->data;
+	int ret;
+
+	ret = trace_event_reg(call, type, data);
+	if (ret)
+		return ret;
+
+	switch (type) {
+	case TRACE_REG_REGISTER:
+		user->ftrace_users++;
+		break;
+	case TRACE_REG_UNREGISTER:
+		user->ftrace_users--;
+		break;
+	case TRACE_REG_PERF_REGISTER:
+		user->perf_users++;
+		break;
+	case TRACE_REG_PERF_UNREGISTER:
+		user->perf_users--;
+		break;
+	default:
+		return 0;
+	}
+
+	user_event_update_status(user);
+	return 0;
+}
+
+static void free_user_event(struct user_event *user)
+{
+	user_event_destroy_fields(user);
+	kfree(user->call.print_fmt);
+	kfree(user->tp.name);
+	kfree(user);
+}
+
+static int register_user_event(struct user_event *user)
+{
+	struct trace_event_call *call = &user->call;
+	int ret;
+
+	call->class = &user->class;
+	user->class.system = USER_EVENTS_SYSTEM;
+	INIT_LIST_HEAD(&user->class.fields);
+	call->event.funcs = &user_event_funcs;
+	user->class.define_fields = user_event_define_fields;
+
+	ret = register_trace_event(&call->event);
+	if (!ret)
+		return -ENODEV;
+
+	call->flags = TRACE_EVENT_FL_TRACEPOINT;
+	user->class.reg = user_event_reg;
+	user->class.probe = user_event_ftrace;
+#ifdef CONFIG_PERF_EVENTS
+	user->class.perf_probe = user_event_perf;
+#endif
+	call->data = user;
+	call->tp = &user->tp;
+
+	ret = trace_add_event_call(call);
+	if (ret) {
+		pr_warn("Failed to register user event: %s\n",
+			EVENT_NAME(user));
+		unregister_trace_event(&call->event);
+	}
+
+	return ret;
+}
+
+/* Parse "name [field[;field]...]" into a new event, and register it */
+static struct user_event *user_event_create(char *name, char *args)
+{
+	struct user_event *user;
+	int index, ret;
+
+	index = find_first_zero_bit(page_bitmap, MAX_EVENTS);
+	if (index == MAX_EVENTS)
+		return ERR_PTR(-EMFILE);
+
+	user = kzalloc(sizeof(*user), GFP_KERNEL);
+	if (!user)
+		return ERR_PTR(-ENOMEM);
+
+	INIT_LIST_HEAD(&user->fields);
+	user->index = index;
+
+	user->tp.name = kstrdup(name, GFP_KERNEL);
+	if (!user->tp.name) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	ret = user_event_parse_fields(user, args);
+	if (ret)
+		goto err;
+
+	ret = user_event_set_print_fmt(user);
+	if (ret)
+		goto err;
+
+	ret = register_user_event(user);
+	if (ret)
+		goto err;
+
+	register_page_data[index] = 0;
+	set_bit(index, page_bitmap);
+	hash_add(register_table, &user->node, user_event_key(name));
+
+	return user;
+err:
+	free_user_event(user);
+	return ERR_PTR(ret);
+}
+
+static struct user_event *user_event_parse_cmd(char *cmd)
+{
+	struct user_event *user;
+	char *name, *args;
+
+	lockdep_assert_held(&reg_mutex);
+
+	name = strim(cmd);
+	args = strpbrk(name, " \t");
+	if (args)
+		*args++ = '\0';
+
+	if (!user_event_name_valid(name))
+		return ERR_PTR(-EINVAL);
+
+	/* the fields of an existing event aren't compared */
+	user = find_user_event(name, user_event_key(name));
+	if (user)
+		return user;
+
+	return user_event_create(name, args);
+}
+
+static int delete_user_event(char *name)
+{
+	struct user_event *user;
+	int ret;
+
+	lockdep_assert_held(&reg_mutex);
+
+	user = find_user_event(name, user_event_key(name));
+	if (!user)
+		return -ENOENT;
+
+	if (atomic_read(&user->refcnt))
+		return -EBUSY;
+
+	/* fails while the event is enabled, or open for perf */
+	ret = trace_remove_event_call(&user->call);
+	if (ret)
+		return ret;
+
+	hash_del(&user->node);
+	clear_bit(user->index, page_bitmap);
+	free_user_event(user);
+
+	return 0;
+}
+
+/* Add @user to the refs of @file, returning its index there */
+static int user_events_ref_add(struct file *file, struct user_event *user)
+{
+	struct user_event_refs *refs, *new_refs;
+	int i, size, count = 0;
+
+	lockdep_assert_held(&reg_mutex);
+
+	refs = rcu_dereference_protected(file->private_data,
+					 lockdep_is_held(&reg_mutex));
+	if (refs) {
+		count = refs->count;
+		for (i = 0; i < count; i++) {
+			if (refs->events[i] == user)
+				return i;
+		}
+	}
+
+	size = struct_size(new_refs, events, count + 1);
+	new_refs = kzalloc(size, GFP_KERNEL);
+	if (!new_refs)
+		return -ENOMEM;
+
+	new_refs->count = count + 1;
+	for (i = 0; i < count; i++)
+		new_refs->events[i] = refs->events[i];
+	new_refs->events[i] = user;
+
+	atomic_inc(&user->refcnt);
+	rcu_assign_pointer(file->private_data, new_refs);
+	if (refs)
+		kfree_rcu(refs, rcu);
+
+	return i;
+}
+
+static long user_events_ioctl_reg(struct file *file, unsigned long uarg)
+{
+	struct user_reg __user *ureg = (struct user_reg __user *)uarg;
+	struct user_event *user;
+	struct user_reg reg;
+	char *desc;
+	long ret;
+	u32 size;
+
+	if (get_user(size, &ureg->size))
+		return -EFAULT;
+	if (size < offsetofend(struct user_reg, write_index))
+		return -EINVAL;
+	if (copy_from_user(&reg, ureg, sizeof(reg)))
+		return -EFAULT;
+
+	desc = strndup_user(u64_to_user_ptr(reg.name_args), MAX_EVENT_DESC);
+	if (IS_ERR(desc))
+		return PTR_ERR(desc);
+
+	mutex_lock(&reg_mutex);
+	user = user_event_parse_cmd(desc);
+	if (IS_ERR(user)) {
+		ret = PTR_ERR(user);
+		goto out;
+	}
+
+	ret = user_events_ref_add(file, user);
+	if (ret < 0)
+		goto out;
+
+	if (put_user((u32)user->index, &ureg->status_index) ||
+	    put_user((u32)ret, &ureg->write_index))
+		ret = -EFAULT;
+	else
+		ret = 0;
+out:
+	mutex_unlock(&reg_mutex);
+	kfree(desc);
+	return ret;
+}
+
+static long user_events_ioctl_del(struct file *file, unsigned long uarg)
+{
+	char *name;
+	long ret;
+
+	name = strndup_user((const char __user *)uarg, MAX_EVENT_DESC);
+	if (IS_ERR(name))
+		return PTR_ERR(name);
+
+	mutex_lock(&reg_mutex);
+	ret = delete_user_event(name);
+	mutex_unlock(&reg_mutex);
+
+	kfree(name);
+	return ret;
+}
+
+static long user_events_ioctl(struct file *file, unsigned int cmd,
+			      unsigned long uarg)
+{
+	switch (cmd) {
+	case DIAG_IOCSREG:
+		return user_events_ioctl_reg(file, uarg);
+	case DIAG_IOCSDEL:
+		return user_events_ioctl_del(file, uarg);
+	}
+
+	return -ENOTTY;
+}
+
+static ssize_t user_events_write_core(struct file *file, struct iov_iter *i)
+{
+	struct user_event_refs *refs;
+	struct user_event *user = NULL;
+	ssize_t ret = i->count;
+	struct tracepoint *tp;
+	u32 idx;
+
+	if (unlikely(copy_from_iter(&idx, sizeof(idx), i) != sizeof(idx)))
+		return -EFAULT;
+
+	/* the events of the refs live as long as the file */
+	rcu_read_lock_sched();
+	refs = rcu_dereference_sched(file->private_data);
+	if (likely(refs && idx < refs->count))
+		user = refs->events[idx];
+	rcu_read_unlock_sched();
+
+	if (unlikely(!user))
+		return -ENOENT;
+
+	if (unlikely(i->count < user->min_size))
+		return -EINVAL;
+
+	tp = &user->tp;
+	if (likely(atomic_read(&tp->key.enabled) > 0)) {
+		struct tracepoint_func *probe_func_ptr;
+		user_event_func_t probe_func;
+		struct iov_iter copy;
+		void *tpdata;
+
+		if (unlikely(iov_iter_fault_in_readable(i, i->count)))
+			return -EFAULT;
+
+		preempt_disable();
+
+		if (unlikely(!cpu_online(raw_smp_processor_id())))
+			goto out;
+
+		probe_func_ptr = rcu_dereference_sched(tp->funcs);
+		if (probe_func_ptr) {
+			do {
+				/* each probe copies the payload */
+				copy = *i;
+				probe_func = probe_func_ptr->func;
+				tpdata = probe_func_ptr->data;
+				probe_func(user, &copy, tpdata);
+			} while ((++probe_func_ptr)->func);
+		}
+out:
+		preempt_enable();
+	}
+
+	return ret;
+}
+
+static ssize_t user_events_write(struct file *file, const char __user *ubuf,
+				 size_t count, loff_t *ppos)
+{
+	struct iovec iov;
+	struct iov_iter i;
+
+	if (unlikely(*ppos != 0))
+		return -EFAULT;
+
+	if (unlikely(import_single_range(WRITE, (char __user *)ubuf, count,
+					 &iov, &i)))
+		return -EFAULT;
+
+	return user_events_write_core(file, &i);
+}
+
+static ssize_t user_events_write_iter(struct kiocb *kp, struct iov_iter *i)
+{
+	return user_events_write_core(kp->ki_filp, i);
+}
+
+static int user_events_release(struct inode *node, struct file *file)
+{
+	struct user_event_refs *refs;
+	int i;
+
+	/* no write nor ioctl can run anymore */
+	refs = file->private_data;
+	if (!refs)
+		return 0;
+
+	for (i = 0; i < refs->count; i++)
+		atomic_dec(&refs->events[i]->refcnt);
+
+	kfree_rcu(refs, rcu);
+	file->private_data = NULL;
+
+	return 0;
+}
+
+static const struct file_operations user_data_fops = {
+	.open		= tracing_open_generic,
+	.write		= user_events_write,
+	.write_iter	= user_events_write_iter,
+	.unlocked_ioctl	= user_events_ioctl,
+	.release	= user_events_release,
+};
+
+static int user_status_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+
+	if (size != PAGE_SIZE)
+		return -EINVAL;
+
+	/* the status bytes are for the kernel to write */
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       virt_to_phys(register_page_data) >> PAGE_SHIFT,
+			       size, vm_get_page_prot(VM_READ));
+}
+
+static int user_status_show(struct seq_file *m, void *p)
+{
+	struct user_event *user;
+	int i, active = 0, busy = 0;
+	char status;
+
+	mutex_lock(&reg_mutex);
+	hash_for_each(register_table, i, user, node) {
+		status = register_page_data[user->index];
+
+		seq_printf(m, "%d:%s", user->index, EVENT_NAME(user));
+		if (status) {
+			seq_puts(m, " #");
+			if (status & EVENT_STATUS_FTRACE)
+				seq_puts(m, " Used by ftrace");
+			if (status & EVENT_STATUS_PERF)
+				seq_puts(m, " Used by perf");
+			busy++;
+		}
+		seq_putc(m, '\n');
+		active++;
+	}
+	mutex_unlock(&reg_mutex);
+
+	seq_puts(m, "\n");
+	seq_printf(m, "Active: %d\n", active);
+	seq_printf(m, "Busy: %d\n", busy);
+	seq_printf(m, "Max: %lu\n", MAX_EVENTS);
+
+	return 0;
+}
+
+static int user_status_open(struct inode *node, struct file *file)
+{
+	return single_open(file, user_status_show, NULL);
+}
+
+static const struct file_operations user_status_fops = {
+	.open		= user_status_open,
+	.mmap		= user_status_mmap,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static __init int trace_events_user_init(void)
+{
+	struct dentry *d_tracer;
+	struct page *page;
+
+	d_tracer = tracing_init_dentry();
+	if (IS_ERR(d_tracer))
+		return 0;
+
+	page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (!page)
+		return -ENOMEM;
+	/* mapped to user space */
+	SetPageReserved(page);
+	register_page_data = page_address(page);
+
+	trace_create_file("user_events_data", 0644, d_tracer, NULL,
+			  &user_data_fops);
+	trace_create_file("user_events_status", 0644, d_tracer, NULL,
+			  &user_status_fops);
+
+	return 0;
+}
+
+fs_initcall(trace_events_user_init);
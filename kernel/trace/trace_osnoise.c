@@ -0,0 +1,965 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * trace_osnoise.c - OS noise and timer latency tracers.
+ *
+ * The osnoise tracer runs a thread per CPU which, for "runtime" out of
+ * every "period" microseconds, reads the time in a loop with preemption
+ * and interrupts enabled. Any gap between two consecutive readings longer
+ * than tracing_thresh is noise: the time the CPU was taken away from the
+ * thread. The NMIs, IRQs, softirqs and threads which interfere with the
+ * thread are counted, a noise no interference accounts for is counted as
+ * hardware noise (SMIs and the like, see the hwlat tracer). A sample of
+ * the noise of each period is recorded in the trace.
+ *
+ * The timerlat tracer runs a real time thread per CPU, which arms a timer
+ * every "timerlat_period" microseconds and waits for it. The latency of
+ * the timer IRQ and the one of the wakeup of the thread, from the time the
+ * timer was set to expire at, are recorded in the trace.
+ *
+ * Both tracers keep a histogram of the latencies they measure per CPU,
+ * and can stop tracing when a latency is over a threshold, to keep the
+ * events which led to it at the end of the trace.
+ *
+ * Like hwlat, these tracers take the CPUs they run on, which is the
+ * point when tuning isolated CPUs, but not something to do on a
+ * production system otherwise.
+ */
+#include <linux/kthread.h>
+#include <linux/tracefs.h>
+#include <linux/uaccess.h>
+#include <linux/cpumask.h>
+#include <linux/delay.h>
+#include <linux/hrtimer.h>
+#include <linux/seq_file.h>
+#include <linux/sched/rt.h>
+#include <uapi/linux/sched/types.h>
+#include <linux/sched/clock.h>
+#include <trace/events/irq.h>
+#include <trace/events/sched.h>
+#ifdef CONFIG_X86_LOCAL_APIC
+#include <asm/trace/irq_vectors.h>
+#endif
+#include <asm/local.h>
+#include "trace.h"
+
+static struct trace_array	*osnoise_trace;
+
+#define U64STR_SIZE		22			/* 20 digits max */
+
+#define BANNER			"osnoise: "
+#define DEFAULT_SAMPLE_PERIOD	1000000			/* 1s */
+#define DEFAULT_SAMPLE_RUNTIME	1000000			/* 1s */
+#define DEFAULT_TIMERLAT_PERIOD	1000			/* 1ms */
+#define DEFAULT_NOISE_THRESHOLD	5			/* 5us */
+#define DEFAULT_TIMERLAT_PRIO	95
+
+/* Histograms have buckets of 1us, the last one counts all the longer */
+#define OSNOISE_HIST_BUCKETS	128
+
+/* Save the previous tracing_thresh value */
+static unsigned long save_tracing_thresh;
+
+/* If the user changed threshold, remember it */
+static u64 last_tracing_thresh = DEFAULT_NOISE_THRESHOLD * NSEC_PER_USEC;
+
+/* Tells NMIs to call back to the osnoise tracer to count them */
+bool trace_osnoise_callback_enabled;
+
+enum {
+	TIMERLAT_IRQ,
+	TIMERLAT_THREAD,
+};
+
+/* The state of the tracers on each CPU */
+struct osnoise_variables {
+	struct task_struct	*kthread;
+	bool			sampling;
+	/* changes whenever an interference starts or ends */
+	local_t			int_counter;
+	unsigned int		nmi_count;
+	unsigned int		irq_count;
+	unsigned int		softirq_count;
+	unsigned int		thread_count;
+	/* timerlat */
+	struct hrtimer		timer;
+	u64			abs_period;
+	unsigned int		seqnum;
+	u64			noise_hist[OSNOISE_HIST_BUCKETS];
+	u64			irq_hist[OSNOISE_HIST_BUCKETS];
+	u64			thread_hist[OSNOISE_HIST_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct osnoise_variables, per_cpu_osnoise_var);
+
+#define this_cpu_osn_var()	this_cpu_ptr(&per_cpu_osnoise_var)
+
+/* Per period counts of a sample of the osnoise tracer */
+struct osnoise_sample {
+	u64			runtime;	/* runtime, us */
+	u64			noise;		/* noise, us */
+	u64			max_sample;	/* max single noise, us */
+	unsigned int		hw_count;
+	unsigned int		nmi_count;
+	unsigned int		irq_count;
+	unsigned int		softirq_count;
+	unsigned int		thread_count;
+};
+
+/* keep the global state somewhere. */
+static struct osnoise_data {
+
+	struct mutex lock;		/* protect changes */
+
+	u64	sample_period;		/* osnoise period, us */
+	u64	sample_runtime;		/* osnoise sampling part of it, us */
+	u64	stop_tracing;		/* stop on a noise or IRQ latency, us */
+	u64	stop_tracing_total;	/* stop on a total or thread lat, us */
+	u64	timerlat_period;	/* timerlat period, us */
+	bool	timerlat;		/* the timerlat tracer runs */
+
+} osnoise_data = {
+	.sample_period		= DEFAULT_SAMPLE_PERIOD,
+	.sample_runtime		= DEFAULT_SAMPLE_RUNTIME,
+	.timerlat_period	= DEFAULT_TIMERLAT_PERIOD,
+};
+
+static void trace_osnoise_sample(struct osnoise_sample *sample)
+{
+	struct trace_array *tr = osnoise_trace;
+	struct trace_event_call *call = &event_osnoise;
+	struct ring_buffer *buffer = tr->trace_buffer.buffer;
+	struct ring_buffer_event *event;
+	struct osnoise_entry *entry;
+	unsigned long flags;
+	int pc;
+
+	pc = preempt_count();
+	local_save_flags(flags);
+
+	event = trace_buffer_lock_reserve(buffer, TRACE_OSNOISE,
+					  sizeof(*entry), flags, pc);
+	if (!event)
+		return;
+	entry	= ring_buffer_event_data(event);
+	entry->runtime			= sample->runtime;
+	entry->noise			= sample->noise;
+	entry->max_sample		= sample->max_sample;
+	entry->hw_count			= sample->hw_count;
+	entry->nmi_count		= sample->nmi_count;
+	entry->irq_count		= sample->irq_count;
+	entry->softirq_count		= sample->softirq_count;
+	entry->thread_count		= sample->thread_count;
+
+	if (!call_filter_check_discard(call, entry, buffer, event))
+		trace_buffer_unlock_commit_nostack(buffer, event);
+}
+
+static void trace_timerlat_sample(unsigned int seqnum, int context,
+				  u64 latency)
+{
+	struct trace_array *tr = osnoise_trace;
+	struct trace_event_call *call = &event_timerlat;
+	struct ring_buffer *buffer = tr->trace_buffer.buffer;
+	struct ring_buffer_event *event;
+	struct timerlat_entry *entry;
+	unsigned long flags;
+	int pc;
+
+	pc = preempt_count();
+	local_save_flags(flags);
+
+	event = trace_buffer_lock_reserve(buffer, TRACE_TIMERLAT,
+					  sizeof(*entry), flags, pc);
+	if (!event)
+		return;
+	entry	= ring_buffer_event_data(event);
+	entry->seqnum			= seqnum;
+	entry->context			= context;
+	entry->timer_latency		= latency;
+
+	if (!call_filter_check_discard(call, entry, buffer, event))
+		trace_buffer_unlock_commit_nostack(buffer, event);
+}
+
+/* Macros to encapsulate the time capturing infrastructure */
+#define time_get()	trace_clock_local()
+#define time_to_us(x)	div_u64(x, 1000)
+#define time_sub(a, b)	((a) - (b))
+
+static void osnoise_hist_add(u64 *hist, u64 latency)
+{
+	u64 bucket = time_to_us(latency);
+
+	if (bucket >= OSNOISE_HIST_BUCKETS)
+		bucket = OSNOISE_HIST_BUCKETS - 1;
+	hist[bucket]++;
+}
+
+/* Keep the events which led to the latency at the end of the trace */
+static void osnoise_stop_tracing(void)
+{
+	tracer_tracing_off(osnoise_trace);
+}
+
+/*
+ * Interferences are only counted while they take the CPU away from the
+ * osnoise thread: the ones which hit the tasks preempting it are part of
+ * the thread noise.
+ */
+static struct osnoise_variables *osnoise_interfering(void)
+{
+	struct osnoise_variables *osn_var = this_cpu_osn_var();
+
+	if (!osn_var->sampling || current != osn_var->kthread)
+		return NULL;
+	return osn_var;
+}
+
+void trace_osnoise_callback(bool enter)
+{
+	struct osnoise_variables *osn_var = osnoise_interfering();
+
+	if (!osn_var)
+		return;
+
+	if (enter)
+		osn_var->nmi_count++;
+	local_inc(&osn_var->int_counter);
+}
+
+static void osnoise_irq_entry(void *data, int irq, struct irqaction *action)
+{
+	struct osnoise_variables *osn_var = osnoise_interfering();
+
+	if (!osn_var)
+		return;
+
+	osn_var->irq_count++;
+	local_inc(&osn_var->int_counter);
+}
+
+static void osnoise_irq_exit(void *data, int irq, struct irqaction *action,
+			     int ret)
+{
+	struct osnoise_variables *osn_var = osnoise_interfering();
+
+	if (osn_var)
+		local_inc(&osn_var->int_counter);
+}
+
+#ifdef CONFIG_X86_LOCAL_APIC
+/* The timer and IPI vectors don't go through irq_handler_entry */
+static void osnoise_vector_entry(void *data, int vector)
+{
+	osnoise_irq_entry(data, vector, NULL);
+}
+
+static void osnoise_vector_exit(void *data, int vector)
+{
+	osnoise_irq_exit(data, vector, NULL, 0);
+}
+
+#define osnoise_vector_events(func)					\
+	func(local_timer)						\
+	func(reschedule)						\
+	func(call_function)						\
+	func(call_function_single)					\
+	func(irq_work)
+
+#define osnoise_register_vector(name)					\
+	register_trace_##name##_entry(osnoise_vector_entry, NULL);	\
+	register_trace_##name##_exit(osnoise_vector_exit, NULL);
+
+#define osnoise_unregister_vector(name)					\
+	unregister_trace_##name##_entry(osnoise_vector_entry, NULL);	\
+	unregister_trace_##name##_exit(osnoise_vector_exit, NULL);
+
+static void osnoise_hook_vectors(void)
+{
+	osnoise_vector_events(osnoise_register_vector)
+}
+
+static void osnoise_unhook_vectors(void)
+{
+	osnoise_vector_events(osnoise_unregister_vector)
+}
+#else
+static inline void osnoise_hook_vectors(void) { }
+static inline void osnoise_unhook_vectors(void) { }
+#endif
+
+static void osnoise_softirq_entry(void *data, unsigned int vec_nr)
+{
+	struct osnoise_variables *osn_var = osnoise_interfering();
+
+	if (!osn_var)
+		return;
+
+	osn_var->softirq_count++;
+	local_inc(&osn_var->int_counter);
+}
+
+static void osnoise_softirq_exit(void *data, unsigned int vec_nr)
+{
+	struct osnoise_variables *osn_var = osnoise_interfering();
+
+	if (osn_var)
+		local_inc(&osn_var->int_counter);
+}
+
+static void osnoise_sched_switch(void *data, bool preempt,
+				 struct task_struct *prev,
+				 struct task_struct *next)
+{
+	struct osnoise_variables *osn_var = this_cpu_osn_var();
+
+	if (!osn_var->sampling)
+		return;
+
+	if (prev == osn_var->kthread) {
+		osn_var->thread_count++;
+		local_inc(&osn_var->int_counter);
+	} else if (next == osn_var->kthread) {
+		local_inc(&osn_var->int_counter);
+	}
+}
+
+static void osnoise_hook_events(void)
+{
+	register_trace_irq_handler_entry(osnoise_irq_entry, NULL);
+	register_trace_irq_handler_exit(osnoise_irq_exit, NULL);
+	register_trace_softirq_entry(osnoise_softirq_entry, NULL);
+	register_trace_softirq_exit(osnoise_softirq_exit, NULL);
+	register_trace_sched_switch(osnoise_sched_switch, NULL);
+	osnoise_hook_vectors();
+	trace_osnoise_callback_enabled = true;
+}
+
+static void osnoise_unhook_events(void)
+{
+	trace_osnoise_callback_enabled = false;
+	osnoise_unhook_vectors();
+	unregister_trace_sched_switch(osnoise_sched_switch, NULL);
+	unregister_trace_softirq_exit(osnoise_softirq_exit, NULL);
+	unregister_trace_softirq_entry(osnoise_softirq_entry, NULL);
+	unregister_trace_irq_handler_exit(osnoise_irq_exit, NULL);
+	unregister_trace_irq_handler_entry(osnoise_irq_entry, NULL);
+	tracepoint_synchronize_unregister();
+}
+
+/*
+ * Read the time along with the interference counter, retrying if an
+ * interference started or ended meanwhile, so that the noise between two
+ * readings can be told apart from the interferences it contains.
+ */
+static u64 set_int_safe_time(struct osnoise_variables *osn_var, u64 *time)
+{
+	u64 int_counter;
+
+	do {
+		int_counter = local_read(&osn_var->int_counter);
+		/* synchronize with interrupts */
+		barrier();
+		*time = time_get();
+		/* synchronize with interrupts */
+		barrier();
+	} while (int_counter != local_read(&osn_var->int_counter));
+
+	return int_counter;
+}
+
+/**
+ * run_osnoise - sample the noise of the CPU for a runtime
+ *
+ * Reads the time in a loop, with preemption and interrupts enabled, and
+ * accounts the gaps over tracing_thresh between two readings as noise.
+ * Returns 0 once the runtime sampled, -1 if the time went backwards.
+ */
+static int run_osnoise(struct osnoise_variables *osn_var)
+{
+	u64 last_int_count, int_count, start, sample, last_sample;
+	u64 stop_in, stop_total, runtime, threshold;
+	unsigned int nmi, irq, softirq, thread;
+	struct osnoise_sample s = {};
+	s64 total, last_total = 0;
+	u64 max_noise = 0;
+	u64 sum_noise = 0;
+	s64 noise;
+	int ret = -1;
+
+	threshold = tracing_thresh;
+	runtime = osnoise_data.sample_runtime * NSEC_PER_USEC;
+	stop_in = osnoise_data.stop_tracing * NSEC_PER_USEC;
+	stop_total = osnoise_data.stop_tracing_total * NSEC_PER_USEC;
+
+	nmi = osn_var->nmi_count;
+	irq = osn_var->irq_count;
+	softirq = osn_var->softirq_count;
+	thread = osn_var->thread_count;
+
+	osn_var->sampling = true;
+	/* Make sure interrupts see this first */
+	barrier();
+
+	last_int_count = set_int_safe_time(osn_var, &last_sample);
+	start = last_sample;
+
+	do {
+		int_count = set_int_safe_time(osn_var, &sample);
+
+		noise = time_sub(sample, last_sample);
+		/* This shouldn't happen */
+		if (noise < 0) {
+			pr_err(BANNER "time running backwards\n");
+			goto out;
+		}
+
+		total = time_sub(sample, start);
+		/* Check for possible overflows */
+		if (total < last_total) {
+			pr_err(BANNER "time total overflowed\n");
+			goto out;
+		}
+		last_total = total;
+
+		if (noise >= threshold) {
+			/* nothing the kernel knows of took the CPU */
+			if (int_count == last_int_count)
+				s.hw_count++;
+
+			sum_noise += noise;
+			if (noise > max_noise)
+				max_noise = noise;
+			osnoise_hist_add(osn_var->noise_hist, noise);
+
+			if (stop_in && noise >= stop_in)
+				osnoise_stop_tracing();
+		}
+
+		last_sample = sample;
+		last_int_count = int_count;
+
+		/*
+		 * Without preemption, let the tasks which need the CPU have
+		 * it: the time they take is thread noise.
+		 */
+		if (!IS_ENABLED(CONFIG_PREEMPT))
+			cond_resched();
+
+	} while (total < runtime && !kthread_should_stop());
+
+	/* finish the above in the view for interrupts */
+	barrier();
+	osn_var->sampling = false;
+	barrier();
+
+	s.runtime = time_to_us(total);
+	s.noise = time_to_us(sum_noise);
+	s.max_sample = time_to_us(max_noise);
+	s.nmi_count = osn_var->nmi_count - nmi;
+	s.irq_count = osn_var->irq_count - irq;
+	s.softirq_count = osn_var->softirq_count - softirq;
+	s.thread_count = osn_var->thread_count - thread;
+	trace_osnoise_sample(&s);
+
+	/* Keep a running maximum ever recorded noise */
+	if (s.max_sample > osnoise_trace->max_latency)
+		osnoise_trace->max_latency = s.max_sample;
+
+	if (stop_total && sum_noise >= stop_total)
+		osnoise_stop_tracing();
+
+	ret = 0;
+out:
+	osn_var->sampling = false;
+	return ret;
+}
+
+static int osnoise_main(void *data)
+{
+	struct osnoise_variables *osn_var;
+	u64 interval;
+
+	osn_var = per_cpu_ptr(&per_cpu_osnoise_var, (long)data);
+
+	while (!kthread_should_stop()) {
+		if (run_osnoise(osn_var))
+			break;
+
+		mutex_lock(&osnoise_data.lock);
+		interval = osnoise_data.sample_period -
+			osnoise_data.sample_runtime;
+		mutex_unlock(&osnoise_data.lock);
+
+		do_div(interval, USEC_PER_MSEC); /* modifies interval value */
+
+		if (interval && msleep_interruptible(interval))
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * The timer IRQ records its latency, then wakes the thread up, which
+ * records its own.
+ */
+static enum hrtimer_restart timerlat_irq(struct hrtimer *timer)
+{
+	struct osnoise_variables *osn_var;
+	s64 latency;
+
+	osn_var = container_of(timer, struct osnoise_variables, timer);
+	latency = ktime_to_ns(ktime_get()) - osn_var->abs_period;
+	if (latency < 0)
+		latency = 0;
+
+	osn_var->seqnum++;
+	trace_timerlat_sample(osn_var->seqnum, TIMERLAT_IRQ, latency);
+	osnoise_hist_add(osn_var->irq_hist, latency);
+
+	if (osnoise_data.stop_tracing &&
+	    latency >= osnoise_data.stop_tracing * NSEC_PER_USEC)
+		osnoise_stop_tracing();
+
+	wake_up_process(osn_var->kthread);
+
+	return HRTIMER_NORESTART;
+}
+
+static int timerlat_main(void *data)
+{
+	struct sched_param sp = { .sched_priority = DEFAULT_TIMERLAT_PRIO };
+	struct osnoise_variables *osn_var;
+	s64 latency;
+
+	osn_var = per_cpu_ptr(&per_cpu_osnoise_var, (long)data);
+	sched_setscheduler_nocheck(current, SCHED_FIFO, &sp);
+
+	hrtimer_init(&osn_var->timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_ABS_PINNED);
+	osn_var->timer.function = timerlat_irq;
+	osn_var->abs_period = ktime_to_ns(ktime_get());
+
+	while (!kthread_should_stop()) {
+		osn_var->abs_period += osnoise_data.timerlat_period *
+			NSEC_PER_USEC;
+
+		/* the timer IRQ sets us running if it fires before we sleep */
+		set_current_state(TASK_INTERRUPTIBLE);
+		hrtimer_start(&osn_var->timer, ns_to_ktime(osn_var->abs_period),
+			      HRTIMER_MODE_ABS_PINNED);
+		schedule();
+		__set_current_state(TASK_RUNNING);
+
+		if (kthread_should_stop())
+			break;
+
+		latency = ktime_to_ns(ktime_get()) - osn_var->abs_period;
+		/* woken up before the timer fired */
+		if (latency < 0) {
+			hrtimer_cancel(&osn_var->timer);
+			continue;
+		}
+
+		trace_timerlat_sample(osn_var->seqnum, TIMERLAT_THREAD,
+				      latency);
+		osnoise_hist_add(osn_var->thread_hist, latency);
+
+		if (osnoise_data.stop_tracing_total &&
+		    latency >= osnoise_data.stop_tracing_total * NSEC_PER_USEC)
+			osnoise_stop_tracing();
+	}
+
+	hrtimer_cancel(&osn_var->timer);
+	return 0;
+}
+
+static void stop_kthreads(void)
+{
+	struct osnoise_variables *osn_var;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		osn_var = per_cpu_ptr(&per_cpu_osnoise_var, cpu);
+		if (!osn_var->kthread)
+			continue;
+		kthread_stop(osn_var->kthread);
+		osn_var->kthread = NULL;
+	}
+}
+
+/**
+ * start_kthreads - Start a sampling thread on each CPU traced
+ *
+ * The threads run on the online CPUs of the tracing_cpumask of the
+ * instance, as they are when the tracer starts.
+ */
+static int start_kthreads(struct trace_array *tr)
+{
+	int (*fn)(void *) = osnoise_data.timerlat ? timerlat_main :
+						    osnoise_main;
+	const char *name = osnoise_data.timerlat ? "timerlat/%u" :
+						   "osnoise/%u";
+	struct osnoise_variables *osn_var;
+	struct task_struct *kthread;
+	long cpu;
+
+	get_online_cpus();
+	for_each_cpu_and(cpu, cpu_online_mask, tr->tracing_cpumask) {
+		osn_var = per_cpu_ptr(&per_cpu_osnoise_var, cpu);
+		if (WARN_ON(osn_var->kthread))
+			continue;
+
+		kthread = kthread_create_on_cpu(fn, (void *)cpu, cpu, name);
+		if (IS_ERR(kthread)) {
+			put_online_cpus();
+			pr_err(BANNER "could not start sampling thread\n");
+			stop_kthreads();
+			return -ENOMEM;
+		}
+
+		osn_var->kthread = kthread;
+		wake_up_process(kthread);
+	}
+	put_online_cpus();
+
+	return 0;
+}
+
+/*
+ * osnoise_read - Wrapper read function for reading the osnoise settings
+ * @filp: The active open file structure
+ * @ubuf: The userspace provided buffer to read value into
+ * @cnt: The maximum number of bytes to read
+ * @ppos: The current "file" position
+ */
+static ssize_t osnoise_read(struct file *filp, char __user *ubuf,
+			    size_t cnt, loff_t *ppos)
+{
+	char buf[U64STR_SIZE];
+	u64 *entry = filp->private_data;
+	u64 val;
+	int len;
+
+	if (!entry)
+		return -EFAULT;
+
+	if (cnt > sizeof(buf))
+		cnt = sizeof(buf);
+
+	val = *entry;
+
+	len = snprintf(buf, sizeof(buf), "%llu\n", val);
+
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, len);
+}
+
+/*
+ * osnoise_write - Write function for the osnoise settings
+ *
+ * The runtime must not be longer than the period, and the timerlat period
+ * is within [100us, 1s]. The stop tracing thresholds can be zero, for no
+ * threshold. The new values apply to the next sample.
+ */
+static ssize_t osnoise_write(struct file *filp, const char __user *ubuf,
+			     size_t cnt, loff_t *ppos)
+{
+	u64 *entry = filp->private_data;
+	u64 val;
+	int err;
+
+	err = kstrtoull_from_user(ubuf, cnt, 10, &val);
+	if (err)
+		return err;
+
+	mutex_lock(&osnoise_data.lock);
+	if (entry == &osnoise_data.sample_period) {
+		if (!val || val < osnoise_data.sample_runtime)
+			err = -EINVAL;
+	} else if (entry == &osnoise_data.sample_runtime) {
+		if (!val || val > osnoise_data.sample_period)
+			err = -EINVAL;
+	} else if (entry == &osnoise_data.timerlat_period) {
+		if (val < 100 || val > USEC_PER_SEC)
+			err = -EINVAL;
+	}
+	if (!err)
+		*entry = val;
+	mutex_unlock(&osnoise_data.lock);
+
+	if (err)
+		return err;
+
+	return cnt;
+}
+
+static const struct file_operations osnoise_fops = {
+	.open		= tracing_open_generic,
+	.read		= osnoise_read,
+	.write		= osnoise_write,
+};
+
+/*
+ * The histograms show a line per microsecond of latency with a count
+ * for some CPU, and a column per CPU (two for timerlat: IRQ and thread).
+ */
+static void osnoise_hist_header(struct seq_file *m, bool timerlat)
+{
+	int cpu;
+
+	seq_puts(m, "# us");
+	for_each_online_cpu(cpu) {
+		if (timerlat)
+			seq_printf(m, "\t IRQ-%03d\t Thr-%03d", cpu, cpu);
+		else
+			seq_printf(m, "\t CPU-%03d", cpu);
+	}
+	seq_putc(m, '\n');
+}
+
+static int osnoise_hist_show(struct seq_file *m, void *v)
+{
+	bool timerlat = (bool)m->private;
+	struct osnoise_variables *osn_var;
+	bool empty;
+	int cpu;
+	int i;
+
+	osnoise_hist_header(m, timerlat);
+
+	for (i = 0; i < OSNOISE_HIST_BUCKETS; i++) {
+		empty = true;
+		for_each_online_cpu(cpu) {
+			osn_var = per_cpu_ptr(&per_cpu_osnoise_var, cpu);
+			if (timerlat ? osn_var->irq_hist[i] ||
+				       osn_var->thread_hist[i] :
+				       osn_var->noise_hist[i])
+				empty = false;
+		}
+		if (empty)
+			continue;
+
+		if (i == OSNOISE_HIST_BUCKETS - 1)
+			seq_printf(m, ">=%d", i);
+		else
+			seq_printf(m, "%d", i);
+
+		for_each_online_cpu(cpu) {
+			osn_var = per_cpu_ptr(&per_cpu_osnoise_var, cpu);
+			if (timerlat)
+				seq_printf(m, "\t%8llu\t%8llu",
+					   osn_var->irq_hist[i],
+					   osn_var->thread_hist[i]);
+			else
+				seq_printf(m, "\t%8llu",
+					   osn_var->noise_hist[i]);
+		}
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
+
+static int osnoise_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, osnoise_hist_show, inode->i_private);
+}
+
+static const struct file_operations osnoise_hist_fops = {
+	.open		= osnoise_hist_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/**
+ * init_tracefs - A function to initialize the tracefs interface files
+ *
+ * This function creates the osnoise directory in the tracing directory,
+ * with the files to change and view the settings of the tracers, and
+ * the histograms of the latencies they measured in their last run:
+ *
+ *  period_us             - osnoise: sampling period
+ *  runtime_us            - osnoise: time sampled in each period
+ *  stop_tracing_us       - stop tracing on a single noise, or a timer IRQ
+ *                          latency, at least this long (0: never)
+ *  stop_tracing_total_us - stop tracing on a noise in a period, or a
+ *                          thread latency, at least this long (0: never)
+ *  timerlat_period_us    - timerlat: timer period
+ *  osnoise_hist          - histogram of the noises, per CPU
+ *  timerlat_hist         - histogram of the latencies, per CPU
+ */
+static int init_tracefs(void)
+{
+	struct dentry *d_tracer;
+	struct dentry *top_dir;
+
+	d_tracer = tracing_init_dentry();
+	if (IS_ERR(d_tracer))
+		return -ENOMEM;
+
+	top_dir = tracefs_create_dir("osnoise", d_tracer);
+	if (!top_dir)
+		return -ENOMEM;
+
+	if (!tracefs_create_file("period_us", 0640, top_dir,
+				 &osnoise_data.sample_period, &osnoise_fops))
+		goto err;
+
+	if (!tracefs_create_file("runtime_us", 0640, top_dir,
+				 &osnoise_data.sample_runtime, &osnoise_fops))
+		goto err;
+
+	if (!tracefs_create_file("stop_tracing_us", 0640, top_dir,
+				 &osnoise_data.stop_tracing, &osnoise_fops))
+		goto err;
+
+	if (!tracefs_create_file("stop_tracing_total_us", 0640, top_dir,
+				 &osnoise_data.stop_tracing_total,
+				 &osnoise_fops))
+		goto err;
+
+	if (!tracefs_create_file("timerlat_period_us", 0640, top_dir,
+				 &osnoise_data.timerlat_period, &osnoise_fops))
+		goto err;
+
+	if (!tracefs_create_file("osnoise_hist", 0444, top_dir,
+				 (void *)false, &osnoise_hist_fops))
+		goto err;
+
+	if (!tracefs_create_file("timerlat_hist", 0444, top_dir,
+				 (void *)true, &osnoise_hist_fops))
+		goto err;
+
+	return 0;
+
+ err:
+	tracefs_remove_recursive(top_dir);
+	return -ENOMEM;
+}
+
+static void osnoise_tracer_start(struct trace_array *tr)
+{
+	int err;
+
+	if (!osnoise_data.timerlat)
+		osnoise_hook_events();
+
+	err = start_kthreads(tr);
+	if (err) {
+		pr_err(BANNER "Cannot start the sampling threads\n");
+		if (!osnoise_data.timerlat)
+			osnoise_unhook_events();
+	}
+}
+
+static void osnoise_tracer_stop(struct trace_array *tr)
+{
+	bool hooked = trace_osnoise_callback_enabled;
+
+	stop_kthreads();
+	if (hooked)
+		osnoise_unhook_events();
+}
+
+static bool osnoise_busy;
+
+static int __osnoise_tracer_init(struct trace_array *tr, bool timerlat)
+{
+	struct osnoise_variables *osn_var;
+	int cpu;
+
+	/* Only allow one instance, and one of the tracers, to run */
+	if (osnoise_busy)
+		return -EBUSY;
+
+	osnoise_trace = tr;
+	osnoise_data.timerlat = timerlat;
+
+	for_each_possible_cpu(cpu) {
+		osn_var = per_cpu_ptr(&per_cpu_osnoise_var, cpu);
+		memset(osn_var->noise_hist, 0, sizeof(osn_var->noise_hist));
+		memset(osn_var->irq_hist, 0, sizeof(osn_var->irq_hist));
+		memset(osn_var->thread_hist, 0, sizeof(osn_var->thread_hist));
+		osn_var->seqnum = 0;
+	}
+	tr->max_latency = 0;
+	save_tracing_thresh = tracing_thresh;
+
+	/* tracing_thresh is in nsecs, we speak in usecs */
+	if (!tracing_thresh)
+		tracing_thresh = last_tracing_thresh;
+
+	if (tracer_tracing_is_on(tr))
+		osnoise_tracer_start(tr);
+
+	osnoise_busy = true;
+
+	return 0;
+}
+
+static int osnoise_tracer_init(struct trace_array *tr)
+{
+	return __osnoise_tracer_init(tr, false);
+}
+
+static void osnoise_tracer_reset(struct trace_array *tr)
+{
+	osnoise_tracer_stop(tr);
+
+	/* the tracing threshold is static between runs */
+	last_tracing_thresh = tracing_thresh;
+
+	tracing_thresh = save_tracing_thresh;
+	osnoise_busy = false;
+}
+
+static struct tracer osnoise_tracer __read_mostly =
+{
+	.name		= "osnoise",
+	.init		= osnoise_tracer_init,
+	.reset		= osnoise_tracer_reset,
+	.start		= osnoise_tracer_start,
+	.stop		= osnoise_tracer_stop,
+	.allow_instances = true,
+};
+
+#ifdef CONFIG_TIMERLAT_TRACER
+static int timerlat_tracer_init(struct trace_array *tr)
+{
+	return __osnoise_tracer_init(tr, true);
+}
+
+static struct tracer timerlat_tracer __read_mostly =
+{
+	.name		= "timerlat",
+	.init		= timerlat_tracer_init,
+	.reset		= osnoise_tracer_reset,
+	.start		= osnoise_tracer_start,
+	.stop		= osnoise_tracer_stop,
+	.allow_instances = true,
+};
+#endif
+
+__init static int init_osnoise_tracer(void)
+{
+	int ret;
+
+	mutex_init(&osnoise_data.lock);
+
+	ret = register_tracer(&osnoise_tracer);
+	if (ret)
+		return ret;
+
+#ifdef CONFIG_TIMERLAT_TRACER
+	ret = register_tracer(&timerlat_tracer);
+	if (ret)
+		return ret;
+#endif
+
+	init_tracefs();
+
+	return 0;
+}
+late_initcall(init_osnoise_tracer);
@@ -10,6 +10,9 @@
 #include <linux/ftrace.h>
 #include <linux/sched/clock.h>
 #include <linux/sched/mm.h>
+#include <linux/math64.h>
+
+#include <asm/sections.h>
 
 #include "trace_output.h"
 
@@ -837,20 +840,50 @@ enum print_line_t trace_nop_print(struct trace_iterator *iter, int flags,
 	return trace_handle_return(&iter->seq);
 }
 
+/*
+ * The kernel text addresses in the events of the previous boot are moved
+ * by the offset of this boot's kernel text from the one of that boot.
+ */
+static unsigned long trace_adjust_address(struct trace_iterator *iter,
+					  unsigned long addr)
+{
+	struct trace_array *tr = iter->tr;
+
+	if (!addr || !tr || !(tr->flags & TRACE_ARRAY_FL_LAST_BOOT))
+		return addr;
+	return addr + tr->text_delta;
+}
+
+/*
+ * The strings the events of the previous boot point to are only read if
+ * they are at the same place of this kernel's read-only data.
+ */
+static const char *trace_adjust_string(struct trace_iterator *iter,
+				       const char *str)
+{
+	unsigned long addr = trace_adjust_address(iter, (unsigned long)str);
+
+	if (addr == (unsigned long)str || is_kernel_rodata(addr))
+		return (const char *)addr;
+	return NULL;
+}
+
 /* TRACE_FN */
 static enum print_line_t trace_fn_trace(struct trace_iterator *iter, int flags,
 					struct trace_event *event)
 {
 	struct ftrace_entry *field;
 	struct trace_seq *s = &iter->seq;
+	unsigned long ip;
 
 	trace_assign_type(field, iter->ent);
 
-	seq_print_ip_sym(s, field->ip, flags);
+	seq_print_ip_sym(s, trace_adjust_address(iter, field->ip), flags);
 
 	if ((flags & TRACE_ITER_PRINT_PARENT) && field->parent_ip) {
+		ip = trace_adjust_address(iter, field->parent_ip);
 		trace_seq_puts(s, " <-");
-		seq_print_ip_sym(s, field->parent_ip, flags);
+		seq_print_ip_sym(s, ip, flags);
 	}
 
 	trace_seq_putc(s, '\n');
@@ -1085,7 +1118,7 @@ static enum print_line_t trace_stack_print(struct trace_iterator *iter,
 			break;
 
 		trace_seq_puts(s, " => ");
-		seq_print_ip_sym(s, *p, flags);
+		seq_print_ip_sym(s, trace_adjust_address(iter, *p), flags);
 		trace_seq_putc(s, '\n');
 	}
 
@@ -1226,6 +1259,123 @@ static struct trace_event trace_hwlat_event = {
 	.funcs		= &trace_hwlat_funcs,
 };
 
+/* TRACE_OSNOISE */
+static enum print_line_t
+trace_osnoise_print(struct trace_iterator *iter, int flags,
+		    struct trace_event *event)
+{
+	struct trace_seq *s = &iter->seq;
+	struct osnoise_entry *field;
+	u64 net_runtime;
+	u64 avail = 0;
+
+	trace_assign_type(field, iter->ent);
+
+	/* The available CPU time, in units of 0.001% */
+	if (field->runtime) {
+		net_runtime = field->runtime;
+		if (field->noise < net_runtime)
+			net_runtime -= field->noise;
+		else
+			net_runtime = 0;
+		avail = div64_u64(net_runtime * 100000ULL, field->runtime);
+	}
+
+	trace_seq_printf(s, "runtime(us):%llu noise(us):%llu avail:%llu.%03llu%%",
+			 field->runtime,
+			 field->noise,
+			 avail / 1000, avail % 1000);
+
+	trace_seq_printf(s, " max(us):%llu hw:%u nmi:%u irq:%u sirq:%u thread:%u",
+			 field->max_sample,
+			 field->hw_count,
+			 field->nmi_count,
+			 field->irq_count,
+			 field->softirq_count,
+			 field->thread_count);
+
+	trace_seq_putc(s, '\n');
+
+	return trace_handle_return(s);
+}
+
+static enum print_line_t
+trace_osnoise_raw(struct trace_iterator *iter, int flags,
+		  struct trace_event *event)
+{
+	struct osnoise_entry *field;
+	struct trace_seq *s = &iter->seq;
+
+	trace_assign_type(field, iter->ent);
+
+	trace_seq_printf(s, "%llu %llu %llu %u %u %u %u %u\n",
+			 field->runtime,
+			 field->noise,
+			 field->max_sample,
+			 field->hw_count,
+			 field->nmi_count,
+			 field->irq_count,
+			 field->softirq_count,
+			 field->thread_count);
+
+	return trace_handle_return(s);
+}
+
+static struct trace_event_functions trace_osnoise_funcs = {
+	.trace		= trace_osnoise_print,
+	.raw		= trace_osnoise_raw,
+};
+
+static struct trace_event trace_osnoise_event = {
+	.type		= TRACE_OSNOISE,
+	.funcs		= &trace_osnoise_funcs,
+};
+
+/* TRACE_TIMERLAT */
+static enum print_line_t
+trace_timerlat_print(struct trace_iterator *iter, int flags,
+		     struct trace_event *event)
+{
+	struct trace_seq *s = &iter->seq;
+	struct timerlat_entry *field;
+
+	trace_assign_type(field, iter->ent);
+
+	trace_seq_printf(s, "#%-5u context %6s timer_latency(ns):%9llu\n",
+			 field->seqnum,
+			 field->context ? "thread" : "irq",
+			 field->timer_latency);
+
+	return trace_handle_return(s);
+}
+
+static enum print_line_t
+trace_timerlat_raw(struct trace_iterator *iter, int flags,
+		   struct trace_event *event)
+{
+	struct timerlat_entry *field;
+	struct trace_seq *s = &iter->seq;
+
+	trace_assign_type(field, iter->ent);
+
+	trace_seq_printf(s, "%u %d %llu\n",
+			 field->seqnum,
+			 field->context,
+			 field->timer_latency);
+
+	return trace_handle_return(s);
+}
+
+static struct trace_event_functions trace_timerlat_funcs = {
+	.trace		= trace_timerlat_print,
+	.raw		= trace_timerlat_raw,
+};
+
+static struct trace_event trace_timerlat_event = {
+	.type		= TRACE_TIMERLAT,
+	.funcs		= &trace_timerlat_funcs,
+};
+
 /* TRACE_BPUTS */
 static enum print_line_t
 trace_bputs_print(struct trace_iterator *iter, int flags,
@@ -1234,12 +1384,14 @@ trace_bputs_print(struct trace_iterator *iter, int flags,
 	struct trace_entry *entry = iter->ent;
 	struct trace_seq *s = &iter->seq;
 	struct bputs_entry *field;
+	const char *str;
 
 	trace_assign_type(field, entry);
+	str = trace_adjust_string(iter, field->str);
 
-	seq_print_ip_sym(s, field->ip, flags);
+	seq_print_ip_sym(s, trace_adjust_address(iter, field->ip), flags);
 	trace_seq_puts(s, ": ");
-	trace_seq_puts(s, field->str);
+	trace_seq_puts(s, str ? str : "[unknown string]\n");
 
 	return trace_handle_return(s);
 }
@@ -1251,11 +1403,13 @@ trace_bputs_raw(struct trace_iterator *iter, int flags,
 {
 	struct bputs_entry *field;
 	struct trace_seq *s = &iter->seq;
+	const char *str;
 
 	trace_assign_type(field, iter->ent);
+	str = trace_adjust_string(iter, field->str);
 
 	trace_seq_printf(s, ": %lx : ", field->ip);
-	trace_seq_puts(s, field->str);
+	trace_seq_puts(s, str ? str : "[unknown string]\n");
 
 	return trace_handle_return(s);
 }
@@ -1278,12 +1432,17 @@ trace_bprint_print(struct trace_iterator *iter, int flags,
 	struct trace_entry *entry = iter->ent;
 	struct trace_seq *s = &iter->seq;
 	struct bprint_entry *field;
+	const char *fmt;
 
 	trace_assign_type(field, entry);
+	fmt = trace_adjust_string(iter, field->fmt);
 
-	seq_print_ip_sym(s, field->ip, flags);
+	seq_print_ip_sym(s, trace_adjust_address(iter, field->ip), flags);
 	trace_seq_puts(s, ": ");
-	trace_seq_bprintf(s, field->fmt, field->buf);
+	if (fmt)
+		trace_seq_bprintf(s, fmt, field->buf);
+	else
+		trace_seq_puts(s, "[unknown format]\n");
 
 	return trace_handle_return(s);
 }
@@ -1295,11 +1454,16 @@ trace_bprint_raw(struct trace_iterator *iter, int flags,
 {
 	struct bprint_entry *field;
 	struct trace_seq *s = &iter->seq;
+	const char *fmt;
 
 	trace_assign_type(field, iter->ent);
+	fmt = trace_adjust_string(iter, field->fmt);
 
 	trace_seq_printf(s, ": %lx : ", field->ip);
-	trace_seq_bprintf(s, field->fmt, field->buf);
+	if (fmt)
+		trace_seq_bprintf(s, fmt, field->buf);
+	else
+		trace_seq_puts(s, "[unknown format]\n");
 
 	return trace_handle_return(s);
 }
@@ -1323,7 +1487,7 @@ static enum print_line_t trace_print_print(struct trace_iterator *iter,
 
 	trace_assign_type(field, iter->ent);
 
-	seq_print_ip_sym(s, field->ip, flags);
+	seq_print_ip_sym(s, trace_adjust_address(iter, field->ip), flags);
 	trace_seq_printf(s, ": %s", field->buf);
 
 	return trace_handle_return(s);
@@ -1391,6 +1555,8 @@ static struct trace_event *events[] __initdata = {
 	&trace_bprint_event,
 	&trace_print_event,
 	&trace_hwlat_event,
+	&trace_osnoise_event,
+	&trace_timerlat_event,
 	&trace_raw_data_event,
 	NULL
 };
@@ -4,12 +4,17 @@
 #include <linux/syscalls.h>
 #include <linux/slab.h>
 #include <linux/kernel.h>
+#include <linux/math64.h>
 #include <linux/module.h>	/* for MODULE_NAME_LEN via KSYM_SYMBOL_LEN */
 #include <linux/ftrace.h>
 #include <linux/perf_event.h>
+#include <linux/cgroup.h>
+#include <linux/tracefs.h>
+#include <linux/sched/clock.h>
 #include <asm/syscall.h>
 
 #include "trace_output.h"
+#include "trace_stat.h"
 #include "trace.h"
 
 static DEFINE_MUTEX(syscall_trace_lock);
@@ -815,3 +820,474 @@ static int syscall_exit_register(struct trace_event_call *event,
 	}
 	return 0;
 }
+
+/*
+ * Syscall latency statistics: the time from sys_enter to sys_exit of each
+ * syscall, aggregated per CPU in log2 buckets of nanoseconds, without going
+ * through the ring buffer. Toggled through the syscall_latency directory
+ * of tracefs, which also has a pid and a cgroup filter, and read from
+ * trace_stat/syscall_latency.
+ */
+#define SYSCALL_LAT_BUCKETS	32
+
+struct syscall_lat_cpu {
+	u64			total_ns;
+	u64			buckets[SYSCALL_LAT_BUCKETS];
+};
+
+struct syscall_lat {
+	struct syscall_lat_cpu __percpu	*cpu;
+	int				nr;
+
+	/* summed over the CPUs when trace_stat/syscall_latency is opened */
+	u64				count;
+	u64				total_ns;
+	u64				buckets[SYSCALL_LAT_BUCKETS];
+};
+
+static DEFINE_MUTEX(syscall_lat_lock);
+static struct syscall_lat *syscall_lats;
+static bool syscall_lat_enabled;
+static u64 syscall_lat_enable_time;
+static pid_t syscall_lat_pid;
+static struct cgroup __rcu *syscall_lat_cgrp;
+
+static bool syscall_lat_filtered(void)
+{
+	struct cgroup *cgrp;
+	pid_t pid;
+
+	pid = READ_ONCE(syscall_lat_pid);
+	if (pid && task_tgid_nr(current) != pid)
+		return true;
+
+	/* Here we're inside tp handler's rcu_read_lock_sched (__DO_TRACE) */
+	cgrp = rcu_dereference_sched(syscall_lat_cgrp);
+	if (cgrp && !task_under_cgroup_hierarchy(current, cgrp))
+		return true;
+
+	return false;
+}
+
+static void syscall_lat_enter(void *data, struct pt_regs *regs, long id)
+{
+	if (syscall_lat_filtered())
+		return;
+
+	current->syscall_lat_start = local_clock();
+}
+
+static void syscall_lat_exit(void *data, struct pt_regs *regs, long ret)
+{
+	struct syscall_lat_cpu *lat;
+	u64 start, delta;
+	int syscall_nr;
+
+	start = current->syscall_lat_start;
+	if (!start)
+		return;
+	current->syscall_lat_start = 0;
+
+	/* entered before the stats were last enabled */
+	if (start < READ_ONCE(syscall_lat_enable_time))
+		return;
+
+	syscall_nr = trace_get_syscall_nr(current, regs);
+	if (syscall_nr < 0 || syscall_nr >= NR_syscalls)
+		return;
+
+	if (!syscall_lats[syscall_nr].cpu)
+		return;
+
+	delta = local_clock() - start;
+	if ((s64)delta < 0)
+		delta = 0;
+
+	lat = this_cpu_ptr(syscall_lats[syscall_nr].cpu);
+	lat->total_ns += delta;
+	lat->buckets[min(delta ? ilog2(delta) : 0, SYSCALL_LAT_BUCKETS - 1)]++;
+}
+
+static void syscall_lat_free(void)
+{
+	int i;
+
+	for (i = 0; i < NR_syscalls; i++)
+		free_percpu(syscall_lats[i].cpu);
+	kfree(syscall_lats);
+	syscall_lats = NULL;
+}
+
+/* The stats are allocated for every syscall with metadata, once. */
+static int syscall_lat_alloc(void)
+{
+	int i;
+
+	if (syscall_lats)
+		return 0;
+
+	syscall_lats = kcalloc(NR_syscalls, sizeof(*syscall_lats), GFP_KERNEL);
+	if (!syscall_lats)
+		return -ENOMEM;
+
+	for (i = 0; i < NR_syscalls; i++) {
+		syscall_lats[i].nr = i;
+		if (!syscall_nr_to_meta(i))
+			continue;
+		syscall_lats[i].cpu = alloc_percpu(struct syscall_lat_cpu);
+		if (!syscall_lats[i].cpu) {
+			syscall_lat_free();
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void syscall_lat_reset(void)
+{
+	int cpu, i;
+
+	for (i = 0; i < NR_syscalls; i++) {
+		if (!syscall_lats[i].cpu)
+			continue;
+		for_each_possible_cpu(cpu)
+			memset(per_cpu_ptr(syscall_lats[i].cpu, cpu), 0,
+			       sizeof(struct syscall_lat_cpu));
+	}
+}
+
+/* Enabling the stats starts them from zero. */
+static int syscall_lat_enable(bool enable)
+{
+	int ret = 0;
+
+	lockdep_assert_held(&syscall_lat_lock);
+
+	if (enable == syscall_lat_enabled)
+		return 0;
+
+	if (!enable) {
+		unregister_trace_sys_exit(syscall_lat_exit, NULL);
+		unregister_trace_sys_enter(syscall_lat_enter, NULL);
+		tracepoint_synchronize_unregister();
+		syscall_lat_enabled = false;
+		return 0;
+	}
+
+	ret = syscall_lat_alloc();
+	if (ret)
+		return ret;
+
+	syscall_lat_reset();
+	WRITE_ONCE(syscall_lat_enable_time, local_clock());
+
+	ret = register_trace_sys_enter(syscall_lat_enter, NULL);
+	if (ret)
+		return ret;
+	ret = register_trace_sys_exit(syscall_lat_exit, NULL);
+	if (ret) {
+		unregister_trace_sys_enter(syscall_lat_enter, NULL);
+		return ret;
+	}
+
+	syscall_lat_enabled = true;
+	return 0;
+}
+
+static ssize_t
+syscall_lat_enable_read(struct file *filp, char __user *ubuf,
+			size_t cnt, loff_t *ppos)
+{
+	char buf[4];
+	int len;
+
+	len = snprintf(buf, sizeof(buf), "%d\n", syscall_lat_enabled);
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, len);
+}
+
+static ssize_t
+syscall_lat_enable_write(struct file *filp, const char __user *ubuf,
+			 size_t cnt, loff_t *ppos)
+{
+	bool val;
+	int err;
+
+	err = kstrtobool_from_user(ubuf, cnt, &val);
+	if (err)
+		return err;
+
+	mutex_lock(&syscall_lat_lock);
+	err = syscall_lat_enable(val);
+	mutex_unlock(&syscall_lat_lock);
+
+	if (err)
+		return err;
+
+	return cnt;
+}
+
+static ssize_t
+syscall_lat_pid_read(struct file *filp, char __user *ubuf,
+		     size_t cnt, loff_t *ppos)
+{
+	char buf[16];
+	int len;
+
+	len = snprintf(buf, sizeof(buf), "%d\n", syscall_lat_pid);
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, len);
+}
+
+/* The pid filter is a process (tgid), 0 for all of them. */
+static ssize_t
+syscall_lat_pid_write(struct file *filp, const char __user *ubuf,
+		      size_t cnt, loff_t *ppos)
+{
+	int err, val;
+
+	err = kstrtoint_from_user(ubuf, cnt, 10, &val);
+	if (err)
+		return err;
+	if (val < 0)
+		return -EINVAL;
+
+	WRITE_ONCE(syscall_lat_pid, val);
+
+	return cnt;
+}
+
+#ifdef CONFIG_CGROUPS
+static ssize_t
+syscall_lat_cgroup_read(struct file *filp, char __user *ubuf,
+			size_t cnt, loff_t *ppos)
+{
+	struct cgroup *cgrp;
+	char *buf;
+	int len = 0;
+	ssize_t ret;
+
+	buf = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	mutex_lock(&syscall_lat_lock);
+	cgrp = rcu_dereference_protected(syscall_lat_cgrp,
+					 lockdep_is_held(&syscall_lat_lock));
+	if (cgrp) {
+		cgroup_path(cgrp, buf, PATH_MAX - 1);
+		len = strlen(buf);
+		buf[len++] = '\n';
+	}
+	mutex_unlock(&syscall_lat_lock);
+
+	ret = simple_read_from_buffer(ubuf, cnt, ppos, buf, len);
+	kfree(buf);
+	return ret;
+}
+
+/*
+ * The cgroup filter is the path of a cgroup of the default hierarchy,
+ * which the syscalls of the tasks of, or under, are accounted. An empty
+ * path removes the filter.
+ */
+static ssize_t
+syscall_lat_cgroup_write(struct file *filp, const char __user *ubuf,
+			 size_t cnt, loff_t *ppos)
+{
+	struct cgroup *cgrp = NULL, *old;
+	char *path;
+
+	if (cnt >= PATH_MAX)
+		return -EINVAL;
+
+	path = memdup_user_nul(ubuf, cnt);
+	if (IS_ERR(path))
+		return PTR_ERR(path);
+
+	strim(path);
+	if (*path) {
+		cgrp = cgroup_get_from_path(path);
+		if (IS_ERR(cgrp)) {
+			kfree(path);
+			return PTR_ERR(cgrp);
+		}
+	}
+	kfree(path);
+
+	mutex_lock(&syscall_lat_lock);
+	old = rcu_dereference_protected(syscall_lat_cgrp,
+					lockdep_is_held(&syscall_lat_lock));
+	rcu_assign_pointer(syscall_lat_cgrp, cgrp);
+	mutex_unlock(&syscall_lat_lock);
+
+	if (old) {
+		synchronize_sched();
+		cgroup_put(old);
+	}
+
+	return cnt;
+}
+
+static const struct file_operations syscall_lat_enable_fops = {
+	.open		= tracing_open_generic,
+	.read		= syscall_lat_enable_read,
+	.write		= syscall_lat_enable_write,
+	.llseek		= generic_file_llseek,
+};
+
+static const struct file_operations syscall_lat_pid_fops = {
+	.open		= tracing_open_generic,
+	.read		= syscall_lat_pid_read,
+	.write		= syscall_lat_pid_write,
+	.llseek		= generic_file_llseek,
+};
+
+static const struct file_operations syscall_lat_cgroup_fops = {
+	.open		= tracing_open_generic,
+	.read		= syscall_lat_cgroup_read,
+	.write		= syscall_lat_cgroup_write,
+	.llseek		= generic_file_llseek,
+};
+#endif
+
+static void syscall_lat_snapshot(struct syscall_lat *lat)
+{
+	struct syscall_lat_cpu *lat_cpu;
+	int cpu, i;
+
+	lat->count = 0;
+	lat->total_ns = 0;
+	memset(lat->buckets, 0, sizeof(lat->buckets));
+
+	for_each_possible_cpu(cpu) {
+		lat_cpu = per_cpu_ptr(lat->cpu, cpu);
+		lat->total_ns += READ_ONCE(lat_cpu->total_ns);
+		for (i = 0; i < SYSCALL_LAT_BUCKETS; i++)
+			lat->buckets[i] += READ_ONCE(lat_cpu->buckets[i]);
+	}
+
+	for (i = 0; i < SYSCALL_LAT_BUCKETS; i++)
+		lat->count += lat->buckets[i];
+}
+
+/* Only the syscalls which were called are listed. */
+static void *syscall_lat_stat_next_nr(int nr)
+{
+	struct syscall_lat *lat;
+
+	for (; nr < NR_syscalls; nr++) {
+		lat = &syscall_lats[nr];
+		if (!lat->cpu)
+			continue;
+		syscall_lat_snapshot(lat);
+		if (lat->count)
+			return lat;
+	}
+
+	return NULL;
+}
+
+static void *syscall_lat_stat_start(struct tracer_stat *trace)
+{
+	void *stat;
+
+	mutex_lock(&syscall_lat_lock);
+	stat = syscall_lats ? syscall_lat_stat_next_nr(0) : NULL;
+	mutex_unlock(&syscall_lat_lock);
+
+	return stat;
+}
+
+static void *syscall_lat_stat_next(void *prev, int idx)
+{
+	struct syscall_lat *lat = prev;
+
+	return syscall_lat_stat_next_nr(lat->nr + 1);
+}
+
+/* The syscalls which took the longest in total come first. */
+static int syscall_lat_stat_cmp(void *p1, void *p2)
+{
+	struct syscall_lat *a = p1;
+	struct syscall_lat *b = p2;
+
+	if (a->total_ns < b->total_ns)
+		return -1;
+	if (a->total_ns > b->total_ns)
+		return 1;
+	return 0;
+}
+
+static int syscall_lat_stat_headers(struct seq_file *m)
+{
+	seq_puts(m, "# syscall                       count      avg(ns)     total(ns)\n"
+		    "#   [ latency range (ns) )      count\n");
+	return 0;
+}
+
+static int syscall_lat_stat_show(struct seq_file *m, void *p)
+{
+	struct syscall_lat *lat = p;
+	const char *name;
+	int i;
+
+	name = get_syscall_name(lat->nr);
+	seq_printf(m, "%-24s %12llu %12llu %13llu\n", name ? name : "?",
+		   lat->count, div64_u64(lat->total_ns, lat->count),
+		   lat->total_ns);
+
+	for (i = 0; i < SYSCALL_LAT_BUCKETS; i++) {
+		if (!lat->buckets[i])
+			continue;
+		if (i == SYSCALL_LAT_BUCKETS - 1)
+			seq_printf(m, "    [%11llu, %11s) %12llu\n",
+				   i ? 1ULL << i : 0ULL, "...",
+				   lat->buckets[i]);
+		else
+			seq_printf(m, "    [%11llu, %11llu) %12llu\n",
+				   i ? 1ULL << i : 0ULL, 2ULL << i,
+				   lat->buckets[i]);
+	}
+
+	return 0;
+}
+
+static struct tracer_stat syscall_lat_stats = {
+	.name		= "syscall_latency",
+	.stat_start	= syscall_lat_stat_start,
+	.stat_next	= syscall_lat_stat_next,
+	.stat_cmp	= syscall_lat_stat_cmp,
+	.stat_headers	= syscall_lat_stat_headers,
+	.stat_show	= syscall_lat_stat_show,
+};
+
+static __init int init_syscall_lat_tracefs(void)
+{
+	struct dentry *d_tracer;
+	struct dentry *top_dir;
+
+	d_tracer = tracing_init_dentry();
+	if (IS_ERR(d_tracer))
+		return 0;
+
+	top_dir = tracefs_create_dir("syscall_latency", d_tracer);
+	if (!top_dir) {
+		pr_warn("Could not create tracefs 'syscall_latency' directory\n");
+		return 0;
+	}
+
+	trace_create_file("enable", 0644, top_dir, NULL,
+			  &syscall_lat_enable_fops);
+	trace_create_file("pid", 0644, top_dir, NULL,
+			  &syscall_lat_pid_fops);
+#ifdef CONFIG_CGROUPS
+	trace_create_file("cgroup", 0644, top_dir, NULL,
+			  &syscall_lat_cgroup_fops);
+#endif
+
+	if (register_stat_tracer(&syscall_lat_stats))
+		pr_warn("Could not register syscall_latency stats\n");
+
+	return 0;
+}
+fs_initcall(init_syscall_lat_tracefs);
@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * ChaCha20-Poly1305 AEAD, RFC7539
+ *
+ * For small, synchronous users which have the whole message in a linear
+ * buffer: no transform to allocate and no scatterlists to walk, unlike
+ * the "rfc7539(chacha20,poly1305)" template in crypto/chacha20poly1305.c.
+ * The 64-bit nonce takes the last eight bytes of the RFC7539 nonce, the
+ * first four are zero.
+ */
+
+#include <crypto/algapi.h>
+#include <crypto/chacha20.h>
+#include <crypto/chacha20poly1305.h>
+#include <crypto/poly1305.h>
+
+#include <asm/unaligned.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+
+static const u8 pad0[POLY1305_BLOCK_SIZE] = { };
+
+static void chacha20poly1305_init(u32 *chacha20_state, const u64 nonce,
+				  const u8 key[CHACHA20POLY1305_KEY_SIZE])
+{
+	u32 k[CHACHA20_KEY_SIZE / sizeof(u32)];
+	u8 iv[CHACHA20_IV_SIZE];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(k); i++)
+		k[i] = get_unaligned_le32(key + i * sizeof(u32));
+
+	/* block counter 0, for the Poly1305 key */
+	memset(iv, 0, 8);
+	put_unaligned_le64(nonce, iv + 8);
+
+	chacha20_init(chacha20_state, k, iv);
+
+	memzero_explicit(k, sizeof(k));
+}
+
+/*
+ * The first block of key stream becomes the one-time Poly1305 key, which
+ * leaves @chacha20_state at block counter 1 for the payload.
+ */
+static void chacha20poly1305_mac_init(struct poly1305_desc_ctx *poly1305,
+				      u32 *chacha20_state)
+{
+	u8 block0[POLY1305_KEY_SIZE] = { };
+
+	chacha20_crypt(chacha20_state, block0, block0, sizeof(block0));
+	poly1305_init(poly1305, block0);
+	memzero_explicit(block0, sizeof(block0));
+}
+
+static void chacha20poly1305_mac_final(struct poly1305_desc_ctx *poly1305,
+				       const size_t ad_len, const size_t ct_len,
+				       u8 *mac)
+{
+	__le64 lens[2];
+
+	lens[0] = cpu_to_le64(ad_len);
+	lens[1] = cpu_to_le64(ct_len);
+	poly1305_update(poly1305, (u8 *)lens, sizeof(lens));
+	poly1305_final(poly1305, mac);
+}
+
+/**
+ * chacha20poly1305_encrypt - seal a message
+ * @dst: src_len bytes of ciphertext followed by the tag, may equal @src
+ * @src: the plaintext
+ * @src_len: length of @src
+ * @ad: additional data to authenticate but not encrypt
+ * @ad_len: length of @ad
+ * @nonce: never to be used twice with the same @key
+ * @key: the key
+ */
+void chacha20poly1305_encrypt(u8 *dst, const u8 *src, const size_t src_len,
+			      const u8 *ad, const size_t ad_len,
+			      const u64 nonce,
+			      const u8 key[CHACHA20POLY1305_KEY_SIZE])
+{
+	u32 chacha20_state[CHACHA20_STATE_WORDS];
+	struct poly1305_desc_ctx poly1305;
+
+	chacha20poly1305_init(chacha20_state, nonce, key);
+	chacha20poly1305_mac_init(&poly1305, chacha20_state);
+
+	poly1305_update(&poly1305, ad, ad_len);
+	poly1305_update(&poly1305, pad0, (0x10 - ad_len) & 0xf);
+
+	chacha20_crypt(chacha20_state, dst, src, src_len);
+
+	poly1305_update(&poly1305, dst, src_len);
+	poly1305_update(&poly1305, pad0, (0x10 - src_len) & 0xf);
+
+	chacha20poly1305_mac_final(&poly1305, ad_len, src_len, dst + src_len);
+
+	memzero_explicit(chacha20_state, sizeof(chacha20_state));
+}
+EXPORT_SYMBOL(chacha20poly1305_encrypt);
+
+/**
+ * chacha20poly1305_decrypt - open a sealed message
+ * @dst: src_len - CHACHA20POLY1305_AUTHTAG_SIZE bytes of plaintext
+ * @src: the ciphertext followed by the tag
+ * @src_len: length of @src
+ * @ad: the additional data it was sealed with
+ * @ad_len: length of @ad
+ * @nonce: the nonce it was sealed with
+ * @key: the key
+ *
+ * Returns false, leaving @dst untouched, if the tag does not match.
+ */
+bool chacha20poly1305_decrypt(u8 *dst, const u8 *src, const size_t src_len,
+			      const u8 *ad, const size_t ad_len,
+			      const u64 nonce,
+			      const u8 key[CHACHA20POLY1305_KEY_SIZE])
+{
+	u32 chacha20_state[CHACHA20_STATE_WORDS];
+	struct poly1305_desc_ctx poly1305;
+	u8 mac[POLY1305_DIGEST_SIZE];
+	size_t dst_len;
+	int ret;
+
+	if (unlikely(src_len < POLY1305_DIGEST_SIZE))
+		return false;
+	dst_len = src_len - POLY1305_DIGEST_SIZE;
+
+	chacha20poly1305_init(chacha20_state, nonce, key);
+	chacha20poly1305_mac_init(&poly1305, chacha20_state);
+
+	poly1305_update(&poly1305, ad, ad_len);
+	poly1305_update(&poly1305, pad0, (0x10 - ad_len) & 0xf);
+
+	poly1305_update(&poly1305, src, dst_len);
+	poly1305_update(&poly1305, pad0, (0x10 - dst_len) & 0xf);
+
+	chacha20poly1305_mac_final(&poly1305, ad_len, dst_len, mac);
+
+	ret = crypto_memneq(mac, src + dst_len, POLY1305_DIGEST_SIZE);
+	if (likely(!ret))
+		chacha20_crypt(chacha20_state, dst, src, dst_len);
+
+	memzero_explicit(chacha20_state, sizeof(chacha20_state));
+	memzero_explicit(mac, sizeof(mac));
+
+	return !ret;
+}
+EXPORT_SYMBOL(chacha20poly1305_decrypt);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("ChaCha20Poly1305 AEAD construction");
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * The ChaCha20 stream cipher (RFC7539), generic library interface
+ *
+ * Copyright (C) 2015 Martin Willi
+ */
+
+#include <linux/kernel.h>
+#include <linux/export.h>
+#include <linux/module.h>
+
+#include <crypto/algapi.h>
+#include <crypto/chacha20.h>
+
+void chacha20_crypt_generic(u32 *state, u8 *dst, const u8 *src,
+			    unsigned int bytes)
+{
+	/* aligned to potentially speed up crypto_xor() */
+	u8 stream[CHACHA20_BLOCK_SIZE] __aligned(sizeof(long));
+
+	while (bytes >= CHACHA20_BLOCK_SIZE) {
+		chacha20_block(state, stream);
+		crypto_xor_cpy(dst, src, stream, CHACHA20_BLOCK_SIZE);
+		bytes -= CHACHA20_BLOCK_SIZE;
+		dst += CHACHA20_BLOCK_SIZE;
+		src += CHACHA20_BLOCK_SIZE;
+	}
+	if (bytes) {
+		chacha20_block(state, stream);
+		crypto_xor_cpy(dst, src, stream, bytes);
+	}
+
+	memzero_explicit(stream, sizeof(stream));
+}
+EXPORT_SYMBOL(chacha20_crypt_generic);
+
+MODULE_LICENSE("GPL");
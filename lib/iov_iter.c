@@ -142,6 +142,13 @@ static int copyout(void __user *to, const void *from, size_t n)
 	return n;
 }
 
+static int copyout_nocache(void __user *to, const void *from, size_t n)
+{
+	if (access_ok(VERIFY_WRITE, to, n))
+		n = __copy_to_user_inatomic_nocache(to, from, n);
+	return n;
+}
+
 static int copyin(void *to, const void __user *from, size_t n)
 {
 	if (access_ok(VERIFY_READ, from, n)) {
@@ -610,6 +617,30 @@ size_t _copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i)
 }
 EXPORT_SYMBOL(_copy_to_iter);
 
+/*
+ * Like _copy_to_iter(), but the copy to user space bypasses the CPU caches
+ * where the architecture can, so that streaming large reads through the
+ * page cache does not evict everybody else's working set.
+ */
+size_t _copy_to_iter_nocache(const void *addr, size_t bytes, struct iov_iter *i)
+{
+	const char *from = addr;
+	if (unlikely(iov_iter_is_pipe(i)))
+		return copy_pipe_to_iter(addr, bytes, i);
+	if (iter_is_iovec(i))
+		might_fault();
+	iterate_and_advance(i, bytes, v,
+		copyout_nocache(v.iov_base, (from += v.iov_len) - v.iov_len,
+				v.iov_len),
+		memcpy_to_page(v.bv_page, v.bv_offset,
+			       (from += v.bv_len) - v.bv_len, v.bv_len),
+		memcpy(v.iov_base, (from += v.iov_len) - v.iov_len, v.iov_len)
+	)
+
+	return bytes;
+}
+EXPORT_SYMBOL(_copy_to_iter_nocache);
+
 #ifdef CONFIG_ARCH_HAS_UACCESS_MCSAFE
 static int copyout_mcsafe(void __user *to, const void *from, size_t n)
 {
@@ -882,6 +913,25 @@ size_t copy_page_to_iter(struct page *page, size_t offset, size_t bytes,
 }
 EXPORT_SYMBOL(copy_page_to_iter);
 
+size_t copy_page_to_iter_nocache(struct page *page, size_t offset,
+				 size_t bytes, struct iov_iter *i)
+{
+	void *kaddr;
+	size_t wanted;
+
+	/* Only copies to user space are worth keeping out of the caches */
+	if (!iter_is_iovec(i))
+		return copy_page_to_iter(page, offset, bytes, i);
+	if (unlikely(!page_copy_sane(page, offset, bytes)))
+		return 0;
+
+	kaddr = kmap(page);
+	wanted = _copy_to_iter_nocache(kaddr + offset, bytes, i);
+	kunmap(page);
+	return wanted;
+}
+EXPORT_SYMBOL(copy_page_to_iter_nocache);
+
 size_t copy_page_from_iter(struct page *page, size_t offset, size_t bytes,
 			 struct iov_iter *i)
 {
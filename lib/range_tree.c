@@ -0,0 +1,576 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * lib/range_tree.c - B+tree of non-overlapping ranges, RCU safe lookups
+ *
+ * Every range is stored by its end, which is unique since ranges do not
+ * overlap. Internal nodes hold the largest end found below each child, so
+ * a lookup picks, at each level, the first slot whose end is above the
+ * address it looks for.
+ *
+ * The tree is modified in place. Nodes being split are copied before the
+ * copy is made visible, and nodes are freed after an RCU grace period, so
+ * that a lockless reader only ever sees entries that are either current or
+ * about to be removed. A reader racing with a writer may fail to find an
+ * entry, or find the wrong one; callers have to validate what they get.
+ *
+ * Insertion splits full nodes on the way down, so it never has to walk
+ * back up. Erasure merges small nodes into a neighbour and drops levels
+ * once the root is left with a single child.
+ *
+ * Each range also carries the size of the free gap before it, which the
+ * caller sets with range_tree_set_gap(), and internal nodes hold the
+ * largest gap found below each child. range_tree_gap_first() and
+ * range_tree_gap_last() use that to find a large enough gap without
+ * visiting the subtrees that have none. Gaps are only maintained for the
+ * writer: the gap searches need the writer lock.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/rcupdate.h>
+#include <linux/range_tree.h>
+
+#define RANGE_TREE_SLOTS	14
+#define RANGE_TREE_MAX_HEIGHT	16
+#define RANGE_TREE_MERGE	(RANGE_TREE_SLOTS / 3)
+
+struct range_tree_node {
+	unsigned char nr;
+	bool leaf;
+	unsigned long end[RANGE_TREE_SLOTS];
+	unsigned long gap[RANGE_TREE_SLOTS];
+	void *slot[RANGE_TREE_SLOTS];
+	struct rcu_head rcu;
+};
+
+static struct kmem_cache *range_tree_node_cachep __read_mostly;
+
+static struct range_tree_node *rt_node_alloc(struct range_tree *rt,
+					     bool leaf, gfp_t gfp)
+{
+	struct range_tree_node *node = rt->reserve;
+
+	if (node) {
+		rt->reserve = node->slot[0];
+		rt->nr_reserve--;
+	} else {
+		node = kmem_cache_alloc(range_tree_node_cachep, gfp);
+		if (!node)
+			return NULL;
+	}
+	node->nr = 0;
+	node->leaf = leaf;
+	return node;
+}
+
+static void rt_node_rcu_free(struct rcu_head *head)
+{
+	struct range_tree_node *node =
+		container_of(head, struct range_tree_node, rcu);
+
+	kmem_cache_free(range_tree_node_cachep, node);
+}
+
+static void rt_node_free(struct range_tree_node *node)
+{
+	call_rcu(&node->rcu, rt_node_rcu_free);
+}
+
+static inline struct range_tree_node *rt_root(struct range_tree *rt)
+{
+	/* Writers are serialized by the caller */
+	return rcu_dereference_protected(rt->root, 1);
+}
+
+static inline struct range_tree_node *rt_child(struct range_tree_node *node,
+					       unsigned int i)
+{
+	return node->slot[i];
+}
+
+static unsigned long rt_max_gap(struct range_tree_node *node)
+{
+	unsigned long max = 0;
+	unsigned int i;
+
+	for (i = 0; i < node->nr; i++)
+		max = max(max, node->gap[i]);
+	return max;
+}
+
+/*
+ * Move slots within a node. Lockless readers may see an entry twice or
+ * miss it while this happens, but each slot holds a valid end/slot pair.
+ */
+static void rt_shift_right(struct range_tree_node *node, unsigned int i)
+{
+	unsigned int j;
+
+	for (j = node->nr; j > i; j--) {
+		WRITE_ONCE(node->end[j], node->end[j - 1]);
+		WRITE_ONCE(node->slot[j], node->slot[j - 1]);
+		node->gap[j] = node->gap[j - 1];
+	}
+}
+
+static void rt_remove_slot(struct range_tree_node *node, unsigned int i)
+{
+	unsigned int j;
+
+	for (j = i; j + 1 < node->nr; j++) {
+		WRITE_ONCE(node->end[j], node->end[j + 1]);
+		WRITE_ONCE(node->slot[j], node->slot[j + 1]);
+		node->gap[j] = node->gap[j + 1];
+	}
+	WRITE_ONCE(node->nr, node->nr - 1);
+}
+
+/**
+ * range_tree_find - find the first range ending above an address
+ * @rt: the tree
+ * @addr: the address
+ *
+ * Return: the entry of the lowest range whose end is above @addr, or NULL.
+ * Must be called with the writer lock held or under rcu_read_lock().
+ */
+void *range_tree_find(struct range_tree *rt, unsigned long addr)
+{
+	struct range_tree_node *node = rcu_dereference_raw(rt->root);
+
+	while (node) {
+		unsigned int i, nr = READ_ONCE(node->nr);
+
+		for (i = 0; i < nr; i++)
+			if (READ_ONCE(node->end[i]) > addr)
+				break;
+		if (i == nr)
+			return NULL;
+		if (node->leaf)
+			return READ_ONCE(node->slot[i]);
+		node = rcu_dereference_raw(node->slot[i]);
+	}
+	return NULL;
+}
+
+/**
+ * range_tree_reserve - preallocate the nodes for one insertion
+ * @rt: the tree
+ * @gfp: allocation flags
+ *
+ * Lets a later range_tree_insert() run in a context that cannot reclaim.
+ *
+ * Return: 0 or -ENOMEM.
+ */
+int range_tree_reserve(struct range_tree *rt, gfp_t gfp)
+{
+	while (rt->nr_reserve < rt->height + 1) {
+		struct range_tree_node *node;
+
+		node = kmem_cache_alloc(range_tree_node_cachep, gfp);
+		if (!node)
+			return -ENOMEM;
+		node->slot[0] = rt->reserve;
+		rt->reserve = node;
+		rt->nr_reserve++;
+	}
+	return 0;
+}
+
+/*
+ * Split the full child at @i of @parent, which has a free slot, moving the
+ * upper half into a new node published right after it.
+ */
+static int rt_split_child(struct range_tree *rt,
+			  struct range_tree_node *parent, unsigned int i,
+			  gfp_t gfp)
+{
+	struct range_tree_node *left = rt_child(parent, i), *right;
+	unsigned int half = RANGE_TREE_SLOTS / 2, j;
+
+	right = rt_node_alloc(rt, left->leaf, gfp);
+	if (!right)
+		return -ENOMEM;
+
+	for (j = half; j < RANGE_TREE_SLOTS; j++) {
+		right->end[j - half] = left->end[j];
+		right->gap[j - half] = left->gap[j];
+		right->slot[j - half] = left->slot[j];
+	}
+	right->nr = RANGE_TREE_SLOTS - half;
+
+	/* Publish the copy, then stop routing its range to the original */
+	rt_shift_right(parent, i + 1);
+	WRITE_ONCE(parent->end[i + 1], parent->end[i]);
+	parent->gap[i + 1] = rt_max_gap(right);
+	rcu_assign_pointer(parent->slot[i + 1], right);
+	WRITE_ONCE(parent->nr, parent->nr + 1);
+	WRITE_ONCE(parent->end[i], left->end[half - 1]);
+	WRITE_ONCE(left->nr, half);
+	parent->gap[i] = rt_max_gap(left);
+	return 0;
+}
+
+/**
+ * range_tree_insert - insert a range
+ * @rt: the tree
+ * @end: end of the range, must not fall inside any range in the tree
+ * @entry: the entry to store, must not be NULL
+ * @gfp: allocation flags, used once the reserved nodes run out
+ *
+ * The range is inserted with a gap of 0.
+ *
+ * Return: 0 or -ENOMEM, in which case the tree is left without @entry.
+ */
+int range_tree_insert(struct range_tree *rt, unsigned long end, void *entry,
+		      gfp_t gfp)
+{
+	struct range_tree_node *node = rt_root(rt), *child;
+	unsigned int i;
+
+	if (!node) {
+		node = rt_node_alloc(rt, true, gfp);
+		if (!node)
+			return -ENOMEM;
+		node->end[0] = end;
+		node->gap[0] = 0;
+		node->slot[0] = entry;
+		node->nr = 1;
+		rcu_assign_pointer(rt->root, node);
+		rt->height = 1;
+		return 0;
+	}
+
+	if (node->nr == RANGE_TREE_SLOTS) {
+		struct range_tree_node *root;
+
+		if (rt->height == RANGE_TREE_MAX_HEIGHT)
+			return -ENOMEM;
+		root = rt_node_alloc(rt, false, gfp);
+		if (!root)
+			return -ENOMEM;
+		root->end[0] = node->end[RANGE_TREE_SLOTS - 1];
+		root->gap[0] = rt_max_gap(node);
+		root->slot[0] = node;
+		root->nr = 1;
+		rcu_assign_pointer(rt->root, root);
+		rt->height++;
+		node = root;
+	}
+
+	for (;;) {
+		for (i = 0; i < node->nr; i++)
+			if (node->end[i] > end)
+				break;
+
+		if (node->leaf)
+			break;
+
+		/* Appending past the last range: raise the last key */
+		if (i == node->nr) {
+			i--;
+			WRITE_ONCE(node->end[i], end);
+		}
+
+		child = rt_child(node, i);
+		if (child->nr == RANGE_TREE_SLOTS) {
+			if (rt_split_child(rt, node, i, gfp))
+				return -ENOMEM;
+			if (end > node->end[i])
+				i++;
+			child = rt_child(node, i);
+		}
+		node = child;
+	}
+
+	rt_shift_right(node, i);
+	WRITE_ONCE(node->end[i], end);
+	node->gap[i] = 0;
+	WRITE_ONCE(node->slot[i], entry);
+	WRITE_ONCE(node->nr, node->nr + 1);
+	return 0;
+}
+
+struct rt_path {
+	struct range_tree_node *node[RANGE_TREE_MAX_HEIGHT];
+	unsigned int slot[RANGE_TREE_MAX_HEIGHT];
+};
+
+/* Find the leaf slot holding @end; returns the depth of the leaf or -1 */
+static int rt_lookup_path(struct range_tree *rt, unsigned long end,
+			  struct rt_path *path)
+{
+	struct range_tree_node *node = rt_root(rt);
+	int depth = 0;
+
+	while (node) {
+		unsigned int i;
+
+		for (i = 0; i < node->nr; i++)
+			if (node->end[i] >= end)
+				break;
+		if (i == node->nr)
+			return -1;
+
+		path->node[depth] = node;
+		path->slot[depth] = i;
+		if (node->leaf)
+			return node->end[i] == end ? depth : -1;
+		node = rt_child(node, i);
+		depth++;
+	}
+	return -1;
+}
+
+/* Merge the children at @i and @i + 1 of @parent if they fit in one node */
+static void rt_merge_children(struct range_tree_node *parent, unsigned int i)
+{
+	struct range_tree_node *left = rt_child(parent, i);
+	struct range_tree_node *right = rt_child(parent, i + 1);
+	unsigned int j;
+
+	if (left->nr + right->nr > RANGE_TREE_SLOTS)
+		return;
+
+	for (j = 0; j < right->nr; j++) {
+		WRITE_ONCE(left->end[left->nr + j], right->end[j]);
+		left->gap[left->nr + j] = right->gap[j];
+		WRITE_ONCE(left->slot[left->nr + j], right->slot[j]);
+	}
+	WRITE_ONCE(left->nr, left->nr + right->nr);
+	WRITE_ONCE(parent->end[i], parent->end[i + 1]);
+	parent->gap[i] = max(parent->gap[i], parent->gap[i + 1]);
+	rt_remove_slot(parent, i + 1);
+	rt_node_free(right);
+}
+
+/**
+ * range_tree_erase - remove a range
+ * @rt: the tree
+ * @end: end of the range, as it was inserted or last updated
+ *
+ * Return: the entry that was removed, or NULL if there was none.
+ */
+void *range_tree_erase(struct range_tree *rt, unsigned long end)
+{
+	struct range_tree_node *node, *root;
+	struct rt_path path;
+	void *entry;
+	int depth;
+
+	depth = rt_lookup_path(rt, end, &path);
+	if (depth < 0)
+		return NULL;
+
+	node = path.node[depth];
+	entry = node->slot[path.slot[depth]];
+	rt_remove_slot(node, path.slot[depth]);
+
+	for (; depth > 0; depth--) {
+		struct range_tree_node *parent = path.node[depth - 1];
+		unsigned int i = path.slot[depth - 1];
+
+		node = path.node[depth];
+		if (!node->nr) {
+			rt_remove_slot(parent, i);
+			rt_node_free(node);
+			continue;
+		}
+
+		WRITE_ONCE(parent->end[i], node->end[node->nr - 1]);
+		parent->gap[i] = rt_max_gap(node);
+		if (node->nr < RANGE_TREE_MERGE && parent->nr > 1)
+			rt_merge_children(parent, i ? i - 1 : i);
+	}
+
+	root = rt_root(rt);
+	if (!root->nr) {
+		RCU_INIT_POINTER(rt->root, NULL);
+		rt->height = 0;
+		rt_node_free(root);
+		return entry;
+	}
+	while (!root->leaf && root->nr == 1) {
+		rcu_assign_pointer(rt->root, rt_child(root, 0));
+		rt->height--;
+		rt_node_free(root);
+		root = rt_root(rt);
+	}
+	return entry;
+}
+
+/**
+ * range_tree_update - change the end of a range
+ * @rt: the tree
+ * @old_end: end of the range in the tree
+ * @new_end: new end, which must not move the range past any other
+ *
+ * Never allocates memory.
+ */
+void range_tree_update(struct range_tree *rt, unsigned long old_end,
+		       unsigned long new_end)
+{
+	struct rt_path path;
+	int depth;
+
+	depth = rt_lookup_path(rt, old_end, &path);
+	if (WARN_ON_ONCE(depth < 0))
+		return;
+
+	/* Leaf first, so that readers never get routed past the range */
+	for (; depth >= 0; depth--) {
+		struct range_tree_node *node = path.node[depth];
+		unsigned int i = path.slot[depth];
+
+		WRITE_ONCE(node->end[i], new_end);
+		if (i != node->nr - 1)
+			break;
+	}
+}
+
+/**
+ * range_tree_set_gap - set the size of the gap before a range
+ * @rt: the tree
+ * @end: end of the range
+ * @gap: size of the gap
+ *
+ * Never allocates memory.
+ */
+void range_tree_set_gap(struct range_tree *rt, unsigned long end,
+			unsigned long gap)
+{
+	struct rt_path path;
+	int depth;
+
+	depth = rt_lookup_path(rt, end, &path);
+	if (WARN_ON_ONCE(depth < 0))
+		return;
+
+	path.node[depth]->gap[path.slot[depth]] = gap;
+	for (; depth > 0; depth--) {
+		struct range_tree_node *parent = path.node[depth - 1];
+		unsigned int i = path.slot[depth - 1];
+		unsigned long max = rt_max_gap(path.node[depth]);
+
+		if (parent->gap[i] == max)
+			break;
+		parent->gap[i] = max;
+	}
+}
+
+static void *rt_gap_first(struct range_tree_node *node, unsigned long gap,
+			  unsigned long min_end)
+{
+	unsigned int i;
+
+	for (i = 0; i < node->nr; i++) {
+		void *entry;
+
+		if (node->end[i] <= min_end || node->gap[i] < gap)
+			continue;
+		if (node->leaf)
+			return node->slot[i];
+		entry = rt_gap_first(rt_child(node, i), gap, min_end);
+		if (entry)
+			return entry;
+	}
+	return NULL;
+}
+
+/**
+ * range_tree_gap_first - find the lowest range with a large enough gap
+ * @rt: the tree
+ * @gap: the smallest gap to look for
+ * @min_end: only look at the ranges that end above this
+ *
+ * Return: the entry of the lowest range ending above @min_end whose gap is
+ * at least @gap, or NULL. Must be called with the writer lock held.
+ */
+void *range_tree_gap_first(struct range_tree *rt, unsigned long gap,
+			   unsigned long min_end)
+{
+	struct range_tree_node *node = rt_root(rt);
+
+	return node ? rt_gap_first(node, gap, min_end) : NULL;
+}
+
+static void *rt_gap_last(struct range_tree_node *node, unsigned long gap,
+			 unsigned long max_end)
+{
+	unsigned int i;
+
+	for (i = node->nr; i-- > 0; ) {
+		void *entry;
+
+		if (node->gap[i] < gap)
+			continue;
+		if (node->leaf) {
+			if (node->end[i] <= max_end)
+				return node->slot[i];
+			continue;
+		}
+		/* All the ranges below end above the previous child's */
+		if (i && node->end[i - 1] >= max_end)
+			continue;
+		entry = rt_gap_last(rt_child(node, i), gap, max_end);
+		if (entry)
+			return entry;
+	}
+	return NULL;
+}
+
+/**
+ * range_tree_gap_last - find the highest range with a large enough gap
+ * @rt: the tree
+ * @gap: the smallest gap to look for
+ * @max_end: only look at the ranges that end at or below this
+ *
+ * Return: the entry of the highest range ending at or below @max_end whose
+ * gap is at least @gap, or NULL. Must be called with the writer lock held.
+ */
+void *range_tree_gap_last(struct range_tree *rt, unsigned long gap,
+			  unsigned long max_end)
+{
+	struct range_tree_node *node = rt_root(rt);
+
+	return node ? rt_gap_last(node, gap, max_end) : NULL;
+}
+
+static void rt_destroy_node(struct range_tree_node *node)
+{
+	unsigned int i;
+
+	if (!node->leaf)
+		for (i = 0; i < node->nr; i++)
+			rt_destroy_node(rt_child(node, i));
+	rt_node_free(node);
+}
+
+/**
+ * range_tree_destroy - free all the nodes of a tree
+ * @rt: the tree
+ *
+ * The entries themselves are left alone. The tree is empty afterwards and
+ * can be used again.
+ */
+void range_tree_destroy(struct range_tree *rt)
+{
+	struct range_tree_node *node = rt_root(rt);
+
+	RCU_INIT_POINTER(rt->root, NULL);
+	if (node)
+		rt_destroy_node(node);
+
+	while (rt->reserve) {
+		node = rt->reserve;
+		rt->reserve = node->slot[0];
+		kmem_cache_free(range_tree_node_cachep, node);
+	}
+	rt->nr_reserve = 0;
+	rt->height = 0;
+}
+
+void __init range_tree_init_cache(void)
+{
+	range_tree_node_cachep = KMEM_CACHE(range_tree_node,
+					    SLAB_HWCACHE_ALIGN | SLAB_PANIC);
+}
@@ -428,6 +428,59 @@ int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 }
 EXPORT_SYMBOL_GPL(__sbitmap_queue_get_shallow);
 
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq,
+					unsigned int nr_bits,
+					unsigned int *offset)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned int hint, depth, index, i;
+
+	if (unlikely(sbq->round_robin || !nr_bits))
+		return 0;
+
+	hint = this_cpu_read(*sbq->alloc_hint);
+	depth = READ_ONCE(sb->depth);
+	if (unlikely(hint >= depth)) {
+		hint = depth ? prandom_u32() % depth : 0;
+		this_cpu_write(*sbq->alloc_hint, hint);
+	}
+
+	index = SB_NR_TO_INDEX(sb, hint);
+	for (i = 0; i < sb->map_nr; i++) {
+		struct sbitmap_word *map = &sb->map[index];
+		unsigned long mask, val;
+		unsigned int nr;
+
+		nr = find_first_zero_bit(&map->word, map->depth);
+		if (nr + nr_bits <= map->depth) {
+			/*
+			 * Grab the range starting at the first free bit in one
+			 * go. Bits in the range that were already set belong to
+			 * someone else; hand back only the ones we flipped.
+			 */
+			mask = (nr_bits == BITS_PER_LONG) ? ~0UL :
+				((1UL << nr_bits) - 1) << nr;
+			val = atomic_long_fetch_or_acquire(mask,
+						(atomic_long_t *)&map->word);
+			mask = (mask & ~val) >> nr;
+			if (mask) {
+				*offset = nr + (index << sb->shift);
+				hint = *offset + fls_long(mask);
+				if (hint >= depth - 1)
+					hint = 0;
+				this_cpu_write(*sbq->alloc_hint, hint);
+				return mask;
+			}
+		}
+
+		if (++index >= sb->map_nr)
+			index = 0;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__sbitmap_queue_get_batch);
+
 void sbitmap_queue_min_shallow_depth(struct sbitmap_queue *sbq,
 				     unsigned int min_shallow_depth)
 {
@@ -524,6 +577,50 @@ void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_clear);
 
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
+			       const int *bits, int nr_bits)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned long *addr = NULL;
+	unsigned long mask = 0;
+	int i;
+
+	if (!nr_bits)
+		return;
+
+	/*
+	 * Order the caller's stores to the objects the bits protect before
+	 * the bits are seen clear, like the release in clear_bit_unlock().
+	 */
+	smp_mb__before_atomic();
+	for (i = 0; i < nr_bits; i++) {
+		const int nr = bits[i] - offset;
+		unsigned long *this_addr = &sb->map[SB_NR_TO_INDEX(sb, nr)].word;
+
+		if (addr != this_addr) {
+			if (mask)
+				atomic_long_andnot(mask, (atomic_long_t *)addr);
+			addr = this_addr;
+			mask = 0;
+		}
+		mask |= 1UL << SB_NR_TO_BIT(sb, nr);
+	}
+	atomic_long_andnot(mask, (atomic_long_t *)addr);
+
+	/* See sbitmap_queue_clear() */
+	smp_mb__after_atomic();
+	for (i = 0; i < nr_bits; i++)
+		sbitmap_queue_wake_up(sbq);
+
+	if (likely(!sbq->round_robin)) {
+		const int nr = bits[nr_bits - 1] - offset;
+
+		if (nr < sb->depth)
+			this_cpu_write(*sbq->alloc_hint, nr);
+	}
+}
+EXPORT_SYMBOL_GPL(sbitmap_queue_clear_batch);
+
 void sbitmap_queue_wake_all(struct sbitmap_queue *sbq)
 {
 	int i, wake_index;
@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Test cases for csum_partial() and csum_partial_copy_nocheck()
+ *
+ * The architecture implementations are checked against a byte at a time
+ * reference for every alignment and a spread of lengths, including the
+ * large buffers that take the vector paths on x86-64, then timed.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <net/checksum.h>
+#include <asm/unaligned.h>
+
+#define CSUM_TEST_MAX_LEN	(64 * 1024)
+#define CSUM_BENCH_LOOPS	1000
+
+static unsigned int __init csum_reference(const u8 *buff, int len)
+{
+	unsigned long sum = 0;
+	int i;
+
+	/* 16-bit words in host order, a trailing byte padded with zero */
+	for (i = 0; i + 1 < len; i += 2)
+		sum += get_unaligned((const u16 *)(buff + i));
+	if (len & 1) {
+		u8 tail[2] = { buff[len - 1], 0 };
+
+		sum += get_unaligned((const u16 *)tail);
+	}
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return sum;
+}
+
+static unsigned int __init csum_to16(__wsum csum)
+{
+	return ~(__force u16)csum_fold(csum) & 0xffff;
+}
+
+static int __init csum_test_one(const u8 *src, u8 *dst, int len)
+{
+	unsigned int want = csum_reference(src, len);
+	unsigned int got;
+
+	got = csum_to16(csum_partial(src, len, 0));
+	if (got != want) {
+		pr_err("csum_partial(%p, %d): got %#x, want %#x\n",
+		       src, len, got, want);
+		return -EINVAL;
+	}
+
+	memset(dst, 0, len);
+	got = csum_to16(csum_partial_copy_nocheck(src, dst, len, 0));
+	if (got != want) {
+		pr_err("csum_partial_copy_nocheck(%p, %d): got %#x, want %#x\n",
+		       src, len, got, want);
+		return -EINVAL;
+	}
+	if (memcmp(src, dst, len)) {
+		pr_err("csum_partial_copy_nocheck(%p, %d): bad copy\n",
+		       src, len);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int __init csum_test_correctness(u8 *src, u8 *dst)
+{
+	static const int lens[] __initconst = {
+		0, 1, 2, 3, 7, 8, 15, 40, 63, 64, 65, 1023, 1024, 1025,
+		1500, 4095, 4096, 9000, 16384 + 7,
+		CSUM_TEST_MAX_LEN - 8,
+	};
+	int off, i, ret;
+
+	for (off = 0; off < 8; off++) {
+		for (i = 0; i < ARRAY_SIZE(lens); i++) {
+			ret = csum_test_one(src + off, dst + off, lens[i]);
+			if (ret)
+				return ret;
+		}
+	}
+
+	/* All ones, the worst case for the carries */
+	memset(src, 0xff, CSUM_TEST_MAX_LEN);
+	for (off = 0; off < 8; off++) {
+		ret = csum_test_one(src + off, dst + off,
+				    CSUM_TEST_MAX_LEN - 8);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void __init csum_bench(u8 *src, u8 *dst)
+{
+	__wsum sum = 0;
+	u64 start, ns;
+	int i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < CSUM_BENCH_LOOPS; i++)
+		sum = csum_partial(src, CSUM_TEST_MAX_LEN, sum);
+	ns = ktime_get_ns() - start;
+	pr_info("csum_partial: %llu MB/s\n",
+		div64_u64((u64)CSUM_TEST_MAX_LEN * CSUM_BENCH_LOOPS * 1000,
+			  ns ?: 1));
+
+	start = ktime_get_ns();
+	for (i = 0; i < CSUM_BENCH_LOOPS; i++)
+		sum = csum_partial_copy_nocheck(src, dst, CSUM_TEST_MAX_LEN,
+						sum);
+	ns = ktime_get_ns() - start;
+	pr_info("csum_partial_copy_nocheck: %llu MB/s\n",
+		div64_u64((u64)CSUM_TEST_MAX_LEN * CSUM_BENCH_LOOPS * 1000,
+			  ns ?: 1));
+
+	/* Keep the compiler from dropping the loops */
+	barrier_data(&sum);
+}
+
+static int __init csum_test_init(void)
+{
+	u8 *src, *dst;
+	int ret = -ENOMEM;
+
+	src = kmalloc(CSUM_TEST_MAX_LEN, GFP_KERNEL);
+	dst = kmalloc(CSUM_TEST_MAX_LEN, GFP_KERNEL);
+	if (!src || !dst)
+		goto out;
+
+	get_random_bytes(src, CSUM_TEST_MAX_LEN);
+	ret = csum_test_correctness(src, dst);
+	if (ret)
+		goto out;
+	pr_info("self-tests: pass\n");
+
+	csum_bench(src, dst);
+out:
+	kfree(src);
+	kfree(dst);
+	return ret;
+}
+
+static void __exit csum_test_exit(void)
+{
+}
+
+module_init(csum_test_init);
+module_exit(csum_test_exit);
+
+MODULE_LICENSE("GPL");
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0
 #include <linux/uaccess.h>
+#include <linux/string.h>
 
 /* out-of-line parts */
 
@@ -31,3 +32,29 @@ unsigned long _copy_to_user(void __user *to, const void *from, unsigned long n)
 }
 EXPORT_SYMBOL(_copy_to_user);
 #endif
+
+/**
+ * check_zeroed_user: check if a userspace buffer only contains zero bytes
+ * @from: Source address, in userspace.
+ * @size: Size of buffer.
+ *
+ * Returns 1 if the buffer is all zeroes, 0 if it is not, and -EFAULT if
+ * the buffer could not be read.
+ */
+int check_zeroed_user(const void __user *from, size_t size)
+{
+	char buf[64];
+
+	while (size) {
+		size_t len = min(size, sizeof(buf));
+
+		if (copy_from_user(buf, from, len))
+			return -EFAULT;
+		if (memchr_inv(buf, 0, len))
+			return 0;
+		from += len;
+		size -= len;
+	}
+	return 1;
+}
+EXPORT_SYMBOL(check_zeroed_user);
@@ -695,7 +695,7 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 {
 	struct zone *zone = cc->zone;
 	unsigned long nr_scanned = 0, nr_isolated = 0;
-	struct lruvec *lruvec;
+	struct lruvec *lruvec = NULL;
 	unsigned long flags = 0;
 	bool locked = false;
 	struct page *page = NULL, *valid_page = NULL;
@@ -758,8 +758,8 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		 * if contended.
 		 */
 		if (!(low_pfn % SWAP_CLUSTER_MAX)
-		    && compact_unlock_should_abort(zone_lru_lock(zone), flags,
-								&locked, cc))
+		    && compact_unlock_should_abort(locked ? &lruvec->lru_lock :
+						   NULL, flags, &locked, cc))
 			break;
 
 		if (!pfn_valid_within(low_pfn))
@@ -818,8 +818,8 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 			if (unlikely(__PageMovable(page)) &&
 					!PageIsolated(page)) {
 				if (locked) {
-					spin_unlock_irqrestore(zone_lru_lock(zone),
-									flags);
+					unlock_page_lruvec_irqrestore(lruvec,
+								      flags);
 					locked = false;
 				}
 
@@ -846,16 +846,37 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		if (!(cc->gfp_mask & __GFP_FS) && page_mapping(page))
 			goto isolate_fail;
 
+		/*
+		 * Pin the page before looking up its lruvec: the memcg of a
+		 * page that can be freed and reused under us is not stable.
+		 */
+		if (unlikely(!get_page_unless_zero(page)))
+			goto isolate_fail;
+
 		/* If we already hold the lock, we can skip some rechecking */
-		if (!locked) {
-			locked = compact_trylock_irqsave(zone_lru_lock(zone),
-								&flags, cc);
-			if (!locked)
+		if (!locked || !lruvec_holds_page_lru_lock(page, lruvec)) {
+			if (locked) {
+				unlock_page_lruvec_irqrestore(lruvec, flags);
+				locked = false;
+			}
+
+			rcu_read_lock();
+			lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
+			locked = compact_trylock_irqsave(&lruvec->lru_lock,
+							 &flags, cc);
+			rcu_read_unlock();
+			if (!locked) {
+				put_page(page);
 				break;
+			}
+
+			/* The page changed memcg while we took the lock */
+			if (!lruvec_holds_page_lru_lock(page, lruvec))
+				goto isolate_fail_put;
 
 			/* Recheck PageLRU and PageCompound under lock */
 			if (!PageLRU(page))
-				goto isolate_fail;
+				goto isolate_fail_put;
 
 			/*
 			 * Page become compound since the non-locked check,
@@ -864,15 +885,16 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 			 */
 			if (unlikely(PageCompound(page))) {
 				low_pfn += (1UL << compound_order(page)) - 1;
-				goto isolate_fail;
+				goto isolate_fail_put;
 			}
 		}
 
-		lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
-
 		/* Try isolate the page */
 		if (__isolate_lru_page(page, isolate_mode) != 0)
-			goto isolate_fail;
+			goto isolate_fail_put;
+
+		/* The isolation took its own reference */
+		put_page(page);
 
 		VM_BUG_ON_PAGE(PageCompound(page), page);
 
@@ -902,6 +924,13 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		}
 
 		continue;
+isolate_fail_put:
+		/* The put may free the page, which takes the lru_lock */
+		if (locked) {
+			unlock_page_lruvec_irqrestore(lruvec, flags);
+			locked = false;
+		}
+		put_page(page);
 isolate_fail:
 		if (!skip_on_failure)
 			continue;
@@ -913,7 +942,7 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		 */
 		if (nr_isolated) {
 			if (locked) {
-				spin_unlock_irqrestore(zone_lru_lock(zone), flags);
+				unlock_page_lruvec_irqrestore(lruvec, flags);
 				locked = false;
 			}
 			putback_movable_pages(&cc->migratepages);
@@ -940,7 +969,7 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		low_pfn = end_pfn;
 
 	if (locked)
-		spin_unlock_irqrestore(zone_lru_lock(zone), flags);
+		unlock_page_lruvec_irqrestore(lruvec, flags);
 
 	/*
 	 * Update the pageblock-skip information and cached scanner pfn,
@@ -1217,6 +1246,94 @@ typedef enum {
  */
 int sysctl_compact_unevictable_allowed __read_mostly = 1;
 
+/*
+ * Tunable for proactive compaction. It determines how aggressively the
+ * kernel should compact memory in the background, 0 disables it. It takes
+ * values in the range [0, 100].
+ */
+int __read_mostly sysctl_compaction_proactiveness = 20;
+
+/*
+ * Fragmentation is measured for the order of a PMD sized huge page, which
+ * is what proactive compaction tries to keep allocatable.
+ */
+#define COMPACTION_HPAGE_ORDER	\
+	min_t(unsigned int, PMD_SHIFT - PAGE_SHIFT, MAX_ORDER - 1)
+
+/*
+ * A zone's fragmentation score is the external fragmentation wrt to the
+ * COMPACTION_HPAGE_ORDER, in the range [0, 100].
+ */
+static unsigned int fragmentation_score_zone(struct zone *zone)
+{
+	return extfrag_for_order(zone, COMPACTION_HPAGE_ORDER);
+}
+
+/*
+ * The per-node proactive (background) compaction process is started by its
+ * corresponding kcompactd thread when the node's fragmentation score
+ * exceeds the high threshold. The compaction process remains active till
+ * the node's score falls below the low threshold, or one of the back-off
+ * conditions is met.
+ *
+ * The node score is the average of its zone scores, weighted by zone size.
+ */
+static unsigned int fragmentation_score_node(pg_data_t *pgdat)
+{
+	unsigned long score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		score += zone->present_pages * fragmentation_score_zone(zone);
+	}
+
+	return div64_ul(score, pgdat->node_present_pages + 1);
+}
+
+/* Size weighted average over all nodes, reported in /proc/vmstat */
+unsigned int fragmentation_score_total(void)
+{
+	unsigned long score = 0, pages = 0;
+	int nid;
+
+	for_each_online_node(nid) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		score += pgdat->node_present_pages *
+			 fragmentation_score_node(pgdat);
+		pages += pgdat->node_present_pages;
+	}
+
+	return div64_ul(score, pages + 1);
+}
+
+static unsigned int fragmentation_score_wmark(bool low)
+{
+	unsigned int wmark_low;
+
+	/*
+	 * Cap the low watermark to avoid excessive compaction activity in
+	 * case a user sets the proactiveness tunable close to 100 (maximum).
+	 */
+	wmark_low = max(100U - sysctl_compaction_proactiveness, 5U);
+	return low ? wmark_low : min(wmark_low + 10, 100U);
+}
+
+static inline bool kswapd_is_running(pg_data_t *pgdat)
+{
+	return pgdat->kswapd && (pgdat->kswapd->state == TASK_RUNNING);
+}
+
+static bool should_proactive_compact_node(pg_data_t *pgdat)
+{
+	if (!sysctl_compaction_proactiveness || kswapd_is_running(pgdat))
+		return false;
+
+	return fragmentation_score_node(pgdat) > fragmentation_score_wmark(false);
+}
+
 /*
  * Isolate all pages that can be migrated from the first suitable block,
  * starting at the block pointed to by the migrate scanner pfn within
@@ -1339,6 +1456,17 @@ static enum compact_result __compact_finished(struct zone *zone,
 			return COMPACT_PARTIAL_SKIPPED;
 	}
 
+	if (cc->proactive_compaction) {
+		/* Leave the node to kswapd when it has to reclaim */
+		if (kswapd_is_running(zone->zone_pgdat))
+			return COMPACT_PARTIAL_SKIPPED;
+
+		if (fragmentation_score_zone(zone) > fragmentation_score_wmark(true))
+			return COMPACT_CONTINUE;
+
+		return COMPACT_SUCCESS;
+	}
+
 	if (is_via_compact_memory(cc->order))
 		return COMPACT_CONTINUE;
 
@@ -1848,6 +1976,54 @@ static void compact_node(int nid)
 	}
 }
 
+/*
+ * Compact the zones of a node in the background until the fragmentation
+ * score drops below the low watermark.
+ */
+static void proactive_compact_node(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+	struct compact_control cc = {
+		.order = -1,
+		.mode = MIGRATE_SYNC_LIGHT,
+		.ignore_skip_hint = true,
+		.whole_zone = true,
+		.gfp_mask = GFP_KERNEL,
+		.proactive_compaction = true,
+	};
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		if (fragmentation_score_zone(zone) <=
+		    fragmentation_score_wmark(true))
+			continue;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.total_migrate_scanned = 0;
+		cc.total_free_scanned = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		if (kthread_should_stop())
+			return;
+		compact_zone(zone, &cc);
+
+		count_compact_events(KCOMPACTD_MIGRATE_SCANNED,
+				     cc.total_migrate_scanned);
+		count_compact_events(KCOMPACTD_FREE_SCANNED,
+				     cc.total_free_scanned);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+}
+
 /* Compact all nodes in the system */
 static void compact_nodes(void)
 {
@@ -1913,6 +2089,13 @@ void compaction_unregister_node(struct node *node)
 }
 #endif /* CONFIG_SYSFS && CONFIG_NUMA */
 
+/*
+ * How often kcompactd checks the fragmentation score of its node, and
+ * the share of a CPU proactive compaction may use.
+ */
+#define HPAGE_FRAG_CHECK_INTERVAL_MSEC	(500)
+#define PROACTIVE_COMPACT_CPU_PCT	(10)
+
 static inline bool kcompactd_work_requested(pg_data_t *pgdat)
 {
 	return pgdat->kcompactd_max_order > 0 || kthread_should_stop();
@@ -2057,6 +2240,9 @@ static int kcompactd(void *p)
 {
 	pg_data_t *pgdat = (pg_data_t*)p;
 	struct task_struct *tsk = current;
+	long default_timeout = msecs_to_jiffies(HPAGE_FRAG_CHECK_INTERVAL_MSEC);
+	long timeout = default_timeout;
+	unsigned int proactive_defer = 0;
 
 	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
 
@@ -2072,12 +2258,45 @@ static int kcompactd(void *p)
 		unsigned long pflags;
 
 		trace_mm_compaction_kcompactd_sleep(pgdat->node_id);
-		wait_event_freezable(pgdat->kcompactd_wait,
-				kcompactd_work_requested(pgdat));
+		if (wait_event_freezable_timeout(pgdat->kcompactd_wait,
+			kcompactd_work_requested(pgdat), timeout)) {
+
+			psi_memstall_enter(&pflags);
+			kcompactd_do_work(pgdat);
+			psi_memstall_leave(&pflags);
+			continue;
+		}
+
+		/* kcompactd wait timeout */
+		timeout = default_timeout;
+		if (should_proactive_compact_node(pgdat)) {
+			unsigned int prev_score, score;
+			unsigned long start;
 
-		psi_memstall_enter(&pflags);
-		kcompactd_do_work(pgdat);
-		psi_memstall_leave(&pflags);
+			if (proactive_defer) {
+				proactive_defer--;
+				continue;
+			}
+			count_compact_event(KCOMPACTD_PROACTIVE_WAKE);
+			start = jiffies;
+			prev_score = fragmentation_score_node(pgdat);
+			proactive_compact_node(pgdat);
+			score = fragmentation_score_node(pgdat);
+			/*
+			 * Defer proactive compaction if the fragmentation
+			 * score did not go down i.e. no progress made.
+			 */
+			proactive_defer = score < prev_score ?
+					0 : 1 << COMPACT_MAX_DEFER_SHIFT;
+			/*
+			 * Sleep long enough that background compaction uses
+			 * at most PROACTIVE_COMPACT_CPU_PCT of a CPU.
+			 */
+			timeout = max_t(long, default_timeout,
+					(jiffies - start) *
+					(100 - PROACTIVE_COMPACT_CPU_PCT) /
+					PROACTIVE_COMPACT_CPU_PCT);
+		}
 	}
 
 	return 0;
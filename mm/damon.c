@@ -0,0 +1,1454 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Data access monitoring
+ *
+ * A monitoring context runs a kernel thread, kdamond, that keeps the
+ * address space of each of its targets split into regions. Each sampling
+ * interval it clears the accessed bit of one page picked at random in each
+ * region and, one interval later, checks whether it was set again: a
+ * region whose page was accessed gets its nr_accesses bumped. At the end of
+ * each aggregation interval the counts are reported, regions of similar
+ * hotness are merged and every region is split in two again, so that the
+ * regions converge to the hot and cold areas of the target while their
+ * number stays bounded.
+ *
+ * Targets are either processes, the regions then covering the mapped parts
+ * of their address spaces, or the physical address space, whose pages have
+ * their accessed bits checked through the reverse map.
+ *
+ * The results are exported as the damon_aggregated tracepoint, and a
+ * context controlled from user space lives in debugfs under damon/.
+ */
+
+#define pr_fmt(fmt) "damon: " fmt
+
+#include <linux/damon.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/ioport.h>
+#include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/mmu_notifier.h>
+#include <linux/page_idle.h>
+#include <linux/pagemap.h>
+#include <linux/random.h>
+#include <linux/rmap.h>
+#include <linux/sched/mm.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/damon.h>
+
+/* Get a random number in [l, r) */
+static unsigned long damon_rand(unsigned long l, unsigned long r)
+{
+	unsigned long range = r - l;
+
+#if BITS_PER_LONG == 64
+	if (range > U32_MAX)
+		return l + (((u64)prandom_u32() << 32 | prandom_u32()) % range);
+#endif
+	return l + prandom_u32_max(range);
+}
+
+static inline unsigned long damon_sz_region(struct damon_region *r)
+{
+	return r->ar.end - r->ar.start;
+}
+
+/*
+ * Regions and targets
+ */
+
+static struct damon_region *damon_new_region(unsigned long start,
+					     unsigned long end)
+{
+	struct damon_region *region;
+
+	region = kmalloc(sizeof(*region), GFP_KERNEL);
+	if (!region)
+		return NULL;
+
+	region->ar.start = start;
+	region->ar.end = end;
+	region->nr_accesses = 0;
+	INIT_LIST_HEAD(&region->list);
+
+	return region;
+}
+
+/* Add a region in between two adjacent regions of a target */
+static inline void damon_insert_region(struct damon_region *r,
+		struct damon_region *prev, struct damon_region *next,
+		struct damon_target *t)
+{
+	__list_add(&r->list, &prev->list, &next->list);
+	t->nr_regions++;
+}
+
+static void damon_add_region(struct damon_region *r, struct damon_target *t)
+{
+	list_add_tail(&r->list, &t->regions_list);
+	t->nr_regions++;
+}
+
+static void damon_destroy_region(struct damon_region *r,
+				 struct damon_target *t)
+{
+	list_del(&r->list);
+	t->nr_regions--;
+	kfree(r);
+}
+
+static inline struct damon_region *damon_next_region(struct damon_region *r)
+{
+	return container_of(r->list.next, struct damon_region, list);
+}
+
+static struct damon_target *damon_new_target(struct pid *pid)
+{
+	struct damon_target *t;
+
+	t = kmalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return NULL;
+
+	t->pid = pid;
+	t->nr_regions = 0;
+	INIT_LIST_HEAD(&t->regions_list);
+
+	return t;
+}
+
+static void damon_destroy_regions(struct damon_target *t)
+{
+	struct damon_region *r, *next;
+
+	list_for_each_entry_safe(r, next, &t->regions_list, list)
+		damon_destroy_region(r, t);
+}
+
+static void damon_destroy_target(struct damon_target *t)
+{
+	damon_destroy_regions(t);
+	put_pid(t->pid);
+	list_del(&t->list);
+	kfree(t);
+}
+
+static void damon_destroy_targets(struct damon_ctx *ctx)
+{
+	struct damon_target *t, *next;
+
+	list_for_each_entry_safe(t, next, &ctx->targets_list, list)
+		damon_destroy_target(t);
+}
+
+static unsigned long damon_nr_regions(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	unsigned long nr_regions = 0;
+
+	damon_for_each_target(t, ctx)
+		nr_regions += t->nr_regions;
+
+	return nr_regions;
+}
+
+/*
+ * Split [start, end) into @nr_pieces regions of about the same size and
+ * append them to @t.
+ */
+static int damon_split_range_evenly(struct damon_target *t,
+		unsigned long start, unsigned long end, unsigned long nr_pieces)
+{
+	unsigned long sz_piece, addr;
+	struct damon_region *r;
+
+	sz_piece = ALIGN_DOWN((end - start) / nr_pieces, DAMON_MIN_REGION);
+	if (!sz_piece)
+		sz_piece = end - start;
+
+	for (addr = start; addr < end; addr += sz_piece) {
+		unsigned long piece_end = addr + sz_piece;
+
+		/* The last piece takes the remainder */
+		if (end - piece_end < sz_piece)
+			piece_end = end;
+
+		r = damon_new_region(addr, piece_end);
+		if (!r)
+			return -ENOMEM;
+		damon_add_region(r, t);
+		if (piece_end == end)
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * Page access checks
+ */
+
+/*
+ * Get a user memory page by pfn: only pages on the LRU are safe to pass to
+ * rmap_walk(). Unlike page_idle, the LRU lock is not taken to recheck, as
+ * this is called under page table locks; a page that just left the LRU is
+ * only a wrong sample.
+ */
+static struct page *damon_get_page(unsigned long pfn)
+{
+	struct page *page;
+
+	if (!pfn_valid(pfn))
+		return NULL;
+
+	page = compound_head(pfn_to_page(pfn));
+	if (!PageLRU(page) || !get_page_unless_zero(page))
+		return NULL;
+
+	if (unlikely(!PageLRU(page) || PageTail(page))) {
+		put_page(page);
+		return NULL;
+	}
+
+	return page;
+}
+
+/*
+ * Find and lock the page table entry mapping @addr, either a pte or, for a
+ * transparent huge page, a pmd. Returns 0 on success, with the lock held.
+ */
+static int damon_follow_pte_pmd(struct mm_struct *mm, unsigned long addr,
+				pte_t **ptepp, pmd_t **pmdpp, spinlock_t **ptlp)
+{
+	pgd_t *pgd;
+	p4d_t *p4d;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	pgd = pgd_offset(mm, addr);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		return -EINVAL;
+
+	p4d = p4d_offset(pgd, addr);
+	if (p4d_none(*p4d) || unlikely(p4d_bad(*p4d)))
+		return -EINVAL;
+
+	pud = pud_offset(p4d, addr);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		return -EINVAL;
+
+	pmd = pmd_offset(pud, addr);
+	if (pmd_trans_huge(*pmd)) {
+		*ptlp = pmd_lock(mm, pmd);
+		if (pmd_trans_huge(*pmd)) {
+			*ptepp = NULL;
+			*pmdpp = pmd;
+			return 0;
+		}
+		spin_unlock(*ptlp);
+	}
+
+	if (pmd_none(*pmd) || unlikely(pmd_bad(*pmd)))
+		return -EINVAL;
+
+	pte = pte_offset_map_lock(mm, pmd, addr, ptlp);
+	if (!pte_present(*pte)) {
+		pte_unmap_unlock(pte, *ptlp);
+		return -EINVAL;
+	}
+	*ptepp = pte;
+	*pmdpp = NULL;
+	return 0;
+}
+
+static void damon_unlock_pte_pmd(pte_t *pte, spinlock_t *ptl)
+{
+	if (pte)
+		pte_unmap_unlock(pte, ptl);
+	else
+		spin_unlock(ptl);
+}
+
+/*
+ * The accessed bits are cleared and the pages marked idle, so that an
+ * access is seen whether the bit is set again or reclaim consumed it
+ * meanwhile. The page is marked young when it was referenced, so that
+ * reclaim does not take it for a cold one.
+ */
+static void damon_va_mkold(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma;
+	struct page *page = NULL;
+	bool referenced = false;
+	spinlock_t *ptl;
+	pte_t *pte;
+	pmd_t *pmd;
+
+	vma = find_vma(mm, addr);
+	if (!vma || vma->vm_start > addr)
+		return;
+
+	if (damon_follow_pte_pmd(mm, addr, &pte, &pmd, &ptl))
+		return;
+
+	if (pte) {
+		page = damon_get_page(pte_pfn(*pte));
+		if (ptep_clear_young_notify(vma, addr, pte))
+			referenced = true;
+	}
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	else {
+		page = damon_get_page(pmd_pfn(*pmd));
+		if (pmdp_clear_young_notify(vma, addr & PMD_MASK, pmd))
+			referenced = true;
+	}
+#endif
+	damon_unlock_pte_pmd(pte, ptl);
+
+	if (!page)
+		return;
+	if (referenced)
+		set_page_young(page);
+	set_page_idle(page);
+	put_page(page);
+}
+
+static bool damon_va_young(struct mm_struct *mm, unsigned long addr)
+{
+	struct page *page = NULL;
+	bool young = false;
+	spinlock_t *ptl;
+	pte_t *pte;
+	pmd_t *pmd;
+
+	if (damon_follow_pte_pmd(mm, addr, &pte, &pmd, &ptl))
+		return false;
+
+	if (pte) {
+		page = damon_get_page(pte_pfn(*pte));
+		young = pte_young(*pte);
+	}
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	else {
+		page = damon_get_page(pmd_pfn(*pmd));
+		young = pmd_young(*pmd);
+	}
+#endif
+	damon_unlock_pte_pmd(pte, ptl);
+
+	if (page) {
+		young |= !page_is_idle(page);
+		put_page(page);
+	}
+
+	return young || mmu_notifier_test_young(mm, addr);
+}
+
+static bool damon_pa_mkold_one(struct page *page, struct vm_area_struct *vma,
+			       unsigned long addr, void *arg)
+{
+	struct page_vma_mapped_walk pvmw = {
+		.page = page,
+		.vma = vma,
+		.address = addr,
+	};
+	bool referenced = false;
+
+	while (page_vma_mapped_walk(&pvmw)) {
+		addr = pvmw.address;
+		if (pvmw.pte) {
+			if (ptep_clear_young_notify(vma, addr, pvmw.pte))
+				referenced = true;
+		} else if (IS_ENABLED(CONFIG_TRANSPARENT_HUGEPAGE)) {
+			if (pmdp_clear_young_notify(vma, addr, pvmw.pmd))
+				referenced = true;
+		} else {
+			/* unexpected pmd-mapped page? */
+			WARN_ON_ONCE(1);
+		}
+	}
+
+	if (referenced)
+		set_page_young(page);
+	return true;
+}
+
+static bool damon_pa_young_one(struct page *page, struct vm_area_struct *vma,
+			       unsigned long addr, void *arg)
+{
+	struct page_vma_mapped_walk pvmw = {
+		.page = page,
+		.vma = vma,
+		.address = addr,
+	};
+	bool *young = arg;
+
+	while (page_vma_mapped_walk(&pvmw)) {
+		addr = pvmw.address;
+		if (pvmw.pte)
+			*young = pte_young(*pvmw.pte);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		else
+			*young = pmd_young(*pvmw.pmd);
+#endif
+		*young |= mmu_notifier_test_young(vma->vm_mm, addr);
+
+		if (*young) {
+			page_vma_mapped_walk_done(&pvmw);
+			break;
+		}
+	}
+
+	/* Stop the rmap walk once an access has been found */
+	return !*young;
+}
+
+static void damon_pa_rmap_walk(struct page *page, struct rmap_walk_control *rwc)
+{
+	bool need_lock;
+
+	if (!page_mapped(page) || !page_rmapping(page))
+		return;
+
+	need_lock = !PageAnon(page) || PageKsm(page);
+	if (need_lock && !trylock_page(page))
+		return;
+
+	rmap_walk(page, rwc);
+
+	if (need_lock)
+		unlock_page(page);
+}
+
+static void damon_pa_mkold(unsigned long paddr)
+{
+	struct rmap_walk_control rwc = {
+		.rmap_one = damon_pa_mkold_one,
+		.anon_lock = page_lock_anon_vma_read,
+	};
+	struct page *page = damon_get_page(PHYS_PFN(paddr));
+
+	if (!page)
+		return;
+
+	damon_pa_rmap_walk(page, &rwc);
+	set_page_idle(page);
+	put_page(page);
+}
+
+static bool damon_pa_young(unsigned long paddr)
+{
+	bool young = false;
+	struct rmap_walk_control rwc = {
+		.arg = &young,
+		.rmap_one = damon_pa_young_one,
+		.anon_lock = page_lock_anon_vma_read,
+	};
+	struct page *page = damon_get_page(PHYS_PFN(paddr));
+
+	if (!page)
+		return false;
+
+	/* Unmapped page cache pages lose the idle flag when accessed */
+	young = !page_is_idle(page);
+	if (!young)
+		damon_pa_rmap_walk(page, &rwc);
+	put_page(page);
+
+	return young;
+}
+
+/*
+ * Target address spaces
+ */
+
+static struct mm_struct *damon_get_mm(struct damon_target *t)
+{
+	struct task_struct *task;
+	struct mm_struct *mm;
+
+	task = get_pid_task(t->pid, PIDTYPE_PID);
+	if (!task)
+		return NULL;
+
+	mm = get_task_mm(task);
+	put_task_struct(task);
+	return mm;
+}
+
+/*
+ * The mapped part of a process address space is mostly made of three
+ * areas: the text, data and heap at the bottom, the mmap()ed area and the
+ * stack at the top, with two huge gaps in between. Find the three ranges
+ * left once the two biggest gaps between the VMAs are cut out, so that
+ * the monitoring does not spend regions on unmapped space.
+ */
+static int damon_va_three_regions(struct mm_struct *mm,
+				  struct damon_addr_range regions[3])
+{
+	struct damon_addr_range gap = {0}, first_gap = {0}, second_gap = {0};
+	struct vm_area_struct *vma, *last_vma = NULL;
+	unsigned long start = 0;
+
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (!last_vma) {
+			start = vma->vm_start;
+			goto next;
+		}
+
+		gap.start = last_vma->vm_end;
+		gap.end = vma->vm_start;
+		if (gap.end - gap.start > second_gap.end - second_gap.start) {
+			if (gap.end - gap.start >
+			    first_gap.end - first_gap.start) {
+				second_gap = first_gap;
+				first_gap = gap;
+			} else {
+				second_gap = gap;
+			}
+		}
+next:
+		last_vma = vma;
+	}
+	up_read(&mm->mmap_sem);
+
+	if (!second_gap.end || !first_gap.end)
+		return -EINVAL;
+
+	/* Sort the two biggest gaps by address */
+	if (first_gap.start > second_gap.start)
+		swap(first_gap, second_gap);
+
+	regions[0].start = ALIGN(start, DAMON_MIN_REGION);
+	regions[0].end = ALIGN(first_gap.start, DAMON_MIN_REGION);
+	regions[1].start = ALIGN(first_gap.end, DAMON_MIN_REGION);
+	regions[1].end = ALIGN(second_gap.start, DAMON_MIN_REGION);
+	regions[2].start = ALIGN(second_gap.end, DAMON_MIN_REGION);
+	regions[2].end = ALIGN(last_vma->vm_end, DAMON_MIN_REGION);
+
+	return 0;
+}
+
+static int damon_va_target_regions(struct damon_target *t,
+				   struct damon_addr_range regions[3])
+{
+	struct mm_struct *mm;
+	int ret;
+
+	mm = damon_get_mm(t);
+	if (!mm)
+		return -EINVAL;
+
+	ret = damon_va_three_regions(mm, regions);
+	mmput(mm);
+	return ret;
+}
+
+static void damon_va_init_regions(struct damon_ctx *ctx,
+				  struct damon_target *t)
+{
+	struct damon_addr_range regions[3];
+	unsigned long sz = 0, nr_pieces;
+	int i;
+
+	if (damon_va_target_regions(t, regions)) {
+		pr_debug("failed to get the regions of target %d\n",
+			 pid_nr(t->pid));
+		return;
+	}
+
+	for (i = 0; i < 3; i++)
+		sz += regions[i].end - regions[i].start;
+	if (ctx->min_nr_regions)
+		sz /= ctx->min_nr_regions;
+	if (sz < DAMON_MIN_REGION)
+		sz = DAMON_MIN_REGION;
+
+	/* Set the initial regions so that they are about the same size */
+	for (i = 0; i < 3; i++) {
+		nr_pieces = (regions[i].end - regions[i].start) / sz;
+		if (damon_split_range_evenly(t, regions[i].start,
+					     regions[i].end, max(nr_pieces, 1UL)))
+			return;
+	}
+}
+
+static bool damon_intersect(struct damon_region *r,
+			    struct damon_addr_range *re)
+{
+	return !(r->ar.end <= re->start || re->end <= r->ar.start);
+}
+
+/*
+ * Make the regions of @t fit the new target ranges @bregions: regions out
+ * of them are dropped, the first and last region overlapping each of them
+ * are resized to its edges, and an empty range gets a new region.
+ */
+static void damon_va_apply_three_regions(struct damon_target *t,
+					 struct damon_addr_range bregions[3])
+{
+	struct damon_region *r, *next;
+	unsigned int i;
+
+	/* Remove regions which are not in the new ranges */
+	list_for_each_entry_safe(r, next, &t->regions_list, list) {
+		for (i = 0; i < 3; i++) {
+			if (damon_intersect(r, &bregions[i]))
+				break;
+		}
+		if (i == 3)
+			damon_destroy_region(r, t);
+	}
+
+	/* Adjust the intersecting regions to fit with the new ranges */
+	for (i = 0; i < 3; i++) {
+		struct damon_region *first = NULL, *last = NULL;
+		struct damon_region *newr;
+		struct damon_addr_range *br = &bregions[i];
+
+		if (br->start >= br->end)
+			continue;
+
+		damon_for_each_region(r, t) {
+			if (damon_intersect(r, br)) {
+				if (!first)
+					first = r;
+				last = r;
+			}
+			if (r->ar.start >= br->end)
+				break;
+		}
+
+		if (!first) {
+			/* Insert a new region covering the whole range */
+			newr = damon_new_region(br->start, br->end);
+			if (!newr)
+				continue;
+
+			/* Keep the regions sorted by address */
+			damon_for_each_region(r, t) {
+				if (r->ar.start > br->start)
+					break;
+			}
+			list_add_tail(&newr->list, &r->list);
+			t->nr_regions++;
+		} else {
+			first->ar.start = br->start;
+			last->ar.end = br->end;
+		}
+	}
+}
+
+static void damon_va_update_regions(struct damon_ctx *ctx)
+{
+	struct damon_addr_range three_regions[3];
+	struct damon_target *t;
+
+	damon_for_each_target(t, ctx) {
+		if (damon_va_target_regions(t, three_regions))
+			continue;
+		damon_va_apply_three_regions(t, three_regions);
+	}
+}
+
+static int damon_find_biggest_system_ram(struct resource *res, void *arg)
+{
+	struct damon_addr_range *a = arg;
+
+	if (a->end - a->start < res->end - res->start) {
+		a->start = res->start;
+		a->end = res->end;
+	}
+	return 0;
+}
+
+/* Monitor the biggest System RAM resource for physical memory */
+static void damon_pa_init_regions(struct damon_ctx *ctx,
+				  struct damon_target *t)
+{
+	struct damon_addr_range ar = {0};
+
+	walk_system_ram_res(0, ULONG_MAX, &ar, damon_find_biggest_system_ram);
+	if (ar.end <= ar.start)
+		return;
+
+	damon_split_range_evenly(t, ALIGN(ar.start, DAMON_MIN_REGION),
+				 ALIGN_DOWN(ar.end + 1, DAMON_MIN_REGION),
+				 max(ctx->min_nr_regions, 1UL));
+}
+
+static void damon_init_regions(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+
+	damon_for_each_target(t, ctx) {
+		if (ctx->type == DAMON_TARGET_PADDR)
+			damon_pa_init_regions(ctx, t);
+		else
+			damon_va_init_regions(ctx, t);
+	}
+}
+
+static void damon_prepare_access_checks(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	struct mm_struct *mm;
+
+	damon_for_each_target(t, ctx) {
+		mm = NULL;
+		if (ctx->type == DAMON_TARGET_VADDR) {
+			mm = damon_get_mm(t);
+			if (!mm)
+				continue;
+			down_read(&mm->mmap_sem);
+		}
+
+		damon_for_each_region(r, t) {
+			r->sampling_addr = damon_rand(r->ar.start, r->ar.end);
+			if (mm)
+				damon_va_mkold(mm, r->sampling_addr);
+			else
+				damon_pa_mkold(r->sampling_addr);
+		}
+
+		if (mm) {
+			up_read(&mm->mmap_sem);
+			mmput(mm);
+		}
+	}
+}
+
+/* Returns the highest nr_accesses of the current aggregation interval */
+static unsigned int damon_check_accesses(struct damon_ctx *ctx)
+{
+	unsigned int max_nr_accesses = 0;
+	struct damon_target *t;
+	struct damon_region *r;
+	struct mm_struct *mm;
+	bool young;
+
+	damon_for_each_target(t, ctx) {
+		mm = NULL;
+		if (ctx->type == DAMON_TARGET_VADDR) {
+			mm = damon_get_mm(t);
+			if (!mm)
+				continue;
+			down_read(&mm->mmap_sem);
+		}
+
+		damon_for_each_region(r, t) {
+			if (mm)
+				young = damon_va_young(mm, r->sampling_addr);
+			else
+				young = damon_pa_young(r->sampling_addr);
+			if (young)
+				r->nr_accesses++;
+			max_nr_accesses = max(r->nr_accesses, max_nr_accesses);
+		}
+
+		if (mm) {
+			up_read(&mm->mmap_sem);
+			mmput(mm);
+		}
+	}
+
+	return max_nr_accesses;
+}
+
+/*
+ * Region adjustment
+ */
+
+static void damon_merge_two_regions(struct damon_target *t,
+		struct damon_region *l, struct damon_region *r)
+{
+	unsigned long sz_l = damon_sz_region(l), sz_r = damon_sz_region(r);
+
+	l->nr_accesses = (l->nr_accesses * sz_l + r->nr_accesses * sz_r) /
+			(sz_l + sz_r);
+	l->ar.end = r->ar.end;
+	damon_destroy_region(r, t);
+}
+
+/*
+ * Merge the adjacent regions of @t whose access counts differ by at most
+ * @thres, as long as the result is not bigger than @sz_limit.
+ */
+static void damon_merge_regions_of(struct damon_target *t, unsigned int thres,
+				   unsigned long sz_limit)
+{
+	struct damon_region *r, *prev = NULL, *next;
+
+	list_for_each_entry_safe(r, next, &t->regions_list, list) {
+		if (prev && prev->ar.end == r->ar.start &&
+		    abs((int)prev->nr_accesses - (int)r->nr_accesses) <= thres &&
+		    damon_sz_region(prev) + damon_sz_region(r) <= sz_limit)
+			damon_merge_two_regions(t, prev, r);
+		else
+			prev = r;
+	}
+}
+
+static void damon_merge_regions(struct damon_ctx *ctx, unsigned int thres,
+				unsigned long sz_limit)
+{
+	struct damon_target *t;
+	unsigned long nr_regions;
+
+	/* Raise the threshold until the regions stay within the bound */
+	do {
+		nr_regions = 0;
+		damon_for_each_target(t, ctx) {
+			damon_merge_regions_of(t, thres, sz_limit);
+			nr_regions += t->nr_regions;
+		}
+		thres = max(thres * 2, 1U);
+	} while (nr_regions > ctx->max_nr_regions &&
+		 thres / 2 < ctx->aggr_interval / ctx->sample_interval);
+}
+
+/* Split every region of @t in @nr_subs regions of random sizes */
+static void damon_split_regions_of(struct damon_target *t, int nr_subs)
+{
+	struct damon_region *r, *next, *new;
+	unsigned long sz_region, sz_sub;
+	int i;
+
+	list_for_each_entry_safe(r, next, &t->regions_list, list) {
+		for (i = 0; i < nr_subs - 1; i++) {
+			sz_region = damon_sz_region(r);
+			if (sz_region <= 2 * DAMON_MIN_REGION)
+				break;
+
+			/* Randomly select a size of 10% to 90% of the region */
+			sz_sub = ALIGN_DOWN(sz_region / 10 * damon_rand(1, 10),
+					    DAMON_MIN_REGION);
+			if (!sz_sub || sz_sub >= sz_region)
+				continue;
+
+			new = damon_new_region(r->ar.start + sz_sub, r->ar.end);
+			if (!new)
+				return;
+
+			r->ar.end = new->ar.start;
+			new->nr_accesses = r->nr_accesses;
+			damon_insert_region(new, r, damon_next_region(r), t);
+			r = new;
+		}
+	}
+}
+
+/*
+ * Split the regions so that hot and cold areas inside them get a chance
+ * to show up in the next interval. Regions are split in three when the
+ * last aggregation could not reduce their number and there is room.
+ */
+static void damon_split_regions(struct damon_ctx *ctx,
+				unsigned long *last_nr_regions)
+{
+	unsigned long nr_regions = damon_nr_regions(ctx);
+	struct damon_target *t;
+	int nr_subs = 2;
+
+	if (nr_regions > ctx->max_nr_regions / 2)
+		return;
+
+	if (*last_nr_regions == nr_regions &&
+	    nr_regions < ctx->max_nr_regions / 3)
+		nr_subs = 3;
+
+	damon_for_each_target(t, ctx)
+		damon_split_regions_of(t, nr_subs);
+
+	*last_nr_regions = nr_regions;
+}
+
+static void damon_reset_aggregated(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region(r, t) {
+			trace_damon_aggregated(t, r, t->nr_regions);
+			r->nr_accesses = 0;
+		}
+	}
+}
+
+/*
+ * The minimum size of a region, so that the merged regions cannot get
+ * below min_nr_regions.
+ */
+static unsigned long damon_region_sz_limit(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned long sz = 0;
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region(r, t)
+			sz += damon_sz_region(r);
+	}
+
+	if (ctx->min_nr_regions)
+		sz /= ctx->min_nr_regions;
+	if (sz < DAMON_MIN_REGION)
+		sz = DAMON_MIN_REGION;
+
+	return sz;
+}
+
+/*
+ * Return whether @interval us passed since @baseline, resetting
+ * @baseline to now if it did.
+ */
+static bool damon_check_reset_time_interval(struct timespec64 *baseline,
+					    unsigned long interval)
+{
+	struct timespec64 now;
+
+	ktime_get_coarse_ts64(&now);
+	if ((timespec64_to_ns(&now) - timespec64_to_ns(baseline)) <
+	    interval * NSEC_PER_USEC)
+		return false;
+
+	*baseline = now;
+	return true;
+}
+
+static bool kdamond_need_stop(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct task_struct *task;
+	bool stop;
+
+	mutex_lock(&ctx->kdamond_lock);
+	stop = ctx->kdamond_stop;
+	mutex_unlock(&ctx->kdamond_lock);
+	if (stop || kthread_should_stop())
+		return true;
+
+	if (ctx->type == DAMON_TARGET_PADDR)
+		return false;
+
+	/* Stop when all the target processes are gone */
+	damon_for_each_target(t, ctx) {
+		task = get_pid_task(t->pid, PIDTYPE_PID);
+		if (task) {
+			put_task_struct(task);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static int kdamond_fn(void *data)
+{
+	struct damon_ctx *ctx = data;
+	struct damon_target *t;
+	unsigned long sz_limit, last_nr_regions = 0;
+	unsigned int max_nr_accesses = 0;
+
+	pr_debug("kdamond (%d) starts\n", current->pid);
+
+	damon_init_regions(ctx);
+	sz_limit = damon_region_sz_limit(ctx);
+	ktime_get_coarse_ts64(&ctx->last_aggregation);
+	ctx->last_update = ctx->last_aggregation;
+
+	while (!kdamond_need_stop(ctx)) {
+		damon_prepare_access_checks(ctx);
+		usleep_range(ctx->sample_interval, ctx->sample_interval + 1);
+		max_nr_accesses = damon_check_accesses(ctx);
+
+		if (damon_check_reset_time_interval(&ctx->last_aggregation,
+						    ctx->aggr_interval)) {
+			damon_merge_regions(ctx, max_nr_accesses / 10,
+					    sz_limit);
+			if (ctx->callback.after_aggregation &&
+			    ctx->callback.after_aggregation(ctx))
+				break;
+			damon_reset_aggregated(ctx);
+			damon_split_regions(ctx, &last_nr_regions);
+		}
+
+		if (ctx->type == DAMON_TARGET_VADDR &&
+		    damon_check_reset_time_interval(&ctx->last_update,
+						    ctx->update_interval)) {
+			damon_va_update_regions(ctx);
+			sz_limit = damon_region_sz_limit(ctx);
+		}
+	}
+
+	damon_for_each_target(t, ctx)
+		damon_destroy_regions(t);
+
+	pr_debug("kdamond (%d) finishes\n", current->pid);
+
+	mutex_lock(&ctx->kdamond_lock);
+	ctx->kdamond = NULL;
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return 0;
+}
+
+/*
+ * Context API
+ */
+
+/**
+ * damon_new_ctx() - Create a monitoring context.
+ * @type: What address space the targets of the context are in.
+ *
+ * Return: the new context, or NULL on allocation failure.
+ */
+struct damon_ctx *damon_new_ctx(enum damon_target_type type)
+{
+	struct damon_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return NULL;
+
+	ctx->type = type;
+	ctx->sample_interval = 5 * 1000;
+	ctx->aggr_interval = 100 * 1000;
+	ctx->update_interval = 1000 * 1000;
+	ctx->min_nr_regions = 10;
+	ctx->max_nr_regions = 1000;
+
+	mutex_init(&ctx->kdamond_lock);
+	INIT_LIST_HEAD(&ctx->targets_list);
+
+	return ctx;
+}
+
+/**
+ * damon_destroy_ctx() - Free a monitoring context, which must be stopped.
+ * @ctx: The context to free.
+ */
+void damon_destroy_ctx(struct damon_ctx *ctx)
+{
+	damon_stop(ctx);
+	damon_destroy_targets(ctx);
+	kfree(ctx);
+}
+
+static bool damon_kdamond_running(struct damon_ctx *ctx)
+{
+	bool running;
+
+	mutex_lock(&ctx->kdamond_lock);
+	running = ctx->kdamond != NULL;
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return running;
+}
+
+/**
+ * damon_set_attrs() - Set the monitoring attributes of a context.
+ * @ctx:		The context.
+ * @sample_int:		Time between samplings, in us.
+ * @aggr_int:		Time between aggregations, in us.
+ * @update_int:		Time between target regions updates, in us.
+ * @min_nr_reg:		Minimal number of regions.
+ * @max_nr_reg:		Maximum number of regions.
+ *
+ * Return: 0 on success, -EBUSY if the monitoring is running, -EINVAL if
+ * the attributes make no sense.
+ */
+int damon_set_attrs(struct damon_ctx *ctx, unsigned long sample_int,
+		    unsigned long aggr_int, unsigned long update_int,
+		    unsigned long min_nr_reg, unsigned long max_nr_reg)
+{
+	if (!sample_int || aggr_int < sample_int)
+		return -EINVAL;
+	if (min_nr_reg < 3 || min_nr_reg > max_nr_reg)
+		return -EINVAL;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		mutex_unlock(&ctx->kdamond_lock);
+		return -EBUSY;
+	}
+
+	ctx->sample_interval = sample_int;
+	ctx->aggr_interval = aggr_int;
+	ctx->update_interval = update_int;
+	ctx->min_nr_regions = min_nr_reg;
+	ctx->max_nr_regions = max_nr_reg;
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return 0;
+}
+
+/**
+ * damon_set_targets() - Set the monitoring targets of a context.
+ * @ctx:	The context.
+ * @pids:	Pids of the processes to monitor.
+ * @nr_pids:	Number of entries in @pids.
+ *
+ * For a physical address space context, @pids is ignored and the single
+ * target is the physical memory.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int damon_set_targets(struct damon_ctx *ctx, int *pids, unsigned int nr_pids)
+{
+	struct damon_target *t;
+	unsigned int i;
+	int err = 0;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	damon_destroy_targets(ctx);
+
+	if (ctx->type == DAMON_TARGET_PADDR)
+		nr_pids = 1;
+
+	for (i = 0; i < nr_pids; i++) {
+		struct pid *pid = NULL;
+
+		if (ctx->type == DAMON_TARGET_VADDR) {
+			pid = find_get_pid(pids[i]);
+			if (!pid) {
+				err = -ESRCH;
+				break;
+			}
+		}
+
+		t = damon_new_target(pid);
+		if (!t) {
+			put_pid(pid);
+			err = -ENOMEM;
+			break;
+		}
+		list_add_tail(&t->list, &ctx->targets_list);
+	}
+
+	if (err)
+		damon_destroy_targets(ctx);
+out:
+	mutex_unlock(&ctx->kdamond_lock);
+	return err;
+}
+
+/**
+ * damon_start() - Start the monitoring of a context.
+ * @ctx: The context, which must have its targets set.
+ *
+ * Return: 0 on success, -EBUSY if it is already running.
+ */
+int damon_start(struct damon_ctx *ctx)
+{
+	int err = 0;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		err = -EBUSY;
+		goto out;
+	}
+	if (list_empty(&ctx->targets_list)) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	ctx->kdamond_stop = false;
+	ctx->kdamond = kthread_run(kdamond_fn, ctx, "kdamond");
+	if (IS_ERR(ctx->kdamond)) {
+		err = PTR_ERR(ctx->kdamond);
+		ctx->kdamond = NULL;
+	}
+out:
+	mutex_unlock(&ctx->kdamond_lock);
+	return err;
+}
+
+/**
+ * damon_stop() - Stop the monitoring of a context and wait for it.
+ * @ctx: The context.
+ *
+ * Return: 0 on success, -EPERM if the monitoring was not running.
+ */
+int damon_stop(struct damon_ctx *ctx)
+{
+	mutex_lock(&ctx->kdamond_lock);
+	if (!ctx->kdamond) {
+		mutex_unlock(&ctx->kdamond_lock);
+		return -EPERM;
+	}
+	ctx->kdamond_stop = true;
+	mutex_unlock(&ctx->kdamond_lock);
+
+	while (damon_kdamond_running(ctx))
+		usleep_range(ctx->sample_interval, ctx->sample_interval * 2);
+
+	return 0;
+}
+
+/*
+ * debugfs interface
+ *
+ * attrs	"<sample> <aggr> <update> <min_nr_regions> <max_nr_regions>",
+ *		the intervals in us
+ * target_ids	pids of the processes to monitor, or "paddr" for the
+ *		physical memory
+ * monitor_on	"on" or "off" to start or stop the monitoring
+ *
+ * The results are reported through the damon_aggregated tracepoint.
+ */
+
+#ifdef CONFIG_DEBUG_FS
+
+static struct damon_ctx *dbgfs_ctx;
+static DEFINE_MUTEX(dbgfs_lock);
+
+/* Copy a user buffer to a NUL terminated kernel one */
+static char *user_input_str(const char __user *buf, size_t count, loff_t *ppos)
+{
+	char *kbuf;
+
+	if (*ppos)
+		return ERR_PTR(-EINVAL);
+
+	kbuf = kmalloc(count + 1, GFP_KERNEL);
+	if (!kbuf)
+		return ERR_PTR(-ENOMEM);
+
+	if (copy_from_user(kbuf, buf, count)) {
+		kfree(kbuf);
+		return ERR_PTR(-EFAULT);
+	}
+	kbuf[count] = '\0';
+
+	return kbuf;
+}
+
+static ssize_t dbgfs_attrs_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = dbgfs_ctx;
+	char kbuf[128];
+	int ret;
+
+	mutex_lock(&ctx->kdamond_lock);
+	ret = scnprintf(kbuf, sizeof(kbuf), "%lu %lu %lu %lu %lu\n",
+			ctx->sample_interval, ctx->aggr_interval,
+			ctx->update_interval, ctx->min_nr_regions,
+			ctx->max_nr_regions);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
+}
+
+static ssize_t dbgfs_attrs_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	unsigned long s, a, u, minr, maxr;
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (sscanf(kbuf, "%lu %lu %lu %lu %lu", &s, &a, &u, &minr,
+		   &maxr) != 5) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&dbgfs_lock);
+	ret = damon_set_attrs(dbgfs_ctx, s, a, u, minr, maxr);
+	mutex_unlock(&dbgfs_lock);
+	if (!ret)
+		ret = count;
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_target_ids_read(struct file *file, char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = dbgfs_ctx;
+	struct damon_target *t;
+	ssize_t len = 0, ret;
+	char *kbuf;
+
+	kbuf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!kbuf)
+		return -ENOMEM;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->type == DAMON_TARGET_PADDR && !list_empty(&ctx->targets_list))
+		len = scnprintf(kbuf, PAGE_SIZE, "paddr ");
+	else
+		damon_for_each_target(t, ctx)
+			len += scnprintf(kbuf + len, PAGE_SIZE - len, "%d ",
+					 pid_nr(t->pid));
+	mutex_unlock(&ctx->kdamond_lock);
+	if (len)
+		kbuf[len - 1] = '\n';
+
+	ret = simple_read_from_buffer(buf, count, ppos, kbuf, len);
+	kfree(kbuf);
+	return ret;
+}
+
+/* Parse a list of pids, returning an array of *nr_pids entries. */
+static int *str_to_pids(const char *str, ssize_t len, unsigned int *nr_pids)
+{
+	unsigned int max_pids = len / 2 + 1;
+	int *pids, pid, pos = 0, parsed;
+
+	pids = kmalloc_array(max_pids, sizeof(*pids), GFP_KERNEL);
+	if (!pids)
+		return NULL;
+
+	*nr_pids = 0;
+	while (pos < len && *nr_pids < max_pids &&
+	       sscanf(&str[pos], "%d%n", &pid, &parsed) == 1) {
+		pos += parsed;
+		pids[(*nr_pids)++] = pid;
+	}
+
+	return pids;
+}
+
+static ssize_t dbgfs_target_ids_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	enum damon_target_type type = DAMON_TARGET_VADDR;
+	struct damon_ctx *ctx = dbgfs_ctx;
+	unsigned int nr_pids = 0;
+	int *pids = NULL;
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (!strncmp(kbuf, "paddr", 5)) {
+		type = DAMON_TARGET_PADDR;
+	} else {
+		pids = str_to_pids(kbuf, count, &nr_pids);
+		if (!pids) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	mutex_lock(&dbgfs_lock);
+	if (damon_kdamond_running(ctx)) {
+		ret = -EBUSY;
+	} else {
+		ctx->type = type;
+		ret = damon_set_targets(ctx, pids, nr_pids);
+	}
+	mutex_unlock(&dbgfs_lock);
+	if (!ret)
+		ret = count;
+
+	kfree(pids);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_monitor_on_read(struct file *file, char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	char kbuf[5];
+	int len;
+
+	len = scnprintf(kbuf, sizeof(kbuf), "%s\n",
+			damon_kdamond_running(dbgfs_ctx) ? "on" : "off");
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, len);
+}
+
+static ssize_t dbgfs_monitor_on_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	mutex_lock(&dbgfs_lock);
+	if (sysfs_streq(kbuf, "on"))
+		ret = damon_start(dbgfs_ctx);
+	else if (sysfs_streq(kbuf, "off"))
+		ret = damon_stop(dbgfs_ctx);
+	else
+		ret = -EINVAL;
+	mutex_unlock(&dbgfs_lock);
+
+	if (!ret)
+		ret = count;
+	kfree(kbuf);
+	return ret;
+}
+
+static const struct file_operations attrs_fops = {
+	.read = dbgfs_attrs_read,
+	.write = dbgfs_attrs_write,
+};
+
+static const struct file_operations target_ids_fops = {
+	.read = dbgfs_target_ids_read,
+	.write = dbgfs_target_ids_write,
+};
+
+static const struct file_operations monitor_on_fops = {
+	.read = dbgfs_monitor_on_read,
+	.write = dbgfs_monitor_on_write,
+};
+
+static int __init damon_dbgfs_init(void)
+{
+	struct dentry *root;
+
+	dbgfs_ctx = damon_new_ctx(DAMON_TARGET_VADDR);
+	if (!dbgfs_ctx)
+		return -ENOMEM;
+
+	root = debugfs_create_dir("damon", NULL);
+	if (!root)
+		goto err;
+
+	if (!debugfs_create_file("attrs", 0600, root, NULL, &attrs_fops) ||
+	    !debugfs_create_file("target_ids", 0600, root, NULL,
+				 &target_ids_fops) ||
+	    !debugfs_create_file("monitor_on", 0600, root, NULL,
+				 &monitor_on_fops)) {
+		debugfs_remove_recursive(root);
+		goto err;
+	}
+
+	return 0;
+err:
+	damon_destroy_ctx(dbgfs_ctx);
+	dbgfs_ctx = NULL;
+	return -ENOMEM;
+}
+late_initcall(damon_dbgfs_init);
+
+#endif	/* CONFIG_DEBUG_FS */
@@ -98,8 +98,8 @@
  *    ->swap_lock		(try_to_unmap_one)
  *    ->private_lock		(try_to_unmap_one)
  *    ->i_pages lock		(try_to_unmap_one)
- *    ->zone_lru_lock(zone)	(follow_page->mark_page_accessed)
- *    ->zone_lru_lock(zone)	(check_pte_range->isolate_lru_page)
+ *    ->lruvec->lru_lock	(follow_page->mark_page_accessed)
+ *    ->lruvec->lru_lock	(check_pte_range->isolate_lru_page)
  *    ->private_lock		(page_remove_rmap->set_page_dirty)
  *    ->i_pages lock		(page_remove_rmap->set_page_dirty)
  *    bdi.wb->list_lock		(page_remove_rmap->set_page_dirty)
@@ -201,8 +201,10 @@ static void unaccount_page_cache_page(struct address_space *mapping,
 		__mod_node_page_state(page_pgdat(page), NR_SHMEM, -nr);
 		if (PageTransHuge(page))
 			__dec_node_page_state(page, NR_SHMEM_THPS);
-	} else {
-		VM_BUG_ON_PAGE(PageTransHuge(page), page);
+	} else if (PageTransHuge(page)) {
+		VM_BUG_ON_PAGE(!IS_ENABLED(CONFIG_FILE_LARGE_PAGES), page);
+		__dec_node_page_state(page, NR_FILE_THPS);
+		filemap_nr_thps_add(mapping, -1);
 	}
 
 	/*
@@ -649,6 +651,60 @@ int filemap_write_and_wait_range(struct address_space *mapping,
 }
 EXPORT_SYMBOL(filemap_write_and_wait_range);
 
+/*
+ * Drop the clean page cache in a byte range after an RWF_UNCACHED I/O.
+ * Pages on the active list are part of somebody's working set and are left
+ * alone, as are dirty, mapped or otherwise busy pages.  The I/O itself does
+ * not mark the pages accessed, so pages it brought in stay inactive.
+ */
+static void filemap_drop_range(struct address_space *mapping,
+			       loff_t lstart, loff_t lend)
+{
+	pgoff_t index = lstart >> PAGE_SHIFT;
+	pgoff_t end = lend >> PAGE_SHIFT;
+	struct pagevec pvec;
+	int i;
+
+	pagevec_init(&pvec);
+	while (pagevec_lookup_range(&pvec, mapping, &index, end)) {
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+
+			if (PageActive(page) || PageTransHuge(page))
+				continue;
+			if (!trylock_page(page))
+				continue;
+			if (page->mapping == mapping)
+				invalidate_inode_page(page);
+			unlock_page(page);
+		}
+		pagevec_release(&pvec);
+		cond_resched();
+	}
+}
+
+/**
+ * filemap_write_and_drop_range - write out and drop a range of page cache
+ * @mapping: the address_space for the pages
+ * @lstart: offset in bytes where the range starts
+ * @lend: offset in bytes where the range ends (inclusive)
+ *
+ * Used for RWF_UNCACHED writes: the data written is synced to the backing
+ * store like for O_DSYNC (without the metadata), and the now clean pages are
+ * dropped from the page cache instead of being left for reclaim to find.
+ */
+int filemap_write_and_drop_range(struct address_space *mapping,
+				 loff_t lstart, loff_t lend)
+{
+	int err;
+
+	err = filemap_write_and_wait_range(mapping, lstart, lend);
+	if (!err)
+		filemap_drop_range(mapping, lstart, lend);
+	return err;
+}
+EXPORT_SYMBOL(filemap_write_and_drop_range);
+
 void __filemap_set_wb_err(struct address_space *mapping, int err)
 {
 	errseq_t eseq = errseq_set(&mapping->wb_err, err);
@@ -798,46 +854,71 @@ static int __add_to_page_cache_locked(struct page *page,
 				      pgoff_t offset, gfp_t gfp_mask,
 				      void **shadowp)
 {
-	XA_STATE(xas, &mapping->i_pages, offset);
 	int huge = PageHuge(page);
+	/* hugetlb pages are represented by a single entry in the xarray */
+	XA_STATE_ORDER(xas, &mapping->i_pages, offset,
+		       huge ? 0 : compound_order(page));
+	int nr = huge ? 1 : hpage_nr_pages(page);
 	struct mem_cgroup *memcg;
 	int error;
 	void *old;
 
 	VM_BUG_ON_PAGE(!PageLocked(page), page);
 	VM_BUG_ON_PAGE(PageSwapBacked(page), page);
+	VM_BUG_ON_PAGE(nr > 1 && !IS_ALIGNED(offset, nr), page);
 	mapping_set_update(&xas, mapping);
 
 	if (!huge) {
 		error = mem_cgroup_try_charge(page, current->mm,
-					      gfp_mask, &memcg, false);
+					      gfp_mask, &memcg, nr > 1);
 		if (error)
 			return error;
 	}
 
-	get_page(page);
+	page_ref_add(page, nr);
 	page->mapping = mapping;
 	page->index = offset;
 
 	do {
-		xas_lock_irq(&xas);
-		old = xas_load(&xas);
-		if (old && !xa_is_value(old))
-			xas_set_err(&xas, -EEXIST);
-		xas_store(&xas, page);
-		if (xas_error(&xas))
-			goto unlock;
+		int i = 0;
 
-		if (xa_is_value(old)) {
-			mapping->nrexceptional--;
-			if (shadowp)
-				*shadowp = old;
+		xas_lock_irq(&xas);
+		if (unlikely(nr > 1)) {
+			/* Huge pages do not replace shadow entries */
+			if (xas_find_conflict(&xas))
+				xas_set_err(&xas, -EEXIST);
+			xas_create_range(&xas);
+			if (xas_error(&xas))
+				goto unlock;
+next:
+			xas_store(&xas, page + i);
+			if (++i < nr) {
+				xas_next(&xas);
+				goto next;
+			}
+			count_vm_event(THP_FILE_ALLOC);
+			__inc_node_page_state(page, NR_FILE_THPS);
+			filemap_nr_thps_add(mapping, 1);
+		} else {
+			old = xas_load(&xas);
+			if (old && !xa_is_value(old))
+				xas_set_err(&xas, -EEXIST);
+			xas_store(&xas, page);
+			if (xas_error(&xas))
+				goto unlock;
+
+			if (xa_is_value(old)) {
+				mapping->nrexceptional--;
+				if (shadowp)
+					*shadowp = old;
+			}
 		}
-		mapping->nrpages++;
+		mapping->nrpages += nr;
 
 		/* hugetlb pages do not participate in page cache accounting */
 		if (!huge)
-			__inc_node_page_state(page, NR_FILE_PAGES);
+			__mod_node_page_state(page_pgdat(page), NR_FILE_PAGES,
+					      nr);
 unlock:
 		xas_unlock_irq(&xas);
 	} while (xas_nomem(&xas, gfp_mask & GFP_RECLAIM_MASK));
@@ -846,15 +927,15 @@ static int __add_to_page_cache_locked(struct page *page,
 		goto error;
 
 	if (!huge)
-		mem_cgroup_commit_charge(page, memcg, false, false);
+		mem_cgroup_commit_charge(page, memcg, false, nr > 1);
 	trace_mm_filemap_add_to_page_cache(page);
 	return 0;
 error:
 	page->mapping = NULL;
 	/* Leave page->index set: truncation relies upon it */
 	if (!huge)
-		mem_cgroup_cancel_charge(page, memcg, false);
-	put_page(page);
+		mem_cgroup_cancel_charge(page, memcg, nr > 1);
+	page_ref_sub(page, nr);
 	return xas_error(&xas);
 }
 
@@ -906,7 +987,7 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
 #ifdef CONFIG_NUMA
-struct page *__page_cache_alloc(gfp_t gfp)
+struct page *__page_cache_alloc_order(gfp_t gfp, unsigned int order)
 {
 	int n;
 	struct page *page;
@@ -916,14 +997,14 @@ struct page *__page_cache_alloc(gfp_t gfp)
 		do {
 			cpuset_mems_cookie = read_mems_allowed_begin();
 			n = cpuset_mem_spread_node();
-			page = __alloc_pages_node(n, gfp, 0);
+			page = __alloc_pages_node(n, gfp, order);
 		} while (!page && read_mems_allowed_retry(cpuset_mems_cookie));
 
 		return page;
 	}
-	return alloc_pages(gfp, 0);
+	return alloc_pages(gfp, order);
 }
-EXPORT_SYMBOL(__page_cache_alloc);
+EXPORT_SYMBOL(__page_cache_alloc_order);
 #endif
 
 /*
@@ -1055,6 +1136,7 @@ static inline int wait_on_page_bit_common(wait_queue_head_t *q,
 	struct wait_page_queue wait_page;
 	wait_queue_entry_t *wait = &wait_page.wait;
 	bool thrashing = false;
+	bool pagewait = false;
 	unsigned long pflags;
 	int ret = 0;
 
@@ -1085,6 +1167,10 @@ static inline int wait_on_page_bit_common(wait_queue_head_t *q,
 		spin_unlock_irq(&q->lock);
 
 		if (likely(test_bit(bit_nr, &page->flags))) {
+			if (!thrashing && !pagewait && !PageSwapBacked(page)) {
+				delayacct_pagewait_start();
+				pagewait = true;
+			}
 			io_schedule();
 		}
 
@@ -1104,6 +1190,9 @@ static inline int wait_on_page_bit_common(wait_queue_head_t *q,
 
 	finish_wait(q, wait);
 
+	if (pagewait)
+		delayacct_pagewait_end();
+
 	if (thrashing) {
 		if (!PageSwapBacked(page))
 			delayacct_thrashing_end();
@@ -1532,12 +1621,12 @@ struct page *pagecache_get_page(struct address_space *mapping, pgoff_t offset,
 		}
 
 		/* Has the page been truncated? */
-		if (unlikely(page->mapping != mapping)) {
+		if (unlikely(compound_head(page)->mapping != mapping)) {
 			unlock_page(page);
 			put_page(page);
 			goto repeat;
 		}
-		VM_BUG_ON_PAGE(page->index != offset, page);
+		VM_BUG_ON_PAGE(page_to_pgoff(page) != offset, page);
 	}
 
 	if (page && (fgp_flags & FGP_ACCESSED))
@@ -1987,6 +2076,7 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 	pgoff_t prev_index;
 	unsigned long offset;      /* offset into pagecache page */
 	unsigned int prev_offset;
+	loff_t start_pos = *ppos;
 	int error = 0;
 
 	if (unlikely(*ppos >= inode->i_sb->s_maxbytes))
@@ -2098,9 +2188,11 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 
 		/*
 		 * When a sequential read accesses a page several times,
-		 * only mark it as accessed the first time.
+		 * only mark it as accessed the first time.  Uncached reads
+		 * don't mark it at all, so that they can drop it afterwards.
 		 */
-		if (prev_index != index || offset != prev_offset)
+		if ((prev_index != index || offset != prev_offset) &&
+		    !(iocb->ki_flags & IOCB_UNCACHED))
 			mark_page_accessed(page);
 		prev_index = index;
 
@@ -2109,7 +2201,10 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 		 * now we can copy it to user space...
 		 */
 
-		ret = copy_page_to_iter(page, offset, nr, iter);
+		if (iocb->ki_flags & IOCB_NOCACHE_COPY)
+			ret = copy_page_to_iter_nocache(page, offset, nr, iter);
+		else
+			ret = copy_page_to_iter(page, offset, nr, iter);
 		offset += ret;
 		index += offset >> PAGE_SHIFT;
 		offset &= ~PAGE_MASK;
@@ -2151,7 +2246,7 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 		 * failures, eg. multipath errors.
 		 * PG_error will be set again if readpage fails.
 		 */
-		ClearPageError(page);
+		ClearPageError(compound_head(page));
 		/* Start the actual read. The read will unlock the page. */
 		error = mapping->a_ops->readpage(filp, page);
 
@@ -2224,6 +2319,10 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 
 	*ppos = ((loff_t)index << PAGE_SHIFT) + offset;
 	file_accessed(filp);
+
+	if ((iocb->ki_flags & IOCB_UNCACHED) && *ppos > start_pos)
+		filemap_drop_range(mapping, start_pos, *ppos - 1);
+
 	return written ? written : error;
 }
 
@@ -2460,12 +2559,12 @@ vm_fault_t filemap_fault(struct vm_fault *vmf)
 	}
 
 	/* Did it get truncated? */
-	if (unlikely(page->mapping != mapping)) {
+	if (unlikely(compound_head(page)->mapping != mapping)) {
 		unlock_page(page);
 		put_page(page);
 		goto retry_find;
 	}
-	VM_BUG_ON_PAGE(page->index != offset, page);
+	VM_BUG_ON_PAGE(page_to_pgoff(page) != offset, page);
 
 	/*
 	 * We have a locked page in the page cache, now we need to check
@@ -2517,7 +2616,7 @@ vm_fault_t filemap_fault(struct vm_fault *vmf)
 	 * because there really aren't any performance issues here
 	 * and we need to check for errors.
 	 */
-	ClearPageError(page);
+	ClearPageError(compound_head(page));
 	error = mapping->a_ops->readpage(file, page);
 	if (!error) {
 		wait_on_page_locked(page);
@@ -2571,7 +2670,8 @@ void filemap_map_pages(struct vm_fault *vmf,
 		if (!trylock_page(page))
 			goto skip;
 
-		if (page->mapping != mapping || !PageUptodate(page))
+		if (compound_head(page)->mapping != mapping ||
+		    !PageUptodate(page))
 			goto unlock;
 
 		max_idx = DIV_ROUND_UP(i_size_read(mapping->host), PAGE_SIZE);
@@ -3087,8 +3187,16 @@ struct page *grab_cache_page_write_begin(struct address_space *mapping,
 	if (flags & AOP_FLAG_NOFS)
 		fgp_flags |= FGP_NOFS;
 
+repeat:
 	page = pagecache_get_page(mapping, index, fgp_flags,
 			mapping_gfp_mask(mapping));
+	if (IS_ENABLED(CONFIG_FILE_LARGE_PAGES) && page &&
+	    unlikely(PageTransCompound(page)) &&
+	    filemap_split_large_page(page)) {
+		unlock_page(page);
+		put_page(page);
+		goto repeat;
+	}
 	if (page)
 		wait_for_stable_page(page);
 
@@ -3096,6 +3204,83 @@ struct page *grab_cache_page_write_begin(struct address_space *mapping,
 }
 EXPORT_SYMBOL(grab_cache_page_write_begin);
 
+#ifdef CONFIG_FILE_LARGE_PAGES
+/**
+ * filemap_split_large_page - make a page cache page fit for writing
+ * @page: locked and referenced subpage of a huge page
+ *
+ * Huge pages of regular files are only filled by readahead, and neither
+ * ->write_begin nor ->page_mkwrite know how to dirty them. Split the huge
+ * page so that @page stands on its own and the rest of it stays cached. If
+ * someone else holds a pin the split fails: the huge page is still clean,
+ * so it is dropped from the page cache instead.
+ *
+ * Returns 0 if @page is now a small page cache page, still locked, or
+ * -EBUSY if it was dropped and the caller has to look it up again.
+ */
+int filemap_split_large_page(struct page *page)
+{
+	struct page *head = compound_head(page);
+	struct address_space *mapping = head->mapping;
+
+	VM_BUG_ON_PAGE(!PageLocked(page), page);
+	if (!split_huge_page(page))
+		return 0;
+
+	if (mapping && head->mapping == mapping) {
+		VM_BUG_ON_PAGE(PageDirty(head), head);
+		truncate_inode_page(mapping, head);
+	}
+	return -EBUSY;
+}
+
+/**
+ * filemap_drop_large_pages - remove huge pages from a range of the page cache
+ * @mapping: the address_space
+ * @start: first page offset of the range
+ * @end: last page offset of the range (inclusive)
+ *
+ * Truncation and invalidation only know how to remove whole huge pages,
+ * and skip the subpages of the ones that straddle their range. Huge pages
+ * of regular files are clean, so drop every one overlapping the range
+ * beforehand: the subpages outside of it are read in again when needed.
+ */
+void filemap_drop_large_pages(struct address_space *mapping,
+			      pgoff_t start, pgoff_t end)
+{
+	struct pagevec pvec;
+	pgoff_t index = start;
+	int i;
+
+	if (!filemap_nr_thps(mapping))
+		return;
+
+	pagevec_init(&pvec);
+	while (index <= end &&
+	       pagevec_lookup_range(&pvec, mapping, &index, end)) {
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *head = compound_head(pvec.pages[i]);
+
+			/*
+			 * Every index of a huge page is looked up as its own
+			 * subpage: only the first one seen finds it cached.
+			 */
+			if (!PageTransHuge(head))
+				continue;
+
+			lock_page(head);
+			if (head->mapping == mapping) {
+				VM_BUG_ON_PAGE(PageDirty(head), head);
+				truncate_inode_page(mapping, head);
+			}
+			unlock_page(head);
+		}
+		pagevec_release(&pvec);
+		cond_resched();
+	}
+}
+#endif
+
 ssize_t generic_perform_write(struct file *file,
 				struct iov_iter *i, loff_t pos)
 {
@@ -262,6 +262,9 @@ static struct page *follow_pmd_mask(struct vm_area_struct *vma,
 		if (page)
 			return page;
 	}
+	/* Writes must fault to unshare a PTE table shared on fork */
+	if ((flags & FOLL_WRITE) && pmd_pte_shared(pmdval))
+		return no_page_table(vma, flags);
 	if (likely(!pmd_trans_huge(pmdval)))
 		return follow_page_pte(vma, address, pmd, flags, &ctx->pgmap);
 
@@ -1695,6 +1698,9 @@ static int gup_pmd_range(pud_t pud, unsigned long addr, unsigned long end,
 			if (!gup_huge_pd(__hugepd(pmd_val(pmd)), addr,
 					 PMD_SHIFT, next, write, pages, nr))
 				return 0;
+		} else if (unlikely(write && pmd_pte_shared(pmd))) {
+			/* Let the slow path unshare the PTE table */
+			return 0;
 		} else if (!gup_pte_range(pmd, addr, next, write, pages, nr))
 			return 0;
 	} while (pmdp++, addr = next, addr != end);
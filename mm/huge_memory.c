@@ -57,6 +57,15 @@ unsigned long transparent_hugepage_flags __read_mostly =
 	(1<<TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG)|
 	(1<<TRANSPARENT_HUGEPAGE_USE_ZERO_PAGE_FLAG);
 
+/*
+ * Sub-PMD orders enabled for anonymous faults, see
+ * thp_vma_small_anon_orders().  All of them are off by default.
+ */
+static unsigned long huge_anon_orders_always __read_mostly;
+static unsigned long huge_anon_orders_madvise __read_mostly;
+static unsigned long huge_anon_orders_inherit __read_mostly;
+static DEFINE_SPINLOCK(huge_anon_orders_lock);
+
 static struct shrinker deferred_split_shrinker;
 
 static atomic_t huge_zero_refcount;
@@ -144,6 +153,33 @@ static struct shrinker huge_zero_page_shrinker = {
 	.seeks = DEFAULT_SEEKS,
 };
 
+/**
+ * thp_vma_small_anon_orders - orders an anonymous fault in @vma may allocate
+ * @vma: the faulting vma
+ *
+ * Returns a mask of the enabled orders below HPAGE_PMD_ORDER.  An order set
+ * to "inherit" follows the top level "enabled" setting.
+ */
+unsigned long thp_vma_small_anon_orders(struct vm_area_struct *vma)
+{
+	unsigned long orders;
+
+	if (vma->vm_flags & VM_NOHUGEPAGE)
+		return 0;
+	if (is_vma_temporary_stack(vma))
+		return 0;
+	if (test_bit(MMF_DISABLE_THP, &vma->vm_mm->flags))
+		return 0;
+
+	orders = READ_ONCE(huge_anon_orders_always);
+	if (vma->vm_flags & VM_HUGEPAGE)
+		orders |= READ_ONCE(huge_anon_orders_madvise);
+	if (transparent_hugepage_enabled(vma))
+		orders |= READ_ONCE(huge_anon_orders_inherit);
+
+	return orders;
+}
+
 #ifdef CONFIG_SYSFS
 static ssize_t enabled_show(struct kobject *kobj,
 			    struct kobj_attribute *attr, char *buf)
@@ -288,6 +324,22 @@ static ssize_t use_zero_page_store(struct kobject *kobj,
 static struct kobj_attribute use_zero_page_attr =
 	__ATTR(use_zero_page, 0644, use_zero_page_show, use_zero_page_store);
 
+static ssize_t shrink_underused_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return single_hugepage_flag_show(kobj, attr, buf,
+				TRANSPARENT_HUGEPAGE_SHRINK_UNDERUSED_FLAG);
+}
+static ssize_t shrink_underused_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	return single_hugepage_flag_store(kobj, attr, buf, count,
+				 TRANSPARENT_HUGEPAGE_SHRINK_UNDERUSED_FLAG);
+}
+static struct kobj_attribute shrink_underused_attr =
+	__ATTR(shrink_underused, 0644, shrink_underused_show,
+	       shrink_underused_store);
+
 static ssize_t hpage_pmd_size_show(struct kobject *kobj,
 		struct kobj_attribute *attr, char *buf)
 {
@@ -318,6 +370,7 @@ static struct attribute *hugepage_attr[] = {
 	&enabled_attr.attr,
 	&defrag_attr.attr,
 	&use_zero_page_attr.attr,
+	&shrink_underused_attr.attr,
 	&hpage_pmd_size_attr.attr,
 #if defined(CONFIG_SHMEM) && defined(CONFIG_TRANSPARENT_HUGE_PAGECACHE)
 	&shmem_enabled_attr.attr,
@@ -332,9 +385,121 @@ static const struct attribute_group hugepage_attr_group = {
 	.attrs = hugepage_attr,
 };
 
+struct thpsize {
+	struct kobject kobj;
+	struct list_head node;
+	int order;
+};
+
+#define to_thpsize(kobj) container_of(kobj, struct thpsize, kobj)
+
+static LIST_HEAD(thpsize_list);
+
+static ssize_t thpsize_enabled_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	int order = to_thpsize(kobj)->order;
+
+	if (test_bit(order, &huge_anon_orders_always))
+		return sprintf(buf, "[always] inherit madvise never\n");
+	else if (test_bit(order, &huge_anon_orders_inherit))
+		return sprintf(buf, "always [inherit] madvise never\n");
+	else if (test_bit(order, &huge_anon_orders_madvise))
+		return sprintf(buf, "always inherit [madvise] never\n");
+	else
+		return sprintf(buf, "always inherit madvise [never]\n");
+}
+
+static ssize_t thpsize_enabled_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	int order = to_thpsize(kobj)->order;
+	unsigned long *set = NULL;
+
+	if (sysfs_streq(buf, "always"))
+		set = &huge_anon_orders_always;
+	else if (sysfs_streq(buf, "inherit"))
+		set = &huge_anon_orders_inherit;
+	else if (sysfs_streq(buf, "madvise"))
+		set = &huge_anon_orders_madvise;
+	else if (!sysfs_streq(buf, "never"))
+		return -EINVAL;
+
+	spin_lock(&huge_anon_orders_lock);
+	clear_bit(order, &huge_anon_orders_always);
+	clear_bit(order, &huge_anon_orders_inherit);
+	clear_bit(order, &huge_anon_orders_madvise);
+	if (set)
+		set_bit(order, set);
+	spin_unlock(&huge_anon_orders_lock);
+
+	return count;
+}
+
+static struct kobj_attribute thpsize_enabled_attr =
+	__ATTR(enabled, 0644, thpsize_enabled_show, thpsize_enabled_store);
+
+static struct attribute *thpsize_attrs[] = {
+	&thpsize_enabled_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group thpsize_attr_group = {
+	.attrs = thpsize_attrs,
+};
+
+static void thpsize_release(struct kobject *kobj)
+{
+	kfree(to_thpsize(kobj));
+}
+
+static struct kobj_type thpsize_ktype = {
+	.release = &thpsize_release,
+	.sysfs_ops = &kobj_sysfs_ops,
+};
+
+static struct thpsize *thpsize_create(int order, struct kobject *parent)
+{
+	unsigned long size = (PAGE_SIZE << order) >> 10;
+	struct thpsize *thpsize;
+	int ret;
+
+	thpsize = kzalloc(sizeof(*thpsize), GFP_KERNEL);
+	if (!thpsize)
+		return ERR_PTR(-ENOMEM);
+	thpsize->order = order;
+
+	ret = kobject_init_and_add(&thpsize->kobj, &thpsize_ktype, parent,
+				   "hugepages-%lukB", size);
+	if (ret) {
+		kobject_put(&thpsize->kobj);
+		return ERR_PTR(ret);
+	}
+
+	ret = sysfs_create_group(&thpsize->kobj, &thpsize_attr_group);
+	if (ret) {
+		kobject_put(&thpsize->kobj);
+		return ERR_PTR(ret);
+	}
+
+	return thpsize;
+}
+
+static void thpsize_remove_all(void)
+{
+	struct thpsize *thpsize, *tmp;
+
+	list_for_each_entry_safe(thpsize, tmp, &thpsize_list, node) {
+		list_del(&thpsize->node);
+		kobject_put(&thpsize->kobj);
+	}
+}
+
 static int __init hugepage_init_sysfs(struct kobject **hugepage_kobj)
 {
-	int err;
+	unsigned long orders = THP_ORDERS_SMALL_ANON;
+	int err, order;
 
 	*hugepage_kobj = kobject_create_and_add("transparent_hugepage", mm_kobj);
 	if (unlikely(!*hugepage_kobj)) {
@@ -354,8 +519,22 @@ static int __init hugepage_init_sysfs(struct kobject **hugepage_kobj)
 		goto remove_hp_group;
 	}
 
+	for_each_set_bit(order, &orders, BITS_PER_LONG) {
+		struct thpsize *thpsize = thpsize_create(order, *hugepage_kobj);
+
+		if (IS_ERR(thpsize)) {
+			pr_err("failed to create thpsize for order %d\n", order);
+			err = PTR_ERR(thpsize);
+			goto remove_all;
+		}
+		list_add(&thpsize->node, &thpsize_list);
+	}
+
 	return 0;
 
+remove_all:
+	thpsize_remove_all();
+	sysfs_remove_group(*hugepage_kobj, &khugepaged_attr_group);
 remove_hp_group:
 	sysfs_remove_group(*hugepage_kobj, &hugepage_attr_group);
 delete_obj:
@@ -365,6 +544,7 @@ static int __init hugepage_init_sysfs(struct kobject **hugepage_kobj)
 
 static void __init hugepage_exit_sysfs(struct kobject *hugepage_kobj)
 {
+	thpsize_remove_all();
 	sysfs_remove_group(hugepage_kobj, &khugepaged_attr_group);
 	sysfs_remove_group(hugepage_kobj, &hugepage_attr_group);
 	kobject_put(hugepage_kobj);
@@ -606,6 +786,8 @@ static vm_fault_t __do_huge_pmd_anonymous_page(struct vm_fault *vmf,
 		mm_inc_nr_ptes(vma->vm_mm);
 		spin_unlock(vmf->ptl);
 		count_vm_event(THP_FAULT_ALLOC);
+		if (transparent_hugepage_shrink_underused())
+			deferred_split_huge_page(page, false);
 	}
 
 	return 0;
@@ -938,8 +1120,12 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 			pmd = swp_entry_to_pmd(entry);
 			if (pmd_swp_soft_dirty(*src_pmd))
 				pmd = pmd_swp_mksoft_dirty(pmd);
+			if (pmd_swp_uffd_wp(*src_pmd))
+				pmd = pmd_swp_mkuffd_wp(pmd);
 			set_pmd_at(src_mm, addr, src_pmd, pmd);
 		}
+		if (!(vma->vm_flags & VM_UFFD_WP))
+			pmd = pmd_swp_clear_uffd_wp(pmd);
 		add_mm_counter(dst_mm, MM_ANONPAGES, HPAGE_PMD_NR);
 		mm_inc_nr_ptes(dst_mm);
 		pgtable_trans_huge_deposit(dst_mm, dst_pmd, pgtable);
@@ -981,6 +1167,8 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	pgtable_trans_huge_deposit(dst_mm, dst_pmd, pgtable);
 
 	pmdp_set_wrprotect(src_mm, addr, src_pmd);
+	if (!(vma->vm_flags & VM_UFFD_WP))
+		pmd = pmd_clear_uffd_wp(pmd);
 	pmd = pmd_mkold(pmd_wrprotect(pmd));
 	set_pmd_at(dst_mm, addr, dst_pmd, pmd);
 
@@ -1856,13 +2044,16 @@ bool move_huge_pmd(struct vm_area_struct *vma, unsigned long old_addr,
  *  - HPAGE_PMD_NR is protections changed and TLB flush necessary
  */
 int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
-		unsigned long addr, pgprot_t newprot, int prot_numa)
+		unsigned long addr, pgprot_t newprot, unsigned long cp_flags)
 {
 	struct mm_struct *mm = vma->vm_mm;
 	spinlock_t *ptl;
 	pmd_t entry;
 	bool preserve_write;
 	int ret;
+	bool prot_numa = cp_flags & MM_CP_PROT_NUMA;
+	bool uffd_wp = cp_flags & MM_CP_UFFD_WP;
+	bool uffd_wp_resolve = cp_flags & MM_CP_UFFD_WP_RESOLVE;
 
 	ptl = __pmd_trans_huge_lock(pmd, vma);
 	if (!ptl)
@@ -1874,10 +2065,10 @@ int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 #ifdef CONFIG_ARCH_ENABLE_THP_MIGRATION
 	if (is_swap_pmd(*pmd)) {
 		swp_entry_t entry = pmd_to_swp_entry(*pmd);
+		pmd_t newpmd = *pmd;
 
 		VM_BUG_ON(!is_pmd_migration_entry(*pmd));
 		if (is_write_migration_entry(entry)) {
-			pmd_t newpmd;
 			/*
 			 * A protection check is difficult so
 			 * just be safe and disable write
@@ -1886,8 +2077,15 @@ int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 			newpmd = swp_entry_to_pmd(entry);
 			if (pmd_swp_soft_dirty(*pmd))
 				newpmd = pmd_swp_mksoft_dirty(newpmd);
-			set_pmd_at(mm, addr, pmd, newpmd);
+			if (pmd_swp_uffd_wp(*pmd))
+				newpmd = pmd_swp_mkuffd_wp(newpmd);
 		}
+		if (uffd_wp)
+			newpmd = pmd_swp_mkuffd_wp(newpmd);
+		else if (uffd_wp_resolve)
+			newpmd = pmd_swp_clear_uffd_wp(newpmd);
+		if (!pmd_same(*pmd, newpmd))
+			set_pmd_at(mm, addr, pmd, newpmd);
 		goto unlock;
 	}
 #endif
@@ -1903,6 +2101,9 @@ int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 	if (prot_numa && pmd_protnone(*pmd))
 		goto unlock;
 
+	if (prot_numa && tiering_skip_prot_numa(pmd_page(*pmd)))
+		goto unlock;
+
 	/*
 	 * In case prot_numa, we are under down_read(mmap_sem). It's critical
 	 * to not clear pmd intermittently to avoid race with MADV_DONTNEED
@@ -1929,6 +2130,13 @@ int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 	entry = pmd_modify(entry, newprot);
 	if (preserve_write)
 		entry = pmd_mk_savedwrite(entry);
+	if (uffd_wp) {
+		entry = pmd_wrprotect(entry);
+		entry = pmd_mkuffd_wp(entry);
+	} else if (uffd_wp_resolve) {
+		/* See change_pte_range() */
+		entry = pmd_clear_uffd_wp(entry);
+	}
 	ret = HPAGE_PMD_NR;
 	set_pmd_at(mm, addr, pmd, entry);
 	BUG_ON(vma_is_anonymous(vma) && !preserve_write && pmd_write(entry));
@@ -2078,7 +2286,7 @@ static void __split_huge_pmd_locked(struct vm_area_struct *vma, pmd_t *pmd,
 	struct page *page;
 	pgtable_t pgtable;
 	pmd_t old_pmd, _pmd;
-	bool young, write, soft_dirty, pmd_migration = false;
+	bool young, write, soft_dirty, uffd_wp, pmd_migration = false;
 	unsigned long addr;
 	int i;
 
@@ -2161,6 +2369,10 @@ static void __split_huge_pmd_locked(struct vm_area_struct *vma, pmd_t *pmd,
 	write = pmd_write(old_pmd);
 	young = pmd_young(old_pmd);
 	soft_dirty = pmd_soft_dirty(old_pmd);
+	if (pmd_migration)
+		uffd_wp = pmd_swp_uffd_wp(old_pmd);
+	else
+		uffd_wp = pmd_uffd_wp(old_pmd);
 
 	/*
 	 * Withdraw the table only after we mark the pmd entry invalid.
@@ -2182,6 +2394,8 @@ static void __split_huge_pmd_locked(struct vm_area_struct *vma, pmd_t *pmd,
 			entry = swp_entry_to_pte(swp_entry);
 			if (soft_dirty)
 				entry = pte_swp_mksoft_dirty(entry);
+			if (uffd_wp)
+				entry = pte_swp_mkuffd_wp(entry);
 		} else {
 			entry = mk_pte(page + i, READ_ONCE(vma->vm_page_prot));
 			entry = maybe_mkwrite(entry, vma);
@@ -2191,6 +2405,10 @@ static void __split_huge_pmd_locked(struct vm_area_struct *vma, pmd_t *pmd,
 				entry = pte_mkold(entry);
 			if (soft_dirty)
 				entry = pte_mksoft_dirty(entry);
+			if (uffd_wp) {
+				entry = pte_wrprotect(entry);
+				entry = pte_mkuffd_wp(entry);
+			}
 		}
 		pte = pte_offset_map(&_pmd, addr);
 		BUG_ON(!pte_none(*pte));
@@ -2354,14 +2572,15 @@ static void unmap_page(struct page *page)
 	VM_BUG_ON_PAGE(!unmap_success, page);
 }
 
-static void remap_page(struct page *page)
+static void remap_page(struct page *page, int flags)
 {
 	int i;
 	if (PageTransHuge(page)) {
-		remove_migration_ptes(page, page, true);
+		remove_migration_ptes(page, page, RMP_LOCKED);
 	} else {
 		for (i = 0; i < HPAGE_PMD_NR; i++)
-			remove_migration_ptes(page + i, page + i, true);
+			remove_migration_ptes(page + i, page + i,
+					      RMP_LOCKED | flags);
 	}
 }
 
@@ -2389,7 +2608,8 @@ static void __split_huge_page_tail(struct page *head, int tail,
 			 (1L << PG_workingset) |
 			 (1L << PG_locked) |
 			 (1L << PG_unevictable) |
-			 (1L << PG_dirty)));
+			 (1L << PG_dirty) |
+			 LRU_GEN_MASK));
 
 	/* ->mapping in first tail page is compound_mapcount */
 	VM_BUG_ON_PAGE(tail > 2 && page_tail->mapping != TAIL_MAPPING,
@@ -2428,15 +2648,11 @@ static void __split_huge_page_tail(struct page *head, int tail,
 }
 
 static void __split_huge_page(struct page *page, struct list_head *list,
-		pgoff_t end, unsigned long flags)
+		struct lruvec *lruvec, pgoff_t end, unsigned long flags)
 {
 	struct page *head = compound_head(page);
-	struct zone *zone = page_zone(head);
-	struct lruvec *lruvec;
 	int i;
 
-	lruvec = mem_cgroup_page_lruvec(head, zone->zone_pgdat);
-
 	/* complete memcg works before add pages to LRU */
 	mem_cgroup_split_huge_fixup(head);
 
@@ -2466,9 +2682,10 @@ static void __split_huge_page(struct page *page, struct list_head *list,
 		xa_unlock(&head->mapping->i_pages);
 	}
 
-	spin_unlock_irqrestore(zone_lru_lock(page_zone(head)), flags);
+	unlock_page_lruvec_irqrestore(lruvec, flags);
 
-	remap_page(head);
+	/* Subpages that were never written to are left for put_page() below */
+	remap_page(head, PageAnon(head) ? RMP_USE_SHARED_ZEROPAGE : 0);
 
 	for (i = 0; i < HPAGE_PMD_NR; i++) {
 		struct page *subpage = head + i;
@@ -2609,6 +2826,7 @@ int split_huge_page_to_list(struct page *page, struct list_head *list)
 	struct anon_vma *anon_vma = NULL;
 	struct address_space *mapping = NULL;
 	int count, mapcount, extra_pins, ret;
+	struct lruvec *lruvec;
 	bool mlocked;
 	unsigned long flags;
 	pgoff_t end;
@@ -2677,7 +2895,7 @@ int split_huge_page_to_list(struct page *page, struct list_head *list)
 		lru_add_drain();
 
 	/* prevent PageLRU to go away from under us, and freeze lru stats */
-	spin_lock_irqsave(zone_lru_lock(page_zone(head)), flags);
+	lruvec = lock_page_lruvec_irqsave(head, &flags);
 
 	if (mapping) {
 		XA_STATE(xas, &mapping->i_pages, page_index(head));
@@ -2700,10 +2918,14 @@ int split_huge_page_to_list(struct page *page, struct list_head *list)
 			pgdata->split_queue_len--;
 			list_del(page_deferred_list(head));
 		}
-		if (mapping)
+		if (mapping && PageSwapBacked(head)) {
 			__dec_node_page_state(page, NR_SHMEM_THPS);
+		} else if (mapping) {
+			__dec_node_page_state(page, NR_FILE_THPS);
+			filemap_nr_thps_add(mapping, -1);
+		}
 		spin_unlock(&pgdata->split_queue_lock);
-		__split_huge_page(page, list, end, flags);
+		__split_huge_page(page, list, lruvec, end, flags);
 		if (PageSwapCache(head)) {
 			swp_entry_t entry = { .val = page_private(head) };
 
@@ -2722,8 +2944,8 @@ int split_huge_page_to_list(struct page *page, struct list_head *list)
 		spin_unlock(&pgdata->split_queue_lock);
 fail:		if (mapping)
 			xa_unlock(&mapping->i_pages);
-		spin_unlock_irqrestore(zone_lru_lock(page_zone(head)), flags);
-		remap_page(head);
+		unlock_page_lruvec_irqrestore(lruvec, flags);
+		remap_page(head, 0);
 		ret = -EBUSY;
 	}
 
@@ -2748,12 +2970,23 @@ void free_transhuge_page(struct page *page)
 	if (!list_empty(page_deferred_list(page))) {
 		pgdata->split_queue_len--;
 		list_del(page_deferred_list(page));
+		ClearPagePartiallyMapped(page);
 	}
 	spin_unlock_irqrestore(&pgdata->split_queue_lock, flags);
 	free_compound_page(page);
 }
 
-void deferred_split_huge_page(struct page *page)
+/**
+ * deferred_split_huge_page - queue a THP for the deferred split shrinker
+ * @page: head page of the THP
+ * @partially_mapped: part of the THP got unmapped
+ *
+ * Partially mapped THPs are split unconditionally under memory pressure.
+ * Others are only queued when shrink_underused is set, and are split if
+ * too many of their subpages are still zero-filled when the shrinker gets
+ * to them.
+ */
+void deferred_split_huge_page(struct page *page, bool partially_mapped)
 {
 	struct pglist_data *pgdata = NODE_DATA(page_to_nid(page));
 	unsigned long flags;
@@ -2761,8 +2994,11 @@ void deferred_split_huge_page(struct page *page)
 	VM_BUG_ON_PAGE(!PageTransHuge(page), page);
 
 	spin_lock_irqsave(&pgdata->split_queue_lock, flags);
-	if (list_empty(page_deferred_list(page))) {
+	if (partially_mapped && !PagePartiallyMapped(page)) {
+		SetPagePartiallyMapped(page);
 		count_vm_event(THP_DEFERRED_SPLIT_PAGE);
+	}
+	if (list_empty(page_deferred_list(page))) {
 		list_add_tail(page_deferred_list(page), &pgdata->split_queue);
 		pgdata->split_queue_len++;
 	}
@@ -2776,6 +3012,62 @@ static unsigned long deferred_split_count(struct shrinker *shrink,
 	return READ_ONCE(pgdata->split_queue_len);
 }
 
+/*
+ * An anonymous THP is underused when more of its subpages are zero-filled
+ * than khugepaged would have allowed to be unpopulated when collapsing it.
+ */
+static bool thp_underused(struct page *page)
+{
+	int num_zero_pages = 0, num_filled_pages = 0;
+	void *kaddr;
+	int i;
+
+	if (khugepaged_max_ptes_none == HPAGE_PMD_NR - 1)
+		return false;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		kaddr = kmap_atomic(page + i);
+		if (!memchr_inv(kaddr, 0, PAGE_SIZE)) {
+			num_zero_pages++;
+			if (num_zero_pages > khugepaged_max_ptes_none) {
+				kunmap_atomic(kaddr);
+				return true;
+			}
+		} else {
+			/*
+			 * Another path for early exit once the number
+			 * of non-zero filled pages exceeds threshold.
+			 */
+			num_filled_pages++;
+			if (num_filled_pages >=
+			    HPAGE_PMD_NR - khugepaged_max_ptes_none) {
+				kunmap_atomic(kaddr);
+				return false;
+			}
+		}
+		kunmap_atomic(kaddr);
+	}
+	return false;
+}
+
+/*
+ * Drop a THP that turned out to be used from the queue.  Only a partial
+ * unmap will queue it again.
+ */
+static void deferred_split_dequeue(struct pglist_data *pgdata,
+		struct page *page)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pgdata->split_queue_lock, flags);
+	if (!list_empty(page_deferred_list(page)) &&
+	    !PagePartiallyMapped(page)) {
+		list_del_init(page_deferred_list(page));
+		pgdata->split_queue_len--;
+	}
+	spin_unlock_irqrestore(&pgdata->split_queue_lock, flags);
+}
+
 static unsigned long deferred_split_scan(struct shrinker *shrink,
 		struct shrink_control *sc)
 {
@@ -2783,6 +3075,7 @@ static unsigned long deferred_split_scan(struct shrinker *shrink,
 	unsigned long flags;
 	LIST_HEAD(list), *pos, *next;
 	struct page *page;
+	bool underused;
 	int split = 0;
 
 	spin_lock_irqsave(&pgdata->split_queue_lock, flags);
@@ -2804,11 +3097,24 @@ static unsigned long deferred_split_scan(struct shrinker *shrink,
 
 	list_for_each_safe(pos, next, &list) {
 		page = list_entry((void *)pos, struct page, mapping);
+		underused = false;
+		if (!PagePartiallyMapped(page)) {
+			if (transparent_hugepage_shrink_underused() &&
+			    PageAnon(page))
+				underused = thp_underused(page);
+			if (!underused) {
+				deferred_split_dequeue(pgdata, page);
+				goto next;
+			}
+		}
 		if (!trylock_page(page))
 			goto next;
 		/* split_huge_page() removes page from list on success */
-		if (!split_huge_page(page))
+		if (!split_huge_page(page)) {
 			split++;
+			if (underused)
+				count_vm_event(THP_UNDERUSED_SPLIT_PAGE);
+		}
 		unlock_page(page);
 next:
 		put_page(page);
@@ -2914,6 +3220,8 @@ void set_pmd_migration_entry(struct page_vma_mapped_walk *pvmw,
 	pmdswp = swp_entry_to_pmd(entry);
 	if (pmd_soft_dirty(pmdval))
 		pmdswp = pmd_swp_mksoft_dirty(pmdswp);
+	if (pmd_uffd_wp(pmdval))
+		pmdswp = pmd_swp_mkuffd_wp(pmdswp);
 	set_pmd_at(mm, address, pvmw->pmd, pmdswp);
 	page_remove_rmap(page, true);
 	put_page(page);
@@ -2938,6 +3246,8 @@ void remove_migration_pmd(struct page_vma_mapped_walk *pvmw, struct page *new)
 		pmde = pmd_mksoft_dirty(pmde);
 	if (is_write_migration_entry(entry))
 		pmde = maybe_pmd_mkwrite(pmde, vma);
+	if (pmd_swp_uffd_wp(*pvmw->pmd))
+		pmde = pmd_wrprotect(pmd_mkuffd_wp(pmde));
 
 	flush_cache_range(vma, mmun_start, mmun_start + HPAGE_PMD_SIZE);
 	if (PageAnon(new))
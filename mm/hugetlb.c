@@ -3,6 +3,7 @@
  * (C) Nadia Yvette Chambers, April 2004
  */
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/init.h>
 #include <linux/mm.h>
 #include <linux/seq_file.h>
@@ -25,6 +26,8 @@
 #include <linux/swap.h>
 #include <linux/swapops.h>
 #include <linux/jhash.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 
 #include <asm/page.h>
 #include <asm/pgtable.h>
@@ -37,6 +40,7 @@
 #include <linux/userfaultfd_k.h>
 #include <linux/page_owner.h>
 #include "internal.h"
+#include "hugetlb_vmemmap.h"
 
 int hugetlb_max_hstate __read_mostly;
 unsigned int default_hstate_idx;
@@ -852,10 +856,59 @@ static bool vma_has_reserves(struct vm_area_struct *vma, long chg)
 	return false;
 }
 
+/*
+ * Background zeroing of free huge pages.  With vm.hugetlb_zero_free_pages
+ * set, khugetlbzerod clears the free pages of the pools with CPU time
+ * nothing else wants, and hugetlb_no_page() skips clear_huge_page() for a
+ * page handed out already zeroed.  vm.hugetlb_zero_rate caps the thread
+ * at that many MB per second, 0 means no limit.
+ */
+int sysctl_hugetlb_zero_free_pages __read_mostly;
+unsigned int sysctl_hugetlb_zero_rate __read_mostly;
+
+static DECLARE_WAIT_QUEUE_HEAD(hugetlb_zerod_wait);
+/* Bumped under hugetlb_lock whenever a page to be zeroed is queued */
+static unsigned long hugetlb_zerod_seq;
+
+/*
+ * The page is known to be zeroed, kept in PG_private_2 of the first tail
+ * page.  Only meaningful for a free page and the caller dequeuing it: the
+ * flag is cleared when the page is freed again.
+ */
+static inline bool PageHugeZeroed(struct page *page)
+{
+	return PagePrivate2(&page[1]);
+}
+
+static inline void SetPageHugeZeroed(struct page *page)
+{
+	SetPagePrivate2(&page[1]);
+}
+
+static inline void ClearPageHugeZeroed(struct page *page)
+{
+	ClearPagePrivate2(&page[1]);
+}
+
 static void enqueue_huge_page(struct hstate *h, struct page *page)
 {
 	int nid = page_to_nid(page);
-	list_move(&page->lru, &h->hugepage_freelists[nid]);
+
+	/*
+	 * Zeroed pages go to the head of the free list, where they are
+	 * dequeued first.  With zeroing enabled the others go to the tail,
+	 * where khugetlbzerod looks for work.
+	 */
+	if (PageHugeZeroed(page)) {
+		list_move(&page->lru, &h->hugepage_freelists[nid]);
+		h->zeroed_huge_pages++;
+	} else if (READ_ONCE(sysctl_hugetlb_zero_free_pages)) {
+		list_move_tail(&page->lru, &h->hugepage_freelists[nid]);
+		hugetlb_zerod_seq++;
+		wake_up(&hugetlb_zerod_wait);
+	} else {
+		list_move(&page->lru, &h->hugepage_freelists[nid]);
+	}
 	h->free_huge_pages++;
 	h->free_huge_pages_node[nid]++;
 }
@@ -875,6 +928,8 @@ static struct page *dequeue_huge_page_node_exact(struct hstate *h, int nid)
 		return NULL;
 	list_move(&page->lru, &h->hugepage_activelist);
 	set_page_refcounted(page);
+	if (PageHugeZeroed(page))
+		h->zeroed_huge_pages--;
 	h->free_huge_pages--;
 	h->free_huge_pages_node[nid]--;
 	return page;
@@ -1152,15 +1207,10 @@ static inline void destroy_compound_gigantic_page(struct page *page,
 						unsigned int order) { }
 #endif
 
-static void update_and_free_page(struct hstate *h, struct page *page)
+static void __update_and_free_page(struct hstate *h, struct page *page)
 {
 	int i;
 
-	if (hstate_is_gigantic(h) && !gigantic_page_supported())
-		return;
-
-	h->nr_huge_pages--;
-	h->nr_huge_pages_node[page_to_nid(page)]--;
 	for (i = 0; i < pages_per_huge_page(h); i++) {
 		page[i].flags &= ~(1 << PG_locked | 1 << PG_error |
 				1 << PG_referenced | 1 << PG_dirty |
@@ -1178,6 +1228,72 @@ static void update_and_free_page(struct hstate *h, struct page *page)
 	}
 }
 
+/*
+ * The pages whose vmemmap has to be allocated back before they can be
+ * freed. update_and_free_page() runs under hugetlb_lock, so they are
+ * freed from a workqueue, linked through page->mapping.
+ */
+static LLIST_HEAD(hpage_freelist);
+
+static void free_hpage_workfn(struct work_struct *work)
+{
+	struct llist_node *node;
+
+	node = llist_del_all(&hpage_freelist);
+	while (node) {
+		struct page *page;
+		struct hstate *h;
+		int nid;
+
+		page = container_of((struct address_space **)node,
+				    struct page, mapping);
+		node = node->next;
+		page->mapping = NULL;
+		h = page_hstate(page);
+		nid = page_to_nid(page);
+
+		if (!alloc_huge_page_vmemmap(h, page)) {
+			__update_and_free_page(h, page);
+		} else {
+			/* Keep the page in the pool, as a surplus page */
+			spin_lock(&hugetlb_lock);
+			h->nr_huge_pages++;
+			h->nr_huge_pages_node[nid]++;
+			h->surplus_huge_pages++;
+			h->surplus_huge_pages_node[nid]++;
+			INIT_LIST_HEAD(&page->lru);
+			enqueue_huge_page(h, page);
+			spin_unlock(&hugetlb_lock);
+		}
+
+		cond_resched();
+	}
+}
+static DECLARE_WORK(free_hpage_work, free_hpage_workfn);
+
+static void update_and_free_page(struct hstate *h, struct page *page)
+{
+	if (hstate_is_gigantic(h) && !gigantic_page_supported())
+		return;
+
+	h->nr_huge_pages--;
+	h->nr_huge_pages_node[page_to_nid(page)]--;
+
+	if (PageHugeZeroed(page)) {
+		h->zeroed_huge_pages--;
+		ClearPageHugeZeroed(page);
+	}
+
+	if (PageHugeVmemmapOptimized(page)) {
+		if (llist_add((struct llist_node *)&page->mapping,
+			      &hpage_freelist))
+			schedule_work(&free_hpage_work);
+		return;
+	}
+
+	__update_and_free_page(h, page);
+}
+
 struct hstate *size_to_hstate(unsigned long size)
 {
 	struct hstate *h;
@@ -1255,6 +1371,7 @@ void free_huge_page(struct page *page)
 	page->mapping = NULL;
 	restore_reserve = PagePrivate(page);
 	ClearPagePrivate(page);
+	ClearPageHugeZeroed(page);
 
 	/*
 	 * A return code of zero implies that the subpool will be under its
@@ -1290,6 +1407,7 @@ void free_huge_page(struct page *page)
 
 static void prep_new_huge_page(struct hstate *h, struct page *page, int nid)
 {
+	free_huge_page_vmemmap(h, page);
 	INIT_LIST_HEAD(&page->lru);
 	set_compound_page_dtor(page, HUGETLB_PAGE_DTOR);
 	spin_lock(&hugetlb_lock);
@@ -1494,6 +1612,28 @@ int dissolve_free_huge_page(struct page *page)
 		int nid = page_to_nid(head);
 		if (h->free_huge_pages - h->resv_huge_pages == 0)
 			goto out;
+		list_del(&head->lru);
+		h->free_huge_pages--;
+		h->free_huge_pages_node[nid]--;
+		h->max_huge_pages--;
+
+		/*
+		 * The vmemmap must be restored here rather than from the free
+		 * worker, as the caller expects the page to be gone when we
+		 * return. If it cannot be, put the page back in the pool.
+		 */
+		if (PageHugeVmemmapOptimized(head)) {
+			spin_unlock(&hugetlb_lock);
+			rc = alloc_huge_page_vmemmap(h, head);
+			spin_lock(&hugetlb_lock);
+			if (rc) {
+				INIT_LIST_HEAD(&head->lru);
+				enqueue_huge_page(h, head);
+				h->max_huge_pages++;
+				goto out;
+			}
+		}
+
 		/*
 		 * Move PageHWPoison flag from head page to the raw error page,
 		 * which makes any subpages rather than the error page reusable.
@@ -1502,10 +1642,6 @@ int dissolve_free_huge_page(struct page *page)
 			SetPageHWPoison(page);
 			ClearPageHWPoison(head);
 		}
-		list_del(&head->lru);
-		h->free_huge_pages--;
-		h->free_huge_pages_node[nid]--;
-		h->max_huge_pages--;
 		update_and_free_page(h, head);
 		rc = 0;
 	}
@@ -2561,12 +2697,21 @@ static ssize_t surplus_hugepages_show(struct kobject *kobj,
 }
 HSTATE_ATTR_RO(surplus_hugepages);
 
+static ssize_t zeroed_hugepages_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	struct hstate *h = kobj_to_hstate(kobj, NULL);
+	return sprintf(buf, "%lu\n", h->zeroed_huge_pages);
+}
+HSTATE_ATTR_RO(zeroed_hugepages);
+
 static struct attribute *hstate_attrs[] = {
 	&nr_hugepages_attr.attr,
 	&nr_overcommit_hugepages_attr.attr,
 	&free_hugepages_attr.attr,
 	&resv_hugepages_attr.attr,
 	&surplus_hugepages_attr.attr,
+	&zeroed_hugepages_attr.attr,
 #ifdef CONFIG_NUMA
 	&nr_hugepages_mempolicy_attr.attr,
 #endif
@@ -2832,6 +2977,7 @@ void __init hugetlb_add_hstate(unsigned int order)
 	h->next_nid_to_free = first_memory_node;
 	snprintf(h->name, HSTATE_NAME_LEN, "hugepages-%lukB",
 					huge_page_size(h)/1024);
+	hugetlb_vmemmap_init(h);
 
 	parsed_hstate = h;
 }
@@ -2969,6 +3115,142 @@ int hugetlb_overcommit_handler(struct ctl_table *table, int write,
 	return ret;
 }
 
+static struct task_struct *hugetlb_zerod_task;
+static DEFINE_MUTEX(hugetlb_zerod_mutex);
+
+/*
+ * Take a free page that still has to be zeroed off the free list, as
+ * dequeue_huge_page_node_exact() would.  The pages backing reservations
+ * are left alone, and so is the last unreserved one, so that zeroing does
+ * not make allocations fail.
+ */
+static struct page *hugetlb_zero_isolate_page(struct hstate *h)
+{
+	struct page *page;
+	int nid;
+
+	if (h->free_huge_pages < h->resv_huge_pages + 2)
+		return NULL;
+
+	for_each_node_state(nid, N_MEMORY) {
+		list_for_each_entry_reverse(page, &h->hugepage_freelists[nid],
+					    lru) {
+			/* Everything from here to the head is zeroed */
+			if (PageHugeZeroed(page))
+				break;
+			if (PageHWPoison(page))
+				continue;
+			list_move(&page->lru, &h->hugepage_activelist);
+			set_page_refcounted(page);
+			h->free_huge_pages--;
+			h->free_huge_pages_node[nid]--;
+			return page;
+		}
+	}
+	return NULL;
+}
+
+static void hugetlb_zero_putback_page(struct hstate *h, struct page *page)
+{
+	int nid = page_to_nid(page);
+
+	/*
+	 * Unless the pool shrank or somebody else got a reference in the
+	 * meantime, the page goes back as free.  Otherwise the last
+	 * put_page() decides what happens to it, as for any in use page.
+	 */
+	spin_lock(&hugetlb_lock);
+	if (!h->surplus_huge_pages_node[nid] && page_ref_freeze(page, 1)) {
+		SetPageHugeZeroed(page);
+		enqueue_huge_page(h, page);
+		spin_unlock(&hugetlb_lock);
+		return;
+	}
+	spin_unlock(&hugetlb_lock);
+	put_page(page);
+}
+
+static int hugetlb_zerod(void *unused)
+{
+	struct sched_param param = { .sched_priority = 0 };
+	u64 zeroed = 0;
+
+	sched_setscheduler_nocheck(current, SCHED_IDLE, &param);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		struct page *page = NULL;
+		unsigned long seq, delay;
+		unsigned int rate;
+		struct hstate *h;
+
+		spin_lock(&hugetlb_lock);
+		seq = hugetlb_zerod_seq;
+		for_each_hstate(h) {
+			page = hugetlb_zero_isolate_page(h);
+			if (page)
+				break;
+		}
+		spin_unlock(&hugetlb_lock);
+
+		if (!page) {
+			wait_event_freezable(hugetlb_zerod_wait,
+					READ_ONCE(hugetlb_zerod_seq) != seq ||
+					kthread_should_stop());
+			continue;
+		}
+
+		clear_huge_page(page, 0, pages_per_huge_page(h));
+		hugetlb_zero_putback_page(h, page);
+
+		rate = READ_ONCE(sysctl_hugetlb_zero_rate);
+		if (!rate) {
+			cond_resched();
+			continue;
+		}
+		/* Sleep for the time the pages zeroed so far are worth */
+		zeroed += huge_page_size(h);
+		delay = div64_u64(zeroed * HZ, (u64)rate << 20);
+		if (delay) {
+			zeroed -= div64_u64((u64)delay * rate << 20, HZ);
+			schedule_timeout_interruptible(delay);
+			try_to_freeze();
+		}
+	}
+	return 0;
+}
+
+int hugetlb_zero_sysctl_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	struct task_struct *task;
+	int ret;
+
+	if (!hugepages_supported())
+		return -EOPNOTSUPP;
+
+	mutex_lock(&hugetlb_zerod_mutex);
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		goto out;
+
+	if (sysctl_hugetlb_zero_free_pages && !hugetlb_zerod_task) {
+		task = kthread_run(hugetlb_zerod, NULL, "khugetlbzerod");
+		if (IS_ERR(task)) {
+			sysctl_hugetlb_zero_free_pages = 0;
+			ret = PTR_ERR(task);
+			goto out;
+		}
+		hugetlb_zerod_task = task;
+	} else if (!sysctl_hugetlb_zero_free_pages && hugetlb_zerod_task) {
+		kthread_stop(hugetlb_zerod_task);
+		hugetlb_zerod_task = NULL;
+	}
+out:
+	mutex_unlock(&hugetlb_zerod_mutex);
+	return ret;
+}
+
 #endif /* CONFIG_SYSCTL */
 
 void hugetlb_report_meminfo(struct seq_file *m)
@@ -3718,6 +4000,43 @@ int huge_add_to_page_cache(struct page *page, struct address_space *mapping,
 	return 0;
 }
 
+static inline vm_fault_t hugetlb_handle_userfault(struct vm_area_struct *vma,
+						  struct address_space *mapping,
+						  pgoff_t idx,
+						  unsigned int flags,
+						  unsigned long haddr,
+						  unsigned long reason)
+{
+	struct hstate *h = hstate_vma(vma);
+	vm_fault_t ret;
+	u32 hash;
+	struct vm_fault vmf = {
+		.vma = vma,
+		.address = haddr,
+		.flags = flags,
+		/*
+		 * Hard to debug if it ends up being
+		 * used by a callee that assumes
+		 * something about the other
+		 * uninitialized fields... same as in
+		 * memory.c
+		 */
+	};
+
+	/*
+	 * hugetlb_fault_mutex must be dropped before
+	 * handling userfault.  Reacquire after handling
+	 * fault to make calling code simpler.
+	 */
+	hash = hugetlb_fault_mutex_hash(h, vma->vm_mm, vma, mapping,
+					idx, haddr);
+	mutex_unlock(&hugetlb_fault_mutex_table[hash]);
+	ret = handle_userfault(&vmf, reason);
+	mutex_lock(&hugetlb_fault_mutex_table[hash]);
+
+	return ret;
+}
+
 static vm_fault_t hugetlb_no_page(struct mm_struct *mm,
 			struct vm_area_struct *vma,
 			struct address_space *mapping, pgoff_t idx,
@@ -3758,30 +4077,9 @@ static vm_fault_t hugetlb_no_page(struct mm_struct *mm,
 		 * Check for page in userfault range
 		 */
 		if (userfaultfd_missing(vma)) {
-			u32 hash;
-			struct vm_fault vmf = {
-				.vma = vma,
-				.address = haddr,
-				.flags = flags,
-				/*
-				 * Hard to debug if it ends up being
-				 * used by a callee that assumes
-				 * something about the other
-				 * uninitialized fields... same as in
-				 * memory.c
-				 */
-			};
-
-			/*
-			 * hugetlb_fault_mutex must be dropped before
-			 * handling userfault.  Reacquire after handling
-			 * fault to make calling code simpler.
-			 */
-			hash = hugetlb_fault_mutex_hash(h, mm, vma, mapping,
-							idx, haddr);
-			mutex_unlock(&hugetlb_fault_mutex_table[hash]);
-			ret = handle_userfault(&vmf, VM_UFFD_MISSING);
-			mutex_lock(&hugetlb_fault_mutex_table[hash]);
+			ret = hugetlb_handle_userfault(vma, mapping, idx,
+						       flags, haddr,
+						       VM_UFFD_MISSING);
 			goto out;
 		}
 
@@ -3790,7 +4088,9 @@ static vm_fault_t hugetlb_no_page(struct mm_struct *mm,
 			ret = vmf_error(PTR_ERR(page));
 			goto out;
 		}
-		clear_huge_page(page, address, pages_per_huge_page(h));
+		if (!PageHugeZeroed(page))
+			clear_huge_page(page, address,
+					pages_per_huge_page(h));
 		__SetPageUptodate(page);
 		set_page_huge_active(page);
 
@@ -3821,6 +4121,16 @@ static vm_fault_t hugetlb_no_page(struct mm_struct *mm,
 				VM_FAULT_SET_HINDEX(hstate_index(h));
 			goto backout_unlocked;
 		}
+
+		/* Check for page in userfault range. */
+		if (userfaultfd_minor(vma)) {
+			unlock_page(page);
+			put_page(page);
+			ret = hugetlb_handle_userfault(vma, mapping, idx,
+						       flags, haddr,
+						       VM_UFFD_MINOR);
+			goto out;
+		}
 	}
 
 	/*
@@ -4057,19 +4367,27 @@ int hugetlb_mcopy_atomic_pte(struct mm_struct *dst_mm,
 			    struct vm_area_struct *dst_vma,
 			    unsigned long dst_addr,
 			    unsigned long src_addr,
+			    enum mcopy_atomic_mode mode,
 			    struct page **pagep)
 {
-	struct address_space *mapping;
-	pgoff_t idx;
+	bool is_continue = (mode == MCOPY_ATOMIC_CONTINUE);
+	struct hstate *h = hstate_vma(dst_vma);
+	struct address_space *mapping = dst_vma->vm_file->f_mapping;
+	pgoff_t idx = vma_hugecache_offset(h, dst_vma, dst_addr);
 	unsigned long size;
 	int vm_shared = dst_vma->vm_flags & VM_SHARED;
-	struct hstate *h = hstate_vma(dst_vma);
 	pte_t _dst_pte;
 	spinlock_t *ptl;
 	int ret;
 	struct page *page;
+	int writable;
 
-	if (!*pagep) {
+	if (is_continue) {
+		ret = -EFAULT;
+		page = find_lock_page(mapping, idx);
+		if (!page)
+			goto out;
+	} else if (!*pagep) {
 		ret = -ENOMEM;
 		page = alloc_huge_page(dst_vma, dst_addr, 0);
 		if (IS_ERR(page))
@@ -4096,16 +4414,15 @@ int hugetlb_mcopy_atomic_pte(struct mm_struct *dst_mm,
 	 * preceding stores to the page contents become visible before
 	 * the set_pte_at() write.
 	 */
-	__SetPageUptodate(page);
-	set_page_huge_active(page);
-
-	mapping = dst_vma->vm_file->f_mapping;
-	idx = vma_hugecache_offset(h, dst_vma, dst_addr);
+	if (!is_continue) {
+		__SetPageUptodate(page);
+		set_page_huge_active(page);
+	}
 
 	/*
 	 * If shared, add to page cache
 	 */
-	if (vm_shared) {
+	if (vm_shared && !is_continue) {
 		size = i_size_read(mapping->host) >> huge_page_shift(h);
 		ret = -EFAULT;
 		if (idx >= size)
@@ -4143,36 +4460,45 @@ int hugetlb_mcopy_atomic_pte(struct mm_struct *dst_mm,
 	if (!huge_pte_none(huge_ptep_get(dst_pte)))
 		goto out_release_unlock;
 
-	if (vm_shared) {
+	if (vm_shared || is_continue) {
 		page_dup_rmap(page, true);
 	} else {
 		ClearPagePrivate(page);
 		hugepage_add_new_anon_rmap(page, dst_vma, dst_addr);
 	}
 
-	_dst_pte = make_huge_pte(dst_vma, page, dst_vma->vm_flags & VM_WRITE);
-	if (dst_vma->vm_flags & VM_WRITE)
+	/*
+	 * A page cache page mapped into a private mapping by UFFDIO_CONTINUE
+	 * stays read-only: a write has to break COW as usual.
+	 */
+	if (is_continue && !vm_shared)
+		writable = 0;
+	else
+		writable = dst_vma->vm_flags & VM_WRITE;
+
+	_dst_pte = make_huge_pte(dst_vma, page, writable);
+	if (writable)
 		_dst_pte = huge_pte_mkdirty(_dst_pte);
 	_dst_pte = pte_mkyoung(_dst_pte);
 
 	set_huge_pte_at(dst_mm, dst_addr, dst_pte, _dst_pte);
 
 	(void)huge_ptep_set_access_flags(dst_vma, dst_addr, dst_pte, _dst_pte,
-					dst_vma->vm_flags & VM_WRITE);
+					writable);
 	hugetlb_count_add(pages_per_huge_page(h), dst_mm);
 
 	/* No need to invalidate - it was non-present before */
 	update_mmu_cache(dst_vma, dst_addr, dst_pte);
 
 	spin_unlock(ptl);
-	if (vm_shared)
+	if (vm_shared || is_continue)
 		unlock_page(page);
 	ret = 0;
 out:
 	return ret;
 out_release_unlock:
 	spin_unlock(ptl);
-	if (vm_shared)
+	if (vm_shared || is_continue)
 		unlock_page(page);
 out_release_nounlock:
 	put_page(page);
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Freeing the vmemmap pages of HugeTLB pages
+ *
+ * A HugeTLB page is described by pages_per_huge_page() struct pages, which
+ * with 64 byte struct pages take 8 vmemmap pages for a 2MB page and 4096
+ * for a 1GB one. Only the head and the first few tail struct pages hold
+ * anything specific to the page; all the other tail struct pages are
+ * identical, with just the compound_head pointer set.
+ *
+ * So the first RESERVE_VMEMMAP_NR vmemmap pages of a HugeTLB page are left
+ * alone, and the rest of its vmemmap is mapped read-only to the last of
+ * them, freeing the pages it used. This is done when a page enters the
+ * HugeTLB pool, and undone, which needs memory, when it leaves it.
+ */
+#define pr_fmt(fmt)	"HugeTLB: " fmt
+
+#include "hugetlb_vmemmap.h"
+
+/*
+ * The head page and the first tail page, which hold the state of the
+ * HugeTLB page, are not freed. The vmemmap page of the first tail page is
+ * the one the others are remapped to.
+ */
+#define RESERVE_VMEMMAP_NR		2U
+#define RESERVE_VMEMMAP_SIZE		(RESERVE_VMEMMAP_NR << PAGE_SHIFT)
+
+static bool hugetlb_free_vmemmap_enabled __initdata =
+	IS_ENABLED(CONFIG_HUGETLB_PAGE_FREE_VMEMMAP_DEFAULT_ON);
+
+static int __init early_hugetlb_free_vmemmap_param(char *buf)
+{
+	if (!buf)
+		return -EINVAL;
+
+	if (!strcmp(buf, "on"))
+		hugetlb_free_vmemmap_enabled = true;
+	else if (!strcmp(buf, "off"))
+		hugetlb_free_vmemmap_enabled = false;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+early_param("hugetlb_free_vmemmap", early_hugetlb_free_vmemmap_param);
+
+static inline unsigned long free_vmemmap_pages_size_per_hpage(struct hstate *h)
+{
+	return (unsigned long)h->nr_free_vmemmap_pages << PAGE_SHIFT;
+}
+
+/**
+ * alloc_huge_page_vmemmap - give back its own vmemmap to a HugeTLB page
+ * @h: the hstate of @head
+ * @head: the head page, leaving the HugeTLB pool
+ *
+ * Must be called before anything writes to the tail struct pages past the
+ * first ones. May sleep.
+ *
+ * Return: 0 on success, -ENOMEM if the vmemmap pages could not be
+ * allocated.
+ */
+int alloc_huge_page_vmemmap(struct hstate *h, struct page *head)
+{
+	unsigned long vmemmap_addr = (unsigned long)head;
+	unsigned long vmemmap_end, vmemmap_reuse;
+	int ret;
+
+	if (!PageHugeVmemmapOptimized(head))
+		return 0;
+
+	vmemmap_addr += RESERVE_VMEMMAP_SIZE;
+	vmemmap_end = vmemmap_addr + free_vmemmap_pages_size_per_hpage(h);
+	vmemmap_reuse = vmemmap_addr - PAGE_SIZE;
+
+	/*
+	 * Do not dig into reserves or retry hard for this: the caller can
+	 * keep the HugeTLB page instead.
+	 */
+	ret = vmemmap_remap_alloc(vmemmap_addr, vmemmap_end, vmemmap_reuse,
+				  GFP_KERNEL | __GFP_NORETRY | __GFP_THISNODE);
+	if (!ret)
+		ClearPageHugeVmemmapOptimized(head);
+
+	return ret;
+}
+
+/**
+ * free_huge_page_vmemmap - free the vmemmap of a new HugeTLB page
+ * @h: the hstate of @head
+ * @head: the head page, entering the HugeTLB pool
+ *
+ * Failing to split the vmemmap mapping just leaves the vmemmap in place.
+ */
+void free_huge_page_vmemmap(struct hstate *h, struct page *head)
+{
+	unsigned long vmemmap_addr = (unsigned long)head;
+	unsigned long vmemmap_end, vmemmap_reuse;
+
+	ClearPageHugeVmemmapOptimized(head);
+	if (!h->nr_free_vmemmap_pages)
+		return;
+
+	vmemmap_addr += RESERVE_VMEMMAP_SIZE;
+	vmemmap_end = vmemmap_addr + free_vmemmap_pages_size_per_hpage(h);
+	vmemmap_reuse = vmemmap_addr - PAGE_SIZE;
+
+	if (!vmemmap_remap_free(vmemmap_addr, vmemmap_end, vmemmap_reuse))
+		SetPageHugeVmemmapOptimized(head);
+}
+
+void __init hugetlb_vmemmap_init(struct hstate *h)
+{
+	unsigned int nr_pages = pages_per_huge_page(h);
+	unsigned int vmemmap_pages;
+
+	/*
+	 * The tail struct pages can only share a vmemmap page if none of
+	 * them straddles two.
+	 */
+	if (!hugetlb_free_vmemmap_enabled ||
+	    !is_power_of_2(sizeof(struct page)))
+		return;
+
+	vmemmap_pages = (nr_pages * sizeof(struct page)) >> PAGE_SHIFT;
+	if (vmemmap_pages <= RESERVE_VMEMMAP_NR)
+		return;
+
+	h->nr_free_vmemmap_pages = vmemmap_pages - RESERVE_VMEMMAP_NR;
+	pr_info("can free %u vmemmap pages for %s\n",
+		h->nr_free_vmemmap_pages, h->name);
+}
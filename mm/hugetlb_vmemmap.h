@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Freeing the vmemmap pages of HugeTLB pages
+ */
+#ifndef _LINUX_HUGETLB_VMEMMAP_H
+#define _LINUX_HUGETLB_VMEMMAP_H
+#include <linux/hugetlb.h>
+
+#ifdef CONFIG_HUGETLB_PAGE_FREE_VMEMMAP
+void hugetlb_vmemmap_init(struct hstate *h);
+int alloc_huge_page_vmemmap(struct hstate *h, struct page *head);
+void free_huge_page_vmemmap(struct hstate *h, struct page *head);
+
+/*
+ * Internal hugetlb specific page flag, kept in the first tail page: the
+ * vmemmap of the page is freed, and its tail struct pages past the first
+ * ones are read-only.
+ */
+static inline bool PageHugeVmemmapOptimized(struct page *head)
+{
+	return page_private(&head[1]) == 1;
+}
+
+static inline void SetPageHugeVmemmapOptimized(struct page *head)
+{
+	set_page_private(&head[1], 1);
+}
+
+static inline void ClearPageHugeVmemmapOptimized(struct page *head)
+{
+	set_page_private(&head[1], 0);
+}
+#else
+static inline void hugetlb_vmemmap_init(struct hstate *h)
+{
+}
+
+static inline int alloc_huge_page_vmemmap(struct hstate *h, struct page *head)
+{
+	return 0;
+}
+
+static inline void free_huge_page_vmemmap(struct hstate *h, struct page *head)
+{
+}
+
+static inline bool PageHugeVmemmapOptimized(struct page *head)
+{
+	return false;
+}
+#endif /* CONFIG_HUGETLB_PAGE_FREE_VMEMMAP */
+#endif /* _LINUX_HUGETLB_VMEMMAP_H */
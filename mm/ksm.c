@@ -189,6 +189,8 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @age: number of scans that have seen the page without merging it
+ * @remaining_skips: how many more scans may skip the page
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -204,6 +206,8 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	u8 age;				/* for smart scanning */
+	u8 remaining_skips;
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -279,6 +283,19 @@ static unsigned int zero_checksum __read_mostly;
 /* Whether to merge empty (zeroed) pages with actual zero pages */
 static bool ksm_use_zero_pages __read_mostly;
 
+/* Skip pages that have not merged over several scans */
+static bool ksm_smart_scan __read_mostly = true;
+
+/* The number of pages ksmd has looked at */
+static unsigned long ksm_pages_scanned;
+
+/* The number of pages smart scanning has skipped */
+static unsigned long ksm_pages_skipped;
+
+/* Wall time of the last full scan, and when the current one started */
+static unsigned int ksm_full_scan_msecs;
+static unsigned long ksm_scan_start;
+
 #ifdef CONFIG_NUMA
 /* Zeroed when merging across nodes is not allowed */
 static unsigned int ksm_merge_across_nodes = 1;
@@ -2207,6 +2224,60 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+/* How many scans to skip a page for, once it got to @age */
+static unsigned int skip_age(u8 age)
+{
+	if (age <= 3)
+		return 1;
+	if (age <= 5)
+		return 2;
+	if (age <= 8)
+		return 4;
+
+	return 8;
+}
+
+/*
+ * Smart scanning: a page that has not merged after a few scans is
+ * unlikely to ever merge, because it keeps changing or because nothing
+ * else has the same contents. Skip such pages on more and more of the
+ * following scans, rather than spend the scan rate on them.
+ */
+static bool should_skip_rmap_item(struct page *page,
+				  struct rmap_item *rmap_item)
+{
+	u8 age;
+
+	if (!ksm_smart_scan)
+		return false;
+
+	/*
+	 * KSM pages cost little in cmp_and_merge_page(), and must be seen
+	 * to notice migrations and stale stable nodes.
+	 */
+	if (PageKsm(page))
+		return false;
+
+	age = rmap_item->age;
+	if (age != U8_MAX)
+		rmap_item->age++;
+
+	/* Young pages get the chance to go through all merging stages */
+	if (age < 3)
+		return false;
+
+	/* Done skipping: look at the page, and skip it longer next time */
+	if (!rmap_item->remaining_skips) {
+		rmap_item->remaining_skips = skip_age(age);
+		return false;
+	}
+
+	ksm_pages_skipped++;
+	rmap_item->remaining_skips--;
+	remove_rmap_item_from_tree(rmap_item);
+	return true;
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -2254,6 +2325,8 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		for (nid = 0; nid < ksm_nr_node_ids; nid++)
 			root_unstable_tree[nid] = RB_ROOT;
 
+		ksm_scan_start = jiffies;
+
 		spin_lock(&ksm_mmlist_lock);
 		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
 		ksm_scan.mm_slot = slot;
@@ -2301,12 +2374,16 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 				if (rmap_item) {
 					ksm_scan.rmap_list =
 							&rmap_item->rmap_list;
+					if (should_skip_rmap_item(*page,
+								  rmap_item))
+						goto next_page;
 					ksm_scan.address += PAGE_SIZE;
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
 				return rmap_item;
 			}
+next_page:
 			put_page(*page);
 			ksm_scan.address += PAGE_SIZE;
 			cond_resched();
@@ -2326,7 +2403,8 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 	spin_lock(&ksm_mmlist_lock);
 	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
 						struct mm_slot, mm_list);
-	if (ksm_scan.address == 0) {
+	if (ksm_scan.address == 0 &&
+	    (ksm_test_exit(mm) || !test_bit(MMF_VM_MERGE_ANY, &mm->flags))) {
 		/*
 		 * We've completed a full scan of all vmas, holding mmap_sem
 		 * throughout, and found no VM_MERGEABLE: so do the same as
@@ -2335,6 +2413,8 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		 * (but beware: we can reach here even before __ksm_exit),
 		 * or when all VM_MERGEABLE areas have been unmapped (and
 		 * mmap_sem then protects against race with MADV_MERGEABLE).
+		 * An mm that asked for PR_SET_MEMORY_MERGE stays listed, as
+		 * its next mapping will be mergeable.
 		 */
 		hash_del(&slot->link);
 		list_del(&slot->mm_list);
@@ -2361,6 +2441,7 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 	if (slot != &ksm_mm_head)
 		goto next_mm;
 
+	ksm_full_scan_msecs = jiffies_to_msecs(jiffies - ksm_scan_start);
 	ksm_scan.seqnr++;
 	return NULL;
 }
@@ -2379,6 +2460,7 @@ static void ksm_do_scan(unsigned int scan_npages)
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
 			return;
+		ksm_pages_scanned++;
 		cmp_and_merge_page(page, rmap_item);
 		put_page(page);
 	}
@@ -2414,6 +2496,139 @@ static int ksm_scan_thread(void *nothing)
 	return 0;
 }
 
+/*
+ * Whether KSM can scan a mapping of @file with @vm_flags. Be somewhat
+ * over-protective for now!
+ */
+static bool ksm_compatible(const struct file *file, vm_flags_t vm_flags)
+{
+	if (vm_flags & (VM_SHARED   | VM_MAYSHARE   | VM_PFNMAP  |
+			VM_IO       | VM_DONTEXPAND | VM_HUGETLB |
+			VM_MIXEDMAP))
+		return false;
+
+	if (file && IS_DAX(file->f_mapping->host))
+		return false;
+
+#ifdef VM_SAO
+	if (vm_flags & VM_SAO)
+		return false;
+#endif
+#ifdef VM_SPARC_ADI
+	if (vm_flags & VM_SPARC_ADI)
+		return false;
+#endif
+
+	return true;
+}
+
+static bool vma_ksm_compatible(struct vm_area_struct *vma)
+{
+	return ksm_compatible(vma->vm_file, vma->vm_flags);
+}
+
+/**
+ * ksm_vma_flags - vm_flags of a new mapping in @mm
+ * @mm: the mm the mapping is made in
+ * @file: the file mapped, or NULL
+ * @vm_flags: the flags asked for
+ *
+ * Adds VM_MERGEABLE when the process asked for all its memory to be
+ * merged with PR_SET_MEMORY_MERGE, and KSM can handle the mapping.
+ */
+vm_flags_t ksm_vma_flags(struct mm_struct *mm, const struct file *file,
+			 vm_flags_t vm_flags)
+{
+	if (test_bit(MMF_VM_MERGE_ANY, &mm->flags) &&
+	    ksm_compatible(file, vm_flags))
+		vm_flags |= VM_MERGEABLE;
+	return vm_flags;
+}
+
+/* Called with mmap_sem held for writing */
+static void ksm_add_vmas(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if ((vma->vm_flags & VM_MERGEABLE) || !vma_ksm_compatible(vma))
+			continue;
+		vma_write_lock(vma);
+		vma->vm_flags |= VM_MERGEABLE;
+	}
+}
+
+/* Called with mmap_sem held for writing */
+static int ksm_del_vmas(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	int err;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (!(vma->vm_flags & VM_MERGEABLE))
+			continue;
+		if (vma->anon_vma) {
+			err = unmerge_ksm_pages(vma, vma->vm_start,
+						vma->vm_end);
+			if (err)
+				return err;
+		}
+		vma_write_lock(vma);
+		vma->vm_flags &= ~VM_MERGEABLE;
+	}
+	return 0;
+}
+
+/**
+ * ksm_enable_merge_any - make all the memory of @mm mergeable
+ * @mm: the mm, with mmap_sem held for writing
+ *
+ * Marks all the existing VMAs KSM can handle VM_MERGEABLE, and so will
+ * ksm_vma_flags() do for the ones created later, until
+ * ksm_disable_merge_any(). The setting is inherited over fork and exec.
+ */
+int ksm_enable_merge_any(struct mm_struct *mm)
+{
+	int err;
+
+	if (test_bit(MMF_VM_MERGE_ANY, &mm->flags))
+		return 0;
+
+	if (!test_bit(MMF_VM_MERGEABLE, &mm->flags)) {
+		err = __ksm_enter(mm);
+		if (err)
+			return err;
+	}
+
+	set_bit(MMF_VM_MERGE_ANY, &mm->flags);
+	ksm_add_vmas(mm);
+	return 0;
+}
+
+/**
+ * ksm_disable_merge_any - undo ksm_enable_merge_any()
+ * @mm: the mm, with mmap_sem held for writing
+ *
+ * Unmerges all the KSM pages of @mm, including those in areas made
+ * mergeable with MADV_MERGEABLE.
+ */
+int ksm_disable_merge_any(struct mm_struct *mm)
+{
+	int err;
+
+	if (!test_bit(MMF_VM_MERGE_ANY, &mm->flags))
+		return 0;
+
+	err = ksm_del_vmas(mm);
+	if (err) {
+		ksm_add_vmas(mm);
+		return err;
+	}
+
+	clear_bit(MMF_VM_MERGE_ANY, &mm->flags);
+	return 0;
+}
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -2422,25 +2637,10 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 
 	switch (advice) {
 	case MADV_MERGEABLE:
-		/*
-		 * Be somewhat over-protective for now!
-		 */
-		if (*vm_flags & (VM_MERGEABLE | VM_SHARED  | VM_MAYSHARE   |
-				 VM_PFNMAP    | VM_IO      | VM_DONTEXPAND |
-				 VM_HUGETLB | VM_MIXEDMAP))
-			return 0;		/* just ignore the advice */
-
-		if (vma_is_dax(vma))
+		if (*vm_flags & VM_MERGEABLE)
 			return 0;
-
-#ifdef VM_SAO
-		if (*vm_flags & VM_SAO)
-			return 0;
-#endif
-#ifdef VM_SPARC_ADI
-		if (*vm_flags & VM_SPARC_ADI)
-			return 0;
-#endif
+		if (!ksm_compatible(vma->vm_file, *vm_flags))
+			return 0;		/* just ignore the advice */
 
 		if (!test_bit(MMF_VM_MERGEABLE, &mm->flags)) {
 			err = __ksm_enter(mm);
@@ -2980,6 +3180,29 @@ static ssize_t use_zero_pages_store(struct kobject *kobj,
 }
 KSM_ATTR(use_zero_pages);
 
+static ssize_t smart_scan_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_smart_scan);
+}
+
+static ssize_t smart_scan_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	int err;
+	bool value;
+
+	err = kstrtobool(buf, &value);
+	if (err)
+		return -EINVAL;
+
+	ksm_smart_scan = value;
+
+	return count;
+}
+KSM_ATTR(smart_scan);
+
 static ssize_t max_page_sharing_show(struct kobject *kobj,
 				     struct kobj_attribute *attr, char *buf)
 {
@@ -3106,6 +3329,27 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
+static ssize_t full_scan_msecs_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_full_scan_msecs);
+}
+KSM_ATTR_RO(full_scan_msecs);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -3115,6 +3359,9 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_scanned_attr.attr,
+	&pages_skipped_attr.attr,
+	&full_scan_msecs_attr.attr,
 #ifdef CONFIG_NUMA
 	&merge_across_nodes_attr.attr,
 #endif
@@ -3123,6 +3370,7 @@ static struct attribute *ksm_attrs[] = {
 	&stable_node_dups_attr.attr,
 	&stable_node_chains_prune_millisecs_attr.attr,
 	&use_zero_pages_attr.attr,
+	&smart_scan_attr.attr,
 	NULL,
 };
 
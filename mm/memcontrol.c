@@ -65,6 +65,8 @@
 #include <linux/lockdep.h>
 #include <linux/file.h>
 #include <linux/tracehook.h>
+#include <linux/kmemleak.h>
+#include <linux/parser.h>
 #include "internal.h"
 #include <net/sock.h>
 #include <net/ip.h>
@@ -306,7 +308,7 @@ void memcg_put_cache_ids(void)
 
 /*
  * A lot of the calls to the cache allocation functions are expected to be
- * inlined by the compiler. Since the calls to memcg_kmem_get_cache are
+ * inlined by the compiler. Since the calls to the slab accounting hooks are
  * conditional to this static branch, we'll have to allow modules that does
  * kmem_cache_alloc and the such to see this symbol as well
  */
@@ -488,6 +490,9 @@ ino_t page_cgroup_ino(struct page *page)
 
 	rcu_read_lock();
 	memcg = READ_ONCE(page->mem_cgroup);
+	/* Slab pages are charged per object, see page_obj_cgroups() */
+	if ((unsigned long)memcg & 0x1UL)
+		memcg = NULL;
 	while (memcg && !(memcg->css.flags & CSS_ONLINE))
 		memcg = parent_mem_cgroup(memcg);
 	if (memcg)
@@ -680,10 +685,84 @@ mem_cgroup_largest_soft_limit_node(struct mem_cgroup_tree_per_node *mctz)
 	return mz;
 }
 
+/*
+ * Page state and event updates only touch the local cpu's counters and
+ * mark the memcg updated with rstat. Readers fold them in lazily with an
+ * rstat flush, which only visits the cgroups updated since the last one.
+ *
+ * Reclaim flushes the whole tree once enough updates have queued up on
+ * all cpus together, and a periodic flush bounds how stale the numbers
+ * can get in between.
+ */
+static DEFINE_PER_CPU(unsigned int, stats_updates);
+static atomic_t stats_flush_threshold = ATOMIC_INIT(0);
+static DEFINE_SPINLOCK(stats_flush_lock);
+
+static void flush_memcg_stats_dwork(struct work_struct *w);
+static DECLARE_DEFERRABLE_WORK(stats_flush_dwork, flush_memcg_stats_dwork);
+
+/* Called with irqs disabled */
+void memcg_rstat_updated(struct mem_cgroup *memcg, int val)
+{
+	unsigned int x;
+
+	cgroup_rstat_updated(memcg->css.cgroup, smp_processor_id());
+
+	x = __this_cpu_add_return(stats_updates, abs(val));
+	if (x > MEMCG_CHARGE_BATCH) {
+		atomic_add(x / MEMCG_CHARGE_BATCH, &stats_flush_threshold);
+		__this_cpu_write(stats_updates, 0);
+	}
+}
+
+static void __mem_cgroup_flush_stats(void)
+{
+	unsigned long flags;
+
+	/* Somebody else is flushing, their result is good enough for us */
+	if (!spin_trylock_irqsave(&stats_flush_lock, flags))
+		return;
+
+	cgroup_rstat_flush_irqsafe(root_mem_cgroup->css.cgroup);
+	atomic_set(&stats_flush_threshold, 0);
+	spin_unlock_irqrestore(&stats_flush_lock, flags);
+}
+
+/**
+ * mem_cgroup_flush_stats - fold pending page state and event updates in
+ *
+ * Flushes the stats of all memcgs, but only once the updates since the
+ * last flush could add up to more than the per-cpu batching would have
+ * let drift. Can be called from any context.
+ */
+void mem_cgroup_flush_stats(void)
+{
+	if (mem_cgroup_disabled())
+		return;
+
+	if (atomic_read(&stats_flush_threshold) > num_online_cpus())
+		__mem_cgroup_flush_stats();
+}
+
+static void flush_memcg_stats_dwork(struct work_struct *w)
+{
+	__mem_cgroup_flush_stats();
+	queue_delayed_work(system_unbound_wq, &stats_flush_dwork, 2UL * HZ);
+}
+
 static unsigned long memcg_sum_events(struct mem_cgroup *memcg,
 				      int event)
 {
-	return atomic_long_read(&memcg->events[event]);
+	return READ_ONCE(memcg->events[event]);
+}
+
+static unsigned long memcg_tree_events(struct mem_cgroup *memcg, int event)
+{
+	/* A cgroup1 non-hierarchical memcg only accounts for itself */
+	if (!memcg->use_hierarchy && !mem_cgroup_is_root(memcg))
+		return memcg_sum_events(memcg, event);
+
+	return READ_ONCE(memcg->events_tree[event]);
 }
 
 static void mem_cgroup_charge_statistics(struct mem_cgroup *memcg,
@@ -820,9 +899,9 @@ EXPORT_SYMBOL(mem_cgroup_from_task);
  * get_mem_cgroup_from_mm: Obtain a reference on given mm_struct's memcg.
  * @mm: mm from which memcg should be extracted. It can be NULL.
  *
- * Obtain a reference on mm->memcg and returns it if successful. Otherwise
- * root_mem_cgroup is returned. However if mem_cgroup is disabled, NULL is
- * returned.
+ * Obtain a reference on mm->memcg and returns it if successful. Without an
+ * @mm, current->active_memcg is used if set. Otherwise root_mem_cgroup is
+ * returned. However if mem_cgroup is disabled, NULL is returned.
  */
 struct mem_cgroup *get_mem_cgroup_from_mm(struct mm_struct *mm)
 {
@@ -832,6 +911,16 @@ struct mem_cgroup *get_mem_cgroup_from_mm(struct mm_struct *mm)
 		return NULL;
 
 	rcu_read_lock();
+	/*
+	 * Kernel threads doing IO on behalf of a cgroup, e.g. the loop
+	 * driver, charge the page cache they populate to that cgroup.
+	 */
+	if (unlikely(!mm && current->active_memcg) &&
+	    css_tryget_online(&current->active_memcg->css)) {
+		memcg = current->active_memcg;
+		rcu_read_unlock();
+		return memcg;
+	}
 	do {
 		/*
 		 * Page cache insertions can happen withou an
@@ -1129,6 +1218,54 @@ struct lruvec *mem_cgroup_page_lruvec(struct page *page, struct pglist_data *pgd
 	return lruvec;
 }
 
+/**
+ * lock_page_lruvec_irq - lock the lruvec a page belongs to
+ * @page: the page
+ *
+ * The memcg of a page on an LRU list only changes under the lock of the
+ * lruvec it leaves, so once the lock is held and the page still maps to
+ * that lruvec it stays there.  Otherwise the memcg changed while we were
+ * waiting for the lock, and the lock of the new lruvec is taken instead.
+ * The RCU read lock keeps the lruvec of a memcg being freed around until
+ * we found out.
+ */
+struct lruvec *lock_page_lruvec_irq(struct page *page)
+{
+	struct pglist_data *pgdat = page_pgdat(page);
+	struct lruvec *lruvec;
+
+	rcu_read_lock();
+	for (;;) {
+		lruvec = mem_cgroup_page_lruvec(page, pgdat);
+		spin_lock_irq(&lruvec->lru_lock);
+		if (likely(lruvec_holds_page_lru_lock(page, lruvec)))
+			break;
+		spin_unlock_irq(&lruvec->lru_lock);
+	}
+	rcu_read_unlock();
+
+	return lruvec;
+}
+
+struct lruvec *lock_page_lruvec_irqsave(struct page *page,
+					unsigned long *flags)
+{
+	struct pglist_data *pgdat = page_pgdat(page);
+	struct lruvec *lruvec;
+
+	rcu_read_lock();
+	for (;;) {
+		lruvec = mem_cgroup_page_lruvec(page, pgdat);
+		spin_lock_irqsave(&lruvec->lru_lock, *flags);
+		if (likely(lruvec_holds_page_lru_lock(page, lruvec)))
+			break;
+		spin_unlock_irqrestore(&lruvec->lru_lock, *flags);
+	}
+	rcu_read_unlock();
+
+	return lruvec;
+}
+
 /**
  * mem_cgroup_update_lru_size - account for adding or removing an lru page
  * @lruvec: mem_cgroup per zone lru vector
@@ -1330,6 +1467,8 @@ void mem_cgroup_print_oom_info(struct mem_cgroup *memcg, struct task_struct *p)
 		K((u64)page_counter_read(&memcg->kmem)),
 		K((u64)memcg->kmem.max), memcg->kmem.failcnt);
 
+	mem_cgroup_flush_stats();
+
 	for_each_mem_cgroup_tree(iter, memcg) {
 		pr_info("Memory cgroup stats for ");
 		pr_cont_cgroup_path(iter->css.cgroup);
@@ -1922,6 +2061,14 @@ EXPORT_SYMBOL(unlock_page_memcg);
 struct memcg_stock_pcp {
 	struct mem_cgroup *cached; /* this never be root cgroup */
 	unsigned int nr_pages;
+
+#ifdef CONFIG_MEMCG_KMEM
+	struct obj_cgroup *cached_objcg;
+	unsigned int nr_bytes;
+	/* NR_SLAB_{UN,}RECLAIMABLE deltas of cached_objcg, in bytes */
+	int nr_slab_bytes[2];
+#endif
+
 	struct work_struct work;
 	unsigned long flags;
 #define FLUSHING_CACHED_CHARGE	0
@@ -1929,6 +2076,14 @@ struct memcg_stock_pcp {
 static DEFINE_PER_CPU(struct memcg_stock_pcp, memcg_stock);
 static DEFINE_MUTEX(percpu_charge_mutex);
 
+#ifdef CONFIG_MEMCG_KMEM
+static void drain_obj_stock(struct memcg_stock_pcp *stock);
+#else
+static inline void drain_obj_stock(struct memcg_stock_pcp *stock)
+{
+}
+#endif
+
 /**
  * consume_stock: Try to consume stocked charge on this cpu.
  * @memcg: memcg to consume from.
@@ -1991,6 +2146,7 @@ static void drain_local_stock(struct work_struct *dummy)
 	local_irq_save(flags);
 
 	stock = this_cpu_ptr(&memcg_stock);
+	drain_obj_stock(stock);
 	drain_stock(stock);
 	clear_bit(FLUSHING_CACHED_CHARGE, &stock->flags);
 
@@ -2068,22 +2224,20 @@ static int memcg_hotplug_cpu_dead(unsigned int cpu)
 	struct mem_cgroup *memcg;
 
 	stock = &per_cpu(memcg_stock, cpu);
+	drain_obj_stock(stock);
 	drain_stock(stock);
 
+	/*
+	 * The memcg page state and events of the dead cpu stay where they
+	 * are: rstat flushes visit all possible cpus.
+	 */
 	for_each_mem_cgroup(memcg) {
 		int i;
 
-		for (i = 0; i < MEMCG_NR_STAT; i++) {
+		for (i = 0; i < NR_VM_NODE_STAT_ITEMS; i++) {
 			int nid;
 			long x;
 
-			x = this_cpu_xchg(memcg->stat_cpu->count[i], 0);
-			if (x)
-				atomic_long_add(x, &memcg->stat[i]);
-
-			if (i >= NR_VM_NODE_STAT_ITEMS)
-				continue;
-
 			for_each_node(nid) {
 				struct mem_cgroup_per_node *pn;
 
@@ -2093,14 +2247,6 @@ static int memcg_hotplug_cpu_dead(unsigned int cpu)
 					atomic_long_add(x, &pn->lruvec_stat[i]);
 			}
 		}
-
-		for (i = 0; i < NR_VM_EVENT_ITEMS; i++) {
-			long x;
-
-			x = this_cpu_xchg(memcg->stat_cpu->events[i], 0);
-			if (x)
-				atomic_long_add(x, &memcg->events[i]);
-		}
 	}
 
 	return 0;
@@ -2327,40 +2473,44 @@ static void cancel_charge(struct mem_cgroup *memcg, unsigned int nr_pages)
 	css_put_many(&memcg->css, nr_pages);
 }
 
-static void lock_page_lru(struct page *page, int *isolated)
+static struct lruvec *lock_page_lru(struct page *page, int *isolated)
 {
-	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec = lock_page_lruvec_irq(page);
 
-	spin_lock_irq(zone_lru_lock(zone));
 	if (PageLRU(page)) {
-		struct lruvec *lruvec;
-
-		lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
 		ClearPageLRU(page);
 		del_page_from_lru_list(page, lruvec, page_lru(page));
 		*isolated = 1;
 	} else
 		*isolated = 0;
+
+	return lruvec;
 }
 
-static void unlock_page_lru(struct page *page, int isolated)
+/*
+ * page->mem_cgroup was changed under the lock of the old lruvec: drop it,
+ * and put the page back on the lruvec of its new memcg.
+ */
+static void unlock_page_lru(struct page *page, struct lruvec *locked,
+			    int isolated)
 {
-	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
 
-	if (isolated) {
-		struct lruvec *lruvec;
+	unlock_page_lruvec_irq(locked);
+	if (!isolated)
+		return;
 
-		lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
-		VM_BUG_ON_PAGE(PageLRU(page), page);
-		SetPageLRU(page);
-		add_page_to_lru_list(page, lruvec, page_lru(page));
-	}
-	spin_unlock_irq(zone_lru_lock(zone));
+	lruvec = lock_page_lruvec_irq(page);
+	VM_BUG_ON_PAGE(PageLRU(page), page);
+	SetPageLRU(page);
+	add_page_to_lru_list(page, lruvec, page_lru(page));
+	unlock_page_lruvec_irq(lruvec);
 }
 
 static void commit_charge(struct page *page, struct mem_cgroup *memcg,
 			  bool lrucare)
 {
+	struct lruvec *lruvec = NULL;
 	int isolated;
 
 	VM_BUG_ON_PAGE(page->mem_cgroup, page);
@@ -2370,7 +2520,7 @@ static void commit_charge(struct page *page, struct mem_cgroup *memcg,
 	 * may already be on some other mem_cgroup's LRU.  Take care of it.
 	 */
 	if (lrucare)
-		lock_page_lru(page, &isolated);
+		lruvec = lock_page_lru(page, &isolated);
 
 	/*
 	 * Nobody should be changing or seriously looking at
@@ -2389,7 +2539,7 @@ static void commit_charge(struct page *page, struct mem_cgroup *memcg,
 	page->mem_cgroup = memcg;
 
 	if (lrucare)
-		unlock_page_lru(page, isolated);
+		unlock_page_lru(page, lruvec, isolated);
 }
 
 #ifdef CONFIG_MEMCG_KMEM
@@ -2438,46 +2588,6 @@ static void memcg_free_cache_id(int id)
 	ida_simple_remove(&memcg_cache_ida, id);
 }
 
-struct memcg_kmem_cache_create_work {
-	struct mem_cgroup *memcg;
-	struct kmem_cache *cachep;
-	struct work_struct work;
-};
-
-static void memcg_kmem_cache_create_func(struct work_struct *w)
-{
-	struct memcg_kmem_cache_create_work *cw =
-		container_of(w, struct memcg_kmem_cache_create_work, work);
-	struct mem_cgroup *memcg = cw->memcg;
-	struct kmem_cache *cachep = cw->cachep;
-
-	memcg_create_kmem_cache(memcg, cachep);
-
-	css_put(&memcg->css);
-	kfree(cw);
-}
-
-/*
- * Enqueue the creation of a per-memcg kmem_cache.
- */
-static void memcg_schedule_kmem_cache_create(struct mem_cgroup *memcg,
-					       struct kmem_cache *cachep)
-{
-	struct memcg_kmem_cache_create_work *cw;
-
-	cw = kmalloc(sizeof(*cw), GFP_NOWAIT | __GFP_NOWARN);
-	if (!cw)
-		return;
-
-	css_get(&memcg->css);
-
-	cw->memcg = memcg;
-	cw->cachep = cachep;
-	INIT_WORK(&cw->work, memcg_kmem_cache_create_func);
-
-	queue_work(memcg_kmem_cache_wq, &cw->work);
-}
-
 static inline bool memcg_kmem_bypass(void)
 {
 	if (in_interrupt() || !current->mm || (current->flags & PF_KTHREAD))
@@ -2485,68 +2595,38 @@ static inline bool memcg_kmem_bypass(void)
 	return false;
 }
 
-/**
- * memcg_kmem_get_cache: select the correct per-memcg cache for allocation
- * @cachep: the original global kmem cache
- *
- * Return the kmem_cache we're supposed to use for a slab allocation.
- * We try to use the current memcg's version of the cache.
- *
- * If the cache does not exist yet, if we are the first user of it, we
- * create it asynchronously in a workqueue and let the current allocation
- * go through with the original cache.
- *
- * This function takes a reference to the cache it returns to assure it
- * won't get destroyed while we are working with it. Once the caller is
- * done with it, memcg_kmem_put_cache() must be called to release the
- * reference.
+/*
+ * Charge @nr_pages to @memcg and, on cgroup1, to its kmem counter.  The
+ * caller owns the css references try_charge() takes on success.
  */
-struct kmem_cache *memcg_kmem_get_cache(struct kmem_cache *cachep)
+static int __memcg_kmem_charge(struct mem_cgroup *memcg, gfp_t gfp,
+			       unsigned int nr_pages)
 {
-	struct mem_cgroup *memcg;
-	struct kmem_cache *memcg_cachep;
-	int kmemcg_id;
-
-	VM_BUG_ON(!is_root_cache(cachep));
-
-	if (memcg_kmem_bypass())
-		return cachep;
-
-	memcg = get_mem_cgroup_from_current();
-	kmemcg_id = READ_ONCE(memcg->kmemcg_id);
-	if (kmemcg_id < 0)
-		goto out;
+	struct page_counter *counter;
+	int ret;
 
-	memcg_cachep = cache_from_memcg_idx(cachep, kmemcg_id);
-	if (likely(memcg_cachep))
-		return memcg_cachep;
+	ret = try_charge(memcg, gfp, nr_pages);
+	if (ret)
+		return ret;
 
-	/*
-	 * If we are in a safe context (can wait, and not in interrupt
-	 * context), we could be be predictable and return right away.
-	 * This would guarantee that the allocation being performed
-	 * already belongs in the new cache.
-	 *
-	 * However, there are some clashes that can arrive from locking.
-	 * For instance, because we acquire the slab_mutex while doing
-	 * memcg_create_kmem_cache, this means no further allocation
-	 * could happen with the slab_mutex held. So it's better to
-	 * defer everything.
-	 */
-	memcg_schedule_kmem_cache_create(memcg, cachep);
-out:
-	css_put(&memcg->css);
-	return cachep;
+	if (!cgroup_subsys_on_dfl(memory_cgrp_subsys) &&
+	    !page_counter_try_charge(&memcg->kmem, nr_pages, &counter)) {
+		cancel_charge(memcg, nr_pages);
+		return -ENOMEM;
+	}
+	return 0;
 }
 
-/**
- * memcg_kmem_put_cache: drop reference taken by memcg_kmem_get_cache
- * @cachep: the cache returned by memcg_kmem_get_cache
- */
-void memcg_kmem_put_cache(struct kmem_cache *cachep)
+/* Counterpart of __memcg_kmem_charge(), the css references are left alone */
+static void __memcg_kmem_uncharge(struct mem_cgroup *memcg,
+				  unsigned int nr_pages)
 {
-	if (!is_root_cache(cachep))
-		css_put(&cachep->memcg_params.memcg->css);
+	if (!cgroup_subsys_on_dfl(memory_cgrp_subsys))
+		page_counter_uncharge(&memcg->kmem, nr_pages);
+
+	page_counter_uncharge(&memcg->memory, nr_pages);
+	if (do_memsw_account())
+		page_counter_uncharge(&memcg->memsw, nr_pages);
 }
 
 /**
@@ -2561,20 +2641,12 @@ void memcg_kmem_put_cache(struct kmem_cache *cachep)
 int memcg_kmem_charge_memcg(struct page *page, gfp_t gfp, int order,
 			    struct mem_cgroup *memcg)
 {
-	unsigned int nr_pages = 1 << order;
-	struct page_counter *counter;
 	int ret;
 
-	ret = try_charge(memcg, gfp, nr_pages);
+	ret = __memcg_kmem_charge(memcg, gfp, 1 << order);
 	if (ret)
 		return ret;
 
-	if (!cgroup_subsys_on_dfl(memory_cgrp_subsys) &&
-	    !page_counter_try_charge(&memcg->kmem, nr_pages, &counter)) {
-		cancel_charge(memcg, nr_pages);
-		return -ENOMEM;
-	}
-
 	page->mem_cgroup = memcg;
 
 	return 0;
@@ -2620,13 +2692,7 @@ void memcg_kmem_uncharge(struct page *page, int order)
 
 	VM_BUG_ON_PAGE(mem_cgroup_is_root(memcg), page);
 
-	if (!cgroup_subsys_on_dfl(memory_cgrp_subsys))
-		page_counter_uncharge(&memcg->kmem, nr_pages);
-
-	page_counter_uncharge(&memcg->memory, nr_pages);
-	if (do_memsw_account())
-		page_counter_uncharge(&memcg->memsw, nr_pages);
-
+	__memcg_kmem_uncharge(memcg, nr_pages);
 	page->mem_cgroup = NULL;
 
 	/* slab pages do not have PageKmemcg flag set */
@@ -2635,13 +2701,399 @@ void memcg_kmem_uncharge(struct page *page, int order)
 
 	css_put_many(&memcg->css, nr_pages);
 }
+
+static DEFINE_SPINLOCK(objcg_lock);
+
+static void obj_cgroup_release(struct percpu_ref *ref)
+{
+	struct obj_cgroup *objcg = container_of(ref, struct obj_cgroup, refcnt);
+	struct mem_cgroup *memcg;
+	unsigned int nr_bytes;
+	unsigned int nr_pages;
+	unsigned long flags;
+
+	/*
+	 * All objects are freed and every per-cpu stock holding @objcg has
+	 * been drained, so what's left in nr_charged_bytes is a whole number
+	 * of pages: the partially used pages the objects were charged from.
+	 */
+	nr_bytes = atomic_read(&objcg->nr_charged_bytes);
+	WARN_ON_ONCE(nr_bytes & (PAGE_SIZE - 1));
+	nr_pages = nr_bytes >> PAGE_SHIFT;
+
+	spin_lock_irqsave(&objcg_lock, flags);
+	memcg = obj_cgroup_memcg(objcg);
+	if (nr_pages && !mem_cgroup_is_root(memcg))
+		__memcg_kmem_uncharge(memcg, nr_pages);
+	list_del(&objcg->list);
+	mem_cgroup_put(memcg);
+	spin_unlock_irqrestore(&objcg_lock, flags);
+
+	percpu_ref_exit(ref);
+	kfree_rcu(objcg, rcu);
+}
+
+static struct obj_cgroup *obj_cgroup_alloc(void)
+{
+	struct obj_cgroup *objcg;
+	int ret;
+
+	objcg = kzalloc(sizeof(struct obj_cgroup), GFP_KERNEL);
+	if (!objcg)
+		return NULL;
+
+	ret = percpu_ref_init(&objcg->refcnt, obj_cgroup_release, 0,
+			      GFP_KERNEL);
+	if (ret) {
+		kfree(objcg);
+		return NULL;
+	}
+	INIT_LIST_HEAD(&objcg->list);
+	return objcg;
+}
+
+/*
+ * Hand the obj_cgroups of a dying memcg over to @parent, along with the
+ * ones reparented to it earlier.  The objects they charged are then
+ * uncharged from @parent, and @memcg doesn't outlive its last page.
+ */
+static void memcg_reparent_objcgs(struct mem_cgroup *memcg,
+				  struct mem_cgroup *parent)
+{
+	struct obj_cgroup *objcg, *iter;
+
+	objcg = rcu_dereference_protected(memcg->objcg, true);
+	RCU_INIT_POINTER(memcg->objcg, NULL);
+
+	spin_lock_irq(&objcg_lock);
+
+	/* 1) Ready to reparent active objcg. */
+	list_add(&objcg->list, &memcg->objcg_list);
+	/* 2) Reparent active objcg and already reparented objcgs to parent. */
+	list_for_each_entry(iter, &memcg->objcg_list, list) {
+		css_get(&parent->css);
+		xchg(&iter->memcg, parent);
+		css_put(&memcg->css);
+	}
+	/* 3) Move already reparented objcgs to the parent's list */
+	list_splice(&memcg->objcg_list, &parent->objcg_list);
+
+	spin_unlock_irq(&objcg_lock);
+
+	percpu_ref_kill(&objcg->refcnt);
+}
+
+/**
+ * get_obj_cgroup_from_current: the obj_cgroup to charge objects to
+ *
+ * Returns the obj_cgroup of the current task's memcg, or of its closest
+ * ancestor still online, with a reference taken; NULL if the allocation
+ * isn't to be accounted.
+ */
+struct obj_cgroup *get_obj_cgroup_from_current(void)
+{
+	struct obj_cgroup *objcg = NULL;
+	struct mem_cgroup *memcg;
+
+	if (memcg_kmem_bypass())
+		return NULL;
+
+	rcu_read_lock();
+	if (unlikely(current->active_memcg))
+		memcg = current->active_memcg;
+	else
+		memcg = mem_cgroup_from_task(current);
+
+	for (; memcg && memcg != root_mem_cgroup;
+	     memcg = parent_mem_cgroup(memcg)) {
+		objcg = rcu_dereference(memcg->objcg);
+		if (objcg && obj_cgroup_tryget(objcg))
+			break;
+		objcg = NULL;
+	}
+	rcu_read_unlock();
+
+	return objcg;
+}
+
+static struct mem_cgroup *get_mem_cgroup_from_objcg(struct obj_cgroup *objcg)
+{
+	struct mem_cgroup *memcg;
+
+	rcu_read_lock();
+retry:
+	memcg = obj_cgroup_memcg(objcg);
+	if (unlikely(!css_tryget(&memcg->css)))
+		goto retry;
+	rcu_read_unlock();
+
+	return memcg;
+}
+
+static void obj_cgroup_uncharge_pages(struct obj_cgroup *objcg,
+				      unsigned int nr_pages)
+{
+	struct mem_cgroup *memcg;
+
+	rcu_read_lock();
+	memcg = obj_cgroup_memcg(objcg);
+	if (!mem_cgroup_is_root(memcg))
+		__memcg_kmem_uncharge(memcg, nr_pages);
+	rcu_read_unlock();
+}
+
+/*
+ * Fold @nr_bytes of slab statistics into the memcg of @objcg.  Only whole
+ * pages reach the memcg counters, the remainder waits in the objcg.
+ */
+static void flush_objcg_slab_bytes(struct obj_cgroup *objcg, int i,
+				   int nr_bytes)
+{
+	int nr_pages;
+
+	nr_bytes += atomic_xchg(&objcg->nr_slab_bytes[i], 0);
+	nr_pages = nr_bytes / (int)PAGE_SIZE;
+	nr_bytes -= nr_pages * (int)PAGE_SIZE;
+	if (nr_bytes)
+		atomic_add(nr_bytes, &objcg->nr_slab_bytes[i]);
+
+	if (nr_pages) {
+		rcu_read_lock();
+		__mod_memcg_state(obj_cgroup_memcg(objcg),
+				  i ? NR_SLAB_RECLAIMABLE :
+				      NR_SLAB_UNRECLAIMABLE, nr_pages);
+		rcu_read_unlock();
+	}
+}
+
+static void drain_obj_stock(struct memcg_stock_pcp *stock)
+{
+	struct obj_cgroup *old = stock->cached_objcg;
+	int i;
+
+	if (!old)
+		return;
+
+	if (stock->nr_bytes) {
+		unsigned int nr_pages = stock->nr_bytes >> PAGE_SHIFT;
+		unsigned int nr_bytes = stock->nr_bytes & (PAGE_SIZE - 1);
+
+		if (nr_pages)
+			obj_cgroup_uncharge_pages(old, nr_pages);
+
+		/*
+		 * The leftover is kept in the objcg, the next stock to cache
+		 * it picks it up and obj_cgroup_release() uncharges it.
+		 */
+		atomic_add(nr_bytes, &old->nr_charged_bytes);
+		stock->nr_bytes = 0;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(stock->nr_slab_bytes); i++) {
+		if (stock->nr_slab_bytes[i]) {
+			flush_objcg_slab_bytes(old, i, stock->nr_slab_bytes[i]);
+			stock->nr_slab_bytes[i] = 0;
+		}
+	}
+
+	obj_cgroup_put(old);
+	stock->cached_objcg = NULL;
+}
+
+/* Must be called with interrupts disabled */
+static struct memcg_stock_pcp *get_obj_stock(struct obj_cgroup *objcg)
+{
+	struct memcg_stock_pcp *stock = this_cpu_ptr(&memcg_stock);
+
+	if (stock->cached_objcg != objcg) { /* reset if necessary */
+		drain_obj_stock(stock);
+		obj_cgroup_get(objcg);
+		stock->cached_objcg = objcg;
+		stock->nr_bytes = atomic_xchg(&objcg->nr_charged_bytes, 0);
+	}
+	return stock;
+}
+
+static bool consume_obj_stock(struct obj_cgroup *objcg, unsigned int nr_bytes)
+{
+	struct memcg_stock_pcp *stock;
+	unsigned long flags;
+	bool ret = false;
+
+	local_irq_save(flags);
+
+	stock = this_cpu_ptr(&memcg_stock);
+	if (objcg == stock->cached_objcg && stock->nr_bytes >= nr_bytes) {
+		stock->nr_bytes -= nr_bytes;
+		ret = true;
+	}
+
+	local_irq_restore(flags);
+
+	return ret;
+}
+
+static void refill_obj_stock(struct obj_cgroup *objcg, unsigned int nr_bytes)
+{
+	struct memcg_stock_pcp *stock;
+	unsigned long flags;
+
+	local_irq_save(flags);
+
+	stock = get_obj_stock(objcg);
+	stock->nr_bytes += nr_bytes;
+	if (stock->nr_bytes > PAGE_SIZE)
+		drain_obj_stock(stock);
+
+	local_irq_restore(flags);
+}
+
+/**
+ * obj_cgroup_charge: charge @size bytes of objects to @objcg
+ * @objcg: object cgroup to charge
+ * @gfp: reclaim mode
+ * @size: number of bytes
+ *
+ * Whole pages are charged to the memcg, the rest of the last one is kept
+ * in the per-cpu stock for the next objects of @objcg.
+ *
+ * Returns 0 on success, an error code on failure.
+ */
+int obj_cgroup_charge(struct obj_cgroup *objcg, gfp_t gfp, size_t size)
+{
+	struct mem_cgroup *memcg;
+	unsigned int nr_pages, nr_bytes;
+	int ret;
+
+	if (consume_obj_stock(objcg, size))
+		return 0;
+
+	memcg = get_mem_cgroup_from_objcg(objcg);
+	if (mem_cgroup_is_root(memcg)) {
+		css_put(&memcg->css);
+		return 0;
+	}
+
+	nr_pages = size >> PAGE_SHIFT;
+	nr_bytes = size & (PAGE_SIZE - 1);
+	if (nr_bytes)
+		nr_pages += 1;
+
+	ret = __memcg_kmem_charge(memcg, gfp, nr_pages);
+	if (!ret) {
+		/* The objcg pins the memcg, not the charged pages */
+		css_put_many(&memcg->css, nr_pages);
+		if (nr_bytes)
+			refill_obj_stock(objcg, PAGE_SIZE - nr_bytes);
+	}
+
+	css_put(&memcg->css);
+	return ret;
+}
+
+/**
+ * obj_cgroup_uncharge: uncharge @size bytes of objects from @objcg
+ * @objcg: object cgroup to uncharge
+ * @size: number of bytes
+ */
+void obj_cgroup_uncharge(struct obj_cgroup *objcg, size_t size)
+{
+	refill_obj_stock(objcg, size);
+}
+
+/**
+ * mod_objcg_slab_state: account slab objects to the memcg of @objcg
+ * @objcg: object cgroup the objects are charged to
+ * @reclaimable: whether NR_SLAB_RECLAIMABLE or NR_SLAB_UNRECLAIMABLE
+ * @nr_bytes: size of the objects, negative when they are freed
+ */
+void mod_objcg_slab_state(struct obj_cgroup *objcg, bool reclaimable,
+			  int nr_bytes)
+{
+	struct memcg_stock_pcp *stock;
+	unsigned long flags;
+	int *bytes;
+
+	local_irq_save(flags);
+
+	stock = get_obj_stock(objcg);
+	bytes = &stock->nr_slab_bytes[reclaimable];
+	*bytes += nr_bytes;
+	if (abs(*bytes) > PAGE_SIZE) {
+		flush_objcg_slab_bytes(objcg, reclaimable, *bytes);
+		*bytes = 0;
+	}
+
+	local_irq_restore(flags);
+}
+
+/**
+ * mem_cgroup_from_obj: the memcg a kernel object is charged to
+ * @p: pointer to the object
+ *
+ * Works for slab objects as well as for kmem pages.  The caller must hold
+ * rcu_read_lock() or otherwise keep the memcg alive.
+ */
+struct mem_cgroup *mem_cgroup_from_obj(void *p)
+{
+	struct page *page;
+
+	if (mem_cgroup_disabled())
+		return NULL;
+
+	page = virt_to_head_page(p);
+
+	if (PageSlab(page)) {
+		struct obj_cgroup **objcgs = page_obj_cgroups(page);
+		unsigned int off;
+
+		if (!objcgs)
+			return NULL;
+
+		off = obj_to_index(page->slab_cache, page, p);
+		if (objcgs[off])
+			return obj_cgroup_memcg(objcgs[off]);
+		return NULL;
+	}
+
+	return page->mem_cgroup;
+}
+
+/**
+ * memcg_alloc_page_obj_cgroups: allocate the obj_cgroup vector of a slab
+ * @page: the slab page
+ * @s: the cache @page belongs to
+ * @gfp: allocation flags of the object that needs the vector
+ *
+ * The vector is installed with cmpxchg(), the page may be shared by
+ * concurrent allocations.
+ */
+int memcg_alloc_page_obj_cgroups(struct page *page, struct kmem_cache *s,
+				 gfp_t gfp)
+{
+	unsigned int objects = objs_per_slab_page(s, page);
+	void *vec;
+
+	vec = kcalloc_node(objects, sizeof(struct obj_cgroup *), gfp,
+			   page_to_nid(page));
+	if (!vec)
+		return -ENOMEM;
+
+	if (cmpxchg(&page->obj_cgroups, NULL,
+		    (struct obj_cgroup **)((unsigned long)vec | 0x1UL)))
+		kfree(vec);
+	else
+		kmemleak_not_leak(vec);
+
+	return 0;
+}
 #endif /* CONFIG_MEMCG_KMEM */
 
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 
 /*
  * Because tail pages are not marked as "used", set it. We're under
- * zone_lru_lock and migration entries setup in all page mappings.
+ * lruvec->lru_lock and migration entries setup in all page mappings.
  */
 void mem_cgroup_split_huge_fixup(struct page *head)
 {
@@ -2941,25 +3393,23 @@ struct accumulated_stats {
 	int events_size;
 };
 
+/* The caller must have flushed the stats of @memcg's subtree */
 static void accumulate_memcg_tree(struct mem_cgroup *memcg,
 				  struct accumulated_stats *acc)
 {
-	struct mem_cgroup *mi;
 	int i;
 
-	for_each_mem_cgroup_tree(mi, memcg) {
-		for (i = 0; i < acc->stats_size; i++)
-			acc->stat[i] += memcg_page_state(mi,
-				acc->stats_array ? acc->stats_array[i] : i);
+	for (i = 0; i < acc->stats_size; i++)
+		acc->stat[i] = memcg_tree_page_state(memcg,
+			acc->stats_array ? acc->stats_array[i] : i);
 
-		for (i = 0; i < acc->events_size; i++)
-			acc->events[i] += memcg_sum_events(mi,
-				acc->events_array ? acc->events_array[i] : i);
+	for (i = 0; i < acc->events_size; i++)
+		acc->events[i] = memcg_tree_events(memcg,
+			acc->events_array ? acc->events_array[i] : i);
 
-		for (i = 0; i < NR_LRU_LISTS; i++)
-			acc->lru_pages[i] +=
-				mem_cgroup_nr_lru_pages(mi, BIT(i));
-	}
+	for (i = 0; i < NR_LRU_LISTS; i++)
+		acc->lru_pages[i] = memcg_tree_page_state(memcg,
+							  NR_LRU_BASE + i);
 }
 
 static unsigned long mem_cgroup_usage(struct mem_cgroup *memcg, bool swap)
@@ -2967,14 +3417,11 @@ static unsigned long mem_cgroup_usage(struct mem_cgroup *memcg, bool swap)
 	unsigned long val = 0;
 
 	if (mem_cgroup_is_root(memcg)) {
-		struct mem_cgroup *iter;
-
-		for_each_mem_cgroup_tree(iter, memcg) {
-			val += memcg_page_state(iter, MEMCG_CACHE);
-			val += memcg_page_state(iter, MEMCG_RSS);
-			if (swap)
-				val += memcg_page_state(iter, MEMCG_SWAP);
-		}
+		mem_cgroup_flush_stats();
+		val = memcg_tree_page_state(memcg, MEMCG_CACHE) +
+		      memcg_tree_page_state(memcg, MEMCG_RSS);
+		if (swap)
+			val += memcg_tree_page_state(memcg, MEMCG_SWAP);
 	} else {
 		if (!swap)
 			val = page_counter_read(&memcg->memory);
@@ -3038,6 +3485,7 @@ static u64 mem_cgroup_read_u64(struct cgroup_subsys_state *css,
 #ifdef CONFIG_MEMCG_KMEM
 static int memcg_online_kmem(struct mem_cgroup *memcg)
 {
+	struct obj_cgroup *objcg;
 	int memcg_id;
 
 	if (cgroup_memory_nokmem)
@@ -3050,6 +3498,16 @@ static int memcg_online_kmem(struct mem_cgroup *memcg)
 	if (memcg_id < 0)
 		return memcg_id;
 
+	objcg = obj_cgroup_alloc();
+	if (!objcg) {
+		memcg_free_cache_id(memcg_id);
+		return -ENOMEM;
+	}
+	/* Dropped when the objcg is reparented or released */
+	css_get(&memcg->css);
+	objcg->memcg = memcg;
+	rcu_assign_pointer(memcg->objcg, objcg);
+
 	static_branch_inc(&memcg_kmem_enabled_key);
 	/*
 	 * A memory cgroup is considered kmem-online as soon as it gets
@@ -3076,7 +3534,7 @@ static void memcg_offline_kmem(struct mem_cgroup *memcg)
 	 * Clear the online state before clearing memcg_caches array
 	 * entries. The slab_mutex in memcg_deactivate_kmem_caches()
 	 * guarantees that no cache will be created for this cgroup
-	 * after we are done (see memcg_create_kmem_cache()).
+	 * after we are done.
 	 */
 	memcg->kmem_state = KMEM_ALLOCATED;
 
@@ -3110,6 +3568,14 @@ static void memcg_offline_kmem(struct mem_cgroup *memcg)
 	memcg_drain_all_list_lrus(kmemcg_id, parent);
 
 	memcg_free_cache_id(kmemcg_id);
+
+	/*
+	 * Without use_hierarchy the charges never reached the parent's
+	 * counters, only the root can absorb the uncharges.
+	 */
+	if (!memcg->use_hierarchy)
+		parent = root_mem_cgroup;
+	memcg_reparent_objcgs(memcg, parent);
 }
 
 static void memcg_free_kmem(struct mem_cgroup *memcg)
@@ -3121,7 +3587,6 @@ static void memcg_free_kmem(struct mem_cgroup *memcg)
 	if (memcg->kmem_state == KMEM_ALLOCATED) {
 		memcg_destroy_kmem_caches(memcg);
 		static_branch_dec(&memcg_kmem_enabled_key);
-		WARN_ON(page_counter_read(&memcg->kmem));
 	}
 }
 #else
@@ -3374,6 +3839,8 @@ static int memcg_stat_show(struct seq_file *m, void *v)
 	BUILD_BUG_ON(ARRAY_SIZE(memcg1_stat_names) != ARRAY_SIZE(memcg1_stats));
 	BUILD_BUG_ON(ARRAY_SIZE(mem_cgroup_lru_names) != NR_LRU_LISTS);
 
+	cgroup_rstat_flush(memcg->css.cgroup);
+
 	for (i = 0; i < ARRAY_SIZE(memcg1_stats); i++) {
 		if (memcg1_stats[i] == MEMCG_SWAP && !do_memsw_account())
 			continue;
@@ -3875,6 +4342,8 @@ void mem_cgroup_wb_stats(struct bdi_writeback *wb, unsigned long *pfilepages,
 	struct mem_cgroup *memcg = mem_cgroup_from_css(wb->memcg_css);
 	struct mem_cgroup *parent;
 
+	mem_cgroup_flush_stats();
+
 	*pdirty = memcg_page_state(memcg, NR_FILE_DIRTY);
 
 	/* this should eventually include NR_UNSTABLE_NFS */
@@ -4435,9 +4904,14 @@ static struct mem_cgroup *mem_cgroup_alloc(void)
 	memcg->socket_pressure = jiffies;
 #ifdef CONFIG_MEMCG_KMEM
 	memcg->kmemcg_id = -1;
+	INIT_LIST_HEAD(&memcg->objcg_list);
 #endif
 #ifdef CONFIG_CGROUP_WRITEBACK
 	INIT_LIST_HEAD(&memcg->cgwb_list);
+#endif
+#ifdef CONFIG_LRU_GEN
+	INIT_LIST_HEAD(&memcg->mm_list.fifo);
+	spin_lock_init(&memcg->mm_list.lock);
 #endif
 	idr_replace(&mem_cgroup_idr, memcg, memcg->id.id);
 	return memcg;
@@ -4523,6 +4997,10 @@ static int mem_cgroup_css_online(struct cgroup_subsys_state *css)
 	/* Online state pins memcg ID, memcg ID pins CSS */
 	refcount_set(&memcg->id.ref, 1);
 	css_get(css);
+
+	if (unlikely(mem_cgroup_is_root(memcg)))
+		queue_delayed_work(system_unbound_wq, &stats_flush_dwork,
+				   2UL * HZ);
 	return 0;
 }
 
@@ -4608,6 +5086,64 @@ static void mem_cgroup_css_reset(struct cgroup_subsys_state *css)
 	memcg_wb_domain_size_changed(memcg);
 }
 
+static void mem_cgroup_css_rstat_flush(struct cgroup_subsys_state *css, int cpu)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(css);
+	struct mem_cgroup *parent = mem_cgroup_from_css(css->parent);
+	struct mem_cgroup_stat_cpu *statc;
+	long delta, v;
+	int i;
+
+	statc = per_cpu_ptr(memcg->stat_cpu, cpu);
+
+	for (i = 0; i < MEMCG_NR_STAT; i++) {
+		/*
+		 * Collect what the children propagated up. This is a
+		 * global counter and we're called for every cpu, so the
+		 * first cpu gets all of it.
+		 */
+		delta = memcg->stat_pending[i];
+		if (delta)
+			memcg->stat_pending[i] = 0;
+
+		/* Add what changed on this cpu since the last flush */
+		v = READ_ONCE(statc->count[i]);
+		if (v != statc->count_prev[i]) {
+			memcg->stat[i] += v - statc->count_prev[i];
+			delta += v - statc->count_prev[i];
+			statc->count_prev[i] = v;
+		}
+
+		if (!delta)
+			continue;
+
+		/* Children are flushed before their parents */
+		memcg->stat_tree[i] += delta;
+		if (parent)
+			parent->stat_pending[i] += delta;
+	}
+
+	for (i = 0; i < NR_VM_EVENT_ITEMS; i++) {
+		delta = memcg->events_pending[i];
+		if (delta)
+			memcg->events_pending[i] = 0;
+
+		v = READ_ONCE(statc->events[i]);
+		if (v != statc->events_prev[i]) {
+			memcg->events[i] += v - statc->events_prev[i];
+			delta += v - statc->events_prev[i];
+			statc->events_prev[i] = v;
+		}
+
+		if (!delta)
+			continue;
+
+		memcg->events_tree[i] += delta;
+		if (parent)
+			parent->events_pending[i] += delta;
+	}
+}
+
 #ifdef CONFIG_MMU
 /* Handlers for move charge at task migration. */
 static int mem_cgroup_do_precharge(unsigned long count)
@@ -5313,6 +5849,27 @@ static void mem_cgroup_move_task(void)
 }
 #endif
 
+#ifdef CONFIG_LRU_GEN
+/* Move the mm of a migrated owner to the mm list of its new memcg */
+static void mem_cgroup_attach(struct cgroup_taskset *tset)
+{
+	struct cgroup_subsys_state *css;
+	struct task_struct *leader;
+
+	cgroup_taskset_for_each_leader(leader, css, tset) {
+		task_lock(leader);
+		if (leader->mm &&
+		    rcu_access_pointer(leader->mm->owner) == leader)
+			lru_gen_migrate_mm(leader->mm);
+		task_unlock(leader);
+	}
+}
+#else
+static void mem_cgroup_attach(struct cgroup_taskset *tset)
+{
+}
+#endif
+
 /*
  * Cgroup retains root cgroups across [un]mount cycles making it necessary
  * to verify whether we're attached to the default hierarchy on each mount
@@ -5436,6 +5993,95 @@ static ssize_t memory_high_write(struct kernfs_open_file *of,
 	return nbytes;
 }
 
+enum {
+	MEMORY_RECLAIM_SWAPPINESS = 0,
+	MEMORY_RECLAIM_FILE,
+	MEMORY_RECLAIM_ANON,
+	MEMORY_RECLAIM_NULL,
+};
+
+static const match_table_t memory_reclaim_tokens = {
+	{ MEMORY_RECLAIM_SWAPPINESS, "swappiness=%d" },
+	{ MEMORY_RECLAIM_FILE, "file" },
+	{ MEMORY_RECLAIM_ANON, "anon" },
+	{ MEMORY_RECLAIM_NULL, NULL },
+};
+
+/*
+ * "<bytes> [swappiness=<0-100>] [file|anon]": reclaim that much memory from
+ * the cgroup without touching its limits.  Fails with -EAGAIN if the target
+ * could not be met.
+ */
+static ssize_t memory_reclaim(struct kernfs_open_file *of, char *buf,
+			      size_t nbytes, loff_t off)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(of_css(of));
+	unsigned int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
+	unsigned long nr_to_reclaim, nr_reclaimed = 0;
+	bool may_file = true, may_anon = true;
+	int swappiness = -1;
+	substring_t args[MAX_OPT_ARGS];
+	char *start, *p;
+	u64 bytes;
+
+	buf = strstrip(buf);
+	bytes = memparse(buf, &start);
+	if (start == buf)
+		return -EINVAL;
+	nr_to_reclaim = bytes >> PAGE_SHIFT;
+
+	while ((p = strsep(&start, " ")) != NULL) {
+		if (!*p)
+			continue;
+		switch (match_token(p, memory_reclaim_tokens, args)) {
+		case MEMORY_RECLAIM_SWAPPINESS:
+			if (match_int(&args[0], &swappiness) ||
+			    swappiness < 0 || swappiness > 100)
+				return -EINVAL;
+			break;
+		case MEMORY_RECLAIM_FILE:
+			may_anon = false;
+			break;
+		case MEMORY_RECLAIM_ANON:
+			may_file = false;
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+	if (!may_file && !may_anon)
+		return -EINVAL;
+	/* without swap, reclaim would fall back to the page cache */
+	if (!may_file && mem_cgroup_get_nr_swap_pages(memcg) <= 0)
+		return -EAGAIN;
+
+	while (nr_reclaimed < nr_to_reclaim) {
+		unsigned long reclaimed;
+
+		if (signal_pending(current))
+			return -EINTR;
+
+		/*
+		 * On the last attempt, drain the per-cpu LRU caches in the
+		 * hope of exposing more pages to reclaim.
+		 */
+		if (!nr_retries)
+			lru_add_drain_all();
+
+		reclaimed = try_to_free_mem_cgroup_pages_proactive(memcg,
+					min(nr_to_reclaim - nr_reclaimed,
+					    SWAP_CLUSTER_MAX),
+					swappiness, may_file, may_anon);
+
+		if (!reclaimed && !nr_retries--)
+			return -EAGAIN;
+
+		nr_reclaimed += reclaimed;
+	}
+
+	return nbytes;
+}
+
 static int memory_max_show(struct seq_file *m, void *v)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_css(seq_css(m));
@@ -5533,6 +6179,8 @@ static int memory_stat_show(struct seq_file *m, void *v)
 	 * Current memory state:
 	 */
 
+	cgroup_rstat_flush(memcg->css.cgroup);
+
 	memset(&acc, 0, sizeof(acc));
 	acc.stats_size = MEMCG_NR_STAT;
 	acc.events_size = NR_VM_EVENT_ITEMS;
@@ -5654,6 +6302,11 @@ static struct cftype memory_files[] = {
 		.seq_show = memory_max_show,
 		.write = memory_max_write,
 	},
+	{
+		.name = "reclaim",
+		.flags = CFTYPE_NS_DELEGATABLE,
+		.write = memory_reclaim,
+	},
 	{
 		.name = "events",
 		.flags = CFTYPE_NOT_ON_ROOT,
@@ -5681,8 +6334,10 @@ struct cgroup_subsys memory_cgrp_subsys = {
 	.css_released = mem_cgroup_css_released,
 	.css_free = mem_cgroup_css_free,
 	.css_reset = mem_cgroup_css_reset,
+	.css_rstat_flush = mem_cgroup_css_rstat_flush,
 	.can_attach = mem_cgroup_can_attach,
 	.cancel_attach = mem_cgroup_cancel_attach,
+	.attach = mem_cgroup_attach,
 	.post_attach = mem_cgroup_move_task,
 	.bind = mem_cgroup_bind,
 	.dfl_cftypes = memory_files,
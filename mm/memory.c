@@ -736,6 +736,8 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 				pte = swp_entry_to_pte(entry);
 				if (pte_swp_soft_dirty(*src_pte))
 					pte = pte_swp_mksoft_dirty(pte);
+				if (pte_swp_uffd_wp(*src_pte))
+					pte = pte_swp_mkuffd_wp(pte);
 				set_pte_at(src_mm, addr, src_pte, pte);
 			}
 		} else if (is_device_private_entry(entry)) {
@@ -788,6 +790,13 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		pte = pte_mkclean(pte);
 	pte = pte_mkold(pte);
 
+	/*
+	 * Write protection for userfaultfd only makes sense on vmas that
+	 * keep VM_UFFD_WP in the child, see dup_userfaultfd().
+	 */
+	if (!(vm_flags & VM_UFFD_WP))
+		pte = pte_clear_uffd_wp(pte);
+
 	page = vm_normal_page(vma, addr, pte);
 	if (page) {
 		get_page(page);
@@ -876,6 +885,285 @@ static int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	return 0;
 }
 
+#ifdef CONFIG_FORK_SHARE_PTE
+/*
+ * With PR_SET_FORK_SHARE_PTE, fork() does not copy the PTE tables of
+ * anonymous memory: the child maps the parent's tables, and both map them
+ * read-only at the PMD level so that any write faults. A process only
+ * copies a table, like fork() would have, when it faults on it or changes
+ * part of it; a process dropping the whole range just drops its reference.
+ *
+ * table->pt_share_count counts the processes mapping a table besides its
+ * owner, and is serialized by the split page table lock of the table,
+ * which all of them share. The pages of a shared table are accounted to
+ * the RSS of each process mapping it, but are only mapped once as far as
+ * rmap is concerned: page_vma_mapped_walk() unshares a table before
+ * reclaim, migration or KSM touch its entries, so shared tables only ever
+ * hold present entries.
+ */
+static bool fork_share_pte(struct vm_area_struct *vma, unsigned long addr,
+			   unsigned long end)
+{
+	if (!test_bit(MMF_FORK_SHARE_PTE, &vma->vm_mm->flags))
+		return false;
+	if (!vma_is_anonymous(vma) || (vma->vm_flags & (VM_SHARED | VM_LOCKED)))
+		return false;
+	if (userfaultfd_armed(vma))
+		return false;
+	return !(addr & ~PMD_MASK) && end - addr == PMD_SIZE;
+}
+
+/* Count the pages mapped by a PTE table, as zap_pte_range() would */
+static bool pte_table_rss(struct vm_area_struct *vma, pte_t *pte,
+			  unsigned long addr, int *rss)
+{
+	int i;
+
+	for (i = 0; i < PTRS_PER_PTE; i++, pte++, addr += PAGE_SIZE) {
+		struct page *page;
+
+		if (pte_none(*pte))
+			continue;
+		if (!pte_present(*pte))
+			return false;
+		page = vm_normal_page(vma, addr, *pte);
+		if (page)
+			rss[mm_counter(page)]++;
+	}
+	return true;
+}
+
+static int share_pte_table(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+			   pmd_t *dst_pmd, pmd_t *src_pmd,
+			   struct vm_area_struct *vma, unsigned long addr)
+{
+	struct page *table = pmd_page(*src_pmd);
+	spinlock_t *pmdl, *ptl;
+	int rss[NR_MM_COUNTERS];
+	pte_t *pte;
+	int ret = -EAGAIN;
+
+	init_rss_vec(rss);
+	pmdl = pmd_lock(src_mm, src_pmd);
+	pte = pte_offset_map(src_pmd, addr);
+	ptl = pte_lockptr(src_mm, src_pmd);
+	spin_lock_nested(ptl, SINGLE_DEPTH_NESTING);
+	/*
+	 * Swap and migration entries are found again through rmap or the
+	 * swap map, which do not know about shared tables: copy those.
+	 */
+	if (pte_table_rss(vma, pte, addr, rss)) {
+		atomic_inc(&table->pt_share_count);
+		set_pmd(src_pmd, pmd_wrprotect(*src_pmd));
+		set_pmd(dst_pmd, *src_pmd);
+		ret = 0;
+	}
+	pte_unmap_unlock(pte, ptl);
+	spin_unlock(pmdl);
+
+	if (!ret) {
+		mm_inc_nr_ptes(dst_mm);
+		add_mm_rss_vec(dst_mm, rss);
+	}
+	return ret;
+}
+
+/**
+ * unshare_pte_table - give a process its own copy of a shared PTE table
+ * @vma: vma the table maps
+ * @addr: an address in the range of the table
+ * @pmd: pmd the table is mapped at
+ *
+ * Must be called before changing any entry of a table mapped read-only
+ * at @pmd, with mmap_sem, the vma lock or the rmap lock of @vma held. The
+ * copy write-protects the pages for copy-on-write, as fork() would have.
+ *
+ * Returns 0 on success, -ENOMEM if no table could be allocated.
+ */
+int unshare_pte_table(struct vm_area_struct *vma, unsigned long addr,
+		      pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long start = addr & PMD_MASK, end = start + PMD_SIZE;
+	pte_t *orig_src_pte, *src_pte, *dst_pte;
+	int rss[NR_MM_COUNTERS];
+	spinlock_t *pmdl, *ptl;
+	struct page *table;
+	pgtable_t new;
+
+	new = pte_alloc_one(mm, start);
+	if (!new)
+		return -ENOMEM;
+
+	pmdl = pmd_lock(mm, pmd);
+	if (!pmd_pte_shared(*pmd))
+		goto out;
+	table = pmd_page(*pmd);
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock_nested(ptl, SINGLE_DEPTH_NESTING);
+	if (!atomic_read(&table->pt_share_count)) {
+		/* Everybody else is gone, the table is ours alone again */
+		set_pmd(pmd, pmd_mkwrite(*pmd));
+		goto out_unlock;
+	}
+
+	/* The pages are already accounted to us, ignore the rss counts */
+	init_rss_vec(rss);
+	orig_src_pte = src_pte = pte_offset_map(pmd, start);
+	dst_pte = (pte_t *)page_address(new);
+	arch_enter_lazy_mmu_mode();
+	for (addr = start; addr != end; addr += PAGE_SIZE, src_pte++, dst_pte++) {
+		if (pte_none(*src_pte))
+			continue;
+		/* Shared tables hold no swap entry to duplicate */
+		WARN_ON_ONCE(copy_one_pte(mm, mm, dst_pte, src_pte, vma, addr,
+					  rss));
+	}
+	arch_leave_lazy_mmu_mode();
+	pte_unmap(orig_src_pte);
+
+	smp_wmb(); /* See comment in __pte_alloc() */
+	pmd_populate(mm, pmd, new);
+	/* Nothing may reach the shared table through us once it is put */
+	flush_tlb_range(vma, start, end);
+	atomic_dec(&table->pt_share_count);
+	new = NULL;
+out_unlock:
+	spin_unlock(ptl);
+out:
+	spin_unlock(pmdl);
+	if (new)
+		pte_free(mm, new);
+	return 0;
+}
+
+/**
+ * unshare_pte_tables - copy the shared PTE tables of a range
+ * @vma: vma of the range
+ * @start: start of the range
+ * @end: end of the range
+ *
+ * Gives the process its own copy of every shared table that maps part
+ * of [@start, @end). For the callers that change entries in a range and
+ * cannot fail halfway through, such as mprotect(): with mmap_sem held,
+ * no fork() can share the tables again before they are done.
+ *
+ * Returns 0 on success, -ENOMEM if a table could not be copied.
+ */
+int unshare_pte_tables(struct vm_area_struct *vma, unsigned long start,
+		       unsigned long end)
+{
+	unsigned long addr;
+
+	if (!vma_is_anonymous(vma))
+		return 0;
+	for (addr = start & PMD_MASK; addr < end; addr += PMD_SIZE) {
+		pmd_t *pmd = mm_find_pmd(vma->vm_mm, addr);
+
+		if (pmd && unlikely(pmd_pte_shared(*pmd)) &&
+		    unshare_pte_table(vma, addr, pmd))
+			return -ENOMEM;
+		cond_resched();
+	}
+	return 0;
+}
+
+/**
+ * unshare_partial_pte_tables - copy the shared PTE tables a zap splits
+ * @vma: vma of the range
+ * @start: start of the range
+ * @end: end of the range
+ *
+ * A zap drops a shared table it covers whole, but has to copy one it
+ * covers only in part, and has no way to fail.  Callers zapping part of
+ * an anonymous vma copy those tables, at the ends of the range within
+ * @vma, beforehand.
+ *
+ * Returns 0 on success, -ENOMEM if a table could not be copied.
+ */
+int unshare_partial_pte_tables(struct vm_area_struct *vma,
+			       unsigned long start, unsigned long end)
+{
+	start = max(start, vma->vm_start);
+	end = min(end, vma->vm_end);
+	if ((start & ~PMD_MASK) && unshare_pte_tables(vma, start, start + 1))
+		return -ENOMEM;
+	if ((end & ~PMD_MASK) && unshare_pte_tables(vma, end - 1, end))
+		return -ENOMEM;
+	return 0;
+}
+
+/*
+ * Drop the reference of a process on a shared PTE table it unmaps in
+ * full. Returns false if the process turned out to be the last one
+ * mapping the table, which has then to be zapped as usual.
+ */
+static bool zap_shared_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+				 unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	int rss[NR_MM_COUNTERS];
+	spinlock_t *pmdl, *ptl;
+	struct page *table;
+	bool dropped = false;
+	pte_t *pte;
+	int i;
+
+	pmdl = pmd_lock(mm, pmd);
+	if (!pmd_pte_shared(*pmd))
+		goto out;
+	table = pmd_page(*pmd);
+	pte = pte_offset_map(pmd, addr);
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock_nested(ptl, SINGLE_DEPTH_NESTING);
+	if (!atomic_read(&table->pt_share_count)) {
+		set_pmd(pmd, pmd_mkwrite(*pmd));
+	} else {
+		init_rss_vec(rss);
+		pte_table_rss(vma, pte, addr, rss);
+		pmd_clear(pmd);
+		/*
+		 * Flush before letting go, the last process holding the
+		 * table may free the pages as soon as we do.
+		 */
+		flush_tlb_range(vma, addr, addr + PMD_SIZE);
+		atomic_dec(&table->pt_share_count);
+		dropped = true;
+	}
+	pte_unmap_unlock(pte, ptl);
+out:
+	spin_unlock(pmdl);
+
+	if (dropped) {
+		mm_dec_nr_ptes(mm);
+		for (i = 0; i < NR_MM_COUNTERS; i++)
+			rss[i] = -rss[i];
+		add_mm_rss_vec(mm, rss);
+	}
+	return dropped;
+}
+#else
+static inline bool fork_share_pte(struct vm_area_struct *vma,
+				  unsigned long addr, unsigned long end)
+{
+	return false;
+}
+
+static inline int share_pte_table(struct mm_struct *dst_mm,
+				  struct mm_struct *src_mm,
+				  pmd_t *dst_pmd, pmd_t *src_pmd,
+				  struct vm_area_struct *vma, unsigned long addr)
+{
+	return -EAGAIN;
+}
+
+static inline bool zap_shared_pte_table(struct vm_area_struct *vma,
+					pmd_t *pmd, unsigned long addr)
+{
+	return false;
+}
+#endif /* CONFIG_FORK_SHARE_PTE */
+
 static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		pud_t *dst_pud, pud_t *src_pud, struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end)
@@ -903,6 +1191,10 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 		}
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
+		if (fork_share_pte(vma, addr, next) &&
+		    !share_pte_table(dst_mm, src_mm, dst_pmd, src_pmd,
+				     vma, addr))
+			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
 						vma, addr, next))
 			return -ENOMEM;
@@ -1033,6 +1325,16 @@ int copy_page_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	return ret;
 }
 
+static bool pte_table_empty(pte_t *table)
+{
+	int i;
+
+	for (i = 0; i < PTRS_PER_PTE; i++)
+		if (!pte_none(table[i]))
+			return false;
+	return true;
+}
+
 static unsigned long zap_pte_range(struct mmu_gather *tlb,
 				struct vm_area_struct *vma, pmd_t *pmd,
 				unsigned long addr, unsigned long end,
@@ -1122,7 +1424,7 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 		}
 
 		/* If details->check_mapping, we leave swap entries. */
-		if (unlikely(details))
+		if (unlikely(details && details->check_mapping))
 			continue;
 
 		entry = pte_to_swp_entry(ptent);
@@ -1190,7 +1492,29 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		 */
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			goto next;
+		if (unlikely(pmd_pte_shared(*pmd))) {
+			/*
+			 * exit drops the whole table even if the vma only
+			 * maps part of it. Other partial zaps find it copied
+			 * by unshare_partial_pte_tables().
+			 */
+			if (next - addr == PMD_SIZE || tlb->fullmm) {
+				if (zap_shared_pte_table(vma, pmd,
+							addr & PMD_MASK))
+					goto next;
+			} else if (mm_is_oom_victim(vma->vm_mm)) {
+				/* Don't allocate to reap, the exit will do */
+				goto next;
+			}
+			VM_BUG_ON_VMA(pmd_pte_shared(*pmd), vma);
+		}
 		next = zap_pte_range(tlb, vma, pmd, addr, next, details);
+		if (unlikely(details && details->reclaim_pt) &&
+		    next - addr == PMD_SIZE) {
+			if (!details->pt_end)
+				details->pt_start = addr;
+			details->pt_end = next;
+		}
 next:
 		cond_resched();
 	} while (pmd++, addr = next, addr != end);
@@ -1374,7 +1698,7 @@ void zap_page_range(struct vm_area_struct *vma, unsigned long start,
  *
  * The range must fit into one VMA.
  */
-static void zap_page_range_single(struct vm_area_struct *vma, unsigned long address,
+void zap_page_range_single(struct vm_area_struct *vma, unsigned long address,
 		unsigned long size, struct zap_details *details)
 {
 	struct mm_struct *mm = vma->vm_mm;
@@ -1390,6 +1714,140 @@ static void zap_page_range_single(struct vm_area_struct *vma, unsigned long addr
 	tlb_finish_mmu(&tlb, address, end);
 }
 
+static bool free_empty_pte_table(struct mmu_gather *tlb, pmd_t *pmd,
+				 unsigned long addr)
+{
+	struct mm_struct *mm = tlb->mm;
+	spinlock_t *pml, *ptl;
+	pgtable_t table = NULL;
+	pte_t *pte;
+
+	pml = pmd_lock(mm, pmd);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd) || pmd_devmap(*pmd) ||
+	    pmd_pte_shared(*pmd))
+		goto out;
+	pte = pte_offset_map(pmd, addr);
+	ptl = pte_lockptr(mm, pmd);
+	if (ptl != pml)
+		spin_lock_nested(ptl, SINGLE_DEPTH_NESTING);
+	if (pte_table_empty(pte)) {
+		table = pmd_pgtable(*pmd);
+		pmd_clear(pmd);
+	}
+	if (ptl != pml)
+		spin_unlock(ptl);
+	pte_unmap(pte);
+out:
+	spin_unlock(pml);
+
+	if (!table)
+		return false;
+	pte_free_tlb(tlb, table, addr);
+	mm_dec_nr_ptes(mm);
+	return true;
+}
+
+/**
+ * free_vma_empty_pte_tables - free the empty PTE tables of a VMA
+ * @vma: the VMA
+ * @start: start of the range to look at
+ * @end: end of the range to look at
+ *
+ * Frees the PTE tables that map nothing in [@start, @end), as zapping
+ * leaves them, provided their whole PMD range lies within @vma.
+ *
+ * The caller holds mmap_sem for write, and has to vma_write_unlock_mm()
+ * before releasing it.  That keeps out the faults, and the rmap locks keep
+ * out rmap walks.  The mmu_gather frees the tables once the TLB is flushed,
+ * or after an RCU grace period on the architectures whose lockless
+ * get_user_pages_fast() relies on that.
+ */
+static void free_vma_empty_pte_tables(struct vm_area_struct *vma,
+				      unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct address_space *mapping = NULL;
+	struct mmu_gather tlb;
+	unsigned long addr, next;
+	int nr_freed = 0;
+
+	lockdep_assert_held_exclusive(&mm->mmap_sem);
+
+	if (is_vm_hugetlb_page(vma))
+		return;
+	start = ALIGN(max(start, vma->vm_start), PMD_SIZE);
+	end = min(end, vma->vm_end) & PMD_MASK;
+	if (start >= end)
+		return;
+
+	vma_write_lock(vma);
+	if (vma->vm_file) {
+		mapping = vma->vm_file->f_mapping;
+		i_mmap_lock_write(mapping);
+	}
+	if (vma->anon_vma)
+		anon_vma_lock_write(vma->anon_vma);
+
+	tlb_gather_mmu(&tlb, mm, start, end);
+	for (addr = start; addr < end; addr = next) {
+		pgd_t *pgd = pgd_offset(mm, addr);
+		p4d_t *p4d;
+		pud_t *pud;
+
+		/* Skip what is not mapped at all a PUD at a time */
+		next = pud_addr_end(addr, end);
+		if (pgd_none_or_clear_bad(pgd))
+			continue;
+		p4d = p4d_offset(pgd, addr);
+		if (p4d_none_or_clear_bad(p4d))
+			continue;
+		pud = pud_offset(p4d, addr);
+		if (!pud_present(*pud) || pud_trans_huge(*pud) ||
+		    pud_devmap(*pud))
+			continue;
+		for (; addr < next; addr += PMD_SIZE)
+			if (free_empty_pte_table(&tlb, pmd_offset(pud, addr),
+						 addr))
+				nr_freed++;
+		cond_resched();
+	}
+	tlb_finish_mmu(&tlb, start, end);
+
+	if (vma->anon_vma)
+		anon_vma_unlock_write(vma->anon_vma);
+	if (mapping)
+		i_mmap_unlock_write(mapping);
+
+	count_vm_events(PGTABLE_EMPTY_FREE, nr_freed);
+}
+
+/**
+ * free_empty_pte_tables - free the PTE tables a zap emptied
+ * @mm: the address space
+ * @details: the zap_details the zap was done with
+ *
+ * Called after MADV_DONTNEED, with mmap_sem released, for the PTE tables
+ * whose whole range the zap covered, as noted in @details.  Only done if
+ * mmap_sem can be had for write right away, so as not to hold up
+ * madvise() or the faults of other threads; munmap() and exit free the
+ * tables otherwise.
+ */
+void free_empty_pte_tables(struct mm_struct *mm, struct zap_details *details)
+{
+	unsigned long start = details->pt_start, end = details->pt_end;
+	struct vm_area_struct *vma;
+
+	if (!end || !down_write_trylock(&mm->mmap_sem))
+		return;
+
+	for (vma = find_vma(mm, start); vma && vma->vm_start < end;
+	     vma = vma->vm_next)
+		free_vma_empty_pte_tables(vma, start, end);
+
+	vma_write_unlock_mm(mm);
+	up_write(&mm->mmap_sem);
+}
+
 /**
  * zap_vma_ptes - remove ptes mapping the vma
  * @vma: vm_area_struct holding ptes to be zapped
@@ -2139,6 +2597,19 @@ static vm_fault_t do_page_mkwrite(struct vm_fault *vmf)
 	struct page *page = vmf->page;
 	unsigned int old_flags = vmf->flags;
 
+	if (IS_ENABLED(CONFIG_FILE_LARGE_PAGES) &&
+	    unlikely(PageTransCompound(page))) {
+		/*
+		 * Splitting unmaps the huge page, so whether it is split or
+		 * dropped, fault the small page back in and retry.
+		 */
+		lock_page(page);
+		if (PageTransCompound(page) && page_mapping(page))
+			filemap_split_large_page(page);
+		unlock_page(page);
+		return 0; /* retry */
+	}
+
 	vmf->flags = FAULT_FLAG_WRITE|FAULT_FLAG_MKWRITE;
 
 	ret = vmf->vma->vm_ops->page_mkwrite(vmf);
@@ -2482,6 +2953,11 @@ static vm_fault_t do_wp_page(struct vm_fault *vmf)
 {
 	struct vm_area_struct *vma = vmf->vma;
 
+	if (userfaultfd_pte_wp(vma, *vmf->pte)) {
+		pte_unmap_unlock(vmf->pte, vmf->ptl);
+		return handle_userfault(vmf, VM_UFFD_WP);
+	}
+
 	vmf->page = vm_normal_page(vma, vmf->address, vmf->orig_pte);
 	if (!vmf->page) {
 		/*
@@ -2645,6 +3121,207 @@ void unmap_mapping_range(struct address_space *mapping,
 }
 EXPORT_SYMBOL(unmap_mapping_range);
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/* Do the @nr ptes hold the consecutive swap entries from @entry? */
+static bool pte_range_swap(pte_t *pte, swp_entry_t entry, int nr)
+{
+	swp_entry_t e;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (!is_swap_pte(pte[i]) || pte_swp_uffd_wp(pte[i]))
+			return false;
+		e = pte_to_swp_entry(pte[i]);
+		if (non_swap_entry(e) || swp_type(e) != swp_type(entry) ||
+		    swp_offset(e) != swp_offset(entry) + i)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Swapping in from a synchronous device without the swap cache, try the
+ * enabled orders from the largest down for a naturally aligned block of
+ * ptes that hold consecutive swap entries no one else uses.  That is how
+ * a THP or a sub-PMD block comes back from swap when it went out in one
+ * piece.  As for anonymous faults, the block is split into base pages
+ * straight away, but the pages stay contiguous and one fault reads and
+ * maps all of them.
+ */
+static struct page *alloc_swap_pages(struct vm_fault *vmf, swp_entry_t entry,
+				     int *order)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	unsigned long orders, addr, idx;
+	swp_entry_t first;
+	struct page *page;
+	gfp_t gfp;
+	pte_t *pte;
+	int o;
+
+	orders = thp_vma_small_anon_orders(vma) & THP_ORDERS_SMALL_ANON;
+	if (transparent_hugepage_enabled(vma))
+		orders |= BIT(HPAGE_PMD_ORDER);
+	if (!orders || userfaultfd_armed(vma))
+		goto fallback;
+
+	/* racy, rechecked under the pte lock */
+	pte = pte_offset_map(vmf->pmd, vmf->address & PMD_MASK);
+	for_each_set_bit(o, &orders, HPAGE_PMD_ORDER + 1) {
+		addr = ALIGN_DOWN(vmf->address, PAGE_SIZE << o);
+		idx = (vmf->address - addr) >> PAGE_SHIFT;
+		first = swp_entry(swp_type(entry), swp_offset(entry) - idx);
+		if (addr < vma->vm_start ||
+		    addr + (PAGE_SIZE << o) > vma->vm_end ||
+		    swp_offset(entry) < idx ||
+		    !pte_range_swap(pte + ((addr & ~PMD_MASK) >> PAGE_SHIFT),
+				    first, 1 << o) ||
+		    !swap_range_exclusive(first, 1 << o))
+			clear_bit(o, &orders);
+	}
+	pte_unmap(pte);
+
+	gfp = (GFP_HIGHUSER_MOVABLE | __GFP_NOWARN | __GFP_NOMEMALLOC) &
+		~__GFP_DIRECT_RECLAIM;
+	for (o = fls_long(orders) - 1; o > 0; o--) {
+		if (!test_bit(o, &orders))
+			continue;
+		addr = ALIGN_DOWN(vmf->address, PAGE_SIZE << o);
+		page = alloc_pages_vma(gfp, o, vma, addr, numa_node_id(), false);
+		if (page) {
+			split_page(page, o);
+			count_vm_event(THP_SWPIN);
+			*order = o;
+			return page;
+		}
+		count_vm_event(THP_SWPIN_FALLBACK);
+	}
+
+fallback:
+	*order = 0;
+	return alloc_page_vma(GFP_HIGHUSER_MOVABLE, vma, vmf->address);
+}
+
+/*
+ * Read the block of 1 << @order pages allocated by alloc_swap_pages() for
+ * the swap entries around @entry and map them.  Like the order-0 path of
+ * do_swap_page() the pages bypass the swap cache, and the swap entries
+ * are freed once the ptes point at the pages.
+ */
+static vm_fault_t do_swap_block(struct vm_fault *vmf, struct page *page,
+				int order, swp_entry_t entry)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	unsigned long addr = ALIGN_DOWN(vmf->address, PAGE_SIZE << order);
+	struct mem_cgroup *memcg;
+	vm_fault_t ret = VM_FAULT_MAJOR;
+	int i, nr = 1 << order;
+	int exclusive = 0;
+	pte_t pte, orig_pte;
+
+	entry = swp_entry(swp_type(entry), swp_offset(entry) -
+			  ((vmf->address - addr) >> PAGE_SHIFT));
+
+	for (i = 0; i < nr; i++) {
+		__SetPageLocked(page + i);
+		__SetPageSwapBacked(page + i);
+		set_page_private(page + i, entry.val + i);
+		lru_cache_add_anon(page + i);
+		swap_readpage(page + i, true);
+	}
+	delayacct_clear_flag(DELAYACCT_PF_SWAPIN);
+
+	/* Had to read the page from swap area: Major fault */
+	count_vm_event(PGMAJFAULT);
+	count_memcg_event_mm(vma->vm_mm, PGMAJFAULT);
+
+	for (i = 0; i < nr; i++) {
+		if (mem_cgroup_try_charge_delay(page + i, vma->vm_mm,
+						GFP_KERNEL, &memcg, false)) {
+			while (i--)
+				mem_cgroup_cancel_charge(page + i, memcg, false);
+			ret = VM_FAULT_OOM;
+			goto out_release;
+		}
+	}
+
+	/*
+	 * Back out if somebody else already faulted in one of the ptes.
+	 */
+	vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd, addr, &vmf->ptl);
+	if (unlikely(!pte_range_swap(vmf->pte, entry, nr)))
+		goto out_nomap;
+
+	for (i = 0; i < nr; i++) {
+		if (unlikely(!PageUptodate(page + i))) {
+			ret = VM_FAULT_SIGBUS;
+			goto out_nomap;
+		}
+	}
+
+	/*
+	 * Every entry was used by one pte only, so the pages are ours alone
+	 * and a write fault can make all of them writable at once.
+	 */
+	if (vmf->flags & FAULT_FLAG_WRITE) {
+		ret |= VM_FAULT_WRITE;
+		exclusive = RMAP_EXCLUSIVE;
+	}
+
+	add_mm_counter_fast(vma->vm_mm, MM_ANONPAGES, nr);
+	add_mm_counter_fast(vma->vm_mm, MM_SWAPENTS, -nr);
+	for (i = 0; i < nr; i++, addr += PAGE_SIZE) {
+		orig_pte = vmf->pte[i];
+		pte = mk_pte(page + i, vma->vm_page_prot);
+		if (exclusive)
+			pte = maybe_mkwrite(pte_mkdirty(pte), vma);
+		flush_icache_page(vma, page + i);
+		if (pte_swp_soft_dirty(orig_pte))
+			pte = pte_mksoft_dirty(pte);
+		set_pte_at(vma->vm_mm, addr, vmf->pte + i, pte);
+		arch_do_swap_page(vma->vm_mm, vma, addr, pte, orig_pte);
+
+		do_page_add_anon_rmap(page + i, vma, addr, exclusive);
+		mem_cgroup_commit_charge(page + i, memcg, true, false);
+		activate_page(page + i);
+
+		swap_free(swp_entry(swp_type(entry), swp_offset(entry) + i));
+		unlock_page(page + i);
+
+		/* No need to invalidate - it was non-present before */
+		update_mmu_cache(vma, addr, vmf->pte + i);
+	}
+	pte_unmap_unlock(vmf->pte, vmf->ptl);
+	return ret;
+
+out_nomap:
+	pte_unmap_unlock(vmf->pte, vmf->ptl);
+	for (i = 0; i < nr; i++)
+		mem_cgroup_cancel_charge(page + i, memcg, false);
+out_release:
+	for (i = 0; i < nr; i++) {
+		unlock_page(page + i);
+		put_page(page + i);
+	}
+	return ret;
+}
+#else
+static struct page *alloc_swap_pages(struct vm_fault *vmf, swp_entry_t entry,
+				     int *order)
+{
+	*order = 0;
+	return alloc_page_vma(GFP_HIGHUSER_MOVABLE, vmf->vma, vmf->address);
+}
+
+/* alloc_swap_pages() only hands out order-0 pages here */
+static vm_fault_t do_swap_block(struct vm_fault *vmf, struct page *page,
+				int order, swp_entry_t entry)
+{
+	BUG();
+	return 0;
+}
+#endif
+
 /*
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
@@ -2699,9 +3376,12 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 
 		if (si->flags & SWP_SYNCHRONOUS_IO &&
 				__swap_count(si, entry) == 1) {
+			int order;
+
 			/* skip swapcache */
-			page = alloc_page_vma(GFP_HIGHUSER_MOVABLE, vma,
-							vmf->address);
+			page = alloc_swap_pages(vmf, entry, &order);
+			if (page && order)
+				return do_swap_block(vmf, page, order, entry);
 			if (page) {
 				__SetPageLocked(page);
 				__SetPageSwapBacked(page);
@@ -2808,6 +3488,10 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 	flush_icache_page(vma, page);
 	if (pte_swp_soft_dirty(vmf->orig_pte))
 		pte = pte_mksoft_dirty(pte);
+	if (pte_swp_uffd_wp(vmf->orig_pte)) {
+		pte = pte_mkuffd_wp(pte);
+		pte = pte_wrprotect(pte);
+	}
 	set_pte_at(vma->vm_mm, vmf->address, vmf->pte, pte);
 	arch_do_swap_page(vma->vm_mm, vma, vmf->address, pte, vmf->orig_pte);
 	vmf->orig_pte = pte;
@@ -2868,6 +3552,91 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 	return ret;
 }
 
+static bool pte_range_none(pte_t *pte, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		if (!pte_none(pte[i]))
+			return false;
+	return true;
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Try the enabled sub-PMD orders from the largest down, for a naturally
+ * aligned block that lies within the vma and has no pte populated yet.
+ *
+ * The block is split into base pages straight away: rmap, the LRU, swap
+ * and migration only know PMD sized compound anon pages.  The pages stay
+ * physically contiguous, so hardware that coalesces contiguous ptes in the
+ * TLB still benefits, and one fault maps all of them.
+ */
+static struct page *alloc_anon_pages(struct vm_fault *vmf, int *order)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	unsigned long orders, addr;
+	struct page *page;
+	gfp_t gfp;
+	pte_t *pte;
+	int o;
+
+	orders = thp_vma_small_anon_orders(vma) & THP_ORDERS_SMALL_ANON;
+	if (!orders || userfaultfd_armed(vma))
+		goto fallback;
+
+	/* racy, rechecked under the pte lock */
+	pte = pte_offset_map(vmf->pmd, vmf->address & PMD_MASK);
+	for_each_set_bit(o, &orders, HPAGE_PMD_ORDER) {
+		addr = ALIGN_DOWN(vmf->address, PAGE_SIZE << o);
+		if (addr < vma->vm_start ||
+		    addr + (PAGE_SIZE << o) > vma->vm_end ||
+		    !pte_range_none(pte + ((addr & ~PMD_MASK) >> PAGE_SHIFT),
+				    1 << o))
+			clear_bit(o, &orders);
+	}
+	pte_unmap(pte);
+
+	gfp = (GFP_HIGHUSER_MOVABLE | __GFP_NOWARN | __GFP_NOMEMALLOC) &
+		~__GFP_DIRECT_RECLAIM;
+	for (o = fls_long(orders) - 1; o > 0; o--) {
+		if (!test_bit(o, &orders))
+			continue;
+		addr = ALIGN_DOWN(vmf->address, PAGE_SIZE << o);
+		page = alloc_pages_vma(gfp, o, vma, addr, numa_node_id(), false);
+		if (page) {
+			int i;
+
+			/*
+			 * Only PMD sized anon compound pages are handled by
+			 * rmap, the LRU and reclaim, so the block is mapped as
+			 * base pages.  No contiguous pte hint is set: nothing
+			 * would unfold it when a single pte of the block
+			 * changes.
+			 */
+			split_page(page, o);
+			for (i = 0; i < 1 << o; i++)
+				clear_user_highpage(page + i,
+						    addr + i * PAGE_SIZE);
+			count_vm_event(THP_SMALL_FAULT_ALLOC);
+			*order = o;
+			return page;
+		}
+		count_vm_event(THP_SMALL_FAULT_FALLBACK);
+	}
+
+fallback:
+	*order = 0;
+	return alloc_zeroed_user_highpage_movable(vma, vmf->address);
+}
+#else
+static struct page *alloc_anon_pages(struct vm_fault *vmf, int *order)
+{
+	*order = 0;
+	return alloc_zeroed_user_highpage_movable(vmf->vma, vmf->address);
+}
+#endif
+
 /*
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
@@ -2879,6 +3648,8 @@ static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
 	struct mem_cgroup *memcg;
 	struct page *page;
 	vm_fault_t ret = 0;
+	unsigned long addr;
+	int i, nr, order;
 	pte_t entry;
 
 	/* File mapping without ->vm_ops ? */
@@ -2919,34 +3690,38 @@ static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
 			pte_unmap_unlock(vmf->pte, vmf->ptl);
 			return handle_userfault(vmf, VM_UFFD_MISSING);
 		}
-		goto setpte;
+		set_pte_at(vma->vm_mm, vmf->address, vmf->pte, entry);
+		/* No need to invalidate - it was non-present before */
+		update_mmu_cache(vma, vmf->address, vmf->pte);
+		goto unlock;
 	}
 
 	/* Allocate our own private page. */
 	if (unlikely(anon_vma_prepare(vma)))
 		goto oom;
-	page = alloc_zeroed_user_highpage_movable(vma, vmf->address);
+	page = alloc_anon_pages(vmf, &order);
 	if (!page)
 		goto oom;
+	nr = 1 << order;
+	addr = ALIGN_DOWN(vmf->address, PAGE_SIZE << order);
+
+	for (i = 0; i < nr; i++) {
+		if (mem_cgroup_try_charge_delay(page + i, vma->vm_mm,
+						GFP_KERNEL, &memcg, false)) {
+			while (i--)
+				mem_cgroup_cancel_charge(page + i, memcg, false);
+			goto oom_free_page;
+		}
+		/*
+		 * The memory barrier inside __SetPageUptodate makes sure that
+		 * preceeding stores to the page contents become visible before
+		 * the set_pte_at() write.
+		 */
+		__SetPageUptodate(page + i);
+	}
 
-	if (mem_cgroup_try_charge_delay(page, vma->vm_mm, GFP_KERNEL, &memcg,
-					false))
-		goto oom_free_page;
-
-	/*
-	 * The memory barrier inside __SetPageUptodate makes sure that
-	 * preceeding stores to the page contents become visible before
-	 * the set_pte_at() write.
-	 */
-	__SetPageUptodate(page);
-
-	entry = mk_pte(page, vma->vm_page_prot);
-	if (vma->vm_flags & VM_WRITE)
-		entry = pte_mkwrite(pte_mkdirty(entry));
-
-	vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd, vmf->address,
-			&vmf->ptl);
-	if (!pte_none(*vmf->pte))
+	vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd, addr, &vmf->ptl);
+	if (!pte_range_none(vmf->pte, nr))
 		goto release;
 
 	ret = check_stable_address_space(vma->vm_mm);
@@ -2956,29 +3731,39 @@ static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
 	/* Deliver the page fault to userland, check inside PT lock */
 	if (userfaultfd_missing(vma)) {
 		pte_unmap_unlock(vmf->pte, vmf->ptl);
-		mem_cgroup_cancel_charge(page, memcg, false);
-		put_page(page);
+		for (i = 0; i < nr; i++) {
+			mem_cgroup_cancel_charge(page + i, memcg, false);
+			put_page(page + i);
+		}
 		return handle_userfault(vmf, VM_UFFD_MISSING);
 	}
 
-	inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
-	page_add_new_anon_rmap(page, vma, vmf->address, false);
-	mem_cgroup_commit_charge(page, memcg, false, false);
-	lru_cache_add_active_or_unevictable(page, vma);
-setpte:
-	set_pte_at(vma->vm_mm, vmf->address, vmf->pte, entry);
+	add_mm_counter_fast(vma->vm_mm, MM_ANONPAGES, nr);
+	for (i = 0; i < nr; i++, addr += PAGE_SIZE) {
+		page_add_new_anon_rmap(page + i, vma, addr, false);
+		mem_cgroup_commit_charge(page + i, memcg, false, false);
+		lru_cache_add_active_or_unevictable(page + i, vma);
 
-	/* No need to invalidate - it was non-present before */
-	update_mmu_cache(vma, vmf->address, vmf->pte);
+		entry = mk_pte(page + i, vma->vm_page_prot);
+		if (vma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+		set_pte_at(vma->vm_mm, addr, vmf->pte + i, entry);
+
+		/* No need to invalidate - it was non-present before */
+		update_mmu_cache(vma, addr, vmf->pte + i);
+	}
 unlock:
 	pte_unmap_unlock(vmf->pte, vmf->ptl);
 	return ret;
 release:
-	mem_cgroup_cancel_charge(page, memcg, false);
-	put_page(page);
+	for (i = 0; i < nr; i++) {
+		mem_cgroup_cancel_charge(page + i, memcg, false);
+		put_page(page + i);
+	}
 	goto unlock;
 oom_free_page:
-	put_page(page);
+	for (i = 0; i < nr; i++)
+		put_page(page + i);
 oom:
 	return VM_FAULT_OOM;
 }
@@ -3662,8 +4447,11 @@ static inline vm_fault_t create_huge_pmd(struct vm_fault *vmf)
 /* `inline' is required to avoid gcc 4.1.2 build error */
 static inline vm_fault_t wp_huge_pmd(struct vm_fault *vmf, pmd_t orig_pmd)
 {
-	if (vma_is_anonymous(vmf->vma))
+	if (vma_is_anonymous(vmf->vma)) {
+		if (userfaultfd_huge_pmd_wp(vmf->vma, orig_pmd))
+			return handle_userfault(vmf, VM_UFFD_WP);
 		return do_huge_pmd_wp_page(vmf, orig_pmd);
+	}
 	if (vmf->vma->vm_ops->huge_fault)
 		return vmf->vma->vm_ops->huge_fault(vmf, PE_SIZE_PMD);
 
@@ -3886,6 +4674,10 @@ static vm_fault_t __handle_mm_fault(struct vm_area_struct *vma,
 		}
 	}
 
+	if (unlikely(pmd_pte_shared(*vmf.pmd)) &&
+	    unshare_pte_table(vma, address, vmf.pmd))
+		return VM_FAULT_OOM;
+
 	return handle_pte_fault(&vmf);
 }
 
@@ -40,6 +40,7 @@
 #include <linux/gfp.h>
 #include <linux/pfn_t.h>
 #include <linux/memremap.h>
+#include <linux/memory.h>
 #include <linux/userfaultfd_k.h>
 #include <linux/balloon_compaction.h>
 #include <linux/mmu_notifier.h>
@@ -47,6 +48,7 @@
 #include <linux/page_owner.h>
 #include <linux/sched/mm.h>
 #include <linux/ptrace.h>
+#include <linux/sched/sysctl.h>
 
 #include <asm/tlbflush.h>
 
@@ -197,14 +199,60 @@ void putback_movable_pages(struct list_head *l)
 	}
 }
 
+struct rmap_walk_arg {
+	struct page *page;
+	bool map_unused_to_zeropage;
+};
+
+/*
+ * Map a zero-filled subpage of a just split anonymous THP to the shared zero
+ * page instead of restoring its migration entry, so that the subpage is
+ * freed when the split drops its reference.
+ */
+static bool try_to_map_unused_to_zeropage(struct page_vma_mapped_walk *pvmw,
+					  struct page *page)
+{
+	struct vm_area_struct *vma = pvmw->vma;
+	bool contains_data;
+	pte_t newpte;
+	void *addr;
+
+	VM_BUG_ON_PAGE(PageCompound(page), page);
+	VM_BUG_ON_PAGE(!PageAnon(page), page);
+	VM_BUG_ON_PAGE(!PageLocked(page), page);
+	VM_BUG_ON_PAGE(pte_present(*pvmw->pte), page);
+
+	if (PageMlocked(page) || PageSwapCache(page) ||
+	    (vma->vm_flags & VM_LOCKED) || mm_forbids_zeropage(vma->vm_mm))
+		return false;
+
+	/* The zero page would lose the userfaultfd write protection */
+	if (pte_swp_uffd_wp(*pvmw->pte))
+		return false;
+
+	addr = kmap_atomic(page);
+	contains_data = memchr_inv(addr, 0, PAGE_SIZE);
+	kunmap_atomic(addr);
+	if (contains_data)
+		return false;
+
+	newpte = pte_mkspecial(pfn_pte(my_zero_pfn(pvmw->address),
+				       vma->vm_page_prot));
+	set_pte_at(vma->vm_mm, pvmw->address, pvmw->pte, newpte);
+
+	dec_mm_counter(vma->vm_mm, MM_ANONPAGES);
+	return true;
+}
+
 /*
  * Restore a potential migration pte to a working pte entry
  */
 static bool remove_migration_pte(struct page *page, struct vm_area_struct *vma,
-				 unsigned long addr, void *old)
+				 unsigned long addr, void *arg)
 {
+	struct rmap_walk_arg *rmap_walk_arg = arg;
 	struct page_vma_mapped_walk pvmw = {
-		.page = old,
+		.page = rmap_walk_arg->page,
 		.vma = vma,
 		.address = addr,
 		.flags = PVMW_SYNC | PVMW_MIGRATION,
@@ -230,6 +278,10 @@ static bool remove_migration_pte(struct page *page, struct vm_area_struct *vma,
 		}
 #endif
 
+		if (rmap_walk_arg->map_unused_to_zeropage &&
+		    try_to_map_unused_to_zeropage(&pvmw, new))
+			continue;
+
 		get_page(new);
 		pte = pte_mkold(mk_pte(new, READ_ONCE(vma->vm_page_prot)));
 		if (pte_swp_soft_dirty(*pvmw.pte))
@@ -241,6 +293,8 @@ static bool remove_migration_pte(struct page *page, struct vm_area_struct *vma,
 		entry = pte_to_swp_entry(*pvmw.pte);
 		if (is_write_migration_entry(entry))
 			pte = maybe_mkwrite(pte, vma);
+		if (pte_swp_uffd_wp(*pvmw.pte))
+			pte = pte_wrprotect(pte_mkuffd_wp(pte));
 
 		if (unlikely(is_zone_device_page(new))) {
 			if (is_device_private_page(new)) {
@@ -287,16 +341,21 @@ static bool remove_migration_pte(struct page *page, struct vm_area_struct *vma,
 
 /*
  * Get rid of all migration entries and replace them by
- * references to the indicated page.
+ * references to the indicated page.  With RMP_USE_SHARED_ZEROPAGE,
+ * zero-filled anonymous pages are mapped to the shared zero page instead.
  */
-void remove_migration_ptes(struct page *old, struct page *new, bool locked)
+void remove_migration_ptes(struct page *old, struct page *new, int flags)
 {
+	struct rmap_walk_arg rmap_walk_arg = {
+		.page = old,
+		.map_unused_to_zeropage = flags & RMP_USE_SHARED_ZEROPAGE,
+	};
 	struct rmap_walk_control rwc = {
 		.rmap_one = remove_migration_pte,
-		.arg = old,
+		.arg = &rmap_walk_arg,
 	};
 
-	if (locked)
+	if (flags & RMP_LOCKED)
 		rmap_walk_locked(new, &rwc);
 	else
 		rmap_walk(new, &rwc);
@@ -854,7 +913,7 @@ static int writeout(struct address_space *mapping, struct page *page)
 	 * At this point we know that the migration attempt cannot
 	 * be successful.
 	 */
-	remove_migration_ptes(page, page, false);
+	remove_migration_ptes(page, page, 0);
 
 	rc = mapping->a_ops->writepage(page, &wbc);
 
@@ -1094,7 +1153,7 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 
 	if (page_was_mapped)
 		remove_migration_ptes(page,
-			rc == MIGRATEPAGE_SUCCESS ? newpage : page, false);
+			rc == MIGRATEPAGE_SUCCESS ? newpage : page, 0);
 
 out_unlock_both:
 	unlock_page(newpage);
@@ -1307,7 +1366,7 @@ static int unmap_and_move_huge_page(new_page_t get_new_page,
 
 	if (page_was_mapped)
 		remove_migration_ptes(hpage,
-			rc == MIGRATEPAGE_SUCCESS ? new_hpage : hpage, false);
+			rc == MIGRATEPAGE_SUCCESS ? new_hpage : hpage, 0);
 
 	unlock_page(new_hpage);
 
@@ -1855,8 +1914,24 @@ static int numamigrate_isolate_page(pg_data_t *pgdat, struct page *page)
 	VM_BUG_ON_PAGE(compound_order(page) && !PageTransHuge(page), page);
 
 	/* Avoid migrating to a node that is nearly full */
-	if (!migrate_balanced_pgdat(pgdat, 1UL << compound_order(page)))
+	if (!migrate_balanced_pgdat(pgdat, 1UL << compound_order(page))) {
+		int z;
+
+		/*
+		 * When promoting, have kswapd make room by demoting the
+		 * coldest pages of the node.
+		 */
+		if (!(sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING))
+			return 0;
+		for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+			if (populated_zone(pgdat->node_zones + z))
+				break;
+		}
+		if (z >= 0)
+			wakeup_kswapd(pgdat->node_zones + z, 0,
+				      compound_order(page), ZONE_MOVABLE);
 		return 0;
+	}
 
 	if (isolate_lru_page(page))
 		return 0;
@@ -1901,6 +1976,8 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			   int node)
 {
 	pg_data_t *pgdat = NODE_DATA(node);
+	bool promote = !node_is_toptier(page_to_nid(page)) &&
+		       node_is_toptier(node);
 	int isolated;
 	int nr_remaining;
 	LIST_HEAD(migratepages);
@@ -1936,8 +2013,11 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			putback_lru_page(page);
 		}
 		isolated = 0;
-	} else
+	} else {
 		count_vm_numa_event(NUMA_PAGE_MIGRATE);
+		if (promote)
+			count_vm_numa_event(NUMA_PAGE_PROMOTE);
+	}
 	BUG_ON(!list_empty(&migratepages));
 	return isolated;
 
@@ -2058,6 +2138,8 @@ int migrate_misplaced_transhuge_page(struct mm_struct *mm,
 
 	count_vm_events(PGMIGRATE_SUCCESS, HPAGE_PMD_NR);
 	count_vm_numa_events(NUMA_PAGE_MIGRATE, HPAGE_PMD_NR);
+	if (!node_is_toptier(page_to_nid(page)) && node_is_toptier(node))
+		count_vm_numa_events(NUMA_PAGE_PROMOTE, HPAGE_PMD_NR);
 
 	mod_node_page_state(page_pgdat(page),
 			NR_ISOLATED_ANON + page_lru,
@@ -2180,6 +2262,9 @@ static int migrate_vma_collect_pmd(pmd_t *pmdp,
 
 	if (unlikely(pmd_bad(*pmdp)))
 		return migrate_vma_collect_skip(start, end, walk);
+	/* Device memory may not be put in a PTE table shared on fork */
+	if (unlikely(pmd_pte_shared(*pmdp)))
+		return migrate_vma_collect_skip(start, end, walk);
 
 	ptep = pte_offset_map_lock(mm, pmdp, addr, &ptl);
 	arch_enter_lazy_mmu_mode();
@@ -2540,7 +2625,7 @@ static void migrate_vma_unmap(struct migrate_vma *migrate)
 		if (!page || (migrate->src[i] & MIGRATE_PFN_MIGRATE))
 			continue;
 
-		remove_migration_ptes(page, page, false);
+		remove_migration_ptes(page, page, 0);
 
 		migrate->src[i] = 0;
 		unlock_page(page);
@@ -2807,7 +2892,7 @@ static void migrate_vma_finalize(struct migrate_vma *migrate)
 			newpage = page;
 		}
 
-		remove_migration_ptes(page, newpage, false);
+		remove_migration_ptes(page, newpage, 0);
 		unlock_page(page);
 		migrate->cpages--;
 
@@ -2946,3 +3031,129 @@ int migrate_vma(const struct migrate_vma_ops *ops,
 }
 EXPORT_SYMBOL(migrate_vma);
 #endif /* defined(MIGRATE_VMA_HELPER) */
+
+#ifdef CONFIG_NUMA
+/*
+ * node_demotion[] gives, for each top tier node, the slow memory node that
+ * reclaim migrates its cold pages to rather than discarding or swapping
+ * them. It is the nearest memory-only node by node_distance(), and is
+ * recomputed when memory is onlined or offlined. Readers do not lock:
+ * they may see a stale target, which migration copes with.
+ */
+static int node_demotion[MAX_NUMNODES] __read_mostly =
+	{[0 ... MAX_NUMNODES - 1] = NUMA_NO_NODE};
+
+/* Set from /sys/kernel/mm/numa/demotion_enabled */
+bool numa_demotion_enabled __read_mostly;
+
+/**
+ * next_demotion_node() - Get the node to demote the pages of @node to
+ * @node: The node reclaim runs on
+ *
+ * Return: the target node, or NUMA_NO_NODE if @node is in the slow tier or
+ * there is no slow memory.
+ */
+int next_demotion_node(int node)
+{
+	return READ_ONCE(node_demotion[node]);
+}
+
+static void set_migration_target_nodes(void)
+{
+	int node, target, best;
+
+	for_each_node(node) {
+		best = NUMA_NO_NODE;
+		if (node_state(node, N_MEMORY) && node_is_toptier(node)) {
+			for_each_node_state(target, N_MEMORY) {
+				if (node_is_toptier(target))
+					continue;
+				if (best == NUMA_NO_NODE ||
+				    node_distance(node, target) <
+				    node_distance(node, best))
+					best = target;
+			}
+		}
+		WRITE_ONCE(node_demotion[node], best);
+	}
+}
+
+static int migrate_on_reclaim_callback(struct notifier_block *self,
+				       unsigned long action, void *arg)
+{
+	switch (action) {
+	case MEM_ONLINE:
+	case MEM_OFFLINE:
+		set_migration_target_nodes();
+		break;
+	}
+	return notifier_from_errno(0);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t demotion_enabled_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n",
+		       numa_demotion_enabled ? "true" : "false");
+}
+
+static ssize_t demotion_enabled_store(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	if (!strncmp(buf, "true", 4) || !strncmp(buf, "1", 1))
+		numa_demotion_enabled = true;
+	else if (!strncmp(buf, "false", 5) || !strncmp(buf, "0", 1))
+		numa_demotion_enabled = false;
+	else
+		return -EINVAL;
+
+	return count;
+}
+
+static struct kobj_attribute numa_demotion_enabled_attr =
+	__ATTR(demotion_enabled, 0644, demotion_enabled_show,
+	       demotion_enabled_store);
+
+static struct attribute *numa_attrs[] = {
+	&numa_demotion_enabled_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group numa_attr_group = {
+	.attrs = numa_attrs,
+};
+
+static int __init numa_init_sysfs(void)
+{
+	int err;
+	struct kobject *numa_kobj;
+
+	numa_kobj = kobject_create_and_add("numa", mm_kobj);
+	if (!numa_kobj) {
+		pr_err("failed to create numa kobject\n");
+		return -ENOMEM;
+	}
+	err = sysfs_create_group(numa_kobj, &numa_attr_group);
+	if (err) {
+		pr_err("failed to register numa group\n");
+		goto delete_obj;
+	}
+	return 0;
+
+delete_obj:
+	kobject_put(numa_kobj);
+	return err;
+}
+subsys_initcall(numa_init_sysfs);
+#endif /* CONFIG_SYSFS */
+
+static int __init migrate_on_reclaim_init(void)
+{
+	set_migration_target_nodes();
+	hotplug_memory_notifier(migrate_on_reclaim_callback, 100);
+	return 0;
+}
+late_initcall(migrate_on_reclaim_init);
+#endif /* CONFIG_NUMA */
@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Page allocator side of the mm benchmarks.
+ *
+ * /sys/kernel/debug/mm_benchmark times page allocations for user space,
+ * which cannot allocate pages of a given order directly:
+ *
+ * MM_BENCH_ALLOC allocates @count pages of @order, @batch at a time, and
+ * frees each batch again, timing every alloc_pages_node() and
+ * __free_pages() call.
+ *
+ * MM_BENCH_COMPACT makes @count movable allocations of @order without
+ * retrying, the way THP allocations are made, and holds on to all of them
+ * until the end, so that each one needs a free block of its own and has
+ * to compact for it once the free ones run out.  Fragmenting memory
+ * beforehand is up to the caller.
+ *
+ * Both report latency percentiles and how many allocations succeeded.
+ * See tools/testing/selftests/vm/mm_bench.c.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+
+#define MM_BENCH_ALLOC		_IOWR('m', 1, struct mm_benchmark)
+#define MM_BENCH_COMPACT	_IOWR('m', 2, struct mm_benchmark)
+
+/* p50, p90, p99, p99.9 and max */
+#define MM_BENCH_NR_PCT		5
+
+/* Caps the sample arrays of a single call at a few MB */
+#define MM_BENCH_MAX_COUNT	(1U << 20)
+
+struct mm_benchmark {
+	__u32 order;
+	__s32 nid;		/* -1 for the local node */
+	__u32 count;
+	__u32 batch;
+	__u32 nr_done;		/* out: allocations that succeeded */
+	__u32 flags;		/* unused, must be 0 */
+	__u64 alloc_ns[MM_BENCH_NR_PCT];	/* out */
+	__u64 free_ns[MM_BENCH_NR_PCT];		/* out */
+	__u64 expansion[8];	/* For future use */
+};
+
+static const unsigned int mm_bench_permille[MM_BENCH_NR_PCT] = {
+	500, 900, 990, 999, 1000,
+};
+
+static int mm_bench_cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void mm_bench_percentiles(u64 *samples, unsigned int nr, __u64 *pct)
+{
+	int i;
+
+	if (!nr)
+		return;
+
+	sort(samples, nr, sizeof(*samples), mm_bench_cmp_u64, NULL);
+	for (i = 0; i < MM_BENCH_NR_PCT; i++) {
+		u64 idx = (u64)nr * mm_bench_permille[i] / 1000;
+
+		pct[i] = samples[min_t(u64, idx, nr - 1)];
+	}
+}
+
+static int __mm_benchmark_ioctl(unsigned int cmd, struct mm_benchmark *mmb)
+{
+	u64 *alloc_ns, *free_ns, t;
+	unsigned int i, j, n, nr_free = 0;
+	struct page **pages;
+	gfp_t gfp;
+	int nid;
+	int ret = -ENOMEM;
+
+	if (mmb->order >= MAX_ORDER || mmb->flags || !mmb->count ||
+	    mmb->count > MM_BENCH_MAX_COUNT)
+		return -EINVAL;
+
+	if (mmb->nid == NUMA_NO_NODE) {
+		nid = numa_node_id();
+	} else {
+		if (mmb->nid < 0 || mmb->nid >= MAX_NUMNODES ||
+		    !node_online(mmb->nid))
+			return -EINVAL;
+		nid = mmb->nid;
+	}
+
+	if (cmd == MM_BENCH_COMPACT) {
+		gfp = GFP_HIGHUSER_MOVABLE | __GFP_NORETRY | __GFP_NOWARN;
+		mmb->batch = mmb->count;
+	} else {
+		gfp = GFP_KERNEL | __GFP_NOWARN;
+		if (!mmb->batch || mmb->batch > mmb->count)
+			mmb->batch = 1;
+	}
+	if (mmb->nid != NUMA_NO_NODE)
+		gfp |= __GFP_THISNODE;
+
+	pages = kvcalloc(mmb->batch, sizeof(*pages), GFP_KERNEL);
+	alloc_ns = kvmalloc_array(mmb->count, sizeof(*alloc_ns), GFP_KERNEL);
+	free_ns = kvmalloc_array(mmb->count, sizeof(*free_ns), GFP_KERNEL);
+	if (!pages || !alloc_ns || !free_ns)
+		goto out;
+
+	mmb->nr_done = 0;
+	for (i = 0; i < mmb->count; i += n) {
+		n = min(mmb->batch, mmb->count - i);
+
+		for (j = 0; j < n; j++) {
+			t = ktime_get_ns();
+			pages[j] = alloc_pages_node(nid, gfp, mmb->order);
+			alloc_ns[i + j] = ktime_get_ns() - t;
+			if (pages[j])
+				mmb->nr_done++;
+		}
+
+		for (j = 0; j < n; j++) {
+			if (!pages[j])
+				continue;
+			t = ktime_get_ns();
+			__free_pages(pages[j], mmb->order);
+			free_ns[nr_free++] = ktime_get_ns() - t;
+		}
+
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			goto out;
+		}
+		cond_resched();
+	}
+
+	memset(mmb->alloc_ns, 0, sizeof(mmb->alloc_ns));
+	memset(mmb->free_ns, 0, sizeof(mmb->free_ns));
+	mm_bench_percentiles(alloc_ns, mmb->count, mmb->alloc_ns);
+	mm_bench_percentiles(free_ns, nr_free, mmb->free_ns);
+	ret = 0;
+out:
+	kvfree(free_ns);
+	kvfree(alloc_ns);
+	kvfree(pages);
+	return ret;
+}
+
+static long mm_benchmark_ioctl(struct file *filep, unsigned int cmd,
+		unsigned long arg)
+{
+	struct mm_benchmark mmb;
+	int ret;
+
+	switch (cmd) {
+	case MM_BENCH_ALLOC:
+	case MM_BENCH_COMPACT:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (copy_from_user(&mmb, (void __user *)arg, sizeof(mmb)))
+		return -EFAULT;
+
+	ret = __mm_benchmark_ioctl(cmd, &mmb);
+	if (ret)
+		return ret;
+
+	if (copy_to_user((void __user *)arg, &mmb, sizeof(mmb)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static const struct file_operations mm_benchmark_fops = {
+	.owner = THIS_MODULE,
+	.open = nonseekable_open,
+	.unlocked_ioctl = mm_benchmark_ioctl,
+};
+
+static struct dentry *mm_benchmark_dentry;
+
+static int __init mm_benchmark_init(void)
+{
+	mm_benchmark_dentry = debugfs_create_file_unsafe("mm_benchmark", 0600,
+					NULL, NULL, &mm_benchmark_fops);
+	if (!mm_benchmark_dentry)
+		pr_warn("Failed to create mm_benchmark in debugfs");
+
+	return 0;
+}
+
+static void __exit mm_benchmark_exit(void)
+{
+	debugfs_remove(mm_benchmark_dentry);
+}
+
+module_init(mm_benchmark_init);
+module_exit(mm_benchmark_exit);
+MODULE_LICENSE("GPL");
@@ -36,6 +36,7 @@
 #include <linux/perf_event.h>
 #include <linux/audit.h>
 #include <linux/khugepaged.h>
+#include <linux/ksm.h>
 #include <linux/uprobes.h>
 #include <linux/rbtree_augmented.h>
 #include <linux/notifier.h>
@@ -45,6 +46,7 @@
 #include <linux/moduleparam.h>
 #include <linux/pkeys.h>
 #include <linux/oom.h>
+#include <linux/range_tree.h>
 
 #include <linux/uaccess.h>
 #include <asm/cacheflush.h>
@@ -272,10 +274,12 @@ SYSCALL_DEFINE1(brk, unsigned long, brk)
 
 success:
 	populate = newbrk > oldbrk && (mm->def_flags & VM_LOCKED) != 0;
-	if (downgraded)
+	if (downgraded) {
 		up_read(&mm->mmap_sem);
-	else
+	} else {
+		vma_write_unlock_mm(mm);
 		up_write(&mm->mmap_sem);
+	}
 	userfaultfd_unmap_complete(mm, &uf);
 	if (populate)
 		mm_populate(oldbrk, newbrk - oldbrk);
@@ -283,13 +287,20 @@ SYSCALL_DEFINE1(brk, unsigned long, brk)
 
 out:
 	retval = origbrk;
+	vma_write_unlock_mm(mm);
 	up_write(&mm->mmap_sem);
 	return retval;
 }
 
-static long vma_compute_subtree_gap(struct vm_area_struct *vma)
+/* Whether vma_tree is in use, see vma_tree_reserve() */
+static inline bool vma_tree_active(struct mm_struct *mm)
 {
-	unsigned long max, prev_end, subtree_gap;
+	return !test_bit(MMF_NO_VMA_TREE, &mm->flags);
+}
+
+static unsigned long vma_compute_gap(struct vm_area_struct *vma)
+{
+	unsigned long gap, prev_end;
 
 	/*
 	 * Note: in the rare case of a VM_GROWSDOWN above a VM_GROWSUP, we
@@ -297,14 +308,22 @@ static long vma_compute_subtree_gap(struct vm_area_struct *vma)
 	 * an unmapped area; whereas when expanding we only require one.
 	 * That's a little inconsistent, but keeps the code here simpler.
 	 */
-	max = vm_start_gap(vma);
+	gap = vm_start_gap(vma);
 	if (vma->vm_prev) {
 		prev_end = vm_end_gap(vma->vm_prev);
-		if (max > prev_end)
-			max -= prev_end;
+		if (gap > prev_end)
+			gap -= prev_end;
 		else
-			max = 0;
+			gap = 0;
 	}
+	return gap;
+}
+
+static long vma_compute_subtree_gap(struct vm_area_struct *vma)
+{
+	unsigned long max, subtree_gap;
+
+	max = vma_compute_gap(vma);
 	if (vma->vm_rb.rb_left) {
 		subtree_gap = rb_entry(vma->vm_rb.rb_left,
 				struct vm_area_struct, vm_rb)->rb_subtree_gap;
@@ -347,7 +366,8 @@ static int browse_rb(struct mm_struct *mm)
 			bug = 1;
 		}
 		spin_lock(&mm->page_table_lock);
-		if (vma->rb_subtree_gap != vma_compute_subtree_gap(vma)) {
+		if (!vma_tree_active(mm) &&
+		    vma->rb_subtree_gap != vma_compute_subtree_gap(vma)) {
 			pr_emerg("free gap %lx, correct %lx\n",
 			       vma->rb_subtree_gap,
 			       vma_compute_subtree_gap(vma));
@@ -373,6 +393,9 @@ static void validate_mm_rb(struct rb_root *root, struct vm_area_struct *ignore)
 {
 	struct rb_node *nd;
 
+	if (vma_tree_active(container_of(root, struct mm_struct, mm_rb)))
+		return;
+
 	for (nd = rb_first(root); nd; nd = rb_next(nd)) {
 		struct vm_area_struct *vma;
 		vma = rb_entry(nd, struct vm_area_struct, vm_rb);
@@ -430,12 +453,20 @@ RB_DECLARE_CALLBACKS(static, vma_gap_callbacks, struct vm_area_struct, vm_rb,
 		     unsigned long, rb_subtree_gap, vma_compute_subtree_gap)
 
 /*
- * Update augmented rbtree rb_subtree_gap values after vma->vm_start or
- * vma->vm_prev->vm_end values changed, without modifying the vma's position
- * in the rbtree.
+ * Update the gap tracking, in vma_tree or in the augmented rbtree
+ * rb_subtree_gap values, after vma->vm_start or vma->vm_prev->vm_end values
+ * changed, without modifying the vma's position in the trees.
  */
 static void vma_gap_update(struct vm_area_struct *vma)
 {
+	struct mm_struct *mm = vma->vm_mm;
+
+	if (vma_tree_active(mm)) {
+		range_tree_set_gap(&mm->vma_tree, vma->vm_end,
+				   vma_compute_gap(vma));
+		return;
+	}
+
 	/*
 	 * As it turns out, RB_DECLARE_CALLBACKS() already created a callback
 	 * function that does exacltly what we want.
@@ -443,9 +474,31 @@ static void vma_gap_update(struct vm_area_struct *vma)
 	vma_gap_callbacks_propagate(&vma->vm_rb, NULL);
 }
 
+/*
+ * The rb_subtree_gap values are left alone while vma_tree tracks the gaps.
+ * Recompute them all, children first, when the rbtree takes over.
+ */
+static void vma_rb_rebuild_gaps(struct mm_struct *mm)
+{
+	struct rb_node *nd;
+
+	for (nd = rb_first_postorder(&mm->mm_rb); nd;
+	     nd = rb_next_postorder(nd)) {
+		struct vm_area_struct *vma;
+
+		vma = rb_entry(nd, struct vm_area_struct, vm_rb);
+		vma->rb_subtree_gap = vma_compute_subtree_gap(vma);
+	}
+}
+
 static inline void vma_rb_insert(struct vm_area_struct *vma,
 				 struct rb_root *root)
 {
+	if (vma_tree_active(vma->vm_mm)) {
+		rb_insert_color(&vma->vm_rb, root);
+		return;
+	}
+
 	/* All rb_subtree_gap values must be consistent prior to insertion */
 	validate_mm_rb(root, NULL);
 
@@ -454,6 +507,11 @@ static inline void vma_rb_insert(struct vm_area_struct *vma,
 
 static void __vma_rb_erase(struct vm_area_struct *vma, struct rb_root *root)
 {
+	if (vma_tree_active(vma->vm_mm)) {
+		rb_erase(&vma->vm_rb, root);
+		return;
+	}
+
 	/*
 	 * Note rb_erase_augmented is a fairly large inline function,
 	 * so make sure we instantiate it only once with our desired
@@ -582,9 +640,55 @@ static unsigned long count_vma_pages_range(struct mm_struct *mm,
 	return nr_pages;
 }
 
+/*
+ * mm->vma_tree indexes the VMAs by vm_end for find_vma(), and tracks the
+ * gap before each of them for get_unmapped_area(). The rbtree is still
+ * kept in order for the insertion points, but its gaps are not maintained.
+ * The nodes needed to insert a VMA are reserved before taking the i_mmap
+ * and anon_vma locks, under which we must not enter reclaim. Should an
+ * insertion still fail, the tree is dropped and the rbtree, its gaps
+ * rebuilt, and vmacache take over for the life of the mm.
+ */
+void vma_tree_reserve(struct mm_struct *mm)
+{
+	if (vma_tree_active(mm))
+		range_tree_reserve(&mm->vma_tree, GFP_KERNEL);
+}
+
+static void vma_tree_insert(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+	if (!vma_tree_active(mm))
+		return;
+	if (unlikely(range_tree_insert(&mm->vma_tree, vma->vm_end, vma,
+				       GFP_NOWAIT | __GFP_NOWARN))) {
+		set_bit(MMF_NO_VMA_TREE, &mm->flags);
+		range_tree_destroy(&mm->vma_tree);
+		vma_rb_rebuild_gaps(mm);
+	}
+}
+
+static void vma_tree_erase(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+	void *entry;
+
+	if (!vma_tree_active(mm))
+		return;
+	entry = range_tree_erase(&mm->vma_tree, vma->vm_end);
+	VM_WARN_ON_ONCE(entry != vma);
+}
+
+static void vma_tree_update(struct mm_struct *mm, unsigned long old_end,
+			    unsigned long new_end)
+{
+	if (vma_tree_active(mm))
+		range_tree_update(&mm->vma_tree, old_end, new_end);
+}
+
 void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct rb_node **rb_link, struct rb_node *rb_parent)
 {
+	vma_tree_insert(mm, vma);
+
 	/* Update tracking information for the gap following the new vma. */
 	if (vma->vm_next)
 		vma_gap_update(vma->vm_next);
@@ -640,6 +744,7 @@ static void vma_link(struct mm_struct *mm, struct vm_area_struct *vma,
 {
 	struct address_space *mapping = NULL;
 
+	vma_tree_reserve(mm);
 	if (vma->vm_file) {
 		mapping = vma->vm_file->f_mapping;
 		i_mmap_lock_write(mapping);
@@ -679,6 +784,7 @@ static __always_inline void __vma_unlink_common(struct mm_struct *mm,
 {
 	struct vm_area_struct *next;
 
+	vma_tree_erase(mm, vma);
 	vma_rb_erase_ignore(vma, &mm->mm_rb, ignore);
 	next = vma->vm_next;
 	if (has_prev)
@@ -722,9 +828,13 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 	struct anon_vma *anon_vma = NULL;
 	struct file *file = vma->vm_file;
 	bool start_changed = false, end_changed = false;
+	unsigned long old_end = 0;
 	long adjust_next = 0;
 	int remove_next = 0;
 
+	if (insert)
+		vma_tree_reserve(mm);
+
 	if (next && !insert) {
 		struct vm_area_struct *exporter = NULL, *importer = NULL;
 
@@ -810,6 +920,12 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 		}
 	}
 again:
+	vma_write_lock(vma);
+	if (next)
+		vma_write_lock(next);
+	if (insert)
+		vma_write_lock(insert);
+
 	vma_adjust_trans_huge(orig_vma, start, end, adjust_next);
 
 	if (file) {
@@ -856,6 +972,7 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 		start_changed = true;
 	}
 	if (end != vma->vm_end) {
+		old_end = vma->vm_end;
 		vma->vm_end = end;
 		end_changed = true;
 	}
@@ -872,11 +989,20 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 		flush_dcache_mmap_unlock(mapping);
 	}
 
+	/*
+	 * vma_tree is indexed by vm_end: move vma's key once it cannot clash
+	 * with the one of a removed next or of insert, which takes vma's
+	 * old end.
+	 */
+	if (end_changed && !remove_next)
+		vma_tree_update(mm, old_end, end);
+
 	if (remove_next) {
 		/*
 		 * vma_merge has merged next into vma, and needs
 		 * us to remove next before dropping the locks.
 		 */
+		vma_mark_detached(next, true);
 		if (remove_next != 3)
 			__vma_unlink_prev(mm, next, vma);
 		else
@@ -892,6 +1018,8 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 			__vma_unlink_common(mm, next, NULL, false, vma);
 		if (file)
 			__remove_shared_vm_struct(next, file, mapping);
+		if (end_changed)
+			vma_tree_update(mm, old_end, end);
 	} else if (insert) {
 		/*
 		 * split_vma has split insert from vma, and needs
@@ -1740,6 +1868,8 @@ unsigned long mmap_region(struct file *file, unsigned long addr,
 		vm_flags |= VM_ACCOUNT;
 	}
 
+	vm_flags = ksm_vma_flags(mm, file, vm_flags);
+
 	/*
 	 * Can we just expand an old mapping?
 	 */
@@ -1796,6 +1926,11 @@ unsigned long mmap_region(struct file *file, unsigned long addr,
 		 */
 		WARN_ON_ONCE(addr != vma->vm_start);
 
+		/* ->mmap() may have made the mapping unsuitable for KSM */
+		if (vma->vm_flags & VM_MERGEABLE)
+			vma->vm_flags = ksm_vma_flags(mm, vma->vm_file,
+					vma->vm_flags & ~VM_MERGEABLE);
+
 		addr = vma->vm_start;
 		vm_flags = vma->vm_flags;
 	} else if (vm_flags & VM_SHARED) {
@@ -1864,6 +1999,46 @@ unsigned long mmap_region(struct file *file, unsigned long addr,
 	return error;
 }
 
+/*
+ * The gap searches of unmapped_area() and unmapped_area_topdown() on
+ * vma_tree, with the limits adjusted by the length as they are there.
+ * The gaps found are large enough, but the ones that straddle the limit
+ * have to be skipped, which only happens next to it.
+ */
+static struct vm_area_struct *vma_tree_gap_first(struct mm_struct *mm,
+						 unsigned long length,
+						 unsigned long low_limit)
+{
+	unsigned long min_end = low_limit;
+	struct vm_area_struct *vma;
+
+	while ((vma = range_tree_gap_first(&mm->vma_tree, length, min_end))) {
+		if (vm_start_gap(vma) >= low_limit)
+			break;
+		min_end = vma->vm_end;
+	}
+	return vma;
+}
+
+static struct vm_area_struct *vma_tree_gap_last(struct mm_struct *mm,
+						unsigned long length,
+						unsigned long high_limit)
+{
+	struct vm_area_struct *vma;
+	unsigned long max_end;
+
+	/* The gaps starting at or below high_limit end by this VMA */
+	vma = range_tree_find(&mm->vma_tree, high_limit);
+	max_end = vma ? vma->vm_end : ULONG_MAX;
+
+	while ((vma = range_tree_gap_last(&mm->vma_tree, length, max_end))) {
+		if (!vma->vm_prev || vm_end_gap(vma->vm_prev) <= high_limit)
+			break;
+		max_end = vma->vm_start;
+	}
+	return vma;
+}
+
 unsigned long unmapped_area(struct vm_unmapped_area_info *info)
 {
 	/*
@@ -1892,6 +2067,17 @@ unsigned long unmapped_area(struct vm_unmapped_area_info *info)
 		return -ENOMEM;
 	low_limit = info->low_limit + length;
 
+	if (likely(vma_tree_active(mm))) {
+		vma = vma_tree_gap_first(mm, length, low_limit);
+		if (!vma)
+			goto check_highest;
+		gap_start = vma->vm_prev ? vm_end_gap(vma->vm_prev) : 0;
+		gap_end = vm_start_gap(vma);
+		if (gap_start > high_limit)
+			return -ENOMEM;
+		goto found;
+	}
+
 	/* Check if rbtree root looks promising */
 	if (RB_EMPTY_ROOT(&mm->mm_rb))
 		goto check_highest;
@@ -1996,6 +2182,17 @@ unsigned long unmapped_area_topdown(struct vm_unmapped_area_info *info)
 	if (gap_start <= high_limit)
 		goto found_highest;
 
+	if (likely(vma_tree_active(mm))) {
+		vma = vma_tree_gap_last(mm, length, high_limit);
+		if (!vma)
+			return -ENOMEM;
+		gap_start = vma->vm_prev ? vm_end_gap(vma->vm_prev) : 0;
+		gap_end = vm_start_gap(vma);
+		if (gap_end < low_limit)
+			return -ENOMEM;
+		goto found;
+	}
+
 	/* Check if rbtree root looks promising */
 	if (RB_EMPTY_ROOT(&mm->mm_rb))
 		return -ENOMEM;
@@ -2217,6 +2414,9 @@ struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
 	struct rb_node *rb_node;
 	struct vm_area_struct *vma;
 
+	if (likely(vma_tree_active(mm)))
+		return range_tree_find(&mm->vma_tree, addr);
+
 	/* Check the cache first. */
 	vma = vmacache_find(mm, addr);
 	if (likely(vma))
@@ -2245,6 +2445,49 @@ struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
 
 EXPORT_SYMBOL(find_vma);
 
+#ifdef CONFIG_PER_VMA_LOCK
+/*
+ * Look up and read-lock the anonymous VMA containing @address without taking
+ * mmap_sem. vma_tree lookups may miss or misreport a VMA that is being
+ * modified, and VMAs are freed through RCU; the result is validated once
+ * the VMA lock is held. Returns NULL when the caller must fall back to
+ * mmap_sem.
+ */
+struct vm_area_struct *lock_vma_under_rcu(struct mm_struct *mm,
+					  unsigned long address)
+{
+	struct vm_area_struct *vma;
+
+	rcu_read_lock();
+	if (!vma_tree_active(mm))
+		goto inval;
+	vma = range_tree_find(&mm->vma_tree, address);
+	if (!vma)
+		goto inval;
+
+	/* Only anonymous VMAs that already have an anon_vma for now */
+	if (!vma_is_anonymous(vma) || !READ_ONCE(vma->anon_vma))
+		goto inval;
+
+	if (!vma_read_trylock(mm, vma))
+		goto inval;
+
+	/* The VMA may have been removed or resized before we locked it */
+	if (vma->vm_detached || address < vma->vm_start ||
+	    address >= vma->vm_end || userfaultfd_armed(vma)) {
+		vma_read_unlock(vma);
+		goto inval;
+	}
+	rcu_read_unlock();
+	return vma;
+
+inval:
+	rcu_read_unlock();
+	count_vm_event(VMA_LOCK_ABORT);
+	return NULL;
+}
+#endif /* CONFIG_PER_VMA_LOCK */
+
 /*
  * Same as find_vma, but also return a pointer to the previous VMA in *pprev.
  */
@@ -2388,6 +2631,7 @@ int expand_upwards(struct vm_area_struct *vma, unsigned long address)
 					mm->locked_vm += grow;
 				vm_stat_account(mm, vma->vm_flags, grow);
 				anon_vma_interval_tree_pre_update_vma(vma);
+				vma_tree_update(mm, vma->vm_end, address);
 				vma->vm_end = address;
 				anon_vma_interval_tree_post_update_vma(vma);
 				if (vma->vm_next)
@@ -2612,6 +2856,8 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
 	do {
+		vma_mark_detached(vma, true);
+		vma_tree_erase(mm, vma);
 		vma_rb_erase(vma, &mm->mm_rb);
 		mm->map_count--;
 		tail_vma = vma;
@@ -2715,7 +2961,7 @@ int __do_munmap(struct mm_struct *mm, unsigned long start, size_t len,
 		struct list_head *uf, bool downgrade)
 {
 	unsigned long end;
-	struct vm_area_struct *vma, *prev, *last;
+	struct vm_area_struct *vma, *prev, *last, *tmp;
 
 	if ((offset_in_page(start)) || start > TASK_SIZE || len > TASK_SIZE-start)
 		return -EINVAL;
@@ -2769,6 +3015,17 @@ int __do_munmap(struct mm_struct *mm, unsigned long start, size_t len,
 	}
 	vma = prev ? prev->vm_next : mm->mmap;
 
+	/*
+	 * Copy the PTE tables shared on fork that a vma only maps part of,
+	 * while we can still fail: unmap_region() has to.
+	 */
+	for (tmp = vma; tmp && tmp->vm_start < end; tmp = tmp->vm_next) {
+		int error = unshare_partial_pte_tables(tmp, tmp->vm_start,
+						       tmp->vm_end);
+		if (error)
+			return error;
+	}
+
 	if (unlikely(uf)) {
 		/*
 		 * If userfaultfd_unmap_prep returns an error the vmas
@@ -2788,7 +3045,7 @@ int __do_munmap(struct mm_struct *mm, unsigned long start, size_t len,
 	 * unlock any mlock()ed ranges before detaching vmas
 	 */
 	if (mm->locked_vm) {
-		struct vm_area_struct *tmp = vma;
+		tmp = vma;
 		while (tmp && tmp->vm_start < end) {
 			if (tmp->vm_flags & VM_LOCKED) {
 				mm->locked_vm -= vma_pages(tmp);
@@ -2808,8 +3065,10 @@ int __do_munmap(struct mm_struct *mm, unsigned long start, size_t len,
 	 */
 	arch_unmap(mm, vma, start, end);
 
-	if (downgrade)
+	if (downgrade) {
+		vma_write_unlock_mm(mm);
 		downgrade_write(&mm->mmap_sem);
+	}
 
 	unmap_region(mm, vma, prev, start, end);
 
@@ -2843,8 +3102,10 @@ static int __vm_munmap(unsigned long start, size_t len, bool downgrade)
 	if (ret == 1) {
 		up_read(&mm->mmap_sem);
 		ret = 0;
-	} else
+	} else {
+		vma_write_unlock_mm(mm);
 		up_write(&mm->mmap_sem);
+	}
 
 	userfaultfd_unmap_complete(mm, &uf);
 	return ret;
@@ -2954,6 +3215,7 @@ SYSCALL_DEFINE5(remap_file_pages, unsigned long, start, unsigned long, size,
 			prot, flags, pgoff, &populate, NULL);
 	fput(file);
 out:
+	vma_write_unlock_mm(mm);
 	up_write(&mm->mmap_sem);
 	if (populate)
 		mm_populate(ret, populate);
@@ -2989,6 +3251,7 @@ static int do_brk_flags(unsigned long addr, unsigned long len, unsigned long fla
 	if ((flags & (~VM_EXEC)) != 0)
 		return -EINVAL;
 	flags |= VM_DATA_DEFAULT_FLAGS | VM_ACCOUNT | mm->def_flags;
+	flags = ksm_vma_flags(mm, NULL, flags);
 
 	error = get_unmapped_area(NULL, addr, len, 0, MAP_FIXED);
 	if (offset_in_page(error))
@@ -3074,6 +3337,7 @@ int vm_brk_flags(unsigned long addr, unsigned long request, unsigned long flags)
 
 	ret = do_brk_flags(addr, len, flags, &uf);
 	populate = ((mm->def_flags & VM_LOCKED) != 0);
+	vma_write_unlock_mm(mm);
 	up_write(&mm->mmap_sem);
 	userfaultfd_unmap_complete(mm, &uf);
 	if (populate && !ret)
@@ -3134,8 +3398,10 @@ void exit_mmap(struct mm_struct *mm)
 	arch_exit_mmap(mm);
 
 	vma = mm->mmap;
-	if (!vma)	/* Can happen if dup_mmap() received an OOM */
+	if (!vma) {	/* Can happen if dup_mmap() received an OOM */
+		range_tree_destroy(&mm->vma_tree);
 		return;
+	}
 
 	lru_add_drain();
 	flush_cache_mm(mm);
@@ -3156,6 +3422,7 @@ void exit_mmap(struct mm_struct *mm)
 		vma = remove_vma(vma);
 	}
 	vm_unacct_memory(nr_accounted);
+	range_tree_destroy(&mm->vma_tree);
 }
 
 /* Insert vm structure into process list sorted by address
@@ -238,6 +238,9 @@ unsigned long move_page_tables(struct vm_area_struct *vma,
 			if (pmd_trans_unstable(old_pmd))
 				continue;
 		}
+		if (unlikely(pmd_pte_shared(*old_pmd)) &&
+		    unshare_pte_table(vma, old_addr, old_pmd))
+			break;
 		if (pte_alloc(new_vma->vm_mm, new_pmd, new_addr))
 			break;
 		next = (new_addr + PMD_SIZE) & PMD_MASK;
@@ -294,6 +297,9 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 	if (!new_vma)
 		return -ENOMEM;
 
+	/* Faults under the VMA lock must not race with the page table move */
+	vma_write_lock(vma);
+	vma_write_lock(new_vma);
 	moved_len = move_page_tables(vma, old_addr, new_vma, new_addr, old_len,
 				     need_rmap_locks);
 	if (moved_len < old_len) {
@@ -636,10 +642,12 @@ SYSCALL_DEFINE5(mremap, unsigned long, addr, unsigned long, old_len,
 		vm_unacct_memory(charged);
 		locked = 0;
 	}
-	if (downgraded)
+	if (downgraded) {
 		up_read(&current->mm->mmap_sem);
-	else
+	} else {
+		vma_write_unlock_mm(current->mm);
 		up_write(&current->mm->mmap_sem);
+	}
 	if (locked && new_len > old_len)
 		mm_populate(new_addr + old_len, new_len - old_len);
 	userfaultfd_unmap_complete(mm, &uf_unmap_early);
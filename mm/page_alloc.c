@@ -66,11 +66,14 @@
 #include <linux/lockdep.h>
 #include <linux/nmi.h>
 #include <linux/psi.h>
+#include <linux/delayacct.h>
+#include <linux/padata.h>
 
 #include <asm/sections.h>
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
 #include "internal.h"
+#include "page_reporting.h"
 
 /* prevent >1 _updater_ of zone percpu pageset ->high and ->batch fields */
 static DEFINE_MUTEX(pcp_batch_high_lock);
@@ -129,6 +132,7 @@ unsigned long totalreserve_pages __read_mostly;
 unsigned long totalcma_pages __read_mostly;
 
 int percpu_pagelist_fraction;
+int percpu_pagelist_high_order __read_mostly = PAGE_ALLOC_COSTLY_ORDER;
 gfp_t gfp_allowed_mask __read_mostly = GFP_BOOT_MASK;
 
 /*
@@ -149,6 +153,22 @@ static inline void set_pcppage_migratetype(struct page *page, int migratetype)
 	page->index = migratetype;
 }
 
+static inline unsigned int order_to_pindex(int migratetype, unsigned int order)
+{
+	return order * MIGRATE_PCPTYPES + migratetype;
+}
+
+static inline unsigned int pindex_to_order(unsigned int pindex)
+{
+	return pindex / MIGRATE_PCPTYPES;
+}
+
+/* Orders above percpu_pagelist_high_order go straight to the buddy lists */
+static inline bool pcp_allowed_order(unsigned int order)
+{
+	return order <= READ_ONCE(percpu_pagelist_high_order);
+}
+
 #ifdef CONFIG_PM_SLEEP
 /*
  * The following functions are used by the suspend/hibernate code to temporarily
@@ -192,6 +212,7 @@ unsigned int pageblock_order __read_mostly;
 #endif
 
 static void __free_pages_ok(struct page *page, unsigned int order);
+static void free_unref_page_order(struct page *page, unsigned int order);
 
 /*
  * results with 256, 32 in the lowmem_reserve sysctl:
@@ -293,6 +314,12 @@ EXPORT_SYMBOL(nr_online_nodes);
 
 int page_group_by_mobility_disabled __read_mostly;
 
+/*
+ * Deferred and hot-added struct pages are initialised by several threads,
+ * each taking at least this many pages at a time.
+ */
+#define MEMMAP_INIT_MIN_CHUNK	(1UL << (30 - PAGE_SHIFT))
+
 #ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
 /* Returns true if the struct page for the pfn is uninitialised */
 static inline bool __meminit early_page_uninitialised(unsigned long pfn)
@@ -568,9 +595,17 @@ static void bad_page(struct page *page, const char *reason,
  * This usage means that zero-order pages may not be compound.
  */
 
+static inline void free_the_page(struct page *page, unsigned int order)
+{
+	if (pcp_allowed_order(order))
+		free_unref_page_order(page, order);
+	else
+		__free_pages_ok(page, order);
+}
+
 void free_compound_page(struct page *page)
 {
-	__free_pages_ok(page, compound_order(page));
+	free_the_page(page, compound_order(page));
 }
 
 void prep_compound_page(struct page *page, unsigned int order)
@@ -708,6 +743,8 @@ static inline void rmv_page_order(struct page *page)
 {
 	__ClearPageBuddy(page);
 	set_page_private(page, 0);
+	/* A page leaving the free lists is no longer known to the host */
+	__ClearPageReported(page);
 }
 
 /*
@@ -778,7 +815,7 @@ static inline int page_is_buddy(struct page *page, struct page *buddy,
 static inline void __free_one_page(struct page *page,
 		unsigned long pfn,
 		struct zone *zone, unsigned int order,
-		int migratetype)
+		int migratetype, bool report)
 {
 	unsigned long combined_pfn;
 	unsigned long uninitialized_var(buddy_pfn);
@@ -875,6 +912,10 @@ static inline void __free_one_page(struct page *page,
 	list_add(&page->lru, &zone->free_area[order].free_list[migratetype]);
 out:
 	zone->free_area[order].nr_free++;
+
+	/* Notify page reporting subsystem of freed page */
+	if (report)
+		page_reporting_notify_free(order);
 }
 
 /*
@@ -1043,9 +1084,9 @@ static __always_inline bool free_pages_prepare(struct page *page,
 }
 
 #ifdef CONFIG_DEBUG_VM
-static inline bool free_pcp_prepare(struct page *page)
+static inline bool free_pcp_prepare(struct page *page, unsigned int order)
 {
-	return free_pages_prepare(page, 0, true);
+	return free_pages_prepare(page, order, true);
 }
 
 static inline bool bulkfree_pcp_prepare(struct page *page)
@@ -1053,9 +1094,9 @@ static inline bool bulkfree_pcp_prepare(struct page *page)
 	return false;
 }
 #else
-static bool free_pcp_prepare(struct page *page)
+static bool free_pcp_prepare(struct page *page, unsigned int order)
 {
-	return free_pages_prepare(page, 0, false);
+	return free_pages_prepare(page, order, false);
 }
 
 static bool bulkfree_pcp_prepare(struct page *page)
@@ -1064,10 +1105,10 @@ static bool bulkfree_pcp_prepare(struct page *page)
 }
 #endif /* CONFIG_DEBUG_VM */
 
-static inline void prefetch_buddy(struct page *page)
+static inline void prefetch_buddy(struct page *page, unsigned int order)
 {
 	unsigned long pfn = page_to_pfn(page);
-	unsigned long buddy_pfn = __find_buddy_pfn(pfn, 0);
+	unsigned long buddy_pfn = __find_buddy_pfn(pfn, order);
 	struct page *buddy = page + (buddy_pfn - pfn);
 
 	prefetch(buddy);
@@ -1087,15 +1128,22 @@ static inline void prefetch_buddy(struct page *page)
 static void free_pcppages_bulk(struct zone *zone, int count,
 					struct per_cpu_pages *pcp)
 {
-	int migratetype = 0;
+	unsigned int pindex = 0;
 	int batch_free = 0;
 	int prefetch_nr = 0;
 	bool isolated_pageblocks;
 	struct page *page, *tmp;
 	LIST_HEAD(head);
 
-	while (count) {
+	/*
+	 * count is in base pages and high-order pages may overshoot it, make
+	 * sure we do not go looking for pages on empty lists.
+	 */
+	count = min(pcp->count, count);
+
+	while (count > 0) {
 		struct list_head *list;
+		unsigned int order;
 
 		/*
 		 * Remove pages from lists in a round-robin fashion. A
@@ -1106,24 +1154,28 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		 */
 		do {
 			batch_free++;
-			if (++migratetype == MIGRATE_PCPTYPES)
-				migratetype = 0;
-			list = &pcp->lists[migratetype];
+			if (++pindex == NR_PCP_LISTS)
+				pindex = 0;
+			list = &pcp->lists[pindex];
 		} while (list_empty(list));
 
 		/* This is the only non-empty list. Free them all. */
-		if (batch_free == MIGRATE_PCPTYPES)
+		if (batch_free == NR_PCP_LISTS)
 			batch_free = count;
 
+		order = pindex_to_order(pindex);
 		do {
 			page = list_last_entry(list, struct page, lru);
 			/* must delete to avoid corrupting pcp list */
 			list_del(&page->lru);
-			pcp->count--;
+			pcp->count -= 1 << order;
+			count -= 1 << order;
 
 			if (bulkfree_pcp_prepare(page))
 				continue;
 
+			/* Remember the order for __free_one_page() below */
+			set_page_private(page, order);
 			list_add_tail(&page->lru, &head);
 
 			/*
@@ -1136,8 +1188,8 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			 * prefetch buddy for the first pcp->batch nr of pages.
 			 */
 			if (prefetch_nr++ < pcp->batch)
-				prefetch_buddy(page);
-		} while (--count && --batch_free && !list_empty(list));
+				prefetch_buddy(page, order);
+		} while (count > 0 && --batch_free && !list_empty(list));
 	}
 
 	spin_lock(&zone->lock);
@@ -1149,14 +1201,17 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 	 */
 	list_for_each_entry_safe(page, tmp, &head, lru) {
 		int mt = get_pcppage_migratetype(page);
+		unsigned int order = page_private(page);
+
+		set_page_private(page, 0);
 		/* MIGRATE_ISOLATE page should not go to pcplists */
 		VM_BUG_ON_PAGE(is_migrate_isolate(mt), page);
 		/* Pageblock could have been isolated meanwhile */
 		if (unlikely(isolated_pageblocks))
 			mt = get_pageblock_migratetype(page);
 
-		__free_one_page(page, page_to_pfn(page), zone, 0, mt);
-		trace_mm_page_pcpu_drain(page, 0, mt);
+		__free_one_page(page, page_to_pfn(page), zone, order, mt, true);
+		trace_mm_page_pcpu_drain(page, order, mt);
 	}
 	spin_unlock(&zone->lock);
 }
@@ -1171,7 +1226,7 @@ static void free_one_page(struct zone *zone,
 		is_migrate_isolate(migratetype))) {
 		migratetype = get_pfnblock_migratetype(page, pfn);
 	}
-	__free_one_page(page, pfn, zone, order, migratetype);
+	__free_one_page(page, pfn, zone, order, migratetype, true);
 	spin_unlock(&zone->lock);
 }
 
@@ -1538,19 +1593,67 @@ static unsigned long  __init deferred_init_pages(int nid, int zid,
 	return (nr_pages);
 }
 
+/* State shared by the threads initialising the deferred pages of a zone */
+struct deferred_init_arg {
+	struct zone *zone;
+	atomic_long_t nr_pages;
+};
+
+/* Initialise the struct pages of the free memory in [start_pfn, end_pfn) */
+static void __init
+deferred_init_memmap_chunk(unsigned long start_pfn, unsigned long end_pfn,
+			   void *data)
+{
+	struct deferred_init_arg *arg = data;
+	int nid = zone_to_nid(arg->zone);
+	int zid = zone_idx(arg->zone);
+	unsigned long spfn, epfn, nr_pages = 0;
+	phys_addr_t spa, epa;
+	u64 i;
+
+	for_each_free_mem_range(i, nid, MEMBLOCK_NONE, &spa, &epa, NULL) {
+		spfn = max_t(unsigned long, start_pfn, PFN_UP(spa));
+		epfn = min_t(unsigned long, end_pfn, PFN_DOWN(epa));
+		if (spfn < epfn)
+			nr_pages += deferred_init_pages(nid, zid, spfn, epfn);
+	}
+	atomic_long_add(nr_pages, &arg->nr_pages);
+	cond_resched();
+}
+
+/* Free the pages initialised by deferred_init_memmap_chunk() */
+static void __init
+deferred_free_memmap_chunk(unsigned long start_pfn, unsigned long end_pfn,
+			   void *data)
+{
+	struct deferred_init_arg *arg = data;
+	int nid = zone_to_nid(arg->zone);
+	int zid = zone_idx(arg->zone);
+	unsigned long spfn, epfn;
+	phys_addr_t spa, epa;
+	u64 i;
+
+	for_each_free_mem_range(i, nid, MEMBLOCK_NONE, &spa, &epa, NULL) {
+		spfn = max_t(unsigned long, start_pfn, PFN_UP(spa));
+		epfn = min_t(unsigned long, end_pfn, PFN_DOWN(epa));
+		if (spfn < epfn)
+			deferred_free_pages(nid, zid, spfn, epfn);
+	}
+	cond_resched();
+}
+
 /* Initialise remaining memory on a node */
 static int __init deferred_init_memmap(void *data)
 {
 	pg_data_t *pgdat = data;
 	int nid = pgdat->node_id;
 	unsigned long start = jiffies;
-	unsigned long nr_pages = 0;
-	unsigned long spfn, epfn, first_init_pfn, flags;
-	phys_addr_t spa, epa;
+	unsigned long first_init_pfn, flags;
+	struct deferred_init_arg arg;
+	struct padata_mt_job job;
 	int zid;
 	struct zone *zone;
 	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
-	u64 i;
 
 	/* Bind memory initialisation thread to a local node if possible */
 	if (!cpumask_empty(cpumask))
@@ -1569,6 +1672,13 @@ static int __init deferred_init_memmap(void *data)
 	BUG_ON(pgdat->first_deferred_pfn > pgdat_end_pfn(pgdat));
 	pgdat->first_deferred_pfn = ULONG_MAX;
 
+	/*
+	 * Once we unlock here, the zone cannot be grown anymore, thus if an
+	 * interrupt thread must allocate this early in boot, zone must be
+	 * pre-grown prior to start of deferred page initialization.
+	 */
+	pgdat_resize_unlock(pgdat, &flags);
+
 	/* Only the highest zone is deferred so find it */
 	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
 		zone = pgdat->node_zones + zid;
@@ -1578,28 +1688,37 @@ static int __init deferred_init_memmap(void *data)
 	first_init_pfn = max(zone->zone_start_pfn, first_init_pfn);
 
 	/*
-	 * Initialize and free pages. We do it in two loops: first we initialize
-	 * struct page, than free to buddy allocator, because while we are
-	 * freeing pages we can access pages that are ahead (computing buddy
-	 * page in __free_one_page()).
+	 * Initialize and free pages. We do it in two passes: first we
+	 * initialize struct page, than free to buddy allocator, because while
+	 * we are freeing pages we can access pages that are ahead (computing
+	 * buddy page in __free_one_page()). Each pass is split over all the
+	 * CPUs of the node.
 	 */
-	for_each_free_mem_range(i, nid, MEMBLOCK_NONE, &spa, &epa, NULL) {
-		spfn = max_t(unsigned long, first_init_pfn, PFN_UP(spa));
-		epfn = min_t(unsigned long, zone_end_pfn(zone), PFN_DOWN(epa));
-		nr_pages += deferred_init_pages(nid, zid, spfn, epfn);
-	}
-	for_each_free_mem_range(i, nid, MEMBLOCK_NONE, &spa, &epa, NULL) {
-		spfn = max_t(unsigned long, first_init_pfn, PFN_UP(spa));
-		epfn = min_t(unsigned long, zone_end_pfn(zone), PFN_DOWN(epa));
-		deferred_free_pages(nid, zid, spfn, epfn);
-	}
-	pgdat_resize_unlock(pgdat, &flags);
+	arg.zone = zone;
+	atomic_long_set(&arg.nr_pages, 0);
+	job = (struct padata_mt_job) {
+		.thread_fn   = deferred_init_memmap_chunk,
+		.fn_arg      = &arg,
+		.start       = first_init_pfn,
+		.size        = zone_end_pfn(zone) - first_init_pfn,
+		.align       = pageblock_nr_pages,
+		.min_chunk   = MEMMAP_INIT_MIN_CHUNK,
+		.max_threads = max(cpumask_weight(cpumask), 1U),
+		.nid         = nid,
+	};
+	padata_do_multithreaded(&job);
+
+	job.thread_fn = deferred_free_memmap_chunk;
+	job.start = first_init_pfn;
+	job.size = zone_end_pfn(zone) - first_init_pfn;
+	padata_do_multithreaded(&job);
 
 	/* Sanity check that the next zone really is unpopulated */
 	WARN_ON(++zid < MAX_NR_ZONES && populated_zone(++zone));
 
-	pr_info("node %d initialised, %lu pages in %ums\n", nid, nr_pages,
-					jiffies_to_msecs(jiffies - start));
+	pr_info("node %d initialised, %lu pages in %ums\n", nid,
+		atomic_long_read(&arg.nr_pages),
+		jiffies_to_msecs(jiffies - start));
 
 	pgdat_init_report_one_done();
 	return 0;
@@ -1871,40 +1990,40 @@ static inline bool free_pages_prezeroed(void)
 		page_poisoning_enabled();
 }
 
+static bool check_new_pages(struct page *page, unsigned int order)
+{
+	int i;
+	for (i = 0; i < (1 << order); i++) {
+		struct page *p = page + i;
+
+		if (unlikely(check_new_page(p)))
+			return true;
+	}
+
+	return false;
+}
+
 #ifdef CONFIG_DEBUG_VM
-static bool check_pcp_refill(struct page *page)
+static bool check_pcp_refill(struct page *page, unsigned int order)
 {
 	return false;
 }
 
-static bool check_new_pcp(struct page *page)
+static bool check_new_pcp(struct page *page, unsigned int order)
 {
-	return check_new_page(page);
+	return check_new_pages(page, order);
 }
 #else
-static bool check_pcp_refill(struct page *page)
+static bool check_pcp_refill(struct page *page, unsigned int order)
 {
-	return check_new_page(page);
+	return check_new_pages(page, order);
 }
-static bool check_new_pcp(struct page *page)
+static bool check_new_pcp(struct page *page, unsigned int order)
 {
 	return false;
 }
 #endif /* CONFIG_DEBUG_VM */
 
-static bool check_new_pages(struct page *page, unsigned int order)
-{
-	int i;
-	for (i = 0; i < (1 << order); i++) {
-		struct page *p = page + i;
-
-		if (unlikely(check_new_page(p)))
-			return true;
-	}
-
-	return false;
-}
-
 inline void post_alloc_hook(struct page *page, unsigned int order,
 				gfp_t gfp_flags)
 {
@@ -2482,7 +2601,7 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 		if (unlikely(page == NULL))
 			break;
 
-		if (unlikely(check_pcp_refill(page)))
+		if (unlikely(check_pcp_refill(page, order)))
 			continue;
 
 		/*
@@ -2736,11 +2855,12 @@ void mark_free_pages(struct zone *zone)
 }
 #endif /* CONFIG_PM */
 
-static bool free_unref_page_prepare(struct page *page, unsigned long pfn)
+static bool free_unref_page_prepare(struct page *page, unsigned long pfn,
+				    unsigned int order)
 {
 	int migratetype;
 
-	if (!free_pcp_prepare(page))
+	if (!free_pcp_prepare(page, order))
 		return false;
 
 	migratetype = get_pfnblock_migratetype(page, pfn);
@@ -2748,14 +2868,15 @@ static bool free_unref_page_prepare(struct page *page, unsigned long pfn)
 	return true;
 }
 
-static void free_unref_page_commit(struct page *page, unsigned long pfn)
+static void free_unref_page_commit(struct page *page, unsigned long pfn,
+				   unsigned int order)
 {
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
 	int migratetype;
 
 	migratetype = get_pcppage_migratetype(page);
-	__count_vm_event(PGFREE);
+	__count_vm_events(PGFREE, 1 << order);
 
 	/*
 	 * We only track unmovable, reclaimable and movable on pcp lists.
@@ -2766,15 +2887,17 @@ static void free_unref_page_commit(struct page *page, unsigned long pfn)
 	 */
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(is_migrate_isolate(migratetype))) {
-			free_one_page(zone, page, pfn, 0, migratetype);
+			free_one_page(zone, page, pfn, order, migratetype);
 			return;
 		}
 		migratetype = MIGRATE_MOVABLE;
 	}
 
+	if (order)
+		__count_vm_event(PCP_HIGH_ORDER_FREE);
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
-	list_add(&page->lru, &pcp->lists[migratetype]);
-	pcp->count++;
+	list_add(&page->lru, &pcp->lists[order_to_pindex(migratetype, order)]);
+	pcp->count += 1 << order;
 	if (pcp->count >= pcp->high) {
 		unsigned long batch = READ_ONCE(pcp->batch);
 		free_pcppages_bulk(zone, batch, pcp);
@@ -2782,21 +2905,29 @@ static void free_unref_page_commit(struct page *page, unsigned long pfn)
 }
 
 /*
- * Free a 0-order page
+ * Free a page of an order the pcp lists cache
  */
-void free_unref_page(struct page *page)
+static void free_unref_page_order(struct page *page, unsigned int order)
 {
 	unsigned long flags;
 	unsigned long pfn = page_to_pfn(page);
 
-	if (!free_unref_page_prepare(page, pfn))
+	if (!free_unref_page_prepare(page, pfn, order))
 		return;
 
 	local_irq_save(flags);
-	free_unref_page_commit(page, pfn);
+	free_unref_page_commit(page, pfn, order);
 	local_irq_restore(flags);
 }
 
+/*
+ * Free a 0-order page
+ */
+void free_unref_page(struct page *page)
+{
+	free_unref_page_order(page, 0);
+}
+
 /*
  * Free a list of 0-order pages
  */
@@ -2809,7 +2940,7 @@ void free_unref_page_list(struct list_head *list)
 	/* Prepare pages for freeing */
 	list_for_each_entry_safe(page, next, list, lru) {
 		pfn = page_to_pfn(page);
-		if (!free_unref_page_prepare(page, pfn))
+		if (!free_unref_page_prepare(page, pfn, 0))
 			list_del(&page->lru);
 		set_page_private(page, pfn);
 	}
@@ -2820,7 +2951,7 @@ void free_unref_page_list(struct list_head *list)
 
 		set_page_private(page, 0);
 		trace_mm_page_free_batched(page);
-		free_unref_page_commit(page, pfn);
+		free_unref_page_commit(page, pfn, 0);
 
 		/*
 		 * Guard against excessive IRQ disabled times when we get
@@ -2905,6 +3036,27 @@ int __isolate_free_page(struct page *page, unsigned int order)
 	return 1UL << order;
 }
 
+/**
+ * __putback_isolated_page - Return a now-isolated page back where we got it
+ * @page: Page that was isolated
+ * @order: Order of the isolated page
+ *
+ * This function is meant to return a page pulled from the free lists via
+ * __isolate_free_page back to the free lists they were pulled from. The
+ * page reporting subsystem is not notified of it. Must be called with
+ * zone->lock held.
+ */
+void __putback_isolated_page(struct page *page, unsigned int order)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long pfn = page_to_pfn(page);
+
+	lockdep_assert_held(&zone->lock);
+
+	__free_one_page(page, pfn, zone, order,
+			get_pfnblock_migratetype(page, pfn), false);
+}
+
 /*
  * Update NUMA hit/miss statistics
  *
@@ -2933,25 +3085,35 @@ static inline void zone_statistics(struct zone *preferred_zone, struct zone *z)
 }
 
 /* Remove page from the per-cpu list, caller must protect the list */
-static struct page *__rmqueue_pcplist(struct zone *zone, int migratetype,
-			struct per_cpu_pages *pcp,
+static struct page *__rmqueue_pcplist(struct zone *zone, unsigned int order,
+			int migratetype, struct per_cpu_pages *pcp,
 			struct list_head *list)
 {
 	struct page *page;
 
 	do {
 		if (list_empty(list)) {
-			pcp->count += rmqueue_bulk(zone, 0,
-					pcp->batch, list,
-					migratetype);
+			int batch = READ_ONCE(pcp->batch);
+
+			/*
+			 * pcp->batch is in base pages, refill high orders
+			 * with fewer but at least a couple of pages so that
+			 * hoarding them does not fragment the zone.
+			 */
+			if (order) {
+				batch = max(batch >> order, 2);
+				__count_vm_event(PCP_HIGH_ORDER_REFILL);
+			}
+			pcp->count += rmqueue_bulk(zone, order, batch, list,
+					migratetype) << order;
 			if (unlikely(list_empty(list)))
 				return NULL;
 		}
 
 		page = list_first_entry(list, struct page, lru);
 		list_del(&page->lru);
-		pcp->count--;
-	} while (check_new_pcp(page));
+		pcp->count -= 1 << order;
+	} while (check_new_pcp(page, order));
 
 	return page;
 }
@@ -2968,10 +3130,12 @@ static struct page *rmqueue_pcplist(struct zone *preferred_zone,
 
 	local_irq_save(flags);
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
-	list = &pcp->lists[migratetype];
-	page = __rmqueue_pcplist(zone,  migratetype, pcp, list);
+	list = &pcp->lists[order_to_pindex(migratetype, order)];
+	page = __rmqueue_pcplist(zone, order, migratetype, pcp, list);
 	if (page) {
 		__count_zid_vm_events(PGALLOC, page_zonenum(page), 1 << order);
+		if (order)
+			__count_vm_event(PCP_HIGH_ORDER_ALLOC);
 		zone_statistics(preferred_zone, zone);
 	}
 	local_irq_restore(flags);
@@ -2979,7 +3143,8 @@ static struct page *rmqueue_pcplist(struct zone *preferred_zone,
 }
 
 /*
- * Allocate a page from the given zone. Use pcplists for order-0 allocations.
+ * Allocate a page from the given zone. Use pcplists for orders up to
+ * percpu_pagelist_high_order.
  */
 static inline
 struct page *rmqueue(struct zone *preferred_zone,
@@ -2990,7 +3155,7 @@ struct page *rmqueue(struct zone *preferred_zone,
 	unsigned long flags;
 	struct page *page;
 
-	if (likely(order == 0)) {
+	if (likely(pcp_allowed_order(order))) {
 		page = rmqueue_pcplist(preferred_zone, zone, order,
 				gfp_flags, migratetype);
 		goto out;
@@ -3553,12 +3718,14 @@ __alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
 		return NULL;
 
 	psi_memstall_enter(&pflags);
+	delayacct_compact_start();
 	noreclaim_flag = memalloc_noreclaim_save();
 
 	*compact_result = try_to_compact_pages(gfp_mask, order, alloc_flags, ac,
 									prio);
 
 	memalloc_noreclaim_restore(noreclaim_flag);
+	delayacct_compact_end();
 	psi_memstall_leave(&pflags);
 
 	if (*compact_result <= COMPACT_INACTIVE)
@@ -4429,12 +4596,8 @@ EXPORT_SYMBOL(get_zeroed_page);
 
 void __free_pages(struct page *page, unsigned int order)
 {
-	if (put_page_testzero(page)) {
-		if (order == 0)
-			free_unref_page(page);
-		else
-			__free_pages_ok(page, order);
-	}
+	if (put_page_testzero(page))
+		free_the_page(page, order);
 }
 
 EXPORT_SYMBOL(__free_pages);
@@ -4485,14 +4648,8 @@ void __page_frag_cache_drain(struct page *page, unsigned int count)
 {
 	VM_BUG_ON_PAGE(page_ref_count(page) == 0, page);
 
-	if (page_ref_sub_and_test(page, count)) {
-		unsigned int order = compound_order(page);
-
-		if (order == 0)
-			free_unref_page(page);
-		else
-			__free_pages_ok(page, order);
-	}
+	if (page_ref_sub_and_test(page, count))
+		free_the_page(page, compound_order(page));
 }
 EXPORT_SYMBOL(__page_frag_cache_drain);
 
@@ -4558,7 +4715,7 @@ void page_frag_free(void *addr)
 	struct page *page = virt_to_head_page(addr);
 
 	if (unlikely(put_page_testzero(page)))
-		__free_pages_ok(page, compound_order(page));
+		free_the_page(page, compound_order(page));
 }
 EXPORT_SYMBOL(page_frag_free);
 
@@ -5471,6 +5628,59 @@ overlap_memmap_init(unsigned long zone, unsigned long *pfn)
 	return false;
 }
 
+#ifdef CONFIG_MEMORY_HOTPLUG
+struct memmap_init_arg {
+	int nid;
+	unsigned long zone;
+};
+
+/* Initialise the struct pages of hot-added memory in [start_pfn, end_pfn) */
+static void __meminit memmap_init_hotplug_chunk(unsigned long start_pfn,
+		unsigned long end_pfn, void *data)
+{
+	struct memmap_init_arg *arg = data;
+	unsigned long pfn;
+
+	for (pfn = start_pfn; pfn < end_pfn; pfn++) {
+		struct page *page = pfn_to_page(pfn);
+
+		__init_single_page(page, pfn, arg->zone, arg->nid);
+		__SetPageReserved(page);
+
+		/* See the comment in memmap_init_zone() */
+		if (!(pfn & (pageblock_nr_pages - 1))) {
+			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+			cond_resched();
+		}
+	}
+}
+
+/*
+ * Hot-added memory has no holes and nobody else touches its struct pages
+ * yet, so the memory map can be initialised by all CPUs of the node.
+ */
+static void __meminit memmap_init_hotplug(unsigned long start_pfn,
+		unsigned long end_pfn, int nid, unsigned long zone)
+{
+	struct memmap_init_arg arg = {
+		.nid = nid,
+		.zone = zone,
+	};
+	struct padata_mt_job job = {
+		.thread_fn   = memmap_init_hotplug_chunk,
+		.fn_arg      = &arg,
+		.start       = start_pfn,
+		.size        = end_pfn - start_pfn,
+		.align       = pageblock_nr_pages,
+		.min_chunk   = MEMMAP_INIT_MIN_CHUNK,
+		.max_threads = max(cpumask_weight(cpumask_of_node(nid)), 1U),
+		.nid         = nid,
+	};
+
+	padata_do_multithreaded(&job);
+}
+#endif
+
 /*
  * Initially all pages are reserved - free ones are freed
  * up by memblock_free_all() once the early boot process is
@@ -5504,6 +5714,13 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 	}
 #endif
 
+#ifdef CONFIG_MEMORY_HOTPLUG
+	if (context == MEMMAP_HOTPLUG) {
+		memmap_init_hotplug(start_pfn, end_pfn, nid, zone);
+		return;
+	}
+#endif
+
 	for (pfn = start_pfn; pfn < end_pfn; pfn++) {
 		/*
 		 * There can be holes in boot-time mem_map[]s handed to this
@@ -5719,14 +5936,14 @@ static void pageset_set_batch(struct per_cpu_pageset *p, unsigned long batch)
 static void pageset_init(struct per_cpu_pageset *p)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	unsigned int pindex;
 
 	memset(p, 0, sizeof(*p));
 
 	pcp = &p->pcp;
 	pcp->count = 0;
-	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
-		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	for (pindex = 0; pindex < NR_PCP_LISTS; pindex++)
+		INIT_LIST_HEAD(&pcp->lists[pindex]);
 }
 
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
@@ -6304,7 +6521,6 @@ static void __meminit pgdat_init_internals(struct pglist_data *pgdat)
 	init_waitqueue_head(&pgdat->pfmemalloc_wait);
 
 	pgdat_page_ext_init(pgdat);
-	spin_lock_init(&pgdat->lru_lock);
 	lruvec_init(node_lruvec(pgdat));
 }
 
@@ -7592,6 +7808,28 @@ int percpu_pagelist_fraction_sysctl_handler(struct ctl_table *table, int write,
 	return ret;
 }
 
+/*
+ * percpu_pagelist_high_order - the highest order cached on the pcp lists.
+ * Lowering it drains the pcp lists so that no pages of the orders that
+ * are no longer allocated from them are left behind.
+ */
+int percpu_pagelist_high_order_sysctl_handler(struct ctl_table *table,
+	int write, void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int old_high_order;
+	int ret;
+
+	mutex_lock(&pcp_batch_high_lock);
+	old_high_order = percpu_pagelist_high_order;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (write && !ret && percpu_pagelist_high_order < old_high_order)
+		drain_all_pages(NULL);
+
+	mutex_unlock(&pcp_batch_high_lock);
+	return ret;
+}
+
 #ifdef CONFIG_NUMA
 int hashdist = HASHDIST_DEFAULT;
 
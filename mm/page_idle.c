@@ -30,8 +30,8 @@
  */
 static struct page *page_idle_get_page(unsigned long pfn)
 {
+	struct lruvec *lruvec;
 	struct page *page;
-	struct zone *zone;
 
 	if (!pfn_valid(pfn))
 		return NULL;
@@ -41,13 +41,12 @@ static struct page *page_idle_get_page(unsigned long pfn)
 	    !get_page_unless_zero(page))
 		return NULL;
 
-	zone = page_zone(page);
-	spin_lock_irq(zone_lru_lock(zone));
+	lruvec = lock_page_lruvec_irq(page);
 	if (unlikely(!PageLRU(page))) {
 		put_page(page);
 		page = NULL;
 	}
-	spin_unlock_irq(zone_lru_lock(zone));
+	unlock_page_lruvec_irq(lruvec);
 	return page;
 }
 
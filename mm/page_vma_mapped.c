@@ -210,9 +210,22 @@ bool page_vma_mapped_walk(struct page_vma_mapped_walk *pvmw)
 	} else if (!pmd_present(pmde)) {
 		return false;
 	}
+	/*
+	 * rmap knows of only one mapping of the entries of a PTE table
+	 * shared on fork: give this process its own copy to work on.
+	 */
+	if (unlikely(pmd_pte_shared(pmde)) &&
+	    unshare_pte_table(pvmw->vma, pvmw->address, pvmw->pmd))
+		return false;
 	if (!map_pte(pvmw))
 		goto next_pte;
 	while (1) {
+		/*
+		 * Shared again by a fork() racing with us, which takes the
+		 * table lock to share it: leave the entries be this time.
+		 */
+		if (unlikely(pmd_pte_shared(*pvmw->pmd)))
+			return not_found(pvmw);
 		if (check_pte(pvmw))
 			return true;
 next_pte:
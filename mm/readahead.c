@@ -24,6 +24,9 @@
 
 #include "internal.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -141,6 +144,47 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 	return ret;
 }
 
+#ifdef CONFIG_FILE_LARGE_PAGES
+/*
+ * Try to read a whole PMD sized range of a read-mostly file into one huge
+ * page. @nr is the number of pages left in the readahead window, @mark the
+ * offset that wants PG_readahead, which a compound page cannot carry.
+ *
+ * Files open for writing are skipped because a write would only split the
+ * page again. That check is racy, but writers cope with huge pages anyway.
+ */
+static struct page *ra_alloc_large_page(struct address_space *mapping,
+		pgoff_t index, unsigned long nr, pgoff_t mark, gfp_t gfp)
+{
+	pgoff_t last = index + HPAGE_PMD_NR - 1;
+	struct page *page;
+
+	if (!mapping_large_pages(mapping) || (index & (HPAGE_PMD_NR - 1)) ||
+	    nr < HPAGE_PMD_NR || (mark >= index && mark <= last) ||
+	    inode_is_open_for_write(mapping->host))
+		return NULL;
+
+	/* Don't clash with pages already in the range */
+	if (xa_find(&mapping->i_pages, &index, last, XA_PRESENT))
+		return NULL;
+
+	page = __page_cache_alloc_order(gfp | __GFP_COMP | __GFP_NORETRY |
+					__GFP_NOWARN, HPAGE_PMD_ORDER);
+	if (!page) {
+		count_vm_event(THP_FILE_FALLBACK);
+		return NULL;
+	}
+	prep_transhuge_page(page);
+	return page;
+}
+#else
+static inline struct page *ra_alloc_large_page(struct address_space *mapping,
+		pgoff_t index, unsigned long nr, pgoff_t mark, gfp_t gfp)
+{
+	return NULL;
+}
+#endif
+
 /*
  * __do_page_cache_readahead() actually reads a chunk of disk.  It allocates
  * the pages first, then submits them for I/O. This avoids the very bad
@@ -190,6 +234,18 @@ unsigned int __do_page_cache_readahead(struct address_space *mapping,
 			continue;
 		}
 
+		page = ra_alloc_large_page(mapping, page_offset,
+				min(nr_to_read - page_idx,
+				    end_index - page_offset + 1),
+				offset + nr_to_read - lookahead_size, gfp_mask);
+		if (page) {
+			page->index = page_offset;
+			list_add(&page->lru, &page_pool);
+			page_idx += HPAGE_PMD_NR - 1;
+			nr_pages++;
+			continue;
+		}
+
 		page = __page_cache_alloc(gfp_mask);
 		if (!page)
 			break;
@@ -374,6 +430,55 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+/*
+ * Adaptive window sizing.
+ *
+ * ra->ra_pages starts out as the bdi's read_ahead_kb and is then adjusted
+ * per file from what the reader observes:
+ *
+ * - When the reader reaches the PG_readahead marker of a window, it has
+ *   consumed the whole previous window since that window was submitted.
+ *   If the marked page is still under I/O, the device could not deliver a
+ *   window in the time the reader took to consume one: the window does not
+ *   cover the device latency at the device's throughput, so double it, up
+ *   to max(read_ahead_kb, read_ahead_max_kb) of the bdi.
+ *
+ * - When the reader misses the page cache inside the current window, pages
+ *   that were read ahead were reclaimed before they were used: the window
+ *   is larger than memory pressure allows, so halve it.
+ *
+ * Fast devices thus grow their windows until they keep up with the reader,
+ * while slow or memory starved ones stay small.
+ */
+#define RA_ADAPT_MIN_PAGES	(VM_MIN_READAHEAD >> (PAGE_SHIFT - 10))
+
+static void ra_adapt_grow(struct address_space *mapping,
+			  struct file_ra_state *ra, pgoff_t offset)
+{
+	struct backing_dev_info *bdi = inode_to_bdi(mapping->host);
+	unsigned long max = max(bdi->ra_pages, bdi->ra_pages_max);
+	unsigned int old = ra->ra_pages;
+
+	if (ra->ra_pages >= max)
+		return;
+	ra->ra_pages = min_t(unsigned long, 2 * ra->ra_pages, max);
+	trace_readahead_adjust(mapping, offset, old, ra->ra_pages, false);
+}
+
+static void ra_adapt_shrink(struct address_space *mapping,
+			    struct file_ra_state *ra, pgoff_t offset)
+{
+	unsigned int old = ra->ra_pages;
+
+	if (!ra->size || offset < ra->start || offset >= ra->start + ra->size)
+		return;
+	if (ra->ra_pages <= RA_ADAPT_MIN_PAGES)
+		return;
+	ra->ra_pages = max_t(unsigned int, ra->ra_pages / 2,
+			     RA_ADAPT_MIN_PAGES);
+	trace_readahead_adjust(mapping, offset, old, ra->ra_pages, true);
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -463,6 +568,8 @@ ondemand_readahead(struct address_space *mapping,
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
+	trace_readahead_ondemand(mapping, ra, offset, req_size,
+				 hit_readahead_marker);
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
@@ -488,6 +595,8 @@ ondemand_readahead(struct address_space *mapping,
 		}
 	}
 
+	trace_readahead_ondemand(mapping, ra, offset, req_size,
+				 hit_readahead_marker);
 	return ra_submit(ra, mapping, filp);
 }
 
@@ -522,6 +631,9 @@ void page_cache_sync_readahead(struct address_space *mapping,
 		return;
 	}
 
+	/* a miss inside the current window: read ahead pages got reclaimed */
+	ra_adapt_shrink(mapping, ra, offset);
+
 	/* do read-ahead */
 	ondemand_readahead(mapping, ra, filp, false, offset, req_size);
 }
@@ -560,6 +672,10 @@ page_cache_async_readahead(struct address_space *mapping,
 
 	ClearPageReadahead(page);
 
+	/* the reader caught up with the I/O of the current window */
+	if (!PageUptodate(page))
+		ra_adapt_grow(mapping, ra, offset);
+
 	/*
 	 * Defer asynchronous read-ahead on IO congestion.
 	 */
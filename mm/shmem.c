@@ -1608,6 +1608,20 @@ static int shmem_getpage_gfp(struct inode *inode, pgoff_t index,
 repeat:
 	swap.val = 0;
 	page = find_lock_entry(mapping, index);
+
+	/*
+	 * The page is in the page cache, even if swapped out: let userland
+	 * map it with UFFDIO_CONTINUE.
+	 */
+	if (page && vma && userfaultfd_minor(vma)) {
+		if (!xa_is_value(page)) {
+			unlock_page(page);
+			put_page(page);
+		}
+		*fault_type = handle_userfault(vmf, VM_UFFD_MINOR);
+		return 0;
+	}
+
 	if (xa_is_value(page)) {
 		swap = radix_to_swp_entry(page);
 		page = NULL;
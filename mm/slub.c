@@ -1477,11 +1477,6 @@ static inline struct page *alloc_slab_page(struct kmem_cache *s,
 	else
 		page = __alloc_pages_node(node, flags, order);
 
-	if (page && memcg_charge_slab(page, flags, order, s)) {
-		__free_pages(page, order);
-		page = NULL;
-	}
-
 	return page;
 }
 
@@ -1707,6 +1702,9 @@ static void __free_slab(struct kmem_cache *s, struct page *page)
 			check_object(s, page, p, SLUB_RED_INACTIVE);
 	}
 
+	/* Shares page->mem_cgroup, must be gone before the stats update */
+	memcg_free_page_obj_cgroups(page);
+
 	mod_lruvec_page_state(page,
 		(s->flags & SLAB_RECLAIM_ACCOUNT) ?
 		NR_SLAB_RECLAIMABLE : NR_SLAB_UNRECLAIMABLE,
@@ -1718,7 +1716,6 @@ static void __free_slab(struct kmem_cache *s, struct page *page)
 	page->mapping = NULL;
 	if (current->reclaim_state)
 		current->reclaim_state->reclaimed_slab += pages;
-	memcg_uncharge_slab(page, order, s);
 	__free_pages(page, order);
 }
 
@@ -2304,6 +2301,39 @@ static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	c->tid = next_tid(c->tid);
 }
 
+#ifdef CONFIG_SLUB_SHEAVES
+static void *sheaf_alloc(struct kmem_cache *s);
+static bool sheaf_free(struct kmem_cache *s, struct page *page, void *object);
+static void sheaf_flush_cpu(struct kmem_cache *s, int cpu);
+
+/* Pairs with the release in slub_set_sheaf_capacity() */
+static inline unsigned int slub_sheaf_capacity(struct kmem_cache *s)
+{
+	return smp_load_acquire(&s->sheaf_capacity);
+}
+
+static inline bool sheaf_has_objects(struct kmem_cache *s, int cpu)
+{
+	return s->sheaf && per_cpu_ptr(s->sheaf, cpu)->count;
+}
+#else
+static inline void *sheaf_alloc(struct kmem_cache *s) { return NULL; }
+static inline bool sheaf_free(struct kmem_cache *s, struct page *page,
+			      void *object)
+{
+	return false;
+}
+static inline void sheaf_flush_cpu(struct kmem_cache *s, int cpu) { }
+static inline unsigned int slub_sheaf_capacity(struct kmem_cache *s)
+{
+	return 0;
+}
+static inline bool sheaf_has_objects(struct kmem_cache *s, int cpu)
+{
+	return false;
+}
+#endif
+
 /*
  * Flush cpu slab.
  *
@@ -2313,6 +2343,9 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	/* Objects of the sheaf may go back to the cpu slab being flushed */
+	sheaf_flush_cpu(s, cpu);
+
 	if (likely(c)) {
 		if (c->page)
 			flush_slab(s, c);
@@ -2333,7 +2366,7 @@ static bool has_cpu_slab(int cpu, void *info)
 	struct kmem_cache *s = info;
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	return c->page || slub_percpu_partial(c);
+	return c->page || slub_percpu_partial(c) || sheaf_has_objects(s, cpu);
 }
 
 static void flush_all(struct kmem_cache *s)
@@ -2666,10 +2699,19 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 	struct kmem_cache_cpu *c;
 	struct page *page;
 	unsigned long tid;
+	struct obj_cgroup *objcg = NULL;
 
-	s = slab_pre_alloc_hook(s, gfpflags);
+	s = slab_pre_alloc_hook(s, &objcg, 1, gfpflags);
 	if (!s)
 		return NULL;
+
+	if (slub_sheaf_capacity(s) && node == NUMA_NO_NODE) {
+		object = sheaf_alloc(s);
+		if (object) {
+			stat(s, ALLOC_SHEAF);
+			goto out;
+		}
+	}
 redo:
 	/*
 	 * Must read kmem_cache cpu data via this cpu ptr. Preemption is
@@ -2737,11 +2779,11 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 		prefetch_freepointer(s, next_object);
 		stat(s, ALLOC_FASTPATH);
 	}
-
+out:
 	if (unlikely(gfpflags & __GFP_ZERO) && object)
 		memset(object, 0, s->object_size);
 
-	slab_post_alloc_hook(s, gfpflags, 1, &object);
+	slab_post_alloc_hook(s, objcg, gfpflags, 1, &object);
 
 	return object;
 }
@@ -2988,8 +3030,14 @@ static __always_inline void slab_free(struct kmem_cache *s, struct page *page,
 	 * With KASAN enabled slab_free_freelist_hook modifies the freelist
 	 * to remove objects, whose reuse must be delayed.
 	 */
-	if (slab_free_freelist_hook(s, &head, &tail))
-		do_slab_free(s, page, head, tail, cnt, addr);
+	if (!slab_free_freelist_hook(s, &head, &tail))
+		return;
+
+	if (cnt == 1 && !tail && slub_sheaf_capacity(s) &&
+	    sheaf_free(s, page, head))
+		return;
+
+	do_slab_free(s, page, head, tail, cnt, addr);
 }
 
 #ifdef CONFIG_KASAN
@@ -3001,10 +3049,14 @@ void ___cache_free(struct kmem_cache *cache, void *x, unsigned long addr)
 
 void kmem_cache_free(struct kmem_cache *s, void *x)
 {
+	struct page *page;
+
 	s = cache_from_obj(s, x);
 	if (!s)
 		return;
-	slab_free(s, virt_to_head_page(x), x, NULL, 1, _RET_IP_);
+	page = virt_to_head_page(x);
+	memcg_slab_free_hook(s, page, x);
+	slab_free(s, page, x, NULL, 1, _RET_IP_);
 	trace_kmem_cache_free(_RET_IP_, x);
 }
 EXPORT_SYMBOL(kmem_cache_free);
@@ -3106,6 +3158,19 @@ void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
 	if (WARN_ON(!size))
 		return;
 
+	if (memcg_kmem_enabled()) {
+		size_t i;
+
+		for (i = 0; i < size; i++) {
+			struct page *page;
+
+			if (!p[i])
+				continue;
+			page = virt_to_head_page(p[i]);
+			memcg_slab_free_hook(page->slab_cache, page, p[i]);
+		}
+	}
+
 	do {
 		struct detached_freelist df;
 
@@ -3118,15 +3183,175 @@ void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
 }
 EXPORT_SYMBOL(kmem_cache_free_bulk);
 
+#ifdef CONFIG_SLUB_SHEAVES
+/* Serializes changes of sheaf_capacity */
+static DEFINE_MUTEX(sheaf_mutex);
+
+/*
+ * Take a batch of objects from the cpu slab freelist. The tid is bumped
+ * as in kmem_cache_alloc_bulk() so that a preempted lockless fastpath
+ * notices the change. Interrupts must be disabled.
+ */
+static void sheaf_refill(struct kmem_cache *s, struct slub_sheaf *sheaf)
+{
+	struct kmem_cache_cpu *c = this_cpu_ptr(s->cpu_slab);
+	unsigned int target = max(slub_sheaf_capacity(s) / 2, 1U);
+	void *object = c->freelist;
+
+	if (!object)
+		return;
+
+	while (object && sheaf->count < target) {
+		sheaf->objects[sheaf->count++] = object;
+		object = get_freepointer(s, object);
+	}
+	c->freelist = object;
+	c->tid = next_tid(c->tid);
+	stat(s, SHEAF_REFILL);
+}
+
+/*
+ * Allocate from the sheaf of this cpu. When it is empty it is refilled
+ * from the cpu slab; if that is empty too, the caller goes through the
+ * regular paths, which will get a new cpu slab for the next refill.
+ */
+static void *sheaf_alloc(struct kmem_cache *s)
+{
+	struct slub_sheaf *sheaf;
+	unsigned long flags;
+	void *object = NULL;
+
+	local_irq_save(flags);
+	sheaf = this_cpu_ptr(s->sheaf);
+	if (unlikely(!sheaf->count))
+		sheaf_refill(s, sheaf);
+	if (likely(sheaf->count))
+		object = sheaf->objects[--sheaf->count];
+	local_irq_restore(flags);
+
+	return object;
+}
+
+/* Free a batch of objects to their slabs, grouping them by slab page */
+static void sheaf_drain_batch(struct kmem_cache *s, void **p, size_t nr)
+{
+	stat(s, SHEAF_DRAIN);
+
+	do {
+		struct detached_freelist df;
+
+		nr = build_detached_freelist(s, nr, p, &df);
+		if (!df.page)
+			continue;
+
+		do_slab_free(df.s, df.page, df.freelist, df.tail, df.cnt,
+			     _RET_IP_);
+	} while (nr);
+}
+
+/*
+ * Free an object to the sheaf of this cpu. When the sheaf is full, its
+ * older half is drained to the slabs first. Objects of remote nodes and
+ * of debug caches are left to the regular paths.
+ */
+static bool sheaf_free(struct kmem_cache *s, struct page *page, void *object)
+{
+	void *batch[SLUB_SHEAF_MAX / 2];
+	struct slub_sheaf *sheaf;
+	unsigned int capacity;
+	unsigned long flags;
+	unsigned int nr = 0;
+
+	if (kmem_cache_debug(s))
+		return false;
+
+	local_irq_save(flags);
+	if (unlikely(page_to_nid(page) != numa_mem_id())) {
+		local_irq_restore(flags);
+		return false;
+	}
+
+	sheaf = this_cpu_ptr(s->sheaf);
+	capacity = slub_sheaf_capacity(s);
+	if (unlikely(sheaf->count >= capacity) && capacity) {
+		nr = min_t(unsigned int, sheaf->count - capacity / 2,
+			   ARRAY_SIZE(batch));
+		memcpy(batch, sheaf->objects, nr * sizeof(void *));
+		sheaf->count -= nr;
+		memmove(sheaf->objects, sheaf->objects + nr,
+			sheaf->count * sizeof(void *));
+	}
+	if (likely(sheaf->count < capacity)) {
+		sheaf->objects[sheaf->count++] = object;
+		object = NULL;
+	}
+	local_irq_restore(flags);
+
+	if (nr)
+		sheaf_drain_batch(s, batch, nr);
+	if (object)
+		return false;
+
+	stat(s, FREE_SHEAF);
+	return true;
+}
+
+/*
+ * Drain the whole sheaf of a cpu. Called with interrupts disabled, from
+ * the flush IPI or for a dead cpu.
+ */
+static void sheaf_flush_cpu(struct kmem_cache *s, int cpu)
+{
+	void *batch[SLUB_SHEAF_MAX / 2];
+	struct slub_sheaf *sheaf;
+	unsigned int nr;
+
+	if (!s->sheaf)
+		return;
+
+	sheaf = per_cpu_ptr(s->sheaf, cpu);
+	while (sheaf->count) {
+		nr = min_t(unsigned int, sheaf->count, ARRAY_SIZE(batch));
+		sheaf->count -= nr;
+		memcpy(batch, sheaf->objects + sheaf->count,
+		       nr * sizeof(void *));
+		sheaf_drain_batch(s, batch, nr);
+	}
+}
+
+static int slub_set_sheaf_capacity(struct kmem_cache *s, unsigned int objects)
+{
+	unsigned int old;
+
+	mutex_lock(&sheaf_mutex);
+	if (objects && !s->sheaf) {
+		s->sheaf = alloc_percpu(struct slub_sheaf);
+		if (!s->sheaf) {
+			mutex_unlock(&sheaf_mutex);
+			return -ENOMEM;
+		}
+	}
+
+	old = s->sheaf_capacity;
+	smp_store_release(&s->sheaf_capacity, objects);
+	if (objects < old)
+		flush_all(s);
+	mutex_unlock(&sheaf_mutex);
+
+	return 0;
+}
+#endif
+
 /* Note that interrupts must be enabled when calling this function. */
 int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 			  void **p)
 {
 	struct kmem_cache_cpu *c;
 	int i;
+	struct obj_cgroup *objcg = NULL;
 
 	/* memcg and kmem_cache debug support */
-	s = slab_pre_alloc_hook(s, flags);
+	s = slab_pre_alloc_hook(s, &objcg, size, flags);
 	if (unlikely(!s))
 		return false;
 	/*
@@ -3168,11 +3393,13 @@ int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 	}
 
 	/* memcg and kmem_cache debug support */
-	slab_post_alloc_hook(s, flags, size, p);
+	slab_post_alloc_hook(s, objcg, flags, size, p);
 	return i;
 error:
 	local_irq_enable();
-	slab_post_alloc_hook(s, flags, i, p);
+	/* The NULL entries give back the charge of the missing objects */
+	memset(p + i, 0, (size - i) * sizeof(*p));
+	slab_post_alloc_hook(s, objcg, flags, size, p);
 	__kmem_cache_free_bulk(s, i, p);
 	return 0;
 }
@@ -3398,6 +3625,9 @@ static void free_kmem_cache_nodes(struct kmem_cache *s)
 void __kmem_cache_release(struct kmem_cache *s)
 {
 	cache_random_seq_destroy(s);
+#ifdef CONFIG_SLUB_SHEAVES
+	free_percpu(s->sheaf);
+#endif
 	free_percpu(s->cpu_slab);
 	free_kmem_cache_nodes(s);
 }
@@ -3939,6 +4169,7 @@ void kfree(const void *x)
 		__free_pages(page, compound_order(page));
 		return;
 	}
+	memcg_slab_free_hook(page->slab_cache, page, object);
 	slab_free(page->slab_cache, page, object, NULL, 1, _RET_IP_);
 }
 EXPORT_SYMBOL(kfree);
@@ -4043,10 +4274,14 @@ void __kmemcg_cache_deactivate(struct kmem_cache *s)
 	 */
 	slub_set_cpu_partial(s, 0);
 	s->min_partial = 0;
+#ifdef CONFIG_SLUB_SHEAVES
+	WRITE_ONCE(s->sheaf_capacity, 0);
+#endif
 
 	/*
-	 * s->cpu_partial is checked locklessly (see put_cpu_partial), so
-	 * we have to make sure the change is visible before shrinking.
+	 * s->cpu_partial and s->sheaf_capacity are checked locklessly (see
+	 * put_cpu_partial), so we have to make sure the change is visible
+	 * before shrinking.
 	 */
 	slab_deactivate_memcg_cache_rcu_sched(s, kmemcg_cache_deact_after_rcu);
 }
@@ -4994,6 +5229,32 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+#ifdef CONFIG_SLUB_SHEAVES
+static ssize_t sheaf_capacity_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%u\n", s->sheaf_capacity);
+}
+
+static ssize_t sheaf_capacity_store(struct kmem_cache *s, const char *buf,
+				    size_t length)
+{
+	unsigned int objects;
+	int err;
+
+	err = kstrtouint(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects > SLUB_SHEAF_MAX || (objects && kmem_cache_debug(s)))
+		return -EINVAL;
+
+	err = slub_set_sheaf_capacity(s, objects);
+	if (err)
+		return err;
+	return length;
+}
+SLAB_ATTR(sheaf_capacity);
+#endif
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -5400,6 +5661,10 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(ALLOC_SHEAF, alloc_sheaf);
+STAT_ATTR(FREE_SHEAF, free_sheaf);
+STAT_ATTR(SHEAF_REFILL, sheaf_refill);
+STAT_ATTR(SHEAF_DRAIN, sheaf_drain);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -5409,6 +5674,9 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+#ifdef CONFIG_SLUB_SHEAVES
+	&sheaf_capacity_attr.attr,
+#endif
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
@@ -5466,6 +5734,10 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&alloc_sheaf_attr.attr,
+	&free_sheaf_attr.attr,
+	&sheaf_refill_attr.attr,
+	&sheaf_drain_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
@@ -17,6 +17,10 @@
  *
  * The architecture is expected to provide a vmemmap_populate() function
  * to instantiate the mapping.
+ *
+ * With CONFIG_HUGETLB_PAGE_FREE_VMEMMAP, ranges of the vmemmap can also be
+ * remapped to a single read-only page and their pages freed, and restored
+ * later: see mm/hugetlb_vmemmap.c.
  */
 #include <linux/mm.h>
 #include <linux/mmzone.h>
@@ -27,6 +31,7 @@
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
 #include <linux/sched.h>
+#include <linux/memory_hotplug.h>
 #include <asm/dma.h>
 #include <asm/pgalloc.h>
 #include <asm/pgtable.h>
@@ -261,3 +266,298 @@ struct page * __meminit sparse_mem_map_populate(unsigned long pnum, int nid,
 
 	return map;
 }
+
+#ifdef CONFIG_HUGETLB_PAGE_FREE_VMEMMAP
+/**
+ * struct vmemmap_remap_walk - walk of a vmemmap range
+ * @remap_pte:		called on each PTE after the reuse one, or NULL to
+ *			only split the PMD mappings of the range
+ * @reuse_page:		the page mapped at @reuse_addr
+ * @reuse_addr:		the first address of the walk, whose mapping is kept
+ * @vmemmap_pages:	pages unmapped by, or to be mapped by, @remap_pte
+ */
+struct vmemmap_remap_walk {
+	void (*remap_pte)(pte_t *pte, unsigned long addr,
+			  struct vmemmap_remap_walk *walk);
+	struct page *reuse_page;
+	unsigned long reuse_addr;
+	struct list_head *vmemmap_pages;
+};
+
+/* Map the vmemmap block mapped by @pmd with base pages */
+static int split_vmemmap_huge_pmd(pmd_t *pmd, unsigned long start)
+{
+	struct page *page = pmd_page(*pmd);
+	unsigned long addr = start;
+	pte_t *pgtable;
+	pmd_t __pmd;
+	int i;
+
+	pgtable = pte_alloc_one_kernel(&init_mm, start);
+	if (!pgtable)
+		return -ENOMEM;
+
+	pmd_populate_kernel(&init_mm, &__pmd, pgtable);
+	for (i = 0; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE) {
+		pte_t *pte = pte_offset_kernel(&__pmd, addr);
+
+		set_pte_at(&init_mm, addr, pte, mk_pte(page + i, PAGE_KERNEL));
+	}
+
+	spin_lock(&init_mm.page_table_lock);
+	if (likely(pmd_large(*pmd))) {
+		/* Make the PTEs visible before the PMD, as in __pte_alloc() */
+		smp_wmb();
+		pmd_populate_kernel(&init_mm, pmd, pgtable);
+		flush_tlb_kernel_range(start, start + PMD_SIZE);
+	} else {
+		pte_free_kernel(&init_mm, pgtable);
+	}
+	spin_unlock(&init_mm.page_table_lock);
+
+	return 0;
+}
+
+static void vmemmap_pte_range(pmd_t *pmd, unsigned long addr,
+			      unsigned long end,
+			      struct vmemmap_remap_walk *walk)
+{
+	pte_t *pte = pte_offset_kernel(pmd, addr);
+
+	/* The first PTE of the walk maps the page the others are remapped to */
+	if (!walk->reuse_page) {
+		walk->reuse_page = pte_page(*pte);
+		pte++;
+		addr += PAGE_SIZE;
+	}
+
+	for (; addr != end; addr += PAGE_SIZE, pte++)
+		walk->remap_pte(pte, addr, walk);
+}
+
+static int vmemmap_pmd_range(pud_t *pud, unsigned long addr,
+			     unsigned long end,
+			     struct vmemmap_remap_walk *walk)
+{
+	pmd_t *pmd = pmd_offset(pud, addr);
+	unsigned long next;
+	int ret;
+
+	do {
+		next = pmd_addr_end(addr, end);
+		if (pmd_large(*pmd)) {
+			ret = split_vmemmap_huge_pmd(pmd, addr & PMD_MASK);
+			if (ret)
+				return ret;
+		}
+		if (walk->remap_pte)
+			vmemmap_pte_range(pmd, addr, next, walk);
+	} while (pmd++, addr = next, addr != end);
+
+	return 0;
+}
+
+static int vmemmap_pud_range(p4d_t *p4d, unsigned long addr,
+			     unsigned long end,
+			     struct vmemmap_remap_walk *walk)
+{
+	pud_t *pud = pud_offset(p4d, addr);
+	unsigned long next;
+	int ret;
+
+	do {
+		next = pud_addr_end(addr, end);
+		ret = vmemmap_pmd_range(pud, addr, next, walk);
+		if (ret)
+			return ret;
+	} while (pud++, addr = next, addr != end);
+
+	return 0;
+}
+
+static int vmemmap_p4d_range(pgd_t *pgd, unsigned long addr,
+			     unsigned long end,
+			     struct vmemmap_remap_walk *walk)
+{
+	p4d_t *p4d = p4d_offset(pgd, addr);
+	unsigned long next;
+	int ret;
+
+	do {
+		next = p4d_addr_end(addr, end);
+		ret = vmemmap_pud_range(p4d, addr, next, walk);
+		if (ret)
+			return ret;
+	} while (p4d++, addr = next, addr != end);
+
+	return 0;
+}
+
+/*
+ * Walk the vmemmap in [@start, @end). Splitting the PMD mappings is the
+ * only step that can fail, so a caller that remaps first walks the range
+ * with no @walk->remap_pte: the remapping walk can then not fail halfway.
+ */
+static int vmemmap_remap_range(unsigned long start, unsigned long end,
+			       struct vmemmap_remap_walk *walk)
+{
+	unsigned long addr = start;
+	unsigned long next;
+	pgd_t *pgd;
+	int ret;
+
+	VM_BUG_ON(!IS_ALIGNED(start, PAGE_SIZE));
+	VM_BUG_ON(!IS_ALIGNED(end, PAGE_SIZE));
+
+	pgd = pgd_offset_k(addr);
+	do {
+		next = pgd_addr_end(addr, end);
+		ret = vmemmap_p4d_range(pgd, addr, next, walk);
+		if (ret)
+			return ret;
+	} while (pgd++, addr = next, addr != end);
+
+	if (walk->remap_pte)
+		flush_tlb_kernel_range(start, end);
+
+	return 0;
+}
+
+/* vmemmap pages come from memblock at boot, or from the page allocator */
+static void free_vmemmap_page(struct page *page)
+{
+	if (PageReserved(page)) {
+#ifdef CONFIG_HAVE_BOOTMEM_INFO_NODE
+		unsigned long magic = (unsigned long)page->freelist;
+
+		if (magic == SECTION_INFO || magic == MIX_SECTION_INFO) {
+			put_page_bootmem(page);
+			return;
+		}
+#endif
+		free_reserved_page(page);
+	} else {
+		__free_page(page);
+	}
+}
+
+static void free_vmemmap_page_list(struct list_head *list)
+{
+	struct page *page, *next;
+
+	list_for_each_entry_safe(page, next, list, lru) {
+		list_del(&page->lru);
+		free_vmemmap_page(page);
+	}
+}
+
+static void vmemmap_remap_pte(pte_t *pte, unsigned long addr,
+			      struct vmemmap_remap_walk *walk)
+{
+	struct page *page = pte_page(*pte);
+
+	list_add_tail(&page->lru, walk->vmemmap_pages);
+	set_pte_at(&init_mm, addr, pte,
+		   mk_pte(walk->reuse_page, PAGE_KERNEL_RO));
+}
+
+static void vmemmap_restore_pte(pte_t *pte, unsigned long addr,
+				struct vmemmap_remap_walk *walk)
+{
+	struct page *page;
+
+	BUG_ON(pte_page(*pte) != walk->reuse_page);
+
+	page = list_first_entry(walk->vmemmap_pages, struct page, lru);
+	list_del(&page->lru);
+	copy_page(page_to_virt(page), (void *)walk->reuse_addr);
+	set_pte_at(&init_mm, addr, pte, mk_pte(page, PAGE_KERNEL));
+}
+
+/**
+ * vmemmap_remap_free - remap a vmemmap range to one page and free it
+ * @start:	start address of the vmemmap range to free
+ * @end:	end address of the vmemmap range to free
+ * @reuse:	address of the page to map the range to, @start - PAGE_SIZE
+ *
+ * The pages in [@start, @end) are freed, and the range maps read-only the
+ * page mapped at @reuse, so it must describe identical struct pages.
+ *
+ * Return: 0 on success, -ENOMEM if a PMD mapping could not be split, in
+ * which case nothing was remapped.
+ */
+int vmemmap_remap_free(unsigned long start, unsigned long end,
+		       unsigned long reuse)
+{
+	LIST_HEAD(vmemmap_pages);
+	struct vmemmap_remap_walk walk = {
+		.reuse_addr	= reuse,
+		.vmemmap_pages	= &vmemmap_pages,
+	};
+	int ret;
+
+	BUG_ON(start - reuse != PAGE_SIZE);
+
+	ret = vmemmap_remap_range(reuse, end, &walk);
+	if (ret)
+		return ret;
+
+	walk.remap_pte = vmemmap_remap_pte;
+	vmemmap_remap_range(reuse, end, &walk);
+	free_vmemmap_page_list(&vmemmap_pages);
+
+	return 0;
+}
+
+static int alloc_vmemmap_page_list(unsigned long start, unsigned long end,
+				   gfp_t gfp_mask, struct list_head *list)
+{
+	unsigned long nr_pages = (end - start) >> PAGE_SHIFT;
+	int nid = page_to_nid((struct page *)start);
+	struct page *page, *next;
+
+	while (nr_pages--) {
+		page = alloc_pages_node(nid, gfp_mask, 0);
+		if (!page)
+			goto out;
+		list_add_tail(&page->lru, list);
+	}
+
+	return 0;
+out:
+	list_for_each_entry_safe(page, next, list, lru)
+		__free_page(page);
+	return -ENOMEM;
+}
+
+/**
+ * vmemmap_remap_alloc - undo vmemmap_remap_free()
+ * @start:	start address of the vmemmap range to restore
+ * @end:	end address of the vmemmap range to restore
+ * @reuse:	address of the page the range is mapped to
+ * @gfp_mask:	GFP flags for the new vmemmap pages
+ *
+ * Return: 0 on success, -ENOMEM if the pages could not be allocated, in
+ * which case the range is left as it was.
+ */
+int vmemmap_remap_alloc(unsigned long start, unsigned long end,
+			unsigned long reuse, gfp_t gfp_mask)
+{
+	LIST_HEAD(vmemmap_pages);
+	struct vmemmap_remap_walk walk = {
+		.remap_pte	= vmemmap_restore_pte,
+		.reuse_addr	= reuse,
+		.vmemmap_pages	= &vmemmap_pages,
+	};
+
+	BUG_ON(start - reuse != PAGE_SIZE);
+
+	if (alloc_vmemmap_page_list(start, end, gfp_mask, &vmemmap_pages))
+		return -ENOMEM;
+
+	/* The range was split when it got remapped */
+	vmemmap_remap_range(reuse, end, &walk);
+
+	return 0;
+}
+#endif /* CONFIG_HUGETLB_PAGE_FREE_VMEMMAP */
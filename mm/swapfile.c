@@ -1352,6 +1352,27 @@ int __swap_count(struct swap_info_struct *si, swp_entry_t entry)
 	return swap_count(si->swap_map[offset]);
 }
 
+/*
+ * Check that each of the @nr swap entries from @entry is used by a single
+ * pte and has no page in the swap cache, so that a fault may read them all
+ * into pages of its own.  Racy, like the __swap_count() check of a single
+ * entry in do_swap_page().
+ */
+bool swap_range_exclusive(swp_entry_t entry, int nr)
+{
+	struct swap_info_struct *si = swp_swap_info(entry);
+	pgoff_t offset = swp_offset(entry);
+	int i;
+
+	if (offset + nr > si->max)
+		return false;
+
+	for (i = 0; i < nr; i++)
+		if (READ_ONCE(si->swap_map[offset + i]) != 1)
+			return false;
+	return true;
+}
+
 static int swap_swapcount(struct swap_info_struct *si, swp_entry_t entry)
 {
 	int count = 0;
@@ -181,7 +181,7 @@ truncate_cleanup_page(struct address_space *mapping, struct page *page)
 	}
 
 	if (page_has_private(page))
-		do_invalidatepage(page, 0, PAGE_SIZE);
+		do_invalidatepage(page, 0, PAGE_SIZE * hpage_nr_pages(page));
 
 	/*
 	 * Some filesystems seem to re-dirty the page even after
@@ -323,6 +323,9 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	else
 		end = (lend + 1) >> PAGE_SHIFT;
 
+	filemap_drop_large_pages(mapping, lstart >> PAGE_SHIFT,
+				 lend == -1 ? -1 : lend >> PAGE_SHIFT);
+
 	pagevec_init(&pvec);
 	index = start;
 	while (index < end && pagevec_lookup_entries(&pvec, mapping, index,
@@ -680,6 +683,8 @@ int invalidate_inode_pages2_range(struct address_space *mapping,
 	if (mapping->nrpages == 0 && mapping->nrexceptional == 0)
 		goto out;
 
+	filemap_drop_large_pages(mapping, start, end);
+
 	pagevec_init(&pvec);
 	index = start;
 	while (index <= end && pagevec_lookup_entries(&pvec, mapping, index,
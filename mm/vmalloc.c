@@ -22,7 +22,7 @@
 #include <linux/kallsyms.h>
 #include <linux/list.h>
 #include <linux/notifier.h>
-#include <linux/rbtree.h>
+#include <linux/rbtree_augmented.h>
 #include <linux/radix-tree.h>
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
@@ -332,17 +332,54 @@ LIST_HEAD(vmap_area_list);
 static LLIST_HEAD(vmap_purge_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
+/*
+ * The free vmap space is kept in its own rbtree, sorted by address and
+ * augmented with the size of the largest free area in each subtree, so
+ * that the lowest fitting area is found in O(log n) however fragmented
+ * the space gets. The busy and free trees together cover the whole
+ * address range and are both protected by vmap_area_lock.
+ */
+static struct rb_root free_vmap_area_root = RB_ROOT;
+
+static struct kmem_cache *vmap_area_cachep;
+
+/*
+ * A spare area for splitting a free area in the middle, preloaded before
+ * taking vmap_area_lock when a GFP_NOWAIT allocation under it would fail.
+ */
+static DEFINE_PER_CPU(struct vmap_area *, ne_fit_preload_node);
 
 static unsigned long vmap_area_pcpu_hole;
 
-static struct vmap_area *__find_vmap_area(unsigned long addr)
+static __always_inline unsigned long va_size(struct vmap_area *va)
 {
-	struct rb_node *n = vmap_area_root.rb_node;
+	return va->va_end - va->va_start;
+}
+
+static __always_inline unsigned long get_subtree_max_size(struct rb_node *node)
+{
+	struct vmap_area *va;
+
+	va = rb_entry_safe(node, struct vmap_area, rb_node);
+	return va ? va->subtree_max_size : 0;
+}
+
+static __always_inline unsigned long
+compute_subtree_max_size(struct vmap_area *va)
+{
+	return max3(va_size(va),
+		    get_subtree_max_size(va->rb_node.rb_left),
+		    get_subtree_max_size(va->rb_node.rb_right));
+}
+
+RB_DECLARE_CALLBACKS(static, free_vmap_area_rb_augment_cb,
+	struct vmap_area, rb_node, unsigned long, subtree_max_size,
+	compute_subtree_max_size)
+
+static struct vmap_area *__find_vmap_area_root(unsigned long addr,
+					       struct rb_root *root)
+{
+	struct rb_node *n = root->rb_node;
 
 	while (n) {
 		struct vmap_area *va;
@@ -359,6 +396,11 @@ static struct vmap_area *__find_vmap_area(unsigned long addr)
 	return NULL;
 }
 
+static struct vmap_area *__find_vmap_area(unsigned long addr)
+{
+	return __find_vmap_area_root(addr, &vmap_area_root);
+}
+
 static void __insert_vmap_area(struct vmap_area *va)
 {
 	struct rb_node **p = &vmap_area_root.rb_node;
@@ -386,9 +428,276 @@ static void __insert_vmap_area(struct vmap_area *va)
 	if (tmp) {
 		struct vmap_area *prev;
 		prev = rb_entry(tmp, struct vmap_area, rb_node);
-		list_add_rcu(&va->list, &prev->list);
+		list_add(&va->list, &prev->list);
 	} else
-		list_add_rcu(&va->list, &vmap_area_list);
+		list_add(&va->list, &vmap_area_list);
+}
+
+static void unlink_free_va(struct vmap_area *va)
+{
+	rb_erase_augmented(&va->rb_node, &free_vmap_area_root,
+			   &free_vmap_area_rb_augment_cb);
+	RB_CLEAR_NODE(&va->rb_node);
+}
+
+static void link_free_va(struct vmap_area *va, struct rb_node *parent,
+			 struct rb_node **link)
+{
+	va->subtree_max_size = va_size(va);
+	rb_link_node(&va->rb_node, parent, link);
+	if (parent)
+		free_vmap_area_rb_augment_cb.propagate(parent, NULL);
+	rb_insert_augmented(&va->rb_node, &free_vmap_area_root,
+			    &free_vmap_area_rb_augment_cb);
+}
+
+/*
+ * Return a range of KVA to the free tree, merging it with the free
+ * areas on either side. @va is consumed: it is either linked into the
+ * tree or freed.
+ */
+static void merge_or_add_free_va(struct vmap_area *va)
+{
+	struct rb_node **link = &free_vmap_area_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct vmap_area *prev, *next;
+	bool merged = false;
+
+	while (*link) {
+		struct vmap_area *tmp_va;
+
+		parent = *link;
+		tmp_va = rb_entry(parent, struct vmap_area, rb_node);
+		if (va->va_end <= tmp_va->va_start)
+			link = &parent->rb_left;
+		else if (va->va_start >= tmp_va->va_end)
+			link = &parent->rb_right;
+		else
+			BUG();
+	}
+
+	if (!parent) {
+		prev = next = NULL;
+	} else if (link == &parent->rb_left) {
+		next = rb_entry(parent, struct vmap_area, rb_node);
+		prev = rb_entry_safe(rb_prev(parent), struct vmap_area, rb_node);
+	} else {
+		prev = rb_entry(parent, struct vmap_area, rb_node);
+		next = rb_entry_safe(rb_next(parent), struct vmap_area, rb_node);
+	}
+
+	/*
+	 * The tree must be up to date after each step, as the erase of a
+	 * merged area relies on the sizes cached on its path.
+	 */
+	if (next && next->va_start == va->va_end) {
+		next->va_start = va->va_start;
+		free_vmap_area_rb_augment_cb.propagate(&next->rb_node, NULL);
+		kmem_cache_free(vmap_area_cachep, va);
+		va = next;
+		merged = true;
+	}
+
+	if (prev && prev->va_end == va->va_start) {
+		prev->va_end = va->va_end;
+		free_vmap_area_rb_augment_cb.propagate(&prev->rb_node, NULL);
+		if (merged)
+			unlink_free_va(va);
+		kmem_cache_free(vmap_area_cachep, va);
+		merged = true;
+	}
+
+	if (!merged)
+		link_free_va(va, parent, link);
+}
+
+/*
+ * Insert a free area that is known not to touch any other free area,
+ * as when splitting one in two.
+ */
+static void insert_free_va(struct vmap_area *va)
+{
+	struct rb_node **link = &free_vmap_area_root.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*link) {
+		struct vmap_area *tmp_va;
+
+		parent = *link;
+		tmp_va = rb_entry(parent, struct vmap_area, rb_node);
+		if (va->va_end <= tmp_va->va_start)
+			link = &parent->rb_left;
+		else if (va->va_start >= tmp_va->va_end)
+			link = &parent->rb_right;
+		else
+			BUG();
+	}
+
+	link_free_va(va, parent, link);
+}
+
+static __always_inline unsigned long
+va_fit_start(struct vmap_area *va, unsigned long align, unsigned long vstart)
+{
+	return ALIGN(max(va->va_start, vstart), align);
+}
+
+static __always_inline bool
+is_within_this_va(struct vmap_area *va, unsigned long size,
+		  unsigned long align, unsigned long vstart)
+{
+	unsigned long addr = va_fit_start(va, align, vstart);
+
+	/* Can overflow with a big size or alignment */
+	if (addr + size < addr || addr < vstart)
+		return false;
+
+	return addr + size <= va->va_end;
+}
+
+/*
+ * Find the lowest free area above @vstart that fits @size bytes aligned
+ * to @align. A subtree whose largest area is at least size + align - 1
+ * is guaranteed to hold a fit, so only one path down the tree has to be
+ * walked, plus at most one step back up because of @vstart. Free areas
+ * are page aligned, so up to PAGE_SIZE alignment costs nothing.
+ */
+static struct vmap_area *find_vmap_lowest_match(unsigned long size,
+		unsigned long align, unsigned long vstart)
+{
+	struct rb_node *node = free_vmap_area_root.rb_node;
+	unsigned long length;
+	struct vmap_area *va;
+
+	length = align > PAGE_SIZE ? size + align - 1 : size;
+
+	while (node) {
+		va = rb_entry(node, struct vmap_area, rb_node);
+
+		if (get_subtree_max_size(node->rb_left) >= length &&
+				vstart < va->va_start) {
+			node = node->rb_left;
+			continue;
+		}
+
+		if (is_within_this_va(va, size, align, vstart))
+			return va;
+
+		if (get_subtree_max_size(node->rb_right) >= length) {
+			node = node->rb_right;
+			continue;
+		}
+
+		/*
+		 * Nothing here: go back up to the first ancestor on our
+		 * left whose right subtree lies wholly above vstart and
+		 * is big enough.
+		 */
+		while ((node = rb_parent(node))) {
+			va = rb_entry(node, struct vmap_area, rb_node);
+			if (is_within_this_va(va, size, align, vstart))
+				return va;
+
+			if (get_subtree_max_size(node->rb_right) >= length &&
+					vstart <= va->va_start) {
+				node = node->rb_right;
+				break;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+enum fit_type {
+	NOTHING_FIT = 0,
+	FL_FIT_TYPE,	/* full fit */
+	LE_FIT_TYPE,	/* left edge fit */
+	RE_FIT_TYPE,	/* right edge fit */
+	NE_FIT_TYPE	/* no edge fit, the free area is split in two */
+};
+
+static enum fit_type classify_va_fit_type(struct vmap_area *va,
+		unsigned long addr, unsigned long size)
+{
+	if (addr < va->va_start || addr + size > va->va_end)
+		return NOTHING_FIT;
+
+	if (va->va_start == addr)
+		return va->va_end == addr + size ? FL_FIT_TYPE : LE_FIT_TYPE;
+
+	return va->va_end == addr + size ? RE_FIT_TYPE : NE_FIT_TYPE;
+}
+
+/*
+ * Carve [addr, addr + size) out of the free area @va. Returns 0 on
+ * success, or -ENOMEM if a split was needed and no area to describe the
+ * left part could be allocated.
+ */
+static int adjust_va_to_fit_type(struct vmap_area *va, unsigned long addr,
+				 unsigned long size, enum fit_type type)
+{
+	struct vmap_area *lva = NULL;
+
+	switch (type) {
+	case FL_FIT_TYPE:
+		unlink_free_va(va);
+		kmem_cache_free(vmap_area_cachep, va);
+		return 0;
+	case LE_FIT_TYPE:
+		va->va_start += size;
+		break;
+	case RE_FIT_TYPE:
+		va->va_end = addr;
+		break;
+	case NE_FIT_TYPE:
+		lva = kmem_cache_alloc(vmap_area_cachep, GFP_NOWAIT);
+		if (unlikely(!lva)) {
+			lva = __this_cpu_xchg(ne_fit_preload_node, NULL);
+			if (!lva)
+				return -ENOMEM;
+		}
+		lva->va_start = va->va_start;
+		lva->va_end = addr;
+		va->va_start = addr + size;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	free_vmap_area_rb_augment_cb.propagate(&va->rb_node, NULL);
+	if (lva)
+		insert_free_va(lva);
+	return 0;
+}
+
+/*
+ * Take the lowest fitting range out of the free tree. Returns its start
+ * address, or @vend if there is none.
+ */
+static unsigned long __alloc_vmap_area(unsigned long size,
+		unsigned long align, unsigned long vstart, unsigned long vend)
+{
+	struct vmap_area *va;
+	enum fit_type type;
+	unsigned long addr;
+
+	va = find_vmap_lowest_match(size, align, vstart);
+	if (unlikely(!va))
+		return vend;
+
+	addr = va_fit_start(va, align, vstart);
+	if (addr + size > vend)
+		return vend;
+
+	type = classify_va_fit_type(va, addr, size);
+	if (WARN_ON_ONCE(type == NOTHING_FIT))
+		return vend;
+
+	if (adjust_va_to_fit_type(va, addr, size, type))
+		return vend;
+
+	return addr;
 }
 
 static void purge_vmap_area_lazy(void);
@@ -404,11 +713,9 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				unsigned long vstart, unsigned long vend,
 				int node, gfp_t gfp_mask)
 {
-	struct vmap_area *va;
-	struct rb_node *n;
+	struct vmap_area *va, *pva;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
 
 	BUG_ON(!size);
 	BUG_ON(offset_in_page(size));
@@ -416,7 +723,7 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 
 	might_sleep();
 
-	va = kmalloc_node(sizeof(struct vmap_area),
+	va = kmem_cache_alloc_node(vmap_area_cachep,
 			gfp_mask & GFP_RECLAIM_MASK, node);
 	if (unlikely(!va))
 		return ERR_PTR(-ENOMEM);
@@ -428,84 +735,33 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	kmemleak_scan_area(&va->rb_node, SIZE_MAX, gfp_mask & GFP_RECLAIM_MASK);
 
 retry:
-	spin_lock(&vmap_area_lock);
 	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
+	 * Make sure a split of a free area cannot fail for lack of memory
+	 * once we hold the lock: if this CPU has no spare area yet, get one
+	 * with the caller's gfp mask.
 	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
+	preempt_disable();
+	if (!__this_cpu_read(ne_fit_preload_node)) {
+		preempt_enable();
+		pva = kmem_cache_alloc_node(vmap_area_cachep,
+				gfp_mask & GFP_RECLAIM_MASK, node);
+		preempt_disable();
+
+		if (__this_cpu_cmpxchg(ne_fit_preload_node, NULL, pva) && pva)
+			kmem_cache_free(vmap_area_cachep, pva);
 	}
 
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		if (list_is_last(&first->list, &vmap_area_list))
-			goto found;
-
-		first = list_next_entry(first, list);
-	}
+	spin_lock(&vmap_area_lock);
+	preempt_enable();
 
-found:
-	if (addr + size > vend)
+	addr = __alloc_vmap_area(size, align, vstart, vend);
+	if (unlikely(addr == vend))
 		goto overflow;
 
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(!IS_ALIGNED(va->va_start, align));
@@ -534,7 +790,7 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	if (!(gfp_mask & __GFP_NOWARN) && printk_ratelimit())
 		pr_warn("vmap allocation for size %lu failed: use vmalloc=<size> to increase size\n",
 			size);
-	kfree(va);
+	kmem_cache_free(vmap_area_cachep, va);
 	return ERR_PTR(-EBUSY);
 }
 
@@ -554,24 +810,9 @@ static void __free_vmap_area(struct vmap_area *va)
 {
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
 	rb_erase(&va->rb_node, &vmap_area_root);
 	RB_CLEAR_NODE(&va->rb_node);
-	list_del_rcu(&va->list);
+	list_del(&va->list);
 
 	/*
 	 * Track the highest possible candidate for pcpu area
@@ -582,7 +823,7 @@ static void __free_vmap_area(struct vmap_area *va)
 	if (va->va_end > VMALLOC_START && va->va_end <= VMALLOC_END)
 		vmap_area_pcpu_hole = max(vmap_area_pcpu_hole, va->va_end);
 
-	kfree_rcu(va, rcu_head);
+	merge_or_add_free_va(va);
 }
 
 /*
@@ -1238,12 +1479,48 @@ void __init vm_area_register_early(struct vm_struct *vm, size_t align)
 	vm_area_add_early(vm);
 }
 
+/*
+ * Fill the free tree with the gaps between the areas registered early,
+ * over the whole address space: callers of alloc_vmap_area() restrict
+ * themselves to their own [vstart, vend).
+ */
+static void __init vmap_init_free_space(void)
+{
+	unsigned long vmap_start = 1;
+	struct vmap_area *busy, *free;
+
+	list_for_each_entry(busy, &vmap_area_list, list) {
+		if (busy->va_start > vmap_start) {
+			free = kmem_cache_zalloc(vmap_area_cachep, GFP_NOWAIT);
+			if (WARN_ON_ONCE(!free))
+				return;
+
+			free->va_start = vmap_start;
+			free->va_end = busy->va_start;
+			insert_free_va(free);
+		}
+		vmap_start = busy->va_end;
+	}
+
+	if (vmap_start < ULONG_MAX) {
+		free = kmem_cache_zalloc(vmap_area_cachep, GFP_NOWAIT);
+		if (WARN_ON_ONCE(!free))
+			return;
+
+		free->va_start = vmap_start;
+		free->va_end = ULONG_MAX;
+		insert_free_va(free);
+	}
+}
+
 void __init vmalloc_init(void)
 {
 	struct vmap_area *va;
 	struct vm_struct *tmp;
 	int i;
 
+	vmap_area_cachep = KMEM_CACHE(vmap_area, SLAB_PANIC);
+
 	for_each_possible_cpu(i) {
 		struct vmap_block_queue *vbq;
 		struct vfree_deferred *p;
@@ -1258,7 +1535,10 @@ void __init vmalloc_init(void)
 
 	/* Import existing vmlist entries. */
 	for (tmp = vmlist; tmp; tmp = tmp->next) {
-		va = kzalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+		va = kmem_cache_zalloc(vmap_area_cachep, GFP_NOWAIT);
+		if (WARN_ON_ONCE(!va))
+			continue;
+
 		va->flags = VM_VM_AREA;
 		va->va_start = (unsigned long)tmp->addr;
 		va->va_end = va->va_start + tmp->size;
@@ -1266,6 +1546,7 @@ void __init vmalloc_init(void)
 		__insert_vmap_area(va);
 	}
 
+	vmap_init_free_space();
 	vmap_area_pcpu_hole = VMALLOC_END;
 
 	vmap_initialized = true;
@@ -1768,6 +2049,15 @@ void *__vmalloc_node_range(unsigned long size, unsigned long align,
 	return NULL;
 }
 
+/*
+ * This is only for performance analysis of vmalloc and stress purpose.
+ * It is required by vmalloc test module, therefore do not use it other
+ * than that.
+ */
+#ifdef CONFIG_TEST_VMALLOC_MODULE
+EXPORT_SYMBOL_GPL(__vmalloc_node_range);
+#endif
+
 /**
  *	__vmalloc_node  -  allocate virtually contiguous memory
  *	@size:		allocation size
@@ -2513,7 +2803,7 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 		goto err_free2;
 
 	for (area = 0; area < nr_vms; area++) {
-		vas[area] = kzalloc(sizeof(struct vmap_area), GFP_KERNEL);
+		vas[area] = kmem_cache_zalloc(vmap_area_cachep, GFP_KERNEL);
 		vms[area] = kzalloc(sizeof(struct vm_struct), GFP_KERNEL);
 		if (!vas[area] || !vms[area])
 			goto err_free;
@@ -2585,15 +2875,36 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 		pvm_find_next_prev(base + end, &next, &prev);
 	}
 found:
-	/* we've found a fitting base, insert all va's */
+	/*
+	 * We've found a fitting base: take the areas out of the free tree.
+	 * Each of them lies inside a single free area, as it overlaps no
+	 * busy one.
+	 */
 	for (area = 0; area < nr_vms; area++) {
 		struct vmap_area *va = vas[area];
+		struct vmap_area *free;
+		enum fit_type type;
 
 		va->va_start = base + offsets[area];
 		va->va_end = va->va_start + sizes[area];
-		__insert_vmap_area(va);
+
+		free = __find_vmap_area_root(va->va_start,
+					     &free_vmap_area_root);
+		if (WARN_ON_ONCE(!free))
+			goto err_unwind;
+
+		type = classify_va_fit_type(free, va->va_start, sizes[area]);
+		if (WARN_ON_ONCE(type == NOTHING_FIT))
+			goto err_unwind;
+
+		if (adjust_va_to_fit_type(free, va->va_start, sizes[area],
+					  type))
+			goto err_unwind;
 	}
 
+	for (area = 0; area < nr_vms; area++)
+		__insert_vmap_area(vas[area]);
+
 	vmap_area_pcpu_hole = base + offsets[last_area];
 
 	spin_unlock(&vmap_area_lock);
@@ -2606,9 +2917,17 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 	kfree(vas);
 	return vms;
 
+err_unwind:
+	/* Give back the ranges already carved out, then bail out */
+	while (area--) {
+		merge_or_add_free_va(vas[area]);
+		vas[area] = NULL;
+	}
+	spin_unlock(&vmap_area_lock);
 err_free:
 	for (area = 0; area < nr_vms; area++) {
-		kfree(vas[area]);
+		if (vas[area])
+			kmem_cache_free(vmap_area_cachep, vas[area]);
 		kfree(vms[area]);
 	}
 err_free2:
@@ -37,6 +37,7 @@
 #include <linux/cpu.h>
 #include <linux/cpuset.h>
 #include <linux/compaction.h>
+#include <linux/migrate.h>
 #include <linux/notifier.h>
 #include <linux/rwsem.h>
 #include <linux/delay.h>
@@ -50,6 +51,8 @@
 #include <linux/printk.h>
 #include <linux/dax.h>
 #include <linux/psi.h>
+#include <linux/mmu_notifier.h>
+#include <linux/jump_label.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -87,6 +90,12 @@ struct scan_control {
 	/* Can pages be swapped as part of reclaim? */
 	unsigned int may_swap:1;
 
+	/* Proactive reclaim asked for anonymous pages only */
+	unsigned int anon_only:1;
+
+	/* Do not move pages to a slower memory node instead of freeing */
+	unsigned int no_demotion:1;
+
 	/*
 	 * Cgroups are not reclaimed below their configured memory.low,
 	 * unless we threaten to OOM. If any cgroups are skipped due to
@@ -118,6 +127,9 @@ struct scan_control {
 	/* Number of pages freed so far during a call to shrink_zones() */
 	unsigned long nr_reclaimed;
 
+	/* Swappiness to use instead of the memcg's, if set */
+	int *proactive_swappiness;
+
 	struct {
 		unsigned int dirty;
 		unsigned int unqueued_dirty;
@@ -161,6 +173,18 @@ struct scan_control {
  * From 0 .. 100.  Higher means more swappy.
  */
 int vm_swappiness = 60;
+
+#ifdef CONFIG_LRU_GEN
+#ifdef CONFIG_LRU_GEN_ENABLED
+DEFINE_STATIC_KEY_TRUE(lru_gen_key);
+#else
+DEFINE_STATIC_KEY_FALSE(lru_gen_key);
+#endif
+
+/* Minimum time between two page table walks of the same lruvec */
+static unsigned int lru_gen_aging_interval_ms __read_mostly = 100;
+#endif
+
 /*
  * The total number of pages which are beyond the high watermark within all
  * zones.
@@ -754,8 +778,7 @@ static inline int is_page_cache_freeable(struct page *page)
 	 * that isolated the page, the page cache and optional buffer
 	 * heads at page->private.
 	 */
-	int page_cache_pins = PageTransHuge(page) && PageSwapCache(page) ?
-		HPAGE_PMD_NR : 1;
+	int page_cache_pins = PageTransHuge(page) ? HPAGE_PMD_NR : 1;
 	return page_count(page) - page_has_private(page) == 1 + page_cache_pins;
 }
 
@@ -917,7 +940,7 @@ static int __remove_mapping(struct address_space *mapping, struct page *page,
 	 * Note that if SetPageDirty is always performed via set_page_dirty,
 	 * and thus under the i_pages lock, then this ordering is not required.
 	 */
-	if (unlikely(PageTransHuge(page)) && PageSwapCache(page))
+	if (unlikely(PageTransHuge(page)))
 		refcount = 1 + HPAGE_PMD_NR;
 	else
 		refcount = 2;
@@ -955,8 +978,12 @@ static int __remove_mapping(struct address_space *mapping, struct page *page,
 		 * covering holes, and because we don't want to mix DAX
 		 * exceptional entries and shadow exceptional entries in the
 		 * same address_space.
+		 *
+		 * Huge pages of regular files cover many indices and have
+		 * no single shadow slot to leave behind.
 		 */
 		if (reclaimed && page_is_file_cache(page) &&
+		    !PageTransHuge(page) &&
 		    !mapping_exiting(mapping) && !dax_mapping(mapping))
 			shadow = workingset_eviction(mapping, page);
 		__delete_from_page_cache(page, shadow);
@@ -1100,6 +1127,103 @@ static void page_check_dirty_writeback(struct page *page,
 		mapping->a_ops->is_dirty_writeback(page, dirty, writeback);
 }
 
+/*
+ * Can reclaim on @nid migrate pages to slow memory rather than free them?
+ * Not for cgroup reclaim: the pages would stay charged to the cgroup.
+ */
+static bool can_demote(int nid, struct scan_control *sc)
+{
+	if (!numa_demotion_enabled || sc->no_demotion)
+		return false;
+	if (!global_reclaim(sc))
+		return false;
+
+	return next_demotion_node(nid) != NUMA_NO_NODE;
+}
+
+struct demote_control {
+	int nid;
+	unsigned int nr_demoted;
+};
+
+static struct page *alloc_demote_page(struct page *page, unsigned long data)
+{
+	struct demote_control *dc = (struct demote_control *)data;
+	struct page *newpage;
+
+	/*
+	 * Never reclaim on the slow node for this: kswapd is woken there,
+	 * and a failed demotion falls back to the usual reclaim.
+	 */
+	if (PageTransHuge(page)) {
+		newpage = alloc_pages_node(dc->nid, GFP_TRANSHUGE_LIGHT |
+					   __GFP_THISNODE | __GFP_NOWARN,
+					   HPAGE_PMD_ORDER);
+		if (newpage)
+			prep_transhuge_page(newpage);
+	} else {
+		newpage = alloc_pages_node(dc->nid,
+					   (GFP_HIGHUSER_MOVABLE & ~__GFP_RECLAIM) |
+					   __GFP_KSWAPD_RECLAIM | __GFP_THISNODE |
+					   __GFP_NOMEMALLOC | __GFP_NOWARN, 0);
+	}
+
+	if (newpage)
+		dc->nr_demoted += hpage_nr_pages(newpage);
+	return newpage;
+}
+
+static void free_demote_page(struct page *page, unsigned long data)
+{
+	struct demote_control *dc = (struct demote_control *)data;
+
+	dc->nr_demoted -= hpage_nr_pages(page);
+	put_page(page);
+}
+
+/*
+ * Migrate the isolated pages on @demote_pages to the slow memory node of
+ * @pgdat, and return how many were moved. The pages that could not be
+ * moved are either left on the list or put back on the LRU.
+ */
+static unsigned int demote_page_list(struct list_head *demote_pages,
+				     struct pglist_data *pgdat)
+{
+	struct demote_control dc = {
+		.nid = next_demotion_node(pgdat->node_id),
+	};
+	unsigned long nr_isolated[2] = { 0, };
+	struct page *page;
+
+	if (list_empty(demote_pages) || dc.nid == NUMA_NO_NODE)
+		return 0;
+
+	/*
+	 * migrate_pages() drops NR_ISOLATED_* for the pages it is done with,
+	 * while our caller drops it for all the pages it isolated: account
+	 * the pages a second time for the duration of the migration.
+	 */
+	list_for_each_entry(page, demote_pages, lru)
+		nr_isolated[page_is_file_cache(page)] += hpage_nr_pages(page);
+	mod_node_page_state(pgdat, NR_ISOLATED_ANON, nr_isolated[0]);
+	mod_node_page_state(pgdat, NR_ISOLATED_FILE, nr_isolated[1]);
+
+	migrate_pages(demote_pages, alloc_demote_page, free_demote_page,
+		      (unsigned long)&dc, MIGRATE_ASYNC, MR_DEMOTION);
+
+	list_for_each_entry(page, demote_pages, lru)
+		mod_node_page_state(pgdat, NR_ISOLATED_ANON +
+				    page_is_file_cache(page),
+				    -hpage_nr_pages(page));
+
+	if (current_is_kswapd())
+		count_vm_events(PGDEMOTE_KSWAPD, dc.nr_demoted);
+	else
+		count_vm_events(PGDEMOTE_DIRECT, dc.nr_demoted);
+
+	return dc.nr_demoted;
+}
+
 /*
  * shrink_page_list() returns the number of reclaimed pages
  */
@@ -1112,6 +1236,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 {
 	LIST_HEAD(ret_pages);
 	LIST_HEAD(free_pages);
+	LIST_HEAD(demote_pages);
 	int pgactivate = 0;
 	unsigned nr_unqueued_dirty = 0;
 	unsigned nr_dirty = 0;
@@ -1121,9 +1246,13 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 	unsigned nr_immediate = 0;
 	unsigned nr_ref_keep = 0;
 	unsigned nr_unmap_fail = 0;
+	bool do_demote_pass;
 
 	cond_resched();
 
+	do_demote_pass = can_demote(pgdat->node_id, sc);
+
+retry:
 	while (!list_empty(page_list)) {
 		struct address_space *mapping;
 		struct page *page;
@@ -1274,6 +1403,16 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			; /* try to reclaim the page below */
 		}
 
+		/*
+		 * Before reclaiming the page, try to move it to slower
+		 * memory: that is cheaper than refaulting it from storage.
+		 */
+		if (do_demote_pass) {
+			list_add(&page->lru, &demote_pages);
+			unlock_page(page);
+			continue;
+		}
+
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
@@ -1316,8 +1455,12 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 				/* Adding to swap updated mapping */
 				mapping = page_mapping(page);
 			}
-		} else if (unlikely(PageTransHuge(page))) {
-			/* Split file THP */
+		} else if (unlikely(PageTransHuge(page)) &&
+			   PageSwapBacked(page)) {
+			/*
+			 * Split shmem THP. Huge pages of regular files are
+			 * clean and get reclaimed whole.
+			 */
 			if (split_huge_page_to_list(page, page_list))
 				goto keep_locked;
 		}
@@ -1496,6 +1639,14 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		VM_BUG_ON_PAGE(PageLRU(page) || PageUnevictable(page), page);
 	}
 
+	nr_reclaimed += demote_page_list(&demote_pages, pgdat);
+	/* Reclaim the pages that could not be demoted the usual way */
+	if (!list_empty(&demote_pages)) {
+		list_splice_init(&demote_pages, page_list);
+		do_demote_pass = false;
+		goto retry;
+	}
+
 	mem_cgroup_uncharge_list(&free_pages);
 	try_to_unmap_flush();
 	free_unref_page_list(&free_pages);
@@ -1523,6 +1674,7 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 		.gfp_mask = GFP_KERNEL,
 		.priority = DEF_PRIORITY,
 		.may_unmap = 1,
+		.no_demotion = 1,
 	};
 	unsigned long ret;
 	struct page *page, *next;
@@ -1543,6 +1695,65 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 	return ret;
 }
 
+/*
+ * Reclaim a list of isolated pages right away, for MADV_PAGEOUT. The pages
+ * may come from several nodes; they are reclaimed node by node and whatever
+ * could not be reclaimed is put back on the LRU.
+ */
+unsigned long reclaim_pages(struct list_head *page_list)
+{
+	int nid = -1;
+	unsigned long nr_reclaimed = 0;
+	LIST_HEAD(node_page_list);
+	struct page *page;
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.priority = DEF_PRIORITY,
+		.may_writepage = 1,
+		.may_unmap = 1,
+		.may_swap = 1,
+		.no_demotion = 1,
+	};
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		if (nid == -1) {
+			nid = page_to_nid(page);
+			INIT_LIST_HEAD(&node_page_list);
+		}
+
+		if (nid == page_to_nid(page)) {
+			ClearPageActive(page);
+			list_move(&page->lru, &node_page_list);
+			continue;
+		}
+
+		nr_reclaimed += shrink_page_list(&node_page_list,
+						NODE_DATA(nid), &sc, 0,
+						NULL, true);
+		while (!list_empty(&node_page_list)) {
+			page = lru_to_page(&node_page_list);
+			list_del(&page->lru);
+			putback_lru_page(page);
+		}
+
+		nid = -1;
+	}
+
+	if (!list_empty(&node_page_list)) {
+		nr_reclaimed += shrink_page_list(&node_page_list,
+						NODE_DATA(nid), &sc, 0,
+						NULL, true);
+		while (!list_empty(&node_page_list)) {
+			page = lru_to_page(&node_page_list);
+			list_del(&page->lru);
+			putback_lru_page(page);
+		}
+	}
+
+	return nr_reclaimed;
+}
+
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
@@ -1643,7 +1854,7 @@ static __always_inline void update_lru_sizes(struct lruvec *lruvec,
 }
 
 /*
- * zone_lru_lock is heavily contended.  Some of the functions that
+ * lru_lock is heavily contended.  Some of the functions that
  * shrink the lists perform better by taking out a batch of pages
  * and working on them outside the LRU lock.
  *
@@ -1743,6 +1954,132 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 	return nr_taken;
 }
 
+#ifdef CONFIG_LRU_GEN
+static inline unsigned long lru_gen_nr_gens(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	return READ_ONCE(lrugen->max_seq) - READ_ONCE(lrugen->min_seq[type]) + 1;
+}
+
+/*
+ * Move @page on to the next generation, to the head of its list to skip
+ * it for now or to the tail when folding the oldest generation into the
+ * next one. Called with the lru_lock held.
+ */
+static void lru_gen_inc_page_gen(struct lruvec *lruvec, struct page *page,
+				 bool tail)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	int old_gen = page_lru_gen(page);
+	int new_gen = (old_gen + 1) % MAX_NR_GENS;
+
+	set_mask_bits(&page->flags, LRU_GEN_MASK,
+		      (new_gen + 1UL) << LRU_GEN_PGOFF);
+	lru_gen_update_size(lruvec, page, old_gen, new_gen);
+	if (tail)
+		list_move_tail(&page->lru, &lrugen->lists[new_gen][type]);
+	else
+		list_move(&page->lru, &lrugen->lists[new_gen][type]);
+}
+
+/*
+ * Retire the oldest generations of @type that have run out of pages, the
+ * active ones excepted. Called with the lru_lock held.
+ */
+static void lru_gen_try_inc_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	while (lru_gen_nr_gens(lruvec, type) > MIN_NR_GENS) {
+		int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+		if (!list_empty(&lrugen->lists[gen][type]))
+			break;
+		WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+	}
+}
+
+/*
+ * isolate_lru_pages() for a lruvec on the multi-gen LRU: the pages are taken
+ * from the oldest generation of @type, provided it is not an active one.
+ * Pages from zones above sc->reclaim_idx are moved to the next generation
+ * rather than back to the head of the list, which would have them scanned
+ * again as soon as the rest of the generation is gone.
+ */
+static unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+		struct lruvec *lruvec, struct list_head *dst,
+		unsigned long *nr_scanned, struct scan_control *sc,
+		isolate_mode_t mode, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	unsigned long nr_taken = 0;
+	unsigned long skipped = 0;
+	unsigned long scan = 0, total_scan = 0;
+	struct list_head *src;
+
+	*nr_scanned = 0;
+	lru_gen_try_inc_min_seq(lruvec, type);
+	if (lru_gen_nr_gens(lruvec, type) <= MIN_NR_GENS)
+		return 0;
+
+	src = &lrugen->lists[lru_gen_from_seq(lrugen->min_seq[type])][type];
+
+	for (; scan < nr_to_scan && nr_taken < nr_to_scan && !list_empty(src);
+	     total_scan++) {
+		struct page *page = lru_to_page(src);
+		int nr_pages = hpage_nr_pages(page);
+
+		prefetchw_prev_lru_page(page, src, flags);
+
+		VM_BUG_ON_PAGE(!PageLRU(page), page);
+
+		if (page_zonenum(page) > sc->reclaim_idx) {
+			__count_zid_vm_events(PGSCAN_SKIP, page_zonenum(page),
+					      nr_pages);
+			lru_gen_inc_page_gen(lruvec, page, false);
+			skipped += nr_pages;
+			continue;
+		}
+
+		scan++;
+		switch (__isolate_lru_page(page, mode)) {
+		case 0:
+			nr_taken += nr_pages;
+			lru_gen_del_page(lruvec, page, true);
+			list_add(&page->lru, dst);
+			break;
+
+		case -EBUSY:
+			/* else it is being freed elsewhere */
+			list_move(&page->lru, src);
+			continue;
+
+		default:
+			BUG();
+		}
+	}
+
+	lru_gen_try_inc_min_seq(lruvec, type);
+
+	*nr_scanned = total_scan;
+	trace_mm_vmscan_lru_isolate(sc->reclaim_idx, sc->order, nr_to_scan,
+				    total_scan, skipped, nr_taken, mode,
+				    type * LRU_FILE);
+	return nr_taken;
+}
+#else
+static inline unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+		struct lruvec *lruvec, struct list_head *dst,
+		unsigned long *nr_scanned, struct scan_control *sc,
+		isolate_mode_t mode, int type)
+{
+	*nr_scanned = 0;
+	return 0;
+}
+#endif /* CONFIG_LRU_GEN */
+
 /**
  * isolate_lru_page - tries to isolate a page from its LRU list
  * @page: page to isolate from its LRU list
@@ -1777,11 +2114,9 @@ int isolate_lru_page(struct page *page)
 	WARN_RATELIMIT(PageTail(page), "trying to isolate tail page");
 
 	if (PageLRU(page)) {
-		struct zone *zone = page_zone(page);
 		struct lruvec *lruvec;
 
-		spin_lock_irq(zone_lru_lock(zone));
-		lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
+		lruvec = lock_page_lruvec_irq(page);
 		if (PageLRU(page)) {
 			int lru = page_lru(page);
 			get_page(page);
@@ -1789,7 +2124,7 @@ int isolate_lru_page(struct page *page)
 			del_page_from_lru_list(page, lruvec, lru);
 			ret = 0;
 		}
-		spin_unlock_irq(zone_lru_lock(zone));
+		unlock_page_lruvec_irq(lruvec);
 	}
 	return ret;
 }
@@ -1831,11 +2166,16 @@ static int too_many_isolated(struct pglist_data *pgdat, int file,
 	return isolated > inactive;
 }
 
+/*
+ * Called and returns with the lru_lock of @lruvec held.  Isolated pages may
+ * have been charged to another memcg in the meantime, the lock of the
+ * lruvec they go back to is taken for them.
+ */
 static noinline_for_stack void
 putback_inactive_pages(struct lruvec *lruvec, struct list_head *page_list)
 {
 	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
-	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	struct lruvec *locked = lruvec;
 	LIST_HEAD(pages_to_free);
 
 	/*
@@ -1848,17 +2188,18 @@ putback_inactive_pages(struct lruvec *lruvec, struct list_head *page_list)
 		VM_BUG_ON_PAGE(PageLRU(page), page);
 		list_del(&page->lru);
 		if (unlikely(!page_evictable(page))) {
-			spin_unlock_irq(&pgdat->lru_lock);
+			unlock_page_lruvec_irq(locked);
 			putback_lru_page(page);
-			spin_lock_irq(&pgdat->lru_lock);
+			locked = lruvec;
+			spin_lock_irq(&locked->lru_lock);
 			continue;
 		}
 
-		lruvec = mem_cgroup_page_lruvec(page, pgdat);
+		locked = relock_page_lruvec_irq(page, locked);
 
 		SetPageLRU(page);
 		lru = page_lru(page);
-		add_page_to_lru_list(page, lruvec, lru);
+		add_page_to_lru_list(page, locked, lru);
 
 		if (is_active_lru(lru)) {
 			int file = is_file_lru(lru);
@@ -1868,18 +2209,24 @@ putback_inactive_pages(struct lruvec *lruvec, struct list_head *page_list)
 		if (put_page_testzero(page)) {
 			__ClearPageLRU(page);
 			__ClearPageActive(page);
-			del_page_from_lru_list(page, lruvec, lru);
+			del_page_from_lru_list(page, locked, lru);
 
 			if (unlikely(PageCompound(page))) {
-				spin_unlock_irq(&pgdat->lru_lock);
+				unlock_page_lruvec_irq(locked);
 				mem_cgroup_uncharge(page);
 				(*get_compound_page_dtor(page))(page);
-				spin_lock_irq(&pgdat->lru_lock);
+				locked = lruvec;
+				spin_lock_irq(&locked->lru_lock);
 			} else
 				list_add(&page->lru, &pages_to_free);
 		}
 	}
 
+	if (locked != lruvec) {
+		unlock_page_lruvec_irq(locked);
+		spin_lock_irq(&lruvec->lru_lock);
+	}
+
 	/*
 	 * To save our caller's stack, now use input list for pages to free.
 	 */
@@ -1936,10 +2283,15 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 	if (!sc->may_unmap)
 		isolate_mode |= ISOLATE_UNMAPPED;
 
-	spin_lock_irq(&pgdat->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 
-	nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &page_list,
-				     &nr_scanned, sc, isolate_mode, lru);
+	if (lru_gen_lruvec(lruvec))
+		nr_taken = lru_gen_isolate_pages(nr_to_scan, lruvec, &page_list,
+						 &nr_scanned, sc, isolate_mode,
+						 file);
+	else
+		nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &page_list,
+					     &nr_scanned, sc, isolate_mode, lru);
 
 	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + file, nr_taken);
 	reclaim_stat->recent_scanned[file] += nr_taken;
@@ -1955,7 +2307,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 		count_memcg_events(lruvec_memcg(lruvec), PGSCAN_DIRECT,
 				   nr_scanned);
 	}
-	spin_unlock_irq(&pgdat->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 
 	if (nr_taken == 0)
 		return 0;
@@ -1963,7 +2315,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 	nr_reclaimed = shrink_page_list(&page_list, pgdat, sc, 0,
 				&stat, false);
 
-	spin_lock_irq(&pgdat->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 
 	if (current_is_kswapd()) {
 		if (global_reclaim(sc))
@@ -1981,7 +2333,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 
 	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + file, -nr_taken);
 
-	spin_unlock_irq(&pgdat->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 
 	mem_cgroup_uncharge_list(&page_list);
 	free_unref_page_list(&page_list);
@@ -2021,9 +2373,9 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
  * processes, from rmap.
  *
  * If the pages are mostly unmapped, the processing is fast and it is
- * appropriate to hold zone_lru_lock across the whole operation.  But if
+ * appropriate to hold lru_lock across the whole operation.  But if
  * the pages are mapped, the processing is slow (page_referenced()) so we
- * should drop zone_lru_lock around each page.  It's impossible to balance
+ * should drop lru_lock around each page.  It's impossible to balance
  * this, so instead we remove the pages from the LRU while processing them.
  * It is safe to rely on PG_active against the non-LRU pages in here because
  * nobody will play with that bit on a non-LRU page.
@@ -2031,7 +2383,8 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
  * The downside is that we have to touch page->_refcount against each page.
  * But we had to alter page->flags anyway.
  *
- * Returns the number of pages moved to the given lru.
+ * Returns the number of pages moved to the given lru.  Called and returns
+ * with the lru_lock of @lruvec held, see putback_inactive_pages().
  */
 
 static unsigned move_active_pages_to_lru(struct lruvec *lruvec,
@@ -2039,32 +2392,33 @@ static unsigned move_active_pages_to_lru(struct lruvec *lruvec,
 				     struct list_head *pages_to_free,
 				     enum lru_list lru)
 {
-	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	struct lruvec *locked = lruvec;
 	struct page *page;
 	int nr_pages;
 	int nr_moved = 0;
 
 	while (!list_empty(list)) {
 		page = lru_to_page(list);
-		lruvec = mem_cgroup_page_lruvec(page, pgdat);
+		locked = relock_page_lruvec_irq(page, locked);
 
 		VM_BUG_ON_PAGE(PageLRU(page), page);
 		SetPageLRU(page);
 
 		nr_pages = hpage_nr_pages(page);
-		update_lru_size(lruvec, lru, page_zonenum(page), nr_pages);
-		list_move(&page->lru, &lruvec->lists[lru]);
+		list_del(&page->lru);
+		add_page_to_lru_list(page, locked, lru);
 
 		if (put_page_testzero(page)) {
 			__ClearPageLRU(page);
 			__ClearPageActive(page);
-			del_page_from_lru_list(page, lruvec, lru);
+			del_page_from_lru_list(page, locked, lru);
 
 			if (unlikely(PageCompound(page))) {
-				spin_unlock_irq(&pgdat->lru_lock);
+				unlock_page_lruvec_irq(locked);
 				mem_cgroup_uncharge(page);
 				(*get_compound_page_dtor(page))(page);
-				spin_lock_irq(&pgdat->lru_lock);
+				locked = lruvec;
+				spin_lock_irq(&locked->lru_lock);
 			} else
 				list_add(&page->lru, pages_to_free);
 		} else {
@@ -2072,6 +2426,11 @@ static unsigned move_active_pages_to_lru(struct lruvec *lruvec,
 		}
 	}
 
+	if (locked != lruvec) {
+		unlock_page_lruvec_irq(locked);
+		spin_lock_irq(&lruvec->lru_lock);
+	}
+
 	if (!is_active_lru(lru)) {
 		__count_vm_events(PGDEACTIVATE, nr_moved);
 		count_memcg_events(lruvec_memcg(lruvec), PGDEACTIVATE,
@@ -2105,7 +2464,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	if (!sc->may_unmap)
 		isolate_mode |= ISOLATE_UNMAPPED;
 
-	spin_lock_irq(&pgdat->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 
 	nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &l_hold,
 				     &nr_scanned, sc, isolate_mode, lru);
@@ -2116,7 +2475,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	__count_vm_events(PGREFILL, nr_scanned);
 	count_memcg_events(lruvec_memcg(lruvec), PGREFILL, nr_scanned);
 
-	spin_unlock_irq(&pgdat->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 
 	while (!list_empty(&l_hold)) {
 		cond_resched();
@@ -2162,7 +2521,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	/*
 	 * Move pages back to the lru list.
 	 */
-	spin_lock_irq(&pgdat->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 	/*
 	 * Count referenced pages from currently used mappings as rotated,
 	 * even though only some of them are actually re-activated.  This
@@ -2174,7 +2533,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	nr_activate = move_active_pages_to_lru(lruvec, &l_active, &l_hold, lru);
 	nr_deactivate = move_active_pages_to_lru(lruvec, &l_inactive, &l_hold, lru - LRU_ACTIVE);
 	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + file, -nr_taken);
-	spin_unlock_irq(&pgdat->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 
 	mem_cgroup_uncharge_list(&l_hold);
 	free_unref_page_list(&l_hold);
@@ -2261,10 +2620,637 @@ static bool inactive_list_is_low(struct lruvec *lruvec, bool file,
 	return inactive * inactive_ratio < active;
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generational LRU aging.
+ *
+ * Instead of asking the rmap for every isolated page whether it has been
+ * accessed, the page tables of the processes charged to a lruvec are walked
+ * in one go before a new generation is opened. Young ptes are cleared and
+ * their pages moved to the youngest generation; pages that were not seen
+ * young drift towards the oldest one, from which they are evicted. Walks
+ * are rate limited and skip busy mms, so shrink_page_list() still consults
+ * page_referenced() for every mapped page before giving it up.
+ */
+
+/* Pages moved per lru_lock hold when a lruvec changes over its lists */
+#define LRU_GEN_BATCH		SWAP_CLUSTER_MAX
+
+static DEFINE_MUTEX(lru_gen_state_mutex);
+
+static struct lru_gen_mm_list lru_gen_mm_list = {
+	.fifo = LIST_HEAD_INIT(lru_gen_mm_list.fifo),
+	.lock = __SPIN_LOCK_UNLOCKED(lru_gen_mm_list.lock),
+};
+
+static struct lru_gen_mm_list *lru_gen_get_mm_list(struct mem_cgroup *memcg)
+{
+#ifdef CONFIG_MEMCG
+	if (memcg)
+		return &memcg->mm_list;
+#endif
+	return &lru_gen_mm_list;
+}
+
+void lru_gen_init_mm(struct mm_struct *mm)
+{
+	INIT_LIST_HEAD(&mm->lru_gen.list);
+#ifdef CONFIG_MEMCG
+	mm->lru_gen.memcg = NULL;
+#endif
+}
+
+/* Put @mm on the mm list of the memcg of its owner */
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	struct mem_cgroup *memcg = get_mem_cgroup_from_mm(mm);
+	struct lru_gen_mm_list *mm_list = lru_gen_get_mm_list(memcg);
+
+	VM_BUG_ON_MM(!list_empty(&mm->lru_gen.list), mm);
+#ifdef CONFIG_MEMCG
+	VM_BUG_ON_MM(mm->lru_gen.memcg, mm);
+	mm->lru_gen.memcg = memcg;
+#endif
+	spin_lock(&mm_list->lock);
+	list_add_tail(&mm->lru_gen.list, &mm_list->fifo);
+	spin_unlock(&mm_list->lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	struct lru_gen_mm_list *mm_list;
+	struct mem_cgroup *memcg = NULL;
+	int nid;
+
+	if (list_empty(&mm->lru_gen.list))
+		return;
+
+#ifdef CONFIG_MEMCG
+	memcg = mm->lru_gen.memcg;
+#endif
+	mm_list = lru_gen_get_mm_list(memcg);
+
+	spin_lock(&mm_list->lock);
+	/* Walks in progress carry on with the next mm */
+	for_each_node(nid) {
+		struct lruvec *lruvec;
+
+		if (!NODE_DATA(nid))
+			continue;
+
+		lruvec = mem_cgroup_lruvec(NODE_DATA(nid), memcg);
+		if (lruvec->lrugen.mm_iter == &mm->lru_gen.list)
+			lruvec->lrugen.mm_iter = mm->lru_gen.list.next;
+	}
+	list_del_init(&mm->lru_gen.list);
+	spin_unlock(&mm_list->lock);
+
+#ifdef CONFIG_MEMCG
+	mem_cgroup_put(mm->lru_gen.memcg);
+	mm->lru_gen.memcg = NULL;
+#endif
+}
+
+#ifdef CONFIG_MEMCG
+/*
+ * Move @mm to the mm list of its owner's memcg after the owner changed or
+ * was moved to another memcg. Called with the task_lock of the owner held.
+ */
+void lru_gen_migrate_mm(struct mm_struct *mm)
+{
+	struct mem_cgroup *memcg;
+
+	/* Not on a list yet, lru_gen_add_mm() will pick the right one */
+	if (mem_cgroup_disabled() || list_empty(&mm->lru_gen.list))
+		return;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_task(rcu_dereference(mm->owner));
+	rcu_read_unlock();
+	if (memcg == mm->lru_gen.memcg)
+		return;
+
+	lru_gen_del_mm(mm);
+	lru_gen_add_mm(mm);
+}
+#endif
+
+/* Return the next mm of the walk of @lruvec with a reference held */
+static struct mm_struct *lru_gen_next_mm(struct lruvec *lruvec,
+					 struct lru_gen_mm_list *mm_list)
+{
+	struct mm_struct *mm = NULL;
+	struct list_head *pos;
+
+	spin_lock(&mm_list->lock);
+	pos = lruvec->lrugen.mm_iter;
+	while (pos != &mm_list->fifo) {
+		struct mm_struct *next;
+
+		next = list_entry(pos, struct mm_struct, lru_gen.list);
+		pos = pos->next;
+		/* Skip the mms on their way out, see __mmput() */
+		if (mmget_not_zero(next)) {
+			mm = next;
+			break;
+		}
+	}
+	lruvec->lrugen.mm_iter = pos;
+	spin_unlock(&mm_list->lock);
+
+	return mm;
+}
+
+struct lru_gen_walk {
+	int nid;
+	unsigned long nr_scanned;
+	unsigned long nr_young;
+};
+
+static void lru_gen_mark_young(struct page *page, struct lru_gen_walk *args)
+{
+	args->nr_young += hpage_nr_pages(page);
+	SetPageWorkingset(page);
+	/* Moves the page to the youngest generation */
+	activate_page(page);
+}
+
+static int lru_gen_pmd_entry(pmd_t *pmd, unsigned long addr,
+			     unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_walk *args = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	pte_t *orig_pte, *pte;
+	struct page *page;
+	spinlock_t *ptl;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		pmd_t pmdval = *pmd;
+
+		if (!pmd_present(pmdval) || is_huge_zero_pmd(pmdval))
+			goto unlock_pmd;
+
+		args->nr_scanned += HPAGE_PMD_NR;
+		if (!pmd_young(pmdval))
+			goto unlock_pmd;
+
+		page = pmd_page(pmdval);
+		if (page_to_nid(page) == args->nid &&
+		    pmdp_clear_young_notify(vma, addr, pmd))
+			lru_gen_mark_young(page, args);
+unlock_pmd:
+		spin_unlock(ptl);
+		return 0;
+	}
+#endif
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		pte_t ptent = *pte;
+
+		if (!pte_present(ptent))
+			continue;
+
+		args->nr_scanned++;
+		if (!pte_young(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page || page_to_nid(page) != args->nid)
+			continue;
+
+		if (ptep_clear_young_notify(vma, addr, pte))
+			lru_gen_mark_young(page, args);
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+
+	return 0;
+}
+
+static int lru_gen_test_walk(unsigned long start, unsigned long end,
+			     struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->vma;
+
+	/* Unevictable and special mappings have nothing to age */
+	if (vma->vm_flags & (VM_LOCKED | VM_PFNMAP | VM_IO | VM_MIXEDMAP))
+		return 1;
+
+	/*
+	 * page_referenced() ignores the accessed bit of streaming mappings,
+	 * leave it for the rmap to clear.
+	 */
+	if (vma->vm_flags & VM_SEQ_READ)
+		return 1;
+
+	return 0;
+}
+
+/* Walk the page tables of all the mms charged to the memcg of @lruvec */
+static void lru_gen_walk_mms(struct lruvec *lruvec, struct mem_cgroup *memcg)
+{
+	struct lru_gen_mm_list *mm_list = lru_gen_get_mm_list(memcg);
+	struct lru_gen_walk args = {
+		.nid = lruvec_pgdat(lruvec)->node_id,
+	};
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_pmd_entry,
+		.test_walk = lru_gen_test_walk,
+		.private = &args,
+	};
+	struct mm_struct *mm;
+
+	spin_lock(&mm_list->lock);
+	lruvec->lrugen.mm_iter = mm_list->fifo.next;
+	spin_unlock(&mm_list->lock);
+
+	while ((mm = lru_gen_next_mm(lruvec, mm_list))) {
+		if (down_read_trylock(&mm->mmap_sem)) {
+			walk.mm = mm;
+			walk_page_range(FIRST_USER_ADDRESS, mm->highest_vm_end,
+					&walk);
+			up_read(&mm->mmap_sem);
+			count_vm_event(LRU_GEN_WALK_MM);
+		}
+		mmput_async(mm);
+
+		if (fatal_signal_pending(current))
+			break;
+		cond_resched();
+	}
+
+	spin_lock(&mm_list->lock);
+	lruvec->lrugen.mm_iter = NULL;
+	spin_unlock(&mm_list->lock);
+
+	/* Put the pages found young on their lists before the new generation */
+	lru_add_drain();
+
+	count_vm_events(LRU_GEN_PTE_SCANNED, args.nr_scanned);
+	count_vm_events(LRU_GEN_PTE_YOUNG, args.nr_young);
+}
+
+/*
+ * Make room for a new generation of @type by moving the pages of the oldest
+ * one behind those of the next one. Called with the lru_lock held, which is
+ * dropped between batches.
+ */
+static void lru_gen_fold_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	while (lru_gen_nr_gens(lruvec, type) >= MAX_NR_GENS) {
+		int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+		struct list_head *list = &lrugen->lists[gen][type];
+		int nr = 0;
+
+		while (!list_empty(list) && nr++ < LRU_GEN_BATCH)
+			lru_gen_inc_page_gen(lruvec, lru_to_page(list), true);
+
+		if (list_empty(list)) {
+			WRITE_ONCE(lrugen->min_seq[type],
+				   lrugen->min_seq[type] + 1);
+			continue;
+		}
+
+		spin_unlock_irq(&lruvec->lru_lock);
+		cond_resched();
+		spin_lock_irq(&lruvec->lru_lock);
+	}
+}
+
+/*
+ * Open a new generation. The second youngest one becomes inactive and its
+ * pages are accounted as such.
+ */
+static void lru_gen_inc_max_seq(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type, zid, gen;
+
+	spin_lock_irq(&lruvec->lru_lock);
+
+	for (type = 0; type < ANON_AND_FILE; type++)
+		lru_gen_fold_min_seq(lruvec, type);
+
+	gen = lru_gen_from_seq(lrugen->max_seq - 1);
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		enum lru_list lru = type * LRU_FILE;
+
+		for (zid = 0; zid < MAX_NR_ZONES; zid++) {
+			long delta = lrugen->nr_pages[gen][type][zid];
+
+			if (!delta)
+				continue;
+
+			update_lru_size(lruvec, lru + LRU_ACTIVE, zid, -delta);
+			update_lru_size(lruvec, lru, zid, delta);
+		}
+	}
+	WRITE_ONCE(lrugen->max_seq, lrugen->max_seq + 1);
+
+	spin_unlock_irq(&lruvec->lru_lock);
+}
+
+static bool lru_gen_should_age(struct lruvec *lruvec, struct mem_cgroup *memcg,
+			       struct scan_control *sc)
+{
+	if (lru_gen_nr_gens(lruvec, 1) <= MIN_NR_GENS)
+		return true;
+
+	/* Nothing to evict from the anon generations without swap */
+	return sc->may_swap && mem_cgroup_get_nr_swap_pages(memcg) > 0 &&
+	       lru_gen_nr_gens(lruvec, 0) <= MIN_NR_GENS;
+}
+
+/*
+ * Open a new generation of @lruvec once eviction has caught up with the
+ * active ones, after walking the page tables if the last walk is older than
+ * lru_gen_aging_interval_ms.
+ */
+static void lru_gen_age_lruvec(struct lruvec *lruvec, struct mem_cgroup *memcg,
+			       struct scan_control *sc)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	unsigned long max_seq = READ_ONCE(lrugen->max_seq);
+
+	if (!lru_gen_should_age(lruvec, memcg, sc))
+		return;
+
+	mutex_lock(&lrugen->aging_mutex);
+
+	/* Somebody else did it while we were waiting */
+	if (lrugen->max_seq != max_seq || !lru_gen_lruvec(lruvec))
+		goto unlock;
+
+	if (time_after_eq(jiffies, lrugen->walk_timestamp +
+			  msecs_to_jiffies(lru_gen_aging_interval_ms))) {
+		lru_gen_walk_mms(lruvec, memcg);
+		lrugen->walk_timestamp = jiffies;
+	}
+
+	lru_gen_inc_max_seq(lruvec);
+unlock:
+	mutex_unlock(&lrugen->aging_mutex);
+}
+
+/* Move a batch of pages from the classic lists to the generation lists */
+static bool lru_gen_fill(struct lruvec *lruvec)
+{
+	int nr = 0;
+	enum lru_list lru;
+
+	for_each_evictable_lru(lru) {
+		struct list_head *list = &lruvec->lists[lru];
+
+		while (!list_empty(list)) {
+			struct page *page = lru_to_page(list);
+
+			if (nr++ == LRU_GEN_BATCH)
+				return false;
+
+			del_page_from_lru_list(page, lruvec, lru);
+			add_page_to_lru_list(page, lruvec, lru);
+		}
+	}
+
+	return true;
+}
+
+/* Move a batch of pages from the generation lists to the classic lists */
+static bool lru_gen_drain(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int nr = 0;
+	int type;
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		unsigned long seq;
+
+		for (seq = lrugen->min_seq[type]; seq <= lrugen->max_seq;
+		     seq++) {
+			struct list_head *list;
+
+			list = &lrugen->lists[lru_gen_from_seq(seq)][type];
+			while (!list_empty(list)) {
+				struct page *page = lru_to_page(list);
+
+				if (nr++ == LRU_GEN_BATCH)
+					return false;
+
+				lru_gen_del_page(lruvec, page, false);
+				add_page_to_lru_list(page, lruvec,
+						     page_lru(page));
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Move the pages of @lruvec over to the lists selected by lru_gen_key, in
+ * batches so that reclaim keeps going meanwhile. The pages are added in
+ * the order they were on the old lists, the youngest last.
+ */
+static void lru_gen_change_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	bool done = false;
+
+	mutex_lock(&lrugen->aging_mutex);
+	while (!done) {
+		spin_lock_irq(&lruvec->lru_lock);
+		WRITE_ONCE(lrugen->enabled, lru_gen_enabled());
+		if (lrugen->enabled)
+			done = lru_gen_fill(lruvec);
+		else
+			done = lru_gen_drain(lruvec);
+		spin_unlock_irq(&lruvec->lru_lock);
+		cond_resched();
+	}
+	mutex_unlock(&lrugen->aging_mutex);
+}
+
+static void lru_gen_set_enabled(bool enable)
+{
+	struct mem_cgroup *memcg;
+
+	mutex_lock(&lru_gen_state_mutex);
+
+	if (enable)
+		static_branch_enable(&lru_gen_key);
+	else
+		static_branch_disable(&lru_gen_key);
+
+	/* Lruvecs created or onlined meanwhile follow in shrink_node_memcg() */
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		struct pglist_data *pgdat;
+
+		for_each_online_pgdat(pgdat)
+			lru_gen_change_lruvec(mem_cgroup_lruvec(pgdat, memcg));
+
+		memcg = mem_cgroup_iter(NULL, memcg, NULL);
+	} while (memcg);
+
+	mutex_unlock(&lru_gen_state_mutex);
+}
+
+void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen, type;
+
+	/* Start with two inactive generations next to the active ones */
+	lrugen->max_seq = MAX_NR_GENS - 1;
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		lrugen->min_seq[type] = 0;
+		for (gen = 0; gen < MAX_NR_GENS; gen++)
+			INIT_LIST_HEAD(&lrugen->lists[gen][type]);
+	}
+	memset(lrugen->nr_pages, 0, sizeof(lrugen->nr_pages));
+	lrugen->enabled = lru_gen_enabled();
+	mutex_init(&lrugen->aging_mutex);
+	lrugen->walk_timestamp = jiffies;
+	lrugen->mm_iter = NULL;
+}
+
+static unsigned long lru_gen_shrink_list(enum lru_list lru,
+		unsigned long nr_to_scan, struct lruvec *lruvec,
+		struct mem_cgroup *memcg, struct scan_control *sc)
+{
+	/* The active generations are only ever aged, never scanned */
+	if (is_active_lru(lru))
+		return 0;
+
+	lru_gen_age_lruvec(lruvec, memcg, sc);
+
+	return shrink_inactive_list(nr_to_scan, lruvec, sc, lru);
+}
+
+/* -1 keeps the default from CONFIG_LRU_GEN_ENABLED */
+static int lru_gen_boot_enabled __initdata = -1;
+
+static int __init setup_lru_gen(char *str)
+{
+	bool enable;
+
+	if (kstrtobool(str, &enable))
+		return 0;
+
+	lru_gen_boot_enabled = enable;
+	return 1;
+}
+__setup("lru_gen=", setup_lru_gen);
+
+#ifdef CONFIG_SYSFS
+static ssize_t lru_gen_enabled_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", lru_gen_enabled());
+}
+
+static ssize_t lru_gen_enabled_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	bool enable;
+
+	if (kstrtobool(buf, &enable))
+		return -EINVAL;
+
+	lru_gen_set_enabled(enable);
+	return count;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, lru_gen_enabled_show, lru_gen_enabled_store);
+
+static ssize_t aging_interval_ms_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", lru_gen_aging_interval_ms);
+}
+
+static ssize_t aging_interval_ms_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	unsigned int msecs;
+
+	if (kstrtouint(buf, 10, &msecs))
+		return -EINVAL;
+
+	lru_gen_aging_interval_ms = msecs;
+	return count;
+}
+
+static struct kobj_attribute aging_interval_ms_attr =
+	__ATTR(aging_interval_ms, 0644, aging_interval_ms_show,
+	       aging_interval_ms_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	&aging_interval_ms_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group lru_gen_attr_group = {
+	.name = "lru_gen",
+	.attrs = lru_gen_attrs,
+};
+
+#endif /* CONFIG_SYSFS */
+
+static int __init lru_gen_init(void)
+{
+	BUILD_BUG_ON(MIN_NR_GENS + 1 >= MAX_NR_GENS);
+	BUILD_BUG_ON(BIT(LRU_GEN_WIDTH) <= MAX_NR_GENS);
+
+	/* Static keys cannot be flipped yet when __setup() runs */
+	if (lru_gen_boot_enabled >= 0)
+		lru_gen_set_enabled(lru_gen_boot_enabled);
+
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		pr_err("lru_gen: failed to register sysfs group\n");
+#endif
+	return 0;
+}
+subsys_initcall(lru_gen_init);
+#else
+static inline void lru_gen_age_lruvec(struct lruvec *lruvec,
+				      struct mem_cgroup *memcg,
+				      struct scan_control *sc)
+{
+}
+
+static inline void lru_gen_change_lruvec(struct lruvec *lruvec)
+{
+}
+
+static inline unsigned long lru_gen_shrink_list(enum lru_list lru,
+		unsigned long nr_to_scan, struct lruvec *lruvec,
+		struct mem_cgroup *memcg, struct scan_control *sc)
+{
+	return 0;
+}
+#endif /* CONFIG_LRU_GEN */
+
 static unsigned long shrink_list(enum lru_list lru, unsigned long nr_to_scan,
 				 struct lruvec *lruvec, struct mem_cgroup *memcg,
 				 struct scan_control *sc)
 {
+	if (lru_gen_lruvec(lruvec))
+		return lru_gen_shrink_list(lru, nr_to_scan, lruvec, memcg, sc);
+
 	if (is_active_lru(lru)) {
 		if (inactive_list_is_low(lruvec, is_file_lru(lru),
 					 memcg, sc, true))
@@ -2295,7 +3281,8 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 			   struct scan_control *sc, unsigned long *nr,
 			   unsigned long *lru_pages)
 {
-	int swappiness = mem_cgroup_swappiness(memcg);
+	int swappiness = sc->proactive_swappiness ? *sc->proactive_swappiness :
+						    mem_cgroup_swappiness(memcg);
 	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
 	u64 fraction[2];
 	u64 denominator = 0;	/* gcc */
@@ -2306,12 +3293,21 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	unsigned long ap, fp;
 	enum lru_list lru;
 
-	/* If we have no swap space, do not bother scanning anon pages. */
-	if (!sc->may_swap || mem_cgroup_get_nr_swap_pages(memcg) <= 0) {
+	/*
+	 * If we have no swap space, do not bother scanning anon pages,
+	 * unless they can be demoted.
+	 */
+	if (!sc->may_swap || (mem_cgroup_get_nr_swap_pages(memcg) <= 0 &&
+			      !can_demote(pgdat->node_id, sc))) {
 		scan_balance = SCAN_FILE;
 		goto out;
 	}
 
+	if (sc->anon_only) {
+		scan_balance = SCAN_ANON;
+		goto out;
+	}
+
 	/*
 	 * Global reclaim will swap to prevent OOM even with no
 	 * swappiness, but memcg users want to use this knob to
@@ -2417,7 +3413,7 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	file  = lruvec_lru_size(lruvec, LRU_ACTIVE_FILE, MAX_NR_ZONES) +
 		lruvec_lru_size(lruvec, LRU_INACTIVE_FILE, MAX_NR_ZONES);
 
-	spin_lock_irq(&pgdat->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 	if (unlikely(reclaim_stat->recent_scanned[0] > anon / 4)) {
 		reclaim_stat->recent_scanned[0] /= 2;
 		reclaim_stat->recent_rotated[0] /= 2;
@@ -2438,7 +3434,7 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 
 	fp = file_prio * (reclaim_stat->recent_scanned[1] + 1);
 	fp /= reclaim_stat->recent_rotated[1] + 1;
-	spin_unlock_irq(&pgdat->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 
 	fraction[0] = ap;
 	fraction[1] = fp;
@@ -2507,6 +3503,11 @@ static void shrink_node_memcg(struct pglist_data *pgdat, struct mem_cgroup *memc
 	struct blk_plug plug;
 	bool scan_adjusted;
 
+	if (lru_gen_lruvec(lruvec) != lru_gen_enabled())
+		lru_gen_change_lruvec(lruvec);
+	if (lru_gen_lruvec(lruvec))
+		lru_gen_age_lruvec(lruvec, memcg, sc);
+
 	get_scan_count(lruvec, memcg, sc, nr, lru_pages);
 
 	/* Record the original scan target for proportional adjustments later */
@@ -2605,7 +3606,8 @@ static void shrink_node_memcg(struct pglist_data *pgdat, struct mem_cgroup *memc
 	 * Even if we did not try to evict anon pages at all, we want to
 	 * rebalance the anon lru active/inactive ratio.
 	 */
-	if (inactive_list_is_low(lruvec, false, memcg, sc, true))
+	if (!lru_gen_lruvec(lruvec) &&
+	    inactive_list_is_low(lruvec, false, memcg, sc, true))
 		shrink_active_list(SWAP_CLUSTER_MAX, lruvec,
 				   sc, LRU_ACTIVE_ANON);
 }
@@ -2720,6 +3722,9 @@ static bool shrink_node(pg_data_t *pgdat, struct scan_control *sc)
 		nr_reclaimed = sc->nr_reclaimed;
 		nr_scanned = sc->nr_scanned;
 
+		/* Let inactive_list_is_low() see current refault counts */
+		mem_cgroup_flush_stats();
+
 		memcg = mem_cgroup_iter(root, NULL, &reclaim);
 		do {
 			unsigned long lru_pages;
@@ -2998,6 +4003,8 @@ static void snapshot_refaults(struct mem_cgroup *root_memcg, pg_data_t *pgdat)
 {
 	struct mem_cgroup *memcg;
 
+	mem_cgroup_flush_stats();
+
 	memcg = mem_cgroup_iter(root_memcg, NULL, NULL);
 	do {
 		unsigned long refaults;
@@ -3308,10 +4315,12 @@ unsigned long mem_cgroup_shrink_node(struct mem_cgroup *memcg,
 	return sc.nr_reclaimed;
 }
 
-unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
-					   unsigned long nr_pages,
-					   gfp_t gfp_mask,
-					   bool may_swap)
+static unsigned long __try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
+						    unsigned long nr_pages,
+						    gfp_t gfp_mask,
+						    bool may_swap,
+						    int swappiness,
+						    bool anon_only)
 {
 	struct zonelist *zonelist;
 	unsigned long nr_reclaimed;
@@ -3328,6 +4337,8 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 		.may_writepage = !laptop_mode,
 		.may_unmap = 1,
 		.may_swap = may_swap,
+		.anon_only = anon_only,
+		.proactive_swappiness = swappiness >= 0 ? &swappiness : NULL,
 	};
 
 	/*
@@ -3356,6 +4367,39 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 
 	return nr_reclaimed;
 }
+
+unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
+					   unsigned long nr_pages,
+					   gfp_t gfp_mask,
+					   bool may_swap)
+{
+	return __try_to_free_mem_cgroup_pages(memcg, nr_pages, gfp_mask,
+					      may_swap, -1, false);
+}
+
+/**
+ * try_to_free_mem_cgroup_pages_proactive - reclaim pages from a memcg on request
+ * @memcg: the memcg to reclaim from
+ * @nr_pages: the number of pages to try to reclaim
+ * @swappiness: swappiness to balance anon and file with, -1 for the memcg's
+ * @may_file: whether page cache may be reclaimed
+ * @may_anon: whether anonymous pages may be swapped out
+ *
+ * Like try_to_free_mem_cgroup_pages(), for reclaim that is asked for by
+ * user space rather than forced by a limit.  At least one of @may_file and
+ * @may_anon has to be set.
+ *
+ * Returns the number of pages reclaimed.
+ */
+unsigned long try_to_free_mem_cgroup_pages_proactive(struct mem_cgroup *memcg,
+						     unsigned long nr_pages,
+						     int swappiness,
+						     bool may_file,
+						     bool may_anon)
+{
+	return __try_to_free_mem_cgroup_pages(memcg, nr_pages, GFP_KERNEL,
+					      may_anon, swappiness, !may_file);
+}
 #endif
 
 static void age_active_anon(struct pglist_data *pgdat,
@@ -3370,7 +4414,8 @@ static void age_active_anon(struct pglist_data *pgdat,
 	do {
 		struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
 
-		if (inactive_list_is_low(lruvec, false, memcg, sc, true))
+		if (!lru_gen_lruvec(lruvec) &&
+		    inactive_list_is_low(lruvec, false, memcg, sc, true))
 			shrink_active_list(SWAP_CLUSTER_MAX, lruvec,
 					   sc, LRU_ACTIVE_ANON);
 
@@ -4194,24 +5239,16 @@ int page_evictable(struct page *page)
  */
 void check_move_unevictable_pages(struct page **pages, int nr_pages)
 {
-	struct lruvec *lruvec;
-	struct pglist_data *pgdat = NULL;
+	struct lruvec *lruvec = NULL;
 	int pgscanned = 0;
 	int pgrescued = 0;
 	int i;
 
 	for (i = 0; i < nr_pages; i++) {
 		struct page *page = pages[i];
-		struct pglist_data *pagepgdat = page_pgdat(page);
 
 		pgscanned++;
-		if (pagepgdat != pgdat) {
-			if (pgdat)
-				spin_unlock_irq(&pgdat->lru_lock);
-			pgdat = pagepgdat;
-			spin_lock_irq(&pgdat->lru_lock);
-		}
-		lruvec = mem_cgroup_page_lruvec(page, pgdat);
+		lruvec = relock_page_lruvec_irq(page, lruvec);
 
 		if (!PageLRU(page) || !PageUnevictable(page))
 			continue;
@@ -4227,10 +5264,10 @@ void check_move_unevictable_pages(struct page **pages, int nr_pages)
 		}
 	}
 
-	if (pgdat) {
+	if (lruvec) {
 		__count_vm_events(UNEVICTABLE_PGRESCUED, pgrescued);
 		__count_vm_events(UNEVICTABLE_PGSCANNED, pgscanned);
-		spin_unlock_irq(&pgdat->lru_lock);
+		unlock_page_lruvec_irq(lruvec);
 	}
 }
 #endif /* CONFIG_SHMEM */
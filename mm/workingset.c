@@ -6,6 +6,7 @@
  */
 
 #include <linux/memcontrol.h>
+#include <linux/mm_inline.h>
 #include <linux/writeback.h>
 #include <linux/shmem_fs.h>
 #include <linux/pagemap.h>
@@ -213,6 +214,26 @@ static void unpack_shadow(void *shadow, int *memcgidp, pg_data_t **pgdat,
 	*workingsetp = workingset;
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * On the multi-gen LRU, the oldest generation of the page's type stands in
+ * for inactive_age: a page refaulting before the generation it was evicted
+ * from has been retired is activated.
+ */
+static unsigned long lru_gen_eviction(struct lruvec *lruvec, struct page *page)
+{
+	unsigned long min_seq;
+
+	min_seq = READ_ONCE(lruvec->lrugen.min_seq[page_is_file_cache(page)]);
+	return (min_seq & EVICTION_MASK) << bucket_order;
+}
+#else
+static unsigned long lru_gen_eviction(struct lruvec *lruvec, struct page *page)
+{
+	return 0;
+}
+#endif
+
 /**
  * workingset_eviction - note the eviction of a page from memory
  * @mapping: address space the page was backing
@@ -235,7 +256,10 @@ void *workingset_eviction(struct address_space *mapping, struct page *page)
 	VM_BUG_ON_PAGE(!PageLocked(page), page);
 
 	lruvec = mem_cgroup_lruvec(pgdat, memcg);
-	eviction = atomic_long_inc_return(&lruvec->inactive_age);
+	if (lru_gen_lruvec(lruvec))
+		eviction = lru_gen_eviction(lruvec, page);
+	else
+		eviction = atomic_long_inc_return(&lruvec->inactive_age);
 	return pack_shadow(memcgid, pgdat, eviction, PageWorkingset(page));
 }
 
@@ -282,6 +306,13 @@ void workingset_refault(struct page *page, void *shadow)
 	if (!mem_cgroup_disabled() && !memcg)
 		goto out;
 	lruvec = mem_cgroup_lruvec(pgdat, memcg);
+	if (lru_gen_lruvec(lruvec)) {
+		inc_lruvec_state(lruvec, WORKINGSET_REFAULT);
+		if (eviction != lru_gen_eviction(lruvec, page))
+			goto out;
+		goto activate;
+	}
+
 	refault = atomic_long_read(&lruvec->inactive_age);
 	active_file = lruvec_lru_size(lruvec, LRU_ACTIVE_FILE, MAX_NR_ZONES);
 
@@ -313,8 +344,9 @@ void workingset_refault(struct page *page, void *shadow)
 	if (refault_distance > active_file)
 		goto out;
 
-	SetPageActive(page);
 	atomic_long_inc(&lruvec->inactive_age);
+activate:
+	SetPageActive(page);
 	inc_lruvec_state(lruvec, WORKINGSET_ACTIVATE);
 
 	/* Page was active prior to eviction */
@@ -41,6 +41,8 @@
 #include <linux/swapops.h>
 #include <linux/writeback.h>
 #include <linux/pagemap.h>
+#include <linux/workqueue.h>
+#include <linux/blkdev.h>
 
 /*********************************
 * statistics
@@ -63,7 +65,7 @@ static atomic_t zswap_same_filled_pages = ATOMIC_INIT(0);
 static u64 zswap_pool_limit_hit;
 /* Pages written back when pool limit was reached */
 static u64 zswap_written_back_pages;
-/* Store failed due to a reclaim failure after pool limit was reached */
+/* Shrink worker gave up on a writeback after pool limit was reached */
 static u64 zswap_reject_reclaim_fail;
 /* Compressed page was too big for the allocator to (optimally) store */
 static u64 zswap_reject_compress_poor;
@@ -118,6 +120,14 @@ module_param_cb(zpool, &zswap_zpool_param_ops, &zswap_zpool_type, 0644);
 static unsigned int zswap_max_pool_percent = 20;
 module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
 
+/*
+ * Once the pool limit is hit, stores are rejected and cold entries are
+ * written back until the pool is below this percentage of the limit.
+ */
+static unsigned int zswap_accept_thr_percent = 90;
+module_param_named(accept_threshold_percent, zswap_accept_thr_percent,
+		   uint, 0644);
+
 /* Enable/disable handling same-value filled pages (enabled by default) */
 static bool zswap_same_filled_pages_enabled = true;
 module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
@@ -134,6 +144,8 @@ struct zswap_pool {
 	struct list_head list;
 	struct work_struct work;
 	struct hlist_node node;
+	struct list_head lru;
+	spinlock_t lru_lock;
 	char tfm_name[CRYPTO_MAX_ALG_NAME];
 };
 
@@ -151,9 +163,12 @@ struct zswap_pool {
  *            for the zswap_tree structure that contains the entry must
  *            be held while changing the refcount.  Since the lock must
  *            be held, there is no reason to also make refcount atomic.
+ * swpentry - the swap entry the page was stored for, used by writeback
  * length - the length in bytes of the compressed page data.  Needed during
  *          decompression. For a same value filled page length is 0.
  * pool - the zswap_pool the entry's data is in
+ * lru - links the entry into the LRU of its pool, oldest first.  Same value
+ *       filled entries take no pool space and are not on any LRU.
  * handle - zpool allocation handle that stores the compressed page data
  * value - value of the same-value filled pages which have same content
  */
@@ -161,22 +176,24 @@ struct zswap_entry {
 	struct rb_node rbnode;
 	pgoff_t offset;
 	int refcount;
+	swp_entry_t swpentry;
 	unsigned int length;
 	struct zswap_pool *pool;
+	struct list_head lru;
 	union {
 		unsigned long handle;
 		unsigned long value;
 	};
 };
 
-struct zswap_header {
-	swp_entry_t swpentry;
-};
-
 /*
  * The tree lock in the zswap_tree struct protects a few things:
  * - the rbtree
  * - the refcount field of each entry in the tree
+ *
+ * The lru_lock of a pool protects its LRU list and nests inside the tree
+ * lock.  The shrink worker, which walks the LRU first, only ever trylocks
+ * the tree lock.
  */
 struct zswap_tree {
 	struct rb_root rbroot;
@@ -201,6 +218,13 @@ static bool zswap_init_failed;
 /* init completed, but couldn't create the initial pool */
 static bool zswap_has_pool;
 
+/* the pool limit was hit and stores are rejected until writeback catches up */
+static bool zswap_pool_reached_full;
+
+static struct workqueue_struct *shrink_wq;
+static void zswap_shrink_worker(struct work_struct *w);
+static DECLARE_WORK(zswap_shrink_work, zswap_shrink_worker);
+
 /*********************************
 * helpers and fwd declarations
 **********************************/
@@ -209,20 +233,22 @@ static bool zswap_has_pool;
 	pr_debug("%s pool %s/%s\n", msg, (p)->tfm_name,		\
 		 zpool_get_type((p)->zpool))
 
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle);
 static int zswap_pool_get(struct zswap_pool *pool);
 static void zswap_pool_put(struct zswap_pool *pool);
 
-static const struct zpool_ops zswap_zpool_ops = {
-	.evict = zswap_writeback_entry
-};
-
 static bool zswap_is_full(void)
 {
 	return totalram_pages * zswap_max_pool_percent / 100 <
 		DIV_ROUND_UP(zswap_pool_total_size, PAGE_SIZE);
 }
 
+static bool zswap_can_accept(void)
+{
+	return totalram_pages * zswap_accept_thr_percent / 100 *
+				zswap_max_pool_percent / 100 >
+			DIV_ROUND_UP(zswap_pool_total_size, PAGE_SIZE);
+}
+
 static void zswap_update_total_size(void)
 {
 	struct zswap_pool *pool;
@@ -262,6 +288,7 @@ static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
 		return NULL;
 	entry->refcount = 1;
 	RB_CLEAR_NODE(&entry->rbnode);
+	INIT_LIST_HEAD(&entry->lru);
 	return entry;
 }
 
@@ -334,6 +361,9 @@ static void zswap_free_entry(struct zswap_entry *entry)
 	if (!entry->length)
 		atomic_dec(&zswap_same_filled_pages);
 	else {
+		spin_lock(&entry->pool->lru_lock);
+		list_del(&entry->lru);
+		spin_unlock(&entry->pool->lru_lock);
 		zpool_free(entry->pool->zpool, entry->handle);
 		zswap_pool_put(entry->pool);
 	}
@@ -535,7 +565,11 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	/* unique name for each pool specifically required by zsmalloc */
 	snprintf(name, 38, "zswap%x", atomic_inc_return(&zswap_pools_count));
 
-	pool->zpool = zpool_create_pool(type, name, gfp, &zswap_zpool_ops);
+	/*
+	 * No zpool_ops: zswap writes back from its own LRU, so the zpool
+	 * never evicts and the handles need no swap entry header.
+	 */
+	pool->zpool = zpool_create_pool(type, name, gfp, NULL);
 	if (!pool->zpool) {
 		pr_err("%s zpool not available\n", type);
 		goto error;
@@ -560,6 +594,8 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	 */
 	kref_init(&pool->kref);
 	INIT_LIST_HEAD(&pool->list);
+	INIT_LIST_HEAD(&pool->lru);
+	spin_lock_init(&pool->lru_lock);
 
 	zswap_pool_debug("created", pool);
 
@@ -845,14 +881,16 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
  * in the first place.  After the page has been decompressed into
  * the swap cache, the compressed version stored by zswap can be
  * freed.
+ *
+ * The caller holds a reference on the entry.  The bio is only submitted
+ * once the caller's block plug is flushed, so a batch of writebacks to
+ * neighbouring swap slots is merged into a few large requests.
  */
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+static int zswap_writeback_entry(struct zswap_entry *entry,
+				 struct zswap_tree *tree)
 {
-	struct zswap_header *zhdr;
-	swp_entry_t swpentry;
-	struct zswap_tree *tree;
-	pgoff_t offset;
-	struct zswap_entry *entry;
+	swp_entry_t swpentry = entry->swpentry;
+	pgoff_t offset = swp_offset(swpentry);
 	struct page *page;
 	struct crypto_comp *tfm;
 	u8 *src, *dst;
@@ -862,41 +900,21 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 		.sync_mode = WB_SYNC_NONE,
 	};
 
-	/* extract swpentry from data */
-	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
-	swpentry = zhdr->swpentry; /* here */
-	zpool_unmap_handle(pool, handle);
-	tree = zswap_trees[swp_type(swpentry)];
-	offset = swp_offset(swpentry);
-
-	/* find and ref zswap entry */
-	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
-	if (!entry) {
-		/* entry was invalidated */
-		spin_unlock(&tree->lock);
-		return 0;
-	}
-	spin_unlock(&tree->lock);
-	BUG_ON(offset != entry->offset);
-
 	/* try to allocate swap cache page */
 	switch (zswap_get_swap_cache_page(swpentry, &page)) {
 	case ZSWAP_SWAPCACHE_FAIL: /* no memory or invalidate happened */
-		ret = -ENOMEM;
-		goto fail;
+		return -ENOMEM;
 
 	case ZSWAP_SWAPCACHE_EXIST:
 		/* page is already in the swap cache, ignore for now */
 		put_page(page);
-		ret = -EEXIST;
-		goto fail;
+		return -EEXIST;
 
 	case ZSWAP_SWAPCACHE_NEW: /* page is locked */
 		/* decompress */
 		dlen = PAGE_SIZE;
-		src = (u8 *)zpool_map_handle(entry->pool->zpool, entry->handle,
-				ZPOOL_MM_RO) + sizeof(struct zswap_header);
+		src = zpool_map_handle(entry->pool->zpool, entry->handle,
+				       ZPOOL_MM_RO);
 		dst = kmap_atomic(page);
 		tfm = *get_cpu_ptr(entry->pool->tfm);
 		ret = crypto_comp_decompress(tfm, src, entry->length,
@@ -919,53 +937,108 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	put_page(page);
 	zswap_written_back_pages++;
 
-	spin_lock(&tree->lock);
-	/* drop local reference */
-	zswap_entry_put(tree, entry);
-
 	/*
-	* There are two possible situations for entry here:
-	* (1) refcount is 1(normal case),  entry is valid and on the tree
-	* (2) refcount is 0, entry is freed and not on the tree
-	*     because invalidate happened during writeback
-	*  search the tree and free the entry if find entry
-	*/
-	if (entry == zswap_rb_search(&tree->rbroot, offset))
+	 * The entry may have been invalidated during writeback, in which
+	 * case it is no longer on the tree and the caller's put frees it.
+	 */
+	spin_lock(&tree->lock);
+	if (entry == zswap_rb_search(&tree->rbroot, offset)) {
+		zswap_rb_erase(&tree->rbroot, entry);
 		zswap_entry_put(tree, entry);
+	}
 	spin_unlock(&tree->lock);
 
-	goto end;
+	return 0;
+}
+
+/*
+ * Takes the coldest entry off the LRU of @pool and writes it back.  Returns
+ * -ENOENT when the LRU is empty and -EAGAIN when the entry was busy.
+ */
+static int zswap_reclaim_entry(struct zswap_pool *pool)
+{
+	struct zswap_entry *entry;
+	struct zswap_tree *tree;
+	int ret;
+
+	spin_lock(&pool->lru_lock);
+	if (list_empty(&pool->lru)) {
+		spin_unlock(&pool->lru_lock);
+		return -ENOENT;
+	}
+	entry = list_first_entry(&pool->lru, struct zswap_entry, lru);
+	tree = zswap_trees[swp_type(entry->swpentry)];
 
 	/*
-	* if we get here due to ZSWAP_SWAPCACHE_EXIST
-	* a load may happening concurrently
-	* it is safe and okay to not free the entry
-	* if we free the entry in the following put
-	* it it either okay to return !0
-	*/
-fail:
+	 * The entry cannot be freed while it is on the LRU and we hold the
+	 * lru_lock, but the tree lock nests outside of it: only trylock, and
+	 * rotate the entry if its tree is busy.
+	 */
+	if (!spin_trylock(&tree->lock)) {
+		list_move_tail(&entry->lru, &pool->lru);
+		spin_unlock(&pool->lru_lock);
+		return -EAGAIN;
+	}
+	list_del_init(&entry->lru);
+	spin_unlock(&pool->lru_lock);
+
+	/* a load or invalidate is in flight, it will free the entry */
+	if (RB_EMPTY_NODE(&entry->rbnode)) {
+		spin_unlock(&tree->lock);
+		return -EAGAIN;
+	}
+	zswap_entry_get(entry);
+	spin_unlock(&tree->lock);
+
+	ret = zswap_writeback_entry(entry, tree);
+
 	spin_lock(&tree->lock);
+	if (ret && !RB_EMPTY_NODE(&entry->rbnode)) {
+		/* still stored, give it another round on the LRU */
+		spin_lock(&pool->lru_lock);
+		list_add_tail(&entry->lru, &pool->lru);
+		spin_unlock(&pool->lru_lock);
+	}
+	/* drop local reference */
 	zswap_entry_put(tree, entry);
 	spin_unlock(&tree->lock);
 
-end:
-	return ret;
+	return ret ? -EAGAIN : 0;
 }
 
-static int zswap_shrink(void)
+/* entries written back under one block plug */
+#define ZSWAP_WRITEBACK_BATCH	32
+/* failed writebacks after which the shrink worker gives up */
+#define ZSWAP_MAX_RECLAIM_RETRIES	16
+
+static void zswap_shrink_worker(struct work_struct *w)
 {
 	struct zswap_pool *pool;
-	int ret;
+	struct blk_plug plug;
+	int i, ret, failures = 0;
 
 	pool = zswap_pool_last_get();
 	if (!pool)
-		return -ENOENT;
+		return;
 
-	ret = zpool_shrink(pool->zpool, 1, NULL);
+	do {
+		blk_start_plug(&plug);
+		for (i = 0; i < ZSWAP_WRITEBACK_BATCH; i++) {
+			ret = zswap_reclaim_entry(pool);
+			if (ret == -ENOENT)
+				break;
+			if (ret && ++failures == ZSWAP_MAX_RECLAIM_RETRIES)
+				break;
+		}
+		blk_finish_plug(&plug);
+		if (ret == -ENOENT || failures == ZSWAP_MAX_RECLAIM_RETRIES) {
+			zswap_reject_reclaim_fail++;
+			break;
+		}
+		cond_resched();
+	} while (!zswap_can_accept());
 
 	zswap_pool_put(pool);
-
-	return ret;
 }
 
 static int zswap_is_page_same_filled(void *ptr, unsigned long *value)
@@ -1001,11 +1074,10 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	struct zswap_entry *entry, *dupentry;
 	struct crypto_comp *tfm;
 	int ret;
-	unsigned int hlen, dlen = PAGE_SIZE;
+	unsigned int dlen = PAGE_SIZE;
 	unsigned long handle, value;
 	char *buf;
 	u8 *src, *dst;
-	struct zswap_header zhdr = { .swpentry = swp_entry(type, offset) };
 
 	/* THP isn't supported */
 	if (PageTransHuge(page)) {
@@ -1018,23 +1090,21 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto reject;
 	}
 
-	/* reclaim space if needed */
+	/*
+	 * Reclaim space if needed.  Writeback is left to the shrink worker,
+	 * which frees a batch of the coldest entries at once; until the pool
+	 * is back under the acceptance threshold, pages go straight to swap.
+	 */
 	if (zswap_is_full()) {
 		zswap_pool_limit_hit++;
-		if (zswap_shrink()) {
-			zswap_reject_reclaim_fail++;
-			ret = -ENOMEM;
-			goto reject;
-		}
+		zswap_pool_reached_full = true;
+		goto shrink;
+	}
 
-		/* A second zswap_is_full() check after
-		 * zswap_shrink() to make sure it's now
-		 * under the max_pool_percent
-		 */
-		if (zswap_is_full()) {
-			ret = -ENOMEM;
-			goto reject;
-		}
+	if (zswap_pool_reached_full) {
+		if (!zswap_can_accept())
+			goto shrink;
+		zswap_pool_reached_full = false;
 	}
 
 	/* allocate entry */
@@ -1050,6 +1120,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		if (zswap_is_page_same_filled(src, &value)) {
 			kunmap_atomic(src);
 			entry->offset = offset;
+			entry->swpentry = swp_entry(type, offset);
 			entry->length = 0;
 			entry->value = value;
 			atomic_inc(&zswap_same_filled_pages);
@@ -1078,8 +1149,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	}
 
 	/* store */
-	hlen = zpool_evictable(entry->pool->zpool) ? sizeof(zhdr) : 0;
-	ret = zpool_malloc(entry->pool->zpool, hlen + dlen,
+	ret = zpool_malloc(entry->pool->zpool, dlen,
 			   __GFP_NORETRY | __GFP_NOWARN | __GFP_KSWAPD_RECLAIM,
 			   &handle);
 	if (ret == -ENOSPC) {
@@ -1091,13 +1161,13 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto put_dstmem;
 	}
 	buf = zpool_map_handle(entry->pool->zpool, handle, ZPOOL_MM_RW);
-	memcpy(buf, &zhdr, hlen);
-	memcpy(buf + hlen, dst, dlen);
+	memcpy(buf, dst, dlen);
 	zpool_unmap_handle(entry->pool->zpool, handle);
 	put_cpu_var(zswap_dstmem);
 
 	/* populate entry */
 	entry->offset = offset;
+	entry->swpentry = swp_entry(type, offset);
 	entry->handle = handle;
 	entry->length = dlen;
 
@@ -1113,6 +1183,11 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 			zswap_entry_put(tree, dupentry);
 		}
 	} while (ret == -EEXIST);
+	if (entry->length) {
+		spin_lock(&entry->pool->lru_lock);
+		list_add_tail(&entry->lru, &entry->pool->lru);
+		spin_unlock(&entry->pool->lru_lock);
+	}
 	spin_unlock(&tree->lock);
 
 	/* update stats */
@@ -1128,6 +1203,11 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	zswap_entry_cache_free(entry);
 reject:
 	return ret;
+
+shrink:
+	queue_work(shrink_wq, &zswap_shrink_work);
+	ret = -ENOMEM;
+	goto reject;
 }
 
 /*
@@ -1164,8 +1244,6 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	/* decompress */
 	dlen = PAGE_SIZE;
 	src = zpool_map_handle(entry->pool->zpool, entry->handle, ZPOOL_MM_RO);
-	if (zpool_evictable(entry->pool->zpool))
-		src += sizeof(struct zswap_header);
 	dst = kmap_atomic(page);
 	tfm = *get_cpu_ptr(entry->pool->tfm);
 	ret = crypto_comp_decompress(tfm, src, entry->length, dst, &dlen);
@@ -1331,6 +1409,11 @@ static int __init init_zswap(void)
 	if (ret)
 		goto hp_fail;
 
+	shrink_wq = alloc_workqueue("zswap-shrink",
+				    WQ_UNBOUND | WQ_MEM_RECLAIM, 1);
+	if (!shrink_wq)
+		goto shrink_wq_fail;
+
 	pool = __zswap_pool_create_fallback();
 	if (pool) {
 		pr_info("loaded using pool %s/%s\n", pool->tfm_name,
@@ -1347,6 +1430,8 @@ static int __init init_zswap(void)
 		pr_warn("debugfs initialization failed\n");
 	return 0;
 
+shrink_wq_fail:
+	cpuhp_remove_multi_state(CPUHP_MM_ZSWP_POOL_PREPARE);
 hp_fail:
 	cpuhp_remove_state(CPUHP_MM_ZSWP_MEM_PREPARE);
 dstmem_fail:
@@ -447,6 +447,9 @@ int skb_copy_datagram_iter(const struct sk_buff *skb, int offset,
 		if ((copy = end - offset) > 0) {
 			if (copy > len)
 				copy = len;
+			/* Device memory is handed out, never copied */
+			if (skb_frag_is_net_iov(frag))
+				goto fault;
 			n = copy_page_to_iter(skb_frag_page(frag),
 					      frag->page_offset + offset -
 					      start, copy, to);
@@ -0,0 +1,337 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Device memory TCP: binding dma-bufs to receive queues
+ *
+ * A socket binds a dma-buf to a receive queue of a device; the binding
+ * lives until the socket is closed.  The dma-buf is mapped for the device
+ * once and carved up into page sized net_iovs, which the page_pool of the
+ * queue hands to the driver instead of pages.
+ */
+
+#include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
+#include <linux/idr.h>
+#include <linux/mm.h>
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <net/devmem.h>
+#include <net/page_pool.h>
+#include <net/sock.h>
+
+static DEFINE_IDA(net_devmem_ida);
+
+struct net_iov *
+net_devmem_alloc_niov(struct net_devmem_dmabuf_binding *binding)
+{
+	struct net_iov *niov = NULL;
+
+	spin_lock_bh(&binding->free_lock);
+	if (binding->num_free)
+		niov = binding->free_niovs[--binding->num_free];
+	spin_unlock_bh(&binding->free_lock);
+
+	return niov;
+}
+
+void net_devmem_free_niov(struct net_iov *niov)
+{
+	struct net_devmem_dmabuf_binding *binding = niov->binding;
+	unsigned long flags;
+
+	/* The last reference can be dropped from hard irq context */
+	spin_lock_irqsave(&binding->free_lock, flags);
+	binding->free_niovs[binding->num_free++] = niov;
+	spin_unlock_irqrestore(&binding->free_lock, flags);
+}
+
+/**
+ * net_iov_put - drop a reference on a net_iov
+ * @niov: the net_iov, from an skb frag or a user space token
+ *
+ * The last reference gives it back to the page_pool it came from.
+ */
+void net_iov_put(struct net_iov *niov)
+{
+	if (atomic_dec_and_test(&niov->ref))
+		page_pool_put_net_iov(niov->pp, niov);
+}
+EXPORT_SYMBOL(net_iov_put);
+
+static void net_devmem_binding_free(struct work_struct *work)
+{
+	struct net_devmem_dmabuf_binding *binding =
+		container_of(work, typeof(*binding), free_work);
+
+	WARN_ON(binding->num_free != binding->num_niovs);
+
+	dma_buf_unmap_attachment(binding->attachment, binding->sgt,
+				 DMA_FROM_DEVICE);
+	dma_buf_detach(binding->dmabuf, binding->attachment);
+	dma_buf_put(binding->dmabuf);
+	dev_put(binding->dev);
+	ida_free(&net_devmem_ida, binding->id);
+	kvfree(binding->free_niovs);
+	kvfree(binding->niovs);
+	kfree(binding);
+}
+
+void net_devmem_binding_put(struct net_devmem_dmabuf_binding *binding)
+{
+	/* Unmapping the dma-buf may sleep, the last put may come from NAPI */
+	if (refcount_dec_and_test(&binding->ref))
+		schedule_work(&binding->free_work);
+}
+EXPORT_SYMBOL(net_devmem_binding_put);
+
+/**
+ * net_devmem_rxq_binding - the device memory bound to a receive queue
+ * @dev: the device
+ * @rxq_idx: the receive queue
+ *
+ * For drivers to set up the page_pool of the queue, from their
+ * ndo_rx_queue_restart() or when the device is opened.  Called with rtnl
+ * held.  Returns NULL when no device memory is bound to the queue.
+ */
+struct net_devmem_dmabuf_binding *
+net_devmem_rxq_binding(struct net_device *dev, unsigned int rxq_idx)
+{
+	ASSERT_RTNL();
+
+	if (rxq_idx >= dev->real_num_rx_queues)
+		return NULL;
+	return dev->_rx[rxq_idx].devmem_binding;
+}
+EXPORT_SYMBOL(net_devmem_rxq_binding);
+
+static int net_devmem_init_niovs(struct net_devmem_dmabuf_binding *binding)
+{
+	struct scatterlist *sg;
+	unsigned long n = 0;
+	unsigned int i;
+
+	binding->num_niovs = binding->dmabuf->size >> PAGE_SHIFT;
+	binding->niovs = kvcalloc(binding->num_niovs, sizeof(*binding->niovs),
+				  GFP_KERNEL);
+	binding->free_niovs = kvcalloc(binding->num_niovs,
+				       sizeof(*binding->free_niovs),
+				       GFP_KERNEL);
+	if (!binding->niovs || !binding->free_niovs)
+		return -ENOMEM;
+
+	for_each_sg(binding->sgt->sgl, sg, binding->sgt->nents, i) {
+		dma_addr_t dma = sg_dma_address(sg);
+		unsigned int len = sg_dma_len(sg);
+
+		/* Every net_iov must cover a page worth of device memory */
+		if (!PAGE_ALIGNED(dma) || !PAGE_ALIGNED(len))
+			return -EINVAL;
+
+		for (; len && n < binding->num_niovs; len -= PAGE_SIZE) {
+			struct net_iov *niov = &binding->niovs[n++];
+
+			niov->binding = binding;
+			niov->dma_addr = dma;
+			dma += PAGE_SIZE;
+		}
+	}
+
+	/* Hand out the start of the dma-buf first */
+	for (binding->num_free = 0; binding->num_free < n; binding->num_free++)
+		binding->free_niovs[binding->num_free] =
+			&binding->niovs[n - 1 - binding->num_free];
+
+	return 0;
+}
+
+static struct net_devmem_dmabuf_binding *
+net_devmem_bind_dmabuf(struct net_device *dev, unsigned int rxq_idx,
+		       int dmabuf_fd)
+{
+	struct net_devmem_dmabuf_binding *binding;
+	struct dma_buf *dmabuf;
+	int err;
+
+	dmabuf = dma_buf_get(dmabuf_fd);
+	if (IS_ERR(dmabuf))
+		return ERR_CAST(dmabuf);
+
+	binding = kzalloc(sizeof(*binding), GFP_KERNEL);
+	if (!binding) {
+		err = -ENOMEM;
+		goto err_put_dmabuf;
+	}
+
+	err = ida_alloc_min(&net_devmem_ida, 1, GFP_KERNEL);
+	if (err < 0)
+		goto err_free_binding;
+	binding->id = err;
+
+	binding->dmabuf = dmabuf;
+	binding->dev = dev;
+	binding->rxq_idx = rxq_idx;
+	refcount_set(&binding->ref, 1);
+	spin_lock_init(&binding->free_lock);
+	INIT_LIST_HEAD(&binding->sk_list);
+	INIT_WORK(&binding->free_work, net_devmem_binding_free);
+
+	binding->attachment = dma_buf_attach(dmabuf, dev->dev.parent);
+	if (IS_ERR(binding->attachment)) {
+		err = PTR_ERR(binding->attachment);
+		goto err_free_id;
+	}
+
+	binding->sgt = dma_buf_map_attachment(binding->attachment,
+					      DMA_FROM_DEVICE);
+	if (IS_ERR(binding->sgt)) {
+		err = PTR_ERR(binding->sgt);
+		goto err_detach;
+	}
+
+	err = net_devmem_init_niovs(binding);
+	if (err)
+		goto err_unmap;
+
+	dev_hold(dev);
+	return binding;
+
+err_unmap:
+	kvfree(binding->free_niovs);
+	kvfree(binding->niovs);
+	dma_buf_unmap_attachment(binding->attachment, binding->sgt,
+				 DMA_FROM_DEVICE);
+err_detach:
+	dma_buf_detach(dmabuf, binding->attachment);
+err_free_id:
+	ida_free(&net_devmem_ida, binding->id);
+err_free_binding:
+	kfree(binding);
+err_put_dmabuf:
+	dma_buf_put(dmabuf);
+	return ERR_PTR(err);
+}
+
+static void net_devmem_unbind(struct net_devmem_dmabuf_binding *binding)
+{
+	struct net_device *dev = binding->dev;
+
+	ASSERT_RTNL();
+
+	dev->_rx[binding->rxq_idx].devmem_binding = NULL;
+	if (dev->reg_state == NETREG_REGISTERED && netif_running(dev) &&
+	    dev->netdev_ops->ndo_rx_queue_restart(dev, binding->rxq_idx))
+		netdev_warn(dev, "failed to restart rx queue %u\n",
+			    binding->rxq_idx);
+
+	list_del(&binding->sk_list);
+	net_devmem_binding_put(binding);
+}
+
+/**
+ * net_devmem_bind_sk - bind a dma-buf to a receive queue for a socket
+ * @sk: the socket owning the binding until it is closed
+ * @ifindex: the device
+ * @rxq_idx: its receive queue
+ * @dmabuf_fd: the dma-buf
+ * @id: returns the id of the binding, as reported in SCM_DEVMEM_DMABUF
+ *
+ * Traffic has to be steered to the queue separately, e.g. with ethtool
+ * flow rules; the payload of anything else received there is lost to the
+ * stack as well.
+ */
+int net_devmem_bind_sk(struct sock *sk, unsigned int ifindex,
+		       unsigned int rxq_idx, int dmabuf_fd, u32 *id)
+{
+	struct net_devmem_dmabuf_binding *binding;
+	struct net_device *dev;
+	int err;
+
+	if (!ns_capable(sock_net(sk)->user_ns, CAP_NET_ADMIN))
+		return -EPERM;
+
+	rtnl_lock();
+
+	dev = __dev_get_by_index(sock_net(sk), ifindex);
+	if (!dev) {
+		err = -ENODEV;
+		goto out;
+	}
+	if (!dev->netdev_ops->ndo_rx_queue_restart) {
+		err = -EOPNOTSUPP;
+		goto out;
+	}
+	if (rxq_idx >= dev->real_num_rx_queues) {
+		err = -ERANGE;
+		goto out;
+	}
+	if (dev->_rx[rxq_idx].devmem_binding) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	binding = net_devmem_bind_dmabuf(dev, rxq_idx, dmabuf_fd);
+	if (IS_ERR(binding)) {
+		err = PTR_ERR(binding);
+		goto out;
+	}
+
+	dev->_rx[rxq_idx].devmem_binding = binding;
+	list_add(&binding->sk_list, &sk->sk_devmem_bindings);
+
+	if (netif_running(dev)) {
+		err = dev->netdev_ops->ndo_rx_queue_restart(dev, rxq_idx);
+		if (err) {
+			net_devmem_unbind(binding);
+			goto out;
+		}
+	}
+
+	*id = binding->id;
+	err = 0;
+out:
+	rtnl_unlock();
+	return err;
+}
+
+/* Called when the socket is released, in process context */
+void net_devmem_unbind_sk(struct sock *sk)
+{
+	struct net_devmem_dmabuf_binding *binding, *tmp;
+
+	if (list_empty(&sk->sk_devmem_bindings))
+		return;
+
+	rtnl_lock();
+	list_for_each_entry_safe(binding, tmp, &sk->sk_devmem_bindings,
+				 sk_list)
+		net_devmem_unbind(binding);
+	rtnl_unlock();
+}
+
+/* Bindings hold the device, let go of them when it goes away */
+static int net_devmem_netdev_event(struct notifier_block *this,
+				   unsigned long event, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+	unsigned int i;
+
+	if (event != NETDEV_UNREGISTER)
+		return NOTIFY_DONE;
+
+	for (i = 0; i < dev->num_rx_queues; i++)
+		if (dev->_rx[i].devmem_binding)
+			net_devmem_unbind(dev->_rx[i].devmem_binding);
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block net_devmem_netdev_notifier = {
+	.notifier_call = net_devmem_netdev_event,
+};
+
+static int __init net_devmem_init(void)
+{
+	return register_netdevice_notifier(&net_devmem_netdev_notifier);
+}
+subsys_initcall(net_devmem_init);
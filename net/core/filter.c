@@ -73,6 +73,7 @@
 #include <linux/seg6_local.h>
 #include <net/seg6.h>
 #include <net/seg6_local.h>
+#include <net/bpf_sk_storage.h>
 
 /**
  *	sk_filter_trim_cap - run a packet through a socket filter
@@ -3108,6 +3109,39 @@ static const struct bpf_func_proto bpf_xdp_adjust_head_proto = {
 	.arg2_type	= ARG_ANYTHING,
 };
 
+/* Trim @shrink bytes off the end of a multi-buffer packet, releasing
+ * the fragments that end up empty. Once all of them are gone, the
+ * remainder comes off the head buffer as for a linear packet.
+ */
+static int bpf_xdp_frags_shrink_tail(struct xdp_buff *xdp, int shrink)
+{
+	struct skb_shared_info *sinfo = xdp_get_shared_info_from_buff(xdp);
+	int i;
+
+	if (unlikely(shrink > (int)xdp_get_buff_len(xdp) - ETH_HLEN))
+		return -EINVAL;
+
+	for (i = sinfo->nr_frags - 1; i >= 0 && shrink > 0; i--) {
+		skb_frag_t *frag = &sinfo->frags[i];
+		int size = skb_frag_size(frag);
+
+		if (shrink < size) {
+			skb_frag_size_sub(frag, shrink);
+			return 0;
+		}
+
+		xdp_return_buff_frag(xdp, frag);
+		sinfo->nr_frags--;
+		shrink -= size;
+	}
+
+	if (!sinfo->nr_frags)
+		xdp->flags &= ~XDP_FLAGS_HAS_FRAGS;
+	xdp->data_end -= shrink;
+
+	return 0;
+}
+
 BPF_CALL_2(bpf_xdp_adjust_tail, struct xdp_buff *, xdp, int, offset)
 {
 	void *data_end = xdp->data_end + offset;
@@ -3116,6 +3150,9 @@ BPF_CALL_2(bpf_xdp_adjust_tail, struct xdp_buff *, xdp, int, offset)
 	if (unlikely(offset >= 0))
 		return -EINVAL;
 
+	if (unlikely(xdp_buff_has_frags(xdp)))
+		return bpf_xdp_frags_shrink_tail(xdp, -offset);
+
 	if (unlikely(data_end < xdp->data + ETH_HLEN))
 		return -EINVAL;
 
@@ -3132,6 +3169,204 @@ static const struct bpf_func_proto bpf_xdp_adjust_tail_proto = {
 	.arg2_type	= ARG_ANYTHING,
 };
 
+BPF_CALL_1(bpf_xdp_get_buff_len, struct xdp_buff *, xdp)
+{
+	return xdp_get_buff_len(xdp);
+}
+
+static const struct bpf_func_proto bpf_xdp_get_buff_len_proto = {
+	.func		= bpf_xdp_get_buff_len,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+};
+
+/* Copy between @buf and the packet, walking into the fragments once the
+ * head buffer is exhausted. The caller has checked @off and @len against
+ * the total packet length.
+ */
+static void bpf_xdp_copy_buf(struct xdp_buff *xdp, u32 off, void *buf,
+			     u32 len, bool flush)
+{
+	u32 headsize = xdp->data_end - xdp->data;
+	struct skb_shared_info *sinfo;
+	u32 copy;
+	int i;
+
+	if (off < headsize) {
+		copy = min(len, headsize - off);
+		if (flush)
+			memcpy(xdp->data + off, buf, copy);
+		else
+			memcpy(buf, xdp->data + off, copy);
+		buf += copy;
+		len -= copy;
+		off = 0;
+	} else {
+		off -= headsize;
+	}
+
+	if (!len)
+		return;
+
+	sinfo = xdp_get_shared_info_from_buff(xdp);
+	for (i = 0; len && i < sinfo->nr_frags; i++) {
+		skb_frag_t *frag = &sinfo->frags[i];
+		u32 size = skb_frag_size(frag);
+		void *addr;
+
+		if (off >= size) {
+			off -= size;
+			continue;
+		}
+
+		copy = min(len, size - off);
+		addr = skb_frag_address(frag) + off;
+		if (flush)
+			memcpy(addr, buf, copy);
+		else
+			memcpy(buf, addr, copy);
+		buf += copy;
+		len -= copy;
+		off = 0;
+	}
+}
+
+BPF_CALL_4(bpf_xdp_load_bytes, struct xdp_buff *, xdp, u32, offset,
+	   void *, buf, u32, len)
+{
+	if (unlikely((u64)offset + len > xdp_get_buff_len(xdp)))
+		return -EINVAL;
+
+	bpf_xdp_copy_buf(xdp, offset, buf, len, false);
+
+	return 0;
+}
+
+static const struct bpf_func_proto bpf_xdp_load_bytes_proto = {
+	.func		= bpf_xdp_load_bytes,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_PTR_TO_UNINIT_MEM,
+	.arg4_type	= ARG_CONST_SIZE,
+};
+
+BPF_CALL_4(bpf_xdp_store_bytes, struct xdp_buff *, xdp, u32, offset,
+	   void *, buf, u32, len)
+{
+	if (unlikely((u64)offset + len > xdp_get_buff_len(xdp)))
+		return -EINVAL;
+
+	bpf_xdp_copy_buf(xdp, offset, buf, len, true);
+
+	return 0;
+}
+
+static const struct bpf_func_proto bpf_xdp_store_bytes_proto = {
+	.func		= bpf_xdp_store_bytes,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_PTR_TO_MEM,
+	.arg4_type	= ARG_CONST_SIZE,
+};
+
+static const struct xdp_metadata_ops *
+bpf_xdp_metadata_ops(const struct xdp_buff *xdp)
+{
+	if (!xdp_buff_has_rx_meta(xdp))
+		return NULL;
+
+	return xdp->rxq->dev->xdp_metadata_ops;
+}
+
+BPF_CALL_3(bpf_xdp_metadata_rx_timestamp, struct xdp_buff *, xdp,
+	   u64 *, timestamp, u32, size)
+{
+	const struct xdp_metadata_ops *ops = bpf_xdp_metadata_ops(xdp);
+	int err = -EINVAL;
+
+	if (unlikely(size != sizeof(*timestamp)))
+		goto err_clear;
+	err = -EOPNOTSUPP;
+	if (!ops || !ops->xmo_rx_timestamp)
+		goto err_clear;
+	err = ops->xmo_rx_timestamp(xdp, timestamp);
+	if (!err)
+		return 0;
+err_clear:
+	memset(timestamp, 0, size);
+	return err;
+}
+
+static const struct bpf_func_proto bpf_xdp_metadata_rx_timestamp_proto = {
+	.func		= bpf_xdp_metadata_rx_timestamp,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_PTR_TO_UNINIT_MEM,
+	.arg3_type	= ARG_CONST_SIZE,
+};
+
+BPF_CALL_3(bpf_xdp_metadata_rx_hash, struct xdp_buff *, xdp,
+	   struct bpf_xdp_rx_hash *, hash, u32, size)
+{
+	const struct xdp_metadata_ops *ops = bpf_xdp_metadata_ops(xdp);
+	int err = -EINVAL;
+
+	if (unlikely(size != sizeof(*hash)))
+		goto err_clear;
+	err = -EOPNOTSUPP;
+	if (!ops || !ops->xmo_rx_hash)
+		goto err_clear;
+	err = ops->xmo_rx_hash(xdp, &hash->hash, &hash->rss_type);
+	if (!err)
+		return 0;
+err_clear:
+	memset(hash, 0, size);
+	return err;
+}
+
+static const struct bpf_func_proto bpf_xdp_metadata_rx_hash_proto = {
+	.func		= bpf_xdp_metadata_rx_hash,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_PTR_TO_UNINIT_MEM,
+	.arg3_type	= ARG_CONST_SIZE,
+};
+
+BPF_CALL_3(bpf_xdp_metadata_rx_vlan_tag, struct xdp_buff *, xdp,
+	   struct bpf_xdp_rx_vlan *, vlan, u32, size)
+{
+	const struct xdp_metadata_ops *ops = bpf_xdp_metadata_ops(xdp);
+	int err = -EINVAL;
+
+	if (unlikely(size != sizeof(*vlan)))
+		goto err_clear;
+	err = -EOPNOTSUPP;
+	if (!ops || !ops->xmo_rx_vlan_tag)
+		goto err_clear;
+	err = ops->xmo_rx_vlan_tag(xdp, &vlan->vlan_proto, &vlan->vlan_tci);
+	if (!err)
+		return 0;
+err_clear:
+	memset(vlan, 0, size);
+	return err;
+}
+
+static const struct bpf_func_proto bpf_xdp_metadata_rx_vlan_tag_proto = {
+	.func		= bpf_xdp_metadata_rx_vlan_tag,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_PTR_TO_UNINIT_MEM,
+	.arg3_type	= ARG_CONST_SIZE,
+};
+
 BPF_CALL_2(bpf_xdp_adjust_meta, struct xdp_buff *, xdp, int, offset)
 {
 	void *xdp_frame_end = xdp->data_hard_start + sizeof(struct xdp_frame);
@@ -3172,7 +3407,11 @@ static int __bpf_tx_xdp(struct net_device *dev,
 		return -EOPNOTSUPP;
 	}
 
-	err = xdp_ok_fwd_dev(dev, xdp->data_end - xdp->data);
+	if (unlikely(xdp_buff_has_frags(xdp) &&
+		     !(dev->priv_flags & IFF_XDP_XMIT_FRAGS)))
+		return -EOPNOTSUPP;
+
+	err = xdp_ok_fwd_dev(dev, xdp_get_buff_len(xdp));
 	if (unlikely(err))
 		return err;
 
@@ -3309,6 +3548,7 @@ static int xdp_do_redirect_map(struct net_device *dev, struct xdp_buff *xdp,
 			       struct bpf_prog *xdp_prog, struct bpf_map *map,
 			       struct bpf_redirect_info *ri)
 {
+	bool broadcast = ri->flags & BPF_F_BROADCAST;
 	u32 index = ri->ifindex;
 	void *fwd = NULL;
 	int err;
@@ -3316,15 +3556,21 @@ static int xdp_do_redirect_map(struct net_device *dev, struct xdp_buff *xdp,
 	ri->ifindex = 0;
 	WRITE_ONCE(ri->map, NULL);
 
-	fwd = __xdp_map_lookup_elem(map, index);
-	if (unlikely(!fwd)) {
-		err = -EINVAL;
-		goto err;
+	if (!broadcast) {
+		fwd = __xdp_map_lookup_elem(map, index);
+		if (unlikely(!fwd)) {
+			err = -EINVAL;
+			goto err;
+		}
 	}
 	if (ri->map_to_flush && unlikely(ri->map_to_flush != map))
 		xdp_do_flush_map();
 
-	err = __bpf_tx_xdp_map(dev, fwd, map, xdp, index);
+	if (unlikely(broadcast))
+		err = dev_map_enqueue_multi(xdp, dev, map,
+					    ri->flags & BPF_F_EXCLUDE_INGRESS);
+	else
+		err = __bpf_tx_xdp_map(dev, fwd, map, xdp, index);
 	if (unlikely(err))
 		goto err;
 
@@ -3363,6 +3609,14 @@ static int xdp_do_generic_redirect_map(struct net_device *dev,
 	ri->ifindex = 0;
 	WRITE_ONCE(ri->map, NULL);
 
+	if (unlikely(ri->flags & BPF_F_BROADCAST)) {
+		err = dev_map_redirect_multi(dev, skb, xdp_prog, map,
+					     ri->flags & BPF_F_EXCLUDE_INGRESS);
+		if (unlikely(err))
+			goto err;
+		goto out;
+	}
+
 	fwd = __xdp_map_lookup_elem(map, index);
 	if (unlikely(!fwd)) {
 		err = -EINVAL;
@@ -3388,6 +3642,7 @@ static int xdp_do_generic_redirect_map(struct net_device *dev,
 		goto err;
 	}
 
+out:
 	_trace_xdp_redirect_map(dev, xdp_prog, fwd, map, index);
 	return 0;
 err:
@@ -3455,7 +3710,12 @@ BPF_CALL_3(bpf_xdp_redirect_map, struct bpf_map *, map, u32, ifindex,
 {
 	struct bpf_redirect_info *ri = this_cpu_ptr(&bpf_redirect_info);
 
-	if (unlikely(flags))
+	if (unlikely(flags & ~(BPF_F_BROADCAST | BPF_F_EXCLUDE_INGRESS)))
+		return XDP_ABORTED;
+
+	/* Broadcasting only makes sense towards a set of devices */
+	if (unlikely(flags && (!(flags & BPF_F_BROADCAST) ||
+			       map->map_type != BPF_MAP_TYPE_DEVMAP)))
 		return XDP_ABORTED;
 
 	ri->ifindex = ifindex;
@@ -5014,6 +5274,16 @@ bpf_base_func_proto(enum bpf_func_id func_id)
 		return &bpf_map_pop_elem_proto;
 	case BPF_FUNC_map_peek_elem:
 		return &bpf_map_peek_elem_proto;
+	case BPF_FUNC_ringbuf_output:
+		return &bpf_ringbuf_output_proto;
+	case BPF_FUNC_ringbuf_reserve:
+		return &bpf_ringbuf_reserve_proto;
+	case BPF_FUNC_ringbuf_submit:
+		return &bpf_ringbuf_submit_proto;
+	case BPF_FUNC_ringbuf_discard:
+		return &bpf_ringbuf_discard_proto;
+	case BPF_FUNC_ringbuf_query:
+		return &bpf_ringbuf_query_proto;
 	case BPF_FUNC_get_prandom_u32:
 		return &bpf_get_prandom_u32_proto;
 	case BPF_FUNC_get_smp_processor_id:
@@ -5092,12 +5362,21 @@ sk_filter_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 	}
 }
 
+const struct bpf_func_proto bpf_sk_storage_get_proto __weak;
+const struct bpf_func_proto bpf_sk_storage_delete_proto __weak;
+const struct bpf_func_proto bpf_sk_storage_get_skb_proto __weak;
+const struct bpf_func_proto bpf_sk_storage_delete_skb_proto __weak;
+
 static const struct bpf_func_proto *
 cg_skb_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 {
 	switch (func_id) {
 	case BPF_FUNC_get_local_storage:
 		return &bpf_get_local_storage_proto;
+	case BPF_FUNC_sk_storage_get:
+		return &bpf_sk_storage_get_skb_proto;
+	case BPF_FUNC_sk_storage_delete:
+		return &bpf_sk_storage_delete_skb_proto;
 	default:
 		return sk_filter_func_proto(func_id, prog);
 	}
@@ -5186,6 +5465,10 @@ tc_cls_act_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_sk_lookup_udp_proto;
 	case BPF_FUNC_sk_release:
 		return &bpf_sk_release_proto;
+	case BPF_FUNC_sk_storage_get:
+		return &bpf_sk_storage_get_proto;
+	case BPF_FUNC_sk_storage_delete:
+		return &bpf_sk_storage_delete_proto;
 #endif
 	default:
 		return bpf_base_func_proto(func_id);
@@ -5214,6 +5497,18 @@ xdp_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_xdp_adjust_tail_proto;
 	case BPF_FUNC_fib_lookup:
 		return &bpf_xdp_fib_lookup_proto;
+	case BPF_FUNC_xdp_get_buff_len:
+		return &bpf_xdp_get_buff_len_proto;
+	case BPF_FUNC_xdp_load_bytes:
+		return &bpf_xdp_load_bytes_proto;
+	case BPF_FUNC_xdp_store_bytes:
+		return &bpf_xdp_store_bytes_proto;
+	case BPF_FUNC_xdp_metadata_rx_timestamp:
+		return &bpf_xdp_metadata_rx_timestamp_proto;
+	case BPF_FUNC_xdp_metadata_rx_hash:
+		return &bpf_xdp_metadata_rx_hash_proto;
+	case BPF_FUNC_xdp_metadata_rx_vlan_tag:
+		return &bpf_xdp_metadata_rx_vlan_tag_proto;
 	default:
 		return bpf_base_func_proto(func_id);
 	}
@@ -5221,6 +5516,8 @@ xdp_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 
 const struct bpf_func_proto bpf_sock_map_update_proto __weak;
 const struct bpf_func_proto bpf_sock_hash_update_proto __weak;
+const struct bpf_func_proto bpf_sk_storage_get_sock_ops_proto __weak;
+const struct bpf_func_proto bpf_sk_storage_delete_sock_ops_proto __weak;
 
 static const struct bpf_func_proto *
 sock_ops_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
@@ -5240,6 +5537,10 @@ sock_ops_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_get_socket_cookie_sock_ops_proto;
 	case BPF_FUNC_get_local_storage:
 		return &bpf_get_local_storage_proto;
+	case BPF_FUNC_sk_storage_get:
+		return &bpf_sk_storage_get_sock_ops_proto;
+	case BPF_FUNC_sk_storage_delete:
+		return &bpf_sk_storage_delete_sock_ops_proto;
 	default:
 		return bpf_base_func_proto(func_id);
 	}
@@ -5301,6 +5602,10 @@ sk_skb_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_sk_lookup_udp_proto;
 	case BPF_FUNC_sk_release:
 		return &bpf_sk_release_proto;
+	case BPF_FUNC_sk_storage_get:
+		return &bpf_sk_storage_get_proto;
+	case BPF_FUNC_sk_storage_delete:
+		return &bpf_sk_storage_delete_proto;
 #endif
 	default:
 		return bpf_base_func_proto(func_id);
@@ -5796,6 +6101,11 @@ static bool xdp_is_valid_access(int off, int size,
 	case offsetof(struct xdp_md, data):
 		info->reg_type = PTR_TO_PACKET;
 		break;
+	case offsetof(struct xdp_md, egress_ifindex):
+		/* Only devmap programs run with a txq attached */
+		if (prog->expected_attach_type != BPF_XDP_DEVMAP)
+			return false;
+		break;
 	case offsetof(struct xdp_md, data_meta):
 		info->reg_type = PTR_TO_PACKET_META;
 		break;
@@ -6410,17 +6720,21 @@ u32 bpf_sock_convert_ctx_access(enum bpf_access_type type,
 		break;
 
 	case offsetof(struct bpf_sock, type):
-		*insn++ = BPF_LDX_MEM(BPF_W, si->dst_reg, si->src_reg,
-				      offsetof(struct sock, __sk_flags_offset));
-		*insn++ = BPF_ALU32_IMM(BPF_AND, si->dst_reg, SK_FL_TYPE_MASK);
-		*insn++ = BPF_ALU32_IMM(BPF_RSH, si->dst_reg, SK_FL_TYPE_SHIFT);
+		*insn++ = BPF_LDX_MEM(
+			BPF_FIELD_SIZEOF(struct sock, sk_type),
+			si->dst_reg, si->src_reg,
+			bpf_target_off(struct sock, sk_type,
+				       FIELD_SIZEOF(struct sock, sk_type),
+				       target_size));
 		break;
 
 	case offsetof(struct bpf_sock, protocol):
-		*insn++ = BPF_LDX_MEM(BPF_W, si->dst_reg, si->src_reg,
-				      offsetof(struct sock, __sk_flags_offset));
-		*insn++ = BPF_ALU32_IMM(BPF_AND, si->dst_reg, SK_FL_PROTO_MASK);
-		*insn++ = BPF_ALU32_IMM(BPF_RSH, si->dst_reg, SK_FL_PROTO_SHIFT);
+		*insn++ = BPF_LDX_MEM(
+			BPF_FIELD_SIZEOF(struct sock, sk_protocol),
+			si->dst_reg, si->src_reg,
+			bpf_target_off(struct sock, sk_protocol,
+				       FIELD_SIZEOF(struct sock, sk_protocol),
+				       target_size));
 		break;
 
 	case offsetof(struct bpf_sock, src_ip4):
@@ -6529,6 +6843,16 @@ static u32 xdp_convert_ctx_access(enum bpf_access_type type,
 				      offsetof(struct xdp_rxq_info,
 					       queue_index));
 		break;
+	case offsetof(struct xdp_md, egress_ifindex):
+		*insn++ = BPF_LDX_MEM(BPF_FIELD_SIZEOF(struct xdp_buff, txq),
+				      si->dst_reg, si->src_reg,
+				      offsetof(struct xdp_buff, txq));
+		*insn++ = BPF_LDX_MEM(BPF_FIELD_SIZEOF(struct xdp_txq_info, dev),
+				      si->dst_reg, si->dst_reg,
+				      offsetof(struct xdp_txq_info, dev));
+		*insn++ = BPF_LDX_MEM(BPF_W, si->dst_reg, si->dst_reg,
+				      offsetof(struct net_device, ifindex));
+		break;
 	}
 
 	return insn - insn_buf;
@@ -6660,20 +6984,13 @@ static u32 sock_addr_convert_ctx_access(enum bpf_access_type type,
 		break;
 
 	case offsetof(struct bpf_sock_addr, type):
-		SOCK_ADDR_LOAD_NESTED_FIELD_SIZE_OFF(
-			struct bpf_sock_addr_kern, struct sock, sk,
-			__sk_flags_offset, BPF_W, 0);
-		*insn++ = BPF_ALU32_IMM(BPF_AND, si->dst_reg, SK_FL_TYPE_MASK);
-		*insn++ = BPF_ALU32_IMM(BPF_RSH, si->dst_reg, SK_FL_TYPE_SHIFT);
+		SOCK_ADDR_LOAD_NESTED_FIELD(struct bpf_sock_addr_kern,
+					    struct sock, sk, sk_type);
 		break;
 
 	case offsetof(struct bpf_sock_addr, protocol):
-		SOCK_ADDR_LOAD_NESTED_FIELD_SIZE_OFF(
-			struct bpf_sock_addr_kern, struct sock, sk,
-			__sk_flags_offset, BPF_W, 0);
-		*insn++ = BPF_ALU32_IMM(BPF_AND, si->dst_reg, SK_FL_PROTO_MASK);
-		*insn++ = BPF_ALU32_IMM(BPF_RSH, si->dst_reg,
-					SK_FL_PROTO_SHIFT);
+		SOCK_ADDR_LOAD_NESTED_FIELD(struct bpf_sock_addr_kern,
+					    struct sock, sk, sk_protocol);
 		break;
 
 	case offsetof(struct bpf_sock_addr, msg_src_ip4):
@@ -7595,11 +7912,11 @@ sk_reuseport_is_valid_access(int off, int size,
 				    skb,				\
 				    SKB_FIELD)
 
-#define SK_REUSEPORT_LOAD_SK_FIELD_SIZE_OFF(SK_FIELD, BPF_SIZE, EXTRA_OFF) \
-	SOCK_ADDR_LOAD_NESTED_FIELD_SIZE_OFF(struct sk_reuseport_kern,	\
-					     struct sock,		\
-					     sk,			\
-					     SK_FIELD, BPF_SIZE, EXTRA_OFF)
+#define SK_REUSEPORT_LOAD_SK_FIELD(SK_FIELD)				\
+	SOCK_ADDR_LOAD_NESTED_FIELD(struct sk_reuseport_kern,		\
+				    struct sock,			\
+				    sk,					\
+				    SK_FIELD)
 
 static u32 sk_reuseport_convert_ctx_access(enum bpf_access_type type,
 					   const struct bpf_insn *si,
@@ -7623,16 +7940,7 @@ static u32 sk_reuseport_convert_ctx_access(enum bpf_access_type type,
 		break;
 
 	case offsetof(struct sk_reuseport_md, ip_protocol):
-		BUILD_BUG_ON(HWEIGHT32(SK_FL_PROTO_MASK) != BITS_PER_BYTE);
-		SK_REUSEPORT_LOAD_SK_FIELD_SIZE_OFF(__sk_flags_offset,
-						    BPF_W, 0);
-		*insn++ = BPF_ALU32_IMM(BPF_AND, si->dst_reg, SK_FL_PROTO_MASK);
-		*insn++ = BPF_ALU32_IMM(BPF_RSH, si->dst_reg,
-					SK_FL_PROTO_SHIFT);
-		/* SK_FL_PROTO_MASK and SK_FL_PROTO_SHIFT are endian
-		 * aware.  No further narrowing or masking is needed.
-		 */
-		*target_size = 1;
+		SK_REUSEPORT_LOAD_SK_FIELD(sk_protocol);
 		break;
 
 	case offsetof(struct sk_reuseport_md, data_end):
@@ -7660,3 +7968,12 @@ const struct bpf_verifier_ops sk_reuseport_verifier_ops = {
 const struct bpf_prog_ops sk_reuseport_prog_ops = {
 };
 #endif /* CONFIG_INET */
+
+DEFINE_BPF_DISPATCHER(bpf_dispatcher_xdp)
+
+/* Called when the XDP program of a device, driver or generic, changes */
+void bpf_prog_change_xdp(struct bpf_prog *prev_prog, struct bpf_prog *prog)
+{
+	bpf_dispatcher_change_prog(BPF_DISPATCHER_PTR(bpf_dispatcher_xdp),
+				   prev_prog, prog);
+}
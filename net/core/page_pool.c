@@ -8,11 +8,16 @@
 #include <linux/kernel.h>
 #include <linux/slab.h>
 
+#include <net/devmem.h>
 #include <net/page_pool.h>
 #include <linux/dma-direction.h>
 #include <linux/dma-mapping.h>
 #include <linux/page-flags.h>
 #include <linux/mm.h> /* for __put_page() */
+#include <linux/poison.h>
+
+#define DEFER_TIME (msecs_to_jiffies(1000))
+#define DEFER_WARN_INTERVAL (60 * HZ)
 
 static int page_pool_init(struct page_pool *pool,
 			  const struct page_pool_params *params)
@@ -43,6 +48,10 @@ static int page_pool_init(struct page_pool *pool,
 	if (ptr_ring_init(&pool->ring, ring_qsize, GFP_KERNEL) < 0)
 		return -ENOMEM;
 
+	/* Device memory is mapped once for the whole binding */
+	if (pool->p.binding)
+		refcount_inc(&pool->p.binding->ref);
+
 	return 0;
 }
 
@@ -149,6 +158,10 @@ static struct page *__page_pool_alloc_pages_slow(struct page_pool *pool,
 	set_page_private(page, dma); /* page->private = dma; */
 
 skip_dma_map:
+	page->pp_magic = PP_SIGNATURE;
+	page->pp = pool;
+	pool->pages_state_hold_cnt++;
+
 	/* When page just alloc'ed is should/must have refcnt 1. */
 	return page;
 }
@@ -171,19 +184,30 @@ struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp)
 }
 EXPORT_SYMBOL(page_pool_alloc_pages);
 
-/* Cleanup page_pool state from page */
+/* Cleanup page_pool state from page, it no longer belongs to the pool */
 static void __page_pool_clean_page(struct page_pool *pool,
 				   struct page *page)
 {
 	if (!(pool->p.flags & PP_FLAG_DMA_MAP))
-		return;
+		goto skip_dma_unmap;
 
 	/* DMA unmap */
 	dma_unmap_page(pool->p.dev, page_private(page),
 		       PAGE_SIZE << pool->p.order, pool->p.dma_dir);
 	set_page_private(page, 0);
+
+skip_dma_unmap:
+	page->pp_magic = 0;
+	page->pp = NULL;
+	atomic_inc(&pool->pages_state_release_cnt);
 }
 
+void page_pool_release_page(struct page_pool *pool, struct page *page)
+{
+	__page_pool_clean_page(pool, page);
+}
+EXPORT_SYMBOL(page_pool_release_page);
+
 /* Return a page to the page allocator, cleaning up our state */
 static void __page_pool_return_page(struct page_pool *pool, struct page *page)
 {
@@ -264,6 +288,61 @@ void __page_pool_put_page(struct page_pool *pool,
 }
 EXPORT_SYMBOL(__page_pool_put_page);
 
+bool page_pool_return_skb_page(struct page *page)
+{
+	page = compound_head(page);
+
+	/* Pages the pool has let go of, and pages that never came from a
+	 * pool, are left to the regular put_page() path.
+	 */
+	if (unlikely(page->pp_magic != PP_SIGNATURE))
+		return false;
+
+	/* The skb free path can run on any CPU, so the page is never put
+	 * straight into the allocation side cache.
+	 */
+	page_pool_put_page(page->pp, page, false);
+	return true;
+}
+EXPORT_SYMBOL(page_pool_return_skb_page);
+
+#ifdef CONFIG_NET_DEVMEM
+/**
+ * page_pool_alloc_net_iov - allocate a buffer from device memory
+ * @pool: a pool created with a device memory binding
+ *
+ * Same context rules as page_pool_alloc_pages().  The buffer comes with
+ * one reference, for the driver to hand to an skb frag or drop with
+ * net_iov_put().
+ */
+struct net_iov *page_pool_alloc_net_iov(struct page_pool *pool)
+{
+	struct net_iov *niov;
+
+	if (WARN_ON_ONCE(!pool->p.binding))
+		return NULL;
+
+	niov = net_devmem_alloc_niov(pool->p.binding);
+	if (!niov)
+		return NULL;
+
+	niov->pp = pool;
+	atomic_set(&niov->ref, 1);
+	pool->pages_state_hold_cnt++;
+	return niov;
+}
+EXPORT_SYMBOL(page_pool_alloc_net_iov);
+
+void page_pool_put_net_iov(struct page_pool *pool, struct net_iov *niov)
+{
+	niov->pp = NULL;
+	net_devmem_free_niov(niov);
+	/* Last, the pool may go away as soon as nothing is in flight */
+	atomic_inc(&pool->pages_state_release_cnt);
+}
+EXPORT_SYMBOL(page_pool_put_net_iov);
+#endif
+
 static void __page_pool_empty_ring(struct page_pool *pool)
 {
 	struct page *page;
@@ -289,11 +368,14 @@ static void __page_pool_destroy_rcu(struct rcu_head *rcu)
 
 	__page_pool_empty_ring(pool);
 	ptr_ring_cleanup(&pool->ring, NULL);
+#ifdef CONFIG_NET_DEVMEM
+	if (pool->p.binding)
+		net_devmem_binding_put(pool->p.binding);
+#endif
 	kfree(pool);
 }
 
-/* Cleanup and release resources */
-void page_pool_destroy(struct page_pool *pool)
+static void __page_pool_empty_alloc_cache(struct page_pool *pool)
 {
 	struct page *page;
 
@@ -305,12 +387,64 @@ void page_pool_destroy(struct page_pool *pool)
 		page = pool->alloc.cache[--pool->alloc.count];
 		__page_pool_return_page(pool, page);
 	}
+}
+
+static int page_pool_inflight(struct page_pool *pool)
+{
+	u32 release_cnt = atomic_read(&pool->pages_state_release_cnt);
+
+	return (s32)(pool->pages_state_hold_cnt - release_cnt);
+}
+
+/* Returns the number of pages still in flight */
+static int page_pool_release(struct page_pool *pool)
+{
+	__page_pool_empty_alloc_cache(pool);
 
 	/* No more consumers should exist, but producers could still
 	 * be in-flight.
 	 */
 	__page_pool_empty_ring(pool);
 
+	return page_pool_inflight(pool);
+}
+
+static void page_pool_release_retry(struct work_struct *wq)
+{
+	struct delayed_work *dwq = to_delayed_work(wq);
+	struct page_pool *pool = container_of(dwq, typeof(*pool), release_dw);
+	int inflight;
+
+	inflight = page_pool_release(pool);
+	if (!inflight) {
+		call_rcu(&pool->rcu, __page_pool_destroy_rcu);
+		return;
+	}
+
+	/* Periodic warning */
+	if (time_after_eq(jiffies, pool->defer_warn)) {
+		pr_warn("%s() stalled pool shutdown %d inflight\n",
+			__func__, inflight);
+		pool->defer_warn = jiffies + DEFER_WARN_INTERVAL;
+	}
+
+	/* Still not ready to be disconnected, retry later */
+	schedule_delayed_work(&pool->release_dw, DEFER_TIME);
+}
+
+/* Cleanup and release resources */
+void page_pool_destroy(struct page_pool *pool)
+{
+	/* Pages still referenced from skbs point back at the pool, so
+	 * its memory outlives this call until the last one returns.
+	 */
+	if (page_pool_release(pool)) {
+		pool->defer_warn = jiffies + DEFER_WARN_INTERVAL;
+		INIT_DELAYED_WORK(&pool->release_dw, page_pool_release_retry);
+		schedule_delayed_work(&pool->release_dw, DEFER_TIME);
+		return;
+	}
+
 	/* An xdp_mem_allocator can still ref page_pool pointer */
 	call_rcu(&pool->rcu, __page_pool_destroy_rcu);
 }
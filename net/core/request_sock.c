@@ -12,6 +12,7 @@
  */
 
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/random.h>
 #include <linux/slab.h>
 #include <linux/string.h>
@@ -47,6 +48,105 @@ void reqsk_queue_alloc(struct request_sock_queue *queue)
 	queue->rskq_accept_head = NULL;
 }
 
+/* Split the accept queue of a listener into per-CPU FIFOs.  Children are
+ * queued on the CPU that completed their handshake, and accept() prefers
+ * the FIFO of the CPU it runs on, so that the softirq, accept() and the
+ * processing of a connection tend to stay on one CPU.  The FIFOs are only
+ * freed with the socket, as a child being added may still reference
+ * them after the listener was closed.
+ */
+int reqsk_subqueue_alloc(struct request_sock_queue *queue)
+{
+	struct request_sock_subqueue __percpu *subq;
+	int cpu;
+
+	if (queue->rskq_subq)
+		return 0;
+
+	subq = alloc_percpu(struct request_sock_subqueue);
+	if (!subq)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(subq, cpu)->lock);
+
+	atomic_set(&queue->rskq_subq_len, 0);
+	queue->rskq_subq = subq;
+	return 0;
+}
+
+void reqsk_subqueue_free(struct request_sock_queue *queue)
+{
+	free_percpu(queue->rskq_subq);
+	queue->rskq_subq = NULL;
+}
+
+/* Called with BH disabled.  parent->sk_ack_backlog can no longer be
+ * updated under a single lock, so it mirrors rskq_subq_len instead.  Like
+ * the lockless readers of sk_acceptq_is_full(), it may be briefly off.
+ */
+void reqsk_subqueue_add(struct request_sock_queue *queue,
+			struct request_sock *req, struct sock *parent)
+{
+	struct request_sock_subqueue *subq = this_cpu_ptr(queue->rskq_subq);
+
+	req->dl_next = NULL;
+	if (subq->head == NULL)
+		subq->head = req;
+	else
+		subq->tail->dl_next = req;
+	subq->tail = req;
+	WRITE_ONCE(parent->sk_ack_backlog,
+		   atomic_inc_return(&queue->rskq_subq_len));
+}
+
+static struct request_sock *reqsk_subqueue_pop(struct request_sock_queue *queue,
+					       int cpu, struct sock *parent)
+{
+	struct request_sock_subqueue *subq = per_cpu_ptr(queue->rskq_subq, cpu);
+	struct request_sock *req;
+
+	if (!READ_ONCE(subq->head))
+		return NULL;
+
+	spin_lock_bh(&subq->lock);
+	req = subq->head;
+	if (req) {
+		subq->head = req->dl_next;
+		if (subq->head == NULL)
+			subq->tail = NULL;
+		WRITE_ONCE(parent->sk_ack_backlog,
+			   atomic_dec_return(&queue->rskq_subq_len));
+	}
+	spin_unlock_bh(&subq->lock);
+	return req;
+}
+
+/* Take a child from the local CPU's FIFO, or steal one from another CPU */
+struct request_sock *reqsk_subqueue_remove(struct request_sock_queue *queue,
+					   struct sock *parent)
+{
+	int this_cpu = raw_smp_processor_id();
+	struct request_sock *req;
+	int cpu;
+
+	if (!atomic_read(&queue->rskq_subq_len))
+		return NULL;
+
+	req = reqsk_subqueue_pop(queue, this_cpu, parent);
+	if (req)
+		return req;
+
+	for_each_possible_cpu(cpu) {
+		if (cpu == this_cpu)
+			continue;
+		req = reqsk_subqueue_pop(queue, cpu, parent);
+		if (req)
+			return req;
+	}
+	return NULL;
+}
+
 /*
  * This function is called to set a Fast Open socket's "fastopen_rsk" field
  * to NULL when a TFO socket no longer needs to access the request_sock.
@@ -69,6 +69,7 @@
 #include <net/sock.h>
 #include <net/checksum.h>
 #include <net/ip6_checksum.h>
+#include <net/ipv6.h>
 #include <net/xfrm.h>
 
 #include <linux/uaccess.h>
@@ -151,6 +152,129 @@ static void *__kmalloc_reserve(size_t size, gfp_t flags, int node,
 	return obj;
 }
 
+/*
+ * Per-CPU caches of skb heads, one for skbuff_head_cache and one for
+ * skbuff_fclone_cache, used for heads allocated and freed in any context.
+ * Misses are refilled with kmem_cache_alloc_bulk(), and an overflowing
+ * cache gives half of its heads back with kmem_cache_free_bulk(), so the
+ * heads freed on TX completion are reused for the next packets sent.
+ * The slab bulk calls may enable interrupts, so they are made outside of
+ * the irq-off sections that protect the caches, and only by callers that
+ * run with interrupts on: others miss and overflow one head at a time.
+ */
+#define SKB_HEAD_CACHE_SIZE	64
+#define SKB_HEAD_CACHE_REFILL	16
+
+struct skb_head_cache {
+	unsigned int count;
+	void *objs[SKB_HEAD_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct skb_head_cache, skb_head_caches[2]);
+
+static struct skb_head_cache *skb_head_cache_get(struct kmem_cache *cache)
+{
+	return this_cpu_ptr(&skb_head_caches[cache == skbuff_fclone_cache]);
+}
+
+static bool skb_head_bulk_ok(void)
+{
+	return !irqs_disabled() && !in_irq();
+}
+
+static void *skb_head_alloc(struct kmem_cache *cache, gfp_t gfp_mask,
+			    int node)
+{
+	void *objs[SKB_HEAD_CACHE_REFILL];
+	struct skb_head_cache *hc;
+	unsigned long flags;
+	int n;
+
+	/* Heads from the reserves or from another node are not cached */
+	if ((gfp_mask & __GFP_MEMALLOC) ||
+	    (node != NUMA_NO_NODE && node != numa_mem_id()))
+		return kmem_cache_alloc_node(cache, gfp_mask, node);
+
+	local_irq_save(flags);
+	hc = skb_head_cache_get(cache);
+	if (likely(hc->count)) {
+		objs[0] = hc->objs[--hc->count];
+		local_irq_restore(flags);
+		return objs[0];
+	}
+	local_irq_restore(flags);
+
+	if (!skb_head_bulk_ok())
+		return kmem_cache_alloc_node(cache, gfp_mask, node);
+
+	n = kmem_cache_alloc_bulk(cache, gfp_mask, SKB_HEAD_CACHE_REFILL, objs);
+	if (unlikely(!n))
+		return kmem_cache_alloc_node(cache, gfp_mask, node);
+
+	/* We may have moved to another CPU, whose cache may have filled */
+	local_irq_save(flags);
+	hc = skb_head_cache_get(cache);
+	while (n > 1 && hc->count < SKB_HEAD_CACHE_SIZE)
+		hc->objs[hc->count++] = objs[--n];
+	local_irq_restore(flags);
+
+	if (n > 1)
+		kmem_cache_free_bulk(cache, n - 1, objs + 1);
+	return objs[0];
+}
+
+static bool skb_head_cacheable(void *obj)
+{
+	struct page *page = virt_to_head_page(obj);
+
+	return page_to_nid(page) == numa_mem_id() && !PageSlabPfmemalloc(page);
+}
+
+/* Give @n heads, none of them from the reserves, to the per-CPU cache. */
+static void skb_head_free_bulk(struct kmem_cache *cache, void **objs,
+			       unsigned int n)
+{
+	void *spill[SKB_HEAD_CACHE_SIZE / 2];
+	struct skb_head_cache *hc;
+	unsigned long flags;
+	unsigned int nr_spill = 0;
+	bool bulk = skb_head_bulk_ok();
+
+	local_irq_save(flags);
+	hc = skb_head_cache_get(cache);
+	while (n) {
+		if (hc->count == SKB_HEAD_CACHE_SIZE) {
+			if (nr_spill || !bulk)
+				break;
+			nr_spill = SKB_HEAD_CACHE_SIZE / 2;
+			hc->count -= nr_spill;
+			memcpy(spill, hc->objs + hc->count,
+			       nr_spill * sizeof(*spill));
+		}
+		hc->objs[hc->count++] = objs[--n];
+	}
+	local_irq_restore(flags);
+
+	if (nr_spill)
+		kmem_cache_free_bulk(cache, nr_spill, spill);
+	if (bulk) {
+		if (n)
+			kmem_cache_free_bulk(cache, n, objs);
+	} else {
+		while (n)
+			kmem_cache_free(cache, objs[--n]);
+	}
+}
+
+static void skb_head_free(struct kmem_cache *cache, void *obj)
+{
+	if (unlikely(!skb_head_cacheable(obj))) {
+		kmem_cache_free(cache, obj);
+		return;
+	}
+	skb_head_free_bulk(cache, &obj, 1);
+}
+
 /* 	Allocate a new skbuff. We do this ourselves so we can fill in a few
  *	'private' fields and also do memory statistics to find all the
  *	[BEEP] leaks.
@@ -190,7 +314,7 @@ struct sk_buff *__alloc_skb(unsigned int size, gfp_t gfp_mask,
 		gfp_mask |= __GFP_MEMALLOC;
 
 	/* Get the HEAD */
-	skb = kmem_cache_alloc_node(cache, gfp_mask & ~__GFP_DMA, node);
+	skb = skb_head_alloc(cache, gfp_mask & ~__GFP_DMA, node);
 	if (!skb)
 		goto out;
 	prefetchw(skb);
@@ -278,7 +402,7 @@ struct sk_buff *__build_skb(void *data, unsigned int frag_size)
 	struct sk_buff *skb;
 	unsigned int size = frag_size ? : ksize(data);
 
-	skb = kmem_cache_alloc(skbuff_head_cache, GFP_ATOMIC);
+	skb = skb_head_alloc(skbuff_head_cache, GFP_ATOMIC, NUMA_NO_NODE);
 	if (!skb)
 		return NULL;
 
@@ -509,6 +633,35 @@ void skb_add_rx_frag(struct sk_buff *skb, int i, struct page *page, int off,
 }
 EXPORT_SYMBOL(skb_add_rx_frag);
 
+/**
+ * skb_add_rx_frag_net_iov - add a device memory fragment to an skb
+ * @skb: the buffer, whose headers are in host memory
+ * @i: frag index
+ * @niov: the device memory, whose reference moves to the skb
+ * @off: offset of the data in @niov
+ * @size: length of the data
+ * @truesize: memory charged for it
+ *
+ * The skb is marked @devmem, its payload is then never read by the stack.
+ * The checksum must have been verified by the device.
+ */
+void skb_add_rx_frag_net_iov(struct sk_buff *skb, int i, struct net_iov *niov,
+			     int off, int size, unsigned int truesize)
+{
+	skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+
+	frag->page.p = (struct page *)((unsigned long)niov | SKB_FRAG_NET_IOV);
+	frag->page_offset = off;
+	skb_frag_size_set(frag, size);
+	skb_shinfo(skb)->nr_frags = i + 1;
+
+	skb->devmem = 1;
+	skb->len += size;
+	skb->data_len += size;
+	skb->truesize += truesize;
+}
+EXPORT_SYMBOL(skb_add_rx_frag_net_iov);
+
 void skb_coalesce_rx_frag(struct sk_buff *skb, int i, int size,
 			  unsigned int truesize)
 {
@@ -540,14 +693,26 @@ static void skb_clone_fraglist(struct sk_buff *skb)
 		skb_get(list);
 }
 
+static bool skb_pp_recycle(struct sk_buff *skb, void *data)
+{
+#ifdef CONFIG_PAGE_POOL
+	if (skb->pp_recycle)
+		return page_pool_return_skb_page(virt_to_head_page(data));
+#endif
+	return false;
+}
+
 static void skb_free_head(struct sk_buff *skb)
 {
 	unsigned char *head = skb->head;
 
-	if (skb->head_frag)
+	if (skb->head_frag) {
+		if (skb_pp_recycle(skb, head))
+			return;
 		skb_free_frag(head);
-	else
+	} else {
 		kfree(head);
+	}
 }
 
 static void skb_release_data(struct sk_buff *skb)
@@ -561,7 +726,7 @@ static void skb_release_data(struct sk_buff *skb)
 		return;
 
 	for (i = 0; i < shinfo->nr_frags; i++)
-		__skb_frag_unref(&shinfo->frags[i]);
+		__skb_frag_unref(&shinfo->frags[i], skb->pp_recycle);
 
 	if (shinfo->frag_list)
 		kfree_skb_list(shinfo->frag_list);
@@ -579,7 +744,7 @@ static void kfree_skbmem(struct sk_buff *skb)
 
 	switch (skb->fclone) {
 	case SKB_FCLONE_UNAVAILABLE:
-		kmem_cache_free(skbuff_head_cache, skb);
+		skb_head_free(skbuff_head_cache, skb);
 		return;
 
 	case SKB_FCLONE_ORIG:
@@ -600,7 +765,7 @@ static void kfree_skbmem(struct sk_buff *skb)
 	if (!refcount_dec_and_test(&fclones->fclone_ref))
 		return;
 fastpath:
-	kmem_cache_free(skbuff_fclone_cache, fclones);
+	skb_head_free(skbuff_fclone_cache, fclones);
 }
 
 void skb_release_head_state(struct sk_buff *skb)
@@ -720,10 +885,10 @@ void __kfree_skb_flush(void)
 {
 	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
 
-	/* flush skb_cache if containing objects */
+	/* hand skb_cache over to the per-CPU head cache for reuse */
 	if (nc->skb_count) {
-		kmem_cache_free_bulk(skbuff_head_cache, nc->skb_count,
-				     nc->skb_cache);
+		skb_head_free_bulk(skbuff_head_cache, nc->skb_cache,
+				   nc->skb_count);
 		nc->skb_count = 0;
 	}
 }
@@ -735,6 +900,11 @@ static inline void _kfree_skb_defer(struct sk_buff *skb)
 	/* drop skb->head and call any destructors for packet */
 	skb_release_all(skb);
 
+	if (unlikely(!skb_head_cacheable(skb))) {
+		kmem_cache_free(skbuff_head_cache, skb);
+		return;
+	}
+
 	/* record skb to CPU local list */
 	nc->skb_cache[nc->skb_count++] = skb;
 
@@ -745,8 +915,8 @@ static inline void _kfree_skb_defer(struct sk_buff *skb)
 
 	/* flush skb_cache if it is filled */
 	if (unlikely(nc->skb_count == NAPI_SKB_CACHE_SIZE)) {
-		kmem_cache_free_bulk(skbuff_head_cache, NAPI_SKB_CACHE_SIZE,
-				     nc->skb_cache);
+		skb_head_free_bulk(skbuff_head_cache, nc->skb_cache,
+				   NAPI_SKB_CACHE_SIZE);
 		nc->skb_count = 0;
 	}
 }
@@ -859,6 +1029,7 @@ static struct sk_buff *__skb_clone(struct sk_buff *n, struct sk_buff *skb)
 	n->nohdr = 0;
 	n->peeked = 0;
 	C(pfmemalloc);
+	C(pp_recycle);
 	n->destructor = NULL;
 	C(tail);
 	C(end);
@@ -1277,7 +1448,7 @@ struct sk_buff *skb_clone(struct sk_buff *skb, gfp_t gfp_mask)
 		if (skb_pfmemalloc(skb))
 			gfp_mask |= __GFP_MEMALLOC;
 
-		n = kmem_cache_alloc(skbuff_head_cache, gfp_mask);
+		n = skb_head_alloc(skbuff_head_cache, gfp_mask, NUMA_NO_NODE);
 		if (!n)
 			return NULL;
 
@@ -1342,9 +1513,12 @@ struct sk_buff *skb_copy(const struct sk_buff *skb, gfp_t gfp_mask)
 {
 	int headerlen = skb_headroom(skb);
 	unsigned int size = skb_end_offset(skb) + skb->data_len;
-	struct sk_buff *n = __alloc_skb(size, gfp_mask,
-					skb_alloc_rx_flag(skb), NUMA_NO_NODE);
+	struct sk_buff *n;
+
+	if (!skb_frags_readable(skb))
+		return NULL;
 
+	n = __alloc_skb(size, gfp_mask, skb_alloc_rx_flag(skb), NUMA_NO_NODE);
 	if (!n)
 		return NULL;
 
@@ -1571,15 +1745,18 @@ struct sk_buff *skb_copy_expand(const struct sk_buff *skb,
 				int newheadroom, int newtailroom,
 				gfp_t gfp_mask)
 {
-	/*
-	 *	Allocate the copy buffer
-	 */
-	struct sk_buff *n = __alloc_skb(newheadroom + skb->len + newtailroom,
-					gfp_mask, skb_alloc_rx_flag(skb),
-					NUMA_NO_NODE);
 	int oldheadroom = skb_headroom(skb);
 	int head_copy_len, head_copy_off;
+	struct sk_buff *n;
+
+	if (!skb_frags_readable(skb))
+		return NULL;
 
+	/*
+	 *	Allocate the copy buffer
+	 */
+	n = __alloc_skb(newheadroom + skb->len + newtailroom,
+			gfp_mask, skb_alloc_rx_flag(skb), NUMA_NO_NODE);
 	if (!n)
 		return NULL;
 
@@ -1893,8 +2070,12 @@ void *__pskb_pull_tail(struct sk_buff *skb, int delta)
 			return NULL;
 	}
 
-	BUG_ON(skb_copy_bits(skb, skb_headlen(skb),
-			     skb_tail_pointer(skb), delta));
+	if (skb_copy_bits(skb, skb_headlen(skb),
+			  skb_tail_pointer(skb), delta)) {
+		/* Only device memory cannot be pulled into the head */
+		BUG_ON(skb_frags_readable(skb));
+		return NULL;
+	}
 
 	/* Optimization: no fragments, no reasons to preestimate
 	 * size of pulled pages. Superb.
@@ -2052,6 +2233,9 @@ int skb_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
 			if (copy > len)
 				copy = len;
 
+			if (skb_frag_is_net_iov(f))
+				goto fault;
+
 			skb_frag_foreach_page(f,
 					      f->page_offset + offset - start,
 					      copy, p, p_off, p_len, copied) {
@@ -2228,6 +2412,10 @@ static bool __skb_splice_bits(struct sk_buff *skb, struct pipe_inode_info *pipe,
 	for (seg = 0; seg < skb_shinfo(skb)->nr_frags; seg++) {
 		const skb_frag_t *f = &skb_shinfo(skb)->frags[seg];
 
+		/* Device memory has no page to put in the pipe */
+		if (skb_frag_is_net_iov(f))
+			return true;
+
 		if (__splice_segment(skb_frag_page(f),
 				     f->page_offset, skb_frag_size(f),
 				     offset, len, spd, false, sk, pipe))
@@ -2504,6 +2692,10 @@ __wsum __skb_checksum(const struct sk_buff *skb, int offset, int len,
 			if (copy > len)
 				copy = len;
 
+			/* The device verified the checksum of device memory */
+			if (WARN_ON_ONCE(skb_frag_is_net_iov(frag)))
+				return 0;
+
 			skb_frag_foreach_page(frag,
 					      frag->page_offset + offset - start,
 					      copy, p, p_off, p_len, copied) {
@@ -3104,6 +3296,10 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 		return 0;
 	if (skb_zcopy(tgt) || skb_zcopy(skb))
 		return 0;
+	if (tgt->pp_recycle != skb->pp_recycle)
+		return 0;
+	if (tgt->devmem != skb->devmem)
+		return 0;
 
 	todo = shiftlen;
 	from = 0;
@@ -3184,7 +3380,7 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 		fragto = &skb_shinfo(tgt)->frags[merge];
 
 		skb_frag_size_add(fragto, skb_frag_size(fragfrom));
-		__skb_frag_unref(fragfrom);
+		__skb_frag_unref(fragfrom, skb->pp_recycle);
 	}
 
 	/* Reposition in the original skb */
@@ -3435,6 +3631,89 @@ static inline skb_frag_t skb_head_frag_to_page_desc(struct sk_buff *frag_skb)
 	return head_frag;
 }
 
+/**
+ *	skb_segment_list - Segment a GRO frag_list chain back into packets
+ *	@skb: buffer to segment
+ *	@features: features for the output path (see dev->features)
+ *	@offset: length of the headers in front of the network header
+ *
+ *	Undo the work of skb_gro_receive_list(): the skbs on the frag_list
+ *	become the segments again and get a copy of the head's headers.  No
+ *	payload is copied.  The original skb stays the first segment, so an
+ *	extra reference is taken for the caller to drop.
+ */
+struct sk_buff *skb_segment_list(struct sk_buff *skb,
+				 netdev_features_t features,
+				 unsigned int offset)
+{
+	struct sk_buff *list_skb = skb_shinfo(skb)->frag_list;
+	unsigned int tnl_hlen = skb_tnl_header_len(skb);
+	unsigned int delta_truesize = 0;
+	unsigned int delta_len = 0;
+	struct sk_buff *tail = NULL;
+	struct sk_buff *nskb;
+	int len_diff;
+
+	skb_push(skb, -skb_network_offset(skb) + offset);
+
+	skb_shinfo(skb)->frag_list = NULL;
+
+	do {
+		nskb = list_skb;
+		list_skb = list_skb->next;
+
+		if (!tail)
+			skb->next = nskb;
+		else
+			tail->next = nskb;
+
+		tail = nskb;
+
+		delta_len += nskb->len;
+		delta_truesize += nskb->truesize;
+
+		skb_push(nskb, -skb_network_offset(nskb) + offset);
+
+		skb_release_head_state(nskb);
+		len_diff = skb_network_header_len(nskb) -
+			   skb_network_header_len(skb);
+		__copy_skb_header(nskb, skb);
+
+		skb_headers_offset_update(nskb,
+					  skb_headroom(nskb) - skb_headroom(skb));
+		nskb->transport_header += len_diff;
+		skb_copy_from_linear_data_offset(skb, -tnl_hlen,
+						 nskb->data - tnl_hlen,
+						 offset + tnl_hlen);
+
+		if (skb_needs_linearize(nskb, features) &&
+		    __skb_linearize(nskb))
+			goto err_linearize;
+	} while (list_skb);
+
+	skb->truesize = skb->truesize - delta_truesize;
+	skb->data_len = skb->data_len - delta_len;
+	skb->len = skb->len - delta_len;
+
+	skb_gso_reset(skb);
+
+	skb->prev = tail;
+
+	if (skb_needs_linearize(skb, features) &&
+	    __skb_linearize(skb))
+		goto err_linearize;
+
+	skb_get(skb);
+
+	return skb;
+
+err_linearize:
+	kfree_skb_list(skb->next);
+	skb->next = NULL;
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL_GPL(skb_segment_list);
+
 /**
  *	skb_segment - Perform protocol segmentation on skb.
  *	@head_skb: buffer to segment
@@ -3768,14 +4047,37 @@ int skb_gro_receive(struct sk_buff *p, struct sk_buff *skb)
 	unsigned int headlen = skb_headlen(skb);
 	unsigned int len = skb_gro_len(skb);
 	unsigned int delta_truesize;
+	unsigned int gro_max_size;
 	struct sk_buff *lp;
 
-	if (unlikely(p->len + len >= 65536))
+	gro_max_size = READ_ONCE(p->dev->gro_max_size);
+	if (unlikely(p->len + len >= gro_max_size))
 		return -E2BIG;
 
+	/* Only TCP gets here, and the IPv4 and IPv6 gro_complete handlers
+	 * can describe the length of a packet above 64k, but the length
+	 * fields of a tunnel header cannot.  IPv6 also needs room in front
+	 * of the packet to insert the jumbo payload option.
+	 */
+	if (unlikely(p->len + len >= GRO_LEGACY_MAX_SIZE)) {
+		if (NAPI_GRO_CB(p)->encap_mark ||
+		    (p->protocol == htons(ETH_P_IPV6) &&
+		     skb_mac_header(p) - p->head <
+		     sizeof(struct hop_jumbo_hdr)))
+			return -E2BIG;
+	}
+
 	lp = NAPI_GRO_CB(p)->last;
 	pinfo = skb_shinfo(lp);
 
+	/* Page pool and non page pool pages can not be mixed in one skb */
+	if (p->pp_recycle != skb->pp_recycle)
+		return -ETOOMANYREFS;
+
+	/* Neither can device memory and host memory */
+	if (p->devmem != skb->devmem)
+		return -ETOOMANYREFS;
+
 	if (headlen <= offset) {
 		skb_frag_t *frag;
 		skb_frag_t *frag2;
@@ -3837,6 +4139,10 @@ int skb_gro_receive(struct sk_buff *p, struct sk_buff *skb)
 	}
 
 merge:
+	/* Device memory receive only walks frags, not a frag_list */
+	if (p->devmem)
+		return -E2BIG;
+
 	delta_truesize = skb->truesize;
 	if (offset > headlen) {
 		unsigned int eat = offset - headlen;
@@ -3873,6 +4179,32 @@ int skb_gro_receive(struct sk_buff *p, struct sk_buff *skb)
 }
 EXPORT_SYMBOL_GPL(skb_gro_receive);
 
+/* Chain @skb onto @p's frag_list without touching the payload, so that
+ * the packets can be sent out again unchanged by skb_segment_list().
+ */
+int skb_gro_receive_list(struct sk_buff *p, struct sk_buff *skb)
+{
+	if (unlikely(p->len + skb->len >= GRO_LEGACY_MAX_SIZE))
+		return -E2BIG;
+
+	if (NAPI_GRO_CB(p)->last == p)
+		skb_shinfo(p)->frag_list = skb;
+	else
+		NAPI_GRO_CB(p)->last->next = skb;
+
+	skb_pull(skb, skb_gro_offset(skb));
+
+	NAPI_GRO_CB(p)->last = skb;
+	NAPI_GRO_CB(p)->count++;
+	p->data_len += skb->len;
+	p->truesize += skb->truesize;
+	p->len += skb->len;
+
+	NAPI_GRO_CB(skb)->same_flow = 1;
+
+	return 0;
+}
+
 void __init skb_init(void)
 {
 	skbuff_head_cache = kmem_cache_create_usercopy("skbuff_head_cache",
@@ -4740,7 +5072,7 @@ void kfree_skb_partial(struct sk_buff *skb, bool head_stolen)
 {
 	if (head_stolen) {
 		skb_release_head_state(skb);
-		kmem_cache_free(skbuff_head_cache, skb);
+		skb_head_free(skbuff_head_cache, skb);
 	} else {
 		__kfree_skb(skb);
 	}
@@ -4765,7 +5097,18 @@ bool skb_try_coalesce(struct sk_buff *to, struct sk_buff *from,
 	if (skb_cloned(to))
 		return false;
 
-	if (len <= skb_tailroom(to)) {
+	/* The page pool signature of struct page will eventually figure out
+	 * which pages can be recycled or not but for now let's prohibit slab
+	 * allocated and page_pool allocated SKBs from being coalesced.
+	 */
+	if (to->pp_recycle != from->pp_recycle)
+		return false;
+
+	/* Nor can device memory be mixed with host memory, or copied */
+	if (to->devmem != from->devmem)
+		return false;
+
+	if (len <= skb_tailroom(to) && skb_frags_readable(from)) {
 		if (len)
 			BUG_ON(skb_copy_bits(from, 0, skb_put(to, len), len));
 		*delta_truesize = 0;
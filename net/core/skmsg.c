@@ -579,11 +579,71 @@ void sk_psock_drop(struct sock *sk, struct sk_psock *psock)
 		sk_psock_stop_strp(sk, psock);
 	write_unlock_bh(&sk->sk_callback_lock);
 	sk_psock_clear_state(psock, SK_PSOCK_TX_ENABLED);
+	sk_psock_unpair(psock);
 
 	call_rcu_sched(&psock->rcu, sk_psock_destroy);
 }
 EXPORT_SYMBOL_GPL(sk_psock_drop);
 
+/* Pairs of psocks with SK_PSOCK_BYPASS, on both ends of a local connection.
+ * Each holds a reference on the socket of the other, dropped when either
+ * goes away.
+ */
+static DEFINE_SPINLOCK(sk_psock_peer_lock);
+
+void sk_psock_pair(struct sk_psock *psock, struct sk_psock *peer)
+{
+	spin_lock_bh(&sk_psock_peer_lock);
+	/* a psock being dropped is past sk_psock_unpair(), or waiting on us */
+	if (!rcu_access_pointer(psock->sk_peer) &&
+	    !rcu_access_pointer(peer->sk_peer) &&
+	    sk_psock_test_state(psock, SK_PSOCK_TX_ENABLED) &&
+	    sk_psock_test_state(peer, SK_PSOCK_TX_ENABLED)) {
+		sock_hold(peer->sk);
+		rcu_assign_pointer(psock->sk_peer, peer->sk);
+		sock_hold(psock->sk);
+		rcu_assign_pointer(peer->sk_peer, psock->sk);
+	}
+	spin_unlock_bh(&sk_psock_peer_lock);
+}
+EXPORT_SYMBOL_GPL(sk_psock_pair);
+
+static void __sk_psock_unpair(struct sk_psock *psock, struct sock *sk)
+{
+	struct sock *peer;
+
+	peer = rcu_dereference_protected(psock->sk_peer,
+					 lockdep_is_held(&sk_psock_peer_lock));
+	if (!peer || (sk && peer != sk))
+		return;
+
+	RCU_INIT_POINTER(psock->sk_peer, NULL);
+	sock_put(peer);
+}
+
+void sk_psock_unpair(struct sk_psock *psock)
+{
+	struct sk_psock *peer_psock;
+	struct sock *peer;
+
+	spin_lock_bh(&sk_psock_peer_lock);
+	peer = rcu_dereference_protected(psock->sk_peer,
+					 lockdep_is_held(&sk_psock_peer_lock));
+	if (peer) {
+		/* the peer psock may be detached already, it then unpairs
+		 * itself when dropped
+		 */
+		rcu_read_lock();
+		peer_psock = sk_psock(peer);
+		if (peer_psock)
+			__sk_psock_unpair(peer_psock, psock->sk);
+		rcu_read_unlock();
+		__sk_psock_unpair(psock, NULL);
+	}
+	spin_unlock_bh(&sk_psock_peer_lock);
+}
+EXPORT_SYMBOL_GPL(sk_psock_unpair);
+
 static int sk_psock_map_verd(int verdict, bool redir)
 {
 	switch (verdict) {
@@ -137,6 +137,7 @@
 
 #include <linux/filter.h>
 #include <net/sock_reuseport.h>
+#include <net/bpf_sk_storage.h>
 
 #include <trace/events/sock.h>
 
@@ -650,6 +651,106 @@ EXPORT_SYMBOL(sk_mc_loop);
  *	at the socket level. Everything here is generic.
  */
 
+#ifdef CONFIG_NET_DEVMEM
+#define SOCK_DEVMEM_MAX_TOKENS	128
+#define SOCK_DEVMEM_MAX_FRAGS	1024
+
+/* Give back device memory frags received with MSG_SOCK_DEVMEM */
+static noinline_for_stack int
+sock_devmem_dontneed(struct sock *sk, char __user *optval, unsigned int optlen)
+{
+	unsigned int num_tokens, num_frags = 0, i, j;
+	struct dmabuf_token *tokens;
+	int ret = 0;
+
+	if (!optlen || optlen % sizeof(*tokens) ||
+	    optlen > sizeof(*tokens) * SOCK_DEVMEM_MAX_TOKENS)
+		return -EINVAL;
+
+	num_tokens = optlen / sizeof(*tokens);
+	tokens = kvmalloc_array(num_tokens, sizeof(*tokens), GFP_KERNEL);
+	if (!tokens)
+		return -ENOMEM;
+
+	if (copy_from_user(tokens, optval, optlen)) {
+		kvfree(tokens);
+		return -EFAULT;
+	}
+
+	for (i = 0; i < num_tokens; i++) {
+		for (j = 0; j < tokens[i].token_count; j++) {
+			struct net_iov *niov;
+
+			/* Bound the work done by a single call */
+			if (++num_frags > SOCK_DEVMEM_MAX_FRAGS)
+				goto out;
+
+			niov = xa_erase_bh(&sk->sk_user_frags,
+					   tokens[i].token_start + j);
+			if (!niov)
+				continue;
+
+			net_iov_put(niov);
+			ret++;
+		}
+	}
+
+out:
+	kvfree(tokens);
+	return ret;
+}
+
+/* Bind a dma-buf to a receive queue, the binding lives as long as @sk */
+static int sock_devmem_bind(struct sock *sk, char __user *optval,
+			    int __user *optlen)
+{
+	struct dmabuf_bind bind;
+	int len, err;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len != sizeof(bind))
+		return -EINVAL;
+	if (copy_from_user(&bind, optval, sizeof(bind)))
+		return -EFAULT;
+
+	err = net_devmem_bind_sk(sk, bind.ifindex, bind.rxq_idx,
+				 bind.dmabuf_fd, &bind.dmabuf_id);
+	if (err)
+		return err;
+
+	if (copy_to_user(optval, &bind, sizeof(bind)))
+		return -EFAULT;
+	return 0;
+}
+
+static void sock_devmem_release_frags(struct sock *sk)
+{
+	struct net_iov *niov;
+	unsigned long index = 0;
+
+	xa_for_each(&sk->sk_user_frags, niov, index, ULONG_MAX, XA_PRESENT)
+		net_iov_put(niov);
+	xa_destroy(&sk->sk_user_frags);
+}
+#else
+static int sock_devmem_dontneed(struct sock *sk, char __user *optval,
+				unsigned int optlen)
+{
+	return -ENOPROTOOPT;
+}
+
+static int sock_devmem_bind(struct sock *sk, char __user *optval,
+			    int __user *optlen)
+{
+	return -ENOPROTOOPT;
+}
+
+static void sock_devmem_release_frags(struct sock *sk)
+{
+}
+#endif
+
 int sock_setsockopt(struct socket *sock, int level, int optname,
 		    char __user *optval, unsigned int optlen)
 {
@@ -667,6 +768,9 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 	if (optname == SO_BINDTODEVICE)
 		return sock_setbindtodevice(sk, optval, optlen);
 
+	if (optname == SO_DEVMEM_DONTNEED)
+		return sock_devmem_dontneed(sk, optval, optlen);
+
 	if (optlen < sizeof(int))
 		return -EINVAL;
 
@@ -1382,6 +1486,9 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		v.val = sock_flag(sk, SOCK_ZEROCOPY);
 		break;
 
+	case SO_DEVMEM_BIND:
+		return sock_devmem_bind(sk, optval, optlen);
+
 	case SO_TXTIME:
 		lv = sizeof(v.txtime);
 		v.txtime.clockid = sk->sk_clockid;
@@ -1568,6 +1675,8 @@ static void __sk_destruct(struct rcu_head *head)
 	}
 	if (rcu_access_pointer(sk->sk_reuseport_cb))
 		reuseport_detach_sock(sk);
+	bpf_sk_storage_free(sk);
+	sock_devmem_release_frags(sk);
 
 	sock_disable_timestamp(sk, SK_FLAGS_TIMESTAMP);
 
@@ -1638,6 +1747,11 @@ static void sk_init_common(struct sock *sk)
 	lockdep_set_class_and_name(&sk->sk_callback_lock,
 			af_callback_keys + sk->sk_family,
 			af_family_clock_key_strings[sk->sk_family]);
+
+#ifdef CONFIG_NET_DEVMEM
+	INIT_LIST_HEAD(&sk->sk_devmem_bindings);
+	xa_init_flags(&sk->sk_user_frags, XA_FLAGS_ALLOC);
+#endif
 }
 
 /**
@@ -1676,6 +1790,10 @@ struct sock *sk_clone_lock(const struct sock *sk, const gfp_t priority)
 		refcount_set(&newsk->sk_wmem_alloc, 1);
 		atomic_set(&newsk->sk_omem_alloc, 0);
 		sk_init_common(newsk);
+#ifdef CONFIG_BPF_SYSCALL
+		/* BPF storage isn't inherited */
+		RCU_INIT_POINTER(newsk->sk_bpf_storage, NULL);
+#endif
 
 		newsk->sk_dst_cache	= NULL;
 		newsk->sk_dst_pending_confirm = 0;
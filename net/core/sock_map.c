@@ -19,7 +19,7 @@ struct bpf_stab {
 };
 
 #define SOCK_CREATE_FLAG_MASK				\
-	(BPF_F_NUMA_NODE | BPF_F_RDONLY | BPF_F_WRONLY)
+	(BPF_F_NUMA_NODE | BPF_F_RDONLY | BPF_F_WRONLY | BPF_F_SOCK_BYPASS)
 
 static struct bpf_map *sock_map_alloc(union bpf_attr *attr)
 {
@@ -199,6 +199,8 @@ static int sock_map_link(struct bpf_map *map, struct sk_psock_progs *progs,
 
 	if (msg_parser)
 		psock_set_prog(&psock->progs.msg_parser, msg_parser);
+	if (map->map_flags & BPF_F_SOCK_BYPASS)
+		sk_psock_set_state(psock, SK_PSOCK_BYPASS);
 	if (sk_psock_is_new) {
 		ret = tcp_bpf_init(sk);
 		if (ret < 0)
@@ -219,6 +221,8 @@ static int sock_map_link(struct bpf_map *map, struct sk_psock_progs *progs,
 		sk_psock_start_strp(sk, psock);
 	}
 	write_unlock_bh(&sk->sk_callback_lock);
+	if (sk_psock_test_state(psock, SK_PSOCK_BYPASS))
+		tcp_bpf_pair(sk, psock);
 	return 0;
 out_drop:
 	sk_psock_put(sk, psock);
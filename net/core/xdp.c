@@ -361,24 +361,56 @@ static void __xdp_return(void *data, struct xdp_mem_info *mem, bool napi_direct,
 	}
 }
 
+/* Fragments share the memory model of the head buffer. Zero-copy
+ * buffers are never multi-buffer, so no handle is needed here.
+ */
+static void xdp_return_frags(struct skb_shared_info *sinfo,
+			     struct xdp_mem_info *mem, bool napi_direct)
+{
+	int i;
+
+	for (i = 0; i < sinfo->nr_frags; i++)
+		__xdp_return(skb_frag_address(&sinfo->frags[i]), mem,
+			     napi_direct, 0);
+}
+
 void xdp_return_frame(struct xdp_frame *xdpf)
 {
+	if (unlikely(xdp_frame_has_frags(xdpf)))
+		xdp_return_frags(xdp_get_shared_info_from_frame(xdpf),
+				 &xdpf->mem, false);
+
 	__xdp_return(xdpf->data, &xdpf->mem, false, 0);
 }
 EXPORT_SYMBOL_GPL(xdp_return_frame);
 
 void xdp_return_frame_rx_napi(struct xdp_frame *xdpf)
 {
+	if (unlikely(xdp_frame_has_frags(xdpf)))
+		xdp_return_frags(xdp_get_shared_info_from_frame(xdpf),
+				 &xdpf->mem, true);
+
 	__xdp_return(xdpf->data, &xdpf->mem, true, 0);
 }
 EXPORT_SYMBOL_GPL(xdp_return_frame_rx_napi);
 
 void xdp_return_buff(struct xdp_buff *xdp)
 {
+	if (unlikely(xdp_buff_has_frags(xdp)))
+		xdp_return_frags(xdp_get_shared_info_from_buff(xdp),
+				 &xdp->rxq->mem, true);
+
 	__xdp_return(xdp->data, &xdp->rxq->mem, true, xdp->handle);
 }
 EXPORT_SYMBOL_GPL(xdp_return_buff);
 
+/* Release a single fragment that a helper trimmed off an xdp_buff */
+void xdp_return_buff_frag(struct xdp_buff *xdp, skb_frag_t *frag)
+{
+	__xdp_return(skb_frag_address(frag), &xdp->rxq->mem, true, 0);
+}
+EXPORT_SYMBOL_GPL(xdp_return_buff_frag);
+
 int xdp_attachment_query(struct xdp_attachment_info *info,
 			 struct netdev_bpf *bpf)
 {
@@ -447,3 +479,38 @@ struct xdp_frame *xdp_convert_zc_to_xdp_frame(struct xdp_buff *xdp)
 	return xdpf;
 }
 EXPORT_SYMBOL_GPL(xdp_convert_zc_to_xdp_frame);
+
+/* Copy a frame into a freshly allocated page, e.g. to send the same
+ * frame out of several devices. Multi-buffer frames are not supported.
+ */
+struct xdp_frame *xdpf_clone(struct xdp_frame *xdpf)
+{
+	unsigned int headroom, totalsize;
+	struct xdp_frame *nxdpf;
+	struct page *page;
+	void *addr;
+
+	if (unlikely(xdp_frame_has_frags(xdpf)))
+		return NULL;
+
+	headroom = xdpf->headroom + sizeof(*xdpf);
+	totalsize = headroom + xdpf->len;
+	if (unlikely(totalsize > PAGE_SIZE))
+		return NULL;
+
+	page = dev_alloc_page();
+	if (!page)
+		return NULL;
+
+	addr = page_to_virt(page);
+	memcpy(addr, xdpf, totalsize);
+
+	nxdpf = addr;
+	nxdpf->data = addr + headroom;
+	nxdpf->frame_sz = PAGE_SIZE;
+	nxdpf->mem.type = MEM_TYPE_PAGE_ORDER0;
+	nxdpf->mem.id = 0;
+
+	return nxdpf;
+}
+EXPORT_SYMBOL_GPL(xdpf_clone);
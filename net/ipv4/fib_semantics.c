@@ -219,6 +219,8 @@ static void free_fib_info_rcu(struct rcu_head *head)
 	} endfor_nexthops(fi);
 
 	ip_fib_metrics_put(fi->fib_metrics);
+	if (fi->nh)
+		nexthop_put(fi->nh);
 
 	kfree(fi);
 }
@@ -252,6 +254,8 @@ void fib_release_info(struct fib_info *fi)
 				continue;
 			hlist_del(&nexthop_nh->nh_hash);
 		} endfor_nexthops(fi)
+		if (fi->nh)
+			list_del(&fi->nh_list);
 		fi->fib_dead = 1;
 		fib_info_put(fi);
 	}
@@ -318,6 +322,8 @@ static struct fib_info *fib_find_info(const struct fib_info *nfi)
 			continue;
 		if (fi->fib_nhs != nfi->fib_nhs)
 			continue;
+		if (fi->nh != nfi->nh)
+			continue;
 		if (nfi->fib_protocol == fi->fib_protocol &&
 		    nfi->fib_scope == fi->fib_scope &&
 		    nfi->fib_prefsrc == fi->fib_prefsrc &&
@@ -367,6 +373,7 @@ static inline size_t fib_nlmsg_size(struct fib_info *fi)
 			 + nla_total_size(4) /* RTA_DST */
 			 + nla_total_size(4) /* RTA_PRIORITY */
 			 + nla_total_size(4) /* RTA_PREFSRC */
+			 + nla_total_size(4) /* RTA_NH_ID */
 			 + nla_total_size(TCP_CA_NAME_MAX); /* RTAX_CC_ALGO */
 
 	/* space for nested metrics */
@@ -638,6 +645,9 @@ int fib_nh_match(struct fib_config *cfg, struct fib_info *fi,
 	if (cfg->fc_priority && cfg->fc_priority != fi->fib_priority)
 		return 1;
 
+	if (cfg->fc_nh_id)
+		return !(fi->nh && fi->nh->id == cfg->fc_nh_id);
+
 	if (cfg->fc_oif || cfg->fc_gw) {
 		if (cfg->fc_encap) {
 			if (fib_encap_match(cfg->fc_encap_type, cfg->fc_encap,
@@ -1018,12 +1028,34 @@ static bool fib_valid_prefsrc(struct fib_config *cfg, __be32 fib_prefsrc)
 	return true;
 }
 
-struct fib_info *fib_create_info(struct fib_config *cfg,
-				 struct netlink_ext_ack *extack)
+/* Fill nexthops of a route from the paths of a nexthop object */
+static void fib_get_nh_obj(struct fib_info *fi, const struct nexthop *nh)
+{
+	change_nexthops(fi) {
+		const struct nh_info *nhi;
+		int weight;
+
+		nhi = nexthop_path(nh, nhsel, &weight);
+		nexthop_nh->nh_oif = nhi->oif;
+		nexthop_nh->nh_gw = nhi->gw;
+		nexthop_nh->nh_flags = nhi->flags;
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+		nexthop_nh->nh_weight = weight;
+#endif
+	} endfor_nexthops(fi);
+}
+
+/* If metrics is given, it's shared with the new fib_info instead of building
+ * it from the configuration.
+ */
+static struct fib_info *__fib_create_info(struct fib_config *cfg,
+					  struct dst_metrics *metrics,
+					  struct netlink_ext_ack *extack)
 {
 	int err;
 	struct fib_info *fi = NULL;
 	struct fib_info *ofi;
+	struct nexthop *nh = NULL;
 	int nhs = 1;
 	struct net *net = cfg->fc_nlinfo.nl_net;
 
@@ -1050,6 +1082,22 @@ struct fib_info *fib_create_info(struct fib_config *cfg,
 	}
 #endif
 
+	if (cfg->fc_nh_id) {
+		nh = nexthop_find_by_id(net, cfg->fc_nh_id);
+		if (!nh) {
+			NL_SET_ERR_MSG(extack, "Nexthop id does not exist");
+			goto err_inval;
+		}
+		nhs = nexthop_num_path(nh);
+#ifndef CONFIG_IP_ROUTE_MULTIPATH
+		if (nhs > 1) {
+			NL_SET_ERR_MSG(extack,
+				       "Multipath support not enabled in kernel");
+			goto err_inval;
+		}
+#endif
+	}
+
 	err = -ENOBUFS;
 	if (fib_info_cnt >= fib_info_hash_size) {
 		unsigned int new_size = fib_info_hash_size << 1;
@@ -1075,13 +1123,23 @@ struct fib_info *fib_create_info(struct fib_config *cfg,
 	fi = kzalloc(sizeof(*fi)+nhs*sizeof(struct fib_nh), GFP_KERNEL);
 	if (!fi)
 		goto failure;
-	fi->fib_metrics = ip_fib_metrics_init(fi->fib_net, cfg->fc_mx,
-					      cfg->fc_mx_len);
+	if (metrics) {
+		if (metrics != &dst_default_metrics)
+			refcount_inc(&metrics->refcnt);
+		fi->fib_metrics = metrics;
+	} else {
+		fi->fib_metrics = ip_fib_metrics_init(fi->fib_net, cfg->fc_mx,
+						      cfg->fc_mx_len);
+	}
 	if (unlikely(IS_ERR(fi->fib_metrics))) {
 		err = PTR_ERR(fi->fib_metrics);
 		kfree(fi);
 		return ERR_PTR(err);
 	}
+	if (nh) {
+		nexthop_get(nh);
+		fi->nh = nh;
+	}
 
 	fib_info_cnt++;
 	fi->fib_net = net;
@@ -1128,6 +1186,8 @@ struct fib_info *fib_create_info(struct fib_config *cfg,
 			       "Multipath support not enabled in kernel");
 		goto err_inval;
 #endif
+	} else if (nh) {
+		fib_get_nh_obj(fi, nh);
 	} else {
 		struct fib_nh *nh = fi->fib_nh;
 
@@ -1161,7 +1221,7 @@ struct fib_info *fib_create_info(struct fib_config *cfg,
 	}
 
 	if (fib_props[cfg->fc_type].error) {
-		if (cfg->fc_gw || cfg->fc_oif || cfg->fc_mp) {
+		if (cfg->fc_gw || cfg->fc_oif || cfg->fc_mp || nh) {
 			NL_SET_ERR_MSG(extack,
 				       "Gateway, device and multipath can not be specified for this route type");
 			goto err_inval;
@@ -1260,6 +1320,8 @@ struct fib_info *fib_create_info(struct fib_config *cfg,
 		head = &fib_info_devhash[hash];
 		hlist_add_head(&nexthop_nh->nh_hash, head);
 	} endfor_nexthops(fi)
+	if (fi->nh)
+		list_add(&fi->nh_list, &fi->nh->fi_list);
 	spin_unlock_bh(&fib_info_lock);
 	return fi;
 
@@ -1275,6 +1337,121 @@ struct fib_info *fib_create_info(struct fib_config *cfg,
 	return ERR_PTR(err);
 }
 
+struct fib_info *fib_create_info(struct fib_config *cfg,
+				 struct netlink_ext_ack *extack)
+{
+	return __fib_create_info(cfg, NULL, extack);
+}
+
+/* Check that routes could use a nexthop object with these paths, with the
+ * widest scope, and looking its gateway up in the main table.
+ */
+int fib_check_nexthop(struct net *net, const struct nh_info *nhi,
+		      struct netlink_ext_ack *extack)
+{
+	struct fib_config cfg = {
+		.fc_table	= RT_TABLE_MAIN,
+		.fc_scope	= RT_SCOPE_UNIVERSE,
+		.fc_nlinfo	= {
+			.nl_net	= net,
+		},
+	};
+	struct fib_nh nh = {
+		.nh_oif		= nhi->oif,
+		.nh_gw		= nhi->gw,
+		.nh_flags	= nhi->flags,
+	};
+	int err;
+
+	err = fib_check_nh(&cfg, &nh, extack);
+	if (nh.nh_dev)
+		dev_put(nh.nh_dev);
+
+	return err;
+}
+
+/* Build a fib_info like ofi, from the current state of its nexthop object,
+ * and move all routes using ofi to it.
+ */
+static int fib_info_nh_rebuild(struct fib_info *ofi)
+{
+	struct net *net = ofi->fib_net;
+	struct fib_config cfg = {
+		.fc_protocol	= ofi->fib_protocol,
+		.fc_scope	= ofi->fib_scope,
+		.fc_type	= ofi->fib_type,
+		.fc_table	= ofi->fib_tb_id,
+		.fc_flags	= ofi->fib_flags &
+				  ~(RTNH_F_DEAD | RTNH_F_LINKDOWN),
+		.fc_priority	= ofi->fib_priority,
+		.fc_prefsrc	= ofi->fib_prefsrc,
+		.fc_nh_id	= ofi->nh->id,
+		.fc_nlinfo	= {
+			.nl_net	= net,
+		},
+	};
+	struct fib_info *nfi;
+	unsigned int h;
+
+	nfi = __fib_create_info(&cfg, ofi->fib_metrics, NULL);
+	if (IS_ERR(nfi))
+		return PTR_ERR(nfi);
+
+	for (h = 0; h < FIB_TABLE_HASHSZ; h++) {
+		struct hlist_head *head = &net->ipv4.fib_table_hash[h];
+		struct fib_table *tb;
+
+		hlist_for_each_entry(tb, head, tb_hlist)
+			fib_table_replace_info(net, tb, ofi, nfi);
+	}
+
+	/* drop the reference we got on creation */
+	fib_release_info(nfi);
+	return 0;
+}
+
+/* Called with RTNL held after a nexthop changed: routes using it get the
+ * new paths at once, or are removed if they can't use them.
+ */
+void fib_nexthop_update(struct nexthop *nh)
+{
+	struct fib_info *fi, *tmp;
+	LIST_HEAD(fi_list);
+	bool flush = false;
+
+	/* rebuilt fib_infos are added to nh->fi_list, don't visit them */
+	list_splice_init(&nh->fi_list, &fi_list);
+
+	list_for_each_entry_safe(fi, tmp, &fi_list, nh_list) {
+		list_move(&fi->nh_list, &nh->fi_list);
+
+		fib_info_hold(fi);
+		if (fib_info_nh_rebuild(fi)) {
+			fi->fib_flags |= RTNH_F_DEAD;
+			flush = true;
+		}
+		fib_info_put(fi);
+	}
+
+	if (flush)
+		fib_flush(nh->net);
+	rt_cache_flush(nh->net);
+}
+
+/* Called with RTNL held before a nexthop goes away */
+void fib_nexthop_remove(struct nexthop *nh)
+{
+	struct fib_info *fi;
+
+	if (list_empty(&nh->fi_list))
+		return;
+
+	list_for_each_entry(fi, &nh->fi_list, nh_list)
+		fi->fib_flags |= RTNH_F_DEAD;
+
+	fib_flush(nh->net);
+}
+
 int fib_dump_info(struct sk_buff *skb, u32 portid, u32 seq, int event,
 		  u32 tb_id, u8 type, __be32 dst, int dst_len, u8 tos,
 		  struct fib_info *fi, unsigned int flags)
@@ -1314,6 +1491,9 @@ int fib_dump_info(struct sk_buff *skb, u32 portid, u32 seq, int event,
 	if (fi->fib_prefsrc &&
 	    nla_put_in_addr(skb, RTA_PREFSRC, fi->fib_prefsrc))
 		goto nla_put_failure;
+	if (fi->nh &&
+	    nla_put_u32(skb, RTA_NH_ID, fi->nh->id))
+		goto nla_put_failure;
 	if (fi->fib_nhs == 1) {
 		if (fi->fib_nh->nh_gw &&
 		    nla_put_in_addr(skb, RTA_GATEWAY, fi->fib_nh->nh_gw))
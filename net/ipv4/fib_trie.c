@@ -1933,6 +1933,43 @@ int fib_table_flush(struct net *net, struct fib_table *tb)
 	return found;
 }
 
+/* Point routes of this table using ofi to nfi instead, caller holds RTNL */
+int fib_table_replace_info(struct net *net, struct fib_table *tb,
+			   struct fib_info *ofi, struct fib_info *nfi)
+{
+	struct trie *t = (struct trie *)tb->tb_data;
+	struct key_vector *l, *tp = t->kv;
+	t_key key = 0;
+	int found = 0;
+
+	rcu_read_lock();
+	while ((l = leaf_walk_rcu(&tp, key)) != NULL) {
+		struct fib_alias *fa;
+
+		hlist_for_each_entry(fa, &l->leaf, fa_list) {
+			if (fa->fa_info != ofi || tb->tb_id != fa->tb_id)
+				continue;
+
+			nfi->fib_treeref++;
+			WRITE_ONCE(fa->fa_info, nfi);
+			call_fib_entry_notifiers(net, FIB_EVENT_ENTRY_REPLACE,
+						 l->key,
+						 KEYLENGTH - fa->fa_slen, fa,
+						 NULL);
+			fib_release_info(ofi);
+			found++;
+		}
+
+		key = l->key + 1;
+		/* stop in case of wrap around */
+		if (key < l->key)
+			break;
+	}
+	rcu_read_unlock();
+
+	return found;
+}
+
 static void fib_leaf_notify(struct net *net, struct key_vector *l,
 			    struct fib_table *tb, struct notifier_block *nb)
 {
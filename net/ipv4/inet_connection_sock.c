@@ -928,11 +928,18 @@ struct sock *inet_csk_reqsk_queue_add(struct sock *sk,
 				      struct sock *child)
 {
 	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	spinlock_t *lock = &queue->rskq_lock;
 
-	spin_lock(&queue->rskq_lock);
+	if (queue->rskq_subq)
+		lock = &this_cpu_ptr(queue->rskq_subq)->lock;
+
+	spin_lock(lock);
 	if (unlikely(sk->sk_state != TCP_LISTEN)) {
 		inet_child_forget(sk, req, child);
 		child = NULL;
+	} else if (queue->rskq_subq) {
+		req->sk = child;
+		reqsk_subqueue_add(queue, req, sk);
 	} else {
 		req->sk = child;
 		req->dl_next = NULL;
@@ -943,7 +950,7 @@ struct sock *inet_csk_reqsk_queue_add(struct sock *sk,
 		queue->rskq_accept_tail = req;
 		sk_acceptq_added(sk);
 	}
-	spin_unlock(&queue->rskq_lock);
+	spin_unlock(lock);
 	return child;
 }
 EXPORT_SYMBOL(inet_csk_reqsk_queue_add);
@@ -0,0 +1,981 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Nexthop objects
+ *
+ * Nexthops and nexthop groups are managed as objects of their own through
+ * RTM_{NEW,DEL,GET}NEXTHOP, and IPv4 routes refer to them by id. Routes
+ * keep a copy of the paths in their fib_info, see fib_nexthop_update(), so
+ * nothing here is used in the forwarding path, and all of it runs under RTNL.
+ */
+
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/slab.h>
+#include <net/ip_fib.h>
+#include <net/net_namespace.h>
+#include <net/netlink.h>
+#include <net/nexthop.h>
+#include <net/rtnetlink.h>
+
+static const struct nla_policy rtm_nh_policy[NHA_MAX + 1] = {
+	[NHA_ID]		= { .type = NLA_U32 },
+	[NHA_GROUP]		= { .type = NLA_BINARY },
+	[NHA_GROUP_TYPE]	= { .type = NLA_U16 },
+	[NHA_BLACKHOLE]		= { .type = NLA_FLAG },
+	[NHA_OIF]		= { .type = NLA_U32 },
+	[NHA_GATEWAY]		= { .type = NLA_BINARY },
+	[NHA_ENCAP_TYPE]	= { .type = NLA_U16 },
+	[NHA_ENCAP]		= { .type = NLA_NESTED },
+	[NHA_GROUPS]		= { .type = NLA_FLAG },
+	[NHA_MASTER]		= { .type = NLA_U32 },
+};
+
+static void remove_nexthop(struct net *net, struct nexthop *nh,
+			   struct nl_info *nlinfo);
+
+struct nexthop *nexthop_find_by_id(struct net *net, u32 id)
+{
+	struct rb_node *node = net->nexthop.rb_root.rb_node;
+
+	ASSERT_RTNL();
+
+	while (node) {
+		struct nexthop *nh = rb_entry(node, struct nexthop, rb_node);
+
+		if (id < nh->id)
+			node = node->rb_left;
+		else if (id > nh->id)
+			node = node->rb_right;
+		else
+			return nh;
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(nexthop_find_by_id);
+
+/* May be called from RCU callbacks, through the last nexthop_put() on
+ * freeing of a fib_info: group entries were unlinked by remove_nexthop().
+ */
+void nexthop_free(struct nexthop *nh)
+{
+	if (nh->is_group) {
+		struct nh_group *nhg = nh->nh_grp;
+		int i;
+
+		for (i = 0; i < nhg->num_nh; i++)
+			nexthop_put(nhg->nh_entries[i].nh);
+
+		kfree(nhg);
+	} else {
+		kfree(nh->nh_info);
+	}
+
+	kfree(nh);
+}
+EXPORT_SYMBOL_GPL(nexthop_free);
+
+static struct nexthop *nexthop_alloc(struct net *net)
+{
+	struct nexthop *nh;
+
+	nh = kzalloc(sizeof(*nh), GFP_KERNEL);
+	if (!nh)
+		return NULL;
+
+	INIT_LIST_HEAD(&nh->fi_list);
+	INIT_LIST_HEAD(&nh->grp_list);
+	refcount_set(&nh->refcnt, 1);
+	nh->net = net;
+
+	return nh;
+}
+
+static struct nh_group *nexthop_grp_alloc(u16 num_nh)
+{
+	return kzalloc(sizeof(struct nh_group) +
+		       num_nh * sizeof(struct nh_grp_entry), GFP_KERNEL);
+}
+
+static size_t nh_nlmsg_size(const struct nexthop *nh)
+{
+	size_t sz = NLMSG_ALIGN(sizeof(struct nhmsg))
+		  + nla_total_size(4);	/* NHA_ID */
+
+	if (nh->is_group)
+		sz += nla_total_size(sizeof(struct nexthop_grp) *
+				     nh->nh_grp->num_nh)	/* NHA_GROUP */
+		    + nla_total_size(2);	/* NHA_GROUP_TYPE */
+	else
+		sz += nla_total_size(4)		/* NHA_OIF */
+		    + nla_total_size(4);	/* NHA_GATEWAY */
+
+	return sz;
+}
+
+static int nh_fill_node(struct sk_buff *skb, const struct nexthop *nh,
+			int event, u32 portid, u32 seq, unsigned int nlflags)
+{
+	struct nlmsghdr *nlh;
+	struct nhmsg *nhm;
+
+	nlh = nlmsg_put(skb, portid, seq, event, sizeof(*nhm), nlflags);
+	if (!nlh)
+		return -EMSGSIZE;
+
+	nhm = nlmsg_data(nlh);
+	nhm->nh_family = nh->is_group ? AF_UNSPEC : nh->nh_info->family;
+	nhm->nh_scope = 0;
+	nhm->nh_protocol = nh->protocol;
+	nhm->resvd = 0;
+	nhm->nh_flags = nh->nh_flags;
+
+	if (nla_put_u32(skb, NHA_ID, nh->id))
+		goto nla_put_failure;
+
+	if (nh->is_group) {
+		struct nh_group *nhg = nh->nh_grp;
+		struct nexthop_grp *p;
+		struct nlattr *nla;
+		int i;
+
+		nla = nla_reserve(skb, NHA_GROUP, sizeof(*p) * nhg->num_nh);
+		if (!nla)
+			goto nla_put_failure;
+
+		p = nla_data(nla);
+		for (i = 0; i < nhg->num_nh; i++, p++) {
+			p->id = nhg->nh_entries[i].nh->id;
+			p->weight = nhg->nh_entries[i].weight - 1;
+			p->resvd1 = 0;
+			p->resvd2 = 0;
+		}
+
+		if (nla_put_u16(skb, NHA_GROUP_TYPE, NEXTHOP_GRP_TYPE_MPATH))
+			goto nla_put_failure;
+	} else {
+		const struct nh_info *nhi = nh->nh_info;
+
+		if (nla_put_u32(skb, NHA_OIF, nhi->oif))
+			goto nla_put_failure;
+		if (nhi->gw && nla_put_in_addr(skb, NHA_GATEWAY, nhi->gw))
+			goto nla_put_failure;
+	}
+
+	nlmsg_end(skb, nlh);
+	return 0;
+
+nla_put_failure:
+	nlmsg_cancel(skb, nlh);
+	return -EMSGSIZE;
+}
+
+static void nexthop_notify(int event, struct nexthop *nh,
+			   struct nl_info *info)
+{
+	unsigned int nlflags = info->nlh ? info->nlh->nlmsg_flags : 0;
+	u32 seq = info->nlh ? info->nlh->nlmsg_seq : 0;
+	struct sk_buff *skb;
+	int err = -ENOBUFS;
+
+	skb = nlmsg_new(nh_nlmsg_size(nh), GFP_KERNEL);
+	if (!skb)
+		goto errout;
+
+	err = nh_fill_node(skb, nh, event, info->portid, seq, nlflags);
+	if (err < 0) {
+		/* -EMSGSIZE implies BUG in nh_nlmsg_size() */
+		WARN_ON(err == -EMSGSIZE);
+		kfree_skb(skb);
+		goto errout;
+	}
+
+	rtnl_notify(skb, info->nl_net, info->portid, RTNLGRP_NEXTHOP,
+		    info->nlh, GFP_KERNEL);
+	return;
+errout:
+	if (err < 0)
+		rtnl_set_sk_err(info->nl_net, RTNLGRP_NEXTHOP, err);
+}
+
+/* Routes using @nh, or any group @nh is in, need to be rebuilt */
+static void nexthop_update_routes(struct nexthop *nh)
+{
+	struct nh_grp_entry *nhge;
+
+	fib_nexthop_update(nh);
+
+	list_for_each_entry(nhge, &nh->grp_list, nh_list)
+		fib_nexthop_update(nhge->nh_parent);
+}
+
+static void nh_group_link(struct nexthop *nh, struct nh_group *nhg)
+{
+	int i;
+
+	for (i = 0; i < nhg->num_nh; i++) {
+		struct nh_grp_entry *nhge = &nhg->nh_entries[i];
+
+		nhge->nh_parent = nh;
+		list_add_tail(&nhge->nh_list, &nhge->nh->grp_list);
+	}
+}
+
+static void nh_group_unlink(struct nh_group *nhg)
+{
+	int i;
+
+	for (i = 0; i < nhg->num_nh; i++)
+		list_del(&nhg->nh_entries[i].nh_list);
+}
+
+/* Drop @nh from group @parent, in place: entries are compacted, and
+ * relinked on their nexthop's group list as they move.
+ */
+static void remove_nh_grp_entry(struct nexthop *parent, struct nexthop *nh,
+				struct nl_info *nlinfo)
+{
+	struct nh_group *nhg = parent->nh_grp;
+	int i, j;
+
+	for (i = 0, j = 0; i < nhg->num_nh; i++) {
+		struct nh_grp_entry *nhge = &nhg->nh_entries[i];
+
+		list_del(&nhge->nh_list);
+		if (nhge->nh == nh) {
+			nexthop_put(nh);
+			continue;
+		}
+
+		if (i != j)
+			nhg->nh_entries[j] = *nhge;
+		list_add_tail(&nhg->nh_entries[j].nh_list,
+			      &nhg->nh_entries[j].nh->grp_list);
+		j++;
+	}
+	nhg->num_nh = j;
+
+	if (!nhg->num_nh) {
+		remove_nexthop(parent->net, parent, nlinfo);
+		return;
+	}
+
+	fib_nexthop_update(parent);
+	nexthop_notify(RTM_NEWNEXTHOP, parent, nlinfo);
+}
+
+static void remove_nexthop(struct net *net, struct nexthop *nh,
+			   struct nl_info *nlinfo)
+{
+	if (nh->is_group) {
+		nh_group_unlink(nh->nh_grp);
+	} else {
+		struct nh_grp_entry *nhge;
+
+		while (!list_empty(&nh->grp_list)) {
+			nhge = list_first_entry(&nh->grp_list,
+						struct nh_grp_entry, nh_list);
+			remove_nh_grp_entry(nhge->nh_parent, nh, nlinfo);
+		}
+	}
+
+	fib_nexthop_remove(nh);
+
+	rb_erase(&nh->rb_node, &net->nexthop.rb_root);
+	net->nexthop.seq++;
+
+	nexthop_notify(RTM_DELNEXTHOP, nh, nlinfo);
+
+	nexthop_put(nh);
+}
+
+static int replace_nexthop(struct net *net, struct nexthop *old,
+			   struct nh_config *cfg,
+			   struct netlink_ext_ack *extack)
+{
+	if (old->is_group != !!cfg->nh_grp) {
+		NL_SET_ERR_MSG(extack,
+			       "Can not replace a nexthop with a nexthop group or vice versa");
+		return -EINVAL;
+	}
+
+	if (old->is_group) {
+		struct nh_group *nhg, *onhg = old->nh_grp;
+		struct nexthop_grp *entry = nla_data(cfg->nh_grp);
+		u16 i, num_nh;
+
+		num_nh = nla_len(cfg->nh_grp) / sizeof(*entry);
+		nhg = nexthop_grp_alloc(num_nh);
+		if (!nhg)
+			return -ENOMEM;
+
+		nhg->num_nh = num_nh;
+		for (i = 0; i < num_nh; i++) {
+			struct nexthop *nhe;
+
+			nhe = nexthop_find_by_id(net, entry[i].id);
+			nexthop_get(nhe);
+			nhg->nh_entries[i].nh = nhe;
+			nhg->nh_entries[i].weight = entry[i].weight + 1;
+		}
+
+		nh_group_unlink(onhg);
+		nh_group_link(old, nhg);
+		old->nh_grp = nhg;
+
+		for (i = 0; i < onhg->num_nh; i++)
+			nexthop_put(onhg->nh_entries[i].nh);
+		kfree(onhg);
+	} else {
+		struct nh_info *nhi, *onhi = old->nh_info;
+
+		nhi = kzalloc(sizeof(*nhi), GFP_KERNEL);
+		if (!nhi)
+			return -ENOMEM;
+
+		nhi->family = cfg->nh_family;
+		nhi->oif = cfg->nh_ifindex;
+		nhi->gw = cfg->nh_gw;
+		nhi->flags = cfg->nh_flags;
+
+		old->nh_info = nhi;
+		kfree(onhi);
+	}
+
+	old->protocol = cfg->nh_protocol;
+	old->nh_flags = cfg->nh_flags;
+	net->nexthop.seq++;
+
+	nexthop_update_routes(old);
+
+	return 0;
+}
+
+static void insert_nexthop(struct net *net, struct nexthop *new_nh)
+{
+	struct rb_node **pp = &net->nexthop.rb_root.rb_node, *parent = NULL;
+
+	while (*pp) {
+		struct nexthop *nh;
+
+		parent = *pp;
+		nh = rb_entry(parent, struct nexthop, rb_node);
+		if (new_nh->id < nh->id)
+			pp = &parent->rb_left;
+		else
+			pp = &parent->rb_right;
+	}
+
+	rb_link_node(&new_nh->rb_node, parent, pp);
+	rb_insert_color(&new_nh->rb_node, &net->nexthop.rb_root);
+	net->nexthop.seq++;
+}
+
+/* rtnl */
+static u32 nh_find_unused_id(struct net *net)
+{
+	u32 id_start = net->nexthop.last_id_allocated;
+
+	while (1) {
+		net->nexthop.last_id_allocated++;
+		if (net->nexthop.last_id_allocated == id_start)
+			break;
+
+		if (!nexthop_find_by_id(net, net->nexthop.last_id_allocated))
+			return net->nexthop.last_id_allocated;
+	}
+	return 0;
+}
+
+static struct nexthop *nexthop_create(struct net *net, struct nh_config *cfg)
+{
+	struct nexthop *nh;
+
+	nh = nexthop_alloc(net);
+	if (!nh)
+		return ERR_PTR(-ENOMEM);
+
+	nh->id = cfg->nh_id;
+	nh->protocol = cfg->nh_protocol;
+	nh->nh_flags = cfg->nh_flags;
+
+	if (cfg->nh_grp) {
+		struct nexthop_grp *entry = nla_data(cfg->nh_grp);
+		struct nh_group *nhg;
+		u16 i, num_nh;
+
+		num_nh = nla_len(cfg->nh_grp) / sizeof(*entry);
+		nhg = nexthop_grp_alloc(num_nh);
+		if (!nhg)
+			goto out_free;
+
+		nhg->num_nh = num_nh;
+		for (i = 0; i < num_nh; i++) {
+			struct nexthop *nhe;
+
+			nhe = nexthop_find_by_id(net, entry[i].id);
+			nexthop_get(nhe);
+			nhg->nh_entries[i].nh = nhe;
+			nhg->nh_entries[i].weight = entry[i].weight + 1;
+		}
+
+		nh->is_group = true;
+		nh->nh_grp = nhg;
+	} else {
+		struct nh_info *nhi;
+
+		nhi = kzalloc(sizeof(*nhi), GFP_KERNEL);
+		if (!nhi)
+			goto out_free;
+
+		nhi->family = cfg->nh_family;
+		nhi->oif = cfg->nh_ifindex;
+		nhi->gw = cfg->nh_gw;
+		nhi->flags = cfg->nh_flags;
+
+		nh->nh_info = nhi;
+	}
+
+	return nh;
+
+out_free:
+	kfree(nh);
+	return ERR_PTR(-ENOMEM);
+}
+
+/* called with RTNL held */
+static int nexthop_add(struct net *net, struct nh_config *cfg,
+		       struct netlink_ext_ack *extack)
+{
+	struct nexthop *nh;
+	int err;
+
+	if (!cfg->nh_id) {
+		cfg->nh_id = nh_find_unused_id(net);
+		if (!cfg->nh_id) {
+			NL_SET_ERR_MSG(extack, "No unused id");
+			return -EINVAL;
+		}
+		nh = NULL;
+	} else {
+		nh = nexthop_find_by_id(net, cfg->nh_id);
+	}
+
+	if (nh) {
+		if (!(cfg->nlinfo.nlflags & NLM_F_REPLACE)) {
+			NL_SET_ERR_MSG(extack, "Nexthop with id already exists");
+			return -EEXIST;
+		}
+
+		err = replace_nexthop(net, nh, cfg, extack);
+		if (err)
+			return err;
+	} else {
+		nh = nexthop_create(net, cfg);
+		if (IS_ERR(nh))
+			return PTR_ERR(nh);
+
+		if (nh->is_group)
+			nh_group_link(nh, nh->nh_grp);
+		insert_nexthop(net, nh);
+	}
+
+	nexthop_notify(RTM_NEWNEXTHOP, nh, &cfg->nlinfo);
+
+	return 0;
+}
+
+static int nh_check_attr_group(struct net *net, struct nlattr *tb[],
+			       struct netlink_ext_ack *extack)
+{
+	unsigned int len = nla_len(tb[NHA_GROUP]);
+	struct nexthop_grp *nhg;
+	unsigned int i, j;
+
+	if (len & (sizeof(struct nexthop_grp) - 1)) {
+		NL_SET_ERR_MSG(extack,
+			       "Invalid length for nexthop group attribute");
+		return -EINVAL;
+	}
+
+	/* convert len to number of nexthop ids */
+	len /= sizeof(*nhg);
+	if (!len || len > NEXTHOP_MAX_PATHS) {
+		NL_SET_ERR_MSG(extack, "Invalid number of nexthops in group");
+		return -EINVAL;
+	}
+
+	nhg = nla_data(tb[NHA_GROUP]);
+	for (i = 0; i < len; ++i) {
+		struct nexthop *nh;
+
+		if (nhg[i].resvd1 || nhg[i].resvd2) {
+			NL_SET_ERR_MSG(extack, "Reserved fields in nexthop_grp must be 0");
+			return -EINVAL;
+		}
+
+		nh = nexthop_find_by_id(net, nhg[i].id);
+		if (!nh) {
+			NL_SET_ERR_MSG(extack, "Invalid nexthop id");
+			return -EINVAL;
+		}
+		if (nh->is_group) {
+			NL_SET_ERR_MSG(extack, "Nested nexthop groups are not supported");
+			return -EINVAL;
+		}
+
+		for (j = i + 1; j < len; ++j) {
+			if (nhg[i].id == nhg[j].id) {
+				NL_SET_ERR_MSG(extack, "Nexthop id can not be used twice in a group");
+				return -EINVAL;
+			}
+		}
+	}
+
+	for (i = NHA_GROUP + 1; i < __NHA_MAX; ++i) {
+		if (!tb[i] || i == NHA_GROUP_TYPE)
+			continue;
+
+		NL_SET_ERR_MSG(extack,
+			       "No other attributes can be set in nexthop groups");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int rtm_to_nh_config(struct net *net, struct sk_buff *skb,
+			    struct nlmsghdr *nlh, struct nh_config *cfg,
+			    struct netlink_ext_ack *extack)
+{
+	struct nhmsg *nhm = nlmsg_data(nlh);
+	struct nlattr *tb[NHA_MAX + 1];
+	int err;
+
+	err = nlmsg_parse(nlh, sizeof(*nhm), tb, NHA_MAX, rtm_nh_policy,
+			  extack);
+	if (err < 0)
+		return err;
+
+	err = -EINVAL;
+	if (nhm->resvd || nhm->nh_scope) {
+		NL_SET_ERR_MSG(extack, "Invalid values in ancillary header");
+		goto out;
+	}
+	if (nhm->nh_flags & ~RTNH_F_ONLINK) {
+		NL_SET_ERR_MSG(extack, "Invalid nexthop flags in ancillary header");
+		goto out;
+	}
+
+	switch (nhm->nh_family) {
+	case AF_INET:
+		break;
+	case AF_UNSPEC:
+		if (tb[NHA_GROUP])
+			break;
+		/* fallthrough */
+	default:
+		NL_SET_ERR_MSG(extack, "Invalid address family");
+		goto out;
+	}
+
+	if (tb[NHA_GROUPS] || tb[NHA_MASTER]) {
+		NL_SET_ERR_MSG(extack, "Invalid attributes in request");
+		goto out;
+	}
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->nlinfo.nlh = nlh;
+	cfg->nlinfo.portid = NETLINK_CB(skb).portid;
+	cfg->nlinfo.nlflags = nlh->nlmsg_flags;
+	cfg->nlinfo.nl_net = net;
+
+	cfg->nh_family = nhm->nh_family;
+	cfg->nh_protocol = nhm->nh_protocol;
+	cfg->nh_flags = nhm->nh_flags;
+
+	if (tb[NHA_ID])
+		cfg->nh_id = nla_get_u32(tb[NHA_ID]);
+
+	if (tb[NHA_GROUP]) {
+		if (nhm->nh_family != AF_UNSPEC) {
+			NL_SET_ERR_MSG(extack, "Invalid family for group");
+			goto out;
+		}
+		cfg->nh_grp = tb[NHA_GROUP];
+
+		cfg->nh_grp_type = NEXTHOP_GRP_TYPE_MPATH;
+		if (tb[NHA_GROUP_TYPE])
+			cfg->nh_grp_type = nla_get_u16(tb[NHA_GROUP_TYPE]);
+
+		if (cfg->nh_grp_type > NEXTHOP_GRP_TYPE_MAX) {
+			NL_SET_ERR_MSG(extack, "Invalid group type");
+			goto out;
+		}
+		err = nh_check_attr_group(net, tb, extack);
+
+		/* no other attributes should be set */
+		goto out;
+	}
+
+	if (tb[NHA_BLACKHOLE] || tb[NHA_ENCAP] || tb[NHA_ENCAP_TYPE]) {
+		NL_SET_ERR_MSG(extack,
+			       "Blackhole and encap nexthops are not supported");
+		err = -EOPNOTSUPP;
+		goto out;
+	}
+
+	if (!tb[NHA_OIF]) {
+		NL_SET_ERR_MSG(extack, "Device attribute required for nexthop");
+		goto out;
+	}
+
+	cfg->nh_ifindex = nla_get_u32(tb[NHA_OIF]);
+	if (cfg->nh_ifindex <= 0) {
+		NL_SET_ERR_MSG(extack, "Invalid device index");
+		goto out;
+	}
+
+	if (tb[NHA_GATEWAY]) {
+		struct nlattr *gwa = tb[NHA_GATEWAY];
+
+		if (nla_len(gwa) != sizeof(__be32)) {
+			NL_SET_ERR_MSG(extack, "Invalid gateway");
+			goto out;
+		}
+		cfg->nh_gw = nla_get_be32(gwa);
+	}
+
+	if ((cfg->nh_flags & RTNH_F_ONLINK) && !cfg->nh_gw) {
+		NL_SET_ERR_MSG(extack, "ONLINK flag can not be set for nexthop without a gateway");
+		goto out;
+	}
+
+	{
+		struct nh_info nhi = {
+			.family	= cfg->nh_family,
+			.oif	= cfg->nh_ifindex,
+			.gw	= cfg->nh_gw,
+			.flags	= cfg->nh_flags,
+		};
+
+		err = fib_check_nexthop(net, &nhi, extack);
+	}
+out:
+	return err;
+}
+
+/* rtnl */
+static int rtm_new_nexthop(struct sk_buff *skb, struct nlmsghdr *nlh,
+			   struct netlink_ext_ack *extack)
+{
+	struct net *net = sock_net(skb->sk);
+	struct nh_config cfg;
+	int err;
+
+	err = rtm_to_nh_config(net, skb, nlh, &cfg, extack);
+	if (!err)
+		err = nexthop_add(net, &cfg, extack);
+
+	return err;
+}
+
+static int nh_valid_get_del_req(struct nlmsghdr *nlh, u32 *id,
+				struct netlink_ext_ack *extack)
+{
+	struct nhmsg *nhm = nlmsg_data(nlh);
+	struct nlattr *tb[NHA_MAX + 1];
+	int err, i;
+
+	err = nlmsg_parse(nlh, sizeof(*nhm), tb, NHA_MAX, rtm_nh_policy,
+			  extack);
+	if (err < 0)
+		return err;
+
+	err = -EINVAL;
+	for (i = 0; i < __NHA_MAX; ++i) {
+		if (!tb[i])
+			continue;
+
+		switch (i) {
+		case NHA_ID:
+			break;
+		default:
+			NL_SET_ERR_MSG_ATTR(extack, tb[i],
+					    "Unexpected attribute in request");
+			goto out;
+		}
+	}
+	if (nhm->nh_protocol || nhm->resvd || nhm->nh_scope || nhm->nh_flags) {
+		NL_SET_ERR_MSG(extack, "Invalid values in header");
+		goto out;
+	}
+
+	if (!tb[NHA_ID]) {
+		NL_SET_ERR_MSG(extack, "Nexthop id is missing");
+		goto out;
+	}
+
+	*id = nla_get_u32(tb[NHA_ID]);
+	if (!(*id))
+		NL_SET_ERR_MSG(extack, "Invalid nexthop id");
+	else
+		err = 0;
+out:
+	return err;
+}
+
+/* rtnl */
+static int rtm_del_nexthop(struct sk_buff *skb, struct nlmsghdr *nlh,
+			   struct netlink_ext_ack *extack)
+{
+	struct net *net = sock_net(skb->sk);
+	struct nl_info nlinfo = {
+		.nlh = nlh,
+		.nl_net = net,
+		.portid = NETLINK_CB(skb).portid,
+	};
+	struct nexthop *nh;
+	int err;
+	u32 id;
+
+	err = nh_valid_get_del_req(nlh, &id, extack);
+	if (err)
+		return err;
+
+	nh = nexthop_find_by_id(net, id);
+	if (!nh)
+		return -ENOENT;
+
+	remove_nexthop(net, nh, &nlinfo);
+
+	return 0;
+}
+
+/* rtnl */
+static int rtm_get_nexthop(struct sk_buff *in_skb, struct nlmsghdr *nlh,
+			   struct netlink_ext_ack *extack)
+{
+	struct net *net = sock_net(in_skb->sk);
+	struct sk_buff *skb = NULL;
+	struct nexthop *nh;
+	int err;
+	u32 id;
+
+	err = nh_valid_get_del_req(nlh, &id, extack);
+	if (err)
+		return err;
+
+	nh = nexthop_find_by_id(net, id);
+	if (!nh)
+		return -ENOENT;
+
+	err = -ENOBUFS;
+	skb = alloc_skb(nh_nlmsg_size(nh), GFP_KERNEL);
+	if (!skb)
+		goto out;
+
+	err = nh_fill_node(skb, nh, RTM_NEWNEXTHOP, NETLINK_CB(in_skb).portid,
+			   nlh->nlmsg_seq, 0);
+	if (err < 0) {
+		WARN_ON(err == -EMSGSIZE);
+		goto errout_free;
+	}
+
+	err = rtnl_unicast(skb, net, NETLINK_CB(in_skb).portid);
+out:
+	return err;
+errout_free:
+	kfree_skb(skb);
+	goto out;
+}
+
+static bool nh_dump_filtered(struct nexthop *nh, int dev_idx, bool group_filter)
+{
+	if (group_filter && !nh->is_group)
+		return true;
+
+	if (dev_idx && (nh->is_group || nh->nh_info->oif != dev_idx))
+		return true;
+
+	return false;
+}
+
+static int nh_valid_dump_req(const struct nlmsghdr *nlh, int *dev_idx,
+			     bool *group_filter, struct netlink_callback *cb)
+{
+	struct netlink_ext_ack *extack = cb->extack;
+	struct nlattr *tb[NHA_MAX + 1];
+	struct nhmsg *nhm;
+	int err, i;
+	u32 idx;
+
+	err = nlmsg_parse(nlh, sizeof(*nhm), tb, NHA_MAX, rtm_nh_policy,
+			  extack);
+	if (err < 0)
+		return err;
+
+	for (i = 0; i <= NHA_MAX; ++i) {
+		if (!tb[i])
+			continue;
+
+		switch (i) {
+		case NHA_OIF:
+			idx = nla_get_u32(tb[i]);
+			if (idx > INT_MAX) {
+				NL_SET_ERR_MSG(extack, "Invalid device index");
+				return -EINVAL;
+			}
+			*dev_idx = idx;
+			break;
+		case NHA_GROUPS:
+			*group_filter = true;
+			break;
+		default:
+			NL_SET_ERR_MSG(extack, "Unsupported attribute in dump request");
+			return -EINVAL;
+		}
+	}
+
+	nhm = nlmsg_data(nlh);
+	if (nhm->nh_protocol || nhm->resvd || nhm->nh_scope || nhm->nh_flags) {
+		NL_SET_ERR_MSG(extack, "Invalid values in header for nexthop dump request");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* rtnl */
+static int rtm_dump_nexthop(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nhmsg *nhm = nlmsg_data(cb->nlh);
+	struct net *net = sock_net(skb->sk);
+	struct rb_root *root = &net->nexthop.rb_root;
+	bool group_filter = false;
+	struct rb_node *node;
+	int dev_filter_idx = 0;
+	int idx = 0, s_idx;
+	int err;
+
+	if (nlmsg_len(cb->nlh) >= sizeof(*nhm)) {
+		err = nh_valid_dump_req(cb->nlh, &dev_filter_idx,
+					&group_filter, cb);
+		if (err < 0)
+			return err;
+	}
+
+	s_idx = cb->args[0];
+	for (node = rb_first(root); node; node = rb_next(node)) {
+		struct nexthop *nh;
+
+		if (idx < s_idx)
+			goto cont;
+
+		nh = rb_entry(node, struct nexthop, rb_node);
+		if (nh_dump_filtered(nh, dev_filter_idx, group_filter))
+			goto cont;
+
+		err = nh_fill_node(skb, nh, RTM_NEWNEXTHOP,
+				   NETLINK_CB(cb->skb).portid,
+				   cb->nlh->nlmsg_seq, NLM_F_MULTI);
+		if (err < 0) {
+			if (likely(skb->len))
+				goto out;
+
+			goto out_err;
+		}
+cont:
+		idx++;
+	}
+
+out:
+	err = skb->len;
+out_err:
+	cb->args[0] = idx;
+	cb->seq = net->nexthop.seq;
+	nl_dump_check_consistent(cb, nlmsg_hdr(skb));
+
+	return err;
+}
+
+/* Nexthops are bound to a device by ifindex, they go away along with it */
+static void nexthop_flush_dev(struct net_device *dev)
+{
+	struct net *net = dev_net(dev);
+	struct nl_info nlinfo = {
+		.nl_net = net,
+	};
+	struct rb_node *node;
+
+restart:
+	for (node = rb_first(&net->nexthop.rb_root); node;
+	     node = rb_next(node)) {
+		struct nexthop *nh = rb_entry(node, struct nexthop, rb_node);
+
+		if (nh->is_group || nh->nh_info->oif != dev->ifindex)
+			continue;
+
+		/* may also remove groups left empty, walk again */
+		remove_nexthop(net, nh, &nlinfo);
+		goto restart;
+	}
+}
+
+static int nh_netdev_event(struct notifier_block *this,
+			   unsigned long event, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+
+	switch (event) {
+	case NETDEV_UNREGISTER:
+		nexthop_flush_dev(dev);
+		break;
+	}
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block nh_netdev_notifier = {
+	.notifier_call = nh_netdev_event,
+};
+
+static void __net_exit nexthop_net_exit(struct net *net)
+{
+	struct nl_info nlinfo = {
+		.nl_net = net,
+	};
+	struct rb_node *node;
+
+	rtnl_lock();
+	while ((node = rb_first(&net->nexthop.rb_root))) {
+		struct nexthop *nh = rb_entry(node, struct nexthop, rb_node);
+
+		remove_nexthop(net, nh, &nlinfo);
+	}
+	rtnl_unlock();
+}
+
+static int __net_init nexthop_net_init(struct net *net)
+{
+	net->nexthop.rb_root = RB_ROOT;
+	return 0;
+}
+
+static struct pernet_operations nexthop_net_ops = {
+	.init = nexthop_net_init,
+	.exit = nexthop_net_exit,
+};
+
+static int __init nexthop_init(void)
+{
+	register_pernet_subsys(&nexthop_net_ops);
+
+	register_netdevice_notifier(&nh_netdev_notifier);
+
+	rtnl_register(PF_UNSPEC, RTM_NEWNEXTHOP, rtm_new_nexthop, NULL, 0);
+	rtnl_register(PF_UNSPEC, RTM_DELNEXTHOP, rtm_del_nexthop, NULL, 0);
+	rtnl_register(PF_UNSPEC, RTM_GETNEXTHOP, rtm_get_nexthop,
+		      rtm_dump_nexthop, 0);
+
+	return 0;
+}
+subsys_initcall(nexthop_init);
@@ -2121,6 +2121,69 @@ int ip_route_input_noref(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 }
 EXPORT_SYMBOL(ip_route_input_noref);
 
+/* The result of the input route lookup only depends on the addresses, tos,
+ * mark and device, unless tunnel metadata, L4 fib rules or L4 (or ICMP
+ * inner header) multipath hashing are involved.
+ */
+static bool ip_route_input_hint_ok(const struct net *net,
+				   const struct sk_buff *skb)
+{
+	if (skb_tunnel_info(skb) || ip_hdr(skb)->protocol == IPPROTO_ICMP)
+		return false;
+#ifdef CONFIG_IP_MULTIPLE_TABLES
+	if (net->ipv4.fib_rules_require_fldissect)
+		return false;
+#endif
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+	if (net->ipv4.sysctl_fib_multipath_hash_policy)
+		return false;
+#endif
+	return true;
+}
+
+/* Route a packet from a received list: if the previous lookup had the same
+ * keys and found a cached route that is still valid, reuse it instead of
+ * walking the fib again. Called with rcu_read_lock held, for the whole list.
+ */
+int ip_route_input_hint(struct sk_buff *skb, __be32 daddr, __be32 saddr,
+			u8 tos, struct net_device *dev,
+			struct ip_rt_input_hint *hint)
+{
+	struct net *net = dev_net(dev);
+	struct fib_result res;
+	int err;
+
+	tos &= IPTOS_RT_MASK;
+	if (hint->rt && hint->daddr == daddr && hint->saddr == saddr &&
+	    hint->tos == tos && hint->dev == dev && hint->mark == skb->mark &&
+	    rt_cache_valid(hint->rt) && ip_route_input_hint_ok(net, skb)) {
+		IPCB(skb)->flags |= hint->ipcb_flags;
+		skb_dst_set_noref(skb, &hint->rt->dst);
+		return 0;
+	}
+
+	hint->rt = NULL;
+	err = ip_route_input_rcu(skb, daddr, saddr, tos, dev, &res);
+	if (err)
+		return err;
+
+	/* only routes from the nexthop cache can be shared */
+	if (!(skb->_skb_refdst & SKB_DST_NOREF) ||
+	    !ip_route_input_hint_ok(net, skb))
+		return 0;
+
+	hint->rt = skb_rtable(skb);
+	hint->dev = dev;
+	hint->daddr = daddr;
+	hint->saddr = saddr;
+	hint->mark = skb->mark;
+	hint->tos = tos;
+	hint->ipcb_flags = IPCB(skb)->flags & IPSKB_DOREDIRECT;
+
+	return 0;
+}
+EXPORT_SYMBOL(ip_route_input_hint);
+
 /* called with rcu_read_lock held */
 int ip_route_input_rcu(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 		       u8 tos, struct net_device *dev, struct fib_result *res)
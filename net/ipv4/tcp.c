@@ -275,6 +275,7 @@
 #include <net/icmp.h>
 #include <net/inet_common.h>
 #include <net/tcp.h>
+#include <net/mptcp.h>
 #include <net/xfrm.h>
 #include <net/ip.h>
 #include <net/sock.h>
@@ -1744,6 +1745,47 @@ int tcp_mmap(struct file *file, struct socket *sock,
 }
 EXPORT_SYMBOL(tcp_mmap);
 
+/* Copy up to @len bytes starting at *@seq, which could not be mapped,
+ * into the user supplied copy buffer.  Several skbs may be walked, the
+ * caller still owns the read queue and updates copied_seq from *@seq.
+ */
+static int tcp_zerocopy_copy_leftover(struct sock *sk,
+				      struct tcp_zerocopy_receive *zc,
+				      u32 len, u32 *seq)
+{
+	unsigned long copy_address = (unsigned long)zc->copybuf_address;
+	struct msghdr msg = {};
+	struct iovec iov;
+	u32 copied = 0;
+	int err;
+
+	if (copy_address != zc->copybuf_address)
+		return -EINVAL;
+
+	err = import_single_range(READ, (void __user *)copy_address, len,
+				  &iov, &msg.msg_iter);
+	if (err)
+		return err;
+
+	while (copied < len) {
+		struct sk_buff *skb;
+		u32 offset, used;
+
+		skb = tcp_recv_skb(sk, *seq, &offset);
+		if (!skb)
+			break;
+		used = min_t(u32, skb->len - offset, len - copied);
+		if (!used)
+			break;
+		err = skb_copy_datagram_msg(skb, offset, &msg, used);
+		if (err)
+			return copied ? (int)copied : err;
+		copied += used;
+		*seq += used;
+	}
+	return copied;
+}
+
 static int tcp_zerocopy_receive(struct sock *sk,
 				struct tcp_zerocopy_receive *zc)
 {
@@ -1752,12 +1794,15 @@ static int tcp_zerocopy_receive(struct sock *sk,
 	u32 length = 0, seq, offset;
 	struct vm_area_struct *vma;
 	struct sk_buff *skb = NULL;
+	s32 copybuf_len = zc->copybuf_len;
 	struct tcp_sock *tp;
+	int copied = 0;
 	int inq;
 	int ret;
 
 	if (address & (PAGE_SIZE - 1) || address != zc->address)
 		return -EINVAL;
+	zc->copybuf_len = 0;
 
 	if (sk->sk_state == TCP_LISTEN)
 		return -ENOTCONN;
@@ -1795,7 +1840,8 @@ static int tcp_zerocopy_receive(struct sock *sk,
 
 			zc->recv_skip_hint = skb->len - offset;
 			offset -= skb_headlen(skb);
-			if ((int)offset < 0 || skb_has_frag_list(skb))
+			if ((int)offset < 0 || skb_has_frag_list(skb) ||
+			    skb->devmem)
 				break;
 			frags = skb_shinfo(skb)->frags;
 			while (offset) {
@@ -1827,15 +1873,31 @@ static int tcp_zerocopy_receive(struct sock *sk,
 	}
 out:
 	up_read(&current->mm->mmap_sem);
-	if (length) {
+
+	/* Mapping stopped at data that is not page aligned: copy it to the
+	 * caller's buffer so that it does not need a separate recvmsg().
+	 */
+	if (!ret && copybuf_len > 0 && zc->recv_skip_hint &&
+	    (length < zc->length || !zc->length)) {
+		copied = tcp_zerocopy_copy_leftover(sk, zc,
+				min_t(u32, copybuf_len, zc->recv_skip_hint),
+				&seq);
+		zc->copybuf_len = copied;
+		if (copied > 0)
+			zc->recv_skip_hint -= copied;
+		else
+			copied = 0;
+	}
+
+	if (length || copied) {
 		tp->copied_seq = seq;
 		tcp_rcv_space_adjust(sk);
 
 		/* Clean up data we have read: This will do ACK frames. */
 		tcp_recv_skb(sk, seq, &offset);
-		tcp_cleanup_rbuf(sk, length);
+		tcp_cleanup_rbuf(sk, length + copied);
 		ret = 0;
-		if (length == zc->length)
+		if (length && length == zc->length)
 			zc->recv_skip_hint = 0;
 	} else {
 		if (!zc->recv_skip_hint && sock_flag(sk, SOCK_DONE))
@@ -1917,6 +1979,109 @@ static int tcp_inq_hint(struct sock *sk)
 	return inq;
 }
 
+#ifdef CONFIG_NET_DEVMEM
+/*
+ * Hand out the payload of a device memory skb: bytes the header split left
+ * in the linear part are copied and reported with SCM_DEVMEM_LINEAR, each
+ * net_iov frag is reported with SCM_DEVMEM_DMABUF and a token which keeps
+ * it from being recycled until SO_DEVMEM_DONTNEED gives it back.
+ * Returns the number of bytes consumed, or an error if there were none.
+ */
+static int tcp_recvmsg_devmem(struct sock *sk, const struct sk_buff *skb,
+			      unsigned int offset, struct msghdr *msg,
+			      int remaining_len)
+{
+	struct dmabuf_cmsg dmabuf_cmsg = {};
+	int start = skb_headlen(skb);
+	int i, copy, err = 0;
+	int sent = 0;
+
+	copy = start - offset;
+	if (copy > 0) {
+		copy = min(copy, remaining_len);
+		if (copy_to_iter(skb->data + offset, copy,
+				 &msg->msg_iter) != copy) {
+			err = -EFAULT;
+			goto out;
+		}
+		offset += copy;
+		remaining_len -= copy;
+
+		dmabuf_cmsg.frag_size = copy;
+		err = put_cmsg(msg, SOL_SOCKET, SO_DEVMEM_LINEAR,
+			       sizeof(dmabuf_cmsg), &dmabuf_cmsg);
+		if (err || msg->msg_flags & MSG_CTRUNC)
+			goto out;
+
+		sent += copy;
+		if (!remaining_len)
+			goto out;
+	}
+
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
+		const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+		struct net_iov *niov;
+		u32 token = 0;
+		int end;
+
+		end = start + skb_frag_size(frag);
+		copy = end - offset;
+		if (copy <= 0) {
+			start = end;
+			continue;
+		}
+		copy = min(copy, remaining_len);
+
+		/* All the payload of such skbs is in device memory */
+		if (!skb_frag_is_net_iov(frag)) {
+			err = -ENODEV;
+			goto out;
+		}
+		niov = skb_frag_net_iov(frag);
+
+		err = xa_alloc_bh(&sk->sk_user_frags, &token, U32_MAX, niov,
+				  GFP_KERNEL);
+		if (err)
+			goto out;
+		net_iov_get(niov);
+
+		dmabuf_cmsg.frag_offset = net_iov_dmabuf_offset(niov) +
+					  frag->page_offset + offset - start;
+		dmabuf_cmsg.frag_size = copy;
+		dmabuf_cmsg.frag_token = token;
+		dmabuf_cmsg.dmabuf_id = niov->binding->id;
+		err = put_cmsg(msg, SOL_SOCKET, SO_DEVMEM_DMABUF,
+			       sizeof(dmabuf_cmsg), &dmabuf_cmsg);
+		if (err || msg->msg_flags & MSG_CTRUNC) {
+			xa_erase_bh(&sk->sk_user_frags, token);
+			net_iov_put(niov);
+			goto out;
+		}
+
+		offset += copy;
+		remaining_len -= copy;
+		sent += copy;
+		if (!remaining_len)
+			goto out;
+		start = end;
+	}
+
+out:
+	if (!sent)
+		return err ?: -ENOBUFS;
+	/* What did not fit is left for the next call */
+	msg->msg_flags &= ~MSG_CTRUNC;
+	return sent;
+}
+#else
+static int tcp_recvmsg_devmem(struct sock *sk, const struct sk_buff *skb,
+			      unsigned int offset, struct msghdr *msg,
+			      int remaining_len)
+{
+	return -EFAULT;
+}
+#endif
+
 /*
  *	This routine copies from a sock struct into the user buffer.
  *
@@ -1940,6 +2105,7 @@ int tcp_recvmsg(struct sock *sk, struct msghdr *msg, size_t len, int nonblock,
 	u32 urg_hole = 0;
 	struct scm_timestamping tss;
 	bool has_tss = false;
+	int last_devmem = -1;
 	bool has_cmsg;
 
 	if (unlikely(flags & MSG_ERRQUEUE))
@@ -2113,12 +2279,36 @@ int tcp_recvmsg(struct sock *sk, struct msghdr *msg, size_t len, int nonblock,
 		}
 
 		if (!(flags & MSG_TRUNC)) {
-			err = skb_copy_datagram_msg(skb, offset, msg, used);
-			if (err) {
-				/* Exception. Bailout! */
-				if (!copied)
-					copied = -EFAULT;
+			/* Without cmsgs, copied and device memory bytes could
+			 * not be told apart: stop where the kind changes.
+			 */
+			if (last_devmem != -1 && last_devmem != skb->devmem)
 				break;
+			last_devmem = skb->devmem;
+
+			if (unlikely(skb->devmem)) {
+				if (!(flags & MSG_SOCK_DEVMEM) ||
+				    (flags & MSG_PEEK))
+					err = -EFAULT;
+				else
+					err = tcp_recvmsg_devmem(sk, skb,
+								 offset, msg,
+								 used);
+				if (err < 0) {
+					if (!copied)
+						copied = err;
+					break;
+				}
+				used = err;
+			} else {
+				err = skb_copy_datagram_msg(skb, offset, msg,
+							    used);
+				if (err) {
+					/* Exception. Bailout! */
+					if (!copied)
+						copied = -EFAULT;
+					break;
+				}
 			}
 		}
 
@@ -3054,6 +3244,17 @@ static int do_tcp_setsockopt(struct sock *sk, int level,
 		else
 			tp->recvmsg_inq = val;
 		break;
+	case TCP_ACCEPT_PERCPU:
+		/* Once a listener used them, children added late may still
+		 * reference the per-CPU queues, so they cannot be turned off.
+		 */
+		if (val > 1 || val < 0 || sk->sk_state != TCP_CLOSE)
+			err = -EINVAL;
+		else if (val)
+			err = reqsk_subqueue_alloc(&icsk->icsk_accept_queue);
+		else if (icsk->icsk_accept_queue.rskq_subq)
+			err = -EINVAL;
+		break;
 	default:
 		err = -ENOPROTOOPT;
 		break;
@@ -3518,6 +3719,9 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 	case TCP_INQ:
 		val = tp->recvmsg_inq;
 		break;
+	case TCP_ACCEPT_PERCPU:
+		val = !!icsk->icsk_accept_queue.rskq_subq;
+		break;
 	case TCP_SAVE_SYN:
 		val = tp->save_syn;
 		break;
@@ -3556,17 +3760,30 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 	}
 #ifdef CONFIG_MMU
 	case TCP_ZEROCOPY_RECEIVE: {
-		struct tcp_zerocopy_receive zc;
+		struct tcp_zerocopy_receive zc = {};
 		int err;
 
 		if (get_user(len, optlen))
 			return -EFAULT;
-		if (len != sizeof(zc))
+		/* Older binaries pass the structure without the copy buffer */
+		if (len < offsetofend(struct tcp_zerocopy_receive,
+				      recv_skip_hint))
 			return -EINVAL;
+		if (len > sizeof(zc)) {
+			len = sizeof(zc);
+			if (put_user(len, optlen))
+				return -EFAULT;
+		}
 		if (copy_from_user(&zc, optval, len))
 			return -EFAULT;
+		if (zc.flags)
+			return -EINVAL;
 		lock_sock(sk);
 		err = tcp_zerocopy_receive(sk, &zc);
+		if (!err) {
+			zc.inq = tcp_inq_hint(sk);
+			zc.err = sock_error(sk);
+		}
 		release_sock(sk);
 		if (!err && copy_to_user(optval, &zc, len))
 			err = -EFAULT;
@@ -3914,4 +4131,5 @@ void __init tcp_init(void)
 	tcp_metrics_init();
 	BUG_ON(tcp_register_congestion_control(&tcp_reno) != 0);
 	tcp_tasklet_init();
+	mptcp_init();
 }
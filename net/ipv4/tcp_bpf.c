@@ -8,6 +8,8 @@
 #include <linux/wait.h>
 
 #include <net/inet_common.h>
+#include <net/inet_hashtables.h>
+#include <net/inet6_hashtables.h>
 
 static bool tcp_bpf_stream_read(const struct sock *sk)
 {
@@ -111,6 +113,15 @@ int __tcp_bpf_recvmsg(struct sock *sk, struct sk_psock *psock,
 }
 EXPORT_SYMBOL_GPL(__tcp_bpf_recvmsg);
 
+/* Data from the peer of a bypass went to the ingress queue only while the
+ * receive queue was empty, and is older than what is there now.
+ */
+static bool tcp_bpf_ingress_first(struct sk_psock *psock)
+{
+	return sk_psock_test_state(psock, SK_PSOCK_BYPASS) &&
+	       !list_empty(&psock->ingress_msg);
+}
+
 int tcp_bpf_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
 		    int nonblock, int flags, int *addr_len)
 {
@@ -119,12 +130,15 @@ int tcp_bpf_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
 
 	if (unlikely(flags & MSG_ERRQUEUE))
 		return inet_recv_error(sk, msg, len, addr_len);
-	if (!skb_queue_empty(&sk->sk_receive_queue))
-		return tcp_recvmsg(sk, msg, len, nonblock, flags, addr_len);
 
 	psock = sk_psock_get(sk);
 	if (unlikely(!psock))
 		return tcp_recvmsg(sk, msg, len, nonblock, flags, addr_len);
+	if (!skb_queue_empty(&sk->sk_receive_queue) &&
+	    !tcp_bpf_ingress_first(psock)) {
+		sk_psock_put(sk, psock);
+		return tcp_recvmsg(sk, msg, len, nonblock, flags, addr_len);
+	}
 	lock_sock(sk);
 msg_bytes_ready:
 	copied = __tcp_bpf_recvmsg(sk, psock, msg, len, flags);
@@ -135,7 +149,8 @@ int tcp_bpf_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
 		timeo = sock_rcvtimeo(sk, nonblock);
 		data = tcp_bpf_wait_data(sk, psock, flags, timeo, &err);
 		if (data) {
-			if (skb_queue_empty(&sk->sk_receive_queue))
+			if (skb_queue_empty(&sk->sk_receive_queue) ||
+			    tcp_bpf_ingress_first(psock))
 				goto msg_bytes_ready;
 			release_sock(sk);
 			sk_psock_put(sk, psock);
@@ -370,12 +385,72 @@ static int tcp_bpf_send_verdict(struct sock *sk, struct sk_psock *psock,
 	return ret;
 }
 
+/* Return the peer of @sk, with a reference, when data sent now can go to
+ * its ingress queue rather than through TCP: everything sent through TCP
+ * before was acked, and read since the receive queue of the peer is empty.
+ */
+static struct sock *tcp_bpf_peer_get(struct sock *sk, struct sk_psock *psock)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	struct sock *peer;
+
+	rcu_read_lock();
+	peer = rcu_dereference(psock->sk_peer);
+	if (peer && !refcount_inc_not_zero(&peer->sk_refcnt))
+		peer = NULL;
+	/* TCP sockets are SLAB_TYPESAFE_BY_RCU, this one may be another */
+	if (peer && unlikely(peer != rcu_access_pointer(psock->sk_peer))) {
+		sock_put(peer);
+		peer = NULL;
+	}
+	rcu_read_unlock();
+	if (!peer)
+		return NULL;
+
+	if (sk->sk_state != TCP_ESTABLISHED ||
+	    READ_ONCE(tp->snd_una) != tp->write_seq ||
+	    READ_ONCE(peer->sk_state) != TCP_ESTABLISHED ||
+	    READ_ONCE(peer->sk_shutdown) & RCV_SHUTDOWN ||
+	    !skb_queue_empty(&peer->sk_receive_queue)) {
+		sock_put(peer);
+		return NULL;
+	}
+	return peer;
+}
+
+static int tcp_bpf_send_peer(struct sock *sk, struct sock *peer,
+			     struct sk_msg *msg, int *copied, int flags)
+{
+	struct sk_psock *psock;
+	int ret;
+
+	psock = sk_psock_get(peer);
+	if (unlikely(!psock)) {
+		ret = tcp_bpf_push(sk, msg, 0, flags, true);
+		if (unlikely(ret))
+			*copied -= sk_msg_free(sk, msg);
+		return ret;
+	}
+
+	sk_msg_return(sk, msg, msg->sg.size);
+	release_sock(sk);
+	do {
+		ret = bpf_tcp_ingress(peer, psock, msg, msg->sg.size, flags);
+	} while (!ret && msg->sg.start != msg->sg.end);
+	lock_sock(sk);
+	if (unlikely(ret < 0))
+		*copied -= sk_msg_free_nocharge(sk, msg);
+	sk_psock_put(peer, psock);
+	return ret;
+}
+
 static int tcp_bpf_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 {
 	struct sk_msg tmp, *msg_tx = NULL;
 	int flags = msg->msg_flags | MSG_NO_SHARED_FRAGS;
 	int copied = 0, err = 0;
 	struct sk_psock *psock;
+	struct sock *peer = NULL;
 	long timeo;
 
 	psock = sk_psock_get(sk);
@@ -383,6 +458,16 @@ static int tcp_bpf_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 		return tcp_sendmsg(sk, msg, size);
 
 	lock_sock(sk);
+	/* without a msg_parser, here only for SK_PSOCK_BYPASS */
+	if (!READ_ONCE(psock->progs.msg_parser)) {
+		peer = tcp_bpf_peer_get(sk, psock);
+		if (!peer) {
+			err = tcp_sendmsg_locked(sk, msg, size);
+			release_sock(sk);
+			sk_psock_put(sk, psock);
+			return err;
+		}
+	}
 	timeo = sock_sndtimeo(sk, msg->msg_flags & MSG_DONTWAIT);
 	while (msg_data_left(msg)) {
 		bool enospc = false;
@@ -432,7 +517,12 @@ static int tcp_bpf_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 			psock->cork_bytes = 0;
 		}
 
-		err = tcp_bpf_send_verdict(sk, psock, msg_tx, &copied, flags);
+		if (peer)
+			err = tcp_bpf_send_peer(sk, peer, msg_tx, &copied,
+						flags);
+		else
+			err = tcp_bpf_send_verdict(sk, psock, msg_tx, &copied,
+						   flags);
 		if (unlikely(err < 0))
 			goto out_err;
 		continue;
@@ -450,6 +540,8 @@ static int tcp_bpf_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 	if (err < 0)
 		err = sk_stream_error(sk, msg->msg_flags, err);
 	release_sock(sk);
+	if (peer)
+		sock_put(peer);
 	sk_psock_put(sk, psock);
 	return copied ? copied : err;
 }
@@ -465,6 +557,10 @@ static int tcp_bpf_sendpage(struct sock *sk, struct page *page, int offset,
 	psock = sk_psock_get(sk);
 	if (unlikely(!psock))
 		return tcp_sendpage(sk, page, offset, size, flags);
+	if (!READ_ONCE(psock->progs.msg_parser)) {
+		sk_psock_put(sk, psock);
+		return tcp_sendpage(sk, page, offset, size, flags);
+	}
 
 	lock_sock(sk);
 	if (psock->cork) {
@@ -506,6 +602,7 @@ static void tcp_bpf_remove(struct sock *sk, struct sk_psock *psock)
 {
 	struct sk_psock_link *link;
 
+	sk_psock_unpair(psock);
 	sk_psock_cork_free(psock);
 	__sk_psock_purge_ingress_msg(psock);
 	while ((link = sk_psock_link_pop(psock))) {
@@ -605,10 +702,17 @@ static int __init tcp_bpf_v4_build_proto(void)
 }
 core_initcall(tcp_bpf_v4_build_proto);
 
+static int tcp_bpf_sk_prot_config(struct sk_psock *psock)
+{
+	return psock->progs.msg_parser ||
+	       sk_psock_test_state(psock, SK_PSOCK_BYPASS) ?
+	       TCP_BPF_TX : TCP_BPF_BASE;
+}
+
 static void tcp_bpf_update_sk_prot(struct sock *sk, struct sk_psock *psock)
 {
 	int family = sk->sk_family == AF_INET6 ? TCP_BPF_IPV6 : TCP_BPF_IPV4;
-	int config = psock->progs.msg_parser   ? TCP_BPF_TX   : TCP_BPF_BASE;
+	int config = tcp_bpf_sk_prot_config(psock);
 
 	sk_psock_update_proto(sk, psock, &tcp_bpf_prots[family][config]);
 }
@@ -616,7 +720,7 @@ static void tcp_bpf_update_sk_prot(struct sock *sk, struct sk_psock *psock)
 static void tcp_bpf_reinit_sk_prot(struct sock *sk, struct sk_psock *psock)
 {
 	int family = sk->sk_family == AF_INET6 ? TCP_BPF_IPV6 : TCP_BPF_IPV4;
-	int config = psock->progs.msg_parser   ? TCP_BPF_TX   : TCP_BPF_BASE;
+	int config = tcp_bpf_sk_prot_config(psock);
 
 	/* Reinit occurs when program types change e.g. TCP_BPF_TX is removed
 	 * or added requiring sk_prot hook updates. We keep original saved
@@ -667,3 +771,61 @@ int tcp_bpf_init(struct sock *sk)
 	rcu_read_unlock();
 	return 0;
 }
+
+static struct sock *tcp_bpf_lookup_peer(struct sock *sk)
+{
+	const struct inet_sock *inet = inet_sk(sk);
+	struct net *net = sock_net(sk);
+
+	switch (sk->sk_family) {
+	case AF_INET:
+		return inet_lookup_established(net, &tcp_hashinfo,
+					       inet->inet_saddr,
+					       inet->inet_sport,
+					       inet->inet_daddr,
+					       inet->inet_dport,
+					       sk->sk_bound_dev_if);
+#if IS_ENABLED(CONFIG_IPV6)
+	case AF_INET6:
+		return __inet6_lookup_established(net, &tcp_hashinfo,
+						  &sk->sk_v6_rcv_saddr,
+						  inet->inet_sport,
+						  &sk->sk_v6_daddr,
+						  ntohs(inet->inet_dport),
+						  sk->sk_bound_dev_if, 0);
+#endif
+	}
+	return NULL;
+}
+
+/* Pair @sk with the other end of its connection, if that's a socket of this
+ * host with SK_PSOCK_BYPASS too. The sequence numbers must match, so that a
+ * socket with the mirrored addresses but another connection isn't taken for
+ * the peer.
+ */
+void tcp_bpf_pair(struct sock *sk, struct sk_psock *psock)
+{
+	struct sk_psock *peer_psock;
+	struct sock *peer;
+
+	if (sk->sk_state != TCP_ESTABLISHED)
+		return;
+
+	rcu_read_lock();
+	peer = tcp_bpf_lookup_peer(sk);
+	if (!peer)
+		goto out;
+
+	/* a connection to itself has no peer */
+	if (peer != sk && peer->sk_state == TCP_ESTABLISHED &&
+	    tcp_sk(peer)->snd_nxt == tcp_sk(sk)->rcv_nxt &&
+	    tcp_sk(peer)->rcv_nxt == tcp_sk(sk)->snd_nxt) {
+		peer_psock = sk_psock(peer);
+		if (peer_psock &&
+		    sk_psock_test_state(peer_psock, SK_PSOCK_BYPASS))
+			sk_psock_pair(psock, peer_psock);
+	}
+	sock_gen_put(peer);
+out:
+	rcu_read_unlock();
+}
@@ -81,6 +81,7 @@
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
 #include <linux/inetdevice.h>
+#include <linux/bpf.h>
 
 #include <crypto/hash.h>
 #include <linux/scatterlist.h>
@@ -2020,9 +2021,24 @@ EXPORT_SYMBOL(tcp_v4_destroy_sock);
  * starting from bucket given in st->bucket; when st->bucket is zero the
  * very first socket in the hash table is returned.
  */
+static unsigned short seq_file_family(const struct seq_file *seq)
+{
+	const struct tcp_iter_state *st = seq->private;
+	const struct tcp_seq_afinfo *afinfo;
+
+	/* BPF iterators see sockets of all families, their program filters */
+	afinfo = st->bpf_seq_afinfo ?: PDE_DATA(file_inode(seq->file));
+	return afinfo->family;
+}
+
+static bool seq_sk_family_match(const struct sock *sk, unsigned short family)
+{
+	return family == AF_UNSPEC || sk->sk_family == family;
+}
+
 static void *listening_get_next(struct seq_file *seq, void *cur)
 {
-	struct tcp_seq_afinfo *afinfo = PDE_DATA(file_inode(seq->file));
+	unsigned short family = seq_file_family(seq);
 	struct tcp_iter_state *st = seq->private;
 	struct net *net = seq_file_net(seq);
 	struct inet_listen_hashbucket *ilb;
@@ -2045,7 +2061,7 @@ static void *listening_get_next(struct seq_file *seq, void *cur)
 	sk_for_each_from(sk) {
 		if (!net_eq(sock_net(sk), net))
 			continue;
-		if (sk->sk_family == afinfo->family)
+		if (seq_sk_family_match(sk, family))
 			return sk;
 	}
 	spin_unlock(&ilb->lock);
@@ -2082,7 +2098,7 @@ static inline bool empty_bucket(const struct tcp_iter_state *st)
  */
 static void *established_get_first(struct seq_file *seq)
 {
-	struct tcp_seq_afinfo *afinfo = PDE_DATA(file_inode(seq->file));
+	unsigned short family = seq_file_family(seq);
 	struct tcp_iter_state *st = seq->private;
 	struct net *net = seq_file_net(seq);
 	void *rc = NULL;
@@ -2099,7 +2115,7 @@ static void *established_get_first(struct seq_file *seq)
 
 		spin_lock_bh(lock);
 		sk_nulls_for_each(sk, node, &tcp_hashinfo.ehash[st->bucket].chain) {
-			if (sk->sk_family != afinfo->family ||
+			if (!seq_sk_family_match(sk, family) ||
 			    !net_eq(sock_net(sk), net)) {
 				continue;
 			}
@@ -2114,7 +2130,7 @@ static void *established_get_first(struct seq_file *seq)
 
 static void *established_get_next(struct seq_file *seq, void *cur)
 {
-	struct tcp_seq_afinfo *afinfo = PDE_DATA(file_inode(seq->file));
+	unsigned short family = seq_file_family(seq);
 	struct sock *sk = cur;
 	struct hlist_nulls_node *node;
 	struct tcp_iter_state *st = seq->private;
@@ -2126,7 +2142,7 @@ static void *established_get_next(struct seq_file *seq, void *cur)
 	sk = sk_nulls_next(sk);
 
 	sk_nulls_for_each_from(sk, node) {
-		if (sk->sk_family == afinfo->family &&
+		if (seq_sk_family_match(sk, family) &&
 		    net_eq(sock_net(sk), net))
 			return sk;
 	}
@@ -2442,6 +2458,88 @@ void tcp4_proc_exit(void)
 {
 	unregister_pernet_subsys(&tcp4_net_ops);
 }
+
+#ifdef CONFIG_BPF_SYSCALL
+/* BPF iterator target "tcp": args[0] is the sock_common of a listening,
+ * request, established or timewait socket of any family, args[1] its uid.
+ */
+static struct tcp_seq_afinfo bpf_iter_tcp_seq_afinfo = {
+	.family		= AF_UNSPEC,
+};
+
+static int __bpf_iter_tcp_seq_show(struct seq_file *seq, struct sock *sk,
+				   bool in_stop)
+{
+	struct bpf_iter_ctx ctx = {};
+	struct bpf_iter_meta meta;
+	struct bpf_prog *prog;
+	kuid_t uid;
+
+	meta.seq = seq;
+	prog = bpf_iter_get_info(&meta, in_stop);
+	if (!prog)
+		return 0;
+
+	ctx.meta = &meta;
+	if (sk) {
+		if (sk->sk_state == TCP_TIME_WAIT)
+			uid = GLOBAL_ROOT_UID;
+		else if (sk->sk_state == TCP_NEW_SYN_RECV)
+			uid = sock_i_uid(inet_reqsk(sk)->rsk_listener);
+		else
+			uid = sock_i_uid(sk);
+
+		ctx.args[0] = (unsigned long)sk;
+		ctx.args[1] = from_kuid_munged(seq_user_ns(seq), uid);
+	}
+	return bpf_iter_run_prog(prog, &ctx);
+}
+
+static int bpf_iter_tcp_seq_show(struct seq_file *seq, void *v)
+{
+	if (v == SEQ_START_TOKEN)
+		return 0;
+
+	return __bpf_iter_tcp_seq_show(seq, v, false);
+}
+
+static void bpf_iter_tcp_seq_stop(struct seq_file *seq, void *v)
+{
+	if (!v)
+		(void)__bpf_iter_tcp_seq_show(seq, v, true);
+
+	tcp_seq_stop(seq, v);
+}
+
+static const struct seq_operations bpf_iter_tcp_seq_ops = {
+	.show		= bpf_iter_tcp_seq_show,
+	.start		= tcp_seq_start,
+	.next		= tcp_seq_next,
+	.stop		= bpf_iter_tcp_seq_stop,
+};
+
+static int bpf_iter_init_tcp(void *priv_data)
+{
+	struct tcp_iter_state *st = priv_data;
+
+	st->bpf_seq_afinfo = &bpf_iter_tcp_seq_afinfo;
+	return bpf_iter_init_seq_net(priv_data);
+}
+
+static const struct bpf_iter_reg tcp_reg_info = {
+	.target			= "tcp",
+	.seq_ops		= &bpf_iter_tcp_seq_ops,
+	.init_seq_private	= bpf_iter_init_tcp,
+	.fini_seq_private	= bpf_iter_fini_seq_net,
+	.seq_priv_size		= sizeof(struct tcp_iter_state),
+};
+
+static int __init bpf_iter_tcp_init(void)
+{
+	return bpf_iter_reg_target(&tcp_reg_info);
+}
+late_initcall(bpf_iter_tcp_init);
+#endif /* CONFIG_BPF_SYSCALL */
 #endif /* CONFIG_PROC_FS */
 
 struct proto tcp_prot = {
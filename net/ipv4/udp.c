@@ -115,6 +115,7 @@
 #include "udp_impl.h"
 #include <net/sock_reuseport.h>
 #include <net/addrconf.h>
+#include <linux/bpf.h>
 
 struct udp_table udp_table __read_mostly;
 EXPORT_SYMBOL(udp_table);
@@ -2684,10 +2685,24 @@ EXPORT_SYMBOL(udp_prot);
 /* ------------------------------------------------------------------------ */
 #ifdef CONFIG_PROC_FS
 
+static struct udp_seq_afinfo *udp_get_seq_afinfo(struct seq_file *seq)
+{
+	struct udp_iter_state *state = seq->private;
+
+	return state->bpf_seq_afinfo ?: PDE_DATA(file_inode(seq->file));
+}
+
+/* BPF iterators see sockets of all families, their program filters */
+static bool udp_sk_family_match(const struct sock *sk,
+				const struct udp_seq_afinfo *afinfo)
+{
+	return afinfo->family == AF_UNSPEC || sk->sk_family == afinfo->family;
+}
+
 static struct sock *udp_get_first(struct seq_file *seq, int start)
 {
 	struct sock *sk;
-	struct udp_seq_afinfo *afinfo = PDE_DATA(file_inode(seq->file));
+	struct udp_seq_afinfo *afinfo = udp_get_seq_afinfo(seq);
 	struct udp_iter_state *state = seq->private;
 	struct net *net = seq_file_net(seq);
 
@@ -2702,7 +2717,7 @@ static struct sock *udp_get_first(struct seq_file *seq, int start)
 		sk_for_each(sk, &hslot->head) {
 			if (!net_eq(sock_net(sk), net))
 				continue;
-			if (sk->sk_family == afinfo->family)
+			if (udp_sk_family_match(sk, afinfo))
 				goto found;
 		}
 		spin_unlock_bh(&hslot->lock);
@@ -2714,13 +2729,14 @@ static struct sock *udp_get_first(struct seq_file *seq, int start)
 
 static struct sock *udp_get_next(struct seq_file *seq, struct sock *sk)
 {
-	struct udp_seq_afinfo *afinfo = PDE_DATA(file_inode(seq->file));
+	struct udp_seq_afinfo *afinfo = udp_get_seq_afinfo(seq);
 	struct udp_iter_state *state = seq->private;
 	struct net *net = seq_file_net(seq);
 
 	do {
 		sk = sk_next(sk);
-	} while (sk && (!net_eq(sock_net(sk), net) || sk->sk_family != afinfo->family));
+	} while (sk && (!net_eq(sock_net(sk), net) ||
+			!udp_sk_family_match(sk, afinfo)));
 
 	if (!sk) {
 		if (state->bucket <= afinfo->udp_table->mask)
@@ -2765,7 +2781,7 @@ EXPORT_SYMBOL(udp_seq_next);
 
 void udp_seq_stop(struct seq_file *seq, void *v)
 {
-	struct udp_seq_afinfo *afinfo = PDE_DATA(file_inode(seq->file));
+	struct udp_seq_afinfo *afinfo = udp_get_seq_afinfo(seq);
 	struct udp_iter_state *state = seq->private;
 
 	if (state->bucket <= afinfo->udp_table->mask)
@@ -2851,6 +2867,84 @@ void udp4_proc_exit(void)
 {
 	unregister_pernet_subsys(&udp4_net_ops);
 }
+
+#ifdef CONFIG_BPF_SYSCALL
+/* BPF iterator target "udp": args[0] is the udp_sock, of any family,
+ * args[1] its uid and args[2] its bucket in udp_table.
+ */
+static struct udp_seq_afinfo bpf_iter_udp_seq_afinfo = {
+	.family		= AF_UNSPEC,
+	.udp_table	= &udp_table,
+};
+
+static int __bpf_iter_udp_seq_show(struct seq_file *seq, struct sock *sk,
+				   bool in_stop)
+{
+	struct udp_iter_state *state = seq->private;
+	struct bpf_iter_ctx ctx = {};
+	struct bpf_iter_meta meta;
+	struct bpf_prog *prog;
+
+	meta.seq = seq;
+	prog = bpf_iter_get_info(&meta, in_stop);
+	if (!prog)
+		return 0;
+
+	ctx.meta = &meta;
+	if (sk) {
+		ctx.args[0] = (unsigned long)udp_sk(sk);
+		ctx.args[1] = from_kuid_munged(seq_user_ns(seq),
+					       sock_i_uid(sk));
+		ctx.args[2] = state->bucket;
+	}
+	return bpf_iter_run_prog(prog, &ctx);
+}
+
+static int bpf_iter_udp_seq_show(struct seq_file *seq, void *v)
+{
+	if (v == SEQ_START_TOKEN)
+		return 0;
+
+	return __bpf_iter_udp_seq_show(seq, v, false);
+}
+
+static void bpf_iter_udp_seq_stop(struct seq_file *seq, void *v)
+{
+	if (!v)
+		(void)__bpf_iter_udp_seq_show(seq, v, true);
+
+	udp_seq_stop(seq, v);
+}
+
+static const struct seq_operations bpf_iter_udp_seq_ops = {
+	.start		= udp_seq_start,
+	.next		= udp_seq_next,
+	.stop		= bpf_iter_udp_seq_stop,
+	.show		= bpf_iter_udp_seq_show,
+};
+
+static int bpf_iter_init_udp(void *priv_data)
+{
+	struct udp_iter_state *state = priv_data;
+
+	state->bpf_seq_afinfo = &bpf_iter_udp_seq_afinfo;
+	return bpf_iter_init_seq_net(priv_data);
+}
+
+static const struct bpf_iter_reg udp_reg_info = {
+	.target			= "udp",
+	.seq_ops		= &bpf_iter_udp_seq_ops,
+	.init_seq_private	= bpf_iter_init_udp,
+	.fini_seq_private	= bpf_iter_fini_seq_net,
+	.seq_priv_size		= sizeof(struct udp_iter_state),
+};
+
+static int __init bpf_iter_udp_init(void)
+{
+	return bpf_iter_reg_target(&udp_reg_info);
+}
+late_initcall(bpf_iter_udp_init);
+#endif /* CONFIG_BPF_SYSCALL */
 #endif /* CONFIG_PROC_FS */
 
 static __initdata unsigned long uhash_entries;
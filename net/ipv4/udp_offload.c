@@ -283,6 +283,75 @@ struct sk_buff *__udp_gso_segment(struct sk_buff *gso_skb,
 }
 EXPORT_SYMBOL_GPL(__udp_gso_segment);
 
+struct sk_buff *__udp_gso_segment_list(struct sk_buff *skb,
+				       netdev_features_t features)
+{
+	unsigned int mss = skb_shinfo(skb)->gso_size;
+
+	skb = skb_segment_list(skb, features, skb_mac_header_len(skb));
+	if (IS_ERR(skb))
+		return skb;
+
+	/* udp_gro_complete_list() set the length of the whole chain */
+	udp_hdr(skb)->len = htons(sizeof(struct udphdr) + mss);
+
+	return skb;
+}
+EXPORT_SYMBOL_GPL(__udp_gso_segment_list);
+
+static void __udpv4_gso_segment_csum(struct sk_buff *seg,
+				     __be32 *oldip, __be32 *newip,
+				     __be16 *oldport, __be16 *newport)
+{
+	struct udphdr *uh = udp_hdr(seg);
+
+	if (*oldip == *newip && *oldport == *newport)
+		return;
+
+	if (uh->check) {
+		inet_proto_csum_replace4(&uh->check, seg, *oldip, *newip,
+					 true);
+		inet_proto_csum_replace2(&uh->check, seg, *oldport, *newport,
+					 false);
+		if (!uh->check)
+			uh->check = CSUM_MANGLED_0;
+	}
+	*oldport = *newport;
+	*oldip = *newip;
+}
+
+/* Only the head of a fraglist GRO packet went through the forwarding
+ * path, so copy whatever it changed (TTL, NAT) to the other segments.
+ * The IP header checksum is recomputed by inet_gso_segment().
+ */
+static struct sk_buff *udp4_gso_segment_list(struct sk_buff *skb,
+					     netdev_features_t features)
+{
+	struct sk_buff *segs, *seg;
+	struct udphdr *uh, *uh2;
+	struct iphdr *iph, *iph2;
+
+	segs = __udp_gso_segment_list(skb, features);
+	if (IS_ERR(segs))
+		return segs;
+
+	uh = udp_hdr(segs);
+	iph = ip_hdr(segs);
+
+	for (seg = segs->next; seg; seg = seg->next) {
+		uh2 = udp_hdr(seg);
+		iph2 = ip_hdr(seg);
+
+		__udpv4_gso_segment_csum(seg, &iph2->saddr, &iph->saddr,
+					 &uh2->source, &uh->source);
+		__udpv4_gso_segment_csum(seg, &iph2->daddr, &iph->daddr,
+					 &uh2->dest, &uh->dest);
+		iph2->ttl = iph->ttl;
+	}
+
+	return segs;
+}
+
 static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
@@ -305,6 +374,9 @@ static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 	if (!pskb_may_pull(skb, sizeof(struct udphdr)))
 		goto out;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_FRAGLIST)
+		return udp4_gso_segment_list(skb, features);
+
 	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
 		return __udp_gso_segment(skb, features);
 
@@ -343,6 +415,83 @@ static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 	return segs;
 }
 
+/* Forwarded traffic is aggregated by chaining the packets on the frag_list
+ * of the first one, so that they can be sent out again unchanged by
+ * __udp_gso_segment_list().
+ */
+static struct sk_buff *udp_gro_receive_list(struct list_head *head,
+					    struct sk_buff *skb,
+					    struct udphdr *uh)
+{
+	unsigned int off = skb_gro_offset(skb);
+	struct sk_buff *pp = NULL;
+	struct udphdr *uh2;
+	struct sk_buff *p;
+	unsigned int ulen;
+	int ret = 0;
+
+	/* requires non zero csum, for symmetry with GSO */
+	if (!uh->check) {
+		NAPI_GRO_CB(skb)->flush = 1;
+		return NULL;
+	}
+
+	/* Do not deal with padded or malicious packets, sorry ! */
+	ulen = ntohs(uh->len);
+	if (ulen <= sizeof(*uh) || ulen != skb_gro_len(skb)) {
+		NAPI_GRO_CB(skb)->flush = 1;
+		return NULL;
+	}
+
+	NAPI_GRO_CB(skb)->is_flist = 1;
+
+	/* pull encapsulating udp header */
+	skb_gro_pull(skb, sizeof(struct udphdr));
+
+	list_for_each_entry(p, head, list) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = (struct udphdr *)(p->data + off);
+
+		/* Match ports only, as csum is always non zero */
+		if (*(u32 *)&uh->source != *(u32 *)&uh2->source) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		if (!NAPI_GRO_CB(p)->is_flist) {
+			NAPI_GRO_CB(skb)->flush = 1;
+			return p;
+		}
+
+		/* Terminate the flow on len mismatch or if it grows "too
+		 * much".  On len mismatch merge the first packet shorter
+		 * than gso_size, otherwise complete the GRO packet.
+		 */
+		if (ulen > ntohs(uh2->len)) {
+			pp = p;
+		} else {
+			if (!pskb_may_pull(skb, skb_gro_offset(skb)) ||
+			    skb->ip_summed != p->ip_summed ||
+			    skb->csum_level != p->csum_level) {
+				NAPI_GRO_CB(skb)->flush = 1;
+				return NULL;
+			}
+			ret = skb_gro_receive_list(p, skb);
+		}
+
+		if (ret || ulen != ntohs(uh2->len) ||
+		    NAPI_GRO_CB(p)->count >= UDP_GRO_CNT_MAX)
+			pp = p;
+
+		return pp;
+	}
+
+	/* mismatch, but we never need to flush */
+	return NULL;
+}
+
 struct sk_buff *udp_gro_receive(struct list_head *head, struct sk_buff *skb,
 				struct udphdr *uh, udp_lookup_t lookup)
 {
@@ -367,6 +516,13 @@ struct sk_buff *udp_gro_receive(struct list_head *head, struct sk_buff *skb,
 
 	if (sk && udp_sk(sk)->gro_receive)
 		goto unflush;
+
+	/* Packets nobody here listens for are only being forwarded */
+	if (!sk && (skb->dev->features & NETIF_F_GRO_FRAGLIST)) {
+		pp = udp_gro_receive_list(head, skb, uh);
+		rcu_read_unlock();
+		return pp;
+	}
 	goto out_unlock;
 
 unflush:
@@ -405,7 +561,11 @@ static struct sk_buff *udp4_gro_receive(struct list_head *head,
 {
 	struct udphdr *uh = udp_gro_udphdr(skb);
 
-	if (unlikely(!uh) || !static_branch_unlikely(&udp_encap_needed_key))
+	if (unlikely(!uh))
+		goto flush;
+
+	if (!static_branch_unlikely(&udp_encap_needed_key) &&
+	    !(skb->dev->features & NETIF_F_GRO_FRAGLIST))
 		goto flush;
 
 	/* Don't bother verifying checksum if we're going to flush anyway. */
@@ -456,11 +616,36 @@ int udp_gro_complete(struct sk_buff *skb, int nhoff,
 }
 EXPORT_SYMBOL(udp_gro_complete);
 
+int udp_gro_complete_list(struct sk_buff *skb, int nhoff)
+{
+	struct udphdr *uh = (struct udphdr *)(skb->data + nhoff);
+
+	uh->len = htons(skb->len - nhoff);
+
+	skb_shinfo(skb)->gso_type |= SKB_GSO_FRAGLIST | SKB_GSO_UDP_L4;
+	skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+
+	/* The checksum of every segment was verified on receive */
+	if (skb->ip_summed == CHECKSUM_UNNECESSARY) {
+		if (skb->csum_level < SKB_MAX_CSUM_LEVEL)
+			skb->csum_level++;
+	} else {
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+		skb->csum_level = 0;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(udp_gro_complete_list);
+
 static int udp4_gro_complete(struct sk_buff *skb, int nhoff)
 {
 	const struct iphdr *iph = ip_hdr(skb);
 	struct udphdr *uh = (struct udphdr *)(skb->data + nhoff);
 
+	if (NAPI_GRO_CB(skb)->is_flist)
+		return udp_gro_complete_list(skb, nhoff);
+
 	if (uh->check) {
 		skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_TUNNEL_CSUM;
 		uh->check = ~udp_v4_check(skb->len - nhoff, iph->saddr,
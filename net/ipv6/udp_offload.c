@@ -17,6 +17,57 @@
 #include <net/ip6_checksum.h>
 #include "ip6_offload.h"
 
+static void __udpv6_gso_segment_csum(struct sk_buff *seg,
+				     struct in6_addr *oldip,
+				     const struct in6_addr *newip,
+				     __be16 *oldport, __be16 newport)
+{
+	struct udphdr *uh = udp_hdr(seg);
+
+	if (ipv6_addr_equal(oldip, newip) && *oldport == newport)
+		return;
+
+	if (uh->check) {
+		inet_proto_csum_replace16(&uh->check, seg, oldip->s6_addr32,
+					  newip->s6_addr32, true);
+		inet_proto_csum_replace2(&uh->check, seg, *oldport, newport,
+					 false);
+		if (!uh->check)
+			uh->check = CSUM_MANGLED_0;
+	}
+	*oldport = newport;
+	*oldip = *newip;
+}
+
+/* See udp4_gso_segment_list() */
+static struct sk_buff *udp6_gso_segment_list(struct sk_buff *skb,
+					     netdev_features_t features)
+{
+	struct sk_buff *segs, *seg;
+	struct ipv6hdr *ip6h, *ip6h2;
+	struct udphdr *uh, *uh2;
+
+	segs = __udp_gso_segment_list(skb, features);
+	if (IS_ERR(segs))
+		return segs;
+
+	uh = udp_hdr(segs);
+	ip6h = ipv6_hdr(segs);
+
+	for (seg = segs->next; seg; seg = seg->next) {
+		uh2 = udp_hdr(seg);
+		ip6h2 = ipv6_hdr(seg);
+
+		__udpv6_gso_segment_csum(seg, &ip6h2->saddr, &ip6h->saddr,
+					 &uh2->source, uh->source);
+		__udpv6_gso_segment_csum(seg, &ip6h2->daddr, &ip6h->daddr,
+					 &uh2->dest, uh->dest);
+		ip6h2->hop_limit = ip6h->hop_limit;
+	}
+
+	return segs;
+}
+
 static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
@@ -48,6 +99,9 @@ static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 		if (!pskb_may_pull(skb, sizeof(struct udphdr)))
 			goto out;
 
+		if (skb_shinfo(skb)->gso_type & SKB_GSO_FRAGLIST)
+			return udp6_gso_segment_list(skb, features);
+
 		if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
 			return __udp_gso_segment(skb, features);
 
@@ -119,7 +173,11 @@ static struct sk_buff *udp6_gro_receive(struct list_head *head,
 {
 	struct udphdr *uh = udp_gro_udphdr(skb);
 
-	if (unlikely(!uh) || !static_branch_unlikely(&udpv6_encap_needed_key))
+	if (unlikely(!uh))
+		goto flush;
+
+	if (!static_branch_unlikely(&udpv6_encap_needed_key) &&
+	    !(skb->dev->features & NETIF_F_GRO_FRAGLIST))
 		goto flush;
 
 	/* Don't bother verifying checksum if we're going to flush anyway. */
@@ -147,6 +205,9 @@ static int udp6_gro_complete(struct sk_buff *skb, int nhoff)
 	const struct ipv6hdr *ipv6h = ipv6_hdr(skb);
 	struct udphdr *uh = (struct udphdr *)(skb->data + nhoff);
 
+	if (NAPI_GRO_CB(skb)->is_flist)
+		return udp_gro_complete_list(skb, nhoff);
+
 	if (uh->check) {
 		skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_TUNNEL_CSUM;
 		uh->check = ~udp_v6_check(skb->len - nhoff, &ipv6h->saddr,
@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP
+ *
+ * An MPTCP socket is a connection-level socket owning one or more subflows,
+ * which are regular, kernel-owned TCP sockets. Connection setup, socket
+ * options and receive go through the first subflow, transmit goes through
+ * the subflow picked by the packet scheduler.
+ *
+ * The MPTCP options (MP_CAPABLE, MP_JOIN, DSS) aren't handled yet, so that a
+ * connection only ever has its first subflow, and behaves as a plain TCP
+ * connection on the wire, the fallback mode of RFC 6824.
+ */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <net/sock.h>
+#include <net/inet_common.h>
+#include <net/inet_hashtables.h>
+#include <net/protocol.h>
+#include <net/tcp.h>
+#include <net/mptcp.h>
+#include "protocol.h"
+
+/* Packet scheduler, lowest RTT first: pick the established subflow with
+ * the smallest smoothed RTT among the ones with room in their send buffer.
+ * If there's none, use the first subflow, so that tcp_sendmsg() waits for
+ * it, or reports the error.
+ */
+static struct sock *mptcp_subflow_get(const struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+	struct sock *best = NULL;
+	u32 best_rtt = U32_MAX;
+
+	list_for_each_entry(subflow, &msk->conn_list, node) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+
+		if (!((1 << ssk->sk_state) &
+		      (TCPF_ESTABLISHED | TCPF_CLOSE_WAIT)) ||
+		    !sk_stream_memory_free(ssk))
+			continue;
+
+		if (tcp_sk(ssk)->srtt_us < best_rtt) {
+			best_rtt = tcp_sk(ssk)->srtt_us;
+			best = ssk;
+		}
+	}
+
+	return best ? : msk->subflow->sk;
+}
+
+static int mptcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct sock *ssk;
+
+	lock_sock(sk);
+	ssk = mptcp_subflow_get(msk);
+	release_sock(sk);
+
+	pr_debug("msk=%p, subflow=%p", msk, ssk);
+
+	return sock_sendmsg(ssk->sk_socket, msg);
+}
+
+static int mptcp_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
+			 int nonblock, int flags, int *addr_len)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	if (nonblock)
+		flags |= MSG_DONTWAIT;
+
+	return sock_recvmsg(msk->subflow, msg, flags);
+}
+
+static int mptcp_init_sock(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct net *net = sock_net(sk);
+	struct socket *ssock;
+	int err;
+
+	INIT_LIST_HEAD(&msk->conn_list);
+
+	err = sock_create_kern(net, sk->sk_family, SOCK_STREAM, IPPROTO_TCP,
+			       &ssock);
+	if (err)
+		return err;
+
+	/* The subflow belongs to the user socket, and can outlive it while
+	 * closing: account it, and pin the netns, as a user socket.
+	 */
+	ssock->sk->sk_net_refcnt = 1;
+	get_net(net);
+#ifdef CONFIG_PROC_FS
+	this_cpu_add(*net->core.sock_inuse, 1);
+#endif
+
+	msk->subflow = ssock;
+
+	return 0;
+}
+
+static void mptcp_close(struct sock *sk, long timeout)
+{
+	struct mptcp_subflow_context *subflow, *tmp;
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	inet_sk_state_store(sk, TCP_CLOSE);
+
+	lock_sock(sk);
+	list_for_each_entry_safe(subflow, tmp, &msk->conn_list, node) {
+		struct socket *ssock = subflow->tcp_sock;
+
+		list_del_init(&subflow->node);
+		if (ssock != msk->subflow)
+			sock_release(ssock);
+	}
+	release_sock(sk);
+
+	sock_release(msk->subflow);
+	msk->subflow = NULL;
+
+	sk_common_release(sk);
+}
+
+/* The connection sock is never hashed, its subflows are */
+static void mptcp_unhash(struct sock *sk)
+{
+}
+
+static struct proto mptcp_prot = {
+	.name		= "MPTCP",
+	.owner		= THIS_MODULE,
+	.init		= mptcp_init_sock,
+	.close		= mptcp_close,
+	.sendmsg	= mptcp_sendmsg,
+	.recvmsg	= mptcp_recvmsg,
+	.unhash		= mptcp_unhash,
+	.obj_size	= sizeof(struct mptcp_sock),
+	.no_autobind	= 1,
+};
+
+static int mptcp_bind(struct socket *sock, struct sockaddr *uaddr,
+		      int addr_len)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+
+	return ssock->ops->bind(ssock, uaddr, addr_len);
+}
+
+static int mptcp_stream_connect(struct socket *sock, struct sockaddr *uaddr,
+				int addr_len, int flags)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+	int err;
+
+	lock_sock(sock->sk);
+	err = mptcp_subflow_attach(sock->sk, ssock);
+	release_sock(sock->sk);
+	if (err)
+		return err;
+
+	err = ssock->ops->connect(ssock, uaddr, addr_len, flags);
+	sock->state = ssock->state;
+
+	return err;
+}
+
+static int mptcp_listen(struct socket *sock, int backlog)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+
+	return ssock->ops->listen(ssock, backlog);
+}
+
+static int mptcp_stream_accept(struct socket *sock, struct socket *newsock,
+			       int flags, bool kern)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+	int err;
+
+	err = ssock->ops->accept(ssock, newsock, flags, kern);
+	if (err)
+		return err;
+
+	/* MP_CAPABLE can't be negotiated yet: the new connection is a
+	 * plain TCP one.
+	 */
+	newsock->ops = &inet_stream_ops;
+
+	return 0;
+}
+
+static int mptcp_getname(struct socket *sock, struct sockaddr *uaddr,
+			 int peer)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+
+	return ssock->ops->getname(ssock, uaddr, peer);
+}
+
+static __poll_t mptcp_poll(struct file *file, struct socket *sock,
+			   struct poll_table_struct *wait)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+
+	return ssock->ops->poll(file, ssock, wait);
+}
+
+static int mptcp_shutdown(struct socket *sock, int how)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+
+	return ssock->ops->shutdown(ssock, how);
+}
+
+static int mptcp_setsockopt(struct socket *sock, int level, int optname,
+			    char __user *optval, unsigned int optlen)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+
+	return ssock->ops->setsockopt(ssock, level, optname, optval, optlen);
+}
+
+static int mptcp_getsockopt(struct socket *sock, int level, int optname,
+			    char __user *optval, int __user *optlen)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+
+	return ssock->ops->getsockopt(ssock, level, optname, optval, optlen);
+}
+
+#ifdef CONFIG_COMPAT
+static int mptcp_compat_setsockopt(struct socket *sock, int level,
+				   int optname, char __user *optval,
+				   unsigned int optlen)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+
+	return ssock->ops->compat_setsockopt(ssock, level, optname, optval,
+					     optlen);
+}
+
+static int mptcp_compat_getsockopt(struct socket *sock, int level,
+				   int optname, char __user *optval,
+				   int __user *optlen)
+{
+	struct socket *ssock = mptcp_sk(sock->sk)->subflow;
+
+	return ssock->ops->compat_getsockopt(ssock, level, optname, optval,
+					     optlen);
+}
+#endif
+
+static const struct proto_ops mptcp_stream_ops = {
+	.family		   = PF_INET,
+	.owner		   = THIS_MODULE,
+	.release	   = inet_release,
+	.bind		   = mptcp_bind,
+	.connect	   = mptcp_stream_connect,
+	.socketpair	   = sock_no_socketpair,
+	.accept		   = mptcp_stream_accept,
+	.getname	   = mptcp_getname,
+	.poll		   = mptcp_poll,
+	.ioctl		   = inet_ioctl,
+	.listen		   = mptcp_listen,
+	.shutdown	   = mptcp_shutdown,
+	.setsockopt	   = mptcp_setsockopt,
+	.getsockopt	   = mptcp_getsockopt,
+	.sendmsg	   = inet_sendmsg,
+	.recvmsg	   = inet_recvmsg,
+	.mmap		   = sock_no_mmap,
+	.sendpage	   = sock_no_sendpage,
+#ifdef CONFIG_COMPAT
+	.compat_setsockopt = mptcp_compat_setsockopt,
+	.compat_getsockopt = mptcp_compat_getsockopt,
+#endif
+};
+
+static struct inet_protosw mptcp_protosw = {
+	.type		= SOCK_STREAM,
+	.protocol	= IPPROTO_MPTCP,
+	.prot		= &mptcp_prot,
+	.ops		= &mptcp_stream_ops,
+	.flags		= INET_PROTOSW_ICSK,
+};
+
+void __init mptcp_init(void)
+{
+	mptcp_subflow_init();
+
+	if (proto_register(&mptcp_prot, 1) != 0)
+		panic("Failed to register MPTCP proto.\n");
+
+	inet_register_protosw(&mptcp_protosw);
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Multipath TCP */
+
+#ifndef __MPTCP_PROTOCOL_H
+#define __MPTCP_PROTOCOL_H
+
+#include <linux/list.h>
+#include <net/inet_connection_sock.h>
+
+/* MPTCP connection sock */
+struct mptcp_sock {
+	/* inet_connection_sock must be the first member */
+	struct inet_connection_sock sk;
+	struct list_head conn_list;	/* subflows of the connection */
+	struct socket	*subflow;	/* first subflow, for bind/connect/listen */
+};
+
+static inline struct mptcp_sock *mptcp_sk(const struct sock *sk)
+{
+	return (struct mptcp_sock *)sk;
+}
+
+/* MPTCP subflow context, attached as ULP data to each subflow TCP sock */
+struct mptcp_subflow_context {
+	struct list_head node;		/* on conn_list */
+	struct socket	*tcp_sock;	/* tcp socket backpointer */
+	struct sock	*conn;		/* parent mptcp_sock */
+};
+
+static inline struct mptcp_subflow_context *
+mptcp_subflow_ctx(const struct sock *sk)
+{
+	return inet_csk(sk)->icsk_ulp_data;
+}
+
+static inline struct sock *
+mptcp_subflow_tcp_sock(const struct mptcp_subflow_context *subflow)
+{
+	return subflow->tcp_sock->sk;
+}
+
+void mptcp_subflow_init(void);
+int mptcp_subflow_attach(struct sock *sk, struct socket *ssock);
+
+#endif /* __MPTCP_PROTOCOL_H */
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <net/sock.h>
+#include <net/inet_common.h>
+#include <net/tcp.h>
+#include "protocol.h"
+
+/* Subflows are regular TCP sockets, the MPTCP state of each of them lives
+ * in a ULP context, so that option and data sequence mapping handling can
+ * hook into the TCP stack the way other ULPs do.
+ */
+static int subflow_ulp_init(struct sock *sk)
+{
+	struct mptcp_subflow_context *ctx;
+
+	/* disallow attaching ULP to a socket unless it has been
+	 * created with sock_create_kern()
+	 */
+	if (!sk->sk_kern_sock)
+		return -EOPNOTSUPP;
+
+	ctx = kzalloc(sizeof(*ctx), sk->sk_allocation);
+	if (!ctx)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&ctx->node);
+	ctx->tcp_sock = sk->sk_socket;
+	inet_csk(sk)->icsk_ulp_data = ctx;
+
+	pr_debug("subflow=%p", ctx);
+
+	return 0;
+}
+
+static void subflow_ulp_release(struct sock *sk)
+{
+	struct mptcp_subflow_context *ctx = mptcp_subflow_ctx(sk);
+
+	inet_csk(sk)->icsk_ulp_data = NULL;
+	kfree(ctx);
+}
+
+static struct tcp_ulp_ops subflow_ulp_ops __read_mostly = {
+	.name		= "mptcp",
+	.owner		= THIS_MODULE,
+	.init		= subflow_ulp_init,
+	.release	= subflow_ulp_release,
+};
+
+/* Attach the subflow @ssock to the MPTCP connection @sk, caller holds the
+ * lock of @sk
+ */
+int mptcp_subflow_attach(struct sock *sk, struct socket *ssock)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *ctx;
+	struct sock *ssk = ssock->sk;
+	int err = 0;
+
+	lock_sock(ssk);
+	if (!inet_csk(ssk)->icsk_ulp_ops) {
+		err = tcp_set_ulp(ssk, subflow_ulp_ops.name);
+		if (!err) {
+			ctx = mptcp_subflow_ctx(ssk);
+			ctx->conn = sk;
+			list_add_tail(&ctx->node, &msk->conn_list);
+		}
+	}
+	release_sock(ssk);
+
+	return err;
+}
+
+void mptcp_subflow_init(void)
+{
+	if (tcp_register_ulp(&subflow_ulp_ops) != 0)
+		panic("MPTCP: failed to register subflows to ULP\n");
+}
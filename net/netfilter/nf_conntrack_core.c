@@ -70,6 +70,7 @@ EXPORT_SYMBOL_GPL(nf_conntrack_hash);
 struct conntrack_gc_work {
 	struct delayed_work	dwork;
 	u32			last_bucket;
+	u32			pass_entries;
 	bool			exiting;
 	bool			early_drop;
 	long			next_gc_run;
@@ -89,6 +90,29 @@ static __read_mostly bool nf_conntrack_locks_all;
 
 static struct conntrack_gc_work conntrack_gc_work;
 
+/* chains longer than this on insertion ask for a bigger table */
+#define NF_CT_MAX_CHAINLEN	64u
+/* grow when there are more hash entries than this many per bucket */
+#define NF_CT_GROW_LOAD		2u
+/* shrink when there is less than one hash entry per this many buckets */
+#define NF_CT_SHRINK_LOAD	8u
+/* minimum time between two automatic resizes */
+#define NF_CT_RESIZE_INTERVAL	(10u * HZ)
+
+static DEFINE_MUTEX(nf_conntrack_resize_mutex);
+/* automatic resizing never goes below the boot or user-requested size */
+static unsigned int nf_conntrack_htable_size_min __read_mostly;
+static unsigned int nf_conntrack_resize_goal;
+static unsigned long nf_conntrack_resize_stamp;
+static void nf_conntrack_resize_worker(struct work_struct *work);
+static DECLARE_WORK(nf_conntrack_resize_work, nf_conntrack_resize_worker);
+
+unsigned int nf_conntrack_resizes __read_mostly;
+EXPORT_SYMBOL_GPL(nf_conntrack_resizes);
+
+int nf_conntrack_htable_autoresize __read_mostly = 1;
+EXPORT_SYMBOL_GPL(nf_conntrack_htable_autoresize);
+
 void nf_conntrack_lock(spinlock_t *lock) __acquires(lock)
 {
 	/* 1) Acquire the lock */
@@ -739,6 +763,28 @@ nf_conntrack_find_get(struct net *net, const struct nf_conntrack_zone *zone,
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_find_get);
 
+static void nf_conntrack_resize_request(unsigned int hashsize)
+{
+	if (!READ_ONCE(nf_conntrack_htable_autoresize) ||
+	    time_before(jiffies, READ_ONCE(nf_conntrack_resize_stamp) +
+				 NF_CT_RESIZE_INTERVAL))
+		return;
+
+	WRITE_ONCE(nf_conntrack_resize_goal, hashsize);
+	queue_work(system_power_efficient_wq, &nf_conntrack_resize_work);
+}
+
+/* Called with bh disabled, after inserting into chains of given length */
+static void nf_conntrack_chainlen_check(struct net *net,
+					unsigned int chainlen)
+{
+	if (likely(chainlen <= NF_CT_MAX_CHAINLEN))
+		return;
+
+	NF_CT_STAT_INC(net, chaintoolong);
+	nf_conntrack_resize_request(nf_conntrack_htable_size * 2);
+}
+
 static void __nf_conntrack_hash_insert(struct nf_conn *ct,
 				       unsigned int hash,
 				       unsigned int reply_hash)
@@ -756,6 +802,7 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 	struct net *net = nf_ct_net(ct);
 	unsigned int hash, reply_hash;
 	struct nf_conntrack_tuple_hash *h;
+	unsigned int chainlen = 0, len;
 	struct hlist_nulls_node *n;
 	unsigned int sequence;
 
@@ -771,15 +818,21 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 	} while (nf_conntrack_double_lock(net, hash, reply_hash, sequence));
 
 	/* See if there's one in the list already, including reverse */
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[hash], hnnode)
+	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[hash], hnnode) {
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
 				    zone, net))
 			goto out;
+		chainlen++;
+	}
 
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[reply_hash], hnnode)
+	len = 0;
+	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[reply_hash], hnnode) {
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_REPLY].tuple,
 				    zone, net))
 			goto out;
+		len++;
+	}
+	chainlen = max(chainlen, len);
 
 	smp_wmb();
 	/* The caller holds a reference to this object */
@@ -787,6 +840,7 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 	__nf_conntrack_hash_insert(ct, hash, reply_hash);
 	nf_conntrack_double_unlock(hash, reply_hash);
 	NF_CT_STAT_INC(net, insert);
+	nf_conntrack_chainlen_check(net, chainlen);
 	local_bh_enable();
 	return 0;
 
@@ -863,6 +917,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 {
 	const struct nf_conntrack_zone *zone;
 	unsigned int hash, reply_hash;
+	unsigned int chainlen = 0, len;
 	struct nf_conntrack_tuple_hash *h;
 	struct nf_conn *ct;
 	struct nf_conn_help *help;
@@ -921,15 +976,21 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	/* See if there's one in the list already, including reverse:
 	   NAT could have grabbed it without realizing, since we're
 	   not in the hash.  If there is, we lost race. */
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[hash], hnnode)
+	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[hash], hnnode) {
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
 				    zone, net))
 			goto out;
+		chainlen++;
+	}
 
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[reply_hash], hnnode)
+	len = 0;
+	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[reply_hash], hnnode) {
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_REPLY].tuple,
 				    zone, net))
 			goto out;
+		len++;
+	}
+	chainlen = max(chainlen, len);
 
 	/* Timer relative to confirmation time, not original
 	   setting time, otherwise we'd get timer wrap in
@@ -953,6 +1014,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	 */
 	__nf_conntrack_hash_insert(ct, hash, reply_hash);
 	nf_conntrack_double_unlock(hash, reply_hash);
+	nf_conntrack_chainlen_check(net, chainlen);
 	local_bh_enable();
 
 	help = nfct_help(ct);
@@ -1131,6 +1193,19 @@ static void nf_ct_offload_timeout(struct nf_conn *ct)
 		ct->timeout = nfct_time_stamp + DAY;
 }
 
+/* Called by the gc worker once per full table scan, with the number of
+ * hash entries (two per conntrack) it came across.
+ */
+static void nf_conntrack_resize_check(unsigned int entries,
+				      unsigned int hashsz)
+{
+	if (entries > hashsz * NF_CT_GROW_LOAD)
+		nf_conntrack_resize_request(hashsz * 2);
+	else if (entries < hashsz / NF_CT_SHRINK_LOAD &&
+		 hashsz / 2 >= READ_ONCE(nf_conntrack_htable_size_min))
+		nf_conntrack_resize_request(hashsz / 2);
+}
+
 static void gc_worker(struct work_struct *work)
 {
 	unsigned int min_interval = max(HZ / GC_MAX_BUCKETS_DIV, 1u);
@@ -1158,8 +1233,12 @@ static void gc_worker(struct work_struct *work)
 		rcu_read_lock();
 
 		nf_conntrack_get_ht(&ct_hash, &hashsz);
-		if (i >= hashsz)
+		if (i >= hashsz) {
 			i = 0;
+			nf_conntrack_resize_check(gc_work->pass_entries,
+						  hashsz);
+			gc_work->pass_entries = 0;
+		}
 
 		hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[i], hnnode) {
 			struct net *net;
@@ -1167,6 +1246,7 @@ static void gc_worker(struct work_struct *work)
 			tmp = nf_ct_tuplehash_to_ctrack(h);
 
 			scanned++;
+			gc_work->pass_entries++;
 			if (test_bit(IPS_OFFLOAD_BIT, &tmp->status)) {
 				nf_ct_offload_timeout(tmp);
 				continue;
@@ -1251,6 +1331,7 @@ static void conntrack_gc_work_init(struct conntrack_gc_work *gc_work)
 {
 	INIT_DEFERRABLE_WORK(&gc_work->dwork, gc_worker);
 	gc_work->next_gc_run = HZ;
+	gc_work->pass_entries = 0;
 	gc_work->exiting = false;
 }
 
@@ -2058,6 +2139,7 @@ void nf_conntrack_cleanup_end(void)
 {
 	RCU_INIT_POINTER(nf_ct_hook, NULL);
 	cancel_delayed_work_sync(&conntrack_gc_work.dwork);
+	cancel_work_sync(&nf_conntrack_resize_work);
 	kvfree(nf_conntrack_hash);
 
 	nf_conntrack_proto_fini();
@@ -2142,7 +2224,7 @@ void *nf_ct_alloc_hashtable(unsigned int *sizep, int nulls)
 }
 EXPORT_SYMBOL_GPL(nf_ct_alloc_hashtable);
 
-int nf_conntrack_hash_resize(unsigned int hashsize)
+static int __nf_conntrack_hash_resize(unsigned int hashsize)
 {
 	int i, bucket;
 	unsigned int old_size;
@@ -2150,8 +2232,7 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 	struct nf_conntrack_tuple_hash *h;
 	struct nf_conn *ct;
 
-	if (!hashsize)
-		return -EINVAL;
+	lockdep_assert_held(&nf_conntrack_resize_mutex);
 
 	hash = nf_ct_alloc_hashtable(&hashsize, 1);
 	if (!hash)
@@ -2194,11 +2275,53 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 	nf_conntrack_all_unlock();
 	local_bh_enable();
 
+	WRITE_ONCE(nf_conntrack_resizes, nf_conntrack_resizes + 1);
+
 	synchronize_net();
 	kvfree(old_hash);
 	return 0;
 }
 
+int nf_conntrack_hash_resize(unsigned int hashsize)
+{
+	int ret;
+
+	if (!hashsize)
+		return -EINVAL;
+
+	mutex_lock(&nf_conntrack_resize_mutex);
+	ret = __nf_conntrack_hash_resize(hashsize);
+	if (ret == 0)
+		WRITE_ONCE(nf_conntrack_htable_size_min,
+			   nf_conntrack_htable_size);
+	mutex_unlock(&nf_conntrack_resize_mutex);
+
+	return ret;
+}
+
+/* Lookups keep running locklessly while the table is rehashed, only new
+ * insertions wait for the rehash to complete.
+ */
+static void nf_conntrack_resize_worker(struct work_struct *work)
+{
+	unsigned int hashsize = READ_ONCE(nf_conntrack_resize_goal);
+
+	if (conntrack_gc_work.exiting)
+		return;
+
+	mutex_lock(&nf_conntrack_resize_mutex);
+
+	if (nf_conntrack_max)
+		hashsize = min(hashsize, nf_conntrack_max);
+	hashsize = max(hashsize, nf_conntrack_htable_size_min);
+
+	if (hashsize != nf_conntrack_htable_size)
+		__nf_conntrack_hash_resize(hashsize);
+
+	WRITE_ONCE(nf_conntrack_resize_stamp, jiffies);
+	mutex_unlock(&nf_conntrack_resize_mutex);
+}
+
 int nf_conntrack_set_hashsize(const char *val, const struct kernel_param *kp)
 {
 	unsigned int hashsize;
@@ -2291,6 +2414,7 @@ int nf_conntrack_init_start(void)
 		return -ENOMEM;
 
 	nf_conntrack_max = max_factor * nf_conntrack_htable_size;
+	nf_conntrack_htable_size_min = nf_conntrack_htable_size;
 
 	nf_conntrack_cachep = kmem_cache_create("nf_conntrack",
 						sizeof(struct nf_conn),
@@ -11,6 +11,7 @@
 #include <net/netfilter/nf_conntrack.h>
 #include <net/netfilter/nf_conntrack_core.h>
 #include <net/netfilter/nf_conntrack_tuple.h>
+#include <net/netfilter/nf_conntrack_acct.h>
 
 struct flow_offload_entry {
 	struct flow_offload	flow;
@@ -29,6 +30,7 @@ flow_offload_fill_dir(struct flow_offload *flow, struct nf_conn *ct,
 	struct flow_offload_tuple *ft = &flow->tuplehash[dir].tuple;
 	struct nf_conntrack_tuple *ctt = &ct->tuplehash[dir].tuple;
 	struct dst_entry *dst = route->tuple[dir].dst;
+	int i;
 
 	ft->dir = dir;
 
@@ -50,9 +52,15 @@ flow_offload_fill_dir(struct flow_offload *flow, struct nf_conn *ct,
 	ft->src_port = ctt->src.u.tcp.port;
 	ft->dst_port = ctt->dst.u.tcp.port;
 
-	ft->iifidx = route->tuple[dir].ifindex;
+	ft->iifidx = route->tuple[dir].iifidx ?: route->tuple[dir].ifindex;
 	ft->oifidx = route->tuple[!dir].ifindex;
 	ft->dst_cache = dst;
+
+	for (i = 0; i < route->tuple[dir].encap_num; i++) {
+		ft->encap[i].id = route->tuple[dir].encap[i].id;
+		ft->encap[i].proto = route->tuple[dir].encap[i].proto;
+	}
+	ft->encap_num = route->tuple[dir].encap_num;
 }
 
 struct flow_offload *
@@ -182,6 +190,8 @@ static const struct rhashtable_params nf_flow_offload_rhash_params = {
 	.automatic_shrinking	= true,
 };
 
+static void nf_flow_offload_add(struct flow_offload *flow);
+
 int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow)
 {
 	flow->timeout = (u32)jiffies;
@@ -192,6 +202,10 @@ int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow)
 	rhashtable_insert_fast(&flow_table->rhashtable,
 			       &flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].node,
 			       nf_flow_offload_rhash_params);
+
+	if (nf_flowtable_hw_offload(flow_table))
+		nf_flow_offload_add(flow);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(flow_offload_add);
@@ -286,6 +300,186 @@ static inline bool nf_flow_has_expired(const struct flow_offload *flow)
 	return (__s32)(flow->timeout - (u32)jiffies) <= 0;
 }
 
+/* Hardware offload: requests to drivers may sleep, so they are queued from
+ * the packet path and the garbage collector, and issued from a work item.
+ * A flow is never freed while a request for it is pending.
+ */
+struct flow_offload_work {
+	struct list_head		list;
+	enum flow_offload_hw_command	cmd;
+	struct flow_offload		*flow;
+};
+
+static LIST_HEAD(flow_offload_pending_list);
+static DEFINE_SPINLOCK(flow_offload_pending_list_lock);
+
+static int flow_offload_hw_cmd(struct flow_offload_work *offload,
+			       enum flow_offload_tuple_dir dir,
+			       enum flow_offload_hw_command cmd,
+			       struct flow_offload_hw_stats *stats)
+{
+	struct flow_offload *flow = offload->flow;
+	const struct flow_offload_tuple *tuple = &flow->tuplehash[dir].tuple;
+	struct flow_offload_hw hw = {
+		.command	= cmd,
+		.cookie		= (unsigned long)tuple,
+		.tuple		= tuple,
+		.other		= &flow->tuplehash[!dir].tuple,
+		.flags		= flow->flags & (FLOW_OFFLOAD_SNAT |
+						 FLOW_OFFLOAD_DNAT),
+	};
+	struct flow_offload_entry *e;
+	struct net_device *dev;
+	int err;
+
+	e = container_of(flow, struct flow_offload_entry, flow);
+	dev = dev_get_by_index(nf_ct_net(e->ct), tuple->iifidx);
+	if (!dev)
+		return -ENODEV;
+
+	if (dev->netdev_ops->ndo_setup_tc)
+		err = dev->netdev_ops->ndo_setup_tc(dev, TC_SETUP_FT, &hw);
+	else
+		err = -EOPNOTSUPP;
+
+	dev_put(dev);
+
+	if (!err && stats)
+		*stats = hw.stats;
+
+	return err;
+}
+
+static void flow_offload_work_add(struct flow_offload_work *offload)
+{
+	if (flow_offload_hw_cmd(offload, FLOW_OFFLOAD_DIR_ORIGINAL,
+				FLOW_OFFLOAD_HW_REPLACE, NULL) < 0)
+		return;
+
+	if (flow_offload_hw_cmd(offload, FLOW_OFFLOAD_DIR_REPLY,
+				FLOW_OFFLOAD_HW_REPLACE, NULL) < 0) {
+		flow_offload_hw_cmd(offload, FLOW_OFFLOAD_DIR_ORIGINAL,
+				    FLOW_OFFLOAD_HW_DESTROY, NULL);
+		return;
+	}
+
+	set_bit(NF_FLOW_HW, &offload->flow->hw_flags);
+}
+
+static void flow_offload_work_del(struct flow_offload_work *offload)
+{
+	flow_offload_hw_cmd(offload, FLOW_OFFLOAD_DIR_ORIGINAL,
+			    FLOW_OFFLOAD_HW_DESTROY, NULL);
+	flow_offload_hw_cmd(offload, FLOW_OFFLOAD_DIR_REPLY,
+			    FLOW_OFFLOAD_HW_DESTROY, NULL);
+
+	clear_bit(NF_FLOW_HW, &offload->flow->hw_flags);
+}
+
+static void flow_offload_work_stats(struct flow_offload_work *offload)
+{
+	struct flow_offload_hw_stats stats[FLOW_OFFLOAD_DIR_MAX] = {};
+	struct flow_offload *flow = offload->flow;
+	struct flow_offload_entry *e;
+	struct nf_conn_acct *acct;
+	unsigned long lastused;
+	int dir;
+
+	for (dir = 0; dir < FLOW_OFFLOAD_DIR_MAX; dir++)
+		flow_offload_hw_cmd(offload, dir, FLOW_OFFLOAD_HW_STATS,
+				    &stats[dir]);
+
+	lastused = max(stats[0].lastused, stats[1].lastused);
+	if (lastused && (__s32)((u32)lastused + NF_FLOW_TIMEOUT -
+				flow->timeout) > 0)
+		flow->timeout = (u32)lastused + NF_FLOW_TIMEOUT;
+
+	e = container_of(flow, struct flow_offload_entry, flow);
+	acct = nf_conn_acct_find(e->ct);
+	if (!acct)
+		return;
+
+	for (dir = 0; dir < FLOW_OFFLOAD_DIR_MAX; dir++) {
+		atomic64_add(stats[dir].pkts, &acct->counter[dir].packets);
+		atomic64_add(stats[dir].bytes, &acct->counter[dir].bytes);
+	}
+}
+
+static void flow_offload_work_handler(struct work_struct *work)
+{
+	struct flow_offload_work *offload, *next;
+	LIST_HEAD(offload_pending_list);
+
+	spin_lock_bh(&flow_offload_pending_list_lock);
+	list_replace_init(&flow_offload_pending_list, &offload_pending_list);
+	spin_unlock_bh(&flow_offload_pending_list_lock);
+
+	list_for_each_entry_safe(offload, next, &offload_pending_list, list) {
+		switch (offload->cmd) {
+		case FLOW_OFFLOAD_HW_REPLACE:
+			flow_offload_work_add(offload);
+			break;
+		case FLOW_OFFLOAD_HW_DESTROY:
+			flow_offload_work_del(offload);
+			break;
+		case FLOW_OFFLOAD_HW_STATS:
+			flow_offload_work_stats(offload);
+			break;
+		}
+		clear_bit_unlock(NF_FLOW_HW_PENDING, &offload->flow->hw_flags);
+		list_del(&offload->list);
+		kfree(offload);
+	}
+}
+
+static DECLARE_WORK(nf_flow_offload_work, flow_offload_work_handler);
+
+static void flow_offload_queue_work(struct flow_offload *flow,
+				    enum flow_offload_hw_command cmd)
+{
+	struct flow_offload_work *offload;
+
+	if (test_and_set_bit(NF_FLOW_HW_PENDING, &flow->hw_flags))
+		return;
+
+	offload = kmalloc(sizeof(*offload), GFP_ATOMIC);
+	if (!offload) {
+		clear_bit(NF_FLOW_HW_PENDING, &flow->hw_flags);
+		return;
+	}
+
+	offload->cmd = cmd;
+	offload->flow = flow;
+
+	spin_lock_bh(&flow_offload_pending_list_lock);
+	list_add_tail(&offload->list, &flow_offload_pending_list);
+	spin_unlock_bh(&flow_offload_pending_list_lock);
+
+	queue_work(system_power_efficient_wq, &nf_flow_offload_work);
+}
+
+static void nf_flow_offload_add(struct flow_offload *flow)
+{
+	flow_offload_queue_work(flow, FLOW_OFFLOAD_HW_REPLACE);
+}
+
+static void nf_flow_offload_del(struct flow_offload *flow)
+{
+	flow_offload_queue_work(flow, FLOW_OFFLOAD_HW_DESTROY);
+}
+
+static void nf_flow_offload_stats(struct flow_offload *flow)
+{
+	flow_offload_queue_work(flow, FLOW_OFFLOAD_HW_STATS);
+}
+
+void nf_flow_table_offload_flush(struct nf_flowtable *flowtable)
+{
+	if (nf_flowtable_hw_offload(flowtable))
+		flush_work(&nf_flow_offload_work);
+}
+EXPORT_SYMBOL_GPL(nf_flow_table_offload_flush);
+
 static void nf_flow_offload_gc_step(struct nf_flowtable *flow_table)
 {
 	struct flow_offload_tuple_rhash *tuplehash;
@@ -306,10 +500,20 @@ static void nf_flow_offload_gc_step(struct nf_flowtable *flow_table)
 
 		flow = container_of(tuplehash, struct flow_offload, tuplehash[0]);
 
+		if (test_bit(NF_FLOW_HW_PENDING, &flow->hw_flags))
+			continue;
+
 		if (nf_flow_has_expired(flow) ||
 		    (flow->flags & (FLOW_OFFLOAD_DYING |
-				    FLOW_OFFLOAD_TEARDOWN)))
-			flow_offload_del(flow_table, flow);
+				    FLOW_OFFLOAD_TEARDOWN))) {
+			/* free it once it's gone from hardware */
+			if (test_bit(NF_FLOW_HW, &flow->hw_flags))
+				nf_flow_offload_del(flow);
+			else
+				flow_offload_del(flow_table, flow);
+		} else if (test_bit(NF_FLOW_HW, &flow->hw_flags)) {
+			nf_flow_offload_stats(flow);
+		}
 	}
 	rhashtable_walk_stop(&hti);
 	rhashtable_walk_exit(&hti);
@@ -473,9 +677,14 @@ static void nf_flow_table_do_cleanup(struct flow_offload *flow, void *data)
 		flow_offload_teardown(flow);
 		return;
 	}
+	/* flows going through VLAN devices are looked up on the lower
+	 * device, so check output devices as well.
+	 */
 	if (net_eq(nf_ct_net(e->ct), dev_net(dev)) &&
 	    (flow->tuplehash[0].tuple.iifidx == dev->ifindex ||
-	     flow->tuplehash[1].tuple.iifidx == dev->ifindex))
+	     flow->tuplehash[1].tuple.iifidx == dev->ifindex ||
+	     flow->tuplehash[0].tuple.oifidx == dev->ifindex ||
+	     flow->tuplehash[1].tuple.oifidx == dev->ifindex))
 		flow_offload_dead(flow);
 }
 
@@ -484,6 +693,7 @@ static void nf_flow_table_iterate_cleanup(struct nf_flowtable *flowtable,
 {
 	nf_flow_table_iterate(flowtable, nf_flow_table_do_cleanup, dev);
 	flush_delayed_work(&flowtable->gc_work);
+	nf_flow_table_offload_flush(flowtable);
 }
 
 void nf_flow_table_cleanup(struct net_device *dev)
@@ -504,6 +714,12 @@ void nf_flow_table_free(struct nf_flowtable *flow_table)
 	mutex_unlock(&flowtable_lock);
 	cancel_delayed_work_sync(&flow_table->gc_work);
 	nf_flow_table_iterate(flow_table, nf_flow_table_do_cleanup, NULL);
+	if (nf_flowtable_hw_offload(flow_table)) {
+		/* complete pending requests, then remove flows from hardware */
+		nf_flow_table_offload_flush(flow_table);
+		nf_flow_offload_gc_step(flow_table);
+		nf_flow_table_offload_flush(flow_table);
+	}
 	nf_flow_offload_gc_step(flow_table);
 	rhashtable_destroy(&flow_table->rhashtable);
 }
@@ -3,6 +3,7 @@
 #include <linux/module.h>
 #include <linux/netfilter.h>
 #include <linux/rhashtable.h>
+#include <linux/if_vlan.h>
 #include <net/netfilter/nf_flow_table.h>
 #include <net/netfilter/nf_tables.h>
 
@@ -10,7 +11,19 @@ static unsigned int
 nf_flow_offload_inet_hook(void *priv, struct sk_buff *skb,
 			  const struct nf_hook_state *state)
 {
-	switch (skb->protocol) {
+	__be16 proto = skb->protocol;
+
+	if (proto == htons(ETH_P_8021Q)) {
+		struct vlan_hdr *vh;
+
+		if (!pskb_may_pull(skb, VLAN_HLEN))
+			return NF_ACCEPT;
+
+		vh = (struct vlan_hdr *)skb_network_header(skb);
+		proto = vh->h_vlan_encapsulated_proto;
+	}
+
+	switch (proto) {
 	case htons(ETH_P_IP):
 		return nf_flow_offload_ip_hook(priv, skb, state);
 	case htons(ETH_P_IPV6):
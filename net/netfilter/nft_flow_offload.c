@@ -5,6 +5,7 @@
 #include <linux/netfilter.h>
 #include <linux/workqueue.h>
 #include <linux/spinlock.h>
+#include <linux/if_vlan.h>
 #include <linux/netfilter/nf_tables.h>
 #include <net/ip.h> /* for ipv4 options. */
 #include <net/netfilter/nf_tables.h>
@@ -17,8 +18,52 @@ struct nft_flow_offload {
 	struct nft_flowtable	*flowtable;
 };
 
+static bool nft_flowtable_has_dev(const struct nft_flowtable *flowtable,
+				  const struct net_device *dev)
+{
+	int i;
+
+	for (i = 0; i < flowtable->ops_len; i++) {
+		if (READ_ONCE(flowtable->ops[i].dev) == dev)
+			return true;
+	}
+
+	return false;
+}
+
+/* If packets reach the flowtable through VLAN devices stacked on a device
+ * the flowtable is also bound to, look them up on the lower device already,
+ * by their tags, so that they skip the VLAN receive path.
+ */
+static void nft_flow_route_encap(const struct nft_flowtable *flowtable,
+				 struct nf_flow_route *route,
+				 enum ip_conntrack_dir dir,
+				 const struct net_device *dev)
+{
+	int i, n = 0;
+
+	while (is_vlan_dev(dev) && n < NF_FLOW_TABLE_ENCAP_MAX) {
+		route->tuple[dir].encap[n].id = vlan_dev_vlan_id(dev);
+		route->tuple[dir].encap[n].proto = vlan_dev_vlan_proto(dev);
+		dev = vlan_dev_real_dev(dev);
+		n++;
+	}
+
+	if (!n || is_vlan_dev(dev) || !nft_flowtable_has_dev(flowtable, dev))
+		return;
+
+	/* tags were collected innermost first */
+	for (i = 0; i < n / 2; i++)
+		swap(route->tuple[dir].encap[i],
+		     route->tuple[dir].encap[n - 1 - i]);
+
+	route->tuple[dir].encap_num = n;
+	route->tuple[dir].iifidx = dev->ifindex;
+}
+
 static int nft_flow_route(const struct nft_pktinfo *pkt,
 			  const struct nf_conn *ct,
+			  const struct nft_flowtable *flowtable,
 			  struct nf_flow_route *route,
 			  enum ip_conntrack_dir dir)
 {
@@ -45,6 +90,9 @@ static int nft_flow_route(const struct nft_pktinfo *pkt,
 	route->tuple[!dir].dst		= other_dst;
 	route->tuple[!dir].ifindex	= nft_out(pkt)->ifindex;
 
+	nft_flow_route_encap(flowtable, route, dir, nft_in(pkt));
+	nft_flow_route_encap(flowtable, route, !dir, nft_out(pkt));
+
 	return 0;
 }
 
@@ -99,7 +147,8 @@ static void nft_flow_offload_eval(const struct nft_expr *expr,
 		goto out;
 
 	dir = CTINFO2DIR(ctinfo);
-	if (nft_flow_route(pkt, ct, &route, dir) < 0)
+	memset(&route, 0, sizeof(route));
+	if (nft_flow_route(pkt, ct, priv->flowtable, &route, dir) < 0)
 		goto err_flow_route;
 
 	flow = flow_offload_alloc(ct, &route);
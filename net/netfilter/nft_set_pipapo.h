@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#ifndef _NFT_SET_PIPAPO_H
+#define _NFT_SET_PIPAPO_H
+
+#include <linux/log2.h>
+#include <net/ipv6.h>			/* For the maximum length of a field */
+
+/* Count of concatenated fields depends on count of 32-bit nftables registers */
+#define NFT_PIPAPO_MAX_FIELDS		NFT_REG32_COUNT
+
+/* Largest supported field size */
+#define NFT_PIPAPO_MAX_BYTES		(sizeof(struct in6_addr))
+#define NFT_PIPAPO_MAX_BITS		(NFT_PIPAPO_MAX_BYTES * BITS_PER_BYTE)
+
+/* Bits to be grouped together in table buckets depending on set size */
+#define NFT_PIPAPO_GROUP_BITS		4
+#define NFT_PIPAPO_GROUPS_PER_BYTE	(BITS_PER_BYTE / NFT_PIPAPO_GROUP_BITS)
+#define NFT_PIPAPO_BUCKETS		BIT(NFT_PIPAPO_GROUP_BITS)
+
+/* Fields are padded to 32 bits in input registers */
+#define NFT_PIPAPO_GROUPS_PADDED_SIZE(f)				\
+	(round_up((f)->groups / NFT_PIPAPO_GROUPS_PER_BYTE, sizeof(u32)))
+
+/* Number of bits to be allocated for the mapping of a rule to rules in the
+ * next field: we can expand a range to at most two rules per bit.
+ */
+#define NFT_PIPAPO_MAP_NBITS		(ilog2(NFT_PIPAPO_MAX_BITS * 2))
+
+/* Limit of rules per field, to keep a rule index within the mapping bits */
+#define NFT_PIPAPO_RULE0_MAX		(U32_MAX - (1U << NFT_PIPAPO_MAP_NBITS))
+
+/* Minimum number of concatenated fields for this set type to be selected */
+#define NFT_PIPAPO_MIN_FIELDS		2
+
+/* Bucket size is kept as a multiple of 256 bits where the AVX2 lookup is
+ * built, so that it can AND whole ymm blocks without handling a tail.
+ */
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX2)
+#define NFT_PIPAPO_BSIZE_ALIGN		(32 / sizeof(unsigned long))
+#else
+#define NFT_PIPAPO_BSIZE_ALIGN		1
+#endif
+
+/**
+ * union nft_pipapo_map_bucket - Bucket of mapping table
+ * @to:		First rule number (in next field) this rule maps to
+ * @n:		Number of rules (in next field) this rule maps to
+ * @e:		If there's no next field, pointer to element this rule maps to
+ */
+union nft_pipapo_map_bucket {
+	struct {
+		u32 to;
+		u32 n;
+	};
+	struct nft_pipapo_elem *e;
+};
+
+/**
+ * struct nft_pipapo_field - Lookup, mapping tables and related data for a field
+ * @groups:	Amount of bit groups
+ * @rules:	Number of inserted rules
+ * @bsize:	Size of each bucket in lookup table, in longs
+ * @lt:		Lookup table: 'groups' rows of NFT_PIPAPO_BUCKETS buckets
+ * @mt:		Mapping table: one bucket per rule
+ */
+struct nft_pipapo_field {
+	int groups;
+	unsigned long rules;
+	size_t bsize;
+	unsigned long *lt;
+	union nft_pipapo_map_bucket *mt;
+};
+
+/**
+ * struct nft_pipapo_match - Data used for lookup and matching
+ * @field_count:	Amount of fields in set
+ * @scratch:		Preallocated per-CPU maps for partial matching results
+ * @bsize_max:		Maximum lookup table bucket size of all fields, in longs
+ * @rcu:		Matching data is swapped on commits
+ * @f:			Fields, with lookup and mapping tables
+ */
+struct nft_pipapo_match {
+	int field_count;
+	unsigned long * __percpu *scratch;
+	size_t bsize_max;
+	struct rcu_head rcu;
+	struct nft_pipapo_field f[0];
+};
+
+/**
+ * struct nft_pipapo - Representation of a set
+ * @match:	Currently in-use matching data
+ * @clone:	Copy where pending insertions and deletions are kept
+ * @dirty:	Working copy has pending insertions or deletions
+ * @last_gc:	Timestamp of last garbage collection run, jiffies
+ */
+struct nft_pipapo {
+	struct nft_pipapo_match __rcu *match;
+	struct nft_pipapo_match *clone;
+	bool dirty;
+	unsigned long last_gc;
+};
+
+/**
+ * struct nft_pipapo_elem - API-facing representation of single set element
+ * @ext:	nftables API extensions
+ */
+struct nft_pipapo_elem {
+	struct nft_set_ext ext;
+};
+
+int pipapo_refill(unsigned long *map, int len, int rules, unsigned long *dst,
+		  union nft_pipapo_map_bucket *mt, bool match_only);
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX2)
+bool nft_pipapo_avx2_lookup(const struct net *net, const struct nft_set *set,
+			    const u32 *key, const struct nft_set_ext **ext);
+bool nft_pipapo_avx2_estimate(const struct nft_set_desc *desc, u32 features,
+			      struct nft_set_estimate *est);
+#endif
+
+bool nft_pipapo_lookup(const struct net *net, const struct nft_set *set,
+		       const u32 *key, const struct nft_set_ext **ext);
+bool nft_pipapo_estimate(const struct nft_set_desc *desc, u32 features,
+			 struct nft_set_estimate *est);
+
+#define nft_pipapo_for_each_field(field, index, match)		\
+	for ((field) = (match)->f, (index) = 0;			\
+	     (index) < (match)->field_count;			\
+	     (index)++, (field)++)
+
+/**
+ * pipapo_resmap_init() - Initialise result map before first field lookup
+ * @m:		Matching data
+ * @res_map:	Result map, bsize_max longs
+ *
+ * Only bits for rules in the first field can be set, the rest of the map must
+ * be clean, as it's handed over as fill map for the next fields.
+ */
+static inline void pipapo_resmap_init(const struct nft_pipapo_match *m,
+				      unsigned long *res_map)
+{
+	size_t bsize = m->f[0].bsize;
+
+	memset(res_map, 0xff, bsize * sizeof(*res_map));
+	memset(res_map + bsize, 0, (m->bsize_max - bsize) * sizeof(*res_map));
+}
+
+#endif /* _NFT_SET_PIPAPO_H */
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/* PIPAPO: PIle PAcket POlicies: AVX2 packet lookup routines
+ *
+ * The generic lookup ANDs, for each group of packet bits, a whole lookup
+ * table bucket into the result bitmap, going over the result bitmap once per
+ * group. Here, the result bitmap is processed in 256-bit blocks instead: each
+ * block is loaded into a ymm register once, all the buckets selected by the
+ * packet for a given field are ANDed into it, and the block is stored back,
+ * before moving on to the next one.
+ *
+ * Buckets are sized in multiples of 256 bits by the generic code when this
+ * implementation is built, so there's no partial block to be handled.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+
+#include "nft_set_pipapo.h"
+
+#define NFT_PIPAPO_LONGS_PER_M256	(32 / sizeof(unsigned long))
+
+/* Load, AND and store 256-bit blocks, operands are declared as full blocks so
+ * that the compiler doesn't cache partial values across the asm statements
+ */
+#define NFT_PIPAPO_AVX2_M256(loc)	(*(u8 (*)[32])(loc))
+
+#define NFT_PIPAPO_AVX2_LOAD(reg, loc)					\
+	asm volatile("vmovdqu %0, %%ymm" #reg				\
+		     : : "m" (NFT_PIPAPO_AVX2_M256(loc)))
+
+#define NFT_PIPAPO_AVX2_AND(dst, a, loc)				\
+	asm volatile("vpand %0, %%ymm" #a ", %%ymm" #dst		\
+		     : : "m" (NFT_PIPAPO_AVX2_M256(loc)))
+
+#define NFT_PIPAPO_AVX2_STORE(loc, reg)					\
+	asm volatile("vmovdqu %%ymm" #reg ", %0"			\
+		     : "=m" (NFT_PIPAPO_AVX2_M256(loc)))
+
+/**
+ * nft_pipapo_avx2_and_field() - AND buckets selected by packet for one field
+ * @f:		Field, containing lookup table
+ * @dst:	Result bitmap, f->bsize longs
+ * @data:	Packet data for this field, one group per nibble
+ *
+ * Must be called between kernel_fpu_begin() and kernel_fpu_end().
+ */
+static void nft_pipapo_avx2_and_field(const struct nft_pipapo_field *f,
+				      unsigned long *dst, const u8 *data)
+{
+	const unsigned long *lt[NFT_PIPAPO_MAX_BITS / NFT_PIPAPO_GROUP_BITS];
+	int g, b;
+
+	for (g = 0; g < f->groups; g++) {
+		u8 v;
+
+		if (g % 2)
+			v = data[g / 2] & 0x0f;
+		else
+			v = data[g / 2] >> 4;
+
+		lt[g] = f->lt + (g * NFT_PIPAPO_BUCKETS + v) * f->bsize;
+	}
+
+	for (b = 0; b < f->bsize; b += NFT_PIPAPO_LONGS_PER_M256) {
+		NFT_PIPAPO_AVX2_LOAD(0, dst + b);
+
+		for (g = 0; g < f->groups; g++)
+			NFT_PIPAPO_AVX2_AND(0, 0, lt[g] + b);
+
+		NFT_PIPAPO_AVX2_STORE(dst + b, 0);
+	}
+}
+
+/**
+ * nft_pipapo_avx2_estimate() - Set size, space and lookup complexity
+ * @desc:	Set description, element count and field description used
+ * @features:	Flags: NFT_SET_INTERVAL needs to be there
+ * @est:	Storage for estimation data
+ *
+ * Return: true if set is compatible and AVX2 available, false otherwise.
+ */
+bool nft_pipapo_avx2_estimate(const struct nft_set_desc *desc, u32 features,
+			      struct nft_set_estimate *est)
+{
+	if (!boot_cpu_has(X86_FEATURE_AVX2) || !boot_cpu_has(X86_FEATURE_AVX))
+		return false;
+
+	return nft_pipapo_estimate(desc, features, est);
+}
+
+/**
+ * nft_pipapo_avx2_lookup() - Lookup function for AVX2 implementation
+ * @net:	Network namespace
+ * @set:	nftables API set representation
+ * @key:	nftables API element representation containing key data
+ * @ext:	nftables API extension pointer, filled with matching reference
+ *
+ * Same as nft_pipapo_lookup(), except that buckets are intersected with the
+ * result bitmap using AVX2 instructions. If the FPU can't be used in the
+ * current context, fall back to the generic implementation.
+ *
+ * Return: true on match, false otherwise.
+ */
+bool nft_pipapo_avx2_lookup(const struct net *net, const struct nft_set *set,
+			    const u32 *key, const struct nft_set_ext **ext)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	unsigned long *res_map, *fill_map;
+	u8 genmask = nft_genmask_cur(net);
+	const u8 *rp = (const u8 *)key;
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	bool ret = false;
+	int i;
+
+	local_bh_disable();
+
+	if (unlikely(!irq_fpu_usable())) {
+		ret = nft_pipapo_lookup(net, set, key, ext);
+
+		local_bh_enable();
+		return ret;
+	}
+
+	m = rcu_dereference(priv->match);
+
+	if (unlikely(!m || !*raw_cpu_ptr(m->scratch)))
+		goto out;
+
+	res_map  = *raw_cpu_ptr(m->scratch);
+	fill_map = *raw_cpu_ptr(m->scratch) + m->bsize_max;
+
+	pipapo_resmap_init(m, res_map);
+
+	kernel_fpu_begin();
+
+	nft_pipapo_for_each_field(f, i, m) {
+		bool last = i == m->field_count - 1;
+		int b;
+
+		nft_pipapo_avx2_and_field(f, res_map, rp);
+
+next_match:
+		b = pipapo_refill(res_map, f->bsize, f->rules, fill_map, f->mt,
+				  last);
+		if (b < 0)
+			goto out_fpu;
+
+		if (last) {
+			*ext = &f->mt[b].e->ext;
+			if (unlikely(nft_set_elem_expired(*ext) ||
+				     !nft_set_elem_active(*ext, genmask)))
+				goto next_match;
+
+			memset(res_map, 0, f->bsize * sizeof(*res_map));
+			ret = true;
+			goto out_fpu;
+		}
+
+		swap(res_map, fill_map);
+
+		rp += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
+	}
+
+out_fpu:
+	kernel_fpu_end();
+out:
+	local_bh_enable();
+	return ret;
+}
@@ -246,6 +246,11 @@ static int packet_direct_xmit(struct sk_buff *skb)
 	return dev_direct_xmit(skb, packet_pick_tx_queue(skb));
 }
 
+static int packet_direct_xmit_list(struct sk_buff *skb)
+{
+	return dev_direct_xmit_list(skb, packet_pick_tx_queue(skb));
+}
+
 static struct net_device *packet_cached_dev_get(struct packet_sock *po)
 {
 	struct net_device *dev;
@@ -2592,8 +2597,26 @@ static int tpacket_parse_header(struct packet_sock *po, void *frame,
 	return tp_len;
 }
 
+/*
+ * Send the skbs tpacket_snd() batched up for a TPACKET_V3 block.  Their
+ * frames are already marked TP_STATUS_SENDING, the destructor of each skb
+ * hands its frame back.
+ */
+static int tpacket_snd_batch(struct sk_buff **batch, struct sk_buff ***tail)
+{
+	int ret;
+
+	if (!*batch)
+		return 0;
+	ret = packet_direct_xmit_list(*batch);
+	*batch = NULL;
+	*tail = batch;
+	return ret > 0 ? net_xmit_errno(ret) : 0;
+}
+
 static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 {
+	struct sk_buff *batch = NULL, **batch_tail = &batch;
 	struct sk_buff *skb;
 	struct net_device *dev;
 	struct virtio_net_hdr *vnet_hdr = NULL;
@@ -2609,6 +2632,7 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	int len_sum = 0;
 	int status = TP_STATUS_AVAILABLE;
 	int hlen, tlen, copylen = 0;
+	bool batching;
 
 	mutex_lock(&po->pg_vec_lock);
 
@@ -2651,10 +2675,21 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	if ((size_max > dev->mtu + reserve + VLAN_HLEN) && !po->has_vnet_hdr)
 		size_max = dev->mtu + reserve + VLAN_HLEN;
 
+	/*
+	 * With the qdisc bypassed, the frames of a TPACKET_V3 block go to
+	 * the driver together, so that it can defer kicking the hardware to
+	 * the last one.
+	 */
+	batching = po->tp_version == TPACKET_V3 && packet_use_direct_xmit(po);
+
 	do {
 		ph = packet_current_frame(po, &po->tx_ring,
 					  TP_STATUS_SEND_REQUEST);
 		if (unlikely(ph == NULL)) {
+			/* The frames pending below include the batched ones */
+			err = tpacket_snd_batch(&batch, &batch_tail);
+			if (unlikely(err))
+				goto out_put;
 			if (need_wait && need_resched())
 				schedule();
 			continue;
@@ -2681,10 +2716,18 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 						    vnet_hdr->hdr_len);
 		}
 		copylen = max_t(int, copylen, dev->hard_header_len);
+again:
+		/* Batched skbs hold send buffer space until they are sent */
 		skb = sock_alloc_send_skb(&po->sk,
 				hlen + tlen + sizeof(struct sockaddr_ll) +
 				(copylen - dev->hard_header_len),
-				!need_wait, &err);
+				!need_wait || batch, &err);
+		if (unlikely(skb == NULL) && batch) {
+			err = tpacket_snd_batch(&batch, &batch_tail);
+			if (unlikely(err))
+				goto out_status;
+			goto again;
+		}
 
 		if (unlikely(skb == NULL)) {
 			/* we assume the socket was initially writeable ... */
@@ -2728,6 +2771,18 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		packet_inc_pending(&po->tx_ring);
 
 		status = TP_STATUS_SEND_REQUEST;
+		if (batching) {
+			*batch_tail = skb;
+			batch_tail = &skb->next;
+			packet_increment_head(&po->tx_ring);
+			len_sum += tp_len;
+			if (po->tx_ring.head % po->tx_ring.frames_per_block)
+				continue;
+			err = tpacket_snd_batch(&batch, &batch_tail);
+			if (unlikely(err))
+				goto out_put;
+			continue;
+		}
 		err = po->xmit(skb);
 		if (unlikely(err > 0)) {
 			err = net_xmit_errno(err);
@@ -2761,6 +2816,7 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	__packet_set_status(po, ph, status);
 	kfree_skb(skb);
 out_put:
+	tpacket_snd_batch(&batch, &batch_tail);
 	dev_put(dev);
 out:
 	mutex_unlock(&po->pg_vec_lock);
@@ -32,6 +32,11 @@
  *  Note : When a flow becomes empty, we do not immediately remove it from
  *  rb trees, for performance reasons (its expected to send additional packets,
  *  or SLAB cache will reuse socket for another flow)
+ *
+ *  fq_mq is a lockless (TCQ_F_NOLOCK) variant for multiqueue devices.
+ *  The flow tables are partitioned per TX queue, each partition with
+ *  its own lock, so that CPUs sending on different queues do not
+ *  serialize on the qdisc root lock at enqueue time.
  */
 
 #include <linux/module.h>
@@ -312,7 +317,7 @@ static struct fq_flow *fq_classify(struct sk_buff *skb, struct fq_sched_data *q)
 
 
 /* remove one skb from head of flow queue */
-static struct sk_buff *fq_dequeue_head(struct Qdisc *sch, struct fq_flow *flow)
+static struct sk_buff *fq_dequeue_head(struct fq_flow *flow)
 {
 	struct sk_buff *skb = flow->head;
 
@@ -320,8 +325,6 @@ static struct sk_buff *fq_dequeue_head(struct Qdisc *sch, struct fq_flow *flow)
 		flow->head = skb->next;
 		skb_mark_not_on_list(skb);
 		flow->qlen--;
-		qdisc_qstats_backlog_dec(sch, skb);
-		sch->q.qlen--;
 	}
 	return skb;
 }
@@ -339,23 +342,20 @@ static void flow_queue_add(struct fq_flow *flow, struct sk_buff *skb)
 	flow->tail = skb;
 }
 
-static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
-		      struct sk_buff **to_free)
+/* Queue @skb on its flow.  The caller accounts for it in the qdisc
+ * stats, and drops it if NET_XMIT_DROP is returned.
+ */
+static int __fq_enqueue(struct fq_sched_data *q, struct sk_buff *skb)
 {
-	struct fq_sched_data *q = qdisc_priv(sch);
 	struct fq_flow *f;
 
-	if (unlikely(sch->q.qlen >= sch->limit))
-		return qdisc_drop(skb, sch, to_free);
-
 	f = fq_classify(skb, q);
 	if (unlikely(f->qlen >= q->flow_plimit && f != &q->internal)) {
 		q->stat_flows_plimit++;
-		return qdisc_drop(skb, sch, to_free);
+		return NET_XMIT_DROP;
 	}
 
 	f->qlen++;
-	qdisc_qstats_backlog_inc(sch, skb);
 	if (fq_flow_is_detached(f)) {
 		struct sock *sk = skb->sk;
 
@@ -377,6 +377,22 @@ static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 	if (unlikely(f == &q->internal)) {
 		q->stat_internal_packets++;
 	}
+
+	return NET_XMIT_SUCCESS;
+}
+
+static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
+		      struct sk_buff **to_free)
+{
+	struct fq_sched_data *q = qdisc_priv(sch);
+
+	if (unlikely(sch->q.qlen >= sch->limit))
+		return qdisc_drop(skb, sch, to_free);
+
+	if (__fq_enqueue(q, skb) != NET_XMIT_SUCCESS)
+		return qdisc_drop(skb, sch, to_free);
+
+	qdisc_qstats_backlog_inc(sch, skb);
 	sch->q.qlen++;
 
 	return NET_XMIT_SUCCESS;
@@ -409,17 +425,18 @@ static void fq_check_throttled(struct fq_sched_data *q, u64 now)
 	}
 }
 
-static struct sk_buff *fq_dequeue(struct Qdisc *sch)
+/* Pick the next skb to send.  When NULL is returned, the caller arms
+ * its watchdog for q->time_next_delayed_flow, unless it is ~0ULL.
+ */
+static struct sk_buff *__fq_dequeue(struct fq_sched_data *q, u64 now)
 {
-	struct fq_sched_data *q = qdisc_priv(sch);
-	u64 now = ktime_get_ns();
 	struct fq_flow_head *head;
 	struct sk_buff *skb;
 	struct fq_flow *f;
 	unsigned long rate;
 	u32 plen;
 
-	skb = fq_dequeue_head(sch, &q->internal);
+	skb = fq_dequeue_head(&q->internal);
 	if (skb)
 		goto out;
 	fq_check_throttled(q, now);
@@ -427,12 +444,8 @@ static struct sk_buff *fq_dequeue(struct Qdisc *sch)
 	head = &q->new_flows;
 	if (!head->first) {
 		head = &q->old_flows;
-		if (!head->first) {
-			if (q->time_next_delayed_flow != ~0ULL)
-				qdisc_watchdog_schedule_ns(&q->watchdog,
-							   q->time_next_delayed_flow);
+		if (!head->first)
 			return NULL;
-		}
 	}
 	f = head->first;
 
@@ -456,7 +469,7 @@ static struct sk_buff *fq_dequeue(struct Qdisc *sch)
 		}
 	}
 
-	skb = fq_dequeue_head(sch, f);
+	skb = fq_dequeue_head(f);
 	if (!skb) {
 		head->first = f->next;
 		/* force a pass through old_flows to prevent starvation */
@@ -515,6 +528,23 @@ static struct sk_buff *fq_dequeue(struct Qdisc *sch)
 		f->time_next_packet = now + len;
 	}
 out:
+	return skb;
+}
+
+static struct sk_buff *fq_dequeue(struct Qdisc *sch)
+{
+	struct fq_sched_data *q = qdisc_priv(sch);
+	struct sk_buff *skb;
+
+	skb = __fq_dequeue(q, ktime_get_ns());
+	if (!skb) {
+		if (q->time_next_delayed_flow != ~0ULL)
+			qdisc_watchdog_schedule_ns(&q->watchdog,
+						   q->time_next_delayed_flow);
+		return NULL;
+	}
+	qdisc_qstats_backlog_dec(sch, skb);
+	sch->q.qlen--;
 	qdisc_bstats_update(sch, skb);
 	return skb;
 }
@@ -526,17 +556,13 @@ static void fq_flow_purge(struct fq_flow *flow)
 	flow->qlen = 0;
 }
 
-static void fq_reset(struct Qdisc *sch)
+static void __fq_reset(struct fq_sched_data *q)
 {
-	struct fq_sched_data *q = qdisc_priv(sch);
 	struct rb_root *root;
 	struct rb_node *p;
 	struct fq_flow *f;
 	unsigned int idx;
 
-	sch->q.qlen = 0;
-	sch->qstats.backlog = 0;
-
 	fq_flow_purge(&q->internal);
 
 	if (!q->fq_root)
@@ -561,6 +587,16 @@ static void fq_reset(struct Qdisc *sch)
 	q->throttled_flows	= 0;
 }
 
+static void fq_reset(struct Qdisc *sch)
+{
+	struct fq_sched_data *q = qdisc_priv(sch);
+
+	sch->q.qlen = 0;
+	sch->qstats.backlog = 0;
+
+	__fq_reset(q);
+}
+
 static void fq_rehash(struct fq_sched_data *q,
 		      struct rb_root *old_array, u32 old_log,
 		      struct rb_root *new_array, u32 new_log)
@@ -611,9 +647,10 @@ static void fq_free(void *addr)
 	kvfree(addr);
 }
 
-static int fq_resize(struct Qdisc *sch, u32 log)
+/* @lock protects @q against enqueue and dequeue */
+static int __fq_resize(struct fq_sched_data *q, u32 log, int node,
+		       spinlock_t *lock)
 {
-	struct fq_sched_data *q = qdisc_priv(sch);
 	struct rb_root *array;
 	void *old_fq_root;
 	u32 idx;
@@ -621,16 +658,15 @@ static int fq_resize(struct Qdisc *sch, u32 log)
 	if (q->fq_root && log == q->fq_trees_log)
 		return 0;
 
-	/* If XPS was setup, we can allocate memory on right NUMA node */
-	array = kvmalloc_node(sizeof(struct rb_root) << log, GFP_KERNEL | __GFP_RETRY_MAYFAIL,
-			      netdev_queue_numa_node_read(sch->dev_queue));
+	array = kvmalloc_node(sizeof(struct rb_root) << log,
+			      GFP_KERNEL | __GFP_RETRY_MAYFAIL, node);
 	if (!array)
 		return -ENOMEM;
 
 	for (idx = 0; idx < (1U << log); idx++)
 		array[idx] = RB_ROOT;
 
-	sch_tree_lock(sch);
+	spin_lock_bh(lock);
 
 	old_fq_root = q->fq_root;
 	if (old_fq_root)
@@ -639,13 +675,21 @@ static int fq_resize(struct Qdisc *sch, u32 log)
 	q->fq_root = array;
 	q->fq_trees_log = log;
 
-	sch_tree_unlock(sch);
+	spin_unlock_bh(lock);
 
 	fq_free(old_fq_root);
 
 	return 0;
 }
 
+static int fq_resize(struct Qdisc *sch, u32 log)
+{
+	/* If XPS was setup, we can allocate memory on right NUMA node */
+	return __fq_resize(qdisc_priv(sch), log,
+			   netdev_queue_numa_node_read(sch->dev_queue),
+			   qdisc_root_sleeping_lock(sch));
+}
+
 static const struct nla_policy fq_policy[TCA_FQ_MAX + 1] = {
 	[TCA_FQ_PLIMIT]			= { .type = NLA_U32 },
 	[TCA_FQ_FLOW_PLIMIT]		= { .type = NLA_U32 },
@@ -659,36 +703,12 @@ static const struct nla_policy fq_policy[TCA_FQ_MAX + 1] = {
 	[TCA_FQ_LOW_RATE_THRESHOLD]	= { .type = NLA_U32 },
 };
 
-static int fq_change(struct Qdisc *sch, struct nlattr *opt,
-		     struct netlink_ext_ack *extack)
+/* Apply the options that live in struct fq_sched_data, except for the
+ * number of buckets which needs a resize.
+ */
+static int fq_change_params(struct fq_sched_data *q, struct nlattr **tb)
 {
-	struct fq_sched_data *q = qdisc_priv(sch);
-	struct nlattr *tb[TCA_FQ_MAX + 1];
-	int err, drop_count = 0;
-	unsigned drop_len = 0;
-	u32 fq_log;
-
-	if (!opt)
-		return -EINVAL;
-
-	err = nla_parse_nested(tb, TCA_FQ_MAX, opt, fq_policy, NULL);
-	if (err < 0)
-		return err;
-
-	sch_tree_lock(sch);
-
-	fq_log = q->fq_trees_log;
-
-	if (tb[TCA_FQ_BUCKETS_LOG]) {
-		u32 nval = nla_get_u32(tb[TCA_FQ_BUCKETS_LOG]);
-
-		if (nval >= 1 && nval <= ilog2(256*1024))
-			fq_log = nval;
-		else
-			err = -EINVAL;
-	}
-	if (tb[TCA_FQ_PLIMIT])
-		sch->limit = nla_get_u32(tb[TCA_FQ_PLIMIT]);
+	int err = 0;
 
 	if (tb[TCA_FQ_FLOW_PLIMIT])
 		q->flow_plimit = nla_get_u32(tb[TCA_FQ_FLOW_PLIMIT]);
@@ -736,6 +756,50 @@ static int fq_change(struct Qdisc *sch, struct nlattr *opt,
 	if (tb[TCA_FQ_ORPHAN_MASK])
 		q->orphan_mask = nla_get_u32(tb[TCA_FQ_ORPHAN_MASK]);
 
+	return err;
+}
+
+static int fq_change_log(struct nlattr **tb, u32 *fq_log)
+{
+	if (tb[TCA_FQ_BUCKETS_LOG]) {
+		u32 nval = nla_get_u32(tb[TCA_FQ_BUCKETS_LOG]);
+
+		if (nval >= 1 && nval <= ilog2(256*1024))
+			*fq_log = nval;
+		else
+			return -EINVAL;
+	}
+	return 0;
+}
+
+static int fq_change(struct Qdisc *sch, struct nlattr *opt,
+		     struct netlink_ext_ack *extack)
+{
+	struct fq_sched_data *q = qdisc_priv(sch);
+	struct nlattr *tb[TCA_FQ_MAX + 1];
+	int err, err2, drop_count = 0;
+	unsigned drop_len = 0;
+	u32 fq_log;
+
+	if (!opt)
+		return -EINVAL;
+
+	err = nla_parse_nested(tb, TCA_FQ_MAX, opt, fq_policy, NULL);
+	if (err < 0)
+		return err;
+
+	sch_tree_lock(sch);
+
+	fq_log = q->fq_trees_log;
+	err = fq_change_log(tb, &fq_log);
+
+	if (tb[TCA_FQ_PLIMIT])
+		sch->limit = nla_get_u32(tb[TCA_FQ_PLIMIT]);
+
+	err2 = fq_change_params(q, tb);
+	if (!err)
+		err = err2;
+
 	if (!err) {
 		sch_tree_unlock(sch);
 		err = fq_resize(sch, fq_log);
@@ -765,13 +829,8 @@ static void fq_destroy(struct Qdisc *sch)
 	qdisc_watchdog_cancel(&q->watchdog);
 }
 
-static int fq_init(struct Qdisc *sch, struct nlattr *opt,
-		   struct netlink_ext_ack *extack)
+static void fq_init_params(struct Qdisc *sch, struct fq_sched_data *q)
 {
-	struct fq_sched_data *q = qdisc_priv(sch);
-	int err;
-
-	sch->limit		= 10000;
 	q->flow_plimit		= 100;
 	q->quantum		= 2 * psched_mtu(qdisc_dev(sch));
 	q->initial_quantum	= 10 * psched_mtu(qdisc_dev(sch));
@@ -786,6 +845,16 @@ static int fq_init(struct Qdisc *sch, struct nlattr *opt,
 	q->fq_trees_log		= ilog2(1024);
 	q->orphan_mask		= 1024 - 1;
 	q->low_rate_threshold	= 550000 / 8;
+}
+
+static int fq_init(struct Qdisc *sch, struct nlattr *opt,
+		   struct netlink_ext_ack *extack)
+{
+	struct fq_sched_data *q = qdisc_priv(sch);
+	int err;
+
+	sch->limit		= 10000;
+	fq_init_params(sch, q);
 	qdisc_watchdog_init_clockid(&q->watchdog, sch, CLOCK_MONOTONIC);
 
 	if (opt)
@@ -796,9 +865,9 @@ static int fq_init(struct Qdisc *sch, struct nlattr *opt,
 	return err;
 }
 
-static int fq_dump(struct Qdisc *sch, struct sk_buff *skb)
+static int __fq_dump(struct Qdisc *sch, struct fq_sched_data *q,
+		     struct sk_buff *skb)
 {
-	struct fq_sched_data *q = qdisc_priv(sch);
 	struct nlattr *opts;
 
 	opts = nla_nest_start(skb, TCA_OPTIONS);
@@ -828,26 +897,39 @@ static int fq_dump(struct Qdisc *sch, struct sk_buff *skb)
 	return -1;
 }
 
+static int fq_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	return __fq_dump(sch, qdisc_priv(sch), skb);
+}
+
+/* Add the stats of @q to @st, which starts out zeroed.
+ * time_next_delayed_flow is left to the caller.
+ */
+static void fq_add_stats(struct tc_fq_qd_stats *st,
+			 const struct fq_sched_data *q)
+{
+	u32 latency = min_t(unsigned long, q->unthrottle_latency_ns, ~0U);
+
+	st->gc_flows		  += q->stat_gc_flows;
+	st->highprio_packets	  += q->stat_internal_packets;
+	st->throttled		  += q->stat_throttled;
+	st->flows_plimit	  += q->stat_flows_plimit;
+	st->pkts_too_long	  += q->stat_pkts_too_long;
+	st->allocation_errors	  += q->stat_allocation_errors;
+	st->flows		  += q->flows;
+	st->inactive_flows	  += q->inactive_flows;
+	st->throttled_flows	  += q->throttled_flows;
+	st->unthrottle_latency_ns  = max(st->unthrottle_latency_ns, latency);
+}
+
 static int fq_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
 {
 	struct fq_sched_data *q = qdisc_priv(sch);
-	struct tc_fq_qd_stats st;
+	struct tc_fq_qd_stats st = {};
 
 	sch_tree_lock(sch);
-
-	st.gc_flows		  = q->stat_gc_flows;
-	st.highprio_packets	  = q->stat_internal_packets;
-	st.tcp_retrans		  = 0;
-	st.throttled		  = q->stat_throttled;
-	st.flows_plimit		  = q->stat_flows_plimit;
-	st.pkts_too_long	  = q->stat_pkts_too_long;
-	st.allocation_errors	  = q->stat_allocation_errors;
+	fq_add_stats(&st, q);
 	st.time_next_delayed_flow = q->time_next_delayed_flow - ktime_get_ns();
-	st.flows		  = q->flows;
-	st.inactive_flows	  = q->inactive_flows;
-	st.throttled_flows	  = q->throttled_flows;
-	st.unthrottle_latency_ns  = min_t(unsigned long,
-					  q->unthrottle_latency_ns, ~0U);
 	sch_tree_unlock(sch);
 
 	return gnet_stats_copy_app(d, &st, sizeof(st));
@@ -869,6 +951,257 @@ static struct Qdisc_ops fq_qdisc_ops __read_mostly = {
 	.owner		=	THIS_MODULE,
 };
 
+/* One partition of fq_mq per TX queue */
+struct fq_mq_part {
+	spinlock_t		lock;
+	u32			qlen;
+	struct fq_sched_data	q;
+} ____cacheline_aligned_in_smp;
+
+struct fq_mq_sched_data {
+	struct fq_mq_part	*parts;
+	unsigned int		nr_parts;
+	unsigned int		next_part;	/* round robin for dequeue */
+	struct qdisc_watchdog	watchdog;
+};
+
+static u32 fq_mq_part_limit(const struct Qdisc *sch,
+			    const struct fq_mq_sched_data *priv)
+{
+	return DIV_ROUND_UP(sch->limit, priv->nr_parts);
+}
+
+/* Runs without the qdisc lock, concurrently on all CPUs */
+static int fq_mq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
+			 struct sk_buff **to_free)
+{
+	struct fq_mq_sched_data *priv = qdisc_priv(sch);
+	unsigned int pkt_len = qdisc_pkt_len(skb);
+	struct fq_mq_part *part;
+	int ret = NET_XMIT_DROP;
+
+	part = &priv->parts[skb_get_queue_mapping(skb) % priv->nr_parts];
+
+	spin_lock(&part->lock);
+	if (likely(part->qlen < fq_mq_part_limit(sch, priv)))
+		ret = __fq_enqueue(&part->q, skb);
+	if (ret == NET_XMIT_SUCCESS)
+		part->qlen++;
+	spin_unlock(&part->lock);
+
+	if (ret != NET_XMIT_SUCCESS)
+		return qdisc_drop_cpu(skb, sch, to_free);
+
+	/* skb may already be dequeued by another CPU */
+	qdisc_qstats_cpu_qlen_inc(sch);
+	this_cpu_add(sch->cpu_qstats->backlog, pkt_len);
+	return NET_XMIT_SUCCESS;
+}
+
+/* Dequeue runs under qdisc->seqlock, so it is never concurrent with itself.
+ * A single watchdog is armed for the earliest throttled flow across all
+ * partitions.
+ */
+static struct sk_buff *fq_mq_dequeue(struct Qdisc *sch)
+{
+	struct fq_mq_sched_data *priv = qdisc_priv(sch);
+	u64 next = ~0ULL, now = ktime_get_ns();
+	struct sk_buff *skb = NULL;
+	unsigned int i;
+
+	for (i = 0; i < priv->nr_parts && !skb; i++) {
+		struct fq_mq_part *part = &priv->parts[priv->next_part];
+
+		if (++priv->next_part == priv->nr_parts)
+			priv->next_part = 0;
+
+		if (!READ_ONCE(part->qlen))
+			continue;
+
+		spin_lock(&part->lock);
+		skb = __fq_dequeue(&part->q, now);
+		if (skb)
+			part->qlen--;
+		else
+			next = min(next, part->q.time_next_delayed_flow);
+		spin_unlock(&part->lock);
+	}
+
+	if (!skb) {
+		if (next != ~0ULL)
+			qdisc_watchdog_schedule_ns(&priv->watchdog, next);
+		return NULL;
+	}
+	qdisc_qstats_cpu_backlog_dec(sch, skb);
+	qdisc_bstats_cpu_update(sch, skb);
+	qdisc_qstats_cpu_qlen_dec(sch);
+	return skb;
+}
+
+static void fq_mq_reset(struct Qdisc *sch)
+{
+	struct fq_mq_sched_data *priv = qdisc_priv(sch);
+	unsigned int i;
+	int cpu;
+
+	for (i = 0; i < priv->nr_parts; i++) {
+		struct fq_mq_part *part = &priv->parts[i];
+
+		spin_lock_bh(&part->lock);
+		__fq_reset(&part->q);
+		part->qlen = 0;
+		spin_unlock_bh(&part->lock);
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct gnet_stats_queue *q = per_cpu_ptr(sch->cpu_qstats, cpu);
+
+		q->backlog = 0;
+		q->qlen = 0;
+	}
+}
+
+static int fq_mq_resize(struct Qdisc *sch, u32 log)
+{
+	struct fq_mq_sched_data *priv = qdisc_priv(sch);
+	struct net_device *dev = qdisc_dev(sch);
+	unsigned int i;
+	int err = 0;
+
+	for (i = 0; i < priv->nr_parts && !err; i++) {
+		struct netdev_queue *txq = netdev_get_tx_queue(dev, i);
+
+		err = __fq_resize(&priv->parts[i].q, log,
+				  netdev_queue_numa_node_read(txq),
+				  &priv->parts[i].lock);
+	}
+	return err;
+}
+
+static int fq_mq_change(struct Qdisc *sch, struct nlattr *opt,
+			struct netlink_ext_ack *extack)
+{
+	struct fq_mq_sched_data *priv = qdisc_priv(sch);
+	struct nlattr *tb[TCA_FQ_MAX + 1];
+	unsigned int i;
+	int err, err2;
+	u32 fq_log;
+
+	if (!opt)
+		return -EINVAL;
+
+	err = nla_parse_nested(tb, TCA_FQ_MAX, opt, fq_policy, NULL);
+	if (err < 0)
+		return err;
+
+	/* All partitions share the same configuration */
+	fq_log = priv->parts[0].q.fq_trees_log;
+	err = fq_change_log(tb, &fq_log);
+
+	if (tb[TCA_FQ_PLIMIT])
+		WRITE_ONCE(sch->limit, nla_get_u32(tb[TCA_FQ_PLIMIT]));
+
+	for (i = 0; i < priv->nr_parts; i++) {
+		struct fq_mq_part *part = &priv->parts[i];
+
+		spin_lock_bh(&part->lock);
+		err2 = fq_change_params(&part->q, tb);
+		spin_unlock_bh(&part->lock);
+		if (!err)
+			err = err2;
+	}
+
+	if (!err)
+		err = fq_mq_resize(sch, fq_log);
+	return err;
+}
+
+static void fq_mq_destroy(struct Qdisc *sch)
+{
+	struct fq_mq_sched_data *priv = qdisc_priv(sch);
+	unsigned int i;
+
+	if (!priv->parts)
+		return;
+
+	qdisc_watchdog_cancel(&priv->watchdog);
+	for (i = 0; i < priv->nr_parts; i++) {
+		__fq_reset(&priv->parts[i].q);
+		fq_free(priv->parts[i].q.fq_root);
+	}
+	kvfree(priv->parts);
+}
+
+static int fq_mq_init(struct Qdisc *sch, struct nlattr *opt,
+		      struct netlink_ext_ack *extack)
+{
+	struct fq_mq_sched_data *priv = qdisc_priv(sch);
+	struct net_device *dev = qdisc_dev(sch);
+	unsigned int i;
+
+	priv->nr_parts = dev->num_tx_queues;
+	priv->parts = kvcalloc(priv->nr_parts, sizeof(*priv->parts),
+			       GFP_KERNEL);
+	if (!priv->parts)
+		return -ENOMEM;
+
+	sch->limit = 10000;
+	for (i = 0; i < priv->nr_parts; i++) {
+		spin_lock_init(&priv->parts[i].lock);
+		fq_init_params(sch, &priv->parts[i].q);
+	}
+	qdisc_watchdog_init_clockid(&priv->watchdog, sch, CLOCK_MONOTONIC);
+
+	if (opt)
+		return fq_mq_change(sch, opt, extack);
+
+	return fq_mq_resize(sch, priv->parts[0].q.fq_trees_log);
+}
+
+static int fq_mq_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct fq_mq_sched_data *priv = qdisc_priv(sch);
+
+	return __fq_dump(sch, &priv->parts[0].q, skb);
+}
+
+static int fq_mq_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
+{
+	struct fq_mq_sched_data *priv = qdisc_priv(sch);
+	struct tc_fq_qd_stats st = {};
+	u64 next = ~0ULL;
+	unsigned int i;
+
+	for (i = 0; i < priv->nr_parts; i++) {
+		struct fq_mq_part *part = &priv->parts[i];
+
+		spin_lock_bh(&part->lock);
+		fq_add_stats(&st, &part->q);
+		next = min(next, part->q.time_next_delayed_flow);
+		spin_unlock_bh(&part->lock);
+	}
+	st.time_next_delayed_flow = next - ktime_get_ns();
+
+	return gnet_stats_copy_app(d, &st, sizeof(st));
+}
+
+static struct Qdisc_ops fq_mq_qdisc_ops __read_mostly = {
+	.id		=	"fq_mq",
+	.priv_size	=	sizeof(struct fq_mq_sched_data),
+	.static_flags	=	TCQ_F_NOLOCK | TCQ_F_CPUSTATS,
+
+	.enqueue	=	fq_mq_enqueue,
+	.dequeue	=	fq_mq_dequeue,
+	.peek		=	qdisc_peek_dequeued,
+	.init		=	fq_mq_init,
+	.reset		=	fq_mq_reset,
+	.destroy	=	fq_mq_destroy,
+	.change		=	fq_mq_change,
+	.dump		=	fq_mq_dump,
+	.dump_stats	=	fq_mq_dump_stats,
+	.owner		=	THIS_MODULE,
+};
+
 static int __init fq_module_init(void)
 {
 	int ret;
@@ -881,12 +1214,24 @@ static int __init fq_module_init(void)
 
 	ret = register_qdisc(&fq_qdisc_ops);
 	if (ret)
-		kmem_cache_destroy(fq_flow_cachep);
+		goto err_cache;
+
+	ret = register_qdisc(&fq_mq_qdisc_ops);
+	if (ret)
+		goto err_fq;
+
+	return 0;
+
+err_fq:
+	unregister_qdisc(&fq_qdisc_ops);
+err_cache:
+	kmem_cache_destroy(fq_flow_cachep);
 	return ret;
 }
 
 static void __exit fq_module_exit(void)
 {
+	unregister_qdisc(&fq_mq_qdisc_ops);
 	unregister_qdisc(&fq_qdisc_ops);
 	kmem_cache_destroy(fq_flow_cachep);
 }
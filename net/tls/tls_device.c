@@ -140,7 +140,7 @@ static void destroy_record(struct tls_record_info *record)
 
 	while (nr_frags-- > 0) {
 		frag = &record->frags[nr_frags];
-		__skb_frag_unref(frag);
+		__skb_frag_unref(frag, false);
 	}
 	kfree(record);
 }
@@ -270,7 +270,7 @@ static int tls_push_record(struct sock *sk,
 	spin_unlock_irq(&offload_ctx->lock);
 	offload_ctx->open_record = NULL;
 	set_bit(TLS_PENDING_CLOSED_RECORD, &ctx->flags);
-	tls_advance_record_sn(sk, &ctx->tx);
+	tls_advance_record_sn(sk, &ctx->tx, ctx->crypto_send.info.version);
 
 	for (i = 0; i < record->num_frags; i++) {
 		frag = &record->frags[i];
@@ -340,8 +340,12 @@ static int tls_do_allocation(struct sock *sk,
 	return 0;
 }
 
+/* Data is either copied from @msg_iter, or with zerocopy sendfile, taken
+ * by reference from @zc_page starting at @zc_offset.
+ */
 static int tls_push_data(struct sock *sk,
 			 struct iov_iter *msg_iter,
+			 struct page *zc_page, int zc_offset,
 			 size_t size, int flags,
 			 unsigned char record_type)
 {
@@ -404,16 +408,31 @@ static int tls_push_data(struct sock *sk,
 		}
 
 		record = ctx->open_record;
-		copy = min_t(size_t, size, (pfrag->size - pfrag->offset));
-		copy = min_t(size_t, copy, (max_open_record_len - record->len));
-
-		if (copy_from_iter_nocache(page_address(pfrag->page) +
-					       pfrag->offset,
-					   copy, msg_iter) != copy) {
-			rc = -EFAULT;
-			goto handle_error;
+		if (zc_page) {
+			struct page_frag zc_pfrag = {
+				.page	= zc_page,
+				.offset	= zc_offset,
+			};
+
+			copy = min_t(size_t, size,
+				     max_open_record_len - record->len);
+			zc_pfrag.size = copy;
+			tls_append_frag(record, &zc_pfrag, copy);
+			zc_offset += copy;
+		} else {
+			copy = min_t(size_t, size,
+				     pfrag->size - pfrag->offset);
+			copy = min_t(size_t, copy,
+				     max_open_record_len - record->len);
+
+			if (copy_from_iter_nocache(page_address(pfrag->page) +
+						   pfrag->offset,
+						   copy, msg_iter) != copy) {
+				rc = -EFAULT;
+				goto handle_error;
+			}
+			tls_append_frag(record, pfrag, copy);
 		}
-		tls_append_frag(record, pfrag, copy);
 
 		size -= copy;
 		if (!size) {
@@ -461,7 +480,7 @@ int tls_device_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 			goto out;
 	}
 
-	rc = tls_push_data(sk, &msg->msg_iter, size,
+	rc = tls_push_data(sk, &msg->msg_iter, NULL, 0, size,
 			   msg->msg_flags, record_type);
 
 out:
@@ -472,9 +491,10 @@ int tls_device_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 int tls_device_sendpage(struct sock *sk, struct page *page,
 			int offset, size_t size, int flags)
 {
+	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct iov_iter	msg_iter;
-	char *kaddr = kmap(page);
 	struct kvec iov;
+	char *kaddr;
 	int rc;
 
 	if (flags & MSG_SENDPAGE_NOTLAST)
@@ -487,10 +507,21 @@ int tls_device_sendpage(struct sock *sk, struct page *page,
 		goto out;
 	}
 
+	/* The records keep referencing the page until acked, for
+	 * retransmissions: this is only correct if the data doesn't
+	 * change meanwhile, which userspace promised.
+	 */
+	if (tls_ctx->zerocopy_sendfile) {
+		rc = tls_push_data(sk, NULL, page, offset, size,
+				   flags, TLS_RECORD_TYPE_DATA);
+		goto out;
+	}
+
+	kaddr = kmap(page);
 	iov.iov_base = kaddr + offset;
 	iov.iov_len = size;
 	iov_iter_kvec(&msg_iter, WRITE, &iov, 1, size);
-	rc = tls_push_data(sk, &msg_iter, size,
+	rc = tls_push_data(sk, &msg_iter, NULL, 0, size,
 			   flags, TLS_RECORD_TYPE_DATA);
 	kunmap(page);
 
@@ -539,7 +570,8 @@ static int tls_device_push_pending_record(struct sock *sk, int flags)
 	struct iov_iter	msg_iter;
 
 	iov_iter_kvec(&msg_iter, WRITE, NULL, 0, 0);
-	return tls_push_data(sk, &msg_iter, 0, flags, TLS_RECORD_TYPE_DATA);
+	return tls_push_data(sk, &msg_iter, NULL, 0, 0, flags,
+			     TLS_RECORD_TYPE_DATA);
 }
 
 void handle_device_resync(struct sock *sk, u32 seq, u64 rcd_sn)
@@ -669,6 +701,12 @@ int tls_set_device_offload(struct sock *sk, struct tls_context *ctx)
 	if (!ctx)
 		goto out;
 
+	/* devices only handle TLS 1.2 records */
+	if (ctx->crypto_send.info.version != TLS_1_2_VERSION) {
+		rc = -EOPNOTSUPP;
+		goto out;
+	}
+
 	if (ctx->priv_ctx_tx) {
 		rc = -EEXIST;
 		goto out;
@@ -821,6 +859,9 @@ int tls_set_device_offload_rx(struct sock *sk, struct tls_context *ctx)
 	struct net_device *netdev;
 	int rc = 0;
 
+	if (ctx->crypto_recv.info.version != TLS_1_2_VERSION)
+		return -EOPNOTSUPP;
+
 	/* We support starting offload on multiple sockets
 	 * concurrently, so we only need a read lock here.
 	 * This lock must precede get_netdev_for_sock to prevent races between
@@ -177,7 +177,7 @@ static int tls_do_decryption(struct sock *sk,
 	int ret;
 
 	aead_request_set_tfm(aead_req, ctx->aead_recv);
-	aead_request_set_ad(aead_req, TLS_AAD_SPACE_SIZE);
+	aead_request_set_ad(aead_req, tls_ctx->rx.aad_size);
 	aead_request_set_crypt(aead_req, sgin, sgout,
 			       data_len + tls_ctx->rx.tag_size,
 			       (u8 *)iv_recv);
@@ -281,12 +281,12 @@ static struct tls_rec *tls_get_rec(struct sock *sk)
 
 	sg_init_table(rec->sg_aead_in, 2);
 	sg_set_buf(&rec->sg_aead_in[0], rec->aad_space,
-		   sizeof(rec->aad_space));
+		   tls_ctx->tx.aad_size);
 	sg_unmark_end(&rec->sg_aead_in[1]);
 
 	sg_init_table(rec->sg_aead_out, 2);
 	sg_set_buf(&rec->sg_aead_out[0], rec->aad_space,
-		   sizeof(rec->aad_space));
+		   tls_ctx->tx.aad_size);
 	sg_unmark_end(&rec->sg_aead_out[1]);
 
 	return rec;
@@ -444,11 +444,15 @@ static int tls_do_encryption(struct sock *sk,
 
 	msg_en->sg.curr = start;
 
+	memcpy(rec->iv_data, tls_ctx->tx.iv, sizeof(rec->iv_data));
+	tls_xor_iv_with_seq(tls_ctx->crypto_send.info.version, rec->iv_data,
+			    tls_ctx->tx.rec_seq);
+
 	aead_request_set_tfm(aead_req, ctx->aead_send);
-	aead_request_set_ad(aead_req, TLS_AAD_SPACE_SIZE);
+	aead_request_set_ad(aead_req, tls_ctx->tx.aad_size);
 	aead_request_set_crypt(aead_req, rec->sg_aead_in,
 			       rec->sg_aead_out,
-			       data_len, tls_ctx->tx.iv);
+			       data_len, rec->iv_data);
 
 	aead_request_set_callback(aead_req, CRYPTO_TFM_REQ_MAY_BACKLOG,
 				  tls_encrypt_done, sk);
@@ -473,7 +477,8 @@ static int tls_do_encryption(struct sock *sk,
 
 	/* Unhook the record from context if encryption is not failure */
 	ctx->open_rec = NULL;
-	tls_advance_record_sn(sk, &tls_ctx->tx);
+	tls_advance_record_sn(sk, &tls_ctx->tx,
+			      tls_ctx->crypto_send.info.version);
 	return rc;
 }
 
@@ -601,6 +606,7 @@ static int tls_push_record(struct sock *sk, int flags,
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_tx *ctx = tls_sw_ctx_tx(tls_ctx);
 	struct tls_rec *rec = ctx->open_rec, *tmp = NULL;
+	int version = tls_ctx->crypto_send.info.version;
 	u32 i, split_point, uninitialized_var(orig_end);
 	struct sk_msg *msg_pl, *msg_en;
 	struct aead_request *req;
@@ -630,10 +636,23 @@ static int tls_push_record(struct sock *sk, int flags,
 
 	i = msg_pl->sg.end;
 	sk_msg_iter_var_prev(i);
-	sg_mark_end(sk_msg_elem(msg_pl, i));
+
+	rec->content_type = record_type;
+	if (version == TLS_1_3_VERSION) {
+		/* The record type goes at the end of the plaintext, chain it
+		 * from the element following the last one, which is the
+		 * spare one if the message is full.
+		 */
+		sg_set_buf(&rec->sg_content_type, &rec->content_type, 1);
+		sg_mark_end(&rec->sg_content_type);
+		sg_chain(msg_pl->sg.data, i + 2, &rec->sg_content_type);
+	} else {
+		sg_mark_end(sk_msg_elem(msg_pl, i));
+	}
 
 	i = msg_pl->sg.start;
-	sg_chain(rec->sg_aead_in, 2, rec->inplace_crypto ?
+	sg_chain(rec->sg_aead_in, 2,
+		 rec->inplace_crypto && version != TLS_1_3_VERSION ?
 		 &msg_en->sg.data[i] : &msg_pl->sg.data[i]);
 
 	i = msg_en->sg.end;
@@ -643,18 +662,22 @@ static int tls_push_record(struct sock *sk, int flags,
 	i = msg_en->sg.start;
 	sg_chain(rec->sg_aead_out, 2, &msg_en->sg.data[i]);
 
-	tls_make_aad(rec->aad_space, msg_pl->sg.size,
+	tls_make_aad(rec->aad_space, version == TLS_1_3_VERSION ?
+		     msg_pl->sg.size + tls_ctx->tx.tail_size +
+		     tls_ctx->tx.tag_size : msg_pl->sg.size,
 		     tls_ctx->tx.rec_seq, tls_ctx->tx.rec_seq_size,
-		     record_type);
+		     record_type, version);
 
 	tls_fill_prepend(tls_ctx,
 			 page_address(sg_page(&msg_en->sg.data[i])) +
-			 msg_en->sg.data[i].offset, msg_pl->sg.size,
+			 msg_en->sg.data[i].offset,
+			 msg_pl->sg.size + tls_ctx->tx.tail_size,
 			 record_type);
 
 	tls_ctx->pending_open_record_frags = false;
 
-	rc = tls_do_encryption(sk, tls_ctx, ctx, req, msg_pl->sg.size, i);
+	rc = tls_do_encryption(sk, tls_ctx, ctx, req,
+			       msg_pl->sg.size + tls_ctx->tx.tail_size, i);
 	if (rc < 0) {
 		if (rc != -EINPROGRESS) {
 			tls_err_abort(sk, EBADMSG);
@@ -1266,7 +1289,9 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 	u8 *aad, *iv, *mem = NULL;
 	struct scatterlist *sgin = NULL;
 	struct scatterlist *sgout = NULL;
-	const int data_len = rxm->full_len - tls_ctx->rx.overhead_size;
+	const int data_len = rxm->full_len - tls_ctx->rx.overhead_size +
+			     tls_ctx->rx.tail_size;
+	int version = tls_ctx->crypto_recv.info.version;
 
 	if (*zc && (out_iov || out_sg)) {
 		if (out_iov)
@@ -1310,23 +1335,29 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 	iv = aad + TLS_AAD_SPACE_SIZE;
 
 	/* Prepare IV */
-	err = skb_copy_bits(skb, rxm->offset + TLS_HEADER_SIZE,
-			    iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
-			    tls_ctx->rx.iv_size);
-	if (err < 0) {
-		kfree(mem);
-		return err;
+	if (version == TLS_1_3_VERSION) {
+		memcpy(iv, tls_ctx->rx.iv, crypto_aead_ivsize(ctx->aead_recv));
+	} else {
+		err = skb_copy_bits(skb, rxm->offset + TLS_HEADER_SIZE,
+				    iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
+				    tls_ctx->rx.iv_size);
+		if (err < 0) {
+			kfree(mem);
+			return err;
+		}
+		memcpy(iv, tls_ctx->rx.iv, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
 	}
-	memcpy(iv, tls_ctx->rx.iv, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+	tls_xor_iv_with_seq(version, iv, tls_ctx->rx.rec_seq);
 
 	/* Prepare AAD */
-	tls_make_aad(aad, rxm->full_len - tls_ctx->rx.overhead_size,
+	tls_make_aad(aad, version == TLS_1_3_VERSION ?
+		     rxm->full_len - tls_ctx->rx.prepend_size : data_len,
 		     tls_ctx->rx.rec_seq, tls_ctx->rx.rec_seq_size,
-		     ctx->control);
+		     ctx->control, version);
 
 	/* Prepare sgin */
 	sg_init_table(sgin, n_sgin);
-	sg_set_buf(&sgin[0], aad, TLS_AAD_SPACE_SIZE);
+	sg_set_buf(&sgin[0], aad, tls_ctx->rx.aad_size);
 	err = skb_to_sgvec(skb, &sgin[1],
 			   rxm->offset + tls_ctx->rx.prepend_size,
 			   rxm->full_len - tls_ctx->rx.prepend_size);
@@ -1338,7 +1369,7 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 	if (n_sgout) {
 		if (out_iov) {
 			sg_init_table(sgout, n_sgout);
-			sg_set_buf(&sgout[0], aad, TLS_AAD_SPACE_SIZE);
+			sg_set_buf(&sgout[0], aad, tls_ctx->rx.aad_size);
 
 			*chunk = 0;
 			err = tls_setup_from_iter(sk, out_iov, data_len,
@@ -1373,11 +1404,40 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 	return err;
 }
 
+/* TLS 1.3 plaintext is followed by the actual record type and zero padding,
+ * find the type from the end of the decrypted record, and return the length
+ * of the type and padding.
+ */
+static int tls_padding_length(struct tls_sw_context_rx *ctx,
+			      struct sk_buff *skb, int offset, int len)
+{
+	int sub = 0;
+
+	while (sub < len) {
+		u8 content_type;
+		int err;
+
+		err = skb_copy_bits(skb, offset + len - sub - 1,
+				    &content_type, 1);
+		if (err < 0)
+			return err;
+
+		sub++;
+		if (content_type) {
+			ctx->control = content_type;
+			return sub;
+		}
+	}
+
+	return -EBADMSG;
+}
+
 static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 			      struct iov_iter *dest, int *chunk, bool *zc)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
+	int version = tls_ctx->crypto_recv.info.version;
 	struct strp_msg *rxm = strp_msg(skb);
 	int err = 0;
 
@@ -1390,17 +1450,34 @@ static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 		err = decrypt_internal(sk, skb, dest, NULL, chunk, zc);
 		if (err < 0) {
 			if (err == -EINPROGRESS)
-				tls_advance_record_sn(sk, &tls_ctx->rx);
+				tls_advance_record_sn(sk, &tls_ctx->rx,
+						      version);
 
 			return err;
 		}
+
+		/* TLS 1.3 records are always decrypted in place */
+		if (version == TLS_1_3_VERSION) {
+			int pad;
+
+			pad = tls_padding_length(ctx, skb,
+						 rxm->offset +
+						 tls_ctx->rx.prepend_size,
+						 rxm->full_len -
+						 tls_ctx->rx.prepend_size -
+						 tls_ctx->rx.tag_size);
+			if (pad < 0)
+				return pad;
+
+			rxm->full_len -= pad - tls_ctx->rx.tail_size;
+		}
 	} else {
 		*zc = false;
 	}
 
 	rxm->offset += tls_ctx->rx.prepend_size;
 	rxm->full_len -= tls_ctx->rx.overhead_size;
-	tls_advance_record_sn(sk, &tls_ctx->rx);
+	tls_advance_record_sn(sk, &tls_ctx->rx, version);
 	ctx->decrypted = true;
 	ctx->saved_data_ready(sk);
 
@@ -1458,6 +1535,7 @@ int tls_sw_recvmsg(struct sock *sk,
 	int target, err = 0;
 	long timeo;
 	bool is_kvec = iov_iter_is_kvec(&msg->msg_iter);
+	bool tls13 = tls_ctx->crypto_recv.info.version == TLS_1_3_VERSION;
 	int num_async = 0;
 
 	flags |= nonblock;
@@ -1492,6 +1570,17 @@ int tls_sw_recvmsg(struct sock *sk,
 
 		rxm = strp_msg(skb);
 
+		/* TLS 1.3 records only tell their type once decrypted */
+		if (tls13 && !ctx->decrypted) {
+			err = decrypt_skb_update(sk, skb, NULL, &chunk, &zc);
+			if (err < 0) {
+				tls_err_abort(sk, EBADMSG);
+				goto recv_end;
+			}
+
+			ctx->decrypted = true;
+		}
+
 		if (!cmsg) {
 			int cerr;
 
@@ -1622,12 +1711,6 @@ ssize_t tls_sw_splice_read(struct socket *sock,  loff_t *ppos,
 	if (!skb)
 		goto splice_read_end;
 
-	/* splice does not support reading control messages */
-	if (ctx->control != TLS_RECORD_TYPE_DATA) {
-		err = -ENOTSUPP;
-		goto splice_read_end;
-	}
-
 	if (!ctx->decrypted) {
 		err = decrypt_skb_update(sk, skb, NULL, &chunk, &zc);
 
@@ -1637,6 +1720,14 @@ ssize_t tls_sw_splice_read(struct socket *sock,  loff_t *ppos,
 		}
 		ctx->decrypted = true;
 	}
+
+	/* splice does not support reading control messages, with TLS 1.3
+	 * the record type is only known after decryption
+	 */
+	if (ctx->control != TLS_RECORD_TYPE_DATA) {
+		err = -ENOTSUPP;
+		goto splice_read_end;
+	}
 	rxm = strp_msg(skb);
 
 	chunk = min_t(unsigned int, rxm->full_len, len);
@@ -1674,7 +1765,7 @@ static int tls_read_size(struct strparser *strp, struct sk_buff *skb)
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
 	char header[TLS_HEADER_SIZE + MAX_IV_SIZE];
 	struct strp_msg *rxm = strp_msg(skb);
-	size_t cipher_overhead;
+	size_t cipher_overhead, max_len;
 	size_t data_len = 0;
 	int ret;
 
@@ -1698,9 +1789,15 @@ static int tls_read_size(struct strparser *strp, struct sk_buff *skb)
 
 	data_len = ((header[4] & 0xFF) | (header[3] << 8));
 
-	cipher_overhead = tls_ctx->rx.tag_size + tls_ctx->rx.iv_size;
+	if (tls_ctx->crypto_recv.info.version == TLS_1_3_VERSION) {
+		cipher_overhead = tls_ctx->rx.tag_size + tls_ctx->rx.tail_size;
+		max_len = TLS_MAX_PAYLOAD_SIZE + TLS_1_3_MAX_EXPANSION;
+	} else {
+		cipher_overhead = tls_ctx->rx.tag_size + tls_ctx->rx.iv_size;
+		max_len = TLS_MAX_PAYLOAD_SIZE + cipher_overhead;
+	}
 
-	if (data_len > TLS_MAX_PAYLOAD_SIZE + cipher_overhead) {
+	if (data_len > max_len) {
 		ret = -EMSGSIZE;
 		goto read_failure;
 	}
@@ -1709,8 +1806,18 @@ static int tls_read_size(struct strparser *strp, struct sk_buff *skb)
 		goto read_failure;
 	}
 
-	if (header[1] != TLS_VERSION_MINOR(tls_ctx->crypto_recv.info.version) ||
-	    header[2] != TLS_VERSION_MAJOR(tls_ctx->crypto_recv.info.version)) {
+	if (tls_ctx->crypto_recv.info.version == TLS_1_3_VERSION) {
+		/* legacy record version and opaque type, see RFC 8446 5.2 */
+		if (header[0] != TLS_RECORD_TYPE_DATA ||
+		    header[1] != TLS_1_2_VERSION_MINOR ||
+		    header[2] != TLS_1_2_VERSION_MAJOR) {
+			ret = -EINVAL;
+			goto read_failure;
+		}
+	} else if (header[1] !=
+		   TLS_VERSION_MINOR(tls_ctx->crypto_recv.info.version) ||
+		   header[2] !=
+		   TLS_VERSION_MAJOR(tls_ctx->crypto_recv.info.version)) {
 		ret = -EINVAL;
 		goto read_failure;
 	}
@@ -1938,9 +2045,19 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 		goto free_priv;
 	}
 
+	if (crypto_info->version == TLS_1_3_VERSION) {
+		nonce_size = 0;
+		cctx->aad_size = TLS_1_3_AAD_SPACE_SIZE;
+		cctx->tail_size = TLS_1_3_TAIL_SIZE;
+	} else {
+		cctx->aad_size = TLS_AAD_SPACE_SIZE;
+		cctx->tail_size = 0;
+	}
+
 	cctx->prepend_size = TLS_HEADER_SIZE + nonce_size;
 	cctx->tag_size = tag_size;
-	cctx->overhead_size = cctx->prepend_size + cctx->tag_size;
+	cctx->overhead_size = cctx->prepend_size + cctx->tag_size +
+			      cctx->tail_size;
 	cctx->iv_size = iv_size;
 	cctx->iv = kmalloc(iv_size + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
 			   GFP_KERNEL);
@@ -74,27 +74,19 @@
 #include <linux/un.h>
 #include <linux/net.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
 #include <linux/skbuff.h>
 #include <linux/netdevice.h>
 #include <linux/file.h>
 #include <linux/proc_fs.h>
-#include <linux/mutex.h>
-#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include <net/sock.h>
 #include <net/af_unix.h>
 #include <net/scm.h>
 #include <net/tcp_states.h>
 
-/* Internal data structures and random procedures: */
-
-static LIST_HEAD(gc_inflight_list);
-static LIST_HEAD(gc_candidates);
-static DEFINE_SPINLOCK(unix_gc_lock);
-static DECLARE_WAIT_QUEUE_HEAD(unix_gc_wait);
-
-unsigned int unix_tot_inflight;
-
 struct sock *unix_get_socket(struct file *filp)
 {
 	struct sock *u_sock = NULL;
@@ -112,265 +104,566 @@ struct sock *unix_get_socket(struct file *filp)
 	return u_sock;
 }
 
-/* Keep the number of times in flight count for the file
- * descriptor if it is for an AF_UNIX socket.
+/* In-flight graph
+ *
+ * Every AF_UNIX socket whose file is in flight is a vertex, and every
+ * in-flight reference to it is an edge, directed to the socket holding
+ * the skb in its receive queue.  Edges are added when an skb carrying
+ * descriptors is queued, and removed when the descriptors are received or
+ * the skb is freed, so the graph is always up to date and the collector
+ * never has to scan receive queues to build it.
+ *
+ * Garbage can only be a strongly connected component (SCC) of that graph
+ * whose sockets are referenced by in-flight descriptors only, and which
+ * no edge leaves.  The SCCs are computed with Tarjan's algorithm, and kept
+ * grouped until an edge involving an in-flight receiver is added or
+ * removed: until then, the collector just checks the known SCCs again.
+ * And if no SCC can be cyclic, there's nothing to collect at all.
+ *
+ * Everything here is protected by unix_gc_lock, which is only taken by
+ * senders and receivers of AF_UNIX descriptors, and for short periods.
  */
+static DEFINE_SPINLOCK(unix_gc_lock);
+unsigned int unix_tot_inflight;
 
-void unix_inflight(struct user_struct *user, struct file *fp)
+static struct unix_vertex *unix_edge_successor(struct unix_edge *edge)
 {
-	struct sock *s = unix_get_socket(fp);
+	/* If an embryo socket has a descriptor queued, the listener
+	 * indirectly holds the reference, until accept().
+	 */
+	if (edge->successor->listener)
+		return unix_sk(edge->successor->listener)->vertex;
 
-	spin_lock(&unix_gc_lock);
+	return edge->successor->vertex;
+}
 
-	if (s) {
-		struct unix_sock *u = unix_sk(s);
+static bool unix_graph_maybe_cyclic;
+static bool unix_graph_grouped;
 
-		if (atomic_long_inc_return(&u->inflight) == 1) {
-			BUG_ON(!list_empty(&u->link));
-			list_add_tail(&u->link, &gc_inflight_list);
-		} else {
-			BUG_ON(list_empty(&u->link));
-		}
-		unix_tot_inflight++;
+static void unix_update_graph(struct unix_vertex *vertex)
+{
+	/* If the receiver socket is not in flight, no cycle can be formed */
+	if (!vertex)
+		return;
+
+	unix_graph_maybe_cyclic = true;
+	unix_graph_grouped = false;
+}
+
+static LIST_HEAD(unix_unvisited_vertices);
+
+enum unix_vertex_index {
+	UNIX_VERTEX_INDEX_MARK1,
+	UNIX_VERTEX_INDEX_MARK2,
+	UNIX_VERTEX_INDEX_START,
+};
+
+static unsigned long unix_vertex_unvisited_index = UNIX_VERTEX_INDEX_MARK1;
+static unsigned long unix_vertex_max_scc_index = UNIX_VERTEX_INDEX_START;
+
+static void unix_add_edge(struct scm_fp_list *fpl, struct unix_edge *edge)
+{
+	struct unix_vertex *vertex = edge->predecessor->vertex;
+
+	if (!vertex) {
+		vertex = list_first_entry(&fpl->vertices, typeof(*vertex),
+					  entry);
+		vertex->index = unix_vertex_unvisited_index;
+		/* Not grouped yet: can't be in the same SCC as any other */
+		vertex->scc_index = ++unix_vertex_max_scc_index;
+		vertex->out_degree = 0;
+		INIT_LIST_HEAD(&vertex->edges);
+		INIT_LIST_HEAD(&vertex->scc_entry);
+
+		list_move_tail(&vertex->entry, &unix_unvisited_vertices);
+		edge->predecessor->vertex = vertex;
+	}
+
+	vertex->out_degree++;
+	list_add_tail(&edge->vertex_entry, &vertex->edges);
+
+	unix_update_graph(unix_edge_successor(edge));
+}
+
+static void unix_del_edge(struct scm_fp_list *fpl, struct unix_edge *edge)
+{
+	struct unix_vertex *vertex = edge->predecessor->vertex;
+
+	/* The receiver of a collected skb might be gone already */
+	if (!fpl->dead)
+		unix_update_graph(unix_edge_successor(edge));
+
+	list_del(&edge->vertex_entry);
+	vertex->out_degree--;
+
+	if (!vertex->out_degree) {
+		edge->predecessor->vertex = NULL;
+		list_move_tail(&vertex->entry, &fpl->vertices);
+	}
+}
+
+static void unix_free_vertices(struct scm_fp_list *fpl)
+{
+	struct unix_vertex *vertex, *next_vertex;
+
+	list_for_each_entry_safe(vertex, next_vertex, &fpl->vertices, entry) {
+		list_del(&vertex->entry);
+		kfree(vertex);
 	}
-	user->unix_inflight++;
+}
+
+/* Called with the receiver state lock held, as the skb is queued */
+void unix_add_edges(struct scm_fp_list *fpl, struct unix_sock *receiver)
+{
+	int i = 0, j = 0;
+
+	spin_lock(&unix_gc_lock);
+
+	if (!fpl->count_unix)
+		goto out;
+
+	do {
+		struct sock *inflight = unix_get_socket(fpl->fp[j++]);
+		struct unix_edge *edge;
+
+		if (!inflight)
+			continue;
+
+		edge = fpl->edges + i++;
+		edge->predecessor = unix_sk(inflight);
+		edge->successor = receiver;
+
+		unix_add_edge(fpl, edge);
+	} while (i < fpl->count_unix);
+
+	receiver->nr_unix_fds += fpl->count_unix;
+	WRITE_ONCE(unix_tot_inflight, unix_tot_inflight + fpl->count_unix);
+out:
+	WRITE_ONCE(fpl->user->unix_inflight,
+		   fpl->user->unix_inflight + fpl->count);
+
 	spin_unlock(&unix_gc_lock);
+
+	fpl->inflight = true;
+
+	unix_free_vertices(fpl);
 }
 
-void unix_notinflight(struct user_struct *user, struct file *fp)
+static void unix_del_edges(struct scm_fp_list *fpl)
 {
-	struct sock *s = unix_get_socket(fp);
+	struct unix_sock *receiver;
+	int i = 0;
 
 	spin_lock(&unix_gc_lock);
 
-	if (s) {
-		struct unix_sock *u = unix_sk(s);
+	if (!fpl->count_unix)
+		goto out;
+
+	do {
+		struct unix_edge *edge = fpl->edges + i++;
 
-		BUG_ON(!atomic_long_read(&u->inflight));
-		BUG_ON(list_empty(&u->link));
+		unix_del_edge(fpl, edge);
+	} while (i < fpl->count_unix);
 
-		if (atomic_long_dec_and_test(&u->inflight))
-			list_del_init(&u->link);
-		unix_tot_inflight--;
+	if (!fpl->dead) {
+		receiver = fpl->edges[0].successor;
+		receiver->nr_unix_fds -= fpl->count_unix;
 	}
-	user->unix_inflight--;
+	WRITE_ONCE(unix_tot_inflight, unix_tot_inflight - fpl->count_unix);
+out:
+	WRITE_ONCE(fpl->user->unix_inflight,
+		   fpl->user->unix_inflight - fpl->count);
+
 	spin_unlock(&unix_gc_lock);
+
+	fpl->inflight = false;
 }
 
-static void scan_inflight(struct sock *x, void (*func)(struct unix_sock *),
-			  struct sk_buff_head *hitlist)
+/* Called on accept(), with the state lock of the embryo held */
+void unix_update_edges(struct unix_sock *receiver)
 {
-	struct sk_buff *skb;
-	struct sk_buff *next;
-
-	spin_lock(&x->sk_receive_queue.lock);
-	skb_queue_walk_safe(&x->sk_receive_queue, skb, next) {
-		/* Do we have file descriptors ? */
-		if (UNIXCB(skb).fp) {
-			bool hit = false;
-			/* Process the descriptors of this socket */
-			int nfd = UNIXCB(skb).fp->count;
-			struct file **fp = UNIXCB(skb).fp->fp;
-
-			while (nfd--) {
-				/* Get the socket the fd matches if it indeed does so */
-				struct sock *sk = unix_get_socket(*fp++);
-
-				if (sk) {
-					struct unix_sock *u = unix_sk(sk);
-
-					/* Ignore non-candidates, they could
-					 * have been added to the queues after
-					 * starting the garbage collection
-					 */
-					if (test_bit(UNIX_GC_CANDIDATE, &u->gc_flags)) {
-						hit = true;
-
-						func(u);
-					}
-				}
-			}
-			if (hit && hitlist != NULL) {
-				__skb_unlink(skb, &x->sk_receive_queue);
-				__skb_queue_tail(hitlist, skb);
-			}
-		}
+	/* nr_unix_fds is only increased under the receiver state lock: if
+	 * it's zero, the embryo isn't in the graph, no need to lock.
+	 */
+	if (!receiver->nr_unix_fds) {
+		receiver->listener = NULL;
+	} else {
+		spin_lock(&unix_gc_lock);
+		unix_update_graph(unix_sk(receiver->listener)->vertex);
+		receiver->listener = NULL;
+		spin_unlock(&unix_gc_lock);
 	}
-	spin_unlock(&x->sk_receive_queue.lock);
 }
 
-static void scan_children(struct sock *x, void (*func)(struct unix_sock *),
-			  struct sk_buff_head *hitlist)
+/* Allocate vertices and edges for the AF_UNIX descriptors in @fpl upfront,
+ * so that they can be added to the graph without failing, under locks.
+ */
+int unix_prepare_fpl(struct scm_fp_list *fpl)
 {
-	if (x->sk_state != TCP_LISTEN) {
-		scan_inflight(x, func, hitlist);
-	} else {
-		struct sk_buff *skb;
-		struct sk_buff *next;
-		struct unix_sock *u;
-		LIST_HEAD(embryos);
+	struct unix_vertex *vertex;
+	int i;
+
+	fpl->count_unix = 0;
+	fpl->inflight = false;
+	fpl->dead = false;
+	fpl->edges = NULL;
+	INIT_LIST_HEAD(&fpl->vertices);
+
+	for (i = 0; i < fpl->count; i++) {
+		if (unix_get_socket(fpl->fp[i]))
+			fpl->count_unix++;
+	}
 
-		/* For a listening socket collect the queued embryos
-		 * and perform a scan on them as well.
-		 */
-		spin_lock(&x->sk_receive_queue.lock);
-		skb_queue_walk_safe(&x->sk_receive_queue, skb, next) {
-			u = unix_sk(skb->sk);
+	if (!fpl->count_unix)
+		return 0;
 
-			/* An embryo cannot be in-flight, so it's safe
-			 * to use the list link.
-			 */
-			BUG_ON(!list_empty(&u->link));
-			list_add_tail(&u->link, &embryos);
-		}
-		spin_unlock(&x->sk_receive_queue.lock);
+	for (i = 0; i < fpl->count_unix; i++) {
+		vertex = kmalloc(sizeof(*vertex), GFP_KERNEL);
+		if (!vertex)
+			goto err;
 
-		while (!list_empty(&embryos)) {
-			u = list_entry(embryos.next, struct unix_sock, link);
-			scan_inflight(&u->sk, func, hitlist);
-			list_del_init(&u->link);
-		}
+		list_add(&vertex->entry, &fpl->vertices);
 	}
-}
 
-static void dec_inflight(struct unix_sock *usk)
-{
-	atomic_long_dec(&usk->inflight);
+	fpl->edges = kvmalloc_array(fpl->count_unix, sizeof(*fpl->edges),
+				    GFP_KERNEL_ACCOUNT);
+	if (!fpl->edges)
+		goto err;
+
+	return 0;
+
+err:
+	unix_free_vertices(fpl);
+	return -ENOMEM;
 }
 
-static void inc_inflight(struct unix_sock *usk)
+void unix_destroy_fpl(struct scm_fp_list *fpl)
 {
-	atomic_long_inc(&usk->inflight);
+	if (fpl->inflight)
+		unix_del_edges(fpl);
+
+	kvfree(fpl->edges);
+	unix_free_vertices(fpl);
 }
 
-static void inc_inflight_move_tail(struct unix_sock *u)
+static bool unix_vertex_dead(struct unix_vertex *vertex)
 {
-	atomic_long_inc(&u->inflight);
-	/* If this still might be part of a cycle, move it to the end
-	 * of the list, so that it's checked even if it was already
-	 * passed over
+	struct unix_edge *edge;
+	struct unix_sock *u;
+	long total_ref;
+
+	list_for_each_entry(edge, &vertex->edges, vertex_entry) {
+		struct unix_vertex *next_vertex = unix_edge_successor(edge);
+
+		/* The descriptor can be received by a socket not in flight */
+		if (!next_vertex)
+			return false;
+
+		/* ...or by an in-flight socket in another SCC */
+		if (next_vertex->scc_index != vertex->scc_index)
+			return false;
+	}
+
+	/* No receiver exists out of the same SCC: now, is the socket
+	 * referenced by anything but in-flight descriptors?
 	 */
-	if (test_bit(UNIX_GC_MAYBE_CYCLE, &u->gc_flags))
-		list_move_tail(&u->link, &gc_candidates);
+	edge = list_first_entry(&vertex->edges, typeof(*edge), vertex_entry);
+	u = edge->predecessor;
+	total_ref = file_count(u->sk.sk_socket->file);
+
+	return total_ref == vertex->out_degree;
 }
 
-static bool gc_in_progress;
-#define UNIX_INFLIGHT_TRIGGER_GC 16000
+static void unix_collect_skb(struct list_head *scc,
+			     struct sk_buff_head *hitlist)
+{
+	struct unix_vertex *vertex;
+
+	list_for_each_entry_reverse(vertex, scc, scc_entry) {
+		struct sk_buff_head *queue;
+		struct unix_edge *edge;
+		struct unix_sock *u;
+
+		edge = list_first_entry(&vertex->edges, typeof(*edge),
+					vertex_entry);
+		u = edge->predecessor;
+		queue = &u->sk.sk_receive_queue;
+
+		spin_lock(&queue->lock);
+
+		if (u->sk.sk_state == TCP_LISTEN) {
+			struct sk_buff *skb;
+
+			/* Descriptors sent to the embryos, the embryos
+			 * themselves go away with the listener.
+			 */
+			skb_queue_walk(queue, skb) {
+				struct sk_buff_head *embryo_queue;
+
+				embryo_queue = &skb->sk->sk_receive_queue;
+				spin_lock_nested(&embryo_queue->lock,
+						 SINGLE_DEPTH_NESTING);
+				skb_queue_splice_init(embryo_queue, hitlist);
+				spin_unlock(&embryo_queue->lock);
+			}
+		} else {
+			skb_queue_splice_init(queue, hitlist);
+		}
 
-void wait_for_unix_gc(void)
+		spin_unlock(&queue->lock);
+	}
+}
+
+static bool unix_scc_cyclic(struct list_head *scc)
 {
-	/* If number of inflight sockets is insane,
-	 * force a garbage collect right now.
-	 */
-	if (unix_tot_inflight > UNIX_INFLIGHT_TRIGGER_GC && !gc_in_progress)
-		unix_gc();
-	wait_event(unix_gc_wait, gc_in_progress == false);
+	struct unix_vertex *vertex;
+	struct unix_edge *edge;
+
+	/* SCC containing multiple vertices ? */
+	if (!list_is_singular(scc))
+		return true;
+
+	vertex = list_first_entry(scc, typeof(*vertex), scc_entry);
+
+	/* Self-reference or an embryo-listener circle ? */
+	list_for_each_entry(edge, &vertex->edges, vertex_entry) {
+		if (unix_edge_successor(edge) == vertex)
+			return true;
+	}
+
+	return false;
 }
 
-/* The external entry point: unix_gc() */
-void unix_gc(void)
+/* Check a finalised SCC: collect it if it's dead, otherwise note whether
+ * it could become garbage later.
+ */
+static void unix_check_scc(struct list_head *scc,
+			   struct sk_buff_head *hitlist)
 {
-	struct unix_sock *u;
-	struct unix_sock *next;
-	struct sk_buff_head hitlist;
-	struct list_head cursor;
-	LIST_HEAD(not_cycle_list);
+	struct unix_vertex *vertex;
 
-	spin_lock(&unix_gc_lock);
+	list_for_each_entry_reverse(vertex, scc, scc_entry) {
+		if (!unix_vertex_dead(vertex)) {
+			if (!unix_graph_maybe_cyclic)
+				unix_graph_maybe_cyclic = unix_scc_cyclic(scc);
+			return;
+		}
+	}
 
-	/* Avoid a recursive GC. */
-	if (gc_in_progress)
-		goto out;
+	unix_collect_skb(scc, hitlist);
+}
+
+static LIST_HEAD(unix_visited_vertices);
+static unsigned long unix_vertex_grouped_index = UNIX_VERTEX_INDEX_MARK2;
 
-	gc_in_progress = true;
-	/* First, select candidates for garbage collection.  Only
-	 * in-flight sockets are considered, and from those only ones
-	 * which don't have any external reference.
-	 *
-	 * Holding unix_gc_lock will protect these candidates from
-	 * being detached, and hence from gaining an external
-	 * reference.  Since there are no possible receivers, all
-	 * buffers currently on the candidates' queues stay there
-	 * during the garbage collection.
-	 *
-	 * We also know that no new candidate can be added onto the
-	 * receive queues.  Other, non candidate sockets _can_ be
-	 * added to queue, so we must make sure only to touch
-	 * candidates.
+/* Tarjan's algorithm, iterative: the DFS path is kept as a stack of edges,
+ * and scc_index acts as the lowlink.
+ */
+static void __unix_walk_scc(struct unix_vertex *vertex,
+			    unsigned long *last_index,
+			    struct sk_buff_head *hitlist)
+{
+	LIST_HEAD(vertex_stack);
+	struct unix_edge *edge;
+	LIST_HEAD(edge_stack);
+
+next_vertex:
+	/* Push vertex to vertex_stack and mark it as on-stack
+	 * (index >= UNIX_VERTEX_INDEX_START).  It's popped when its SCC
+	 * is finalised.
 	 */
-	list_for_each_entry_safe(u, next, &gc_inflight_list, link) {
-		long total_refs;
-		long inflight_refs;
-
-		total_refs = file_count(u->sk.sk_socket->file);
-		inflight_refs = atomic_long_read(&u->inflight);
-
-		BUG_ON(inflight_refs < 1);
-		BUG_ON(total_refs < inflight_refs);
-		if (total_refs == inflight_refs) {
-			list_move_tail(&u->link, &gc_candidates);
-			__set_bit(UNIX_GC_CANDIDATE, &u->gc_flags);
-			__set_bit(UNIX_GC_MAYBE_CYCLE, &u->gc_flags);
+	list_add(&vertex->scc_entry, &vertex_stack);
+
+	vertex->index = *last_index;
+	vertex->scc_index = *last_index;
+	(*last_index)++;
+
+	/* Explore receivers of the current vertex */
+	list_for_each_entry(edge, &vertex->edges, vertex_entry) {
+		struct unix_vertex *next_vertex = unix_edge_successor(edge);
+
+		if (!next_vertex)
+			continue;
+
+		if (next_vertex->index == unix_vertex_unvisited_index) {
+			/* Forward edge: push it, and descend */
+			list_add(&edge->stack_entry, &edge_stack);
+
+			vertex = next_vertex;
+			goto next_vertex;
+
+			/* Backtrack here: pop the edge that led to the
+			 * current vertex, and restore its predecessor.
+			 */
+prev_vertex:
+			edge = list_first_entry(&edge_stack, typeof(*edge),
+						stack_entry);
+			list_del_init(&edge->stack_entry);
+
+			next_vertex = vertex;
+			vertex = edge->predecessor->vertex;
+
+			vertex->scc_index = min(vertex->scc_index,
+						next_vertex->scc_index);
+		} else if (next_vertex->index != unix_vertex_grouped_index) {
+			/* Back or cross edge to a vertex still on stack:
+			 * both are in the same SCC.
+			 */
+			vertex->scc_index = min(vertex->scc_index,
+						next_vertex->scc_index);
 		}
+		/* else: already grouped in another SCC */
 	}
 
-	/* Now remove all internal in-flight reference to children of
-	 * the candidates.
-	 */
-	list_for_each_entry(u, &gc_candidates, link)
-		scan_children(&u->sk, dec_inflight, NULL);
-
-	/* Restore the references for children of all candidates,
-	 * which have remaining references.  Do this recursively, so
-	 * only those remain, which form cyclic references.
-	 *
-	 * Use a "cursor" link, to make the list traversal safe, even
-	 * though elements might be moved about.
-	 */
-	list_add(&cursor, &gc_candidates);
-	while (cursor.next != &gc_candidates) {
-		u = list_entry(cursor.next, struct unix_sock, link);
+	if (vertex->index == vertex->scc_index) {
+		struct unix_vertex *v;
+		struct list_head scc;
 
-		/* Move cursor to after the current position. */
-		list_move(&cursor, &u->link);
+		/* SCC finalised: all the vertices above on vertex_stack
+		 * belong to it.  Group them using scc_entry, and give them
+		 * the same scc_index, as lowlinks of members can differ.
+		 */
+		__list_cut_position(&scc, &vertex_stack, &vertex->scc_entry);
 
-		if (atomic_long_read(&u->inflight) > 0) {
-			list_move_tail(&u->link, &not_cycle_list);
-			__clear_bit(UNIX_GC_MAYBE_CYCLE, &u->gc_flags);
-			scan_children(&u->sk, inc_inflight_move_tail, NULL);
+		list_for_each_entry_reverse(v, &scc, scc_entry) {
+			/* Don't restart DFS from it in unix_walk_scc() */
+			list_move_tail(&v->entry, &unix_visited_vertices);
+
+			/* Mark vertex as off-stack */
+			v->index = unix_vertex_grouped_index;
+			v->scc_index = vertex->scc_index;
 		}
+
+		unix_check_scc(&scc, hitlist);
+
+		/* Members stay linked together through scc_entry, for
+		 * unix_walk_scc_fast().
+		 */
+		list_del(&scc);
 	}
-	list_del(&cursor);
 
-	/* Now gc_candidates contains only garbage.  Restore original
-	 * inflight counters for these as well, and remove the skbuffs
-	 * which are creating the cycle(s).
-	 */
-	skb_queue_head_init(&hitlist);
-	list_for_each_entry(u, &gc_candidates, link)
-		scan_children(&u->sk, inc_inflight, &hitlist);
+	if (!list_empty(&edge_stack))
+		goto prev_vertex;
+}
 
-	/* not_cycle_list contains those sockets which do not make up a
-	 * cycle.  Restore these to the inflight list.
+static void unix_walk_scc(struct sk_buff_head *hitlist)
+{
+	unsigned long last_index = UNIX_VERTEX_INDEX_START;
+
+	unix_graph_maybe_cyclic = false;
+
+	/* Visit every vertex exactly once: __unix_walk_scc() moves visited
+	 * vertices to unix_visited_vertices.
 	 */
-	while (!list_empty(&not_cycle_list)) {
-		u = list_entry(not_cycle_list.next, struct unix_sock, link);
-		__clear_bit(UNIX_GC_CANDIDATE, &u->gc_flags);
-		list_move_tail(&u->link, &gc_inflight_list);
+	while (!list_empty(&unix_unvisited_vertices)) {
+		struct unix_vertex *vertex;
+
+		vertex = list_first_entry(&unix_unvisited_vertices,
+					  typeof(*vertex), entry);
+		__unix_walk_scc(vertex, &last_index, hitlist);
+	}
+
+	list_replace_init(&unix_visited_vertices, &unix_unvisited_vertices);
+	swap(unix_vertex_unvisited_index, unix_vertex_grouped_index);
+
+	unix_vertex_max_scc_index = last_index;
+	unix_graph_grouped = true;
+}
+
+/* Graph didn't change since the last unix_walk_scc(): reuse its SCCs */
+static void unix_walk_scc_fast(struct sk_buff_head *hitlist)
+{
+	unix_graph_maybe_cyclic = false;
+
+	while (!list_empty(&unix_unvisited_vertices)) {
+		struct unix_vertex *vertex;
+		struct list_head scc;
+
+		vertex = list_first_entry(&unix_unvisited_vertices,
+					  typeof(*vertex), entry);
+		list_add(&scc, &vertex->scc_entry);
+
+		list_for_each_entry_reverse(vertex, &scc, scc_entry)
+			list_move_tail(&vertex->entry, &unix_visited_vertices);
+
+		unix_check_scc(&scc, hitlist);
+
+		list_del(&scc);
+	}
+
+	list_replace_init(&unix_visited_vertices, &unix_unvisited_vertices);
+}
+
+static bool gc_in_progress;
+
+static void __unix_gc(struct work_struct *work)
+{
+	struct sk_buff_head hitlist;
+	struct sk_buff *skb;
+
+	spin_lock(&unix_gc_lock);
+
+	if (!unix_graph_maybe_cyclic) {
+		spin_unlock(&unix_gc_lock);
+		goto skip_gc;
 	}
 
+	__skb_queue_head_init(&hitlist);
+
+	if (unix_graph_grouped)
+		unix_walk_scc_fast(&hitlist);
+	else
+		unix_walk_scc(&hitlist);
+
 	spin_unlock(&unix_gc_lock);
 
+	/* Receivers of these skbs can be released as soon as the first
+	 * descriptors are dropped: don't touch them in unix_del_edges().
+	 */
+	skb_queue_walk(&hitlist, skb) {
+		if (UNIXCB(skb).fp)
+			UNIXCB(skb).fp->dead = true;
+	}
+
 	/* Here we are. Hitlist is filled. Die. */
 	__skb_queue_purge(&hitlist);
+skip_gc:
+	WRITE_ONCE(gc_in_progress, false);
+}
 
-	spin_lock(&unix_gc_lock);
+static DECLARE_WORK(unix_gc_work, __unix_gc);
 
-	/* All candidates should have been detached by now. */
-	BUG_ON(!list_empty(&gc_candidates));
-	gc_in_progress = false;
-	wake_up(&unix_gc_wait);
+/* The external entry point: unix_gc() */
+void unix_gc(void)
+{
+	WRITE_ONCE(gc_in_progress, true);
+	queue_work(system_unbound_wq, &unix_gc_work);
+}
 
- out:
-	spin_unlock(&unix_gc_lock);
+void unix_gc_flush(void)
+{
+	flush_work(&unix_gc_work);
+}
+
+#define UNIX_INFLIGHT_TRIGGER_GC 16000
+#define UNIX_INFLIGHT_SANE_USER (SCM_MAX_FD * 8)
+
+void wait_for_unix_gc(struct scm_fp_list *fpl)
+{
+	/* If number of inflight sockets is insane,
+	 * force a garbage collect right now.
+	 */
+	if (READ_ONCE(unix_tot_inflight) > UNIX_INFLIGHT_TRIGGER_GC &&
+	    !READ_ONCE(gc_in_progress))
+		unix_gc();
+
+	/* Only throttle senders of AF_UNIX sockets with many of them
+	 * still in flight, everybody else just goes ahead.
+	 */
+	if (!fpl || !fpl->count ||
+	    READ_ONCE(fpl->user->unix_inflight) < UNIX_INFLIGHT_SANE_USER)
+		return;
+
+	if (READ_ONCE(gc_in_progress))
+		flush_work(&unix_gc_work);
 }
@@ -91,6 +91,16 @@ int xdp_umem_assign_dev(struct xdp_umem *umem, struct net_device *dev,
 	xdp_reg_umem_at_qid(dev, umem, queue_id);
 	umem->dev = dev;
 	umem->queue_id = queue_id;
+
+	if (flags & XDP_USE_NEED_WAKEUP) {
+		umem->flags |= XDP_UMEM_USES_NEED_WAKEUP;
+		/* Tx needs to be explicitly woken up the first time. This
+		 * also covers copy mode and drivers that never clear the
+		 * flag, which then simply require a sendto() every time.
+		 */
+		umem->need_wakeup = XDP_WAKEUP_TX;
+	}
+
 	if (force_copy)
 		/* For copy-mode, we are done. */
 		goto out_rtnl_unlock;
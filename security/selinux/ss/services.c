@@ -2207,6 +2207,7 @@ int security_load_policy(struct selinux_state *state, void *data, size_t len)
 			" table\n");
 		goto err;
 	}
+	sidtab_rehash(&newsidtab);
 
 	/* Save the old policydb and SID table to free later. */
 	memcpy(oldpolicydb, policydb, sizeof(*policydb));
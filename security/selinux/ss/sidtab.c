@@ -5,6 +5,7 @@
  * Author : Stephen Smalley, <sds@tycho.nsa.gov>
  */
 #include <linux/kernel.h>
+#include <linux/jhash.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/errno.h>
@@ -12,18 +13,32 @@
 #include "security.h"
 #include "sidtab.h"
 
-#define SIDTAB_HASH(sid) \
-(sid & SIDTAB_HASH_MASK)
+static struct sidtab_rev *sidtab_rev_alloc(unsigned int bits)
+{
+	struct sidtab_rev *rev;
+
+	rev = kzalloc(struct_size(rev, buckets, 1U << bits),
+		      GFP_ATOMIC | __GFP_NOWARN);
+	if (rev)
+		rev->bits = bits;
+	return rev;
+}
 
 int sidtab_init(struct sidtab *s)
 {
 	int i;
 
-	s->htable = kmalloc_array(SIDTAB_SIZE, sizeof(*s->htable), GFP_ATOMIC);
-	if (!s->htable)
+	s->root = kzalloc(sizeof(*s->root), GFP_ATOMIC);
+	if (!s->root)
+		return -ENOMEM;
+	s->rev = sidtab_rev_alloc(SIDTAB_REV_BITS_MIN);
+	if (!s->rev) {
+		kfree(s->root);
+		s->root = NULL;
 		return -ENOMEM;
-	for (i = 0; i < SIDTAB_SIZE; i++)
-		s->htable[i] = NULL;
+	}
+	for (i = 0; i < SIDTAB_CACHE_LEN; i++)
+		s->cache[i] = NULL;
 	s->nel = 0;
 	s->next_sid = 1;
 	s->shutdown = 0;
@@ -31,23 +46,114 @@ int sidtab_init(struct sidtab *s)
 	return 0;
 }
 
+/*
+ * The hash of a context covers what context_cmp() compares: the string of
+ * an unmapped context, otherwise the user, role, type and MLS range.
+ */
+static u32 sidtab_context_hash(struct context *c)
+{
+	struct ebitmap_node *node;
+	u32 hash;
+	int i;
+
+	if (c->len)
+		return jhash(c->str, c->len, 0);
+
+	hash = jhash_3words(c->user, c->role, c->type, 0);
+	for (i = 0; i < 2; i++) {
+		hash = jhash_1word(c->range.level[i].sens, hash);
+		for (node = c->range.level[i].cat.node; node; node = node->next)
+			hash = jhash(node->maps, sizeof(node->maps),
+				     hash ^ node->startbit);
+	}
+	return hash;
+}
+
+/*
+ * Return the level 0 slot of @sid, adding the directories down to it if
+ * @alloc, or NULL. Directories are published with a release so that the
+ * lockless walks see them initialized.
+ */
+static void **sidtab_slot(struct sidtab *s, u32 sid, bool alloc)
+{
+	struct sidtab_dir *dir = s->root, *next;
+	void **slot;
+	int level;
+
+	for (level = SIDTAB_LEVELS - 1; level > 0; level--) {
+		slot = &dir->slots[(sid >> (level * SIDTAB_DIR_SHIFT)) &
+				   SIDTAB_DIR_MASK];
+		next = READ_ONCE(*slot);
+		if (!next) {
+			if (!alloc)
+				return NULL;
+			next = kzalloc(sizeof(*next), GFP_ATOMIC);
+			if (!next)
+				return NULL;
+			smp_store_release(slot, next);
+		}
+		dir = next;
+	}
+
+	return &dir->slots[sid & SIDTAB_DIR_MASK];
+}
+
+static struct sidtab_node *sidtab_lookup(struct sidtab *s, u32 sid)
+{
+	void **slot = sidtab_slot(s, sid, false);
+
+	return slot ? READ_ONCE(*slot) : NULL;
+}
+
+/*
+ * Double the buckets of the reverse index once it has as many nodes as
+ * buckets. The nodes are relinked in place: a lockless reader walking a
+ * chain meanwhile may miss its context, which sidtab_context_to_sid()
+ * already handles by searching again under the lock.
+ */
+static void sidtab_rev_grow(struct sidtab *s)
+{
+	struct sidtab_rev *old = s->rev, *new;
+	struct sidtab_node *cur, *next, **bucket;
+	u32 i, mask;
+
+	if (s->nel < (1U << old->bits) || old->bits >= SIDTAB_REV_BITS_MAX)
+		return;
+
+	/* growing is an optimization, do without it under memory pressure */
+	new = sidtab_rev_alloc(old->bits + 1);
+	if (!new)
+		return;
+
+	mask = (1U << new->bits) - 1;
+	for (i = 0; i < (1U << old->bits); i++) {
+		cur = old->buckets[i];
+		while (cur) {
+			next = cur->context_next;
+			bucket = &new->buckets[cur->hash & mask];
+			WRITE_ONCE(cur->context_next, *bucket);
+			*bucket = cur;
+			cur = next;
+		}
+	}
+
+	new->old = old;
+	smp_store_release(&s->rev, new);
+}
+
 int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 {
-	int hvalue;
-	struct sidtab_node *prev, *cur, *newnode;
+	struct sidtab_node *newnode, **bucket;
+	void **slot;
 
 	if (!s)
 		return -ENOMEM;
 
-	hvalue = SIDTAB_HASH(sid);
-	prev = NULL;
-	cur = s->htable[hvalue];
-	while (cur && sid > cur->sid) {
-		prev = cur;
-		cur = cur->next;
-	}
+	slot = sidtab_slot(s, sid, true);
+	if (!slot)
+		return -ENOMEM;
 
-	if (cur && sid == cur->sid)
+	if (*slot)
 		return -EEXIST;
 
 	newnode = kmalloc(sizeof(*newnode), GFP_ATOMIC);
@@ -59,16 +165,14 @@ int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 		kfree(newnode);
 		return -ENOMEM;
 	}
+	newnode->hash = sidtab_context_hash(context);
 
-	if (prev) {
-		newnode->next = prev->next;
-		wmb();
-		prev->next = newnode;
-	} else {
-		newnode->next = s->htable[hvalue];
-		wmb();
-		s->htable[hvalue] = newnode;
-	}
+	sidtab_rev_grow(s);
+
+	bucket = &s->rev->buckets[newnode->hash & ((1U << s->rev->bits) - 1)];
+	newnode->context_next = *bucket;
+	smp_store_release(bucket, newnode);
+	smp_store_release(slot, newnode);
 
 	s->nel++;
 	if (sid >= s->next_sid)
@@ -78,28 +182,20 @@ int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 
 static struct context *sidtab_search_core(struct sidtab *s, u32 sid, int force)
 {
-	int hvalue;
 	struct sidtab_node *cur;
 
 	if (!s)
 		return NULL;
 
-	hvalue = SIDTAB_HASH(sid);
-	cur = s->htable[hvalue];
-	while (cur && sid > cur->sid)
-		cur = cur->next;
+	cur = sidtab_lookup(s, sid);
 
-	if (force && cur && sid == cur->sid && cur->context.len)
+	if (force && cur && cur->context.len)
 		return &cur->context;
 
-	if (!cur || sid != cur->sid || cur->context.len) {
+	if (!cur || cur->context.len) {
 		/* Remap invalid SIDs to the unlabeled SID. */
-		sid = SECINITSID_UNLABELED;
-		hvalue = SIDTAB_HASH(sid);
-		cur = s->htable[hvalue];
-		while (cur && sid > cur->sid)
-			cur = cur->next;
-		if (!cur || sid != cur->sid)
+		cur = sidtab_lookup(s, SECINITSID_UNLABELED);
+		if (!cur)
 			return NULL;
 	}
 
@@ -116,29 +212,63 @@ struct context *sidtab_search_force(struct sidtab *s, u32 sid)
 	return sidtab_search_core(s, sid, 1);
 }
 
+static int sidtab_map_dir(struct sidtab_dir *dir, int level,
+			  int (*apply) (u32 sid,
+					struct context *context,
+					void *args),
+			  void *args)
+{
+	struct sidtab_node *cur;
+	int i, rc = 0;
+
+	for (i = 0; i < SIDTAB_DIR_SIZE && !rc; i++) {
+		if (!dir->slots[i])
+			continue;
+		if (level) {
+			rc = sidtab_map_dir(dir->slots[i], level - 1,
+					    apply, args);
+		} else {
+			cur = dir->slots[i];
+			rc = apply(cur->sid, &cur->context, args);
+		}
+	}
+	return rc;
+}
+
 int sidtab_map(struct sidtab *s,
 	       int (*apply) (u32 sid,
 			     struct context *context,
 			     void *args),
 	       void *args)
 {
-	int i, rc = 0;
-	struct sidtab_node *cur;
+	if (!s || !s->root)
+		return 0;
 
-	if (!s)
-		goto out;
+	return sidtab_map_dir(s->root, SIDTAB_LEVELS - 1, apply, args);
+}
 
-	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = s->htable[i];
-		while (cur) {
-			rc = apply(cur->sid, &cur->context, args);
-			if (rc)
-				goto out;
-			cur = cur->next;
-		}
-	}
-out:
-	return rc;
+static int sidtab_rehash_node(u32 sid, struct context *context, void *args)
+{
+	struct sidtab_rev *rev = args;
+	struct sidtab_node *node, **bucket;
+
+	node = container_of(context, struct sidtab_node, context);
+	node->hash = sidtab_context_hash(context);
+	bucket = &rev->buckets[node->hash & ((1U << rev->bits) - 1)];
+	node->context_next = *bucket;
+	*bucket = node;
+	return 0;
+}
+
+/*
+ * Rebuild the reverse index after the contexts were changed in place, by
+ * sidtab_map(). Only for a sidtab no one else uses yet.
+ */
+void sidtab_rehash(struct sidtab *s)
+{
+	memset(s->rev->buckets, 0,
+	       sizeof(*s->rev->buckets) << s->rev->bits);
+	sidtab_map(s, sidtab_rehash_node, s->rev);
 }
 
 static void sidtab_update_cache(struct sidtab *s, struct sidtab_node *n, int loc)
@@ -153,20 +283,18 @@ static void sidtab_update_cache(struct sidtab *s, struct sidtab_node *n, int loc
 }
 
 static inline u32 sidtab_search_context(struct sidtab *s,
-						  struct context *context)
+					 struct context *context, u32 hash)
 {
-	int i;
+	struct sidtab_rev *rev = smp_load_acquire(&s->rev);
 	struct sidtab_node *cur;
 
-	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = s->htable[i];
-		while (cur) {
-			if (context_cmp(&cur->context, context)) {
-				sidtab_update_cache(s, cur, SIDTAB_CACHE_LEN - 1);
-				return cur->sid;
-			}
-			cur = cur->next;
+	cur = smp_load_acquire(&rev->buckets[hash & ((1U << rev->bits) - 1)]);
+	while (cur) {
+		if (cur->hash == hash && context_cmp(&cur->context, context)) {
+			sidtab_update_cache(s, cur, SIDTAB_CACHE_LEN - 1);
+			return cur->sid;
 		}
+		cur = smp_load_acquire(&cur->context_next);
 	}
 	return 0;
 }
@@ -192,40 +320,44 @@ int sidtab_context_to_sid(struct sidtab *s,
 			  struct context *context,
 			  u32 *out_sid)
 {
-	u32 sid;
+	u32 sid, hash;
 	int ret = 0;
 	unsigned long flags;
 
 	*out_sid = SECSID_NULL;
 
 	sid  = sidtab_search_cache(s, context);
-	if (!sid)
-		sid = sidtab_search_context(s, context);
-	if (!sid) {
-		spin_lock_irqsave(&s->lock, flags);
-		/* Rescan now that we hold the lock. */
-		sid = sidtab_search_context(s, context);
-		if (sid)
-			goto unlock_out;
-		/* No SID exists for the context.  Allocate a new one. */
-		if (s->next_sid == UINT_MAX || s->shutdown) {
-			ret = -ENOMEM;
-			goto unlock_out;
-		}
-		sid = s->next_sid++;
-		if (context->len)
-			pr_info("SELinux:  Context %s is not valid (left unmapped).\n",
-			       context->str);
-		ret = sidtab_insert(s, sid, context);
-		if (ret)
-			s->next_sid--;
-unlock_out:
-		spin_unlock_irqrestore(&s->lock, flags);
+	if (sid)
+		goto out;
+
+	hash = sidtab_context_hash(context);
+	sid = sidtab_search_context(s, context, hash);
+	if (sid)
+		goto out;
+
+	spin_lock_irqsave(&s->lock, flags);
+	/* Rescan now that we hold the lock. */
+	sid = sidtab_search_context(s, context, hash);
+	if (sid)
+		goto unlock_out;
+	/* No SID exists for the context.  Allocate a new one. */
+	if (s->next_sid == UINT_MAX || s->shutdown) {
+		ret = -ENOMEM;
+		goto unlock_out;
 	}
+	sid = s->next_sid++;
+	if (context->len)
+		pr_info("SELinux:  Context %s is not valid (left unmapped).\n",
+		       context->str);
+	ret = sidtab_insert(s, sid, context);
+	if (ret)
+		s->next_sid--;
+unlock_out:
+	spin_unlock_irqrestore(&s->lock, flags);
 
 	if (ret)
 		return ret;
-
+out:
 	*out_sid = sid;
 	return 0;
 }
@@ -237,14 +369,14 @@ void sidtab_hash_eval(struct sidtab *h, char *tag)
 
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = h->htable[i];
+	for (i = 0; i < (1 << h->rev->bits); i++) {
+		cur = h->rev->buckets[i];
 		if (cur) {
 			slots_used++;
 			chain_len = 0;
 			while (cur) {
 				chain_len++;
-				cur = cur->next;
+				cur = cur->context_next;
 			}
 
 			if (chain_len > max_chain_len)
@@ -253,30 +385,44 @@ void sidtab_hash_eval(struct sidtab *h, char *tag)
 	}
 
 	pr_debug("%s:  %d entries and %d/%d buckets used, longest "
-	       "chain length %d\n", tag, h->nel, slots_used, SIDTAB_SIZE,
-	       max_chain_len);
+	       "chain length %d\n", tag, h->nel, slots_used,
+	       1 << h->rev->bits, max_chain_len);
 }
 
-void sidtab_destroy(struct sidtab *s)
+static void sidtab_destroy_dir(struct sidtab_dir *dir, int level)
 {
+	struct sidtab_node *cur;
 	int i;
-	struct sidtab_node *cur, *temp;
+
+	for (i = 0; i < SIDTAB_DIR_SIZE; i++) {
+		if (!dir->slots[i])
+			continue;
+		if (level) {
+			sidtab_destroy_dir(dir->slots[i], level - 1);
+		} else {
+			cur = dir->slots[i];
+			context_destroy(&cur->context);
+			kfree(cur);
+		}
+	}
+	kfree(dir);
+}
+
+void sidtab_destroy(struct sidtab *s)
+{
+	struct sidtab_rev *rev;
 
 	if (!s)
 		return;
 
-	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = s->htable[i];
-		while (cur) {
-			temp = cur;
-			cur = cur->next;
-			context_destroy(&temp->context);
-			kfree(temp);
-		}
-		s->htable[i] = NULL;
+	if (s->root)
+		sidtab_destroy_dir(s->root, SIDTAB_LEVELS - 1);
+	s->root = NULL;
+	while (s->rev) {
+		rev = s->rev;
+		s->rev = rev->old;
+		kfree(rev);
 	}
-	kfree(s->htable);
-	s->htable = NULL;
 	s->nel = 0;
 	s->next_sid = 1;
 }
@@ -287,7 +433,8 @@ void sidtab_set(struct sidtab *dst, struct sidtab *src)
 	int i;
 
 	spin_lock_irqsave(&src->lock, flags);
-	dst->htable = src->htable;
+	dst->root = src->root;
+	dst->rev = src->rev;
 	dst->nel = src->nel;
 	dst->next_sid = src->next_sid;
 	dst->shutdown = 0;
@@ -1,7 +1,8 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 /*
- * A security identifier table (sidtab) is a hash table
- * of security context structures indexed by SID value.
+ * A security identifier table (sidtab) is a table
+ * of security context structures indexed by SID value,
+ * with a reverse index from context to SID.
  *
  * Author : Stephen Smalley, <sds@tycho.nsa.gov>
  */
@@ -12,18 +13,44 @@
 
 struct sidtab_node {
 	u32 sid;		/* security identifier */
+	u32 hash;		/* hash of the context */
 	struct context context;	/* security context structure */
-	struct sidtab_node *next;
+	struct sidtab_node *context_next;	/* in the reverse index */
 };
 
-#define SIDTAB_HASH_BITS 7
-#define SIDTAB_HASH_BUCKETS (1 << SIDTAB_HASH_BITS)
-#define SIDTAB_HASH_MASK (SIDTAB_HASH_BUCKETS-1)
+/*
+ * The nodes are found by SID in a tree of directories, indexed by
+ * SIDTAB_DIR_SHIFT bits of the SID at each of its SIDTAB_LEVELS levels
+ * like a page table. It grows by adding directories, never moves a node,
+ * and is walked without locks.
+ */
+#define SIDTAB_DIR_SHIFT 8
+#define SIDTAB_DIR_SIZE (1 << SIDTAB_DIR_SHIFT)
+#define SIDTAB_DIR_MASK (SIDTAB_DIR_SIZE-1)
+#define SIDTAB_LEVELS (32 / SIDTAB_DIR_SHIFT)
 
-#define SIDTAB_SIZE SIDTAB_HASH_BUCKETS
+struct sidtab_dir {
+	void *slots[SIDTAB_DIR_SIZE];	/* directories, or nodes at level 0 */
+};
+
+/*
+ * The reverse index is a hash table of the nodes by context, which doubles
+ * its buckets as it fills up, up to SIDTAB_REV_BITS_MAX. The bucket arrays
+ * it outgrows are kept until the sidtab is destroyed, as lockless readers
+ * may still be walking them.
+ */
+#define SIDTAB_REV_BITS_MIN 7
+#define SIDTAB_REV_BITS_MAX 14
+
+struct sidtab_rev {
+	struct sidtab_rev *old;	/* the bucket array this one replaced */
+	unsigned int bits;
+	struct sidtab_node *buckets[];
+};
 
 struct sidtab {
-	struct sidtab_node **htable;
+	struct sidtab_dir *root;
+	struct sidtab_rev *rev;
 	unsigned int nel;	/* number of elements */
 	unsigned int next_sid;	/* next SID to allocate */
 	unsigned char shutdown;
@@ -43,6 +70,8 @@ int sidtab_map(struct sidtab *s,
 			     void *args),
 	       void *args);
 
+void sidtab_rehash(struct sidtab *s);
+
 int sidtab_context_to_sid(struct sidtab *s,
 			  struct context *context,
 			  u32 *sid);
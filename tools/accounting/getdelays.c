@@ -205,7 +205,13 @@ static void print_delayacct(struct taskstats *t)
 	       "RECLAIM  %12s%15s%15s\n"
 	       "      %15llu%15llu%15llums\n"
 	       "THRASHING%12s%15s%15s\n"
-	       "      %15llu%15llu%15llums\n",
+	       "      %15llu%15llu%15llums\n"
+	       "COMPACT  %12s%15s%15s\n"
+	       "      %15llu%15llu%15llums\n"
+	       "PAGEWAIT %12s%15s%15s\n"
+	       "      %15llu%15llu%15llums\n"
+	       "MAX   %15s%15s%15s%15s%15s%15s\n"
+	       "      %13llums%13llums%13llums%13llums%13llums%13llums\n",
 	       "count", "real total", "virtual total",
 	       "delay total", "delay average",
 	       (unsigned long long)t->cpu_count,
@@ -228,7 +234,22 @@ static void print_delayacct(struct taskstats *t)
 	       "count", "delay total", "delay average",
 	       (unsigned long long)t->thrashing_count,
 	       (unsigned long long)t->thrashing_delay_total,
-	       average_ms(t->thrashing_delay_total, t->thrashing_count));
+	       average_ms(t->thrashing_delay_total, t->thrashing_count),
+	       "count", "delay total", "delay average",
+	       (unsigned long long)t->compact_count,
+	       (unsigned long long)t->compact_delay_total,
+	       average_ms(t->compact_delay_total, t->compact_count),
+	       "count", "delay total", "delay average",
+	       (unsigned long long)t->pagewait_count,
+	       (unsigned long long)t->pagewait_delay_total,
+	       average_ms(t->pagewait_delay_total, t->pagewait_count),
+	       "io", "swap", "reclaim", "thrashing", "compact", "pagewait",
+	       (unsigned long long)t->blkio_delay_max / 1000000ULL,
+	       (unsigned long long)t->swapin_delay_max / 1000000ULL,
+	       (unsigned long long)t->freepages_delay_max / 1000000ULL,
+	       (unsigned long long)t->thrashing_delay_max / 1000000ULL,
+	       (unsigned long long)t->compact_delay_max / 1000000ULL,
+	       (unsigned long long)t->pagewait_delay_max / 1000000ULL);
 }
 
 static void task_context_switch_counts(struct taskstats *t)
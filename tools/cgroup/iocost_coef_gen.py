@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0
+#
+# Generate linear IO cost model coefficients for blk-iocost.
+#
+# Runs fio against a test file on the filesystem of the target device with
+# the IO scheduler temporarily set to none and prints a line which can be
+# written to io.cost.model in the root cgroup.  Requires fio and root.
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description='''
+Measure the sequential bandwidth and the sequential and random 4k IOPS of a
+block device with fio and print the matching io.cost.model line.
+''')
+parser.add_argument('--testdev', metavar='DEV',
+                    help='Raw block device to use for testing, its contents are destroyed')
+parser.add_argument('--testfile-size-gb', type=float, metavar='GIGABYTES', default=16,
+                    help='Testfile size in gigabytes (default: %(default)s)')
+parser.add_argument('--duration', type=int, metavar='SECONDS', default=120,
+                    help='Individual test run duration in seconds (default: %(default)s)')
+parser.add_argument('--seqio-block-mb', metavar='MEGABYTES', type=int, default=128,
+                    help='Sequential test block size (default: %(default)s)')
+parser.add_argument('--seq-depth', type=int, metavar='DEPTH', default=64,
+                    help='Sequential test queue depth (default: %(default)s)')
+parser.add_argument('--rand-depth', type=int, metavar='DEPTH', default=64,
+                    help='Random test queue depth (default: %(default)s)')
+parser.add_argument('--numjobs', type=int, metavar='JOBS', default=1,
+                    help='Number of parallel fio jobs to run (default: %(default)s)')
+parser.add_argument('--quiet', action='store_true')
+parser.add_argument('--verbose', action='store_true')
+
+def info(msg):
+    if not args.quiet:
+        print(msg, file=sys.stderr)
+
+def dbg(msg):
+    if args.verbose and not args.quiet:
+        print(msg, file=sys.stderr)
+
+def dev_to_devno(path):
+    st = os.stat(path)
+    if not os.path.isdir(path) and not os.path.isfile(path):
+        return os.major(st.st_rdev), os.minor(st.st_rdev)
+    return os.major(st.st_dev), os.minor(st.st_dev)
+
+def devno_to_sysfs(devno):
+    # partitions point to their parent disk for the queue attributes
+    path = os.path.realpath('/sys/dev/block/%d:%d' % devno)
+    if not os.path.exists(os.path.join(path, 'queue')):
+        path = os.path.dirname(path)
+    return path
+
+def read_sysfs(path):
+    with open(path, 'r') as f:
+        return f.read().strip()
+
+def write_sysfs(path, val):
+    with open(path, 'w') as f:
+        f.write(val)
+
+def cur_sched(sched_path):
+    m = re.search(r'\[(\S+)\]', read_sysfs(sched_path))
+    return m.group(1) if m else None
+
+def run_fio(testfile, duration, iotype, iodepth, blocksize, jobs):
+    cmd = ['fio', '--direct=1', '--ioengine=libaio', '--name=coef',
+           '--filename=' + testfile, '--runtime=%d' % duration,
+           '--readwrite=' + iotype, '--iodepth=%d' % iodepth,
+           '--blocksize=' + blocksize, '--eta=never',
+           '--numjobs=%d' % jobs, '--group_reporting',
+           '--output-format=json', '--time_based']
+    if not args.testdev:
+        cmd.append('--size=%dM' % int(args.testfile_size_gb * 1024))
+    dbg('Running ' + ' '.join(cmd))
+    out = subprocess.run(cmd, stdout=subprocess.PIPE, check=True).stdout
+    job = json.loads(out)['jobs'][0]
+    rw = 'read' if 'read' in iotype else 'write'
+    return job[rw]['bw_bytes'], job[rw]['iops']
+
+def measure(testfile):
+    seq_bs = '%dm' % args.seqio_block_mb
+    res = {}
+    for pfx, rw in (('r', 'read'), ('w', 'write')):
+        info('Measuring %s bps...' % rw)
+        res[pfx + 'bps'], _ = run_fio(testfile, args.duration, rw,
+                                      args.seq_depth, seq_bs, args.numjobs)
+        info('Measuring %s seqiops...' % rw)
+        _, res[pfx + 'seqiops'] = run_fio(testfile, args.duration, rw,
+                                          args.seq_depth, '4k', args.numjobs)
+        info('Measuring %s randiops...' % rw)
+        _, res[pfx + 'randiops'] = run_fio(testfile, args.duration, 'rand' + rw,
+                                           args.rand_depth, '4k', args.numjobs)
+    return res
+
+args = parser.parse_args()
+
+if args.testdev:
+    testfile = args.testdev
+    devno = dev_to_devno(testfile)
+    tmpdir = None
+else:
+    tmpdir = tempfile.TemporaryDirectory(prefix='iocost-coef-', dir=os.getcwd())
+    testfile = os.path.join(tmpdir.name, 'testfile')
+    devno = dev_to_devno(tmpdir.name)
+
+sysfs = devno_to_sysfs(devno)
+sched_path = os.path.join(sysfs, 'queue', 'scheduler')
+disk_devno = read_sysfs(os.path.join(sysfs, 'dev'))
+old_sched = cur_sched(sched_path)
+
+info('Test target: %s (%d:%d)' % ((testfile,) + devno))
+if old_sched != 'none':
+    info('Temporarily disabling the IO scheduler %s' % old_sched)
+    write_sysfs(sched_path, 'none')
+
+try:
+    res = measure(testfile)
+finally:
+    if old_sched and old_sched != 'none':
+        write_sysfs(sched_path, old_sched)
+    if tmpdir:
+        tmpdir.cleanup()
+
+# io.cost.model is per disk, not per partition
+print('%s rbps=%d rseqiops=%d rrandiops=%d wbps=%d wseqiops=%d wrandiops=%d' %
+      ((disk_devno,) + tuple(round(res[k]) for k in
+                             ('rbps', 'rseqiops', 'rrandiops',
+                              'wbps', 'wseqiops', 'wrandiops'))))
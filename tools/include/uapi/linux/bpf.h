@@ -178,6 +178,7 @@ enum bpf_attach_type {
 	BPF_CGROUP_UDP6_SENDMSG,
 	BPF_LIRC_MODE2,
 	BPF_FLOW_DISSECTOR,
+	BPF_XDP_DEVMAP,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -232,6 +233,13 @@ enum bpf_attach_type {
  */
 #define BPF_F_STRICT_ALIGNMENT	(1U << 0)
 
+/* If BPF_F_XDP_HAS_FRAGS is used in BPF_PROG_LOAD command, the XDP
+ * program declares that it can handle multi-buffer packets, i.e. it
+ * does not assume that data_end marks the end of the packet and uses
+ * the frags aware helpers to reach the rest of it.
+ */
+#define BPF_F_XDP_HAS_FRAGS	(1U << 1)
+
 /* when bpf_ldimm64->src_reg == BPF_PSEUDO_MAP_FD, bpf_ldimm64->imm == fd */
 #define BPF_PSEUDO_MAP_FD	1
 
@@ -1488,8 +1496,12 @@ union bpf_attr {
  * 		but this is only implemented for native XDP (with driver
  * 		support) as of this writing).
  *
- * 		All values for *flags* are reserved for future usage, and must
- * 		be left at zero.
+ * 		With a **BPF_MAP_TYPE_DEVMAP**, **BPF_F_BROADCAST** may be
+ * 		passed in *flags* to send a copy of the packet to every
+ * 		device in *map*, ignoring *key*. **BPF_F_EXCLUDE_INGRESS**
+ * 		can be added to leave out the device the packet came in on.
+ * 		All other values for *flags* are reserved for future usage,
+ * 		and must be left at zero.
  *
  * 		When used to redirect packets to net devices, this helper
  * 		provides a high performance increase over **bpf_redirect**\ ().
@@ -2265,6 +2277,65 @@ union bpf_attr {
  *
  *	Return
  *		0 on success, or a negative error in case of failure.
+ *
+ * u64 bpf_xdp_get_buff_len(struct xdp_buff *xdp_md)
+ *	Description
+ *		Get the total size of the packet described by *xdp_md*,
+ *		including the fragments of a multi-buffer packet.
+ *	Return
+ *		The length of the packet.
+ *
+ * int bpf_xdp_load_bytes(struct xdp_buff *xdp_md, u32 offset, void *buf, u32 len)
+ *	Description
+ *		This helper is provided as an easy way to load data from a
+ *		xdp buffer. It can be used to load *len* bytes from *offset*
+ *		from the frame associated to *xdp_md*, into the buffer
+ *		pointed by *buf*. Unlike direct packet access, it can reach
+ *		the data held in the fragments of a multi-buffer packet.
+ *	Return
+ *		0 on success, or a negative error in case of failure.
+ *
+ * int bpf_xdp_store_bytes(struct xdp_buff *xdp_md, u32 offset, void *buf, u32 len)
+ *	Description
+ *		Store *len* bytes from buffer *buf* into the frame
+ *		associated to *xdp_md*, at *offset*. Unlike direct packet
+ *		access, it can reach the data held in the fragments of a
+ *		multi-buffer packet.
+ *	Return
+ *		0 on success, or a negative error in case of failure.
+ *
+ * int bpf_xdp_metadata_rx_timestamp(struct xdp_buff *xdp_md, u64 *timestamp, u32 size)
+ *	Description
+ *		Read the hardware receive timestamp of the packet described
+ *		by *xdp_md*, as reported by the driver, into *timestamp*.
+ *		*size* must be **sizeof**\ (*u64*).
+ *	Return
+ *		0 on success, or a negative error in case of failure. In
+ *		particular **-EOPNOTSUPP** if the driver does not implement
+ *		it and **-ENODATA** if no timestamp is available for this
+ *		packet. On failure *timestamp* is zeroed.
+ *
+ * int bpf_xdp_metadata_rx_hash(struct xdp_buff *xdp_md, struct bpf_xdp_rx_hash *hash, u32 size)
+ *	Description
+ *		Read the receive hash the device computed for the packet
+ *		described by *xdp_md*, along with the headers it covered
+ *		(one of the **XDP_RSS_TYPE_\*** values), into *hash*.
+ *		*size* must be **sizeof**\ (**struct bpf_xdp_rx_hash**).
+ *
+ *		This saves the program from recomputing a flow hash the
+ *		hardware already provides.
+ *	Return
+ *		0 on success, or a negative error in case of failure, see
+ *		**bpf_xdp_metadata_rx_timestamp**\ ().
+ *
+ * int bpf_xdp_metadata_rx_vlan_tag(struct xdp_buff *xdp_md, struct bpf_xdp_rx_vlan *vlan, u32 size)
+ *	Description
+ *		Read the VLAN tag the device stripped from the packet
+ *		described by *xdp_md* into *vlan*. *size* must be
+ *		**sizeof**\ (**struct bpf_xdp_rx_vlan**).
+ *	Return
+ *		0 on success, or a negative error in case of failure, see
+ *		**bpf_xdp_metadata_rx_timestamp**\ ().
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -2357,7 +2428,13 @@ union bpf_attr {
 	FN(map_push_elem),		\
 	FN(map_pop_elem),		\
 	FN(map_peek_elem),		\
-	FN(msg_push_data),
+	FN(msg_push_data),		\
+	FN(xdp_get_buff_len),		\
+	FN(xdp_load_bytes),		\
+	FN(xdp_store_bytes),		\
+	FN(xdp_metadata_rx_timestamp),	\
+	FN(xdp_metadata_rx_hash),	\
+	FN(xdp_metadata_rx_vlan_tag),
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
  * function eBPF program intends to call
@@ -2388,6 +2465,10 @@ enum bpf_func_id {
 /* BPF_FUNC_clone_redirect and BPF_FUNC_redirect flags. */
 #define BPF_F_INGRESS			(1ULL << 0)
 
+/* BPF_FUNC_redirect_map flags. */
+#define BPF_F_BROADCAST			(1ULL << 0)
+#define BPF_F_EXCLUDE_INGRESS		(1ULL << 1)
+
 /* BPF_FUNC_skb_set_tunnel_key and BPF_FUNC_skb_get_tunnel_key flags. */
 #define BPF_F_TUNINFO_IPV6		(1ULL << 0)
 
@@ -2578,6 +2659,76 @@ struct xdp_md {
 	/* Below access go through struct xdp_rxq_info */
 	__u32 ingress_ifindex; /* rxq->dev->ifindex */
 	__u32 rx_queue_index;  /* rxq->queue_index  */
+
+	__u32 egress_ifindex;  /* txq->dev->ifindex */
+};
+
+/* DEVMAP map-value layout
+ *
+ * The struct data-layout of map-value is a configuration interface.
+ * New members can only be added to the end of this structure.
+ */
+struct bpf_devmap_val {
+	__u32 ifindex;   /* device index */
+	union {
+		int   fd;  /* prog fd on map write */
+		__u32 id;  /* prog id on map read */
+	} bpf_prog;
+};
+
+/* Headers covered by the hash returned from bpf_xdp_metadata_rx_hash() */
+enum xdp_rss_hash_type {
+	/* First part: individual bits for L3/L4 types */
+	XDP_RSS_L3_IPV4		= 1U << 0,
+	XDP_RSS_L3_IPV6		= 1U << 1,
+	/* The fixed (L3) IPv4 and IPv6 headers can both be followed by
+	 * variable/dynamic headers, IPv4 called Options and IPv6 called
+	 * Extension Headers. HW RSS type can contain this info.
+	 */
+	XDP_RSS_L3_DYNHDR	= 1U << 2,
+	/* When RSS hash covers L4 then drivers MUST set XDP_RSS_L4 bit in
+	 * addition to the protocol specific bit.
+	 */
+	XDP_RSS_L4		= 1U << 3,
+	XDP_RSS_L4_TCP		= 1U << 4,
+	XDP_RSS_L4_UDP		= 1U << 5,
+	XDP_RSS_L4_SCTP		= 1U << 6,
+	XDP_RSS_L4_IPSEC	= 1U << 7,
+
+	/* Second part: RSS hash type combinations used for driver HW
+	 * mapping
+	 */
+	XDP_RSS_TYPE_NONE	= 0,
+	XDP_RSS_TYPE_L2		= XDP_RSS_TYPE_NONE,
+
+	XDP_RSS_TYPE_L3_IPV4	= XDP_RSS_L3_IPV4,
+	XDP_RSS_TYPE_L3_IPV6	= XDP_RSS_L3_IPV6,
+	XDP_RSS_TYPE_L3_IPV4_OPT = XDP_RSS_L3_IPV4 | XDP_RSS_L3_DYNHDR,
+	XDP_RSS_TYPE_L3_IPV6_EX	= XDP_RSS_L3_IPV6 | XDP_RSS_L3_DYNHDR,
+
+	XDP_RSS_TYPE_L4_ANY	= XDP_RSS_L4,
+	XDP_RSS_TYPE_L4_IPV4_TCP = XDP_RSS_L3_IPV4 | XDP_RSS_L4 |
+				   XDP_RSS_L4_TCP,
+	XDP_RSS_TYPE_L4_IPV4_UDP = XDP_RSS_L3_IPV4 | XDP_RSS_L4 |
+				   XDP_RSS_L4_UDP,
+	XDP_RSS_TYPE_L4_IPV4_SCTP = XDP_RSS_L3_IPV4 | XDP_RSS_L4 |
+				    XDP_RSS_L4_SCTP,
+	XDP_RSS_TYPE_L4_IPV6_TCP = XDP_RSS_L3_IPV6 | XDP_RSS_L4 |
+				   XDP_RSS_L4_TCP,
+	XDP_RSS_TYPE_L4_IPV6_UDP = XDP_RSS_L3_IPV6 | XDP_RSS_L4 |
+				   XDP_RSS_L4_UDP,
+	XDP_RSS_TYPE_L4_IPV6_SCTP = XDP_RSS_L3_IPV6 | XDP_RSS_L4 |
+				    XDP_RSS_L4_SCTP,
+};
+
+struct bpf_xdp_rx_hash {
+	__u32 hash;
+	__u32 rss_type;	/* enum xdp_rss_hash_type */
+};
+
+struct bpf_xdp_rx_vlan {
+	__be16 vlan_proto;
+	__u16 vlan_tci;	/* PCP, DEI and VID */
 };
 
 enum sk_action {
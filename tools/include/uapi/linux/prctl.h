@@ -220,4 +220,8 @@ struct prctl_mm_map {
 # define PR_SPEC_DISABLE		(1UL << 2)
 # define PR_SPEC_FORCE_DISABLE		(1UL << 3)
 
+/* Let KSM merge all the anonymous memory of the process */
+#define PR_SET_MEMORY_MERGE		54
+#define PR_GET_MEMORY_MERGE		55
+
 #endif /* _LINUX_PRCTL_H */
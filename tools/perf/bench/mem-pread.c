@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * mem-pread.c
+ *
+ * pread: Benchmark for buffered reads copied to user space with and
+ *        without RWF_NOCACHE_COPY
+ *
+ * A file is read from the page cache in large chunks, and between chunks
+ * a working set standing for a co-located service is walked.  The read
+ * throughput is reported along with the cost of walking the working set,
+ * in time and in cache misses, which goes up as the copies evict it.
+ */
+#include "debug.h"
+#include "../perf.h"
+#include "../util/util.h"
+#include <subcmd/parse-options.h>
+#include "../util/cloexec.h"
+#include "../util/string2.h"
+#include "bench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/time64.h>
+
+#ifndef RWF_NOCACHE_COPY
+#define RWF_NOCACHE_COPY	0x00000040
+#endif
+
+#define CACHELINE		64
+
+static const char	*file_size_str	= "256MB";
+static const char	*read_size_str	= "1MB";
+static const char	*ws_size_str	= "4MB";
+static int		nr_loops	= 4;
+
+static const struct option options[] = {
+	OPT_STRING('t', "total", &file_size_str, "256MB",
+		    "Specify the size of the file read. "
+		    "Available units: B, KB, MB, GB and TB (case insensitive)"),
+	OPT_STRING('s', "size", &read_size_str, "1MB",
+		    "Specify the size of each read"),
+	OPT_STRING('w', "working-set", &ws_size_str, "4MB",
+		    "Specify the size of the working set walked between reads"),
+	OPT_INTEGER('l', "nr_loops", &nr_loops,
+		    "Specify the number of passes over the file. (default: 4)"),
+	OPT_END()
+};
+
+static const char * const bench_mem_pread_usage[] = {
+	"perf bench mem pread <options>",
+	NULL
+};
+
+struct pread_result {
+	double		read_bps;
+	double		walk_ns;
+	u64		walk_misses;
+	bool		have_misses;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int open_cache_misses(void)
+{
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_HARDWARE,
+		.config		= PERF_COUNT_HW_CACHE_MISSES,
+		.size		= sizeof(attr),
+	};
+
+	return sys_perf_event_open(&attr, getpid(), -1, -1,
+				   perf_event_open_cloexec_flag());
+}
+
+static u64 read_counter(int fd)
+{
+	u64 val = 0;
+
+	if (fd >= 0 && read(fd, &val, sizeof(val)) != sizeof(val))
+		val = 0;
+	return val;
+}
+
+static ssize_t do_preadv2(int fd, const struct iovec *iov, off_t off,
+			  int flags)
+{
+	return syscall(__NR_preadv2, fd, iov, 1, (long)off, 0L, flags);
+}
+
+static u64 walk_working_set(volatile char *ws, size_t size)
+{
+	u64 sum = 0;
+	size_t i;
+
+	for (i = 0; i < size; i += CACHELINE)
+		sum += ws[i];
+	return sum;
+}
+
+static int run_pread(int fd, size_t file_size, size_t read_size,
+		     char *buf, char *ws, size_t ws_size, int flags,
+		     struct pread_result *res)
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = read_size };
+	u64 read_ns = 0, walk_ns = 0, misses = 0, walks = 0, t;
+	int misses_fd = open_cache_misses();
+	off_t off;
+	int loop;
+
+	/* Start with the working set hot, as a running service has it */
+	walk_working_set(ws, ws_size);
+
+	for (loop = 0; loop < nr_loops; loop++) {
+		for (off = 0; off < (off_t)file_size; off += read_size) {
+			ssize_t ret;
+			u64 m;
+
+			t = now_ns();
+			ret = do_preadv2(fd, &iov, off, flags);
+			read_ns += now_ns() - t;
+			if (ret < 0) {
+				if (misses_fd >= 0)
+					close(misses_fd);
+				return -errno;
+			}
+
+			m = read_counter(misses_fd);
+			t = now_ns();
+			walk_working_set(ws, ws_size);
+			walk_ns += now_ns() - t;
+			misses += read_counter(misses_fd) - m;
+			walks++;
+		}
+	}
+
+	res->read_bps = (double)file_size * nr_loops * NSEC_PER_SEC /
+			(read_ns ?: 1);
+	res->walk_ns = (double)walk_ns / (walks ?: 1);
+	res->walk_misses = misses / (walks ?: 1);
+	res->have_misses = misses_fd >= 0;
+
+	if (misses_fd >= 0)
+		close(misses_fd);
+	return 0;
+}
+
+static void print_result(const char *name, struct pread_result *res)
+{
+	if (bench_format == BENCH_FORMAT_SIMPLE) {
+		printf("%s %lf %lf %" PRIu64 "\n", name, res->read_bps,
+		       res->walk_ns, res->have_misses ? res->walk_misses : 0);
+		return;
+	}
+
+	printf("# %s\n", name);
+	printf(" %14lf MB/sec read\n", res->read_bps / 1024 / 1024);
+	printf(" %14lf usecs per working set walk\n", res->walk_ns / 1000);
+	if (res->have_misses)
+		printf(" %14" PRIu64 " cache misses per working set walk\n",
+		       res->walk_misses);
+	printf("\n");
+}
+
+static int prepare_file(size_t file_size, char *buf, size_t read_size)
+{
+	char path[] = "/tmp/perf-bench-pread.XXXXXX";
+	size_t done;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return -1;
+	unlink(path);
+
+	memset(buf, 0x5a, read_size);
+	for (done = 0; done < file_size; done += read_size) {
+		if (write(fd, buf, read_size) != (ssize_t)read_size) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+int bench_mem_pread(int argc, const char **argv)
+{
+	struct pread_result cached, nocache;
+	size_t file_size, read_size, ws_size;
+	char *buf = NULL, *ws = NULL;
+	int fd, ret;
+
+	argc = parse_options(argc, argv, options, bench_mem_pread_usage, 0);
+
+	file_size = (size_t)perf_atoll((char *)file_size_str);
+	read_size = (size_t)perf_atoll((char *)read_size_str);
+	ws_size = (size_t)perf_atoll((char *)ws_size_str);
+	if ((s64)file_size <= 0 || (s64)read_size <= 0 || (s64)ws_size <= 0 ||
+	    read_size > file_size) {
+		fprintf(stderr, "Invalid size\n");
+		return 1;
+	}
+	/* Whole reads only, so every pass copies the same amount */
+	file_size -= file_size % read_size;
+
+	buf = malloc(read_size);
+	ws = malloc(ws_size);
+	if (!buf || !ws) {
+		fprintf(stderr, "Memory allocation failed\n");
+		ret = 1;
+		goto out;
+	}
+	memset(ws, 1, ws_size);
+
+	fd = prepare_file(file_size, buf, read_size);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to create the file: %s\n",
+			strerror(errno));
+		ret = 1;
+		goto out;
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Reading %s in %s chunks, %d times, with a %s working set\n\n",
+		       file_size_str, read_size_str, nr_loops, ws_size_str);
+
+	/* A first pass brings the file into the page cache */
+	ret = run_pread(fd, file_size, read_size, buf, ws, ws_size, 0,
+			&cached);
+	if (!ret)
+		ret = run_pread(fd, file_size, read_size, buf, ws, ws_size, 0,
+				&cached);
+	if (ret) {
+		fprintf(stderr, "preadv2 failed: %s\n", strerror(-ret));
+		ret = 1;
+		goto out_close;
+	}
+	print_result("cached copy", &cached);
+
+	ret = run_pread(fd, file_size, read_size, buf, ws, ws_size,
+			RWF_NOCACHE_COPY, &nocache);
+	if (ret == -EOPNOTSUPP) {
+		printf("# RWF_NOCACHE_COPY is not supported by this kernel\n");
+		ret = 0;
+		goto out_close;
+	}
+	if (ret) {
+		fprintf(stderr, "preadv2 failed: %s\n", strerror(-ret));
+		ret = 1;
+		goto out_close;
+	}
+	print_result("non-temporal copy", &nocache);
+	ret = 0;
+
+out_close:
+	close(fd);
+out:
+	free(buf);
+	free(ws);
+	return ret;
+}
@@ -0,0 +1,778 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * trace-overhead.c
+ *
+ * overhead: Benchmark for the per-event cost of the tracing mechanisms
+ * reader:   Benchmark for the consumption of the ring buffer by readers
+ *
+ * Both drive the tracing infrastructure through tracefs, so they need to be
+ * run as root with tracefs mounted, and leave the tracing setup as they
+ * found it only as long as nothing else uses it concurrently.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include <api/fs/tracing_path.h>
+#include "../builtin.h"
+#include "bench.h"
+#include "cpumap.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/time64.h>
+
+#define LOOPS_DEFAULT		100000
+#define THREADS_MAX		4096
+
+static unsigned int loops = LOOPS_DEFAULT;
+static const char *threads_str;
+static const char *modes_str;
+static unsigned int nsecs = 5;
+static unsigned int buffer_kb;
+
+static unsigned int nr_threads_list[THREADS_MAX];
+static unsigned int nr_threads_nr;
+static struct cpu_map *cpus;
+
+static const struct option overhead_options[] = {
+	OPT_UINTEGER('l', "loop",	&loops,		"Specify number of events per thread"),
+	OPT_STRING('t', "threads",	&threads_str,	"n[,n...]",
+		   "Specify the thread counts to run with (default: 1 and all CPUs)"),
+	OPT_STRING('m', "modes",	&modes_str,	"mode[,mode...]",
+		   "Specify the tracing modes to measure (default: all)"),
+	OPT_END()
+};
+
+static const char * const bench_trace_overhead_usage[] = {
+	"perf bench trace overhead <options>",
+	NULL
+};
+
+static const struct option reader_options[] = {
+	OPT_UINTEGER('r', "runtime",	&nsecs,		"Specify runtime (in seconds)"),
+	OPT_STRING('t', "threads",	&threads_str,	"n[,n...]",
+		   "Specify the writer thread counts to run with (default: 1 and all CPUs)"),
+	OPT_UINTEGER('b', "buffer-size", &buffer_kb,	"Specify the per-CPU buffer size in KB"),
+	OPT_END()
+};
+
+static const char * const bench_trace_reader_usage[] = {
+	"perf bench trace reader <options>",
+	NULL
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int tracing_write(const char *name, const char *val, bool append)
+{
+	char *file = get_tracing_file(name);
+	int fd, ret = 0;
+	size_t len = strlen(val);
+
+	if (!file)
+		return -ENOMEM;
+
+	fd = open(file, O_WRONLY | (append ? O_APPEND : O_TRUNC));
+	put_tracing_file(file);
+	if (fd < 0)
+		return -errno;
+
+	if (write(fd, val, len) != (ssize_t)len)
+		ret = -errno;
+
+	close(fd);
+	return ret;
+}
+
+/*
+ * The entry point of getppid(), the syscall the events are generated with,
+ * has a name depending on the architecture and on the syscall wrappers.
+ */
+static char syscall_sym[128];
+
+static int find_syscall_sym(void)
+{
+	static const char * const candidates[] = {
+		"__x64_sys_getppid",
+		"__arm64_sys_getppid",
+		"__s390x_sys_getppid",
+		"sys_getppid",
+	};
+	unsigned int best = ARRAY_SIZE(candidates), i;
+	char line[256], name[128];
+	FILE *fp;
+
+	fp = fopen("/proc/kallsyms", "r");
+	if (!fp)
+		return -errno;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%*s %*c %127s", name) != 1)
+			continue;
+		for (i = 0; i < best; i++) {
+			if (!strcmp(name, candidates[i])) {
+				best = i;
+				break;
+			}
+		}
+	}
+	fclose(fp);
+
+	if (best == ARRAY_SIZE(candidates))
+		return -ENOENT;
+
+	strcpy(syscall_sym, candidates[best]);
+	return 0;
+}
+
+/* The function a uprobe is placed on, the workload of the uprobe mode. */
+static noinline void bench_trace_uprobe_target(void)
+{
+	asm volatile("" ::: "memory");
+}
+
+static int uprobe_target_location(char *buf, size_t size)
+{
+	unsigned long addr = (unsigned long)bench_trace_uprobe_target;
+	unsigned long start, end, off;
+	char line[PATH_MAX + 128], path[PATH_MAX];
+	int ret = -ENOENT;
+	FILE *fp;
+
+	fp = fopen("/proc/self/maps", "r");
+	if (!fp)
+		return -errno;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%lx-%lx %*s %lx %*s %*s %s",
+			   &start, &end, &off, path) != 4)
+			continue;
+		if (addr < start || addr >= end)
+			continue;
+		snprintf(buf, size, "%s:0x%lx", path, addr - start + off);
+		ret = 0;
+		break;
+	}
+	fclose(fp);
+
+	return ret;
+}
+
+static void workload_getppid(void)
+{
+	getppid();
+}
+
+static int marker_fd = -1;
+
+static void workload_marker(void)
+{
+	int __maybe_unused ret;
+
+	ret = write(marker_fd, "perf bench trace\n", 17);
+}
+
+static void workload_uprobe(void)
+{
+	bench_trace_uprobe_target();
+}
+
+/*
+ * A tracing mode attaches one mechanism to the workload, the cost of which
+ * is the difference of the time a workload iteration takes with and
+ * without it.
+ */
+struct trace_mode {
+	const char	*name;
+	const char	*summary;
+	int		(*setup)(void);
+	void		(*teardown)(void);
+	void		(*workload)(void);
+	/* attached to the entry of getppid(), found in kallsyms */
+	bool		needs_sym;
+};
+
+static int setup_none(void)
+{
+	return 0;
+}
+
+static void teardown_none(void)
+{
+}
+
+static int setup_tracepoint(void)
+{
+	return tracing_write("events/syscalls/sys_enter_getppid/enable", "1",
+			     false);
+}
+
+static void teardown_tracepoint(void)
+{
+	tracing_write("events/syscalls/sys_enter_getppid/enable", "0", false);
+}
+
+static int setup_kprobe(void)
+{
+	char buf[256];
+	int ret;
+
+	snprintf(buf, sizeof(buf), "p:perf_bench/getppid %s\n", syscall_sym);
+	ret = tracing_write("kprobe_events", buf, true);
+	if (ret)
+		return ret;
+
+	return tracing_write("events/perf_bench/getppid/enable", "1", false);
+}
+
+static void teardown_kprobe(void)
+{
+	tracing_write("events/perf_bench/getppid/enable", "0", false);
+	tracing_write("kprobe_events", "-:perf_bench/getppid\n", true);
+}
+
+static int setup_uprobe(void)
+{
+	char loc[PATH_MAX + 32], buf[PATH_MAX + 64];
+	int ret;
+
+	ret = uprobe_target_location(loc, sizeof(loc));
+	if (ret)
+		return ret;
+
+	snprintf(buf, sizeof(buf), "p:perf_bench/target %s\n", loc);
+	ret = tracing_write("uprobe_events", buf, true);
+	if (ret)
+		return ret;
+
+	return tracing_write("events/perf_bench/target/enable", "1", false);
+}
+
+static void teardown_uprobe(void)
+{
+	tracing_write("events/perf_bench/target/enable", "0", false);
+	tracing_write("uprobe_events", "-:perf_bench/target\n", true);
+}
+
+static int setup_tracer(const char *tracer)
+{
+	int ret;
+
+	ret = tracing_write("set_ftrace_filter", syscall_sym, false);
+	if (ret)
+		return ret;
+
+	return tracing_write("current_tracer", tracer, false);
+}
+
+static void teardown_tracer(void)
+{
+	tracing_write("current_tracer", "nop", false);
+	tracing_write("set_ftrace_filter", "", false);
+}
+
+static int setup_function(void)
+{
+	return setup_tracer("function");
+}
+
+static int setup_function_graph(void)
+{
+	return setup_tracer("function_graph");
+}
+
+static struct trace_mode trace_modes[] = {
+	{ "none",		"No tracing, the baseline",
+	  setup_none,		teardown_none,		workload_getppid,	false },
+	{ "tracepoint",		"The syscalls:sys_enter_getppid tracepoint",
+	  setup_tracepoint,	teardown_tracepoint,	workload_getppid,	false },
+	{ "marker",		"Writes to trace_marker, as trace_printk() from user space",
+	  setup_none,		teardown_none,		workload_marker,	false },
+	{ "kprobe",		"A kprobe event on the getppid() entry",
+	  setup_kprobe,		teardown_kprobe,	workload_getppid,	true },
+	{ "uprobe",		"A uprobe event on a function of perf",
+	  setup_uprobe,		teardown_uprobe,	workload_uprobe,	false },
+	{ "function",		"The function tracer on the getppid() entry",
+	  setup_function,	teardown_tracer,	workload_getppid,	true },
+	{ "function_graph",	"The function_graph tracer on the getppid() entry",
+	  setup_function_graph,	teardown_tracer,	workload_getppid,	true },
+	{ NULL,			NULL,	NULL,	NULL,	NULL,	false }
+};
+
+static bool mode_selected(const char *name)
+{
+	const char *p = modes_str;
+	size_t len = strlen(name);
+
+	if (!p)
+		return true;
+
+	while (p && *p) {
+		if (!strncmp(p, name, len) && (p[len] == ',' || !p[len]))
+			return true;
+		p = strchr(p, ',');
+		if (p)
+			p++;
+	}
+
+	return false;
+}
+
+static int parse_threads(void)
+{
+	const char *p = threads_str;
+	char *end;
+	unsigned long n;
+
+	nr_threads_nr = 0;
+
+	if (!p) {
+		nr_threads_list[nr_threads_nr++] = 1;
+		if (cpus->nr > 1)
+			nr_threads_list[nr_threads_nr++] = cpus->nr;
+		return 0;
+	}
+
+	while (*p) {
+		n = strtoul(p, &end, 10);
+		if (end == p || !n || n > THREADS_MAX ||
+		    nr_threads_nr == THREADS_MAX)
+			return -EINVAL;
+		nr_threads_list[nr_threads_nr++] = n;
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -EINVAL;
+		p = end;
+	}
+
+	return nr_threads_nr ? 0 : -EINVAL;
+}
+
+struct worker {
+	pthread_t	thread;
+	int		cpu;
+	void		(*workload)(void);
+	u64		ops;
+	u64		runtime_ns;
+};
+
+static pthread_barrier_t start_barrier;
+static volatile bool done, readers_done;
+
+static void *overhead_worker(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int i;
+	u64 start;
+
+	pthread_barrier_wait(&start_barrier);
+
+	start = now_ns();
+	for (i = 0; i < loops; i++)
+		w->workload();
+	w->runtime_ns = now_ns() - start;
+	w->ops = loops;
+
+	return NULL;
+}
+
+static void *writer_worker(void *arg)
+{
+	struct worker *w = arg;
+	u64 start;
+
+	pthread_barrier_wait(&start_barrier);
+
+	start = now_ns();
+	while (!done) {
+		w->workload();
+		w->ops++;
+	}
+	w->runtime_ns = now_ns() - start;
+
+	return NULL;
+}
+
+static void start_workers(struct worker *workers, unsigned int nr,
+			  void *(*fn)(void *))
+{
+	pthread_attr_t thread_attr;
+	cpu_set_t cpuset;
+	unsigned int i;
+
+	pthread_attr_init(&thread_attr);
+
+	for (i = 0; i < nr; i++) {
+		workers[i].cpu = cpus->map[i % cpus->nr];
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(workers[i].cpu, &cpuset);
+		if (pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpuset))
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		if (pthread_create(&workers[i].thread, &thread_attr, fn, &workers[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	pthread_attr_destroy(&thread_attr);
+}
+
+static void join_workers(struct worker *workers, unsigned int nr)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		if (pthread_join(workers[i].thread, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+	}
+}
+
+/* Returns the average time of an iteration of the workload, in nsecs. */
+static double run_overhead(void (*workload)(void), unsigned int nr)
+{
+	struct worker *workers;
+	u64 ops = 0, runtime_ns = 0;
+	unsigned int i;
+
+	workers = calloc(nr, sizeof(*workers));
+	if (!workers)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < nr; i++)
+		workers[i].workload = workload;
+
+	pthread_barrier_init(&start_barrier, NULL, nr);
+	start_workers(workers, nr, overhead_worker);
+	join_workers(workers, nr);
+	pthread_barrier_destroy(&start_barrier);
+
+	for (i = 0; i < nr; i++) {
+		ops += workers[i].ops;
+		runtime_ns += workers[i].runtime_ns;
+	}
+	free(workers);
+
+	return ops ? (double)runtime_ns / ops : 0;
+}
+
+static void measure(struct stats *stats, void (*workload)(void),
+		    unsigned int nr)
+{
+	unsigned int i;
+
+	init_stats(stats);
+	for (i = 0; i < bench_repeat; i++)
+		update_stats(stats, run_overhead(workload, nr));
+}
+
+static void bench_init(void)
+{
+	cpus = cpu_map__new(NULL);
+	if (!cpus)
+		err(EXIT_FAILURE, "cpu_map__new");
+
+	if (parse_threads())
+		errx(EXIT_FAILURE, "Invalid thread counts: '%s'", threads_str);
+
+	if (!tracing_path_mount())
+		errx(EXIT_FAILURE, "tracefs is not mounted");
+
+	if (tracing_write("tracing_on", "1", false))
+		errx(EXIT_FAILURE, "Cannot write to tracefs, are you root?");
+}
+
+int bench_trace_overhead(int argc, const char **argv)
+{
+	struct trace_mode *mode;
+	struct stats base, traced;
+	unsigned int t;
+	char *file;
+	int ret;
+
+	argc = parse_options(argc, argv, overhead_options,
+			     bench_trace_overhead_usage, 0);
+	if (argc) {
+		usage_with_options(bench_trace_overhead_usage, overhead_options);
+		exit(EXIT_FAILURE);
+	}
+
+	bench_init();
+
+	if (find_syscall_sym())
+		fprintf(stderr, "Cannot find the getppid() entry in /proc/kallsyms\n");
+
+	file = get_tracing_file("trace_marker");
+	if (file) {
+		marker_fd = open(file, O_WRONLY);
+		put_tracing_file(file);
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT) {
+		printf("# %u events per thread, %u runs per measurement\n",
+		       loops, bench_repeat);
+		for (mode = trace_modes; mode->name; mode++) {
+			if (mode_selected(mode->name))
+				printf("#  %-16s %s\n", mode->name, mode->summary);
+		}
+		printf("\n# %-16s %8s %14s %14s %14s\n", "mode", "threads",
+		       "base ns/op", "traced ns/op", "cost ns/event");
+	} else
+		printf("mode,threads,base_ns,base_stddev_pct,traced_ns,traced_stddev_pct,cost_ns\n");
+
+	for (mode = trace_modes; mode->name; mode++) {
+		if (!mode_selected(mode->name))
+			continue;
+
+		for (t = 0; t < nr_threads_nr; t++) {
+			unsigned int nr = nr_threads_list[t];
+
+			if (mode->needs_sym && !syscall_sym[0])
+				goto skip;
+
+			if (mode->workload == workload_marker) {
+				if (marker_fd < 0)
+					goto skip;
+				/* the marker writes are not recorded while off */
+				tracing_write("tracing_on", "0", false);
+				measure(&base, mode->workload, nr);
+				tracing_write("tracing_on", "1", false);
+			} else {
+				measure(&base, mode->workload, nr);
+			}
+
+			ret = mode->setup();
+			if (ret) {
+				mode->teardown();
+				goto skip;
+			}
+			measure(&traced, mode->workload, nr);
+			mode->teardown();
+
+			if (bench_format == BENCH_FORMAT_DEFAULT)
+				printf("  %-16s %8u %14.1f %14.1f %14.1f\n",
+				       mode->name, nr, avg_stats(&base),
+				       avg_stats(&traced),
+				       avg_stats(&traced) - avg_stats(&base));
+			else
+				printf("%s,%u,%.1f,%.2f,%.1f,%.2f,%.1f\n",
+				       mode->name, nr, avg_stats(&base),
+				       rel_stddev_stats(stddev_stats(&base), avg_stats(&base)),
+				       avg_stats(&traced),
+				       rel_stddev_stats(stddev_stats(&traced), avg_stats(&traced)),
+				       avg_stats(&traced) - avg_stats(&base));
+			continue;
+skip:
+			if (bench_format == BENCH_FORMAT_DEFAULT)
+				printf("  %-16s %8u %14s\n", mode->name, nr,
+				       "unsupported");
+			break;
+		}
+	}
+
+	if (marker_fd >= 0)
+		close(marker_fd);
+	cpu_map__put(cpus);
+
+	return 0;
+}
+
+struct reader {
+	pthread_t	thread;
+	int		cpu;
+	int		fd;
+	u64		bytes;
+	u64		pages;
+};
+
+/*
+ * Readers consume the binary pages of their CPU buffer the way the
+ * per-CPU readers of perf and trace-cmd do, polling while it is empty.
+ */
+static void *reader_fn(void *arg)
+{
+	struct reader *r = arg;
+	size_t size = sysconf(_SC_PAGESIZE);
+	char *page = malloc(size);
+	ssize_t n;
+
+	if (!page)
+		err(EXIT_FAILURE, "malloc");
+
+	for (;;) {
+		n = read(r->fd, page, size);
+		if (n > 0) {
+			r->bytes += n;
+			r->pages++;
+			continue;
+		}
+		if (n < 0 && errno != EAGAIN && errno != EINTR)
+			break;
+		/* the writers are stopped before the last drain */
+		if (readers_done)
+			break;
+		usleep(100);
+	}
+
+	free(page);
+	return NULL;
+}
+
+/* The events overwritten before being read, from per_cpu/cpuN/stats. */
+static u64 cpu_overrun(int cpu)
+{
+	char name[64], line[128], *file;
+	unsigned long long val;
+	u64 overrun = 0;
+	FILE *fp;
+
+	snprintf(name, sizeof(name), "per_cpu/cpu%d/stats", cpu);
+	file = get_tracing_file(name);
+	if (!file)
+		return 0;
+
+	fp = fopen(file, "r");
+	put_tracing_file(file);
+	if (!fp)
+		return 0;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "overrun: %llu", &val) == 1 ||
+		    sscanf(line, "dropped events: %llu", &val) == 1)
+			overrun += val;
+	}
+	fclose(fp);
+
+	return overrun;
+}
+
+static void run_reader(unsigned int nr)
+{
+	struct worker *writers;
+	struct reader *readers;
+	unsigned int i, nr_readers = min(nr, (unsigned int)cpus->nr);
+	u64 events = 0, bytes = 0, pages = 0, lost = 0, runtime_ns = 0;
+	double secs;
+	char name[64], *file;
+
+	writers = calloc(nr, sizeof(*writers));
+	readers = calloc(nr_readers, sizeof(*readers));
+	if (!writers || !readers)
+		err(EXIT_FAILURE, "calloc");
+
+	tracing_write("trace", "", false);
+
+	for (i = 0; i < nr_readers; i++) {
+		readers[i].cpu = cpus->map[i];
+		snprintf(name, sizeof(name), "per_cpu/cpu%d/trace_pipe_raw",
+			 readers[i].cpu);
+		file = get_tracing_file(name);
+		if (!file)
+			err(EXIT_FAILURE, "get_tracing_file");
+		readers[i].fd = open(file, O_RDONLY | O_NONBLOCK);
+		put_tracing_file(file);
+		if (readers[i].fd < 0)
+			err(EXIT_FAILURE, "open %s", name);
+	}
+
+	for (i = 0; i < nr; i++)
+		writers[i].workload = workload_getppid;
+
+	done = false;
+	readers_done = false;
+	for (i = 0; i < nr_readers; i++) {
+		if (pthread_create(&readers[i].thread, NULL, reader_fn, &readers[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	if (setup_tracepoint())
+		errx(EXIT_FAILURE, "Cannot enable syscalls:sys_enter_getppid");
+
+	pthread_barrier_init(&start_barrier, NULL, nr);
+	start_workers(writers, nr, writer_worker);
+	sleep(nsecs);
+	done = true;
+	join_workers(writers, nr);
+	pthread_barrier_destroy(&start_barrier);
+
+	teardown_tracepoint();
+	readers_done = true;
+
+	for (i = 0; i < nr_readers; i++) {
+		pthread_join(readers[i].thread, NULL);
+		close(readers[i].fd);
+		bytes += readers[i].bytes;
+		pages += readers[i].pages;
+		lost += cpu_overrun(readers[i].cpu);
+	}
+
+	for (i = 0; i < nr; i++) {
+		events += writers[i].ops;
+		runtime_ns = max(runtime_ns, writers[i].runtime_ns);
+	}
+	secs = (double)runtime_ns / NSEC_PER_SEC;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("  %8u %14.0f %14.0f %14.1f %14" PRIu64 "\n", nr,
+		       events / secs, pages / secs,
+		       bytes / secs / (1024 * 1024), lost);
+	else
+		printf("%u,%.0f,%.0f,%.0f,%" PRIu64 "\n", nr, events / secs,
+		       pages / secs, bytes / secs, lost);
+
+	free(readers);
+	free(writers);
+}
+
+int bench_trace_reader(int argc, const char **argv)
+{
+	char buf[32];
+	unsigned int t;
+
+	argc = parse_options(argc, argv, reader_options,
+			     bench_trace_reader_usage, 0);
+	if (argc) {
+		usage_with_options(bench_trace_reader_usage, reader_options);
+		exit(EXIT_FAILURE);
+	}
+
+	bench_init();
+
+	if (buffer_kb) {
+		snprintf(buf, sizeof(buf), "%u", buffer_kb);
+		if (tracing_write("buffer_size_kb", buf, false))
+			errx(EXIT_FAILURE, "Cannot set the buffer size");
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# syscalls:sys_enter_getppid events for %u secs, one reader per CPU\n\n"
+		       "# %8s %14s %14s %14s %14s\n", nsecs, "writers",
+		       "events/sec", "pages/sec", "MB/sec", "lost events");
+	else
+		printf("writers,events_per_sec,pages_per_sec,bytes_per_sec,lost_events\n");
+
+	for (t = 0; t < nr_threads_nr; t++)
+		run_reader(nr_threads_list[t]);
+
+	cpu_map__put(cpus);
+
+	return 0;
+}
@@ -11,6 +11,8 @@
 #include "util/symbol.h"
 #include "util/thread.h"
 #include "util/header.h"
+#include "util/callchain.h"
+#include "util/map.h"
 
 #include <subcmd/parse-options.h>
 #include "util/trace-event.h"
@@ -62,6 +64,9 @@ struct lock_stat {
 	unsigned int		nr_readlock;
 	unsigned int		nr_trylock;
 
+	/* LCB_F_* flags of lock:contention_begin, for perf lock contention */
+	unsigned int		flags;
+
 	/* these times are in nano sec. */
 	u64                     avg_wait_time;
 	u64			wait_time_total;
@@ -108,6 +113,9 @@ struct lock_seq_stat {
 	void                    *addr;
 
 	int                     read_count;
+
+	/* where a lock:contention_begin..end wait is accounted */
+	struct lock_stat	*ls;
 };
 
 struct thread_stat {
@@ -358,6 +366,12 @@ struct trace_lock_handler {
 
 	int (*release_event)(struct perf_evsel *evsel,
 			     struct perf_sample *sample);
+
+	int (*contention_begin_event)(struct perf_evsel *evsel,
+				      struct perf_sample *sample);
+
+	int (*contention_end_event)(struct perf_evsel *evsel,
+				    struct perf_sample *sample);
 };
 
 static struct lock_seq_stat *get_seq(struct thread_stat *ts, void *addr)
@@ -645,6 +659,188 @@ static int report_lock_release_event(struct perf_evsel *evsel,
 	return 0;
 }
 
+/* flags of lock:contention_begin, from include/trace/events/lock.h */
+#define LCB_F_SPIN	(1U << 0)
+#define LCB_F_READ	(1U << 1)
+#define LCB_F_WRITE	(1U << 2)
+#define LCB_F_RT	(1U << 3)
+#define LCB_F_PERCPU	(1U << 4)
+#define LCB_F_MUTEX	(1U << 5)
+
+/*
+ * The first entries of the callchain of lock:contention_begin are in the
+ * lock code itself, the caller is looked for past them.
+ */
+#define CONTENTION_STACK_SKIP	3
+#define CONTENTION_STACK_DEPTH	8
+
+static u64 sched_text_start, sched_text_end;
+static u64 lock_text_start, lock_text_end;
+static bool lock_text_init;
+
+static u64 kernel_symbol_addr(struct machine *machine, const char *name)
+{
+	struct symbol *sym;
+	struct map *kmap;
+
+	sym = machine__find_kernel_symbol_by_name(machine, name, &kmap);
+	if (!sym)
+		return 0;
+
+	return kmap->unmap_ip(kmap, sym->start);
+}
+
+static bool is_lock_function(struct machine *machine, u64 addr)
+{
+	if (!lock_text_init) {
+		sched_text_start = kernel_symbol_addr(machine,
+						      "__sched_text_start");
+		sched_text_end = kernel_symbol_addr(machine,
+						    "__sched_text_end");
+		lock_text_start = kernel_symbol_addr(machine,
+						     "__lock_text_start");
+		lock_text_end = kernel_symbol_addr(machine,
+						   "__lock_text_end");
+		lock_text_init = true;
+	}
+
+	/* mutex and rwsem functions are in the sched text section */
+	if (sched_text_start <= addr && addr < sched_text_end)
+		return true;
+
+	/* spinlock functions are in the lock text section */
+	if (lock_text_start <= addr && addr < lock_text_end)
+		return true;
+
+	return false;
+}
+
+/*
+ * Find the function which waited for the lock in the callchain of @sample,
+ * return its address in @key and its name in @buf.
+ */
+static int lock_contention_caller(struct perf_evsel *evsel,
+				  struct perf_sample *sample,
+				  u64 *key, char *buf, int size)
+{
+	struct machine *machine = &session->machines.host;
+	struct callchain_cursor *cursor = &callchain_cursor;
+	struct callchain_cursor_node *node;
+	struct thread *thread;
+	int skip = 0;
+	int ret;
+
+	if (!sample->callchain)
+		return -1;
+
+	thread = machine__findnew_thread(machine, sample->pid, sample->tid);
+	if (thread == NULL)
+		return -1;
+
+	ret = thread__resolve_callchain(thread, cursor, evsel, sample,
+					NULL, NULL, CONTENTION_STACK_DEPTH);
+	thread__put(thread);
+	if (ret)
+		return -1;
+
+	callchain_cursor_commit(cursor);
+	while ((node = callchain_cursor_current(cursor)) != NULL) {
+		if (++skip > CONTENTION_STACK_SKIP && node->sym &&
+		    !is_lock_function(machine, node->ip)) {
+			*key = node->ip;
+			scnprintf(buf, size, "%s+%#" PRIx64, node->sym->name,
+				  node->map->map_ip(node->map, node->ip) -
+				  node->sym->start);
+			return 0;
+		}
+		callchain_cursor_advance(cursor);
+	}
+
+	return -1;
+}
+
+static int report_lock_contention_begin_event(struct perf_evsel *evsel,
+					      struct perf_sample *sample)
+{
+	void *addr, *key_addr;
+	struct lock_stat *ls;
+	struct thread_stat *ts;
+	struct lock_seq_stat *seq;
+	u64 tmp = perf_evsel__intval(evsel, sample, "lock_addr");
+	unsigned int flags = perf_evsel__intval(evsel, sample, "flags");
+	u64 key = tmp;
+	char name[128];
+
+	memcpy(&addr, &tmp, sizeof(void *));
+
+	ts = thread_stat_findnew(sample->tid);
+	if (!ts)
+		return -ENOMEM;
+
+	seq = get_seq(ts, addr);
+	if (!seq)
+		return -ENOMEM;
+
+	/* e.g. a mutex waiter going from spinning to sleeping */
+	if (seq->state == SEQ_STATE_CONTENDED)
+		return 0;
+
+	/* without a callchain, account the wait to the lock instance */
+	if (lock_contention_caller(evsel, sample, &key, name, sizeof(name)))
+		scnprintf(name, sizeof(name), "%p", addr);
+	memcpy(&key_addr, &key, sizeof(void *));
+
+	ls = lock_stat_findnew(key_addr, name);
+	if (!ls)
+		return -ENOMEM;
+	ls->flags = flags;
+
+	seq->state = SEQ_STATE_CONTENDED;
+	seq->prev_event_time = sample->time;
+	seq->ls = ls;
+	return 0;
+}
+
+static int report_lock_contention_end_event(struct perf_evsel *evsel,
+					    struct perf_sample *sample)
+{
+	void *addr;
+	struct lock_stat *ls;
+	struct thread_stat *ts;
+	struct lock_seq_stat *seq;
+	u64 contended_term;
+	u64 tmp = perf_evsel__intval(evsel, sample, "lock_addr");
+
+	memcpy(&addr, &tmp, sizeof(void *));
+
+	ts = thread_stat_findnew(sample->tid);
+	if (!ts)
+		return -ENOMEM;
+
+	seq = get_seq(ts, addr);
+	if (!seq)
+		return -ENOMEM;
+
+	/* an orphan event, the wait began before recording did */
+	if (seq->state != SEQ_STATE_CONTENDED)
+		goto free_seq;
+
+	ls = seq->ls;
+	contended_term = sample->time - seq->prev_event_time;
+	ls->nr_contended++;
+	ls->wait_time_total += contended_term;
+	if (contended_term < ls->wait_time_min)
+		ls->wait_time_min = contended_term;
+	if (ls->wait_time_max < contended_term)
+		ls->wait_time_max = contended_term;
+	ls->avg_wait_time = ls->wait_time_total/ls->nr_contended;
+
+free_seq:
+	list_del(&seq->list);
+	free(seq);
+	return 0;
+}
+
 /* lock oriented handlers */
 /* TODO: handlers for CPU oriented, thread oriented */
 static struct trace_lock_handler report_lock_ops  = {
@@ -654,6 +850,12 @@ static struct trace_lock_handler report_lock_ops  = {
 	.release_event		= report_lock_release_event,
 };
 
+/* caller oriented handlers, for the lock:contention_* events */
+static struct trace_lock_handler contention_lock_ops  = {
+	.contention_begin_event	= report_lock_contention_begin_event,
+	.contention_end_event	= report_lock_contention_end_event,
+};
+
 static struct trace_lock_handler *trace_handler;
 
 static int perf_evsel__process_lock_acquire(struct perf_evsel *evsel,
@@ -688,6 +890,22 @@ static int perf_evsel__process_lock_release(struct perf_evsel *evsel,
 	return 0;
 }
 
+static int perf_evsel__process_contention_begin(struct perf_evsel *evsel,
+						struct perf_sample *sample)
+{
+	if (trace_handler->contention_begin_event)
+		return trace_handler->contention_begin_event(evsel, sample);
+	return 0;
+}
+
+static int perf_evsel__process_contention_end(struct perf_evsel *evsel,
+					      struct perf_sample *sample)
+{
+	if (trace_handler->contention_end_event)
+		return trace_handler->contention_end_event(evsel, sample);
+	return 0;
+}
+
 static void print_bad_events(int bad, int total)
 {
 	/* Output for debug, this have to be removed */
@@ -757,6 +975,57 @@ static void print_result(void)
 	print_bad_events(bad, total);
 }
 
+static const char *get_type_str(unsigned int flags)
+{
+	switch (flags & ~LCB_F_SPIN) {
+	case 0:
+		return "spinlock";
+	case LCB_F_READ:
+		return flags & LCB_F_SPIN ? "rwlock:R" : "rwsem:R";
+	case LCB_F_WRITE:
+		return flags & LCB_F_SPIN ? "rwlock:W" : "rwsem:W";
+	case LCB_F_RT:
+		return "rtmutex";
+	case LCB_F_PERCPU | LCB_F_READ:
+		return "pcpu-sem:R";
+	case LCB_F_PERCPU | LCB_F_WRITE:
+		return "pcpu-sem:W";
+	case LCB_F_MUTEX:
+		return "mutex";
+	default:
+		break;
+	}
+
+	return "unknown";
+}
+
+static void print_contention_result(void)
+{
+	struct lock_stat *st;
+
+	pr_info("%10s ", "contended");
+	pr_info("%15s ", "total wait (ns)");
+	pr_info("%15s ", "max wait (ns)");
+	pr_info("%15s ", "avg wait (ns)");
+	pr_info("%10s ", "type");
+	pr_info("  %s", "caller");
+
+	pr_info("\n\n");
+
+	while ((st = pop_from_result())) {
+		/* a wait which did not end while recording */
+		if (!st->nr_contended)
+			continue;
+
+		pr_info("%10u ", st->nr_contended);
+		pr_info("%15" PRIu64 " ", st->wait_time_total);
+		pr_info("%15" PRIu64 " ", st->wait_time_max);
+		pr_info("%15" PRIu64 " ", st->avg_wait_time);
+		pr_info("%10s ", get_type_str(st->flags));
+		pr_info("  %s\n", st->name);
+	}
+}
+
 static bool info_threads, info_map;
 
 static void dump_threads(void)
@@ -854,7 +1123,13 @@ static const struct perf_evsel_str_handler lock_tracepoints[] = {
 	{ "lock:lock_release",	 perf_evsel__process_lock_release,   }, /* CONFIG_LOCKDEP */
 };
 
+static const struct perf_evsel_str_handler contention_tracepoints[] = {
+	{ "lock:contention_begin", perf_evsel__process_contention_begin, },
+	{ "lock:contention_end",   perf_evsel__process_contention_end,   },
+};
+
 static bool force;
+static bool show_contention;
 
 static int __cmd_report(bool display_info)
 {
@@ -862,6 +1137,8 @@ static int __cmd_report(bool display_info)
 	struct perf_tool eops = {
 		.sample		 = process_sample_event,
 		.comm		 = perf_event__process_comm,
+		.mmap		 = perf_event__process_mmap,
+		.mmap2		 = perf_event__process_mmap2,
 		.namespaces	 = perf_event__process_namespaces,
 		.ordered_events	 = true,
 	};
@@ -884,7 +1161,9 @@ static int __cmd_report(bool display_info)
 	if (!perf_session__has_traces(session, "lock record"))
 		goto out_delete;
 
-	if (perf_session__set_tracepoints_handlers(session, lock_tracepoints)) {
+	if (perf_session__set_tracepoints_handlers(session, lock_tracepoints) ||
+	    perf_session__set_tracepoints_handlers(session,
+						   contention_tracepoints)) {
 		pr_err("Initializing perf session tracepoint handlers failed\n");
 		goto out_delete;
 	}
@@ -901,7 +1180,10 @@ static int __cmd_report(bool display_info)
 		err = dump_info();
 	else {
 		sort_result();
-		print_result();
+		if (show_contention)
+			print_contention_result();
+		else
+			print_result();
 	}
 
 out_delete:
@@ -914,21 +1196,38 @@ static int __cmd_record(int argc, const char **argv)
 	const char *record_args[] = {
 		"record", "-R", "-m", "1024", "-c", "1",
 	};
+	/* the callchains give the callers for perf lock contention */
+	const char *callgraph_args[] = {
+		"--call-graph", "fp",
+	};
+	const struct perf_evsel_str_handler *tracepoints = lock_tracepoints;
+	unsigned int nr_tracepoints = ARRAY_SIZE(lock_tracepoints);
+	unsigned int nr_callgraph_args = 0;
 	unsigned int rec_argc, i, j, ret;
 	const char **rec_argv;
 
 	for (i = 0; i < ARRAY_SIZE(lock_tracepoints); i++) {
 		if (!is_valid_tracepoint(lock_tracepoints[i].name)) {
+			/* fall back to the contention events */
+			tracepoints = contention_tracepoints;
+			nr_tracepoints = ARRAY_SIZE(contention_tracepoints);
+			nr_callgraph_args = ARRAY_SIZE(callgraph_args);
+			break;
+		}
+	}
+
+	for (i = 0; i < nr_tracepoints; i++) {
+		if (!is_valid_tracepoint(tracepoints[i].name)) {
 				pr_err("tracepoint %s is not enabled. "
 				       "Are CONFIG_LOCKDEP and CONFIG_LOCK_STAT enabled?\n",
-				       lock_tracepoints[i].name);
+				       tracepoints[i].name);
 				return 1;
 		}
 	}
 
-	rec_argc = ARRAY_SIZE(record_args) + argc - 1;
+	rec_argc = ARRAY_SIZE(record_args) + nr_callgraph_args + argc - 1;
 	/* factor of 2 is for -e in front of each tracepoint */
-	rec_argc += 2 * ARRAY_SIZE(lock_tracepoints);
+	rec_argc += 2 * nr_tracepoints;
 
 	rec_argv = calloc(rec_argc + 1, sizeof(char *));
 	if (!rec_argv)
@@ -937,11 +1236,14 @@ static int __cmd_record(int argc, const char **argv)
 	for (i = 0; i < ARRAY_SIZE(record_args); i++)
 		rec_argv[i] = strdup(record_args[i]);
 
-	for (j = 0; j < ARRAY_SIZE(lock_tracepoints); j++) {
+	for (j = 0; j < nr_tracepoints; j++) {
 		rec_argv[i++] = "-e";
-		rec_argv[i++] = strdup(lock_tracepoints[j].name);
+		rec_argv[i++] = strdup(tracepoints[j].name);
 	}
 
+	for (j = 0; j < nr_callgraph_args; j++, i++)
+		rec_argv[i] = callgraph_args[j];
+
 	for (j = 1; j < (unsigned int)argc; j++, i++)
 		rec_argv[i] = argv[j];
 
@@ -977,12 +1279,18 @@ int cmd_lock(int argc, const char **argv)
 	OPT_PARENT(lock_options)
 	};
 
+	const struct option contention_options[] = {
+	OPT_STRING('k', "key", &sort_key, "wait_total",
+		    "key for sorting (contended / wait_total / wait_max / wait_min / avg_wait)"),
+	OPT_PARENT(lock_options)
+	};
+
 	const char * const info_usage[] = {
 		"perf lock info [<options>]",
 		NULL
 	};
 	const char *const lock_subcommands[] = { "record", "report", "script",
-						 "info", NULL };
+						 "info", "contention", NULL };
 	const char *lock_usage[] = {
 		NULL,
 		NULL
@@ -991,6 +1299,10 @@ int cmd_lock(int argc, const char **argv)
 		"perf lock report [<options>]",
 		NULL
 	};
+	const char * const contention_usage[] = {
+		"perf lock contention [<options>]",
+		NULL
+	};
 	unsigned int i;
 	int rc = 0;
 
@@ -1026,6 +1338,18 @@ int cmd_lock(int argc, const char **argv)
 		/* recycling report_lock_ops */
 		trace_handler = &report_lock_ops;
 		rc = __cmd_report(true);
+	} else if (!strcmp(argv[0], "contention")) {
+		trace_handler = &contention_lock_ops;
+		show_contention = true;
+		sort_key = "wait_total";
+		if (argc) {
+			argc = parse_options(argc, argv, contention_options,
+					     contention_usage, 0);
+			if (argc)
+				usage_with_options(contention_usage,
+						   contention_options);
+		}
+		rc = __cmd_report(false);
 	} else {
 		usage_with_options(lock_usage, lock_options);
 	}
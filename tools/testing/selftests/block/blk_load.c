@@ -0,0 +1,379 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Block device load generator for the null_blk benchmarks.
+ *
+ * Runs one thread per CPU in the list, each keeping a fixed number of
+ * O_DIRECT reads or writes in flight through its own io_uring, and prints
+ * the aggregate IOPS, bandwidth and completion latency as a single JSON
+ * object on stdout.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+
+#include "../kselftest.h"
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup	296
+#define __NR_io_uring_enter	297
+#endif
+
+#define read_barrier()	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define write_barrier()	__atomic_thread_fence(__ATOMIC_RELEASE)
+
+/* log2 latency buckets in ns, enough for ~500s */
+#define NR_LAT_BUCKETS	40
+#define MAX_CPUS	1024
+
+struct ring {
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+struct worker {
+	pthread_t thread;
+	int cpu;
+	unsigned int seed;
+	unsigned long long ios;
+	unsigned long long errors;
+	unsigned long long lat_sum;
+	unsigned long long lat[NR_LAT_BUCKETS];
+};
+
+static const char *dev_path;
+static unsigned int depth = 1;
+static unsigned int bs = 4096;
+static unsigned int runtime = 5;
+static unsigned int write_pct;
+static bool sequential;
+static unsigned long long dev_size;
+static volatile bool stop;
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+			  unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int ring_init(struct ring *r, unsigned entries)
+{
+	struct io_uring_params p;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = io_uring_setup(entries, &p);
+	if (r->fd < 0)
+		return -errno;
+
+	sq = mmap(NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+		  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+		  IORING_OFF_SQ_RING);
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       r->fd, IORING_OFF_SQES);
+	cq = mmap(NULL, p.cq_off.cqes + p.cq_entries *
+		  sizeof(struct io_uring_cqe), PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	if (sq == MAP_FAILED || r->sqes == MAP_FAILED || cq == MAP_FAILED)
+		return -errno;
+
+	r->sq_head = sq + p.sq_off.head;
+	r->sq_tail = sq + p.sq_off.tail;
+	r->sq_mask = sq + p.sq_off.ring_mask;
+	r->sq_array = sq + p.sq_off.array;
+	r->cq_head = cq + p.cq_off.head;
+	r->cq_tail = cq + p.cq_off.tail;
+	r->cq_mask = cq + p.cq_off.ring_mask;
+	r->cqes = cq + p.cq_off.cqes;
+	return 0;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long next_offset(struct worker *w,
+				      unsigned long long *pos)
+{
+	unsigned long long nr_blocks = dev_size / bs;
+	unsigned long long blk;
+
+	if (sequential) {
+		blk = (*pos)++ % nr_blocks;
+	} else {
+		blk = ((unsigned long long)rand_r(&w->seed) << 31 |
+		       rand_r(&w->seed)) % nr_blocks;
+	}
+	return blk * bs;
+}
+
+static void queue_io(struct worker *w, struct ring *r, int fd,
+		     struct iovec *iov, unsigned long long *start,
+		     unsigned int slot, unsigned long long *pos)
+{
+	unsigned tail = *r->sq_tail;
+	unsigned idx = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+	bool write = write_pct && (unsigned int)rand_r(&w->seed) % 100 <
+			write_pct;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+	sqe->fd = fd;
+	sqe->off = next_offset(w, pos);
+	sqe->addr = (unsigned long)&iov[slot];
+	sqe->len = 1;
+	sqe->user_data = slot;
+	r->sq_array[idx] = idx;
+	write_barrier();
+	*r->sq_tail = tail + 1;
+	write_barrier();
+
+	start[slot] = now_ns();
+}
+
+static void account(struct worker *w, unsigned long long lat, int res)
+{
+	int bucket = 0;
+
+	if (res != (int)bs) {
+		w->errors++;
+		return;
+	}
+
+	w->ios++;
+	w->lat_sum += lat;
+	while (lat > 1 && bucket < NR_LAT_BUCKETS - 1) {
+		lat >>= 1;
+		bucket++;
+	}
+	w->lat[bucket]++;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long long *start, pos = w->cpu * 1024ULL;
+	struct iovec *iov;
+	struct ring r;
+	cpu_set_t set;
+	unsigned int i;
+	int fd, ret;
+
+	CPU_ZERO(&set);
+	CPU_SET(w->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	fd = open(dev_path, (write_pct ? O_RDWR : O_RDONLY) | O_DIRECT);
+	if (fd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", dev_path, strerror(errno));
+
+	ret = ring_init(&r, depth);
+	if (ret == -ENOSYS)
+		ksft_exit_skip("io_uring not supported\n");
+	if (ret)
+		ksft_exit_fail_msg("io_uring setup: %s\n", strerror(-ret));
+
+	iov = calloc(depth, sizeof(*iov));
+	start = calloc(depth, sizeof(*start));
+	if (!iov || !start)
+		ksft_exit_fail_msg("out of memory\n");
+
+	for (i = 0; i < depth; i++) {
+		if (posix_memalign(&iov[i].iov_base, 4096, bs))
+			ksft_exit_fail_msg("out of memory\n");
+		memset(iov[i].iov_base, 0x5a, bs);
+		iov[i].iov_len = bs;
+		queue_io(w, &r, fd, iov, start, i, &pos);
+	}
+
+	ret = io_uring_enter(r.fd, depth, 0, 0);
+	while (!stop && ret >= 0) {
+		unsigned head, queued = 0;
+
+		ret = io_uring_enter(r.fd, 0, 1, IORING_ENTER_GETEVENTS);
+		if (ret < 0 && errno == EINTR)
+			ret = 0;
+		if (ret < 0)
+			break;
+
+		head = *r.cq_head;
+		read_barrier();
+		while (head != *r.cq_tail) {
+			struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+			unsigned int slot = cqe->user_data;
+
+			account(w, now_ns() - start[slot], cqe->res);
+			queue_io(w, &r, fd, iov, start, slot, &pos);
+			queued++;
+			head++;
+		}
+		*r.cq_head = head;
+		write_barrier();
+
+		if (queued)
+			ret = io_uring_enter(r.fd, queued, 0, 0);
+	}
+	if (ret < 0 && errno != EINTR)
+		ksft_exit_fail_msg("io_uring_enter: %s\n", strerror(errno));
+
+	/* closing the ring waits for what is still in flight */
+	close(r.fd);
+	close(fd);
+	return NULL;
+}
+
+static unsigned long long percentile(const unsigned long long *lat,
+				     unsigned long long total, unsigned int pct)
+{
+	unsigned long long seen = 0, want = (total * pct + 99) / 100;
+	int i;
+
+	for (i = 0; i < NR_LAT_BUCKETS; i++) {
+		seen += lat[i];
+		if (seen >= want)
+			return 1ULL << i;
+	}
+	return 1ULL << (NR_LAT_BUCKETS - 1);
+}
+
+static int parse_cpus(const char *list, int *cpus)
+{
+	char *dup = strdup(list), *tok, *save;
+	int nr = 0;
+
+	for (tok = strtok_r(dup, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		int first, last;
+
+		if (sscanf(tok, "%d-%d", &first, &last) != 2)
+			last = first = atoi(tok);
+		for (; first <= last && nr < MAX_CPUS; first++)
+			cpus[nr++] = first;
+	}
+	free(dup);
+	return nr;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s -d DEV [-c CPULIST] [-q DEPTH] [-b BS] [-t SECS] [-w WRITE%%] [-s]\n"
+		"  -c  CPUs to run one submitter on each (default 0)\n"
+		"  -q  I/Os in flight per submitter (default 1)\n"
+		"  -b  block size in bytes (default 4096)\n"
+		"  -t  runtime in seconds (default 5)\n"
+		"  -w  percentage of writes (default 0)\n"
+		"  -s  sequential instead of random offsets\n", prog);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long ios = 0, errors = 0, lat_sum = 0, elapsed;
+	unsigned long long lat[NR_LAT_BUCKETS] = { 0 };
+	static int cpus[MAX_CPUS];
+	const char *cpu_list = "0";
+	struct worker *workers;
+	int nr_cpus, opt, fd, i, j;
+
+	while ((opt = getopt(argc, argv, "d:c:q:b:t:w:s")) != -1) {
+		switch (opt) {
+		case 'd':
+			dev_path = optarg;
+			break;
+		case 'c':
+			cpu_list = optarg;
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 'b':
+			bs = atoi(optarg);
+			break;
+		case 't':
+			runtime = atoi(optarg);
+			break;
+		case 'w':
+			write_pct = atoi(optarg);
+			break;
+		case 's':
+			sequential = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!dev_path || !depth || !bs || write_pct > 100)
+		usage(argv[0]);
+
+	fd = open(dev_path, O_RDONLY);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &dev_size))
+		ksft_exit_fail_msg("%s: %s\n", dev_path, strerror(errno));
+	close(fd);
+	if (dev_size < bs)
+		ksft_exit_fail_msg("%s: device too small\n", dev_path);
+
+	nr_cpus = parse_cpus(cpu_list, cpus);
+	workers = calloc(nr_cpus, sizeof(*workers));
+	if (!nr_cpus || !workers)
+		usage(argv[0]);
+
+	elapsed = now_ns();
+	for (i = 0; i < nr_cpus; i++) {
+		workers[i].cpu = cpus[i];
+		workers[i].seed = cpus[i] + 1;
+		pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]);
+	}
+	sleep(runtime);
+	stop = true;
+	for (i = 0; i < nr_cpus; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ios += workers[i].ios;
+		errors += workers[i].errors;
+		lat_sum += workers[i].lat_sum;
+		for (j = 0; j < NR_LAT_BUCKETS; j++)
+			lat[j] += workers[i].lat[j];
+	}
+	elapsed = now_ns() - elapsed;
+
+	printf("{\"threads\": %d, \"depth\": %u, \"bs\": %u, \"write_pct\": %u, "
+	       "\"sequential\": %s, \"ios\": %llu, \"errors\": %llu, "
+	       "\"iops\": %llu, \"mbps\": %llu, \"lat_avg_ns\": %llu, "
+	       "\"lat_p50_ns\": %llu, \"lat_p99_ns\": %llu}\n",
+	       nr_cpus, depth, bs, write_pct, sequential ? "true" : "false",
+	       ios, errors, ios * 1000000000ULL / elapsed,
+	       ios * bs * 1000ULL / elapsed,
+	       ios ? lat_sum / ios : 0,
+	       percentile(lat, ios, 50), percentile(lat, ios, 99));
+
+	return errors ? KSFT_FAIL : KSFT_PASS;
+}
@@ -0,0 +1,179 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Block layer submission/completion scalability benchmark on null_blk.
+#
+# For every device profile, I/O scheduler and submitter CPU count, create
+# a null_blk device through configfs, run blk_load on it and print one
+# JSON object per run on stdout (JSON Lines), so results of two kernels
+# can be compared with any JSON tool.
+#
+# The default sweep runs for well over ten minutes, so this script is not
+# part of the default kselftest run; invoke it directly as root.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+CONFIGFS=/sys/kernel/config/nullb
+NAME=selftest_bench
+
+runtime=5
+depth=32
+bs=4096
+write_pct=0
+scheds="none mq-deadline kyber bfq"
+profiles="irq_none irq_softirq irq_timer memory zoned"
+cpu_counts=""
+output=/dev/stdout
+
+usage() {
+	cat <<EOF
+Usage: $0 [-t SECS] [-q DEPTH] [-b BS] [-w WRITE%] [-s SCHEDS] [-p PROFILES]
+          [-c CPU_COUNTS] [-o FILE]
+  -t  runtime of each run in seconds (default $runtime)
+  -q  I/Os in flight per submitter (default $depth)
+  -b  block size in bytes (default $bs)
+  -w  percentage of writes (default $write_pct, zoned runs are read-only)
+  -s  schedulers to sweep (default "$scheds")
+  -p  device profiles to sweep (default "$profiles")
+  -c  submitter CPU counts to sweep (default powers of two up to nproc)
+  -o  append results to FILE instead of stdout
+EOF
+	exit 1
+}
+
+# Device profiles: null_blk configfs attributes on top of the defaults
+profile_attrs() {
+	case $1 in
+	irq_none)	echo "irqmode=0" ;;
+	irq_softirq)	echo "irqmode=1" ;;
+	irq_timer)	echo "irqmode=2 completion_nsec=10000" ;;
+	memory)		echo "irqmode=0 memory_backed=1" ;;
+	zoned)		echo "irqmode=0 zoned=1 zone_size=64" ;;
+	*)		return 1 ;;
+	esac
+}
+
+cleanup() {
+	if [ -d $CONFIGFS/$NAME ]; then
+		echo 0 > $CONFIGFS/$NAME/power 2>/dev/null
+		rmdir $CONFIGFS/$NAME
+	fi
+}
+trap cleanup EXIT
+
+# create_dev PROFILE: set up and power on the device, print its index
+create_dev() {
+	local dir=$CONFIGFS/$NAME
+	local attr
+
+	mkdir $dir || return 1
+	echo 2 > $dir/queue_mode
+	echo $(nproc) > $dir/submit_queues
+	echo 1024 > $dir/hw_queue_depth
+	echo $bs > $dir/blocksize
+	echo 4096 > $dir/size
+	for attr in $(profile_attrs $1); do
+		echo ${attr#*=} > $dir/${attr%%=*} || return 1
+	done
+	echo 1 > $dir/power || return 1
+	cat $dir/index
+}
+
+# Schedulers the running kernel offers for the device
+has_sched() {
+	grep -qw -- "$2" /sys/block/$1/queue/scheduler
+}
+
+run_one() {
+	local profile=$1 sched=$2 cpus=$3 dev=$4
+	local wp=$write_pct
+	local result
+
+	[ $profile = zoned ] && wp=0
+
+	result=$(./blk_load -d /dev/$dev -c 0-$((cpus - 1)) -q $depth -b $bs \
+		 -t $runtime -w $wp)
+	if [ $? -ne 0 ] || [ -z "$result" ]; then
+		echo "$profile/$sched/$cpus: blk_load failed" >&2
+		return 1
+	fi
+
+	echo "{\"kernel\": \"$(uname -r)\", \"profile\": \"$profile\"," \
+	     "\"attrs\": \"$(profile_attrs $profile)\"," \
+	     "\"sched\": \"$sched\", ${result#\{}" >> $output
+}
+
+while getopts "t:q:b:w:s:p:c:o:h" opt; do
+	case $opt in
+	t) runtime=$OPTARG ;;
+	q) depth=$OPTARG ;;
+	b) bs=$OPTARG ;;
+	w) write_pct=$OPTARG ;;
+	s) scheds=$OPTARG ;;
+	p) profiles=$OPTARG ;;
+	c) cpu_counts=$OPTARG ;;
+	o) output=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+if [ $UID != 0 ]; then
+	echo "null_blk_bench: must be run as root" >&2
+	exit $ksft_skip
+fi
+
+if [ ! -x ./blk_load ]; then
+	echo "null_blk_bench: blk_load not built" >&2
+	exit $ksft_skip
+fi
+
+if [ ! -d $CONFIGFS ]; then
+	modprobe null_blk nr_devices=0 2>/dev/null
+	mount | grep -q configfs || \
+		mount -t configfs none /sys/kernel/config 2>/dev/null
+fi
+if [ ! -d $CONFIGFS ]; then
+	echo "null_blk_bench: null_blk configfs interface not available" >&2
+	exit $ksft_skip
+fi
+
+if [ -z "$cpu_counts" ]; then
+	n=1
+	while [ $n -lt $(nproc) ]; do
+		cpu_counts="$cpu_counts $n"
+		n=$((n * 2))
+	done
+	cpu_counts="$cpu_counts $(nproc)"
+fi
+
+ret=0
+for profile in $profiles; do
+	if ! profile_attrs $profile > /dev/null; then
+		echo "null_blk_bench: unknown profile $profile" >&2
+		exit 1
+	fi
+
+	if ! index=$(create_dev $profile); then
+		echo "null_blk_bench: $profile: device setup failed, skipping" >&2
+		cleanup
+		continue
+	fi
+	dev=nullb$index
+
+	for sched in $scheds; do
+		if ! has_sched $dev $sched; then
+			echo "null_blk_bench: $dev: no $sched scheduler, skipping" >&2
+			continue
+		fi
+		echo $sched > /sys/block/$dev/queue/scheduler
+
+		for cpus in $cpu_counts; do
+			run_one $profile $sched $cpus $dev || ret=1
+		done
+	done
+
+	cleanup
+done
+
+exit $ret
@@ -113,6 +113,18 @@ static int (*bpf_msg_pull_data)(void *ctx, int start, int end, int flags) =
 	(void *) BPF_FUNC_msg_pull_data;
 static int (*bpf_msg_push_data)(void *ctx, int start, int end, int flags) =
 	(void *) BPF_FUNC_msg_push_data;
+static unsigned long long (*bpf_xdp_get_buff_len)(void *ctx) =
+	(void *) BPF_FUNC_xdp_get_buff_len;
+static int (*bpf_xdp_load_bytes)(void *ctx, int off, void *to, int len) =
+	(void *) BPF_FUNC_xdp_load_bytes;
+static int (*bpf_xdp_store_bytes)(void *ctx, int off, void *from, int len) =
+	(void *) BPF_FUNC_xdp_store_bytes;
+static int (*bpf_xdp_metadata_rx_timestamp)(void *ctx, void *ts, int size) =
+	(void *) BPF_FUNC_xdp_metadata_rx_timestamp;
+static int (*bpf_xdp_metadata_rx_hash)(void *ctx, void *hash, int size) =
+	(void *) BPF_FUNC_xdp_metadata_rx_hash;
+static int (*bpf_xdp_metadata_rx_vlan_tag)(void *ctx, void *vlan, int size) =
+	(void *) BPF_FUNC_xdp_metadata_rx_vlan_tag;
 static int (*bpf_bind)(void *ctx, void *addr, int addr_len) =
 	(void *) BPF_FUNC_bind;
 static int (*bpf_xdp_adjust_tail)(void *ctx, int offset) =
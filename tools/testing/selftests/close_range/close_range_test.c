@@ -0,0 +1,170 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * close_range() tests: argument validation, closing a range of descriptors,
+ * CLOSE_RANGE_CLOEXEC and CLOSE_RANGE_UNSHARE.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/close_range.h>
+
+#include "../kselftest.h"
+
+#ifndef __NR_close_range
+#define __NR_close_range	300
+#endif
+
+#define NR_FDS	100
+
+static int sys_close_range(unsigned int fd, unsigned int max_fd,
+			   unsigned int flags)
+{
+	int ret = syscall(__NR_close_range, fd, max_fd, flags);
+
+	return ret >= 0 ? ret : -errno;
+}
+
+static void open_fds(int *fds)
+{
+	int i;
+
+	for (i = 0; i < NR_FDS; i++) {
+		fds[i] = open("/dev/null", O_RDONLY);
+		if (fds[i] < 0)
+			ksft_exit_fail_msg("open: %s\n", strerror(errno));
+		/* the fds must be consecutive for the ranges below */
+		if (i && fds[i] != fds[i - 1] + 1)
+			ksft_exit_fail_msg("non-consecutive fds\n");
+	}
+}
+
+static int is_open(int fd)
+{
+	return fcntl(fd, F_GETFD) >= 0;
+}
+
+static void test_args(void)
+{
+	int ret;
+
+	ret = sys_close_range(1, 0, 0);
+	if (ret == -EINVAL)
+		ksft_test_result_pass("fd > max_fd rejected\n");
+	else
+		ksft_test_result_fail("fd > max_fd: got %d\n", ret);
+
+	ret = sys_close_range(INT_MAX, INT_MAX, 1U << 31);
+	if (ret == -EINVAL)
+		ksft_test_result_pass("unknown flags rejected\n");
+	else
+		ksft_test_result_fail("unknown flags: got %d\n", ret);
+}
+
+static void test_close(void)
+{
+	int fds[NR_FDS];
+	int ret, i;
+
+	open_fds(fds);
+
+	/* close a window in the middle, then everything above it */
+	ret = sys_close_range(fds[10], fds[19], 0);
+	for (i = 0; i < NR_FDS; i++)
+		if (is_open(fds[i]) != (i < 10 || i > 19))
+			break;
+	if (!ret && i == NR_FDS)
+		ksft_test_result_pass("close window\n");
+	else
+		ksft_test_result_fail("close window: ret %d, fd index %d\n",
+				      ret, i);
+
+	ret = sys_close_range(fds[0], UINT_MAX, 0);
+	for (i = 0; i < NR_FDS; i++)
+		if (is_open(fds[i]))
+			break;
+	if (!ret && i == NR_FDS)
+		ksft_test_result_pass("close to UINT_MAX\n");
+	else
+		ksft_test_result_fail("close to UINT_MAX: ret %d, fd index %d\n",
+				      ret, i);
+}
+
+static void test_cloexec(void)
+{
+	int fds[NR_FDS];
+	int ret, i;
+
+	open_fds(fds);
+
+	ret = sys_close_range(fds[0], fds[NR_FDS / 2 - 1],
+			      CLOSE_RANGE_CLOEXEC);
+	for (i = 0; i < NR_FDS; i++)
+		if (fcntl(fds[i], F_GETFD) != (i < NR_FDS / 2 ? FD_CLOEXEC : 0))
+			break;
+	if (!ret && i == NR_FDS)
+		ksft_test_result_pass("CLOSE_RANGE_CLOEXEC\n");
+	else
+		ksft_test_result_fail("CLOSE_RANGE_CLOEXEC: ret %d, fd index %d\n",
+				      ret, i);
+
+	sys_close_range(fds[0], UINT_MAX, 0);
+}
+
+static int child_fn(void *arg)
+{
+	int *fds = arg;
+
+	if (sys_close_range(fds[0], UINT_MAX, CLOSE_RANGE_UNSHARE))
+		_exit(1);
+	_exit(is_open(fds[0]) ? 2 : 0);
+}
+
+static void test_unshare(void)
+{
+	static char stack[64 * 1024];
+	int fds[NR_FDS];
+	int pid, status;
+
+	open_fds(fds);
+
+	/* share the fd table with the child, which unshares it and closes */
+	pid = clone(child_fn, stack + sizeof(stack), CLONE_FILES | SIGCHLD,
+		    fds);
+	if (pid < 0)
+		ksft_exit_fail_msg("clone: %s\n", strerror(errno));
+	if (waitpid(pid, &status, 0) != pid)
+		ksft_exit_fail_msg("waitpid: %s\n", strerror(errno));
+
+	if (WIFEXITED(status) && !WEXITSTATUS(status) && is_open(fds[0]) &&
+	    is_open(fds[NR_FDS - 1]))
+		ksft_test_result_pass("CLOSE_RANGE_UNSHARE\n");
+	else
+		ksft_test_result_fail("CLOSE_RANGE_UNSHARE: status %#x\n",
+				      status);
+
+	sys_close_range(fds[0], UINT_MAX, 0);
+}
+
+int main(void)
+{
+	ksft_print_header();
+
+	if (sys_close_range(INT_MAX, INT_MAX, 0) == -ENOSYS)
+		ksft_exit_skip("close_range not supported\n");
+
+	test_args();
+	test_close();
+	test_cloexec();
+	test_unshare();
+
+	return ksft_exit_pass();
+}
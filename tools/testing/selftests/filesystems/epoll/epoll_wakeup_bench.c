@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * epoll wakeup scalability benchmark.
+ *
+ * Every producer thread is pinned to its own CPU and keeps signalling its
+ * own eventfd, which is registered in one epoll instance shared by all
+ * waiter threads.  Each write runs ep_poll_callback() on the producer's
+ * CPU, so this measures how well concurrent wakeups on a single epoll
+ * instance scale with the number of CPUs.  The result is printed as a
+ * single JSON object on stdout.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "../../kselftest.h"
+
+#define MAX_EVENTS	64
+
+struct producer {
+	pthread_t thread;
+	int cpu;
+	int efd;
+	unsigned long long writes;
+};
+
+struct waiter {
+	pthread_t thread;
+	unsigned long long waits;
+	unsigned long long events;
+	unsigned long long counts;
+};
+
+static volatile bool stop;
+static int epfd;
+
+static void *producer_fn(void *arg)
+{
+	struct producer *p = arg;
+	uint64_t one = 1;
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(p->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	while (!stop) {
+		if (write(p->efd, &one, sizeof(one)) == sizeof(one))
+			p->writes++;
+	}
+	return NULL;
+}
+
+static void *waiter_fn(void *arg)
+{
+	struct epoll_event events[MAX_EVENTS];
+	struct waiter *w = arg;
+	uint64_t val;
+	int i, n;
+
+	while (!stop) {
+		n = epoll_wait(epfd, events, MAX_EVENTS, 100);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ksft_exit_fail_msg("epoll_wait: %s\n", strerror(errno));
+		}
+		w->waits++;
+		w->events += n;
+		for (i = 0; i < n; i++) {
+			if (read(events[i].data.fd, &val, sizeof(val)) ==
+			    sizeof(val))
+				w->counts += val;
+		}
+	}
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-t SECS] [-p PRODUCERS] [-w WAITERS] [-l]\n"
+		"  -t  runtime in seconds (default 2)\n"
+		"  -p  producer threads, one per CPU (default: online CPUs)\n"
+		"  -w  threads waiting on the shared epoll fd (default 4)\n"
+		"  -l  register eventfds level-triggered instead of EPOLLET\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long writes = 0, waits = 0, events = 0, counts = 0;
+	int nr_producers = sysconf(_SC_NPROCESSORS_ONLN);
+	struct producer *producers;
+	struct waiter *waiters;
+	struct epoll_event ev;
+	int nr_waiters = 4;
+	bool edge = true;
+	double runtime = 2, start, elapsed;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "t:p:w:l")) != -1) {
+		switch (opt) {
+		case 't':
+			runtime = atof(optarg);
+			break;
+		case 'p':
+			nr_producers = atoi(optarg);
+			break;
+		case 'w':
+			nr_waiters = atoi(optarg);
+			break;
+		case 'l':
+			edge = false;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (runtime <= 0 || nr_producers <= 0 || nr_waiters <= 0)
+		usage(argv[0]);
+
+	producers = calloc(nr_producers, sizeof(*producers));
+	waiters = calloc(nr_waiters, sizeof(*waiters));
+	if (!producers || !waiters)
+		ksft_exit_fail_msg("out of memory\n");
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		ksft_exit_fail_msg("epoll_create1: %s\n", strerror(errno));
+
+	for (i = 0; i < nr_producers; i++) {
+		struct producer *p = &producers[i];
+
+		p->cpu = i % sysconf(_SC_NPROCESSORS_ONLN);
+		p->efd = eventfd(0, EFD_NONBLOCK);
+		if (p->efd < 0)
+			ksft_exit_fail_msg("eventfd: %s\n", strerror(errno));
+		ev.events = EPOLLIN | (edge ? EPOLLET : 0);
+		ev.data.fd = p->efd;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, p->efd, &ev))
+			ksft_exit_fail_msg("epoll_ctl: %s\n", strerror(errno));
+	}
+
+	start = now();
+	for (i = 0; i < nr_waiters; i++)
+		if (pthread_create(&waiters[i].thread, NULL, waiter_fn,
+				   &waiters[i]))
+			ksft_exit_fail_msg("pthread_create failed\n");
+	for (i = 0; i < nr_producers; i++)
+		if (pthread_create(&producers[i].thread, NULL, producer_fn,
+				   &producers[i]))
+			ksft_exit_fail_msg("pthread_create failed\n");
+
+	usleep(runtime * 1e6);
+	stop = true;
+
+	for (i = 0; i < nr_producers; i++) {
+		pthread_join(producers[i].thread, NULL);
+		writes += producers[i].writes;
+	}
+	for (i = 0; i < nr_waiters; i++) {
+		pthread_join(waiters[i].thread, NULL);
+		waits += waiters[i].waits;
+		events += waiters[i].events;
+		counts += waiters[i].counts;
+	}
+	elapsed = now() - start;
+
+	printf("{\"producers\": %d, \"waiters\": %d, \"trigger\": \"%s\", "
+	       "\"runtime_s\": %.3f, \"wakeups_per_sec\": %.0f, "
+	       "\"events_per_sec\": %.0f, \"epoll_waits_per_sec\": %.0f, "
+	       "\"writes_per_event\": %.2f}\n",
+	       nr_producers, nr_waiters, edge ? "edge" : "level", elapsed,
+	       writes / elapsed, events / elapsed, waits / elapsed,
+	       events ? (double)counts / events : 0.0);
+
+	for (i = 0; i < nr_producers; i++)
+		close(producers[i].efd);
+	close(epfd);
+
+	if (!events)
+		ksft_exit_fail_msg("no events delivered\n");
+	return ksft_exit_pass();
+}
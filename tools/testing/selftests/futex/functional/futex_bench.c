@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Measure futex wait/wake round trips between pairs of threads, with the
+ * futexes homed on the node of the waiting thread (FUTEX_NUMA_FLAG) or
+ * spread over all the nodes by the kernel, and the latency of waking one
+ * thread blocked in futex_waitv() on a growing number of futexes.
+ *
+ * Usage: futex_bench [-t pairs] [-s seconds] [-n] [-v max_futexes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#ifndef FUTEX_NUMA_FLAG
+#define FUTEX_NUMA_FLAG		512
+#define FUTEX_NO_NODE		(-1)
+#endif
+
+#ifndef FUTEX2_SIZE_U32
+#define FUTEX2_SIZE_U32		0x02
+#define FUTEX2_PRIVATE		FUTEX_PRIVATE_FLAG
+#endif
+
+#ifndef FUTEX_WAITV_MAX
+#define FUTEX_WAITV_MAX		128
+
+struct futex_waitv {
+	uint64_t val;
+	uint64_t uaddr;
+	uint32_t flags;
+	uint32_t __reserved;
+};
+#endif
+
+#ifndef __NR_futex_waitv
+#define __NR_futex_waitv	295
+#endif
+
+/* A futex followed by its home node, as FUTEX_NUMA_FLAG expects. */
+struct numa_futex {
+	uint32_t val;
+	uint32_t node;
+} __attribute__((aligned(64)));
+
+struct pair {
+	pthread_t waiter, waker;
+	struct numa_futex ping, pong;
+	unsigned long rounds;
+	int ready;
+};
+
+static volatile int stop;
+static int numa;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int futex_op(struct numa_futex *f, int op, uint32_t val)
+{
+	op |= FUTEX_PRIVATE_FLAG;
+	if (numa)
+		op |= FUTEX_NUMA_FLAG;
+
+	return syscall(SYS_futex, &f->val, op, val, NULL, NULL, 0);
+}
+
+static void post(struct numa_futex *f)
+{
+	__atomic_store_n(&f->val, 1, __ATOMIC_RELEASE);
+	futex_op(f, FUTEX_WAKE, 1);
+}
+
+static void take(struct numa_futex *f)
+{
+	while (!__atomic_exchange_n(&f->val, 0, __ATOMIC_ACQUIRE))
+		futex_op(f, FUTEX_WAIT, 0);
+}
+
+static void *waiter_fn(void *arg)
+{
+	struct pair *p = arg;
+	unsigned int cpu, node;
+
+	/* Home both futexes on the node this thread first runs on. */
+	if (numa && !syscall(SYS_getcpu, &cpu, &node, NULL))
+		p->ping.node = p->pong.node = node;
+	__atomic_store_n(&p->ready, 1, __ATOMIC_RELEASE);
+	post(&p->pong);
+
+	while (!stop) {
+		take(&p->ping);
+		post(&p->pong);
+	}
+	return NULL;
+}
+
+static void *waker_fn(void *arg)
+{
+	struct pair *p = arg;
+
+	/* Both sides must agree on the home node before using the futexes. */
+	while (!__atomic_load_n(&p->ready, __ATOMIC_ACQUIRE))
+		;
+	take(&p->pong);
+	while (!stop) {
+		post(&p->ping);
+		take(&p->pong);
+		p->rounds++;
+	}
+	/* Let the waiter see stop. */
+	post(&p->ping);
+	return NULL;
+}
+
+static void bench_pairs(int nr_pairs, int seconds)
+{
+	struct pair *pairs;
+	unsigned long total = 0;
+	double t;
+	int i;
+
+	pairs = calloc(nr_pairs, sizeof(*pairs));
+	if (!pairs)
+		err(1, "calloc");
+
+	stop = 0;
+	for (i = 0; i < nr_pairs; i++) {
+		pairs[i].ping.node = pairs[i].pong.node = FUTEX_NO_NODE;
+		if (pthread_create(&pairs[i].waiter, NULL, waiter_fn, &pairs[i]) ||
+		    pthread_create(&pairs[i].waker, NULL, waker_fn, &pairs[i]))
+			err(1, "pthread_create");
+	}
+
+	t = now();
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_pairs; i++) {
+		pthread_join(pairs[i].waker, NULL);
+		pthread_join(pairs[i].waiter, NULL);
+		total += pairs[i].rounds;
+	}
+	t = now() - t;
+
+	printf("%-6d %-6s %12.0f\n", nr_pairs, numa ? "node" : "spread",
+	       total / t);
+	free(pairs);
+}
+
+struct waitv_arg {
+	uint32_t *futexes;
+	int nr;
+	volatile int woken;
+};
+
+static void *waitv_fn(void *arg)
+{
+	struct waitv_arg *a = arg;
+	struct futex_waitv w[FUTEX_WAITV_MAX];
+	int i, ret;
+
+	for (;;) {
+		for (i = 0; i < a->nr; i++) {
+			w[i].val = 0;
+			w[i].uaddr = (uintptr_t)&a->futexes[i];
+			w[i].flags = FUTEX2_SIZE_U32 | FUTEX2_PRIVATE;
+			w[i].__reserved = 0;
+		}
+		ret = syscall(__NR_futex_waitv, w, a->nr, 0, NULL, 0);
+		if (ret < 0 && errno != EAGAIN && errno != EINTR)
+			err(1, "futex_waitv");
+		if (stop)
+			return NULL;
+		/* The value changed before we slept: find which one. */
+		for (i = 0; ret < 0 && i < a->nr; i++) {
+			if (__atomic_load_n(&a->futexes[i], __ATOMIC_ACQUIRE))
+				ret = i;
+		}
+		if (ret >= 0) {
+			__atomic_store_n(&a->futexes[ret], 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&a->woken, ret + 1, __ATOMIC_RELEASE);
+		}
+	}
+}
+
+static void bench_waitv(int nr, int seconds)
+{
+	uint32_t futexes[FUTEX_WAITV_MAX] = { 0 };
+	struct waitv_arg a = { .futexes = futexes, .nr = nr };
+	unsigned long rounds = 0;
+	pthread_t thread;
+	double t, end;
+	int i;
+
+	stop = 0;
+	if (pthread_create(&thread, NULL, waitv_fn, &a))
+		err(1, "pthread_create");
+
+	t = now();
+	end = t + seconds;
+	while (now() < end) {
+		i = rounds % nr;
+		a.woken = 0;
+		__atomic_store_n(&futexes[i], 1, __ATOMIC_RELEASE);
+		syscall(SYS_futex, &futexes[i], FUTEX_WAKE_PRIVATE, 1,
+			NULL, NULL, 0);
+		while (!__atomic_load_n(&a.woken, __ATOMIC_ACQUIRE))
+			;
+		if (a.woken != i + 1)
+			errx(1, "futex_waitv returned %d, expected %d",
+			     a.woken - 1, i);
+		rounds++;
+	}
+	t = now() - t;
+
+	stop = 1;
+	futexes[0] = 1;
+	syscall(SYS_futex, &futexes[0], FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	pthread_join(thread, NULL);
+
+	printf("%-6d %12.2f\n", nr, t * 1e6 / rounds);
+}
+
+int main(int argc, char **argv)
+{
+	int max_pairs = 8, seconds = 2, max_waitv = 0;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, "t:s:nv:")) != -1) {
+		switch (opt) {
+		case 't':
+			max_pairs = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'n':
+			numa = 1;
+			break;
+		case 'v':
+			max_waitv = atoi(optarg);
+			if (max_waitv > FUTEX_WAITV_MAX)
+				max_waitv = FUTEX_WAITV_MAX;
+			break;
+		default:
+			errx(1, "usage: %s [-t pairs] [-s seconds] [-n] [-v max_futexes]",
+			     argv[0]);
+		}
+	}
+
+	printf("%-6s %-6s %12s\n", "pairs", "hash", "rounds/s");
+	for (n = 1; n <= max_pairs; n *= 2)
+		bench_pairs(n, seconds);
+
+	if (!max_waitv)
+		return 0;
+
+	printf("\n%-6s %12s\n", "futexes", "wake_us");
+	for (n = 1; n <= max_waitv; n *= 2)
+		bench_waitv(n, seconds);
+
+	return 0;
+}
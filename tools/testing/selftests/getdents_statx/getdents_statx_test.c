@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * getdents_statx() tests: argument validation, and that the attributes
+ * returned for each entry match what lstat() reports for it.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/dirent_statx.h>
+
+#include "../kselftest.h"
+
+#ifndef __NR_getdents_statx
+#define __NR_getdents_statx	301
+#endif
+
+#define FILE_SIZE	1234
+
+static int sys_getdents_statx(int fd, void *buf, unsigned int count,
+			      unsigned int mask, unsigned int flags)
+{
+	int ret = syscall(__NR_getdents_statx, fd, buf, count, mask, flags);
+
+	return ret >= 0 ? ret : -errno;
+}
+
+static char dir[] = "/tmp/getdents_statx.XXXXXX";
+static char buf[64 * 1024];
+
+static void setup(void)
+{
+	char path[128];
+	int fd;
+
+	if (!mkdtemp(dir))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+
+	snprintf(path, sizeof(path), "%s/file", dir);
+	fd = open(path, O_CREAT | O_WRONLY, 0644);
+	if (fd < 0 || ftruncate(fd, FILE_SIZE))
+		ksft_exit_fail_msg("create file: %s\n", strerror(errno));
+	close(fd);
+
+	snprintf(path, sizeof(path), "%s/subdir", dir);
+	if (mkdir(path, 0755))
+		ksft_exit_fail_msg("mkdir: %s\n", strerror(errno));
+
+	snprintf(path, sizeof(path), "%s/link", dir);
+	if (symlink("file", path))
+		ksft_exit_fail_msg("symlink: %s\n", strerror(errno));
+}
+
+static void cleanup(void)
+{
+	char path[128];
+
+	snprintf(path, sizeof(path), "%s/file", dir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/link", dir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/subdir", dir);
+	rmdir(path);
+	rmdir(dir);
+}
+
+static void test_args(int dfd)
+{
+	int ret;
+
+	ret = sys_getdents_statx(dfd, buf, sizeof(buf), STATX__RESERVED, 0);
+	if (ret == -EINVAL)
+		ksft_test_result_pass("reserved mask rejected\n");
+	else
+		ksft_test_result_fail("reserved mask: got %d\n", ret);
+
+	ret = sys_getdents_statx(dfd, buf, sizeof(buf), STATX_BASIC_STATS,
+				 AT_SYMLINK_NOFOLLOW);
+	if (ret == -EINVAL)
+		ksft_test_result_pass("unknown flags rejected\n");
+	else
+		ksft_test_result_fail("unknown flags: got %d\n", ret);
+
+	ret = sys_getdents_statx(dfd, buf, 8, STATX_BASIC_STATS, 0);
+	if (ret == -EINVAL)
+		ksft_test_result_pass("short buffer rejected\n");
+	else
+		ksft_test_result_fail("short buffer: got %d\n", ret);
+}
+
+static int check_entry(struct linux_dirent_statx *d)
+{
+	char path[128];
+	struct stat st;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, d->d_name);
+	if (lstat(path, &st))
+		return -1;
+	if (d->d_stat_err) {
+		ksft_print_msg("%s: d_stat_err %d\n", d->d_name,
+			       d->d_stat_err);
+		return -1;
+	}
+	if (d->d_stat.stx_ino != st.st_ino ||
+	    d->d_stat.stx_mode != st.st_mode ||
+	    d->d_stat.stx_size != (__u64)st.st_size ||
+	    d->d_stat.stx_nlink != st.st_nlink) {
+		ksft_print_msg("%s: statx does not match lstat\n", d->d_name);
+		return -1;
+	}
+	if (!strcmp(d->d_name, "file") && d->d_stat.stx_size != FILE_SIZE)
+		return -1;
+	return 0;
+}
+
+static void test_entries(int dfd)
+{
+	int seen = 0, bad = 0;
+	int ret, pos;
+
+	while ((ret = sys_getdents_statx(dfd, buf, sizeof(buf),
+					 STATX_BASIC_STATS, 0)) > 0) {
+		for (pos = 0; pos < ret; ) {
+			struct linux_dirent_statx *d = (void *)(buf + pos);
+
+			if (check_entry(d))
+				bad++;
+			seen++;
+			pos += d->d_reclen;
+		}
+	}
+
+	if (!ret && seen == 5 && !bad)
+		ksft_test_result_pass("entries match lstat\n");
+	else
+		ksft_test_result_fail("entries: ret %d, seen %d, bad %d\n",
+				      ret, seen, bad);
+}
+
+int main(void)
+{
+	int dfd;
+
+	ksft_print_header();
+
+	if (sys_getdents_statx(-1, NULL, 0, 0, 0) == -ENOSYS)
+		ksft_exit_skip("getdents_statx not supported\n");
+
+	setup();
+	dfd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (dfd < 0)
+		ksft_exit_fail_msg("open: %s\n", strerror(errno));
+
+	test_args(dfd);
+	test_entries(dfd);
+
+	close(dfd);
+	cleanup();
+
+	return ksft_exit_pass();
+}
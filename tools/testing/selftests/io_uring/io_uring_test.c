@@ -0,0 +1,377 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Basic io_uring functional tests: ring setup and mapping, NOP, READV and
+ * WRITEV on a regular file, FSYNC and POLL_ADD/POLL_REMOVE on a pipe,
+ * READ_FIXED/WRITE_FIXED on registered files and buffers, and submission
+ * through the SQ polling thread.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "../kselftest.h"
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup	296
+#define __NR_io_uring_enter	297
+#define __NR_io_uring_register	298
+#endif
+
+#define read_barrier()	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define write_barrier()	__atomic_thread_fence(__ATOMIC_RELEASE)
+
+struct ring {
+	int fd;
+	unsigned flags;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array, *sq_flags;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+			  unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg,
+			     unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int ring_init(struct ring *r, unsigned entries, unsigned flags)
+{
+	struct io_uring_params p;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = flags;
+	r->flags = flags;
+	r->fd = io_uring_setup(entries, &p);
+	if (r->fd < 0) {
+		if (errno == ENOSYS)
+			ksft_exit_skip("io_uring not supported\n");
+		if (flags && errno == EPERM)
+			return -errno;
+		ksft_exit_fail_msg("io_uring_setup: %s\n", strerror(errno));
+	}
+
+	sq = mmap(NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+		  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+		  IORING_OFF_SQ_RING);
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       r->fd, IORING_OFF_SQES);
+	cq = mmap(NULL, p.cq_off.cqes + p.cq_entries *
+		  sizeof(struct io_uring_cqe), PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	if (sq == MAP_FAILED || r->sqes == MAP_FAILED || cq == MAP_FAILED)
+		ksft_exit_fail_msg("mmap: %s\n", strerror(errno));
+
+	r->sq_head = sq + p.sq_off.head;
+	r->sq_tail = sq + p.sq_off.tail;
+	r->sq_mask = sq + p.sq_off.ring_mask;
+	r->sq_array = sq + p.sq_off.array;
+	r->sq_flags = sq + p.sq_off.flags;
+	r->cq_head = cq + p.cq_off.head;
+	r->cq_tail = cq + p.cq_off.tail;
+	r->cq_mask = cq + p.cq_off.ring_mask;
+	r->cqes = cq + p.cq_off.cqes;
+
+	ksft_test_result_pass("setup 0x%x: %u sq entries, %u cq entries\n",
+			      flags, p.sq_entries, p.cq_entries);
+	return 0;
+}
+
+static struct io_uring_sqe *get_sqe(struct ring *r)
+{
+	unsigned tail = *r->sq_tail;
+	unsigned idx = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_array[idx] = idx;
+	write_barrier();
+	*r->sq_tail = tail + 1;
+	write_barrier();
+	return sqe;
+}
+
+/* Submit everything queued and wait for one completion. */
+static int submit_and_wait(struct ring *r, unsigned to_submit,
+			   struct io_uring_cqe *cqe)
+{
+	unsigned flags = IORING_ENTER_GETEVENTS;
+	unsigned head;
+	int ret;
+
+	if (r->flags & IORING_SETUP_SQPOLL) {
+		/* full barrier between the tail store and the flags load */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (*r->sq_flags & IORING_SQ_NEED_WAKEUP)
+			flags |= IORING_ENTER_SQ_WAKEUP;
+	}
+
+	ret = io_uring_enter(r->fd, to_submit, 1, flags);
+	if (ret < 0)
+		return -errno;
+
+	head = *r->cq_head;
+	read_barrier();
+	if (head == *r->cq_tail)
+		return -EAGAIN;
+
+	*cqe = r->cqes[head & *r->cq_mask];
+	*r->cq_head = head + 1;
+	write_barrier();
+	return 0;
+}
+
+static void check(const char *name, int ret, struct io_uring_cqe *cqe,
+		  unsigned long long data, int res)
+{
+	if (ret)
+		ksft_test_result_fail("%s: submit: %s\n", name, strerror(-ret));
+	else if (cqe->user_data != data || cqe->res != res)
+		ksft_test_result_fail("%s: got data %llu res %d, expected %llu %d\n",
+				      name, (unsigned long long)cqe->user_data,
+				      cqe->res, data, res);
+	else
+		ksft_test_result_pass("%s\n", name);
+}
+
+static void test_nop(struct ring *r)
+{
+	struct io_uring_cqe cqe;
+	struct io_uring_sqe *sqe;
+
+	sqe = get_sqe(r);
+	sqe->opcode = IORING_OP_NOP;
+	sqe->user_data = 1;
+	check("nop", submit_and_wait(r, 1, &cqe), &cqe, 1, 0);
+}
+
+static void test_rw(struct ring *r)
+{
+	char wbuf[4096], rbuf[4096], path[] = "/tmp/io_uring_testXXXXXX";
+	struct iovec iov;
+	struct io_uring_cqe cqe;
+	struct io_uring_sqe *sqe;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		ksft_exit_fail_msg("mkstemp: %s\n", strerror(errno));
+	unlink(path);
+
+	memset(wbuf, 0x5a, sizeof(wbuf));
+	iov.iov_base = wbuf;
+	iov.iov_len = sizeof(wbuf);
+	sqe = get_sqe(r);
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)&iov;
+	sqe->len = 1;
+	sqe->user_data = 2;
+	check("writev", submit_and_wait(r, 1, &cqe), &cqe, 2, sizeof(wbuf));
+
+	sqe = get_sqe(r);
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->fd = fd;
+	sqe->user_data = 3;
+	check("fsync", submit_and_wait(r, 1, &cqe), &cqe, 3, 0);
+
+	memset(rbuf, 0, sizeof(rbuf));
+	iov.iov_base = rbuf;
+	iov.iov_len = sizeof(rbuf);
+	sqe = get_sqe(r);
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)&iov;
+	sqe->len = 1;
+	sqe->user_data = 4;
+	check("readv", submit_and_wait(r, 1, &cqe), &cqe, 4, sizeof(rbuf));
+	if (memcmp(wbuf, rbuf, sizeof(rbuf)))
+		ksft_test_result_fail("readv: data mismatch\n");
+
+	close(fd);
+}
+
+static void test_poll(struct ring *r)
+{
+	struct io_uring_cqe cqe, cqe2;
+	struct io_uring_sqe *sqe;
+	int fds[2], ret;
+
+	if (pipe(fds))
+		ksft_exit_fail_msg("pipe: %s\n", strerror(errno));
+
+	/* Nothing to read yet, so this has to wait for the write below. */
+	sqe = get_sqe(r);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fds[0];
+	sqe->poll_events = POLLIN;
+	sqe->user_data = 5;
+	ret = io_uring_enter(r->fd, 1, 0, 0);
+	if (ret != 1)
+		ksft_exit_fail_msg("poll submit: %d\n", ret);
+
+	if (write(fds[1], "x", 1) != 1)
+		ksft_exit_fail_msg("write: %s\n", strerror(errno));
+	check("poll add", submit_and_wait(r, 0, &cqe), &cqe, 5, POLLIN);
+
+	/* Queue another poll and cancel it. */
+	sqe = get_sqe(r);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fds[1];
+	sqe->poll_events = POLLPRI;
+	sqe->user_data = 6;
+	sqe = get_sqe(r);
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->addr = 6;
+	sqe->user_data = 7;
+	/* both the removal and the canceled poll post a completion */
+	ret = submit_and_wait(r, 2, &cqe);
+	if (!ret && cqe.user_data == 6)
+		ret = submit_and_wait(r, 0, &cqe);
+	else if (!ret)
+		ret = submit_and_wait(r, 0, &cqe2);
+	check("poll remove", ret, &cqe, 7, 0);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static void test_fixed(struct ring *r)
+{
+	char path[] = "/tmp/io_uring_testXXXXXX";
+	struct io_uring_cqe cqe;
+	struct io_uring_sqe *sqe;
+	struct iovec iov[2];
+	char *buf;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		ksft_exit_fail_msg("mkstemp: %s\n", strerror(errno));
+	unlink(path);
+
+	buf = aligned_alloc(4096, 2 * 4096);
+	if (!buf)
+		ksft_exit_fail_msg("aligned_alloc failed\n");
+	memset(buf, 0xa5, 4096);
+	memset(buf + 4096, 0, 4096);
+	iov[0].iov_base = buf;
+	iov[0].iov_len = 4096;
+	iov[1].iov_base = buf + 4096;
+	iov[1].iov_len = 4096;
+
+	if (io_uring_register(r->fd, IORING_REGISTER_BUFFERS, iov, 2))
+		ksft_exit_fail_msg("register buffers: %s\n", strerror(errno));
+	if (io_uring_register(r->fd, IORING_REGISTER_FILES, &fd, 1))
+		ksft_exit_fail_msg("register files: %s\n", strerror(errno));
+	/* a ring can't be registered in itself */
+	if (!io_uring_register(r->fd, IORING_UNREGISTER_FILES, NULL, 0) &&
+	    io_uring_register(r->fd, IORING_REGISTER_FILES, &r->fd, 1) != -1)
+		ksft_test_result_fail("register ring fd succeeded\n");
+	if (io_uring_register(r->fd, IORING_REGISTER_FILES, &fd, 1))
+		ksft_exit_fail_msg("register files: %s\n", strerror(errno));
+
+	sqe = get_sqe(r);
+	sqe->opcode = IORING_OP_WRITE_FIXED;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = 0;
+	sqe->addr = (unsigned long)buf;
+	sqe->len = 4096;
+	sqe->buf_index = 0;
+	sqe->user_data = 8;
+	check("write fixed", submit_and_wait(r, 1, &cqe), &cqe, 8, 4096);
+
+	sqe = get_sqe(r);
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = 0;
+	sqe->addr = (unsigned long)(buf + 4096);
+	sqe->len = 4096;
+	sqe->buf_index = 1;
+	sqe->user_data = 9;
+	check("read fixed", submit_and_wait(r, 1, &cqe), &cqe, 9, 4096);
+	if (memcmp(buf, buf + 4096, 4096))
+		ksft_test_result_fail("read fixed: data mismatch\n");
+
+	/* outside of the registered buffer */
+	sqe = get_sqe(r);
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->addr = (unsigned long)(buf + 4096);
+	sqe->len = 8192;
+	sqe->buf_index = 1;
+	sqe->user_data = 10;
+	check("read fixed overflow", submit_and_wait(r, 1, &cqe), &cqe, 10,
+	      -EFAULT);
+
+	if (io_uring_register(r->fd, IORING_UNREGISTER_BUFFERS, NULL, 0) ||
+	    io_uring_register(r->fd, IORING_UNREGISTER_FILES, NULL, 0))
+		ksft_test_result_fail("unregister: %s\n", strerror(errno));
+
+	free(buf);
+	close(fd);
+}
+
+static void test_sqpoll(void)
+{
+	struct io_uring_cqe cqe;
+	struct io_uring_sqe *sqe;
+	struct ring r;
+	int i;
+
+	if (ring_init(&r, 8, IORING_SETUP_SQPOLL)) {
+		ksft_test_result_skip("sqpoll: needs CAP_SYS_ADMIN\n");
+		return;
+	}
+
+	for (i = 0; i < 4; i++) {
+		sqe = get_sqe(&r);
+		sqe->opcode = IORING_OP_NOP;
+		sqe->user_data = 100 + i;
+		check("sqpoll nop", submit_and_wait(&r, 1, &cqe), &cqe,
+		      100 + i, 0);
+	}
+
+	close(r.fd);
+}
+
+int main(void)
+{
+	struct ring r;
+
+	ksft_print_header();
+
+	ring_init(&r, 8, 0);
+	test_nop(&r);
+	test_rw(&r);
+	test_poll(&r);
+	test_fixed(&r);
+	close(r.fd);
+
+	test_sqpoll();
+
+	return ksft_exit_pass();
+}
@@ -31,25 +31,26 @@ FIXTURE(tls)
 	bool notls;
 };
 
-FIXTURE_SETUP(tls)
+static void tls_setup(struct __test_metadata *_metadata, int *fd, int *cfd,
+		      bool *notls, __u16 version)
 {
 	struct tls12_crypto_info_aes_gcm_128 tls12;
 	struct sockaddr_in addr;
 	socklen_t len;
 	int sfd, ret;
 
-	self->notls = false;
+	*notls = false;
 	len = sizeof(addr);
 
 	memset(&tls12, 0, sizeof(tls12));
-	tls12.info.version = TLS_1_2_VERSION;
+	tls12.info.version = version;
 	tls12.info.cipher_type = TLS_CIPHER_AES_GCM_128;
 
 	addr.sin_family = AF_INET;
 	addr.sin_addr.s_addr = htonl(INADDR_ANY);
 	addr.sin_port = 0;
 
-	self->fd = socket(AF_INET, SOCK_STREAM, 0);
+	*fd = socket(AF_INET, SOCK_STREAM, 0);
 	sfd = socket(AF_INET, SOCK_STREAM, 0);
 
 	ret = bind(sfd, &addr, sizeof(addr));
@@ -60,30 +61,30 @@ FIXTURE_SETUP(tls)
 	ret = getsockname(sfd, &addr, &len);
 	ASSERT_EQ(ret, 0);
 
-	ret = connect(self->fd, &addr, sizeof(addr));
+	ret = connect(*fd, &addr, sizeof(addr));
 	ASSERT_EQ(ret, 0);
 
-	ret = setsockopt(self->fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"));
+	ret = setsockopt(*fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"));
 	if (ret != 0) {
-		self->notls = true;
+		*notls = true;
 		printf("Failure setting TCP_ULP, testing without tls\n");
 	}
 
-	if (!self->notls) {
-		ret = setsockopt(self->fd, SOL_TLS, TLS_TX, &tls12,
+	if (!*notls) {
+		ret = setsockopt(*fd, SOL_TLS, TLS_TX, &tls12,
 				 sizeof(tls12));
 		ASSERT_EQ(ret, 0);
 	}
 
-	self->cfd = accept(sfd, &addr, &len);
-	ASSERT_GE(self->cfd, 0);
+	*cfd = accept(sfd, &addr, &len);
+	ASSERT_GE(*cfd, 0);
 
-	if (!self->notls) {
-		ret = setsockopt(self->cfd, IPPROTO_TCP, TCP_ULP, "tls",
+	if (!*notls) {
+		ret = setsockopt(*cfd, IPPROTO_TCP, TCP_ULP, "tls",
 				 sizeof("tls"));
 		ASSERT_EQ(ret, 0);
 
-		ret = setsockopt(self->cfd, SOL_TLS, TLS_RX, &tls12,
+		ret = setsockopt(*cfd, SOL_TLS, TLS_RX, &tls12,
 				 sizeof(tls12));
 		ASSERT_EQ(ret, 0);
 	}
@@ -91,6 +92,12 @@ FIXTURE_SETUP(tls)
 	close(sfd);
 }
 
+FIXTURE_SETUP(tls)
+{
+	tls_setup(_metadata, &self->fd, &self->cfd, &self->notls,
+		  TLS_1_2_VERSION);
+}
+
 FIXTURE_TEARDOWN(tls)
 {
 	close(self->fd);
@@ -128,6 +135,45 @@ TEST_F(tls, send_then_sendfile)
 	EXPECT_EQ(recv(self->cfd, buf, st.st_size, MSG_WAITALL), st.st_size);
 }
 
+TEST_F(tls, sendfile_zc_ro)
+{
+	int filefd = open("/proc/self/exe", O_RDONLY);
+	unsigned int optval = 1;
+	socklen_t optlen;
+	struct stat st;
+	char *buf, *expected;
+
+	if (self->notls)
+		return;
+
+	ASSERT_EQ(setsockopt(self->fd, SOL_TLS, TLS_TX_ZEROCOPY_RO,
+			     &optval, sizeof(optval)), 0);
+	optval = 0;
+	optlen = sizeof(optval);
+	ASSERT_EQ(getsockopt(self->fd, SOL_TLS, TLS_TX_ZEROCOPY_RO,
+			     &optval, &optlen), 0);
+	EXPECT_EQ(optval, 1);
+
+	optval = 2;
+	EXPECT_EQ(setsockopt(self->fd, SOL_TLS, TLS_TX_ZEROCOPY_RO,
+			     &optval, sizeof(optval)), -1);
+	EXPECT_EQ(errno, EINVAL);
+
+	EXPECT_GE(filefd, 0);
+	fstat(filefd, &st);
+	buf = (char *)malloc(st.st_size);
+	expected = (char *)malloc(st.st_size);
+	EXPECT_EQ(read(filefd, expected, st.st_size), st.st_size);
+
+	EXPECT_EQ(sendfile(self->fd, filefd, 0, st.st_size), st.st_size);
+	EXPECT_EQ(recv(self->cfd, buf, st.st_size, MSG_WAITALL), st.st_size);
+	EXPECT_EQ(memcmp(buf, expected, st.st_size), 0);
+
+	free(expected);
+	free(buf);
+	close(filefd);
+}
+
 TEST_F(tls, recv_max)
 {
 	unsigned int send_len = TLS_PAYLOAD_MAX_LEN;
@@ -761,4 +807,99 @@ TEST_F(tls, control_msg)
 	EXPECT_EQ(memcmp(buf, test_str, send_len), 0);
 }
 
+FIXTURE(tls13)
+{
+	int fd, cfd;
+	bool notls;
+};
+
+FIXTURE_SETUP(tls13)
+{
+	tls_setup(_metadata, &self->fd, &self->cfd, &self->notls,
+		  TLS_1_3_VERSION);
+}
+
+FIXTURE_TEARDOWN(tls13)
+{
+	close(self->fd);
+	close(self->cfd);
+}
+
+TEST_F(tls13, sendmsg_large)
+{
+	int send_len = TLS_PAYLOAD_MAX_LEN * 4 + 1;
+	char *mem = malloc(send_len);
+	char *buf = malloc(send_len);
+	int i;
+
+	for (i = 0; i < send_len; i++)
+		mem[i] = rand();
+	EXPECT_EQ(send(self->fd, mem, send_len, 0), send_len);
+	EXPECT_EQ(recv(self->cfd, buf, send_len, MSG_WAITALL), send_len);
+	EXPECT_EQ(memcmp(mem, buf, send_len), 0);
+
+	free(mem);
+	free(buf);
+}
+
+TEST_F(tls13, splice_to_pipe)
+{
+	int send_len = TLS_PAYLOAD_MAX_LEN;
+	char mem1[TLS_PAYLOAD_MAX_LEN];
+	char mem2[TLS_PAYLOAD_MAX_LEN];
+	int i, p[2];
+
+	ASSERT_GE(pipe(p), 0);
+	for (i = 0; i < send_len; i++)
+		mem1[i] = rand();
+	EXPECT_GE(send(self->fd, mem1, send_len, 0), 0);
+	EXPECT_GE(splice(self->cfd, NULL, p[1], NULL, send_len, 0), 0);
+	EXPECT_GE(read(p[0], mem2, send_len), 0);
+	EXPECT_EQ(memcmp(mem1, mem2, send_len), 0);
+}
+
+TEST_F(tls13, control_msg)
+{
+	char cbuf[CMSG_SPACE(sizeof(char))];
+	char const *test_str = "test_read";
+	int cmsg_len = sizeof(char);
+	char record_type = 100;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	int send_len = 10;
+	struct iovec vec;
+	char buf[10];
+
+	if (self->notls)
+		return;
+
+	vec.iov_base = (char *)test_str;
+	vec.iov_len = 10;
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_iov = &vec;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(cmsg_len);
+	*CMSG_DATA(cmsg) = record_type;
+	msg.msg_controllen = cmsg->cmsg_len;
+
+	EXPECT_EQ(sendmsg(self->fd, &msg, 0), send_len);
+	/* the record type is only found after decryption */
+	EXPECT_EQ(recv(self->cfd, buf, send_len, 0), -1);
+
+	vec.iov_base = buf;
+	EXPECT_EQ(recvmsg(self->cfd, &msg, MSG_WAITALL), send_len);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	EXPECT_NE(cmsg, NULL);
+	EXPECT_EQ(cmsg->cmsg_level, SOL_TLS);
+	EXPECT_EQ(cmsg->cmsg_type, TLS_GET_RECORD_TYPE);
+	record_type = *((unsigned char *)CMSG_DATA(cmsg));
+	EXPECT_EQ(record_type, 100);
+	EXPECT_EQ(memcmp(buf, test_str, send_len), 0);
+}
+
 TEST_HARNESS_MAIN
@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Stress the garbage collector of AF_UNIX in-flight descriptors.
+ *
+ * The main thread keeps building unreachable cycles of sockets (a socket
+ * queued to itself, two sockets queued to each other, and a listener queued
+ * to its own embryo), each also carrying a "witness" socket, whose peer sees
+ * EOF once the cycle is collected.  Meanwhile, a bystander thread passes
+ * descriptors back and forth over its own socket pair, never forming a
+ * cycle: check that it's not held up by the collector, and that every
+ * cycle is eventually collected.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <error.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NR_BATCH	128	/* cycles, and witnesses, per round */
+#define NR_ROUNDS	64
+#define COLLECT_MS	10000
+
+static int cfg_rounds = NR_ROUNDS;
+static volatile bool stop;
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		error(1, errno, "clock_gettime");
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void send_fds(int sock, int *fds, int n)
+{
+	char cbuf[CMSG_SPACE(sizeof(int) * 4)];
+	struct msghdr msg = {};
+	struct cmsghdr *cmsg;
+	char data = 'x';
+	struct iovec iov = {
+		.iov_base = &data,
+		.iov_len = 1,
+	};
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n);
+
+	if (sendmsg(sock, &msg, 0) != 1)
+		error(1, errno, "sendmsg");
+}
+
+static int recv_fd(int sock)
+{
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg = {};
+	struct cmsghdr *cmsg;
+	char data;
+	struct iovec iov = {
+		.iov_base = &data,
+		.iov_len = 1,
+	};
+	int fd;
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	if (recvmsg(sock, &msg, 0) != 1)
+		error(1, errno, "recvmsg");
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+		error(1, 0, "recvmsg: no descriptor");
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+	return fd;
+}
+
+static void do_socketpair(int *sv)
+{
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+		error(1, errno, "socketpair");
+}
+
+/* Returns the witness end to watch */
+static int make_cycle(int type, int id)
+{
+	int a[2], b[2], w[2], fds[2];
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+	socklen_t len;
+
+	do_socketpair(w);
+
+	switch (type) {
+	case 0:
+		/* a[0] queued to itself */
+		do_socketpair(a);
+		fds[0] = a[0];
+		fds[1] = w[0];
+		send_fds(a[1], fds, 2);
+		close(a[0]);
+		close(a[1]);
+		break;
+	case 1:
+		/* a[0] queued to b[0], and the other way around */
+		do_socketpair(a);
+		do_socketpair(b);
+		fds[0] = b[0];
+		fds[1] = w[0];
+		send_fds(a[1], fds, 2);
+		send_fds(b[1], &a[0], 1);
+		close(a[0]);
+		close(a[1]);
+		close(b[0]);
+		close(b[1]);
+		break;
+	default:
+		/* listener queued to its embryo, never accepted */
+		a[0] = socket(AF_UNIX, SOCK_STREAM, 0);
+		a[1] = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (a[0] < 0 || a[1] < 0)
+			error(1, errno, "socket");
+
+		len = offsetof(struct sockaddr_un, sun_path) + 1 +
+		      snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1,
+			       "unix_gc-%d-%d", getpid(), id);
+		if (bind(a[0], (struct sockaddr *)&addr, len))
+			error(1, errno, "bind");
+		if (listen(a[0], 1))
+			error(1, errno, "listen");
+		if (connect(a[1], (struct sockaddr *)&addr, len))
+			error(1, errno, "connect");
+
+		fds[0] = a[0];
+		fds[1] = w[0];
+		send_fds(a[1], fds, 2);
+		close(a[0]);
+		close(a[1]);
+		break;
+	}
+
+	close(w[0]);
+
+	return w[1];
+}
+
+static void *bystander(void *arg)
+{
+	unsigned long long *max_us = arg;
+	int sv[2], other[2];
+
+	do_socketpair(sv);
+	do_socketpair(other);
+
+	while (!stop) {
+		unsigned long long start = now_us(), delta;
+		int fd;
+
+		send_fds(sv[0], &other[0], 1);
+		delta = now_us() - start;
+		if (delta > *max_us)
+			*max_us = delta;
+
+		fd = recv_fd(sv[1]);
+		close(fd);
+	}
+
+	close(sv[0]);
+	close(sv[1]);
+	close(other[0]);
+	close(other[1]);
+
+	return NULL;
+}
+
+static void wait_collected(int *witness, int n)
+{
+	unsigned long long deadline = now_us() + COLLECT_MS * 1000ULL;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		struct pollfd pfd = {
+			.fd = witness[i],
+			.events = POLLIN,
+		};
+		long long left = deadline - now_us();
+		char c;
+
+		if (left < 0 || poll(&pfd, 1, left / 1000) != 1)
+			error(1, 0, "cycle %d not collected", i);
+		if (recv(witness[i], &c, 1, MSG_DONTWAIT))
+			error(1, errno, "witness %d not at EOF", i);
+
+		close(witness[i]);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long max_us = 0;
+	int witness[NR_BATCH];
+	pthread_t thread;
+	int c, i, r;
+
+	while ((c = getopt(argc, argv, "r:")) != -1) {
+		switch (c) {
+		case 'r':
+			cfg_rounds = strtol(optarg, NULL, 0);
+			break;
+		default:
+			error(1, 0, "usage: %s [-r rounds]", argv[0]);
+		}
+	}
+
+	if (pthread_create(&thread, NULL, bystander, &max_us))
+		error(1, errno, "pthread_create");
+
+	for (r = 0; r < cfg_rounds; r++) {
+		for (i = 0; i < NR_BATCH; i++)
+			witness[i] = make_cycle(i % 3, r * NR_BATCH + i);
+
+		wait_collected(witness, NR_BATCH);
+	}
+
+	stop = true;
+	if (pthread_join(thread, NULL))
+		error(1, errno, "pthread_join");
+
+	fprintf(stderr, "collected %d cycles, max bystander sendmsg %llu us\n",
+		cfg_rounds * NR_BATCH, max_us);
+	fprintf(stderr, "ok\n");
+
+	return 0;
+}
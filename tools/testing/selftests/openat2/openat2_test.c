@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * openat2() tests: argument validation, extensible struct handling, and the
+ * RESOLVE_* path resolution restrictions (including RESOLVE_CACHED).
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+
+#include "../kselftest.h"
+
+#ifndef __NR_openat2
+#define __NR_openat2	299
+#endif
+
+#define OPEN_HOW_SIZE_VER0	24
+
+static int sys_openat2(int dfd, const char *path, void *how, size_t size)
+{
+	int ret = syscall(__NR_openat2, dfd, path, how, size);
+
+	return ret >= 0 ? ret : -errno;
+}
+
+static void check(const char *name, int dfd, const char *path,
+		  void *how, size_t size, int expected)
+{
+	int ret = sys_openat2(dfd, path, how, size);
+
+	if (ret >= 0)
+		close(ret);
+	if (expected >= 0 ? ret >= 0 : ret == expected)
+		ksft_test_result_pass("%s\n", name);
+	else
+		ksft_test_result_fail("%s: got %d (%s), expected %d\n", name,
+				      ret, ret < 0 ? strerror(-ret) : "ok",
+				      expected);
+}
+
+static void test_args(int dfd)
+{
+	struct {
+		struct open_how how;
+		__u64 pad;
+	} big = { .how.flags = O_RDONLY };
+	struct open_how how = { .flags = O_RDONLY };
+
+	check("valid struct", dfd, "file", &how, sizeof(how), 0);
+	check("short struct", dfd, "file", &how, OPEN_HOW_SIZE_VER0 - 1,
+	      -EINVAL);
+	check("larger zeroed struct", dfd, "file", &big, sizeof(big), 0);
+	big.pad = 1;
+	check("larger non-zero struct", dfd, "file", &big, sizeof(big), -E2BIG);
+
+	how.flags = O_RDONLY | (1ULL << 40);
+	check("unknown flag", dfd, "file", &how, sizeof(how), -EINVAL);
+	how.flags = O_RDONLY;
+	how.mode = 0644;
+	check("mode without O_CREAT", dfd, "file", &how, sizeof(how), -EINVAL);
+	how.mode = 0;
+	how.flags = O_PATH | O_RDWR;
+	check("O_PATH with O_RDWR", dfd, "file", &how, sizeof(how), -EINVAL);
+	how.flags = O_RDONLY;
+	how.resolve = 1ULL << 40;
+	check("unknown resolve flag", dfd, "file", &how, sizeof(how), -EINVAL);
+	how.resolve = RESOLVE_BENEATH | RESOLVE_IN_ROOT;
+	check("BENEATH with IN_ROOT", dfd, "file", &how, sizeof(how), -EINVAL);
+}
+
+static void test_resolve(int dfd)
+{
+	struct open_how how = { .flags = O_RDONLY };
+
+	how.resolve = RESOLVE_BENEATH;
+	check("beneath: plain", dfd, "dir/../file", &how, sizeof(how), 0);
+	check("beneath: dotdot escape", dfd, "../", &how, sizeof(how), -EXDEV);
+	check("beneath: absolute", dfd, "/", &how, sizeof(how), -EXDEV);
+	check("beneath: absolute symlink", dfd, "abslink", &how, sizeof(how),
+	      -EXDEV);
+
+	how.resolve = RESOLVE_IN_ROOT;
+	check("in_root: dotdot clamped", dfd, "../../file", &how, sizeof(how), 0);
+	check("in_root: absolute", dfd, "/file", &how, sizeof(how), 0);
+	check("in_root: absolute symlink", dfd, "abslink", &how, sizeof(how), 0);
+
+	how.resolve = RESOLVE_NO_SYMLINKS;
+	check("no_symlinks: symlink", dfd, "rellink", &how, sizeof(how), -ELOOP);
+	how.flags = O_PATH | O_NOFOLLOW;
+	check("no_symlinks: O_PATH|O_NOFOLLOW", dfd, "rellink", &how,
+	      sizeof(how), 0);
+
+	how.flags = O_RDONLY;
+	how.resolve = RESOLVE_NO_MAGICLINKS;
+	check("no_magiclinks: symlink", dfd, "rellink", &how, sizeof(how), 0);
+	check("no_magiclinks: magic-link", AT_FDCWD, "/proc/self/exe", &how,
+	      sizeof(how), -ELOOP);
+
+	how.resolve = RESOLVE_NO_XDEV;
+	check("no_xdev: same mount", dfd, "file", &how, sizeof(how), 0);
+	check("no_xdev: into /proc", AT_FDCWD, "/proc/self/status", &how,
+	      sizeof(how), -EXDEV);
+}
+
+static void test_cached(int dfd)
+{
+	struct open_how how = { .flags = O_RDONLY };
+	int ret;
+
+	/* Warm the dcache; a cached lookup may still fail if it was evicted. */
+	check("cached: uncached lookup", dfd, "file", &how, sizeof(how), 0);
+	how.resolve = RESOLVE_CACHED;
+	ret = sys_openat2(dfd, "file", &how, sizeof(how));
+	if (ret >= 0) {
+		close(ret);
+		ksft_test_result_pass("cached: warm lookup\n");
+	} else if (ret == -EAGAIN) {
+		ksft_test_result_skip("cached: warm lookup not in dcache\n");
+	} else {
+		ksft_test_result_fail("cached: warm lookup: %s\n",
+				      strerror(-ret));
+	}
+
+	how.flags = O_RDWR | O_TRUNC;
+	check("cached: O_TRUNC", dfd, "file", &how, sizeof(how), -EAGAIN);
+	how.flags = O_RDWR | O_CREAT;
+	how.mode = 0644;
+	check("cached: O_CREAT", dfd, "newfile", &how, sizeof(how), -EAGAIN);
+}
+
+int main(void)
+{
+	char tmpl[] = "/tmp/openat2_test.XXXXXX";
+	struct open_how how = { .flags = O_RDONLY };
+	int dfd, fd;
+
+	ksft_print_header();
+
+	if (sys_openat2(AT_FDCWD, ".", &how, sizeof(how)) == -ENOSYS)
+		ksft_exit_skip("openat2 not supported\n");
+
+	if (!mkdtemp(tmpl))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+	dfd = open(tmpl, O_PATH | O_DIRECTORY);
+	if (dfd < 0)
+		ksft_exit_fail_msg("open %s: %s\n", tmpl, strerror(errno));
+
+	fd = openat(dfd, "file", O_CREAT | O_WRONLY, 0644);
+	if (fd < 0)
+		ksft_exit_fail_msg("create file: %s\n", strerror(errno));
+	close(fd);
+	if (mkdirat(dfd, "dir", 0755) || symlinkat("file", dfd, "rellink") ||
+	    symlinkat("/file", dfd, "abslink"))
+		ksft_exit_fail_msg("setup: %s\n", strerror(errno));
+
+	test_args(dfd);
+	test_resolve(dfd);
+	test_cached(dfd);
+
+	unlinkat(dfd, "abslink", 0);
+	unlinkat(dfd, "rellink", 0);
+	unlinkat(dfd, "dir", AT_REMOVEDIR);
+	unlinkat(dfd, "file", 0);
+	close(dfd);
+	rmdir(tmpl);
+
+	return ksft_exit_pass();
+}
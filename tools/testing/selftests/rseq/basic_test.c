@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: LGPL-2.1
 /*
- * Basic test coverage for critical regions and rseq_current_cpu().
+ * Basic test coverage for critical regions, rseq_current_cpu() and
+ * rseq_current_mm_cid().
  */
 
 #define _GNU_SOURCE
@@ -35,6 +36,12 @@ void test_cpu_pointer(void)
 	sched_setaffinity(0, sizeof(affinity), &affinity);
 }
 
+void test_mm_cid(void)
+{
+	/* The only thread of this process always gets the first id. */
+	assert(rseq_current_mm_cid() == 0);
+}
+
 int main(int argc, char **argv)
 {
 	if (rseq_register_current_thread()) {
@@ -44,6 +51,8 @@ int main(int argc, char **argv)
 	}
 	printf("testing current cpu\n");
 	test_cpu_pointer();
+	printf("testing current mm_cid\n");
+	test_mm_cid();
 	if (rseq_unregister_current_thread()) {
 		fprintf(stderr, "Error: rseq_unregister_current_thread(...) failed(%d): %s\n",
 			errno, strerror(errno));
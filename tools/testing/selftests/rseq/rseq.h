@@ -137,6 +137,15 @@ static inline uint32_t rseq_current_cpu(void)
 	return cpu;
 }
 
+/*
+ * Returns the concurrency id of the current thread within its memory
+ * map. Only valid while rseq is registered for the current thread.
+ */
+static inline uint32_t rseq_current_mm_cid(void)
+{
+	return RSEQ_ACCESS_ONCE(__rseq_abi.mm_cid);
+}
+
 static inline void rseq_clear_rseq_cs(void)
 {
 #ifdef __LP64__
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Measure fork() latency against the resident set size of the parent,
+ * with the page tables copied as usual and with them shared through
+ * PR_SET_FORK_SHARE_PTE, and how long the child then takes to write all
+ * of its memory once.
+ *
+ * THP is disabled on the mapping, so that fork() has PTE tables to copy.
+ *
+ * Usage: fork_bench [-s max_size_mb] [-w]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#ifndef PR_SET_FORK_SHARE_PTE
+#define PR_SET_FORK_SHARE_PTE	56
+#endif
+
+static unsigned long page_size;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the fork() latency, and the child's write time in *write_us */
+static double bench_fork(char *buf, unsigned long size, int touch,
+			 double *write_us)
+{
+	int pipefd[2], status;
+	double t, fork_us;
+	pid_t pid;
+
+	if (pipe(pipefd))
+		err(1, "pipe");
+
+	t = now();
+	pid = fork();
+	if (pid < 0)
+		err(1, "fork");
+	if (!pid) {
+		double w = 0;
+		unsigned long i;
+
+		if (touch) {
+			w = now();
+			for (i = 0; i < size; i += page_size)
+				buf[i]++;
+			w = (now() - w) * 1e6;
+		}
+		if (write(pipefd[1], &w, sizeof(w)) != sizeof(w))
+			_exit(1);
+		_exit(0);
+	}
+	fork_us = (now() - t) * 1e6;
+
+	if (read(pipefd[0], write_us, sizeof(*write_us)) != sizeof(*write_us))
+		errx(1, "child failed");
+	if (waitpid(pid, &status, 0) != pid || status)
+		errx(1, "child failed");
+	close(pipefd[0]);
+	close(pipefd[1]);
+	return fork_us;
+}
+
+static void bench(unsigned long size, int touch)
+{
+	double copy_us, share_us, copy_write_us, share_write_us;
+	char *buf;
+
+	buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		err(1, "mmap");
+	madvise(buf, size, MADV_NOHUGEPAGE);
+	memset(buf, 1, size);
+
+	if (prctl(PR_SET_FORK_SHARE_PTE, 0, 0, 0, 0))
+		err(1, "PR_SET_FORK_SHARE_PTE");
+	copy_us = bench_fork(buf, size, touch, &copy_write_us);
+
+	if (prctl(PR_SET_FORK_SHARE_PTE, 1, 0, 0, 0))
+		err(1, "PR_SET_FORK_SHARE_PTE");
+	share_us = bench_fork(buf, size, touch, &share_write_us);
+
+	munmap(buf, size);
+
+	printf("%8lu MB: fork copy %10.0f us, share %10.0f us",
+	       size >> 20, copy_us, share_us);
+	if (touch)
+		printf("; child write copy %10.0f us, share %10.0f us",
+		       copy_write_us, share_write_us);
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long max_size = 4096, size;
+	int opt, touch = 0;
+
+	while ((opt = getopt(argc, argv, "s:w")) != -1) {
+		switch (opt) {
+		case 's':
+			max_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			touch = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s max_size_mb] [-w]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	for (size = 64; size < max_size; size *= 2)
+		bench(size << 20, touch);
+	bench(max_size << 20, touch);
+	return 0;
+}
@@ -0,0 +1,711 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Memory management microbenchmarks, to compare kernels with.
+ *
+ *   fault-anon	write faults on private anonymous memory
+ *   fault-file	read faults on shared mappings of a file in page cache
+ *   fault-thp	write faults on anonymous memory with MADV_HUGEPAGE
+ *   mmap	mmap(), first touch and munmap() of 16 pages, all threads
+ *		sharing the address space
+ *   alloc	alloc_pages() and __free_pages() latency for each order
+ *   compact	THP-like allocations after every other page of memory was
+ *		freed, reporting how many succeed
+ *   reclaim	faults while allocating more anonymous memory than is free,
+ *		with page cache to reclaim (not run by default)
+ *
+ * Each test runs once for every thread count, the threads bound to the
+ * CPUs and the memory of a node with -n.  The fault tests time the first
+ * touch of every page or huge page, so fault-around is included for
+ * files.  alloc and compact need CONFIG_MM_BENCHMARK, and report the
+ * worst percentiles of the threads, as computed by the kernel.
+ *
+ * Results are printed as one JSON object per line.
+ *
+ * Usage: mm_bench [-t threads[,threads...]] [-n node] [-s size_mb]
+ *		   [-i iterations] [-o order[,order...]] [-c count]
+ *		   [-b batch] [-d dir] [test...]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <err.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <linux/types.h>
+#include <linux/mempolicy.h>
+
+#define MB (1UL << 20)
+
+#define MM_BENCH_ALLOC		_IOWR('m', 1, struct mm_benchmark)
+#define MM_BENCH_COMPACT	_IOWR('m', 2, struct mm_benchmark)
+
+#define NR_PCT			5
+
+struct mm_benchmark {
+	__u32 order;
+	__s32 nid;
+	__u32 count;
+	__u32 batch;
+	__u32 nr_done;
+	__u32 flags;
+	__u64 alloc_ns[NR_PCT];
+	__u64 free_ns[NR_PCT];
+	__u64 expansion[8];
+};
+
+static const char * const pct_names[NR_PCT] = {
+	"p50_ns", "p90_ns", "p99_ns", "p999_ns", "max_ns",
+};
+static const unsigned int pct_permille[NR_PCT] = { 500, 900, 990, 999, 1000 };
+
+struct bench_thread {
+	pthread_t tid;
+	int idx;
+	unsigned long long start, end;
+	unsigned long long *lat;
+	unsigned long nr_lat;
+	/* the kernel side tests */
+	struct mm_benchmark mmb;
+	/* memory held until the test is over */
+	char *map;
+	unsigned long map_size;
+};
+
+static unsigned long page_size, thp_size;
+static unsigned long size = 64 * MB;
+static unsigned long iters = 4;
+static unsigned long count = 100000, batch = 32;
+static int node = -1;
+static const char *dir = "/tmp";
+
+static int nr_threads;
+static struct bench_thread *threads;
+static pthread_barrier_t barrier;
+static int cur_order;
+
+static int bench_fd = -1;
+static int *files;
+static char *frag_map;
+static unsigned long frag_size;
+static unsigned long long pgsteal_start;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void samples_alloc(struct bench_thread *bt, unsigned long nr)
+{
+	bt->lat = malloc(nr * sizeof(*bt->lat));
+	if (!bt->lat)
+		err(1, "malloc");
+	bt->nr_lat = 0;
+}
+
+static inline void sample(struct bench_thread *bt, unsigned long long t)
+{
+	bt->lat[bt->nr_lat++] = now_ns() - t;
+}
+
+static char *map_anon(unsigned long len, unsigned long align, int advice)
+{
+	char *p;
+
+	p = mmap(NULL, len + align, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+		err(1, "mmap");
+	if (align) {
+		unsigned long off = -(unsigned long)p & (align - 1);
+
+		munmap(p, off);
+		munmap(p + off + len, align - off);
+		p += off;
+	}
+	if (madvise(p, len, advice) && advice == MADV_HUGEPAGE)
+		err(1, "madvise(MADV_HUGEPAGE)");
+	return p;
+}
+
+static void touch(struct bench_thread *bt, char *p, unsigned long len,
+		  unsigned long step, int write)
+{
+	unsigned long long t;
+	unsigned long off;
+
+	for (off = 0; off < len; off += step) {
+		t = now_ns();
+		if (write)
+			p[off] = 1;
+		else
+			(void)*(volatile char *)(p + off);
+		sample(bt, t);
+	}
+}
+
+static void run_fault_anon(struct bench_thread *bt)
+{
+	unsigned long i;
+
+	samples_alloc(bt, size / page_size * iters);
+	for (i = 0; i < iters; i++) {
+		char *p = map_anon(size, 0, MADV_NOHUGEPAGE);
+
+		touch(bt, p, size, page_size, 1);
+		munmap(p, size);
+	}
+}
+
+static void run_fault_thp(struct bench_thread *bt)
+{
+	unsigned long i;
+
+	samples_alloc(bt, size / thp_size * iters);
+	for (i = 0; i < iters; i++) {
+		char *p = map_anon(size, thp_size, MADV_HUGEPAGE);
+
+		touch(bt, p, size, thp_size, 1);
+		munmap(p, size);
+	}
+}
+
+static void create_files(int nr, unsigned long len)
+{
+	char *buf, path[4096];
+	unsigned long off;
+	int i;
+
+	buf = malloc(MB);
+	if (!buf)
+		err(1, "malloc");
+	memset(buf, 1, MB);
+
+	files = calloc(nr, sizeof(*files));
+	if (!files)
+		err(1, "calloc");
+	for (i = 0; i < nr; i++) {
+		snprintf(path, sizeof(path), "%s/mm_bench.XXXXXX", dir);
+		files[i] = mkstemp(path);
+		if (files[i] < 0)
+			err(1, "mkstemp %s", path);
+		unlink(path);
+		/* Written once, so that the test only finds page cache */
+		for (off = 0; off < len; off += MB)
+			if (pwrite(files[i], buf, MB, off) != MB)
+				err(1, "pwrite");
+	}
+	free(buf);
+}
+
+static void close_files(int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		close(files[i]);
+	free(files);
+}
+
+static int setup_fault_file(void)
+{
+	create_files(nr_threads, size);
+	return 0;
+}
+
+static void run_fault_file(struct bench_thread *bt)
+{
+	unsigned long i;
+
+	samples_alloc(bt, size / page_size * iters);
+	for (i = 0; i < iters; i++) {
+		char *p = mmap(NULL, size, PROT_READ, MAP_SHARED,
+			       files[bt->idx], 0);
+
+		if (p == MAP_FAILED)
+			err(1, "mmap");
+		touch(bt, p, size, page_size, 0);
+		munmap(p, size);
+	}
+}
+
+static void teardown_fault_file(void)
+{
+	close_files(nr_threads);
+}
+
+#define MMAP_OPS_PER_ITER	10000
+#define MMAP_PAGES		16
+
+static void run_mmap(struct bench_thread *bt)
+{
+	unsigned long i, len = MMAP_PAGES * page_size;
+	unsigned long long t;
+
+	samples_alloc(bt, iters * MMAP_OPS_PER_ITER);
+	for (i = 0; i < iters * MMAP_OPS_PER_ITER; i++) {
+		char *p;
+
+		t = now_ns();
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			err(1, "mmap");
+		p[0] = 1;
+		munmap(p, len);
+		sample(bt, t);
+	}
+}
+
+static int open_bench_fd(void)
+{
+	if (bench_fd >= 0)
+		return 0;
+
+	bench_fd = open("/sys/kernel/debug/mm_benchmark", O_RDWR);
+	if (bench_fd < 0) {
+		warn("open /sys/kernel/debug/mm_benchmark (CONFIG_MM_BENCHMARK?)");
+		return -1;
+	}
+	return 0;
+}
+
+static void run_kernel(struct bench_thread *bt, unsigned int cmd,
+		       unsigned long nr)
+{
+	bt->mmb.order = cur_order;
+	bt->mmb.nid = node;
+	bt->mmb.count = nr;
+	bt->mmb.batch = batch;
+	if (ioctl(bench_fd, cmd, &bt->mmb))
+		err(1, "ioctl");
+}
+
+static void run_alloc(struct bench_thread *bt)
+{
+	unsigned long nr = count >> cur_order;
+
+	run_kernel(bt, MM_BENCH_ALLOC, nr < 16 ? 16 : nr);
+}
+
+/*
+ * Fill memory with 4k pages and free every other one, so that no free
+ * block of the THP order is left there without compaction.
+ */
+static int setup_compact(void)
+{
+	unsigned long off;
+
+	if (open_bench_fd())
+		return -1;
+
+	frag_size = size * nr_threads;
+	frag_map = map_anon(frag_size, 0, MADV_NOHUGEPAGE);
+	for (off = 0; off < frag_size; off += page_size)
+		frag_map[off] = 1;
+	for (off = 0; off < frag_size; off += 2 * page_size)
+		madvise(frag_map + off, page_size, MADV_DONTNEED);
+	return 0;
+}
+
+static void run_compact(struct bench_thread *bt)
+{
+	unsigned long nr = frag_size / 2 / (page_size << cur_order);
+
+	nr /= nr_threads;
+	run_kernel(bt, MM_BENCH_COMPACT, nr ? nr : 1);
+}
+
+static void teardown_compact(void)
+{
+	munmap(frag_map, frag_size);
+}
+
+static unsigned long long read_pgsteal(void)
+{
+	unsigned long long total = 0, val;
+	char name[64];
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		err(1, "/proc/vmstat");
+	while (fscanf(f, "%63s %llu", name, &val) == 2)
+		if (!strncmp(name, "pgsteal_", 8))
+			total += val;
+	fclose(f);
+	return total;
+}
+
+static unsigned long read_memfree(void)
+{
+	unsigned long kb = 0;
+	char line[256];
+	FILE *f;
+
+	f = fopen("/proc/meminfo", "r");
+	if (!f)
+		err(1, "/proc/meminfo");
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "MemFree: %lu kB", &kb) == 1)
+			break;
+	fclose(f);
+	return kb * 1024;
+}
+
+/*
+ * Put size * threads of a file in page cache, then have the threads
+ * allocate what is free plus half of that, so that the page cache has to
+ * be reclaimed for the faults to complete.
+ */
+static int setup_reclaim(void)
+{
+	unsigned long memfree;
+	int i;
+
+	create_files(1, size * nr_threads);
+	memfree = read_memfree();
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].map_size = (memfree + size * nr_threads / 2) /
+				      nr_threads;
+		threads[i].map_size &= ~(page_size - 1);
+	}
+	pgsteal_start = read_pgsteal();
+	return 0;
+}
+
+static void run_reclaim(struct bench_thread *bt)
+{
+	samples_alloc(bt, bt->map_size / page_size);
+	bt->map = map_anon(bt->map_size, 0, MADV_NOHUGEPAGE);
+	touch(bt, bt->map, bt->map_size, page_size, 1);
+}
+
+static void teardown_reclaim(void)
+{
+	int i;
+
+	for (i = 0; i < nr_threads; i++)
+		munmap(threads[i].map, threads[i].map_size);
+	close_files(1);
+}
+
+struct bench {
+	const char *name;
+	int (*setup)(void);
+	void (*run)(struct bench_thread *bt);
+	void (*teardown)(void);
+	/* the kernel computes the percentiles, for each order */
+	int kernel;
+	int by_default;
+};
+
+static const struct bench benches[] = {
+	{ "fault-anon", NULL, run_fault_anon, NULL, 0, 1 },
+	{ "fault-file", setup_fault_file, run_fault_file,
+	  teardown_fault_file, 0, 1 },
+	{ "fault-thp", NULL, run_fault_thp, NULL, 0, 1 },
+	{ "mmap", NULL, run_mmap, NULL, 0, 1 },
+	{ "alloc", open_bench_fd, run_alloc, NULL, 1, 1 },
+	{ "compact", setup_compact, run_compact, teardown_compact, 1, 1 },
+	{ "reclaim", setup_reclaim, run_reclaim, teardown_reclaim, 0, 0 },
+};
+
+static void bind_node(void)
+{
+	char path[64], list[4096], *s;
+	unsigned long mask[16] = { 0 };
+	cpu_set_t cpus;
+	FILE *f;
+
+	if (node < 0)
+		return;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/node/node%d/cpulist", node);
+	f = fopen(path, "r");
+	if (!f || !fgets(list, sizeof(list), f))
+		err(1, "%s", path);
+	fclose(f);
+
+	CPU_ZERO(&cpus);
+	for (s = strtok(list, ",\n"); s; s = strtok(NULL, ",\n")) {
+		int first, last;
+
+		if (sscanf(s, "%d-%d", &first, &last) != 2)
+			last = first = atoi(s);
+		for (; first <= last; first++)
+			CPU_SET(first, &cpus);
+	}
+	/* A node without CPUs still gets the memory bound to it */
+	if (CPU_COUNT(&cpus) && sched_setaffinity(0, sizeof(cpus), &cpus))
+		err(1, "sched_setaffinity");
+
+	if (node >= (int)(sizeof(mask) * 8))
+		errx(1, "node %d out of range", node);
+	mask[node / (8 * sizeof(long))] |= 1UL << (node % (8 * sizeof(long)));
+	if (syscall(__NR_set_mempolicy, MPOL_BIND, mask, sizeof(mask) * 8))
+		err(1, "set_mempolicy");
+}
+
+static const struct bench *cur_bench;
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+
+	bind_node();
+	pthread_barrier_wait(&barrier);
+	bt->start = now_ns();
+	cur_bench->run(bt);
+	bt->end = now_ns();
+	return NULL;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, unsigned long ops, double secs,
+		   const unsigned long long *pct, const char *extra)
+{
+	int i;
+
+	printf("{\"test\":\"%s\",\"threads\":%d,\"node\":%d,",
+	       name, nr_threads, node);
+	if (cur_bench->kernel)
+		printf("\"order\":%d,", cur_order);
+	printf("\"ops\":%lu,\"ops_per_sec\":%.0f", ops, ops / secs);
+	for (i = 0; i < NR_PCT; i++)
+		printf(",\"%s\":%llu", pct_names[i], pct[i]);
+	printf("%s}\n", extra);
+	fflush(stdout);
+}
+
+static void report_user(double secs)
+{
+	unsigned long long *all, pct[NR_PCT] = { 0 };
+	unsigned long nr = 0, idx;
+	char extra[128] = "";
+	int i;
+
+	for (i = 0; i < nr_threads; i++)
+		nr += threads[i].nr_lat;
+	all = malloc((nr ? nr : 1) * sizeof(*all));
+	if (!all)
+		err(1, "malloc");
+	nr = 0;
+	for (i = 0; i < nr_threads; i++) {
+		memcpy(all + nr, threads[i].lat,
+		       threads[i].nr_lat * sizeof(*all));
+		nr += threads[i].nr_lat;
+		free(threads[i].lat);
+	}
+
+	qsort(all, nr, sizeof(*all), cmp_ull);
+	for (i = 0; nr && i < NR_PCT; i++) {
+		idx = (unsigned long long)nr * pct_permille[i] / 1000;
+		pct[i] = all[idx < nr ? idx : nr - 1];
+	}
+	free(all);
+
+	if (cur_bench->run == run_reclaim) {
+		unsigned long long pages = read_pgsteal() - pgsteal_start;
+
+		snprintf(extra, sizeof(extra),
+			 ",\"reclaimed_pages\":%llu,\"reclaim_mb_per_sec\":%.1f",
+			 pages, pages * page_size / (double)MB / secs);
+	}
+	report(cur_bench->name, nr, secs, pct, extra);
+}
+
+static void report_kernel(double secs)
+{
+	unsigned long long alloc_pct[NR_PCT] = { 0 }, free_pct[NR_PCT] = { 0 };
+	unsigned long ops = 0, done = 0;
+	char extra[64];
+	int i, j;
+
+	for (i = 0; i < nr_threads; i++) {
+		struct mm_benchmark *mmb = &threads[i].mmb;
+
+		ops += mmb->count;
+		done += mmb->nr_done;
+		for (j = 0; j < NR_PCT; j++) {
+			if (mmb->alloc_ns[j] > alloc_pct[j])
+				alloc_pct[j] = mmb->alloc_ns[j];
+			if (mmb->free_ns[j] > free_pct[j])
+				free_pct[j] = mmb->free_ns[j];
+		}
+	}
+
+	snprintf(extra, sizeof(extra), ",\"success\":%lu", done);
+	report(cur_bench->name, ops, secs, alloc_pct, extra);
+	if (cur_bench->run == run_alloc)
+		report("free", done, secs, free_pct, "");
+}
+
+static void run_bench(const struct bench *b)
+{
+	unsigned long long start = ~0ULL, end = 0;
+	double secs;
+	int i;
+
+	cur_bench = b;
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		err(1, "calloc");
+	if (pthread_barrier_init(&barrier, NULL, nr_threads + 1))
+		errx(1, "pthread_barrier_init");
+
+	if (b->setup && b->setup())
+		goto out;
+
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].idx = i;
+		if (pthread_create(&threads[i].tid, NULL, bench_thread_fn,
+				   &threads[i]))
+			errx(1, "pthread_create");
+	}
+	pthread_barrier_wait(&barrier);
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].tid, NULL);
+		if (threads[i].start < start)
+			start = threads[i].start;
+		if (threads[i].end > end)
+			end = threads[i].end;
+	}
+	secs = (end - start) / 1e9;
+
+	if (b->kernel)
+		report_kernel(secs);
+	else
+		report_user(secs);
+
+	if (b->teardown)
+		b->teardown();
+out:
+	pthread_barrier_destroy(&barrier);
+	free(threads);
+}
+
+static int parse_list(const char *arg, int *vals, int max)
+{
+	char *copy = strdup(arg), *s;
+	int n = 0;
+
+	for (s = strtok(copy, ","); s && n < max; s = strtok(NULL, ","))
+		vals[n++] = atoi(s);
+	free(copy);
+	return n;
+}
+
+static unsigned long read_thp_size(void)
+{
+	unsigned long val = 0;
+	FILE *f;
+
+	f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+	if (f) {
+		if (fscanf(f, "%lu", &val) != 1)
+			val = 0;
+		fclose(f);
+	}
+	return val ? val : 2 * MB;
+}
+
+int main(int argc, char **argv)
+{
+	int thread_counts[64] = { 1 }, nr_counts = 1;
+	int orders[32] = { 0, 1, 2, 3 }, nr_orders = 4;
+	int opt, i, j, k, thp_order;
+
+	while ((opt = getopt(argc, argv, "t:n:s:i:o:c:b:d:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_counts = parse_list(optarg, thread_counts, 64);
+			break;
+		case 'n':
+			node = atoi(optarg);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0) * MB;
+			break;
+		case 'i':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			nr_orders = parse_list(optarg, orders, 32);
+			break;
+		case 'c':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads[,threads...]] [-n node] [-s size_mb] [-i iterations]\n"
+				"\t[-o order[,order...]] [-c count] [-b batch] [-d dir] [test...]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	thp_size = read_thp_size();
+	for (thp_order = 0; (page_size << thp_order) < thp_size; thp_order++)
+		;
+	size = (size + thp_size - 1) & ~(thp_size - 1);
+
+	for (i = 0; i < (int)(sizeof(benches) / sizeof(benches[0])); i++) {
+		const struct bench *b = &benches[i];
+
+		if (optind < argc) {
+			for (j = optind; j < argc; j++)
+				if (!strcmp(argv[j], b->name))
+					break;
+			if (j == argc)
+				continue;
+		} else if (!b->by_default) {
+			continue;
+		}
+
+		for (j = 0; j < nr_counts; j++) {
+			nr_threads = thread_counts[j];
+			if (nr_threads < 1)
+				errx(1, "bad thread count %d", nr_threads);
+
+			if (b->run == run_alloc) {
+				for (k = 0; k < nr_orders; k++) {
+					cur_order = orders[k];
+					run_bench(b);
+				}
+			} else {
+				cur_order = thp_order;
+				run_bench(b);
+			}
+		}
+	}
+
+	if (bench_fd >= 0)
+		close(bench_fd);
+	return 0;
+}
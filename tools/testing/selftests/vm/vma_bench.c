@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Measure mmap/munmap and page fault rates against the number of VMAs in
+ * the address space, to watch how find_vma() and friends scale.
+ *
+ * The VMAs are made by punching a hole in every other page of a large
+ * mapping, so that they cannot merge.
+ *
+ * Usage: vma_bench [-n max_vmas] [-i iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+#include <sys/mman.h>
+
+static unsigned long page_size;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Cheap PRNG, so that the benchmark does not measure random() */
+static unsigned long rnd(void)
+{
+	static unsigned long x = 88172645463325252UL;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return x;
+}
+
+static char *make_vmas(unsigned long nr)
+{
+	unsigned long i;
+	char *base;
+
+	base = mmap(NULL, 2 * nr * page_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED)
+		err(1, "mmap");
+
+	for (i = 0; i < nr; i++)
+		if (munmap(base + (2 * i + 1) * page_size, page_size))
+			err(1, "munmap (is vm.max_map_count large enough?)");
+	return base;
+}
+
+static void bench(unsigned long nr, unsigned long iters)
+{
+	char *base = make_vmas(nr);
+	double t, fault_ns, mmap_ns;
+	unsigned long i;
+
+	/* Faults on random VMAs, zapping the page again each time */
+	t = now();
+	for (i = 0; i < iters; i++) {
+		char *p = base + 2 * (rnd() % nr) * page_size;
+
+		*(volatile char *)p = 1;
+		if (madvise(p, page_size, MADV_DONTNEED))
+			err(1, "madvise");
+	}
+	fault_ns = (now() - t) * 1e9 / iters;
+
+	/* mmap() and munmap() a page in a random hole */
+	t = now();
+	for (i = 0; i < iters; i++) {
+		char *p = base + (2 * (rnd() % nr) + 1) * page_size;
+
+		if (mmap(p, page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS |
+			 MAP_FIXED, -1, 0) != p)
+			err(1, "mmap fixed");
+		if (munmap(p, page_size))
+			err(1, "munmap");
+	}
+	mmap_ns = (now() - t) * 1e9 / iters;
+
+	munmap(base, 2 * nr * page_size);
+
+	printf("%10lu vmas: fault+zap %8.0f ns, mmap+munmap %8.0f ns\n",
+	       nr, fault_ns, mmap_ns);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long max_vmas = 60000, iters = 100000, nr;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:i:")) != -1) {
+		switch (opt) {
+		case 'n':
+			max_vmas = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n max_vmas] [-i iterations]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	for (nr = 16; nr < max_vmas; nr *= 4)
+		bench(nr, iters);
+	bench(max_vmas, iters);
+	return 0;
+}
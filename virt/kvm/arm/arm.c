@@ -1219,6 +1219,31 @@ int kvm_vm_ioctl_get_dirty_log(struct kvm *kvm, struct kvm_dirty_log *log)
 	return r;
 }
 
+/**
+ * kvm_vm_ioctl_clear_dirty_log - clear and re-protect a range of a slot
+ * @kvm: kvm instance
+ * @log: slot id, range and address of the bitmap of pages to clear
+ *
+ * Used with KVM_CAP_MANUAL_DIRTY_LOG_PROTECT, see
+ * kvm_clear_dirty_log_protect().
+ */
+int kvm_vm_ioctl_clear_dirty_log(struct kvm *kvm,
+				 struct kvm_clear_dirty_log *log)
+{
+	bool flush = false;
+	int r;
+
+	mutex_lock(&kvm->slots_lock);
+
+	r = kvm_clear_dirty_log_protect(kvm, log, &flush);
+
+	if (flush)
+		kvm_flush_remote_tlbs(kvm);
+
+	mutex_unlock(&kvm->slots_lock);
+	return r;
+}
+
 static int kvm_vm_ioctl_set_device_addr(struct kvm *kvm,
 					struct kvm_arm_device_addr *dev_addr)
 {
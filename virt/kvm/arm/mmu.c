@@ -2042,8 +2042,14 @@ void kvm_arch_commit_memory_region(struct kvm *kvm,
 	 * At this point memslot has been committed and there is an
 	 * allocated dirty_bitmap[], dirty pages will be be tracked while the
 	 * memory slot is write protected.
+	 *
+	 * With initially-all-set bitmaps every page is already reported
+	 * dirty: leave the slot mapped and let KVM_CLEAR_DIRTY_LOG write
+	 * protect it range by range, block mappings included, as user space
+	 * gets to each range.
 	 */
-	if (change != KVM_MR_DELETE && mem->flags & KVM_MEM_LOG_DIRTY_PAGES)
+	if (change != KVM_MR_DELETE && mem->flags & KVM_MEM_LOG_DIRTY_PAGES &&
+	    !kvm_dirty_log_manual_protect_and_init_set(kvm))
 		kvm_mmu_wp_memory_region(kvm, mem->slot);
 }
 
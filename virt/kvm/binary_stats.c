@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KVM binary statistics interface implementation
+ *
+ * Each VM and vcpu can hand out a read-only fd laid out as described in
+ * include/uapi/linux/kvm.h: a header, an id string, one descriptor per
+ * statistic and the values.  The statistics are the arch's debugfs_entries
+ * plus the generic halt statistics of every vcpu, so a monitoring agent
+ * gets all of them with a single pread() instead of a debugfs file each.
+ */
+
+#include <linux/kvm_host.h>
+#include <linux/kvm.h>
+#include <linux/anon_inodes.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+
+#define KVM_STATS_NAME_SIZE	48
+
+/* Where a statistic lives in struct kvm or struct kvm_vcpu. */
+struct kvm_stat_source {
+	const char *name;
+	u32 flags;
+	s16 exponent;
+	u16 size;
+	u32 offset;
+	/* VM statistics of the debugfs_entries are unsigned long */
+	bool is_ulong;
+};
+
+#define HALT_STAT_NS(x)							\
+	{ #x, KVM_STATS_TYPE_CUMULATIVE | KVM_STATS_UNIT_SECONDS |	\
+	  KVM_STATS_BASE_POW10, -9, 1,					\
+	  offsetof(struct kvm_vcpu, halt_stat.x), false }
+#define HALT_STAT_HIST(x)						\
+	{ #x, KVM_STATS_TYPE_LOG_HIST | KVM_STATS_UNIT_SECONDS |	\
+	  KVM_STATS_BASE_POW10, -9, HALT_POLL_HIST_COUNT,		\
+	  offsetof(struct kvm_vcpu, halt_stat.x), false }
+
+static const struct kvm_stat_source halt_stat_sources[] = {
+	HALT_STAT_NS(halt_poll_success_ns),
+	HALT_STAT_NS(halt_poll_fail_ns),
+	HALT_STAT_NS(halt_wait_ns),
+	HALT_STAT_HIST(halt_poll_success_hist),
+	HALT_STAT_HIST(halt_poll_fail_hist),
+	HALT_STAT_HIST(halt_wait_hist),
+	HALT_STAT_HIST(halt_wakeup_latency_hist),
+};
+
+struct kvm_stats_file {
+	struct kvm *kvm;
+	/* NULL for the statistics of the VM */
+	struct kvm_vcpu *vcpu;
+	struct kvm_stat_source *sources;
+	u32 num_sources;
+	/* Serializes the refresh of the data block by concurrent readers */
+	struct mutex lock;
+	size_t size;
+	size_t data_offset;
+	char *image;
+};
+
+static void kvm_stats_source_from_debugfs(struct kvm_stat_source *source,
+					  struct kvm_stats_debugfs_item *item)
+{
+	source->name = item->name;
+	source->flags = KVM_STATS_TYPE_CUMULATIVE | KVM_STATS_UNIT_NONE |
+			KVM_STATS_BASE_POW10;
+	source->exponent = 0;
+	source->size = 1;
+	source->offset = item->offset;
+	source->is_ulong = item->kind == KVM_STAT_VM;
+}
+
+static int kvm_stats_build_sources(struct kvm_stats_file *stats_file)
+{
+	enum kvm_stat_kind kind = stats_file->vcpu ? KVM_STAT_VCPU :
+						     KVM_STAT_VM;
+	struct kvm_stats_debugfs_item *item;
+	u32 n = 0;
+	int i;
+
+	for (item = debugfs_entries; item->name; item++)
+		if (item->kind == kind)
+			n++;
+	if (stats_file->vcpu)
+		n += ARRAY_SIZE(halt_stat_sources);
+
+	stats_file->sources = kcalloc(n, sizeof(*stats_file->sources),
+				      GFP_KERNEL);
+	if (!stats_file->sources)
+		return -ENOMEM;
+
+	n = 0;
+	for (item = debugfs_entries; item->name; item++)
+		if (item->kind == kind)
+			kvm_stats_source_from_debugfs(&stats_file->sources[n++],
+						      item);
+	if (stats_file->vcpu)
+		for (i = 0; i < ARRAY_SIZE(halt_stat_sources); i++)
+			stats_file->sources[n++] = halt_stat_sources[i];
+
+	stats_file->num_sources = n;
+	return 0;
+}
+
+/* Lay out and fill everything but the data block, which reads refresh. */
+static int kvm_stats_build_image(struct kvm_stats_file *stats_file)
+{
+	size_t desc_size = sizeof(struct kvm_stats_desc) + KVM_STATS_NAME_SIZE;
+	struct kvm_stats_header *header;
+	struct kvm_stats_desc *desc;
+	size_t data_size = 0;
+	u32 i;
+
+	for (i = 0; i < stats_file->num_sources; i++)
+		data_size += stats_file->sources[i].size * sizeof(u64);
+
+	stats_file->data_offset = sizeof(*header) + KVM_STATS_NAME_SIZE +
+				  stats_file->num_sources * desc_size;
+	stats_file->size = stats_file->data_offset + data_size;
+
+	stats_file->image = kvzalloc(stats_file->size, GFP_KERNEL);
+	if (!stats_file->image)
+		return -ENOMEM;
+
+	header = (struct kvm_stats_header *)stats_file->image;
+	header->flags = 0;
+	header->name_size = KVM_STATS_NAME_SIZE;
+	header->num_desc = stats_file->num_sources;
+	header->id_offset = sizeof(*header);
+	header->desc_offset = header->id_offset + KVM_STATS_NAME_SIZE;
+	header->data_offset = stats_file->data_offset;
+
+	if (stats_file->vcpu)
+		snprintf(stats_file->image + header->id_offset,
+			 KVM_STATS_NAME_SIZE, "kvm-%d/vcpu-%d",
+			 task_pid_nr(current), stats_file->vcpu->vcpu_id);
+	else
+		snprintf(stats_file->image + header->id_offset,
+			 KVM_STATS_NAME_SIZE, "kvm-%d", task_pid_nr(current));
+
+	data_size = 0;
+	for (i = 0; i < stats_file->num_sources; i++) {
+		struct kvm_stat_source *source = &stats_file->sources[i];
+
+		desc = (void *)stats_file->image + header->desc_offset +
+		       i * desc_size;
+		desc->flags = source->flags;
+		desc->exponent = source->exponent;
+		desc->size = source->size;
+		desc->offset = data_size;
+		desc->bucket_size = 0;
+		strlcpy(desc->name, source->name, KVM_STATS_NAME_SIZE);
+
+		data_size += source->size * sizeof(u64);
+	}
+
+	return 0;
+}
+
+static void kvm_stats_refresh_data(struct kvm_stats_file *stats_file)
+{
+	void *base = stats_file->vcpu ? (void *)stats_file->vcpu :
+					(void *)stats_file->kvm;
+	u64 *data = (u64 *)(stats_file->image + stats_file->data_offset);
+	u32 i, j;
+
+	for (i = 0; i < stats_file->num_sources; i++) {
+		struct kvm_stat_source *source = &stats_file->sources[i];
+		void *src = base + source->offset;
+
+		for (j = 0; j < source->size; j++) {
+			if (source->is_ulong)
+				*data++ = READ_ONCE(((ulong *)src)[j]);
+			else
+				*data++ = READ_ONCE(((u64 *)src)[j]);
+		}
+	}
+}
+
+static ssize_t kvm_stats_read(struct file *file, char __user *user_buffer,
+			      size_t size, loff_t *offset)
+{
+	struct kvm_stats_file *stats_file = file->private_data;
+	ssize_t ret;
+
+	mutex_lock(&stats_file->lock);
+	if (*offset + size > stats_file->data_offset)
+		kvm_stats_refresh_data(stats_file);
+	ret = simple_read_from_buffer(user_buffer, size, offset,
+				      stats_file->image, stats_file->size);
+	mutex_unlock(&stats_file->lock);
+
+	return ret;
+}
+
+static void kvm_stats_free(struct kvm_stats_file *stats_file)
+{
+	kvfree(stats_file->image);
+	kfree(stats_file->sources);
+	kfree(stats_file);
+}
+
+static int kvm_stats_release(struct inode *inode, struct file *file)
+{
+	struct kvm_stats_file *stats_file = file->private_data;
+
+	kvm_put_kvm(stats_file->kvm);
+	kvm_stats_free(stats_file);
+	return 0;
+}
+
+static const struct file_operations kvm_stats_fops = {
+	.read = kvm_stats_read,
+	.release = kvm_stats_release,
+	.llseek = noop_llseek,
+};
+
+static int kvm_stats_fd(struct kvm *kvm, struct kvm_vcpu *vcpu)
+{
+	struct kvm_stats_file *stats_file;
+	struct file *file;
+	int fd, r;
+
+	stats_file = kzalloc(sizeof(*stats_file), GFP_KERNEL);
+	if (!stats_file)
+		return -ENOMEM;
+
+	stats_file->kvm = kvm;
+	stats_file->vcpu = vcpu;
+	mutex_init(&stats_file->lock);
+
+	r = kvm_stats_build_sources(stats_file);
+	if (r)
+		goto out_free;
+	r = kvm_stats_build_image(stats_file);
+	if (r)
+		goto out_free;
+
+	fd = get_unused_fd_flags(O_CLOEXEC);
+	if (fd < 0) {
+		r = fd;
+		goto out_free;
+	}
+
+	file = anon_inode_getfile(vcpu ? "kvm-vcpu-stats" : "kvm-vm-stats",
+				  &kvm_stats_fops, stats_file, O_RDONLY);
+	if (IS_ERR(file)) {
+		put_unused_fd(fd);
+		r = PTR_ERR(file);
+		goto out_free;
+	}
+	file->f_mode |= FMODE_PREAD;
+
+	kvm_get_kvm(kvm);
+	fd_install(fd, file);
+	return fd;
+
+out_free:
+	kvm_stats_free(stats_file);
+	return r;
+}
+
+int kvm_vm_ioctl_get_stats_fd(struct kvm *kvm)
+{
+	return kvm_stats_fd(kvm, NULL);
+}
+
+int kvm_vcpu_ioctl_get_stats_fd(struct kvm_vcpu *vcpu)
+{
+	return kvm_stats_fd(vcpu->kvm, vcpu);
+}